@@ -454,7 +454,7 @@ FSGetClientBody(FSClient *client) {
    if (!client) {
       return NULL;
    }
-   return (FSClientBody *) ((((uint32_t) client) + 0x3F) & ~0x3F);
+   return (FSClientBody *) ((((uintptr_t) client) + 0x3F) & ~0x3F);
 }
 
 /**
@@ -465,7 +465,7 @@ FSGetCmdBlockBody(FSCmdBlock *cmdBlock) {
    if (!cmdBlock) {
       return NULL;
    }
-   return (FSCmdBlockBody *) ((((uint32_t) cmdBlock) + 0x3F) & ~0x3F);
+   return (FSCmdBlockBody *) ((((uintptr_t) cmdBlock) + 0x3F) & ~0x3F);
 }
 
 void
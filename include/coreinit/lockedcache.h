@@ -0,0 +1,135 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup coreinit_lockedcache Locked Cache
+ * \ingroup coreinit
+ *
+ * Half of each core's 32 KiB L1 data cache can be locked and used as a
+ * 16 KiB scratchpad that never misses, with a DMA engine that moves 32 byte
+ * blocks between it and main memory.
+ *
+ * The locked cache belongs to the core it was allocated on. LCEnableDMA pins
+ * the calling thread to its current core until LCDisableDMA.
+ *
+ * Addresses passed to the DMA functions must be 32 byte aligned.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Size of a locked cache DMA block.
+#define LC_DMA_BLOCK_SIZE      32
+
+//! Most blocks a single LCLoadDMABlocks / LCStoreDMABlocks call transfers.
+#define LC_DMA_MAX_BLOCKS      128
+
+//! Number of transfers the DMA queue holds.
+#define LC_DMA_QUEUE_LENGTH    15
+
+/**
+ * Whether the locked cache can be used by the current process.
+ */
+BOOL
+LCHardwareIsAvailable();
+
+/**
+ * Allocate locked cache memory on the current core.
+ *
+ * \param size
+ * Multiple of 512 bytes.
+ *
+ * \return
+ * A 512 byte aligned address in the locked cache, or NULL.
+ */
+void *
+LCAlloc(uint32_t size);
+
+void
+LCDealloc(void *addr);
+
+/**
+ * Size of the whole locked cache, 16 KiB.
+ */
+uint32_t
+LCGetMaxSize();
+
+/**
+ * Largest allocation LCAlloc can currently make.
+ */
+uint32_t
+LCGetAllocatableSize();
+
+/**
+ * Total number of bytes not allocated.
+ */
+uint32_t
+LCGetUnallocated();
+
+BOOL
+LCIsDMAEnabled();
+
+/**
+ * Enable locked cache DMA for the current core and pin the calling thread
+ * to it.
+ */
+BOOL
+LCEnableDMA();
+
+void
+LCDisableDMA();
+
+/**
+ * Number of DMA transfers queued and not yet finished.
+ */
+uint32_t
+LCGetDMAQueueLength();
+
+/**
+ * Queue a transfer from main memory into the locked cache.
+ *
+ * \param lcDst
+ * Destination in the locked cache.
+ *
+ * \param memSrc
+ * Source in main memory, it is read from memory and not from the cache.
+ *
+ * \param blocks
+ * Number of LC_DMA_BLOCK_SIZE blocks, 0 for LC_DMA_MAX_BLOCKS.
+ */
+void
+LCLoadDMABlocks(void *lcDst,
+                const void *memSrc,
+                uint32_t blocks);
+
+/**
+ * Queue a transfer from the locked cache to main memory.
+ *
+ * \param memDst
+ * Destination in main memory, it is written past the cache.
+ *
+ * \param lcSrc
+ * Source in the locked cache.
+ *
+ * \param blocks
+ * Number of LC_DMA_BLOCK_SIZE blocks, 0 for LC_DMA_MAX_BLOCKS.
+ */
+void
+LCStoreDMABlocks(void *memDst,
+                 const void *lcSrc,
+                 uint32_t blocks);
+
+/**
+ * Wait until at most queueLength transfers are left in the DMA queue, 0 to
+ * wait for all of them.
+ */
+void
+LCWaitDMAQueue(uint32_t queueLength);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -26,6 +26,21 @@ typedef uint64_t DMAETimeStamp;
 BOOL
 DMAEWaitDone(DMAETimeStamp timestamp);
 
+/**
+ * Gets the timestamp of the most recently completed DMAE operation.
+ *
+ * An operation has completed once this is greater than or equal to its
+ * timestamp.
+ */
+DMAETimeStamp
+DMAEGetRetiredTimeStamp();
+
+/**
+ * Gets the timestamp of the most recently submitted DMAE operation.
+ */
+DMAETimeStamp
+DMAEGetLastSubmittedTimeStamp();
+
 #ifdef __cplusplus
 }
 #endif
@@ -72,6 +72,26 @@ GX2GetSwapStatus(uint32_t *swapCount,
 BOOL
 GX2WaitTimeStamp(OSTime time);
 
+/**
+ * Have the GPU write its cycle counter to cycle once the preceding commands
+ * have reached the top of the pipeline.
+ */
+void
+GX2SampleTopGPUCycle(uint64_t *cycle);
+
+/**
+ * Have the GPU write its cycle counter to cycle once the preceding commands
+ * have finished.
+ */
+void
+GX2SampleBottomGPUCycle(uint64_t *cycle);
+
+OSTime
+GX2GPUTimeToCPUTime(uint64_t time);
+
+uint64_t
+GX2CPUTimeToGPUTime(OSTime time);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,205 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup lzma920_lzmadec LZMA Decoder
+ * \ingroup lzma920
+ *
+ * The LZMA decoder from version 9.20 of the LZMA SDK.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct CLzmaProps CLzmaProps;
+typedef struct CLzmaDec CLzmaDec;
+typedef struct ISzAlloc ISzAlloc;
+
+#define SZ_OK                    0
+#define SZ_ERROR_DATA            1
+#define SZ_ERROR_MEM             2
+#define SZ_ERROR_UNSUPPORTED     4
+#define SZ_ERROR_PARAM           5
+#define SZ_ERROR_INPUT_EOF       6
+
+//! Size of the properties that precede LZMA compressed data.
+#define LZMA_PROPS_SIZE          5
+
+#define LZMA_REQUIRED_INPUT_MAX  20
+
+typedef enum ELzmaFinishMode
+{
+   //! Stop at any point, the output may continue.
+   LZMA_FINISH_ANY               = 0,
+   //! The output must end at the destination limit.
+   LZMA_FINISH_END               = 1,
+} ELzmaFinishMode;
+
+typedef enum ELzmaStatus
+{
+   LZMA_STATUS_NOT_SPECIFIED                 = 0,
+   LZMA_STATUS_FINISHED_WITH_MARK            = 1,
+   LZMA_STATUS_NOT_FINISHED                  = 2,
+   LZMA_STATUS_NEEDS_MORE_INPUT              = 3,
+   LZMA_STATUS_MAYBE_FINISHED_WITHOUT_MARK   = 4,
+} ELzmaStatus;
+
+struct ISzAlloc
+{
+   void *(*Alloc)(void *p, size_t size);
+   void (*Free)(void *p, void *address);
+};
+WUT_CHECK_OFFSET(ISzAlloc, 0x00, Alloc);
+WUT_CHECK_OFFSET(ISzAlloc, 0x04, Free);
+WUT_CHECK_SIZE(ISzAlloc, 0x08);
+
+struct CLzmaProps
+{
+   uint32_t lc;
+   uint32_t lp;
+   uint32_t pb;
+   uint32_t dicSize;
+};
+WUT_CHECK_OFFSET(CLzmaProps, 0x00, lc);
+WUT_CHECK_OFFSET(CLzmaProps, 0x04, lp);
+WUT_CHECK_OFFSET(CLzmaProps, 0x08, pb);
+WUT_CHECK_OFFSET(CLzmaProps, 0x0C, dicSize);
+WUT_CHECK_SIZE(CLzmaProps, 0x10);
+
+struct CLzmaDec
+{
+   CLzmaProps prop;
+   uint16_t *probs;
+
+   //! Output buffer, which is also the dictionary.
+   uint8_t *dic;
+   const uint8_t *buf;
+   uint32_t range;
+   uint32_t code;
+
+   //! Number of bytes decoded into dic.
+   size_t dicPos;
+
+   //! Size of dic.
+   size_t dicBufSize;
+   uint32_t processedPos;
+   uint32_t checkDicSize;
+   uint32_t state;
+   uint32_t reps[4];
+   uint32_t remainLen;
+   int needFlush;
+   int needInitState;
+   uint32_t numProbs;
+   uint32_t tempBufSize;
+   uint8_t tempBuf[LZMA_REQUIRED_INPUT_MAX];
+};
+WUT_CHECK_OFFSET(CLzmaDec, 0x00, prop);
+WUT_CHECK_OFFSET(CLzmaDec, 0x10, probs);
+WUT_CHECK_OFFSET(CLzmaDec, 0x14, dic);
+WUT_CHECK_OFFSET(CLzmaDec, 0x18, buf);
+WUT_CHECK_OFFSET(CLzmaDec, 0x1C, range);
+WUT_CHECK_OFFSET(CLzmaDec, 0x20, code);
+WUT_CHECK_OFFSET(CLzmaDec, 0x24, dicPos);
+WUT_CHECK_OFFSET(CLzmaDec, 0x28, dicBufSize);
+WUT_CHECK_OFFSET(CLzmaDec, 0x2C, processedPos);
+WUT_CHECK_OFFSET(CLzmaDec, 0x30, checkDicSize);
+WUT_CHECK_OFFSET(CLzmaDec, 0x34, state);
+WUT_CHECK_OFFSET(CLzmaDec, 0x38, reps);
+WUT_CHECK_OFFSET(CLzmaDec, 0x48, remainLen);
+WUT_CHECK_OFFSET(CLzmaDec, 0x4C, needFlush);
+WUT_CHECK_OFFSET(CLzmaDec, 0x50, needInitState);
+WUT_CHECK_OFFSET(CLzmaDec, 0x54, numProbs);
+WUT_CHECK_OFFSET(CLzmaDec, 0x58, tempBufSize);
+WUT_CHECK_OFFSET(CLzmaDec, 0x5C, tempBuf);
+WUT_CHECK_SIZE(CLzmaDec, 0x70);
+
+/**
+ * Allocate the probability tables for props, without a dictionary.
+ *
+ * Used with LzmaDec_DecodeToDic when the output buffer itself is the
+ * dictionary. dic and probs must be NULL before the first call.
+ */
+int
+LzmaDec_AllocateProbs(CLzmaDec *p,
+                      const uint8_t *props,
+                      uint32_t propsSize,
+                      ISzAlloc *alloc);
+
+void
+LzmaDec_FreeProbs(CLzmaDec *p,
+                  ISzAlloc *alloc);
+
+/**
+ * Allocate the probability tables and a dictionary of the size in props.
+ */
+int
+LzmaDec_Allocate(CLzmaDec *p,
+                 const uint8_t *props,
+                 uint32_t propsSize,
+                 ISzAlloc *alloc);
+
+void
+LzmaDec_Free(CLzmaDec *p,
+             ISzAlloc *alloc);
+
+void
+LzmaDec_Init(CLzmaDec *p);
+
+/**
+ * Decode into p->dic until p->dicPos reaches dicLimit or the input runs out.
+ *
+ * \param srcLen
+ * Size of src, receives the number of bytes consumed.
+ */
+int
+LzmaDec_DecodeToDic(CLzmaDec *p,
+                    size_t dicLimit,
+                    const uint8_t *src,
+                    size_t *srcLen,
+                    ELzmaFinishMode finishMode,
+                    ELzmaStatus *status);
+
+/**
+ * Decode into dest through the dictionary allocated by LzmaDec_Allocate.
+ */
+int
+LzmaDec_DecodeToBuf(CLzmaDec *p,
+                    uint8_t *dest,
+                    size_t *destLen,
+                    const uint8_t *src,
+                    size_t *srcLen,
+                    ELzmaFinishMode finishMode,
+                    ELzmaStatus *status);
+
+/**
+ * Decode a whole buffer in one call.
+ */
+int
+LzmaDecode(uint8_t *dest,
+           size_t *destLen,
+           const uint8_t *src,
+           size_t *srcLen,
+           const uint8_t *propData,
+           uint32_t propSize,
+           ELzmaFinishMode finishMode,
+           ELzmaStatus *status,
+           ISzAlloc *alloc);
+
+/**
+ * Decode LZMA data compressed with LzmaCompress.
+ */
+int
+LzmaUncompress(uint8_t *dest,
+               size_t *destLen,
+               const uint8_t *src,
+               size_t *srcLen,
+               const uint8_t *props,
+               size_t propsSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -155,6 +155,8 @@ struct CreateArg
    {
    }
 
+   //! See \link GetWorkMemorySize \endlink. May be \c nullptr to use the
+   //! arena from \link WUTAppletMemoryInit \endlink.
    void *workMemory;
    RegionType region;
    LangType language;
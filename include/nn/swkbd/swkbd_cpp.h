@@ -1,6 +1,7 @@
 #pragma once
 #include <wut.h>
 #include <coreinit/filesystem.h>
+#include <coreinit/thread.h>
 #include <nn/result.h>
 #include <padscore/kpad.h>
 #include <vpad/input.h>
@@ -251,6 +252,7 @@ WUT_CHECK_SIZE(AppearArg, 0xE0);
 struct CreateArg
 {
    //! A pointer to a work memory buffer; see \link GetWorkMemorySize \endlink.
+   //! May be \c nullptr to use the arena from \link WUTAppletMemoryInit \endlink.
    void *workMemory = nullptr;
    //! The swkbd region to use.
    RegionType regionType = RegionType::Europe;
@@ -394,10 +396,40 @@ ConfirmUnfixAll();
  * \sa
  * - \link Destroy \endlink
  * - \link GetWorkMemorySize \endlink
+ * - \link Preload \endlink
  */
 bool
 Create(const CreateArg &args);
 
+/**
+ * Start loading swkbd.rpl into the work memory on a background thread, so a
+ * later \link Create \endlink doesn't stall on it. Call this early, e.g.
+ * while the application boots.
+ *
+ * \link Create \endlink waits for the preload to finish and must be given
+ * the same work memory and \c unk_0x08. Call \link Destroy \endlink to
+ * free a preloaded keyboard that was never created.
+ *
+ * \warning
+ * DynLoad's allocator is redirected to the work memory while the RPL is
+ * loading, so the application should not load other RPLs until
+ * \link Create \endlink returns.
+ *
+ * \param workMemory
+ * The work memory which will be passed to \link Create \endlink; see
+ * \link GetWorkMemorySize \endlink. May be \c nullptr to use the arena from
+ * \link WUTAppletMemoryInit \endlink.
+ *
+ * \param unk
+ * The \c unk_0x08 which will be passed to \link Create \endlink.
+ *
+ * \return
+ * \c true if loading was started, \c false otherwise.
+ */
+bool
+Preload(void *workMemory,
+        uint32_t unk = 0);
+
 /**
  * Clean up and shut down the swkbd library.
  *
@@ -640,6 +672,40 @@ SetUserControllerEventObj(IControllerEventObj *controllerEventObj);
 void
 SetUserSoundObj(ISoundObj *soundObj);
 
+/**
+ * Start two helper threads running \link CalcSubThreadFont \endlink and
+ * \link CalcSubThreadPredict \endlink, so the application doesn't have to
+ * call them itself. Calls to \link Calc \endlink then wake the helpers
+ * whenever \link IsNeedCalcSubThreadFont \endlink or
+ * \link IsNeedCalcSubThreadPredict \endlink say there is work.
+ *
+ * Pick a core other than the one rendering, so font rasterising and word
+ * prediction don't take up frame time.
+ *
+ * \param affinity
+ * The core(s) to run the helpers on.
+ *
+ * \param priority
+ * Priority of the helpers, by default just below the default thread
+ * priority of 16.
+ *
+ * \return
+ * \c true on success, \c false if already started or on error.
+ *
+ * \sa
+ * - \link StopSubThreads \endlink
+ */
+bool
+StartSubThreads(OSThreadAttributes affinity = OS_THREAD_ATTRIB_AFFINITY_CPU2,
+                int32_t priority = 17);
+
+/**
+ * Stop the helper threads started by \link StartSubThreads \endlink.
+ * \link Destroy \endlink does this automatically.
+ */
+void
+StopSubThreads();
+
 } // namespace swkbd
 } // namespace nn
 
@@ -41,6 +41,13 @@ struct nsysnet_timeval
     long tv_usec;
 };
 
+typedef enum SOMemOptRequest
+{
+    //! Give the socket library a buffer to allocate socket buffers from, the
+    //! call blocks for as long as the buffer is in use.
+    SOMEMOPT_REQUEST_INIT = 0x01,
+} SOMemOptRequest;
+
 void
 socket_lib_init();
 
@@ -151,6 +158,19 @@ RPLWRAP(inet_pton)(int af,
 int
 RPLWRAP(socketlasterr)();
 
+/**
+ * Socket memory options, exported by nn_nets2.
+ *
+ * \param buf
+ * Buffer for SOMEMOPT_REQUEST_INIT, must be 0x40 byte aligned and stay valid
+ * until the call returns.
+ */
+int
+somemopt(SOMemOptRequest request,
+         void *buf,
+         uint32_t bufSize,
+         int flags);
+
 #ifdef __cplusplus
 }
 #endif
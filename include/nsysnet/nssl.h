@@ -30,6 +30,8 @@ typedef int32_t NSSLError;
 typedef int32_t NSSLContextHandle;
 //! A handle to a NSSL connection created with NSSLCreateConnection().
 typedef int32_t NSSLConnectionHandle;
+//! A handle to a TLS session returned by NSSLGetSession().
+typedef int32_t NSSLSessionHandle;
 
 /**
  * List of errors returned by the NSSL library.
@@ -453,6 +455,43 @@ NSSLWrite(NSSLConnectionHandle connection,
           int32_t length,
           int32_t *outBytesWritten);
 
+/**
+ * Get the TLS session of a connection, so it can be resumed by another
+ * connection to the same server with NSSLSetSession().
+ *
+ * \warning
+ * The session function signatures have not been verified against nsysnet
+ * yet, only their names are known from its exports.
+ *
+ * \returns
+ * A #NSSLSessionHandle that must be freed with NSSLFreeSession(), or a
+ * negative value among NSSLErrors on error.
+ */
+NSSLSessionHandle
+NSSLGetSession(NSSLConnectionHandle connection);
+
+/**
+ * Resume a TLS session on a connection before its handshake.
+ *
+ * \warning
+ * Signature not verified, see NSSLGetSession().
+ *
+ * \returns
+ * 0 on success, or a negative value on error.
+ */
+NSSLError
+NSSLSetSession(NSSLConnectionHandle connection,
+               NSSLSessionHandle session);
+
+/**
+ * Free a session returned by NSSLGetSession().
+ *
+ * \warning
+ * Signature not verified, see NSSLGetSession().
+ */
+NSSLError
+NSSLFreeSession(NSSLSessionHandle session);
+
 #ifdef __cplusplus
 }
 #endif
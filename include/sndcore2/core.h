@@ -1,5 +1,6 @@
 #pragma once
 #include <wut.h>
+#include <coreinit/time.h>
 #include <sndcore2/device.h>
 #include "result.h"
 
@@ -38,9 +39,33 @@ enum AX_INIT_PIPELINE
   AX_INIT_PIPELINE_FOUR_STAGE = 1,
 };
 
+/**
+ * Timings of one AX frame, recorded once profiling is started with
+ * AXInitProfile. Times are from OSGetTime.
+ *
+ * \warning
+ * The layout follows the AXPROFILE of earlier AX versions and is unverified,
+ * give the buffers passed to AX room for larger entries.
+ */
 struct AXProfile
 {
-  // Unknown
+   //! Start of the AX frame.
+   OSTime axFrameStart;
+
+   //! Start and end of the aux callbacks.
+   OSTime auxProcessingStart;
+   OSTime auxProcessingEnd;
+
+   //! Start and end of the frame callbacks of the application.
+   OSTime userCallbackStart;
+   OSTime userCallbackEnd;
+
+   //! End of the AX frame.
+   OSTime axFrameEnd;
+
+   //! Voices that were rendered in the frame.
+   uint32_t axNumVoices;
+   WUT_UNKNOWN_BYTES(4);
 };
 
 struct AXInitParams
@@ -83,10 +108,20 @@ AXInitWithParams(AXInitParams *params);
 BOOL
 AXIsInit();
 
+/**
+ * Start recording an AXProfile for every AX frame into a ring of count
+ * entries.
+ */
 void
 AXInitProfile(AXProfile *profile,
               uint32_t count);
 
+/**
+ * Copy the profiles recorded since the last call into profile.
+ *
+ * \return
+ * The number of profiles copied, at most count.
+ */
 uint32_t
 AXGetSwapProfile(AXProfile *profile,
                  uint32_t count);
@@ -1,5 +1,9 @@
 #pragma once
 
+// Can be defined bigger before including, select takes sets of any size
+// that hold nfds bits
+#ifndef FD_SETSIZE
 #define FD_SETSIZE 32
+#endif
 
 #include_next <sys/select.h>
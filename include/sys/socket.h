@@ -1,6 +1,7 @@
 #pragma once
 #include <stdint.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #define SOL_SOCKET      -1
 
@@ -17,6 +18,7 @@
 #define MSG_PEEK        0x0002
 #define MSG_DONTROUTE   0x0004
 #define MSG_DONTWAIT    0x0020
+#define MSG_WAITFORONE  0x10000     // recvmmsg, always the case
 
 #define SHUT_RD         0
 #define SHUT_WR         1
@@ -65,6 +67,25 @@ struct linger
    int l_linger;
 };
 
+struct msghdr
+{
+   void         *msg_name;
+   socklen_t     msg_namelen;
+   struct iovec *msg_iov;
+   int           msg_iovlen;
+   void         *msg_control;      // not supported
+   socklen_t     msg_controllen;
+   int           msg_flags;
+};
+
+struct mmsghdr
+{
+   struct msghdr msg_hdr;
+   unsigned int  msg_len;
+};
+
+struct timespec;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -119,12 +140,37 @@ recvfrom(int sockfd,
          struct sockaddr *src_addr,
          socklen_t *addrlen);
 
+ssize_t
+recvmsg(int sockfd,
+        struct msghdr *msg,
+        int flags);
+
+// Only the first datagram is waited for, for at most timeout if not NULL,
+// the rest are whatever is already queued
+int
+recvmmsg(int sockfd,
+         struct mmsghdr *msgvec,
+         unsigned int vlen,
+         int flags,
+         struct timespec *timeout);
+
 ssize_t
 send(int sockfd,
      const void *buf,
      size_t len,
      int flags);
 
+ssize_t
+sendmsg(int sockfd,
+        const struct msghdr *msg,
+        int flags);
+
+int
+sendmmsg(int sockfd,
+         struct mmsghdr *msgvec,
+         unsigned int vlen,
+         int flags);
+
 ssize_t
 sendto(int sockfd,
        const void *buf,
@@ -0,0 +1,8 @@
+#pragma once
+#include <stddef.h>
+
+struct iovec
+{
+   void  *iov_base;
+   size_t iov_len;
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_applet_memory Applet work memory
+ *
+ * One arena shared by the work memory of the nn::swkbd and nn::erreula
+ * wrappers, so a title using both keeps a single large buffer resident
+ * instead of one for each.
+ *
+ * \code
+ * WUTAppletMemoryInit(0);
+ *
+ * nn::swkbd::CreateArg createArg;
+ * createArg.workMemory = nullptr; // taken from the arena
+ * createArg.fsClient = fsClient;
+ * nn::swkbd::Create(createArg);
+ * ...
+ * nn::swkbd::Destroy();           // gives the memory back
+ * \endcode
+ *
+ * The wrappers take their work memory from the arena when
+ * CreateArg::workMemory is NULL, and return it in Destroy. The RPL is
+ * loaded into the same block, so it is released along with the rest.
+ *
+ * The default size fits the largest single applet, so only one of them can
+ * be created at a time; pass the sum of their work memory sizes to keep
+ * both up together.
+ * @{
+ */
+
+//! Largest work memory of any wrapped applet, currently nn::erreula.
+#define WUT_APPLET_MEMORY_DEFAULT_SIZE 0x1F00000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Allocate the arena from the default heap.
+ *
+ * \param size
+ * Work memory the arena hands out in bytes, 0 for
+ * WUT_APPLET_MEMORY_DEFAULT_SIZE. A little more is reserved for the
+ * arena's own bookkeeping.
+ */
+BOOL
+WUTAppletMemoryInit(uint32_t size);
+
+/**
+ * Free the arena. Every applet using it must have been destroyed.
+ */
+void
+WUTAppletMemoryShutdown(void);
+
+/**
+ * \return
+ * TRUE between WUTAppletMemoryInit and WUTAppletMemoryShutdown.
+ */
+BOOL
+WUTAppletMemoryIsInit(void);
+
+/**
+ * Take a block of work memory from the arena.
+ *
+ * \return
+ * NULL if the arena is not initialised or doesn't have size bytes left.
+ */
+void *
+WUTAppletMemoryAcquire(uint32_t size);
+
+/**
+ * Return a block from WUTAppletMemoryAcquire to the arena.
+ */
+void
+WUTAppletMemoryRelease(void *ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
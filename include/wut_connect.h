@@ -0,0 +1,81 @@
+#pragma once
+#include <wut.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+/**
+ * \defgroup wut_connect Connect with timeout
+ *
+ * Socket connects that give up after a timeout, and racing connects to
+ * every address of a host.
+ *
+ * A blocking connect to an unreachable address only returns once the
+ * network stack gives up, which can take a long time. These switch the
+ * socket to non-blocking, connect and wait for it with select.
+ *
+ * wut_connect_race starts a connect to the first address and, if it has
+ * not finished after staggerMs, to the next one as well, like the happy
+ * eyeballs algorithm. The first one to connect is kept and the others are
+ * closed.
+ *
+ * \code
+ * struct addrinfo hints = { 0 }, *res;
+ * hints.ai_family = AF_INET;
+ * hints.ai_socktype = SOCK_STREAM;
+ * getaddrinfo("example.com", "443", &hints, &res);
+ * int fd = wut_connect_race(res, 250, 5000);
+ * freeaddrinfo(res);
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of connects wut_connect_race has in flight at once.
+#define WUT_CONNECT_MAX_RACE  8
+
+/**
+ * Connect a socket, giving up after ms milliseconds.
+ *
+ * The socket's blocking mode is restored before returning.
+ *
+ * \param ms
+ * Maximum time to wait in milliseconds, or -1 to wait forever.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error, ETIMEDOUT if the connect did not
+ * finish in time.
+ */
+int
+wut_connect_timeout(int fd,
+                    const struct sockaddr *addr,
+                    socklen_t len,
+                    int ms);
+
+/**
+ * Race connects to the addresses in an addrinfo list and return the first
+ * socket to connect.
+ *
+ * \param staggerMs
+ * Time to give an attempt before the next address is tried as well. An
+ * attempt that fails starts the next one straight away.
+ *
+ * \param ms
+ * Maximum time to wait in milliseconds, or -1 to wait forever.
+ *
+ * \return
+ * A connected blocking socket, or -1 with errno set to the error of the last
+ * attempt to fail, ETIMEDOUT if none connected in time.
+ */
+int
+wut_connect_race(const struct addrinfo *list,
+                 int staggerMs,
+                 int ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,128 @@
+#pragma once
+#include <wut.h>
+#include <wut_psmath.h>
+
+/**
+ * \defgroup wut_cull Visibility culling
+ *
+ * Tests batches of bounding spheres or boxes against a view frustum and
+ * writes the indices of the visible ones, e.g. to upload as the instance
+ * data of a single instanced draw:
+ *
+ * \code
+ * WUTFrustum frustum;
+ * WUTFrustumFromMtx44(viewProjection, &frustum);
+ * uint32_t numVisible = WUTCullSpheresParallel(&frustum, &spheres,
+ *                                              numObjects, visible);
+ * \endcode
+ *
+ * Bounds are stored as structure of arrays, one array per component, so the
+ * paired-single kernels test two objects per instruction. The Parallel
+ * versions split the batch across the workers of the job system, or cull
+ * on the calling thread when it has not been started.
+ *
+ * Visible indices are written in ascending order. An object that touches a
+ * plane counts as visible.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Objects below which the Parallel versions stay on the calling thread.
+#define WUT_CULL_PARALLEL_THRESHOLD 512
+
+/**
+ * Six planes with the normal in x, y, z pointing inwards, a point p is
+ * inside a plane when dot(normal, p) + w >= 0.
+ */
+typedef struct WUTFrustum
+{
+   WUTVec4 planes[6];
+} WUTFrustum;
+
+typedef struct WUTCullSphereSoA
+{
+   const float *x;
+   const float *y;
+   const float *z;
+   const float *radius;
+} WUTCullSphereSoA;
+
+//! Axis aligned boxes as their centre and half their size.
+typedef struct WUTCullBoxSoA
+{
+   const float *centerX;
+   const float *centerY;
+   const float *centerZ;
+   const float *extentX;
+   const float *extentY;
+   const float *extentZ;
+} WUTCullBoxSoA;
+
+WUT_CHECK_SIZE(WUTFrustum, 0x60);
+
+/**
+ * Extract the normalised planes of a projection or view projection matrix,
+ * which transforms column vectors to a clip space with -w <= z <= w as
+ * GX2 uses by default. Bounds are then tested in the space the matrix
+ * transforms from.
+ */
+void
+WUTFrustumFromMtx44(const WUTMtx44 m,
+                    WUTFrustum *frustum);
+
+/**
+ * Write the indices of the visible spheres to visible and return how many
+ * there are.
+ *
+ * \param visible
+ * Room for count indices.
+ */
+uint32_t
+WUTCullSpheres(const WUTFrustum *frustum,
+               const WUTCullSphereSoA *spheres,
+               uint32_t count,
+               uint32_t *visible);
+uint32_t
+WUTCullSpheresScalar(const WUTFrustum *frustum,
+                     const WUTCullSphereSoA *spheres,
+                     uint32_t count,
+                     uint32_t *visible);
+
+uint32_t
+WUTCullSpheresParallel(const WUTFrustum *frustum,
+                       const WUTCullSphereSoA *spheres,
+                       uint32_t count,
+                       uint32_t *visible);
+
+/**
+ * Write the indices of the visible boxes to visible and return how many
+ * there are.
+ *
+ * \param visible
+ * Room for count indices.
+ */
+uint32_t
+WUTCullBoxes(const WUTFrustum *frustum,
+             const WUTCullBoxSoA *boxes,
+             uint32_t count,
+             uint32_t *visible);
+uint32_t
+WUTCullBoxesScalar(const WUTFrustum *frustum,
+                   const WUTCullBoxSoA *boxes,
+                   uint32_t count,
+                   uint32_t *visible);
+
+uint32_t
+WUTCullBoxesParallel(const WUTFrustum *frustum,
+                     const WUTCullBoxSoA *boxes,
+                     uint32_t count,
+                     uint32_t *visible);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,448 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/filesystem.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/time.h>
+#include <sys/types.h>
+
+/**
+ * \defgroup wut_devoptab Devoptab
+ *
+ * Extensions to the "fs" devoptab that backs the standard C file functions.
+ *
+ * File positions and sizes are 32-bit in the FSA interface, so files on
+ * these devices are limited to 4 GiB - 1 bytes. Seeking past that fails
+ * with EOVERFLOW and writing past it with EFBIG.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTDevoptabAsyncRequest WUTDevoptabAsyncRequest;
+
+typedef void (*WUTDevoptabAsyncCallbackFn)(WUTDevoptabAsyncRequest *request,
+                                           void *userContext);
+
+/**
+ * An asynchronous read or write request.
+ *
+ * Requests are served one at a time, in the order they were queued, by a
+ * single I/O thread that does a blocking pread()/pwrite() for each. The
+ * request must stay valid until it has completed.
+ */
+struct WUTDevoptabAsyncRequest
+{
+   //! File descriptor returned by open() or fileno().
+   int fd;
+
+   //! Buffer to read into or write from.
+   void *buffer;
+
+   //! Number of bytes to transfer.
+   size_t size;
+
+   //! File position to transfer at, the file offset is not changed.
+   off_t offset;
+
+   //! Called from the I/O thread once the request has completed, can be NULL.
+   WUTDevoptabAsyncCallbackFn callback;
+
+   //! Passed to callback.
+   void *userContext;
+
+   //! Receives an OSMessage with message set to the request once it has
+   //! completed, can be NULL.
+   OSMessageQueue *queue;
+
+   //! Number of bytes transferred, or -1 on error.
+   volatile ssize_t result;
+
+   //! errno value of a failed request.
+   volatile int error;
+
+   //! TRUE once the request has completed.
+   volatile BOOL done;
+
+   //! Internal.
+   BOOL write;
+
+   //! Internal.
+   WUTDevoptabAsyncRequest *next;
+};
+
+/**
+ * Queue an asynchronous pread() of request->size bytes at request->offset.
+ *
+ * \return
+ * FALSE if the request could not be queued.
+ */
+BOOL
+WUTDevoptabReadAsync(WUTDevoptabAsyncRequest *request);
+
+/**
+ * Queue an asynchronous pwrite() of request->size bytes at request->offset.
+ *
+ * \return
+ * FALSE if the request could not be queued.
+ */
+BOOL
+WUTDevoptabWriteAsync(WUTDevoptabAsyncRequest *request);
+
+/**
+ * Check whether a request has completed without blocking.
+ */
+BOOL
+WUTDevoptabIsAsyncDone(WUTDevoptabAsyncRequest *request);
+
+/**
+ * Wait for one or all of the given requests to complete.
+ *
+ * \param timeout
+ * Maximum time to wait in ticks, or -1 to wait forever.
+ *
+ * \return
+ * The number of completed requests, which is 0 if the wait timed out.
+ */
+uint32_t
+WUTDevoptabWaitAsync(WUTDevoptabAsyncRequest **requests,
+                     uint32_t count,
+                     BOOL waitAll,
+                     OSTime timeout);
+
+//! Devoptab handlers tracked by WUTDevoptabStats.
+typedef enum WUTDevoptabOp
+{
+   WUT_DEVOPTAB_OP_OPEN,
+   WUT_DEVOPTAB_OP_CLOSE,
+   WUT_DEVOPTAB_OP_READ,
+   WUT_DEVOPTAB_OP_WRITE,
+   WUT_DEVOPTAB_OP_PREAD,
+   WUT_DEVOPTAB_OP_PWRITE,
+   WUT_DEVOPTAB_OP_SEEK,
+   WUT_DEVOPTAB_OP_FSTAT,
+   WUT_DEVOPTAB_OP_STAT,
+   WUT_DEVOPTAB_OP_UNLINK,
+   WUT_DEVOPTAB_OP_CHDIR,
+   WUT_DEVOPTAB_OP_RENAME,
+   WUT_DEVOPTAB_OP_MKDIR,
+   WUT_DEVOPTAB_OP_DIROPEN,
+   WUT_DEVOPTAB_OP_DIRRESET,
+   WUT_DEVOPTAB_OP_DIRNEXT,
+   WUT_DEVOPTAB_OP_DIRCLOSE,
+   WUT_DEVOPTAB_OP_STATVFS,
+   WUT_DEVOPTAB_OP_FTRUNCATE,
+   WUT_DEVOPTAB_OP_FSYNC,
+   WUT_DEVOPTAB_OP_CHMOD,
+   WUT_DEVOPTAB_OP_RMDIR,
+   WUT_DEVOPTAB_OP_COUNT,
+} WUTDevoptabOp;
+
+#define WUT_DEVOPTAB_LATENCY_BUCKETS 32
+
+/**
+ * I/O statistics of a device, collected while enabled with
+ * WUTDevoptabSetStatsEnabled.
+ */
+typedef struct WUTDevoptabStats
+{
+   //! Bytes read from FSA, including read-ahead.
+   uint64_t bytesRead;
+
+   //! Bytes written to FSA, including write-behind flushes.
+   uint64_t bytesWritten;
+
+   //! FSA reads that went through the cache line bounce buffer because the
+   //! destination was unaligned.
+   uint32_t bounceBufferReads;
+
+   //! FSA writes that went through the cache line bounce buffer because the
+   //! source was unaligned.
+   uint32_t bounceBufferWrites;
+
+   //! Number of calls per handler.
+   uint32_t opCount[WUT_DEVOPTAB_OP_COUNT];
+
+   //! Latency histogram per handler, bucket i counts calls that took
+   //! [2^(i-1), 2^i) microseconds, bucket 0 calls under 1 microsecond.
+   uint32_t latency[WUT_DEVOPTAB_OP_COUNT][WUT_DEVOPTAB_LATENCY_BUCKETS];
+} WUTDevoptabStats;
+
+/**
+ * Enable or disable collecting I/O statistics, disabled by default.
+ */
+void
+WUTDevoptabSetStatsEnabled(BOOL enabled);
+
+/**
+ * Get the I/O statistics of a device.
+ *
+ * \param name
+ * Device name without the ':', or NULL for "fs".
+ *
+ * \return
+ * FALSE if there is no such device.
+ */
+BOOL
+WUTDevoptabGetStats(const char *name,
+                    WUTDevoptabStats *outStats);
+
+/**
+ * Reset the I/O statistics of a device, or NULL for "fs".
+ */
+BOOL
+WUTDevoptabResetStats(const char *name);
+
+/**
+ * Custom allocator for WUTDevoptabLoadFile, e.g. to load into MEM1 or a
+ * GX2R buffer.
+ */
+typedef struct WUTDevoptabAllocator
+{
+   //! Allocate size bytes aligned to alignment.
+   void *(*alloc)(void *userContext, uint32_t size, uint32_t alignment);
+
+   //! Free memory returned by alloc, used if loading fails. Can be NULL.
+   void (*free)(void *userContext, void *ptr);
+
+   //! Passed to alloc and free.
+   void *userContext;
+} WUTDevoptabAllocator;
+
+/**
+ * Load a whole file into memory.
+ *
+ * On FSA devices the file is read straight into the destination with no
+ * bounce buffer. The allocation is padded to a whole number of cache lines.
+ *
+ * \param allocator
+ * Allocator for the file data, or NULL to use memalign. Memory from the
+ * default allocator must be released with free().
+ *
+ * \param alignment
+ * Alignment of the file data, at least 0x40 is used.
+ *
+ * \param outSize
+ * Receives the size of the file, can be NULL.
+ *
+ * \return
+ * The file data, or NULL with errno set on error.
+ */
+void *
+WUTDevoptabLoadFile(const char *path,
+                    const WUTDevoptabAllocator *allocator,
+                    uint32_t alignment,
+                    uint32_t *outSize);
+
+/**
+ * Recursively copy the directory src to dst.
+ *
+ * Directories are walked on the calling thread, the files are copied by a
+ * worker thread per core.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTDevoptabCopyTree(const char *src,
+                    const char *dst);
+
+/**
+ * Recursively remove the directory path and everything in it.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTDevoptabRemoveTree(const char *path);
+
+/**
+ * Get the total size of all files below the directory path.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTDevoptabGetTreeSize(const char *path,
+                       uint64_t *outSize);
+
+/**
+ * Mount an additional FSA device, accessible as "name:/path".
+ *
+ * Every device gets its own FSA clients, cwd and stat cache, so I/O on
+ * separate devices does not contend on shared state.
+ *
+ * \param name
+ * Device name without the ':', e.g. "usb".
+ *
+ * \param devicePath
+ * Device to mount, e.g. "/dev/usb01", or NULL if mountPath is already mounted.
+ *
+ * \param mountPath
+ * Path to mount the device at, e.g. "/vol/storage_usb01". Relative paths
+ * on the device are resolved against it.
+ */
+FSError
+WUTDevoptabMount(const char *name,
+                 const char *devicePath,
+                 const char *mountPath);
+
+/**
+ * Unmount a device mounted with WUTDevoptabMount.
+ *
+ * Files and directories opened on the device must be closed first.
+ */
+FSError
+WUTDevoptabUnmount(const char *name);
+
+/**
+ * Start writing a group of files to the save quota at path, e.g.
+ * "fs:/vol/save/80000001".
+ *
+ * Until the save is committed or aborted, fsync on files below path only
+ * hands buffered data to the FSA instead of flushing the journal for every
+ * file. WUTDevoptabCommitSave then flushes the whole quota once, so the
+ * files become durable together.
+ *
+ * \code
+ * WUTDevoptabBeginSave("fs:/vol/save/80000001");
+ * // write, fsync and close the save files
+ * if (WUTDevoptabCommitSave("fs:/vol/save/80000001") < 0) {
+ *    WUTDevoptabAbortSave("fs:/vol/save/80000001");
+ * }
+ * \endcode
+ *
+ * Only one save can be open per device.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error, EBUSY if a save is already open.
+ */
+int
+WUTDevoptabBeginSave(const char *path);
+
+/**
+ * Flush the quota of the save opened with WUTDevoptabBeginSave with a single
+ * FSAFlushQuota.
+ *
+ * Files still open must be fsync'ed first, data they hold in write-behind
+ * buffers is not part of the commit. On failure the save stays open.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTDevoptabCommitSave(const char *path);
+
+/**
+ * Close the save opened with WUTDevoptabBeginSave and roll its quota back to
+ * the last flush with FSARollbackQuota.
+ *
+ * Files in the save must be closed first.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTDevoptabAbortSave(const char *path);
+
+/**
+ * Replace the contents of the file at path, inside the save opened with
+ * WUTDevoptabBeginSave, with size bytes of data, writing only the 32 KiB
+ * blocks that changed.
+ *
+ * Checksums of every block are kept for files written this way, so saving
+ * again only compares checksums. The first write of a file after startup,
+ * or after it was opened for writing or removed through other functions,
+ * compares against the file's contents instead. The blocks become durable
+ * together with the rest of the save in WUTDevoptabCommitSave.
+ *
+ * \code
+ * WUTDevoptabBeginSave("fs:/vol/save/80000001");
+ * WUTDevoptabWriteSaveFile("fs:/vol/save/80000001/game.sav", save, saveSize);
+ * WUTDevoptabCommitSave("fs:/vol/save/80000001");
+ * \endcode
+ *
+ * On failure the file should be rolled back with WUTDevoptabAbortSave.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error, EINVAL if path is not inside
+ * the open save.
+ */
+int
+WUTDevoptabWriteSaveFile(const char *path,
+                         const void *data,
+                         uint32_t size);
+
+/**
+ * Make sure space for the range [offset, offset + len) is allocated,
+ * extending the file with FSAAppendFileEx if needed.
+ *
+ * Declared here as well since newlib does not provide it.
+ *
+ * \return
+ * 0 on success, otherwise an error number, errno is not set.
+ */
+int
+posix_fallocate(int fd,
+                off_t offset,
+                off_t len);
+
+#ifndef POSIX_FADV_NORMAL
+#define POSIX_FADV_NORMAL     0
+#define POSIX_FADV_RANDOM     1
+#define POSIX_FADV_SEQUENTIAL 2
+#define POSIX_FADV_WILLNEED   3
+#define POSIX_FADV_DONTNEED   4
+#define POSIX_FADV_NOREUSE    5
+#endif
+
+/**
+ * Tell the devoptab how a file is going to be read.
+ *
+ * - POSIX_FADV_WILLNEED reads [offset, offset + len) into a buffer of the
+ *   file on the async I/O thread, read() and pread() in that range are then
+ *   served from memory. len is clamped to __wut_fsa_prefetch_size, 1 MiB by
+ *   default, and 0 prefetches that much from offset. Only one prefetch per
+ *   file is in flight, a hint while one runs is ignored.
+ * - POSIX_FADV_SEQUENTIAL grows the read-ahead buffer of the file to
+ *   __wut_fsa_read_ahead_sequential_size, 512 KiB by default.
+ * - POSIX_FADV_RANDOM disables read-ahead for the file and
+ *   POSIX_FADV_NORMAL restores the default __wut_fsa_read_ahead_size.
+ * - POSIX_FADV_DONTNEED drops the read-ahead and prefetched data.
+ *
+ * Writes to the file drop prefetched data. Files on other devices, O_DIRECT
+ * and write-only files ignore the advice.
+ *
+ * Declared here as well since newlib does not provide it.
+ *
+ * \return
+ * 0 on success, otherwise an error number, errno is not set.
+ */
+int
+posix_fadvise(int fd,
+              off_t offset,
+              off_t len,
+              int advice);
+
+/**
+ * Send count bytes of a file starting at offset to a socket, or up to the
+ * end of the file if count is 0. The file offset is not changed.
+ *
+ * Reads are done on the async I/O thread into two cache aligned buffers, so
+ * the next chunk is read from the device while the current one is sent.
+ *
+ * \return
+ * The number of bytes sent, or -1 with errno set if nothing was sent.
+ */
+ssize_t
+wut_sendfile(int sockfd,
+             int filefd,
+             off_t offset,
+             size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
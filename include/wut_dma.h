@@ -0,0 +1,80 @@
+#pragma once
+#include <wut.h>
+#include <dmae/sync.h>
+
+/**
+ * \defgroup wut_dma Asynchronous DMA copies
+ *
+ * memcpy and memset on the DMA engine, so large copies run while the CPU
+ * does other work.
+ *
+ * The cache is handled here: the source is written back before the copy
+ * and the destination is flushed before and invalidated after it. Only the
+ * part of the destination made of whole 64-byte cache lines is transferred
+ * by DMA, the partial lines at either end are copied by the CPU so data
+ * sharing those lines is not lost. Larger transfers are split into several
+ * DMA requests.
+ *
+ * Copies where src and dst differ in their offset from a 4-byte boundary,
+ * and copies too small to contain a whole cache line, are done by the CPU
+ * and return a fence that is already signalled.
+ *
+ * The destination must not be accessed by the CPU until the fence has been
+ * waited on or polled as done.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTDmaFence
+{
+   //! Timestamp of the last DMA request, 0 if nothing was submitted.
+   DMAETimeStamp timestamp;
+
+   //! Cache lines to invalidate once the DMA has completed.
+   void *invalidateAddr;
+   uint32_t invalidateSize;
+} WUTDmaFence;
+WUT_CHECK_OFFSET(WUTDmaFence, 0x00, timestamp);
+WUT_CHECK_OFFSET(WUTDmaFence, 0x08, invalidateAddr);
+WUT_CHECK_OFFSET(WUTDmaFence, 0x0C, invalidateSize);
+WUT_CHECK_SIZE(WUTDmaFence, 0x10);
+
+/**
+ * Start copying size bytes from src to dst. The buffers must not overlap.
+ */
+WUTDmaFence
+wut_dma_copy_async(void *dst,
+                   const void *src,
+                   size_t size);
+
+/**
+ * Start filling size bytes at dst with the byte c.
+ */
+WUTDmaFence
+wut_dma_fill_async(void *dst,
+                   int c,
+                   size_t size);
+
+/**
+ * Check whether the copy has completed, without blocking.
+ */
+BOOL
+wut_dma_fence_is_done(WUTDmaFence *fence);
+
+/**
+ * Wait for the copy to complete.
+ *
+ * \return
+ * FALSE if DMAEWaitDone timed out, the destination can't be used then.
+ */
+BOOL
+wut_dma_fence_wait(WUTDmaFence *fence);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
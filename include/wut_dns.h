@@ -0,0 +1,86 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/messagequeue.h>
+#include <netinet/in.h>
+
+/**
+ * \defgroup wut_dns DNS
+ *
+ * Asynchronous host name lookups and the resolver cache.
+ *
+ * Successful lookups through getaddrinfo, gethostbyname and
+ * WUTDnsResolveAsync are cached. nsysnet does not report the TTL of a
+ * record, so entries expire after a fixed time instead.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WUT_DNS_MAX_ADDRESSES 8
+
+typedef struct WUTDnsRequest WUTDnsRequest;
+
+typedef void (*WUTDnsCallbackFn)(WUTDnsRequest *request,
+                                 void *userContext);
+
+/**
+ * An asynchronous IPv4 host name lookup.
+ *
+ * The request and name must stay valid until it has completed.
+ */
+struct WUTDnsRequest
+{
+   //! Host name to look up.
+   const char *name;
+
+   //! Called once the lookup has completed, can be NULL.
+   WUTDnsCallbackFn callback;
+
+   //! Passed to callback.
+   void *userContext;
+
+   //! Receives an OSMessage with message set to the request once it has
+   //! completed, can be NULL.
+   OSMessageQueue *queue;
+
+   //! 0 on success, otherwise one of the EAI_ errors.
+   volatile int error;
+
+   //! Number of addresses found.
+   volatile uint32_t addressCount;
+
+   //! The addresses found.
+   struct in_addr addresses[WUT_DNS_MAX_ADDRESSES];
+
+   //! TRUE once the lookup has completed.
+   volatile BOOL done;
+
+   //! Internal.
+   WUTDnsRequest *next;
+};
+
+/**
+ * Look up a host name on the resolver thread.
+ *
+ * If the name is cached the request completes before this returns, with
+ * the callback called on the calling thread.
+ *
+ * \return
+ * FALSE if the request could not be queued.
+ */
+BOOL
+WUTDnsResolveAsync(WUTDnsRequest *request);
+
+/**
+ * Clear the wut and nsysnet resolver caches.
+ */
+void
+WUTDnsClearCache();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
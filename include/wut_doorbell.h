@@ -0,0 +1,130 @@
+#pragma once
+#include <wut.h>
+#include <wut_lockfree.h>
+
+/**
+ * \defgroup wut_doorbell Doorbell
+ *
+ * Wakes one waiting thread on another core with less latency than an
+ * OSEvent or OSMessageQueue, for hand-offs such as a render thread passing
+ * a finished command list to a GPU submit thread:
+ *
+ * \code
+ * wut::doorbell bell;
+ * wut::spsc_queue<CommandList *, 4> lists;
+ *
+ * // Render thread
+ * lists.try_push(list);
+ * bell.ring();
+ *
+ * // Submit thread
+ * while (true) {
+ *    bell.wait();
+ *    CommandList *list;
+ *    while (lists.try_pop(list)) {
+ *       submit(list);
+ *    }
+ * }
+ * \endcode
+ *
+ * wait() first spins on the doorbell for a short while, which catches a
+ * ring from a thread running on another core without going through the
+ * scheduler. Only when nothing arrives in that time does it block on an
+ * OSEvent, which ring() then signals. The spin time defaults to
+ * wut::doorbell::DefaultSpinTimeUs, about what it costs to block and be woken
+ * through an event; samples/cmake/crosscore_benchmark measures both.
+ *
+ * Rings are not counted: several rings before a wait wake it once. Only
+ * one thread may wait on a doorbell.
+ *
+ * Only available when compiling as C++.
+ * @{
+ */
+
+#ifdef __cplusplus
+
+#include <coreinit/event.h>
+#include <coreinit/time.h>
+
+namespace wut
+{
+
+class doorbell
+{
+public:
+   //! Spin time used by wait() when none is given.
+   static constexpr uint32_t DefaultSpinTimeUs = 20;
+
+   doorbell()
+   {
+      OSInitEventEx(&mEvent, FALSE, OS_EVENT_MODE_AUTO, (char *)"wut doorbell");
+   }
+
+   doorbell(const doorbell &) = delete;
+   doorbell &operator=(const doorbell &) = delete;
+
+   //! Wake the waiter, or make its next wait() return immediately.
+   void ring()
+   {
+      // Whatever was written before ringing must be visible to the waiter
+      detail::memory_barrier();
+      if (OSSwapAtomic(&mState, Rung) == Waiting) {
+         OSSignalEvent(&mEvent);
+      }
+   }
+
+   //! Wait for a ring, spinning for up to spinTimeUs before blocking.
+   void wait(uint32_t spinTimeUs = DefaultSpinTimeUs)
+   {
+      if (spin(spinTimeUs)) {
+         return;
+      }
+
+      // A ring between the spin and here makes the swap fail
+      if (OSCompareAndSwapAtomic(&mState, Idle, Waiting)) {
+         OSWaitEvent(&mEvent);
+      }
+
+      detail::store(&mState, Idle);
+      detail::memory_barrier();
+   }
+
+   //! Consume a ring if there is one, without waiting.
+   bool try_wait()
+   {
+      return spin(0);
+   }
+
+private:
+   enum : uint32_t
+   {
+      Idle,
+      Rung,
+      Waiting,
+   };
+
+   bool spin(uint32_t spinTimeUs)
+   {
+      OSTick start = OSGetSystemTick();
+      OSTick limit = (OSTick)OSMicrosecondsToTicks(spinTimeUs);
+
+      do {
+         if (detail::load(&mState) == Rung &&
+             OSCompareAndSwapAtomic(&mState, Rung, Idle)) {
+            detail::memory_barrier();
+            return true;
+         }
+      } while ((OSTick)(OSGetSystemTick() - start) < limit);
+
+      return false;
+   }
+
+   alignas(cache_line_size) volatile uint32_t mState = Idle;
+   OSEvent mEvent;
+};
+
+} // namespace wut
+
+#endif
+
+/** @} */
@@ -0,0 +1,142 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_download Ranged HTTP downloader
+ *
+ * Downloads a file over several HTTP connections at once.
+ *
+ * The file is split into chunks that are fetched with HTTP range requests,
+ * each connection is kept alive and reused for its next chunk. The output
+ * file is preallocated to its full size and every chunk is written straight
+ * to its offset with pwrite, in writes as large as the receive buffer.
+ *
+ * With resume set, the chunks that have been written are recorded in a
+ * journal next to the file, path with ".journal" appended. A download that
+ * failed or was cancelled can be started again with the same path and only
+ * fetches the missing chunks, unless the size or ETag of the file on the
+ * server changed. The journal is deleted once the download completes.
+ *
+ * \code
+ * WUTDownloadOptions options = { 0 };
+ * options.resume = TRUE;
+ * WUTDownload *download = WUTDownloadStart("http://example.com/pack.bin",
+ *                                          "fs:/vol/external01/pack.bin",
+ *                                          &options);
+ * while (!WUTDownloadIsDone(download)) {
+ *    WUTDownloadProgress progress;
+ *    WUTDownloadGetProgress(download, &progress);
+ *    ...
+ * }
+ * int error = WUTDownloadWait(download);
+ * WUTDownloadDestroy(download);
+ * \endcode
+ *
+ * Only plain http:// URLs are supported. Servers that ignore range
+ * requests are downloaded over a single connection, without a journal.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Maximum number of connections of one download.
+#define WUT_DOWNLOAD_MAX_CONNECTIONS 8
+
+typedef struct WUTDownload WUTDownload;
+
+typedef struct WUTDownloadOptions
+{
+   //! Number of connections, 0 for 4.
+   uint32_t connections;
+
+   //! Size of each range request, 0 for 1 MiB.
+   uint32_t chunkSize;
+
+   //! Receive buffer and write size per connection, 0 for 64 KiB.
+   uint32_t bufferSize;
+
+   //! Connect and receive timeout in milliseconds, 0 for 10 seconds.
+   uint32_t timeoutMs;
+
+   //! Priority of the download threads, 0 for 16.
+   int32_t priority;
+
+   //! Keep a progress journal and resume from it.
+   BOOL resume;
+} WUTDownloadOptions;
+
+typedef struct WUTDownloadProgress
+{
+   //! Size of the file, 0 until it is known.
+   uint64_t totalSize;
+
+   //! Bytes written to the file, including those of a resumed download.
+   uint64_t downloaded;
+
+   //! Number of chunks written.
+   uint32_t chunksDone;
+
+   //! Number of chunks the file is split into.
+   uint32_t chunkCount;
+
+   //! Status code of the last HTTP response that was not a success.
+   int httpStatus;
+} WUTDownloadProgress;
+
+/**
+ * Start a download on background threads.
+ *
+ * \param options
+ * Download options, or NULL for the defaults.
+ *
+ * \return
+ * The download, or NULL with errno set if it could not be started.
+ */
+WUTDownload *
+WUTDownloadStart(const char *url,
+                 const char *path,
+                 const WUTDownloadOptions *options);
+
+/**
+ * Check whether a download has completed, failed or been cancelled.
+ */
+BOOL
+WUTDownloadIsDone(WUTDownload *download);
+
+/**
+ * Get the progress of a download.
+ */
+void
+WUTDownloadGetProgress(WUTDownload *download,
+                       WUTDownloadProgress *outProgress);
+
+/**
+ * Stop a download, the journal is kept so it can be resumed.
+ */
+void
+WUTDownloadCancel(WUTDownload *download);
+
+/**
+ * Wait for a download to finish.
+ *
+ * \return
+ * 0 on success, otherwise an errno value: ECANCELED if it was cancelled,
+ * EIO if the server answered with an error status, EPROTO for responses
+ * that could not be used.
+ */
+int
+WUTDownloadWait(WUTDownload *download);
+
+/**
+ * Wait for a download to finish and free it.
+ */
+void
+WUTDownloadDestroy(WUTDownload *download);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,117 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/messagequeue.h>
+#include <sys/types.h>
+
+/**
+ * \defgroup wut_event_loop Socket event loop
+ *
+ * Runs socket I/O on a background thread and posts completions to an
+ * OSMessageQueue.
+ *
+ * Each loop has one thread that waits for all of its sockets with a single
+ * select. Once a socket is ready the queued recv, send or accept is done on
+ * that thread without blocking, and an OSMessage with message set to the
+ * request and args[0] set to its type is sent to the loop's queue.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTEventLoop WUTEventLoop;
+typedef struct WUTEventLoopRequest WUTEventLoopRequest;
+
+typedef enum WUTEventLoopRequestType
+{
+   WUT_EVENT_LOOP_RECV,
+   WUT_EVENT_LOOP_SEND,
+   WUT_EVENT_LOOP_ACCEPT,
+} WUTEventLoopRequestType;
+
+/**
+ * A socket operation to do once the socket is ready.
+ *
+ * The request must stay valid until its completion has been received.
+ */
+struct WUTEventLoopRequest
+{
+   //! The socket.
+   int fd;
+
+   //! Buffer for WUT_EVENT_LOOP_RECV and WUT_EVENT_LOOP_SEND.
+   void *buffer;
+
+   //! Size of buffer.
+   size_t size;
+
+   //! Flags passed to recv or send, MSG_DONTWAIT is always added.
+   int flags;
+
+   //! Passed back untouched.
+   void *userContext;
+
+   //! Bytes transferred, the accepted socket, or -1 on error.
+   ssize_t result;
+
+   //! errno value of a failed request, ECANCELED if the loop was destroyed.
+   int error;
+
+   //! Internal.
+   WUTEventLoopRequestType type;
+
+   //! Internal.
+   WUTEventLoopRequest *next;
+};
+
+/**
+ * Create an event loop and start its thread.
+ *
+ * \param queue
+ * Queue the completions are sent to, usually drained by the main thread.
+ *
+ * \param priority
+ * Priority of the loop thread.
+ *
+ * \return
+ * NULL on error.
+ */
+WUTEventLoop *
+WUTEventLoopCreate(OSMessageQueue *queue,
+                   int32_t priority);
+
+/**
+ * Stop the loop thread and free the loop. Requests that have not completed
+ * yet are completed with ECANCELED.
+ */
+void
+WUTEventLoopDestroy(WUTEventLoop *loop);
+
+/**
+ * Queue a recv of up to request->size bytes once request->fd is readable.
+ */
+BOOL
+WUTEventLoopRecv(WUTEventLoop *loop,
+                 WUTEventLoopRequest *request);
+
+/**
+ * Queue a send of up to request->size bytes once request->fd is writable,
+ * result may be less than size.
+ */
+BOOL
+WUTEventLoopSend(WUTEventLoop *loop,
+                 WUTEventLoopRequest *request);
+
+/**
+ * Queue an accept once the listening socket request->fd has a connection.
+ */
+BOOL
+WUTEventLoopAccept(WUTEventLoop *loop,
+                   WUTEventLoopRequest *request);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
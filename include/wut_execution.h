@@ -0,0 +1,412 @@
+#pragma once
+#include <wut.h>
+#include <wut_job.h>
+
+/**
+ * \defgroup wut_execution Parallel algorithms
+ *
+ * Parallel versions of std::for_each, transform, reduce, transform_reduce,
+ * sort and stable_sort running on the workers of the job system.
+ *
+ * libstdc++ only runs the std::execution policies in parallel with TBB,
+ * which doesn't exist for the Wii U, so they run serially. These take
+ * wut::execution::par instead and otherwise have the signatures of the
+ * standard algorithms:
+ *
+ * \code
+ * WUTJobSystemInit(0, 16);
+ * wut::sort(wut::execution::par, entities.begin(), entities.end(), byDepth);
+ * float total = wut::transform_reduce(wut::execution::par,
+ *                                     entities.begin(), entities.end(),
+ *                                     0.0f, std::plus<>(), mass);
+ * \endcode
+ *
+ * Ranges are split into chunks which the workers, one pinned to each core,
+ * take from each other while the calling thread works on them too. Before
+ * WUTJobSystemInit everything runs on the calling thread.
+ *
+ * Like the standard parallel algorithms, the functions passed in are
+ * called concurrently and in no particular order, reduce needs an
+ * associative and commutative operation, and an exception thrown on a
+ * worker calls std::terminate. Iterators must be random access.
+ *
+ * Requires C++17.
+ * @{
+ */
+
+#if defined(__cplusplus) && __cplusplus >= 201703L
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace wut::execution
+{
+
+struct parallel_policy
+{
+   //! Elements per chunk, 0 picks a size from the length of the range.
+   std::size_t grain_size = 0;
+};
+
+inline constexpr parallel_policy par { };
+
+namespace detail
+{
+
+//! A few chunks per core, so workers that finish early can steal more
+constexpr std::size_t max_chunks = 24;
+
+//! Elements below which a chunk isn't worth a job
+constexpr std::size_t min_grain = 256;
+
+//! Chunks of sort and stable_sort, a power of two for the merge passes
+constexpr std::size_t sort_chunks = 8;
+
+template<typename It>
+using require_random_access = std::enable_if_t<std::is_base_of_v<
+   std::random_access_iterator_tag,
+   typename std::iterator_traits<It>::iterator_category>, int>;
+
+inline std::size_t
+num_chunks(const parallel_policy &policy,
+           std::size_t count)
+{
+   std::size_t chunks;
+
+   if (policy.grain_size) {
+      chunks = (count + policy.grain_size - 1) / policy.grain_size;
+   } else {
+      chunks = std::min(count / min_grain, max_chunks);
+   }
+
+   return std::clamp<std::size_t>(chunks, 1, std::max<std::size_t>(count, 1));
+}
+
+//! First element of chunk i when count elements are split into chunks
+inline std::size_t
+chunk_begin(std::size_t i,
+            std::size_t count,
+            std::size_t chunks)
+{
+   return static_cast<std::size_t>(static_cast<uint64_t>(i) * count / chunks);
+}
+
+template<typename Fn>
+struct chunk_context
+{
+   Fn *fn;
+   std::size_t count;
+   std::size_t chunks;
+};
+
+template<typename Fn>
+void
+run_chunks(uint32_t begin,
+           uint32_t end,
+           void *userData)
+{
+   auto ctx = static_cast<chunk_context<Fn> *>(userData);
+   for (uint32_t i = begin; i < end; ++i) {
+      (*ctx->fn)(i,
+                 chunk_begin(i, ctx->count, ctx->chunks),
+                 chunk_begin(i + 1, ctx->count, ctx->chunks));
+   }
+}
+
+//! Call fn(chunk, begin, end) for every chunk and wait for all of them
+template<typename Fn>
+void
+parallel_chunks(std::size_t count,
+                std::size_t chunks,
+                Fn &&fn)
+{
+   using FnType = std::remove_reference_t<Fn>;
+   chunk_context<FnType> ctx { &fn, count, chunks };
+   WUTJobParallelFor(static_cast<uint32_t>(chunks), 1, run_chunks<FnType>, &ctx);
+}
+
+template<typename RandomIt, typename Compare, typename Sort>
+void
+parallel_sort(const parallel_policy &policy,
+              RandomIt first,
+              RandomIt last,
+              Compare comp,
+              Sort sort)
+{
+   std::size_t count = static_cast<std::size_t>(last - first);
+   std::size_t chunks = sort_chunks;
+   std::size_t grain = policy.grain_size ? policy.grain_size : 4 * min_grain;
+
+   while (chunks > 1 && count / chunks < grain) {
+      chunks /= 2;
+   }
+
+   if (chunks == 1) {
+      sort(first, last, comp);
+      return;
+   }
+
+   parallel_chunks(count, chunks,
+      [&](std::size_t, std::size_t begin, std::size_t end) {
+         sort(first + begin, first + end, comp);
+      });
+
+   // Merge neighbouring runs, halving their number every pass
+   for (std::size_t width = 1; width < chunks; width *= 2) {
+      parallel_chunks(chunks / (2 * width), chunks / (2 * width),
+         [&](std::size_t pair, std::size_t, std::size_t) {
+            std::size_t run = pair * 2 * width;
+            std::inplace_merge(first + chunk_begin(run, count, chunks),
+                               first + chunk_begin(run + width, count, chunks),
+                               first + chunk_begin(run + 2 * width, count, chunks),
+                               comp);
+         });
+   }
+}
+
+} // namespace detail
+
+} // namespace wut::execution
+
+namespace wut
+{
+
+template<typename RandomIt, typename UnaryFunction,
+         execution::detail::require_random_access<RandomIt> = 0>
+void
+for_each(const execution::parallel_policy &policy,
+         RandomIt first,
+         RandomIt last,
+         UnaryFunction f)
+{
+   std::size_t count = static_cast<std::size_t>(last - first);
+   if (!count) {
+      return;
+   }
+
+   execution::detail::parallel_chunks(count, execution::detail::num_chunks(policy, count),
+      [&](std::size_t, std::size_t begin, std::size_t end) {
+         std::for_each(first + begin, first + end, f);
+      });
+}
+
+template<typename RandomIt, typename OutputIt, typename UnaryOperation,
+         execution::detail::require_random_access<RandomIt> = 0>
+OutputIt
+transform(const execution::parallel_policy &policy,
+          RandomIt first,
+          RandomIt last,
+          OutputIt d_first,
+          UnaryOperation op)
+{
+   std::size_t count = static_cast<std::size_t>(last - first);
+   if (!count) {
+      return d_first;
+   }
+
+   execution::detail::parallel_chunks(count, execution::detail::num_chunks(policy, count),
+      [&](std::size_t, std::size_t begin, std::size_t end) {
+         std::transform(first + begin, first + end, d_first + begin, op);
+      });
+   return d_first + count;
+}
+
+template<typename RandomIt1, typename RandomIt2, typename OutputIt,
+         typename BinaryOperation,
+         execution::detail::require_random_access<RandomIt1> = 0>
+OutputIt
+transform(const execution::parallel_policy &policy,
+          RandomIt1 first1,
+          RandomIt1 last1,
+          RandomIt2 first2,
+          OutputIt d_first,
+          BinaryOperation op)
+{
+   std::size_t count = static_cast<std::size_t>(last1 - first1);
+   if (!count) {
+      return d_first;
+   }
+
+   execution::detail::parallel_chunks(count, execution::detail::num_chunks(policy, count),
+      [&](std::size_t, std::size_t begin, std::size_t end) {
+         std::transform(first1 + begin, first1 + end, first2 + begin, d_first + begin, op);
+      });
+   return d_first + count;
+}
+
+template<typename RandomIt, typename T, typename BinaryReductionOp,
+         typename UnaryTransformOp,
+         execution::detail::require_random_access<RandomIt> = 0>
+T
+transform_reduce(const execution::parallel_policy &policy,
+                 RandomIt first,
+                 RandomIt last,
+                 T init,
+                 BinaryReductionOp reduce,
+                 UnaryTransformOp transform)
+{
+   std::size_t count = static_cast<std::size_t>(last - first);
+   if (!count) {
+      return init;
+   }
+
+   // Every chunk has at least one element and starts from it
+   std::size_t chunks = execution::detail::num_chunks(policy, count);
+   std::vector<std::optional<T>> partials(chunks);
+   execution::detail::parallel_chunks(count, chunks,
+      [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+         T acc = transform(first[begin]);
+         for (std::size_t i = begin + 1; i < end; ++i) {
+            acc = reduce(std::move(acc), transform(first[i]));
+         }
+         partials[chunk].emplace(std::move(acc));
+      });
+
+   for (auto &partial : partials) {
+      init = reduce(std::move(init), std::move(*partial));
+   }
+   return init;
+}
+
+template<typename RandomIt1, typename RandomIt2, typename T,
+         typename BinaryReductionOp, typename BinaryTransformOp,
+         execution::detail::require_random_access<RandomIt1> = 0>
+T
+transform_reduce(const execution::parallel_policy &policy,
+                 RandomIt1 first1,
+                 RandomIt1 last1,
+                 RandomIt2 first2,
+                 T init,
+                 BinaryReductionOp reduce,
+                 BinaryTransformOp transform)
+{
+   std::size_t count = static_cast<std::size_t>(last1 - first1);
+   if (!count) {
+      return init;
+   }
+
+   std::size_t chunks = execution::detail::num_chunks(policy, count);
+   std::vector<std::optional<T>> partials(chunks);
+   execution::detail::parallel_chunks(count, chunks,
+      [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+         T acc = transform(first1[begin], first2[begin]);
+         for (std::size_t i = begin + 1; i < end; ++i) {
+            acc = reduce(std::move(acc), transform(first1[i], first2[i]));
+         }
+         partials[chunk].emplace(std::move(acc));
+      });
+
+   for (auto &partial : partials) {
+      init = reduce(std::move(init), std::move(*partial));
+   }
+   return init;
+}
+
+//! Dot product like std::inner_product.
+template<typename RandomIt1, typename RandomIt2, typename T,
+         execution::detail::require_random_access<RandomIt1> = 0>
+T
+transform_reduce(const execution::parallel_policy &policy,
+                 RandomIt1 first1,
+                 RandomIt1 last1,
+                 RandomIt2 first2,
+                 T init)
+{
+   return wut::transform_reduce(policy, first1, last1, first2, std::move(init),
+                                std::plus<>(), std::multiplies<>());
+}
+
+template<typename RandomIt, typename T, typename BinaryOp,
+         execution::detail::require_random_access<RandomIt> = 0>
+T
+reduce(const execution::parallel_policy &policy,
+       RandomIt first,
+       RandomIt last,
+       T init,
+       BinaryOp op)
+{
+   return wut::transform_reduce(policy, first, last, std::move(init), op,
+      [](const auto &value) -> T { return value; });
+}
+
+template<typename RandomIt, typename T,
+         execution::detail::require_random_access<RandomIt> = 0>
+T
+reduce(const execution::parallel_policy &policy,
+       RandomIt first,
+       RandomIt last,
+       T init)
+{
+   return wut::reduce(policy, first, last, std::move(init), std::plus<>());
+}
+
+template<typename RandomIt,
+         execution::detail::require_random_access<RandomIt> = 0>
+typename std::iterator_traits<RandomIt>::value_type
+reduce(const execution::parallel_policy &policy,
+       RandomIt first,
+       RandomIt last)
+{
+   using T = typename std::iterator_traits<RandomIt>::value_type;
+   return wut::reduce(policy, first, last, T { }, std::plus<>());
+}
+
+/**
+ * Sort chunks in parallel with std::sort and combine them with
+ * std::inplace_merge, which allocates a temporary buffer.
+ */
+template<typename RandomIt, typename Compare,
+         execution::detail::require_random_access<RandomIt> = 0>
+void
+sort(const execution::parallel_policy &policy,
+     RandomIt first,
+     RandomIt last,
+     Compare comp)
+{
+   execution::detail::parallel_sort(policy, first, last, comp,
+      [](RandomIt begin, RandomIt end, Compare &c) { std::sort(begin, end, c); });
+}
+
+template<typename RandomIt,
+         execution::detail::require_random_access<RandomIt> = 0>
+void
+sort(const execution::parallel_policy &policy,
+     RandomIt first,
+     RandomIt last)
+{
+   wut::sort(policy, first, last, std::less<>());
+}
+
+template<typename RandomIt, typename Compare,
+         execution::detail::require_random_access<RandomIt> = 0>
+void
+stable_sort(const execution::parallel_policy &policy,
+            RandomIt first,
+            RandomIt last,
+            Compare comp)
+{
+   execution::detail::parallel_sort(policy, first, last, comp,
+      [](RandomIt begin, RandomIt end, Compare &c) { std::stable_sort(begin, end, c); });
+}
+
+template<typename RandomIt,
+         execution::detail::require_random_access<RandomIt> = 0>
+void
+stable_sort(const execution::parallel_policy &policy,
+            RandomIt first,
+            RandomIt last)
+{
+   wut::stable_sort(policy, first, last, std::less<>());
+}
+
+} // namespace wut
+
+#endif
+
+/** @} */
@@ -0,0 +1,125 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_fiber Fibers
+ *
+ * Cooperative user space threads with small stacks, for running thousands
+ * of lightweight tasks.
+ *
+ * One worker thread per selected core runs the fibers in its run queue,
+ * switching between them with OSSwitchCoroutine. A fiber runs until it
+ * yields, sleeps, waits or returns, and always stays on the core it was
+ * created for. Finished fibers are kept for reuse, so creating a fiber
+ * usually doesn't allocate.
+ *
+ * A blocking call in a fiber blocks every fiber of its worker. In
+ * particular OSMutex is owned by the worker thread, so fibers must not
+ * hold one across a yield, use WUTFiberMutex instead.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTFiber WUTFiber;
+
+typedef void (*WUTFiberFn)(void *userData);
+
+//! A mutex that suspends the waiting fiber instead of the worker thread.
+typedef struct WUTFiberMutex
+{
+   volatile uint32_t locked;
+} WUTFiberMutex;
+
+/**
+ * Start the fiber worker threads.
+ *
+ * \param coreMask
+ * Cores to run workers on, or 0 for all three.
+ *
+ * \param priority
+ * Priority of the worker threads.
+ *
+ * \param stackSize
+ * Stack size of each fiber, or 0 for 8 KiB.
+ */
+BOOL
+WUTFiberSystemInit(uint32_t coreMask,
+                   int32_t priority,
+                   uint32_t stackSize);
+
+/**
+ * Stop the workers once all fibers have finished, and free the pooled
+ * stacks.
+ */
+void
+WUTFiberSystemShutdown(void);
+
+/**
+ * Create a fiber and queue it to run.
+ *
+ * \param core
+ * Core to run the fiber on, or -1 to spread fibers over the workers.
+ *
+ * \return
+ * The fiber, which must be passed to WUTFiberJoin or WUTFiberDetach, or
+ * NULL on failure.
+ */
+WUTFiber *
+WUTFiberCreate(WUTFiberFn fn,
+               void *userData,
+               int core);
+
+/**
+ * Wait for a fiber to finish and release it.
+ *
+ * Can be called from a fiber, which will yield while waiting, or from any
+ * other thread.
+ */
+void
+WUTFiberJoin(WUTFiber *fiber);
+
+/**
+ * Release a fiber, it is freed once it finishes.
+ */
+void
+WUTFiberDetach(WUTFiber *fiber);
+
+/**
+ * Get the calling fiber, or NULL if not called from a fiber.
+ */
+WUTFiber *
+WUTFiberSelf(void);
+
+/**
+ * Let the other fibers of this worker run.
+ */
+void
+WUTFiberYield(void);
+
+/**
+ * Suspend the calling fiber for at least the given number of ticks.
+ */
+void
+WUTFiberSleep(OSTime ticks);
+
+void
+WUTFiberMutexInit(WUTFiberMutex *mutex);
+
+void
+WUTFiberMutexLock(WUTFiberMutex *mutex);
+
+BOOL
+WUTFiberMutexTryLock(WUTFiberMutex *mutex);
+
+void
+WUTFiberMutexUnlock(WUTFiberMutex *mutex);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,213 @@
+#pragma once
+#include <wut.h>
+#include <gx2/enum.h>
+#include <gx2/registers.h>
+
+/**
+ * \defgroup wut_gx2_registers Compile-time GX2 registers
+ *
+ * constexpr counterparts of the GX2Init*Reg functions, so fixed pipeline
+ * states can be built by the compiler and live in .rodata. They produce the
+ * same register structures, ready for the matching GX2Set*Reg function:
+ *
+ * \code
+ * static constexpr GX2BlendControlReg sAlphaBlend =
+ *    wut::gx2::blend_control(GX2_RENDER_TARGET_0,
+ *                            GX2_BLEND_MODE_SRC_ALPHA, GX2_BLEND_MODE_INV_SRC_ALPHA,
+ *                            GX2_BLEND_COMBINE_MODE_ADD,
+ *                            FALSE,
+ *                            GX2_BLEND_MODE_ONE, GX2_BLEND_MODE_ZERO,
+ *                            GX2_BLEND_COMBINE_MODE_ADD);
+ *
+ * GX2SetBlendControlReg(&sAlphaBlend);
+ * \endcode
+ *
+ * The GX2Init*Reg functions modify the fields they set and keep the rest of
+ * a register, these start from zero, which is what GX2 itself starts from.
+ *
+ * Only available when compiling as C++.
+ * @{
+ */
+
+#ifdef __cplusplus
+
+#include <cstdint>
+
+namespace wut
+{
+
+namespace gx2
+{
+
+namespace detail
+{
+
+constexpr uint32_t
+field(uint32_t value,
+      uint32_t shift,
+      uint32_t bits)
+{
+   return (value & ((1u << bits) - 1)) << shift;
+}
+
+} // namespace detail
+
+//! Same as GX2InitAAMaskReg.
+constexpr GX2AAMaskReg
+aa_mask(uint8_t upperLeft,
+        uint8_t upperRight,
+        uint8_t lowerLeft,
+        uint8_t lowerRight)
+{
+   return GX2AAMaskReg {
+      detail::field(upperLeft, 0, 8) |
+      detail::field(upperRight, 8, 8) |
+      detail::field(lowerLeft, 16, 8) |
+      detail::field(lowerRight, 24, 8)
+   };
+}
+
+//! Same as GX2InitAlphaTestReg.
+constexpr GX2AlphaTestReg
+alpha_test(BOOL alphaTest,
+           GX2CompareFunction func,
+           float ref)
+{
+   return GX2AlphaTestReg {
+      detail::field(func, 0, 3) |
+      detail::field(alphaTest ? 1 : 0, 3, 1),
+      __builtin_bit_cast(uint32_t, ref)
+   };
+}
+
+//! Same as GX2InitBlendControlReg.
+constexpr GX2BlendControlReg
+blend_control(GX2RenderTarget target,
+              GX2BlendMode colorSrcBlend,
+              GX2BlendMode colorDstBlend,
+              GX2BlendCombineMode colorCombine,
+              BOOL useAlphaBlend,
+              GX2BlendMode alphaSrcBlend,
+              GX2BlendMode alphaDstBlend,
+              GX2BlendCombineMode alphaCombine)
+{
+   return GX2BlendControlReg {
+      target,
+      detail::field(colorSrcBlend, 0, 5) |
+      detail::field(colorCombine, 5, 3) |
+      detail::field(colorDstBlend, 8, 5) |
+      detail::field(alphaSrcBlend, 16, 5) |
+      detail::field(alphaCombine, 21, 3) |
+      detail::field(alphaDstBlend, 24, 5) |
+      detail::field(useAlphaBlend ? 1 : 0, 29, 1)
+   };
+}
+
+//! Same as GX2InitBlendConstantColorReg.
+constexpr GX2BlendConstantColorReg
+blend_constant_color(float red,
+                     float green,
+                     float blue,
+                     float alpha)
+{
+   return GX2BlendConstantColorReg { red, green, blue, alpha };
+}
+
+//! Same as GX2InitColorControlReg.
+constexpr GX2ColorControlReg
+color_control(GX2LogicOp rop3,
+              uint8_t targetBlendEnable,
+              BOOL multiWriteEnable,
+              BOOL colorWriteEnable)
+{
+   // SPECIAL_OP is DISABLE (1) when colour writes are off, NORMAL otherwise
+   return GX2ColorControlReg {
+      detail::field(multiWriteEnable ? 1 : 0, 1, 1) |
+      detail::field(colorWriteEnable ? 0 : 1, 4, 3) |
+      detail::field(targetBlendEnable, 8, 8) |
+      detail::field(rop3, 16, 8)
+   };
+}
+
+//! Same as GX2InitDepthStencilControlReg.
+constexpr GX2DepthStencilControlReg
+depth_stencil_control(BOOL depthTest,
+                      BOOL depthWrite,
+                      GX2CompareFunction depthCompare,
+                      BOOL stencilTest,
+                      BOOL backfaceStencil,
+                      GX2CompareFunction frontStencilFunc,
+                      GX2StencilFunction frontStencilZPass,
+                      GX2StencilFunction frontStencilZFail,
+                      GX2StencilFunction frontStencilFail,
+                      GX2CompareFunction backStencilFunc,
+                      GX2StencilFunction backStencilZPass,
+                      GX2StencilFunction backStencilZFail,
+                      GX2StencilFunction backStencilFail)
+{
+   return GX2DepthStencilControlReg {
+      detail::field(stencilTest ? 1 : 0, 0, 1) |
+      detail::field(depthTest ? 1 : 0, 1, 1) |
+      detail::field(depthWrite ? 1 : 0, 2, 1) |
+      detail::field(depthCompare, 4, 3) |
+      detail::field(backfaceStencil ? 1 : 0, 7, 1) |
+      detail::field(frontStencilFunc, 8, 3) |
+      detail::field(frontStencilFail, 11, 3) |
+      detail::field(frontStencilZPass, 14, 3) |
+      detail::field(frontStencilZFail, 17, 3) |
+      detail::field(backStencilFunc, 20, 3) |
+      detail::field(backStencilFail, 23, 3) |
+      detail::field(backStencilZPass, 26, 3) |
+      detail::field(backStencilZFail, 29, 3)
+   };
+}
+
+//! Same as GX2InitStencilMaskReg.
+constexpr GX2StencilMaskReg
+stencil_mask(uint8_t frontMask,
+             uint8_t frontWriteMask,
+             uint8_t frontRef,
+             uint8_t backMask,
+             uint8_t backWriteMask,
+             uint8_t backRef)
+{
+   return GX2StencilMaskReg {
+      detail::field(frontRef, 0, 8) |
+      detail::field(frontMask, 8, 8) |
+      detail::field(frontWriteMask, 16, 8),
+      detail::field(backRef, 0, 8) |
+      detail::field(backMask, 8, 8) |
+      detail::field(backWriteMask, 16, 8)
+   };
+}
+
+//! Same as GX2InitTargetChannelMasksReg.
+constexpr GX2TargetChannelMaskReg
+target_channel_masks(GX2ChannelMask mask0,
+                     GX2ChannelMask mask1,
+                     GX2ChannelMask mask2,
+                     GX2ChannelMask mask3,
+                     GX2ChannelMask mask4,
+                     GX2ChannelMask mask5,
+                     GX2ChannelMask mask6,
+                     GX2ChannelMask mask7)
+{
+   return GX2TargetChannelMaskReg {
+      detail::field(mask0, 0, 4) |
+      detail::field(mask1, 4, 4) |
+      detail::field(mask2, 8, 4) |
+      detail::field(mask3, 12, 4) |
+      detail::field(mask4, 16, 4) |
+      detail::field(mask5, 20, 4) |
+      detail::field(mask6, 24, 4) |
+      detail::field(mask7, 28, 4)
+   };
+}
+
+} // namespace gx2
+
+} // namespace wut
+
+#endif // __cplusplus
+
+/** @} */
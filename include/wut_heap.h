@@ -0,0 +1,80 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/memheap.h>
+
+/**
+ * \defgroup wut_heap Heap layout
+ *
+ * How an rpx splits MEM2 between malloc and the default heap.
+ *
+ * At startup malloc reserves its memory from the MEM2 expanded heap, the
+ * rest stays available to MEMAllocFromDefaultHeapEx. By default malloc gets
+ * all of it. The split is configured by overriding these variables in the
+ * application:
+ *
+ * \code
+ * // Bytes of MEM2 to use for malloc, 0 to use __wut_sbrk_heap_percent.
+ * uint32_t __wut_sbrk_heap_size = 0;
+ *
+ * // Percentage of the free MEM2 to use for malloc, default 100.
+ * uint32_t __wut_sbrk_heap_percent = 40;
+ *
+ * // Bytes of MEM2 for a separate GPU resource heap, default 0 for none.
+ * uint32_t __wut_gpu_heap_size = 64 * 1024 * 1024;
+ * \endcode
+ *
+ * The GPU resource heap is reserved before malloc takes its share, followed
+ * by the heaps of the subsystems given a budget, see \ref wut_heap_budget.
+ * Custom __preinit_user implementations get the same split as long as they
+ * call __init_wut_sbrk_heap.
+ *
+ * Memory malloc no longer needs, e.g. after unloading a level, can be handed
+ * back to the MEM2 heap for GX2 and other users with WUTHeapTrim. malloc
+ * takes it back when it needs to grow again, as long as nothing else has
+ * been allocated in it by then.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Get the GPU resource heap, an expanded heap with its own lock.
+ *
+ * \return
+ * The heap, or NULL if __wut_gpu_heap_size is 0 or it could not be created.
+ */
+MEMHeapHandle
+WUTGetGpuHeap(void);
+
+/**
+ * Release the free memory at the top of malloc's heap, keeping pad bytes,
+ * and shrink malloc's MEM2 reservation to what is left.
+ *
+ * Only the top of the heap can be released, free memory below the highest
+ * allocation stays with malloc.
+ *
+ * \return
+ * The number of bytes given back to the MEM2 heap.
+ */
+uint32_t
+WUTHeapTrim(uint32_t pad);
+
+/**
+ * Shrink the GPU resource heap to end at its highest allocation with
+ * MEMAdjustExpHeap and give the rest back to the MEM2 heap.
+ *
+ * The GPU heap can't grow again afterwards.
+ *
+ * \return
+ * The number of bytes given back to the MEM2 heap.
+ */
+uint32_t
+WUTHeapShrinkGpuHeap(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
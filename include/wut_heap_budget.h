@@ -0,0 +1,120 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_heap_budget Heap budgets
+ *
+ * Memory allocated by wut itself is tagged with the subsystem it belongs
+ * to, so running out of MEM2 can be traced to the part of the runtime that
+ * grew: devoptab read-ahead, write-behind, prefetch and sendfile buffers,
+ * socket message and stream buffers, std::thread stacks, the deferred log
+ * records of libwhb and libwhb's MEM2 graphics resources.
+ *
+ * Each subsystem can get a budget by overriding its variable in the
+ * application:
+ *
+ * \code
+ * // Bytes of MEM2 for the subsystem's own heap, default 0 for none.
+ * uint32_t __wut_heap_budget_devoptab = 4 * 1024 * 1024;
+ * uint32_t __wut_heap_budget_socket = 0;
+ * uint32_t __wut_heap_budget_thread = 0;
+ * uint32_t __wut_heap_budget_log = 0;
+ * uint32_t __wut_heap_budget_gfx = 0;
+ * \endcode
+ *
+ * A subsystem with a budget allocates from an expanded heap of that size,
+ * reserved at startup after the GPU resource heap and before malloc takes
+ * its share, so it can neither take memory from the rest of the application
+ * nor be starved by it. A little of the budget goes to the heap's own
+ * bookkeeping. Without a budget a subsystem allocates where it always has,
+ * the devoptab, sockets and threads from malloc, the log and graphics from
+ * the default heap, and is only counted.
+ *
+ * Whenever an allocation fails the failure is counted, and on the first
+ * failure of a subsystem and then every time its failure count doubles the
+ * subsystems are printed with OSReport, largest first.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum WUTHeapSubsystem
+{
+   WUT_HEAP_SUBSYSTEM_DEVOPTAB,
+   WUT_HEAP_SUBSYSTEM_SOCKET,
+   WUT_HEAP_SUBSYSTEM_THREAD,
+   WUT_HEAP_SUBSYSTEM_LOG,
+   WUT_HEAP_SUBSYSTEM_GFX,
+   WUT_HEAP_SUBSYSTEM_COUNT,
+} WUTHeapSubsystem;
+
+typedef struct WUTHeapBudgetStats
+{
+   //! Name of the subsystem.
+   const char *name;
+
+   //! Size of the subsystem's heap, 0 if it has no budget.
+   uint32_t budget;
+
+   //! Bytes currently allocated, including allocator rounding.
+   uint32_t current;
+
+   //! Highest value of current since startup or WUTHeapBudgetResetPeaks.
+   uint32_t peak;
+
+   //! Number of successful allocations.
+   uint32_t allocations;
+
+   //! Number of failed allocations.
+   uint32_t failures;
+} WUTHeapBudgetStats;
+
+/**
+ * Allocate size bytes aligned to align for a subsystem.
+ *
+ * \return
+ * The block, or NULL if it does not fit in the subsystem's budget or its
+ * fallback allocator is out of memory.
+ */
+void *
+WUTHeapBudgetAlloc(WUTHeapSubsystem subsystem,
+                   uint32_t size,
+                   uint32_t align);
+
+/**
+ * Free a block from WUTHeapBudgetAlloc for the same subsystem, NULL is
+ * ignored.
+ */
+void
+WUTHeapBudgetFree(WUTHeapSubsystem subsystem,
+                  void *block);
+
+/**
+ * Get the counters of a subsystem.
+ *
+ * \return
+ * FALSE if subsystem is not a valid subsystem.
+ */
+BOOL
+WUTHeapBudgetGetStats(WUTHeapSubsystem subsystem,
+                      WUTHeapBudgetStats *outStats);
+
+/**
+ * Print every subsystem with OSReport, largest current usage first.
+ */
+void
+WUTHeapBudgetReport(void);
+
+/**
+ * Set the peak of every subsystem to its current usage.
+ */
+void
+WUTHeapBudgetResetPeaks(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,132 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+#include <nsyshid/hid.h>
+
+/**
+ * \defgroup wut_hid HID read pipeline
+ *
+ * Keeps several HIDRead requests in flight on a device so no input report
+ * is lost between frames, e.g. for GameCube adapters and USB controllers.
+ *
+ * Every buffer is requeued from its own completion callback right after the
+ * report has been copied into a lock-free queue, which the application
+ * drains from one thread:
+ *
+ * \code
+ * static int32_t
+ * attachCallback(HIDClient *client, HIDDevice *device, HIDAttachEvent attach)
+ * {
+ *    if (attach == HID_DEVICE_ATTACH) {
+ *       sReader = WUTHIDReaderCreate(device->handle, device->maxPacketSizeRx, 4, 64);
+ *       return sReader != NULL;
+ *    }
+ *    ...
+ * }
+ *
+ * // Once per frame
+ * WUTHIDReport report;
+ * while (WUTHIDReaderPop(sReader, &report)) {
+ *    handleReport(report.data, report.size);
+ * }
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Largest report a WUTHIDReport holds, the full-speed interrupt packet size.
+#define WUT_HID_MAX_REPORT_SIZE 64
+
+typedef struct WUTHIDReader WUTHIDReader;
+
+typedef struct WUTHIDReport
+{
+   //! OSGetSystemTime when the read completed.
+   OSTime time;
+
+   //! Number of bytes in data.
+   uint32_t size;
+
+   uint8_t data[WUT_HID_MAX_REPORT_SIZE];
+} WUTHIDReport;
+
+typedef struct WUTHIDReaderStats
+{
+   //! Reports put in the queue.
+   uint32_t reports;
+
+   //! Reports dropped because the queue was full.
+   uint32_t dropped;
+
+   //! Reads that completed with an error, their buffer is not requeued.
+   uint32_t errors;
+
+   //! Reads currently in flight.
+   uint32_t outstanding;
+
+   //! Shortest and longest time between two reports, in ticks.
+   OSTime minInterval;
+   OSTime maxInterval;
+
+   //! Time from the first report to the last one, divided by
+   //! reports + dropped - 1 gives the average report interval.
+   OSTime totalInterval;
+} WUTHIDReaderStats;
+
+/**
+ * Start reading reports from a device.
+ *
+ * \param reportSize
+ * Size of each read, usually HIDDevice::maxPacketSizeRx. Reports longer
+ * than WUT_HID_MAX_REPORT_SIZE are truncated in the queue.
+ *
+ * \param numBuffers
+ * Number of reads to keep in flight.
+ *
+ * \param queueSize
+ * Number of reports the queue holds, a power of two.
+ *
+ * \return
+ * NULL on error.
+ */
+WUTHIDReader *
+WUTHIDReaderCreate(uint32_t handle,
+                   uint32_t reportSize,
+                   uint32_t numBuffers,
+                   uint32_t queueSize);
+
+/**
+ * Stop requeuing reads, wait for the ones in flight to complete and free
+ * the reader.
+ *
+ * After the device has been detached every read completes with an error,
+ * so this can be called from the detach callback.
+ */
+void
+WUTHIDReaderDestroy(WUTHIDReader *reader);
+
+/**
+ * Take the oldest report from the queue.
+ *
+ * \return
+ * FALSE if the queue is empty.
+ */
+BOOL
+WUTHIDReaderPop(WUTHIDReader *reader,
+                WUTHIDReport *outReport);
+
+/**
+ * Get the statistics of a reader.
+ */
+void
+WUTHIDReaderGetStats(WUTHIDReader *reader,
+                     WUTHIDReaderStats *outStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,159 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <padscore/kpad.h>
+#include <vpad/input.h>
+
+/**
+ * \defgroup wut_input Input sampling
+ *
+ * Polls the Gamepad and Wii Remotes on a high priority thread at the
+ * controller rate, so no sample is lost between frames and the newest one
+ * can be picked up right before the frame is submitted.
+ *
+ * Every sample is stamped with the system time it was read at and put in a
+ * ring buffer per channel. The rings are lock-free with one producer, the
+ * sampling thread, and one consumer, so each channel must only be read from
+ * one thread. When a ring fills up the oldest samples are overwritten.
+ *
+ * \code
+ * VPADInit();
+ * KPADInit();
+ * WUTInputStart(NULL);
+ *
+ * while (WHBProcIsRunning()) {
+ *    // Simulate every sample up to the start of the frame
+ *    WUTInputVPADSample samples[16];
+ *    uint32_t count = WUTInputReadVPAD(VPAD_CHAN_0, samples, 16, frameStart);
+ *    ...
+ *    // Latest input for the camera, just before submitting
+ *    WUTInputGetLatestVPAD(VPAD_CHAN_0, &latest);
+ * }
+ *
+ * WUTInputStop();
+ * \endcode
+ *
+ * VPADRead and KPADRead must not be called on enabled channels while the
+ * sampling thread runs, as samples are only returned once.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of samples kept per channel.
+#define WUT_INPUT_RING_SIZE      32
+
+#define WUT_INPUT_VPAD_CHANNELS  2
+#define WUT_INPUT_KPAD_CHANNELS  4
+
+typedef struct WUTInputVPADSample
+{
+   //! OSGetSystemTime when the sample was read.
+   OSTime time;
+   VPADStatus status;
+} WUTInputVPADSample;
+
+typedef struct WUTInputKPADSample
+{
+   //! OSGetSystemTime when the sample was read.
+   OSTime time;
+   KPADStatus status;
+} WUTInputKPADSample;
+
+typedef struct WUTInputConfig
+{
+   //! Time between polls in ticks, 0 for 4 ms.
+   OSTime interval;
+
+   //! Priority of the sampling thread, 0 is the highest.
+   int32_t priority;
+
+   //! Cores the sampling thread may run on, 0 for any.
+   OSThreadAttributes affinity;
+
+   //! Bit i enables VPAD_CHAN_0 + i.
+   uint32_t vpadChannels;
+
+   //! Bit i enables WPAD_CHAN_0 + i.
+   uint32_t kpadChannels;
+} WUTInputConfig;
+
+/**
+ * Start the sampling thread.
+ *
+ * VPADInit and KPADInit must have been called for the enabled channels.
+ *
+ * \param config
+ * NULL polls VPAD_CHAN_0 and every Wii Remote every 4 ms at priority 1 on
+ * any core.
+ *
+ * \return
+ * FALSE if the thread could not be started or is already running.
+ */
+BOOL
+WUTInputStart(const WUTInputConfig *config);
+
+/**
+ * Stop the sampling thread. Samples still in the rings can be read after.
+ */
+void
+WUTInputStop(void);
+
+/**
+ * Take the samples of a Gamepad read up to deadline, oldest first.
+ *
+ * \param deadline
+ * Samples read after this time stay in the ring, -1 takes all of them.
+ *
+ * \return
+ * The number of samples written to outSamples.
+ */
+uint32_t
+WUTInputReadVPAD(VPADChan chan,
+                 WUTInputVPADSample *outSamples,
+                 uint32_t maxSamples,
+                 OSTime deadline);
+
+/**
+ * Take the samples of a Wii Remote read up to deadline, oldest first.
+ */
+uint32_t
+WUTInputReadKPAD(KPADChan chan,
+                 WUTInputKPADSample *outSamples,
+                 uint32_t maxSamples,
+                 OSTime deadline);
+
+/**
+ * Get the newest Gamepad sample and drop every sample before it.
+ *
+ * \return
+ * FALSE if no sample was read since the last call.
+ */
+BOOL
+WUTInputGetLatestVPAD(VPADChan chan,
+                      WUTInputVPADSample *outSample);
+
+/**
+ * Get the newest Wii Remote sample and drop every sample before it.
+ */
+BOOL
+WUTInputGetLatestKPAD(KPADChan chan,
+                      WUTInputKPADSample *outSample);
+
+/**
+ * Get the number of samples of a channel overwritten before they were read.
+ */
+uint32_t
+WUTInputGetLostVPAD(VPADChan chan);
+
+uint32_t
+WUTInputGetLostKPAD(KPADChan chan);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
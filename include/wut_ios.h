@@ -0,0 +1,197 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/event.h>
+#include <coreinit/ios.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_ios Async IOS requests
+ *
+ * Asynchronous IOS_Ioctl and IOS_Ioctlv requests for custom drivers, with a
+ * pool of IPC-safe buffers to hand to them.
+ *
+ * Buffers from a WUTIOSBufferPool are aligned to and padded out to whole
+ * 0x40 byte cache lines. Input buffers are flushed before a request is
+ * submitted and output buffers invalidated before it completes, so the
+ * data IOS wrote is what the CPU sees.
+ *
+ * A completed request either calls its callback, posts an OSMessage to its
+ * queue, or both. Many requests can be in flight at once, e.g.
+ *
+ * \code
+ * for (i = 0; i < 16; ++i) {
+ *    requests[i].queue = &queue;
+ *    WUTIOSIoctlAsync(&requests[i], handle, IOCTL_READ,
+ *                     NULL, 0, WUTIOSBufferAlloc(pool), bufferSize);
+ * }
+ *
+ * while (busy) {
+ *    OSReceiveMessage(&queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+ *    WUTIOSRequest *request = (WUTIOSRequest *)message.message;
+ *    // handle request->result and request->outBuf, then resubmit
+ * }
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTIOSBufferPool WUTIOSBufferPool;
+typedef struct WUTIOSRequest WUTIOSRequest;
+
+typedef void (*WUTIOSCallbackFn)(WUTIOSRequest *request,
+                                 void *userContext);
+
+/**
+ * An asynchronous IOS request.
+ *
+ * The request, and the buffers and vectors given with it, must stay valid
+ * until it has completed.
+ */
+struct WUTIOSRequest
+{
+   //! Called from the IPC callback thread once the request has completed,
+   //! can be NULL. Must not block.
+   WUTIOSCallbackFn callback;
+
+   //! Passed to callback.
+   void *userContext;
+
+   //! Receives an OSMessage with message set to the request and args[0] to
+   //! the result once it has completed, can be NULL. The message is dropped
+   //! if the queue is full, so it must hold every request in flight.
+   OSMessageQueue *queue;
+
+   //! Result of the request.
+   volatile IOSError result;
+
+   //! TRUE once the request has completed.
+   volatile BOOL done;
+
+   //! Output buffer of an ioctl.
+   void *outBuf;
+
+   //! Internal.
+   uint32_t outLen;
+
+   //! Internal.
+   IOSVec *vec;
+
+   //! Internal.
+   uint32_t vecIn;
+
+   //! Internal.
+   uint32_t vecOut;
+
+   //! Internal.
+   OSEvent event;
+};
+
+/**
+ * Create a pool of count buffers of bufferSize bytes each, rounded up to a
+ * whole number of cache lines.
+ *
+ * The buffers are carved out of a single IPCBufPool allocated from the
+ * default heap.
+ *
+ * \return
+ * NULL on error.
+ */
+WUTIOSBufferPool *
+WUTIOSBufferPoolCreate(uint32_t bufferSize,
+                       uint32_t count);
+
+/**
+ * Free a pool. Buffers still in use by requests must not be freed with it.
+ */
+void
+WUTIOSBufferPoolDestroy(WUTIOSBufferPool *pool);
+
+/**
+ * Get the size of each buffer in the pool.
+ */
+uint32_t
+WUTIOSBufferPoolGetBufferSize(WUTIOSBufferPool *pool);
+
+/**
+ * Take a buffer from the pool, safe to call from any thread.
+ *
+ * \return
+ * NULL if every buffer is in use.
+ */
+void *
+WUTIOSBufferAlloc(WUTIOSBufferPool *pool);
+
+/**
+ * Return a buffer to the pool, safe to call from a completion callback.
+ */
+void
+WUTIOSBufferFree(WUTIOSBufferPool *pool,
+                 void *buffer);
+
+/**
+ * Submit an asynchronous IOS_Ioctl.
+ *
+ * \param outBuf
+ * Must be aligned to and a whole number of 0x40 byte cache lines, as the
+ * range is invalidated on completion. Buffers from a WUTIOSBufferPool are.
+ *
+ * \return
+ * IOS_ERROR_OK if the request was submitted, otherwise the request does
+ * not complete.
+ */
+IOSError
+WUTIOSIoctlAsync(WUTIOSRequest *request,
+                 IOSHandle handle,
+                 uint32_t ioctl,
+                 void *inBuf,
+                 uint32_t inLen,
+                 void *outBuf,
+                 uint32_t outLen);
+
+/**
+ * Submit an asynchronous IOS_Ioctlv with vecIn input vectors followed by
+ * vecOut output vectors.
+ *
+ * The output vectors have the same alignment requirement as the outBuf of
+ * WUTIOSIoctlAsync.
+ *
+ * \return
+ * IOS_ERROR_OK if the request was submitted, otherwise the request does
+ * not complete.
+ */
+IOSError
+WUTIOSIoctlvAsync(WUTIOSRequest *request,
+                  IOSHandle handle,
+                  uint32_t ioctlv,
+                  uint32_t vecIn,
+                  uint32_t vecOut,
+                  IOSVec *vec);
+
+/**
+ * Check whether a request has completed without blocking.
+ */
+BOOL
+WUTIOSIsDone(WUTIOSRequest *request);
+
+/**
+ * Wait for a request to complete.
+ *
+ * \param timeout
+ * Maximum time to wait in ticks, or -1 to wait forever.
+ *
+ * \return
+ * FALSE if the wait timed out.
+ */
+BOOL
+WUTIOSWait(WUTIOSRequest *request,
+           OSTime timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
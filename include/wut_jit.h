@@ -0,0 +1,207 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_jit JIT code space
+ *
+ * Allocation, writing and a small PowerPC emitter for the codegen area
+ * described in coreinit/codegen.h.
+ *
+ * The codegen area is either writable or executable, switching between
+ * the two is a kernel call. Writes are batched between WUTJitBeginWrite
+ * and WUTJitEndWrite so a whole block of generated code costs one switch
+ * each way, and WUTJitEndWrite flushes the data cache and invalidates the
+ * instruction cache over everything written in the batch.
+ *
+ * \code
+ * WUTJitInit();
+ *
+ * uint32_t code[64];
+ * WUTJitEmitter emitter;
+ * void *block = WUTJitAlloc(sizeof(code));
+ * WUTJitEmitterInit(&emitter, code, sizeof(code), block);
+ * WUTJitEmitLoadImm(&emitter, 3, 42);
+ * WUTJitEmitReturn(&emitter);
+ *
+ * WUTJitBeginWrite();
+ * WUTJitWrite(block, code, WUTJitEmitterGetSize(&emitter));
+ * WUTJitEndWrite();
+ *
+ * int result = ((int (*)(void))block)();
+ * \endcode
+ *
+ * Codegen only works on the core returned by OSGetCodegenCore, so a batch
+ * moves the writing thread to that core and restores its affinity when it
+ * ends. No thread may run code from the area while a write is in progress,
+ * and a batch keeps other threads from writing until it ends.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Alignment and granularity of code space allocations.
+#define WUT_JIT_ALIGN               32
+
+//! Number of free ranges the allocator can track.
+#define WUT_JIT_MAX_FREE_RANGES     256
+
+//! Size of a trampoline made by WUTJitCreateTrampoline.
+#define WUT_JIT_TRAMPOLINE_SIZE     16
+
+typedef struct WUTJitEmitter
+{
+   //! Where instructions are written.
+   uint32_t *buffer;
+
+   //! Address the first instruction will run from.
+   uint32_t address;
+
+   //! Number of instructions written.
+   uint32_t count;
+
+   //! Number of instructions that fit in buffer.
+   uint32_t capacity;
+
+   //! Set once an instruction did not fit.
+   BOOL overflow;
+} WUTJitEmitter;
+
+/**
+ * Find the codegen area and set up the allocator.
+ *
+ * \return
+ * FALSE if the application has no codegen area.
+ */
+BOOL
+WUTJitInit(void);
+
+/**
+ * Allocate size bytes of code space, aligned to WUT_JIT_ALIGN.
+ *
+ * \return
+ * The code space, or NULL if there is no free range big enough.
+ */
+void *
+WUTJitAlloc(uint32_t size);
+
+/**
+ * Free code space allocated with WUTJitAlloc, with the same size.
+ */
+void
+WUTJitFree(void *code,
+           uint32_t size);
+
+/**
+ * Get the number of free bytes of code space.
+ */
+uint32_t
+WUTJitGetFreeSize(void);
+
+/**
+ * Make the code space writable, if this is the outermost call.
+ *
+ * The outermost call pins the calling thread to the codegen core until the
+ * outermost WUTJitEndWrite. Calls nest, only the outermost WUTJitEndWrite
+ * makes the area executable again.
+ *
+ * \return
+ * FALSE if the thread can't run on the codegen core.
+ */
+BOOL
+WUTJitBeginWrite(void);
+
+/**
+ * Finish a batch of writes. The outermost call flushes and invalidates the
+ * caches over everything written since WUTJitBeginWrite and makes the area
+ * executable.
+ */
+void
+WUTJitEndWrite(void);
+
+/**
+ * Copy code into code space. Outside of a batch this is a batch of its own.
+ */
+BOOL
+WUTJitWrite(void *dst,
+            const void *src,
+            uint32_t size);
+
+/**
+ * Record code written to the code space directly, e.g. by an emitter
+ * pointed at it, between WUTJitBeginWrite and WUTJitEndWrite.
+ */
+void
+WUTJitMarkWritten(void *dst,
+                  uint32_t size);
+
+/**
+ * Allocate and write a trampoline that branches to target through CTR,
+ * clobbering r12. Free it with WUTJitFree and WUT_JIT_TRAMPOLINE_SIZE.
+ *
+ * \return
+ * The trampoline, or NULL on error.
+ */
+void *
+WUTJitCreateTrampoline(const void *target);
+
+/**
+ * Start emitting into buffer, for code that will run from address.
+ *
+ * buffer may be a staging buffer to copy with WUTJitWrite, or the code
+ * space itself during a batch of writes.
+ */
+void
+WUTJitEmitterInit(WUTJitEmitter *emitter,
+                  void *buffer,
+                  uint32_t size,
+                  const void *address);
+
+/**
+ * Get the number of bytes emitted.
+ */
+uint32_t
+WUTJitEmitterGetSize(WUTJitEmitter *emitter);
+
+/**
+ * Get the address the next instruction will run from.
+ */
+uint32_t
+WUTJitEmitterGetAddress(WUTJitEmitter *emitter);
+
+/**
+ * Emit one instruction.
+ */
+void
+WUTJitEmit(WUTJitEmitter *emitter,
+           uint32_t instruction);
+
+/**
+ * Load a 32 bit value into a register, with li or lis and ori.
+ */
+void
+WUTJitEmitLoadImm(WUTJitEmitter *emitter,
+                  uint32_t reg,
+                  uint32_t value);
+
+/**
+ * Branch to target, with b or bl if it is within 32 MiB and otherwise
+ * through CTR, clobbering r12.
+ */
+void
+WUTJitEmitBranch(WUTJitEmitter *emitter,
+                 const void *target,
+                 BOOL link);
+
+/**
+ * Emit blr.
+ */
+void
+WUTJitEmitReturn(WUTJitEmitter *emitter);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,147 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_job Job system
+ *
+ * Spreads work across the CPU cores with one worker thread per core.
+ *
+ * Every worker has its own queue of jobs. Jobs submitted by a worker go to
+ * its own queue, which it runs newest first, while idle workers steal the
+ * oldest jobs from the others. Jobs submitted by other threads go to a
+ * shared queue.
+ *
+ * Jobs are allocated by the caller, e.g. on the stack, and must stay valid
+ * until they are done. A job can have a parent, which is only done once
+ * the job and all its other children are done:
+ *
+ * \code
+ * WUTJob root, children[16];
+ * WUTJobInit(&root, NULL, NULL, NULL);
+ * for (int i = 0; i < 16; ++i) {
+ *    WUTJobInit(&children[i], work, &items[i], &root);
+ *    WUTJobSubmit(&children[i]);
+ * }
+ * WUTJobSubmit(&root);
+ * WUTJobWait(&root);
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTJob WUTJob;
+
+typedef void (*WUTJobFn)(WUTJob *job, void *userData);
+
+typedef void (*WUTJobParallelForFn)(uint32_t begin, uint32_t end, void *userData);
+
+struct WUTJob
+{
+   //! Function to run, can be NULL for a job that only groups its children.
+   WUTJobFn fn;
+
+   //! Passed to fn.
+   void *userData;
+
+   //! Internal.
+   WUTJob *parent;
+
+   //! Internal, the job itself plus its unfinished children.
+   volatile uint32_t unfinished;
+
+   //! Internal.
+   WUTJob *next;
+};
+
+/**
+ * Start one worker thread on each core in coreMask.
+ *
+ * \param coreMask
+ * Cores to run workers on, e.g. OS_THREAD_ATTRIB_AFFINITY_CPU0 |
+ * OS_THREAD_ATTRIB_AFFINITY_CPU2, or 0 for all three.
+ *
+ * \param priority
+ * Priority of the worker threads, from 0 (highest) to 31 (lowest).
+ */
+BOOL
+WUTJobSystemInit(uint32_t coreMask,
+                 int32_t priority);
+
+/**
+ * Stop the worker threads once they have run all submitted jobs.
+ */
+void
+WUTJobSystemShutdown(void);
+
+/**
+ * Stop the worker threads from starting new jobs, e.g. while the
+ * application is in the background.
+ *
+ * Jobs that are already running complete, and submitted jobs are queued
+ * until WUTJobSystemResume. WUTJobWait still runs jobs on the calling
+ * thread.
+ */
+void
+WUTJobSystemSuspend(void);
+
+/**
+ * Let the worker threads run jobs again after WUTJobSystemSuspend.
+ */
+void
+WUTJobSystemResume(void);
+
+BOOL
+WUTJobSystemIsSuspended(void);
+
+/**
+ * Initialise a job.
+ *
+ * \param parent
+ * Parent job, or NULL. Must not be done yet, i.e. either not submitted yet
+ * or still running.
+ */
+void
+WUTJobInit(WUTJob *job,
+           WUTJobFn fn,
+           void *userData,
+           WUTJob *parent);
+
+/**
+ * Queue a job to run on a worker thread.
+ */
+void
+WUTJobSubmit(WUTJob *job);
+
+/**
+ * Check whether a job and all its children are done.
+ */
+BOOL
+WUTJobIsDone(WUTJob *job);
+
+/**
+ * Wait until a job and all its children are done, running other jobs in
+ * the meantime.
+ */
+void
+WUTJobWait(WUTJob *job);
+
+/**
+ * Call fn on [0, count) split into ranges of at most grainSize, and wait
+ * until all of them are done.
+ *
+ * The calling thread works on the ranges too.
+ */
+void
+WUTJobParallelFor(uint32_t count,
+                  uint32_t grainSize,
+                  WUTJobParallelForFn fn,
+                  void *userData);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,82 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_lock_stats Lock statistics
+ *
+ * Optional contention counters for the locks used inside wut: newlib's
+ * locks, std::mutex and the other gthread mutexes, and the devoptab's file
+ * and cache locks.
+ *
+ * While enabled, every lock is tried first and only acquisitions that had
+ * to wait are counted, together with the time spent waiting. Locks are told
+ * apart by address and reported with the name they were initialised with,
+ * e.g. by OSInitMutexEx.
+ *
+ * \code
+ * WUTLockStatsSetEnabled(TRUE);
+ * // run the workload
+ * WUTLockStatsReport(10);
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of locks tracked, contention on further locks is not recorded.
+#define WUT_LOCK_STATS_MAX_LOCKS 256
+
+typedef struct WUTLockStats
+{
+   //! Address of the lock.
+   const void *lock;
+
+   //! Name of the lock when its first contended acquisition was recorded.
+   char name[32];
+
+   //! Number of acquisitions that had to wait.
+   uint32_t contended;
+
+   //! Total time spent waiting, in ticks.
+   OSTime waitTicks;
+
+   //! Longest single wait, in ticks.
+   OSTime maxWaitTicks;
+} WUTLockStats;
+
+/**
+ * Enable or disable collecting lock statistics, disabled by default.
+ */
+void
+WUTLockStatsSetEnabled(BOOL enabled);
+
+/**
+ * Get the most contended locks, ordered by total wait time.
+ *
+ * \return
+ * Number of entries written to outStats, at most maxStats.
+ */
+uint32_t
+WUTLockStatsGetTop(WUTLockStats *outStats,
+                   uint32_t maxStats);
+
+/**
+ * Print the count most contended locks with OSReport.
+ */
+void
+WUTLockStatsReport(uint32_t count);
+
+/**
+ * Clear the statistics of every lock.
+ */
+void
+WUTLockStatsReset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
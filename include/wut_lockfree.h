@@ -0,0 +1,339 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_lockfree Lock-free containers
+ *
+ * Bounded ring queues and an intrusive stack that never enter the kernel,
+ * for handing work between threads and cores where an OSMessageQueue would
+ * be too heavy:
+ *
+ * \code
+ * wut::spsc_queue<Sample, 256> samples;  // one producer, one consumer
+ * wut::mpsc_queue<Job *, 128> jobs;      // any producers, one consumer
+ *
+ * // Producer
+ * if (!jobs.try_push(job)) {
+ *    // Full
+ * }
+ *
+ * // Consumer
+ * Job *job;
+ * while (jobs.try_pop(job)) {
+ *    job->run();
+ * }
+ * \endcode
+ *
+ * Indices written by different sides are kept on their own cache lines so
+ * producers and consumers don't steal lines from each other on every
+ * operation. Loads and stores use the GCC \c __atomic builtins; ordering
+ * between them uses \c sync, the barrier OSMemoryBarrier issues, because
+ * Espresso has no lighter barrier. Read-modify-write operations go through
+ * coreinit's atomics, or \c lwarx / \c stwcx. with the \c dcbst Espresso
+ * expects before a store conditional, rather than GCC's own sequences.
+ *
+ * Only available when compiling as C++.
+ * @{
+ */
+
+#ifdef __cplusplus
+
+#include <coreinit/atomic.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace wut
+{
+
+//! Espresso's cache line size, the unit of false sharing.
+static constexpr std::size_t cache_line_size = 32;
+
+namespace detail
+{
+
+//! Full barrier, equivalent to OSMemoryBarrier without the call.
+inline void
+memory_barrier()
+{
+#ifdef __PPC__
+   __asm__ __volatile__ ("sync" ::: "memory");
+#else
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+inline uint32_t
+load(const volatile uint32_t *ptr)
+{
+   return __atomic_load_n(ptr, __ATOMIC_RELAXED);
+}
+
+inline void
+store(volatile uint32_t *ptr,
+      uint32_t value)
+{
+   __atomic_store_n(ptr, value, __ATOMIC_RELAXED);
+}
+
+constexpr bool
+is_power_of_two(std::size_t value)
+{
+   return value && !(value & (value - 1));
+}
+
+} // namespace detail
+
+/**
+ * Bounded queue for exactly one producer thread and one consumer thread.
+ *
+ * Neither side ever waits: try_push fails while the queue is full and
+ * try_pop while it is empty.
+ */
+template<typename T, std::size_t Capacity>
+class spsc_queue
+{
+   static_assert(detail::is_power_of_two(Capacity), "Capacity must be a power of two");
+
+public:
+   spsc_queue() = default;
+   spsc_queue(const spsc_queue &) = delete;
+   spsc_queue &operator=(const spsc_queue &) = delete;
+
+   //! Producer only.
+   bool try_push(T value)
+   {
+      uint32_t head = detail::load(&mHead);
+      if (head - detail::load(&mTail) == Capacity) {
+         return false;
+      }
+
+      mItems[head & (Capacity - 1)] = std::move(value);
+
+      // Publish the item before the index that makes it visible
+      detail::memory_barrier();
+      detail::store(&mHead, head + 1);
+      return true;
+   }
+
+   //! Consumer only.
+   bool try_pop(T &out)
+   {
+      uint32_t tail = detail::load(&mTail);
+      if (detail::load(&mHead) == tail) {
+         return false;
+      }
+
+      detail::memory_barrier();
+      out = std::move(mItems[tail & (Capacity - 1)]);
+
+      // The producer may reuse the slot as soon as it sees the new tail
+      detail::memory_barrier();
+      detail::store(&mTail, tail + 1);
+      return true;
+   }
+
+   //! Exact from either side only while the other one is idle.
+   std::size_t size() const
+   {
+      return detail::load(&mHead) - detail::load(&mTail);
+   }
+
+   bool empty() const { return size() == 0; }
+
+   static constexpr std::size_t capacity() { return Capacity; }
+
+private:
+   alignas(cache_line_size) volatile uint32_t mHead = 0;
+   alignas(cache_line_size) volatile uint32_t mTail = 0;
+   alignas(cache_line_size) T mItems[Capacity];
+};
+
+/**
+ * Bounded queue for any number of producer threads and one consumer thread.
+ *
+ * Every slot carries a sequence number telling producers and the consumer
+ * whose turn it is, so a producer only needs one compare and swap to claim
+ * a slot and the consumer none.
+ */
+template<typename T, std::size_t Capacity>
+class mpsc_queue
+{
+   static_assert(detail::is_power_of_two(Capacity), "Capacity must be a power of two");
+
+public:
+   mpsc_queue()
+   {
+      for (uint32_t i = 0; i < Capacity; ++i) {
+         mSlots[i].sequence = i;
+      }
+   }
+
+   mpsc_queue(const mpsc_queue &) = delete;
+   mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+   //! Any thread.
+   bool try_push(T value)
+   {
+      uint32_t head = detail::load(&mHead);
+      slot *s;
+
+      while (true) {
+         s = &mSlots[head & (Capacity - 1)];
+         int32_t diff = static_cast<int32_t>(detail::load(&s->sequence) - head);
+
+         if (diff == 0) {
+            if (OSCompareAndSwapAtomic(&mHead, head, head + 1)) {
+               break;
+            }
+         } else if (diff < 0) {
+            // The consumer hasn't freed this slot yet
+            return false;
+         }
+
+         head = detail::load(&mHead);
+      }
+
+      s->value = std::move(value);
+      detail::memory_barrier();
+      detail::store(&s->sequence, head + 1);
+      return true;
+   }
+
+   //! Consumer only.
+   bool try_pop(T &out)
+   {
+      uint32_t tail = mTail;
+      slot *s = &mSlots[tail & (Capacity - 1)];
+
+      // A claimed slot isn't readable until its producer has finished
+      if (detail::load(&s->sequence) != tail + 1) {
+         return false;
+      }
+
+      detail::memory_barrier();
+      out = std::move(s->value);
+
+      detail::memory_barrier();
+      detail::store(&s->sequence, tail + Capacity);
+      mTail = tail + 1;
+      return true;
+   }
+
+   static constexpr std::size_t capacity() { return Capacity; }
+
+private:
+   struct slot
+   {
+      volatile uint32_t sequence;
+      T value;
+   };
+
+   alignas(cache_line_size) volatile uint32_t mHead = 0;
+   alignas(cache_line_size) uint32_t mTail = 0;
+   alignas(cache_line_size) slot mSlots[Capacity];
+};
+
+//! Base for elements of a wut::treiber_stack.
+struct stack_node
+{
+   stack_node *next = nullptr;
+};
+
+/**
+ * Unbounded intrusive LIFO stack, usable from any number of threads.
+ *
+ * T has to derive from wut::stack_node. The stack doesn't own its nodes,
+ * which must stay allocated while any thread may still pop them, e.g.
+ * because they come from a pool that outlives the stack.
+ *
+ * On Espresso pop reads the next pointer inside the \c lwarx reservation,
+ * so a node popped and pushed back by another thread in between simply
+ * makes the store conditional fail, there is no ABA problem.
+ */
+template<typename T>
+class treiber_stack
+{
+public:
+   treiber_stack() = default;
+   treiber_stack(const treiber_stack &) = delete;
+   treiber_stack &operator=(const treiber_stack &) = delete;
+
+   void push(T *value)
+   {
+      stack_node *node = static_cast<stack_node *>(value);
+
+      // The node's contents must be visible before the node is
+      detail::memory_barrier();
+
+#ifdef __PPC__
+      stack_node *head;
+      __asm__ __volatile__ (
+         "1: lwarx  %0, 0, %1\n"
+         "   stw    %0, 0(%2)\n"
+         "   dcbst  0, %1\n"
+         "   stwcx. %2, 0, %1\n"
+         "   bne-   1b\n"
+         : "=&r" (head)
+         : "r" (&mHead), "b" (node)
+         : "cr0", "memory");
+      (void)head;
+#else
+      stack_node *head = __atomic_load_n(&mHead, __ATOMIC_RELAXED);
+      do {
+         node->next = head;
+      } while (!__atomic_compare_exchange_n(&mHead, &head, node, true,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+#endif
+   }
+
+   //! \return nullptr when the stack is empty.
+   T *pop()
+   {
+      stack_node *head;
+
+#ifdef __PPC__
+      stack_node *next;
+      __asm__ __volatile__ (
+         "1: lwarx  %0, 0, %2\n"
+         "   cmpwi  %0, 0\n"
+         "   beq-   2f\n"
+         "   lwz    %1, 0(%0)\n"
+         "   dcbst  0, %2\n"
+         "   stwcx. %1, 0, %2\n"
+         "   bne-   1b\n"
+         "2:\n"
+         : "=&b" (head), "=&r" (next)
+         : "r" (&mHead)
+         : "cr0", "memory");
+#else
+      head = __atomic_load_n(&mHead, __ATOMIC_ACQUIRE);
+      while (head && !__atomic_compare_exchange_n(&mHead, &head, head->next, true,
+                                                  __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+      }
+#endif
+
+      if (!head) {
+         return nullptr;
+      }
+
+      detail::memory_barrier();
+      head->next = nullptr;
+      return static_cast<T *>(head);
+   }
+
+   bool empty() const
+   {
+      return __atomic_load_n(&mHead, __ATOMIC_RELAXED) == nullptr;
+   }
+
+private:
+   alignas(cache_line_size) stack_node *volatile mHead = nullptr;
+};
+
+} // namespace wut
+
+#endif
+
+/** @} */
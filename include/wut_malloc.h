@@ -0,0 +1,114 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_malloc Allocation tracing
+ *
+ * Optional tracing of malloc, free and realloc to find hot allocation sites,
+ * leaks and fragmentation on hardware.
+ *
+ * Tracing is enabled by overriding __wut_malloc_trace_size with the number
+ * of entries to keep, the ring buffer is allocated at startup and the oldest
+ * entries are overwritten once it is full:
+ *
+ * \code
+ * uint32_t __wut_malloc_trace_size = 64 * 1024;
+ * \endcode
+ *
+ * Entries are written without a lock, an entry being written while the
+ * trace is read can come out torn.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum WUTMallocTraceType
+{
+   //! A block was allocated by malloc, calloc, realloc, memalign, valloc or pvalloc.
+   WUT_MALLOC_TRACE_ALLOC  = 0,
+   //! A block was freed by free or realloc.
+   WUT_MALLOC_TRACE_FREE   = 1,
+   //! A block was resized in place by realloc.
+   WUT_MALLOC_TRACE_RESIZE = 2,
+} WUTMallocTraceType;
+
+typedef struct WUTMallocTraceEntry
+{
+   //! System time of the call.
+   OSTime time;
+
+   //! The block.
+   void *ptr;
+
+   //! Return address of the allocating or freeing call.
+   void *caller;
+
+   //! Requested size, 0 for WUT_MALLOC_TRACE_FREE.
+   uint32_t size;
+
+   //! Requested alignment, 0 if none was requested.
+   uint16_t align;
+
+   //! WUTMallocTraceType.
+   uint16_t type;
+} WUTMallocTraceEntry;
+WUT_CHECK_OFFSET(WUTMallocTraceEntry, 0x00, time);
+WUT_CHECK_OFFSET(WUTMallocTraceEntry, 0x08, ptr);
+WUT_CHECK_OFFSET(WUTMallocTraceEntry, 0x0C, caller);
+WUT_CHECK_OFFSET(WUTMallocTraceEntry, 0x10, size);
+WUT_CHECK_OFFSET(WUTMallocTraceEntry, 0x14, align);
+WUT_CHECK_OFFSET(WUTMallocTraceEntry, 0x16, type);
+WUT_CHECK_SIZE(WUTMallocTraceEntry, 0x18);
+
+//! Called by WUTMallocTraceDump for every line of text.
+typedef void (*WUTMallocTraceWriteFn)(const char *line,
+                                      void *userContext);
+
+/**
+ * Copy up to maxEntries of the newest trace entries, oldest first.
+ *
+ * \return
+ * The number of entries copied, 0 if tracing is disabled.
+ */
+uint32_t
+WUTMallocTraceGetEntries(WUTMallocTraceEntry *outEntries,
+                         uint32_t maxEntries);
+
+/**
+ * Discard all trace entries.
+ */
+void
+WUTMallocTraceReset(void);
+
+/**
+ * Write the trace as text, one line per entry, oldest first.
+ *
+ * The first line holds the free space and largest free block of the heap.
+ * Nothing is traced while dumping, so writeFn may allocate and can e.g.
+ * forward the lines to WHBLogWrite to stream them over the UDP log.
+ *
+ * \return
+ * FALSE if tracing is disabled.
+ */
+BOOL
+WUTMallocTraceDump(WUTMallocTraceWriteFn writeFn,
+                   void *userContext);
+
+/**
+ * Write the trace as text to a file, e.g. "fs:/vol/external01/malloc.txt"
+ * on the SD card.
+ *
+ * \return
+ * FALSE if tracing is disabled or the file could not be written.
+ */
+BOOL
+WUTMallocTraceDumpToFile(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,45 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_memory Cache-line aware copies
+ *
+ * memcpy and memset for large buffers that avoid reading the destination.
+ *
+ * A plain store to a line that is not in the cache first reads the whole
+ * line from memory, even if it is about to be overwritten. These functions
+ * allocate every 32-byte destination line they fill completely with dcbz
+ * instead, and prefetch the source a few lines ahead with dcbt, so a large
+ * copy only reads the source and writes the destination.
+ *
+ * Buffers under 256 bytes are passed straight to memcpy and memset. The
+ * destination must be in cached memory, which is the case for everything
+ * allocated from the heaps. calloc and realloc use them for large blocks.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * memcpy for buffers that don't overlap.
+ */
+void *
+WUTMemcpy(void *dst,
+          const void *src,
+          size_t size);
+
+/**
+ * memset, zeroing whole lines with dcbz alone when c is 0.
+ */
+void *
+WUTMemset(void *dst,
+          int c,
+          size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
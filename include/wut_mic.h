@@ -0,0 +1,109 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+#include <mic/mic.h>
+
+/**
+ * \defgroup wut_mic Microphone capture
+ *
+ * Drains the Gamepad microphone on its own thread, so the application never
+ * has to poll MICGetStatus or copy out of the mic ring itself.
+ *
+ * Every few milliseconds the capture thread moves the new samples into a
+ * lock-free ring, resampling them to the requested rate on the way. The
+ * application reads them from a single thread along with the time the
+ * first one was recorded:
+ *
+ * \code
+ * WUTMicCaptureConfig config = { 0 };
+ * config.outputRate = 16000;
+ * WUTMicCapture *capture = WUTMicCaptureStart(&config);
+ *
+ * // Every frame
+ * int16_t samples[512];
+ * OSTime time;
+ * uint32_t count = WUTMicCaptureRead(capture, samples, 512, &time);
+ * \endcode
+ *
+ * When the application falls behind, the newest samples are dropped and
+ * counted as overruns.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Rate the Gamepad microphone records at.
+#define WUT_MIC_SAMPLE_RATE 32000
+
+typedef struct WUTMicCapture WUTMicCapture;
+
+typedef struct WUTMicCaptureConfig
+{
+   MICInstance instance;
+
+   //! Rate to resample to, 0 keeps WUT_MIC_SAMPLE_RATE. Must not be higher.
+   uint32_t outputRate;
+
+   //! Number of samples the ring holds, a power of two, 0 for 0x4000.
+   uint32_t ringSamples;
+
+   //! Time between drains in ticks, 0 for 5 ms.
+   OSTime interval;
+
+   //! Priority of the capture thread, 0 for 10.
+   int32_t priority;
+} WUTMicCaptureConfig;
+
+/**
+ * Initialise and open the microphone and start the capture thread.
+ *
+ * \param config
+ * Can be NULL for the defaults on MIC_INSTANCE_0.
+ *
+ * \return
+ * NULL on error.
+ */
+WUTMicCapture *
+WUTMicCaptureStart(const WUTMicCaptureConfig *config);
+
+/**
+ * Stop the capture thread, close the microphone and free the capture.
+ */
+void
+WUTMicCaptureStop(WUTMicCapture *capture);
+
+/**
+ * Take up to maxSamples samples from the ring.
+ *
+ * \param outTime
+ * Receives the estimated OSGetSystemTime at which the first sample returned
+ * was recorded, can be NULL.
+ *
+ * \return
+ * The number of samples written to outSamples.
+ */
+uint32_t
+WUTMicCaptureRead(WUTMicCapture *capture,
+                  int16_t *outSamples,
+                  uint32_t maxSamples,
+                  OSTime *outTime);
+
+/**
+ * Get the number of samples waiting in the ring.
+ */
+uint32_t
+WUTMicCaptureGetAvailable(WUTMicCapture *capture);
+
+/**
+ * Get the number of samples dropped because the ring was full.
+ */
+uint32_t
+WUTMicCaptureGetOverruns(WUTMicCapture *capture);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
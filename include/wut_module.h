@@ -0,0 +1,103 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/dynload.h>
+
+/**
+ * \defgroup wut_module Module manager
+ *
+ * A cache of OSDynLoad module handles and exports, with optional
+ * preloading on a background thread.
+ *
+ * The first OSDynLoad_Acquire of a system library blocks for as long as it
+ * takes to load, so libraries needed later can be preloaded while the
+ * application starts up. WUTModuleAcquire and WUTModuleFindExport then
+ * return the cached results without calling the loader again, only
+ * waiting if the module is still being loaded.
+ *
+ * \code
+ * static const char *sCameraExports[] = { "CAMInit", "CAMOpen", NULL };
+ * static const WUTModulePreloadSpec sModules[] = {
+ *    { "camera.rpl", sCameraExports },
+ *    { "nlibcurl.rpl", NULL },
+ * };
+ * WUTModulePreload(sModules, 2, 20);
+ * ...
+ * void *camOpen;
+ * WUTModuleFindExport("camera.rpl", OS_DYNLOAD_EXPORT_FUNC, "CAMOpen", &camOpen);
+ * \endcode
+ *
+ * Handles stay acquired until WUTModuleReleaseAll. Modules that need a
+ * custom loader allocator, like erreula.rpl and swkbd.rpl, should keep
+ * loading themselves.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of modules the cache holds.
+#define WUT_MODULE_MAX_MODULES 32
+
+//! Number of exports the cache holds across all modules.
+#define WUT_MODULE_MAX_EXPORTS 256
+
+typedef struct WUTModulePreloadSpec
+{
+   //! Module name as passed to OSDynLoad_Acquire.
+   const char *name;
+
+   //! NULL terminated list of function exports to resolve, or NULL.
+   const char *const *exports;
+} WUTModulePreloadSpec;
+
+/**
+ * Queue modules to be acquired, and their exports resolved, on a
+ * background thread with the given priority. The module names are copied,
+ * the export lists must stay valid until the modules are loaded.
+ *
+ * \return
+ * FALSE if the cache is full or the thread could not be started.
+ */
+BOOL
+WUTModulePreload(const WUTModulePreloadSpec *specs,
+                 uint32_t count,
+                 int32_t priority);
+
+/**
+ * Wait until every queued module has been loaded or failed to load.
+ */
+void
+WUTModuleWaitPreload(void);
+
+/**
+ * Get the handle for a module, acquiring it if it is not cached yet, or
+ * waiting for it if it is being preloaded.
+ *
+ * The handle belongs to the cache and must not be released.
+ */
+OSDynLoad_Error
+WUTModuleAcquire(const char *name,
+                 OSDynLoad_Module *outModule);
+
+/**
+ * Find an export of a module, from the cache if it was resolved before.
+ */
+OSDynLoad_Error
+WUTModuleFindExport(const char *module,
+                    OSDynLoad_ExportType type,
+                    const char *name,
+                    void **outAddr);
+
+/**
+ * Release every cached module handle and forget all exports. Must not be
+ * called while a preload is in progress.
+ */
+void
+WUTModuleReleaseAll(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
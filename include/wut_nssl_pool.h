@@ -0,0 +1,102 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+#include <nsysnet/nssl.h>
+#include <stdint.h>
+
+/**
+ * \defgroup wut_nssl_pool NSSL connection pool
+ *
+ * Reuses NSSL connections to the same host and port.
+ *
+ * A connection released with keepAlive set is kept open for the next
+ * WUTNSSLPoolAcquire to the same server, skipping both the TCP and the TLS
+ * handshake. When a new connection is needed the TLS session of the last
+ * connection to that server is resumed if NSSL still has it. Resuming
+ * relies on the NSSL session functions, whose signatures are not verified
+ * yet, see NSSLGetSession().
+ *
+ * Whether a connection can be kept alive is up to the caller, e.g. after a
+ * complete HTTP/1.1 response without "Connection: close".
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WUT_NSSL_POOL_MAX_HOST 256
+
+typedef struct WUTNSSLPool WUTNSSLPool;
+
+typedef struct WUTNSSLPoolConnection
+{
+   //! The TCP socket.
+   int fd;
+
+   //! The NSSL connection to use with NSSLRead and NSSLWrite.
+   NSSLConnectionHandle connection;
+
+   //! TRUE if this is a kept-alive connection from an earlier request.
+   BOOL reused;
+
+   //! Internal.
+   char host[WUT_NSSL_POOL_MAX_HOST];
+
+   //! Internal.
+   uint16_t port;
+} WUTNSSLPoolConnection;
+
+/**
+ * Create a connection pool for a context set up with the server's CAs.
+ *
+ * \param maxIdle
+ * Maximum number of idle connections to keep open.
+ *
+ * \param idleTimeout
+ * Idle connections older than this are closed instead of reused.
+ *
+ * \return
+ * NULL on error.
+ */
+WUTNSSLPool *
+WUTNSSLPoolCreate(NSSLContextHandle context,
+                  uint32_t maxIdle,
+                  OSTime idleTimeout);
+
+/**
+ * Close all idle connections and free the pool. Connections that were
+ * acquired and not released yet stay open.
+ */
+void
+WUTNSSLPoolDestroy(WUTNSSLPool *pool);
+
+/**
+ * Get a connection to host:port, reusing an idle one if possible.
+ *
+ * \return
+ * 0 on success, or a negative value among NSSLErrors on error.
+ * NSSL_ERROR_IO_ERROR is returned with errno set if connecting failed.
+ */
+NSSLError
+WUTNSSLPoolAcquire(WUTNSSLPool *pool,
+                   const char *host,
+                   uint16_t port,
+                   WUTNSSLPoolConnection *outConnection);
+
+/**
+ * Give a connection back to the pool.
+ *
+ * \param keepAlive
+ * TRUE to keep the connection open for reuse, FALSE to close it.
+ */
+void
+WUTNSSLPoolRelease(WUTNSSLPool *pool,
+                   WUTNSSLPoolConnection *connection,
+                   BOOL keepAlive);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
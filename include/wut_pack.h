@@ -0,0 +1,126 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_pack Packed archive devoptab
+ *
+ * Mount a read-only image holding a whole directory tree as a device, so
+ * loading an asset doesn't pay an FSA open and stat per file.
+ *
+ * \code
+ * extern const uint8_t assets_pack[];
+ * extern const uint32_t assets_pack_size;
+ * WUTPackMountMemory("assets", assets_pack, assets_pack_size);
+ *
+ * // Or one file on the SD card
+ * WUTPackMountFile("dlc", "fs:/vol/external01/game/dlc.pack");
+ *
+ * FILE *f = fopen("assets:/textures/player.gtx", "rb");
+ * \endcode
+ *
+ * Paths are looked up with one hash of the normalized path, opening a file
+ * doesn't touch the storage at all. Files of an image in memory are read
+ * with memcpy, files of an image file with pread() at their offset on the
+ * single handle kept open for the image.
+ *
+ * An image is big endian and starts with a WUTPackHeader. It holds
+ * WUTPackHeader::numEntries WUTPackEntry structs, entry 0 being the root
+ * directory, and WUTPackHeader::numBuckets bucket heads, each the index of
+ * the first entry in the bucket or WUT_PACK_INVALID_INDEX. An entry is in
+ * bucket `hash & (numBuckets - 1)`, where hash is the 32-bit FNV-1a hash
+ * of its path, chained through WUTPackEntry::nextInBucket. Paths are stored
+ * NUL terminated in the names table, without a leading '/' and with '/'
+ * between components, the root is the empty string. The children of a
+ * directory are consecutive entries.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WUT_PACK_MAGIC          0x57504B31 // "WPK1"
+#define WUT_PACK_INVALID_INDEX  0xFFFFFFFF
+
+//! Set in WUTPackEntry::flags for directories.
+#define WUT_PACK_ENTRY_DIRECTORY 0x1
+
+typedef struct WUTPackHeader
+{
+   //! WUT_PACK_MAGIC.
+   uint32_t magic;
+   uint32_t numEntries;
+   //! A power of two.
+   uint32_t numBuckets;
+   //! Offsets from the start of the image.
+   uint32_t entriesOffset;
+   uint32_t bucketsOffset;
+   uint32_t namesOffset;
+   uint32_t namesSize;
+   uint32_t reserved;
+} WUTPackHeader;
+WUT_CHECK_OFFSET(WUTPackHeader, 0x0C, entriesOffset);
+WUT_CHECK_SIZE(WUTPackHeader, 0x20);
+
+typedef struct WUTPackEntry
+{
+   //! FNV-1a hash of the path.
+   uint32_t hash;
+   //! Next entry in the same bucket, WUT_PACK_INVALID_INDEX at the end.
+   uint32_t nextInBucket;
+   //! Offset of the path in the names table.
+   uint32_t nameOffset;
+   uint32_t flags;
+   //! Files: offset of the data from the start of the image.
+   //! Directories: index of the first child.
+   uint32_t offset;
+   //! Files: size of the data. Directories: number of children.
+   uint32_t size;
+   //! Index of the parent directory, 0 for the root itself.
+   uint32_t parent;
+   uint32_t reserved;
+} WUTPackEntry;
+WUT_CHECK_OFFSET(WUTPackEntry, 0x10, offset);
+WUT_CHECK_SIZE(WUTPackEntry, 0x20);
+
+/**
+ * Mount an image in memory as device name, e.g. one linked into the RPX.
+ *
+ * The image must be 4 byte aligned and stay valid until it is unmounted.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTPackMountMemory(const char *name,
+                   const void *image,
+                   uint32_t size);
+
+/**
+ * Mount the image file at path as device name.
+ *
+ * The header and index are read into memory, the file stays open for
+ * reads until the image is unmounted.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTPackMountFile(const char *name,
+                 const char *path);
+
+/**
+ * Unmount an image, files and directories opened on it must be closed
+ * first.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error, EBUSY if files are still open.
+ */
+int
+WUTPackUnmount(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
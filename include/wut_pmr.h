@@ -0,0 +1,269 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/memblockheap.h>
+#include <coreinit/memexpheap.h>
+#include <coreinit/memfrmheap.h>
+#include <coreinit/memunitheap.h>
+
+/**
+ * \defgroup wut_pmr Heap memory resources
+ *
+ * std::pmr::memory_resource adapters for the coreinit heaps, so containers
+ * can allocate from a specific heap instead of through the global
+ * operator new.
+ *
+ * \code
+ * wut::pmr::exp_heap_resource mem1(MEMGetBaseHeapHandle(MEM_BASE_HEAP_MEM1));
+ * std::pmr::vector<Vertex> vertices(&mem1);
+ *
+ * // Everything allocated for the level is freed at once when it goes out
+ * // of scope
+ * wut::pmr::frame_heap_state_resource level(frameHeap, LEVEL_HEAP_TAG);
+ * std::pmr::unordered_map<int, Entity> entities(&level);
+ * \endcode
+ *
+ * The resources only wrap a heap handle, the heap has to outlive them and
+ * its own flags decide whether it is thread safe. A failed allocation
+ * throws std::bad_alloc, or calls abort() when exceptions are disabled.
+ *
+ * Requires C++17.
+ * @{
+ */
+
+#if defined(__cplusplus) && __cplusplus >= 201703L
+
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+
+namespace wut::pmr
+{
+
+namespace detail
+{
+
+[[noreturn]] inline void
+throw_bad_alloc()
+{
+#if __cpp_exceptions
+   throw std::bad_alloc();
+#else
+   std::abort();
+#endif
+}
+
+// The heaps take a signed alignment, where negative values mean allocating
+// from the tail, and need at least 4
+inline int
+heap_alignment(std::size_t alignment)
+{
+   return alignment < 4 ? 4 : static_cast<int>(alignment);
+}
+
+} // namespace detail
+
+//! Allocates from an expanded heap, memory is freed on deallocate.
+class exp_heap_resource : public std::pmr::memory_resource
+{
+public:
+   explicit exp_heap_resource(MEMHeapHandle heap) noexcept : mHeap(heap) { }
+
+   MEMHeapHandle heap() const noexcept { return mHeap; }
+
+protected:
+   void *do_allocate(std::size_t bytes, std::size_t alignment) override
+   {
+      void *ptr = MEMAllocFromExpHeapEx(mHeap, bytes ? bytes : 1, detail::heap_alignment(alignment));
+      if (!ptr) {
+         detail::throw_bad_alloc();
+      }
+      return ptr;
+   }
+
+   void do_deallocate(void *ptr, std::size_t, std::size_t) override
+   {
+      MEMFreeToExpHeap(mHeap, ptr);
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      return this == &other;
+   }
+
+private:
+   MEMHeapHandle mHeap;
+};
+
+//! Allocates from a block heap, memory is freed on deallocate.
+class block_heap_resource : public std::pmr::memory_resource
+{
+public:
+   explicit block_heap_resource(MEMHeapHandle heap) noexcept : mHeap(heap) { }
+
+   MEMHeapHandle heap() const noexcept { return mHeap; }
+
+protected:
+   void *do_allocate(std::size_t bytes, std::size_t alignment) override
+   {
+      void *ptr = MEMAllocFromBlockHeapEx(mHeap, bytes ? bytes : 1, detail::heap_alignment(alignment));
+      if (!ptr) {
+         detail::throw_bad_alloc();
+      }
+      return ptr;
+   }
+
+   void do_deallocate(void *ptr, std::size_t, std::size_t) override
+   {
+      MEMFreeToBlockHeap(mHeap, ptr);
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      return this == &other;
+   }
+
+private:
+   MEMHeapHandle mHeap;
+};
+
+/**
+ * Allocates fixed size blocks from a unit heap.
+ *
+ * Allocations bigger than the heap's block size, or with a stricter
+ * alignment than the heap was created with, go to upstream instead, like
+ * std::pmr::unsynchronized_pool_resource does for big blocks.
+ */
+class unit_heap_resource : public std::pmr::memory_resource
+{
+public:
+   unit_heap_resource(MEMHeapHandle heap,
+                      std::size_t alignment,
+                      std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) noexcept :
+      mHeap(heap),
+      mBlockSize(reinterpret_cast<MEMUnitHeap *>(heap)->blockSize),
+      mAlignment(alignment),
+      mUpstream(upstream)
+   {
+   }
+
+   MEMHeapHandle heap() const noexcept { return mHeap; }
+   std::pmr::memory_resource *upstream_resource() const noexcept { return mUpstream; }
+
+protected:
+   void *do_allocate(std::size_t bytes, std::size_t alignment) override
+   {
+      if (!fits(bytes, alignment)) {
+         return mUpstream->allocate(bytes, alignment);
+      }
+
+      void *ptr = MEMAllocFromUnitHeap(mHeap);
+      if (!ptr) {
+         detail::throw_bad_alloc();
+      }
+      return ptr;
+   }
+
+   void do_deallocate(void *ptr, std::size_t bytes, std::size_t alignment) override
+   {
+      if (!fits(bytes, alignment)) {
+         mUpstream->deallocate(ptr, bytes, alignment);
+      } else {
+         MEMFreeToUnitHeap(mHeap, ptr);
+      }
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      return this == &other;
+   }
+
+private:
+   bool fits(std::size_t bytes, std::size_t alignment) const noexcept
+   {
+      return bytes <= mBlockSize && alignment <= mAlignment;
+   }
+
+   MEMHeapHandle mHeap;
+   std::size_t mBlockSize;
+   std::size_t mAlignment;
+   std::pmr::memory_resource *mUpstream;
+};
+
+/**
+ * Allocates from the head of a frame heap.
+ *
+ * deallocate does nothing, memory is only given back by release(), which
+ * frees everything allocated from the head of the heap.
+ */
+class frame_heap_resource : public std::pmr::memory_resource
+{
+public:
+   explicit frame_heap_resource(MEMHeapHandle heap) noexcept : mHeap(heap) { }
+
+   MEMHeapHandle heap() const noexcept { return mHeap; }
+
+   void release() noexcept { MEMFreeToFrmHeap(mHeap, MEM_FRM_HEAP_FREE_HEAD); }
+
+protected:
+   void *do_allocate(std::size_t bytes, std::size_t alignment) override
+   {
+      void *ptr = MEMAllocFromFrmHeapEx(mHeap, bytes ? bytes : 1, detail::heap_alignment(alignment));
+      if (!ptr) {
+         detail::throw_bad_alloc();
+      }
+      return ptr;
+   }
+
+   void do_deallocate(void *, std::size_t, std::size_t) override
+   {
+   }
+
+   bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      return this == &other;
+   }
+
+   MEMHeapHandle mHeap;
+};
+
+/**
+ * A monotonic resource over a frame heap state.
+ *
+ * Records the state of the heap with tag on construction and frees
+ * everything allocated after it with MEMFreeByStateToFrmHeap on destruction
+ * or release(). Resources on the same heap nest like scopes, an inner one
+ * must be released before an outer one.
+ */
+class frame_heap_state_resource : public frame_heap_resource
+{
+public:
+   frame_heap_state_resource(MEMHeapHandle heap, uint32_t tag) noexcept :
+      frame_heap_resource(heap),
+      mTag(tag)
+   {
+      MEMRecordStateForFrmHeap(heap, tag);
+   }
+
+   frame_heap_state_resource(const frame_heap_state_resource &) = delete;
+   frame_heap_state_resource &operator=(const frame_heap_state_resource &) = delete;
+
+   ~frame_heap_state_resource() override { MEMFreeByStateToFrmHeap(mHeap, mTag); }
+
+   //! Free everything allocated since construction or the last release.
+   void release() noexcept
+   {
+      MEMFreeByStateToFrmHeap(mHeap, mTag);
+      MEMRecordStateForFrmHeap(mHeap, mTag);
+   }
+
+   uint32_t tag() const noexcept { return mTag; }
+
+private:
+   uint32_t mTag;
+};
+
+} // namespace wut::pmr
+
+#endif
+
+/** @} */
@@ -0,0 +1,109 @@
+#pragma once
+#include <wut.h>
+#include <poll.h>
+
+/**
+ * \defgroup wut_poll Persistent poll
+ *
+ * A persistent set of sockets to wait on, similar to epoll.
+ *
+ * poll() and select() translate every fd and rebuild the nsysnet fd sets on
+ * each call. A wut_poll_t keeps the translated sets between calls, so each
+ * wut_poll_wait is a single nsysnet select plus a scan of the ready bits.
+ *
+ * Readiness is level-triggered. A wut_poll_t is not thread-safe, and a socket
+ * must be removed with wut_poll_del before it is closed.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct wut_poll wut_poll_t;
+
+struct wut_poll_event
+{
+   //! The socket.
+   int fd;
+
+   //! POLLIN, POLLOUT and POLLPRI, as requested or as reported ready.
+   int events;
+
+   //! User data passed to wut_poll_add or wut_poll_mod.
+   void *data;
+};
+
+/**
+ * Create an empty interest set.
+ *
+ * \return
+ * NULL with errno set on error.
+ */
+wut_poll_t *
+wut_poll_create(void);
+
+/**
+ * Destroy an interest set, the sockets in it are not closed.
+ */
+void
+wut_poll_destroy(wut_poll_t *set);
+
+/**
+ * Add a socket to the set.
+ *
+ * \return
+ * 0 on success, -1 with errno set to EEXIST if fd is already in the set.
+ */
+int
+wut_poll_add(wut_poll_t *set,
+             int fd,
+             int events,
+             void *data);
+
+/**
+ * Change the events and user data of a socket in the set.
+ *
+ * \return
+ * 0 on success, -1 with errno set to ENOENT if fd is not in the set.
+ */
+int
+wut_poll_mod(wut_poll_t *set,
+             int fd,
+             int events,
+             void *data);
+
+/**
+ * Remove a socket from the set.
+ *
+ * \return
+ * 0 on success, -1 with errno set to ENOENT if fd is not in the set.
+ */
+int
+wut_poll_del(wut_poll_t *set,
+             int fd);
+
+/**
+ * Wait for sockets in the set to become ready.
+ *
+ * If more than maxevents sockets are ready the rest are reported by the
+ * next call.
+ *
+ * \param timeout
+ * Maximum time to wait in milliseconds, or -1 to wait forever.
+ *
+ * \return
+ * The number of entries written to events, 0 on timeout, or -1 with errno
+ * set on error.
+ */
+int
+wut_poll_wait(wut_poll_t *set,
+              struct wut_poll_event *events,
+              int maxevents,
+              int timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,66 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_profile Profile-guided optimisation
+ *
+ * Writes the gcov profile of a `-fprofile-generate` build to the SD card,
+ * so it can be fed back to the compiler with `-fprofile-use`.
+ *
+ * Build the application with share/wut_profile.cmake, or the
+ * WUT_PROFILE_CFLAGS and WUT_PROFILE_LDFLAGS of wut_rules:
+ *
+ * \code
+ * include("${WUT_ROOT}/share/wut_profile.cmake")
+ * wut_create_rpx(game)
+ * wut_profile(game GENERATE)
+ * \endcode
+ *
+ * The profile is written when the application exits, before the SD card is
+ * unmounted, and whenever WUTProfileDump is called. Each object gets one
+ * .gcda file in the output directory, named after its mangled build path.
+ * Copy the directory back to the build machine and rebuild with
+ * `wut_profile(game USE DIR <directory>)`.
+ *
+ * In builds without `-fprofile-generate` these functions do nothing.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Directory the profile is written to unless WUTProfileSetOutputDir is
+//! called.
+#define WUT_PROFILE_DEFAULT_DIR "fs:/vol/external01/wiiu/profile"
+
+/**
+ * Check whether the application was built with `-fprofile-generate`.
+ */
+BOOL
+WUTProfileIsEnabled(void);
+
+/**
+ * Set the directory the profile is written to, it is created if needed.
+ */
+void
+WUTProfileSetOutputDir(const char *dir);
+
+/**
+ * Write the profile counters now, merging them into existing .gcda files.
+ *
+ * \param reset
+ * Clear the counters afterwards, so the next dump only adds what ran since.
+ * Without a reset the profile is not written again at exit.
+ *
+ * \return
+ * FALSE if profiling is not enabled or the directory could not be created.
+ */
+BOOL
+WUTProfileDump(BOOL reset);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,211 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_psmath Paired-single math
+ *
+ * Vector, matrix and quaternion kernels using the paired-single floating
+ * point unit of the Espresso CPU, which operates on two floats per
+ * instruction and can load and store quantised integers.
+ *
+ * Every function has a plain C equivalent with the Scalar suffix, which
+ * gives the same results up to rounding. The paired-single versions call
+ * them when wut is not built for Espresso.
+ *
+ * Matrices are row-major. A WUTMtx34 is an affine transform whose implied
+ * fourth row is [0 0 0 1], transforming column vectors like GX2 shaders
+ * expect after uploading it as three vec4 uniforms. Inputs and outputs may
+ * alias unless stated otherwise.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTVec2
+{
+   float x, y;
+} WUTVec2;
+
+typedef struct WUTVec3
+{
+   float x, y, z;
+} WUTVec3;
+
+typedef struct WUTVec4
+{
+   float x, y, z, w;
+} WUTVec4;
+
+//! Quaternion with the imaginary part in x, y, z.
+typedef struct WUTQuat
+{
+   float x, y, z, w;
+} WUTQuat;
+
+typedef float WUTMtx34[3][4];
+typedef float WUTMtx44[4][4];
+
+WUT_CHECK_SIZE(WUTVec2, 0x08);
+WUT_CHECK_SIZE(WUTVec3, 0x0C);
+WUT_CHECK_SIZE(WUTVec4, 0x10);
+WUT_CHECK_SIZE(WUTQuat, 0x10);
+
+//! Integer formats for WUTDequantize, the GQR load types.
+typedef enum WUTQuantType
+{
+   WUT_QUANT_TYPE_U8  = 4,
+   WUT_QUANT_TYPE_U16 = 5,
+   WUT_QUANT_TYPE_S8  = 6,
+   WUT_QUANT_TYPE_S16 = 7,
+} WUTQuantType;
+
+void
+WUTVec2Add(const WUTVec2 *a, const WUTVec2 *b, WUTVec2 *ab);
+void
+WUTVec2AddScalar(const WUTVec2 *a, const WUTVec2 *b, WUTVec2 *ab);
+
+void
+WUTVec2Scale(const WUTVec2 *src, WUTVec2 *dst, float scale);
+void
+WUTVec2ScaleScalar(const WUTVec2 *src, WUTVec2 *dst, float scale);
+
+float
+WUTVec2Dot(const WUTVec2 *a, const WUTVec2 *b);
+float
+WUTVec2DotScalar(const WUTVec2 *a, const WUTVec2 *b);
+
+void
+WUTVec3Add(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab);
+void
+WUTVec3AddScalar(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab);
+
+void
+WUTVec3Sub(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab);
+void
+WUTVec3SubScalar(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab);
+
+void
+WUTVec3Scale(const WUTVec3 *src, WUTVec3 *dst, float scale);
+void
+WUTVec3ScaleScalar(const WUTVec3 *src, WUTVec3 *dst, float scale);
+
+float
+WUTVec3Dot(const WUTVec3 *a, const WUTVec3 *b);
+float
+WUTVec3DotScalar(const WUTVec3 *a, const WUTVec3 *b);
+
+void
+WUTVec3Cross(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *axb);
+void
+WUTVec3CrossScalar(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *axb);
+
+/**
+ * Scale src to unit length, src must not be the zero vector.
+ */
+void
+WUTVec3Normalize(const WUTVec3 *src, WUTVec3 *dst);
+void
+WUTVec3NormalizeScalar(const WUTVec3 *src, WUTVec3 *dst);
+
+void
+WUTVec4Add(const WUTVec4 *a, const WUTVec4 *b, WUTVec4 *ab);
+void
+WUTVec4AddScalar(const WUTVec4 *a, const WUTVec4 *b, WUTVec4 *ab);
+
+void
+WUTVec4Scale(const WUTVec4 *src, WUTVec4 *dst, float scale);
+void
+WUTVec4ScaleScalar(const WUTVec4 *src, WUTVec4 *dst, float scale);
+
+float
+WUTVec4Dot(const WUTVec4 *a, const WUTVec4 *b);
+float
+WUTVec4DotScalar(const WUTVec4 *a, const WUTVec4 *b);
+
+void
+WUTMtx34Identity(WUTMtx34 m);
+
+/**
+ * ab = a * b, so ab applies b first and then a.
+ */
+void
+WUTMtx34Concat(const WUTMtx34 a, const WUTMtx34 b, WUTMtx34 ab);
+void
+WUTMtx34ConcatScalar(const WUTMtx34 a, const WUTMtx34 b, WUTMtx34 ab);
+
+/**
+ * Transform the point src, including the translation.
+ */
+void
+WUTMtx34MultVec(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst);
+void
+WUTMtx34MultVecScalar(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst);
+
+/**
+ * Transform count points, e.g. to skin a vertex array on the CPU.
+ *
+ * The matrix stays in registers for the whole batch. src and dst may be
+ * the same array but must not otherwise overlap.
+ */
+void
+WUTMtx34MultVecArray(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst, uint32_t count);
+void
+WUTMtx34MultVecArrayScalar(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst, uint32_t count);
+
+void
+WUTMtx44Identity(WUTMtx44 m);
+
+void
+WUTMtx44Concat(const WUTMtx44 a, const WUTMtx44 b, WUTMtx44 ab);
+void
+WUTMtx44ConcatScalar(const WUTMtx44 a, const WUTMtx44 b, WUTMtx44 ab);
+
+void
+WUTMtx44MultVec(const WUTMtx44 m, const WUTVec4 *src, WUTVec4 *dst);
+void
+WUTMtx44MultVecScalar(const WUTMtx44 m, const WUTVec4 *src, WUTVec4 *dst);
+
+/**
+ * pq = p * q, the rotation q followed by p.
+ */
+void
+WUTQuatMultiply(const WUTQuat *p, const WUTQuat *q, WUTQuat *pq);
+void
+WUTQuatMultiplyScalar(const WUTQuat *p, const WUTQuat *q, WUTQuat *pq);
+
+/**
+ * Scale src to unit length, src must not be zero.
+ */
+void
+WUTQuatNormalize(const WUTQuat *src, WUTQuat *dst);
+void
+WUTQuatNormalizeScalar(const WUTQuat *src, WUTQuat *dst);
+
+/**
+ * Rotation matrix of the unit quaternion q with no translation.
+ */
+void
+WUTQuatToMtx34(const WUTQuat *q, WUTMtx34 m);
+
+/**
+ * Convert count integers of the given type to floats multiplied by
+ * 2^-shift, e.g. to decompress vertex positions stored as s16.
+ *
+ * The paired-single version loads two integers per instruction with psq_l,
+ * using GQR6 which it saves and restores.
+ *
+ * \param shift
+ * Power of two to divide by, from 0 to 31.
+ */
+void
+WUTDequantize(float *dst, const void *src, uint32_t count, WUTQuantType type, uint32_t shift);
+void
+WUTDequantizeScalar(float *dst, const void *src, uint32_t count, WUTQuantType type, uint32_t shift);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,92 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/condition.h>
+#include <coreinit/mutex.h>
+
+/**
+ * \defgroup wut_rwlock Reader-writer lock
+ *
+ * A lock that can be held by any number of readers or by one writer.
+ *
+ * Taking and releasing the lock without contention is a single atomic
+ * operation. Waiting writers block new readers, so writers don't starve
+ * under a constant stream of readers. In C++, wut::shared_mutex wraps it
+ * for use with std::shared_lock and std::unique_lock.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTRWLock
+{
+   //! Number of readers, or WUT_RWLOCK_WRITER while held by a writer.
+   volatile uint32_t state;
+
+   //! Number of writers waiting for the lock.
+   volatile uint32_t waitingWriters;
+
+   //! Number of readers waiting for the lock.
+   volatile uint32_t waitingReaders;
+
+   //! Only taken by threads that have to wait.
+   OSMutex mutex;
+   OSCondition cond;
+} WUTRWLock;
+
+#define WUT_RWLOCK_WRITER 0x80000000u
+
+void
+WUTRWLockInit(WUTRWLock *lock);
+
+void
+WUTRWLockReadLock(WUTRWLock *lock);
+
+BOOL
+WUTRWLockTryReadLock(WUTRWLock *lock);
+
+void
+WUTRWLockReadUnlock(WUTRWLock *lock);
+
+void
+WUTRWLockWriteLock(WUTRWLock *lock);
+
+BOOL
+WUTRWLockTryWriteLock(WUTRWLock *lock);
+
+void
+WUTRWLockWriteUnlock(WUTRWLock *lock);
+
+#ifdef __cplusplus
+}
+
+namespace wut
+{
+
+//! Meets the SharedMutex requirements, like std::shared_mutex.
+class shared_mutex
+{
+public:
+   shared_mutex() { WUTRWLockInit(&mLock); }
+   shared_mutex(const shared_mutex &) = delete;
+   shared_mutex &operator=(const shared_mutex &) = delete;
+
+   void lock() { WUTRWLockWriteLock(&mLock); }
+   bool try_lock() { return WUTRWLockTryWriteLock(&mLock); }
+   void unlock() { WUTRWLockWriteUnlock(&mLock); }
+
+   void lock_shared() { WUTRWLockReadLock(&mLock); }
+   bool try_lock_shared() { return WUTRWLockTryReadLock(&mLock); }
+   void unlock_shared() { WUTRWLockReadUnlock(&mLock); }
+
+   WUTRWLock *native_handle() { return &mLock; }
+
+private:
+   WUTRWLock mLock;
+};
+
+} // namespace wut
+#endif
+
+/** @} */
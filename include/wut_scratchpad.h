@@ -0,0 +1,94 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_scratchpad Locked cache scratchpad
+ *
+ * Tight loops such as audio mixing or skinning work on tiles moved in and
+ * out of the locked L1 cache, which never misses:
+ *
+ * \code
+ * WUTScratchpad pad;
+ * WUTScratchpadInit(&pad, 8 * 1024);
+ * uint8_t *in = (uint8_t *)pad.base;
+ * uint8_t *out = in + 4096;
+ *
+ * for (uint32_t offset = 0; offset < size; offset += 4096) {
+ *    WUTScratchpadLoad(in, src + offset, 4096);
+ *    WUTScratchpadWait(0);
+ *    mix(out, in, 4096);
+ *    WUTScratchpadStore(dst + offset, out, 4096);
+ * }
+ *
+ * WUTScratchpadWait(0);
+ * WUTScratchpadShutdown(&pad);
+ * \endcode
+ *
+ * A scratchpad belongs to the core it was set up on, and the thread calling
+ * WUTScratchpadInit stays pinned to that core until WUTScratchpadShutdown.
+ *
+ * Memory addresses and sizes passed to the transfers must be multiples of
+ * 32 bytes. The caches are handled here: the source of a load is flushed,
+ * and the destination of a store invalidated, so it must not be touched by
+ * the CPU until the transfer has been waited for.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTScratchpad
+{
+   //! Start of the scratchpad in the locked cache, NULL if not set up.
+   void *base;
+
+   //! Size in bytes, a multiple of 512.
+   uint32_t size;
+} WUTScratchpad;
+
+/**
+ * Allocate size bytes of locked cache, rounded up to 512, and enable its
+ * DMA on the current core.
+ *
+ * \return
+ * FALSE if the locked cache is not available or not enough of it is free.
+ */
+BOOL
+WUTScratchpadInit(WUTScratchpad *pad,
+                  uint32_t size);
+
+/**
+ * Wait for outstanding transfers and free the scratchpad.
+ */
+void
+WUTScratchpadShutdown(WUTScratchpad *pad);
+
+/**
+ * Queue copying size bytes from main memory at src to the scratchpad.
+ * Larger copies are split, and wait for room when the DMA queue is full.
+ */
+void
+WUTScratchpadLoad(void *lcDst,
+                  const void *src,
+                  uint32_t size);
+
+/**
+ * Queue copying size bytes from the scratchpad to main memory at dst.
+ */
+void
+WUTScratchpadStore(void *dst,
+                   const void *lcSrc,
+                   uint32_t size);
+
+/**
+ * Wait until at most pending transfers are left, 0 to wait for all of them.
+ */
+void
+WUTScratchpadWait(uint32_t pending);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
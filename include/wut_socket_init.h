@@ -0,0 +1,48 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_socket_init Network start-up
+ *
+ * By default wutsocket starts the socket library, registers the socket
+ * device and starts connecting to the network before main. Titles that
+ * only use the network later, or not at all on most runs, can leave that
+ * out of their start-up time by defining:
+ *
+ * \code
+ * uint32_t __wut_socket_deferred_init = 1;
+ * \endcode
+ *
+ * The network is then brought up by the first call to socket,
+ * getaddrinfo, getnameinfo, gethostbyname, gethostbyaddr or the wut_dns
+ * functions, or earlier, off the main thread, by WUTSocketInit.
+ *
+ * Either way the connection itself is made in the background, as with
+ * ACConnectAsync, so the first sockets may still fail with ENETUNREACH.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Bring up the socket library and start connecting, if that hasn't
+ * happened yet. Safe to call from any thread; calls racing with the first
+ * one wait for it to finish.
+ */
+void
+WUTSocketInit(void);
+
+/**
+ * \return
+ * TRUE once the socket library has been brought up.
+ */
+BOOL
+WUTSocketIsInit(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
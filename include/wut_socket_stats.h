@@ -0,0 +1,74 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_socket_stats Socket statistics
+ *
+ * Optional throughput and error counters for wutsocket, per socket and for
+ * all sockets together.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of nsysnet error codes counted separately, larger codes share the
+//! last bucket.
+#define WUT_SOCKET_STATS_ERROR_CODES 64
+
+typedef struct WUTSocketStats
+{
+   //! Bytes received.
+   uint64_t bytesIn;
+
+   //! Bytes sent.
+   uint64_t bytesOut;
+
+   //! recv, recvfrom, recvmsg, recvmmsg and read calls, one per datagram.
+   uint32_t recvCalls;
+
+   //! send, sendto, sendmsg, sendmmsg and write calls, one per datagram.
+   uint32_t sendCalls;
+
+   //! Calls that failed with EWOULDBLOCK.
+   uint32_t wouldBlock;
+
+   //! Calls that failed, including wouldBlock.
+   uint32_t errors;
+
+   //! Failed calls per nsysnet error code, see socketlasterr. The global
+   //! counters include every socket function, the per socket ones only
+   //! sends and receives.
+   uint32_t errorCodes[WUT_SOCKET_STATS_ERROR_CODES];
+} WUTSocketStats;
+
+/**
+ * Enable or disable collecting socket statistics, disabled by default.
+ */
+void
+WUTSocketSetStatsEnabled(BOOL enabled);
+
+/**
+ * Get the statistics of a socket, or of all sockets if fd is -1.
+ *
+ * Per socket counters start at zero when the socket is created.
+ *
+ * \return
+ * FALSE if fd is not a socket.
+ */
+BOOL
+WUTSocketGetStats(int fd,
+                  WUTSocketStats *outStats);
+
+/**
+ * Reset the statistics of a socket, or of all sockets if fd is -1.
+ */
+BOOL
+WUTSocketResetStats(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
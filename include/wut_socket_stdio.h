@@ -0,0 +1,69 @@
+#pragma once
+#include <wut.h>
+#include <stdio.h>
+
+/**
+ * \defgroup wut_socket_stdio Socket stdio streams
+ *
+ * FILE streams over sockets, for parsing line based protocols such as IRC
+ * or HTTP headers with fgets or getline.
+ *
+ * Each refill of a stream's buffer is a single recv, which returns what has
+ * arrived so far up to the size of the buffer, so a larger buffer means
+ * fewer round trips to the network stack per line. The buffer belongs to the
+ * stream and is freed by fclose, also when the socket was closed first.
+ *
+ * \code
+ * FILE *stream = wut_socket_fdopen(fd, "r", 0);
+ * char line[512];
+ * while (fgets(line, sizeof(line), stream)) {
+ *    ...
+ * }
+ * fclose(stream);
+ * \endcode
+ *
+ * Closing the stream closes the socket. On a non-blocking socket a read
+ * with no data sets the error indicator of the stream with errno EAGAIN,
+ * clearerr then allows reading again.
+ *
+ * newlib drops data that has been read ahead when a stream switches from
+ * reading to writing, so a protocol that sends while there may still be
+ * data to read should send with send or a wut_tcp_stream_t instead.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Buffer size used when 0 is passed to wut_socket_fdopen, also the
+//! st_blksize that fstat reports for sockets.
+#define WUT_SOCKET_STDIO_DEFAULT_BUFFER_SIZE (16 * 1024)
+
+//! Buffer sizes are rounded up to a multiple of this, a cache line.
+#define WUT_SOCKET_STDIO_BUFFER_ALIGN        0x40
+
+/**
+ * Open a fully buffered stream over a socket.
+ *
+ * \param mode
+ * As for fdopen.
+ *
+ * \param bufferSize
+ * Size of the stream's buffer, rounded up to a multiple of
+ * WUT_SOCKET_STDIO_BUFFER_ALIGN, or 0 for
+ * WUT_SOCKET_STDIO_DEFAULT_BUFFER_SIZE.
+ *
+ * \return
+ * NULL with errno set on error.
+ */
+FILE *
+wut_socket_fdopen(int fd,
+                  const char *mode,
+                  size_t bufferSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
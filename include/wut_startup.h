@@ -0,0 +1,134 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_startup Start-up
+ *
+ * What __init_wut does before main, and how long it took.
+ *
+ * newlib and the C++ runtime are initialised first, then the "fs:" device
+ * is set up and the SD card mounted on the main thread while the socket
+ * library and network connection are brought up on another core, if
+ * wutsocket is linked. Both are finished before main. To run everything on
+ * the main thread instead, define:
+ *
+ * \code
+ * uint32_t __wut_parallel_init = 0;
+ * \endcode
+ *
+ * The socket step is only there when something in the application uses
+ * sockets. The other steps can be left out, along with their code, by
+ * linking one of the opt-out libraries. The startup code that references
+ * each step is itself in libwut.a, so the linker has to be told to look for
+ * the step before it reaches libwut, with -u ahead of the library:
+ *
+ * - `-Wl,-u,__init_wut_devoptab -lwut_nodevoptab`, no "fs:" device and no
+ *   SD card mount, for applications that only use FS or FSA directly.
+ * - `-Wl,-u,__init_wut_stdcpp -lwut_nostdcpp`, no gthread implementation,
+ *   for applications that don't use std::thread, std::mutex and the like.
+ *
+ * wut_rules has these as $(WUT_NODEVOPTAB) and $(WUT_NOSTDCPP):
+ *
+ * \code
+ * LIBS := $(WUT_NODEVOPTAB) -lwut
+ * \endcode
+ *
+ * Without the -u the opt-out library is scanned before anything refers to
+ * the step and is silently ignored.
+ *
+ * Calling into a left-out component anyway, e.g. mounting a device,
+ * pulls the component back in and fails to link with a duplicate symbol.
+ *
+ * The time of each step is kept and can be printed with
+ * WUTReportStartupTimes.
+ *
+ * The whole way from the RPX being started to the first frame can also be
+ * traced as a list of named marks. wut records one at the start of
+ * __preinit_user, for each step of __init_wut, and before the static
+ * constructors run; the application adds its own with WUTMarkStartup:
+ *
+ * \code
+ * int main(int argc, char **argv)
+ * {
+ *    WUTMarkStartup("main");
+ *    ...
+ *    WUTMarkStartup("first frame");
+ *    WUTReportStartupTimes();
+ * }
+ * \endcode
+ *
+ * The "main" mark also ends the static constructor phase. Other
+ * constructors of priority 101 may run on either side of its start.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTStartupTimes
+{
+   //! All of __init_wut.
+   OSTime total;
+
+   OSTime newlib;
+   OSTime stdcpp;
+
+   //! Setting up "fs:" and mounting the SD card.
+   OSTime devoptab;
+
+   //! Network bring-up on the other core, overlapping devoptab.
+   OSTime socketEarly;
+
+   //! Waiting for socketEarly after devoptab had finished.
+   OSTime join;
+
+   //! The rest of the socket setup on the main thread.
+   OSTime socket;
+} WUTStartupTimes;
+
+typedef struct WUTStartupMark
+{
+   const char *name;
+
+   //! OSGetSystemTime when the mark was recorded.
+   OSTime time;
+} WUTStartupMark;
+
+/**
+ * Record a startup mark. Only the first 32 marks are kept.
+ *
+ * \param name
+ * Must stay valid, usually a string literal.
+ */
+void
+WUTMarkStartup(const char *name);
+
+/**
+ * Copy up to maxMarks startup marks in the order they were recorded.
+ *
+ * \return
+ * The number of marks kept, which may be more than maxMarks.
+ */
+uint32_t
+WUTGetStartupMarks(WUTStartupMark *outMarks,
+                   uint32_t maxMarks);
+
+/**
+ * Get the duration of each __init_wut step, in ticks.
+ */
+void
+WUTGetStartupTimes(WUTStartupTimes *outTimes);
+
+/**
+ * OSReport the duration of each __init_wut step and every startup mark.
+ */
+void
+WUTReportStartupTimes();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
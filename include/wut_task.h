@@ -0,0 +1,500 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_task Coroutines
+ *
+ * C++20 coroutines driven by a single threaded scheduler, with awaitables
+ * for timers, file I/O and socket readiness.
+ *
+ * A wut::task is started when it is awaited or passed to
+ * wut::scheduler::spawn, and every coroutine spawned on a scheduler runs on
+ * the thread calling wut::scheduler::run:
+ *
+ * \code
+ * wut::task<void> download(wut::scheduler &sched, int sock, int file) {
+ *    char buf[512];
+ *    off_t offset = 0;
+ *    while (co_await sched.readable(sock)) {
+ *       ssize_t len = recv(sock, buf, sizeof(buf), 0);
+ *       if (len <= 0) {
+ *          break;
+ *       }
+ *       offset += co_await sched.write(file, buf, len, offset);
+ *    }
+ * }
+ *
+ * wut::scheduler sched;
+ * sched.spawn(download(sched, sock, file));
+ * sched.run();
+ * \endcode
+ *
+ * Only available when compiling as C++20 or later.
+ * @{
+ */
+
+#if defined(__cplusplus) && defined(__cpp_impl_coroutine)
+
+#include <coreinit/alarm.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/time.h>
+#include <wut_devoptab.h>
+#include <wut_poll.h>
+
+#include <atomic>
+#include <coroutine>
+#include <cstdlib>
+#include <optional>
+#include <utility>
+
+namespace wut
+{
+
+template<typename T = void>
+class task;
+
+namespace detail
+{
+
+struct task_promise_base
+{
+   std::coroutine_handle<> continuation;
+   bool detached = false;
+
+   struct final_awaiter
+   {
+      bool await_ready() noexcept { return false; }
+
+      template<typename Promise>
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+      {
+         task_promise_base &promise = handle.promise();
+         if (promise.continuation) {
+            return promise.continuation;
+         }
+
+         if (promise.detached) {
+            handle.destroy();
+         }
+         return std::noop_coroutine();
+      }
+
+      void await_resume() noexcept { }
+   };
+
+   std::suspend_always initial_suspend() noexcept { return {}; }
+   final_awaiter final_suspend() noexcept { return {}; }
+
+   // Built without exceptions
+   void unhandled_exception() noexcept { std::abort(); }
+};
+
+//! A resume that could not be posted, kept until the scheduler runs it.
+struct deferred_resume
+{
+   std::coroutine_handle<> handle;
+   deferred_resume *next;
+};
+
+template<typename T>
+struct task_promise : task_promise_base
+{
+   std::optional<T> value;
+
+   task<T> get_return_object() noexcept;
+   void return_value(T v) { value.emplace(std::move(v)); }
+   T result() { return std::move(*value); }
+};
+
+template<>
+struct task_promise<void> : task_promise_base
+{
+   task<void> get_return_object() noexcept;
+   void return_void() noexcept { }
+   void result() noexcept { }
+};
+
+} // namespace detail
+
+//! A lazily started coroutine returning T.
+template<typename T>
+class task
+{
+public:
+   using promise_type = detail::task_promise<T>;
+   using handle_type = std::coroutine_handle<promise_type>;
+
+   explicit task(handle_type handle) noexcept : mHandle(handle) { }
+   task(task &&other) noexcept : mHandle(std::exchange(other.mHandle, nullptr)) { }
+   task(const task &) = delete;
+   task &operator=(const task &) = delete;
+
+   ~task()
+   {
+      if (mHandle) {
+         mHandle.destroy();
+      }
+   }
+
+   bool await_ready() const noexcept { return !mHandle || mHandle.done(); }
+
+   std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+   {
+      mHandle.promise().continuation = awaiting;
+      return mHandle;
+   }
+
+   T await_resume() { return mHandle.promise().result(); }
+
+   //! Give up ownership, the coroutine frees itself once it completes.
+   handle_type detach() noexcept
+   {
+      mHandle.promise().detached = true;
+      return std::exchange(mHandle, nullptr);
+   }
+
+private:
+   handle_type mHandle;
+};
+
+namespace detail
+{
+
+template<typename T>
+inline task<T> task_promise<T>::get_return_object() noexcept
+{
+   return task<T> { std::coroutine_handle<task_promise<T>>::from_promise(*this) };
+}
+
+inline task<void> task_promise<void>::get_return_object() noexcept
+{
+   return task<void> { std::coroutine_handle<task_promise<void>>::from_promise(*this) };
+}
+
+} // namespace detail
+
+/**
+ * Runs coroutines on the thread calling run().
+ *
+ * Completions from alarms and the async I/O thread are passed to the
+ * scheduler through a message queue of MaxPending entries. The I/O thread
+ * waits while it is full, alarms can't, so their resumes are kept aside
+ * and run once the scheduler gets to them.
+ *
+ * Any number of coroutines can wait on the same socket at once.
+ */
+class scheduler
+{
+public:
+   static constexpr uint32_t MaxPending = 128;
+
+   scheduler()
+   {
+      OSInitMessageQueueEx(&mQueue, mMessages, MaxPending, "wut scheduler");
+      mPoll = wut_poll_create();
+   }
+
+   ~scheduler()
+   {
+      if (mPoll) {
+         wut_poll_destroy(mPoll);
+      }
+   }
+
+   scheduler(const scheduler &) = delete;
+   scheduler &operator=(const scheduler &) = delete;
+
+   //! Start a task, run() returns once every spawned task completed.
+   void spawn(task<void> t)
+   {
+      ++mOutstanding;
+      post(run_spawned(this, std::move(t)).detach());
+   }
+
+   //! Resume a coroutine on the scheduler thread, callable from any thread.
+   bool post(std::coroutine_handle<> handle, bool blocking = true)
+   {
+      OSMessage message = {};
+      message.message = handle.address();
+      return OSSendMessage(&mQueue, &message,
+                           blocking ? OS_MESSAGE_FLAGS_BLOCKING : OS_MESSAGE_FLAGS_NONE);
+   }
+
+   /**
+    * Resume a coroutine on the scheduler thread, callable from an alarm
+    * callback. Never blocks and never drops the resume, resume has to stay
+    * valid until the coroutine is resumed.
+    */
+   void post_from_interrupt(detail::deferred_resume *resume)
+   {
+      if (post(resume->handle, false)) {
+         return;
+      }
+
+      detail::deferred_resume *head = mDeferred.load(std::memory_order_relaxed);
+      do {
+         resume->next = head;
+      } while (!mDeferred.compare_exchange_weak(head, resume,
+                                                std::memory_order_release,
+                                                std::memory_order_relaxed));
+
+      // run() may have emptied the queue before the resume was kept aside,
+      // if this fails too the queue is still full and run() wakes anyway
+      post(nullptr, false);
+   }
+
+   //! Run coroutines until every spawned task completed.
+   void run()
+   {
+      while (mOutstanding) {
+         if (resume_deferred()) {
+            continue;
+         }
+
+         OSMessage message;
+         bool block = (mSocketWaiters == 0);
+         if (OSReceiveMessage(&mQueue, &message, block ? OS_MESSAGE_FLAGS_BLOCKING : OS_MESSAGE_FLAGS_NONE)) {
+            if (message.message) {
+               std::coroutine_handle<>::from_address(message.message).resume();
+            }
+            continue;
+         }
+
+         poll_sockets(1);
+      }
+   }
+
+   //! Awaitable that resumes after the given number of ticks.
+   auto sleep_for(OSTime ticks)
+   {
+      struct awaiter
+      {
+         scheduler *sched;
+         OSTime ticks;
+         OSAlarm alarm;
+         detail::deferred_resume resume;
+
+         bool await_ready() const noexcept { return ticks <= 0; }
+
+         void await_suspend(std::coroutine_handle<> h)
+         {
+            resume.handle = h;
+            OSCreateAlarm(&alarm);
+            OSSetAlarmUserData(&alarm, this);
+            OSSetAlarm(&alarm, ticks, &callback);
+         }
+
+         void await_resume() const noexcept { }
+
+         static void callback(OSAlarm *alarm, OSContext *)
+         {
+            auto self = static_cast<awaiter *>(OSGetAlarmUserData(alarm));
+            self->sched->post_from_interrupt(&self->resume);
+         }
+      };
+
+      return awaiter { this, ticks, {}, {} };
+   }
+
+   //! Awaitable pread() on the async I/O thread, returns the result.
+   auto read(int fd, void *buffer, size_t size, off_t offset)
+   {
+      return io_awaiter { this, false, fd, buffer, size, offset, {}, {} };
+   }
+
+   //! Awaitable pwrite() on the async I/O thread, returns the result.
+   auto write(int fd, const void *buffer, size_t size, off_t offset)
+   {
+      return io_awaiter { this, true, fd, const_cast<void *>(buffer), size, offset, {}, {} };
+   }
+
+   //! Awaitable that resumes once a socket is readable, returns false on error.
+   auto readable(int fd) { return socket_awaiter { this, fd, POLLIN, {}, false, nullptr }; }
+
+   //! Awaitable that resumes once a socket is writable, returns false on error.
+   auto writable(int fd) { return socket_awaiter { this, fd, POLLOUT, {}, false, nullptr }; }
+
+private:
+   struct io_awaiter
+   {
+      scheduler *sched;
+      bool write;
+      int fd;
+      void *buffer;
+      size_t size;
+      off_t offset;
+      WUTDevoptabAsyncRequest request;
+      std::coroutine_handle<> handle;
+
+      bool await_ready() const noexcept { return false; }
+
+      bool await_suspend(std::coroutine_handle<> h)
+      {
+         handle = h;
+         request = {};
+         request.fd = fd;
+         request.buffer = buffer;
+         request.size = size;
+         request.offset = offset;
+         request.callback = &callback;
+         request.userContext = this;
+
+         BOOL queued = write ? WUTDevoptabWriteAsync(&request) : WUTDevoptabReadAsync(&request);
+         return queued;
+      }
+
+      ssize_t await_resume() const noexcept { return request.done ? request.result : -1; }
+
+      static void callback(WUTDevoptabAsyncRequest *, void *userContext)
+      {
+         auto self = static_cast<io_awaiter *>(userContext);
+         self->sched->post(self->handle);
+      }
+   };
+
+   struct socket_awaiter
+   {
+      scheduler *sched;
+      int fd;
+      int events;
+      std::coroutine_handle<> handle;
+      bool ok;
+      socket_awaiter *next;
+
+      bool await_ready() const noexcept { return false; }
+
+      bool await_suspend(std::coroutine_handle<> h)
+      {
+         int wanted = events;
+         bool added = false;
+
+         handle = h;
+         if (!sched->mPoll) {
+            return false;
+         }
+
+         // The socket is in the set once, for everything its waiters want
+         for (socket_awaiter *waiter = sched->mSockets; waiter; waiter = waiter->next) {
+            if (waiter->fd == fd) {
+               wanted |= waiter->events;
+               added = true;
+            }
+         }
+
+         if ((added ? wut_poll_mod(sched->mPoll, fd, wanted, nullptr)
+                    : wut_poll_add(sched->mPoll, fd, wanted, nullptr)) < 0) {
+            return false;
+         }
+
+         next = sched->mSockets;
+         sched->mSockets = this;
+         ++sched->mSocketWaiters;
+         return true;
+      }
+
+      bool await_resume() const noexcept { return ok; }
+   };
+
+   static task<void> run_spawned(scheduler *sched, task<void> t)
+   {
+      co_await t;
+      --sched->mOutstanding;
+   }
+
+   //! Resume the coroutines kept aside by post_from_interrupt, oldest first.
+   bool resume_deferred()
+   {
+      detail::deferred_resume *resume = mDeferred.exchange(nullptr, std::memory_order_acquire);
+      detail::deferred_resume *ordered = nullptr;
+
+      if (!resume) {
+         return false;
+      }
+
+      while (resume) {
+         detail::deferred_resume *next = resume->next;
+         resume->next = ordered;
+         ordered = resume;
+         resume = next;
+      }
+
+      while (ordered) {
+         // The resumed coroutine owns the entry
+         detail::deferred_resume *next = ordered->next;
+         ordered->handle.resume();
+         ordered = next;
+      }
+
+      return true;
+   }
+
+   void poll_sockets(int timeout)
+   {
+      wut_poll_event events[16];
+      socket_awaiter *ready = nullptr, **readyTail = &ready;
+      int count = mSocketWaiters ? wut_poll_wait(mPoll, events, 16, timeout) : 0;
+
+      if (count < 0) {
+         // Usually a socket closed while awaited, select doesn't say which one
+         // so fail every waiter rather than retrying the same select forever
+         while (mSockets) {
+            socket_awaiter *waiter = mSockets;
+            mSockets = waiter->next;
+            wut_poll_del(mPoll, waiter->fd);
+            waiter->ok = false;
+            waiter->next = nullptr;
+            *readyTail = waiter;
+            readyTail = &waiter->next;
+            --mSocketWaiters;
+         }
+      }
+
+      // Waiters are resumed after the set is updated, they may wait again
+      for (int i = 0; i < count; ++i) {
+         int remaining = 0;
+
+         for (socket_awaiter **link = &mSockets; *link; ) {
+            socket_awaiter *waiter = *link;
+            if (waiter->fd != events[i].fd) {
+               link = &waiter->next;
+            } else if (events[i].events & waiter->events) {
+               *link = waiter->next;
+               waiter->ok = true;
+               waiter->next = nullptr;
+               *readyTail = waiter;
+               readyTail = &waiter->next;
+               --mSocketWaiters;
+            } else {
+               remaining |= waiter->events;
+               link = &waiter->next;
+            }
+         }
+
+         if (remaining) {
+            wut_poll_mod(mPoll, events[i].fd, remaining, nullptr);
+         } else {
+            wut_poll_del(mPoll, events[i].fd);
+         }
+      }
+
+      while (ready) {
+         socket_awaiter *next = ready->next;
+         ready->handle.resume();
+         ready = next;
+      }
+   }
+
+   OSMessageQueue mQueue;
+   OSMessage mMessages[MaxPending];
+   wut_poll_t *mPoll = nullptr;
+   uint32_t mOutstanding = 0;
+   uint32_t mSocketWaiters = 0;
+   socket_awaiter *mSockets = nullptr;
+   std::atomic<detail::deferred_resume *> mDeferred { nullptr };
+};
+
+} // namespace wut
+
+#endif
+
+/** @} */
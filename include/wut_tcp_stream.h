@@ -0,0 +1,121 @@
+#pragma once
+#include <wut.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * \defgroup wut_tcp_stream Buffered TCP stream
+ *
+ * Write coalescing for TCP sockets.
+ *
+ * Every send is a round trip to the network stack, and with Nagle's
+ * algorithm a small write after another can sit waiting for an ACK. A
+ * wut_tcp_stream_t gathers writes into one buffer and sends it with a
+ * single send per flush, and turns TCP_NODELAY on so a flush goes out
+ * straight away.
+ *
+ * Without a cork each write or writev call is flushed before it returns, so
+ * a header and payload passed to wut_tcp_stream_writev go out together.
+ * Between wut_tcp_stream_cork and wut_tcp_stream_uncork writes are only
+ * sent once the buffer is full.
+ *
+ * \code
+ * wut_tcp_stream_t *stream = wut_tcp_stream_create(fd, 0);
+ * wut_tcp_stream_cork(stream);
+ * wut_tcp_stream_write(stream, &header, sizeof(header));
+ * wut_tcp_stream_write(stream, payload, payloadSize);
+ * wut_tcp_stream_uncork(stream);
+ * \endcode
+ *
+ * A stream is not thread-safe and does not own the socket. On a
+ * non-blocking socket data that could not be sent stays buffered, and is
+ * sent by the next flush.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Buffer size used when 0 is passed to wut_tcp_stream_create.
+#define WUT_TCP_STREAM_DEFAULT_BUFFER_SIZE (16 * 1024)
+
+typedef struct wut_tcp_stream wut_tcp_stream_t;
+
+/**
+ * Create a stream over a connected TCP socket and enable TCP_NODELAY.
+ *
+ * \return
+ * NULL with errno set on error.
+ */
+wut_tcp_stream_t *
+wut_tcp_stream_create(int fd,
+                      size_t bufferSize);
+
+/**
+ * Flush and destroy a stream, the socket is not closed.
+ */
+void
+wut_tcp_stream_destroy(wut_tcp_stream_t *stream);
+
+/**
+ * Buffer data to send.
+ *
+ * Data bigger than the buffer is sent directly after what is already
+ * buffered.
+ *
+ * \return
+ * The number of bytes taken, or -1 with errno set if none were.
+ */
+ssize_t
+wut_tcp_stream_write(wut_tcp_stream_t *stream,
+                     const void *buf,
+                     size_t len);
+
+/**
+ * Buffer data from several buffers, flushed as one send without a cork.
+ *
+ * \return
+ * The number of bytes taken, or -1 with errno set if none were.
+ */
+ssize_t
+wut_tcp_stream_writev(wut_tcp_stream_t *stream,
+                      const struct iovec *iov,
+                      int iovcnt);
+
+/**
+ * Hold writes in the buffer until wut_tcp_stream_uncork. Corks nest.
+ */
+void
+wut_tcp_stream_cork(wut_tcp_stream_t *stream);
+
+/**
+ * Release a cork, flushing the buffer once the last one is released.
+ *
+ * \return
+ * 0 on success, -1 with errno set if the flush failed.
+ */
+int
+wut_tcp_stream_uncork(wut_tcp_stream_t *stream);
+
+/**
+ * Send everything buffered.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error, EWOULDBLOCK if a non-blocking
+ * socket could not take it all.
+ */
+int
+wut_tcp_stream_flush(wut_tcp_stream_t *stream);
+
+/**
+ * Get the number of bytes buffered and not sent yet.
+ */
+size_t
+wut_tcp_stream_pending(wut_tcp_stream_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,128 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_thread std::thread
+ *
+ * Options for the threads created by std::thread and other C++ threading
+ * functions.
+ *
+ * Attributes such as the stack size, priority and affinity are set per
+ * calling thread and apply to every thread it creates afterwards.
+ *
+ * The stack size of every such thread defaults to 128 KiB, which can be
+ * changed for all of them by overriding __wut_thread_default_stack_size.
+ * To avoid allocating a new OSThread and stack for every short lived
+ * thread, finished threads can be kept for reuse by overriding
+ * __wut_thread_pool_size with the number of threads to keep:
+ *
+ * \code
+ * uint32_t __wut_thread_pool_size = 8;
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTThreadAttributes
+{
+   //! Stack size in bytes, 0 for __wut_thread_default_stack_size.
+   uint32_t stackSize;
+
+   //! Priority from 0 (highest) to 31 (lowest), 16 by default.
+   int32_t priority;
+
+   //! Cores the thread may run on, OS_THREAD_ATTRIB_AFFINITY_ANY by default.
+   OSThreadAttributes affinity;
+
+   //! Run quantum in microseconds, see OSSetThreadRunQuantum, 1000 by
+   //! default. 0 lets the thread run until it blocks or yields.
+   uint32_t runQuantum;
+} WUTThreadAttributes;
+
+/**
+ * Get the attributes used if none were set.
+ */
+void
+WUTThreadGetDefaultAttributes(WUTThreadAttributes *outAttribs);
+
+/**
+ * Set the attributes of threads created by the calling thread, e.g. to pin
+ * the workers created by a std::thread pool to a core:
+ *
+ * \code
+ * WUTThreadAttributes attribs;
+ * WUTThreadGetDefaultAttributes(&attribs);
+ * attribs.affinity = OS_THREAD_ATTRIB_AFFINITY_CPU0;
+ * attribs.runQuantum = 0;
+ * WUTThreadSetAttributes(&attribs);
+ * std::thread worker(run);
+ * WUTThreadSetAttributes(NULL);
+ * \endcode
+ *
+ * \param attribs
+ * The attributes, or NULL to go back to the defaults.
+ *
+ * \return
+ * FALSE if the attributes are invalid or could not be stored.
+ */
+BOOL
+WUTThreadSetAttributes(const WUTThreadAttributes *attribs);
+
+/**
+ * Get the attributes of threads created by the calling thread.
+ */
+void
+WUTThreadGetAttributes(WUTThreadAttributes *outAttribs);
+
+/**
+ * Set the stack size of threads created by the calling thread, or 0 to go
+ * back to __wut_thread_default_stack_size.
+ */
+void
+WUTThreadSetStackSize(uint32_t size);
+
+/**
+ * Get the stack size of threads created by the calling thread.
+ */
+uint32_t
+WUTThreadGetStackSize(void);
+
+/**
+ * Join a std::thread, given by its native_handle(), unless it does not
+ * finish within timeout ticks.
+ *
+ * The wait is on an event signalled when the thread exits, so no alarm is
+ * set up per call. Only works for threads created by std::thread.
+ *
+ * \return
+ * FALSE if the thread has not finished in time, in which case it can still
+ * be joined or detached later.
+ */
+BOOL
+WUTThreadJoinWithTimeout(OSThread *thread,
+                         OSTime timeout,
+                         int *outResult);
+
+/**
+ * Lock a std::mutex, std::timed_mutex or OSMutex, given by its
+ * native_handle(), or give up after timeout ticks. A recursive mutex that
+ * is already held by the calling thread is locked again.
+ *
+ * \return
+ * FALSE if the mutex could not be locked in time.
+ */
+BOOL
+WUTMutexLockWithTimeout(OSMutex *mutex,
+                        OSTime timeout);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,145 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_thread_stats Thread statistics
+ *
+ * A registry of threads with their CPU time and stack high-water mark, and
+ * the utilisation of each core, to size stacks and balance work between the
+ * cores.
+ *
+ * While running, an alarm on every core samples which thread it
+ * interrupted, so the time of a thread is the number of samples it was
+ * seen in times the interval. Stack usage comes from
+ * OSCheckThreadStackUsage, the unused part of a stack is filled when its
+ * thread is registered and scanned whenever statistics are read.
+ *
+ * Threads created by std::thread and the other gthread functions, and the
+ * helper threads of libwhb, are registered automatically when they are
+ * created after WUTThreadStatsStart. Others can be added with WUTThreadStatsRegister.
+ *
+ * \code
+ * WUTThreadStatsStart(1000);
+ * // run the workload
+ * WUTThreadStatsReport();
+ * WUTThreadStatsStop();
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of threads the registry holds, later registrations fail.
+#define WUT_THREAD_STATS_MAX_THREADS 64
+
+typedef struct WUTThreadStats
+{
+   OSThread *thread;
+
+   //! Name of the thread, copied from OSGetThreadName when read.
+   char name[32];
+
+   //! Size of the stack in bytes.
+   uint32_t stackSize;
+
+   //! Most stack the thread has used in bytes, or -1 if it is not tracked.
+   int32_t stackUsed;
+
+   //! Samples the thread was seen running in, per core.
+   uint32_t samples[3];
+
+   //! Estimated time the thread ran, all cores together.
+   OSTime runTicks;
+} WUTThreadStats;
+
+typedef struct WUTCoreStats
+{
+   //! Samples taken on the core.
+   uint32_t samples;
+
+   //! Samples where no thread was running.
+   uint32_t idleSamples;
+
+   //! Samples of threads that are not registered.
+   uint32_t otherSamples;
+
+   //! Percentage of samples where a thread was running.
+   float utilisation;
+} WUTCoreStats;
+
+/**
+ * Add a thread to the registry.
+ *
+ * To track its stack the thread must not have been resumed yet, or be the
+ * calling thread. The thread unregisters itself when it exits by chaining
+ * onto its cleanup callback, so a callback set after registering replaces
+ * that and WUTThreadStatsUnregister has to be called instead.
+ *
+ * \return
+ * FALSE if the registry is full.
+ */
+BOOL
+WUTThreadStatsRegister(OSThread *thread);
+
+/**
+ * Remove a thread from the registry.
+ */
+void
+WUTThreadStatsUnregister(OSThread *thread);
+
+/**
+ * Start sampling every core every intervalUs microseconds, 1000 if 0.
+ */
+BOOL
+WUTThreadStatsStart(uint32_t intervalUs);
+
+/**
+ * Stop sampling, the registry and the samples so far are kept.
+ */
+void
+WUTThreadStatsStop(void);
+
+/**
+ * Clear all samples, stack high-water marks are kept.
+ */
+void
+WUTThreadStatsReset(void);
+
+/**
+ * Get the registered threads, ordered by run time.
+ *
+ * \return
+ * Number of entries written to outStats, at most maxStats.
+ */
+uint32_t
+WUTThreadStatsGetThreads(WUTThreadStats *outStats,
+                         uint32_t maxStats);
+
+/**
+ * Get the statistics of the three cores.
+ */
+void
+WUTThreadStatsGetCores(WUTCoreStats *outStats);
+
+/**
+ * Get the most stack used by any registered thread that has exited, in
+ * bytes, so short lived workers can be sized too.
+ */
+uint32_t
+WUTThreadStatsGetExitedStackUsed(void);
+
+/**
+ * Print the core utilisation and every registered thread with OSReport.
+ */
+void
+WUTThreadStatsReport(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,87 @@
+#pragma once
+#include <wut.h>
+#include <gx2/surface.h>
+
+/**
+ * \defgroup wut_tiling CPU surface tiling
+ *
+ * Write linear image data straight into a tiled GX2Surface, e.g. a video
+ * frame or a changed part of a UI atlas, without a linear staging surface
+ * and a GX2CopySurface pass on the GPU.
+ *
+ * \code
+ * WUTTilingRect rect = { 64, 32, 128, 128 };
+ * WUTTilingUpload(&texture->surface, pixels, 128 * 4, &rect);
+ *
+ * // On the rendering thread, before the texture is sampled
+ * GX2Invalidate(GX2_INVALIDATE_MODE_TEXTURE, texture->surface.image, texture->surface.imageSize);
+ * \endcode
+ *
+ * Supports the first mip level and slice of single sample surfaces with
+ * GX2_TILE_MODE_LINEAR_ALIGNED, GX2_TILE_MODE_TILED_1D_THIN1 or
+ * GX2_TILE_MODE_TILED_2D_THIN1, the mode GX2 picks for most textures. The
+ * destination address of every 8x8 micro tile is computed once, with the
+ * pipe and bank swizzle of GX2GetSurfaceSwizzle, and its rows are copied
+ * in runs of 8 or 16 bytes. Micro tiles that are covered entirely have
+ * their cache lines allocated with dcbz, so the destination is never read.
+ *
+ * Coordinates are in elements, i.e. in 4x4 blocks for BC formats.
+ * Both functions flush the CPU cache over what they wrote, the GPU
+ * texture cache must still be invalidated before the surface is sampled.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTTilingRect
+{
+   uint32_t x;
+   uint32_t y;
+   uint32_t width;
+   uint32_t height;
+} WUTTilingRect;
+
+/**
+ * Check whether the surface can be written by WUTTilingUpload.
+ */
+BOOL
+WUTTilingIsSupported(const GX2Surface *surface);
+
+/**
+ * Tile a linear image into a rectangle of a surface.
+ *
+ * \param src
+ * First element of the rectangle.
+ *
+ * \param srcPitch
+ * Bytes from one row of src to the next.
+ *
+ * \param rect
+ * Part of the surface to write, or NULL for all of it.
+ *
+ * \return
+ * FALSE if the surface is not supported or rect is outside of it.
+ */
+BOOL
+WUTTilingUpload(const GX2Surface *surface,
+                const void *src,
+                uint32_t srcPitch,
+                const WUTTilingRect *rect);
+
+/**
+ * WUTTilingUpload split across the cores with WUTJobParallelFor, in rows
+ * of micro tiles. Without WUTJobSystemInit it runs on the calling thread.
+ */
+BOOL
+WUTTilingUploadParallel(const GX2Surface *surface,
+                        const void *src,
+                        uint32_t srcPitch,
+                        const WUTTilingRect *rect);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,44 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+#include <time.h>
+
+/**
+ * \defgroup wut_time Time
+ *
+ * Cheap conversions of OSTime ticks for instrumentation.
+ * @{
+ */
+
+#ifndef CLOCK_MONOTONIC_RAW
+//! The system timer in clock_gettime, the same as CLOCK_MONOTONIC since the
+//! timer is never adjusted.
+#define CLOCK_MONOTONIC_RAW ((clockid_t)0x57540001)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Convert ticks, e.g. from OSGetSystemTime, to nanoseconds with
+ * multiplications instead of the 64-bit division of OSTicksToNanoseconds.
+ */
+uint64_t
+WUTTicksToNanoseconds(OSTime ticks);
+
+/**
+ * Sleep until OSGetSystemTime() reaches deadline, e.g. in a frame limiter.
+ *
+ * The thread sleeps for most of the time and spins for the last
+ * __wut_nanosleep_spin_us microseconds (200 by default) so it wakes up
+ * close to the deadline. nanosleep sleeps the same way.
+ */
+void
+wut_precise_sleep_until(OSTime deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,148 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_timer_wheel Timer wheel
+ *
+ * Many software timers on one OSAlarm, for timeouts, retransmits and
+ * gameplay timers that would otherwise each need an alarm of their own.
+ *
+ * Timers are kept in a hierarchical wheel of 4 levels of 64 slots, so
+ * adding and cancelling a timer is O(1) whatever the number of timers.
+ * Time advances in ticks of a fixed length, a timer fires on the first tick
+ * at or after its expiry.
+ *
+ * Callbacks run on the thread that calls WUTTimerWheelPoll, e.g. once a
+ * frame from the main loop, or on a thread of the wheel's own started with
+ * WUTTimerWheelStartThread, which is woken by a single periodic alarm.
+ *
+ * \code
+ * static void
+ * retransmit(WUTTimer *timer, void *userContext)
+ * {
+ *    resend((Packet *)userContext);
+ * }
+ *
+ * WUTTimerWheel *wheel = WUTTimerWheelCreate(1000);
+ * WUTTimerWheelStartThread(wheel, 16, OS_THREAD_ATTRIB_AFFINITY_CPU2);
+ *
+ * WUTTimerInit(&packet->timer, retransmit, packet);
+ * WUTTimerWheelAdd(wheel, &packet->timer, OSMillisecondsToTicks(200), 0);
+ * ...
+ * WUTTimerWheelCancel(wheel, &packet->timer);
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTTimerWheel WUTTimerWheel;
+typedef struct WUTTimer WUTTimer;
+
+typedef void (*WUTTimerCallback)(WUTTimer *timer, void *userContext);
+
+/**
+ * A software timer, owned by the caller.
+ *
+ * A timer must stay valid while it is pending and must not be added to two
+ * wheels at once.
+ */
+struct WUTTimer
+{
+   WUTTimerCallback callback;
+   void *userContext;
+
+   //! Internal.
+   WUTTimer *next;
+   WUTTimer *prev;
+   WUTTimer **list;
+   WUTTimerWheel *wheel;
+   uint32_t expires;
+   uint32_t period;
+};
+
+/**
+ * Create a wheel that advances every tickUs microseconds, 1000 if 0.
+ *
+ * \return
+ * NULL on error.
+ */
+WUTTimerWheel *
+WUTTimerWheelCreate(uint32_t tickUs);
+
+/**
+ * Stop the wheel's thread if it has one and free the wheel. Timers still
+ * pending are dropped without their callbacks being called.
+ */
+void
+WUTTimerWheelDestroy(WUTTimerWheel *wheel);
+
+/**
+ * Start a thread that runs the callbacks, woken every tick by a periodic
+ * alarm. WUTTimerWheelPoll must not be called afterwards.
+ */
+BOOL
+WUTTimerWheelStartThread(WUTTimerWheel *wheel,
+                         int32_t priority,
+                         OSThreadAttributes affinity);
+
+/**
+ * Run the callbacks of every timer that expired since the last call.
+ *
+ * Callbacks are called without the wheel locked and may add or cancel any
+ * timer, including their own.
+ *
+ * \return
+ * Number of callbacks called.
+ */
+uint32_t
+WUTTimerWheelPoll(WUTTimerWheel *wheel);
+
+/**
+ * Initialise a timer.
+ */
+void
+WUTTimerInit(WUTTimer *timer,
+             WUTTimerCallback callback,
+             void *userContext);
+
+/**
+ * Arm a timer to fire after delay, and then every period if it is not 0.
+ * Re-arms the timer if it is already pending.
+ *
+ * Delays longer than 2^24 ticks are allowed, such timers are moved down the
+ * wheel as their expiry gets closer.
+ */
+BOOL
+WUTTimerWheelAdd(WUTTimerWheel *wheel,
+                 WUTTimer *timer,
+                 OSTime delay,
+                 OSTime period);
+
+/**
+ * Disarm a timer.
+ *
+ * A callback that is already running on another thread is not waited for.
+ *
+ * \return
+ * TRUE if the timer was pending.
+ */
+BOOL
+WUTTimerWheelCancel(WUTTimerWheel *wheel,
+                    WUTTimer *timer);
+
+/**
+ * Check whether a timer is armed.
+ */
+BOOL
+WUTTimerIsPending(WUTTimer *timer);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
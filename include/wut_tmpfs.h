@@ -0,0 +1,72 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/memheap.h>
+
+/**
+ * \defgroup wut_tmpfs RAM disk devoptab
+ *
+ * Mount a device holding files and directories in memory, for temporary
+ * files that don't need to reach the SD card, e.g. decompression scratch
+ * space or the temp store of sqlite.
+ *
+ * \code
+ * // 16 MiB from the default heap
+ * WUTTmpfsMount("tmp", NULL, 16 * 1024 * 1024);
+ *
+ * FILE *f = fopen("tmp:/scratch.bin", "w+b");
+ * ...
+ * fclose(f);
+ * unlink("tmp:/scratch.bin");
+ *
+ * WUTTmpfsUnmount("tmp");
+ * \endcode
+ *
+ * File data is stored in WUT_TMPFS_PAGE_SIZE pages allocated from the heap
+ * as a file grows, so a file never has to be copied to grow and unwritten
+ * ranges below the end of a file don't take any memory. Everything is lost
+ * when the device is unmounted or the application exits.
+ *
+ * Files can be unlinked while open, their memory is released when the last
+ * handle is closed.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WUT_TMPFS_PAGE_SIZE 0x1000
+
+/**
+ * Mount a new, empty RAM disk as device name.
+ *
+ * \param heap
+ * Expanded heap to allocate files from, NULL for the default heap.
+ *
+ * \param maxSize
+ * Maximum number of bytes of file data, 0 for no limit besides the heap.
+ * Writes beyond it fail with ENOSPC.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error.
+ */
+int
+WUTTmpfsMount(const char *name,
+              MEMHeapHandle heap,
+              uint32_t maxSize);
+
+/**
+ * Unmount a RAM disk and free everything stored on it, files and
+ * directories opened on it must be closed first.
+ *
+ * \return
+ * 0 on success, -1 with errno set on error, EBUSY if files are still open.
+ */
+int
+WUTTmpfsUnmount(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
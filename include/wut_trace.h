@@ -0,0 +1,47 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wut_trace Runtime trace hook
+ *
+ * The devoptab handlers and the socket wrappers report a span for every
+ * call to __wut_trace_span if something defines it, e.g. the libwhb trace
+ * API. It is a weak symbol, so without a definition every call site only
+ * costs a branch and no timestamps are taken.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTTraceSpan
+{
+   //! Name of the call, e.g. "fs read" or "socket recv", a string literal.
+   const char *name;
+
+   //! Path of the file or directory, or NULL. Only valid during the call.
+   const char *path;
+
+   //! File descriptor or socket, or -1.
+   int fd;
+
+   //! Bytes transferred, or the negative result of a failed call.
+   int64_t bytes;
+
+   OSTime start;
+   OSTime end;
+} WUTTraceSpan;
+
+/**
+ * Called on the calling thread once a traced call has returned.
+ */
+void
+__wut_trace_span(const WUTTraceSpan *span) __attribute__((weak));
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
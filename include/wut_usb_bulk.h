@@ -0,0 +1,129 @@
+#pragma once
+#include <wut.h>
+#include <nsysuhs/uhs.h>
+#include <wut_ios.h>
+
+/**
+ * \defgroup wut_usb_bulk USB bulk transfer queue
+ *
+ * Queues bulk transfers on one endpoint, so the caller can keep the next
+ * transfers lined up without blocking on UhsSubmitBulkRequest.
+ *
+ * UhsSubmitBulkRequest blocks until its transfer has completed, and the
+ * data of a bulk endpoint is an ordered stream, so a queue runs a single
+ * worker thread that issues the transfers one at a time in the order they
+ * were submitted. Each completes through a callback on the worker thread,
+ * in the same order. Buffers come from a pool of cache line aligned IPC
+ * buffers owned by the queue:
+ *
+ * \code
+ * WUTUsbBulkQueue *queue = WUTUsbBulkQueueCreate(&handle, ifHandle, 1,
+ *                                                ENDPOINT_TRANSFER_IN,
+ *                                                4, 0x4000, 16);
+ * WUTIOSBufferPool *pool = WUTUsbBulkGetBufferPool(queue);
+ *
+ * for (i = 0; i < 4; ++i) {
+ *    transfers[i].buffer = WUTIOSBufferAlloc(pool);
+ *    transfers[i].length = 0x4000;
+ *    transfers[i].timeout = TIMEOUT_NONE;
+ *    transfers[i].callback = onTransfer; // consumes and resubmits
+ *    WUTUsbBulkSubmit(queue, &transfers[i]);
+ * }
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTUsbBulkQueue WUTUsbBulkQueue;
+typedef struct WUTUsbBulkTransfer WUTUsbBulkTransfer;
+
+typedef void (*WUTUsbBulkCallbackFn)(WUTUsbBulkTransfer *transfer,
+                                     void *userContext);
+
+/**
+ * A bulk transfer, which must stay valid until it has completed.
+ */
+struct WUTUsbBulkTransfer
+{
+   //! Data to send or receive, aligned to 0x40 bytes.
+   void *buffer;
+
+   //! Number of bytes to transfer, at most the queue's maxTransferSize.
+   int32_t length;
+
+   //! Timeout in milliseconds, or TIMEOUT_NONE.
+   int32_t timeout;
+
+   //! Called from the worker thread once the transfer has completed, can be
+   //! NULL. May submit the transfer again.
+   WUTUsbBulkCallbackFn callback;
+
+   //! Passed to callback.
+   void *userContext;
+
+   //! Bytes transferred, or a negative UHSStatus on error.
+   volatile int32_t result;
+
+   //! TRUE once the transfer has completed.
+   volatile BOOL done;
+};
+
+/**
+ * Enable a bulk endpoint for up to maxPending outstanding transfers and
+ * start the queue's worker thread.
+ *
+ * \param endpoint
+ * Endpoint number, without the direction bit.
+ *
+ * \param direction
+ * ENDPOINT_TRANSFER_IN or ENDPOINT_TRANSFER_OUT.
+ *
+ * \param queueLength
+ * Number of submitted transfers that can wait for the worker.
+ *
+ * \return
+ * NULL on error.
+ */
+WUTUsbBulkQueue *
+WUTUsbBulkQueueCreate(UhsHandle *handle,
+                      uint32_t ifHandle,
+                      uint8_t endpoint,
+                      int32_t direction,
+                      uint32_t maxPending,
+                      uint32_t maxTransferSize,
+                      uint32_t queueLength);
+
+/**
+ * Finish every submitted transfer, stop the worker, disable the endpoint
+ * and free the queue and its buffer pool.
+ *
+ * Transfers resubmitted from a callback while the queue is destroyed may
+ * not be run.
+ */
+void
+WUTUsbBulkQueueDestroy(WUTUsbBulkQueue *queue);
+
+/**
+ * Get the pool of maxPending * 2 buffers of maxTransferSize bytes.
+ */
+WUTIOSBufferPool *
+WUTUsbBulkGetBufferPool(WUTUsbBulkQueue *queue);
+
+/**
+ * Queue a transfer, without blocking.
+ *
+ * \return
+ * FALSE if queueLength transfers are already waiting.
+ */
+BOOL
+WUTUsbBulkSubmit(WUTUsbBulkQueue *queue,
+                 WUTUsbBulkTransfer *transfer);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,89 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup wut_virtual_arena Virtual arenas
+ *
+ * A range of virtual addresses reserved once and backed with memory page by
+ * page as it is used, so a buffer at the start of it can grow without ever
+ * moving:
+ *
+ * \code
+ * WUTVirtualArena arena;
+ * WUTVirtualArenaCreate(&arena, 256 * 1024 * 1024);
+ *
+ * WUTVirtualArenaCommit(&arena, used + size); // pointers stay valid
+ * ...
+ * WUTVirtualArenaDecommit(&arena, 0);         // give the pages back
+ * WUTVirtualArenaDestroy(&arena);
+ * \endcode
+ *
+ * Pages are OS_PAGE_SIZE, 128 KiB. One is backed by a page sized block from
+ * the default heap which is mapped into the arena with OSMapMemory as well,
+ * so decommitted memory goes straight back to the heap.
+ *
+ * An arena is not thread safe.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WUTVirtualArena WUTVirtualArena;
+
+struct WUTVirtualArena
+{
+   //! Start of the reserved range.
+   uint8_t *base;
+
+   //! Size of the reserved range, a whole number of pages.
+   uint32_t reserved;
+
+   //! Bytes from base that are backed by memory, a whole number of pages.
+   uint32_t committed;
+
+   //! Default heap block backing each committed page.
+   void **pages;
+};
+
+/**
+ * Reserve size bytes of virtual addresses, rounded up to a whole page.
+ * Nothing is committed yet.
+ */
+BOOL
+WUTVirtualArenaCreate(WUTVirtualArena *arena,
+                      uint32_t size);
+
+/**
+ * Decommit everything and release the reserved range.
+ */
+void
+WUTVirtualArenaDestroy(WUTVirtualArena *arena);
+
+/**
+ * Make sure the first size bytes of the arena are backed by memory.
+ *
+ * Newly committed memory is not cleared.
+ *
+ * \return
+ * FALSE if size is larger than the reserved range or the default heap ran
+ * out of memory, the pages committed so far stay committed.
+ */
+BOOL
+WUTVirtualArenaCommit(WUTVirtualArena *arena,
+                      uint32_t size);
+
+/**
+ * Unmap every page past the first size bytes and give their memory back to
+ * the default heap.
+ */
+void
+WUTVirtualArenaDecommit(WUTVirtualArena *arena,
+                        uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -10,8 +10,16 @@ extern "C" {
 typedef struct GFDHeader GFDHeader;
 typedef struct GFDBlockHeader GFDBlockHeader;
 typedef struct GFDRelocationHeader GFDRelocationHeader;
+typedef struct GFDIndex GFDIndex;
+typedef struct GFDStream GFDStream;
+typedef struct GFDCompressedBlockHeader GFDCompressedBlockHeader;
+typedef struct GFDPackHeader GFDPackHeader;
+typedef struct GFDPackEntry GFDPackEntry;
+typedef struct GFDPackBlock GFDPackBlock;
+typedef struct GFDPack GFDPack;
 
 #define GFD_HEADER_MAGIC (0x47667832)
+#define GFD_COMPRESSED_HEADER_MAGIC (0x47667A32)
 #define GFD_BLOCK_HEADER_MAGIC (0x424C4B7B)
 #define GFD_RELOCATION_HEADER_MAGIC (0x7D424C4B)
 
@@ -19,6 +27,10 @@ typedef struct GFDRelocationHeader GFDRelocationHeader;
 #define GFD_FILE_VERSION_MINOR (1)
 #define GFD_BLOCK_VERSION_MAJOR (1)
 
+#define GFD_PACK_MAGIC (0x4750414B)
+#define GFD_PACK_VERSION (1)
+#define GFD_PACK_FILE_ALIGNMENT (0x100)
+
 #define GFD_PATCH_MASK (0xFFF00000)
 #define GFD_PATCH_DATA (0xD0600000)
 #define GFD_PATCH_TEXT (0xCA700000)
@@ -41,6 +53,8 @@ typedef enum GFDBlockType
    GFD_BLOCK_COMPUTE_SHADER_PROGRAM       = 15,
 } GFDBlockType;
 
+#define GFD_BLOCK_TYPE_COUNT (16)
+
 struct GFDHeader
 {
    uint32_t magic;
@@ -108,9 +122,162 @@ WUT_CHECK_OFFSET(GFDRelocationHeader, 0x20, patchCount);
 WUT_CHECK_OFFSET(GFDRelocationHeader, 0x24, patchOffset);
 WUT_CHECK_SIZE(GFDRelocationHeader, 0x28);
 
+/**
+ * Follows every block header in a file with GFD_COMPRESSED_HEADER_MAGIC.
+ *
+ * The file uses the normal GFD layout, except that each block's data is
+ * compressedSize bytes of raw LZMA data which decodes to the block's
+ * dataSize. A compressedSize of 0 means the data is stored uncompressed.
+ */
+struct GFDCompressedBlockHeader
+{
+   uint32_t compressedSize;
+   uint8_t props[5];
+   uint8_t padding[3];
+};
+WUT_CHECK_OFFSET(GFDCompressedBlockHeader, 0x00, compressedSize);
+WUT_CHECK_OFFSET(GFDCompressedBlockHeader, 0x04, props);
+WUT_CHECK_SIZE(GFDCompressedBlockHeader, 0x0C);
+
+/**
+ * Reads a file block by block from a file descriptor, so block data can be
+ * read straight into its final destination.
+ */
+struct GFDStream
+{
+   int fd;
+
+   //! Header of the current block.
+   GFDBlockHeader block;
+
+   //! Bytes of the current block's data that have not been read yet.
+   uint32_t dataLeft;
+
+   //! TRUE for a file with GFD_COMPRESSED_HEADER_MAGIC.
+   BOOL compressed;
+
+   //! Internal.
+   GFDCompressedBlockHeader compressedBlock;
+   uint32_t compressedLeft;
+   uint8_t *input;
+   uint32_t inputPos;
+   uint32_t inputSize;
+};
+
+/**
+ * Offsets of every block in a file, grouped by type.
+ *
+ * While an index is registered with GFDInitIndex, every GFDGet function
+ * called with its file looks blocks up in it instead of walking the blocks
+ * from the start of the file.
+ */
+struct GFDIndex
+{
+   const void *file;
+   uint32_t count[GFD_BLOCK_TYPE_COUNT];
+   uint32_t first[GFD_BLOCK_TYPE_COUNT];
+   uint32_t *offsets;
+   GFDIndex *next;
+};
+
+/**
+ * Header of a pack of GFD files.
+ *
+ * A pack starts with the directory: this header, entryCount GFDPackEntry,
+ * blockCount GFDPackBlock and the NUL terminated entry names, directorySize
+ * bytes in total. The GFD files follow, each aligned to
+ * GFD_PACK_FILE_ALIGNMENT. All offsets are from the start of the pack
+ * unless noted otherwise, and all fields are big endian.
+ */
+struct GFDPackHeader
+{
+   uint32_t magic;
+   uint32_t version;
+   uint32_t entryCount;
+   uint32_t blockCount;
+   uint32_t directorySize;
+
+   //! Written as 0.
+   uint32_t reserved[3];
+};
+WUT_CHECK_OFFSET(GFDPackHeader, 0x00, magic);
+WUT_CHECK_OFFSET(GFDPackHeader, 0x04, version);
+WUT_CHECK_OFFSET(GFDPackHeader, 0x08, entryCount);
+WUT_CHECK_OFFSET(GFDPackHeader, 0x0C, blockCount);
+WUT_CHECK_OFFSET(GFDPackHeader, 0x10, directorySize);
+WUT_CHECK_SIZE(GFDPackHeader, 0x20);
+
+//! A GFD file in a pack, entries are sorted by name with strcmp.
+struct GFDPackEntry
+{
+   uint32_t nameOffset;
+   uint32_t fileOffset;
+   uint32_t fileSize;
+
+   //! First of the entry's blocks in the block table.
+   uint32_t firstBlock;
+   uint32_t blockCount;
+};
+WUT_CHECK_OFFSET(GFDPackEntry, 0x00, nameOffset);
+WUT_CHECK_OFFSET(GFDPackEntry, 0x04, fileOffset);
+WUT_CHECK_OFFSET(GFDPackEntry, 0x08, fileSize);
+WUT_CHECK_OFFSET(GFDPackEntry, 0x0C, firstBlock);
+WUT_CHECK_OFFSET(GFDPackEntry, 0x10, blockCount);
+WUT_CHECK_SIZE(GFDPackEntry, 0x14);
+
+//! A block of a GFD file in a pack, in the order they appear in the file.
+struct GFDPackBlock
+{
+   GFDBlockType type;
+
+   //! Offset of the block header from the start of the GFD file.
+   uint32_t offset;
+};
+WUT_CHECK_OFFSET(GFDPackBlock, 0x00, type);
+WUT_CHECK_OFFSET(GFDPackBlock, 0x04, offset);
+WUT_CHECK_SIZE(GFDPackBlock, 0x08);
+
+/**
+ * An open pack.
+ *
+ * Every file in the pack has a GFDIndex built from the directory, so the
+ * GFDGet functions never have to scan them.
+ */
+struct GFDPack
+{
+   uint8_t *data;
+   uint32_t size;
+   BOOL ownsData;
+   const GFDPackEntry *entries;
+   const GFDPackBlock *blocks;
+   uint32_t entryCount;
+   GFDIndex *indices;
+   uint32_t *offsets;
+};
+
+/**
+ * Get the last error of the calling thread.
+ *
+ * Errors are kept per thread and only formatted here. The string is valid
+ * until the next error on the thread, the last errors of up to 16 threads
+ * are remembered.
+ */
 char *
 GFDGetLastErrorString();
 
+/**
+ * Validate a file once and index its blocks.
+ *
+ * The file must not change or move until GFDFreeIndex is called, and must
+ * not be used by other threads while its index is being freed.
+ */
+BOOL
+GFDInitIndex(GFDIndex *index,
+             const void *file);
+
+void
+GFDFreeIndex(GFDIndex *index);
+
 uint32_t
 GFDGetGeometryShaderCount(const void *file);
 
@@ -150,6 +317,21 @@ GFDGetPixelShader(GX2PixelShader *shader,
                   uint32_t index,
                   const void *file);
 
+/**
+ * Get a pixel shader without copying its program out of the file.
+ *
+ * The header is copied to shader, which must hold
+ * GFDGetPixelShaderHeaderSize bytes, and relocated there. The file itself
+ * is not modified. The program points into the file, so the file must be
+ * aligned to GX2_SHADER_PROGRAM_ALIGNMENT, readable by the GPU and kept
+ * alive for as long as the shader is used. The CPU cache must be flushed
+ * with GX2Invalidate before the shader is first used.
+ */
+BOOL
+GFDGetPixelShaderPointer(GX2PixelShader *shader,
+                         uint32_t index,
+                         const void *file);
+
 uint32_t
 GFDGetVertexShaderCount(const void *file);
 
@@ -167,6 +349,15 @@ GFDGetVertexShader(GX2VertexShader *shader,
                    uint32_t index,
                    const void *file);
 
+/**
+ * Get a vertex shader without copying it out of the file, see
+ * GFDGetPixelShaderPointer.
+ */
+BOOL
+GFDGetVertexShaderPointer(GX2VertexShader *shader,
+                          uint32_t index,
+                          const void *file);
+
 uint32_t
 GFDGetTextureCount(const void *file);
 
@@ -198,10 +389,120 @@ GFDGetGX2RTexture(GX2Texture *texture,
                   uint32_t index,
                   const void *file);
 
+/**
+ * Like GFDGetGX2RTexture, but drops the largest mip levels.
+ *
+ * The surface is created with level skipLevels of the file as its base
+ * level, or more levels dropped until it fits in maxSize x maxSize. Only
+ * the kept levels are allocated, and they are re-tiled into it with
+ * GX2CopySurface, so GX2 must be initialised. At least the smallest level
+ * is always kept.
+ *
+ * If the file data is not aligned to the surface alignment the whole
+ * texture is loaded instead, check texture->surface.width.
+ *
+ * \param maxSize
+ * Largest width and height of the base level, 0 for no limit.
+ */
+BOOL
+GFDGetGX2RTextureEx(GX2Texture *texture,
+                    uint32_t index,
+                    const void *file,
+                    uint32_t skipLevels,
+                    uint32_t maxSize);
+
 const GX2Texture *
 GFDGetTexturePointer(uint32_t index,
                      const void *file);
 
+const void *
+GFDGetTextureImagePointer(uint32_t index,
+                          const void *file);
+
+const void *
+GFDGetTextureMipImagePointer(uint32_t index,
+                             const void *file);
+
+/**
+ * Validate a pack that is already in memory, data must be aligned to
+ * GFD_PACK_FILE_ALIGNMENT and stay valid until GFDPackClose.
+ */
+BOOL
+GFDPackInit(GFDPack *pack,
+            void *data,
+            uint32_t size);
+
+/**
+ * Load a whole pack with one read and validate it.
+ */
+BOOL
+GFDPackOpen(GFDPack *pack,
+            const char *path);
+
+/**
+ * Close a pack, files from it must no longer be used.
+ */
+void
+GFDPackClose(GFDPack *pack);
+
+/**
+ * Get a GFD file in a pack by name, to be passed to the GFDGet functions or
+ * the libwhb loaders.
+ *
+ * \return
+ * NULL if the pack has no file with that name.
+ */
+void *
+GFDPackGetFile(const GFDPack *pack,
+               const char *name,
+               uint32_t *outSize);
+
+/**
+ * Read and validate the file header, fd must be at the start of the file.
+ *
+ * Both plain and compressed files can be read, compressed blocks are
+ * decoded straight into the destination passed to GFDStreamReadBlockData.
+ */
+BOOL
+GFDStreamInit(GFDStream *stream,
+              int fd);
+
+/**
+ * Free the buffers of a stream, the file descriptor is not closed.
+ */
+void
+GFDStreamFree(GFDStream *stream);
+
+/**
+ * Skip whatever is left of the current block and read the next block
+ * header into stream->block.
+ *
+ * \return
+ * FALSE at the end of the file or on error.
+ */
+BOOL
+GFDStreamNextBlock(GFDStream *stream);
+
+/**
+ * Read the next size bytes of the current block's data.
+ *
+ * A compressed block is decoded using dst as the dictionary, so it can only
+ * be read by a single call. Reading less than the whole block is allowed,
+ * the rest is skipped.
+ */
+BOOL
+GFDStreamReadBlockData(GFDStream *stream,
+                       void *dst,
+                       uint32_t size);
+
+/**
+ * Read a whole shader header block into dst, which must hold
+ * stream->block.dataSize bytes, and relocate it there.
+ */
+BOOL
+GFDStreamReadShaderHeader(GFDStream *stream,
+                          void *dst);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,10 +1,23 @@
 #include "gfd.h"
 
+#include <coreinit/spinlock.h>
+#include <coreinit/thread.h>
+#include <gx2/event.h>
+#include <gx2/mem.h>
+#include <gx2/surface.h>
 #include <gx2/temp.h>
 #include <gx2r/surface.h>
+#include <lzma920/lzmadec.h>
+#include <fcntl.h>
+#include <malloc.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 // #define CHECK_GPU_VERSION
 
@@ -12,6 +25,8 @@ static uint32_t _GFDCleanTag(uint32_t tag);
 static BOOL _GFDCheckTagDAT(uint32_t tag);
 static BOOL _GFDCheckTagSTR(uint32_t tag);
 static BOOL _GFDRelocateBlock(const GFDBlockHeader *blockHeader, void *dst);
+static BOOL _GFDRelocateBlockData(const uint8_t *blockData, uint32_t dataSize,
+                                  void *dst);
 static BOOL _GFDRelocateBlockEx(const GFDRelocationHeader *relocationHeader,
                                 const uint32_t *patchTable, uint8_t *dst);
 static uint32_t _GFDGetBlockDataSize(GFDBlockType type, uint32_t index,
@@ -32,22 +47,130 @@ static BOOL _GFDGetBlockPointer(GFDBlockType type, uint32_t index, void *file,
                                 void **blockDataOut);
 #endif
 
+#define GFD_ERROR_MAX_THREADS   (16)
+#define GFD_ERROR_MAX_ARGS      (6)
+#define GFD_ERROR_STRING_SIZE   (256)
+
+/**
+ * The last error of a thread, only formatted when it is asked for.
+ *
+ * Every argument is a 32-bit value or a pointer to a string that lives
+ * forever, such as __FUNCTION__.
+ */
+typedef struct
+{
+   OSThread *thread;
+   const char *fmt;
+   uintptr_t args[GFD_ERROR_MAX_ARGS];
+   char string[GFD_ERROR_STRING_SIZE];
+} GFDErrorRecord;
+
+static GFDErrorRecord
+sErrors[GFD_ERROR_MAX_THREADS];
+
+static uint32_t
+sNextError = 0;
+
 static char
-sLastError[1024] = { 0 };
+sNoError[1] = { 0 };
+
+//! Guards sErrors and sIndexList, zero initialised is the same as OSInitSpinLock
+static OSSpinLock
+sLock;
+
+static GFDIndex *
+sIndexList = NULL;
+
+static GFDErrorRecord *
+_GFDGetErrorRecord(OSThread *thread,
+                   BOOL create)
+{
+   GFDErrorRecord *record;
+   uint32_t i;
+
+   for (i = 0; i < GFD_ERROR_MAX_THREADS; ++i) {
+      if (sErrors[i].thread == thread) {
+         return &sErrors[i];
+      }
+   }
+
+   if (!create) {
+      return NULL;
+   }
+
+   // Reuse the oldest record once every one is taken
+   record = &sErrors[sNextError];
+   sNextError = (sNextError + 1) % GFD_ERROR_MAX_THREADS;
+   record->thread = thread;
+   return record;
+}
 
 static void
 setLastError(const char *fmt, ...)
 {
+   GFDErrorRecord *record;
+   const char *ptr;
+   uint32_t i, count = 0;
    va_list va;
+
+   // Only count the arguments here, formatting is left to GFDGetLastErrorString
+   for (ptr = fmt; *ptr; ++ptr) {
+      if (*ptr == '%') {
+         if (ptr[1] == '%') {
+            ++ptr;
+         } else {
+            ++count;
+         }
+      }
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sLock);
+   record = _GFDGetErrorRecord(OSGetCurrentThread(), TRUE);
+   record->fmt = fmt;
+
    va_start(va, fmt);
-   vsnprintf(sLastError, 1024, fmt, va);
+   for (i = 0; i < GFD_ERROR_MAX_ARGS; ++i) {
+      record->args[i] = (i < count) ? va_arg(va, uintptr_t) : 0;
+   }
    va_end(va);
+   OSUninterruptibleSpinLock_Release(&sLock);
 }
 
 char *
 GFDGetLastErrorString()
 {
-   return sLastError;
+   GFDErrorRecord *record;
+   char *string = sNoError;
+   char buffer[GFD_ERROR_STRING_SIZE];
+   uintptr_t args[GFD_ERROR_MAX_ARGS];
+   const char *fmt = NULL;
+
+   OSUninterruptibleSpinLock_Acquire(&sLock);
+   record = _GFDGetErrorRecord(OSGetCurrentThread(), FALSE);
+   if (record && record->fmt) {
+      fmt = record->fmt;
+      memcpy(args, record->args, sizeof(args));
+   }
+   OSUninterruptibleSpinLock_Release(&sLock);
+
+   if (!fmt) {
+      return string;
+   }
+
+   // Format outside the lock, interrupts are disabled while it is held
+   snprintf(buffer, sizeof(buffer), fmt,
+            args[0], args[1], args[2], args[3], args[4], args[5]);
+
+   // The record may have been handed to another thread in the meantime
+   OSUninterruptibleSpinLock_Acquire(&sLock);
+   record = _GFDGetErrorRecord(OSGetCurrentThread(), FALSE);
+   if (record) {
+      memcpy(record->string, buffer, sizeof(buffer));
+      string = record->string;
+   }
+   OSUninterruptibleSpinLock_Release(&sLock);
+
+   return string;
 }
 
 static BOOL
@@ -123,6 +246,137 @@ _GFDCheckBlockHeaderMagicVersions(const GFDBlockHeader *header)
    return TRUE;
 }
 
+BOOL
+GFDInitIndex(GFDIndex *index,
+             const void *file)
+{
+   const uint8_t *ptr;
+   const GFDHeader *fileHeader = (const GFDHeader *)file;
+   const GFDBlockHeader *blockHeader;
+   uint32_t fill[GFD_BLOCK_TYPE_COUNT];
+   uint32_t i, total = 0;
+
+   memset(index, 0, sizeof(GFDIndex));
+
+   if (!file || !_GFDCheckHeaderVersions(file)) {
+      return FALSE;
+   }
+
+   // Count the blocks of each type so they can be stored grouped by type
+   ptr = (const uint8_t *)file + fileHeader->headerSize;
+   blockHeader = (const GFDBlockHeader *)ptr;
+
+   while (_GFDCheckBlockHeaderMagicVersions(blockHeader)) {
+      if (blockHeader->type == GFD_BLOCK_END_OF_FILE) {
+         break;
+      }
+
+      if ((uint32_t)blockHeader->type < GFD_BLOCK_TYPE_COUNT) {
+         index->count[blockHeader->type]++;
+         total++;
+      }
+
+      ptr += blockHeader->headerSize + blockHeader->dataSize;
+      blockHeader = (const GFDBlockHeader *)ptr;
+   }
+
+   for (i = 0; i < GFD_BLOCK_TYPE_COUNT; ++i) {
+      index->first[i] = (i == 0) ? 0 : index->first[i - 1] + index->count[i - 1];
+      fill[i] = index->first[i];
+   }
+
+   if (total) {
+      index->offsets = (uint32_t *)malloc(total * sizeof(uint32_t));
+      if (!index->offsets) {
+         setLastError("%s: failed to allocate %u block offsets",
+                      __FUNCTION__, total);
+         return FALSE;
+      }
+   }
+
+   ptr = (const uint8_t *)file + fileHeader->headerSize;
+   blockHeader = (const GFDBlockHeader *)ptr;
+
+   while (_GFDCheckBlockHeaderMagicVersions(blockHeader)) {
+      if (blockHeader->type == GFD_BLOCK_END_OF_FILE) {
+         break;
+      }
+
+      if ((uint32_t)blockHeader->type < GFD_BLOCK_TYPE_COUNT) {
+         index->offsets[fill[blockHeader->type]++] =
+            (uint32_t)(ptr - (const uint8_t *)file);
+      }
+
+      ptr += blockHeader->headerSize + blockHeader->dataSize;
+      blockHeader = (const GFDBlockHeader *)ptr;
+   }
+
+   index->file = file;
+   OSUninterruptibleSpinLock_Acquire(&sLock);
+   index->next = sIndexList;
+   sIndexList = index;
+   OSUninterruptibleSpinLock_Release(&sLock);
+   return TRUE;
+}
+
+static void
+_GFDUnregisterIndex(GFDIndex *index)
+{
+   GFDIndex **link;
+
+   OSUninterruptibleSpinLock_Acquire(&sLock);
+   for (link = &sIndexList; *link; link = &(*link)->next) {
+      if (*link == index) {
+         *link = index->next;
+         break;
+      }
+   }
+   OSUninterruptibleSpinLock_Release(&sLock);
+}
+
+void
+GFDFreeIndex(GFDIndex *index)
+{
+   _GFDUnregisterIndex(index);
+   free(index->offsets);
+   memset(index, 0, sizeof(GFDIndex));
+}
+
+static const GFDIndex *
+_GFDFindIndex(const void *file)
+{
+   const GFDIndex *index;
+
+   // Fast path for the common case of nothing being indexed
+   if (!sIndexList) {
+      return NULL;
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sLock);
+   for (index = sIndexList; index; index = index->next) {
+      if (index->file == file) {
+         break;
+      }
+   }
+   OSUninterruptibleSpinLock_Release(&sLock);
+
+   return index;
+}
+
+static const GFDBlockHeader *
+_GFDGetIndexedBlock(const GFDIndex *index,
+                    GFDBlockType type,
+                    uint32_t blockIndex)
+{
+   if ((uint32_t)type >= GFD_BLOCK_TYPE_COUNT
+    || blockIndex >= index->count[type]) {
+      return NULL;
+   }
+
+   return (const GFDBlockHeader *)
+      ((const uint8_t *)index->file + index->offsets[index->first[type] + blockIndex]);
+}
+
 static uint32_t
 _GFDGetBlockCount(GFDBlockType type,
                   const void *file)
@@ -130,12 +384,18 @@ _GFDGetBlockCount(GFDBlockType type,
    const uint8_t *ptr = (const uint8_t *)file;
    const GFDHeader *fileHeader = (const GFDHeader *)file;
    const GFDBlockHeader *blockHeader;
+   const GFDIndex *fileIndex;
    uint32_t count = 0;
 
    if (!file) {
       return 0;
    }
 
+   fileIndex = _GFDFindIndex(file);
+   if (fileIndex) {
+      return ((uint32_t)type < GFD_BLOCK_TYPE_COUNT) ? fileIndex->count[type] : 0;
+   }
+
    if (!_GFDCheckHeaderVersions(file)) {
       return 0;
    }
@@ -165,12 +425,19 @@ _GFDGetBlockDataSize(GFDBlockType type,
    const uint8_t *ptr = (const uint8_t *)file;
    const GFDHeader *fileHeader = (const GFDHeader *)file;
    const GFDBlockHeader *blockHeader;
+   const GFDIndex *fileIndex;
    uint32_t count = 0;
 
    if (!file) {
       return 0;
    }
 
+   fileIndex = _GFDFindIndex(file);
+   if (fileIndex) {
+      blockHeader = _GFDGetIndexedBlock(fileIndex, type, index);
+      return blockHeader ? blockHeader->dataSize : 0;
+   }
+
    if (!_GFDCheckHeaderVersions(file)) {
       return 0;
    }
@@ -206,12 +473,25 @@ _GFDGetBlockPointerConst(GFDBlockType type,
    const uint8_t *ptr = (const uint8_t *)file;
    const GFDHeader *fileHeader = (const GFDHeader *)file;
    const GFDBlockHeader *blockHeader;
+   const GFDIndex *fileIndex;
    uint32_t count = 0;
 
    if (!file) {
       return FALSE;
    }
 
+   fileIndex = _GFDFindIndex(file);
+   if (fileIndex) {
+      blockHeader = _GFDGetIndexedBlock(fileIndex, type, index);
+      if (!blockHeader) {
+         return FALSE;
+      }
+
+      *blockHeaderOut = blockHeader;
+      *blockDataOut = (const uint8_t *)blockHeader + blockHeader->headerSize;
+      return TRUE;
+   }
+
    if (!_GFDCheckHeaderVersions(file)) {
       return FALSE;
    }
@@ -352,17 +632,29 @@ static BOOL
 _GFDRelocateBlock(const GFDBlockHeader *blockHeader,
                   void *dst)
 {
-   const uint8_t *blockData = ((const uint8_t *)blockHeader) +
-                              blockHeader->headerSize;
+   if (!blockHeader) {
+      return FALSE;
+   }
+
+   return _GFDRelocateBlockData(((const uint8_t *)blockHeader) + blockHeader->headerSize,
+                                blockHeader->dataSize,
+                                dst);
+}
+
+static BOOL
+_GFDRelocateBlockData(const uint8_t *blockData,
+                      uint32_t dataSize,
+                      void *dst)
+{
    const GFDRelocationHeader *relocationHeader;
    const uint32_t *patchTable;
 
-   if (!blockHeader || !dst) {
+   if (!blockData || !dst || dataSize < sizeof(GFDRelocationHeader)) {
       return FALSE;
    }
 
    relocationHeader = (const GFDRelocationHeader *)(blockData
-                                                    + blockHeader->dataSize
+                                                    + dataSize
                                                     - sizeof(GFDRelocationHeader));
 
    if (relocationHeader->magic != GFD_RELOCATION_HEADER_MAGIC) {
@@ -461,6 +753,52 @@ _GFDGetGenericBlock(GFDBlockType blockTypeHeader,
 
    return result;
 }
+
+// Copies a shader header out of the file and relocates the copy, pointing
+// its program at the program block so the program itself is not copied.
+static BOOL
+_GFDGetShaderInPlace(GFDBlockType blockTypeHeader,
+                     uint32_t headerSize,
+                     GFDBlockType blockTypeProgram,
+                     uint32_t programOffset,
+                     void *header,
+                     uint32_t index,
+                     const void *file)
+{
+   const GFDBlockHeader *blockHeader, *programHeader;
+   const void *blockData, *programData;
+
+   if (!header || !file) {
+      return FALSE;
+   }
+
+   if (!_GFDGetBlockPointerConst(blockTypeHeader, index, file,
+                                 &blockHeader, &blockData)
+    || !_GFDGetBlockPointerConst(blockTypeProgram, index, file,
+                                 &programHeader, &programData)) {
+      return FALSE;
+   }
+
+   if (blockHeader->dataSize < headerSize) {
+      setLastError("%s: blockHeader->dataSize %u < %u", __FUNCTION__,
+                   blockHeader->dataSize, headerSize);
+      return FALSE;
+   }
+
+   if (!_GFDCheckShaderAlign((void *)programData)) {
+      setLastError("%s: program %p is not aligned to GX2_SHADER_PROGRAM_ALIGNMENT",
+                   __FUNCTION__, programData);
+      return FALSE;
+   }
+
+   memcpy(header, blockData, blockHeader->dataSize);
+   if (!_GFDRelocateBlock(blockHeader, header)) {
+      return FALSE;
+   }
+
+   *(const void **)((uint8_t *)header + programOffset) = programData;
+   return TRUE;
+}
 /*
 BOOL
 GFDGetVertexShader(GX2VertexShader *shader,
@@ -676,6 +1014,20 @@ GFDGetPixelShader(GX2PixelShader *shader,
                               file);
 }
 
+BOOL
+GFDGetPixelShaderPointer(GX2PixelShader *shader,
+                         uint32_t index,
+                         const void *file)
+{
+   return _GFDGetShaderInPlace(GFD_BLOCK_PIXEL_SHADER_HEADER,
+                               sizeof(GX2PixelShader),
+                               GFD_BLOCK_PIXEL_SHADER_PROGRAM,
+                               offsetof(GX2PixelShader, program),
+                               shader,
+                               index,
+                               file);
+}
+
 uint32_t
 GFDGetVertexShaderCount(const void *file)
 {
@@ -719,6 +1071,20 @@ GFDGetVertexShader(GX2VertexShader *shader,
                               file);
 }
 
+BOOL
+GFDGetVertexShaderPointer(GX2VertexShader *shader,
+                          uint32_t index,
+                          const void *file)
+{
+   return _GFDGetShaderInPlace(GFD_BLOCK_VERTEX_SHADER_HEADER,
+                               sizeof(GX2VertexShader),
+                               GFD_BLOCK_VERTEX_SHADER_PROGRAM,
+                               offsetof(GX2VertexShader, program),
+                               shader,
+                               index,
+                               file);
+}
+
 uint32_t
 GFDGetTextureCount(const void *file)
 {
@@ -883,6 +1249,128 @@ error:
    return FALSE;
 }
 
+BOOL
+GFDGetGX2RTextureEx(GX2Texture *texture,
+                    uint32_t index,
+                    const void *file,
+                    uint32_t skipLevels,
+                    uint32_t maxSize)
+{
+   const GFDBlockHeader *blockHeader;
+   const GX2Texture *header;
+   const uint8_t *image, *mipmap = NULL;
+   GX2Surface src;
+   uint32_t skip = skipLevels;
+   uint32_t level;
+
+   if (!texture || !file) {
+      return FALSE;
+   }
+
+   if (!_GFDGetBlockPointerConst(GFD_BLOCK_TEXTURE_HEADER, index, file,
+                                 &blockHeader, (const void **)&header)
+    || blockHeader->dataSize < sizeof(GX2Texture)) {
+      return FALSE;
+   }
+
+   if (maxSize) {
+      while ((header->surface.width >> skip) > maxSize
+          || (header->surface.height >> skip) > maxSize) {
+         skip++;
+      }
+   }
+
+   if (header->surface.mipLevels <= 1 || header->surface.aa != GX2_AA_MODE1X) {
+      skip = 0;
+   } else if (skip >= header->surface.mipLevels) {
+      skip = header->surface.mipLevels - 1;
+   }
+
+   if (skip == 0) {
+      return GFDGetGX2RTexture(texture, index, file);
+   }
+
+   if (!_GFDGetBlockPointerConst(GFD_BLOCK_TEXTURE_IMAGE, index, file,
+                                 &blockHeader, (const void **)&image)) {
+      return FALSE;
+   }
+
+   if (header->surface.mipLevels > 1
+    && !_GFDGetBlockPointerConst(GFD_BLOCK_TEXTURE_MIPMAP, index, file,
+                                 &blockHeader, (const void **)&mipmap)) {
+      return FALSE;
+   }
+
+   // Level skip of the file becomes the base level of the new surface
+   memcpy(texture, header, sizeof(GX2Texture));
+   texture->surface.width = MAX(header->surface.width >> skip, 1);
+   texture->surface.height = MAX(header->surface.height >> skip, 1);
+   if (header->surface.dim == GX2_SURFACE_DIM_TEXTURE_3D) {
+      texture->surface.depth = MAX(header->surface.depth >> skip, 1);
+   }
+
+   texture->surface.mipLevels = header->surface.mipLevels - skip;
+   texture->surface.image = NULL;
+   texture->surface.mipmaps = NULL;
+   texture->surface.imageSize = 0;
+   texture->surface.mipmapSize = 0;
+
+   if (!GX2RCreateSurface(&texture->surface,
+                          GX2R_RESOURCE_BIND_TEXTURE
+                        | GX2R_RESOURCE_USAGE_CPU_READ
+                        | GX2R_RESOURCE_USAGE_CPU_WRITE
+                        | GX2R_RESOURCE_USAGE_GPU_READ
+                        | GX2R_RESOURCE_USAGE_GPU_WRITE)) {
+      setLastError("%s: GX2RCreateSurface failed", __FUNCTION__);
+      return FALSE;
+   }
+
+   // The kept levels change tileMode, swizzle and pitch along with their
+   // size, so re-tile them from the file data with the GPU
+   src = header->surface;
+   src.image = (void *)image;
+   src.mipmaps = (void *)mipmap;
+
+   if (((uintptr_t)image & (src.alignment - 1))
+    || (mipmap && ((uintptr_t)mipmap & (src.alignment - 1)))) {
+      GX2RDestroySurfaceEx(&texture->surface, 0);
+      return GFDGetGX2RTexture(texture, index, file);
+   }
+
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_TEXTURE, src.image, src.imageSize);
+   if (src.mipmaps) {
+      GX2Invalidate(GX2_INVALIDATE_MODE_CPU_TEXTURE, src.mipmaps, src.mipmapSize);
+   }
+
+   for (level = 0; level < texture->surface.mipLevels; ++level) {
+      uint32_t depth = texture->surface.depth;
+      uint32_t slice;
+
+      if (texture->surface.dim == GX2_SURFACE_DIM_TEXTURE_3D) {
+         depth = MAX(depth >> level, 1);
+      }
+
+      for (slice = 0; slice < depth; ++slice) {
+         GX2CopySurface(&src, level + skip, slice,
+                        &texture->surface, level, slice);
+      }
+   }
+
+   // The file data may be freed as soon as we return
+   GX2DrawDone();
+
+   texture->viewFirstMip = 0;
+   texture->viewNumMips = texture->surface.mipLevels;
+   GX2InitTextureRegs(texture);
+
+   GX2RInvalidateSurface(&texture->surface, 0, 0);
+   if (texture->surface.mipmaps) {
+      GX2RInvalidateSurface(&texture->surface, -1, 0);
+   }
+
+   return TRUE;
+}
+
 const GX2Texture *
 GFDGetTexturePointer(uint32_t index,
                      const void *file)
@@ -904,3 +1392,586 @@ GFDGetTexturePointer(uint32_t index,
 
    return texture;
 }
+
+const void *
+GFDGetTextureImagePointer(uint32_t index,
+                          const void *file)
+{
+   const GFDBlockHeader *blockHeader;
+   const void *image;
+
+   if (!_GFDGetBlockPointerConst(GFD_BLOCK_TEXTURE_IMAGE,
+                                 index,
+                                 file,
+                                 &blockHeader,
+                                 &image)) {
+      return NULL;
+   }
+
+   return image;
+}
+
+const void *
+GFDGetTextureMipImagePointer(uint32_t index,
+                             const void *file)
+{
+   const GFDBlockHeader *blockHeader;
+   const void *mipmap;
+
+   if (!_GFDGetBlockPointerConst(GFD_BLOCK_TEXTURE_MIPMAP,
+                                 index,
+                                 file,
+                                 &blockHeader,
+                                 &mipmap)) {
+      return NULL;
+   }
+
+   return mipmap;
+}
+
+static BOOL
+_GFDStreamRead(GFDStream *stream,
+               void *dst,
+               uint32_t size)
+{
+   uint8_t *ptr = (uint8_t *)dst;
+
+   while (size) {
+      ssize_t rc = read(stream->fd, ptr, size);
+      if (rc <= 0) {
+         setLastError("%s: read(%d, %p, %u) failed", __FUNCTION__,
+                      stream->fd, ptr, size);
+         return FALSE;
+      }
+
+      ptr += rc;
+      size -= rc;
+   }
+
+   return TRUE;
+}
+
+static BOOL
+_GFDStreamSkip(GFDStream *stream,
+               uint32_t size)
+{
+   if (size && lseek(stream->fd, size, SEEK_CUR) < 0) {
+      setLastError("%s: lseek(%d, %u, SEEK_CUR) failed", __FUNCTION__,
+                   stream->fd, size);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+// Size of the buffer compressed data is read into
+#define GFD_STREAM_INPUT_SIZE (0x10000)
+
+static void *
+_GFDLzmaAlloc(void *p,
+              size_t size)
+{
+   return malloc(size);
+}
+
+static void
+_GFDLzmaFree(void *p,
+             void *address)
+{
+   free(address);
+}
+
+static ISzAlloc
+sLzmaAlloc = { _GFDLzmaAlloc, _GFDLzmaFree };
+
+static BOOL
+_GFDStreamDecode(GFDStream *stream,
+                 void *dst,
+                 uint32_t size)
+{
+   CLzmaDec dec;
+   ELzmaStatus status;
+   BOOL result = FALSE;
+   int res;
+
+   memset(&dec, 0, sizeof(CLzmaDec));
+   res = LzmaDec_AllocateProbs(&dec, stream->compressedBlock.props,
+                               LZMA_PROPS_SIZE, &sLzmaAlloc);
+   if (res != SZ_OK) {
+      setLastError("%s: LzmaDec_AllocateProbs failed with %d", __FUNCTION__, res);
+      return FALSE;
+   }
+
+   // Decode straight into the destination, it doubles as the dictionary
+   dec.dic = (uint8_t *)dst;
+   dec.dicBufSize = size;
+   LzmaDec_Init(&dec);
+
+   while (dec.dicPos < size) {
+      size_t inputLen;
+
+      if (stream->inputPos == stream->inputSize) {
+         uint32_t chunk = stream->compressedLeft;
+         if (chunk > GFD_STREAM_INPUT_SIZE) {
+            chunk = GFD_STREAM_INPUT_SIZE;
+         }
+
+         if (!chunk) {
+            setLastError("%s: compressed data ended after %u of %u bytes",
+                         __FUNCTION__, dec.dicPos, size);
+            goto out;
+         }
+
+         if (!_GFDStreamRead(stream, stream->input, chunk)) {
+            goto out;
+         }
+
+         stream->compressedLeft -= chunk;
+         stream->inputPos = 0;
+         stream->inputSize = chunk;
+      }
+
+      inputLen = stream->inputSize - stream->inputPos;
+      res = LzmaDec_DecodeToDic(&dec, size, stream->input + stream->inputPos,
+                                &inputLen, LZMA_FINISH_ANY, &status);
+      stream->inputPos += inputLen;
+
+      if (res != SZ_OK) {
+         setLastError("%s: LzmaDec_DecodeToDic failed with %d", __FUNCTION__, res);
+         goto out;
+      }
+
+      if (status == LZMA_STATUS_FINISHED_WITH_MARK && dec.dicPos < size) {
+         setLastError("%s: compressed data ended after %u of %u bytes",
+                      __FUNCTION__, dec.dicPos, size);
+         goto out;
+      }
+   }
+
+   result = TRUE;
+
+out:
+   LzmaDec_FreeProbs(&dec, &sLzmaAlloc);
+   return result;
+}
+
+BOOL
+GFDStreamInit(GFDStream *stream,
+              int fd)
+{
+   GFDHeader header;
+
+   memset(stream, 0, sizeof(GFDStream));
+   stream->fd = fd;
+
+   if (!_GFDStreamRead(stream, &header, sizeof(GFDHeader))) {
+      return FALSE;
+   }
+
+   if (header.magic == GFD_COMPRESSED_HEADER_MAGIC) {
+      stream->input = (uint8_t *)malloc(GFD_STREAM_INPUT_SIZE);
+      if (!stream->input) {
+         setLastError("%s: failed to allocate the input buffer", __FUNCTION__);
+         return FALSE;
+      }
+
+      stream->compressed = TRUE;
+      header.magic = GFD_HEADER_MAGIC;
+   }
+
+   if (!_GFDCheckHeaderVersions(&header)) {
+      GFDStreamFree(stream);
+      return FALSE;
+   }
+
+   if (header.headerSize < sizeof(GFDHeader)) {
+      setLastError("%s: header.headerSize %u < %u", __FUNCTION__,
+                   header.headerSize, sizeof(GFDHeader));
+      GFDStreamFree(stream);
+      return FALSE;
+   }
+
+   if (!_GFDStreamSkip(stream, header.headerSize - sizeof(GFDHeader))) {
+      GFDStreamFree(stream);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+void
+GFDStreamFree(GFDStream *stream)
+{
+   free(stream->input);
+   stream->input = NULL;
+   stream->inputPos = 0;
+   stream->inputSize = 0;
+}
+
+BOOL
+GFDStreamNextBlock(GFDStream *stream)
+{
+   uint32_t skip = stream->dataLeft;
+
+   if (stream->compressed && stream->compressedBlock.compressedSize) {
+      skip = stream->compressedLeft;
+   }
+
+   if (!_GFDStreamSkip(stream, skip)) {
+      return FALSE;
+   }
+
+   stream->dataLeft = 0;
+   stream->compressedLeft = 0;
+   stream->inputPos = 0;
+   stream->inputSize = 0;
+   memset(&stream->compressedBlock, 0, sizeof(GFDCompressedBlockHeader));
+   if (!_GFDStreamRead(stream, &stream->block, sizeof(GFDBlockHeader))) {
+      return FALSE;
+   }
+
+   if (!_GFDCheckBlockHeaderMagicVersions(&stream->block)) {
+      return FALSE;
+   }
+
+   if (stream->block.headerSize < sizeof(GFDBlockHeader)) {
+      setLastError("%s: block.headerSize %u < %u", __FUNCTION__,
+                   stream->block.headerSize, sizeof(GFDBlockHeader));
+      return FALSE;
+   }
+
+   if (stream->block.type == GFD_BLOCK_END_OF_FILE) {
+      return FALSE;
+   }
+
+   if (!_GFDStreamSkip(stream, stream->block.headerSize - sizeof(GFDBlockHeader))) {
+      return FALSE;
+   }
+
+   if (stream->compressed) {
+      if (!_GFDStreamRead(stream, &stream->compressedBlock,
+                          sizeof(GFDCompressedBlockHeader))) {
+         return FALSE;
+      }
+
+      stream->compressedLeft = stream->compressedBlock.compressedSize;
+   }
+
+   stream->dataLeft = stream->block.dataSize;
+   return TRUE;
+}
+
+BOOL
+GFDStreamReadBlockData(GFDStream *stream,
+                       void *dst,
+                       uint32_t size)
+{
+   if (size > stream->dataLeft) {
+      setLastError("%s: size %u > %u bytes left in block", __FUNCTION__,
+                   size, stream->dataLeft);
+      return FALSE;
+   }
+
+   if (stream->compressed && stream->compressedBlock.compressedSize) {
+      if (stream->dataLeft != stream->block.dataSize) {
+         setLastError("%s: compressed block has already been read", __FUNCTION__);
+         return FALSE;
+      }
+
+      if (!_GFDStreamDecode(stream, dst, size)) {
+         return FALSE;
+      }
+
+      // The rest of the block can not be decoded without dst
+      stream->dataLeft = 0;
+      return TRUE;
+   }
+
+   if (!_GFDStreamRead(stream, dst, size)) {
+      return FALSE;
+   }
+
+   stream->dataLeft -= size;
+   return TRUE;
+}
+
+BOOL
+GFDStreamReadShaderHeader(GFDStream *stream,
+                          void *dst)
+{
+   uint32_t size = stream->dataLeft;
+
+   if (size != stream->block.dataSize) {
+      setLastError("%s: block has already been partially read", __FUNCTION__);
+      return FALSE;
+   }
+
+   if (!GFDStreamReadBlockData(stream, dst, size)) {
+      return FALSE;
+   }
+
+   return _GFDRelocateBlockData((const uint8_t *)dst, size, dst);
+}
+
+static BOOL
+_GFDPackCheck(const uint8_t *data,
+              uint32_t size)
+{
+   const GFDPackHeader *header = (const GFDPackHeader *)data;
+   const GFDPackEntry *entries;
+   const GFDPackBlock *blocks;
+   const char *prevName = NULL;
+   uint32_t i, j;
+
+   if (size < sizeof(GFDPackHeader) || header->magic != GFD_PACK_MAGIC) {
+      setLastError("%s: not a GFD pack", __FUNCTION__);
+      return FALSE;
+   }
+
+   if (header->version != GFD_PACK_VERSION) {
+      setLastError("%s: header->version %u != %u GFD_PACK_VERSION",
+                   __FUNCTION__, header->version, GFD_PACK_VERSION);
+      return FALSE;
+   }
+
+   if (header->directorySize > size
+    || sizeof(GFDPackHeader)
+       + (uint64_t)header->entryCount * sizeof(GFDPackEntry)
+       + (uint64_t)header->blockCount * sizeof(GFDPackBlock) > header->directorySize) {
+      setLastError("%s: directory does not fit in the pack", __FUNCTION__);
+      return FALSE;
+   }
+
+   entries = (const GFDPackEntry *)(data + sizeof(GFDPackHeader));
+   blocks = (const GFDPackBlock *)(entries + header->entryCount);
+
+   for (i = 0; i < header->entryCount; ++i) {
+      const GFDPackEntry *entry = &entries[i];
+      const char *name = (const char *)data + entry->nameOffset;
+
+      if (entry->nameOffset >= header->directorySize
+       || !memchr(name, 0, header->directorySize - entry->nameOffset)) {
+         setLastError("%s: entry %u has an invalid name", __FUNCTION__, i);
+         return FALSE;
+      }
+
+      // Names are sorted so they can be binary searched
+      if (prevName && strcmp(prevName, name) >= 0) {
+         setLastError("%s: entry %u is out of order", __FUNCTION__, i);
+         return FALSE;
+      }
+
+      prevName = name;
+
+      if (entry->fileOffset & (GFD_PACK_FILE_ALIGNMENT - 1)
+       || (uint64_t)entry->fileOffset + entry->fileSize > size
+       || (uint64_t)entry->firstBlock + entry->blockCount > header->blockCount
+       || entry->fileSize < sizeof(GFDHeader)
+       || !_GFDCheckHeaderVersions(data + entry->fileOffset)) {
+         setLastError("%s: entry %u is invalid", __FUNCTION__, i);
+         return FALSE;
+      }
+
+      for (j = 0; j < entry->blockCount; ++j) {
+         const GFDPackBlock *block = &blocks[entry->firstBlock + j];
+         const GFDBlockHeader *blockHeader;
+
+         if ((uint32_t)block->type >= GFD_BLOCK_TYPE_COUNT
+          || (uint64_t)block->offset + sizeof(GFDBlockHeader) > entry->fileSize) {
+            setLastError("%s: entry %u has an invalid block %u",
+                         __FUNCTION__, i, j);
+            return FALSE;
+         }
+
+         // The directory is trusted for where blocks are, check that they
+         // really are there and fit in the file
+         blockHeader = (const GFDBlockHeader *)(data + entry->fileOffset + block->offset);
+         if (!_GFDCheckBlockHeaderMagicVersions(blockHeader)) {
+            return FALSE;
+         }
+
+         if (blockHeader->type != block->type
+          || blockHeader->headerSize < sizeof(GFDBlockHeader)
+          || (uint64_t)block->offset + blockHeader->headerSize
+             + blockHeader->dataSize > entry->fileSize) {
+            setLastError("%s: entry %u block %u does not match the file",
+                         __FUNCTION__, i, j);
+            return FALSE;
+         }
+      }
+   }
+
+   return TRUE;
+}
+
+BOOL
+GFDPackInit(GFDPack *pack,
+            void *data,
+            uint32_t size)
+{
+   const GFDPackHeader *header = (const GFDPackHeader *)data;
+   uint32_t i, j;
+
+   memset(pack, 0, sizeof(GFDPack));
+
+   if (!data || !_GFDPackCheck((const uint8_t *)data, size)) {
+      return FALSE;
+   }
+
+   pack->data = (uint8_t *)data;
+   pack->size = size;
+   pack->entries = (const GFDPackEntry *)(pack->data + sizeof(GFDPackHeader));
+   pack->blocks = (const GFDPackBlock *)(pack->entries + header->entryCount);
+   pack->entryCount = header->entryCount;
+
+   pack->indices = (GFDIndex *)calloc(header->entryCount ? header->entryCount : 1,
+                                      sizeof(GFDIndex));
+   pack->offsets = (uint32_t *)malloc((header->blockCount ? header->blockCount : 1)
+                                      * sizeof(uint32_t));
+   if (!pack->indices || !pack->offsets) {
+      setLastError("%s: failed to allocate the pack indices", __FUNCTION__);
+      free(pack->indices);
+      free(pack->offsets);
+      memset(pack, 0, sizeof(GFDPack));
+      return FALSE;
+   }
+
+   // Build every file's index from the directory, nothing has to be scanned
+   for (i = 0; i < pack->entryCount; ++i) {
+      const GFDPackEntry *entry = &pack->entries[i];
+      GFDIndex *index = &pack->indices[i];
+      uint32_t *offsets = pack->offsets + entry->firstBlock;
+      uint32_t fill[GFD_BLOCK_TYPE_COUNT];
+
+      for (j = 0; j < entry->blockCount; ++j) {
+         index->count[pack->blocks[entry->firstBlock + j].type]++;
+      }
+
+      for (j = 0; j < GFD_BLOCK_TYPE_COUNT; ++j) {
+         index->first[j] = (j == 0) ? 0 : index->first[j - 1] + index->count[j - 1];
+         fill[j] = index->first[j];
+      }
+
+      for (j = 0; j < entry->blockCount; ++j) {
+         const GFDPackBlock *block = &pack->blocks[entry->firstBlock + j];
+         offsets[fill[block->type]++] = block->offset;
+      }
+
+      index->file = pack->data + entry->fileOffset;
+      index->offsets = offsets;
+      OSUninterruptibleSpinLock_Acquire(&sLock);
+      index->next = sIndexList;
+      sIndexList = index;
+      OSUninterruptibleSpinLock_Release(&sLock);
+   }
+
+   return TRUE;
+}
+
+BOOL
+GFDPackOpen(GFDPack *pack,
+            const char *path)
+{
+   struct stat st;
+   uint8_t *data = NULL;
+   uint32_t size, done = 0;
+   int fd;
+
+   memset(pack, 0, sizeof(GFDPack));
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      setLastError("%s: open failed", __FUNCTION__);
+      return FALSE;
+   }
+
+   if (fstat(fd, &st) < 0 || st.st_size <= 0 || st.st_size > UINT32_MAX) {
+      setLastError("%s: fstat failed", __FUNCTION__);
+      goto error;
+   }
+
+   // The whole pack is read at once, aligned so shader programs stay aligned
+   size = (uint32_t)st.st_size;
+   data = (uint8_t *)memalign(GFD_PACK_FILE_ALIGNMENT, size);
+   if (!data) {
+      setLastError("%s: failed to allocate %u bytes", __FUNCTION__, size);
+      goto error;
+   }
+
+   while (done < size) {
+      ssize_t rc = read(fd, data + done, size - done);
+      if (rc <= 0) {
+         setLastError("%s: read failed", __FUNCTION__);
+         goto error;
+      }
+
+      done += rc;
+   }
+
+   close(fd);
+   fd = -1;
+
+   if (!GFDPackInit(pack, data, size)) {
+      goto error;
+   }
+
+   pack->ownsData = TRUE;
+   return TRUE;
+
+error:
+   if (fd >= 0) {
+      close(fd);
+   }
+
+   free(data);
+   return FALSE;
+}
+
+void
+GFDPackClose(GFDPack *pack)
+{
+   uint32_t i;
+
+   if (pack->indices) {
+      for (i = 0; i < pack->entryCount; ++i) {
+         _GFDUnregisterIndex(&pack->indices[i]);
+      }
+   }
+
+   if (pack->ownsData) {
+      free(pack->data);
+   }
+
+   free(pack->indices);
+   free(pack->offsets);
+   memset(pack, 0, sizeof(GFDPack));
+}
+
+void *
+GFDPackGetFile(const GFDPack *pack,
+               const char *name,
+               uint32_t *outSize)
+{
+   uint32_t lo = 0, hi = pack->entryCount;
+
+   while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      const GFDPackEntry *entry = &pack->entries[mid];
+      int cmp = strcmp(name, (const char *)pack->data + entry->nameOffset);
+
+      if (cmp == 0) {
+         if (outSize) {
+            *outSize = entry->fileSize;
+         }
+
+         return pack->data + entry->fileOffset;
+      } else if (cmp < 0) {
+         hi = mid;
+      } else {
+         lo = mid + 1;
+      }
+   }
+
+   setLastError("%s: no such file", __FUNCTION__);
+   return NULL;
+}
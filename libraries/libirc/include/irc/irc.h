@@ -7,6 +7,9 @@
  * \defgroup irc_irc
  * \ingroup irc
  * High-Level InfraRed Connection
+ *
+ * Each channel has its own connection state, callbacks and buffers, so both
+ * DRCs can be used at the same time.
  * 
  * @{
  */
@@ -42,6 +45,9 @@ typedef enum {
    IRC_RESULT_DISCONNECT_FAILED         = 18,
 } IRCResult;
 
+//! Largest payload of one packet, the size of a transfer minus the headers.
+#define IRC_MAX_PACKET_SIZE 0x1fe
+
 typedef void (*IRCConnectCallback)();
 typedef void (*IRCReceiveCallback)(void *data, uint16_t size, IRCResult result);
 
@@ -97,6 +103,10 @@ IRCConnect(VPADChan channel,
 /**
  * Process the internal state.
  * Should be called periodically.
+ *
+ * While background receive is running this only runs the callbacks for
+ * what the receive thread has queued since the last call, without talking
+ * to the DRC.
  * 
  * \param channel
  * The device to use for IR.
@@ -107,6 +117,36 @@ IRCConnect(VPADChan channel,
 IRCResult
 IRCProc(VPADChan channel);
 
+/**
+ * Starts a thread which polls the IR status and receives pending data, so
+ * IRCProc no longer has to.
+ *
+ * Received packets are copied into a queue and the callbacks are still
+ * called from IRCProc, in order. Packets arriving while the queue is full
+ * are dropped.
+ *
+ * \param channel
+ * The device to use for IR.
+ *
+ * \param pollIntervalUs
+ * Time the thread sleeps between polls in microseconds, 0 for 1ms.
+ *
+ * \return
+ * \c TRUE on success.
+ */
+BOOL
+IRCStartBackgroundReceive(VPADChan channel,
+                          uint32_t pollIntervalUs);
+
+/**
+ * Stops the receive thread and runs the callbacks for anything it queued.
+ *
+ * \param channel
+ * The device to use for IR.
+ */
+void
+IRCStopBackgroundReceive(VPADChan channel);
+
 /**
  * Sends data over an IR connection.
  * 
@@ -131,6 +171,52 @@ IRCSend(VPADChan channel,
         uint32_t dataSize,
         uint32_t receiveSize);
 
+/**
+ * Queues data to be sent together with other queued data in one transfer.
+ *
+ * Every IRCSend costs a full CDC transfer however small the packet is.
+ * Queued packets are instead concatenated into one frame of up to
+ * \c IRC_MAX_PACKET_SIZE bytes, which is sent by IRCFlushSend, by the next
+ * IRCSend or when the next packet no longer fits.
+ *
+ * The peer receives one packet per frame, so packet boundaries are lost:
+ * only queue data of a protocol which delimits its own messages.
+ *
+ * \param channel
+ * The device to use for IR.
+ *
+ * \param data
+ * The data which should be sent, copied before this returns.
+ *
+ * \param dataSize
+ * The size of the data, at most \c IRC_MAX_PACKET_SIZE.
+ *
+ * \param receiveSize
+ * Amount of data which should be received from the other device, the
+ * largest one of a frame is used for it.
+ *
+ * \return
+ * \c IRC_RESULT_SUCCESS on success, or the result of sending the previous
+ * frame if it had to be flushed.
+ */
+IRCResult
+IRCQueueSend(VPADChan channel,
+             const void *data,
+             uint32_t dataSize,
+             uint32_t receiveSize);
+
+/**
+ * Sends everything queued with IRCQueueSend as one transfer.
+ *
+ * \param channel
+ * The device to use for IR.
+ *
+ * \return
+ * \c IRC_RESULT_SUCCESS on success or if nothing was queued.
+ */
+IRCResult
+IRCFlushSend(VPADChan channel);
+
 /**
  * Checks if a connection is established.
  * 
@@ -5,8 +5,11 @@
 
 #include <string.h>
 
-static uint8_t sendBuffer[CCR_CDC_IRDA_DATA_TRANSFER_SIZE] __attribute__((aligned(0x40)));
-static uint8_t replyBuffer[CCR_CDC_IRDA_DATA_TRANSFER_SIZE] __attribute__((aligned(0x40)));
+#define CDC_MAX_DRCS 2
+
+// One set of buffers per DRC so transfers to different DRCs can overlap
+static uint8_t sendBuffers[CDC_MAX_DRCS][CCR_CDC_IRDA_DATA_TRANSFER_SIZE] __attribute__((aligned(0x40)));
+static uint8_t replyBuffers[CDC_MAX_DRCS][CCR_CDC_IRDA_DATA_TRANSFER_SIZE] __attribute__((aligned(0x40)));
 
 int32_t
 __CCRCDCIRCConnect(int32_t drcIndex,
@@ -17,8 +20,12 @@ __CCRCDCIRCConnect(int32_t drcIndex,
                    uint8_t targetId,
                    CCRCDCIrdaConnectionType type)
 {
-    CCRCDCIrdaConnectRequest *request = (CCRCDCIrdaConnectRequest *) sendBuffer;
-    CCRCDCIrdaConnectReply *reply = (CCRCDCIrdaConnectReply *) replyBuffer;
+    if (drcIndex < 0 || drcIndex >= CDC_MAX_DRCS) {
+        return -1;
+    }
+
+    CCRCDCIrdaConnectRequest *request = (CCRCDCIrdaConnectRequest *) sendBuffers[drcIndex];
+    CCRCDCIrdaConnectReply *reply = (CCRCDCIrdaConnectReply *) replyBuffers[drcIndex];
 
     if (receiveSize < 0x3e) {
         request->receiveSize = receiveSize + sizeof(CCRCDCIrdaSmallPacketHeader) + 1; // +1 for crc8
@@ -49,8 +56,12 @@ __CCRCDCIRCSend(int32_t drcIndex,
                 uint32_t receiveSize,
                 void *data)
 {
-    CCRCDCIrdaSendRequest *request = (CCRCDCIrdaSendRequest *) sendBuffer;
-    CCRCDCIrdaSendReply *reply = (CCRCDCIrdaSendReply *) replyBuffer;
+    if (drcIndex < 0 || drcIndex >= CDC_MAX_DRCS) {
+        return -1;
+    }
+
+    CCRCDCIrdaSendRequest *request = (CCRCDCIrdaSendRequest *) sendBuffers[drcIndex];
+    CCRCDCIrdaSendReply *reply = (CCRCDCIrdaSendReply *) replyBuffers[drcIndex];
 
     uint16_t totalReceiveSize;
     if (receiveSize < 0x3e) {
@@ -113,7 +124,11 @@ __CCRCDCIRCReceive(int32_t drcIndex,
                    uint16_t *receivedSize,
                    void *data)
 {
-    CCRCDCIrdaReceiveRequest *request = (CCRCDCIrdaReceiveRequest *) sendBuffer;
+    if (drcIndex < 0 || drcIndex >= CDC_MAX_DRCS) {
+        return -1;
+    }
+
+    CCRCDCIrdaReceiveRequest *request = (CCRCDCIrdaReceiveRequest *) sendBuffers[drcIndex];
     CCRCDCIrdaReceiveReply *reply = (CCRCDCIrdaReceiveReply *) data;
 
     request->command = CCR_IRDA_COMMAND_RECEIVE;
@@ -134,8 +149,12 @@ int32_t
 __CCRCDCIRCDisconnect(int32_t drcIndex,
                       uint8_t *result)
 {
-    CCRCDCIrdaDisconnectRequest *request = (CCRCDCIrdaDisconnectRequest *) sendBuffer;
-    CCRCDCIrdaDisconnectReply *reply = (CCRCDCIrdaDisconnectReply *) replyBuffer;
+    if (drcIndex < 0 || drcIndex >= CDC_MAX_DRCS) {
+        return -1;
+    }
+
+    CCRCDCIrdaDisconnectRequest *request = (CCRCDCIrdaDisconnectRequest *) sendBuffers[drcIndex];
+    CCRCDCIrdaDisconnectReply *reply = (CCRCDCIrdaDisconnectReply *) replyBuffers[drcIndex];
 
     reply->result = 0;
     request->command = CCR_IRDA_COMMAND_DISCONNECT;
@@ -1,8 +1,18 @@
 #include "irc/irc.h"
 #include "irc/cdc.h"
 
+#include <coreinit/cache.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <string.h>
 #include <vpad/input.h>
 
+#define IRC_MAX_CHANNELS          2
+#define IRC_EVENT_QUEUE_SIZE      8
+#define IRC_RECEIVE_STACK_SIZE    0x4000
+#define IRC_RECEIVE_PRIORITY      16
+
 typedef enum {
    IRC_STATE_UNINITIALIZED,
    IRC_STATE_DISCONNECTED,
@@ -10,33 +20,137 @@ typedef enum {
    IRC_STATE_CONNECTED,
 } IRCState;
 
-static BOOL isInitialized = FALSE;
-static IRCState state = IRC_STATE_UNINITIALIZED;
-static CCRCDCIrdaConnectionType connectionType;
-static uint8_t targetId;
-static uint8_t sessionId;
-static IRCReceiveCallback receiveCallback;
-static IRCConnectCallback connectCallback;
-static uint8_t receiveBuffer[CCR_CDC_IRDA_DATA_TRANSFER_SIZE] __attribute__((aligned(0x40)));
+typedef struct {
+   BOOL connected;
+   IRCResult result;
+   uint16_t size;
+   uint8_t data[IRC_MAX_PACKET_SIZE];
+} IRCEvent;
+
+typedef struct {
+   BOOL isInitialized;
+   volatile IRCState state;
+   CCRCDCIrdaConnectionType connectionType;
+   uint8_t targetId;
+   uint8_t sessionId;
+   IRCReceiveCallback receiveCallback;
+   IRCConnectCallback connectCallback;
+
+   // Serializes CDC transfers and state changes between the game and the
+   // receive thread, recursive so callbacks run from IRCProc can send
+   OSMutex cdcMutex;
+   uint8_t receiveBuffer[CCR_CDC_IRDA_DATA_TRANSFER_SIZE] __attribute__((aligned(0x40)));
+
+   // Small packets waiting to go out in one transfer
+   uint8_t sendQueue[IRC_MAX_PACKET_SIZE];
+   uint32_t sendQueueSize;
+   uint32_t sendQueueReceiveSize;
+
+   // Events from the receive thread, single producer single consumer
+   IRCEvent eventQueue[IRC_EVENT_QUEUE_SIZE];
+   volatile uint32_t eventHead;
+   volatile uint32_t eventTail;
+
+   OSThread receiveThread;
+   uint8_t receiveThreadStack[IRC_RECEIVE_STACK_SIZE] __attribute__((aligned(16)));
+   volatile BOOL receiveThreadRunning;
+   OSTime receiveInterval;
+} IRCChannel;
+
+static IRCChannel channels[IRC_MAX_CHANNELS];
+
+static IRCChannel *
+IRCGetChannel(VPADChan channel)
+{
+   if ((uint32_t)channel >= IRC_MAX_CHANNELS) {
+      return NULL;
+   }
+
+   return &channels[channel];
+}
+
+static void
+IRCNotifyConnect(IRCChannel *irc,
+                 BOOL background)
+{
+   if (!background) {
+      if (irc->connectCallback) {
+         irc->connectCallback();
+      }
+      return;
+   }
+
+   if (irc->eventHead - irc->eventTail == IRC_EVENT_QUEUE_SIZE) {
+      return;
+   }
+
+   IRCEvent *event = &irc->eventQueue[irc->eventHead % IRC_EVENT_QUEUE_SIZE];
+   event->connected = TRUE;
+   event->result = IRC_RESULT_SUCCESS;
+   event->size = 0;
+
+   OSMemoryBarrier();
+   irc->eventHead = irc->eventHead + 1;
+}
+
+static void
+IRCNotifyReceive(IRCChannel *irc,
+                 BOOL background,
+                 void *data,
+                 uint16_t size,
+                 IRCResult result)
+{
+   if (!background) {
+      if (irc->receiveCallback) {
+         irc->receiveCallback(data, size, result);
+      }
+      return;
+   }
+
+   // Packets are dropped rather than overwritten while the game isn't
+   // keeping up
+   if (irc->eventHead - irc->eventTail == IRC_EVENT_QUEUE_SIZE) {
+      return;
+   }
+
+   IRCEvent *event = &irc->eventQueue[irc->eventHead % IRC_EVENT_QUEUE_SIZE];
+   event->connected = FALSE;
+   event->result = result;
+   event->size = size;
+   if (data) {
+      memcpy(event->data, data, size);
+   }
+
+   OSMemoryBarrier();
+   irc->eventHead = irc->eventHead + 1;
+}
 
 BOOL
 IRCInit(VPADChan channel,
-        uint8_t _targetId)
+        uint8_t targetId)
 {
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc) {
+      return FALSE;
+   }
+
    if (!VPADBASEIsInit()) {
       return FALSE;
    }
 
-   if (isInitialized) {
+   if (irc->isInitialized) {
       return FALSE;
    }
 
-   isInitialized = TRUE;
-   state = IRC_STATE_DISCONNECTED;
-   connectionType = CCR_IRDA_CONNECTION_WAIT;
-   targetId = _targetId;
-   receiveCallback = NULL;
-   connectCallback = NULL;
+   irc->isInitialized = TRUE;
+   irc->state = IRC_STATE_DISCONNECTED;
+   irc->connectionType = CCR_IRDA_CONNECTION_WAIT;
+   irc->targetId = targetId;
+   irc->receiveCallback = NULL;
+   irc->connectCallback = NULL;
+   irc->sendQueueSize = 0;
+   irc->sendQueueReceiveSize = 0;
+   OSInitMutexEx(&irc->cdcMutex, "IRC CDC");
 
    return TRUE;
 }
@@ -49,34 +163,42 @@ IRCConnect(VPADChan channel,
            uint32_t receiveSize,
            IRCConnectCallback callback)
 {
-   if (state == IRC_STATE_UNINITIALIZED) {
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || irc->state == IRC_STATE_UNINITIALIZED) {
      return IRC_RESULT_UNINITIALIZED;
    }
 
-   // Can't connected if we already have an established connection
-   if (state == IRC_STATE_CONNECTED) {
-      return IRC_RESULT_ALREADY_CONNECTED;
-   }
-
    // IR is blocked if the TV menu is opened
    if (VPADGetTVMenuStatus(channel)) {
       return IRC_IR_UNAVAILABLE;
    }
 
-   connectionType = type;
+   OSLockMutex(&irc->cdcMutex);
+
+   // Can't connected if we already have an established connection
+   if (irc->state == IRC_STATE_CONNECTED) {
+      OSUnlockMutex(&irc->cdcMutex);
+      return IRC_RESULT_ALREADY_CONNECTED;
+   }
+
+   irc->connectionType = type;
+   irc->sendQueueSize = 0;
 
    uint8_t result;
-   if (__CCRCDCIRCConnect(channel,
-                          &result,
-                          timeout,
-                          bitrate,
-                          receiveSize,
-                          targetId,
-                          type) != 0) {
+   int32_t ret = __CCRCDCIRCConnect(channel,
+                                    &result,
+                                    timeout,
+                                    bitrate,
+                                    receiveSize,
+                                    irc->targetId,
+                                    type);
+   if (ret != 0) {
+      OSUnlockMutex(&irc->cdcMutex);
       return IRC_RESULT_CONNECT_FAILED;
    }
 
    if (result != 0) {
+      OSUnlockMutex(&irc->cdcMutex);
       return result;
    }
 
@@ -87,42 +209,39 @@ IRCConnect(VPADChan channel,
    //   // If the type is any, we don't need to wait for a connection
    //   state = IRC_STATE_CONNECTED;
    //} else {
-      state = IRC_STATE_WAITING;
-      connectCallback = callback;
+      irc->state = IRC_STATE_WAITING;
+      irc->connectCallback = callback;
    //}
 
+   OSUnlockMutex(&irc->cdcMutex);
    return IRC_RESULT_SUCCESS;
 }
 
-IRCResult
-IRCProc(VPADChan channel)
+static IRCResult
+IRCProcessLocked(VPADChan channel,
+                 IRCChannel *irc,
+                 BOOL background)
 {
-   if (!isInitialized) {
-      return IRC_RESULT_UNINITIALIZED;
-   }
 
    uint32_t status = VPADBASEGetIRCStatus(channel);
    if (status & VPAD_IRC_STATUS_FLAG_CONNECTED) {
       // If we were waiting on a connection, we're now connected
-      if (state == IRC_STATE_WAITING) {
-         if (connectCallback) {
-            connectCallback();
-         }
-
-         state = IRC_STATE_CONNECTED;
+      if (irc->state == IRC_STATE_WAITING) {
+         IRCNotifyConnect(irc, background);
+         irc->state = IRC_STATE_CONNECTED;
          return IRC_RESULT_SUCCESS;
       }
    } else {
       // If we were connected, the connection is now broken
-      if (state == IRC_STATE_CONNECTED) {
-         state = IRC_STATE_DISCONNECTED;
+      if (irc->state == IRC_STATE_CONNECTED) {
+         irc->state = IRC_STATE_DISCONNECTED;
       }
    }
 
    if (!(status & VPAD_IRC_STATUS_FLAG_HAS_DATA)) {
       // IR is blocked if the TV menu is opened
       if (VPADGetTVMenuStatus(channel)) {
-         state = IRC_STATE_DISCONNECTED;
+         irc->state = IRC_STATE_DISCONNECTED;
          return IRC_IR_UNAVAILABLE;
       }
 
@@ -132,48 +251,44 @@ IRCProc(VPADChan channel)
    // If we're here, there is pending data which can be received
    uint8_t result;
    uint16_t receivedSize;
-   if (__CCRCDCIRCReceive(channel,
-                          &result,
-                          &receivedSize,
-                          receiveBuffer) != 0) {
+   int32_t ret = __CCRCDCIRCReceive(channel,
+                                    &result,
+                                    &receivedSize,
+                                    irc->receiveBuffer);
+   if (ret != 0) {
       return IRC_RESULT_RECEIVE_FAILED;
    }
 
-   if (state == IRC_STATE_UNINITIALIZED) {
+   if (irc->state == IRC_STATE_UNINITIALIZED) {
       return IRC_RESULT_SUCCESS;
    }
 
-   if (state == IRC_STATE_DISCONNECTED) {
-      if (receiveCallback) {
-         receiveCallback(NULL, 0, result);
-      }
-
+   if (irc->state == IRC_STATE_DISCONNECTED) {
+      IRCNotifyReceive(irc, background, NULL, 0, result);
       return result;
    }
 
    // If we're not connected yet, but are already receiving data, terminate connection
-   if (state == IRC_STATE_WAITING) {
-      if (receiveCallback) {
-         receiveCallback(NULL, 0, result);
-      }
-
-      state = IRC_STATE_DISCONNECTED;
+   if (irc->state == IRC_STATE_WAITING) {
+      IRCNotifyReceive(irc, background, NULL, 0, result);
+      irc->state = IRC_STATE_DISCONNECTED;
       return result;
    }
 
-   if (!receiveCallback) {
+   // The callback may be set by the time the game dispatches the packet
+   if (!irc->receiveCallback && !background) {
       return IRC_RESULT_SUCCESS;
    }
 
    if (result != 0) {
-      receiveCallback(NULL, 0, result);
+      IRCNotifyReceive(irc, background, NULL, 0, result);
       return result;
    }
 
-   CCRCDCIrdaSmallPacketHeader *smallHeader = (CCRCDCIrdaSmallPacketHeader *) (receiveBuffer + sizeof(CCRCDCIrdaReceiveReply));
-   CCRCDCIrdaLargePacketHeader *largeHeader = (CCRCDCIrdaLargePacketHeader *) (receiveBuffer + sizeof(CCRCDCIrdaReceiveReply));
+   CCRCDCIrdaSmallPacketHeader *smallHeader = (CCRCDCIrdaSmallPacketHeader *) (irc->receiveBuffer + sizeof(CCRCDCIrdaReceiveReply));
+   CCRCDCIrdaLargePacketHeader *largeHeader = (CCRCDCIrdaLargePacketHeader *) (irc->receiveBuffer + sizeof(CCRCDCIrdaReceiveReply));
 
-   sessionId = smallHeader->sessionId;
+   irc->sessionId = smallHeader->sessionId;
 
    void *packetData;
    uint16_t packetSize;
@@ -188,56 +303,262 @@ IRCProc(VPADChan channel)
    // Don't count the request size
    packetSize -= 2;
 
-   if (packetSize > 0x1fe) {
-      receiveCallback(NULL, 0, IRC_RESULT_INVALID_PACKET);
+   if (packetSize > IRC_MAX_PACKET_SIZE) {
+      IRCNotifyReceive(irc, background, NULL, 0, IRC_RESULT_INVALID_PACKET);
       return IRC_RESULT_INVALID_PACKET;
    }
 
-   receiveCallback(packetData, packetSize, IRC_RESULT_SUCCESS);
+   IRCNotifyReceive(irc, background, packetData, packetSize, IRC_RESULT_SUCCESS);
    return IRC_RESULT_SUCCESS;
 }
 
+static IRCResult
+IRCProcess(VPADChan channel,
+           BOOL background)
+{
+   IRCChannel *irc = &channels[channel];
+
+   OSLockMutex(&irc->cdcMutex);
+   IRCResult result = IRCProcessLocked(channel, irc, background);
+   OSUnlockMutex(&irc->cdcMutex);
+   return result;
+}
+
+static int
+IRCReceiveThreadEntry(int argc,
+                      const char **argv)
+{
+   VPADChan channel = (VPADChan)argc;
+   IRCChannel *irc = &channels[channel];
+
+   while (irc->receiveThreadRunning) {
+      IRCProcess(channel, TRUE);
+      OSSleepTicks(irc->receiveInterval);
+   }
+
+   return 0;
+}
+
+//! Run the callbacks for everything the receive thread queued
+static IRCResult
+IRCDispatchEvents(IRCChannel *irc)
+{
+   IRCResult lastResult = IRC_RESULT_SUCCESS;
+
+   while (irc->eventTail != irc->eventHead) {
+      IRCEvent *event = &irc->eventQueue[irc->eventTail % IRC_EVENT_QUEUE_SIZE];
+      OSMemoryBarrier();
+
+      if (event->connected) {
+         if (irc->connectCallback) {
+            irc->connectCallback();
+         }
+      } else {
+         if (irc->receiveCallback) {
+            irc->receiveCallback(event->result == IRC_RESULT_SUCCESS ? event->data : NULL,
+                                 event->size, event->result);
+         }
+
+         lastResult = event->result;
+      }
+
+      OSMemoryBarrier();
+      irc->eventTail = irc->eventTail + 1;
+   }
+
+   return lastResult;
+}
+
 IRCResult
-IRCSend(VPADChan channel,
-        void *data,
-        uint32_t dataSize,
-        uint32_t receiveSize)
+IRCProc(VPADChan channel)
 {
-   if (!isInitialized) {
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || !irc->isInitialized) {
       return IRC_RESULT_UNINITIALIZED;
    }
 
+   if (irc->receiveThreadRunning) {
+      return IRCDispatchEvents(irc);
+   }
+
+   return IRCProcess(channel, FALSE);
+}
+
+BOOL
+IRCStartBackgroundReceive(VPADChan channel,
+                          uint32_t pollIntervalUs)
+{
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || !irc->isInitialized || irc->receiveThreadRunning) {
+      return FALSE;
+   }
+
+   irc->receiveInterval = OSMicrosecondsToTicks(pollIntervalUs ? pollIntervalUs : 1000);
+   irc->eventHead = 0;
+   irc->eventTail = 0;
+   irc->receiveThreadRunning = TRUE;
+
+   if (!OSCreateThread(&irc->receiveThread,
+                       IRCReceiveThreadEntry,
+                       (int)channel,
+                       NULL,
+                       irc->receiveThreadStack + sizeof(irc->receiveThreadStack),
+                       sizeof(irc->receiveThreadStack),
+                       IRC_RECEIVE_PRIORITY,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      irc->receiveThreadRunning = FALSE;
+      return FALSE;
+   }
+
+   OSSetThreadName(&irc->receiveThread, "IRC receive");
+   OSResumeThread(&irc->receiveThread);
+   return TRUE;
+}
+
+void
+IRCStopBackgroundReceive(VPADChan channel)
+{
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || !irc->receiveThreadRunning) {
+      return;
+   }
+
+   irc->receiveThreadRunning = FALSE;
+   OSJoinThread(&irc->receiveThread, NULL);
+
+   // Deliver whatever arrived before the thread stopped
+   IRCDispatchEvents(irc);
+}
+
+static IRCResult
+IRCSendPacket(VPADChan channel,
+              IRCChannel *irc,
+              void *data,
+              uint32_t dataSize,
+              uint32_t receiveSize)
+{
    // IR is blocked if the TV menu is opened
    if (VPADGetTVMenuStatus(channel)) {
       return IRC_IR_UNAVAILABLE;
    }
 
-   if (state != IRC_STATE_CONNECTED) {
+   OSLockMutex(&irc->cdcMutex);
+   if (irc->state != IRC_STATE_CONNECTED) {
+      OSUnlockMutex(&irc->cdcMutex);
       return IRC_RESULT_NOT_CONNECTED;
    }
 
    uint8_t result;
-   if (__CCRCDCIRCSend(channel,
-                       &result,
-                       dataSize,
-                       receiveSize,
-                       data) != 0) {
+   int32_t ret = __CCRCDCIRCSend(channel,
+                                 &result,
+                                 dataSize,
+                                 receiveSize,
+                                 data);
+   OSUnlockMutex(&irc->cdcMutex);
+   if (ret != 0) {
+      return IRC_RESULT_SEND_FAILED;
+   }
+
+   return result;
+}
+
+IRCResult
+IRCSend(VPADChan channel,
+        void *data,
+        uint32_t dataSize,
+        uint32_t receiveSize)
+{
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || !irc->isInitialized) {
+      return IRC_RESULT_UNINITIALIZED;
+   }
+
+   // Keep the order of anything queued before this packet
+   if (irc->sendQueueSize) {
+      IRCResult result = IRCFlushSend(channel);
+      if (result != IRC_RESULT_SUCCESS) {
+         return result;
+      }
+   }
+
+   return IRCSendPacket(channel, irc, data, dataSize, receiveSize);
+}
+
+IRCResult
+IRCQueueSend(VPADChan channel,
+             const void *data,
+             uint32_t dataSize,
+             uint32_t receiveSize)
+{
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || !irc->isInitialized) {
+      return IRC_RESULT_UNINITIALIZED;
+   }
+
+   if (dataSize > IRC_MAX_PACKET_SIZE) {
       return IRC_RESULT_SEND_FAILED;
    }
 
+   if (irc->state != IRC_STATE_CONNECTED) {
+      return IRC_RESULT_NOT_CONNECTED;
+   }
+
+   // Send what's queued first if this packet doesn't fit in the same frame
+   if (irc->sendQueueSize + dataSize > IRC_MAX_PACKET_SIZE) {
+      IRCResult result = IRCFlushSend(channel);
+      if (result != IRC_RESULT_SUCCESS) {
+         return result;
+      }
+   }
+
+   memcpy(irc->sendQueue + irc->sendQueueSize, data, dataSize);
+   irc->sendQueueSize += dataSize;
+
+   // The frame waits for the largest reply any of its packets asked for
+   if (receiveSize > irc->sendQueueReceiveSize) {
+      irc->sendQueueReceiveSize = receiveSize;
+   }
+
+   return IRC_RESULT_SUCCESS;
+}
+
+IRCResult
+IRCFlushSend(VPADChan channel)
+{
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || !irc->isInitialized) {
+      return IRC_RESULT_UNINITIALIZED;
+   }
+
+   if (!irc->sendQueueSize) {
+      return IRC_RESULT_SUCCESS;
+   }
+
+   IRCResult result = IRCSendPacket(channel,
+                                    irc,
+                                    irc->sendQueue,
+                                    irc->sendQueueSize,
+                                    irc->sendQueueReceiveSize);
+
+   // A failed frame is dropped rather than resent, the peer may already
+   // have seen part of it
+   irc->sendQueueSize = 0;
+   irc->sendQueueReceiveSize = 0;
    return result;
 }
 
 BOOL
 IRCIsConnect(VPADChan channel)
 {
-   return state == IRC_STATE_CONNECTED;
+   IRCChannel *irc = IRCGetChannel(channel);
+   return irc && irc->state == IRC_STATE_CONNECTED;
 }
 
 IRCResult
 IRCDisconnect(VPADChan channel)
 {
-   if (!isInitialized) {
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc || !irc->isInitialized) {
       return IRC_RESULT_UNINITIALIZED;
    }
 
@@ -247,20 +568,31 @@ IRCDisconnect(VPADChan channel)
    }
 
    uint8_t result;
-   if (__CCRCDCIRCDisconnect(channel,
-                             &result) != 0) {
+   OSLockMutex(&irc->cdcMutex);
+   int32_t ret = __CCRCDCIRCDisconnect(channel,
+                                       &result);
+   if (ret != 0) {
+      OSUnlockMutex(&irc->cdcMutex);
       return IRC_RESULT_DISCONNECT_FAILED;
    }
 
-   state = IRC_STATE_DISCONNECTED;
+   irc->state = IRC_STATE_DISCONNECTED;
+   irc->sendQueueSize = 0;
+   irc->sendQueueReceiveSize = 0;
+   OSUnlockMutex(&irc->cdcMutex);
    return result;
 }
 
 IRCReceiveCallback
 IRCSetReceiveCallback(VPADChan channel,
-                      IRCReceiveCallback _receiveCallback)
+                      IRCReceiveCallback receiveCallback)
 {
-   IRCReceiveCallback prev = receiveCallback;
-   receiveCallback = _receiveCallback;
+   IRCChannel *irc = IRCGetChannel(channel);
+   if (!irc) {
+      return NULL;
+   }
+
+   IRCReceiveCallback prev = irc->receiveCallback;
+   irc->receiveCallback = receiveCallback;
    return prev;
 }
@@ -0,0 +1,105 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_arena Arena
+ * \ingroup whb
+ *
+ * Bump allocator for transient memory that is all released at once, e.g.
+ * scratch memory that lives for one frame.
+ *
+ * The arena is a frame heap. Every core carves its allocations out of its
+ * own chunk of the heap with interrupts disabled, so threads allocating on
+ * different cores never contend and only take the heap lock to get a new
+ * chunk. Allocations can't be freed individually, WHBArenaReset releases
+ * all of them in constant time.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WHBArena WHBArena;
+
+/**
+ * Create an arena of size bytes allocated from the default heap.
+ *
+ * \param chunkSize
+ * Size of the chunks handed to each core, or 0 for 16 KiB. Allocations
+ * larger than a quarter of it go to the frame heap directly.
+ *
+ * \return
+ * The arena, or NULL on failure.
+ */
+WHBArena *
+WHBArenaCreate(uint32_t size,
+               uint32_t chunkSize);
+
+/**
+ * Create an arena in the given memory, e.g. from MEM1 or the foreground
+ * bucket. The memory must stay valid until WHBArenaDestroy.
+ *
+ * \return
+ * The arena, or NULL if the memory is too small.
+ */
+WHBArena *
+WHBArenaCreateFromMemory(void *memory,
+                         uint32_t size,
+                         uint32_t chunkSize);
+
+/**
+ * Destroy an arena, freeing its memory if it was created by WHBArenaCreate.
+ */
+void
+WHBArenaDestroy(WHBArena *arena);
+
+/**
+ * Allocate size bytes aligned to align, which must be a power of two of at
+ * most 64.
+ *
+ * Can be called from any thread.
+ *
+ * \return
+ * The allocation, or NULL if the arena is full.
+ */
+void *
+WHBArenaAlloc(WHBArena *arena,
+              uint32_t size,
+              uint32_t align);
+
+/**
+ * Copy a string into the arena.
+ */
+char *
+WHBArenaStrdup(WHBArena *arena,
+               const char *str);
+
+/**
+ * Format a string into the arena.
+ */
+char *
+WHBArenaPrintf(WHBArena *arena,
+               const char *fmt,
+               ...);
+
+/**
+ * Release every allocation made from the arena.
+ *
+ * No other thread may be using the arena at the same time.
+ */
+void
+WHBArenaReset(WHBArena *arena);
+
+/**
+ * Get the number of bytes left in the arena, not counting what is left in
+ * the chunks of each core.
+ */
+uint32_t
+WHBArenaGetFreeSize(WHBArena *arena);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
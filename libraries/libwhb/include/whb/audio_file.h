@@ -0,0 +1,84 @@
+#pragma once
+#include <wut.h>
+#include <whb/audio_stream.h>
+
+/**
+ * \defgroup whb_audio_file Streaming audio files
+ * \ingroup whb
+ *
+ * Plays a music track from disk with bounded memory, on top of
+ * WHBAudioStream:
+ *
+ * \code
+ * AXInit();
+ * WHBAudioFile *music = WHBAudioFileOpen("fs:/vol/content/music.dsp", TRUE);
+ * ...
+ * WHBAudioFileClose(music);
+ * \endcode
+ *
+ * A thread on the chosen core reads the file through the devoptab in large
+ * cache aligned chunks, decodes it to 16-bit PCM and feeds the stream's
+ * ring, sleeping while the ring is full. Playback starts once the ring has
+ * been filled for the first time. Only a read buffer, the ring and the
+ * voice buffers are allocated, whatever the length of the track.
+ *
+ * Supported formats are 16-bit PCM WAV files with one or two channels and
+ * mono Nintendo DSP ADPCM files. Looping tracks restart from the beginning.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WHBAudioFile WHBAudioFile;
+
+/**
+ * Open path and start streaming it, decoding on core 2.
+ *
+ * \return
+ * NULL if the file can't be opened or its format is not supported.
+ */
+WHBAudioFile *
+WHBAudioFileOpen(const char *path,
+                 BOOL loop);
+
+/**
+ * Open path and start streaming it.
+ *
+ * \param core
+ * Core the decoder thread runs on, 0 to 2.
+ *
+ * \param ringFrames
+ * Frames the stream's ring holds, see WHBAudioStreamCreate.
+ */
+WHBAudioFile *
+WHBAudioFileOpenEx(const char *path,
+                   BOOL loop,
+                   uint32_t core,
+                   uint32_t ringFrames);
+
+/**
+ * Stop playback and the decoder thread, then free everything.
+ */
+void
+WHBAudioFileClose(WHBAudioFile *file);
+
+/**
+ * The stream the file plays on, e.g. for WHBAudioStreamSetVolume.
+ */
+WHBAudioStream *
+WHBAudioFileGetStream(WHBAudioFile *file);
+
+/**
+ * TRUE once a track that doesn't loop has been decoded completely, or
+ * reading failed.
+ */
+BOOL
+WHBAudioFileIsFinished(WHBAudioFile *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
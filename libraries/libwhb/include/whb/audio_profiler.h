@@ -0,0 +1,118 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup whb_audio_profiler Audio frame profiler
+ * \ingroup whb
+ *
+ * Measures how much of every AX frame is spent rendering audio, to find
+ * the frames that come close to an overrun before they crackle:
+ *
+ * \code
+ * AXInitWithParams(&params);
+ * WHBAudioProfilerInit();
+ * while (WHBProcIsRunning()) {
+ *    WHBAudioProfilerUpdate();
+ *    ...
+ * }
+ * WHBAudioProfilerLog();
+ * WHBAudioProfilerShutdown();
+ * \endcode
+ *
+ * AX records a profile of every frame, WHBAudioProfilerUpdate collects them
+ * and should be called at least every WHB_AUDIO_PROFILER_MAX_PROFILES AX
+ * frames (3 ms each), once a video frame is plenty. The performance HUD
+ * shows the statistics while the profiler runs, and with
+ * WHBAudioProfilerSetTraceEnabled each frame is also recorded as trace
+ * events.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Profiles AX keeps between two calls to WHBAudioProfilerUpdate.
+#define WHB_AUDIO_PROFILER_MAX_PROFILES   64
+
+//! AX frames over which the rolling peaks are taken, about a second.
+#define WHB_AUDIO_PROFILER_PEAK_WINDOW    333
+
+typedef struct WHBAudioProfilerStats
+{
+   //! AX frames profiled since WHBAudioProfilerInit or WHBAudioProfilerReset.
+   uint32_t frames;
+
+   //! Frames that took longer than framePeriod, heard as crackling.
+   uint32_t overruns;
+
+   //! Length of an AX frame.
+   OSTime framePeriod;
+
+   //! Duration of the last frame, of its aux callbacks and of the frame
+   //! callbacks of the application.
+   OSTime frameTime;
+   OSTime auxTime;
+   OSTime callbackTime;
+
+   //! Voices rendered in the last frame.
+   uint32_t voices;
+
+   //! Longest times and most voices over the last peak window.
+   OSTime peakFrameTime;
+   OSTime peakCallbackTime;
+   uint32_t peakVoices;
+
+   //! Longest frame since WHBAudioProfilerInit or WHBAudioProfilerReset.
+   OSTime maxFrameTime;
+
+   //! peakFrameTime as a share of framePeriod, in percent.
+   uint32_t peakLoad;
+} WHBAudioProfilerStats;
+
+/**
+ * Start profiling AX frames, AX must already be initialised.
+ */
+BOOL
+WHBAudioProfilerInit();
+
+void
+WHBAudioProfilerShutdown();
+
+BOOL
+WHBAudioProfilerIsRunning();
+
+/**
+ * Collect the frames profiled since the last call.
+ */
+void
+WHBAudioProfilerUpdate();
+
+/**
+ * Forget the frames collected so far.
+ */
+void
+WHBAudioProfilerReset();
+
+/**
+ * Also record the frame, aux and callback time of each AX frame with
+ * WHBTraceAddEvent. Disabled by default.
+ */
+void
+WHBAudioProfilerSetTraceEnabled(BOOL enabled);
+
+void
+WHBAudioProfilerGetStats(WHBAudioProfilerStats *stats);
+
+/**
+ * Print the statistics with WHBLogPrint.
+ */
+void
+WHBAudioProfilerLog();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,128 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_audio_stream Streaming audio
+ * \ingroup whb
+ *
+ * Plays 16-bit PCM produced by a decoder thread on one AX voice per channel,
+ * without any lock shared between the decoder and the audio callback:
+ *
+ * \code
+ * AXInit();
+ * WHBAudioStream *stream = WHBAudioStreamCreate(44100, 2, 16384, 2048);
+ * WHBAudioStreamStart(stream);
+ * // On the decoder thread:
+ * while (decoding) {
+ *    uint32_t frames = decode(samples, WHBAudioStreamGetFreeFrames(stream));
+ *    WHBAudioStreamWrite(stream, samples, frames);
+ * }
+ * \endcode
+ *
+ * The decoder writes interleaved frames into a single-producer
+ * single-consumer ring. The voices loop over a buffer of two halves, and an
+ * AXRegisterAppFrameCallback callback refills the half that has just
+ * finished playing from the ring, so the ring must always hold at least
+ * half a voice buffer. Whenever it doesn't, the rest of the half is played
+ * as silence and counted as an underrun.
+ *
+ * AX has to be initialised before creating a stream. Create and destroy
+ * streams from one thread only.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Streams that can exist at the same time.
+#define WHB_AUDIO_STREAM_MAX 4
+
+typedef struct WHBAudioStream WHBAudioStream;
+
+typedef struct WHBAudioStreamStats
+{
+   //! Voice buffer halves that were not completely filled from the ring.
+   uint32_t underruns;
+
+   //! Frames dropped by WHBAudioStreamWrite because the ring was full.
+   uint32_t overruns;
+
+   //! Frames moved from the ring to the voices.
+   uint64_t framesPlayed;
+} WHBAudioStreamStats;
+
+/**
+ * Create a stream and acquire its voices.
+ *
+ * \param channels
+ * 1 for mono or 2 for stereo.
+ *
+ * \param ringFrames
+ * Frames the ring between decoder and callback holds, rounded up to a
+ * power of two.
+ *
+ * \param halfFrames
+ * Frames in each half of the voice buffers. The latency is between one and
+ * two halves, and the decoder has to stay at least one half ahead.
+ *
+ * \return
+ * NULL if allocation failed or no voice could be acquired.
+ */
+WHBAudioStream *
+WHBAudioStreamCreate(uint32_t sampleRate,
+                     uint32_t channels,
+                     uint32_t ringFrames,
+                     uint32_t halfFrames);
+
+/**
+ * Stop the stream, free its voices and memory.
+ */
+void
+WHBAudioStreamDestroy(WHBAudioStream *stream);
+
+/**
+ * Start playing what is already in the ring, then keep refilling.
+ */
+void
+WHBAudioStreamStart(WHBAudioStream *stream);
+
+void
+WHBAudioStreamStop(WHBAudioStream *stream);
+
+/**
+ * Set the volume of every channel, 1.0f being full volume.
+ */
+void
+WHBAudioStreamSetVolume(WHBAudioStream *stream,
+                        float volume);
+
+/**
+ * Frames WHBAudioStreamWrite can take without dropping any. Only call
+ * from the producer thread.
+ */
+uint32_t
+WHBAudioStreamGetFreeFrames(WHBAudioStream *stream);
+
+/**
+ * Append interleaved frames to the ring without blocking. Only one thread
+ * may write to a stream.
+ *
+ * \return
+ * The number of frames written, frames that did not fit are dropped and
+ * counted as overruns.
+ */
+uint32_t
+WHBAudioStreamWrite(WHBAudioStream *stream,
+                    const int16_t *samples,
+                    uint32_t frames);
+
+void
+WHBAudioStreamGetStats(WHBAudioStream *stream,
+                       WHBAudioStreamStats *outStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
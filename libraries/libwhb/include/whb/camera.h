@@ -0,0 +1,85 @@
+#pragma once
+#include <wut.h>
+#include <camera/camera.h>
+#include <coreinit/time.h>
+#include <gx2/texture.h>
+
+/**
+ * \defgroup whb_camera GamePad camera
+ * \ingroup whb
+ *
+ * Captures the GamePad camera into a pool of surfaces that GX2 samples
+ * directly:
+ *
+ * \code
+ * WHBCameraInit(CAMERA_FPS_30);
+ * while (WHBProcIsRunning()) {
+ *    const WHBCameraFrame *frame = WHBCameraAcquireFrame();
+ *    if (frame) {
+ *       GX2SetPixelTexture(&frame->luma, 0);
+ *       GX2SetPixelTexture(&frame->chroma, 1);
+ *       // Draw, converting with WHBVideoGetYuvToRgbMatrix in the shader
+ *    }
+ *    ...
+ * }
+ * WHBCameraShutdown();
+ * \endcode
+ *
+ * The surfaces are triple buffered: the camera fills one, the latest
+ * complete one waits in a slot and the application holds the third. The
+ * camera's event handler and WHBCameraAcquireFrame exchange buffers through
+ * that slot with a single atomic swap each, so neither side ever waits on
+ * the other and no frame is copied. The application always gets the most
+ * recent frame, older ones are recycled unseen.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WHB_CAMERA_NUM_SURFACES 3
+
+typedef struct WHBCameraFrame
+{
+   //! CAMERA_WIDTH x CAMERA_HEIGHT luma in the red channel.
+   GX2Texture luma;
+
+   //! Half resolution chroma, Cb in the red and Cr in the green channel.
+   GX2Texture chroma;
+
+   //! Counts the frames the camera delivered, including ones never acquired.
+   uint32_t sequence;
+
+   //! When the camera finished the frame.
+   OSTime time;
+} WHBCameraFrame;
+
+/**
+ * Allocate the camera's work memory and surfaces, then start capturing.
+ */
+BOOL
+WHBCameraInit(CamFps fps);
+
+void
+WHBCameraShutdown();
+
+/**
+ * Take the newest frame, giving the previously acquired one back to the
+ * camera. Call from the thread that owns the GX2 context.
+ *
+ * The frame stays valid until the next call; the camera doesn't start
+ * writing to it again before it has delivered another frame.
+ *
+ * \return
+ * The same frame as last time if the camera hasn't delivered a newer one,
+ * NULL until the first frame arrives.
+ */
+const WHBCameraFrame *
+WHBCameraAcquireFrame();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
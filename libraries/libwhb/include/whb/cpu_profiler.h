@@ -0,0 +1,87 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_cpu_profiler Sampling CPU profiler
+ * \ingroup whb
+ *
+ * Samples what every core is running from a periodic alarm:
+ *
+ * \code
+ * WHBCpuProfilerInit(1000);
+ * while (WHBProcIsRunning()) {
+ *    ...
+ *    WHBCpuProfilerUpdate();
+ * }
+ * WHBCpuProfilerWriteFolded("fs:/vol/external01/profile.folded");
+ * WHBCpuProfilerShutdown();
+ * \endcode
+ *
+ * Each sample records the PC, LR and a short back chain of the thread that
+ * was interrupted. Samples go into a lock free buffer per core and are
+ * merged into identical stacks by WHBCpuProfilerUpdate. Symbols are only
+ * looked up when the stacks are exported, in the folded format read by
+ * flamegraph.pl.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Maximum number of addresses recorded per sample.
+#define WHB_CPU_PROFILER_MAX_DEPTH 16
+
+//! Maximum number of distinct stacks that are kept.
+#define WHB_CPU_PROFILER_MAX_STACKS 4096
+
+/**
+ * Start sampling every core every intervalUs microseconds.
+ */
+BOOL
+WHBCpuProfilerInit(uint32_t intervalUs);
+
+void
+WHBCpuProfilerShutdown();
+
+/**
+ * Merge the samples taken since the last call into the stack table.
+ *
+ * Should be called regularly, e.g. once a frame, samples are dropped when
+ * a core's buffer is full.
+ */
+void
+WHBCpuProfilerUpdate();
+
+/**
+ * Forget every sample taken so far.
+ */
+void
+WHBCpuProfilerReset();
+
+/**
+ * Get the number of samples dropped because a buffer or the stack table
+ * was full.
+ */
+uint32_t
+WHBCpuProfilerGetDroppedSamples();
+
+/**
+ * Write the stacks to a file in folded format, one "a;b;c count" line per
+ * distinct stack.
+ */
+BOOL
+WHBCpuProfilerWriteFolded(const char *path);
+
+/**
+ * Print the stacks in folded format with WHBLogPrint, e.g. to send them
+ * over UDP with WHBLogUdpInit.
+ */
+void
+WHBCpuProfilerLogFolded();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -1,5 +1,6 @@
 #pragma once
 #include <wut.h>
+#include <coreinit/time.h>
 
 /**
  * \defgroup whb_crash Crash Handler
@@ -11,9 +12,75 @@
 extern "C" {
 #endif
 
+#define WHB_CRASH_DUMP_MAGIC        0x57434431 // "WCD1"
+#define WHB_CRASH_DUMP_MAX_RPLS     64
+#define WHB_CRASH_DUMP_MAX_STACK    (16 * 1024)
+#define WHB_CRASH_DUMP_CODE_SIZE    (256)
+
+/**
+ * A loaded RPL at the time of the crash.
+ */
+typedef struct WHBCrashDumpRPL
+{
+   uint32_t textAddr;
+   uint32_t textSize;
+   uint32_t dataAddr;
+   uint32_t dataSize;
+   uint32_t readAddr;
+   uint32_t readSize;
+   char name[64];
+} WHBCrashDumpRPL;
+WUT_CHECK_SIZE(WHBCrashDumpRPL, 0x58);
+
+/**
+ * Header of a crash dump written by the crash handler, all offsets are from
+ * the start of the file and all values are big endian.
+ *
+ * The header is followed by the OSContext of the crashed thread, the RPL
+ * list, up to WHB_CRASH_DUMP_MAX_STACK bytes of stack starting at the stack
+ * pointer and WHB_CRASH_DUMP_CODE_SIZE bytes of code centered on SRR0.
+ * Nothing is symbolised on the console, addresses can be resolved offline
+ * against the RPL list.
+ */
+typedef struct WHBCrashDumpHeader
+{
+   uint32_t magic;
+   //! Size of the dump without the padding of the write.
+   uint32_t size;
+   //! "DSI", "ISI", "PROGRAM" or "ALIGNMENT".
+   char type[16];
+   uint32_t coreId;
+   uint32_t upid;
+   OSTime time;
+   //! Address of the crashed thread, and so of its OSContext.
+   uint32_t thread;
+   uint32_t contextOffset;
+   uint32_t rplOffset;
+   uint32_t rplCount;
+   uint32_t stackOffset;
+   uint32_t stackAddr;
+   uint32_t stackSize;
+   uint32_t codeOffset;
+   uint32_t codeAddr;
+   uint32_t codeSize;
+} WHBCrashDumpHeader;
+WUT_CHECK_OFFSET(WHBCrashDumpHeader, 0x20, time);
+WUT_CHECK_OFFSET(WHBCrashDumpHeader, 0x28, thread);
+WUT_CHECK_SIZE(WHBCrashDumpHeader, 0x50);
+
 BOOL
 WHBInitCrashHandler();
 
+/**
+ * Write a binary crash dump to path when a crash is handled, or NULL to
+ * only log the crash.
+ *
+ * The dump is captured into a static buffer without allocating memory and
+ * written with a single write, so it works even if the heap is corrupt.
+ */
+void
+WHBSetCrashDumpPath(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
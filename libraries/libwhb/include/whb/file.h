@@ -43,6 +43,106 @@ WHBReadWholeFile(const char *path,
 void
 WHBFreeWholeFile(char *file);
 
+#define WHB_FILE_DEFAULT_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * Allocator for WHBReadWholeFileEx, e.g. to load into MEM1, the foreground
+ * bucket or a GX2R buffer.
+ */
+typedef struct WHBFileAllocator
+{
+   //! Allocate size bytes aligned to alignment.
+   void *(*alloc)(uint32_t size, uint32_t alignment, void *context);
+
+   //! Free memory returned by alloc, used if reading fails.
+   void (*free)(void *ptr, void *context);
+
+   //! Passed to alloc and free.
+   void *context;
+} WHBFileAllocator;
+
+/**
+ * Called after every chunk that was read, return FALSE to cancel the read.
+ */
+typedef BOOL (*WHBFileProgressFn)(uint32_t bytesRead,
+                                  uint32_t totalSize,
+                                  void *context);
+
+/**
+ * Read a whole file in chunks.
+ *
+ * \param allocator
+ * Allocator for the file data, or NULL for the default heap. The data is
+ * 64 byte aligned and padded to a multiple of 64 bytes.
+ *
+ * \param chunkSize
+ * Bytes read per FSReadFile, rounded down to a multiple of 64 bytes, or 0
+ * for WHB_FILE_DEFAULT_CHUNK_SIZE.
+ *
+ * \param progress
+ * Called after every chunk, can be NULL.
+ */
+char *
+WHBReadWholeFileEx(const char *path,
+                   const WHBFileAllocator *allocator,
+                   uint32_t chunkSize,
+                   WHBFileProgressFn progress,
+                   void *progressContext,
+                   uint32_t *outSize);
+
+/**
+ * Free a file read with WHBReadWholeFileEx using the same allocator.
+ */
+void
+WHBFreeWholeFileEx(char *file,
+                   const WHBFileAllocator *allocator);
+
+/**
+ * A read queued with WHBReadWholeFileAsync, must stay valid until it is done.
+ */
+typedef struct WHBFileAsyncRead
+{
+   //! Path of the file, must stay valid until the read is done.
+   const char *path;
+
+   //! Allocator, see WHBReadWholeFileEx.
+   const WHBFileAllocator *allocator;
+
+   //! Chunk size, see WHBReadWholeFileEx.
+   uint32_t chunkSize;
+
+   //! Called from the loader thread after every chunk, can be NULL.
+   WHBFileProgressFn progress;
+   void *progressContext;
+
+   //! The file data once done, NULL if the read failed or was cancelled.
+   char *data;
+
+   //! Size of the file once done.
+   uint32_t size;
+
+   //! Bytes read so far.
+   volatile uint32_t bytesRead;
+
+   //! TRUE once the read has finished.
+   volatile BOOL done;
+
+   //! Internal.
+   volatile BOOL cancel;
+} WHBFileAsyncRead;
+
+/**
+ * Queue a WHBReadWholeFileEx on the loader thread, reads run in order.
+ */
+BOOL
+WHBReadWholeFileAsync(WHBFileAsyncRead *read);
+
+/**
+ * Ask a queued read to stop after its current chunk.
+ */
+void
+WHBCancelReadWholeFileAsync(WHBFileAsyncRead *read);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,8 +1,11 @@
 #pragma once
 #include <wut.h>
 #include <gx2/context.h>
+#include <gx2/enum.h>
 #include <gx2/shaders.h>
 #include <gx2/texture.h>
+#include <coreinit/time.h>
+#include <dmae/sync.h>
 
 /**
  * \defgroup whb_gfx Graphics
@@ -14,6 +17,9 @@
 extern "C" {
 #endif
 
+//! Maximum number of frames WHBGfxSetMaxFramesInFlight can queue on the GPU.
+#define WHB_GFX_MAX_FRAMES_IN_FLIGHT 4
+
 typedef struct WHBGfxShaderGroup WHBGfxShaderGroup;
 
 struct WHBGfxShaderGroup
@@ -24,11 +30,63 @@ struct WHBGfxShaderGroup
    GX2VertexShader *vertexShader;
    uint32_t numAttributes;
    GX2AttribStream attributes[16];
+
+   //! Loaded when the file has a geometry shader at the group's index.
+   GX2GeometryShader *geometryShader;
 };
 
+typedef struct WHBGfxScreenConfig
+{
+   //! Render resolution, 0 for the resolution of the screen. The colour
+   //! buffer is scaled when copied to the scan buffer.
+   uint32_t width;
+   uint32_t height;
+
+   //! GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8 by default.
+   GX2SurfaceFormat colourFormat;
+
+   //! GX2_SURFACE_FORMAT_FLOAT_R32 by default.
+   GX2SurfaceFormat depthFormat;
+
+   //! Multisampling, GX2_AA_MODE1X by default. Multisampled colour buffers
+   //! are resolved in WHBGfxFinishRenderTV and WHBGfxFinishRenderDRC.
+   GX2AAMode aaMode;
+
+   //! Allocate a HiZ buffer for the depth buffer, FALSE by default.
+   BOOL hiZ;
+} WHBGfxScreenConfig;
+
+typedef struct WHBGfxConfig
+{
+   //! GX2_BUFFERING_MODE_DOUBLE (default) or GX2_BUFFERING_MODE_TRIPLE. With
+   //! triple buffering rendering of the next frame can start while a swap
+   //! is still waiting for vsync.
+   GX2BufferingMode bufferingMode;
+
+   //! Number of vsyncs per swap, 1 (default) for 60 fps, 2 for 30 fps.
+   uint32_t swapInterval;
+
+   //! Size of the GX2 command buffer pool in MEM2, 4 MiB by default. Scenes
+   //! that fill it are flushed to the GPU mid frame.
+   uint32_t commandBufferPoolSize;
+
+   //! Bytes of MEM1 kept out of the graphics heap for WHBAllocHot, 0 by
+   //! default.
+   uint32_t hotMemorySize;
+
+   WHBGfxScreenConfig tv;
+   WHBGfxScreenConfig drc;
+} WHBGfxConfig;
+
+void
+WHBGfxGetDefaultConfig(WHBGfxConfig *config);
+
 BOOL
 WHBGfxInit();
 
+BOOL
+WHBGfxInitEx(const WHBGfxConfig *config);
+
 void
 WHBGfxShutdown();
 
@@ -38,6 +96,27 @@ WHBGfxBeginRender();
 void
 WHBGfxFinishRender();
 
+/**
+ * Let the CPU run up to count frames ahead of the GPU.
+ *
+ * By default (0) WHBGfxFinishRender waits for the GPU to finish the frame.
+ * Otherwise it only waits for the frame submitted count frames earlier, so
+ * the CPU prepares the next frame while the GPU draws. Buffers the GPU reads
+ * must then not be overwritten while a frame using them is still queued.
+ */
+void
+WHBGfxSetMaxFramesInFlight(uint32_t count);
+
+uint32_t
+WHBGfxGetMaxFramesInFlight();
+
+/**
+ * With frames in flight, also wait for any frame that was submitted more
+ * than budget ticks ago, to bound the input latency. 0 disables the budget.
+ */
+void
+WHBGfxSetLatencyBudget(OSTime budget);
+
 void
 WHBGfxClearColor(float r, float g, float b, float a);
 
@@ -53,6 +132,35 @@ WHBGfxBeginRenderTV();
 void
 WHBGfxFinishRenderTV();
 
+/**
+ * Show the TV image on the DRC as well, so the scene only has to be drawn
+ * once per frame.
+ *
+ * WHBGfxFinishRenderTV then also copies the TV colour buffer, scaled, to
+ * the DRC scan buffer and WHBGfxFinishRenderDRC does nothing, so drawing
+ * between WHBGfxBeginRenderDRC and WHBGfxFinishRenderDRC can be skipped.
+ */
+void
+WHBGfxSetMirrorMode(BOOL enable);
+
+BOOL
+WHBGfxGetMirrorMode();
+
+/**
+ * Draw both screens with the TV context state, disabled by default.
+ *
+ * WHBGfxBeginRenderTV and WHBGfxBeginRenderDRC then only set the colour
+ * buffer, depth buffer, viewport and scissor of the screen instead of
+ * loading a whole context state, which is only loaded again after a clear
+ * or after other code loaded its own. State set while drawing one screen
+ * stays set for the other. Change it between frames.
+ */
+void
+WHBGfxSetSharedContextState(BOOL enable);
+
+BOOL
+WHBGfxGetSharedContextState();
+
 GX2PixelShader *
 WHBGfxLoadGFDPixelShader(uint32_t index,
                          const void *file);
@@ -67,11 +175,99 @@ WHBGfxLoadGFDVertexShader(uint32_t index,
 BOOL
 WHBGfxFreeVertexShader(GX2VertexShader *shader);
 
+/**
+ * Load a geometry shader and its copy shader into one GX2R buffer.
+ */
+GX2GeometryShader *
+WHBGfxLoadGFDGeometryShader(uint32_t index,
+                            const void *file);
+
+BOOL
+WHBGfxFreeGeometryShader(GX2GeometryShader *shader);
+
+/**
+ * Grow the ring buffers shared by all geometry shaders so they fit the
+ * given pair, sized with GX2CalcGeometryShaderInputRingBufferSize and
+ * GX2CalcGeometryShaderOutputRingBufferSize from their ring item sizes.
+ *
+ * Shader group loaders call this themselves. Growing waits for the GPU to
+ * be idle so the previous buffers can be freed.
+ */
+BOOL
+WHBGfxReserveGeometryShaderRingBuffers(const GX2VertexShader *vertexShader,
+                                       const GX2GeometryShader *geometryShader);
+
+/**
+ * Bind the shared ring buffers in the current context state. Done by
+ * WHBGfxStateSetShaderGroup for groups with a geometry shader.
+ */
+void
+WHBGfxSetGeometryShaderRingBuffers();
+
+/**
+ * Loads the vertex and pixel shaders at index, and the geometry shader
+ * there if the file has one.
+ */
 BOOL
 WHBGfxLoadGFDShaderGroup(WHBGfxShaderGroup *group,
                          uint32_t index,
                          const void *file);
 
+/**
+ * Load a pixel shader whose program is used straight from the file instead
+ * of being copied into a GX2R buffer. Only the header is copied.
+ *
+ * The file is not modified. It must be aligned to
+ * GX2_SHADER_PROGRAM_ALIGNMENT, stay loaded for as long as the shader is
+ * used, and be flushed once with WHBGfxInvalidateGFDInPlace after all its
+ * shaders have been loaded. Free the shader with WHBGfxFreePixelShader.
+ */
+GX2PixelShader *
+WHBGfxLoadGFDPixelShaderInPlace(uint32_t index,
+                                const void *file);
+
+/**
+ * Load a vertex shader in place, see WHBGfxLoadGFDPixelShaderInPlace.
+ */
+GX2VertexShader *
+WHBGfxLoadGFDVertexShaderInPlace(uint32_t index,
+                                 const void *file);
+
+/**
+ * Flush a file holding in place shader programs out of the CPU cache and
+ * invalidate the GPU shader cache over it.
+ */
+void
+WHBGfxInvalidateGFDInPlace(const void *file,
+                           uint32_t size);
+
+/**
+ * Load a shader group by reading a GFD file block by block from fd, which
+ * must be at the start of the file. Programs are read straight into their
+ * GX2R buffers, the file is never loaded into memory as a whole.
+ *
+ * LZMA compressed GFD files are decoded straight into the GX2R buffers.
+ * Geometry shaders are not loaded this way.
+ */
+BOOL
+WHBGfxLoadGFDShaderGroupFromFd(WHBGfxShaderGroup *group,
+                               uint32_t index,
+                               int fd);
+
+/**
+ * Load count shader groups from one GFD file, group i made of vertex shader
+ * vertexIndices[i] and pixel shader pixelIndices[i].
+ *
+ * The file is indexed once for the whole batch. If any group fails to load
+ * all of them are freed. No geometry shaders are loaded.
+ */
+BOOL
+WHBGfxLoadGFDShaderGroups(WHBGfxShaderGroup *groups,
+                          const uint32_t *vertexIndices,
+                          const uint32_t *pixelIndices,
+                          uint32_t count,
+                          const void *file);
+
 BOOL
 WHBGfxInitShaderAttribute(WHBGfxShaderGroup *group,
                           const char *name,
@@ -79,6 +275,12 @@ WHBGfxInitShaderAttribute(WHBGfxShaderGroup *group,
                           uint32_t offset,
                           GX2AttribFormat format);
 
+/**
+ * Create the fetch shader for the group's attributes.
+ *
+ * Fetch shaders are cached by attribute layout, so groups with identical
+ * attributes share a single fetch shader program.
+ */
 BOOL
 WHBGfxInitFetchShader(WHBGfxShaderGroup *group);
 
@@ -89,9 +291,320 @@ GX2Texture *
 WHBGfxLoadGFDTexture(uint32_t index,
                      const void *file);
 
+/**
+ * Load a texture by reading a GFD file block by block from fd, which must
+ * be at the start of the file. The image and mipmaps are read straight into
+ * the GX2R surface, or decoded into it for LZMA compressed GFD files.
+ */
+GX2Texture *
+WHBGfxLoadGFDTextureFromFd(uint32_t index,
+                           int fd);
+
+/**
+ * Load a texture without its largest mip levels, see GFDGetGX2RTextureEx.
+ */
+GX2Texture *
+WHBGfxLoadGFDTextureEx(uint32_t index,
+                       const void *file,
+                       uint32_t skipLevels,
+                       uint32_t maxSize);
+
 BOOL
 WHBGfxFreeTexture(GX2Texture *texture);
 
+/**
+ * State of a texture loaded by WHBGfxLoadGFDTextureAsync, must stay valid
+ * until the upload has finished.
+ */
+typedef struct WHBGfxTextureUpload
+{
+   //! The texture once WHBGfxPollTextureUpload has seen the upload finish.
+   GX2Texture *texture;
+
+   //! TRUE if the upload could not be started.
+   BOOL failed;
+
+   //! Internal.
+   GX2Texture *pending;
+   DMAETimeStamp timeStamp;
+   volatile BOOL dmaDone;
+} WHBGfxTextureUpload;
+
+/**
+ * Load a texture from a GFD file with DMAE copies instead of memcpy.
+ *
+ * The copies run in the background, a background thread waits for them
+ * to finish. The file must stay valid until the upload has finished.
+ */
+BOOL
+WHBGfxLoadGFDTextureAsync(uint32_t index,
+                          const void *file,
+                          WHBGfxTextureUpload *upload);
+
+/**
+ * Check whether an upload has finished, without blocking.
+ *
+ * Must be called on the thread using GX2, as it invalidates the GPU caches
+ * for the texture once the copy is done.
+ *
+ * \return
+ * The texture once it is ready to use, NULL before that. It is freed with
+ * WHBGfxFreeTexture.
+ */
+GX2Texture *
+WHBGfxPollTextureUpload(WHBGfxTextureUpload *upload);
+
+/**
+ * Wait for an upload to finish.
+ */
+GX2Texture *
+WHBGfxWaitTextureUpload(WHBGfxTextureUpload *upload);
+
+/**
+ * A display list recorded once and replayed every frame, e.g. for static
+ * geometry and state setup.
+ */
+typedef struct WHBGfxDisplayList
+{
+   void *buffer;
+   uint32_t capacity;
+   uint32_t size;
+} WHBGfxDisplayList;
+
+typedef void (*WHBGfxDisplayListRecordFn)(void *userData);
+typedef void (*WHBGfxDisplayListRecordIndexFn)(uint32_t index, void *userData);
+
+/**
+ * Allocate the buffer of a display list in MEM2.
+ *
+ * \param capacity
+ * Initial size of the buffer, 0 for 4 KiB. It grows as needed.
+ */
+BOOL
+WHBGfxDisplayListInit(WHBGfxDisplayList *list,
+                      uint32_t capacity);
+
+/**
+ * Free a display list, the GPU must be done with it.
+ */
+void
+WHBGfxDisplayListFree(WHBGfxDisplayList *list);
+
+/**
+ * Record the GX2 commands issued by recordFn into list, replacing anything
+ * recorded before.
+ *
+ * If the buffer overflows, it is doubled and recordFn is called again, so
+ * recordFn must issue the same commands every time it is called.
+ */
+BOOL
+WHBGfxDisplayListRecord(WHBGfxDisplayList *list,
+                        WHBGfxDisplayListRecordFn recordFn,
+                        void *userData);
+
+/**
+ * Record count display lists in parallel, calling recordFn with the index
+ * of each list on the threads of the wut job system, see WUTJobSystemInit.
+ *
+ * recordFn may only issue commands that can be recorded into a display
+ * list, not set state shared between the lists such as the context state.
+ * GX2 records one list per core at a time, so lists recorded by threads
+ * sharing a core, e.g. a worker and the waiting caller, take turns.
+ *
+ * \return
+ * FALSE if any of the lists could not be recorded.
+ */
+BOOL
+WHBGfxDisplayListRecordParallel(WHBGfxDisplayList *lists,
+                                uint32_t count,
+                                WHBGfxDisplayListRecordIndexFn recordFn,
+                                void *userData);
+
+/**
+ * Replay a display list with GX2CallDisplayList.
+ */
+void
+WHBGfxDisplayListCall(const WHBGfxDisplayList *list);
+
+/**
+ * Replay a display list with GX2DirectCallDisplayList.
+ */
+void
+WHBGfxDisplayListDirectCall(const WHBGfxDisplayList *list);
+
+/**
+ * Replay count display lists in order, e.g. after recording them with
+ * WHBGfxDisplayListRecordParallel.
+ */
+void
+WHBGfxDisplayListCallAll(const WHBGfxDisplayList *lists,
+                         uint32_t count);
+
+typedef struct WHBGfxDisplayListCacheEntry
+{
+   uint32_t key;
+   WHBGfxDisplayList list;
+} WHBGfxDisplayListCacheEntry;
+
+/**
+ * Recorded display lists looked up by a key of the application's choice.
+ */
+typedef struct WHBGfxDisplayListCache
+{
+   WHBGfxDisplayListCacheEntry *entries;
+   uint32_t count;
+   uint32_t capacity;
+} WHBGfxDisplayListCache;
+
+void
+WHBGfxDisplayListCacheInit(WHBGfxDisplayListCache *cache);
+
+void
+WHBGfxDisplayListCacheFree(WHBGfxDisplayListCache *cache);
+
+/**
+ * Get the list for key, recording it with recordFn if it is not cached.
+ *
+ * \return
+ * The list to replay, or NULL if it could not be recorded.
+ */
+const WHBGfxDisplayList *
+WHBGfxDisplayListCacheGet(WHBGfxDisplayListCache *cache,
+                          uint32_t key,
+                          WHBGfxDisplayListRecordFn recordFn,
+                          void *userData);
+
+/**
+ * Drop the list for key, so it is recorded again by the next get. The GPU
+ * must be done with it.
+ */
+void
+WHBGfxDisplayListCacheInvalidate(WHBGfxDisplayListCache *cache,
+                                 uint32_t key);
+
+/**
+ * Drop all lists, the GPU must be done with them.
+ */
+void
+WHBGfxDisplayListCacheClear(WHBGfxDisplayListCache *cache);
+
+//! Maximum number of surfaces WHBGfxAddTransientSurface accepts.
+#define WHB_GFX_MAX_TRANSIENT_SURFACES 32
+
+typedef struct WHBGfxMemoryUsage
+{
+   //! Size of the heap in MEM1 used for render targets.
+   uint32_t totalSize;
+
+   //! Bytes allocated, including the transient surface pool.
+   uint32_t usedSize;
+
+   //! Bytes free.
+   uint32_t freeSize;
+
+   //! Largest allocation that would currently succeed.
+   uint32_t largestFreeBlock;
+
+   //! Size of the pool shared by the transient surfaces.
+   uint32_t transientSize;
+} WHBGfxMemoryUsage;
+
+/**
+ * Get how much of MEM1 is used by WHBGfx render targets and the
+ * application's GX2R MEM1 allocations.
+ */
+void
+WHBGfxGetMEM1Usage(WHBGfxMemoryUsage *usage);
+
+//! Number of GX2R_RESOURCE_BIND_* flags WHBGfxGX2RStats::bind covers.
+#define WHB_GFX_GX2R_BIND_COUNT 11
+
+typedef struct WHBGfxGX2RBindStats
+{
+   //! Live GX2R allocations with this bind flag.
+   uint32_t allocations;
+
+   //! How many of them share a slab chunk.
+   uint32_t slabAllocations;
+
+   //! Bytes of slab slots they use.
+   uint32_t slabBytes;
+} WHBGfxGX2RBindStats;
+
+typedef struct WHBGfxGX2RStats
+{
+   //! Indexed by bit number, e.g. bind[6] is GX2R_RESOURCE_BIND_UNIFORM_BLOCK.
+   WHBGfxGX2RBindStats bind[WHB_GFX_GX2R_BIND_COUNT];
+
+   //! 64 KiB chunks currently taken from MEM2 for slabs.
+   uint32_t slabChunks;
+   uint32_t slabChunkBytes;
+
+   //! Allocations that failed.
+   uint32_t failures;
+} WHBGfxGX2RStats;
+
+/**
+ * Get statistics of the GX2R allocator WHBGfx installs.
+ *
+ * MEM2 resources of up to 4 KiB are packed into 64 KiB chunks of equal
+ * power of two slots, so lots of small uniform, vertex and index buffers
+ * don't each pay for a heap block and fragment the default heap. A chunk
+ * only holds resources with the same GX2RResourceFlags.
+ */
+void
+WHBGfxGetGX2RStats(WHBGfxGX2RStats *outStats);
+
+/**
+ * Allocate CPU data from the slice of MEM1 reserved with
+ * WHBGfxConfig::hotMemorySize, for structures where MEM1's lower latency
+ * matters, e.g. a physics broadphase.
+ *
+ * MEM1 belongs to the application only while it is in the foreground. The
+ * slice is set up again empty every time it returns, so everything in it
+ * must be freed in a ProcUI release callback that runs before WHBGfx's.
+ *
+ * \return
+ * The block, or NULL if there is no hot memory or while in the background.
+ */
+void *
+WHBAllocHot(uint32_t size,
+            uint32_t alignment);
+
+void
+WHBFreeHot(void *block);
+
+/**
+ * Register a surface that is only used from pass firstPass to lastPass of
+ * a frame, e.g. an intermediate target of a post processing chain.
+ *
+ * The surface must have been set up with GX2CalcSurfaceSizeAndAlignment.
+ * Surfaces whose pass ranges do not overlap share memory, so their
+ * contents do not survive other passes. Surfaces are placed in MEM1 by
+ * WHBGfxAllocTransientSurfaces, which sets surface->image, and placed again
+ * in one block when the application returns to the foreground.
+ *
+ * \return
+ * FALSE if the surfaces are already allocated or there are too many.
+ */
+BOOL
+WHBGfxAddTransientSurface(GX2Surface *surface,
+                          uint32_t firstPass,
+                          uint32_t lastPass);
+
+/**
+ * Allocate memory for every registered transient surface.
+ */
+BOOL
+WHBGfxAllocTransientSurfaces();
+
+/**
+ * Free the transient surfaces and forget about them, the GPU must be done
+ * with them.
+ */
+void
+WHBGfxFreeTransientSurfaces();
+
 GX2ColorBuffer *
 WHBGfxGetTVColourBuffer();
 
@@ -114,4 +627,56 @@ WHBGfxGetDRCContextState();
 }
 #endif
 
+#if defined(__cplusplus) && __has_include(<memory_resource>)
+#include <coreinit/memory.h>
+#include <memory_resource>
+
+namespace whb
+{
+
+//! std::pmr resource over WHBAllocHot, falling back to upstream when the
+//! hot memory is full or not available.
+class HotMemoryResource : public std::pmr::memory_resource
+{
+public:
+   explicit HotMemoryResource(std::pmr::memory_resource *upstream = std::pmr::get_default_resource()) :
+      mUpstream(upstream)
+   {
+   }
+
+private:
+   void *
+   do_allocate(std::size_t bytes,
+               std::size_t alignment) override
+   {
+      void *ptr = WHBAllocHot(bytes, alignment);
+      return ptr ? ptr : mUpstream->allocate(bytes, alignment);
+   }
+
+   void
+   do_deallocate(void *ptr,
+                 std::size_t bytes,
+                 std::size_t alignment) override
+   {
+      uint32_t mem1Start, mem1Size;
+      OSGetMemBound(OS_MEM1, &mem1Start, &mem1Size);
+      if ((uint32_t)ptr - mem1Start < mem1Size) {
+         WHBFreeHot(ptr);
+      } else {
+         mUpstream->deallocate(ptr, bytes, alignment);
+      }
+   }
+
+   bool
+   do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+   {
+      return this == &other;
+   }
+
+   std::pmr::memory_resource *mUpstream;
+};
+
+} // namespace whb
+#endif
+
 /** @} */
@@ -0,0 +1,116 @@
+#pragma once
+#include <wut.h>
+#include <gx2/sampler.h>
+#include <gx2/surface.h>
+#include <gx2/texture.h>
+#include <whb/gfx.h>
+
+/**
+ * \defgroup whb_gfx_compute GPU compute passes
+ * \ingroup whb
+ *
+ * Run a pixel shader once per element of a 2D target, for work such as
+ * particle simulation or skinning that the GPU can do between frames. The
+ * results can be sampled as a texture by later passes, or fetched as a
+ * vertex buffer when the target is linear.
+ *
+ * \code
+ * WHBGfxInitShaderAttribute(&sStepGroup, "aPosition", 0, 0, GX2_ATTRIB_FORMAT_FLOAT_32_32);
+ * WHBGfxInitFetchShader(&sStepGroup);
+ * WHBGfxComputeInitTarget(&sParticles[0], 256, 256, GX2_SURFACE_FORMAT_FLOAT_R32_G32_B32_A32, TRUE);
+ * WHBGfxComputeInitTarget(&sParticles[1], 256, 256, GX2_SURFACE_FORMAT_FLOAT_R32_G32_B32_A32, TRUE);
+ *
+ * WHBGfxBeginRender();
+ * WHBGfxComputeBegin(&sStepGroup);
+ * WHBGfxComputeSetUniformBlock(0, sizeof(sParams), &sParams);
+ * WHBGfxComputeSetTexture(&sParticles[frame & 1].texture, 0);
+ * WHBGfxComputeDispatch(&sParticles[~frame & 1]);
+ * WHBGfxComputeEnd();
+ *
+ * // 256 is a multiple of the linear pitch alignment, so there is no padding
+ * WHBGfxBeginRenderTV();
+ * surface = &sParticles[~frame & 1].colorBuffer.surface;
+ * GX2SetAttribBuffer(1, surface->imageSize, 16, surface->image);
+ * ...
+ * \endcode
+ *
+ * The vertex shader of the group gets a float2 clip space position in
+ * attribute buffer 0 and should pass it through. GX2 has no compute
+ * shader support in wut, so this uses the rasteriser to cover the target.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WHBGfxComputeTarget
+{
+   //! Written by WHBGfxComputeDispatch.
+   GX2ColorBuffer colorBuffer;
+
+   //! The same memory, for reading in a later pass.
+   GX2Texture texture;
+} WHBGfxComputeTarget;
+
+/**
+ * Allocate a target in MEM2, so it survives going to the background.
+ *
+ * A linear target has plain rows of surface.pitch elements the vertex
+ * fetcher and the CPU can read, a tiled one is faster to write and sample.
+ */
+BOOL
+WHBGfxComputeInitTarget(WHBGfxComputeTarget *target,
+                        uint32_t width,
+                        uint32_t height,
+                        GX2SurfaceFormat format,
+                        BOOL linear);
+
+void
+WHBGfxComputeFreeTarget(WHBGfxComputeTarget *target);
+
+/**
+ * Switch to the compute context state and the shaders of group.
+ *
+ * Must be called outside of WHBGfxBeginRenderTV or WHBGfxBeginRenderDRC,
+ * which switch back to their own context state.
+ */
+void
+WHBGfxComputeBegin(const WHBGfxShaderGroup *group);
+
+/**
+ * Flush data from the CPU cache and bind it as a pixel uniform block.
+ */
+void
+WHBGfxComputeSetUniformBlock(uint32_t location,
+                             uint32_t size,
+                             const void *data);
+
+/**
+ * Bind a texture, e.g. the target of an earlier pass, with a point sampler
+ * so the shader reads exact elements.
+ */
+void
+WHBGfxComputeSetTexture(const GX2Texture *texture,
+                        uint32_t unit);
+
+/**
+ * Run the pixel shader over every element of target, then flush the
+ * results so they can be read as a texture or an attribute buffer.
+ *
+ * The CPU must wait for the GPU and invalidate the range before reading.
+ */
+void
+WHBGfxComputeDispatch(WHBGfxComputeTarget *target);
+
+/**
+ * Forget the state compute passes set, see WHBGfxStateInvalidate.
+ */
+void
+WHBGfxComputeEnd();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
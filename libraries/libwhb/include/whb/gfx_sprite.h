@@ -0,0 +1,147 @@
+#pragma once
+#include <wut.h>
+#include <gx2/sampler.h>
+#include <gx2/texture.h>
+#include <whb/gfx.h>
+#include <whb/gpu_ring.h>
+
+/**
+ * \defgroup whb_gfx_sprite Sprite batches
+ * \ingroup whb
+ *
+ * Collect sprites and draw them as instanced quads, one GX2DrawEx2 for
+ * every texture instead of one draw per sprite.
+ *
+ * \code
+ * WHBGfxSpriteBatchInitShaderGroup(&sSpriteGroup);
+ * sBatch = WHBGfxSpriteBatchCreate(16384, WHB_GFX_SPRITE_SORT_TEXTURE);
+ *
+ * WHBGfxBeginRenderTV();
+ * GX2SetVertexUniformBlock(0, sizeof(sProjection), sProjection);
+ * WHBGfxSpriteBatchBegin(sBatch, &sSpriteGroup, sRing);
+ * for (i = 0; i < numEnemies; ++i) {
+ *    WHBGfxSpriteBatchDraw(sBatch, sAtlas, &enemies[i].sprite);
+ * }
+ * WHBGfxSpriteBatchEnd(sBatch);
+ * \endcode
+ *
+ * The instance data is copied into the WHBGpuRing, which the application
+ * starts and ends every frame. The vertex shader of the group is
+ * given these attributes:
+ *  - \c aCorner float2, the corner of the quad from (0, 0) to (1, 1).
+ *  - \c aRect float4, WHBGfxSprite::x to WHBGfxSprite::height.
+ *  - \c aTexRect float4, WHBGfxSprite::u0 to WHBGfxSprite::v1, optional.
+ *  - \c aRotation float, WHBGfxSprite::rotation, optional.
+ *  - \c aColor float4 from WHBGfxSprite::color, optional.
+ *
+ * The texture is bound to pixel texture and sampler 0. Uniforms are up to
+ * the application, typically a projection into clip space.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Textures a batch can group sprites by before it has to draw.
+#define WHB_GFX_SPRITE_MAX_TEXTURES 32
+
+typedef struct WHBGfxSpriteBatch WHBGfxSpriteBatch;
+
+typedef enum WHBGfxSpriteSort
+{
+   //! Draw in submission order, with a new draw for every texture change.
+   WHB_GFX_SPRITE_SORT_NONE,
+
+   //! Draw all sprites of a texture together, in submission order within
+   //! a texture. Only for sprites that don't overlap sprites of other
+   //! textures, e.g. the pieces of one UI atlas or particles.
+   WHB_GFX_SPRITE_SORT_TEXTURE,
+} WHBGfxSpriteSort;
+
+typedef struct WHBGfxSprite
+{
+   float x;
+   float y;
+   float width;
+   float height;
+   float u0;
+   float v0;
+   float u1;
+   float v1;
+
+   //! In radians, around the centre of the sprite.
+   float rotation;
+
+   //! 0xRRGGBBAA.
+   uint32_t color;
+} WHBGfxSprite;
+WUT_CHECK_SIZE(WHBGfxSprite, 0x28);
+
+typedef struct WHBGfxSpriteBatchStats
+{
+   //! Since the last call to WHBGfxSpriteBatchBegin.
+   uint32_t sprites;
+   uint32_t draws;
+
+   //! Sprites dropped because the ring was full.
+   uint32_t dropped;
+} WHBGfxSpriteBatchStats;
+
+/**
+ * Add the attributes to group and create its fetch shader. aCorner and
+ * aRect must be used by the vertex shader.
+ */
+BOOL
+WHBGfxSpriteBatchInitShaderGroup(WHBGfxShaderGroup *group);
+
+/**
+ * Create a batch drawing at most maxSprites sprites at once, more are
+ * drawn in several passes.
+ */
+WHBGfxSpriteBatch *
+WHBGfxSpriteBatchCreate(uint32_t maxSprites,
+                        WHBGfxSpriteSort sort);
+
+void
+WHBGfxSpriteBatchDestroy(WHBGfxSpriteBatch *batch);
+
+/**
+ * Replace the default sampler, which is linear and clamps.
+ */
+void
+WHBGfxSpriteBatchSetSampler(WHBGfxSpriteBatch *batch,
+                            const GX2Sampler *sampler);
+
+/**
+ * Start collecting sprites, drawn with group and instance data from ring.
+ */
+void
+WHBGfxSpriteBatchBegin(WHBGfxSpriteBatch *batch,
+                       const WHBGfxShaderGroup *group,
+                       WHBGpuRing *ring);
+
+/**
+ * Add a copy of sprite, drawing what was collected first if the batch is
+ * full.
+ */
+void
+WHBGfxSpriteBatchDraw(WHBGfxSpriteBatch *batch,
+                      const GX2Texture *texture,
+                      const WHBGfxSprite *sprite);
+
+/**
+ * Draw what was collected since WHBGfxSpriteBatchBegin.
+ */
+void
+WHBGfxSpriteBatchEnd(WHBGfxSpriteBatch *batch);
+
+void
+WHBGfxSpriteBatchGetStats(WHBGfxSpriteBatch *batch,
+                          WHBGfxSpriteBatchStats *outStats);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
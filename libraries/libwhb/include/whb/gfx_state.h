@@ -0,0 +1,211 @@
+#pragma once
+#include <wut.h>
+#include <gx2/enum.h>
+#include <gx2/sampler.h>
+#include <gx2/shaders.h>
+#include <gx2/texture.h>
+#include <whb/gfx.h>
+
+/**
+ * \defgroup whb_gfx_state Redundant state filtering
+ * \ingroup whb
+ *
+ * Drop-in replacements for GX2Set* calls that remember what was set last
+ * and skip the call when nothing changed, so rebinding the same material
+ * state does not grow the command buffer.
+ *
+ * \code
+ * for (i = 0; i < numDraws; ++i) {
+ *    WHBGfxStateSetShaderGroup(draws[i].material->group);
+ *    WHBGfxStateSetPixelTexture(draws[i].material->texture, 0);
+ *    WHBGfxStateSetPixelSampler(&sLinearSampler, 0);
+ *    WHBGfxStateSetAttribBuffer(0, draws[i].size, draws[i].stride, draws[i].vertices);
+ *    GX2DrawEx(...);
+ * }
+ * \endcode
+ *
+ * Objects are compared by address, so a shader, sampler or texture changed
+ * in place, or state set with the GX2 functions directly, needs a call to
+ * WHBGfxStateInvalidate. It is called whenever WHBGfxBeginRenderTV,
+ * WHBGfxBeginRenderDRC or WHBGfxClearColor load a context state, and when
+ * a display list is recorded or called.
+ *
+ * While a thread records a display list its calls always reach GX2 and
+ * leave the shadow alone, so recordFn may use these functions too. Apart
+ * from that, only for the thread that renders.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WHB_GFX_STATE_MAX_TEXTURES        18
+#define WHB_GFX_STATE_MAX_UNIFORM_BLOCKS  16
+#define WHB_GFX_STATE_MAX_ATTRIB_BUFFERS  16
+
+typedef struct WHBGfxStateStats
+{
+   //! Calls passed on to GX2.
+   uint32_t issued;
+
+   //! Calls skipped because the state was already set.
+   uint32_t skipped;
+} WHBGfxStateStats;
+
+/**
+ * Forget everything set so far, the next call of each function goes to GX2.
+ */
+void
+WHBGfxStateInvalidate();
+
+void
+WHBGfxStateGetStats(WHBGfxStateStats *outStats);
+
+void
+WHBGfxStateResetStats();
+
+void
+WHBGfxStateSetFetchShader(const GX2FetchShader *shader);
+
+void
+WHBGfxStateSetVertexShader(const GX2VertexShader *shader);
+
+void
+WHBGfxStateSetPixelShader(const GX2PixelShader *shader);
+
+void
+WHBGfxStateSetGeometryShader(const GX2GeometryShader *shader);
+
+/**
+ * Set the fetch, vertex and pixel shaders of a group, and its geometry
+ * shader and the geometry shader ring buffers if it has one.
+ */
+void
+WHBGfxStateSetShaderGroup(const WHBGfxShaderGroup *group);
+
+void
+WHBGfxStateSetShaderMode(GX2ShaderMode mode);
+
+void
+WHBGfxStateSetVertexUniformBlock(uint32_t location,
+                                 uint32_t size,
+                                 const void *data);
+
+void
+WHBGfxStateSetPixelUniformBlock(uint32_t location,
+                                uint32_t size,
+                                const void *data);
+
+void
+WHBGfxStateSetGeometryUniformBlock(uint32_t location,
+                                   uint32_t size,
+                                   const void *data);
+
+void
+WHBGfxStateSetAttribBuffer(uint32_t index,
+                           uint32_t size,
+                           uint32_t stride,
+                           const void *buffer);
+
+void
+WHBGfxStateSetPixelTexture(const GX2Texture *texture,
+                           uint32_t unit);
+
+void
+WHBGfxStateSetVertexTexture(const GX2Texture *texture,
+                            uint32_t unit);
+
+void
+WHBGfxStateSetPixelSampler(const GX2Sampler *sampler,
+                           uint32_t id);
+
+void
+WHBGfxStateSetVertexSampler(const GX2Sampler *sampler,
+                            uint32_t id);
+
+void
+WHBGfxStateSetBlendControl(GX2RenderTarget target,
+                           GX2BlendMode colorSrcBlend,
+                           GX2BlendMode colorDstBlend,
+                           GX2BlendCombineMode colorCombine,
+                           BOOL useAlphaBlend,
+                           GX2BlendMode alphaSrcBlend,
+                           GX2BlendMode alphaDstBlend,
+                           GX2BlendCombineMode alphaCombine);
+
+void
+WHBGfxStateSetBlendConstantColor(float red,
+                                 float green,
+                                 float blue,
+                                 float alpha);
+
+void
+WHBGfxStateSetColorControl(GX2LogicOp rop3,
+                           uint8_t targetBlendEnable,
+                           BOOL multiWriteEnable,
+                           BOOL colorWriteEnable);
+
+void
+WHBGfxStateSetTargetChannelMasks(GX2ChannelMask mask0,
+                                 GX2ChannelMask mask1,
+                                 GX2ChannelMask mask2,
+                                 GX2ChannelMask mask3,
+                                 GX2ChannelMask mask4,
+                                 GX2ChannelMask mask5,
+                                 GX2ChannelMask mask6,
+                                 GX2ChannelMask mask7);
+
+void
+WHBGfxStateSetAlphaTest(BOOL alphaTest,
+                        GX2CompareFunction func,
+                        float ref);
+
+/**
+ * Shares its shadow with WHBGfxStateSetDepthStencilControl, so switching
+ * between the two always goes to GX2.
+ */
+void
+WHBGfxStateSetDepthOnlyControl(BOOL depthTest,
+                               BOOL depthWrite,
+                               GX2CompareFunction depthCompare);
+
+void
+WHBGfxStateSetDepthStencilControl(BOOL depthTest,
+                                  BOOL depthWrite,
+                                  GX2CompareFunction depthCompare,
+                                  BOOL stencilTest,
+                                  BOOL backfaceStencil,
+                                  GX2CompareFunction frontStencilFunc,
+                                  GX2StencilFunction frontStencilZPass,
+                                  GX2StencilFunction frontStencilZFail,
+                                  GX2StencilFunction frontStencilFail,
+                                  GX2CompareFunction backStencilFunc,
+                                  GX2StencilFunction backStencilZPass,
+                                  GX2StencilFunction backStencilZFail,
+                                  GX2StencilFunction backStencilFail);
+
+void
+WHBGfxStateSetCullOnlyControl(GX2FrontFace frontFace,
+                              BOOL cullFront,
+                              BOOL cullBack);
+
+void
+WHBGfxStateSetViewport(float x,
+                       float y,
+                       float width,
+                       float height,
+                       float nearZ,
+                       float farZ);
+
+void
+WHBGfxStateSetScissor(uint32_t x,
+                      uint32_t y,
+                      uint32_t width,
+                      uint32_t height);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,122 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_gfx_uniform Uniform buffers
+ * \ingroup whb
+ *
+ * Uniform blocks that stay in memory across frames and only flush what
+ * changed, instead of locking and unlocking a whole GX2RBuffer for every
+ * update:
+ *
+ * \code
+ * static const uint32_t sizes[] = { sizeof(Camera), sizeof(Lights) };
+ * WHBGfxUniformBuffer *uniforms = WHBGfxUniformBufferCreate(sizes, 2);
+ * while (WHBProcIsRunning()) {
+ *    WHBGfxUniformBufferBeginFrame(uniforms);
+ *    WHBGfxUniformBufferWrite(uniforms, 0, offsetof(Camera, view),
+ *                             &view, sizeof(view));
+ *    WHBGfxUniformBufferFlush(uniforms);
+ *
+ *    WHBGfxBeginRender();
+ *    GX2SetVertexUniformBlock(0, sizeof(Camera),
+ *                             WHBGfxUniformBufferGetBlock(uniforms, 0));
+ *    ...
+ *    WHBGfxFinishRender();
+ * }
+ * \endcode
+ *
+ * Every block has two copies in MEM2. Writes go to the current copy while
+ * the GPU is done with it. Once a copy has been used by a frame the GPU
+ * is still working on, the next write switches to the other copy, first
+ * bringing over the bytes changed since that copy was last current, and
+ * waits only if the GPU still uses that one as well.
+ *
+ * WHBGfxUniformBufferFlush writes back and invalidates the dirty byte
+ * ranges of each block, and has to be called after the updates and before
+ * drawing with them. A block may have moved to its other copy after a
+ * write, so the address passed to GX2 should come from
+ * WHBGfxUniformBufferGetBlock after the frame's updates, and updating a
+ * block after drawing with it in the same frame changes what those draws
+ * read.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Copies of each block, the GPU can read one while the CPU writes another.
+#define WHB_GFX_UNIFORM_COPIES 2
+
+typedef struct WHBGfxUniformBuffer WHBGfxUniformBuffer;
+
+/**
+ * Create a buffer with numBlocks blocks of the given sizes, each rounded up
+ * to the 0x100 alignment of uniform blocks and zeroed.
+ */
+WHBGfxUniformBuffer *
+WHBGfxUniformBufferCreate(const uint32_t *blockSizes,
+                          uint32_t numBlocks);
+
+/**
+ * Wait for the GPU to finish with the buffer and free it.
+ */
+void
+WHBGfxUniformBufferDestroy(WHBGfxUniformBuffer *buffer);
+
+/**
+ * Start a frame, after the previous frame was flushed to the GPU.
+ */
+void
+WHBGfxUniformBufferBeginFrame(WHBGfxUniformBuffer *buffer);
+
+/**
+ * Get size bytes at offset in a block to write, which are flushed by the
+ * next WHBGfxUniformBufferFlush.
+ *
+ * \return
+ * The bytes, or NULL if the range is outside the block.
+ */
+void *
+WHBGfxUniformBufferMap(WHBGfxUniformBuffer *buffer,
+                       uint32_t block,
+                       uint32_t offset,
+                       uint32_t size);
+
+/**
+ * Copy size bytes from data to offset in a block.
+ */
+BOOL
+WHBGfxUniformBufferWrite(WHBGfxUniformBuffer *buffer,
+                         uint32_t block,
+                         uint32_t offset,
+                         const void *data,
+                         uint32_t size);
+
+/**
+ * Flush the ranges written since the last flush to the GPU.
+ */
+void
+WHBGfxUniformBufferFlush(WHBGfxUniformBuffer *buffer);
+
+/**
+ * Current copy of a block, to pass to GX2SetVertexUniformBlock and the
+ * like, or NULL if there is no such block.
+ */
+void *
+WHBGfxUniformBufferGetBlock(WHBGfxUniformBuffer *buffer,
+                            uint32_t block);
+
+/**
+ * Size of a block as passed to WHBGfxUniformBufferCreate.
+ */
+uint32_t
+WHBGfxUniformBufferGetBlockSize(WHBGfxUniformBuffer *buffer,
+                                uint32_t block);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
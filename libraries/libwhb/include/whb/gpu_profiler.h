@@ -0,0 +1,112 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup whb_gpu_profiler GPU pass profiler
+ * \ingroup whb
+ *
+ * Measures how long the GPU spends on parts of a frame:
+ *
+ * \code
+ * WHBGpuProfilerInit();
+ * while (WHBProcIsRunning()) {
+ *    WHBGpuProfilerBeginFrame();
+ *    WHBGfxBeginRender();
+ *    WHBGpuProfilerBegin("shadows");
+ *    ...
+ *    WHBGpuProfilerEnd();
+ *    ...
+ *    WHBGfxFinishRender();
+ * }
+ * WHBGpuProfilerLog();
+ * \endcode
+ *
+ * The GPU writes its cycle counter to memory at every begin and end point.
+ * The values are read back WHB_GPU_PROFILER_FRAME_LATENCY frames later
+ * and results that are not available by then are dropped, so profiling
+ * never waits for the GPU.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WHB_GPU_PROFILER_MAX_PASSES    32
+#define WHB_GPU_PROFILER_MAX_QUERIES   64
+#define WHB_GPU_PROFILER_FRAME_LATENCY 3
+
+typedef struct WHBGpuProfilerPass
+{
+   //! Name passed to WHBGpuProfilerBegin.
+   const char *name;
+
+   //! GPU time of the pass in the last frame it was measured.
+   OSTime lastTime;
+
+   //! Rolling average of the GPU time of the pass over recent frames.
+   OSTime averageTime;
+
+   //! Longest GPU time measured for the pass.
+   OSTime maxTime;
+
+   //! Number of times the pass was measured.
+   uint32_t samples;
+} WHBGpuProfilerPass;
+
+BOOL
+WHBGpuProfilerInit();
+
+void
+WHBGpuProfilerShutdown();
+
+/**
+ * Start a new frame and collect the results of an earlier one.
+ */
+void
+WHBGpuProfilerBeginFrame();
+
+/**
+ * Mark the start of a pass, passes can be nested.
+ *
+ * \param name
+ * Name of the pass, must stay valid until WHBGpuProfilerShutdown.
+ */
+void
+WHBGpuProfilerBegin(const char *name);
+
+/**
+ * Mark the end of the innermost pass.
+ */
+void
+WHBGpuProfilerEnd();
+
+/**
+ * Copy the results of up to maxPasses passes to passes.
+ *
+ * \return
+ * The number of passes copied.
+ */
+uint32_t
+WHBGpuProfilerGetPasses(WHBGpuProfilerPass *passes,
+                        uint32_t maxPasses);
+
+/**
+ * Print the results with WHBLogPrintf, e.g. to show them with the console
+ * log every few frames.
+ */
+void
+WHBGpuProfilerLog();
+
+/**
+ * Reset the results of all passes.
+ */
+void
+WHBGpuProfilerReset();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,86 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_gpu_ring GPU upload ring
+ * \ingroup whb
+ *
+ * A ring buffer in MEM2 for data the GPU only needs for one frame, such as
+ * uniform blocks and dynamic vertices, instead of a GX2RBuffer for each:
+ *
+ * \code
+ * WHBGpuRing *ring = WHBGpuRingCreate(0x100000);
+ * while (WHBProcIsRunning()) {
+ *    WHBGpuRingBeginFrame(ring);
+ *    WHBGfxBeginRender();
+ *    float *uniforms = WHBGpuRingAlloc(ring, sizeof(float) * 16, 0x100);
+ *    ...
+ *    GX2SetVertexUniformBlock(0, sizeof(float) * 16, uniforms);
+ *    ...
+ *    WHBGpuRingEndFrame(ring);
+ *    WHBGfxFinishRender();
+ * }
+ * \endcode
+ *
+ * WHBGpuRingEndFrame does a single GX2Invalidate for everything allocated in
+ * the frame. It has to be called before the frame is flushed to the GPU, so
+ * the command buffer should be large enough not to be flushed mid frame.
+ * Memory of a frame is reused once the GPU has retired it, an allocation
+ * that does not fit waits for the oldest frame.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Frames that can be in flight before WHBGpuRingBeginFrame waits.
+#define WHB_GPU_RING_MAX_FRAMES 8
+
+typedef struct WHBGpuRing WHBGpuRing;
+
+/**
+ * Create a ring of size bytes, allocated from the default heap.
+ */
+WHBGpuRing *
+WHBGpuRingCreate(uint32_t size);
+
+/**
+ * Wait for the GPU to finish with the ring and free it.
+ */
+void
+WHBGpuRingDestroy(WHBGpuRing *ring);
+
+/**
+ * Start a frame, after the previous frame was flushed to the GPU.
+ */
+void
+WHBGpuRingBeginFrame(WHBGpuRing *ring);
+
+/**
+ * Allocate size bytes for the current frame.
+ *
+ * \param align
+ * Alignment, a power of two up to 0x100. Uniform blocks need 0x100 and
+ * vertex data 0x40.
+ *
+ * \return
+ * The memory, or NULL if size is larger than what the ring can hold
+ * besides the current frame.
+ */
+void *
+WHBGpuRingAlloc(WHBGpuRing *ring,
+                uint32_t size,
+                uint32_t align);
+
+/**
+ * Flush the memory of the current frame to the GPU, before it is flushed.
+ */
+void
+WHBGpuRingEndFrame(WHBGpuRing *ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -7,18 +7,64 @@
  * @{
  */
 
+#define WHB_LOG_LEVEL_DEBUG   0
+#define WHB_LOG_LEVEL_INFO    1
+#define WHB_LOG_LEVEL_WARNING 2
+#define WHB_LOG_LEVEL_ERROR   3
+#define WHB_LOG_LEVEL_NONE    4
+
+/**
+ * Messages logged with the level macros below this level are compiled out.
+ * Defaults to WHB_LOG_LEVEL_INFO if NDEBUG is defined.
+ */
+#ifndef WHB_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define WHB_LOG_MIN_LEVEL WHB_LOG_LEVEL_INFO
+#else
+#define WHB_LOG_MIN_LEVEL WHB_LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#define WHB_LOG_LEVELF(level, ...) \
+   (((level) >= WHB_LOG_MIN_LEVEL && (level) >= WHBLogGetLevel()) ? WHBLogPrintf(__VA_ARGS__) : FALSE)
+
+#define WHBLogDebugf(...)   WHB_LOG_LEVELF(WHB_LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define WHBLogInfof(...)    WHB_LOG_LEVELF(WHB_LOG_LEVEL_INFO, __VA_ARGS__)
+#define WHBLogWarningf(...) WHB_LOG_LEVELF(WHB_LOG_LEVEL_WARNING, __VA_ARGS__)
+#define WHBLogErrorf(...)   WHB_LOG_LEVELF(WHB_LOG_LEVEL_ERROR, __VA_ARGS__)
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef void (*LogHandlerFn)(const char *msg);
 
+/**
+ * Add a log handler, safe to call while other threads are logging.
+ */
+
 BOOL
 WHBAddLogHandler(LogHandlerFn fn);
 
+/**
+ * Remove a log handler.
+ *
+ * A thread that was already dispatching a message may still call the handler
+ * once after this returns.
+ */
 BOOL
 WHBRemoveLogHandler(LogHandlerFn fn);
 
+/**
+ * Set the runtime level for the WHBLog*f level macros, messages below it are
+ * not formatted. Defaults to WHB_LOG_LEVEL_DEBUG.
+ */
+void
+WHBLogSetLevel(int level);
+
+int
+WHBLogGetLevel();
+
 BOOL
 WHBLogWrite(const char *str);
 
@@ -13,6 +13,27 @@ extern "C" {
 
 #define WHB_SERVER_BUFFER_SIZE 1024
 
+/**
+ * Draws at the top of the console with OSScreenPutFontEx on both screens.
+ *
+ * \return
+ * The number of rows used, the log lines are shown below them.
+ */
+typedef uint32_t (*WHBLogConsoleOverlayFn)(void *context);
+
+/**
+ * Set the number of lines kept for scrolling back, at least the 16 shown at
+ * once. Must be called before WHBLogConsoleInit.
+ */
+BOOL
+WHBLogConsoleSetScrollback(uint32_t lines);
+
+/**
+ * Start showing log output on both screens.
+ *
+ * Lines can be logged from any thread, each log call claims its own line
+ * without taking a lock.
+ */
 BOOL
 WHBLogConsoleInit();
 
@@ -22,6 +43,27 @@ WHBLogConsoleFree();
 void
 WHBLogConsoleSetColor(uint32_t color);
 
+/**
+ * Scroll back by lines into the scrollback, negative to scroll forward, or
+ * 0 to go back to following the newest lines.
+ */
+void
+WHBLogConsoleScroll(int32_t lines);
+
+/**
+ * Set a function to draw on top of the log lines, or NULL to remove it.
+ *
+ * While an overlay is set the console is redrawn on every
+ * WHBLogConsoleDraw.
+ */
+void
+WHBLogConsoleSetOverlay(WHBLogConsoleOverlayFn overlay,
+                        void *context);
+
+/**
+ * Draw the console, does nothing if no lines were added since it was last
+ * drawn to both screen buffers.
+ */
 void
 WHBLogConsoleDraw();
 
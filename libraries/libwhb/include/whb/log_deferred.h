@@ -0,0 +1,78 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_log_deferred Deferred log formatting
+ * \ingroup whb
+ *
+ * Log from time critical threads without formatting on them:
+ *
+ * \code
+ * WHBLogUdpInit();
+ * WHBLogDeferredInit(1024);
+ *
+ * // Render or audio thread
+ * WHBLogDeferredf("voice %d underrun, %u samples", voice, missing);
+ * \endcode
+ *
+ * WHBLogDeferredf only stores the format pointer, the system time and the
+ * raw arguments in a ring buffer of the current core. A background thread
+ * formats the records and passes them to the log handlers with WHBLogPrint,
+ * prefixed with the time they were logged at. When a ring is full new
+ * records are dropped and counted.
+ *
+ * The format and every \c %s argument are stored as pointers, so they must
+ * be string literals or otherwise outlive the record. Up to
+ * WHB_LOG_DEFERRED_MAX_ARGS arguments are stored, including \c * widths and
+ * precisions, \c %n is not supported.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WHB_LOG_DEFERRED_MAX_ARGS 8
+
+/**
+ * Allocate recordsPerCore records for every core and start the formatting
+ * thread, which wakes up every 10 milliseconds.
+ */
+BOOL
+WHBLogDeferredInit(uint32_t recordsPerCore);
+
+/**
+ * Format what is left and stop the formatting thread.
+ */
+void
+WHBLogDeferredShutdown();
+
+/**
+ * Record a message, formatted later as with WHBLogPrintf.
+ *
+ * \return
+ * FALSE if the ring of the current core is full or WHBLogDeferredInit was
+ * not called.
+ */
+BOOL
+WHBLogDeferredf(const char *fmt, ...)
+   __attribute__((format(printf, 1, 2)));
+
+/**
+ * Format every complete record on the calling thread, e.g. before a crash
+ * handler or a blocking exit.
+ */
+void
+WHBLogDeferredFlush();
+
+/**
+ * Records dropped because a ring was full, since WHBLogDeferredInit.
+ */
+uint32_t
+WHBLogDeferredGetDropped();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,64 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_log_file File Log Output
+ * \ingroup whb
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Size a log file may grow to before it is rotated, by default.
+#define WHB_LOG_FILE_DEFAULT_MAX_SIZE (4 * 1024 * 1024)
+
+/**
+ * Append log messages to the file at path, e.g. on the SD card.
+ *
+ * Messages are copied into one of two 64 byte aligned buffers and written
+ * from a low priority thread whenever a buffer is half full or 100
+ * milliseconds have passed, so the file system sees a few large writes
+ * rather than one per line. When both buffers are full messages are dropped
+ * rather than blocking the caller.
+ *
+ * Once the file reaches the maximum size it is renamed to path with ".1"
+ * appended, replacing an older one, and a new file is started.
+ *
+ * If the crash handler is used, it writes what is still buffered after the
+ * crash was logged.
+ */
+BOOL
+WHBLogFileInit(const char *path);
+
+/**
+ * WHBLogFileInit with the size the file is rotated at, 0 to never rotate.
+ */
+BOOL
+WHBLogFileInitEx(const char *path,
+                 uint32_t maxFileSize);
+
+/**
+ * Write what is buffered and close the file.
+ */
+BOOL
+WHBLogFileDeinit();
+
+/**
+ * Write what is buffered now, from the calling thread.
+ */
+void
+WHBLogFileFlush();
+
+/**
+ * Number of messages dropped because both buffers were full.
+ */
+uint32_t
+WHBLogFileGetDroppedCount();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
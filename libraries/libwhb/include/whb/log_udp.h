@@ -11,12 +11,25 @@
 extern "C" {
 #endif
 
+/**
+ * Broadcast log messages over UDP on port 4405.
+ *
+ * Messages are queued by the logging thread and sent from a low priority
+ * thread, several per datagram. When the queue is full messages are dropped
+ * rather than blocking the caller.
+ */
 BOOL
 WHBLogUdpInit();
 
 BOOL
 WHBLogUdpDeinit();
 
+/**
+ * Number of messages dropped because the queue was full.
+ */
+uint32_t
+WHBLogUdpGetDroppedCount();
+
 #ifdef __cplusplus
 }
 #endif
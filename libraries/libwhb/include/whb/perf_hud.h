@@ -0,0 +1,122 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup whb_perf_hud Performance overlay
+ * \ingroup whb
+ *
+ * Shows frame times, core load and memory usage at the top of the console:
+ *
+ * \code
+ * WHBLogConsoleInit();
+ * WHBPerfHudInit();
+ * while (WHBProcIsRunning()) {
+ *    WHBPerfHudBeginFrame();
+ *    ...
+ *    if (buttonsTriggered & VPAD_BUTTON_ZL) {
+ *       WHBPerfHudSetEnabled(!WHBPerfHudIsEnabled());
+ *    }
+ *    WHBLogConsoleDraw();
+ * }
+ * WHBPerfHudShutdown();
+ * \endcode
+ *
+ * The GPU time is the longest pass measured by the GPU profiler, so wrap
+ * the whole frame in a pass when using WHBGpuProfilerBegin. While the audio
+ * profiler runs a line with its peaks is added, see WHBAudioProfilerInit.
+ *
+ * Idle time is measured by a thread at the lowest priority on every core,
+ * which only runs while the HUD is enabled and keeps the core from idling.
+ * Other threads at priority 31 compete with it and show up as idle time.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WHBPerfHudStats
+{
+   //! CPU time between the last two calls to WHBPerfHudBeginFrame.
+   OSTime frameTime;
+
+   //! Rolling average of frameTime.
+   OSTime averageFrameTime;
+
+   //! Longest frameTime since the HUD was enabled.
+   OSTime maxFrameTime;
+
+   //! GPU time of the longest pass measured by the GPU profiler.
+   OSTime gpuTime;
+
+   //! Name of that pass, or NULL if the GPU profiler measured nothing.
+   const char *gpuPassName;
+
+   //! Idle time of each core in the last frame, in percent.
+   uint32_t coreIdle[3];
+
+   //! Bytes allocated from the malloc heap, see mallinfo.
+   uint32_t heapUsed;
+
+   //! Size of the malloc heap.
+   uint32_t heapSize;
+
+   //! Bytes of MEM1 used by WHBGfx, see WHBGfxGetMEM1Usage.
+   uint32_t mem1Used;
+
+   //! Size of the WHBGfx MEM1 heap.
+   uint32_t mem1Size;
+
+   //! Peak AX frame time from the audio profiler, 0 when it is not running.
+   OSTime audioPeakTime;
+
+   //! audioPeakTime as a share of the AX frame period, in percent.
+   uint32_t audioPeakLoad;
+
+   //! Peak number of voices rendered in an AX frame.
+   uint32_t audioPeakVoices;
+
+   //! AX frames that took longer than the frame period.
+   uint32_t audioOverruns;
+} WHBPerfHudStats;
+
+BOOL
+WHBPerfHudInit();
+
+void
+WHBPerfHudShutdown();
+
+/**
+ * Show or hide the HUD, it starts hidden.
+ */
+void
+WHBPerfHudSetEnabled(BOOL enabled);
+
+BOOL
+WHBPerfHudIsEnabled();
+
+/**
+ * Collect the statistics of the previous frame, call once at the start of
+ * every frame. Does nothing while the HUD is hidden.
+ */
+void
+WHBPerfHudBeginFrame();
+
+/**
+ * Get the statistics collected by the last WHBPerfHudBeginFrame.
+ */
+void
+WHBPerfHudGetStats(WHBPerfHudStats *stats);
+
+/**
+ * Print the HUD with WHBLogPrint, for GX2 applications without a console.
+ */
+void
+WHBPerfHudLog();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,125 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/thread.h>
+#include <whb/file.h>
+
+/**
+ * \defgroup whb_preload Parallel file preloader
+ * \ingroup whb
+ *
+ * Reads a list of files on several threads, each with its own FSA client,
+ * so many small files are not bound by the latency of every single read:
+ *
+ * \code
+ * WHBPreloadFile files[] = {
+ *    { "shaders/pos.gsh" },
+ *    { "textures/font.gtx" },
+ * };
+ * WHBPreload preload;
+ * WHBPreloadStart(&preload, files, 2, 0, NULL, NULL);
+ * while (!WHBPreloadIsDone(&preload)) {
+ *    drawLoadingScreen(WHBPreloadGetCompleted(&preload), 2);
+ * }
+ * WHBPreloadWait(&preload);
+ * \endcode
+ *
+ * Files are read in path order, which keeps files of the same directory
+ * together since they are usually stored next to each other.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WHB_PRELOAD_MAX_THREADS 4
+
+typedef enum WHBPreloadStatus
+{
+   WHB_PRELOAD_PENDING = 0,
+   WHB_PRELOAD_OK = 1,
+   WHB_PRELOAD_FAILED = -1,
+} WHBPreloadStatus;
+
+typedef struct WHBPreloadFile
+{
+   //! Path of the file, relative paths are in /vol/content like WHBOpenFile.
+   const char *path;
+
+   //! Allocator for the data, or NULL for the default heap.
+   const WHBFileAllocator *allocator;
+
+   //! The file data, 64 byte aligned, free it with WHBFreeWholeFileEx.
+   char *data;
+
+   //! Size of the file.
+   uint32_t size;
+
+   //! A WHBPreloadStatus, set once the file is done.
+   volatile int32_t status;
+} WHBPreloadFile;
+
+/**
+ * Called from a loader thread once a file is done, successful or not.
+ */
+typedef void (*WHBPreloadCallbackFn)(WHBPreloadFile *file,
+                                     void *context);
+
+typedef struct WHBPreloadThread WHBPreloadThread;
+
+typedef struct WHBPreload
+{
+   WHBPreloadFile *files;
+   uint32_t count;
+   WHBPreloadCallbackFn callback;
+   void *context;
+
+   //! Internal.
+   WHBPreloadFile **order;
+   volatile uint32_t next;
+   volatile uint32_t completed;
+   uint32_t numThreads;
+   WHBPreloadThread *threads;
+} WHBPreload;
+
+/**
+ * Start reading files on numThreads threads.
+ *
+ * \param numThreads
+ * Number of loader threads, at most WHB_PRELOAD_MAX_THREADS, or 0 for 3.
+ *
+ * \param callback
+ * Called once per file, can be NULL.
+ */
+BOOL
+WHBPreloadStart(WHBPreload *preload,
+                WHBPreloadFile *files,
+                uint32_t count,
+                uint32_t numThreads,
+                WHBPreloadCallbackFn callback,
+                void *context);
+
+/**
+ * Get the number of files done so far.
+ */
+uint32_t
+WHBPreloadGetCompleted(WHBPreload *preload);
+
+BOOL
+WHBPreloadIsDone(WHBPreload *preload);
+
+/**
+ * Wait for every file and free the loader threads, must be called once for
+ * every successful WHBPreloadStart.
+ *
+ * \return
+ * TRUE if every file was read.
+ */
+BOOL
+WHBPreloadWait(WHBPreload *preload);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
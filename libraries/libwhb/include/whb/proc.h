@@ -11,6 +11,12 @@
 extern "C" {
 #endif
 
+/**
+ * Called from WHBProcIsRunning on the main thread when the application
+ * releases or reacquires the foreground.
+ */
+typedef void (*WHBProcForegroundCallbackFn)(void *context);
+
 void
 WHBProcInit();
 
@@ -23,6 +29,46 @@ WHBProcStopRunning();
 BOOL
 WHBProcIsRunning();
 
+/**
+ * Add callbacks to throttle work while in the background, such as pausing
+ * network threads. Either callback can be NULL.
+ *
+ * Release callbacks run before the foreground is released, in the reverse
+ * order they were added, and must free any foreground memory the caller
+ * owns. Acquire callbacks run in order once the foreground is back.
+ */
+BOOL
+WHBProcAddForegroundCallbacks(WHBProcForegroundCallbackFn release,
+                              WHBProcForegroundCallbackFn acquire,
+                              void *context);
+
+void
+WHBProcRemoveForegroundCallbacks(WHBProcForegroundCallbackFn release,
+                                 WHBProcForegroundCallbackFn acquire,
+                                 void *context);
+
+/**
+ * Suspend the WUTJob worker threads while in the background, enabled by
+ * default.
+ */
+void
+WHBProcSetSuspendJobsInBackground(BOOL suspend);
+
+BOOL
+WHBProcIsInForeground();
+
+/**
+ * Block the calling thread while the application is in the background.
+ *
+ * For worker threads that don't otherwise call WHBProcIsRunning, e.g. at the
+ * top of a network loop.
+ *
+ * \return
+ * FALSE once the application is exiting.
+ */
+BOOL
+WHBProcWaitForeground();
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,5 +1,6 @@
 #pragma once
 #include <wut.h>
+#include <coreinit/filesystem.h>
 
 /**
  * \defgroup whb_sdcard SDCard Access
@@ -11,12 +12,51 @@
 extern "C" {
 #endif
 
+typedef struct WHBSdCardConfig
+{
+   //! Number of command blocks in the pool, at least 1.
+   uint32_t numCmdBlocks;
+
+   //! Priority of the commands, see FSSetCmdPriority, 0 is the highest.
+   FSPriority priority;
+} WHBSdCardConfig;
+
+void
+WHBGetDefaultSdCardConfig(WHBSdCardConfig *config);
+
 BOOL
 WHBMountSdCard();
 
+/**
+ * Mount the SD card with a pool of command blocks on its FS client.
+ *
+ * Each command needs its own command block, so the pool size is how many
+ * FS calls on the client can be in flight at the same time.
+ */
+BOOL
+WHBMountSdCardEx(const WHBSdCardConfig *config);
+
 char *
 WHBGetSdCardMountPath();
 
+/**
+ * Get the FS client of the mounted SD card, or NULL if not mounted.
+ */
+FSClient *
+WHBSdCardGetClient();
+
+/**
+ * Take a command block from the pool, waiting until one is free.
+ *
+ * The block has the configured priority and must be given back with
+ * WHBSdCardReleaseCmdBlock once its command has completed.
+ */
+FSCmdBlock *
+WHBSdCardAcquireCmdBlock();
+
+void
+WHBSdCardReleaseCmdBlock(FSCmdBlock *cmd);
+
 BOOL
 WHBUnmountSdCard();
 
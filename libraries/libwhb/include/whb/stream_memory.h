@@ -0,0 +1,197 @@
+#pragma once
+#include <wut.h>
+
+/**
+ * \defgroup whb_stream_memory Streaming memory
+ * \ingroup whb
+ *
+ * One contiguous region for streamed data, e.g. texture and audio pages,
+ * managed by a block heap so long sessions don't fragment it.
+ *
+ * Buffers can be allocated anywhere in the region or at a fixed offset,
+ * and freed ranges are merged with their free neighbours by the block heap.
+ * Pages of the same size are best taken from a slot pool, which reserves
+ * one range of the region for count pages up front and then hands slots
+ * out without touching the heap at all.
+ *
+ * \code
+ * WHBStreamMemory *mem = WHBStreamMemoryCreate(64 * 1024 * 1024, 0);
+ *
+ * // 128 texture pages of 256 KiB at the start of the region
+ * WHBStreamSlots *pages = WHBStreamSlotsCreate(mem, 0, 256 * 1024, 128);
+ * void *page = WHBStreamSlotsAlloc(pages);
+ * ...
+ * WHBStreamSlotsFree(pages, page);
+ * \endcode
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WHBStreamMemory WHBStreamMemory;
+typedef struct WHBStreamSlots WHBStreamSlots;
+
+//! Offset for WHBStreamSlotsCreate to place the slots anywhere.
+#define WHB_STREAM_MEMORY_ANY_OFFSET 0xFFFFFFFF
+
+/**
+ * Create a streaming region of size bytes allocated from the default heap.
+ *
+ * \param maxBlocks
+ * Number of blocks the heap can track, or 0 for 256. Every allocation and
+ * every free range between allocations takes one.
+ *
+ * \return
+ * The region, or NULL on failure.
+ */
+WHBStreamMemory *
+WHBStreamMemoryCreate(uint32_t size,
+                      uint32_t maxBlocks);
+
+/**
+ * Create a streaming region in the given memory, e.g. from MEM1 or the
+ * foreground bucket. The memory must stay valid until
+ * WHBStreamMemoryDestroy.
+ *
+ * \return
+ * The region, or NULL on failure.
+ */
+WHBStreamMemory *
+WHBStreamMemoryCreateFromMemory(void *memory,
+                                uint32_t size,
+                                uint32_t maxBlocks);
+
+/**
+ * Destroy a region, freeing its memory if it was created by
+ * WHBStreamMemoryCreate. Slot pools must be destroyed first.
+ */
+void
+WHBStreamMemoryDestroy(WHBStreamMemory *mem);
+
+/**
+ * Allocate size bytes aligned to align anywhere in the region.
+ *
+ * \return
+ * The allocation, or NULL if no free range is big enough.
+ */
+void *
+WHBStreamMemoryAlloc(WHBStreamMemory *mem,
+                     uint32_t size,
+                     uint32_t align);
+
+/**
+ * Allocate size bytes at offset bytes from the start of the region.
+ *
+ * \return
+ * The allocation, or NULL if part of the range is in use.
+ */
+void *
+WHBStreamMemoryAllocAt(WHBStreamMemory *mem,
+                       uint32_t offset,
+                       uint32_t size);
+
+/**
+ * Free an allocation, it is merged with adjacent free ranges.
+ */
+void
+WHBStreamMemoryFree(WHBStreamMemory *mem,
+                    void *ptr);
+
+/**
+ * Get the start of the region, so offsets can be turned into addresses.
+ */
+void *
+WHBStreamMemoryGetBase(WHBStreamMemory *mem);
+
+/**
+ * Get the size of the largest free range, the biggest allocation that can
+ * still succeed.
+ */
+uint32_t
+WHBStreamMemoryGetLargestFree(WHBStreamMemory *mem);
+
+/**
+ * Get the total number of free bytes in the region.
+ */
+uint32_t
+WHBStreamMemoryGetFreeSize(WHBStreamMemory *mem);
+
+/**
+ * Reserve count slots of slotSize bytes in one range of the region.
+ *
+ * \param offset
+ * Offset of the range from the start of the region, or
+ * WHB_STREAM_MEMORY_ANY_OFFSET to put it anywhere.
+ *
+ * \param slotSize
+ * Size of each slot, rounded up to a multiple of 64 so every slot is cache
+ * line aligned.
+ *
+ * \return
+ * The slot pool, or NULL if the range could not be reserved.
+ */
+WHBStreamSlots *
+WHBStreamSlotsCreate(WHBStreamMemory *mem,
+                     uint32_t offset,
+                     uint32_t slotSize,
+                     uint32_t count);
+
+/**
+ * Give the range of a slot pool back to its region.
+ */
+void
+WHBStreamSlotsDestroy(WHBStreamSlots *slots);
+
+/**
+ * Take the lowest free slot, can be called from any thread.
+ *
+ * \return
+ * The slot, or NULL if all slots are in use.
+ */
+void *
+WHBStreamSlotsAlloc(WHBStreamSlots *slots);
+
+/**
+ * Take the slot with the given index if it is free.
+ *
+ * \return
+ * The slot, or NULL if it is in use or out of range.
+ */
+void *
+WHBStreamSlotsAllocIndex(WHBStreamSlots *slots,
+                         uint32_t index);
+
+/**
+ * Return a slot, can be called from any thread.
+ */
+void
+WHBStreamSlotsFree(WHBStreamSlots *slots,
+                   void *slot);
+
+/**
+ * Get the address of the slot with the given index, used or not.
+ */
+void *
+WHBStreamSlotsGetSlot(WHBStreamSlots *slots,
+                      uint32_t index);
+
+/**
+ * Get the index of a slot, or -1 if it is not in the pool.
+ */
+int32_t
+WHBStreamSlotsGetIndex(WHBStreamSlots *slots,
+                       const void *slot);
+
+/**
+ * Get the number of free slots.
+ */
+uint32_t
+WHBStreamSlotsGetFreeCount(WHBStreamSlots *slots);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,113 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup whb_trace Scoped CPU trace markers
+ * \ingroup whb
+ *
+ * Records named time ranges for a timeline view of a frame:
+ *
+ * \code
+ * WHBTraceInit(4096);
+ * while (WHBProcIsRunning()) {
+ *    WHB_TRACE_SCOPE("frame");
+ *    {
+ *       WHB_TRACE_SCOPE("update");
+ *       ...
+ *    }
+ *    ...
+ * }
+ * WHBTraceWriteChrome("fs:/vol/external01/trace.json");
+ * \endcode
+ *
+ * Events are stored in a ring buffer per core without taking locks, once a
+ * ring is full the oldest events are overwritten. The export can be loaded
+ * in chrome://tracing or Perfetto.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WHBTraceScope WHBTraceScope;
+
+struct WHBTraceScope
+{
+   //! Must be a string literal or otherwise outlive the trace.
+   const char *name;
+   OSTime start;
+};
+
+/**
+ * Allocate eventsPerCore events for every core and start recording.
+ */
+BOOL
+WHBTraceInit(uint32_t eventsPerCore);
+
+void
+WHBTraceShutdown();
+
+/**
+ * Enable or disable recording, enabled by WHBTraceInit.
+ */
+void
+WHBTraceSetEnabled(BOOL enabled);
+
+/**
+ * Also record the devoptab and socket calls reported through the
+ * __wut_trace_span hook in wut_trace.h, with their fd and byte count as
+ * event arguments. Disabled by default.
+ */
+void
+WHBTraceSetRuntimeEnabled(BOOL enabled);
+
+/**
+ * Discard every recorded event.
+ */
+void
+WHBTraceReset();
+
+/**
+ * Record a complete event on the current core and thread.
+ */
+void
+WHBTraceAddEvent(const char *name,
+                 OSTime start,
+                 OSTime end);
+
+static inline void
+WHBTraceScopeEnd(WHBTraceScope *scope)
+{
+   WHBTraceAddEvent(scope->name, scope->start, OSGetSystemTime());
+}
+
+/**
+ * Write the recorded events as Chrome trace JSON.
+ */
+BOOL
+WHBTraceWriteChrome(const char *path);
+
+/**
+ * Print the recorded events as Chrome trace JSON with WHBLogPrint, e.g. to
+ * stream them over UDP with WHBLogUdpInit.
+ */
+void
+WHBTraceLogChrome();
+
+#define WHB_TRACE_CONCAT_(a, b) a##b
+#define WHB_TRACE_CONCAT(a, b) WHB_TRACE_CONCAT_(a, b)
+
+/**
+ * Trace the time until the end of the enclosing scope.
+ */
+#define WHB_TRACE_SCOPE(traceName) \
+   WHBTraceScope WHB_TRACE_CONCAT(__whbTraceScope, __LINE__) \
+      __attribute__((cleanup(WHBTraceScopeEnd))) = { (traceName), OSGetSystemTime() }
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,113 @@
+#pragma once
+#include <wut.h>
+#include <gx2/texture.h>
+
+/**
+ * \defgroup whb_video Video playback
+ * \ingroup whb
+ *
+ * Plays a raw H.264 Annex B elementary stream from disk using the h264
+ * library, handing out the decoded pictures as GX2 textures:
+ *
+ * \code
+ * WHBVideoPlayer *player = WHBVideoPlayerOpen("fs:/vol/content/intro.h264", 1280, 720, 30.0f);
+ * while (!WHBVideoPlayerIsFinished(player)) {
+ *    const WHBVideoFrame *frame = WHBVideoPlayerGetFrame(player);
+ *    if (frame) {
+ *       GX2SetPixelTexture(&frame->luma, 0);
+ *       GX2SetPixelTexture(&frame->chroma, 1);
+ *       // Draw a quad, converting with WHBVideoGetYuvToRgbMatrix in the shader
+ *    }
+ *    ...
+ * }
+ * WHBVideoPlayerClose(player);
+ * \endcode
+ *
+ * A parser thread reads the file and splits it into access units, and a
+ * decoder thread feeds them to the decoder with several pictures in flight.
+ * Pictures are decoded straight into NV12 buffers that the textures point
+ * at, so nothing is copied or converted on the CPU; the fragment shader
+ * samples both textures and applies the colour matrix.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct WHBVideoPlayer WHBVideoPlayer;
+
+typedef struct WHBVideoFrame
+{
+   //! Full resolution luma in the red channel.
+   GX2Texture luma;
+
+   //! Half resolution chroma, Cb in the red and Cr in the green channel.
+   GX2Texture chroma;
+
+   //! Size of the picture after cropping, the textures may be larger.
+   uint32_t width;
+   uint32_t height;
+
+   //! Presentation time in seconds since the start of the stream.
+   double timestamp;
+} WHBVideoFrame;
+
+/**
+ * Open path and start decoding.
+ *
+ * \param maxWidth, maxHeight
+ * Largest picture size in the stream, used to size the decoder's memory and
+ * the picture buffers.
+ *
+ * \param frameRate
+ * Pictures per second, raw streams carry no timestamps of their own.
+ *
+ * \return
+ * NULL if the file can't be opened or memory can't be allocated.
+ */
+WHBVideoPlayer *
+WHBVideoPlayerOpen(const char *path,
+                   uint32_t maxWidth,
+                   uint32_t maxHeight,
+                   float frameRate);
+
+/**
+ * Stop the threads and free everything, including the textures of any
+ * frame returned by WHBVideoPlayerGetFrame.
+ */
+void
+WHBVideoPlayerClose(WHBVideoPlayer *player);
+
+/**
+ * Latest picture that is due, skipping pictures that are late. The clock
+ * starts at the first call, so call it once per displayed frame from the
+ * thread that owns the GX2 context.
+ *
+ * The returned frame, and the one returned before it, stay valid until the
+ * next call, which leaves the GPU a frame to finish reading them.
+ *
+ * \return
+ * NULL until the first picture has been decoded.
+ */
+const WHBVideoFrame *
+WHBVideoPlayerGetFrame(WHBVideoPlayer *player);
+
+/**
+ * TRUE once every picture has been decoded and returned, or decoding failed.
+ */
+BOOL
+WHBVideoPlayerIsFinished(WHBVideoPlayer *player);
+
+/**
+ * Matrix converting limited range BT.601 YCbCr to RGB, as three rows of
+ * four floats to multiply with vec4(y, cb, cr, 1.0).
+ */
+void
+WHBVideoGetYuvToRgbMatrix(float outMatrix[12]);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
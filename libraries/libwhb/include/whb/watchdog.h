@@ -0,0 +1,119 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/context.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup whb_watchdog Frame hitch watchdog
+ * \ingroup whb
+ *
+ * Captures what the render thread was doing when a frame runs over budget:
+ *
+ * \code
+ * WHBWatchdogInit(25000);
+ * while (WHBProcIsRunning()) {
+ *    WHBGfxBeginRender();
+ *    ...
+ *    WHBGfxFinishRender();
+ * }
+ * WHBWatchdogLog();
+ * WHBWatchdogShutdown();
+ * \endcode
+ *
+ * WHBGfxBeginRender re-arms a one shot alarm on every frame. When it fires
+ * the frame has taken longer than the budget since the previous
+ * WHBGfxBeginRender, and the render thread's context and back chain are
+ * copied into a ring of the most recent hitches. Nothing else is done per
+ * frame, symbols are only looked up when the hitches are logged.
+ *
+ * The budget covers a whole frame including the wait for the flip, so it
+ * should be above the frame interval, e.g. 25 ms for 60 fps.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//! Number of hitches kept, older ones are overwritten.
+#define WHB_WATCHDOG_MAX_HITCHES 16
+
+//! Maximum number of addresses recorded per hitch.
+#define WHB_WATCHDOG_MAX_DEPTH 16
+
+typedef struct WHBWatchdogHitch
+{
+   //! Frame number, counted from WHBWatchdogInit.
+   uint32_t frame;
+
+   //! When the frame began, from OSGetTime.
+   OSTime frameStart;
+
+   //! When the alarm fired, from OSGetTime.
+   OSTime time;
+
+   //! TRUE if the render thread was running when the alarm fired, FALSE if
+   //! it was waiting and its context is where it last stopped.
+   BOOL running;
+
+   //! The render thread's registers.
+   OSContext context;
+
+   //! Number of addresses in frames.
+   uint32_t depth;
+
+   //! PC, LR and return addresses from the back chain, innermost first.
+   uint32_t frames[WHB_WATCHDOG_MAX_DEPTH];
+} WHBWatchdogHitch;
+
+/**
+ * Start watching frames, a frame that takes more than budgetUs
+ * microseconds, 25000 if 0, is recorded as a hitch.
+ */
+BOOL
+WHBWatchdogInit(uint32_t budgetUs);
+
+void
+WHBWatchdogShutdown();
+
+/**
+ * Change the budget, takes effect from the next frame.
+ */
+void
+WHBWatchdogSetBudget(uint32_t budgetUs);
+
+/**
+ * Get the number of hitches recorded since WHBWatchdogInit or
+ * WHBWatchdogReset, including overwritten ones.
+ */
+uint32_t
+WHBWatchdogGetHitchCount();
+
+/**
+ * Copy a recorded hitch, 0 is the most recent.
+ *
+ * \return
+ * FALSE if there is no such hitch.
+ */
+BOOL
+WHBWatchdogGetHitch(uint32_t index,
+                    WHBWatchdogHitch *outHitch);
+
+/**
+ * Forget every recorded hitch.
+ */
+void
+WHBWatchdogReset();
+
+/**
+ * Print the recorded hitches, oldest first, with symbolised back chains
+ * using WHBLogPrintf.
+ */
+void
+WHBWatchdogLog();
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
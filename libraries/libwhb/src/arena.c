@@ -0,0 +1,193 @@
+#include <coreinit/core.h>
+#include <coreinit/interrupts.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memfrmheap.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <whb/arena.h>
+
+#define ARENA_NUM_CORES          3
+#define ARENA_DEFAULT_CHUNK_SIZE 0x4000
+#define ARENA_MAX_ALIGN          0x40
+
+typedef struct WUT_ALIGNAS(0x40) ArenaChunk
+{
+   uint8_t *cur;
+   uint8_t *end;
+} ArenaChunk;
+
+struct WHBArena
+{
+   MEMHeapHandle heap;
+   void *ownedMemory;
+   uint32_t chunkSize;
+   ArenaChunk chunks[ARENA_NUM_CORES];
+};
+
+WHBArena *
+WHBArenaCreateFromMemory(void *memory,
+                         uint32_t size,
+                         uint32_t chunkSize)
+{
+   WHBArena *arena;
+   MEMHeapHandle heap;
+
+   if (!memory) {
+      return NULL;
+   }
+
+   heap = MEMCreateFrmHeapEx(memory, size, MEM_HEAP_FLAG_USE_LOCK);
+   if (!heap) {
+      return NULL;
+   }
+
+   // The arena itself lives at the tail of the heap so a reset keeps it
+   arena = MEMAllocFromFrmHeapEx(heap, sizeof(WHBArena), -ARENA_MAX_ALIGN);
+   if (!arena) {
+      MEMDestroyFrmHeap(heap);
+      return NULL;
+   }
+
+   memset(arena, 0, sizeof(WHBArena));
+   arena->heap = heap;
+   arena->chunkSize = chunkSize ? chunkSize : ARENA_DEFAULT_CHUNK_SIZE;
+   return arena;
+}
+
+WHBArena *
+WHBArenaCreate(uint32_t size,
+               uint32_t chunkSize)
+{
+   WHBArena *arena;
+   void *memory = MEMAllocFromDefaultHeapEx(size, ARENA_MAX_ALIGN);
+   if (!memory) {
+      return NULL;
+   }
+
+   arena = WHBArenaCreateFromMemory(memory, size, chunkSize);
+   if (!arena) {
+      MEMFreeToDefaultHeap(memory);
+      return NULL;
+   }
+
+   arena->ownedMemory = memory;
+   return arena;
+}
+
+void
+WHBArenaDestroy(WHBArena *arena)
+{
+   void *ownedMemory;
+
+   if (!arena) {
+      return;
+   }
+
+   ownedMemory = arena->ownedMemory;
+   MEMDestroyFrmHeap(arena->heap);
+
+   if (ownedMemory) {
+      MEMFreeToDefaultHeap(ownedMemory);
+   }
+}
+
+void *
+WHBArenaAlloc(WHBArena *arena,
+              uint32_t size,
+              uint32_t align)
+{
+   ArenaChunk *chunk;
+   uint8_t *ptr;
+   uint8_t *base;
+   int state;
+
+   if (align < 4) {
+      align = 4;
+   } else if (align > ARENA_MAX_ALIGN) {
+      return NULL;
+   }
+
+   // Large allocations would waste most of a chunk
+   if (size > arena->chunkSize / 4) {
+      return MEMAllocFromFrmHeapEx(arena->heap, size, align);
+   }
+
+   // Interrupts are disabled so the thread can't move to another core or be
+   // preempted by another thread using the same chunk
+   state = OSDisableInterrupts();
+   chunk = &arena->chunks[OSGetCoreId()];
+
+   ptr = (uint8_t *)(((uintptr_t)chunk->cur + align - 1) & ~(align - 1));
+   if (!chunk->cur || ptr + size > chunk->end) {
+      base = MEMAllocFromFrmHeapEx(arena->heap, arena->chunkSize, ARENA_MAX_ALIGN);
+      if (!base) {
+         OSRestoreInterrupts(state);
+
+         // Try to fit just this allocation in what is left
+         return MEMAllocFromFrmHeapEx(arena->heap, size, align);
+      }
+
+      chunk->cur = base;
+      chunk->end = base + arena->chunkSize;
+      ptr = base;
+   }
+
+   chunk->cur = ptr + size;
+   OSRestoreInterrupts(state);
+   return ptr;
+}
+
+char *
+WHBArenaStrdup(WHBArena *arena,
+               const char *str)
+{
+   uint32_t length = strlen(str) + 1;
+   char *copy = WHBArenaAlloc(arena, length, 1);
+   if (copy) {
+      memcpy(copy, str, length);
+   }
+
+   return copy;
+}
+
+char *
+WHBArenaPrintf(WHBArena *arena,
+               const char *fmt,
+               ...)
+{
+   va_list va;
+   char *str;
+   int length;
+
+   va_start(va, fmt);
+   length = vsnprintf(NULL, 0, fmt, va);
+   va_end(va);
+
+   if (length < 0) {
+      return NULL;
+   }
+
+   str = WHBArenaAlloc(arena, length + 1, 1);
+   if (!str) {
+      return NULL;
+   }
+
+   va_start(va, fmt);
+   vsnprintf(str, length + 1, fmt, va);
+   va_end(va);
+   return str;
+}
+
+void
+WHBArenaReset(WHBArena *arena)
+{
+   memset(arena->chunks, 0, sizeof(arena->chunks));
+   MEMFreeToFrmHeap(arena->heap, MEM_FRM_HEAP_FREE_HEAD);
+}
+
+uint32_t
+WHBArenaGetFreeSize(WHBArena *arena)
+{
+   return MEMGetAllocatableSizeForFrmHeapEx(arena->heap, 4);
+}
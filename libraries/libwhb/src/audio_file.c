@@ -0,0 +1,465 @@
+#include "../../wutthreadstats/wut_thread_stats.h"
+
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <fcntl.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <whb/audio_file.h>
+#include <whb/log.h>
+#include <wut_thread_stats.h>
+
+#define AUDIO_FILE_STACK_SIZE    0x4000
+#define AUDIO_FILE_PRIORITY      16
+#define AUDIO_FILE_READ_SIZE     0x10000
+#define AUDIO_FILE_DECODE_FRAMES 1022 // Multiple of the 14 samples in a DSP frame
+#define AUDIO_FILE_HALF_FRAMES   2048
+#define AUDIO_FILE_RING_FRAMES   16384
+
+#define DSP_FRAME_BYTES   8
+#define DSP_FRAME_SAMPLES 14
+
+typedef enum AudioFileFormat
+{
+   AUDIO_FILE_FORMAT_WAV,
+   AUDIO_FILE_FORMAT_DSP,
+} AudioFileFormat;
+
+//! Header of a Nintendo DSP ADPCM file, big endian
+typedef struct DspHeader
+{
+   uint32_t numSamples;
+   uint32_t numNibbles;
+   uint32_t sampleRate;
+   uint16_t loopFlag;
+   uint16_t format;
+   uint32_t loopStart;
+   uint32_t loopEnd;
+   uint32_t currentAddress;
+   int16_t coefs[16];
+   uint16_t gain;
+   uint16_t predScale;
+   int16_t hist1;
+   int16_t hist2;
+   uint16_t loopPredScale;
+   int16_t loopHist1;
+   int16_t loopHist2;
+   uint16_t padding[11];
+} DspHeader;
+
+struct WHBAudioFile
+{
+   OSThread thread;
+   uint8_t stack[AUDIO_FILE_STACK_SIZE] __attribute__((aligned(16)));
+
+   WHBAudioStream *stream;
+   int fd;
+   BOOL loop;
+   volatile BOOL stop;
+   volatile BOOL finished;
+
+   AudioFileFormat format;
+   uint32_t channels;
+   uint32_t sampleRate;
+
+   //! File offset and size of the sample data
+   uint32_t dataOffset;
+   uint32_t dataSize;
+
+   //! Bytes of sample data read from the file since the last rewind
+   uint32_t dataRead;
+
+   //! Read buffer, bufferPos bytes of the bufferSize valid ones are consumed
+   uint8_t *buffer;
+   uint32_t bufferPos;
+   uint32_t bufferSize;
+
+   //! DSP decoder state
+   int16_t coefs[16];
+   int32_t hist1;
+   int32_t hist2;
+   uint32_t numSamples;
+   uint32_t samplesDecoded;
+   DspHeader dsp;
+
+   int16_t pcm[AUDIO_FILE_DECODE_FRAMES * 2];
+};
+
+static inline uint16_t
+AudioFileReadLE16(const uint8_t *p)
+{
+   return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t
+AudioFileReadLE32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+          ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static BOOL
+AudioFileReadExact(int fd,
+                   void *dst,
+                   uint32_t size)
+{
+   return read(fd, dst, size) == (ssize_t)size;
+}
+
+static BOOL
+AudioFileParseWav(WHBAudioFile *file)
+{
+   uint8_t header[16];
+   BOOL haveFormat = FALSE;
+
+   if (!AudioFileReadExact(file->fd, header, 12) ||
+       memcmp(header, "RIFF", 4) != 0 ||
+       memcmp(header + 8, "WAVE", 4) != 0) {
+      return FALSE;
+   }
+
+   while (AudioFileReadExact(file->fd, header, 8)) {
+      uint32_t size = AudioFileReadLE32(header + 4);
+
+      if (memcmp(header, "fmt ", 4) == 0) {
+         if (size < 16 || !AudioFileReadExact(file->fd, header, 16)) {
+            return FALSE;
+         }
+
+         if (AudioFileReadLE16(header + 0) != 1 ||
+             AudioFileReadLE16(header + 14) != 16) {
+            WHBLogPrintf("%s: only 16-bit PCM WAV files are supported", __FUNCTION__);
+            return FALSE;
+         }
+
+         file->channels = AudioFileReadLE16(header + 2);
+         file->sampleRate = AudioFileReadLE32(header + 4);
+         haveFormat = TRUE;
+         size -= 16;
+      } else if (memcmp(header, "data", 4) == 0) {
+         if (!haveFormat) {
+            return FALSE;
+         }
+
+         file->dataOffset = (uint32_t)lseek(file->fd, 0, SEEK_CUR);
+         file->dataSize = size;
+         return TRUE;
+      }
+
+      // Chunks are padded to an even size
+      if (lseek(file->fd, size + (size & 1), SEEK_CUR) < 0) {
+         return FALSE;
+      }
+   }
+
+   return FALSE;
+}
+
+static BOOL
+AudioFileParseDsp(WHBAudioFile *file)
+{
+   DspHeader *dsp = &file->dsp;
+
+   if (!AudioFileReadExact(file->fd, dsp, sizeof(DspHeader)) ||
+       dsp->format != 0 ||
+       dsp->sampleRate == 0 ||
+       dsp->numSamples == 0) {
+      return FALSE;
+   }
+
+   memcpy(file->coefs, dsp->coefs, sizeof(file->coefs));
+   file->channels = 1;
+   file->sampleRate = dsp->sampleRate;
+   file->numSamples = dsp->numSamples;
+   file->dataOffset = sizeof(DspHeader);
+   file->dataSize = (dsp->numSamples + DSP_FRAME_SAMPLES - 1) / DSP_FRAME_SAMPLES * DSP_FRAME_BYTES;
+   return TRUE;
+}
+
+//! Seek back to the start of the sample data and reset the decoder
+static BOOL
+AudioFileRewind(WHBAudioFile *file)
+{
+   if (lseek(file->fd, file->dataOffset, SEEK_SET) < 0) {
+      return FALSE;
+   }
+
+   file->dataRead = 0;
+   file->bufferPos = 0;
+   file->bufferSize = 0;
+   file->hist1 = file->dsp.hist1;
+   file->hist2 = file->dsp.hist2;
+   file->samplesDecoded = 0;
+   return TRUE;
+}
+
+//! Make at least size unconsumed bytes contiguous in the read buffer when
+//! the file still has them, returns how many there are
+static uint32_t
+AudioFileEnsure(WHBAudioFile *file,
+                uint32_t size)
+{
+   uint32_t available = file->bufferSize - file->bufferPos;
+   uint32_t want;
+   ssize_t rc;
+
+   if (available >= size || file->dataRead == file->dataSize) {
+      return available;
+   }
+
+   // Keep the tail of a partially consumed sample or frame
+   memmove(file->buffer, file->buffer + file->bufferPos, available);
+   file->bufferPos = 0;
+   file->bufferSize = available;
+
+   want = AUDIO_FILE_READ_SIZE - available;
+   if (want > file->dataSize - file->dataRead) {
+      want = file->dataSize - file->dataRead;
+   }
+
+   rc = read(file->fd, file->buffer + available, want);
+   if (rc <= 0) {
+      if (rc < 0) {
+         WHBLogPrintf("%s: read failed", __FUNCTION__);
+      }
+
+      // Treat a truncated file as ending here
+      file->dataRead = file->dataSize;
+      return available;
+   }
+
+   file->dataRead += rc;
+   file->bufferSize += rc;
+   return file->bufferSize;
+}
+
+static uint32_t
+AudioFileDecodeWav(WHBAudioFile *file)
+{
+   uint32_t frameBytes = file->channels * sizeof(int16_t);
+   uint32_t frames = AudioFileEnsure(file, AUDIO_FILE_DECODE_FRAMES * frameBytes) / frameBytes;
+   const uint8_t *src = file->buffer + file->bufferPos;
+
+   if (frames > AUDIO_FILE_DECODE_FRAMES) {
+      frames = AUDIO_FILE_DECODE_FRAMES;
+   }
+
+   for (uint32_t i = 0; i < frames * file->channels; ++i) {
+      file->pcm[i] = (int16_t)AudioFileReadLE16(src + i * 2);
+   }
+
+   file->bufferPos += frames * frameBytes;
+   return frames;
+}
+
+static uint32_t
+AudioFileDecodeDsp(WHBAudioFile *file)
+{
+   uint32_t frames = 0;
+   int32_t hist1 = file->hist1;
+   int32_t hist2 = file->hist2;
+
+   while (frames + DSP_FRAME_SAMPLES <= AUDIO_FILE_DECODE_FRAMES &&
+          file->samplesDecoded < file->numSamples &&
+          AudioFileEnsure(file, DSP_FRAME_BYTES) >= DSP_FRAME_BYTES) {
+      const uint8_t *frame = file->buffer + file->bufferPos;
+      int32_t scale = 1 << (frame[0] & 0xF);
+      int32_t coef1 = file->coefs[((frame[0] >> 4) & 7) * 2 + 0];
+      int32_t coef2 = file->coefs[((frame[0] >> 4) & 7) * 2 + 1];
+
+      for (uint32_t i = 0; i < DSP_FRAME_SAMPLES && file->samplesDecoded < file->numSamples; ++i) {
+         uint8_t byte = frame[1 + i / 2];
+         int32_t nibble = (i & 1) ? (byte & 0xF) : (byte >> 4);
+         int32_t sample;
+
+         if (nibble >= 8) {
+            nibble -= 16;
+         }
+
+         sample = (((nibble * scale) << 11) + 1024 + coef1 * hist1 + coef2 * hist2) >> 11;
+         if (sample > 32767) {
+            sample = 32767;
+         } else if (sample < -32768) {
+            sample = -32768;
+         }
+
+         file->pcm[frames++] = (int16_t)sample;
+         hist2 = hist1;
+         hist1 = sample;
+         file->samplesDecoded++;
+      }
+
+      file->bufferPos += DSP_FRAME_BYTES;
+   }
+
+   file->hist1 = hist1;
+   file->hist2 = hist2;
+   return frames;
+}
+
+static int
+AudioFileThreadEntry(int argc,
+                     const char **argv)
+{
+   WHBAudioFile *file = (WHBAudioFile *)argv;
+   BOOL started = FALSE;
+
+   while (!file->stop) {
+      uint32_t frames;
+
+      if (WHBAudioStreamGetFreeFrames(file->stream) < AUDIO_FILE_DECODE_FRAMES) {
+         if (!started) {
+            WHBAudioStreamStart(file->stream);
+            started = TRUE;
+         }
+
+         OSSleepTicks(OSMillisecondsToTicks(2));
+         continue;
+      }
+
+      if (file->format == AUDIO_FILE_FORMAT_DSP) {
+         frames = AudioFileDecodeDsp(file);
+      } else {
+         frames = AudioFileDecodeWav(file);
+      }
+
+      if (frames == 0) {
+         if (!file->loop || !AudioFileRewind(file)) {
+            break;
+         }
+
+         continue;
+      }
+
+      WHBAudioStreamWrite(file->stream, file->pcm, frames);
+   }
+
+   // Tracks shorter than the ring never filled it
+   if (!started && !file->stop) {
+      WHBAudioStreamStart(file->stream);
+   }
+
+   file->finished = TRUE;
+   return 0;
+}
+
+WHBAudioFile *
+WHBAudioFileOpen(const char *path,
+                 BOOL loop)
+{
+   return WHBAudioFileOpenEx(path, loop, 2, AUDIO_FILE_RING_FRAMES);
+}
+
+WHBAudioFile *
+WHBAudioFileOpenEx(const char *path,
+                   BOOL loop,
+                   uint32_t core,
+                   uint32_t ringFrames)
+{
+   WHBAudioFile *file;
+   const char *ext = strrchr(path, '.');
+   BOOL parsed;
+
+   if (core > 2) {
+      WHBLogPrintf("%s: invalid core %u", __FUNCTION__, core);
+      return NULL;
+   }
+
+   file = (WHBAudioFile *)MEMAllocFromDefaultHeapEx(sizeof(WHBAudioFile), 16);
+   if (!file) {
+      WHBLogPrintf("%s: out of memory", __FUNCTION__);
+      return NULL;
+   }
+
+   memset(file, 0, sizeof(WHBAudioFile));
+   file->loop = loop;
+   file->fd = open(path, O_RDONLY);
+   if (file->fd < 0) {
+      WHBLogPrintf("%s: could not open %s", __FUNCTION__, path);
+      MEMFreeToDefaultHeap(file);
+      return NULL;
+   }
+
+   if (ext && strcasecmp(ext, ".dsp") == 0) {
+      file->format = AUDIO_FILE_FORMAT_DSP;
+      parsed = AudioFileParseDsp(file);
+   } else {
+      file->format = AUDIO_FILE_FORMAT_WAV;
+      parsed = AudioFileParseWav(file);
+   }
+
+   if (!parsed || file->channels < 1 || file->channels > 2) {
+      WHBLogPrintf("%s: unsupported file %s", __FUNCTION__, path);
+      goto error;
+   }
+
+   // Cache line aligned so the devoptab can read straight into it
+   file->buffer = (uint8_t *)MEMAllocFromDefaultHeapEx(AUDIO_FILE_READ_SIZE, 0x40);
+   if (!file->buffer) {
+      WHBLogPrintf("%s: out of memory", __FUNCTION__);
+      goto error;
+   }
+
+   file->stream = WHBAudioStreamCreate(file->sampleRate, file->channels,
+                                       ringFrames, AUDIO_FILE_HALF_FRAMES);
+   if (!file->stream || !AudioFileRewind(file)) {
+      goto error;
+   }
+
+   if (!OSCreateThread(&file->thread, AudioFileThreadEntry, 0, (char *)file,
+                       file->stack + sizeof(file->stack), sizeof(file->stack),
+                       AUDIO_FILE_PRIORITY, (OSThreadAttributes)(1 << core))) {
+      WHBLogPrintf("%s: could not create thread", __FUNCTION__);
+      goto error;
+   }
+
+   OSSetThreadName(&file->thread, "WHBAudioFile");
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(&file->thread);
+   }
+   OSResumeThread(&file->thread);
+   return file;
+
+error:
+   if (file->stream) {
+      WHBAudioStreamDestroy(file->stream);
+   }
+
+   if (file->buffer) {
+      MEMFreeToDefaultHeap(file->buffer);
+   }
+
+   close(file->fd);
+   MEMFreeToDefaultHeap(file);
+   return NULL;
+}
+
+void
+WHBAudioFileClose(WHBAudioFile *file)
+{
+   if (!file) {
+      return;
+   }
+
+   file->stop = TRUE;
+   OSJoinThread(&file->thread, NULL);
+
+   WHBAudioStreamDestroy(file->stream);
+   MEMFreeToDefaultHeap(file->buffer);
+   close(file->fd);
+   MEMFreeToDefaultHeap(file);
+}
+
+WHBAudioStream *
+WHBAudioFileGetStream(WHBAudioFile *file)
+{
+   return file->stream;
+}
+
+BOOL
+WHBAudioFileIsFinished(WHBAudioFile *file)
+{
+   return file->finished;
+}
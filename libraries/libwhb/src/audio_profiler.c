@@ -0,0 +1,212 @@
+#include <coreinit/time.h>
+#include <sndcore2/core.h>
+#include <string.h>
+#include <whb/audio_profiler.h>
+#include <whb/log.h>
+#include <whb/trace.h>
+
+static BOOL
+sRunning = FALSE;
+
+static BOOL
+sTraceEnabled = FALSE;
+
+//! Recorded into by AX from WHBAudioProfilerInit on. The size of AXProfile
+//! is unverified, so both buffers AX writes have room for entries twice as
+//! large as ours.
+static AXProfile
+sRing[WHB_AUDIO_PROFILER_MAX_PROFILES * 2];
+
+static AXProfile
+sProfiles[WHB_AUDIO_PROFILER_MAX_PROFILES * 2];
+
+static WHBAudioProfilerStats
+sStats;
+
+//! Peaks of the current and the previous window, reported is the larger
+typedef struct ProfilerPeaks
+{
+   OSTime frameTime;
+   OSTime callbackTime;
+   uint32_t voices;
+} ProfilerPeaks;
+
+static ProfilerPeaks
+sPeaks[2];
+
+static uint32_t
+sWindowFrames = 0;
+
+static void
+ProfilerAddFrame(const AXProfile *profile,
+                 OSTime systemTimeOffset)
+{
+   ProfilerPeaks *peaks = &sPeaks[0];
+   OSTime frameTime = profile->axFrameEnd - profile->axFrameStart;
+   OSTime auxTime = profile->auxProcessingEnd - profile->auxProcessingStart;
+   OSTime callbackTime = profile->userCallbackEnd - profile->userCallbackStart;
+
+   ++sStats.frames;
+   if (sStats.framePeriod && frameTime > sStats.framePeriod) {
+      ++sStats.overruns;
+   }
+
+   sStats.frameTime = frameTime;
+   sStats.auxTime = auxTime;
+   sStats.callbackTime = callbackTime;
+   sStats.voices = profile->axNumVoices;
+   if (frameTime > sStats.maxFrameTime) {
+      sStats.maxFrameTime = frameTime;
+   }
+
+   if (++sWindowFrames > WHB_AUDIO_PROFILER_PEAK_WINDOW) {
+      sPeaks[1] = sPeaks[0];
+      memset(&sPeaks[0], 0, sizeof(ProfilerPeaks));
+      sWindowFrames = 1;
+   }
+
+   if (frameTime > peaks->frameTime) {
+      peaks->frameTime = frameTime;
+   }
+   if (callbackTime > peaks->callbackTime) {
+      peaks->callbackTime = callbackTime;
+   }
+   if (profile->axNumVoices > peaks->voices) {
+      peaks->voices = profile->axNumVoices;
+   }
+
+   if (sTraceEnabled) {
+      // Trace events are in OSGetSystemTime, AX profiles in OSGetTime
+      WHBTraceAddEvent("AX frame",
+                       profile->axFrameStart + systemTimeOffset,
+                       profile->axFrameEnd + systemTimeOffset);
+      if (auxTime) {
+         WHBTraceAddEvent("AX aux",
+                          profile->auxProcessingStart + systemTimeOffset,
+                          profile->auxProcessingEnd + systemTimeOffset);
+      }
+      if (callbackTime) {
+         WHBTraceAddEvent("AX frame callback",
+                          profile->userCallbackStart + systemTimeOffset,
+                          profile->userCallbackEnd + systemTimeOffset);
+      }
+   }
+}
+
+BOOL
+WHBAudioProfilerInit()
+{
+   uint32_t samplesPerSec;
+
+   if (sRunning) {
+      return TRUE;
+   }
+
+   if (!AXIsInit()) {
+      WHBLogPrintf("%s: AX is not initialised", __FUNCTION__);
+      return FALSE;
+   }
+
+   WHBAudioProfilerReset();
+
+   samplesPerSec = AXGetInputSamplesPerSec();
+   if (samplesPerSec) {
+      sStats.framePeriod = (OSTime)((uint64_t)AXGetInputSamplesPerFrame() *
+                                    OSTimerClockSpeed / samplesPerSec);
+   }
+
+   memset(sRing, 0, sizeof(sRing));
+   AXInitProfile(sRing, WHB_AUDIO_PROFILER_MAX_PROFILES);
+   sRunning = TRUE;
+   return TRUE;
+}
+
+void
+WHBAudioProfilerShutdown()
+{
+   if (!sRunning) {
+      return;
+   }
+
+   // There is no call to stop profiling, AX keeps recording into the ring
+   // which is why it is static
+   sRunning = FALSE;
+}
+
+BOOL
+WHBAudioProfilerIsRunning()
+{
+   return sRunning;
+}
+
+void
+WHBAudioProfilerUpdate()
+{
+   OSTime systemTimeOffset;
+   uint32_t count, i;
+
+   if (!sRunning) {
+      return;
+   }
+
+   count = AXGetSwapProfile(sProfiles, WHB_AUDIO_PROFILER_MAX_PROFILES);
+   if (count > WHB_AUDIO_PROFILER_MAX_PROFILES) {
+      count = WHB_AUDIO_PROFILER_MAX_PROFILES;
+   }
+
+   systemTimeOffset = OSGetSystemTime() - OSGetTime();
+   for (i = 0; i < count; ++i) {
+      ProfilerAddFrame(&sProfiles[i], systemTimeOffset);
+   }
+
+   sStats.peakFrameTime = sPeaks[0].frameTime > sPeaks[1].frameTime
+                        ? sPeaks[0].frameTime : sPeaks[1].frameTime;
+   sStats.peakCallbackTime = sPeaks[0].callbackTime > sPeaks[1].callbackTime
+                           ? sPeaks[0].callbackTime : sPeaks[1].callbackTime;
+   sStats.peakVoices = sPeaks[0].voices > sPeaks[1].voices
+                     ? sPeaks[0].voices : sPeaks[1].voices;
+   sStats.peakLoad = sStats.framePeriod
+                   ? (uint32_t)(sStats.peakFrameTime * 100 / sStats.framePeriod)
+                   : 0;
+}
+
+void
+WHBAudioProfilerReset()
+{
+   OSTime framePeriod = sStats.framePeriod;
+
+   memset(&sStats, 0, sizeof(sStats));
+   memset(sPeaks, 0, sizeof(sPeaks));
+   sStats.framePeriod = framePeriod;
+   sWindowFrames = 0;
+}
+
+void
+WHBAudioProfilerSetTraceEnabled(BOOL enabled)
+{
+   sTraceEnabled = enabled;
+}
+
+void
+WHBAudioProfilerGetStats(WHBAudioProfilerStats *stats)
+{
+   *stats = sStats;
+}
+
+void
+WHBAudioProfilerLog()
+{
+   WHBLogPrintf("AX frames %u overruns %u period %u us",
+                sStats.frames, sStats.overruns,
+                (uint32_t)OSTicksToMicroseconds(sStats.framePeriod));
+   WHBLogPrintf("AX frame last %u us peak %u us (%u%%) max %u us",
+                (uint32_t)OSTicksToMicroseconds(sStats.frameTime),
+                (uint32_t)OSTicksToMicroseconds(sStats.peakFrameTime),
+                sStats.peakLoad,
+                (uint32_t)OSTicksToMicroseconds(sStats.maxFrameTime));
+   WHBLogPrintf("AX callback last %u us peak %u us, aux %u us, voices %u peak %u",
+                (uint32_t)OSTicksToMicroseconds(sStats.callbackTime),
+                (uint32_t)OSTicksToMicroseconds(sStats.peakCallbackTime),
+                (uint32_t)OSTicksToMicroseconds(sStats.auxTime),
+                sStats.voices, sStats.peakVoices);
+}
@@ -0,0 +1,430 @@
+#include <coreinit/cache.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <sndcore2/core.h>
+#include <sndcore2/voice.h>
+#include <string.h>
+#include <whb/audio_stream.h>
+#include <whb/log.h>
+
+#define AUDIO_STREAM_MAX_CHANNELS 2
+#define AUDIO_STREAM_PRIORITY     31
+
+typedef enum AudioStreamState
+{
+   AUDIO_STREAM_STOPPED,
+   AUDIO_STREAM_START_PENDING,
+   AUDIO_STREAM_PLAYING,
+   AUDIO_STREAM_STOP_PENDING,
+} AudioStreamState;
+
+struct WHBAudioStream
+{
+   uint32_t channels;
+   AXVoice *voices[AUDIO_STREAM_MAX_CHANNELS];
+
+   //! One looping buffer per voice, made of two halves of halfFrames samples
+   int16_t *voiceBuffers[AUDIO_STREAM_MAX_CHANNELS];
+   uint32_t halfFrames;
+
+   //! Half the voices were playing at the last callback
+   uint32_t playingHalf;
+
+   //! Interleaved frames, ringFrames is a power of two
+   int16_t *ring;
+   uint32_t ringFrames;
+
+   //! Frames ever written, only changed by the producer
+   volatile uint32_t ringHead;
+
+   //! Frames ever read, only changed by whoever consumes
+   volatile uint32_t ringTail;
+
+   volatile uint32_t state;
+   WHBAudioStreamStats stats;
+};
+
+static WHBAudioStream * volatile
+sStreams[WHB_AUDIO_STREAM_MAX];
+
+//! Incremented at the end of every callback
+static volatile uint32_t
+sCallbackCount = 0;
+
+static BOOL
+sCallbackRegistered = FALSE;
+
+//! Move up to one half of frames from the ring into a half of the voice
+//! buffers, padding with silence
+static void
+AudioStreamFillHalf(WHBAudioStream *stream,
+                    uint32_t half)
+{
+   uint32_t tail = stream->ringTail;
+   uint32_t available = stream->ringHead - tail;
+   uint32_t frames = available < stream->halfFrames ? available : stream->halfFrames;
+   uint32_t mask = stream->ringFrames - 1;
+
+   // Read the samples only after seeing the head that published them
+   OSMemoryBarrier();
+
+   for (uint32_t ch = 0; ch < stream->channels; ++ch) {
+      int16_t *dst = stream->voiceBuffers[ch] + half * stream->halfFrames;
+      for (uint32_t i = 0; i < frames; ++i) {
+         dst[i] = stream->ring[((tail + i) & mask) * stream->channels + ch];
+      }
+
+      memset(dst + frames, 0, (stream->halfFrames - frames) * sizeof(int16_t));
+      DCFlushRange(dst, stream->halfFrames * sizeof(int16_t));
+   }
+
+   // Done with the samples before handing their space back to the producer
+   OSMemoryBarrier();
+   stream->ringTail = tail + frames;
+
+   if (frames < stream->halfFrames) {
+      stream->stats.underruns++;
+   }
+   stream->stats.framesPlayed += frames;
+}
+
+static void
+AudioStreamSetVoiceStates(WHBAudioStream *stream,
+                          AXVoiceState state)
+{
+   for (uint32_t ch = 0; ch < stream->channels; ++ch) {
+      AXSetVoiceState(stream->voices[ch], state);
+   }
+}
+
+/*
+ * Runs once per AX frame. Voice state changes happen here, so the voices of
+ * a stream always start and stop in the same frame.
+ */
+static void
+AudioStreamFrameCallback()
+{
+   for (uint32_t i = 0; i < WHB_AUDIO_STREAM_MAX; ++i) {
+      WHBAudioStream *stream = sStreams[i];
+      AXVoiceOffsets offsets;
+      uint32_t half;
+
+      if (!stream) {
+         continue;
+      }
+
+      switch (stream->state) {
+      case AUDIO_STREAM_START_PENDING:
+         AudioStreamSetVoiceStates(stream, AX_VOICE_STATE_PLAYING);
+         stream->state = AUDIO_STREAM_PLAYING;
+         continue;
+      case AUDIO_STREAM_STOP_PENDING:
+         AudioStreamSetVoiceStates(stream, AX_VOICE_STATE_STOPPED);
+         stream->state = AUDIO_STREAM_STOPPED;
+         continue;
+      case AUDIO_STREAM_PLAYING:
+         break;
+      default:
+         continue;
+      }
+
+      AXGetVoiceOffsets(stream->voices[0], &offsets);
+      half = offsets.currentOffset >= stream->halfFrames ? 1 : 0;
+      if (half != stream->playingHalf) {
+         AudioStreamFillHalf(stream, stream->playingHalf);
+         stream->playingHalf = half;
+      }
+   }
+
+   sCallbackCount++;
+}
+
+//! Wait for a callback that may still be using a stream to return
+static void
+AudioStreamWaitCallback()
+{
+   uint32_t count = sCallbackCount;
+   OSTime timeout = OSGetSystemTime() + OSMillisecondsToTicks(20);
+
+   // AX frames are 3ms, give up if AX is not running at all
+   while (sCallbackCount == count && OSGetSystemTime() < timeout) {
+      OSSleepTicks(OSMicrosecondsToTicks(500));
+   }
+}
+
+static void
+AudioStreamFree(WHBAudioStream *stream)
+{
+   for (uint32_t ch = 0; ch < AUDIO_STREAM_MAX_CHANNELS; ++ch) {
+      if (stream->voices[ch]) {
+         AXFreeVoice(stream->voices[ch]);
+      }
+
+      if (stream->voiceBuffers[ch]) {
+         MEMFreeToDefaultHeap(stream->voiceBuffers[ch]);
+      }
+   }
+
+   if (stream->ring) {
+      MEMFreeToDefaultHeap(stream->ring);
+   }
+
+   MEMFreeToDefaultHeap(stream);
+}
+
+static void
+AudioStreamSetupVoice(WHBAudioStream *stream,
+                      uint32_t ch,
+                      float ratio)
+{
+   AXVoice *voice = stream->voices[ch];
+   AXVoiceOffsets offsets;
+   AXVoiceVeData ve;
+   AXVoiceDeviceMixData tvMix[6];
+   AXVoiceDeviceMixData drcMix[4];
+
+   memset(&offsets, 0, sizeof(offsets));
+   offsets.dataType = AX_VOICE_FORMAT_LPCM16;
+   offsets.loopingEnabled = AX_VOICE_LOOP_ENABLED;
+   offsets.loopOffset = 0;
+   offsets.endOffset = stream->halfFrames * 2 - 1;
+   offsets.currentOffset = 0;
+   offsets.data = stream->voiceBuffers[ch];
+
+   // A mono stream goes to both the left and the right channel
+   memset(tvMix, 0, sizeof(tvMix));
+   memset(drcMix, 0, sizeof(drcMix));
+   for (uint32_t out = 0; out < 2; ++out) {
+      if (stream->channels == 1 || out == ch) {
+         tvMix[out].bus[0].volume = 0x8000;
+         drcMix[out].bus[0].volume = 0x8000;
+      }
+   }
+
+   ve.volume = 0x8000;
+   ve.delta = 0;
+
+   AXVoiceBegin(voice);
+   AXSetVoiceOffsets(voice, &offsets);
+   AXSetVoiceSrcType(voice, AX_VOICE_SRC_TYPE_LINEAR);
+   AXSetVoiceSrcRatio(voice, ratio);
+   AXSetVoiceDeviceMix(voice, AX_DEVICE_TYPE_TV, 0, tvMix);
+   AXSetVoiceDeviceMix(voice, AX_DEVICE_TYPE_DRC, 0, drcMix);
+   AXSetVoiceVe(voice, &ve);
+   AXSetVoiceState(voice, AX_VOICE_STATE_STOPPED);
+   AXVoiceEnd(voice);
+}
+
+WHBAudioStream *
+WHBAudioStreamCreate(uint32_t sampleRate,
+                     uint32_t channels,
+                     uint32_t ringFrames,
+                     uint32_t halfFrames)
+{
+   WHBAudioStream *stream;
+   uint32_t slot;
+   float ratio;
+
+   if (channels < 1 || channels > AUDIO_STREAM_MAX_CHANNELS || !halfFrames || !sampleRate) {
+      WHBLogPrintf("%s: invalid parameters", __FUNCTION__);
+      return NULL;
+   }
+
+   for (slot = 0; slot < WHB_AUDIO_STREAM_MAX; ++slot) {
+      if (!sStreams[slot]) {
+         break;
+      }
+   }
+
+   if (slot == WHB_AUDIO_STREAM_MAX) {
+      WHBLogPrintf("%s: too many streams", __FUNCTION__);
+      return NULL;
+   }
+
+   if (ringFrames < halfFrames * 2) {
+      ringFrames = halfFrames * 2;
+   }
+   ringFrames = 1u << (32 - __builtin_clz(ringFrames - 1));
+
+   stream = (WHBAudioStream *)MEMAllocFromDefaultHeap(sizeof(WHBAudioStream));
+   if (!stream) {
+      WHBLogPrintf("%s: failed to allocate stream", __FUNCTION__);
+      return NULL;
+   }
+
+   memset(stream, 0, sizeof(WHBAudioStream));
+   stream->channels = channels;
+   stream->halfFrames = halfFrames;
+   stream->ringFrames = ringFrames;
+   stream->state = AUDIO_STREAM_STOPPED;
+
+   stream->ring = (int16_t *)MEMAllocFromDefaultHeap(ringFrames * channels * sizeof(int16_t));
+   if (!stream->ring) {
+      WHBLogPrintf("%s: failed to allocate ring", __FUNCTION__);
+      AudioStreamFree(stream);
+      return NULL;
+   }
+
+   ratio = (float)sampleRate / (float)AXGetInputSamplesPerSec();
+   for (uint32_t ch = 0; ch < channels; ++ch) {
+      stream->voiceBuffers[ch] = (int16_t *)MEMAllocFromDefaultHeapEx(halfFrames * 2 * sizeof(int16_t), 0x40);
+      if (!stream->voiceBuffers[ch]) {
+         WHBLogPrintf("%s: failed to allocate voice buffer", __FUNCTION__);
+         AudioStreamFree(stream);
+         return NULL;
+      }
+
+      memset(stream->voiceBuffers[ch], 0, halfFrames * 2 * sizeof(int16_t));
+      DCFlushRange(stream->voiceBuffers[ch], halfFrames * 2 * sizeof(int16_t));
+
+      stream->voices[ch] = AXAcquireVoice(AUDIO_STREAM_PRIORITY, NULL, NULL);
+      if (!stream->voices[ch]) {
+         WHBLogPrintf("%s: AXAcquireVoice failed", __FUNCTION__);
+         AudioStreamFree(stream);
+         return NULL;
+      }
+
+      AudioStreamSetupVoice(stream, ch, ratio);
+   }
+
+   // Publish the stream to the callback only once it is complete
+   OSMemoryBarrier();
+   sStreams[slot] = stream;
+
+   if (!sCallbackRegistered) {
+      AXRegisterAppFrameCallback(AudioStreamFrameCallback);
+      sCallbackRegistered = TRUE;
+   }
+
+   return stream;
+}
+
+void
+WHBAudioStreamDestroy(WHBAudioStream *stream)
+{
+   BOOL empty = TRUE;
+
+   if (!stream) {
+      return;
+   }
+
+   for (uint32_t i = 0; i < WHB_AUDIO_STREAM_MAX; ++i) {
+      if (sStreams[i] == stream) {
+         sStreams[i] = NULL;
+      } else if (sStreams[i]) {
+         empty = FALSE;
+      }
+   }
+
+   AudioStreamWaitCallback();
+
+   if (empty && sCallbackRegistered) {
+      AXDeregisterAppFrameCallback(AudioStreamFrameCallback);
+      sCallbackRegistered = FALSE;
+   }
+
+   AudioStreamSetVoiceStates(stream, AX_VOICE_STATE_STOPPED);
+   AudioStreamFree(stream);
+}
+
+void
+WHBAudioStreamStart(WHBAudioStream *stream)
+{
+   if (stream->state != AUDIO_STREAM_STOPPED) {
+      return;
+   }
+
+   // The callback leaves stopped streams alone, so the ring can be read here
+   AudioStreamFillHalf(stream, 0);
+   AudioStreamFillHalf(stream, 1);
+   stream->playingHalf = 0;
+
+   for (uint32_t ch = 0; ch < stream->channels; ++ch) {
+      AXVoiceBegin(stream->voices[ch]);
+      AXSetVoiceCurrentOffset(stream->voices[ch], 0);
+      AXVoiceEnd(stream->voices[ch]);
+   }
+
+   OSMemoryBarrier();
+   stream->state = AUDIO_STREAM_START_PENDING;
+}
+
+void
+WHBAudioStreamStop(WHBAudioStream *stream)
+{
+   if (stream->state == AUDIO_STREAM_STOPPED) {
+      return;
+   }
+
+   stream->state = AUDIO_STREAM_STOP_PENDING;
+   AudioStreamWaitCallback();
+
+   // AX is not running callbacks, stop the voices directly
+   if (stream->state != AUDIO_STREAM_STOPPED) {
+      AudioStreamSetVoiceStates(stream, AX_VOICE_STATE_STOPPED);
+      stream->state = AUDIO_STREAM_STOPPED;
+   }
+}
+
+void
+WHBAudioStreamSetVolume(WHBAudioStream *stream,
+                        float volume)
+{
+   AXVoiceVeData ve;
+
+   if (volume < 0.0f) {
+      volume = 0.0f;
+   } else if (volume > 1.0f) {
+      volume = 1.0f;
+   }
+
+   ve.volume = (uint16_t)(volume * 0x8000);
+   ve.delta = 0;
+
+   for (uint32_t ch = 0; ch < stream->channels; ++ch) {
+      AXVoiceBegin(stream->voices[ch]);
+      AXSetVoiceVe(stream->voices[ch], &ve);
+      AXVoiceEnd(stream->voices[ch]);
+   }
+}
+
+uint32_t
+WHBAudioStreamGetFreeFrames(WHBAudioStream *stream)
+{
+   return stream->ringFrames - (stream->ringHead - stream->ringTail);
+}
+
+uint32_t
+WHBAudioStreamWrite(WHBAudioStream *stream,
+                    const int16_t *samples,
+                    uint32_t frames)
+{
+   uint32_t head = stream->ringHead;
+   uint32_t space = stream->ringFrames - (head - stream->ringTail);
+   uint32_t offset = head & (stream->ringFrames - 1);
+   uint32_t count = frames < space ? frames : space;
+   uint32_t first = count < stream->ringFrames - offset ? count : stream->ringFrames - offset;
+
+   // Don't overwrite frames until the consumer has finished reading them
+   OSMemoryBarrier();
+
+   memcpy(stream->ring + offset * stream->channels, samples,
+          first * stream->channels * sizeof(int16_t));
+   memcpy(stream->ring, samples + first * stream->channels,
+          (count - first) * stream->channels * sizeof(int16_t));
+
+   // Publish the frames only once they are written
+   OSMemoryBarrier();
+   stream->ringHead = head + count;
+
+   stream->stats.overruns += frames - count;
+   return count;
+}
+
+void
+WHBAudioStreamGetStats(WHBAudioStream *stream,
+                       WHBAudioStreamStats *outStats)
+{
+   *outStats = stream->stats;
+}
@@ -0,0 +1,224 @@
+#include "gfx_heap.h"
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/memdefaultheap.h>
+#include <gx2/mem.h>
+#include <string.h>
+#include <whb/camera.h>
+#include <whb/log.h>
+
+//! Set in sReady while the buffer there hasn't been acquired yet
+#define CAMERA_SLOT_FRESH 0x80000000
+#define CAMERA_SLOT_INDEX 0x0000000F
+
+//! GX2_TILE_MODE_LINEAR_ALIGNED, the layout GX2 samples directly
+#define CAMERA_SURFACE_TILE_MODE 1
+
+typedef struct CameraBuffer
+{
+   WHBCameraFrame frame;
+   CAMSurface surface;
+   uint8_t *image;
+} CameraBuffer;
+
+static CameraBuffer
+sBuffers[WHB_CAMERA_NUM_SURFACES];
+
+static CAMHandle
+sHandle = -1;
+
+static void *
+sWorkMemory = NULL;
+
+//! Buffer exchanged between the event handler and WHBCameraAcquireFrame
+static volatile uint32_t
+sReady = 1;
+
+//! Buffer held by the application
+static uint32_t
+sHeld = 2;
+
+static BOOL
+sHaveFrame = FALSE;
+
+static uint32_t
+sSequence = 0;
+
+//! Runs on the camera's thread whenever a surface has been filled
+static void
+CameraEventHandler(CAMEventData *event)
+{
+   uint32_t index, previous;
+
+   for (index = 0; index < WHB_CAMERA_NUM_SURFACES; ++index) {
+      if (sBuffers[index].image == event->img) {
+         break;
+      }
+   }
+
+   if (index == WHB_CAMERA_NUM_SURFACES) {
+      return;
+   }
+
+   if (event->err != CAMERA_ERROR_OK) {
+      // Try the same surface again
+      CAMSubmitTargetSurface(sHandle, &sBuffers[index].surface);
+      return;
+   }
+
+   sBuffers[index].frame.sequence = ++sSequence;
+   sBuffers[index].frame.time = OSGetTime();
+
+   // Publish the frame, and capture into whatever it replaces
+   OSMemoryBarrier();
+   previous = OSSwapAtomic(&sReady, index | CAMERA_SLOT_FRESH) & CAMERA_SLOT_INDEX;
+   CAMSubmitTargetSurface(sHandle, &sBuffers[previous].surface);
+}
+
+static void
+CameraFree()
+{
+   for (uint32_t i = 0; i < WHB_CAMERA_NUM_SURFACES; ++i) {
+      if (sBuffers[i].image) {
+         MEMFreeToDefaultHeap(sBuffers[i].image);
+      }
+   }
+
+   memset(sBuffers, 0, sizeof(sBuffers));
+
+   if (sWorkMemory) {
+      MEMFreeToDefaultHeap(sWorkMemory);
+      sWorkMemory = NULL;
+   }
+}
+
+BOOL
+WHBCameraInit(CamFps fps)
+{
+   CAMSetupInfo setup;
+   CAMError error;
+   int32_t memSize;
+
+   if (sHandle >= 0) {
+      return TRUE;
+   }
+
+   memset(&setup, 0, sizeof(setup));
+   setup.streamInfo.type = CAMERA_STREAM_TYPE_1;
+   setup.streamInfo.width = CAMERA_WIDTH;
+   setup.streamInfo.height = CAMERA_HEIGHT;
+
+   memSize = CAMGetMemReq(&setup.streamInfo);
+   if (memSize <= 0) {
+      WHBLogPrintf("%s: CAMGetMemReq failed with %d", __FUNCTION__, memSize);
+      return FALSE;
+   }
+
+   sWorkMemory = MEMAllocFromDefaultHeapEx(memSize, CAMERA_YUV_BUFFER_ALIGNMENT);
+   if (!sWorkMemory) {
+      WHBLogPrintf("%s: out of memory", __FUNCTION__);
+      return FALSE;
+   }
+
+   if (CAMCheckMemSegmentation(sWorkMemory, memSize) != CAMERA_ERROR_OK) {
+      WHBLogPrintf("%s: work memory rejected", __FUNCTION__);
+      goto error;
+   }
+
+   for (uint32_t i = 0; i < WHB_CAMERA_NUM_SURFACES; ++i) {
+      CameraBuffer *buffer = &sBuffers[i];
+
+      buffer->image = (uint8_t *)MEMAllocFromDefaultHeapEx(CAMERA_YUV_BUFFER_SIZE,
+                                                           CAMERA_YUV_BUFFER_ALIGNMENT);
+      if (!buffer->image) {
+         WHBLogPrintf("%s: out of memory for surfaces", __FUNCTION__);
+         goto error;
+      }
+
+      buffer->surface.surfaceSize = CAMERA_YUV_BUFFER_SIZE;
+      buffer->surface.surfaceBuffer = buffer->image;
+      buffer->surface.width = CAMERA_WIDTH;
+      buffer->surface.height = CAMERA_HEIGHT;
+      buffer->surface.unk_0x10 = CAMERA_PITCH;
+      buffer->surface.alignment = CAMERA_YUV_BUFFER_ALIGNMENT;
+      buffer->surface.unk_0x18 = CAMERA_SURFACE_TILE_MODE;
+
+      // NV12, the chroma plane follows the luma plane
+      GfxInitLinearTexture(&buffer->frame.luma, GX2_SURFACE_FORMAT_UNORM_R8,
+                           CAMERA_WIDTH, CAMERA_HEIGHT, CAMERA_PITCH,
+                           buffer->image, GFX_COMP_MAP_R001);
+      GfxInitLinearTexture(&buffer->frame.chroma, GX2_SURFACE_FORMAT_UNORM_R8_G8,
+                           CAMERA_WIDTH / 2, CAMERA_HEIGHT / 2, CAMERA_PITCH / 2,
+                           buffer->image + CAMERA_Y_BUFFER_SIZE, GFX_COMP_MAP_RG01);
+
+      // The camera writes with DMA, nothing cached may be written over it
+      DCFlushRange(buffer->image, CAMERA_YUV_BUFFER_SIZE);
+   }
+
+   setup.workMem.size = memSize;
+   setup.workMem.pMem = sWorkMemory;
+   setup.eventHandler = CameraEventHandler;
+   setup.mode.fps = fps;
+   setup.threadAffinity = OS_THREAD_ATTRIB_AFFINITY_CPU1;
+
+   sReady = 1;
+   sHeld = 2;
+   sHaveFrame = FALSE;
+   sSequence = 0;
+
+   sHandle = CAMInit(0, &setup, &error);
+   if (sHandle < 0 || error != CAMERA_ERROR_OK) {
+      WHBLogPrintf("%s: CAMInit failed with %d", __FUNCTION__, error);
+      sHandle = -1;
+      goto error;
+   }
+
+   error = CAMOpen(sHandle);
+   if (error != CAMERA_ERROR_OK) {
+      WHBLogPrintf("%s: CAMOpen failed with %d", __FUNCTION__, error);
+      CAMExit(sHandle);
+      sHandle = -1;
+      goto error;
+   }
+
+   // The other two start out in the slot and with the application
+   CAMSubmitTargetSurface(sHandle, &sBuffers[0].surface);
+   return TRUE;
+
+error:
+   CameraFree();
+   return FALSE;
+}
+
+void
+WHBCameraShutdown()
+{
+   if (sHandle < 0) {
+      return;
+   }
+
+   CAMClose(sHandle);
+   CAMExit(sHandle);
+   sHandle = -1;
+   CameraFree();
+}
+
+const WHBCameraFrame *
+WHBCameraAcquireFrame()
+{
+   if (sHandle < 0) {
+      return NULL;
+   }
+
+   if (sReady & CAMERA_SLOT_FRESH) {
+      // Hand back the held buffer and take the newest frame in one go
+      sHeld = OSSwapAtomic(&sReady, sHeld) & CAMERA_SLOT_INDEX;
+      sHaveFrame = TRUE;
+      OSMemoryBarrier();
+
+      GX2Invalidate(GX2_INVALIDATE_MODE_TEXTURE, sBuffers[sHeld].image,
+                    CAMERA_YUV_BUFFER_SIZE);
+   }
+
+   return sHaveFrame ? &sBuffers[sHeld].frame : NULL;
+}
@@ -1,47 +1,87 @@
 #include <whb/log.h>
 #include <whb/log_console.h>
 
+#include <coreinit/atomic.h>
 #include <coreinit/memheap.h>
 #include <coreinit/cache.h>
+#include <coreinit/memdefaultheap.h>
 #include <coreinit/memfrmheap.h>
 #include <coreinit/memory.h>
 #include <coreinit/screen.h>
 #include <proc_ui/procui.h>
 
 #include <string.h>
+#include <sys/param.h>
 
 #define NUM_LINES (16)
 #define LINE_LENGTH (128)
 #define CONSOLE_FRAME_HEAP_TAG (0x000DECAF)
 
-static char sConsoleBuffer[NUM_LINES][LINE_LENGTH];
-static int sLineNum = 0;
+// OSScreen is double buffered, so a change has to be drawn into both buffers
+#define CONSOLE_NUM_SCREEN_BUFFERS (2)
+
+typedef struct
+{
+   //! Ticket + 1 of the line written here, 0 while it is being written.
+   volatile uint32_t seq;
+   char text[LINE_LENGTH];
+} ConsoleLine;
+
+static ConsoleLine sDefaultLines[NUM_LINES];
+static ConsoleLine *sLines = sDefaultLines;
+static uint32_t sNumLines = NUM_LINES;
+static uint32_t sScrollback = NUM_LINES;
+static volatile uint32_t sWriteCount = 0;
+static uint32_t sScrollOffset = 0;
+static volatile int sConsoleDirty = CONSOLE_NUM_SCREEN_BUFFERS;
 static void *sBufferTV = NULL, *sBufferDRC = NULL;
 static uint32_t sBufferSizeTV = 0, sBufferSizeDRC = 0;
 static BOOL sConsoleHasForeground = TRUE;
 static uint32_t consoleColor = 0x993333FF;
+static WHBLogConsoleOverlayFn sOverlay = NULL;
+static void *sOverlayContext = NULL;
 
 static void
 ConsoleAddLine(const char *line)
 {
    int length = strlen(line);
+   uint32_t ticket;
+   ConsoleLine *slot;
 
    if (length >= LINE_LENGTH) {
       length = LINE_LENGTH - 1;
    }
 
-   if (sLineNum == NUM_LINES) {
-      for (int i = 0; i < NUM_LINES - 1; ++i) {
-         memcpy(sConsoleBuffer[i], sConsoleBuffer[i + 1], LINE_LENGTH);
-      }
+   // Every writer claims its own slot, the oldest line is overwritten
+   ticket = (uint32_t)OSAddAtomic((volatile int32_t *)&sWriteCount, 1);
+   slot = &sLines[ticket % sNumLines];
+
+   slot->seq = 0;
+   OSMemoryBarrier();
+   memcpy(slot->text, line, length);
+   slot->text[length] = 0;
+   OSMemoryBarrier();
+   slot->seq = ticket + 1;
+
+   sConsoleDirty = CONSOLE_NUM_SCREEN_BUFFERS;
+}
 
-      memcpy(sConsoleBuffer[sLineNum - 1], line, length);
-      sConsoleBuffer[sLineNum - 1][length] = 0;
-   } else {
-      memcpy(sConsoleBuffer[sLineNum], line, length);
-      sConsoleBuffer[sLineNum][length] = 0;
-      ++sLineNum;
+static BOOL
+ConsoleReadLine(uint32_t ticket,
+                char *text)
+{
+   ConsoleLine *slot = &sLines[ticket % sNumLines];
+
+   // Skip lines that are being written or were already overwritten
+   if (slot->seq != ticket + 1) {
+      return FALSE;
    }
+
+   OSMemoryBarrier();
+   memcpy(text, slot->text, LINE_LENGTH);
+   text[LINE_LENGTH - 1] = 0;
+   OSMemoryBarrier();
+   return slot->seq == ticket + 1;
 }
 
 static uint32_t
@@ -59,6 +99,7 @@ ConsoleProcCallbackAcquired(void *context)
    }
 
    sConsoleHasForeground = TRUE;
+   sConsoleDirty = CONSOLE_NUM_SCREEN_BUFFERS;
    OSScreenSetBufferEx(SCREEN_TV, sBufferTV);
    OSScreenSetBufferEx(SCREEN_DRC, sBufferDRC);
    return 0;
@@ -73,9 +114,35 @@ ConsoleProcCallbackReleased(void *context)
    return 0;
 }
 
+BOOL
+WHBLogConsoleSetScrollback(uint32_t lines)
+{
+   if (sLines != sDefaultLines || lines < NUM_LINES) {
+      return FALSE;
+   }
+
+   sScrollback = lines;
+   return TRUE;
+}
+
 BOOL
 WHBLogConsoleInit()
 {
+   // All lines live in one allocation, the static lines are the fallback
+   if (sScrollback > NUM_LINES) {
+      ConsoleLine *lines = MEMAllocFromDefaultHeapEx(sScrollback * sizeof(ConsoleLine), 4);
+      if (lines) {
+         memset(lines, 0, sScrollback * sizeof(ConsoleLine));
+         sLines = lines;
+         sNumLines = sScrollback;
+      } else {
+         WHBLogPrintf("%s: failed to allocate %u lines of scrollback",
+                      __FUNCTION__, sScrollback);
+      }
+   }
+
+   sWriteCount = 0;
+   sScrollOffset = 0;
    OSScreenInit();
    sBufferSizeTV = OSScreenGetBufferSizeEx(SCREEN_TV);
    sBufferSizeDRC = OSScreenGetBufferSizeEx(SCREEN_DRC);
@@ -97,12 +164,48 @@ WHBLogConsoleFree()
       OSScreenShutdown();
       ConsoleProcCallbackReleased(NULL);
    }
+
+   WHBRemoveLogHandler(ConsoleAddLine);
+
+   if (sLines != sDefaultLines) {
+      MEMFreeToDefaultHeap(sLines);
+      sLines = sDefaultLines;
+      sNumLines = NUM_LINES;
+   }
+
+   memset(sDefaultLines, 0, sizeof(sDefaultLines));
 }
 
 void
 WHBLogConsoleSetColor(uint32_t color)
 {
    consoleColor = color;
+   sConsoleDirty = CONSOLE_NUM_SCREEN_BUFFERS;
+}
+
+void
+WHBLogConsoleScroll(int32_t lines)
+{
+   int64_t offset = (int64_t)sScrollOffset + lines;
+   uint32_t available = MIN(sWriteCount, sNumLines);
+   uint32_t maxOffset = (available > NUM_LINES) ? available - NUM_LINES : 0;
+
+   if (lines == 0) {
+      offset = 0;
+   }
+
+   sScrollOffset = (offset < 0) ? 0 : MIN((uint64_t)offset, maxOffset);
+   sConsoleDirty = CONSOLE_NUM_SCREEN_BUFFERS;
+}
+
+void
+WHBLogConsoleSetOverlay(WHBLogConsoleOverlayFn overlay,
+                        void *context)
+{
+   sOverlay = NULL;
+   sOverlayContext = context;
+   sOverlay = overlay;
+   sConsoleDirty = CONSOLE_NUM_SCREEN_BUFFERS;
 }
 
 void
@@ -112,12 +215,33 @@ WHBLogConsoleDraw()
       return;
    }
 
+   // Both screen buffers already show the current lines, an overlay is
+   // redrawn every frame
+   if (!sConsoleDirty && !sOverlay) {
+      return;
+   }
+
+   if (sConsoleDirty) {
+      --sConsoleDirty;
+   }
+
    OSScreenClearBufferEx(SCREEN_TV, consoleColor);
    OSScreenClearBufferEx(SCREEN_DRC, consoleColor);
 
-   for (int y = 0; y < NUM_LINES; ++y) {
-      OSScreenPutFontEx(SCREEN_TV, 0, y, sConsoleBuffer[y]);
-      OSScreenPutFontEx(SCREEN_DRC, 0, y, sConsoleBuffer[y]);
+   uint32_t overlayRows = sOverlay ? MIN(sOverlay(sOverlayContext), NUM_LINES) : 0;
+   uint32_t numLines = NUM_LINES - overlayRows;
+
+   // Show the numLines lines ending sScrollOffset lines before the newest
+   uint32_t end = sWriteCount;
+   end = (end > sScrollOffset) ? end - sScrollOffset : 0;
+   uint32_t start = (end > numLines) ? end - numLines : 0;
+
+   for (uint32_t ticket = start; ticket < end; ++ticket) {
+      char line[LINE_LENGTH];
+      if (ConsoleReadLine(ticket, line)) {
+         OSScreenPutFontEx(SCREEN_TV, 0, overlayRows + ticket - start, line);
+         OSScreenPutFontEx(SCREEN_DRC, 0, overlayRows + ticket - start, line);
+      }
    }
 
    DCFlushRange(sBufferTV, sBufferSizeTV);
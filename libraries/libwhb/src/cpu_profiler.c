@@ -0,0 +1,365 @@
+#include <coreinit/alarm.h>
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/context.h>
+#include <coreinit/core.h>
+#include <coreinit/debug.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <whb/cpu_profiler.h>
+#include <whb/log.h>
+
+#define PROFILER_NUM_CORES        3
+#define PROFILER_RING_SIZE        1024
+#define PROFILER_RING_MASK        (PROFILER_RING_SIZE - 1)
+#define PROFILER_HASH_SIZE        (WHB_CPU_PROFILER_MAX_STACKS * 2)
+#define PROFILER_SETUP_STACK_SIZE (4096)
+#define PROFILER_SYMBOL_SIZE      (128)
+
+typedef struct ProfilerSample
+{
+   uint32_t depth;
+   uint32_t frames[WHB_CPU_PROFILER_MAX_DEPTH];
+} ProfilerSample;
+
+//! Written by the alarm on its core, read by WHBCpuProfilerUpdate
+typedef struct WUT_ALIGNAS(0x40) ProfilerRing
+{
+   volatile uint32_t head;
+   volatile uint32_t tail;
+   ProfilerSample samples[PROFILER_RING_SIZE];
+} ProfilerRing;
+
+typedef struct ProfilerStack
+{
+   uint32_t hash;
+   uint32_t count;
+   ProfilerSample sample;
+} ProfilerStack;
+
+static ProfilerRing *
+sRings = NULL;
+
+static ProfilerStack *
+sStacks = NULL;
+
+static uint32_t
+sNumStacks = 0;
+
+//! Index + 1 into sStacks, 0 for an empty bucket
+static uint16_t *
+sHashTable = NULL;
+
+static volatile uint32_t
+sDropped = 0;
+
+static OSAlarm
+sAlarms[PROFILER_NUM_CORES];
+
+static BOOL
+sAlarmSet[PROFILER_NUM_CORES];
+
+static OSTime
+sInterval;
+
+static OSThread
+sSetupThread;
+
+static uint8_t
+sSetupThreadStack[PROFILER_SETUP_STACK_SIZE] __attribute__((aligned(16)));
+
+static void
+ProfilerAlarmCallback(OSAlarm *alarm,
+                      OSContext *context)
+{
+   ProfilerRing *ring = &sRings[OSGetCoreId()];
+   OSThread *thread = OSGetCurrentThread();
+   ProfilerSample *sample;
+   uint32_t head = ring->head;
+   uint32_t *stackPtr, *stackEnd = NULL, *stackStart = NULL;
+
+   if (head - ring->tail >= PROFILER_RING_SIZE) {
+      OSAddAtomic((volatile int32_t *)&sDropped, 1);
+      return;
+   }
+
+   sample = &ring->samples[head & PROFILER_RING_MASK];
+   sample->frames[0] = context->srr0;
+   sample->frames[1] = context->lr;
+   sample->depth = 2;
+
+   // Only follow the back chain within the interrupted thread's stack, a
+   // bad pointer here would fault inside the alarm interrupt
+   if (thread) {
+      stackStart = (uint32_t *)thread->stackStart;
+      stackEnd = (uint32_t *)thread->stackEnd;
+   }
+
+   stackPtr = (uint32_t *)context->gpr[1];
+   while (stackStart && sample->depth < WHB_CPU_PROFILER_MAX_DEPTH) {
+      uint32_t *next;
+
+      if (stackPtr < stackEnd || stackPtr + 2 > stackStart
+       || ((uintptr_t)stackPtr & 3)) {
+         break;
+      }
+
+      next = (uint32_t *)stackPtr[0];
+      if (next <= stackPtr || next + 2 > stackStart) {
+         break;
+      }
+
+      // The LR save word of the caller's frame holds the return address
+      if (next[1] && next[1] != sample->frames[sample->depth - 1]) {
+         sample->frames[sample->depth++] = next[1];
+      }
+
+      stackPtr = next;
+   }
+
+   OSMemoryBarrier();
+   ring->head = head + 1;
+}
+
+static int
+ProfilerSetupThreadEntry(int argc,
+                         const char **argv)
+{
+   uint32_t core = OSGetCoreId();
+
+   // Alarms fire on the core they were set from
+   OSCreateAlarm(&sAlarms[core]);
+   sAlarmSet[core] = OSSetPeriodicAlarm(&sAlarms[core], sInterval, sInterval,
+                                        ProfilerAlarmCallback);
+   return 0;
+}
+
+static uint32_t
+ProfilerHashSample(const ProfilerSample *sample)
+{
+   uint32_t hash = 2166136261u;
+   uint32_t i;
+
+   for (i = 0; i < sample->depth; ++i) {
+      hash = (hash ^ sample->frames[i]) * 16777619u;
+   }
+
+   return hash;
+}
+
+static void
+ProfilerAddSample(const ProfilerSample *sample)
+{
+   uint32_t hash = ProfilerHashSample(sample);
+   uint32_t bucket = hash % PROFILER_HASH_SIZE;
+
+   while (sHashTable[bucket]) {
+      ProfilerStack *stack = &sStacks[sHashTable[bucket] - 1];
+      if (stack->hash == hash && stack->sample.depth == sample->depth
+       && !memcmp(stack->sample.frames, sample->frames,
+                  sample->depth * sizeof(uint32_t))) {
+         stack->count++;
+         return;
+      }
+
+      bucket = (bucket + 1) % PROFILER_HASH_SIZE;
+   }
+
+   if (sNumStacks == WHB_CPU_PROFILER_MAX_STACKS) {
+      sDropped++;
+      return;
+   }
+
+   sStacks[sNumStacks].hash = hash;
+   sStacks[sNumStacks].count = 1;
+   sStacks[sNumStacks].sample = *sample;
+   sHashTable[bucket] = ++sNumStacks;
+}
+
+BOOL
+WHBCpuProfilerInit(uint32_t intervalUs)
+{
+   uint32_t core;
+
+   if (sRings) {
+      return TRUE;
+   }
+
+   sRings = MEMAllocFromDefaultHeapEx(sizeof(ProfilerRing) * PROFILER_NUM_CORES, 0x40);
+   sStacks = MEMAllocFromDefaultHeap(sizeof(ProfilerStack) * WHB_CPU_PROFILER_MAX_STACKS);
+   sHashTable = MEMAllocFromDefaultHeap(sizeof(uint16_t) * PROFILER_HASH_SIZE);
+   if (!sRings || !sStacks || !sHashTable) {
+      WHBLogPrintf("%s: failed to allocate the sample buffers", __FUNCTION__);
+      WHBCpuProfilerShutdown();
+      return FALSE;
+   }
+
+   memset(sRings, 0, sizeof(ProfilerRing) * PROFILER_NUM_CORES);
+   WHBCpuProfilerReset();
+
+   sInterval = OSMicrosecondsToTicks(intervalUs ? intervalUs : 1000);
+   for (core = 0; core < PROFILER_NUM_CORES; ++core) {
+      if (!OSCreateThread(&sSetupThread,
+                          ProfilerSetupThreadEntry,
+                          0,
+                          NULL,
+                          sSetupThreadStack + sizeof(sSetupThreadStack),
+                          sizeof(sSetupThreadStack),
+                          0,
+                          OS_THREAD_ATTRIB_AFFINITY_CPU0 << core)) {
+         WHBLogPrintf("%s: OSCreateThread failed for core %u", __FUNCTION__, core);
+         continue;
+      }
+
+      OSResumeThread(&sSetupThread);
+      OSJoinThread(&sSetupThread, NULL);
+   }
+
+   return TRUE;
+}
+
+void
+WHBCpuProfilerShutdown()
+{
+   uint32_t core;
+
+   for (core = 0; core < PROFILER_NUM_CORES; ++core) {
+      if (sAlarmSet[core]) {
+         OSCancelAlarm(&sAlarms[core]);
+         sAlarmSet[core] = FALSE;
+      }
+   }
+
+   if (sRings) {
+      MEMFreeToDefaultHeap(sRings);
+      sRings = NULL;
+   }
+
+   if (sStacks) {
+      MEMFreeToDefaultHeap(sStacks);
+      sStacks = NULL;
+   }
+
+   if (sHashTable) {
+      MEMFreeToDefaultHeap(sHashTable);
+      sHashTable = NULL;
+   }
+}
+
+void
+WHBCpuProfilerUpdate()
+{
+   uint32_t core;
+
+   if (!sRings) {
+      return;
+   }
+
+   for (core = 0; core < PROFILER_NUM_CORES; ++core) {
+      ProfilerRing *ring = &sRings[core];
+      uint32_t head = ring->head;
+      uint32_t tail = ring->tail;
+
+      OSMemoryBarrier();
+      while (tail != head) {
+         ProfilerAddSample(&ring->samples[tail & PROFILER_RING_MASK]);
+         ++tail;
+      }
+
+      OSMemoryBarrier();
+      ring->tail = tail;
+   }
+}
+
+void
+WHBCpuProfilerReset()
+{
+   uint32_t core;
+
+   if (!sStacks) {
+      return;
+   }
+
+   for (core = 0; core < PROFILER_NUM_CORES; ++core) {
+      sRings[core].tail = sRings[core].head;
+   }
+
+   sNumStacks = 0;
+   sDropped = 0;
+   memset(sHashTable, 0, sizeof(uint16_t) * PROFILER_HASH_SIZE);
+}
+
+uint32_t
+WHBCpuProfilerGetDroppedSamples()
+{
+   return sDropped;
+}
+
+static uint32_t
+ProfilerFormatStack(const ProfilerStack *stack,
+                    char *buffer,
+                    uint32_t size)
+{
+   char name[PROFILER_SYMBOL_SIZE];
+   uint32_t length = 0;
+   int i;
+
+   // Folded stacks go from the root to the leaf
+   for (i = (int)stack->sample.depth - 1; i >= 0 && length < size; --i) {
+      uint32_t addr = stack->sample.frames[i];
+
+      if (!OSGetSymbolName(addr, name, sizeof(name))) {
+         snprintf(name, sizeof(name), "0x%08x", addr);
+      }
+
+      length += snprintf(buffer + length, size - length, "%s%s",
+                         (i == (int)stack->sample.depth - 1) ? "" : ";", name);
+   }
+
+   if (length < size) {
+      length += snprintf(buffer + length, size - length, " %u", stack->count);
+   }
+
+   return (length < size) ? length : size - 1;
+}
+
+BOOL
+WHBCpuProfilerWriteFolded(const char *path)
+{
+   char line[WHB_CPU_PROFILER_MAX_DEPTH * PROFILER_SYMBOL_SIZE];
+   uint32_t i;
+   FILE *file;
+
+   WHBCpuProfilerUpdate();
+
+   file = fopen(path, "w");
+   if (!file) {
+      WHBLogPrintf("%s: could not open %s", __FUNCTION__, path);
+      return FALSE;
+   }
+
+   for (i = 0; i < sNumStacks; ++i) {
+      ProfilerFormatStack(&sStacks[i], line, sizeof(line));
+      fprintf(file, "%s\n", line);
+   }
+
+   fclose(file);
+   return TRUE;
+}
+
+void
+WHBCpuProfilerLogFolded()
+{
+   char line[WHB_CPU_PROFILER_MAX_DEPTH * PROFILER_SYMBOL_SIZE];
+   uint32_t i;
+
+   WHBCpuProfilerUpdate();
+
+   for (i = 0; i < sNumStacks; ++i) {
+      ProfilerFormatStack(&sStacks[i], line, sizeof(line));
+      WHBLogPrint(line);
+   }
+}
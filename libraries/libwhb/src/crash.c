@@ -1,13 +1,19 @@
+#include "crash_stack.h"
 #include <whb/crash.h>
 #include <coreinit/core.h>
 #include <coreinit/debug.h>
 #include <coreinit/exception.h>
+#include <coreinit/dynload.h>
 #include <coreinit/internal.h>
+#include <coreinit/memorymap.h>
 #include <coreinit/systeminfo.h>
 #include <coreinit/thread.h>
 #include <coreinit/time.h>
 #include <stdarg.h>
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include <whb/log.h>
 
 #define LOG_DISASSEMBLY_SIZE (4096)
@@ -16,6 +22,14 @@
 
 #define THREAD_STACK_SIZE (4096)
 
+#define CRASH_DUMP_PATH_SIZE (256)
+#define CRASH_DUMP_WRITE_ALIGNMENT (0x40)
+#define CRASH_DUMP_BUFFER_SIZE \
+   ((sizeof(WHBCrashDumpHeader) + sizeof(OSContext) \
+     + sizeof(WHBCrashDumpRPL) * WHB_CRASH_DUMP_MAX_RPLS \
+     + WHB_CRASH_DUMP_MAX_STACK + WHB_CRASH_DUMP_CODE_SIZE \
+     + CRASH_DUMP_WRITE_ALIGNMENT - 1) & ~(CRASH_DUMP_WRITE_ALIGNMENT - 1))
+
 static const char *
 sCrashType = NULL;
 
@@ -37,24 +51,170 @@ sRegistersBuffer[LOG_REGISTER_SIZE];
 static uint32_t
 sRegistersLength = 0;
 
+static char
+sCrashDumpPath[CRASH_DUMP_PATH_SIZE];
+
+static uint8_t
+sCrashDump[CRASH_DUMP_BUFFER_SIZE] __attribute__((aligned(CRASH_DUMP_WRITE_ALIGNMENT)));
+
+static uint32_t
+sCrashDumpSize = 0;
+
+static OSDynLoad_NotifyData
+sCrashDumpRPLInfo[WHB_CRASH_DUMP_MAX_RPLS];
+
 static uint8_t
 sCrashThreadStack[THREAD_STACK_SIZE];
 
 static OSThread __attribute__((aligned(8)))
 sCrashThread;
 
+//! Defined in log_file.c, only linked in when the file log is used
+void
+__whb_log_file_flush() __attribute__((weak));
+
+static void
+writeCrashDump()
+{
+   uint32_t size;
+   int fd;
+
+   if (!sCrashDumpSize) {
+      return;
+   }
+
+   // The buffer is padded to the write alignment, the header has the size
+   size = (sCrashDumpSize + CRASH_DUMP_WRITE_ALIGNMENT - 1)
+        & ~(CRASH_DUMP_WRITE_ALIGNMENT - 1);
+
+   fd = open(sCrashDumpPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (fd < 0) {
+      WHBLogPrintf("%s: could not open %s", __FUNCTION__, sCrashDumpPath);
+      return;
+   }
+
+   if (write(fd, sCrashDump, size) != (ssize_t)size) {
+      WHBLogPrintf("%s: could not write %s", __FUNCTION__, sCrashDumpPath);
+   }
+
+   close(fd);
+}
+
 static int
 crashReportThread(int argc, const char **argv)
 {
+   // Save the dump before logging, the log handlers are more likely to
+   // depend on state the crash broke
+   writeCrashDump();
+
    // Log crash dump
    WHBLogPrint(sRegistersBuffer);
    WHBLogPrint(sDisassemblyBuffer);
    WHBLogPrint(sStackTraceBuffer);
 
-   // TODO: Save crash dump to SD card?
+   // The file log buffers what was just logged, get it to the file before
+   // the process is killed
+   if (__whb_log_file_flush) {
+      __whb_log_file_flush();
+   }
+
    return 0;
 }
 
+static BOOL
+isRangeValid(uint32_t addr,
+             uint32_t size)
+{
+   return size && OSIsAddressValid(addr) && OSIsAddressValid(addr + size - 1);
+}
+
+static void
+getCrashDump(const char *type,
+             OSContext *context)
+{
+   WHBCrashDumpHeader *header = (WHBCrashDumpHeader *)sCrashDump;
+   OSThread *thread = (OSThread *)context;
+   uint32_t offset = sizeof(WHBCrashDumpHeader);
+   int32_t numRPLs;
+   int32_t i;
+
+   sCrashDumpSize = 0;
+   if (!sCrashDumpPath[0]) {
+      return;
+   }
+
+   memset(header, 0, sizeof(WHBCrashDumpHeader));
+   header->magic = WHB_CRASH_DUMP_MAGIC;
+   strncpy(header->type, type, sizeof(header->type) - 1);
+   header->coreId = OSGetCoreId();
+   header->upid = OSGetUPID();
+   header->time = OSGetSystemTime();
+   header->thread = (uint32_t)thread;
+
+   header->contextOffset = offset;
+   memcpy(sCrashDump + offset, context, sizeof(OSContext));
+   offset += sizeof(OSContext);
+
+   // Only available on debug CafeOS, the dump just has no RPLs otherwise
+   header->rplOffset = offset;
+   numRPLs = OSDynLoad_GetNumberOfRPLs();
+   if (numRPLs > WHB_CRASH_DUMP_MAX_RPLS) {
+      numRPLs = WHB_CRASH_DUMP_MAX_RPLS;
+   }
+
+   if (numRPLs > 0 && OSDynLoad_GetRPLInfo(0, numRPLs, sCrashDumpRPLInfo)) {
+      for (i = 0; i < numRPLs; ++i) {
+         OSDynLoad_NotifyData *info = &sCrashDumpRPLInfo[i];
+         WHBCrashDumpRPL *rpl = (WHBCrashDumpRPL *)(sCrashDump + offset);
+
+         memset(rpl, 0, sizeof(WHBCrashDumpRPL));
+         rpl->textAddr = info->textAddr;
+         rpl->textSize = info->textSize;
+         rpl->dataAddr = info->dataAddr;
+         rpl->dataSize = info->dataSize;
+         rpl->readAddr = info->readAddr;
+         rpl->readSize = info->readSize;
+         if (info->name && OSIsAddressValid((uint32_t)info->name)) {
+            strncpy(rpl->name, info->name, sizeof(rpl->name) - 1);
+         }
+
+         offset += sizeof(WHBCrashDumpRPL);
+         header->rplCount++;
+      }
+   }
+
+   // Copy the stack from the stack pointer up, if it is within the thread's
+   // own stack
+   header->stackOffset = offset;
+   header->stackAddr = context->gpr[1];
+   if (thread->tag == OS_THREAD_TAG
+    && context->gpr[1] >= (uint32_t)thread->stackEnd
+    && context->gpr[1] < (uint32_t)thread->stackStart) {
+      header->stackSize = (uint32_t)thread->stackStart - context->gpr[1];
+      if (header->stackSize > WHB_CRASH_DUMP_MAX_STACK) {
+         header->stackSize = WHB_CRASH_DUMP_MAX_STACK;
+      }
+
+      if (isRangeValid(header->stackAddr, header->stackSize)) {
+         memcpy(sCrashDump + offset, (void *)header->stackAddr, header->stackSize);
+         offset += header->stackSize;
+      } else {
+         header->stackSize = 0;
+      }
+   }
+
+   header->codeOffset = offset;
+   header->codeAddr = (context->srr0 & ~3) - WHB_CRASH_DUMP_CODE_SIZE / 2;
+   if (isRangeValid(header->codeAddr, WHB_CRASH_DUMP_CODE_SIZE)) {
+      header->codeSize = WHB_CRASH_DUMP_CODE_SIZE;
+      memcpy(sCrashDump + offset, (void *)header->codeAddr, header->codeSize);
+      offset += header->codeSize;
+   }
+
+   header->size = offset;
+   sCrashDumpSize = offset;
+}
+
 static void
 disassemblyPrintCallback(const char* fmt, ...)
 {
@@ -84,26 +244,21 @@ getDisassembly(OSContext *context)
 static void
 getStackTrace(OSContext *context)
 {
-   int i;
-   uint32_t *stackPtr;
+   uint32_t *frames[16];
+   uint32_t depth, i;
    char name[256];
 
    sStackTraceLength = 0;
    sStackTraceBuffer[0] = 0;
-   stackPtr = (uint32_t *)context->gpr[1];
 
    sStackTraceLength += sprintf(sStackTraceBuffer + sStackTraceLength,
                                 "Address:      Back Chain    LR Save\n");
 
-   for (i = 0; i < 16; ++i) {
+   depth = CrashWalkStack(context, frames, 16);
+   for (i = 0; i < depth; ++i) {
+      uint32_t *stackPtr = frames[i];
       uint32_t addr;
 
-      if (!stackPtr ||
-          (uintptr_t)stackPtr == 0x1 ||
-          (uintptr_t)stackPtr == 0xFFFFFFFF) {
-         break;
-      }
-
       sStackTraceLength += sprintf(sStackTraceBuffer + sStackTraceLength,
                                    "0x%08x:   0x%08x    0x%08x",
                                    (uintptr_t)stackPtr,
@@ -118,7 +273,6 @@ getStackTrace(OSContext *context)
       }
 
       sStackTraceLength += sprintf(sStackTraceBuffer + sStackTraceLength, "\n");
-      stackPtr = (uint32_t *)*stackPtr;
    }
 
    sStackTraceBuffer[sStackTraceLength] = 0;
@@ -218,6 +372,7 @@ handleException(const char *type,
                 OSContext *context)
 {
    sCrashType = type;
+   getCrashDump(type, context);
    getDisassembly(context);
    getStackTrace(context);
    getRegisters(context);
@@ -273,3 +428,15 @@ WHBInitCrashHandler()
                             OS_EXCEPTION_TYPE_PROGRAM, handleProgram);
    return TRUE;
 }
+
+void
+WHBSetCrashDumpPath(const char *path)
+{
+   if (!path) {
+      sCrashDumpPath[0] = 0;
+      return;
+   }
+
+   strncpy(sCrashDumpPath, path, sizeof(sCrashDumpPath) - 1);
+   sCrashDumpPath[sizeof(sCrashDumpPath) - 1] = 0;
+}
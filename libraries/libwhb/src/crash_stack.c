@@ -0,0 +1,27 @@
+#include "crash_stack.h"
+#include <coreinit/memorymap.h>
+
+uint32_t
+CrashWalkStack(const OSContext *context,
+               uint32_t **outFrames,
+               uint32_t maxFrames)
+{
+   uint32_t *stackPtr = (uint32_t *)context->gpr[1];
+   uint32_t depth = 0;
+
+   while (depth < maxFrames) {
+      if (!stackPtr ||
+          (uintptr_t)stackPtr == 0x1 ||
+          (uintptr_t)stackPtr == 0xFFFFFFFF ||
+          ((uintptr_t)stackPtr & 3) ||
+          !OSIsAddressValid((uint32_t)stackPtr) ||
+          !OSIsAddressValid((uint32_t)stackPtr + 7)) {
+         break;
+      }
+
+      outFrames[depth++] = stackPtr;
+      stackPtr = (uint32_t *)*stackPtr;
+   }
+
+   return depth;
+}
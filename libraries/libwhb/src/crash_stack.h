@@ -0,0 +1,11 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/context.h>
+
+//! Follow the back chain from the stack pointer in context, writing the
+//! address of up to maxFrames stack frames innermost first. Stops at the
+//! first frame that isn't mapped, so it is safe from an interrupt.
+uint32_t
+CrashWalkStack(const OSContext *context,
+               uint32_t **outFrames,
+               uint32_t maxFrames);
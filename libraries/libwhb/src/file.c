@@ -1,8 +1,13 @@
+#include "../../wutthreadstats/wut_thread_stats.h"
+
 #include <coreinit/memdefaultheap.h>
 #include <coreinit/filesystem.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/thread.h>
 #include <string.h>
 #include <whb/file.h>
 #include <whb/log.h>
+#include <wut_thread_stats.h>
 
 static BOOL
 sInitialised = FALSE;
@@ -10,6 +15,27 @@ sInitialised = FALSE;
 static FSClient
 sClient;
 
+#define WHB_FILE_LOADER_STACK_SIZE (16 * 1024)
+#define WHB_FILE_LOADER_QUEUE_SIZE 32
+
+static OSThread
+sLoaderThread;
+
+static uint8_t
+sLoaderThreadStack[WHB_FILE_LOADER_STACK_SIZE] __attribute__((aligned(16)));
+
+static OSMessageQueue
+sLoaderQueue;
+
+static OSMessage
+sLoaderMessages[WHB_FILE_LOADER_QUEUE_SIZE];
+
+static BOOL
+sLoaderStarted = FALSE;
+
+static void
+StopLoaderThread();
+
 static BOOL
 InitFileSystem()
 {
@@ -29,6 +55,8 @@ InitFileSystem()
 BOOL
 WHBDeInitFileSystem()
 {
+    StopLoaderThread();
+
     if (sInitialised) {
       if (FSDelClient(&sClient, FS_ERROR_FLAG_ALL) != FS_STATUS_OK) {
          return FALSE;
@@ -123,10 +151,57 @@ WHBCloseFile(int32_t handle)
 char *
 WHBReadWholeFile(const char *path,
                  uint32_t *outSize)
+{
+   return WHBReadWholeFileEx(path, NULL, 0, NULL, NULL, outSize);
+}
+
+void
+WHBFreeWholeFile(char *file)
+{
+   MEMFreeToDefaultHeap(file);
+}
+
+static void *
+DefaultAlloc(uint32_t size,
+             uint32_t alignment,
+             void *context)
+{
+   return MEMAllocFromDefaultHeapEx(size, alignment);
+}
+
+static void
+DefaultFree(void *ptr,
+            void *context)
+{
+   MEMFreeToDefaultHeap(ptr);
+}
+
+static const WHBFileAllocator
+sDefaultAllocator = { DefaultAlloc, DefaultFree, NULL };
+
+char *
+WHBReadWholeFileEx(const char *path,
+                   const WHBFileAllocator *allocator,
+                   uint32_t chunkSize,
+                   WHBFileProgressFn progress,
+                   void *progressContext,
+                   uint32_t *outSize)
 {
    int32_t handle;
-   uint32_t size;
+   uint32_t size, allocSize, offset = 0;
    char *buf = NULL;
+
+   if (!allocator) {
+      allocator = &sDefaultAllocator;
+   }
+
+   // FSReadFile wants 64 byte aligned destinations, so keep every chunk
+   // starting on one
+   chunkSize &= ~0x3F;
+   if (!chunkSize) {
+      chunkSize = WHB_FILE_DEFAULT_CHUNK_SIZE;
+   }
+
    handle = WHBOpenFile(path, "r");
    if (handle == WHB_FILE_FATAL_ERROR) {
       WHBLogPrintf("%s: WHBOpenFile failed", __FUNCTION__);
@@ -138,14 +213,27 @@ WHBReadWholeFile(const char *path,
       goto error;
    }
 
-   buf = MEMAllocFromDefaultHeapEx((size + 0x3F) & ~(0x3F), 64);
+   allocSize = (size + 0x3F) & ~(0x3F);
+   buf = allocator->alloc(allocSize, 64, allocator->context);
    if (!buf) {
-      WHBLogPrintf("%s: MEMAllocFromDefaultHeapEx(0x%X, 64) failed", __FUNCTION__, (size + 0x3F) & ~(0x3F));
+      WHBLogPrintf("%s: alloc(0x%X, 64) failed", __FUNCTION__, allocSize);
       goto error;
    }
 
-   if (WHBReadFile(handle, buf, 1, size) != size) {
-      goto error;
+   while (offset < size) {
+      uint32_t length = size - offset;
+      if (length > chunkSize) {
+         length = chunkSize;
+      }
+
+      if (WHBReadFile(handle, buf + offset, 1, length) != length) {
+         goto error;
+      }
+
+      offset += length;
+      if (progress && !progress(offset, size, progressContext)) {
+         goto error;
+      }
    }
 
    if (outSize) {
@@ -156,8 +244,8 @@ WHBReadWholeFile(const char *path,
    return buf;
 
 error:
-   if (buf) {
-      MEMFreeToDefaultHeap(buf);
+   if (buf && allocator->free) {
+      allocator->free(buf, allocator->context);
    }
 
    WHBCloseFile(handle);
@@ -165,7 +253,131 @@ error:
 }
 
 void
-WHBFreeWholeFile(char *file)
+WHBFreeWholeFileEx(char *file,
+                   const WHBFileAllocator *allocator)
 {
-   MEMFreeToDefaultHeap(file);
+   if (!allocator) {
+      allocator = &sDefaultAllocator;
+   }
+
+   if (file && allocator->free) {
+      allocator->free(file, allocator->context);
+   }
+}
+
+static BOOL
+LoaderProgress(uint32_t bytesRead,
+               uint32_t totalSize,
+               void *context)
+{
+   WHBFileAsyncRead *read = (WHBFileAsyncRead *)context;
+
+   read->bytesRead = bytesRead;
+   if (read->cancel) {
+      return FALSE;
+   }
+
+   if (read->progress) {
+      return read->progress(bytesRead, totalSize, read->progressContext);
+   }
+
+   return TRUE;
+}
+
+static int
+LoaderThreadEntry(int argc,
+                  const char **argv)
+{
+   WHBFileAsyncRead *read;
+   OSMessage message;
+
+   while (1) {
+      OSReceiveMessage(&sLoaderQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+      read = (WHBFileAsyncRead *)message.message;
+      if (!read) {
+         break;
+      }
+
+      if (!read->cancel) {
+         read->data = WHBReadWholeFileEx(read->path, read->allocator,
+                                         read->chunkSize, LoaderProgress,
+                                         read, &read->size);
+      }
+
+      read->done = TRUE;
+   }
+
+   return 0;
+}
+
+static BOOL
+StartLoaderThread()
+{
+   if (sLoaderStarted) {
+      return TRUE;
+   }
+
+   OSInitMessageQueue(&sLoaderQueue, sLoaderMessages, WHB_FILE_LOADER_QUEUE_SIZE);
+   if (!OSCreateThread(&sLoaderThread,
+                       LoaderThreadEntry,
+                       0,
+                       NULL,
+                       sLoaderThreadStack + sizeof(sLoaderThreadStack),
+                       sizeof(sLoaderThreadStack),
+                       16,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      WHBLogPrintf("%s: OSCreateThread failed", __FUNCTION__);
+      return FALSE;
+   }
+
+   OSSetThreadName(&sLoaderThread, "WHB file loader");
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(&sLoaderThread);
+   }
+   OSResumeThread(&sLoaderThread);
+   sLoaderStarted = TRUE;
+   return TRUE;
+}
+
+static void
+StopLoaderThread()
+{
+   OSMessage message = { 0 };
+
+   if (!sLoaderStarted) {
+      return;
+   }
+
+   // Queued reads still run before the thread stops
+   OSSendMessage(&sLoaderQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+   OSJoinThread(&sLoaderThread, NULL);
+   sLoaderStarted = FALSE;
+}
+
+BOOL
+WHBReadWholeFileAsync(WHBFileAsyncRead *read)
+{
+   OSMessage message = { 0 };
+
+   read->data = NULL;
+   read->size = 0;
+   read->bytesRead = 0;
+   read->done = FALSE;
+   read->cancel = FALSE;
+
+   // Open the FS client here, the loader thread must not race to do it
+   if (!InitFileSystem() || !StartLoaderThread()) {
+      read->done = TRUE;
+      return FALSE;
+   }
+
+   message.message = read;
+   OSSendMessage(&sLoaderQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+   return TRUE;
+}
+
+void
+WHBCancelReadWholeFileAsync(WHBFileAsyncRead *read)
+{
+   read->cancel = TRUE;
 }
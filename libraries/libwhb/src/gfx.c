@@ -15,13 +15,19 @@
 #include <proc_ui/procui.h>
 #include <string.h>
 #include <whb/gfx.h>
+#include <whb/gfx_state.h>
 #include <whb/log.h>
 
 #define WHB_GFX_COMMAND_BUFFER_POOL_SIZE (0x400000)
+#define WHB_GFX_AA_BUFFER_CLEAR_VALUE (0xCC)
+#define WHB_GFX_FRAME_RING_SIZE (WHB_GFX_MAX_FRAMES_IN_FLIGHT + 1)
 
 static void *
 sCommandBufferPool = NULL;
 
+static uint32_t
+sCommandBufferPoolSize = 0;
+
 static GX2DrcRenderMode
 sDrcRenderMode;
 
@@ -58,6 +64,13 @@ sDrcColourBuffer = { 0 };
 static GX2DepthBuffer
 sDrcDepthBuffer = { 0 };
 
+// Single sampled copies of multisampled colour buffers for scan out
+static GX2ColorBuffer
+sTvResolveBuffer = { 0 };
+
+static GX2ColorBuffer
+sDrcResolveBuffer = { 0 };
+
 static GX2ContextState *
 sTvContextState = NULL;
 
@@ -73,36 +86,65 @@ sGpuTimedOut = FALSE;
 static BOOL
 sGfxHasForeground = TRUE;
 
+static GX2BufferingMode
+sBufferingMode = GX2_BUFFERING_MODE_DOUBLE;
+
+static BOOL
+sMirrorMode = FALSE;
+
+static BOOL
+sSharedContextState = FALSE;
+
+//! Context state last loaded by GfxLoadContextState, NULL when unknown
+static GX2ContextState *
+sCurrentContextState = NULL;
+
+// 0 waits for the GPU to finish every frame in WHBGfxFinishRender
+static uint32_t
+sMaxFramesInFlight = 0;
+
+static OSTime
+sLatencyBudget = 0;
+
+// GPU timestamp and submit time of the most recent frames
+static OSTime
+sFrameTimeStamp[WHB_GFX_FRAME_RING_SIZE] = { 0 };
+
+static OSTime
+sFrameSubmitTime[WHB_GFX_FRAME_RING_SIZE] = { 0 };
+
+static uint32_t
+sFrameIndex = 0;
+
+#define GFX_MAX_RENDER_TARGETS (12)
+
+/*
+ * MEM1 layout of the screen render targets. Sizes, alignments and offsets
+ * are computed once by GfxInitRenderTargets, so reacquiring the foreground
+ * only has to allocate one block and hand out pointers into it.
+ */
+typedef struct GfxRenderTarget
+{
+   void **image;
+   uint32_t size;
+   uint32_t offset;
+   BOOL aaBuffer;
+} GfxRenderTarget;
+
+static GfxRenderTarget
+sRenderTargets[GFX_MAX_RENDER_TARGETS];
+
+static uint32_t
+sNumRenderTargets = 0;
+
 static void *
-GfxGX2RAlloc(GX2RResourceFlags flags,
-             uint32_t size,
-             uint32_t alignment)
-{
-   // Color, depth, scan buffers all belong in MEM1
-   if ((flags & (GX2R_RESOURCE_BIND_COLOR_BUFFER
-                | GX2R_RESOURCE_BIND_DEPTH_BUFFER
-                | GX2R_RESOURCE_BIND_SCAN_BUFFER
-                | GX2R_RESOURCE_USAGE_FORCE_MEM1))
-      && !(flags & GX2R_RESOURCE_USAGE_FORCE_MEM2)) {
-      return GfxHeapAllocMEM1(size, alignment);
-   } else {
-      return GfxHeapAllocMEM2(size, alignment);
-   }
-}
+sRenderTargetBlock = NULL;
 
-static void
-GfxGX2RFree(GX2RResourceFlags flags, void *block)
-{
-   if ((flags & (GX2R_RESOURCE_BIND_COLOR_BUFFER
-                | GX2R_RESOURCE_BIND_DEPTH_BUFFER
-                | GX2R_RESOURCE_BIND_SCAN_BUFFER
-                | GX2R_RESOURCE_USAGE_FORCE_MEM1))
-      && !(flags & GX2R_RESOURCE_USAGE_FORCE_MEM2)) {
-      return GfxHeapFreeMEM1(block);
-   } else {
-      return GfxHeapFreeMEM2(block);
-   }
-}
+static uint32_t
+sRenderTargetBlockSize = 0;
+
+static uint32_t
+sRenderTargetBlockAlignment = 4;
 
 static void
 GfxInitTvColourBuffer(GX2ColorBuffer *cb,
@@ -131,8 +173,11 @@ GfxInitDepthBuffer(GX2DepthBuffer *db,
                    uint32_t width,
                    uint32_t height,
                    GX2SurfaceFormat format,
-                   GX2AAMode aa)
+                   GX2AAMode aa,
+                   BOOL hiZ)
 {
+   uint32_t hiZAlignment;
+
    memset(db, 0, sizeof(GX2DepthBuffer));
 
    if (format == GX2_SURFACE_FORMAT_UNORM_R24_X8 || format == GX2_SURFACE_FORMAT_FLOAT_D24_S8) {
@@ -153,12 +198,126 @@ GfxInitDepthBuffer(GX2DepthBuffer *db,
    db->depthClear = 1.0f;
    GX2CalcSurfaceSizeAndAlignment(&db->surface);
    GX2InitDepthBufferRegs(db);
+
+   // The HiZ buffer is allocated along with the depth buffer
+   if (hiZ) {
+      GX2CalcDepthBufferHiZInfo(db, &db->hiZSize, &hiZAlignment);
+      GX2InitDepthBufferHiZEnable(db, TRUE);
+   }
+}
+
+static void
+GfxAddRenderTarget(void **image,
+                   uint32_t size,
+                   uint32_t alignment,
+                   BOOL aaBuffer)
+{
+   GfxRenderTarget *target = &sRenderTargets[sNumRenderTargets++];
+
+   sRenderTargetBlockSize = (sRenderTargetBlockSize + alignment - 1) & ~(alignment - 1);
+   if (alignment > sRenderTargetBlockAlignment) {
+      sRenderTargetBlockAlignment = alignment;
+   }
+
+   target->image = image;
+   target->size = size;
+   target->offset = sRenderTargetBlockSize;
+   target->aaBuffer = aaBuffer;
+   sRenderTargetBlockSize += size;
+}
+
+static void
+GfxAddColourBuffer(GX2ColorBuffer *cb)
+{
+   uint32_t aaAlignment;
+
+   if (!cb->surface.imageSize) {
+      return;
+   }
+
+   GfxAddRenderTarget(&cb->surface.image, cb->surface.imageSize, cb->surface.alignment, FALSE);
+
+   if (cb->surface.aa != GX2_AA_MODE1X) {
+      GX2CalcColorBufferAuxInfo(cb, &cb->aaSize, &aaAlignment);
+      GfxAddRenderTarget(&cb->aaBuffer, cb->aaSize, aaAlignment, TRUE);
+   }
+}
+
+static void
+GfxAddDepthBuffer(GX2DepthBuffer *db)
+{
+   uint32_t hiZAlignment;
+
+   GfxAddRenderTarget(&db->surface.image, db->surface.imageSize, db->surface.alignment, FALSE);
+
+   if (db->hiZSize) {
+      GX2CalcDepthBufferHiZInfo(db, &db->hiZSize, &hiZAlignment);
+      GfxAddRenderTarget(&db->hiZPtr, db->hiZSize, hiZAlignment, FALSE);
+   }
+}
+
+static void
+GfxInitRenderTargets()
+{
+   sNumRenderTargets = 0;
+   sRenderTargetBlockSize = 0;
+   sRenderTargetBlockAlignment = 4;
+
+   GfxAddColourBuffer(&sTvColourBuffer);
+   GfxAddColourBuffer(&sTvResolveBuffer);
+   GfxAddDepthBuffer(&sTvDepthBuffer);
+   GfxAddColourBuffer(&sDrcColourBuffer);
+   GfxAddColourBuffer(&sDrcResolveBuffer);
+   GfxAddDepthBuffer(&sDrcDepthBuffer);
+}
+
+static BOOL
+GfxAllocRenderTargets()
+{
+   uint32_t i;
+
+   sRenderTargetBlock = GfxHeapAllocMEM1(sRenderTargetBlockSize, sRenderTargetBlockAlignment);
+   if (!sRenderTargetBlock) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM1(0x%X, 0x%X) failed",
+                   __FUNCTION__,
+                   sRenderTargetBlockSize,
+                   sRenderTargetBlockAlignment);
+      return FALSE;
+   }
+
+   for (i = 0; i < sNumRenderTargets; ++i) {
+      GfxRenderTarget *target = &sRenderTargets[i];
+      *target->image = (uint8_t *)sRenderTargetBlock + target->offset;
+
+      if (target->aaBuffer) {
+         memset(*target->image, WHB_GFX_AA_BUFFER_CLEAR_VALUE, target->size);
+      }
+   }
+
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sRenderTargetBlock, sRenderTargetBlockSize);
+   return TRUE;
+}
+
+static void
+GfxFreeRenderTargets()
+{
+   uint32_t i;
+
+   if (sRenderTargetBlock) {
+      GfxHeapFreeMEM1(sRenderTargetBlock);
+      sRenderTargetBlock = NULL;
+   }
+
+   for (i = 0; i < sNumRenderTargets; ++i) {
+      *sRenderTargets[i].image = NULL;
+   }
 }
 
 static uint32_t
 GfxProcCallbackAcquired(void *context)
 {
    sGfxHasForeground = TRUE;
+   sCurrentContextState = NULL;
 
    if (!GfxHeapInitMEM1()) {
       WHBLogPrintf("%s: GfxHeapInitMEM1 failed", __FUNCTION__);
@@ -180,29 +339,7 @@ GfxProcCallbackAcquired(void *context)
       goto error;
    }
    GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sTvScanBuffer, sTvScanBufferSize);
-   GX2SetTVBuffer(sTvScanBuffer, sTvScanBufferSize, sTvRenderMode, sTvSurfaceFormat, GX2_BUFFERING_MODE_DOUBLE);
-
-   // Allocate TV colour buffer.
-   sTvColourBuffer.surface.image = GfxHeapAllocMEM1(sTvColourBuffer.surface.imageSize, sTvColourBuffer.surface.alignment);
-   if (!sTvColourBuffer.surface.image) {
-      WHBLogPrintf("%s: sTvColourBuffer = GfxHeapAllocMEM1(0x%X, 0x%X) failed",
-                   __FUNCTION__,
-                   sTvColourBuffer.surface.imageSize,
-                   sTvColourBuffer.surface.alignment);
-      goto error;
-   }
-   GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sTvColourBuffer.surface.image, sTvColourBuffer.surface.imageSize);
-
-   // Allocate TV depth buffer.
-   sTvDepthBuffer.surface.image = GfxHeapAllocMEM1(sTvDepthBuffer.surface.imageSize, sTvDepthBuffer.surface.alignment);
-   if (!sTvDepthBuffer.surface.image) {
-      WHBLogPrintf("%s: sTvDepthBuffer = GfxHeapAllocMEM1(0x%X, 0x%X) failed",
-                   __FUNCTION__,
-                   sTvDepthBuffer.surface.imageSize,
-                   sTvDepthBuffer.surface.alignment);
-      goto error;
-   }
-   GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sTvDepthBuffer.surface.image, sTvDepthBuffer.surface.imageSize);
+   GX2SetTVBuffer(sTvScanBuffer, sTvScanBufferSize, sTvRenderMode, sTvSurfaceFormat, sBufferingMode);
 
    // Allocate DRC scan buffer.
    sDrcScanBuffer = GfxHeapAllocForeground(sDrcScanBufferSize, GX2_SCAN_BUFFER_ALIGNMENT);
@@ -214,29 +351,17 @@ GfxProcCallbackAcquired(void *context)
       goto error;
    }
    GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sDrcScanBuffer, sDrcScanBufferSize);
-   GX2SetDRCBuffer(sDrcScanBuffer, sDrcScanBufferSize, sDrcRenderMode, sDrcSurfaceFormat, GX2_BUFFERING_MODE_DOUBLE);
+   GX2SetDRCBuffer(sDrcScanBuffer, sDrcScanBufferSize, sDrcRenderMode, sDrcSurfaceFormat, sBufferingMode);
 
-   // Allocate DRC colour buffer.
-   sDrcColourBuffer.surface.image = GfxHeapAllocMEM1(sDrcColourBuffer.surface.imageSize, sDrcColourBuffer.surface.alignment);
-   if (!sDrcColourBuffer.surface.image) {
-      WHBLogPrintf("%s: sDrcColourBuffer = GfxHeapAllocMEM1(0x%X, 0x%X) failed",
-                   __FUNCTION__,
-                   sDrcColourBuffer.surface.imageSize,
-                   sDrcColourBuffer.surface.alignment);
+   // Allocate the colour, resolve and depth buffers of both screens.
+   if (!GfxAllocRenderTargets()) {
       goto error;
    }
-   GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sDrcColourBuffer.surface.image, sDrcColourBuffer.surface.imageSize);
 
-   // Allocate DRC depth buffer.
-   sDrcDepthBuffer.surface.image = GfxHeapAllocMEM1(sDrcDepthBuffer.surface.imageSize, sDrcDepthBuffer.surface.alignment);
-   if (!sDrcDepthBuffer.surface.image) {
-      WHBLogPrintf("%s: sDrcDepthBuffer = GfxHeapAllocMEM1(0x%X, 0x%X) failed",
-                   __FUNCTION__,
-                   sDrcDepthBuffer.surface.imageSize,
-                   sDrcDepthBuffer.surface.alignment);
+   // Transient surfaces go last, packed into a single block
+   if (!GfxTransientAcquire()) {
       goto error;
    }
-   GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sDrcDepthBuffer.surface.image, sDrcDepthBuffer.surface.imageSize);
    return 0;
 
 error:
@@ -253,30 +378,13 @@ GfxProcCallbackReleased(void *context)
       sTvScanBuffer = NULL;
    }
 
-   if (sTvColourBuffer.surface.image) {
-      GfxHeapFreeMEM1(sTvColourBuffer.surface.image);
-      sTvColourBuffer.surface.image = NULL;
-   }
-
-   if (sTvDepthBuffer.surface.image) {
-      GfxHeapFreeMEM1(sTvDepthBuffer.surface.image);
-      sTvDepthBuffer.surface.image = NULL;
-   }
-
    if (sDrcScanBuffer) {
       GfxHeapFreeForeground(sDrcScanBuffer);
       sDrcScanBuffer = NULL;
    }
 
-   if (sDrcColourBuffer.surface.image) {
-      GfxHeapFreeMEM1(sDrcColourBuffer.surface.image);
-      sDrcColourBuffer.surface.image = NULL;
-   }
-
-   if (sDrcDepthBuffer.surface.image) {
-      GfxHeapFreeMEM1(sDrcDepthBuffer.surface.image);
-      sDrcDepthBuffer.surface.image = NULL;
-   }
+   GfxFreeRenderTargets();
+   GfxTransientRelease();
 
    GfxHeapDestroyMEM1();
    GfxHeapDestroyForeground();
@@ -284,14 +392,90 @@ GfxProcCallbackReleased(void *context)
    return 0;
 }
 
+static void
+GfxGetDefaultScreenConfig(WHBGfxScreenConfig *screen)
+{
+   screen->width = 0;
+   screen->height = 0;
+   screen->colourFormat = GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
+   screen->depthFormat = GX2_SURFACE_FORMAT_FLOAT_R32;
+   screen->aaMode = GX2_AA_MODE1X;
+   screen->hiZ = FALSE;
+}
+
+//! Scan buffers only support a few formats, anything else is converted on copy
+static GX2SurfaceFormat
+GfxGetScanBufferFormat(GX2SurfaceFormat colourFormat)
+{
+   switch (colourFormat) {
+   case GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8:
+   case GX2_SURFACE_FORMAT_SRGB_R8_G8_B8_A8:
+   case GX2_SURFACE_FORMAT_UNORM_R10_G10_B10_A2:
+      return colourFormat;
+   default:
+      return GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
+   }
+}
+
+static void
+GfxInitScreenBuffers(const WHBGfxScreenConfig *screen,
+                     uint32_t defaultWidth,
+                     uint32_t defaultHeight,
+                     GX2ColorBuffer *colourBuffer,
+                     GX2DepthBuffer *depthBuffer,
+                     GX2ColorBuffer *resolveBuffer)
+{
+   uint32_t width = screen->width ? screen->width : defaultWidth;
+   uint32_t height = screen->height ? screen->height : defaultHeight;
+
+   GfxInitTvColourBuffer(colourBuffer, width, height, screen->colourFormat, screen->aaMode);
+   GfxInitDepthBuffer(depthBuffer, width, height, screen->depthFormat, screen->aaMode, screen->hiZ);
+
+   if (screen->aaMode != GX2_AA_MODE1X) {
+      GfxInitTvColourBuffer(resolveBuffer, width, height, screen->colourFormat, GX2_AA_MODE1X);
+   } else {
+      memset(resolveBuffer, 0, sizeof(GX2ColorBuffer));
+   }
+}
+
+void
+WHBGfxGetDefaultConfig(WHBGfxConfig *config)
+{
+   config->bufferingMode = GX2_BUFFERING_MODE_DOUBLE;
+   config->swapInterval = 1;
+   config->commandBufferPoolSize = WHB_GFX_COMMAND_BUFFER_POOL_SIZE;
+   config->hotMemorySize = 0;
+   GfxGetDefaultScreenConfig(&config->tv);
+   GfxGetDefaultScreenConfig(&config->drc);
+}
+
 BOOL
 WHBGfxInit()
+{
+   WHBGfxConfig config;
+   WHBGfxGetDefaultConfig(&config);
+   return WHBGfxInitEx(&config);
+}
+
+BOOL
+WHBGfxInitEx(const WHBGfxConfig *config)
 {
    uint32_t drcWidth, drcHeight;
    uint32_t tvWidth, tvHeight;
    uint32_t unk;
 
-   sCommandBufferPool = GfxHeapAllocMEM2(WHB_GFX_COMMAND_BUFFER_POOL_SIZE,
+   if (config->bufferingMode < GX2_BUFFERING_MODE_DOUBLE ||
+       config->bufferingMode > GX2_BUFFERING_MODE_TRIPLE) {
+      WHBLogPrintf("%s: unsupported buffering mode %d", __FUNCTION__, config->bufferingMode);
+      return FALSE;
+   }
+
+   sBufferingMode = config->bufferingMode;
+   GfxHeapSetHotSize(config->hotMemorySize);
+   sCommandBufferPoolSize = config->commandBufferPoolSize ? config->commandBufferPoolSize : WHB_GFX_COMMAND_BUFFER_POOL_SIZE;
+   sCommandBufferPoolSize = (sCommandBufferPoolSize + GX2_COMMAND_BUFFER_ALIGNMENT - 1) & ~(GX2_COMMAND_BUFFER_ALIGNMENT - 1);
+
+   sCommandBufferPool = GfxHeapAllocMEM2(sCommandBufferPoolSize,
                                          GX2_COMMAND_BUFFER_ALIGNMENT);
    if (!sCommandBufferPool) {
       WHBLogPrintf("%s: failed to allocate command buffer pool", __FUNCTION__);
@@ -300,7 +484,7 @@ WHBGfxInit()
 
    uint32_t initAttribs[] = {
       GX2_INIT_CMD_BUF_BASE, (uintptr_t)sCommandBufferPool,
-      GX2_INIT_CMD_BUF_POOL_SIZE, WHB_GFX_COMMAND_BUFFER_POOL_SIZE,
+      GX2_INIT_CMD_BUF_POOL_SIZE, sCommandBufferPoolSize,
       GX2_INIT_ARGC, 0,
       GX2_INIT_ARGV, 0,
       GX2_INIT_END
@@ -308,8 +492,8 @@ WHBGfxInit()
    GX2Init(initAttribs);
 
    sDrcRenderMode = GX2GetSystemDRCMode();
-   sTvSurfaceFormat = GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
-   sDrcSurfaceFormat = GX2_SURFACE_FORMAT_UNORM_R8_G8_B8_A8;
+   sTvSurfaceFormat = GfxGetScanBufferFormat(config->tv.colourFormat);
+   sDrcSurfaceFormat = GfxGetScanBufferFormat(config->drc.colourFormat);
 
    switch(GX2GetSystemTVScanMode())
    {
@@ -337,18 +521,20 @@ WHBGfxInit()
    drcHeight = 480;
 
    // Setup TV and DRC buffers - they will be allocated in GfxProcCallbackAcquired.
-   GX2CalcTVSize(sTvRenderMode, sTvSurfaceFormat, GX2_BUFFERING_MODE_DOUBLE, &sTvScanBufferSize, &unk);
-   GfxInitTvColourBuffer(&sTvColourBuffer, tvWidth, tvHeight, sTvSurfaceFormat, GX2_AA_MODE1X);
-   GfxInitDepthBuffer(&sTvDepthBuffer, sTvColourBuffer.surface.width, sTvColourBuffer.surface.height, GX2_SURFACE_FORMAT_FLOAT_R32, sTvColourBuffer.surface.aa);
+   GX2CalcTVSize(sTvRenderMode, sTvSurfaceFormat, sBufferingMode, &sTvScanBufferSize, &unk);
+   GfxInitScreenBuffers(&config->tv, tvWidth, tvHeight, &sTvColourBuffer, &sTvDepthBuffer, &sTvResolveBuffer);
 
-   GX2CalcDRCSize(sDrcRenderMode, sDrcSurfaceFormat, GX2_BUFFERING_MODE_DOUBLE, &sDrcScanBufferSize, &unk);
-   GfxInitTvColourBuffer(&sDrcColourBuffer, drcWidth, drcHeight, sDrcSurfaceFormat, GX2_AA_MODE1X);
-   GfxInitDepthBuffer(&sDrcDepthBuffer, sDrcColourBuffer.surface.width, sDrcColourBuffer.surface.height, GX2_SURFACE_FORMAT_FLOAT_R32, sDrcColourBuffer.surface.aa);
+   GX2CalcDRCSize(sDrcRenderMode, sDrcSurfaceFormat, sBufferingMode, &sDrcScanBufferSize, &unk);
+   GfxInitScreenBuffers(&config->drc, drcWidth, drcHeight, &sDrcColourBuffer, &sDrcDepthBuffer, &sDrcResolveBuffer);
+   GfxInitRenderTargets();
    if (GfxProcCallbackAcquired(NULL) != 0) {
       WHBLogPrintf("%s: GfxProcCallbackAcquired failed", __FUNCTION__);
       goto error;
    }
 
+   GfxGX2RInit();
+   GfxDisplayListInit();
+   GfxShaderInit();
    GX2RSetAllocator(&GfxGX2RAlloc, &GfxGX2RFree);
    ProcUIRegisterCallback(PROCUI_CALLBACK_ACQUIRE, GfxProcCallbackAcquired, NULL, 100);
    ProcUIRegisterCallback(PROCUI_CALLBACK_RELEASE, GfxProcCallbackReleased, NULL, 100);
@@ -380,9 +566,10 @@ WHBGfxInit()
    GX2SetViewport(0, 0, (float)sDrcColourBuffer.surface.width, (float)sDrcColourBuffer.surface.height, 0.0f, 1.0f);
    GX2SetScissor(0, 0, (float)sDrcColourBuffer.surface.width, (float)sDrcColourBuffer.surface.height);
    GX2SetDRCScale((float)sDrcColourBuffer.surface.width, (float)sDrcColourBuffer.surface.height);
+   sCurrentContextState = sDrcContextState;
 
-   // Set 60fps VSync
-   GX2SetSwapInterval(1);
+   // 1 for 60fps VSync, 2 for 30fps
+   GX2SetSwapInterval(config->swapInterval);
 
    return TRUE;
 
@@ -397,15 +584,7 @@ error:
       sTvScanBuffer = NULL;
    }
 
-   if (sTvColourBuffer.surface.image) {
-      GfxHeapFreeMEM1(sTvColourBuffer.surface.image);
-      sTvColourBuffer.surface.image = NULL;
-   }
-
-   if (sTvDepthBuffer.surface.image) {
-      GfxHeapFreeMEM1(sTvDepthBuffer.surface.image);
-      sTvDepthBuffer.surface.image = NULL;
-   }
+   GfxFreeRenderTargets();
 
    if (sTvContextState) {
       GfxHeapFreeMEM2(sTvContextState);
@@ -417,16 +596,6 @@ error:
       sDrcScanBuffer = NULL;
    }
 
-   if (sDrcColourBuffer.surface.image) {
-      GfxHeapFreeMEM1(sDrcColourBuffer.surface.image);
-      sDrcColourBuffer.surface.image = NULL;
-   }
-
-   if (sDrcDepthBuffer.surface.image) {
-      GfxHeapFreeMEM1(sDrcDepthBuffer.surface.image);
-      sDrcDepthBuffer.surface.image = NULL;
-   }
-
    if (sDrcContextState) {
       GfxHeapFreeMEM2(sDrcContextState);
       sDrcContextState = NULL;
@@ -438,6 +607,8 @@ error:
 void
 WHBGfxShutdown()
 {
+   GfxTextureStreamShutdown();
+
    if (sGpuTimedOut) {
       GX2ResetGPU(0);
       sGpuTimedOut = FALSE;
@@ -449,6 +620,8 @@ WHBGfxShutdown()
 
    GX2RSetAllocator(NULL, NULL);
    GX2Shutdown();
+   GfxComputeShutdown();
+   GfxGeometryRingsShutdown();
 
    if (sTvContextState) {
       GfxHeapFreeMEM2(sTvContextState);
@@ -466,6 +639,10 @@ WHBGfxShutdown()
    }
 }
 
+//! Defined in watchdog.c, only linked in when the watchdog is used
+void
+__whb_watchdog_begin_frame() __attribute__((weak));
+
 void
 WHBGfxBeginRender()
 {
@@ -473,10 +650,17 @@ WHBGfxBeginRender()
    OSTime lastFlip, lastVsync;
    uint32_t waitCount = 0;
 
+   // Each buffer beyond the two a flip needs lets one more swap be queued
+   uint32_t maxPendingSwaps = (uint32_t)sBufferingMode - GX2_BUFFERING_MODE_DOUBLE;
+
+   if (__whb_watchdog_begin_frame) {
+      __whb_watchdog_begin_frame();
+   }
+
    while (1) {
       GX2GetSwapStatus(&swapCount, &flipCount, &lastFlip, &lastVsync);
 
-      if (flipCount >= swapCount) {
+      if (swapCount - flipCount <= maxPendingSwaps) {
          break;
       }
 
@@ -486,9 +670,44 @@ WHBGfxBeginRender()
          break;
       }
 
+      // Sleeps until the next flip rather than every vsync
       waitCount++;
-      GX2WaitForVsync();
+      GX2WaitForFlip();
+   }
+}
+
+static void
+GfxWaitForFrames()
+{
+   uint32_t i;
+   OSTime now;
+
+   if (!sMaxFramesInFlight) {
+      GX2DrawDone();
+      return;
+   }
+
+   sFrameTimeStamp[sFrameIndex] = GX2GetLastSubmittedTimeStamp();
+   sFrameSubmitTime[sFrameIndex] = OSGetTime();
+
+   // Wait for the oldest frame the CPU may not run ahead of
+   i = (sFrameIndex + WHB_GFX_FRAME_RING_SIZE - sMaxFramesInFlight) % WHB_GFX_FRAME_RING_SIZE;
+   if (sFrameTimeStamp[i]) {
+      GX2WaitTimeStamp(sFrameTimeStamp[i]);
+   }
+
+   // And for every frame that has been queued for longer than the budget
+   if (sLatencyBudget) {
+      now = OSGetTime();
+      for (i = 0; i < WHB_GFX_FRAME_RING_SIZE; ++i) {
+         if (sFrameTimeStamp[i] && now - sFrameSubmitTime[i] > sLatencyBudget) {
+            GX2WaitTimeStamp(sFrameTimeStamp[i]);
+            sFrameTimeStamp[i] = 0;
+         }
+      }
    }
+
+   sFrameIndex = (sFrameIndex + 1) % WHB_GFX_FRAME_RING_SIZE;
 }
 
 void
@@ -496,49 +715,183 @@ WHBGfxFinishRender()
 {
    GX2SwapScanBuffers();
    GX2Flush();
-   GX2DrawDone();
+   GfxWaitForFrames();
    GX2SetTVEnable(TRUE);
    GX2SetDRCEnable(TRUE);
 }
 
+void
+WHBGfxSetMaxFramesInFlight(uint32_t count)
+{
+   if (count > WHB_GFX_MAX_FRAMES_IN_FLIGHT) {
+      count = WHB_GFX_MAX_FRAMES_IN_FLIGHT;
+   }
+
+   if (count != sMaxFramesInFlight) {
+      // Start over with nothing in flight
+      GX2DrawDone();
+      memset(sFrameTimeStamp, 0, sizeof(sFrameTimeStamp));
+      sFrameIndex = 0;
+      sMaxFramesInFlight = count;
+   }
+}
+
+uint32_t
+WHBGfxGetMaxFramesInFlight()
+{
+   return sMaxFramesInFlight;
+}
+
+void
+WHBGfxSetLatencyBudget(OSTime budget)
+{
+   sLatencyBudget = budget > 0 ? budget : 0;
+}
+
+static void
+GfxLoadContextState(GX2ContextState *state)
+{
+   GX2SetContextState(state);
+   sCurrentContextState = state;
+   WHBGfxStateInvalidate();
+}
+
+//! Point the loaded context state at the buffers of a screen
+static void
+GfxSetScreenTargets(BOOL tv)
+{
+   GX2ColorBuffer *colourBuffer = tv ? &sTvColourBuffer : &sDrcColourBuffer;
+   GX2DepthBuffer *depthBuffer = tv ? &sTvDepthBuffer : &sDrcDepthBuffer;
+
+   GX2SetColorBuffer(colourBuffer, GX2_RENDER_TARGET_0);
+   GX2SetDepthBuffer(depthBuffer);
+   GX2SetViewport(0, 0, (float)colourBuffer->surface.width, (float)colourBuffer->surface.height, 0.0f, 1.0f);
+   GX2SetScissor(0, 0, (float)colourBuffer->surface.width, (float)colourBuffer->surface.height);
+}
+
+static void
+GfxBeginScreen(BOOL tv)
+{
+   sDrawingTv = tv;
+
+   if (!sSharedContextState) {
+      GfxLoadContextState(tv ? sTvContextState : sDrcContextState);
+      return;
+   }
+
+   // Draw state carries over between the screens, only the targets change
+   if (sCurrentContextState != sTvContextState) {
+      GfxLoadContextState(sTvContextState);
+   }
+   GfxSetScreenTargets(tv);
+}
+
 void
 WHBGfxClearColor(float r, float g, float b, float a)
 {
-   if (sDrawingTv) {
-      GX2ClearColor(&sTvColourBuffer, r, g, b, a);
-      GX2ClearDepthStencilEx(&sTvDepthBuffer, sTvDepthBuffer.depthClear, sTvDepthBuffer.stencilClear, GX2_CLEAR_FLAGS_DEPTH | GX2_CLEAR_FLAGS_STENCIL);
-      GX2SetContextState(sTvContextState);
+   GX2ColorBuffer *colourBuffer = sDrawingTv ? &sTvColourBuffer : &sDrcColourBuffer;
+   GX2DepthBuffer *depthBuffer = sDrawingTv ? &sTvDepthBuffer : &sDrcDepthBuffer;
+
+   // One clear sets up its GPU state once for both buffers, which the
+   // context state is reloaded over afterwards
+   GX2ClearBuffersEx(colourBuffer, depthBuffer, r, g, b, a,
+                     depthBuffer->depthClear, depthBuffer->stencilClear,
+                     GX2_CLEAR_FLAGS_BOTH);
+
+   if (sSharedContextState) {
+      GfxLoadContextState(sTvContextState);
+      GfxSetScreenTargets(sDrawingTv);
    } else {
-      GX2ClearColor(&sDrcColourBuffer, r, g, b, a);
-      GX2ClearDepthStencilEx(&sDrcDepthBuffer, sDrcDepthBuffer.depthClear, sDrcDepthBuffer.stencilClear, GX2_CLEAR_FLAGS_DEPTH | GX2_CLEAR_FLAGS_STENCIL);
-      GX2SetContextState(sDrcContextState);
+      GfxLoadContextState(sDrawingTv ? sTvContextState : sDrcContextState);
    }
 }
 
 void
 WHBGfxBeginRenderDRC()
 {
-   GX2SetContextState(sDrcContextState);
-   sDrawingTv = FALSE;
+   GfxBeginScreen(FALSE);
 }
 
 void
 WHBGfxFinishRenderDRC()
 {
-   GX2CopyColorBufferToScanBuffer(&sDrcColourBuffer, GX2_SCAN_TARGET_DRC);
+   // The DRC already got a copy of the TV image
+   if (sMirrorMode) {
+      return;
+   }
+
+   if (sDrcColourBuffer.surface.aa != GX2_AA_MODE1X) {
+      GX2ResolveAAColorBuffer(&sDrcColourBuffer, &sDrcResolveBuffer.surface, 0, 0);
+      GX2CopyColorBufferToScanBuffer(&sDrcResolveBuffer, GX2_SCAN_TARGET_DRC);
+   } else {
+      GX2CopyColorBufferToScanBuffer(&sDrcColourBuffer, GX2_SCAN_TARGET_DRC);
+   }
+
+   // The copy leaves GPU state of its own behind
+   GfxForgetContextState();
 }
 
 void
 WHBGfxBeginRenderTV()
 {
-   GX2SetContextState(sTvContextState);
-   sDrawingTv = TRUE;
+   GfxBeginScreen(TRUE);
 }
 
 void
 WHBGfxFinishRenderTV()
 {
-   GX2CopyColorBufferToScanBuffer(&sTvColourBuffer, GX2_SCAN_TARGET_TV);
+   GX2ColorBuffer *colourBuffer = &sTvColourBuffer;
+
+   if (sTvColourBuffer.surface.aa != GX2_AA_MODE1X) {
+      GX2ResolveAAColorBuffer(&sTvColourBuffer, &sTvResolveBuffer.surface, 0, 0);
+      colourBuffer = &sTvResolveBuffer;
+   }
+
+   GX2CopyColorBufferToScanBuffer(colourBuffer, GX2_SCAN_TARGET_TV);
+
+   // The scan buffer copy scales, so the same image fits the DRC
+   if (sMirrorMode) {
+      GX2CopyColorBufferToScanBuffer(colourBuffer, GX2_SCAN_TARGET_DRC);
+   }
+
+   // The copy leaves GPU state of its own behind
+   GfxForgetContextState();
+}
+
+void
+WHBGfxSetMirrorMode(BOOL enable)
+{
+   sMirrorMode = enable;
+}
+
+BOOL
+WHBGfxGetMirrorMode()
+{
+   return sMirrorMode;
+}
+
+void
+WHBGfxSetSharedContextState(BOOL enable)
+{
+   if (sSharedContextState && !enable) {
+      // The TV context state may still point at the DRC buffers
+      GfxLoadContextState(sTvContextState);
+      GfxSetScreenTargets(TRUE);
+   }
+
+   sSharedContextState = enable;
+}
+
+BOOL
+WHBGfxGetSharedContextState()
+{
+   return sSharedContextState;
+}
+
+void
+GfxForgetContextState()
+{
+   sCurrentContextState = NULL;
 }
 
 GX2ColorBuffer *
@@ -0,0 +1,178 @@
+#include "gfx_heap.h"
+#include <gx2/context.h>
+#include <gx2/draw.h>
+#include <gx2/mem.h>
+#include <gx2/registers.h>
+#include <gx2/shaders.h>
+#include <gx2/utils.h>
+#include <string.h>
+#include <whb/gfx.h>
+#include <whb/gfx_compute.h>
+#include <whb/gfx_state.h>
+#include <whb/log.h>
+
+//! Clip space corners of a strip covering the whole target
+static const float
+sComputeQuad[8] __attribute__((aligned(GX2_VERTEX_BUFFER_ALIGNMENT))) = {
+   -1.0f, -1.0f,
+    1.0f, -1.0f,
+   -1.0f,  1.0f,
+    1.0f,  1.0f,
+};
+
+//! Separate from the TV and DRC states, which would otherwise shadow the
+//! compute target and shaders
+static GX2ContextState *
+sComputeContextState = NULL;
+
+static GX2Sampler
+sComputeSampler;
+
+static BOOL
+GfxComputeInit()
+{
+   if (sComputeContextState) {
+      return TRUE;
+   }
+
+   sComputeContextState = GfxHeapAllocMEM2(sizeof(GX2ContextState), GX2_CONTEXT_STATE_ALIGNMENT);
+   if (!sComputeContextState) {
+      WHBLogPrintf("%s: failed to allocate sComputeContextState", __FUNCTION__);
+      return FALSE;
+   }
+
+   GX2SetupContextStateEx(sComputeContextState, TRUE);
+   GX2InitSampler(&sComputeSampler, GX2_TEX_CLAMP_MODE_CLAMP, GX2_TEX_XY_FILTER_MODE_POINT);
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_ATTRIBUTE_BUFFER, (void *)sComputeQuad, sizeof(sComputeQuad));
+   return TRUE;
+}
+
+void
+GfxComputeShutdown()
+{
+   if (sComputeContextState) {
+      GfxHeapFreeMEM2(sComputeContextState);
+      sComputeContextState = NULL;
+   }
+}
+
+BOOL
+WHBGfxComputeInitTarget(WHBGfxComputeTarget *target,
+                        uint32_t width,
+                        uint32_t height,
+                        GX2SurfaceFormat format,
+                        BOOL linear)
+{
+   GX2ColorBuffer *cb = &target->colorBuffer;
+   void *image;
+
+   memset(target, 0, sizeof(WHBGfxComputeTarget));
+   cb->surface.use = GX2_SURFACE_USE_TEXTURE | GX2_SURFACE_USE_COLOR_BUFFER;
+   cb->surface.dim = GX2_SURFACE_DIM_TEXTURE_2D;
+   cb->surface.width = width;
+   cb->surface.height = height;
+   cb->surface.depth = 1;
+   cb->surface.mipLevels = 1;
+   cb->surface.format = format;
+   cb->surface.aa = GX2_AA_MODE1X;
+   cb->surface.tileMode = linear ? GX2_TILE_MODE_LINEAR_ALIGNED : GX2_TILE_MODE_DEFAULT;
+   cb->viewNumSlices = 1;
+   GX2CalcSurfaceSizeAndAlignment(&cb->surface);
+   GX2InitColorBufferRegs(cb);
+
+   image = GfxHeapAllocMEM2(cb->surface.imageSize, cb->surface.alignment);
+   if (!image) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(0x%X, 0x%X) failed", __FUNCTION__,
+                   cb->surface.imageSize, cb->surface.alignment);
+      return FALSE;
+   }
+
+   // Nothing of it may still be in the CPU cache when the GPU writes
+   memset(image, 0, cb->surface.imageSize);
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_TEXTURE, image, cb->surface.imageSize);
+   cb->surface.image = image;
+
+   target->texture.surface = cb->surface;
+   target->texture.viewNumMips = 1;
+   target->texture.viewNumSlices = 1;
+   target->texture.compMap = GX2_COMP_MAP(0, 1, 2, 3);
+   GX2InitTextureRegs(&target->texture);
+   return TRUE;
+}
+
+void
+WHBGfxComputeFreeTarget(WHBGfxComputeTarget *target)
+{
+   if (target->colorBuffer.surface.image) {
+      GfxHeapFreeMEM2(target->colorBuffer.surface.image);
+   }
+
+   memset(target, 0, sizeof(WHBGfxComputeTarget));
+}
+
+void
+WHBGfxComputeBegin(const WHBGfxShaderGroup *group)
+{
+   if (!GfxComputeInit()) {
+      return;
+   }
+
+   GX2SetContextState(sComputeContextState);
+   GfxForgetContextState();
+   WHBGfxStateInvalidate();
+
+   // Every element is written exactly once
+   GX2SetDepthOnlyControl(FALSE, FALSE, GX2_COMPARE_FUNC_ALWAYS);
+   GX2SetCullOnlyControl(GX2_FRONT_FACE_CCW, FALSE, FALSE);
+   GX2SetColorControl(GX2_LOGIC_OP_COPY, 0, FALSE, TRUE);
+
+   GX2SetShaderMode(group->vertexShader->mode);
+   GX2SetFetchShader(&group->fetchShader);
+   GX2SetVertexShader(group->vertexShader);
+   GX2SetPixelShader(group->pixelShader);
+   GX2SetAttribBuffer(0, sizeof(sComputeQuad), 2 * sizeof(float), sComputeQuad);
+}
+
+void
+WHBGfxComputeSetUniformBlock(uint32_t location,
+                             uint32_t size,
+                             const void *data)
+{
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU | GX2_INVALIDATE_MODE_UNIFORM_BLOCK, (void *)data, size);
+   GX2SetPixelUniformBlock(location, size, data);
+}
+
+void
+WHBGfxComputeSetTexture(const GX2Texture *texture,
+                        uint32_t unit)
+{
+   GX2SetPixelTexture(texture, unit);
+   GX2SetPixelSampler(&sComputeSampler, unit);
+}
+
+void
+WHBGfxComputeDispatch(WHBGfxComputeTarget *target)
+{
+   GX2Surface *surface = &target->colorBuffer.surface;
+
+   if (!sComputeContextState) {
+      return;
+   }
+
+   GX2SetColorBuffer(&target->colorBuffer, GX2_RENDER_TARGET_0);
+   GX2SetViewport(0.0f, 0.0f, (float)surface->width, (float)surface->height, 0.0f, 1.0f);
+   GX2SetScissor(0, 0, surface->width, surface->height);
+   GX2DrawEx(GX2_PRIMITIVE_MODE_TRIANGLE_STRIP, 4, 0, 1);
+
+   // Write the colour cache back, then drop stale copies of the target
+   // from the caches a later pass reads it through
+   GX2Invalidate(GX2_INVALIDATE_MODE_COLOR_BUFFER, surface->image, surface->imageSize);
+   GX2Invalidate(GX2_INVALIDATE_MODE_TEXTURE | GX2_INVALIDATE_MODE_ATTRIBUTE_BUFFER,
+                 surface->image, surface->imageSize);
+}
+
+void
+WHBGfxComputeEnd()
+{
+   WHBGfxStateInvalidate();
+}
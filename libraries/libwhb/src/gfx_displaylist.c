@@ -0,0 +1,403 @@
+#include "gfx_heap.h"
+#include <coreinit/core.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <gx2/displaylist.h>
+#include <gx2/event.h>
+#include <gx2/mem.h>
+#include <string.h>
+#include <whb/gfx.h>
+#include <whb/gfx_state.h>
+#include <whb/log.h>
+#include <wut_job.h>
+
+#define WHB_GFX_DISPLAY_LIST_ALIGNMENT        GX2_COMMAND_BUFFER_ALIGNMENT
+#define WHB_GFX_DISPLAY_LIST_DEFAULT_CAPACITY 0x1000
+
+#define WHB_GFX_NUM_CORES 3
+
+// A display list being recorded, found by the overrun callback through the
+// thread recording it
+typedef struct GfxDisplayListRecorder
+{
+   OSThread *thread;
+   void *overrunBuffer;
+   BOOL overrun;
+} GfxDisplayListRecorder;
+
+// GX2 records one display list per core at a time. A job can run on the
+// thread waiting for it, which may share its core with a job worker, so a
+// recording pins its thread to the core and holds the core until it ends.
+static OSMutex
+sCoreMutex[WHB_GFX_NUM_CORES];
+
+static GfxDisplayListRecorder *volatile
+sRecorders[WHB_GFX_NUM_CORES] = { NULL };
+
+typedef struct GfxDisplayListRecordData
+{
+   WHBGfxDisplayList *lists;
+   WHBGfxDisplayListRecordIndexFn recordFn;
+   WHBGfxDisplayListRecordFn singleRecordFn;
+   void *userData;
+   volatile BOOL failed;
+} GfxDisplayListRecordData;
+
+void
+GfxDisplayListInit()
+{
+   uint32_t i;
+
+   for (i = 0; i < WHB_GFX_NUM_CORES; ++i) {
+      OSInitMutexEx(&sCoreMutex[i], "WHB display list recording");
+      sRecorders[i] = NULL;
+   }
+}
+
+static GfxDisplayListRecorder *
+GfxDisplayListFindRecorder()
+{
+   OSThread *thread = OSGetCurrentThread();
+   uint32_t i;
+
+   for (i = 0; i < WHB_GFX_NUM_CORES; ++i) {
+      GfxDisplayListRecorder *recorder = sRecorders[i];
+      if (recorder && recorder->thread == thread) {
+         return recorder;
+      }
+   }
+
+   return NULL;
+}
+
+BOOL
+GfxDisplayListIsRecording()
+{
+   return GfxDisplayListFindRecorder() != NULL;
+}
+
+static void
+GfxDisplayListOverrunCallback(GX2EventType type,
+                              void *data)
+{
+   GX2DisplayListOverrunData *overrun = (GX2DisplayListOverrunData *)data;
+   GfxDisplayListRecorder *recorder = GfxDisplayListFindRecorder();
+   uint32_t size = overrun->oldSize * 2;
+
+   if (!recorder) {
+      overrun->newList = NULL;
+      overrun->newSize = 0;
+      return;
+   }
+
+   // Let GX2 continue into a throwaway buffer, the list is recorded again
+   // into a larger one once it is complete
+   if (recorder->overrunBuffer) {
+      GfxHeapFreeMEM2(recorder->overrunBuffer);
+   }
+
+   recorder->overrunBuffer = GfxHeapAllocMEM2(size, WHB_GFX_DISPLAY_LIST_ALIGNMENT);
+   overrun->newList = recorder->overrunBuffer;
+   overrun->newSize = recorder->overrunBuffer ? size : 0;
+   recorder->overrun = TRUE;
+}
+
+BOOL
+WHBGfxDisplayListInit(WHBGfxDisplayList *list,
+                      uint32_t capacity)
+{
+   memset(list, 0, sizeof(WHBGfxDisplayList));
+   capacity = capacity ? capacity : WHB_GFX_DISPLAY_LIST_DEFAULT_CAPACITY;
+   capacity = (capacity + WHB_GFX_DISPLAY_LIST_ALIGNMENT - 1) & ~(WHB_GFX_DISPLAY_LIST_ALIGNMENT - 1);
+
+   list->buffer = GfxHeapAllocMEM2(capacity, WHB_GFX_DISPLAY_LIST_ALIGNMENT);
+   if (!list->buffer) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(0x%X, 0x%X) failed", __FUNCTION__,
+                   capacity, WHB_GFX_DISPLAY_LIST_ALIGNMENT);
+      return FALSE;
+   }
+
+   list->capacity = capacity;
+   return TRUE;
+}
+
+void
+WHBGfxDisplayListFree(WHBGfxDisplayList *list)
+{
+   if (list->buffer) {
+      GfxHeapFreeMEM2(list->buffer);
+   }
+
+   memset(list, 0, sizeof(WHBGfxDisplayList));
+}
+
+// Needs GfxDisplayListOverrunCallback to be installed
+static BOOL
+GfxDisplayListRecord(WHBGfxDisplayList *list,
+                     WHBGfxDisplayListRecordIndexFn recordFn,
+                     uint32_t index,
+                     void *userData)
+{
+   GfxDisplayListRecorder recorder;
+   OSThread *thread = OSGetCurrentThread();
+   uint32_t affinity = OSGetThreadAffinity(thread);
+   uint32_t core;
+   uint32_t capacity;
+   BOOL result = TRUE;
+
+   if (!list->buffer && !WHBGfxDisplayListInit(list, 0)) {
+      return FALSE;
+   }
+
+   // Stay on this core until GX2EndDisplayList
+   OSSetThreadAffinity(thread, 1 << OSGetCoreId());
+   core = OSGetCoreId();
+   OSLockMutex(&sCoreMutex[core]);
+
+   recorder.thread = thread;
+   recorder.overrunBuffer = NULL;
+   sRecorders[core] = &recorder;
+
+   while (1) {
+      recorder.overrun = FALSE;
+      GX2BeginDisplayListEx(list->buffer, list->capacity, TRUE);
+      recordFn(index, userData);
+      list->size = GX2EndDisplayList(list->buffer);
+
+      if (recorder.overrunBuffer) {
+         GfxHeapFreeMEM2(recorder.overrunBuffer);
+         recorder.overrunBuffer = NULL;
+      }
+
+      if (!recorder.overrun) {
+         break;
+      }
+
+      // Grow and record again
+      capacity = list->capacity * 2;
+      GfxHeapFreeMEM2(list->buffer);
+      list->buffer = GfxHeapAllocMEM2(capacity, WHB_GFX_DISPLAY_LIST_ALIGNMENT);
+      if (!list->buffer) {
+         WHBLogPrintf("%s: GfxHeapAllocMEM2(0x%X, 0x%X) failed", __FUNCTION__,
+                      capacity, WHB_GFX_DISPLAY_LIST_ALIGNMENT);
+         list->capacity = 0;
+         list->size = 0;
+         result = FALSE;
+         break;
+      }
+
+      list->capacity = capacity;
+   }
+
+   sRecorders[core] = NULL;
+   OSUnlockMutex(&sCoreMutex[core]);
+   OSSetThreadAffinity(thread, affinity);
+
+   if (result) {
+      GX2Invalidate(GX2_INVALIDATE_MODE_CPU, list->buffer, list->size);
+   }
+   return result;
+}
+
+static void
+GfxDisplayListRecordSingle(uint32_t index,
+                           void *userData)
+{
+   GfxDisplayListRecordData *data = (GfxDisplayListRecordData *)userData;
+   data->singleRecordFn(data->userData);
+}
+
+static void
+GfxDisplayListRecordRange(uint32_t begin,
+                          uint32_t end,
+                          void *userData)
+{
+   GfxDisplayListRecordData *data = (GfxDisplayListRecordData *)userData;
+   uint32_t i;
+
+   for (i = begin; i < end; ++i) {
+      if (!GfxDisplayListRecord(&data->lists[i], data->recordFn, i, data->userData)) {
+         data->failed = TRUE;
+      }
+   }
+}
+
+BOOL
+WHBGfxDisplayListRecord(WHBGfxDisplayList *list,
+                        WHBGfxDisplayListRecordFn recordFn,
+                        void *userData)
+{
+   GX2EventCallbackFunction prevCallback;
+   void *prevUserData;
+   GfxDisplayListRecordData data;
+   BOOL result;
+
+   data.lists = list;
+   data.recordFn = NULL;
+   data.singleRecordFn = recordFn;
+   data.userData = userData;
+   data.failed = FALSE;
+
+   WHBGfxStateInvalidate();
+   GX2GetEventCallback(GX2_EVENT_TYPE_DISPLAY_LIST_OVERRUN, &prevCallback, &prevUserData);
+   GX2SetEventCallback(GX2_EVENT_TYPE_DISPLAY_LIST_OVERRUN, GfxDisplayListOverrunCallback, NULL);
+   result = GfxDisplayListRecord(list, GfxDisplayListRecordSingle, 0, &data);
+   GX2SetEventCallback(GX2_EVENT_TYPE_DISPLAY_LIST_OVERRUN, prevCallback, prevUserData);
+   WHBGfxStateInvalidate();
+   return result;
+}
+
+BOOL
+WHBGfxDisplayListRecordParallel(WHBGfxDisplayList *lists,
+                                uint32_t count,
+                                WHBGfxDisplayListRecordIndexFn recordFn,
+                                void *userData)
+{
+   GX2EventCallbackFunction prevCallback;
+   void *prevUserData;
+   GfxDisplayListRecordData data;
+
+   data.lists = lists;
+   data.recordFn = recordFn;
+   data.singleRecordFn = NULL;
+   data.userData = userData;
+   data.failed = FALSE;
+
+   WHBGfxStateInvalidate();
+   GX2GetEventCallback(GX2_EVENT_TYPE_DISPLAY_LIST_OVERRUN, &prevCallback, &prevUserData);
+   GX2SetEventCallback(GX2_EVENT_TYPE_DISPLAY_LIST_OVERRUN, GfxDisplayListOverrunCallback, NULL);
+   WUTJobParallelFor(count, 1, GfxDisplayListRecordRange, &data);
+   GX2SetEventCallback(GX2_EVENT_TYPE_DISPLAY_LIST_OVERRUN, prevCallback, prevUserData);
+   WHBGfxStateInvalidate();
+   return !data.failed;
+}
+
+void
+WHBGfxDisplayListCall(const WHBGfxDisplayList *list)
+{
+   if (list->size) {
+      // The state the list leaves behind isn't known
+      GX2CallDisplayList(list->buffer, list->size);
+      WHBGfxStateInvalidate();
+   }
+}
+
+void
+WHBGfxDisplayListDirectCall(const WHBGfxDisplayList *list)
+{
+   if (list->size) {
+      GX2DirectCallDisplayList(list->buffer, list->size);
+      WHBGfxStateInvalidate();
+   }
+}
+
+void
+WHBGfxDisplayListCallAll(const WHBGfxDisplayList *lists,
+                         uint32_t count)
+{
+   uint32_t i;
+
+   for (i = 0; i < count; ++i) {
+      WHBGfxDisplayListCall(&lists[i]);
+   }
+}
+
+static WHBGfxDisplayList *
+GfxDisplayListCacheFind(WHBGfxDisplayListCache *cache,
+                        uint32_t key)
+{
+   uint32_t i;
+
+   for (i = 0; i < cache->count; ++i) {
+      if (cache->entries[i].key == key) {
+         return &cache->entries[i].list;
+      }
+   }
+
+   return NULL;
+}
+
+void
+WHBGfxDisplayListCacheInit(WHBGfxDisplayListCache *cache)
+{
+   memset(cache, 0, sizeof(WHBGfxDisplayListCache));
+}
+
+void
+WHBGfxDisplayListCacheFree(WHBGfxDisplayListCache *cache)
+{
+   WHBGfxDisplayListCacheClear(cache);
+
+   if (cache->entries) {
+      GfxHeapFreeMEM2(cache->entries);
+   }
+
+   memset(cache, 0, sizeof(WHBGfxDisplayListCache));
+}
+
+void
+WHBGfxDisplayListCacheClear(WHBGfxDisplayListCache *cache)
+{
+   uint32_t i;
+
+   for (i = 0; i < cache->count; ++i) {
+      WHBGfxDisplayListFree(&cache->entries[i].list);
+   }
+
+   cache->count = 0;
+}
+
+void
+WHBGfxDisplayListCacheInvalidate(WHBGfxDisplayListCache *cache,
+                                 uint32_t key)
+{
+   uint32_t i;
+
+   for (i = 0; i < cache->count; ++i) {
+      if (cache->entries[i].key == key) {
+         WHBGfxDisplayListFree(&cache->entries[i].list);
+         cache->entries[i] = cache->entries[--cache->count];
+         break;
+      }
+   }
+}
+
+const WHBGfxDisplayList *
+WHBGfxDisplayListCacheGet(WHBGfxDisplayListCache *cache,
+                          uint32_t key,
+                          WHBGfxDisplayListRecordFn recordFn,
+                          void *userData)
+{
+   WHBGfxDisplayListCacheEntry *entries;
+   WHBGfxDisplayList *list = GfxDisplayListCacheFind(cache, key);
+   uint32_t capacity;
+
+   if (list) {
+      return list;
+   }
+
+   if (cache->count == cache->capacity) {
+      capacity = cache->capacity ? cache->capacity * 2 : 16;
+      entries = GfxHeapAllocMEM2(capacity * sizeof(WHBGfxDisplayListCacheEntry), 4);
+      if (!entries) {
+         return NULL;
+      }
+
+      if (cache->entries) {
+         memcpy(entries, cache->entries, cache->count * sizeof(WHBGfxDisplayListCacheEntry));
+         GfxHeapFreeMEM2(cache->entries);
+      }
+
+      cache->entries = entries;
+      cache->capacity = capacity;
+   }
+
+   list = &cache->entries[cache->count].list;
+   memset(list, 0, sizeof(WHBGfxDisplayList));
+   if (!WHBGfxDisplayListRecord(list, recordFn, userData)) {
+      return NULL;
+   }
+
+   cache->entries[cache->count++].key = key;
+   return list;
+}
@@ -0,0 +1,300 @@
+#include "gfx_heap.h"
+#include <coreinit/mutex.h>
+#include <string.h>
+#include <whb/gfx.h>
+#include <whb/log.h>
+
+// Small MEM2 resources are packed into 64 KiB chunks of equal slots, one
+// size class per power of two from 64 bytes to 4 KiB. A chunk only holds
+// resources with the same flags, so e.g. uniform blocks the CPU rewrites
+// every frame don't share cache lines with static vertex data.
+#define GFX_SLAB_CHUNK_SHIFT  16
+#define GFX_SLAB_CHUNK_SIZE   (1u << GFX_SLAB_CHUNK_SHIFT)
+#define GFX_SLAB_MIN_SHIFT    6
+#define GFX_SLAB_MAX_SHIFT    12
+#define GFX_SLAB_NUM_CLASSES  (GFX_SLAB_MAX_SHIFT - GFX_SLAB_MIN_SHIFT + 1)
+
+//! Flags that must match for two resources to share a chunk
+#define GFX_SLAB_FLAGS_MASK   (0x7FFFF)
+
+typedef struct GfxSlabChunk GfxSlabChunk;
+
+//! Lives in the first slot of its chunk
+struct GfxSlabChunk
+{
+   GfxSlabChunk *next;
+   GfxSlabChunk *prev;
+   uint32_t flags;
+   uint32_t sizeClass;
+   uint32_t used;
+   uint32_t capacity;
+
+   //! Freed slots, linked through their first word
+   void *freeList;
+
+   //! Offset of the first slot never handed out
+   uint32_t untouched;
+};
+
+//! Chunks with at least one free slot, per size class
+static GfxSlabChunk *
+sSlabPartial[GFX_SLAB_NUM_CLASSES];
+
+//! One bit per 64 KiB of address space, set where a chunk lives
+static uint32_t
+sSlabChunkMap[(1u << (32 - GFX_SLAB_CHUNK_SHIFT)) / 32];
+
+static uint32_t
+sSlabChunks = 0;
+
+static WHBGfxGX2RStats
+sGX2RStats;
+
+static OSMutex
+sGX2RMutex;
+
+static BOOL
+GfxIsMEM1Resource(GX2RResourceFlags flags)
+{
+   // Color, depth, scan buffers all belong in MEM1
+   return (flags & (GX2R_RESOURCE_BIND_COLOR_BUFFER
+                    | GX2R_RESOURCE_BIND_DEPTH_BUFFER
+                    | GX2R_RESOURCE_BIND_SCAN_BUFFER
+                    | GX2R_RESOURCE_USAGE_FORCE_MEM1))
+      && !(flags & GX2R_RESOURCE_USAGE_FORCE_MEM2);
+}
+
+static BOOL
+GfxSlabIsChunk(uint32_t chunk)
+{
+   uint32_t index = chunk >> GFX_SLAB_CHUNK_SHIFT;
+   return (sSlabChunkMap[index / 32] >> (index % 32)) & 1;
+}
+
+static void
+GfxSlabMarkChunk(uint32_t chunk,
+                 BOOL owned)
+{
+   uint32_t index = chunk >> GFX_SLAB_CHUNK_SHIFT;
+   if (owned) {
+      sSlabChunkMap[index / 32] |= 1u << (index % 32);
+   } else {
+      sSlabChunkMap[index / 32] &= ~(1u << (index % 32));
+   }
+}
+
+static void
+GfxSlabLink(GfxSlabChunk *chunk)
+{
+   GfxSlabChunk **head = &sSlabPartial[chunk->sizeClass];
+   chunk->prev = NULL;
+   chunk->next = *head;
+   if (*head) {
+      (*head)->prev = chunk;
+   }
+   *head = chunk;
+}
+
+static void
+GfxSlabUnlink(GfxSlabChunk *chunk)
+{
+   if (chunk->prev) {
+      chunk->prev->next = chunk->next;
+   } else {
+      sSlabPartial[chunk->sizeClass] = chunk->next;
+   }
+   if (chunk->next) {
+      chunk->next->prev = chunk->prev;
+   }
+   chunk->next = NULL;
+   chunk->prev = NULL;
+}
+
+static int
+GfxSlabSizeClass(uint32_t size,
+                 uint32_t alignment)
+{
+   uint32_t shift = GFX_SLAB_MIN_SHIFT;
+
+   if (alignment > size) {
+      size = alignment;
+   }
+
+   while ((1u << shift) < size) {
+      if (++shift > GFX_SLAB_MAX_SHIFT) {
+         return -1;
+      }
+   }
+
+   return shift - GFX_SLAB_MIN_SHIFT;
+}
+
+static void *
+GfxSlabAlloc(uint32_t flags,
+             uint32_t sizeClass)
+{
+   uint32_t slotSize = 1u << (sizeClass + GFX_SLAB_MIN_SHIFT);
+   GfxSlabChunk *chunk;
+   void *block;
+
+   for (chunk = sSlabPartial[sizeClass]; chunk; chunk = chunk->next) {
+      if (chunk->flags == flags) {
+         break;
+      }
+   }
+
+   if (!chunk) {
+      // Slots are naturally aligned, so the chunk must be too
+      chunk = (GfxSlabChunk *)GfxHeapAllocMEM2(GFX_SLAB_CHUNK_SIZE, GFX_SLAB_CHUNK_SIZE);
+      if (!chunk) {
+         return NULL;
+      }
+
+      memset(chunk, 0, sizeof(GfxSlabChunk));
+      chunk->flags = flags;
+      chunk->sizeClass = sizeClass;
+      chunk->capacity = GFX_SLAB_CHUNK_SIZE / slotSize - 1;
+      chunk->untouched = slotSize;
+      GfxSlabMarkChunk((uint32_t)chunk, TRUE);
+      GfxSlabLink(chunk);
+      sSlabChunks++;
+   }
+
+   if (chunk->freeList) {
+      block = chunk->freeList;
+      chunk->freeList = *(void **)block;
+   } else {
+      block = (uint8_t *)chunk + chunk->untouched;
+      chunk->untouched += slotSize;
+   }
+
+   if (++chunk->used == chunk->capacity) {
+      GfxSlabUnlink(chunk);
+   }
+
+   return block;
+}
+
+//! Returns the size of the slot, or 0 when the block is not from a chunk
+static uint32_t
+GfxSlabFree(void *block)
+{
+   GfxSlabChunk *chunk;
+   uint32_t base = (uint32_t)block & ~(GFX_SLAB_CHUNK_SIZE - 1);
+   uint32_t slotSize;
+
+   if (!GfxSlabIsChunk(base)) {
+      return 0;
+   }
+
+   chunk = (GfxSlabChunk *)base;
+   slotSize = 1u << (chunk->sizeClass + GFX_SLAB_MIN_SHIFT);
+   if (chunk->used == chunk->capacity) {
+      GfxSlabLink(chunk);
+   }
+
+   *(void **)block = chunk->freeList;
+   chunk->freeList = block;
+
+   if (--chunk->used == 0) {
+      GfxSlabUnlink(chunk);
+      GfxSlabMarkChunk(base, FALSE);
+      GfxHeapFreeMEM2(chunk);
+      sSlabChunks--;
+   }
+
+   return slotSize;
+}
+
+static void
+GfxGX2RCount(GX2RResourceFlags flags,
+             int32_t count,
+             int32_t slabBytes)
+{
+   uint32_t i;
+
+   for (i = 0; i < WHB_GFX_GX2R_BIND_COUNT; ++i) {
+      if (flags & (1u << i)) {
+         sGX2RStats.bind[i].allocations += count;
+         if (slabBytes) {
+            sGX2RStats.bind[i].slabAllocations += count;
+            sGX2RStats.bind[i].slabBytes += slabBytes;
+         }
+      }
+   }
+}
+
+void
+GfxGX2RInit()
+{
+   OSInitMutex(&sGX2RMutex);
+}
+
+void *
+GfxGX2RAlloc(GX2RResourceFlags flags,
+             uint32_t size,
+             uint32_t alignment)
+{
+   void *block = NULL;
+   int sizeClass = -1;
+
+   if (GfxIsMEM1Resource(flags)) {
+      block = GfxHeapAllocMEM1(size, alignment);
+   } else {
+      sizeClass = GfxSlabSizeClass(size, alignment);
+   }
+
+   OSLockMutex(&sGX2RMutex);
+   if (sizeClass >= 0) {
+      block = GfxSlabAlloc(flags & GFX_SLAB_FLAGS_MASK, (uint32_t)sizeClass);
+      if (!block) {
+         sizeClass = -1;
+      }
+   }
+
+   if (!block && !GfxIsMEM1Resource(flags)) {
+      block = GfxHeapAllocMEM2(size, alignment);
+   }
+
+   if (block) {
+      GfxGX2RCount(flags, 1,
+                   sizeClass >= 0 ? (int32_t)(1u << (sizeClass + GFX_SLAB_MIN_SHIFT)) : 0);
+   } else {
+      sGX2RStats.failures++;
+   }
+   OSUnlockMutex(&sGX2RMutex);
+   return block;
+}
+
+void
+GfxGX2RFree(GX2RResourceFlags flags,
+            void *block)
+{
+   uint32_t slotSize;
+
+   if (GfxIsMEM1Resource(flags)) {
+      GfxHeapFreeMEM1(block);
+      OSLockMutex(&sGX2RMutex);
+      GfxGX2RCount(flags, -1, 0);
+      OSUnlockMutex(&sGX2RMutex);
+      return;
+   }
+
+   OSLockMutex(&sGX2RMutex);
+   slotSize = GfxSlabFree(block);
+   if (!slotSize) {
+      GfxHeapFreeMEM2(block);
+   }
+   GfxGX2RCount(flags, -1, -(int32_t)slotSize);
+   OSUnlockMutex(&sGX2RMutex);
+}
+
+void
+WHBGfxGetGX2RStats(WHBGfxGX2RStats *outStats)
+{
+   OSLockMutex(&sGX2RMutex);
+   *outStats = sGX2RStats;
+   outStats->slabChunks = sSlabChunks;
+   outStats->slabChunkBytes = sSlabChunks * GFX_SLAB_CHUNK_SIZE;
+   OSUnlockMutex(&sGX2RMutex);
+}
@@ -1,9 +1,10 @@
 #include "gfx_heap.h"
 #include <coreinit/memheap.h>
-#include <coreinit/memdefaultheap.h>
 #include <coreinit/memexpheap.h>
 #include <coreinit/memfrmheap.h>
+#include <string.h>
 #include <whb/log.h>
+#include <wut_heap_budget.h>
 
 static void *
 sGfxHeapMEM1 = NULL;
@@ -11,6 +12,15 @@ sGfxHeapMEM1 = NULL;
 static void *
 sGfxHeapForeground = NULL;
 
+static uint32_t
+sGfxHeapMEM1Size = 0;
+
+static uint32_t
+sGfxHotSize = 0;
+
+static MEMHeapHandle
+sGfxHeapHot = NULL;
+
 #define GFX_FRAME_HEAP_TAG (0x123DECAF)
 
 BOOL
@@ -25,6 +35,22 @@ GfxHeapInitMEM1()
       return FALSE;
    }
 
+   // The hot slice is taken first so the graphics heap gets the rest
+   if (sGfxHotSize) {
+      base = MEMAllocFromFrmHeapEx(heap, sGfxHotSize, 64);
+      if (!base) {
+         WHBLogPrintf("%s: MEMAllocFromFrmHeapEx(heap, 0x%X, 64) for hot memory failed", __FUNCTION__, sGfxHotSize);
+         return FALSE;
+      }
+
+      // Shared by CPU threads, unlike the graphics heap
+      sGfxHeapHot = MEMCreateExpHeapEx(base, sGfxHotSize, MEM_HEAP_FLAG_USE_LOCK);
+      if (!sGfxHeapHot) {
+         WHBLogPrintf("%s: MEMCreateExpHeapEx(0x%08X, 0x%X, MEM_HEAP_FLAG_USE_LOCK) failed", __FUNCTION__, base, sGfxHotSize);
+         return FALSE;
+      }
+   }
+
    size = MEMGetAllocatableSizeForFrmHeapEx(heap, 4);
    if (!size) {
       WHBLogPrintf("%s: MEMGetAllocatableSizeForFrmHeapEx == 0", __FUNCTION__);
@@ -43,6 +69,7 @@ GfxHeapInitMEM1()
       return FALSE;
    }
 
+   sGfxHeapMEM1Size = size;
    return TRUE;
 }
 
@@ -54,6 +81,12 @@ GfxHeapDestroyMEM1()
    if (sGfxHeapMEM1) {
       MEMDestroyExpHeap(sGfxHeapMEM1);
       sGfxHeapMEM1 = NULL;
+      sGfxHeapMEM1Size = 0;
+   }
+
+   if (sGfxHeapHot) {
+      MEMDestroyExpHeap(sGfxHeapHot);
+      sGfxHeapHot = NULL;
    }
 
    MEMFreeByStateToFrmHeap(heap, GFX_FRAME_HEAP_TAG);
@@ -130,6 +163,51 @@ GfxHeapFreeMEM1(void *block)
    MEMFreeToExpHeap(sGfxHeapMEM1, block);
 }
 
+void
+GfxHeapGetMEM1Usage(WHBGfxMemoryUsage *usage)
+{
+   if (!sGfxHeapMEM1) {
+      memset(usage, 0, sizeof(WHBGfxMemoryUsage));
+      return;
+   }
+
+   usage->totalSize = sGfxHeapMEM1Size;
+   usage->freeSize = MEMGetTotalFreeSizeForExpHeap(sGfxHeapMEM1);
+   usage->usedSize = usage->totalSize - usage->freeSize;
+   usage->largestFreeBlock = MEMGetAllocatableSizeForExpHeapEx(sGfxHeapMEM1, 4);
+}
+
+void
+GfxHeapSetHotSize(uint32_t size)
+{
+   sGfxHotSize = (size + 63) & ~63;
+}
+
+void *
+WHBAllocHot(uint32_t size,
+            uint32_t alignment)
+{
+   if (!sGfxHeapHot) {
+      return NULL;
+   }
+
+   if (alignment < 4) {
+      alignment = 4;
+   }
+
+   return MEMAllocFromExpHeapEx(sGfxHeapHot, size, alignment);
+}
+
+void
+WHBFreeHot(void *block)
+{
+   if (!sGfxHeapHot || !block) {
+      return;
+   }
+
+   MEMFreeToExpHeap(sGfxHeapHot, block);
+}
+
 void *
 GfxHeapAllocForeground(uint32_t size,
                        uint32_t alignment)
@@ -162,15 +240,11 @@ void *
 GfxHeapAllocMEM2(uint32_t size,
                  uint32_t alignment)
 {
-   if (alignment < 4) {
-      alignment = 4;
-   }
-
-   return MEMAllocFromDefaultHeapEx(size, alignment);
+   return WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_GFX, size, alignment);
 }
 
 void
 GfxHeapFreeMEM2(void *block)
 {
-   MEMFreeToDefaultHeap(block);
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_GFX, block);
 }
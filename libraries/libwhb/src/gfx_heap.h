@@ -1,5 +1,13 @@
 #pragma once
 #include <wut.h>
+#include <gx2/texture.h>
+#include <gx2/utils.h>
+#include <gx2r/resource.h>
+#include <whb/gfx.h>
+
+//! Bytes of MEM1 GfxHeapInitMEM1 sets aside for WHBAllocHot
+void
+GfxHeapSetHotSize(uint32_t size);
 
 BOOL
 GfxHeapInitMEM1();
@@ -20,6 +28,57 @@ GfxHeapAllocMEM1(uint32_t size,
 void
 GfxHeapFreeMEM1(void *block);
 
+void
+GfxHeapGetMEM1Usage(WHBGfxMemoryUsage *usage);
+
+BOOL
+GfxTransientAcquire();
+
+void
+GfxTransientRelease();
+
+uint32_t
+GfxTransientGetPoolSize();
+
+void
+GfxTextureStreamShutdown();
+
+void
+GfxComputeShutdown();
+
+//! Called after loading a context state of its own, so the next
+//! WHBGfxBeginRenderTV or WHBGfxBeginRenderDRC loads theirs again
+void
+GfxForgetContextState();
+
+void
+GfxGeometryRingsShutdown();
+
+void
+GfxShaderInit();
+
+void
+GfxDisplayListInit();
+
+//! TRUE while the calling thread records a display list
+BOOL
+GfxDisplayListIsRecording();
+
+//! Component maps for GfxInitLinearTexture, selector 4 is zero and 5 is one
+#define GFX_COMP_MAP_R001 GX2_COMP_MAP(0, 4, 4, 5)
+#define GFX_COMP_MAP_RG01 GX2_COMP_MAP(0, 1, 4, 5)
+
+//! Describe a single level linear texture over existing memory, e.g. a
+//! plane written by a decoder or the camera
+void
+GfxInitLinearTexture(GX2Texture *texture,
+                     GX2SurfaceFormat format,
+                     uint32_t width,
+                     uint32_t height,
+                     uint32_t pitch,
+                     void *image,
+                     uint32_t compMap);
+
 void *
 GfxHeapAllocForeground(uint32_t size,
                        uint32_t alignment);
@@ -33,3 +92,16 @@ GfxHeapAllocMEM2(uint32_t size,
 
 void
 GfxHeapFreeMEM2(void *block);
+
+void
+GfxGX2RInit();
+
+//! GX2R allocator, small MEM2 resources come from GfxSlab chunks
+void *
+GfxGX2RAlloc(GX2RResourceFlags flags,
+             uint32_t size,
+             uint32_t alignment);
+
+void
+GfxGX2RFree(GX2RResourceFlags flags,
+            void *block);
@@ -1,6 +1,8 @@
 #include "gfx_heap.h"
+#include <coreinit/mutex.h>
 #include <gfd.h>
 #include <gx2r/buffer.h>
+#include <gx2/event.h>
 #include <gx2/mem.h>
 #include <gx2/shaders.h>
 #include <gx2/utils.h>
@@ -8,6 +10,38 @@
 #include <whb/gfx.h>
 #include <whb/log.h>
 
+typedef struct GfxFetchShaderCacheEntry GfxFetchShaderCacheEntry;
+
+struct GfxFetchShaderCacheEntry
+{
+   GfxFetchShaderCacheEntry *next;
+   uint32_t refCount;
+   uint32_t numAttributes;
+   GX2AttribStream attributes[16];
+   GX2FetchShader fetchShader;
+   void *program;
+};
+
+static GfxFetchShaderCacheEntry *
+sFetchShaderCache = NULL;
+
+//! Shader groups are also set up from job threads
+static OSMutex
+sFetchShaderCacheMutex;
+
+//! Shared by every geometry shader, sized for the largest ring items seen
+static void *
+sGeometryInputRing = NULL;
+
+static uint32_t
+sGeometryInputRingSize = 0;
+
+static void *
+sGeometryOutputRing = NULL;
+
+static uint32_t
+sGeometryOutputRingSize = 0;
+
 GX2PixelShader *
 WHBGfxLoadGFDPixelShader(uint32_t index,
                          const void *file)
@@ -192,6 +226,391 @@ WHBGfxFreeVertexShader(GX2VertexShader *shader)
    return TRUE;
 }
 
+GX2GeometryShader *
+WHBGfxLoadGFDGeometryShader(uint32_t index,
+                            const void *file)
+{
+   uint32_t headerSize, programSize, copyProgramSize, copyProgramOffset;
+   GX2GeometryShader *shader = NULL;
+   uint8_t *program = NULL;
+
+   if (index >= GFDGetGeometryShaderCount(file)) {
+      WHBLogPrintf("%s: index %u >= %u GFDGetGeometryShaderCount(file)",
+                   __FUNCTION__,
+                   index,
+                   GFDGetGeometryShaderCount(file));
+      goto error;
+   }
+
+   headerSize = GFDGetGeometryShaderHeaderSize(index, file);
+   if (!headerSize) {
+      WHBLogPrintf("%s: headerSize == 0", __FUNCTION__);
+      goto error;
+   }
+
+   programSize = GFDGetGeometryShaderProgramSize(index, file);
+   copyProgramSize = GFDGetGeometryShaderCopyProgramSize(index, file);
+   if (!programSize || !copyProgramSize) {
+      WHBLogPrintf("%s: programSize == 0 || copyProgramSize == 0", __FUNCTION__);
+      goto error;
+   }
+
+   shader = (GX2GeometryShader *)GfxHeapAllocMEM2(headerSize, 64);
+   if (!shader) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(%u, 64) failed", __FUNCTION__,
+                   headerSize);
+      goto error;
+   }
+
+   // The copy shader goes after the geometry shader in the same buffer
+   copyProgramOffset = (programSize + GX2_SHADER_PROGRAM_ALIGNMENT - 1)
+                     & ~(GX2_SHADER_PROGRAM_ALIGNMENT - 1);
+
+   shader->gx2rBuffer.flags = GX2R_RESOURCE_BIND_SHADER_PROGRAM |
+                              GX2R_RESOURCE_USAGE_CPU_READ |
+                              GX2R_RESOURCE_USAGE_CPU_WRITE |
+                              GX2R_RESOURCE_USAGE_GPU_READ;
+   shader->gx2rBuffer.elemSize = copyProgramOffset + copyProgramSize;
+   shader->gx2rBuffer.elemCount = 1;
+   shader->gx2rBuffer.buffer = NULL;
+   if (!GX2RCreateBuffer(&shader->gx2rBuffer)) {
+      WHBLogPrintf("%s: GX2RCreateBuffer failed with size = %u",
+                   __FUNCTION__, shader->gx2rBuffer.elemSize);
+      goto error;
+   }
+
+   program = (uint8_t *)GX2RLockBufferEx(&shader->gx2rBuffer, 0);
+   if (!program) {
+      WHBLogPrintf("%s: GX2RLockBufferEx failed", __FUNCTION__);
+      goto error;
+   }
+
+   if (!GFDGetGeometryShader(shader, program, program + copyProgramOffset, index, file)) {
+      WHBLogPrintf("%s: GFDGetGeometryShader failed", __FUNCTION__);
+      GX2RUnlockBufferEx(&shader->gx2rBuffer,
+                         GX2R_RESOURCE_DISABLE_CPU_INVALIDATE |
+                         GX2R_RESOURCE_DISABLE_GPU_INVALIDATE);
+      goto error;
+   }
+
+   GX2RUnlockBufferEx(&shader->gx2rBuffer, 0);
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_SHADER, program, shader->gx2rBuffer.elemSize);
+   return shader;
+
+error:
+   if (shader) {
+      if (shader->gx2rBuffer.buffer) {
+         GX2RDestroyBufferEx(&shader->gx2rBuffer, 0);
+      }
+
+      GfxHeapFreeMEM2(shader);
+   }
+
+   return NULL;
+}
+
+BOOL
+WHBGfxFreeGeometryShader(GX2GeometryShader *shader)
+{
+   if (shader->gx2rBuffer.buffer) {
+      GX2RDestroyBufferEx(&shader->gx2rBuffer, 0);
+   }
+
+   GfxHeapFreeMEM2(shader);
+   return TRUE;
+}
+
+BOOL
+WHBGfxReserveGeometryShaderRingBuffers(const GX2VertexShader *vertexShader,
+                                       const GX2GeometryShader *geometryShader)
+{
+   uint32_t inputSize = GX2CalcGeometryShaderInputRingBufferSize(vertexShader->ringItemsize);
+   uint32_t outputSize = GX2CalcGeometryShaderOutputRingBufferSize(geometryShader->ringItemSize);
+   void *input, *output;
+
+   if (inputSize <= sGeometryInputRingSize && outputSize <= sGeometryOutputRingSize) {
+      return TRUE;
+   }
+
+   if (inputSize < sGeometryInputRingSize) {
+      inputSize = sGeometryInputRingSize;
+   }
+
+   if (outputSize < sGeometryOutputRingSize) {
+      outputSize = sGeometryOutputRingSize;
+   }
+
+   input = GfxHeapAllocMEM2(inputSize, GX2_SHADER_PROGRAM_ALIGNMENT);
+   output = GfxHeapAllocMEM2(outputSize, GX2_SHADER_PROGRAM_ALIGNMENT);
+   if (!input || !output) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(0x%X / 0x%X) failed", __FUNCTION__,
+                   inputSize, outputSize);
+      if (input) {
+         GfxHeapFreeMEM2(input);
+      }
+      if (output) {
+         GfxHeapFreeMEM2(output);
+      }
+      return FALSE;
+   }
+
+   // Draws queued with the old rings may still be using them
+   if (sGeometryInputRing) {
+      GX2DrawDone();
+   }
+
+   GfxGeometryRingsShutdown();
+   sGeometryInputRing = input;
+   sGeometryInputRingSize = inputSize;
+   sGeometryOutputRing = output;
+   sGeometryOutputRingSize = outputSize;
+   return TRUE;
+}
+
+void
+WHBGfxSetGeometryShaderRingBuffers()
+{
+   if (!sGeometryInputRing) {
+      return;
+   }
+
+   GX2SetGeometryShaderInputRingBuffer(sGeometryInputRing, sGeometryInputRingSize);
+   GX2SetGeometryShaderOutputRingBuffer(sGeometryOutputRing, sGeometryOutputRingSize);
+}
+
+void
+GfxGeometryRingsShutdown()
+{
+   if (sGeometryInputRing) {
+      GfxHeapFreeMEM2(sGeometryInputRing);
+      sGeometryInputRing = NULL;
+      sGeometryInputRingSize = 0;
+   }
+
+   if (sGeometryOutputRing) {
+      GfxHeapFreeMEM2(sGeometryOutputRing);
+      sGeometryOutputRing = NULL;
+      sGeometryOutputRingSize = 0;
+   }
+}
+
+GX2PixelShader *
+WHBGfxLoadGFDPixelShaderInPlace(uint32_t index,
+                                const void *file)
+{
+   uint32_t headerSize;
+   GX2PixelShader *shader;
+
+   headerSize = GFDGetPixelShaderHeaderSize(index, file);
+   if (!headerSize) {
+      WHBLogPrintf("%s: headerSize == 0", __FUNCTION__);
+      return NULL;
+   }
+
+   shader = (GX2PixelShader *)GfxHeapAllocMEM2(headerSize, 64);
+   if (!shader) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(%u, 64) failed", __FUNCTION__,
+                   headerSize);
+      return NULL;
+   }
+
+   if (!GFDGetPixelShaderPointer(shader, index, file)) {
+      WHBLogPrintf("%s: GFDGetPixelShaderPointer failed: %s", __FUNCTION__,
+                   GFDGetLastErrorString());
+      GfxHeapFreeMEM2(shader);
+      return NULL;
+   }
+
+   // The program is not owned by a GX2R buffer, so freeing the shader only
+   // frees the header
+   memset(&shader->gx2rBuffer, 0, sizeof(shader->gx2rBuffer));
+   return shader;
+}
+
+GX2VertexShader *
+WHBGfxLoadGFDVertexShaderInPlace(uint32_t index,
+                                 const void *file)
+{
+   uint32_t headerSize;
+   GX2VertexShader *shader;
+
+   headerSize = GFDGetVertexShaderHeaderSize(index, file);
+   if (!headerSize) {
+      WHBLogPrintf("%s: headerSize == 0", __FUNCTION__);
+      return NULL;
+   }
+
+   shader = (GX2VertexShader *)GfxHeapAllocMEM2(headerSize, 64);
+   if (!shader) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(%u, 64) failed", __FUNCTION__,
+                   headerSize);
+      return NULL;
+   }
+
+   if (!GFDGetVertexShaderPointer(shader, index, file)) {
+      WHBLogPrintf("%s: GFDGetVertexShaderPointer failed: %s", __FUNCTION__,
+                   GFDGetLastErrorString());
+      GfxHeapFreeMEM2(shader);
+      return NULL;
+   }
+
+   memset(&shader->gx2rBuffer, 0, sizeof(shader->gx2rBuffer));
+   return shader;
+}
+
+void
+WHBGfxInvalidateGFDInPlace(const void *file,
+                           uint32_t size)
+{
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_SHADER, (void *)file, size);
+}
+
+static void *
+GfxStreamShaderHeader(GFDStream *stream)
+{
+   void *header = GfxHeapAllocMEM2(stream->block.dataSize, 64);
+   if (!header) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(%u, 64) failed", __FUNCTION__,
+                   stream->block.dataSize);
+      return NULL;
+   }
+
+   if (!GFDStreamReadShaderHeader(stream, header)) {
+      WHBLogPrintf("%s: GFDStreamReadShaderHeader failed: %s", __FUNCTION__,
+                   GFDGetLastErrorString());
+      GfxHeapFreeMEM2(header);
+      return NULL;
+   }
+
+   return header;
+}
+
+static BOOL
+GfxStreamShaderProgram(GFDStream *stream,
+                       GX2RBuffer *buffer,
+                       void **outProgram)
+{
+   void *program;
+   uint32_t size = stream->block.dataSize;
+
+   buffer->flags = GX2R_RESOURCE_BIND_SHADER_PROGRAM |
+                   GX2R_RESOURCE_USAGE_CPU_READ |
+                   GX2R_RESOURCE_USAGE_CPU_WRITE |
+                   GX2R_RESOURCE_USAGE_GPU_READ;
+   buffer->elemSize = size;
+   buffer->elemCount = 1;
+   buffer->buffer = NULL;
+   if (!GX2RCreateBuffer(buffer)) {
+      WHBLogPrintf("%s: GX2RCreateBuffer failed with programSize = %u",
+                   __FUNCTION__, size);
+      return FALSE;
+   }
+
+   program = GX2RLockBufferEx(buffer, 0);
+   if (!program) {
+      WHBLogPrintf("%s: GX2RLockBufferEx failed", __FUNCTION__);
+      return FALSE;
+   }
+
+   if (!GFDStreamReadBlockData(stream, program, size)) {
+      WHBLogPrintf("%s: GFDStreamReadBlockData failed: %s", __FUNCTION__,
+                   GFDGetLastErrorString());
+      GX2RUnlockBufferEx(buffer,
+                         GX2R_RESOURCE_DISABLE_CPU_INVALIDATE |
+                         GX2R_RESOURCE_DISABLE_GPU_INVALIDATE);
+      return FALSE;
+   }
+
+   GX2RUnlockBufferEx(buffer, 0);
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_SHADER, program, size);
+   *outProgram = program;
+   return TRUE;
+}
+
+BOOL
+WHBGfxLoadGFDShaderGroupFromFd(WHBGfxShaderGroup *group,
+                               uint32_t index,
+                               int fd)
+{
+   GFDStream stream;
+   uint32_t vertexHeaders = 0, vertexPrograms = 0;
+   uint32_t pixelHeaders = 0, pixelPrograms = 0;
+
+   memset(group, 0, sizeof(WHBGfxShaderGroup));
+
+   if (!GFDStreamInit(&stream, fd)) {
+      WHBLogPrintf("%s: GFDStreamInit failed: %s", __FUNCTION__,
+                   GFDGetLastErrorString());
+      return FALSE;
+   }
+
+   // Shader headers come before their programs
+   while (GFDStreamNextBlock(&stream)) {
+      switch (stream.block.type) {
+      case GFD_BLOCK_VERTEX_SHADER_HEADER:
+         if (vertexHeaders++ == index) {
+            group->vertexShader = (GX2VertexShader *)GfxStreamShaderHeader(&stream);
+            if (!group->vertexShader) {
+               goto error;
+            }
+
+            memset(&group->vertexShader->gx2rBuffer, 0,
+                   sizeof(group->vertexShader->gx2rBuffer));
+         }
+         break;
+      case GFD_BLOCK_VERTEX_SHADER_PROGRAM:
+         if (vertexPrograms++ == index && group->vertexShader) {
+            if (!GfxStreamShaderProgram(&stream,
+                                        &group->vertexShader->gx2rBuffer,
+                                        &group->vertexShader->program)) {
+               goto error;
+            }
+         }
+         break;
+      case GFD_BLOCK_PIXEL_SHADER_HEADER:
+         if (pixelHeaders++ == index) {
+            group->pixelShader = (GX2PixelShader *)GfxStreamShaderHeader(&stream);
+            if (!group->pixelShader) {
+               goto error;
+            }
+
+            memset(&group->pixelShader->gx2rBuffer, 0,
+                   sizeof(group->pixelShader->gx2rBuffer));
+         }
+         break;
+      case GFD_BLOCK_PIXEL_SHADER_PROGRAM:
+         if (pixelPrograms++ == index && group->pixelShader) {
+            if (!GfxStreamShaderProgram(&stream,
+                                        &group->pixelShader->gx2rBuffer,
+                                        &group->pixelShader->program)) {
+               goto error;
+            }
+         }
+         break;
+      default:
+         break;
+      }
+
+      if (vertexPrograms > index && pixelPrograms > index) {
+         break;
+      }
+   }
+
+   if (!group->vertexShader || !group->vertexShader->gx2rBuffer.buffer
+    || !group->pixelShader || !group->pixelShader->gx2rBuffer.buffer) {
+      WHBLogPrintf("%s: no shader group at index %u", __FUNCTION__, index);
+      goto error;
+   }
+
+   GFDStreamFree(&stream);
+   return TRUE;
+
+error:
+   WHBGfxFreeShaderGroup(group);
+   GFDStreamFree(&stream);
+   return FALSE;
+}
+
 BOOL
 WHBGfxLoadGFDShaderGroup(WHBGfxShaderGroup *group,
                          uint32_t index,
@@ -207,6 +626,58 @@ WHBGfxLoadGFDShaderGroup(WHBGfxShaderGroup *group,
       return FALSE;
    }
 
+   if (index < GFDGetGeometryShaderCount(file)) {
+      group->geometryShader = WHBGfxLoadGFDGeometryShader(index, file);
+      if (!group->geometryShader
+       || !WHBGfxReserveGeometryShaderRingBuffers(group->vertexShader,
+                                                  group->geometryShader)) {
+         WHBGfxFreeShaderGroup(group);
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+BOOL
+WHBGfxLoadGFDShaderGroups(WHBGfxShaderGroup *groups,
+                          const uint32_t *vertexIndices,
+                          const uint32_t *pixelIndices,
+                          uint32_t count,
+                          const void *file)
+{
+   GFDIndex index;
+   BOOL indexed;
+   uint32_t i;
+
+   // Index the file once instead of walking it for every lookup
+   indexed = GFDInitIndex(&index, file);
+
+   for (i = 0; i < count; ++i) {
+      WHBGfxShaderGroup *group = &groups[i];
+
+      memset(group, 0, sizeof(WHBGfxShaderGroup));
+      group->vertexShader = WHBGfxLoadGFDVertexShader(vertexIndices[i], file);
+      group->pixelShader = WHBGfxLoadGFDPixelShader(pixelIndices[i], file);
+
+      if (!group->vertexShader || !group->pixelShader) {
+         WHBLogPrintf("%s: failed to load shader group %u", __FUNCTION__, i);
+         break;
+      }
+   }
+
+   if (indexed) {
+      GFDFreeIndex(&index);
+   }
+
+   if (i != count) {
+      for (count = i + 1, i = 0; i < count; ++i) {
+         WHBGfxFreeShaderGroup(&groups[i]);
+      }
+
+      return FALSE;
+   }
+
    return TRUE;
 }
 
@@ -282,22 +753,103 @@ WHBGfxInitShaderAttribute(WHBGfxShaderGroup *group,
    return TRUE;
 }
 
+void
+GfxShaderInit()
+{
+   OSInitMutexEx(&sFetchShaderCacheMutex, "WHB fetch shader cache");
+}
+
+static void
+GfxReleaseFetchShader(void *program)
+{
+   GfxFetchShaderCacheEntry **link, *entry;
+
+   OSLockMutex(&sFetchShaderCacheMutex);
+   for (link = &sFetchShaderCache; *link; link = &(*link)->next) {
+      entry = *link;
+      if (entry->program != program) {
+         continue;
+      }
+
+      if (--entry->refCount == 0) {
+         *link = entry->next;
+         GfxHeapFreeMEM2(entry->program);
+         GfxHeapFreeMEM2(entry);
+      }
+
+      OSUnlockMutex(&sFetchShaderCacheMutex);
+      return;
+   }
+   OSUnlockMutex(&sFetchShaderCacheMutex);
+
+   // Not from the cache, e.g. set up by the application
+   GfxHeapFreeMEM2(program);
+}
+
 BOOL
 WHBGfxInitFetchShader(WHBGfxShaderGroup *group)
 {
-   uint32_t size = GX2CalcFetchShaderSizeEx(group->numAttributes,
-                                            GX2_FETCH_SHADER_TESSELLATION_NONE,
-                                            GX2_TESSELLATION_MODE_DISCRETE);
-   group->fetchShaderProgram = GfxHeapAllocMEM2(size, GX2_SHADER_PROGRAM_ALIGNMENT);
+   GfxFetchShaderCacheEntry *entry;
+   uint32_t size;
 
-   GX2InitFetchShaderEx(&group->fetchShader,
-                        group->fetchShaderProgram,
+   if (group->fetchShaderProgram) {
+      GfxReleaseFetchShader(group->fetchShaderProgram);
+      group->fetchShaderProgram = NULL;
+   }
+
+   // Groups with the same attribute layout can share one fetch shader
+   OSLockMutex(&sFetchShaderCacheMutex);
+   for (entry = sFetchShaderCache; entry; entry = entry->next) {
+      if (entry->numAttributes == group->numAttributes
+       && memcmp(entry->attributes, group->attributes,
+                 group->numAttributes * sizeof(GX2AttribStream)) == 0) {
+         entry->refCount++;
+         group->fetchShader = entry->fetchShader;
+         group->fetchShaderProgram = entry->program;
+         OSUnlockMutex(&sFetchShaderCacheMutex);
+         return TRUE;
+      }
+   }
+
+   entry = (GfxFetchShaderCacheEntry *)GfxHeapAllocMEM2(sizeof(GfxFetchShaderCacheEntry), 4);
+   if (!entry) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(%u, 4) failed", __FUNCTION__,
+                   sizeof(GfxFetchShaderCacheEntry));
+      OSUnlockMutex(&sFetchShaderCacheMutex);
+      return FALSE;
+   }
+
+   size = GX2CalcFetchShaderSizeEx(group->numAttributes,
+                                   GX2_FETCH_SHADER_TESSELLATION_NONE,
+                                   GX2_TESSELLATION_MODE_DISCRETE);
+   entry->program = GfxHeapAllocMEM2(size, GX2_SHADER_PROGRAM_ALIGNMENT);
+   if (!entry->program) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(%u, GX2_SHADER_PROGRAM_ALIGNMENT) failed",
+                   __FUNCTION__, size);
+      GfxHeapFreeMEM2(entry);
+      OSUnlockMutex(&sFetchShaderCacheMutex);
+      return FALSE;
+   }
+
+   GX2InitFetchShaderEx(&entry->fetchShader,
+                        entry->program,
                         group->numAttributes,
                         group->attributes,
                         GX2_FETCH_SHADER_TESSELLATION_NONE,
                         GX2_TESSELLATION_MODE_DISCRETE);
 
-   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_SHADER, group->fetchShaderProgram, size);
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_SHADER, entry->program, size);
+
+   entry->refCount = 1;
+   entry->numAttributes = group->numAttributes;
+   memcpy(entry->attributes, group->attributes,
+          group->numAttributes * sizeof(GX2AttribStream));
+   entry->next = sFetchShaderCache;
+   sFetchShaderCache = entry;
+
+   group->fetchShader = entry->fetchShader;
+   group->fetchShaderProgram = entry->program;
+   OSUnlockMutex(&sFetchShaderCacheMutex);
    return TRUE;
 }
 
@@ -305,7 +857,7 @@ BOOL
 WHBGfxFreeShaderGroup(WHBGfxShaderGroup *group)
 {
    if (group->fetchShaderProgram) {
-      GfxHeapFreeMEM2(group->fetchShaderProgram);
+      GfxReleaseFetchShader(group->fetchShaderProgram);
       group->fetchShaderProgram = NULL;
    }
 
@@ -319,5 +871,10 @@ WHBGfxFreeShaderGroup(WHBGfxShaderGroup *group)
       group->vertexShader = NULL;
    }
 
+   if (group->geometryShader) {
+      WHBGfxFreeGeometryShader(group->geometryShader);
+      group->geometryShader = NULL;
+   }
+
    return TRUE;
 }
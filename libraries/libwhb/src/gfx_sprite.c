@@ -0,0 +1,282 @@
+#include "gfx_heap.h"
+#include <gx2/draw.h>
+#include <gx2/mem.h>
+#include <stddef.h>
+#include <string.h>
+#include <whb/gfx.h>
+#include <whb/gfx_sprite.h>
+#include <whb/gfx_state.h>
+#include <whb/log.h>
+
+#define SPRITE_CORNER_BUFFER    0
+#define SPRITE_INSTANCE_BUFFER  1
+
+//! Corners of the quad as a triangle strip, shared by every instance
+static const float
+sSpriteCorners[8] __attribute__((aligned(GX2_VERTEX_BUFFER_ALIGNMENT))) = {
+   0.0f, 0.0f,
+   1.0f, 0.0f,
+   0.0f, 1.0f,
+   1.0f, 1.0f,
+};
+
+struct WHBGfxSpriteBatch
+{
+   uint32_t maxSprites;
+   WHBGfxSpriteSort sort;
+   GX2Sampler sampler;
+
+   //! Set by WHBGfxSpriteBatchBegin.
+   const WHBGfxShaderGroup *group;
+   WHBGpuRing *ring;
+
+   //! Sprites collected so far, and the index of their texture.
+   WHBGfxSprite *sprites;
+   uint8_t *slots;
+   uint32_t count;
+
+   const GX2Texture *textures[WHB_GFX_SPRITE_MAX_TEXTURES];
+   uint32_t counts[WHB_GFX_SPRITE_MAX_TEXTURES];
+   uint32_t numTextures;
+   uint32_t lastSlot;
+
+   WHBGfxSpriteBatchStats stats;
+};
+
+static void
+GfxSpriteDrawRun(WHBGfxSpriteBatch *batch,
+                 const GX2Texture *texture,
+                 const WHBGfxSprite *instances,
+                 uint32_t count)
+{
+   WHBGfxStateSetPixelTexture(texture, 0);
+   WHBGfxStateSetPixelSampler(&batch->sampler, 0);
+
+   // Pointing the buffer at the run doesn't depend on the base instance
+   // being applied to instance fetches
+   WHBGfxStateSetAttribBuffer(SPRITE_INSTANCE_BUFFER, count * sizeof(WHBGfxSprite),
+                              sizeof(WHBGfxSprite), instances);
+   GX2DrawEx2(GX2_PRIMITIVE_MODE_TRIANGLE_STRIP, 4, 0, count, 0);
+   batch->stats.draws++;
+}
+
+static void
+GfxSpriteFlush(WHBGfxSpriteBatch *batch)
+{
+   WHBGfxSprite *instances;
+   uint32_t i, start;
+
+   if (!batch->count) {
+      return;
+   }
+
+   instances = (WHBGfxSprite *)WHBGpuRingAlloc(batch->ring,
+                                                batch->count * sizeof(WHBGfxSprite),
+                                                GX2_VERTEX_BUFFER_ALIGNMENT);
+   if (!instances) {
+      batch->stats.dropped += batch->count;
+      goto reset;
+   }
+
+   WHBGfxStateSetShaderGroup(batch->group);
+   WHBGfxStateSetAttribBuffer(SPRITE_CORNER_BUFFER, sizeof(sSpriteCorners),
+                              2 * sizeof(float), sSpriteCorners);
+
+   if (batch->sort == WHB_GFX_SPRITE_SORT_TEXTURE) {
+      uint32_t offsets[WHB_GFX_SPRITE_MAX_TEXTURES];
+
+      // Counting sort, stable within a texture
+      for (i = 0, start = 0; i < batch->numTextures; ++i) {
+         offsets[i] = start;
+         start += batch->counts[i];
+      }
+
+      for (i = 0; i < batch->count; ++i) {
+         instances[offsets[batch->slots[i]]++] = batch->sprites[i];
+      }
+
+      for (i = 0, start = 0; i < batch->numTextures; ++i) {
+         GfxSpriteDrawRun(batch, batch->textures[i], instances + start, batch->counts[i]);
+         start += batch->counts[i];
+      }
+   } else {
+      memcpy(instances, batch->sprites, batch->count * sizeof(WHBGfxSprite));
+
+      for (i = 1, start = 0; i <= batch->count; ++i) {
+         if (i == batch->count || batch->slots[i] != batch->slots[start]) {
+            GfxSpriteDrawRun(batch, batch->textures[batch->slots[start]],
+                             instances + start, i - start);
+            start = i;
+         }
+      }
+   }
+
+reset:
+   batch->count = 0;
+   batch->numTextures = 0;
+   batch->lastSlot = 0;
+}
+
+//! Index of texture in the batch, drawing what's collected if it is full
+static uint32_t
+GfxSpriteGetSlot(WHBGfxSpriteBatch *batch,
+                 const GX2Texture *texture)
+{
+   uint32_t i;
+
+   if (batch->numTextures && batch->textures[batch->lastSlot] == texture) {
+      return batch->lastSlot;
+   }
+
+   // Without sorting a texture only continues the last run
+   if (batch->sort == WHB_GFX_SPRITE_SORT_TEXTURE) {
+      for (i = 0; i < batch->numTextures; ++i) {
+         if (batch->textures[i] == texture) {
+            batch->lastSlot = i;
+            return i;
+         }
+      }
+   }
+
+   if (batch->numTextures == WHB_GFX_SPRITE_MAX_TEXTURES) {
+      GfxSpriteFlush(batch);
+   }
+
+   i = batch->numTextures++;
+   batch->textures[i] = texture;
+   batch->counts[i] = 0;
+   batch->lastSlot = i;
+   return i;
+}
+
+BOOL
+WHBGfxSpriteBatchInitShaderGroup(WHBGfxShaderGroup *group)
+{
+   uint32_t i;
+
+   if (!WHBGfxInitShaderAttribute(group, "aCorner", SPRITE_CORNER_BUFFER, 0,
+                                  GX2_ATTRIB_FORMAT_FLOAT_32_32)
+    || !WHBGfxInitShaderAttribute(group, "aRect", SPRITE_INSTANCE_BUFFER,
+                                  offsetof(WHBGfxSprite, x),
+                                  GX2_ATTRIB_FORMAT_FLOAT_32_32_32_32)) {
+      WHBLogPrintf("%s: vertex shader has no aCorner or aRect", __FUNCTION__);
+      return FALSE;
+   }
+
+   // The rest are left out when the shader doesn't use them
+   WHBGfxInitShaderAttribute(group, "aTexRect", SPRITE_INSTANCE_BUFFER,
+                             offsetof(WHBGfxSprite, u0),
+                             GX2_ATTRIB_FORMAT_FLOAT_32_32_32_32);
+   WHBGfxInitShaderAttribute(group, "aRotation", SPRITE_INSTANCE_BUFFER,
+                             offsetof(WHBGfxSprite, rotation),
+                             GX2_ATTRIB_FORMAT_FLOAT_32);
+   WHBGfxInitShaderAttribute(group, "aColor", SPRITE_INSTANCE_BUFFER,
+                             offsetof(WHBGfxSprite, color),
+                             GX2_ATTRIB_FORMAT_UNORM_8_8_8_8);
+
+   for (i = 0; i < group->numAttributes; ++i) {
+      if (group->attributes[i].buffer == SPRITE_INSTANCE_BUFFER) {
+         group->attributes[i].type = GX2_ATTRIB_INDEX_PER_INSTANCE;
+         group->attributes[i].aluDivisor = 1;
+      }
+   }
+
+   return WHBGfxInitFetchShader(group);
+}
+
+WHBGfxSpriteBatch *
+WHBGfxSpriteBatchCreate(uint32_t maxSprites,
+                        WHBGfxSpriteSort sort)
+{
+   WHBGfxSpriteBatch *batch;
+
+   batch = (WHBGfxSpriteBatch *)GfxHeapAllocMEM2(sizeof(WHBGfxSpriteBatch), 4);
+   if (!batch) {
+      return NULL;
+   }
+
+   memset(batch, 0, sizeof(WHBGfxSpriteBatch));
+   batch->maxSprites = maxSprites;
+   batch->sort = sort;
+   batch->sprites = (WHBGfxSprite *)GfxHeapAllocMEM2(maxSprites * sizeof(WHBGfxSprite), 4);
+   batch->slots = (uint8_t *)GfxHeapAllocMEM2(maxSprites, 4);
+   if (!maxSprites || !batch->sprites || !batch->slots) {
+      WHBLogPrintf("%s: failed to allocate %u sprites", __FUNCTION__, maxSprites);
+      WHBGfxSpriteBatchDestroy(batch);
+      return NULL;
+   }
+
+   GX2InitSampler(&batch->sampler, GX2_TEX_CLAMP_MODE_CLAMP, GX2_TEX_XY_FILTER_MODE_LINEAR);
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU_ATTRIBUTE_BUFFER, (void *)sSpriteCorners, sizeof(sSpriteCorners));
+   return batch;
+}
+
+void
+WHBGfxSpriteBatchDestroy(WHBGfxSpriteBatch *batch)
+{
+   if (!batch) {
+      return;
+   }
+
+   if (batch->sprites) {
+      GfxHeapFreeMEM2(batch->sprites);
+   }
+
+   if (batch->slots) {
+      GfxHeapFreeMEM2(batch->slots);
+   }
+
+   GfxHeapFreeMEM2(batch);
+}
+
+void
+WHBGfxSpriteBatchSetSampler(WHBGfxSpriteBatch *batch,
+                            const GX2Sampler *sampler)
+{
+   batch->sampler = *sampler;
+}
+
+void
+WHBGfxSpriteBatchBegin(WHBGfxSpriteBatch *batch,
+                       const WHBGfxShaderGroup *group,
+                       WHBGpuRing *ring)
+{
+   batch->group = group;
+   batch->ring = ring;
+   batch->count = 0;
+   batch->numTextures = 0;
+   batch->lastSlot = 0;
+   memset(&batch->stats, 0, sizeof(batch->stats));
+}
+
+void
+WHBGfxSpriteBatchDraw(WHBGfxSpriteBatch *batch,
+                      const GX2Texture *texture,
+                      const WHBGfxSprite *sprite)
+{
+   uint32_t slot;
+
+   if (batch->count == batch->maxSprites) {
+      GfxSpriteFlush(batch);
+   }
+
+   slot = GfxSpriteGetSlot(batch, texture);
+   batch->sprites[batch->count] = *sprite;
+   batch->slots[batch->count] = (uint8_t)slot;
+   batch->counts[slot]++;
+   batch->count++;
+   batch->stats.sprites++;
+}
+
+void
+WHBGfxSpriteBatchEnd(WHBGfxSpriteBatch *batch)
+{
+   GfxSpriteFlush(batch);
+}
+
+void
+WHBGfxSpriteBatchGetStats(WHBGfxSpriteBatch *batch,
+                          WHBGfxSpriteBatchStats *outStats)
+{
+   *outStats = batch->stats;
+}
@@ -0,0 +1,421 @@
+#include "gfx_heap.h"
+#include <gx2/draw.h>
+#include <gx2/registers.h>
+#include <gx2/sampler.h>
+#include <gx2/shaders.h>
+#include <gx2/texture.h>
+#include <string.h>
+#include <whb/gfx_state.h>
+
+#define MAX_RENDER_TARGETS 8
+
+typedef enum GfxStateSlot
+{
+   GFX_STATE_FETCH_SHADER,
+   GFX_STATE_VERTEX_SHADER,
+   GFX_STATE_PIXEL_SHADER,
+   GFX_STATE_GEOMETRY_SHADER,
+   GFX_STATE_SHADER_MODE,
+   GFX_STATE_BLEND_CONSTANT,
+   GFX_STATE_COLOR_CONTROL,
+   GFX_STATE_CHANNEL_MASKS,
+   GFX_STATE_ALPHA_TEST,
+   GFX_STATE_DEPTH_STENCIL,
+   GFX_STATE_CULL,
+   GFX_STATE_VIEWPORT,
+   GFX_STATE_SCISSOR,
+   GFX_STATE_BLEND_CONTROL,
+   GFX_STATE_VERTEX_UNIFORM_BLOCK  = GFX_STATE_BLEND_CONTROL + MAX_RENDER_TARGETS,
+   GFX_STATE_PIXEL_UNIFORM_BLOCK   = GFX_STATE_VERTEX_UNIFORM_BLOCK + WHB_GFX_STATE_MAX_UNIFORM_BLOCKS,
+   GFX_STATE_GEOMETRY_UNIFORM_BLOCK = GFX_STATE_PIXEL_UNIFORM_BLOCK + WHB_GFX_STATE_MAX_UNIFORM_BLOCKS,
+   GFX_STATE_ATTRIB_BUFFER         = GFX_STATE_GEOMETRY_UNIFORM_BLOCK + WHB_GFX_STATE_MAX_UNIFORM_BLOCKS,
+   GFX_STATE_PIXEL_TEXTURE         = GFX_STATE_ATTRIB_BUFFER + WHB_GFX_STATE_MAX_ATTRIB_BUFFERS,
+   GFX_STATE_VERTEX_TEXTURE        = GFX_STATE_PIXEL_TEXTURE + WHB_GFX_STATE_MAX_TEXTURES,
+   GFX_STATE_PIXEL_SAMPLER         = GFX_STATE_VERTEX_TEXTURE + WHB_GFX_STATE_MAX_TEXTURES,
+   GFX_STATE_VERTEX_SAMPLER        = GFX_STATE_PIXEL_SAMPLER + WHB_GFX_STATE_MAX_TEXTURES,
+   GFX_STATE_NUM_SLOTS             = GFX_STATE_VERTEX_SAMPLER + WHB_GFX_STATE_MAX_TEXTURES,
+} GfxStateSlot;
+
+//! Largest set of arguments shadowed, the depth stencil control.
+#define GFX_STATE_MAX_ARGS 14
+
+// Every argument is stored as a 32-bit word, so records have no padding
+// and compare with memcmp
+typedef struct GfxStateRecord
+{
+   uint32_t args[GFX_STATE_MAX_ARGS];
+} GfxStateRecord;
+
+static GfxStateRecord sRecords[GFX_STATE_NUM_SLOTS];
+static uint8_t sValid[GFX_STATE_NUM_SLOTS];
+static WHBGfxStateStats sStats;
+
+//! Store the value of a slot, returns FALSE if it was set already.
+static BOOL
+GfxStateUpdate(uint32_t slot,
+               const uint32_t *args,
+               uint32_t numArgs)
+{
+   GfxStateRecord *record = &sRecords[slot];
+
+   // The shadow follows the main command buffer, what a display list sets
+   // only applies where the list is called
+   if (GfxDisplayListIsRecording()) {
+      return TRUE;
+   }
+
+   if (sValid[slot] && !memcmp(record->args, args, numArgs * sizeof(uint32_t))) {
+      sStats.skipped++;
+      return FALSE;
+   }
+
+   memcpy(record->args, args, numArgs * sizeof(uint32_t));
+   sValid[slot] = 1;
+   sStats.issued++;
+   return TRUE;
+}
+
+static uint32_t
+GfxStateFloatBits(float value)
+{
+   uint32_t bits;
+   memcpy(&bits, &value, sizeof(bits));
+   return bits;
+}
+
+void
+WHBGfxStateInvalidate()
+{
+   memset(sValid, 0, sizeof(sValid));
+}
+
+void
+WHBGfxStateGetStats(WHBGfxStateStats *outStats)
+{
+   *outStats = sStats;
+}
+
+void
+WHBGfxStateResetStats()
+{
+   memset(&sStats, 0, sizeof(sStats));
+}
+
+void
+WHBGfxStateSetFetchShader(const GX2FetchShader *shader)
+{
+   uint32_t args[] = { (uint32_t)shader };
+   if (GfxStateUpdate(GFX_STATE_FETCH_SHADER, args, 1)) {
+      GX2SetFetchShader(shader);
+   }
+}
+
+void
+WHBGfxStateSetVertexShader(const GX2VertexShader *shader)
+{
+   uint32_t args[] = { (uint32_t)shader };
+   if (GfxStateUpdate(GFX_STATE_VERTEX_SHADER, args, 1)) {
+      GX2SetVertexShader(shader);
+   }
+}
+
+void
+WHBGfxStateSetPixelShader(const GX2PixelShader *shader)
+{
+   uint32_t args[] = { (uint32_t)shader };
+   if (GfxStateUpdate(GFX_STATE_PIXEL_SHADER, args, 1)) {
+      GX2SetPixelShader(shader);
+   }
+}
+
+void
+WHBGfxStateSetGeometryShader(const GX2GeometryShader *shader)
+{
+   uint32_t args[] = { (uint32_t)shader };
+   if (GfxStateUpdate(GFX_STATE_GEOMETRY_SHADER, args, 1)) {
+      GX2SetGeometryShader(shader);
+   }
+}
+
+void
+WHBGfxStateSetShaderGroup(const WHBGfxShaderGroup *group)
+{
+   WHBGfxStateSetFetchShader(&group->fetchShader);
+   WHBGfxStateSetVertexShader(group->vertexShader);
+   WHBGfxStateSetPixelShader(group->pixelShader);
+
+   if (group->geometryShader) {
+      WHBGfxStateSetGeometryShader(group->geometryShader);
+      WHBGfxSetGeometryShaderRingBuffers();
+   }
+}
+
+void
+WHBGfxStateSetShaderMode(GX2ShaderMode mode)
+{
+   uint32_t args[] = { (uint32_t)mode };
+   if (GfxStateUpdate(GFX_STATE_SHADER_MODE, args, 1)) {
+      GX2SetShaderMode(mode);
+   }
+}
+
+void
+WHBGfxStateSetVertexUniformBlock(uint32_t location,
+                                 uint32_t size,
+                                 const void *data)
+{
+   uint32_t args[] = { size, (uint32_t)data };
+   if (location >= WHB_GFX_STATE_MAX_UNIFORM_BLOCKS ||
+       GfxStateUpdate(GFX_STATE_VERTEX_UNIFORM_BLOCK + location, args, 2)) {
+      GX2SetVertexUniformBlock(location, size, data);
+   }
+}
+
+void
+WHBGfxStateSetPixelUniformBlock(uint32_t location,
+                                uint32_t size,
+                                const void *data)
+{
+   uint32_t args[] = { size, (uint32_t)data };
+   if (location >= WHB_GFX_STATE_MAX_UNIFORM_BLOCKS ||
+       GfxStateUpdate(GFX_STATE_PIXEL_UNIFORM_BLOCK + location, args, 2)) {
+      GX2SetPixelUniformBlock(location, size, data);
+   }
+}
+
+void
+WHBGfxStateSetGeometryUniformBlock(uint32_t location,
+                                   uint32_t size,
+                                   const void *data)
+{
+   uint32_t args[] = { size, (uint32_t)data };
+   if (location >= WHB_GFX_STATE_MAX_UNIFORM_BLOCKS ||
+       GfxStateUpdate(GFX_STATE_GEOMETRY_UNIFORM_BLOCK + location, args, 2)) {
+      GX2SetGeometryUniformBlock(location, size, data);
+   }
+}
+
+void
+WHBGfxStateSetAttribBuffer(uint32_t index,
+                           uint32_t size,
+                           uint32_t stride,
+                           const void *buffer)
+{
+   uint32_t args[] = { size, stride, (uint32_t)buffer };
+   if (index >= WHB_GFX_STATE_MAX_ATTRIB_BUFFERS ||
+       GfxStateUpdate(GFX_STATE_ATTRIB_BUFFER + index, args, 3)) {
+      GX2SetAttribBuffer(index, size, stride, buffer);
+   }
+}
+
+void
+WHBGfxStateSetPixelTexture(const GX2Texture *texture,
+                           uint32_t unit)
+{
+   uint32_t args[] = { (uint32_t)texture };
+   if (unit >= WHB_GFX_STATE_MAX_TEXTURES ||
+       GfxStateUpdate(GFX_STATE_PIXEL_TEXTURE + unit, args, 1)) {
+      GX2SetPixelTexture(texture, unit);
+   }
+}
+
+void
+WHBGfxStateSetVertexTexture(const GX2Texture *texture,
+                            uint32_t unit)
+{
+   uint32_t args[] = { (uint32_t)texture };
+   if (unit >= WHB_GFX_STATE_MAX_TEXTURES ||
+       GfxStateUpdate(GFX_STATE_VERTEX_TEXTURE + unit, args, 1)) {
+      GX2SetVertexTexture(texture, unit);
+   }
+}
+
+void
+WHBGfxStateSetPixelSampler(const GX2Sampler *sampler,
+                           uint32_t id)
+{
+   uint32_t args[] = { (uint32_t)sampler };
+   if (id >= WHB_GFX_STATE_MAX_TEXTURES ||
+       GfxStateUpdate(GFX_STATE_PIXEL_SAMPLER + id, args, 1)) {
+      GX2SetPixelSampler(sampler, id);
+   }
+}
+
+void
+WHBGfxStateSetVertexSampler(const GX2Sampler *sampler,
+                            uint32_t id)
+{
+   uint32_t args[] = { (uint32_t)sampler };
+   if (id >= WHB_GFX_STATE_MAX_TEXTURES ||
+       GfxStateUpdate(GFX_STATE_VERTEX_SAMPLER + id, args, 1)) {
+      GX2SetVertexSampler(sampler, id);
+   }
+}
+
+void
+WHBGfxStateSetBlendControl(GX2RenderTarget target,
+                           GX2BlendMode colorSrcBlend,
+                           GX2BlendMode colorDstBlend,
+                           GX2BlendCombineMode colorCombine,
+                           BOOL useAlphaBlend,
+                           GX2BlendMode alphaSrcBlend,
+                           GX2BlendMode alphaDstBlend,
+                           GX2BlendCombineMode alphaCombine)
+{
+   uint32_t args[] = {
+      (uint32_t)colorSrcBlend, (uint32_t)colorDstBlend, (uint32_t)colorCombine,
+      (uint32_t)useAlphaBlend,
+      (uint32_t)alphaSrcBlend, (uint32_t)alphaDstBlend, (uint32_t)alphaCombine,
+   };
+   if ((uint32_t)target >= MAX_RENDER_TARGETS ||
+       GfxStateUpdate(GFX_STATE_BLEND_CONTROL + target, args, 7)) {
+      GX2SetBlendControl(target, colorSrcBlend, colorDstBlend, colorCombine,
+                         useAlphaBlend, alphaSrcBlend, alphaDstBlend, alphaCombine);
+   }
+}
+
+void
+WHBGfxStateSetBlendConstantColor(float red,
+                                 float green,
+                                 float blue,
+                                 float alpha)
+{
+   uint32_t args[] = {
+      GfxStateFloatBits(red), GfxStateFloatBits(green),
+      GfxStateFloatBits(blue), GfxStateFloatBits(alpha),
+   };
+   if (GfxStateUpdate(GFX_STATE_BLEND_CONSTANT, args, 4)) {
+      GX2SetBlendConstantColor(red, green, blue, alpha);
+   }
+}
+
+void
+WHBGfxStateSetColorControl(GX2LogicOp rop3,
+                           uint8_t targetBlendEnable,
+                           BOOL multiWriteEnable,
+                           BOOL colorWriteEnable)
+{
+   uint32_t args[] = {
+      (uint32_t)rop3, targetBlendEnable,
+      (uint32_t)multiWriteEnable, (uint32_t)colorWriteEnable,
+   };
+   if (GfxStateUpdate(GFX_STATE_COLOR_CONTROL, args, 4)) {
+      GX2SetColorControl(rop3, targetBlendEnable, multiWriteEnable, colorWriteEnable);
+   }
+}
+
+void
+WHBGfxStateSetTargetChannelMasks(GX2ChannelMask mask0,
+                                 GX2ChannelMask mask1,
+                                 GX2ChannelMask mask2,
+                                 GX2ChannelMask mask3,
+                                 GX2ChannelMask mask4,
+                                 GX2ChannelMask mask5,
+                                 GX2ChannelMask mask6,
+                                 GX2ChannelMask mask7)
+{
+   uint32_t args[] = {
+      (uint32_t)mask0, (uint32_t)mask1, (uint32_t)mask2, (uint32_t)mask3,
+      (uint32_t)mask4, (uint32_t)mask5, (uint32_t)mask6, (uint32_t)mask7,
+   };
+   if (GfxStateUpdate(GFX_STATE_CHANNEL_MASKS, args, 8)) {
+      GX2SetTargetChannelMasks(mask0, mask1, mask2, mask3, mask4, mask5, mask6, mask7);
+   }
+}
+
+void
+WHBGfxStateSetAlphaTest(BOOL alphaTest,
+                        GX2CompareFunction func,
+                        float ref)
+{
+   uint32_t args[] = { (uint32_t)alphaTest, (uint32_t)func, GfxStateFloatBits(ref) };
+   if (GfxStateUpdate(GFX_STATE_ALPHA_TEST, args, 3)) {
+      GX2SetAlphaTest(alphaTest, func, ref);
+   }
+}
+
+void
+WHBGfxStateSetDepthOnlyControl(BOOL depthTest,
+                               BOOL depthWrite,
+                               GX2CompareFunction depthCompare)
+{
+   // The first word tells the two functions apart
+   uint32_t args[] = { 0, (uint32_t)depthTest, (uint32_t)depthWrite, (uint32_t)depthCompare };
+   if (GfxStateUpdate(GFX_STATE_DEPTH_STENCIL, args, 4)) {
+      GX2SetDepthOnlyControl(depthTest, depthWrite, depthCompare);
+   }
+}
+
+void
+WHBGfxStateSetDepthStencilControl(BOOL depthTest,
+                                  BOOL depthWrite,
+                                  GX2CompareFunction depthCompare,
+                                  BOOL stencilTest,
+                                  BOOL backfaceStencil,
+                                  GX2CompareFunction frontStencilFunc,
+                                  GX2StencilFunction frontStencilZPass,
+                                  GX2StencilFunction frontStencilZFail,
+                                  GX2StencilFunction frontStencilFail,
+                                  GX2CompareFunction backStencilFunc,
+                                  GX2StencilFunction backStencilZPass,
+                                  GX2StencilFunction backStencilZFail,
+                                  GX2StencilFunction backStencilFail)
+{
+   uint32_t args[] = {
+      1, (uint32_t)depthTest, (uint32_t)depthWrite, (uint32_t)depthCompare,
+      (uint32_t)stencilTest, (uint32_t)backfaceStencil,
+      (uint32_t)frontStencilFunc, (uint32_t)frontStencilZPass,
+      (uint32_t)frontStencilZFail, (uint32_t)frontStencilFail,
+      (uint32_t)backStencilFunc, (uint32_t)backStencilZPass,
+      (uint32_t)backStencilZFail, (uint32_t)backStencilFail,
+   };
+   if (GfxStateUpdate(GFX_STATE_DEPTH_STENCIL, args, 14)) {
+      GX2SetDepthStencilControl(depthTest, depthWrite, depthCompare,
+                                stencilTest, backfaceStencil,
+                                frontStencilFunc, frontStencilZPass,
+                                frontStencilZFail, frontStencilFail,
+                                backStencilFunc, backStencilZPass,
+                                backStencilZFail, backStencilFail);
+   }
+}
+
+void
+WHBGfxStateSetCullOnlyControl(GX2FrontFace frontFace,
+                              BOOL cullFront,
+                              BOOL cullBack)
+{
+   uint32_t args[] = { (uint32_t)frontFace, (uint32_t)cullFront, (uint32_t)cullBack };
+   if (GfxStateUpdate(GFX_STATE_CULL, args, 3)) {
+      GX2SetCullOnlyControl(frontFace, cullFront, cullBack);
+   }
+}
+
+void
+WHBGfxStateSetViewport(float x,
+                       float y,
+                       float width,
+                       float height,
+                       float nearZ,
+                       float farZ)
+{
+   uint32_t args[] = {
+      GfxStateFloatBits(x), GfxStateFloatBits(y),
+      GfxStateFloatBits(width), GfxStateFloatBits(height),
+      GfxStateFloatBits(nearZ), GfxStateFloatBits(farZ),
+   };
+   if (GfxStateUpdate(GFX_STATE_VIEWPORT, args, 6)) {
+      GX2SetViewport(x, y, width, height, nearZ, farZ);
+   }
+}
+
+void
+WHBGfxStateSetScissor(uint32_t x,
+                      uint32_t y,
+                      uint32_t width,
+                      uint32_t height)
+{
+   uint32_t args[] = { x, y, width, height };
+   if (GfxStateUpdate(GFX_STATE_SCISSOR, args, 4)) {
+      GX2SetScissor(x, y, width, height);
+   }
+}
@@ -1,13 +1,31 @@
 #include "gfx_heap.h"
+#include "../../wutthreadstats/wut_thread_stats.h"
+#include <coreinit/cache.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/thread.h>
+#include <dmae/mem.h>
 #include <gfd.h>
 #include <gx2r/surface.h>
+#include <gx2/surface.h>
 #include <gx2/texture.h>
+#include <string.h>
+#include <sys/param.h>
 #include <whb/log.h>
 #include <whb/gfx.h>
+#include <wut_thread_stats.h>
 
 GX2Texture *
 WHBGfxLoadGFDTexture(uint32_t index,
                      const void *file)
+{
+   return WHBGfxLoadGFDTextureEx(index, file, 0, 0);
+}
+
+GX2Texture *
+WHBGfxLoadGFDTextureEx(uint32_t index,
+                       const void *file,
+                       uint32_t skipLevels,
+                       uint32_t maxSize)
 {
    uint32_t headerSize, imageSize;
    GX2Texture *texture = NULL;
@@ -31,7 +49,7 @@ WHBGfxLoadGFDTexture(uint32_t index,
       goto error;
    }
 
-   if (!GFDGetGX2RTexture(texture, index, file)) {
+   if (!GFDGetGX2RTextureEx(texture, index, file, skipLevels, maxSize)) {
       goto error;
    }
 
@@ -46,6 +64,108 @@ error:
    return NULL;
 }
 
+GX2Texture *
+WHBGfxLoadGFDTextureFromFd(uint32_t index,
+                           int fd)
+{
+   GFDStream stream;
+   GX2Texture *texture = NULL;
+   uint32_t headerCount = 0, imageCount = 0, mipCount = 0;
+   BOOL haveImage = FALSE;
+
+   if (!GFDStreamInit(&stream, fd)) {
+      WHBLogPrintf("%s: GFDStreamInit failed: %s", __FUNCTION__,
+                   GFDGetLastErrorString());
+      return NULL;
+   }
+
+   // Texture headers come before their image and mipmap blocks
+   while (GFDStreamNextBlock(&stream)) {
+      if (stream.block.type == GFD_BLOCK_TEXTURE_HEADER) {
+         if (headerCount++ != index) {
+            if (texture) {
+               break;
+            }
+
+            continue;
+         }
+
+         if (stream.block.dataSize < sizeof(GX2Texture)) {
+            WHBLogPrintf("%s: texture header too small", __FUNCTION__);
+            goto error;
+         }
+
+         texture = (GX2Texture *)GfxHeapAllocMEM2(sizeof(GX2Texture), 64);
+         if (!texture) {
+            WHBLogPrintf("%s: GfxHeapAllocMEM2(0x%X, 64) failed", __FUNCTION__,
+                         sizeof(GX2Texture));
+            goto error;
+         }
+
+         if (!GFDStreamReadBlockData(&stream, texture, sizeof(GX2Texture))) {
+            GfxHeapFreeMEM2(texture);
+            texture = NULL;
+            goto error;
+         }
+
+         texture->surface.image = NULL;
+         texture->surface.mipmaps = NULL;
+         if (!GX2RCreateSurface(&texture->surface,
+                                GX2R_RESOURCE_BIND_TEXTURE
+                              | GX2R_RESOURCE_USAGE_CPU_READ
+                              | GX2R_RESOURCE_USAGE_CPU_WRITE
+                              | GX2R_RESOURCE_USAGE_GPU_READ)) {
+            WHBLogPrintf("%s: GX2RCreateSurface failed", __FUNCTION__);
+            GfxHeapFreeMEM2(texture);
+            texture = NULL;
+            goto error;
+         }
+      } else if (stream.block.type == GFD_BLOCK_TEXTURE_IMAGE) {
+         if (imageCount++ != index || !texture) {
+            continue;
+         }
+
+         if (!GFDStreamReadBlockData(&stream, texture->surface.image,
+                                     MIN(stream.block.dataSize, texture->surface.imageSize))) {
+            goto error;
+         }
+
+         haveImage = TRUE;
+      } else if (stream.block.type == GFD_BLOCK_TEXTURE_MIPMAP) {
+         if (mipCount++ != index || !texture || !texture->surface.mipmaps) {
+            continue;
+         }
+
+         if (!GFDStreamReadBlockData(&stream, texture->surface.mipmaps,
+                                     MIN(stream.block.dataSize, texture->surface.mipmapSize))) {
+            goto error;
+         }
+      }
+   }
+
+   if (!haveImage) {
+      WHBLogPrintf("%s: no image for GFD texture index %u", __FUNCTION__, index);
+      goto error;
+   }
+
+   // The data was written through the CPU, flush it out for the GPU
+   GX2RInvalidateSurface(&texture->surface, 0, 0);
+   if (texture->surface.mipmaps) {
+      GX2RInvalidateSurface(&texture->surface, -1, 0);
+   }
+
+   GFDStreamFree(&stream);
+   return texture;
+
+error:
+   if (texture) {
+      WHBGfxFreeTexture(texture);
+   }
+
+   GFDStreamFree(&stream);
+   return NULL;
+}
+
 BOOL
 WHBGfxFreeTexture(GX2Texture *texture)
 {
@@ -53,3 +173,225 @@ WHBGfxFreeTexture(GX2Texture *texture)
    GfxHeapFreeMEM2(texture);
    return TRUE;
 }
+
+void
+GfxInitLinearTexture(GX2Texture *texture,
+                     GX2SurfaceFormat format,
+                     uint32_t width,
+                     uint32_t height,
+                     uint32_t pitch,
+                     void *image,
+                     uint32_t compMap)
+{
+   memset(texture, 0, sizeof(GX2Texture));
+   texture->surface.dim = GX2_SURFACE_DIM_TEXTURE_2D;
+   texture->surface.width = width;
+   texture->surface.height = height;
+   texture->surface.depth = 1;
+   texture->surface.mipLevels = 1;
+   texture->surface.format = format;
+   texture->surface.aa = GX2_AA_MODE1X;
+   texture->surface.use = GX2_SURFACE_USE_TEXTURE;
+   texture->surface.tileMode = GX2_TILE_MODE_LINEAR_ALIGNED;
+   GX2CalcSurfaceSizeAndAlignment(&texture->surface);
+
+   // Sample the rows where the producer put them
+   texture->surface.pitch = pitch;
+   texture->surface.image = image;
+   texture->viewNumMips = 1;
+   texture->viewNumSlices = 1;
+   texture->compMap = compMap;
+   GX2InitTextureRegs(texture);
+}
+
+#define WHB_GFX_TEXTURE_STREAM_STACK_SIZE  (16 * 1024)
+#define WHB_GFX_TEXTURE_STREAM_QUEUE_SIZE  64
+
+static OSThread
+sStreamThread;
+
+static uint8_t
+sStreamThreadStack[WHB_GFX_TEXTURE_STREAM_STACK_SIZE] __attribute__((aligned(16)));
+
+static OSMessageQueue
+sStreamQueue;
+
+static OSMessage
+sStreamMessages[WHB_GFX_TEXTURE_STREAM_QUEUE_SIZE];
+
+static BOOL
+sStreamStarted = FALSE;
+
+static int
+GfxTextureStreamThreadEntry(int argc,
+                            const char **argv)
+{
+   WHBGfxTextureUpload *upload;
+   OSMessage message;
+
+   while (1) {
+      OSReceiveMessage(&sStreamQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+      upload = (WHBGfxTextureUpload *)message.message;
+      if (!upload) {
+         break;
+      }
+
+      // Copies run in order, so the image is done too once the mips are
+      DMAEWaitDone(upload->timeStamp);
+      upload->dmaDone = TRUE;
+   }
+
+   return 0;
+}
+
+static BOOL
+GfxTextureStreamStart()
+{
+   if (sStreamStarted) {
+      return TRUE;
+   }
+
+   OSInitMessageQueue(&sStreamQueue, sStreamMessages, WHB_GFX_TEXTURE_STREAM_QUEUE_SIZE);
+   if (!OSCreateThread(&sStreamThread,
+                       GfxTextureStreamThreadEntry,
+                       0,
+                       NULL,
+                       sStreamThreadStack + sizeof(sStreamThreadStack),
+                       sizeof(sStreamThreadStack),
+                       16,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      WHBLogPrintf("%s: OSCreateThread failed", __FUNCTION__);
+      return FALSE;
+   }
+
+   OSSetThreadName(&sStreamThread, "WHBGfx texture stream");
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(&sStreamThread);
+   }
+   OSResumeThread(&sStreamThread);
+   sStreamStarted = TRUE;
+   return TRUE;
+}
+
+void
+GfxTextureStreamShutdown()
+{
+   OSMessage message = { 0 };
+
+   if (!sStreamStarted) {
+      return;
+   }
+
+   OSSendMessage(&sStreamQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+   OSJoinThread(&sStreamThread, NULL);
+   sStreamStarted = FALSE;
+}
+
+static DMAETimeStamp
+GfxTextureStreamCopy(void *dst,
+                     const void *src,
+                     uint32_t size)
+{
+   // Nothing dirty may be written back over the copy, and the source has to
+   // be in memory for the DMA engine to read it
+   DCFlushRange(dst, size);
+   DCFlushRange((void *)src, size);
+   return DMAECopyMem(dst, src, (size + 3) / 4, DMAE_SWAP_NONE);
+}
+
+BOOL
+WHBGfxLoadGFDTextureAsync(uint32_t index,
+                          const void *file,
+                          WHBGfxTextureUpload *upload)
+{
+   const GX2Texture *header;
+   const void *image, *mipmap;
+   uint32_t imageSize, mipSize;
+   GX2Texture *texture = NULL;
+   OSMessage message = { 0 };
+
+   memset(upload, 0, sizeof(WHBGfxTextureUpload));
+
+   header = GFDGetTexturePointer(index, file);
+   image = GFDGetTextureImagePointer(index, file);
+   imageSize = GFDGetTextureImageSize(index, file);
+   if (!header || !image || !imageSize) {
+      WHBLogPrintf("%s: invalid GFD texture index %u", __FUNCTION__, index);
+      goto error;
+   }
+
+   if (!GfxTextureStreamStart()) {
+      goto error;
+   }
+
+   texture = (GX2Texture *)GfxHeapAllocMEM2(sizeof(GX2Texture), 64);
+   if (!texture) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM2(0x%X, 64) failed", __FUNCTION__,
+                   sizeof(GX2Texture));
+      goto error;
+   }
+
+   memcpy(texture, header, sizeof(GX2Texture));
+   texture->surface.image = NULL;
+   texture->surface.mipmaps = NULL;
+   if (!GX2RCreateSurface(&texture->surface,
+                          GX2R_RESOURCE_BIND_TEXTURE
+                        | GX2R_RESOURCE_USAGE_CPU_READ
+                        | GX2R_RESOURCE_USAGE_CPU_WRITE
+                        | GX2R_RESOURCE_USAGE_GPU_READ)) {
+      WHBLogPrintf("%s: GX2RCreateSurface failed", __FUNCTION__);
+      GfxHeapFreeMEM2(texture);
+      texture = NULL;
+      goto error;
+   }
+
+   upload->timeStamp = GfxTextureStreamCopy(texture->surface.image, image,
+                                            MIN(imageSize, texture->surface.imageSize));
+
+   mipmap = GFDGetTextureMipImagePointer(index, file);
+   mipSize = GFDGetTextureMipImageSize(index, file);
+   if (mipmap && mipSize && texture->surface.mipmaps) {
+      upload->timeStamp = GfxTextureStreamCopy(texture->surface.mipmaps, mipmap,
+                                               MIN(mipSize, texture->surface.mipmapSize));
+   }
+
+   upload->pending = texture;
+   message.message = upload;
+   OSSendMessage(&sStreamQueue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+   return TRUE;
+
+error:
+   upload->failed = TRUE;
+   return FALSE;
+}
+
+GX2Texture *
+WHBGfxPollTextureUpload(WHBGfxTextureUpload *upload)
+{
+   if (!upload->texture && upload->dmaDone) {
+      // The GPU may have cached whatever was there before the copy
+      GX2RInvalidateSurface(&upload->pending->surface, 0, GX2R_RESOURCE_DISABLE_CPU_INVALIDATE);
+      if (upload->pending->surface.mipmaps) {
+         GX2RInvalidateSurface(&upload->pending->surface, -1, GX2R_RESOURCE_DISABLE_CPU_INVALIDATE);
+      }
+
+      upload->texture = upload->pending;
+   }
+
+   return upload->texture;
+}
+
+GX2Texture *
+WHBGfxWaitTextureUpload(WHBGfxTextureUpload *upload)
+{
+   if (upload->failed) {
+      return NULL;
+   }
+
+   DMAEWaitDone(upload->timeStamp);
+   while (!upload->dmaDone) {
+      OSYieldThread();
+   }
+
+   return WHBGfxPollTextureUpload(upload);
+}
@@ -0,0 +1,226 @@
+#include "gfx_heap.h"
+#include <gx2/mem.h>
+#include <string.h>
+#include <whb/gfx.h>
+#include <whb/log.h>
+
+typedef struct GfxTransientSurface
+{
+   GX2Surface *surface;
+   uint32_t firstPass;
+   uint32_t lastPass;
+   uint32_t offset;
+} GfxTransientSurface;
+
+static GfxTransientSurface
+sTransientSurfaces[WHB_GFX_MAX_TRANSIENT_SURFACES];
+
+static uint32_t
+sNumTransientSurfaces = 0;
+
+static void *
+sTransientPool = NULL;
+
+static uint32_t
+sTransientPoolSize = 0;
+
+static BOOL
+sTransientAllocated = FALSE;
+
+// The surfaces can't change while allocated, so the layout is packed once
+// and reused when the foreground is reacquired
+static uint32_t
+sTransientPackedSize = 0;
+
+static uint32_t
+sTransientPackedAlignment = 4;
+
+static BOOL
+GfxTransientLifetimesOverlap(const GfxTransientSurface *a,
+                             const GfxTransientSurface *b)
+{
+   return a->firstPass <= b->lastPass && b->firstPass <= a->lastPass;
+}
+
+/*
+ * Assign offsets in the pool so that surfaces used in overlapping passes
+ * do not overlap in memory. Largest first, each surface goes to the lowest
+ * offset that is free for its whole lifetime.
+ */
+static uint32_t
+GfxTransientPack(uint32_t *outAlignment)
+{
+   uint32_t order[WHB_GFX_MAX_TRANSIENT_SURFACES];
+   uint32_t placed[WHB_GFX_MAX_TRANSIENT_SURFACES];
+   uint32_t i, j, k, n, tmp, candidate, best, end, poolSize = 0, alignment = 4;
+   GfxTransientSurface *t, *p;
+
+   for (i = 0; i < sNumTransientSurfaces; ++i) {
+      order[i] = i;
+   }
+
+   for (i = 1; i < sNumTransientSurfaces; ++i) {
+      for (j = i; j > 0 && sTransientSurfaces[order[j]].surface->imageSize >
+                           sTransientSurfaces[order[j - 1]].surface->imageSize; --j) {
+         tmp = order[j];
+         order[j] = order[j - 1];
+         order[j - 1] = tmp;
+      }
+   }
+
+   for (n = 0; n < sNumTransientSurfaces; ++n) {
+      t = &sTransientSurfaces[order[n]];
+      if (t->surface->alignment > alignment) {
+         alignment = t->surface->alignment;
+      }
+
+      // Candidates are the start of the pool and the end of every placed
+      // surface that is alive at the same time
+      best = UINT32_MAX;
+      for (i = 0; i <= n; ++i) {
+         if (i == n) {
+            candidate = 0;
+         } else {
+            p = &sTransientSurfaces[placed[i]];
+            if (!GfxTransientLifetimesOverlap(t, p)) {
+               continue;
+            }
+            candidate = p->offset + p->surface->imageSize;
+         }
+
+         candidate = (candidate + t->surface->alignment - 1) & ~(t->surface->alignment - 1);
+         if (candidate >= best) {
+            continue;
+         }
+
+         for (k = 0; k < n; ++k) {
+            p = &sTransientSurfaces[placed[k]];
+            if (GfxTransientLifetimesOverlap(t, p) &&
+                candidate < p->offset + p->surface->imageSize &&
+                p->offset < candidate + t->surface->imageSize) {
+               break;
+            }
+         }
+
+         if (k == n) {
+            best = candidate;
+         }
+      }
+
+      t->offset = best;
+      placed[n] = order[n];
+
+      end = best + t->surface->imageSize;
+      if (end > poolSize) {
+         poolSize = end;
+      }
+   }
+
+   *outAlignment = alignment;
+   return poolSize;
+}
+
+BOOL
+GfxTransientAcquire()
+{
+   uint32_t i, alignment;
+
+   if (!sTransientAllocated || !sNumTransientSurfaces) {
+      return TRUE;
+   }
+
+   if (!sTransientPackedSize) {
+      sTransientPackedSize = GfxTransientPack(&sTransientPackedAlignment);
+   }
+
+   sTransientPoolSize = sTransientPackedSize;
+   alignment = sTransientPackedAlignment;
+   sTransientPool = GfxHeapAllocMEM1(sTransientPoolSize, alignment);
+   if (!sTransientPool) {
+      WHBLogPrintf("%s: GfxHeapAllocMEM1(0x%X, 0x%X) failed", __FUNCTION__,
+                   sTransientPoolSize, alignment);
+      sTransientPoolSize = 0;
+      return FALSE;
+   }
+
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU, sTransientPool, sTransientPoolSize);
+   for (i = 0; i < sNumTransientSurfaces; ++i) {
+      sTransientSurfaces[i].surface->image = (uint8_t *)sTransientPool + sTransientSurfaces[i].offset;
+   }
+
+   return TRUE;
+}
+
+void
+GfxTransientRelease()
+{
+   uint32_t i;
+
+   if (sTransientPool) {
+      GfxHeapFreeMEM1(sTransientPool);
+      sTransientPool = NULL;
+      sTransientPoolSize = 0;
+   }
+
+   for (i = 0; i < sNumTransientSurfaces; ++i) {
+      sTransientSurfaces[i].surface->image = NULL;
+   }
+}
+
+uint32_t
+GfxTransientGetPoolSize()
+{
+   return sTransientPoolSize;
+}
+
+BOOL
+WHBGfxAddTransientSurface(GX2Surface *surface,
+                          uint32_t firstPass,
+                          uint32_t lastPass)
+{
+   GfxTransientSurface *transient;
+
+   if (sTransientAllocated || sNumTransientSurfaces == WHB_GFX_MAX_TRANSIENT_SURFACES ||
+       !surface->imageSize || firstPass > lastPass) {
+      return FALSE;
+   }
+
+   transient = &sTransientSurfaces[sNumTransientSurfaces++];
+   transient->surface = surface;
+   transient->firstPass = firstPass;
+   transient->lastPass = lastPass;
+   transient->offset = 0;
+   return TRUE;
+}
+
+BOOL
+WHBGfxAllocTransientSurfaces()
+{
+   if (sTransientAllocated) {
+      return TRUE;
+   }
+
+   sTransientAllocated = TRUE;
+   if (!GfxTransientAcquire()) {
+      sTransientAllocated = FALSE;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+void
+WHBGfxFreeTransientSurfaces()
+{
+   GfxTransientRelease();
+   sTransientAllocated = FALSE;
+   sNumTransientSurfaces = 0;
+   sTransientPackedSize = 0;
+}
+
+void
+WHBGfxGetMEM1Usage(WHBGfxMemoryUsage *usage)
+{
+   GfxHeapGetMEM1Usage(usage);
+   usage->transientSize = GfxTransientGetPoolSize();
+}
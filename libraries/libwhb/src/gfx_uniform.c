@@ -0,0 +1,270 @@
+#include <coreinit/cache.h>
+#include <coreinit/memdefaultheap.h>
+#include <gx2/event.h>
+#include <gx2/mem.h>
+#include <string.h>
+#include <whb/gfx_uniform.h>
+#include <whb/log.h>
+
+#define UNIFORM_BLOCK_ALIGN 0x100
+
+//! Bytes [begin, end), empty when begin >= end
+typedef struct UniformRange
+{
+   uint32_t begin;
+   uint32_t end;
+} UniformRange;
+
+typedef struct UniformCopy
+{
+   uint8_t *data;
+
+   //! Timestamp of the last frame the copy was current in.
+   OSTime timeStamp;
+
+   //! Written since the last flush.
+   UniformRange dirty;
+
+   //! Written to the other copy since this one was last current.
+   UniformRange stale;
+} UniformCopy;
+
+typedef struct UniformBlock
+{
+   uint32_t size;
+   uint32_t current;
+   UniformCopy copies[WHB_GFX_UNIFORM_COPIES];
+} UniformBlock;
+
+struct WHBGfxUniformBuffer
+{
+   uint8_t *base;
+
+   //! Last known retired timestamp, saves asking GX2 for every write.
+   OSTime retired;
+
+   uint32_t numBlocks;
+   UniformBlock blocks[];
+};
+
+static void
+UniformRangeAdd(UniformRange *range,
+                uint32_t begin,
+                uint32_t end)
+{
+   if (range->begin >= range->end) {
+      range->begin = begin;
+      range->end = end;
+      return;
+   }
+
+   if (begin < range->begin) {
+      range->begin = begin;
+   }
+   if (end > range->end) {
+      range->end = end;
+   }
+}
+
+static BOOL
+UniformCopyBusy(WHBGfxUniformBuffer *buffer,
+                const UniformCopy *copy)
+{
+   if (copy->timeStamp <= buffer->retired) {
+      return FALSE;
+   }
+
+   buffer->retired = GX2GetRetiredTimeStamp();
+   return copy->timeStamp > buffer->retired;
+}
+
+//! Move a block to a copy the GPU is done with, bringing it up to date
+static void
+UniformBlockSwitch(WHBGfxUniformBuffer *buffer,
+                   UniformBlock *block)
+{
+   UniformCopy *from = &block->copies[block->current];
+   UniformCopy *to;
+
+   block->current = (block->current + 1) % WHB_GFX_UNIFORM_COPIES;
+   to = &block->copies[block->current];
+
+   if (UniformCopyBusy(buffer, to)) {
+      GX2WaitTimeStamp(to->timeStamp);
+      buffer->retired = to->timeStamp;
+   }
+
+   if (to->stale.begin < to->stale.end) {
+      memcpy(to->data + to->stale.begin,
+             from->data + to->stale.begin,
+             to->stale.end - to->stale.begin);
+      UniformRangeAdd(&to->dirty, to->stale.begin, to->stale.end);
+      to->stale.begin = to->stale.end = 0;
+   }
+}
+
+WHBGfxUniformBuffer *
+WHBGfxUniformBufferCreate(const uint32_t *blockSizes,
+                          uint32_t numBlocks)
+{
+   WHBGfxUniformBuffer *buffer;
+   uint32_t size = 0;
+   uint8_t *data;
+
+   if (!numBlocks) {
+      return NULL;
+   }
+
+   for (uint32_t i = 0; i < numBlocks; ++i) {
+      size += ((blockSizes[i] + UNIFORM_BLOCK_ALIGN - 1) & ~(UNIFORM_BLOCK_ALIGN - 1)) * WHB_GFX_UNIFORM_COPIES;
+   }
+
+   buffer = MEMAllocFromDefaultHeap(sizeof(WHBGfxUniformBuffer) + sizeof(UniformBlock) * numBlocks);
+   if (!buffer) {
+      return NULL;
+   }
+
+   memset(buffer, 0, sizeof(WHBGfxUniformBuffer) + sizeof(UniformBlock) * numBlocks);
+   buffer->base = MEMAllocFromDefaultHeapEx(size, UNIFORM_BLOCK_ALIGN);
+   if (!buffer->base) {
+      WHBLogPrintf("%s: failed to allocate 0x%X bytes", __FUNCTION__, size);
+      MEMFreeToDefaultHeap(buffer);
+      return NULL;
+   }
+
+   buffer->numBlocks = numBlocks;
+
+   data = buffer->base;
+   for (uint32_t i = 0; i < numBlocks; ++i) {
+      UniformBlock *block = &buffer->blocks[i];
+      block->size = blockSizes[i];
+      for (uint32_t c = 0; c < WHB_GFX_UNIFORM_COPIES; ++c) {
+         block->copies[c].data = data;
+         data += (blockSizes[i] + UNIFORM_BLOCK_ALIGN - 1) & ~(UNIFORM_BLOCK_ALIGN - 1);
+      }
+   }
+
+   memset(buffer->base, 0, size);
+   GX2Invalidate(GX2_INVALIDATE_MODE_CPU | GX2_INVALIDATE_MODE_UNIFORM_BLOCK, buffer->base, size);
+   return buffer;
+}
+
+void
+WHBGfxUniformBufferDestroy(WHBGfxUniformBuffer *buffer)
+{
+   if (!buffer) {
+      return;
+   }
+
+   GX2DrawDone();
+   MEMFreeToDefaultHeap(buffer->base);
+   MEMFreeToDefaultHeap(buffer);
+}
+
+void
+WHBGfxUniformBufferBeginFrame(WHBGfxUniformBuffer *buffer)
+{
+   // The previous frame's commands have all been flushed by now, and read
+   // the copies that were current
+   OSTime timeStamp = GX2GetLastSubmittedTimeStamp();
+
+   for (uint32_t i = 0; i < buffer->numBlocks; ++i) {
+      UniformBlock *block = &buffer->blocks[i];
+      block->copies[block->current].timeStamp = timeStamp;
+   }
+}
+
+void *
+WHBGfxUniformBufferMap(WHBGfxUniformBuffer *buffer,
+                       uint32_t index,
+                       uint32_t offset,
+                       uint32_t size)
+{
+   UniformBlock *block;
+   UniformCopy *copy;
+
+   if (index >= buffer->numBlocks) {
+      return NULL;
+   }
+
+   block = &buffer->blocks[index];
+   if (offset > block->size || size > block->size - offset) {
+      return NULL;
+   }
+
+   if (UniformCopyBusy(buffer, &block->copies[block->current])) {
+      UniformBlockSwitch(buffer, block);
+   }
+
+   copy = &block->copies[block->current];
+   UniformRangeAdd(&copy->dirty, offset, offset + size);
+   for (uint32_t c = 0; c < WHB_GFX_UNIFORM_COPIES; ++c) {
+      if (c != block->current) {
+         UniformRangeAdd(&block->copies[c].stale, offset, offset + size);
+      }
+   }
+
+   return copy->data + offset;
+}
+
+BOOL
+WHBGfxUniformBufferWrite(WHBGfxUniformBuffer *buffer,
+                         uint32_t block,
+                         uint32_t offset,
+                         const void *data,
+                         uint32_t size)
+{
+   void *dst = WHBGfxUniformBufferMap(buffer, block, offset, size);
+   if (!dst) {
+      return FALSE;
+   }
+
+   memcpy(dst, data, size);
+   return TRUE;
+}
+
+void
+WHBGfxUniformBufferFlush(WHBGfxUniformBuffer *buffer)
+{
+   for (uint32_t i = 0; i < buffer->numBlocks; ++i) {
+      UniformBlock *block = &buffer->blocks[i];
+      UniformCopy *copy = &block->copies[block->current];
+      uint8_t *data;
+      uint32_t size;
+
+      if (copy->dirty.begin >= copy->dirty.end) {
+         continue;
+      }
+
+      data = copy->data + copy->dirty.begin;
+      size = copy->dirty.end - copy->dirty.begin;
+      DCFlushRange(data, size);
+      GX2Invalidate(GX2_INVALIDATE_MODE_UNIFORM_BLOCK, data, size);
+      copy->dirty.begin = copy->dirty.end = 0;
+   }
+}
+
+void *
+WHBGfxUniformBufferGetBlock(WHBGfxUniformBuffer *buffer,
+                            uint32_t index)
+{
+   UniformBlock *block;
+
+   if (index >= buffer->numBlocks) {
+      return NULL;
+   }
+
+   block = &buffer->blocks[index];
+   return block->copies[block->current].data;
+}
+
+uint32_t
+WHBGfxUniformBufferGetBlockSize(WHBGfxUniformBuffer *buffer,
+                                uint32_t index)
+{
+   if (index >= buffer->numBlocks) {
+      return 0;
+   }
+
+   return buffer->blocks[index].size;
+}
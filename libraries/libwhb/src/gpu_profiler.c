@@ -0,0 +1,225 @@
+#include <coreinit/cache.h>
+#include <coreinit/memdefaultheap.h>
+#include <gx2/event.h>
+#include <string.h>
+#include <whb/gpu_profiler.h>
+#include <whb/log.h>
+
+#define PROFILER_MAX_DEPTH     8
+#define PROFILER_AVERAGE_SHIFT 4
+
+typedef struct ProfilerQuery
+{
+   uint64_t begin;
+   uint64_t end;
+} ProfilerQuery;
+
+// Written by the GPU, one cache line aligned block per frame in flight
+typedef struct WUT_ALIGNAS(0x40) ProfilerFrame
+{
+   ProfilerQuery queries[WHB_GPU_PROFILER_MAX_QUERIES];
+   uint8_t queryPass[WHB_GPU_PROFILER_MAX_QUERIES];
+   uint32_t numQueries;
+} ProfilerFrame;
+
+static ProfilerFrame *
+sFrames = NULL;
+
+static uint32_t
+sFrameIndex = 0;
+
+static WHBGpuProfilerPass
+sPasses[WHB_GPU_PROFILER_MAX_PASSES];
+
+static uint32_t
+sNumPasses = 0;
+
+static uint32_t
+sStack[PROFILER_MAX_DEPTH];
+
+static uint32_t
+sStackDepth = 0;
+
+static uint32_t
+ProfilerFindPass(const char *name)
+{
+   uint32_t i;
+
+   for (i = 0; i < sNumPasses; ++i) {
+      if (sPasses[i].name == name || !strcmp(sPasses[i].name, name)) {
+         return i;
+      }
+   }
+
+   if (sNumPasses == WHB_GPU_PROFILER_MAX_PASSES) {
+      return WHB_GPU_PROFILER_MAX_PASSES;
+   }
+
+   memset(&sPasses[sNumPasses], 0, sizeof(WHBGpuProfilerPass));
+   sPasses[sNumPasses].name = name;
+   return sNumPasses++;
+}
+
+static void
+ProfilerCollect(ProfilerFrame *frame)
+{
+   WHBGpuProfilerPass *pass;
+   ProfilerQuery *query;
+   OSTime time;
+   uint32_t i;
+
+   DCInvalidateRange(frame->queries, sizeof(frame->queries));
+
+   for (i = 0; i < frame->numQueries; ++i) {
+      query = &frame->queries[i];
+      pass = &sPasses[frame->queryPass[i]];
+
+      // Not written by the GPU yet, drop it rather than wait
+      if (!query->begin || !query->end || query->end < query->begin) {
+         continue;
+      }
+
+      time = GX2GPUTimeToCPUTime(query->end - query->begin);
+      pass->lastTime = time;
+      if (time > pass->maxTime) {
+         pass->maxTime = time;
+      }
+
+      if (!pass->samples) {
+         pass->averageTime = time;
+      } else {
+         pass->averageTime += (time - pass->averageTime) >> PROFILER_AVERAGE_SHIFT;
+      }
+
+      ++pass->samples;
+   }
+
+   frame->numQueries = 0;
+}
+
+BOOL
+WHBGpuProfilerInit()
+{
+   if (sFrames) {
+      return TRUE;
+   }
+
+   sFrames = MEMAllocFromDefaultHeapEx(sizeof(ProfilerFrame) * WHB_GPU_PROFILER_FRAME_LATENCY, 0x40);
+   if (!sFrames) {
+      WHBLogPrintf("%s: failed to allocate query buffers", __FUNCTION__);
+      return FALSE;
+   }
+
+   memset(sFrames, 0, sizeof(ProfilerFrame) * WHB_GPU_PROFILER_FRAME_LATENCY);
+   DCFlushRange(sFrames, sizeof(ProfilerFrame) * WHB_GPU_PROFILER_FRAME_LATENCY);
+   sFrameIndex = 0;
+   sNumPasses = 0;
+   sStackDepth = 0;
+   return TRUE;
+}
+
+void
+WHBGpuProfilerShutdown()
+{
+   if (!sFrames) {
+      return;
+   }
+
+   // The GPU could still write to the query buffers
+   GX2DrawDone();
+   MEMFreeToDefaultHeap(sFrames);
+   sFrames = NULL;
+}
+
+void
+WHBGpuProfilerBeginFrame()
+{
+   ProfilerFrame *frame;
+
+   if (!sFrames) {
+      return;
+   }
+
+   // Reuse the oldest frame, which the GPU should be done with by now
+   sFrameIndex = (sFrameIndex + 1) % WHB_GPU_PROFILER_FRAME_LATENCY;
+   frame = &sFrames[sFrameIndex];
+   ProfilerCollect(frame);
+
+   memset(frame->queries, 0, sizeof(frame->queries));
+   DCFlushRange(frame->queries, sizeof(frame->queries));
+   sStackDepth = 0;
+}
+
+void
+WHBGpuProfilerBegin(const char *name)
+{
+   ProfilerFrame *frame;
+   uint32_t pass;
+
+   if (!sFrames || sStackDepth == PROFILER_MAX_DEPTH) {
+      return;
+   }
+
+   frame = &sFrames[sFrameIndex];
+   pass = ProfilerFindPass(name);
+   if (pass == WHB_GPU_PROFILER_MAX_PASSES || frame->numQueries == WHB_GPU_PROFILER_MAX_QUERIES) {
+      // Still push so the matching end is ignored
+      sStack[sStackDepth++] = WHB_GPU_PROFILER_MAX_QUERIES;
+      return;
+   }
+
+   frame->queryPass[frame->numQueries] = (uint8_t)pass;
+   GX2SampleBottomGPUCycle(&frame->queries[frame->numQueries].begin);
+   sStack[sStackDepth++] = frame->numQueries++;
+}
+
+void
+WHBGpuProfilerEnd()
+{
+   uint32_t query;
+
+   if (!sFrames || !sStackDepth) {
+      return;
+   }
+
+   query = sStack[--sStackDepth];
+   if (query != WHB_GPU_PROFILER_MAX_QUERIES) {
+      GX2SampleBottomGPUCycle(&sFrames[sFrameIndex].queries[query].end);
+   }
+}
+
+uint32_t
+WHBGpuProfilerGetPasses(WHBGpuProfilerPass *passes,
+                        uint32_t maxPasses)
+{
+   uint32_t count = sNumPasses < maxPasses ? sNumPasses : maxPasses;
+   memcpy(passes, sPasses, count * sizeof(WHBGpuProfilerPass));
+   return count;
+}
+
+void
+WHBGpuProfilerLog()
+{
+   uint32_t i;
+
+   for (i = 0; i < sNumPasses; ++i) {
+      WHBLogPrintf("%-16s avg %6u us last %6u us max %6u us",
+                   sPasses[i].name,
+                   (uint32_t)OSTicksToMicroseconds(sPasses[i].averageTime),
+                   (uint32_t)OSTicksToMicroseconds(sPasses[i].lastTime),
+                   (uint32_t)OSTicksToMicroseconds(sPasses[i].maxTime));
+   }
+}
+
+void
+WHBGpuProfilerReset()
+{
+   uint32_t i;
+
+   for (i = 0; i < sNumPasses; ++i) {
+      sPasses[i].lastTime = 0;
+      sPasses[i].averageTime = 0;
+      sPasses[i].maxTime = 0;
+      sPasses[i].samples = 0;
+   }
+}
@@ -0,0 +1,201 @@
+#include <coreinit/memdefaultheap.h>
+#include <gx2/event.h>
+#include <gx2/mem.h>
+#include <string.h>
+#include <whb/gpu_ring.h>
+#include <whb/log.h>
+
+#define GPU_RING_ALIGN 0x100
+
+typedef struct GpuRingFrame
+{
+   //! Bytes used by the frame, including padding and the skipped end of
+   //! the ring on wrap around.
+   uint32_t bytes;
+
+   //! Timestamp of the last flush containing the frame's commands.
+   OSTime timeStamp;
+} GpuRingFrame;
+
+struct WHBGpuRing
+{
+   uint8_t *base;
+   uint32_t size;
+
+   //! Offset of the next allocation.
+   uint32_t head;
+
+   //! Bytes used by frames in flight and the current frame.
+   uint32_t used;
+
+   //! Offset at which the current frame started.
+   uint32_t frameStart;
+
+   //! Frames in flight, oldest first, the last one being the current frame.
+   GpuRingFrame frames[WHB_GPU_RING_MAX_FRAMES];
+   uint32_t firstFrame;
+   uint32_t numFrames;
+};
+
+static GpuRingFrame *
+GpuRingCurrentFrame(WHBGpuRing *ring)
+{
+   return &ring->frames[(ring->firstFrame + ring->numFrames - 1) % WHB_GPU_RING_MAX_FRAMES];
+}
+
+static void
+GpuRingRetireOldest(WHBGpuRing *ring)
+{
+   ring->used -= ring->frames[ring->firstFrame].bytes;
+   ring->firstFrame = (ring->firstFrame + 1) % WHB_GPU_RING_MAX_FRAMES;
+   --ring->numFrames;
+}
+
+//! Wait for the oldest frame before the current one, FALSE if there is none
+static BOOL
+GpuRingWaitOldest(WHBGpuRing *ring)
+{
+   if (ring->numFrames < 2) {
+      return FALSE;
+   }
+
+   GX2WaitTimeStamp(ring->frames[ring->firstFrame].timeStamp);
+   GpuRingRetireOldest(ring);
+   return TRUE;
+}
+
+WHBGpuRing *
+WHBGpuRingCreate(uint32_t size)
+{
+   WHBGpuRing *ring;
+
+   size = (size + GPU_RING_ALIGN - 1) & ~(GPU_RING_ALIGN - 1);
+   if (!size) {
+      return NULL;
+   }
+
+   ring = MEMAllocFromDefaultHeap(sizeof(WHBGpuRing));
+   if (!ring) {
+      return NULL;
+   }
+
+   memset(ring, 0, sizeof(WHBGpuRing));
+   ring->base = MEMAllocFromDefaultHeapEx(size, GPU_RING_ALIGN);
+   if (!ring->base) {
+      WHBLogPrintf("%s: failed to allocate 0x%X bytes", __FUNCTION__, size);
+      MEMFreeToDefaultHeap(ring);
+      return NULL;
+   }
+
+   ring->size = size;
+   ring->numFrames = 1;
+   return ring;
+}
+
+void
+WHBGpuRingDestroy(WHBGpuRing *ring)
+{
+   if (!ring) {
+      return;
+   }
+
+   GX2DrawDone();
+   MEMFreeToDefaultHeap(ring->base);
+   MEMFreeToDefaultHeap(ring);
+}
+
+void
+WHBGpuRingBeginFrame(WHBGpuRing *ring)
+{
+   OSTime retired;
+
+   // The previous frame's commands have all been flushed by now
+   GpuRingCurrentFrame(ring)->timeStamp = GX2GetLastSubmittedTimeStamp();
+
+   retired = GX2GetRetiredTimeStamp();
+   while (ring->numFrames && ring->frames[ring->firstFrame].timeStamp <= retired) {
+      GpuRingRetireOldest(ring);
+   }
+
+   if (ring->numFrames == WHB_GPU_RING_MAX_FRAMES) {
+      GX2WaitTimeStamp(ring->frames[ring->firstFrame].timeStamp);
+      GpuRingRetireOldest(ring);
+   }
+
+   if (!ring->used) {
+      ring->head = 0;
+   }
+
+   ++ring->numFrames;
+   GpuRingCurrentFrame(ring)->bytes = 0;
+   GpuRingCurrentFrame(ring)->timeStamp = 0;
+   ring->frameStart = ring->head;
+}
+
+void *
+WHBGpuRingAlloc(WHBGpuRing *ring,
+                uint32_t size,
+                uint32_t align)
+{
+   GpuRingFrame *frame = GpuRingCurrentFrame(ring);
+   uint32_t tail, offset, skip, bytes;
+
+   if (!align || align > GPU_RING_ALIGN || (align & (align - 1))) {
+      return NULL;
+   }
+
+   while (1) {
+      if (!ring->used) {
+         // Nothing in use, start over at the beginning
+         ring->head = 0;
+         ring->frameStart = 0;
+      }
+
+      tail = (ring->head + ring->size - ring->used) % ring->size;
+      offset = (ring->head + align - 1) & ~(align - 1);
+      skip = 0;
+
+      if (!ring->used || ring->head > tail) {
+         // Free from head to the end and from the start to tail
+         if (offset + size <= ring->size) {
+            break;
+         }
+
+         if (size <= tail) {
+            skip = ring->size - ring->head;
+            offset = 0;
+            break;
+         }
+      } else if (ring->head < tail && offset + size <= tail) {
+         break;
+      }
+
+      if (!GpuRingWaitOldest(ring)) {
+         return NULL;
+      }
+   }
+
+   bytes = (skip ? skip : offset - ring->head) + size;
+   frame->bytes += bytes;
+   ring->used += bytes;
+   ring->head = (offset + size) % ring->size;
+   return ring->base + offset;
+}
+
+void
+WHBGpuRingEndFrame(WHBGpuRing *ring)
+{
+   GpuRingFrame *frame = GpuRingCurrentFrame(ring);
+   GX2InvalidateMode mode = GX2_INVALIDATE_MODE_CPU_ATTRIBUTE_BUFFER | GX2_INVALIDATE_MODE_UNIFORM_BLOCK;
+
+   if (!frame->bytes) {
+      return;
+   }
+
+   if (ring->head > ring->frameStart) {
+      GX2Invalidate(mode, ring->base + ring->frameStart, ring->head - ring->frameStart);
+   } else {
+      GX2Invalidate(mode, ring->base + ring->frameStart, ring->size - ring->frameStart);
+      GX2Invalidate(mode, ring->base, ring->head);
+   }
+}
@@ -1,4 +1,5 @@
-#include <coreinit/memdefaultheap.h>
+#include <coreinit/atomic.h>
+#include <coreinit/thread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -7,36 +8,121 @@
 #define MAX_HANDLERS 16
 #define PRINTF_BUFFER_LENGTH 2048
 
-static LogHandlerFn
+// Number of messages that can be formatted at the same time, e.g. by
+// several threads or a log handler that logs itself
+#define MAX_BUFFERS 8
+
+// Slots are read without a lock so handlers can be added and removed while
+// other threads are dispatching, changes are serialised by sHandlerLock
+static LogHandlerFn volatile
 sHandlers[MAX_HANDLERS] = { 0 };
 
+// Taken with compare and swap as there is no init call to set up a mutex
+static volatile uint32_t
+sHandlerLock = 0;
+
+// Number of slots dispatchMessage has to scan, never shrinks
+static volatile uint32_t
+sHandlerSlots = 0;
+
+static volatile int32_t
+sActiveHandlers = 0;
+
+static volatile int
+sLogLevel = WHB_LOG_LEVEL_DEBUG;
+
+static char
+sBuffers[MAX_BUFFERS][PRINTF_BUFFER_LENGTH];
+
+static volatile uint32_t
+sBuffersInUse = 0;
+
+static int
+acquireBuffer()
+{
+   uint32_t inUse, index;
+
+   do {
+      inUse = sBuffersInUse;
+      if (inUse == (1u << MAX_BUFFERS) - 1) {
+         return -1;
+      }
+
+      index = __builtin_ctz(~inUse);
+   } while (!OSCompareAndSwapAtomic(&sBuffersInUse, inUse, inUse | (1u << index)));
+
+   return (int)index;
+}
+
+static void
+releaseBuffer(int index)
+{
+   OSAndAtomic(&sBuffersInUse, ~(1u << index));
+}
+
 static inline void
 dispatchMessage(const char * str)
 {
-   int i;
-   for (i = 0; i < MAX_HANDLERS; ++i) {
-      if (sHandlers[i]) {
-         sHandlers[i](str);
+   uint32_t i, count = sHandlerSlots;
+
+   for (i = 0; i < count; ++i) {
+      // Read the slot once, it can be cleared while we are calling it
+      LogHandlerFn fn = sHandlers[i];
+      if (fn) {
+         fn(str);
       }
    }
 }
 
+static void
+lockHandlers()
+{
+   while (!OSCompareAndSwapAtomic(&sHandlerLock, 0, 1)) {
+      OSYieldThread();
+   }
+}
+
+static void
+unlockHandlers()
+{
+   OSSwapAtomic(&sHandlerLock, 0);
+}
+
 BOOL
 WHBAddLogHandler(LogHandlerFn fn)
 {
-   int i;
+   uint32_t i, slot = MAX_HANDLERS;
 
+   lockHandlers();
+
+   // Check for duplicates and pick the slot under the lock, otherwise two
+   // threads adding the same handler could both take a slot
    for (i = 0; i < MAX_HANDLERS; ++i) {
-      if(sHandlers[i] == fn){
-        return TRUE;
-      }
-      if (!sHandlers[i]) {
-         sHandlers[i] = fn;
+      if (sHandlers[i] == fn) {
+         unlockHandlers();
          return TRUE;
       }
+
+      if (!sHandlers[i] && slot == MAX_HANDLERS) {
+         slot = i;
+      }
    }
 
-   return FALSE;
+   if (slot == MAX_HANDLERS) {
+      unlockHandlers();
+      return FALSE;
+   }
+
+   sHandlers[slot] = fn;
+
+   // Make sure dispatchMessage scans up to the new slot
+   if (sHandlerSlots < slot + 1) {
+      sHandlerSlots = slot + 1;
+   }
+
+   OSAddAtomic(&sActiveHandlers, 1);
+   unlockHandlers();
+   return TRUE;
 }
 
 BOOL
@@ -44,16 +130,33 @@ WHBRemoveLogHandler(LogHandlerFn fn)
 {
    int i;
 
-   for(i = 0; i < MAX_HANDLERS; ++i) {
-      if(sHandlers[i] == fn) {
+   lockHandlers();
+
+   for (i = 0; i < MAX_HANDLERS; ++i) {
+      if (sHandlers[i] == fn) {
          sHandlers[i] = NULL;
+         OSAddAtomic(&sActiveHandlers, -1);
+         unlockHandlers();
          return TRUE;
       }
    }
 
+   unlockHandlers();
    return FALSE;
 }
 
+void
+WHBLogSetLevel(int level)
+{
+   sLogLevel = level;
+}
+
+int
+WHBLogGetLevel()
+{
+   return sLogLevel;
+}
+
 BOOL
 WHBLogWrite(const char *str)
 {
@@ -64,61 +167,89 @@ WHBLogWrite(const char *str)
 BOOL
 WHBLogPrint(const char *str)
 {
-   char *buf = MEMAllocFromDefaultHeapEx(PRINTF_BUFFER_LENGTH, 4);
-   if(!buf) {
+   int index;
+   char *buf;
+   size_t length;
+
+   // Skip formatting when no one is listening
+   if (!sActiveHandlers) {
+      return TRUE;
+   }
+
+   index = acquireBuffer();
+   if (index < 0) {
       return FALSE;
    }
 
-   snprintf(buf, PRINTF_BUFFER_LENGTH, "%s\n", str);
+   buf = sBuffers[index];
+   length = strnlen(str, PRINTF_BUFFER_LENGTH - 2);
+   memcpy(buf, str, length);
+   buf[length] = '\n';
+   buf[length + 1] = '\0';
    dispatchMessage(buf);
 
-   MEMFreeToDefaultHeap(buf);
+   releaseBuffer(index);
    return TRUE;
 }
 
 BOOL
 WHBLogWritef(const char *fmt, ...)
 {
-   char *buf = MEMAllocFromDefaultHeapEx(PRINTF_BUFFER_LENGTH, 4);
+   int index;
    va_list va;
 
-   if (!buf) {
+   if (!sActiveHandlers) {
+      return TRUE;
+   }
+
+   index = acquireBuffer();
+   if (index < 0) {
       return FALSE;
    }
 
    va_start(va, fmt);
-   vsnprintf(buf, PRINTF_BUFFER_LENGTH, fmt, va);
-   dispatchMessage(buf);
-
-   MEMFreeToDefaultHeap(buf);
+   vsnprintf(sBuffers[index], PRINTF_BUFFER_LENGTH, fmt, va);
+   dispatchMessage(sBuffers[index]);
    va_end(va);
+
+   releaseBuffer(index);
    return TRUE;
 }
 
 BOOL
 WHBLogPrintf(const char *fmt, ...)
 {
-   char *buf1 = MEMAllocFromDefaultHeapEx(PRINTF_BUFFER_LENGTH, 4);
-   char *buf2 = MEMAllocFromDefaultHeapEx(PRINTF_BUFFER_LENGTH, 4);
+   int index;
+   char *buf;
+   int length;
    va_list va;
 
-   if (!buf1) {
-      return FALSE;
+   if (!sActiveHandlers) {
+      return TRUE;
    }
 
-   if(!buf2) {
-      MEMFreeToDefaultHeap(buf1);
+   index = acquireBuffer();
+   if (index < 0) {
       return FALSE;
    }
 
+   buf = sBuffers[index];
+
+   // Leave room to append the newline in place
    va_start(va, fmt);
+   length = vsnprintf(buf, PRINTF_BUFFER_LENGTH - 1, fmt, va);
+   va_end(va);
 
-   vsnprintf(buf1, PRINTF_BUFFER_LENGTH, fmt, va);
-   snprintf(buf2, PRINTF_BUFFER_LENGTH, "%s\n", buf1);
-   dispatchMessage(buf2);
+   if (length < 0) {
+      length = 0;
+   } else if (length > PRINTF_BUFFER_LENGTH - 2) {
+      length = PRINTF_BUFFER_LENGTH - 2;
+   }
 
-   MEMFreeToDefaultHeap(buf1);
-   MEMFreeToDefaultHeap(buf2);
-   va_end(va);
+   buf[length] = '\n';
+   buf[length + 1] = '\0';
+   dispatchMessage(buf);
+
+   releaseBuffer(index);
    return TRUE;
 }
@@ -0,0 +1,456 @@
+#include "../../wutthreadstats/wut_thread_stats.h"
+
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/core.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <whb/log.h>
+#include <whb/log_deferred.h>
+#include <wut_heap_budget.h>
+#include <wut_thread_stats.h>
+
+#define DEFERRED_NUM_CORES      3
+#define DEFERRED_STACK_SIZE     (16 * 1024)
+#define DEFERRED_LINE_LENGTH    2048
+#define DEFERRED_SPEC_LENGTH    32
+#define DEFERRED_INTERVAL_MS    10
+
+typedef enum LogArgType
+{
+   LOG_ARG_NONE,
+   LOG_ARG_INT,
+   LOG_ARG_LONG,
+   LOG_ARG_LONG_LONG,
+   LOG_ARG_POINTER,
+   LOG_ARG_DOUBLE,
+} LogArgType;
+
+typedef struct LogSpec
+{
+   //! Arguments taken by * width and precision
+   uint32_t stars;
+   LogArgType type;
+   char conversion;
+} LogSpec;
+
+typedef struct LogRecord
+{
+   //! Ticket + 1 once the record is complete
+   volatile uint32_t seq;
+   uint32_t numArgs;
+   const char *fmt;
+   OSTime time;
+   //! Integers are sign extended, doubles stored by their bits
+   uint64_t args[WHB_LOG_DEFERRED_MAX_ARGS];
+} LogRecord;
+
+typedef struct WUT_ALIGNAS(0x40) LogRing
+{
+   volatile uint32_t head;
+   //! Only written by the formatting side
+   volatile uint32_t tail;
+   LogRecord *records;
+} LogRing;
+
+static LogRing
+sRings[DEFERRED_NUM_CORES];
+
+static LogRecord *
+sRecords = NULL;
+
+static uint32_t
+sRecordsPerCore = 0;
+
+static volatile BOOL
+sEnabled = FALSE;
+
+static volatile uint32_t
+sDropped = 0;
+
+static OSTime
+sStartTime;
+
+//! Serialises the formatting thread and WHBLogDeferredFlush
+static OSMutex
+sFormatMutex;
+
+static char
+sLine[DEFERRED_LINE_LENGTH];
+
+static OSThread
+sFormatThread;
+
+static uint8_t
+sFormatThreadStack[DEFERRED_STACK_SIZE] __attribute__((aligned(16)));
+
+static volatile BOOL
+sFormatThreadStop = FALSE;
+
+//! Parse the conversion starting at the '%' in fmt, returns its end.
+static const char *
+LogParseSpec(const char *fmt,
+             LogSpec *spec)
+{
+   const char *p = fmt + 1;
+   uint32_t length = 0;
+
+   spec->stars = 0;
+   spec->type = LOG_ARG_NONE;
+
+   while (*p && strchr("-+ #0'", *p)) {
+      ++p;
+   }
+
+   if (*p == '*') {
+      spec->stars++;
+      ++p;
+   } else {
+      while (*p >= '0' && *p <= '9') {
+         ++p;
+      }
+   }
+
+   if (*p == '.') {
+      ++p;
+      if (*p == '*') {
+         spec->stars++;
+         ++p;
+      } else {
+         while (*p >= '0' && *p <= '9') {
+            ++p;
+         }
+      }
+   }
+
+   for (;; ++p) {
+      if (*p == 'h') {
+         continue;
+      } else if (*p == 'l') {
+         length++;
+      } else if (*p == 'j' || *p == 'q' || *p == 'L') {
+         length = 2;
+      } else if (*p == 'z' || *p == 't') {
+         length = 1;
+      } else {
+         break;
+      }
+   }
+
+   spec->conversion = *p;
+   switch (*p) {
+   case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+      spec->type = length >= 2 ? LOG_ARG_LONG_LONG : length ? LOG_ARG_LONG : LOG_ARG_INT;
+      break;
+   case 's': case 'p': case 'n':
+      spec->type = LOG_ARG_POINTER;
+      break;
+   case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+      spec->type = LOG_ARG_DOUBLE;
+      break;
+   case '\0':
+      return p;
+   }
+
+   return p + 1;
+}
+
+static int
+LogFormatThreadEntry(int argc,
+                     const char **argv)
+{
+   while (!sFormatThreadStop) {
+      WHBLogDeferredFlush();
+      OSSleepTicks(OSMillisecondsToTicks(DEFERRED_INTERVAL_MS));
+   }
+
+   return 0;
+}
+
+BOOL
+WHBLogDeferredInit(uint32_t recordsPerCore)
+{
+   uint32_t core;
+
+   if (sRecords) {
+      return TRUE;
+   }
+
+   if (!recordsPerCore) {
+      recordsPerCore = 1024;
+   }
+
+   sRecords = WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_LOG, sizeof(LogRecord) * recordsPerCore * DEFERRED_NUM_CORES, 0x40);
+   if (!sRecords) {
+      WHBLogPrintf("%s: failed to allocate %u records", __FUNCTION__, recordsPerCore);
+      return FALSE;
+   }
+
+   memset(sRecords, 0, sizeof(LogRecord) * recordsPerCore * DEFERRED_NUM_CORES);
+   sRecordsPerCore = recordsPerCore;
+   for (core = 0; core < DEFERRED_NUM_CORES; ++core) {
+      sRings[core].head = 0;
+      sRings[core].tail = 0;
+      sRings[core].records = sRecords + core * recordsPerCore;
+   }
+
+   OSInitMutex(&sFormatMutex);
+   sStartTime = OSGetSystemTime();
+   sDropped = 0;
+   sFormatThreadStop = FALSE;
+
+   if (!OSCreateThread(&sFormatThread,
+                       LogFormatThreadEntry,
+                       0,
+                       NULL,
+                       sFormatThreadStack + sizeof(sFormatThreadStack),
+                       sizeof(sFormatThreadStack),
+                       20,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      WHBLogPrintf("%s: OSCreateThread failed", __FUNCTION__);
+      WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_LOG, sRecords);
+      sRecords = NULL;
+      return FALSE;
+   }
+
+   OSSetThreadName(&sFormatThread, "WHB deferred log");
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(&sFormatThread);
+   }
+   OSResumeThread(&sFormatThread);
+   sEnabled = TRUE;
+   return TRUE;
+}
+
+void
+WHBLogDeferredShutdown()
+{
+   if (!sRecords) {
+      return;
+   }
+
+   sEnabled = FALSE;
+   OSMemoryBarrier();
+
+   sFormatThreadStop = TRUE;
+   OSJoinThread(&sFormatThread, NULL);
+   WHBLogDeferredFlush();
+
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_LOG, sRecords);
+   sRecords = NULL;
+}
+
+BOOL
+WHBLogDeferredf(const char *fmt, ...)
+{
+   LogRing *ring;
+   LogRecord *record;
+   LogSpec spec;
+   const char *p;
+   uint32_t head, i, n = 0;
+   double d;
+   va_list va;
+
+   if (!sEnabled) {
+      return FALSE;
+   }
+
+   // Threads on the same core can preempt each other, so reserve the slot
+   // rather than assuming a single writer
+   ring = &sRings[OSGetCoreId()];
+   do {
+      head = ring->head;
+      if (head - ring->tail >= sRecordsPerCore) {
+         OSAddAtomic((volatile int32_t *)&sDropped, 1);
+         return FALSE;
+      }
+   } while (!OSCompareAndSwapAtomic(&ring->head, head, head + 1));
+
+   record = &ring->records[head % sRecordsPerCore];
+   record->fmt = fmt;
+   record->time = OSGetSystemTime();
+
+   // Only walks the format for the argument types, nothing is converted
+   va_start(va, fmt);
+   for (p = strchr(fmt, '%'); p; p = strchr(p, '%')) {
+      p = LogParseSpec(p, &spec);
+      if (n + spec.stars + (spec.type != LOG_ARG_NONE) > WHB_LOG_DEFERRED_MAX_ARGS) {
+         break;
+      }
+
+      for (i = 0; i < spec.stars; ++i) {
+         record->args[n++] = (uint64_t)(int64_t)va_arg(va, int);
+      }
+
+      switch (spec.type) {
+      case LOG_ARG_INT:
+         record->args[n++] = (uint64_t)(int64_t)va_arg(va, int);
+         break;
+      case LOG_ARG_LONG:
+         record->args[n++] = (uint64_t)(int64_t)va_arg(va, long);
+         break;
+      case LOG_ARG_LONG_LONG:
+         record->args[n++] = (uint64_t)va_arg(va, long long);
+         break;
+      case LOG_ARG_POINTER:
+         record->args[n++] = (uint64_t)(uintptr_t)va_arg(va, void *);
+         break;
+      case LOG_ARG_DOUBLE:
+         d = va_arg(va, double);
+         memcpy(&record->args[n++], &d, sizeof(d));
+         break;
+      case LOG_ARG_NONE:
+         break;
+      }
+   }
+   va_end(va);
+
+   record->numArgs = n;
+   OSMemoryBarrier();
+   record->seq = head + 1;
+   return TRUE;
+}
+
+//! Format record into sLine the way vsnprintf would have.
+static void
+LogFormatRecord(const LogRecord *record)
+{
+   char spec[DEFERRED_SPEC_LENGTH];
+   const char *p, *end;
+   uint32_t pos, specLength, arg = 0;
+   uint64_t us;
+   LogSpec info;
+   double d;
+   int written;
+
+   us = OSTicksToMicroseconds(record->time - sStartTime);
+   pos = snprintf(sLine, DEFERRED_LINE_LENGTH, "[%5u.%06u] ",
+                  (uint32_t)(us / 1000000), (uint32_t)(us % 1000000));
+
+   for (p = record->fmt; *p && pos < DEFERRED_LINE_LENGTH - 1; p = end) {
+      end = strchr(p, '%');
+      if (!end || end != p) {
+         written = end ? end - p : (int)strlen(p);
+         if ((uint32_t)written > DEFERRED_LINE_LENGTH - 1 - pos) {
+            written = DEFERRED_LINE_LENGTH - 1 - pos;
+         }
+
+         memcpy(sLine + pos, p, written);
+         pos += written;
+         if (!end) {
+            break;
+         }
+
+         continue;
+      }
+
+      end = LogParseSpec(p, &info);
+      if (arg + info.stars + (info.type != LOG_ARG_NONE) > record->numArgs) {
+         break;
+      }
+
+      if (info.type == LOG_ARG_NONE || info.conversion == 'n') {
+         // %n was recorded but is never written back
+         if (info.conversion == '%') {
+            sLine[pos++] = '%';
+         }
+
+         arg += info.stars + (info.type != LOG_ARG_NONE);
+         continue;
+      }
+
+      // Replace * with the recorded width and precision
+      if ((end - p) + 11 * info.stars >= DEFERRED_SPEC_LENGTH) {
+         break;
+      }
+
+      for (specLength = 0; p < end; ++p) {
+         if (*p == '*') {
+            specLength += sprintf(spec + specLength, "%d", (int)record->args[arg++]);
+         } else {
+            spec[specLength++] = *p;
+         }
+      }
+      spec[specLength] = '\0';
+
+      switch (info.type) {
+      case LOG_ARG_INT:
+         written = snprintf(sLine + pos, DEFERRED_LINE_LENGTH - pos, spec, (int)record->args[arg]);
+         break;
+      case LOG_ARG_LONG:
+         written = snprintf(sLine + pos, DEFERRED_LINE_LENGTH - pos, spec, (long)record->args[arg]);
+         break;
+      case LOG_ARG_LONG_LONG:
+         written = snprintf(sLine + pos, DEFERRED_LINE_LENGTH - pos, spec, (long long)record->args[arg]);
+         break;
+      case LOG_ARG_POINTER:
+         written = snprintf(sLine + pos, DEFERRED_LINE_LENGTH - pos, spec, (void *)(uintptr_t)record->args[arg]);
+         break;
+      case LOG_ARG_DOUBLE:
+         memcpy(&d, &record->args[arg], sizeof(d));
+         written = snprintf(sLine + pos, DEFERRED_LINE_LENGTH - pos, spec, d);
+         break;
+      default:
+         written = 0;
+         break;
+      }
+
+      arg++;
+      if (written > 0) {
+         pos += written;
+      }
+   }
+
+   if (pos > DEFERRED_LINE_LENGTH - 1) {
+      pos = DEFERRED_LINE_LENGTH - 1;
+   }
+
+   sLine[pos] = '\0';
+}
+
+void
+WHBLogDeferredFlush()
+{
+   LogRing *ring;
+   LogRecord *slot, record;
+   uint32_t core, tail;
+
+   if (!sRecords) {
+      return;
+   }
+
+   OSLockMutex(&sFormatMutex);
+
+   for (core = 0; core < DEFERRED_NUM_CORES; ++core) {
+      ring = &sRings[core];
+
+      for (tail = ring->tail; tail != ring->head; ++tail) {
+         slot = &ring->records[tail % sRecordsPerCore];
+         if (slot->seq != tail + 1) {
+            // Still being written, records after it wait for the next pass
+            break;
+         }
+
+         // Copy it out so the slot can be reused while we format
+         OSMemoryBarrier();
+         record = *slot;
+         OSMemoryBarrier();
+         ring->tail = tail + 1;
+
+         LogFormatRecord(&record);
+         WHBLogPrint(sLine);
+      }
+   }
+
+   OSUnlockMutex(&sFormatMutex);
+}
+
+uint32_t
+WHBLogDeferredGetDropped()
+{
+   return sDropped;
+}
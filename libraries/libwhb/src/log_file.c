@@ -0,0 +1,334 @@
+#include "../../wutthreadstats/wut_thread_stats.h"
+
+#include <coreinit/atomic.h>
+#include <coreinit/event.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <whb/log.h>
+#include <whb/log_file.h>
+#include <wut_thread_stats.h>
+
+#define LOG_FILE_PATH_SIZE        256
+#define LOG_FILE_BUFFER_SIZE      (32 * 1024)
+#define LOG_FILE_BUFFER_ALIGNMENT 0x40
+
+#define WRITER_STACK_SIZE 0x4000
+#define WRITER_PRIORITY 30
+#define WRITER_IDLE_MS 100
+
+static int
+sFd = -1;
+
+static char
+sPath[LOG_FILE_PATH_SIZE];
+
+static char
+sRotatePath[LOG_FILE_PATH_SIZE + 2];
+
+static uint32_t
+sMaxFileSize = 0;
+
+static uint32_t
+sFileSize = 0;
+
+/*
+ * Messages are appended to sBuffers[sActive]. When it is full it is handed
+ * to the writer thread by flipping sActive and setting sPending, until the
+ * writer is done with it the other buffer is the only one left.
+ */
+static char
+sBuffers[2][LOG_FILE_BUFFER_SIZE] __attribute__((aligned(LOG_FILE_BUFFER_ALIGNMENT)));
+
+static uint32_t
+sFill[2];
+
+static uint32_t
+sActive = 0;
+
+static BOOL
+sPending = FALSE;
+
+//! Guards the buffer state above
+static OSMutex
+sBufferMutex;
+
+//! Held while writing to the file
+static OSMutex
+sWriteMutex;
+
+static volatile int32_t
+sDropped = 0;
+
+static volatile BOOL
+sStopWriter = FALSE;
+
+static OSEvent
+sWriterEvent;
+
+static OSThread
+sWriterThread;
+
+static uint8_t
+sWriterStack[WRITER_STACK_SIZE] __attribute__((aligned(16)));
+
+static void
+fileLogHandler(const char *msg)
+{
+   uint32_t length = strlen(msg);
+   BOOL signal = FALSE;
+
+   if (length > LOG_FILE_BUFFER_SIZE) {
+      length = LOG_FILE_BUFFER_SIZE;
+   }
+
+   OSLockMutex(&sBufferMutex);
+
+   if (sFill[sActive] + length > LOG_FILE_BUFFER_SIZE) {
+      if (sPending) {
+         // The writer hasn't caught up, never block the logging thread
+         OSUnlockMutex(&sBufferMutex);
+         OSAddAtomic(&sDropped, 1);
+         return;
+      }
+
+      sActive ^= 1;
+      sPending = TRUE;
+      signal = TRUE;
+   }
+
+   memcpy(sBuffers[sActive] + sFill[sActive], msg, length);
+   sFill[sActive] += length;
+   signal = signal || sFill[sActive] >= LOG_FILE_BUFFER_SIZE / 2;
+
+   OSUnlockMutex(&sBufferMutex);
+
+   if (signal) {
+      OSSignalEvent(&sWriterEvent);
+   }
+}
+
+static void
+fileLogRotate()
+{
+   close(sFd);
+   remove(sRotatePath);
+   rename(sPath, sRotatePath);
+
+   sFd = open(sPath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   sFileSize = 0;
+}
+
+static void
+fileLogWrite(const char *data,
+             uint32_t size)
+{
+   ssize_t written;
+
+   if (sFd < 0) {
+      return;
+   }
+
+   if (sMaxFileSize && sFileSize && sFileSize + size > sMaxFileSize) {
+      fileLogRotate();
+      if (sFd < 0) {
+         return;
+      }
+   }
+
+   written = write(sFd, data, size);
+   if (written > 0) {
+      sFileSize += written;
+   }
+}
+
+//! Write both buffers in the order they were filled, sWriteMutex must be held
+static void
+fileLogWriteBuffers()
+{
+   uint32_t i, index;
+
+   for (i = 0; i < 2; ++i) {
+      OSLockMutex(&sBufferMutex);
+      if (!sPending) {
+         if (!sFill[sActive]) {
+            OSUnlockMutex(&sBufferMutex);
+            break;
+         }
+
+         sActive ^= 1;
+         sPending = TRUE;
+      }
+
+      index = sActive ^ 1;
+      OSUnlockMutex(&sBufferMutex);
+
+      // The handler doesn't touch a pending buffer, so write it unlocked
+      fileLogWrite(sBuffers[index], sFill[index]);
+
+      OSLockMutex(&sBufferMutex);
+      sFill[index] = 0;
+      sPending = FALSE;
+      OSUnlockMutex(&sBufferMutex);
+   }
+}
+
+static int
+fileLogWriterThread(int argc,
+                    const char **argv)
+{
+   while (!sStopWriter) {
+      // Takes the timeout in nanoseconds
+      OSWaitEventWithTimeout(&sWriterEvent, WRITER_IDLE_MS * 1000000ull);
+
+      OSLockMutex(&sWriteMutex);
+      fileLogWriteBuffers();
+      OSUnlockMutex(&sWriteMutex);
+   }
+
+   return 0;
+}
+
+/*
+ * Strong definition of the weak hook in crash.c, called once the crash has
+ * been logged. The crashed thread may still hold sBufferMutex, so this
+ * writes the buffers as they are and closes the file without taking it.
+ */
+void
+__whb_log_file_flush()
+{
+   uint32_t i;
+
+   if (sFd < 0) {
+      return;
+   }
+
+   // Give the writer thread a moment to finish a write in progress
+   for (i = 0; i < 100 && !OSTryLockMutex(&sWriteMutex); ++i) {
+      OSSleepTicks(OSMillisecondsToTicks(1));
+   }
+
+   if (i == 100) {
+      return;
+   }
+
+   if (sPending) {
+      fileLogWrite(sBuffers[sActive ^ 1], sFill[sActive ^ 1]);
+   }
+
+   fileLogWrite(sBuffers[sActive], sFill[sActive]);
+   if (sFd >= 0) {
+      close(sFd);
+      sFd = -1;
+   }
+
+   OSUnlockMutex(&sWriteMutex);
+}
+
+BOOL
+WHBLogFileInit(const char *path)
+{
+   return WHBLogFileInitEx(path, WHB_LOG_FILE_DEFAULT_MAX_SIZE);
+}
+
+BOOL
+WHBLogFileInitEx(const char *path,
+                 uint32_t maxFileSize)
+{
+   off_t size;
+
+   if (sFd >= 0) {
+      return FALSE;
+   }
+
+   if (strlen(path) >= LOG_FILE_PATH_SIZE) {
+      return FALSE;
+   }
+
+   strcpy(sPath, path);
+   snprintf(sRotatePath, sizeof(sRotatePath), "%s.1", path);
+
+   sFd = open(sPath, O_WRONLY | O_CREAT | O_APPEND, 0666);
+   if (sFd < 0) {
+      return FALSE;
+   }
+
+   size = lseek(sFd, 0, SEEK_END);
+   sFileSize = size > 0 ? (uint32_t)size : 0;
+   sMaxFileSize = maxFileSize;
+
+   sFill[0] = sFill[1] = 0;
+   sActive = 0;
+   sPending = FALSE;
+   sDropped = 0;
+   sStopWriter = FALSE;
+   OSInitMutex(&sBufferMutex);
+   OSInitMutex(&sWriteMutex);
+   OSInitEvent(&sWriterEvent, FALSE, OS_EVENT_MODE_AUTO);
+
+   if (!OSCreateThread(&sWriterThread,
+                       fileLogWriterThread,
+                       0,
+                       NULL,
+                       sWriterStack + WRITER_STACK_SIZE,
+                       WRITER_STACK_SIZE,
+                       WRITER_PRIORITY,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      close(sFd);
+      sFd = -1;
+      return FALSE;
+   }
+
+   OSSetThreadName(&sWriterThread, "WHBLogFile");
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(&sWriterThread);
+   }
+   OSResumeThread(&sWriterThread);
+
+   return WHBAddLogHandler(fileLogHandler);
+}
+
+BOOL
+WHBLogFileDeinit()
+{
+   BOOL result = WHBRemoveLogHandler(fileLogHandler);
+
+   if (sFd < 0) {
+      return result;
+   }
+
+   sStopWriter = TRUE;
+   OSSignalEvent(&sWriterEvent);
+   OSJoinThread(&sWriterThread, NULL);
+
+   // Write whatever was logged before deinit
+   fileLogWriteBuffers();
+   if (sFd >= 0) {
+      close(sFd);
+      sFd = -1;
+   }
+
+   return result;
+}
+
+void
+WHBLogFileFlush()
+{
+   if (sFd < 0) {
+      return;
+   }
+
+   OSLockMutex(&sWriteMutex);
+   fileLogWriteBuffers();
+   OSUnlockMutex(&sWriteMutex);
+}
+
+uint32_t
+WHBLogFileGetDroppedCount()
+{
+   return (uint32_t)sDropped;
+}
@@ -1,5 +1,9 @@
-#include <coreinit/memdefaultheap.h>
-#include <coreinit/mutex.h>
+#include "../../wutthreadstats/wut_thread_stats.h"
+
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -8,6 +12,28 @@
 #include <whb/log.h>
 #include <whb/log_udp.h>
 #include <whb/libmanager.h>
+#include <wut_thread_stats.h>
+
+#define SERVER_PORT 4405
+
+// Must be a power of two
+#define RING_SLOT_COUNT 64
+#define RING_SLOT_SIZE 512
+
+// Largest UDP payload that fits in an ethernet frame
+#define DATAGRAM_SIZE 1472
+
+#define SENDER_STACK_SIZE 0x4000
+#define SENDER_PRIORITY 30
+#define SENDER_IDLE_MS 5
+
+typedef struct
+{
+   //! Slot index the slot is ready for, see udpLogPush
+   volatile uint32_t sequence;
+   uint32_t length;
+   char data[RING_SLOT_SIZE];
+} LogSlot;
 
 static int
 sSocket = -1;
@@ -15,23 +41,137 @@ sSocket = -1;
 static struct sockaddr_in
 sSendAddr;
 
-#define SERVER_PORT 4405
+static LogSlot
+sSlots[RING_SLOT_COUNT];
+
+static volatile uint32_t
+sPushPos = 0;
+
+// Only touched by the sender thread
+static uint32_t
+sPopPos = 0;
+
+static volatile int32_t
+sDropped = 0;
+
+static volatile BOOL
+sStopSender = FALSE;
+
+static OSThread
+sSenderThread;
+
+static uint8_t
+sSenderStack[SENDER_STACK_SIZE] __attribute__((aligned(16)));
+
+static char
+sDatagram[DATAGRAM_SIZE];
+
+/*
+ * Bounded multi-producer single-consumer queue, a slot can be claimed when
+ * its sequence equals the push position and read once it is one past it.
+ */
+static BOOL
+udpLogPush(const char *msg,
+           uint32_t length)
+{
+   uint32_t pos = sPushPos;
+   LogSlot *slot;
+
+   while (TRUE) {
+      slot = &sSlots[pos & (RING_SLOT_COUNT - 1)];
+      int32_t diff = (int32_t)(slot->sequence - pos);
+
+      if (diff == 0) {
+         if (OSCompareAndSwapAtomic(&sPushPos, pos, pos + 1)) {
+            break;
+         }
+      } else if (diff < 0) {
+         // The sender hasn't caught up, never block the logging thread
+         return FALSE;
+      }
+
+      pos = sPushPos;
+   }
+
+   memcpy(slot->data, msg, length);
+   slot->length = length;
+   OSMemoryBarrier();
+   slot->sequence = pos + 1;
+   return TRUE;
+}
 
 static void
 udpLogHandler(const char *msg)
 {
-   sendto(sSocket,
-          msg,
-          strlen(msg),
-          0,
-          (struct sockaddr *)&sSendAddr,
-          sizeof(struct sockaddr_in));
+   uint32_t length = strlen(msg);
+
+   // Split long messages over several slots
+   while (length) {
+      uint32_t chunk = length < RING_SLOT_SIZE ? length : RING_SLOT_SIZE;
+      if (!udpLogPush(msg, chunk)) {
+         OSAddAtomic(&sDropped, 1);
+         return;
+      }
+
+      msg += chunk;
+      length -= chunk;
+   }
+}
+
+static void
+udpLogFlush()
+{
+   uint32_t size = 0;
+
+   while (TRUE) {
+      LogSlot *slot = &sSlots[sPopPos & (RING_SLOT_COUNT - 1)];
+      if (slot->sequence != sPopPos + 1) {
+         break;
+      }
+
+      OSMemoryBarrier();
+
+      // Send what we have so far if the slot doesn't fit in this datagram
+      if (size + slot->length > DATAGRAM_SIZE) {
+         sendto(sSocket, sDatagram, size, 0,
+                (struct sockaddr *)&sSendAddr, sizeof(struct sockaddr_in));
+         size = 0;
+      }
+
+      memcpy(sDatagram + size, slot->data, slot->length);
+      size += slot->length;
+
+      // Hand the slot back to the producers for the next lap
+      OSMemoryBarrier();
+      slot->sequence = sPopPos + RING_SLOT_COUNT;
+      sPopPos++;
+   }
+
+   if (size) {
+      sendto(sSocket, sDatagram, size, 0,
+             (struct sockaddr *)&sSendAddr, sizeof(struct sockaddr_in));
+   }
+}
+
+static int
+udpLogSenderThread(int argc,
+                   const char **argv)
+{
+   while (!sStopSender) {
+      udpLogFlush();
+      OSSleepTicks(OSMillisecondsToTicks(SENDER_IDLE_MS));
+   }
+
+   // Send whatever was logged before deinit
+   udpLogFlush();
+   return 0;
 }
 
 BOOL
 WHBLogUdpInit()
 {
    int broadcastEnable = 1;
+   uint32_t i;
 
    sSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
    if (sSocket < 0) {
@@ -45,15 +185,57 @@ WHBLogUdpInit()
    sSendAddr.sin_port = htons(SERVER_PORT);
    sSendAddr.sin_addr.s_addr = htonl(INADDR_BROADCAST);
 
+   for (i = 0; i < RING_SLOT_COUNT; ++i) {
+      sSlots[i].sequence = i;
+   }
+   sPushPos = 0;
+   sPopPos = 0;
+   sDropped = 0;
+   sStopSender = FALSE;
+
+   if (!OSCreateThread(&sSenderThread,
+                       udpLogSenderThread,
+                       0,
+                       NULL,
+                       sSenderStack + SENDER_STACK_SIZE,
+                       SENDER_STACK_SIZE,
+                       SENDER_PRIORITY,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      close(sSocket);
+      sSocket = -1;
+      return FALSE;
+   }
+
+   OSSetThreadName(&sSenderThread, "WHBLogUdp");
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(&sSenderThread);
+   }
+   OSResumeThread(&sSenderThread);
+
    return WHBAddLogHandler(udpLogHandler);
 }
 
 BOOL
 WHBLogUdpDeinit()
 {
+   BOOL result = WHBRemoveLogHandler(udpLogHandler);
+
+   if (sSocket < 0) {
+      return result;
+   }
+
+   sStopSender = TRUE;
+   OSJoinThread(&sSenderThread, NULL);
+
    shutdown(sSocket, SHUT_WR);
    close(sSocket);
    sSocket = -1;
 
-   return WHBRemoveLogHandler(udpLogHandler);
+   return result;
+}
+
+uint32_t
+WHBLogUdpGetDroppedCount()
+{
+   return (uint32_t)sDropped;
 }
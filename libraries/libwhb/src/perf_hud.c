@@ -0,0 +1,299 @@
+#include <coreinit/cache.h>
+#include <coreinit/screen.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include <whb/audio_profiler.h>
+#include <whb/gfx.h>
+#include <whb/gpu_profiler.h>
+#include <whb/log.h>
+#include <whb/log_console.h>
+#include <whb/perf_hud.h>
+
+#define HUD_NUM_CORES        3
+#define HUD_NUM_LINES        5
+#define HUD_LINE_LENGTH      80
+#define HUD_IDLE_STACK_SIZE  (2048)
+#define HUD_IDLE_PRIORITY    31
+
+//! Gaps between two idle loop iterations longer than this were preemptions
+#define HUD_IDLE_MAX_GAP_US  (20)
+
+static BOOL
+sHudInit = FALSE;
+
+static volatile BOOL
+sHudEnabled = FALSE;
+
+static WHBPerfHudStats
+sStats;
+
+static OSTime
+sLastFrame = 0;
+
+static OSThread
+sIdleThreads[HUD_NUM_CORES];
+
+static uint8_t
+sIdleStacks[HUD_NUM_CORES][HUD_IDLE_STACK_SIZE] __attribute__((aligned(16)));
+
+static volatile BOOL
+sIdleStop = FALSE;
+
+//! Written only by the idle thread of each core, wraps every ~69 seconds
+static volatile uint32_t
+sIdleTicks[HUD_NUM_CORES];
+
+static uint32_t
+sLastIdleTicks[HUD_NUM_CORES];
+
+static int
+HudIdleThreadEntry(int argc,
+                   const char **argv)
+{
+   uint32_t core = (uint32_t)argc;
+   uint32_t maxGap = (uint32_t)OSMicrosecondsToTicks(HUD_IDLE_MAX_GAP_US);
+   uint32_t last = (uint32_t)OSGetSystemTick();
+
+   // Only the time this thread actually spins counts, anything that ran in
+   // between shows up as a long gap
+   while (!sIdleStop) {
+      uint32_t now = (uint32_t)OSGetSystemTick();
+      uint32_t gap = now - last;
+
+      if (gap < maxGap) {
+         sIdleTicks[core] += gap;
+      }
+
+      last = now;
+   }
+
+   return 0;
+}
+
+static void
+HudStartIdleThreads()
+{
+   uint32_t core;
+
+   sIdleStop = FALSE;
+   for (core = 0; core < HUD_NUM_CORES; ++core) {
+      if (!OSCreateThread(&sIdleThreads[core],
+                          HudIdleThreadEntry,
+                          (int)core,
+                          NULL,
+                          sIdleStacks[core] + HUD_IDLE_STACK_SIZE,
+                          HUD_IDLE_STACK_SIZE,
+                          HUD_IDLE_PRIORITY,
+                          OS_THREAD_ATTRIB_AFFINITY_CPU0 << core)) {
+         WHBLogPrintf("%s: OSCreateThread failed for core %u", __FUNCTION__, core);
+         continue;
+      }
+
+      OSSetThreadName(&sIdleThreads[core], "WHBPerfHud idle");
+      OSResumeThread(&sIdleThreads[core]);
+   }
+}
+
+static void
+HudStopIdleThreads()
+{
+   uint32_t core;
+
+   sIdleStop = TRUE;
+   for (core = 0; core < HUD_NUM_CORES; ++core) {
+      if (sIdleThreads[core].tag == OS_THREAD_TAG) {
+         OSJoinThread(&sIdleThreads[core], NULL);
+         memset(&sIdleThreads[core], 0, sizeof(OSThread));
+      }
+   }
+}
+
+//! Returns the number of lines, the audio line is only there while the
+//! audio profiler runs
+static uint32_t
+HudFormatLines(char lines[HUD_NUM_LINES][HUD_LINE_LENGTH])
+{
+   snprintf(lines[0], HUD_LINE_LENGTH, "CPU %3u.%02u ms  avg %3u.%02u  max %3u.%02u",
+            (uint32_t)(OSTicksToMicroseconds(sStats.frameTime) / 1000),
+            (uint32_t)(OSTicksToMicroseconds(sStats.frameTime) % 1000) / 10,
+            (uint32_t)(OSTicksToMicroseconds(sStats.averageFrameTime) / 1000),
+            (uint32_t)(OSTicksToMicroseconds(sStats.averageFrameTime) % 1000) / 10,
+            (uint32_t)(OSTicksToMicroseconds(sStats.maxFrameTime) / 1000),
+            (uint32_t)(OSTicksToMicroseconds(sStats.maxFrameTime) % 1000) / 10);
+   snprintf(lines[1], HUD_LINE_LENGTH, "GPU %3u.%02u ms  %s",
+            (uint32_t)(OSTicksToMicroseconds(sStats.gpuTime) / 1000),
+            (uint32_t)(OSTicksToMicroseconds(sStats.gpuTime) % 1000) / 10,
+            sStats.gpuPassName ? sStats.gpuPassName : "-");
+   snprintf(lines[2], HUD_LINE_LENGTH, "Idle core0 %3u%%  core1 %3u%%  core2 %3u%%",
+            sStats.coreIdle[0], sStats.coreIdle[1], sStats.coreIdle[2]);
+   snprintf(lines[3], HUD_LINE_LENGTH, "Heap %u/%u KiB  MEM1 %u/%u KiB",
+            sStats.heapUsed / 1024, sStats.heapSize / 1024,
+            sStats.mem1Used / 1024, sStats.mem1Size / 1024);
+
+   if (!WHBAudioProfilerIsRunning()) {
+      return HUD_NUM_LINES - 1;
+   }
+
+   snprintf(lines[4], HUD_LINE_LENGTH, "AX  %3u.%02u ms peak %3u%%  voices %3u  overruns %u",
+            (uint32_t)(OSTicksToMicroseconds(sStats.audioPeakTime) / 1000),
+            (uint32_t)(OSTicksToMicroseconds(sStats.audioPeakTime) % 1000) / 10,
+            sStats.audioPeakLoad, sStats.audioPeakVoices, sStats.audioOverruns);
+   return HUD_NUM_LINES;
+}
+
+static uint32_t
+HudConsoleOverlay(void *context)
+{
+   char lines[HUD_NUM_LINES][HUD_LINE_LENGTH];
+   uint32_t numLines, i;
+
+   numLines = HudFormatLines(lines);
+   for (i = 0; i < numLines; ++i) {
+      OSScreenPutFontEx(SCREEN_TV, 0, i, lines[i]);
+      OSScreenPutFontEx(SCREEN_DRC, 0, i, lines[i]);
+   }
+
+   // Keep an empty row between the HUD and the log
+   return numLines + 1;
+}
+
+BOOL
+WHBPerfHudInit()
+{
+   if (sHudInit) {
+      return TRUE;
+   }
+
+   memset(&sStats, 0, sizeof(sStats));
+   sHudInit = TRUE;
+   return TRUE;
+}
+
+void
+WHBPerfHudShutdown()
+{
+   if (!sHudInit) {
+      return;
+   }
+
+   WHBPerfHudSetEnabled(FALSE);
+   sHudInit = FALSE;
+}
+
+void
+WHBPerfHudSetEnabled(BOOL enabled)
+{
+   uint32_t core;
+
+   if (!sHudInit || !enabled == !sHudEnabled) {
+      return;
+   }
+
+   if (enabled) {
+      memset(&sStats, 0, sizeof(sStats));
+      sLastFrame = 0;
+      for (core = 0; core < HUD_NUM_CORES; ++core) {
+         sIdleTicks[core] = 0;
+         sLastIdleTicks[core] = 0;
+      }
+
+      HudStartIdleThreads();
+      WHBLogConsoleSetOverlay(HudConsoleOverlay, NULL);
+   } else {
+      WHBLogConsoleSetOverlay(NULL, NULL);
+      HudStopIdleThreads();
+   }
+
+   sHudEnabled = enabled;
+}
+
+BOOL
+WHBPerfHudIsEnabled()
+{
+   return sHudEnabled;
+}
+
+void
+WHBPerfHudBeginFrame()
+{
+   WHBGpuProfilerPass passes[WHB_GPU_PROFILER_MAX_PASSES];
+   WHBAudioProfilerStats audio;
+   WHBGfxMemoryUsage mem1;
+   struct mallinfo heap;
+   OSTime now, frameTime;
+   uint32_t core, numPasses, i;
+
+   if (!sHudEnabled) {
+      return;
+   }
+
+   now = OSGetSystemTime();
+   if (!sLastFrame) {
+      sLastFrame = now;
+      return;
+   }
+
+   frameTime = now - sLastFrame;
+   sLastFrame = now;
+
+   sStats.frameTime = frameTime;
+   sStats.averageFrameTime = sStats.averageFrameTime
+                           ? (sStats.averageFrameTime * 15 + frameTime) / 16
+                           : frameTime;
+   if (frameTime > sStats.maxFrameTime) {
+      sStats.maxFrameTime = frameTime;
+   }
+
+   for (core = 0; core < HUD_NUM_CORES; ++core) {
+      uint32_t idle = sIdleTicks[core];
+      uint64_t delta = idle - sLastIdleTicks[core];
+      sLastIdleTicks[core] = idle;
+      sStats.coreIdle[core] = (uint32_t)MIN(delta * 100 / (uint64_t)frameTime, 100);
+   }
+
+   sStats.gpuTime = 0;
+   sStats.gpuPassName = NULL;
+   numPasses = WHBGpuProfilerGetPasses(passes, WHB_GPU_PROFILER_MAX_PASSES);
+   for (i = 0; i < numPasses; ++i) {
+      if (passes[i].lastTime > sStats.gpuTime) {
+         sStats.gpuTime = passes[i].lastTime;
+         sStats.gpuPassName = passes[i].name;
+      }
+   }
+
+   heap = mallinfo();
+   sStats.heapUsed = heap.uordblks;
+   sStats.heapSize = heap.arena;
+
+   WHBGfxGetMEM1Usage(&mem1);
+   sStats.mem1Used = mem1.usedSize;
+   sStats.mem1Size = mem1.totalSize;
+
+   WHBAudioProfilerGetStats(&audio);
+   sStats.audioPeakTime = audio.peakFrameTime;
+   sStats.audioPeakLoad = audio.peakLoad;
+   sStats.audioPeakVoices = audio.peakVoices;
+   sStats.audioOverruns = audio.overruns;
+}
+
+void
+WHBPerfHudGetStats(WHBPerfHudStats *stats)
+{
+   *stats = sStats;
+}
+
+void
+WHBPerfHudLog()
+{
+   char lines[HUD_NUM_LINES][HUD_LINE_LENGTH];
+   uint32_t numLines, i;
+
+   numLines = HudFormatLines(lines);
+   for (i = 0; i < numLines; ++i) {
+      WHBLogPrint(lines[i]);
+   }
+}
@@ -0,0 +1,286 @@
+#include "../../wutthreadstats/wut_thread_stats.h"
+
+#include <coreinit/atomic.h>
+#include <coreinit/filesystem_fsa.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <whb/log.h>
+#include <whb/preload.h>
+#include <wut_thread_stats.h>
+
+#define PRELOAD_STACK_SIZE (16 * 1024)
+#define PRELOAD_DEFAULT_THREADS 3
+#define PRELOAD_CHUNK_SIZE (1024 * 1024)
+
+struct WHBPreloadThread
+{
+   OSThread thread;
+   uint8_t stack[PRELOAD_STACK_SIZE] __attribute__((aligned(16)));
+   WHBPreload *preload;
+   FSAClientHandle client;
+   BOOL started;
+};
+
+static void *
+PreloadDefaultAlloc(uint32_t size,
+                    uint32_t alignment,
+                    void *context)
+{
+   return MEMAllocFromDefaultHeapEx(size, alignment);
+}
+
+static void
+PreloadDefaultFree(void *ptr,
+                   void *context)
+{
+   MEMFreeToDefaultHeap(ptr);
+}
+
+static const WHBFileAllocator
+sPreloadDefaultAllocator = { PreloadDefaultAlloc, PreloadDefaultFree, NULL };
+
+static int
+PreloadCompareFiles(const void *a,
+                    const void *b)
+{
+   const WHBPreloadFile *fileA = *(const WHBPreloadFile **)a;
+   const WHBPreloadFile *fileB = *(const WHBPreloadFile **)b;
+   return strcmp(fileA->path, fileB->path);
+}
+
+static BOOL
+PreloadReadFile(FSAClientHandle client,
+                WHBPreloadFile *file)
+{
+   const WHBFileAllocator *allocator = file->allocator ? file->allocator : &sPreloadDefaultAllocator;
+   char path[256];
+   FSAFileHandle handle;
+   FSAStat stat;
+   FSError result;
+   uint32_t offset = 0;
+
+   if (file->path[0] != '/') {
+      snprintf(path, sizeof(path), "/vol/content/%s", file->path);
+   } else {
+      snprintf(path, sizeof(path), "%s", file->path);
+   }
+
+   result = FSAOpenFileEx(client, path, "r", (FSMode)0, FS_OPEN_FLAG_NONE, 0, &handle);
+   if (result < 0) {
+      WHBLogPrintf("%s: FSAOpenFileEx(%s) error %d", __FUNCTION__, path, result);
+      return FALSE;
+   }
+
+   result = FSAGetStatFile(client, handle, &stat);
+   if (result < 0 || !stat.size) {
+      goto error;
+   }
+
+   file->size = stat.size;
+   file->data = allocator->alloc((stat.size + 0x3F) & ~0x3F, 64, allocator->context);
+   if (!file->data) {
+      WHBLogPrintf("%s: alloc(0x%X, 64) failed for %s", __FUNCTION__,
+                   (stat.size + 0x3F) & ~0x3F, path);
+      goto error;
+   }
+
+   while (offset < file->size) {
+      uint32_t length = file->size - offset;
+      if (length > PRELOAD_CHUNK_SIZE) {
+         length = PRELOAD_CHUNK_SIZE;
+      }
+
+      result = FSAReadFile(client, file->data + offset, 1, length, handle, 0);
+      if (result < 0 || (uint32_t)result != length) {
+         WHBLogPrintf("%s: FSAReadFile(%s) error %d", __FUNCTION__, path, result);
+         goto error;
+      }
+
+      offset += length;
+   }
+
+   FSACloseFile(client, handle);
+   return TRUE;
+
+error:
+   if (file->data && allocator->free) {
+      allocator->free(file->data, allocator->context);
+   }
+
+   file->data = NULL;
+   file->size = 0;
+   FSACloseFile(client, handle);
+   return FALSE;
+}
+
+static int
+PreloadThreadEntry(int argc,
+                   const char **argv)
+{
+   WHBPreloadThread *self = (WHBPreloadThread *)argv;
+   WHBPreload *preload = self->preload;
+
+   while (1) {
+      uint32_t index = (uint32_t)OSAddAtomic((volatile int32_t *)&preload->next, 1);
+      WHBPreloadFile *file;
+
+      if (index >= preload->count) {
+         break;
+      }
+
+      file = preload->order[index];
+      file->status = PreloadReadFile(self->client, file) ? WHB_PRELOAD_OK : WHB_PRELOAD_FAILED;
+      if (preload->callback) {
+         preload->callback(file, preload->context);
+      }
+
+      OSAddAtomic((volatile int32_t *)&preload->completed, 1);
+   }
+
+   return 0;
+}
+
+BOOL
+WHBPreloadStart(WHBPreload *preload,
+                WHBPreloadFile *files,
+                uint32_t count,
+                uint32_t numThreads,
+                WHBPreloadCallbackFn callback,
+                void *context)
+{
+   uint32_t i;
+
+   memset(preload, 0, sizeof(WHBPreload));
+   preload->files = files;
+   preload->count = count;
+   preload->callback = callback;
+   preload->context = context;
+
+   if (!numThreads) {
+      numThreads = PRELOAD_DEFAULT_THREADS;
+   } else if (numThreads > WHB_PRELOAD_MAX_THREADS) {
+      numThreads = WHB_PRELOAD_MAX_THREADS;
+   }
+
+   if (numThreads > count) {
+      numThreads = count;
+   }
+
+   for (i = 0; i < count; ++i) {
+      files[i].data = NULL;
+      files[i].size = 0;
+      files[i].status = WHB_PRELOAD_PENDING;
+   }
+
+   if (!count) {
+      return TRUE;
+   }
+
+   preload->order = MEMAllocFromDefaultHeap(sizeof(WHBPreloadFile *) * count);
+   preload->threads = MEMAllocFromDefaultHeapEx(sizeof(WHBPreloadThread) * numThreads, 16);
+   if (!preload->order || !preload->threads) {
+      WHBLogPrintf("%s: failed to allocate %u threads", __FUNCTION__, numThreads);
+      WHBPreloadWait(preload);
+      return FALSE;
+   }
+
+   for (i = 0; i < count; ++i) {
+      preload->order[i] = &files[i];
+   }
+
+   qsort(preload->order, count, sizeof(WHBPreloadFile *), PreloadCompareFiles);
+
+   FSAInit();
+   memset(preload->threads, 0, sizeof(WHBPreloadThread) * numThreads);
+   for (i = 0; i < numThreads; ++i) {
+      WHBPreloadThread *thread = &preload->threads[i];
+
+      // Separate clients, so the requests of different threads don't queue
+      // up behind each other
+      thread->preload = preload;
+      thread->client = FSAAddClient(NULL);
+      if (thread->client < 0) {
+         WHBLogPrintf("%s: FSAAddClient failed", __FUNCTION__);
+         break;
+      }
+
+      if (!OSCreateThread(&thread->thread,
+                          PreloadThreadEntry,
+                          0,
+                          (char *)thread,
+                          thread->stack + PRELOAD_STACK_SIZE,
+                          PRELOAD_STACK_SIZE,
+                          16,
+                          OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+         WHBLogPrintf("%s: OSCreateThread failed", __FUNCTION__);
+         FSADelClient(thread->client);
+         break;
+      }
+
+      OSSetThreadName(&thread->thread, "WHB preload");
+      thread->started = TRUE;
+      preload->numThreads++;
+   }
+
+   for (i = 0; i < preload->numThreads; ++i) {
+      if (__wut_thread_stats_running) {
+         WUTThreadStatsRegister(&preload->threads[i].thread);
+      }
+      OSResumeThread(&preload->threads[i].thread);
+   }
+
+   if (!preload->numThreads) {
+      WHBPreloadWait(preload);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+uint32_t
+WHBPreloadGetCompleted(WHBPreload *preload)
+{
+   return preload->completed;
+}
+
+BOOL
+WHBPreloadIsDone(WHBPreload *preload)
+{
+   return preload->completed >= preload->count;
+}
+
+BOOL
+WHBPreloadWait(WHBPreload *preload)
+{
+   BOOL ok = TRUE;
+   uint32_t i;
+
+   if (preload->threads) {
+      for (i = 0; i < preload->numThreads; ++i) {
+         if (preload->threads[i].started) {
+            OSJoinThread(&preload->threads[i].thread, NULL);
+            FSADelClient(preload->threads[i].client);
+         }
+      }
+
+      MEMFreeToDefaultHeap(preload->threads);
+      preload->threads = NULL;
+   }
+
+   if (preload->order) {
+      MEMFreeToDefaultHeap(preload->order);
+      preload->order = NULL;
+   }
+
+   preload->numThreads = 0;
+   for (i = 0; i < preload->count; ++i) {
+      if (preload->files[i].status != WHB_PRELOAD_OK) {
+         ok = FALSE;
+      }
+   }
+
+   return ok;
+}
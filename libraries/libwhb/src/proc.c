@@ -1,4 +1,5 @@
 #include <coreinit/core.h>
+#include <coreinit/event.h>
 #include <coreinit/exit.h>
 #include <coreinit/foreground.h>
 #include <coreinit/messagequeue.h>
@@ -7,14 +8,25 @@
 #include <gx2/event.h>
 #include <proc_ui/procui.h>
 #include <sysapp/launch.h>
+#include <string.h>
 #include <whb/log.h>
 #include <whb/proc.h>
+#include <wut_job.h>
 
 #define HBL_TITLE_ID (0x0005000013374842)
 #define MII_MAKER_JPN_TITLE_ID (0x000500101004A000)
 #define MII_MAKER_USA_TITLE_ID (0x000500101004A100)
 #define MII_MAKER_EUR_TITLE_ID (0x000500101004A200)
 
+#define PROC_MAX_FOREGROUND_CALLBACKS (8)
+
+typedef struct
+{
+   WHBProcForegroundCallbackFn release;
+   WHBProcForegroundCallbackFn acquire;
+   void *context;
+} ProcForegroundCallback;
+
 static uint32_t
 sMainCore;
 
@@ -24,6 +36,58 @@ sRunning = FALSE;
 static BOOL
 sFromHBL = FALSE;
 
+static BOOL
+sInForeground = TRUE;
+
+static BOOL
+sSuspendJobs = TRUE;
+
+//! Signalled while the application is in the foreground
+static OSEvent
+sForegroundEvent;
+
+static ProcForegroundCallback
+sForegroundCallbacks[PROC_MAX_FOREGROUND_CALLBACKS];
+
+static void
+procReleaseForeground()
+{
+   int i;
+
+   sInForeground = FALSE;
+   OSResetEvent(&sForegroundEvent);
+
+   // Release in the reverse order of acquiring
+   for (i = PROC_MAX_FOREGROUND_CALLBACKS - 1; i >= 0; --i) {
+      if (sForegroundCallbacks[i].release) {
+         sForegroundCallbacks[i].release(sForegroundCallbacks[i].context);
+      }
+   }
+
+   if (sSuspendJobs) {
+      WUTJobSystemSuspend();
+   }
+}
+
+static void
+procAcquireForeground()
+{
+   int i;
+
+   if (sSuspendJobs) {
+      WUTJobSystemResume();
+   }
+
+   for (i = 0; i < PROC_MAX_FOREGROUND_CALLBACKS; ++i) {
+      if (sForegroundCallbacks[i].acquire) {
+         sForegroundCallbacks[i].acquire(sForegroundCallbacks[i].context);
+      }
+   }
+
+   sInForeground = TRUE;
+   OSSignalEvent(&sForegroundEvent);
+}
+
 static uint32_t
 procSaveCallback(void *context)
 {
@@ -61,6 +125,8 @@ WHBProcInit()
 
    sMainCore = OSGetCoreId();
    sRunning = TRUE;
+   sInForeground = TRUE;
+   OSInitEventEx(&sForegroundEvent, TRUE, OS_EVENT_MODE_MANUAL, "WHBProc foreground");
    ProcUIInitEx(&procSaveCallback, NULL);
 
    if (sFromHBL) {
@@ -74,6 +140,9 @@ WHBProcShutdown()
 {
    sRunning = FALSE;
 
+   // Don't leave threads waiting for a foreground that will never come
+   OSSignalEvent(&sForegroundEvent);
+
    // If we're running from Homebrew Launcher we must do a SYSRelaunchTitle to
    // correctly return to HBL.
    if (sFromHBL) {
@@ -85,6 +154,66 @@ void
 WHBProcStopRunning()
 {
    sRunning = FALSE;
+   OSSignalEvent(&sForegroundEvent);
+}
+
+BOOL
+WHBProcAddForegroundCallbacks(WHBProcForegroundCallbackFn release,
+                              WHBProcForegroundCallbackFn acquire,
+                              void *context)
+{
+   int i;
+
+   for (i = 0; i < PROC_MAX_FOREGROUND_CALLBACKS; ++i) {
+      if (!sForegroundCallbacks[i].release && !sForegroundCallbacks[i].acquire) {
+         sForegroundCallbacks[i].release = release;
+         sForegroundCallbacks[i].acquire = acquire;
+         sForegroundCallbacks[i].context = context;
+         return TRUE;
+      }
+   }
+
+   WHBLogPrintf("%s: too many callbacks", __FUNCTION__);
+   return FALSE;
+}
+
+void
+WHBProcRemoveForegroundCallbacks(WHBProcForegroundCallbackFn release,
+                                 WHBProcForegroundCallbackFn acquire,
+                                 void *context)
+{
+   int i;
+
+   for (i = 0; i < PROC_MAX_FOREGROUND_CALLBACKS; ++i) {
+      if (sForegroundCallbacks[i].release == release &&
+          sForegroundCallbacks[i].acquire == acquire &&
+          sForegroundCallbacks[i].context == context) {
+         memset(&sForegroundCallbacks[i], 0, sizeof(ProcForegroundCallback));
+         return;
+      }
+   }
+}
+
+void
+WHBProcSetSuspendJobsInBackground(BOOL suspend)
+{
+   sSuspendJobs = suspend;
+}
+
+BOOL
+WHBProcIsInForeground()
+{
+   return sInForeground;
+}
+
+BOOL
+WHBProcWaitForeground()
+{
+   if (!sInForeground && sRunning) {
+      OSWaitEvent(&sForegroundEvent);
+   }
+
+   return sRunning;
 }
 
 BOOL
@@ -101,7 +230,12 @@ WHBProcIsRunning()
    if (status == PROCUI_STATUS_EXITING) {
       WHBProcStopRunning();
    } else if (status == PROCUI_STATUS_RELEASE_FOREGROUND) {
+      if (sInForeground) {
+         procReleaseForeground();
+      }
       ProcUIDrawDoneRelease();
+   } else if (status == PROCUI_STATUS_IN_FOREGROUND && !sInForeground) {
+      procAcquireForeground();
    }
 
    if (!sRunning) {
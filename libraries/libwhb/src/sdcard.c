@@ -1,7 +1,14 @@
+#include <coreinit/atomic.h>
 #include <coreinit/filesystem.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/semaphore.h>
+#include <string.h>
 #include <whb/sdcard.h>
 #include <whb/log.h>
 
+#define WHB_SDCARD_DEFAULT_CMD_BLOCKS (4)
+#define WHB_SDCARD_DEFAULT_PRIORITY (16)
+
 static BOOL
 sMounted = FALSE;
 
@@ -11,10 +18,81 @@ sMountPath[128] = { 0 };
 static FSClient
 sClient;
 
+static FSCmdBlock *
+sCmdBlocks = NULL;
+
+//! One word per command block, 1 while it is acquired
+static volatile uint32_t *
+sCmdBlocksInUse = NULL;
+
+static uint32_t
+sNumCmdBlocks = 0;
+
+//! Counts the free command blocks
+static OSSemaphore
+sCmdBlockSemaphore;
+
+static void
+SdCardFreeCmdBlocks()
+{
+   if (sCmdBlocks) {
+      MEMFreeToDefaultHeap(sCmdBlocks);
+      sCmdBlocks = NULL;
+   }
+
+   if (sCmdBlocksInUse) {
+      MEMFreeToDefaultHeap((void *)sCmdBlocksInUse);
+      sCmdBlocksInUse = NULL;
+   }
+
+   sNumCmdBlocks = 0;
+}
+
+static BOOL
+SdCardAllocCmdBlocks(uint32_t count,
+                     FSPriority priority)
+{
+   uint32_t i;
+
+   sCmdBlocks = MEMAllocFromDefaultHeapEx(sizeof(FSCmdBlock) * count, 0x40);
+   sCmdBlocksInUse = MEMAllocFromDefaultHeap(sizeof(uint32_t) * count);
+   if (!sCmdBlocks || !sCmdBlocksInUse) {
+      WHBLogPrintf("%s: failed to allocate %u command blocks", __FUNCTION__, count);
+      SdCardFreeCmdBlocks();
+      return FALSE;
+   }
+
+   // Blocks keep their priority when reused, so it only has to be set once
+   for (i = 0; i < count; ++i) {
+      FSInitCmdBlock(&sCmdBlocks[i]);
+      FSSetCmdPriority(&sCmdBlocks[i], priority);
+      sCmdBlocksInUse[i] = 0;
+   }
+
+   sNumCmdBlocks = count;
+   OSInitSemaphoreEx(&sCmdBlockSemaphore, (int32_t)count, "WHBSdCard cmd blocks");
+   return TRUE;
+}
+
+void
+WHBGetDefaultSdCardConfig(WHBSdCardConfig *config)
+{
+   config->numCmdBlocks = WHB_SDCARD_DEFAULT_CMD_BLOCKS;
+   config->priority = WHB_SDCARD_DEFAULT_PRIORITY;
+}
+
 BOOL
 WHBMountSdCard()
 {
-   FSCmdBlock cmd;
+   WHBSdCardConfig config;
+   WHBGetDefaultSdCardConfig(&config);
+   return WHBMountSdCardEx(&config);
+}
+
+BOOL
+WHBMountSdCardEx(const WHBSdCardConfig *config)
+{
+   FSCmdBlock *cmd;
    FSMountSource mountSource;
    FSStatus result;
 
@@ -30,23 +108,32 @@ WHBMountSdCard()
       return FALSE;
    }
 
-   FSInitCmdBlock(&cmd);
-   result = FSGetMountSource(&sClient, &cmd, FS_MOUNT_SOURCE_SD, &mountSource, FS_ERROR_FLAG_ALL);
+   if (!SdCardAllocCmdBlocks(config->numCmdBlocks ? config->numCmdBlocks : 1,
+                             config->priority)) {
+      FSDelClient(&sClient, FS_ERROR_FLAG_ALL);
+      return FALSE;
+   }
+
+   cmd = WHBSdCardAcquireCmdBlock();
+   result = FSGetMountSource(&sClient, cmd, FS_MOUNT_SOURCE_SD, &mountSource, FS_ERROR_FLAG_ALL);
    if (result < 0) {
       WHBLogPrintf("%s: FSGetMountSource error %d", __FUNCTION__, result);
       goto fail;
    }
 
-   result = FSMount(&sClient, &cmd, &mountSource, sMountPath, sizeof(sMountPath), FS_ERROR_FLAG_ALL);
+   result = FSMount(&sClient, cmd, &mountSource, sMountPath, sizeof(sMountPath), FS_ERROR_FLAG_ALL);
    if (result < 0) {
       WHBLogPrintf("%s: FSMount error %d", __FUNCTION__, result);
       goto fail;
    }
 
+   WHBSdCardReleaseCmdBlock(cmd);
    sMounted = TRUE;
    return TRUE;
 
 fail:
+   WHBSdCardReleaseCmdBlock(cmd);
+   SdCardFreeCmdBlocks();
    FSDelClient(&sClient, FS_ERROR_FLAG_ALL);
    return FALSE;
 }
@@ -57,30 +144,72 @@ WHBGetSdCardMountPath()
    return sMountPath;
 }
 
+FSClient *
+WHBSdCardGetClient()
+{
+   return sMounted ? &sClient : NULL;
+}
+
+FSCmdBlock *
+WHBSdCardAcquireCmdBlock()
+{
+   uint32_t i;
+
+   if (!sNumCmdBlocks) {
+      return NULL;
+   }
+
+   // The semaphore guarantees that one of the blocks is free
+   OSWaitSemaphore(&sCmdBlockSemaphore);
+   while (TRUE) {
+      for (i = 0; i < sNumCmdBlocks; ++i) {
+         if (!sCmdBlocksInUse[i] &&
+             OSCompareAndSwapAtomic(&sCmdBlocksInUse[i], 0, 1)) {
+            return &sCmdBlocks[i];
+         }
+      }
+   }
+}
+
+void
+WHBSdCardReleaseCmdBlock(FSCmdBlock *cmd)
+{
+   uint32_t index;
+
+   if (!cmd || cmd < sCmdBlocks || cmd >= sCmdBlocks + sNumCmdBlocks) {
+      return;
+   }
+
+   index = (uint32_t)(cmd - sCmdBlocks);
+   sCmdBlocksInUse[index] = 0;
+   OSSignalSemaphore(&sCmdBlockSemaphore);
+}
+
 BOOL
 WHBUnmountSdCard()
 {
-   FSCmdBlock cmd;
+   FSCmdBlock *cmd;
    FSStatus result;
 
    if (!sMounted) {
       return TRUE;
    }
 
-   FSInitCmdBlock(&cmd);
-
-   result = FSUnmount(&sClient, &cmd, sMountPath, FS_ERROR_FLAG_ALL);
+   cmd = WHBSdCardAcquireCmdBlock();
+   result = FSUnmount(&sClient, cmd, sMountPath, FS_ERROR_FLAG_ALL);
+   WHBSdCardReleaseCmdBlock(cmd);
    if (result < 0) {
       WHBLogPrintf("%s: FSUnmount error %d", __FUNCTION__, result);
       return FALSE;
    }
-   
+
    result = FSDelClient(&sClient, FS_ERROR_FLAG_ALL);
    if (result < 0) {
       WHBLogPrintf("%s: FSDelClient error %d", __FUNCTION__, result);
       return FALSE;
    }
 
+   SdCardFreeCmdBlocks();
    sMounted = FALSE;
    return TRUE;
 }
@@ -0,0 +1,320 @@
+#include <coreinit/atomic.h>
+#include <coreinit/memblockheap.h>
+#include <coreinit/memdefaultheap.h>
+#include <string.h>
+#include <whb/stream_memory.h>
+
+#define STREAM_DEFAULT_MAX_BLOCKS   256
+#define STREAM_ALIGN                0x40
+
+struct WHBStreamMemory
+{
+   MEMBlockHeap heap;
+   MEMHeapHandle handle;
+   uint8_t *base;
+   uint32_t size;
+   void *ownedMemory;
+   MEMBlockHeapTracking *tracking;
+};
+
+struct WHBStreamSlots
+{
+   WHBStreamMemory *mem;
+   uint8_t *base;
+   uint32_t slotSize;
+   uint32_t count;
+   volatile uint32_t freeCount;
+
+   //! One bit per slot, set while it is in use, MSB first.
+   volatile uint32_t used[];
+};
+
+WHBStreamMemory *
+WHBStreamMemoryCreateFromMemory(void *memory,
+                                uint32_t size,
+                                uint32_t maxBlocks)
+{
+   WHBStreamMemory *mem;
+   uint32_t trackingSize;
+   uint8_t *start, *end;
+
+   if (!memory) {
+      return NULL;
+   }
+
+   // Cache line align the region so slots and DMA buffers can be too
+   start = (uint8_t *)(((uintptr_t)memory + STREAM_ALIGN - 1) & ~(STREAM_ALIGN - 1));
+   end = (uint8_t *)(((uintptr_t)memory + size) & ~(STREAM_ALIGN - 1));
+   if (end <= start) {
+      return NULL;
+   }
+
+   // The bookkeeping lives outside the region, all of it is usable
+   mem = MEMAllocFromDefaultHeapEx(sizeof(WHBStreamMemory), 4);
+   if (!mem) {
+      return NULL;
+   }
+
+   memset(mem, 0, sizeof(WHBStreamMemory));
+   trackingSize = sizeof(MEMBlockHeapTracking) +
+      (maxBlocks ? maxBlocks : STREAM_DEFAULT_MAX_BLOCKS) * sizeof(MEMBlockHeapBlock);
+   mem->tracking = MEMAllocFromDefaultHeapEx(trackingSize, 4);
+   if (!mem->tracking) {
+      MEMFreeToDefaultHeap(mem);
+      return NULL;
+   }
+
+   mem->handle = MEMInitBlockHeap(&mem->heap, start, end, mem->tracking, trackingSize,
+                                  MEM_HEAP_FLAG_USE_LOCK);
+   if (!mem->handle) {
+      MEMFreeToDefaultHeap(mem->tracking);
+      MEMFreeToDefaultHeap(mem);
+      return NULL;
+   }
+
+   mem->base = start;
+   mem->size = (uint32_t)(end - start);
+   return mem;
+}
+
+WHBStreamMemory *
+WHBStreamMemoryCreate(uint32_t size,
+                      uint32_t maxBlocks)
+{
+   WHBStreamMemory *mem;
+   void *memory = MEMAllocFromDefaultHeapEx(size, STREAM_ALIGN);
+   if (!memory) {
+      return NULL;
+   }
+
+   mem = WHBStreamMemoryCreateFromMemory(memory, size, maxBlocks);
+   if (!mem) {
+      MEMFreeToDefaultHeap(memory);
+      return NULL;
+   }
+
+   mem->ownedMemory = memory;
+   return mem;
+}
+
+void
+WHBStreamMemoryDestroy(WHBStreamMemory *mem)
+{
+   if (!mem) {
+      return;
+   }
+
+   MEMDestroyBlockHeap(mem->handle);
+   MEMFreeToDefaultHeap(mem->tracking);
+
+   if (mem->ownedMemory) {
+      MEMFreeToDefaultHeap(mem->ownedMemory);
+   }
+
+   MEMFreeToDefaultHeap(mem);
+}
+
+void *
+WHBStreamMemoryAlloc(WHBStreamMemory *mem,
+                     uint32_t size,
+                     uint32_t align)
+{
+   if (!size) {
+      return NULL;
+   }
+
+   return MEMAllocFromBlockHeapEx(mem->handle, size, align < 4 ? 4 : (int32_t)align);
+}
+
+void *
+WHBStreamMemoryAllocAt(WHBStreamMemory *mem,
+                       uint32_t offset,
+                       uint32_t size)
+{
+   if (!size || offset >= mem->size || size > mem->size - offset) {
+      return NULL;
+   }
+
+   return MEMAllocFromBlockHeapAt(mem->handle, mem->base + offset, size);
+}
+
+void
+WHBStreamMemoryFree(WHBStreamMemory *mem,
+                    void *ptr)
+{
+   if (ptr) {
+      MEMFreeToBlockHeap(mem->handle, ptr);
+   }
+}
+
+void *
+WHBStreamMemoryGetBase(WHBStreamMemory *mem)
+{
+   return mem->base;
+}
+
+uint32_t
+WHBStreamMemoryGetLargestFree(WHBStreamMemory *mem)
+{
+   return MEMGetAllocatableSizeForBlockHeapEx(mem->handle, 4);
+}
+
+uint32_t
+WHBStreamMemoryGetFreeSize(WHBStreamMemory *mem)
+{
+   return MEMGetTotalFreeSizeForBlockHeap(mem->handle);
+}
+
+WHBStreamSlots *
+WHBStreamSlotsCreate(WHBStreamMemory *mem,
+                     uint32_t offset,
+                     uint32_t slotSize,
+                     uint32_t count)
+{
+   WHBStreamSlots *slots;
+   uint32_t words, size, i;
+   uint8_t *base;
+
+   slotSize = (slotSize + STREAM_ALIGN - 1) & ~(STREAM_ALIGN - 1);
+   if (!slotSize || !count || (uint64_t)slotSize * count > mem->size) {
+      return NULL;
+   }
+
+   size = slotSize * count;
+   if (offset == WHB_STREAM_MEMORY_ANY_OFFSET) {
+      base = MEMAllocFromBlockHeapEx(mem->handle, size, STREAM_ALIGN);
+   } else if (offset & (STREAM_ALIGN - 1)) {
+      return NULL;
+   } else {
+      base = WHBStreamMemoryAllocAt(mem, offset, size);
+   }
+
+   if (!base) {
+      return NULL;
+   }
+
+   words = (count + 31) / 32;
+   slots = MEMAllocFromDefaultHeapEx(sizeof(WHBStreamSlots) + words * sizeof(uint32_t), 4);
+   if (!slots) {
+      MEMFreeToBlockHeap(mem->handle, base);
+      return NULL;
+   }
+
+   slots->mem = mem;
+   slots->base = base;
+   slots->slotSize = slotSize;
+   slots->count = count;
+   slots->freeCount = count;
+
+   for (i = 0; i < words; ++i) {
+      slots->used[i] = 0;
+   }
+
+   // Bits past the last slot are never free
+   if (count % 32) {
+      slots->used[words - 1] = 0xFFFFFFFFu >> (count % 32);
+   }
+
+   return slots;
+}
+
+void
+WHBStreamSlotsDestroy(WHBStreamSlots *slots)
+{
+   if (!slots) {
+      return;
+   }
+
+   MEMFreeToBlockHeap(slots->mem->handle, slots->base);
+   MEMFreeToDefaultHeap(slots);
+}
+
+void *
+WHBStreamSlotsAlloc(WHBStreamSlots *slots)
+{
+   uint32_t words = (slots->count + 31) / 32;
+   uint32_t i, value, bit;
+
+   for (i = 0; i < words; ++i) {
+      value = slots->used[i];
+      while (value != 0xFFFFFFFFu) {
+         bit = __builtin_clz(~value);
+         if (OSCompareAndSwapAtomic(&slots->used[i], value, value | (0x80000000u >> bit))) {
+            OSAddAtomic((volatile int32_t *)&slots->freeCount, -1);
+            return slots->base + (i * 32 + bit) * slots->slotSize;
+         }
+
+         value = slots->used[i];
+      }
+   }
+
+   return NULL;
+}
+
+void *
+WHBStreamSlotsAllocIndex(WHBStreamSlots *slots,
+                         uint32_t index)
+{
+   uint32_t mask;
+
+   if (index >= slots->count) {
+      return NULL;
+   }
+
+   mask = 0x80000000u >> (index % 32);
+   if (OSOrAtomic(&slots->used[index / 32], mask) & mask) {
+      return NULL;
+   }
+
+   OSAddAtomic((volatile int32_t *)&slots->freeCount, -1);
+   return slots->base + index * slots->slotSize;
+}
+
+void
+WHBStreamSlotsFree(WHBStreamSlots *slots,
+                   void *slot)
+{
+   int32_t index = WHBStreamSlotsGetIndex(slots, slot);
+   uint32_t mask;
+
+   if (index < 0) {
+      return;
+   }
+
+   mask = 0x80000000u >> (index % 32);
+   if (OSAndAtomic(&slots->used[index / 32], ~mask) & mask) {
+      OSAddAtomic((volatile int32_t *)&slots->freeCount, 1);
+   }
+}
+
+void *
+WHBStreamSlotsGetSlot(WHBStreamSlots *slots,
+                      uint32_t index)
+{
+   if (index >= slots->count) {
+      return NULL;
+   }
+
+   return slots->base + index * slots->slotSize;
+}
+
+int32_t
+WHBStreamSlotsGetIndex(WHBStreamSlots *slots,
+                       const void *slot)
+{
+   uint32_t offset = (uint32_t)((const uint8_t *)slot - slots->base);
+
+   if ((const uint8_t *)slot < slots->base ||
+       offset >= slots->count * slots->slotSize ||
+       offset % slots->slotSize) {
+      return -1;
+   }
+
+   return (int32_t)(offset / slots->slotSize);
+}
+
+uint32_t
+WHBStreamSlotsGetFreeCount(WHBStreamSlots *slots)
+{
+   return slots->freeCount;
+}
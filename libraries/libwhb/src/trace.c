@@ -0,0 +1,302 @@
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/core.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <stdio.h>
+#include <string.h>
+#include <whb/log.h>
+#include <whb/trace.h>
+#include <wut_trace.h>
+
+#define TRACE_NUM_CORES 3
+
+typedef struct TraceEvent
+{
+   //! Ticket + 1 once the event is complete, 0 while it is written
+   volatile uint32_t seq;
+   const char *name;
+   OSThread *thread;
+   OSTime start;
+   OSTime end;
+   //! From WUTTraceSpan, -1 and 0 for events without one
+   int fd;
+   int64_t bytes;
+} TraceEvent;
+
+typedef struct WUT_ALIGNAS(0x40) TraceRing
+{
+   volatile uint32_t head;
+   TraceEvent *events;
+} TraceRing;
+
+static TraceRing
+sRings[TRACE_NUM_CORES];
+
+static TraceEvent *
+sEvents = NULL;
+
+static uint32_t
+sEventsPerCore = 0;
+
+static volatile BOOL
+sEnabled = FALSE;
+
+static volatile BOOL
+sRuntimeEnabled = FALSE;
+
+BOOL
+WHBTraceInit(uint32_t eventsPerCore)
+{
+   uint32_t core;
+
+   if (sEvents) {
+      return TRUE;
+   }
+
+   if (!eventsPerCore) {
+      eventsPerCore = 4096;
+   }
+
+   sEvents = MEMAllocFromDefaultHeapEx(sizeof(TraceEvent) * eventsPerCore * TRACE_NUM_CORES, 0x40);
+   if (!sEvents) {
+      WHBLogPrintf("%s: failed to allocate %u events", __FUNCTION__, eventsPerCore);
+      return FALSE;
+   }
+
+   sEventsPerCore = eventsPerCore;
+   for (core = 0; core < TRACE_NUM_CORES; ++core) {
+      sRings[core].events = sEvents + core * eventsPerCore;
+   }
+
+   WHBTraceReset();
+   sEnabled = TRUE;
+   return TRUE;
+}
+
+void
+WHBTraceShutdown()
+{
+   sEnabled = FALSE;
+   OSMemoryBarrier();
+
+   if (sEvents) {
+      MEMFreeToDefaultHeap(sEvents);
+      sEvents = NULL;
+   }
+}
+
+void
+WHBTraceSetEnabled(BOOL enabled)
+{
+   sEnabled = enabled && sEvents;
+}
+
+void
+WHBTraceReset()
+{
+   uint32_t core;
+
+   if (!sEvents) {
+      return;
+   }
+
+   memset(sEvents, 0, sizeof(TraceEvent) * sEventsPerCore * TRACE_NUM_CORES);
+   for (core = 0; core < TRACE_NUM_CORES; ++core) {
+      sRings[core].head = 0;
+   }
+}
+
+static void
+TraceAddEvent(const char *name,
+              OSTime start,
+              OSTime end,
+              int fd,
+              int64_t bytes)
+{
+   TraceRing *ring;
+   TraceEvent *event;
+   uint32_t ticket;
+
+   // Threads on the same core can still preempt each other, so take a
+   // ticket rather than assuming a single writer
+   ring = &sRings[OSGetCoreId()];
+   ticket = (uint32_t)OSAddAtomic((volatile int32_t *)&ring->head, 1);
+   event = &ring->events[ticket % sEventsPerCore];
+
+   event->seq = 0;
+   OSMemoryBarrier();
+   event->name = name;
+   event->thread = OSGetCurrentThread();
+   event->start = start;
+   event->end = end;
+   event->fd = fd;
+   event->bytes = bytes;
+   OSMemoryBarrier();
+   event->seq = ticket + 1;
+}
+
+void
+WHBTraceAddEvent(const char *name,
+                 OSTime start,
+                 OSTime end)
+{
+   if (!sEnabled) {
+      return;
+   }
+
+   TraceAddEvent(name, start, end, -1, 0);
+}
+
+void
+WHBTraceSetRuntimeEnabled(BOOL enabled)
+{
+   sRuntimeEnabled = enabled;
+}
+
+/*
+ * Strong definition of the weak hook in wut_trace.h, this is only linked in
+ * when the application uses the trace API.
+ */
+void
+__wut_trace_span(const WUTTraceSpan *span)
+{
+   if (!sEnabled || !sRuntimeEnabled) {
+      return;
+   }
+
+   TraceAddEvent(span->name, span->start, span->end, span->fd, span->bytes);
+}
+
+//! Copy an event out of the ring, FALSE if it is empty or being written.
+static BOOL
+TraceReadEvent(const TraceEvent *event,
+               TraceEvent *out)
+{
+   uint32_t seq = event->seq;
+
+   if (!seq) {
+      return FALSE;
+   }
+
+   OSMemoryBarrier();
+   out->name = event->name;
+   out->thread = event->thread;
+   out->start = event->start;
+   out->end = event->end;
+   out->fd = event->fd;
+   out->bytes = event->bytes;
+   OSMemoryBarrier();
+   return event->seq == seq;
+}
+
+static int
+TraceFormatEvent(char *buffer,
+                 uint32_t size,
+                 uint32_t core,
+                 const TraceEvent *event)
+{
+   uint64_t start = OSTicksToMicroseconds(event->start);
+   uint64_t duration = OSTicksToMicroseconds(event->end - event->start);
+
+   if (event->fd < 0 && !event->bytes) {
+      return snprintf(buffer, size,
+                      ",{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%u,\"tid\":%u}",
+                      event->name, start, duration, core,
+                      (uint32_t)(uintptr_t)event->thread);
+   }
+
+   return snprintf(buffer, size,
+                   ",{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%u,\"tid\":%u,"
+                   "\"args\":{\"fd\":%d,\"bytes\":%lld}}",
+                   event->name, start, duration, core,
+                   (uint32_t)(uintptr_t)event->thread,
+                   event->fd, event->bytes);
+}
+
+typedef void (*TraceOutputFn)(void *context, const char *line);
+
+static void
+TraceExport(TraceOutputFn output,
+            void *context)
+{
+   char line[256];
+   BOOL first = TRUE;
+   uint32_t core, i;
+
+   output(context, "{\"traceEvents\":[");
+
+   // Name the thread rows, Chrome trace shows pid as the core here
+   for (core = 0; core < TRACE_NUM_CORES; ++core) {
+      snprintf(line, sizeof(line),
+               "%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"args\":{\"name\":\"Core %u\"}}",
+               first ? "" : ",", core, core);
+      output(context, line);
+      first = FALSE;
+   }
+
+   for (core = 0; core < TRACE_NUM_CORES; ++core) {
+      TraceRing *ring = &sRings[core];
+      uint32_t head = ring->head;
+      uint32_t count = (head < sEventsPerCore) ? head : sEventsPerCore;
+
+      // Oldest first, so the JSON is roughly in time order per core
+      for (i = head - count; i != head; ++i) {
+         TraceEvent event;
+
+         if (!TraceReadEvent(&ring->events[i % sEventsPerCore], &event)) {
+            continue;
+         }
+
+         TraceFormatEvent(line, sizeof(line), core, &event);
+         output(context, line);
+      }
+   }
+
+   output(context, "]}");
+}
+
+static void
+TraceOutputFile(void *context,
+                const char *line)
+{
+   fprintf((FILE *)context, "%s\n", line);
+}
+
+static void
+TraceOutputLog(void *context,
+               const char *line)
+{
+   WHBLogPrint(line);
+}
+
+BOOL
+WHBTraceWriteChrome(const char *path)
+{
+   FILE *file;
+
+   if (!sEvents) {
+      return FALSE;
+   }
+
+   file = fopen(path, "w");
+   if (!file) {
+      WHBLogPrintf("%s: could not open %s", __FUNCTION__, path);
+      return FALSE;
+   }
+
+   TraceExport(TraceOutputFile, file);
+   fclose(file);
+   return TRUE;
+}
+
+void
+WHBTraceLogChrome()
+{
+   if (!sEvents) {
+      return;
+   }
+
+   TraceExport(TraceOutputLog, NULL);
+}
@@ -0,0 +1,578 @@
+#include "gfx_heap.h"
+#include "../../wutthreadstats/wut_thread_stats.h"
+#include <coreinit/cache.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <fcntl.h>
+#include <gx2/mem.h>
+#include <h264/decode.h>
+#include <string.h>
+#include <unistd.h>
+#include <whb/log.h>
+#include <whb/video.h>
+#include <wut_thread_stats.h>
+
+#define VIDEO_STACK_SIZE   (16 * 1024)
+#define VIDEO_PRIORITY     16
+#define VIDEO_READ_SIZE    (2 * 1024 * 1024)
+#define VIDEO_NUM_PACKETS  8
+#define VIDEO_NUM_FRAMES   8
+
+#define VIDEO_H264_PROFILE 100
+#define VIDEO_H264_LEVEL   42
+
+#define VIDEO_NAL_SLICE     1
+#define VIDEO_NAL_SLICE_IDR 5
+#define VIDEO_NAL_SEI       6
+#define VIDEO_NAL_AUD       9
+
+typedef struct VideoPacket
+{
+   uint8_t *data;
+   uint32_t size;
+   uint32_t capacity;
+   double timestamp;
+} VideoPacket;
+
+typedef struct VideoFrame
+{
+   WHBVideoFrame frame;
+   uint8_t *buffer;
+} VideoFrame;
+
+typedef struct VideoThread
+{
+   OSThread thread;
+   uint8_t stack[VIDEO_STACK_SIZE] __attribute__((aligned(16)));
+} VideoThread;
+
+struct WHBVideoPlayer
+{
+   VideoThread parser;
+   VideoThread decoder;
+   volatile BOOL stop;
+   volatile BOOL decodeDone;
+
+   int fd;
+   double frameDuration;
+
+   //! Read window of the parser
+   uint8_t *stream;
+   uint32_t streamSize;
+
+   void *decoderMemory;
+   uint32_t frameBufferSize;
+
+   VideoPacket packets[VIDEO_NUM_PACKETS];
+   OSMessageQueue freePackets;
+   OSMessage freePacketMessages[VIDEO_NUM_PACKETS + 1];
+   OSMessageQueue filledPackets;
+   OSMessage filledPacketMessages[VIDEO_NUM_PACKETS + 1];
+
+   VideoFrame frames[VIDEO_NUM_FRAMES];
+   OSMessageQueue freeFrames;
+   OSMessage freeFrameMessages[VIDEO_NUM_FRAMES + 1];
+   OSMessageQueue readyFrames;
+   OSMessage readyFrameMessages[VIDEO_NUM_FRAMES];
+
+   //! Only touched by the thread calling WHBVideoPlayerGetFrame
+   VideoFrame *current;
+   VideoFrame *previous;
+   OSTime startTime;
+};
+
+static void
+VideoPostMessage(OSMessageQueue *queue,
+                 void *data)
+{
+   OSMessage message = { 0 };
+   message.message = data;
+   OSSendMessage(queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+}
+
+static void *
+VideoWaitMessage(OSMessageQueue *queue)
+{
+   OSMessage message;
+   OSReceiveMessage(queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+   return message.message;
+}
+
+static void
+VideoReleaseFrame(WHBVideoPlayer *player,
+                  VideoFrame *frame)
+{
+   if (frame) {
+      VideoPostMessage(&player->freeFrames, frame);
+   }
+}
+
+//! Find the next 00 00 01 start code at or after offset, leaving room to
+//! read the NAL header and the byte after it
+static int32_t
+VideoFindStartCode(const uint8_t *data,
+                   uint32_t offset,
+                   uint32_t size)
+{
+   for (uint32_t i = offset; i + 4 < size; ++i) {
+      if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+         return (int32_t)i;
+      }
+   }
+
+   return -1;
+}
+
+//! Whether the NAL starting at a start code begins a new access unit, once
+//! the current one already holds a picture
+static BOOL
+VideoStartsAccessUnit(const uint8_t *nal)
+{
+   uint32_t type = nal[3] & 0x1F;
+
+   if (type == VIDEO_NAL_SLICE || type == VIDEO_NAL_SLICE_IDR) {
+      // first_mb_in_slice is ue(v), a leading 1 bit means zero
+      return (nal[4] & 0x80) != 0;
+   }
+
+   return type >= VIDEO_NAL_SEI && type <= VIDEO_NAL_AUD;
+}
+
+static BOOL
+VideoEmitPacket(WHBVideoPlayer *player,
+                const uint8_t *data,
+                uint32_t size,
+                double timestamp)
+{
+   VideoPacket *packet = (VideoPacket *)VideoWaitMessage(&player->freePackets);
+   if (!packet || player->stop) {
+      return FALSE;
+   }
+
+   if (packet->capacity < size) {
+      MEMFreeToDefaultHeap(packet->data);
+      packet->capacity = (size + 0xFFFF) & ~0xFFFF;
+      packet->data = (uint8_t *)MEMAllocFromDefaultHeapEx(packet->capacity, 0x40);
+      if (!packet->data) {
+         WHBLogPrintf("%s: out of memory for a 0x%X byte access unit", __FUNCTION__, size);
+         packet->capacity = 0;
+         VideoPostMessage(&player->freePackets, packet);
+         return FALSE;
+      }
+   }
+
+   memcpy(packet->data, data, size);
+   packet->size = size;
+   packet->timestamp = timestamp;
+   VideoPostMessage(&player->filledPackets, packet);
+   return TRUE;
+}
+
+static int
+VideoParserThreadEntry(int argc,
+                       const char **argv)
+{
+   WHBVideoPlayer *player = (WHBVideoPlayer *)argv;
+   uint8_t *stream = player->stream;
+   uint32_t size = 0;
+   uint32_t unitStart = 0;
+   uint32_t scan = 0;
+   uint32_t frameIndex = 0;
+   BOOL unitHasPicture = FALSE;
+   BOOL eof = FALSE;
+   BOOL synced = FALSE;
+
+   while (!player->stop) {
+      int32_t code = VideoFindStartCode(stream, scan, size);
+
+      if (code < 0) {
+         if (eof) {
+            if (size > unitStart) {
+               VideoEmitPacket(player, stream + unitStart, size - unitStart,
+                               frameIndex * player->frameDuration);
+            }
+            break;
+         }
+
+         // Slide the unfinished access unit to the front and read more
+         memmove(stream, stream + unitStart, size - unitStart);
+         size -= unitStart;
+         scan -= unitStart;
+         unitStart = 0;
+         if (size == player->streamSize) {
+            WHBLogPrintf("%s: access unit larger than 0x%X bytes", __FUNCTION__, size);
+            break;
+         }
+
+         ssize_t rc = read(player->fd, stream + size, player->streamSize - size);
+         if (rc < 0) {
+            WHBLogPrintf("%s: read failed", __FUNCTION__);
+            break;
+         }
+
+         eof = rc == 0;
+         size += rc;
+
+         if (!synced) {
+            int32_t offset;
+
+            // Decoding has to begin at a sequence parameter set
+            if (H264DECFindDecstartpoint(stream, size, &offset) != H264_ERROR_OK) {
+               unitStart = scan = size > 4 ? size - 4 : 0;
+               continue;
+            }
+
+            unitStart = scan = offset;
+            synced = TRUE;
+         }
+         continue;
+      }
+
+      if (unitHasPicture && VideoStartsAccessUnit(stream + code)) {
+         if (!VideoEmitPacket(player, stream + unitStart, code - unitStart,
+                              frameIndex * player->frameDuration)) {
+            break;
+         }
+
+         ++frameIndex;
+         unitStart = code;
+         unitHasPicture = FALSE;
+      }
+
+      uint32_t type = stream[code + 3] & 0x1F;
+      if (type == VIDEO_NAL_SLICE || type == VIDEO_NAL_SLICE_IDR) {
+         unitHasPicture = TRUE;
+      }
+
+      scan = code + 3;
+   }
+
+   // End of stream
+   VideoPostMessage(&player->filledPackets, NULL);
+   return 0;
+}
+
+//! Called by the decoder, on the decoder thread, for every finished picture
+static void
+VideoDecoderOutput(H264DecodeOutput *output)
+{
+   WHBVideoPlayer *player = (WHBVideoPlayer *)output->userMemory;
+
+   for (int32_t i = 0; i < output->frameCount; ++i) {
+      H264DecodeResult *result = output->decodeResults[i];
+      VideoFrame *frame = NULL;
+
+      for (uint32_t j = 0; j < VIDEO_NUM_FRAMES; ++j) {
+         if (player->frames[j].buffer == result->framebuffer) {
+            frame = &player->frames[j];
+            break;
+         }
+      }
+
+      if (!frame) {
+         continue;
+      }
+
+      // NV12: chroma rows follow the luma rows, padded to whole macroblocks
+      uint32_t alignedHeight = (result->height + 15) & ~15;
+      uint8_t *chroma = frame->buffer + result->nextLine * alignedHeight;
+
+      GfxInitLinearTexture(&frame->frame.luma, GX2_SURFACE_FORMAT_UNORM_R8,
+                       result->width, result->height, result->nextLine,
+                       frame->buffer, GFX_COMP_MAP_R001);
+      GfxInitLinearTexture(&frame->frame.chroma, GX2_SURFACE_FORMAT_UNORM_R8_G8,
+                       result->width / 2, result->height / 2, result->nextLine / 2,
+                       chroma, GFX_COMP_MAP_RG01);
+
+      frame->frame.width = result->width;
+      frame->frame.height = result->height;
+      if (result->cropEnableFlag) {
+         frame->frame.width -= result->cropLeft + result->cropRight;
+         frame->frame.height -= result->cropTop + result->cropBottom;
+      }
+
+      frame->frame.timestamp = result->timestamp;
+
+      // The GPU reads the picture from memory
+      DCFlushRange(frame->buffer, player->frameBufferSize);
+      VideoPostMessage(&player->readyFrames, frame);
+   }
+}
+
+static int
+VideoDecoderThreadEntry(int argc,
+                        const char **argv)
+{
+   WHBVideoPlayer *player = (WHBVideoPlayer *)argv;
+
+   while (!player->stop) {
+      VideoPacket *packet = (VideoPacket *)VideoWaitMessage(&player->filledPackets);
+      VideoFrame *frame;
+      H264Error error;
+
+      if (!packet) {
+         H264DECFlush(player->decoderMemory);
+         break;
+      }
+
+      frame = (VideoFrame *)VideoWaitMessage(&player->freeFrames);
+      if (!frame) {
+         break;
+      }
+
+      // Pictures come out of VideoDecoderOutput in display order, possibly
+      // several packets later
+      error = H264DECSetBitstream(player->decoderMemory, packet->data,
+                                  packet->size, packet->timestamp);
+      if (error == H264_ERROR_OK) {
+         error = H264DECExecute(player->decoderMemory, frame->buffer);
+      }
+
+      VideoPostMessage(&player->freePackets, packet);
+
+      if (error != H264_ERROR_OK) {
+         WHBLogPrintf("%s: decoding failed with error 0x%X", __FUNCTION__, error);
+         VideoReleaseFrame(player, frame);
+      }
+   }
+
+   player->decodeDone = TRUE;
+   return 0;
+}
+
+static BOOL
+VideoStartThread(WHBVideoPlayer *player,
+                 VideoThread *thread,
+                 OSThreadEntryPointFn entry,
+                 const char *name)
+{
+   if (!OSCreateThread(&thread->thread, entry, 0, (char *)player,
+                       thread->stack + sizeof(thread->stack), sizeof(thread->stack),
+                       VIDEO_PRIORITY, OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      WHBLogPrintf("%s: OSCreateThread failed for %s", __FUNCTION__, name);
+      return FALSE;
+   }
+
+   OSSetThreadName(&thread->thread, name);
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(&thread->thread);
+   }
+   OSResumeThread(&thread->thread);
+   return TRUE;
+}
+
+static void
+VideoFree(WHBVideoPlayer *player)
+{
+   for (uint32_t i = 0; i < VIDEO_NUM_PACKETS; ++i) {
+      if (player->packets[i].data) {
+         MEMFreeToDefaultHeap(player->packets[i].data);
+      }
+   }
+
+   for (uint32_t i = 0; i < VIDEO_NUM_FRAMES; ++i) {
+      if (player->frames[i].buffer) {
+         MEMFreeToDefaultHeap(player->frames[i].buffer);
+      }
+   }
+
+   if (player->decoderMemory) {
+      H264DECClose(player->decoderMemory);
+      MEMFreeToDefaultHeap(player->decoderMemory);
+   }
+
+   if (player->stream) {
+      MEMFreeToDefaultHeap(player->stream);
+   }
+
+   if (player->fd >= 0) {
+      close(player->fd);
+   }
+
+   MEMFreeToDefaultHeap(player);
+}
+
+WHBVideoPlayer *
+WHBVideoPlayerOpen(const char *path,
+                   uint32_t maxWidth,
+                   uint32_t maxHeight,
+                   float frameRate)
+{
+   WHBVideoPlayer *player;
+   uint32_t memorySize;
+   uint32_t pitch = (maxWidth + 0xFF) & ~0xFF;
+   uint32_t height = (maxHeight + 15) & ~15;
+
+   player = (WHBVideoPlayer *)MEMAllocFromDefaultHeapEx(sizeof(WHBVideoPlayer), 16);
+   if (!player) {
+      WHBLogPrintf("%s: out of memory", __FUNCTION__);
+      return NULL;
+   }
+
+   memset(player, 0, sizeof(WHBVideoPlayer));
+   player->frameDuration = frameRate > 0.0f ? 1.0 / frameRate : 1.0 / 30.0;
+   player->fd = open(path, O_RDONLY);
+   if (player->fd < 0) {
+      WHBLogPrintf("%s: could not open %s", __FUNCTION__, path);
+      goto error;
+   }
+
+   player->streamSize = VIDEO_READ_SIZE;
+   player->stream = (uint8_t *)MEMAllocFromDefaultHeapEx(player->streamSize, 0x40);
+   if (!player->stream) {
+      WHBLogPrintf("%s: out of memory", __FUNCTION__);
+      goto error;
+   }
+
+   if (H264DECMemoryRequirement(VIDEO_H264_PROFILE, VIDEO_H264_LEVEL,
+                                maxWidth, maxHeight, &memorySize) != H264_ERROR_OK) {
+      WHBLogPrintf("%s: unsupported size %ux%u", __FUNCTION__, maxWidth, maxHeight);
+      goto error;
+   }
+
+   player->decoderMemory = MEMAllocFromDefaultHeapEx(memorySize, 0x100);
+   if (!player->decoderMemory) {
+      WHBLogPrintf("%s: out of memory for the decoder", __FUNCTION__);
+      goto error;
+   }
+
+   if (H264DECInitParam(memorySize, player->decoderMemory) != H264_ERROR_OK ||
+       H264DECSetParam_FPTR_OUTPUT(player->decoderMemory, VideoDecoderOutput) != H264_ERROR_OK ||
+       H264DECSetParam_OUTPUT_PER_FRAME(player->decoderMemory, 1) != H264_ERROR_OK ||
+       H264DECSetParam_USER_MEMORY(player->decoderMemory, player) != H264_ERROR_OK ||
+       H264DECCheckMemSegmentation(player->decoderMemory, memorySize) != H264_ERROR_OK ||
+       H264DECOpen(player->decoderMemory) != H264_ERROR_OK) {
+      WHBLogPrintf("%s: could not open the decoder", __FUNCTION__);
+      MEMFreeToDefaultHeap(player->decoderMemory);
+      player->decoderMemory = NULL;
+      goto error;
+   }
+
+   if (H264DECBegin(player->decoderMemory) != H264_ERROR_OK) {
+      WHBLogPrintf("%s: H264DECBegin failed", __FUNCTION__);
+      goto error;
+   }
+
+   OSInitMessageQueue(&player->freePackets, player->freePacketMessages, VIDEO_NUM_PACKETS + 1);
+   OSInitMessageQueue(&player->filledPackets, player->filledPacketMessages, VIDEO_NUM_PACKETS + 1);
+   OSInitMessageQueue(&player->freeFrames, player->freeFrameMessages, VIDEO_NUM_FRAMES + 1);
+   OSInitMessageQueue(&player->readyFrames, player->readyFrameMessages, VIDEO_NUM_FRAMES);
+
+   for (uint32_t i = 0; i < VIDEO_NUM_PACKETS; ++i) {
+      VideoPostMessage(&player->freePackets, &player->packets[i]);
+   }
+
+   // NV12 needs one and a half bytes per pixel
+   player->frameBufferSize = pitch * height * 3 / 2;
+   for (uint32_t i = 0; i < VIDEO_NUM_FRAMES; ++i) {
+      player->frames[i].buffer = (uint8_t *)MEMAllocFromDefaultHeapEx(player->frameBufferSize, 0x100);
+      if (!player->frames[i].buffer) {
+         WHBLogPrintf("%s: out of memory for picture buffers", __FUNCTION__);
+         goto error;
+      }
+
+      VideoPostMessage(&player->freeFrames, &player->frames[i]);
+   }
+
+   if (!VideoStartThread(player, &player->decoder, VideoDecoderThreadEntry, "WHBVideo decoder")) {
+      goto error;
+   }
+
+   if (!VideoStartThread(player, &player->parser, VideoParserThreadEntry, "WHBVideo parser")) {
+      player->stop = TRUE;
+      VideoPostMessage(&player->filledPackets, NULL);
+      OSJoinThread(&player->decoder.thread, NULL);
+      goto error;
+   }
+
+   return player;
+
+error:
+   VideoFree(player);
+   return NULL;
+}
+
+void
+WHBVideoPlayerClose(WHBVideoPlayer *player)
+{
+   if (!player) {
+      return;
+   }
+
+   // Wake both threads wherever they are blocked
+   player->stop = TRUE;
+   VideoPostMessage(&player->freePackets, NULL);
+   VideoPostMessage(&player->freeFrames, NULL);
+   OSJoinThread(&player->parser.thread, NULL);
+   OSJoinThread(&player->decoder.thread, NULL);
+
+   H264DECEnd(player->decoderMemory);
+   VideoFree(player);
+}
+
+const WHBVideoFrame *
+WHBVideoPlayerGetFrame(WHBVideoPlayer *player)
+{
+   OSMessage message;
+   double now;
+   BOOL changed = FALSE;
+
+   if (!player->startTime) {
+      player->startTime = OSGetSystemTime();
+   }
+
+   now = (double)OSTicksToMicroseconds(OSGetSystemTime() - player->startTime) / 1000000.0;
+
+   while (OSPeekMessage(&player->readyFrames, &message)) {
+      VideoFrame *frame = (VideoFrame *)message.message;
+      if (frame->frame.timestamp > now && player->current) {
+         break;
+      }
+
+      OSReceiveMessage(&player->readyFrames, &message, OS_MESSAGE_FLAGS_NONE);
+      if (changed) {
+         // Skipped without ever being displayed
+         VideoReleaseFrame(player, player->current);
+      } else {
+         VideoReleaseFrame(player, player->previous);
+         player->previous = player->current;
+      }
+
+      player->current = frame;
+      changed = TRUE;
+   }
+
+   if (!player->current) {
+      return NULL;
+   }
+
+   if (changed) {
+      // Drop whatever the texture cache holds from the buffer's last use
+      GX2Invalidate(GX2_INVALIDATE_MODE_TEXTURE, player->current->buffer,
+                    player->frameBufferSize);
+   }
+
+   return &player->current->frame;
+}
+
+BOOL
+WHBVideoPlayerIsFinished(WHBVideoPlayer *player)
+{
+   OSMessage message;
+   return player->decodeDone && !OSPeekMessage(&player->readyFrames, &message);
+}
+
+void
+WHBVideoGetYuvToRgbMatrix(float outMatrix[12])
+{
+   static const float
+   sMatrix[12] = {
+      1.164f,  0.000f,  1.596f, -1.164f * 16.0f / 255.0f - 1.596f * 0.5f,
+      1.164f, -0.392f, -0.813f, -1.164f * 16.0f / 255.0f + (0.392f + 0.813f) * 0.5f,
+      1.164f,  2.017f,  0.000f, -1.164f * 16.0f / 255.0f - 2.017f * 0.5f,
+   };
+
+   memcpy(outMatrix, sMatrix, sizeof(sMatrix));
+}
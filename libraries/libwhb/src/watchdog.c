@@ -0,0 +1,190 @@
+#include "crash_stack.h"
+#include <coreinit/alarm.h>
+#include <coreinit/cache.h>
+#include <coreinit/debug.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <string.h>
+#include <whb/log.h>
+#include <whb/watchdog.h>
+
+#define WATCHDOG_SYMBOL_SIZE (128)
+
+static BOOL
+sEnabled = FALSE;
+
+static OSAlarm
+sAlarm;
+
+static OSTime
+sBudget = 0;
+
+static OSThread *
+sRenderThread = NULL;
+
+static uint32_t
+sFrame = 0;
+
+static OSTime
+sFrameStart = 0;
+
+static WHBWatchdogHitch
+sHitches[WHB_WATCHDOG_MAX_HITCHES];
+
+static volatile uint32_t
+sHitchCount = 0;
+
+static void
+WatchdogAlarmCallback(OSAlarm *alarm,
+                      OSContext *context)
+{
+   WHBWatchdogHitch *hitch = &sHitches[sHitchCount % WHB_WATCHDOG_MAX_HITCHES];
+   OSThread *thread = sRenderThread;
+   uint32_t *frames[WHB_WATCHDOG_MAX_DEPTH];
+   uint32_t depth, i;
+
+   if (!thread) {
+      return;
+   }
+
+   // The alarm fires on the core the frame began on, the render thread is
+   // either the one interrupted or is waiting with its registers saved
+   hitch->running = (OSGetCurrentThread() == thread);
+   if (!hitch->running) {
+      context = &thread->context;
+   }
+
+   hitch->frame = sFrame;
+   hitch->frameStart = sFrameStart;
+   hitch->time = OSGetTime();
+   memcpy(&hitch->context, context, sizeof(OSContext));
+
+   hitch->frames[0] = context->srr0;
+   hitch->frames[1] = context->lr;
+   hitch->depth = 2;
+
+   // The LR save word of each caller's frame holds the return address
+   depth = CrashWalkStack(context, frames, WHB_WATCHDOG_MAX_DEPTH);
+   for (i = 1; i < depth && hitch->depth < WHB_WATCHDOG_MAX_DEPTH; ++i) {
+      if (frames[i][1] && frames[i][1] != hitch->frames[hitch->depth - 1]) {
+         hitch->frames[hitch->depth++] = frames[i][1];
+      }
+   }
+
+   OSMemoryBarrier();
+   sHitchCount++;
+}
+
+//! Called by WHBGfxBeginRender, only linked in when the watchdog is used
+void
+__whb_watchdog_begin_frame()
+{
+   if (!sEnabled) {
+      return;
+   }
+
+   OSCancelAlarm(&sAlarm);
+   sRenderThread = OSGetCurrentThread();
+   sFrameStart = OSGetTime();
+   sFrame++;
+   OSSetAlarm(&sAlarm, sBudget, WatchdogAlarmCallback);
+}
+
+BOOL
+WHBWatchdogInit(uint32_t budgetUs)
+{
+   if (sEnabled) {
+      WHBWatchdogSetBudget(budgetUs);
+      return TRUE;
+   }
+
+   OSCreateAlarm(&sAlarm);
+   WHBWatchdogSetBudget(budgetUs);
+   WHBWatchdogReset();
+   sRenderThread = NULL;
+   sFrame = 0;
+   sEnabled = TRUE;
+   return TRUE;
+}
+
+void
+WHBWatchdogShutdown()
+{
+   if (!sEnabled) {
+      return;
+   }
+
+   sEnabled = FALSE;
+   OSCancelAlarm(&sAlarm);
+   sRenderThread = NULL;
+}
+
+void
+WHBWatchdogSetBudget(uint32_t budgetUs)
+{
+   sBudget = OSMicrosecondsToTicks(budgetUs ? budgetUs : 25000);
+}
+
+uint32_t
+WHBWatchdogGetHitchCount()
+{
+   return sHitchCount;
+}
+
+BOOL
+WHBWatchdogGetHitch(uint32_t index,
+                    WHBWatchdogHitch *outHitch)
+{
+   uint32_t count = sHitchCount;
+
+   if (index >= count || index >= WHB_WATCHDOG_MAX_HITCHES) {
+      return FALSE;
+   }
+
+   OSMemoryBarrier();
+   memcpy(outHitch, &sHitches[(count - 1 - index) % WHB_WATCHDOG_MAX_HITCHES],
+          sizeof(WHBWatchdogHitch));
+   return TRUE;
+}
+
+void
+WHBWatchdogReset()
+{
+   sHitchCount = 0;
+}
+
+void
+WHBWatchdogLog()
+{
+   WHBWatchdogHitch hitch;
+   char name[WATCHDOG_SYMBOL_SIZE];
+   uint32_t count = sHitchCount;
+   uint32_t i, j;
+
+   if (count > WHB_WATCHDOG_MAX_HITCHES) {
+      count = WHB_WATCHDOG_MAX_HITCHES;
+   }
+
+   WHBLogPrintf("%s: %u hitches, last %u:", __FUNCTION__, sHitchCount, count);
+   for (i = count; i > 0; --i) {
+      if (!WHBWatchdogGetHitch(i - 1, &hitch)) {
+         continue;
+      }
+
+      WHBLogPrintf("frame %u over budget after %llu us, render thread %s",
+                   hitch.frame,
+                   OSTicksToMicroseconds(hitch.time - hitch.frameStart),
+                   hitch.running ? "running" : "waiting");
+
+      for (j = 0; j < hitch.depth; ++j) {
+         uint32_t addr = hitch.frames[j];
+         uint32_t symbol = OSGetSymbolName(addr, name, sizeof(name));
+
+         if (symbol) {
+            WHBLogPrintf("  0x%08x %s+0x%x", addr, name, addr - symbol);
+         } else {
+            WHBLogPrintf("  0x%08x", addr);
+         }
+      }
+   }
+}
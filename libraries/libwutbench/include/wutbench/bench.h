@@ -0,0 +1,109 @@
+#pragma once
+#include <wut.h>
+#include <coreinit/time.h>
+
+/**
+ * \defgroup wutbench_bench Benchmark harness
+ * \ingroup wutbench
+ *
+ * Times a function over many iterations on the console and reports the
+ * distribution of the timings rather than just an average:
+ *
+ * \code
+ * static void
+ * alloc_free(void *context)
+ * {
+ *    free(malloc(64));
+ * }
+ *
+ * WUTBenchInit("fs:/vol/external01/bench.csv");
+ * WUTBenchRun("malloc 64", alloc_free, NULL, NULL, NULL);
+ * WUTBenchShutdown();
+ * \endcode
+ *
+ * Every run first calls the function for a number of warm-up iterations
+ * that are not timed, then times each iteration with OSGetSystemTime.
+ * Results go to the WHBLog outputs and, when a path was given to
+ * WUTBenchInit, as CSV lines to that file.
+ *
+ * Build benchmarks with the wut_add_benchmark CMake function from
+ * share/wut_bench.cmake.
+ * @{
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*WUTBenchFn)(void *context);
+
+typedef struct WUTBenchOptions
+{
+   //! Untimed calls before timing starts, default 16.
+   uint32_t warmupIterations;
+
+   //! Timed samples, default 1000.
+   uint32_t iterations;
+
+   //! Calls per timed sample for functions too fast to time one by one,
+   //! default 1. Reported times are per call.
+   uint32_t callsPerIteration;
+
+   //! Bytes one call processes, reported as throughput when not 0.
+   uint64_t bytesPerCall;
+} WUTBenchOptions;
+
+typedef struct WUTBenchResult
+{
+   uint32_t iterations;
+
+   //! Nanoseconds per call.
+   uint64_t min;
+   uint64_t median;
+   uint64_t p99;
+   uint64_t max;
+   uint64_t mean;
+
+   //! Based on the median, 0 when bytesPerCall was 0.
+   uint32_t bytesPerSecond;
+} WUTBenchResult;
+
+/**
+ * Start reporting, additionally writing CSV to path if it is not NULL.
+ */
+BOOL
+WUTBenchInit(const char *path);
+
+void
+WUTBenchShutdown();
+
+/**
+ * Fill options with the defaults.
+ */
+void
+WUTBenchInitOptions(WUTBenchOptions *options);
+
+/**
+ * Warm up, time and report fn.
+ *
+ * \param options
+ * NULL for the defaults.
+ *
+ * \param outResult
+ * Optional, receives the statistics that were reported.
+ *
+ * \return
+ * FALSE if the timing samples could not be allocated.
+ */
+BOOL
+WUTBenchRun(const char *name,
+            WUTBenchFn fn,
+            void *context,
+            const WUTBenchOptions *options,
+            WUTBenchResult *outResult);
+
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */
@@ -0,0 +1,138 @@
+#include <coreinit/memdefaultheap.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <whb/log.h>
+#include <wutbench/bench.h>
+
+#define BENCH_DEFAULT_WARMUP     16
+#define BENCH_DEFAULT_ITERATIONS 1000
+
+static FILE *
+sOutput = NULL;
+
+static int
+BenchCompareTimes(const void *a,
+                  const void *b)
+{
+   OSTime timeA = *(const OSTime *)a;
+   OSTime timeB = *(const OSTime *)b;
+   return (timeA > timeB) - (timeA < timeB);
+}
+
+BOOL
+WUTBenchInit(const char *path)
+{
+   if (!path) {
+      return TRUE;
+   }
+
+   sOutput = fopen(path, "w");
+   if (!sOutput) {
+      WHBLogPrintf("%s: could not open %s", __FUNCTION__, path);
+      return FALSE;
+   }
+
+   fprintf(sOutput, "name,iterations,min_ns,median_ns,p99_ns,max_ns,mean_ns,bytes_per_second\n");
+   return TRUE;
+}
+
+void
+WUTBenchShutdown()
+{
+   if (sOutput) {
+      fclose(sOutput);
+      sOutput = NULL;
+   }
+}
+
+void
+WUTBenchInitOptions(WUTBenchOptions *options)
+{
+   memset(options, 0, sizeof(WUTBenchOptions));
+   options->warmupIterations = BENCH_DEFAULT_WARMUP;
+   options->iterations = BENCH_DEFAULT_ITERATIONS;
+   options->callsPerIteration = 1;
+}
+
+BOOL
+WUTBenchRun(const char *name,
+            WUTBenchFn fn,
+            void *context,
+            const WUTBenchOptions *options,
+            WUTBenchResult *outResult)
+{
+   WUTBenchOptions defaults;
+   WUTBenchResult result;
+   OSTime *samples;
+   OSTime total = 0;
+   uint32_t calls;
+
+   if (!options) {
+      WUTBenchInitOptions(&defaults);
+      options = &defaults;
+   }
+
+   if (!options->iterations) {
+      return FALSE;
+   }
+
+   calls = options->callsPerIteration ? options->callsPerIteration : 1;
+   samples = (OSTime *)MEMAllocFromDefaultHeap(options->iterations * sizeof(OSTime));
+   if (!samples) {
+      WHBLogPrintf("%s: out of memory for %u samples", __FUNCTION__, options->iterations);
+      return FALSE;
+   }
+
+   for (uint32_t i = 0; i < options->warmupIterations; ++i) {
+      fn(context);
+   }
+
+   for (uint32_t i = 0; i < options->iterations; ++i) {
+      OSTime start = OSGetSystemTime();
+      for (uint32_t j = 0; j < calls; ++j) {
+         fn(context);
+      }
+      samples[i] = OSGetSystemTime() - start;
+      total += samples[i];
+   }
+
+   qsort(samples, options->iterations, sizeof(OSTime), BenchCompareTimes);
+
+   memset(&result, 0, sizeof(result));
+   result.iterations = options->iterations;
+   result.min = OSTicksToNanoseconds(samples[0]) / calls;
+   result.median = OSTicksToNanoseconds(samples[options->iterations / 2]) / calls;
+   result.p99 = OSTicksToNanoseconds(samples[(options->iterations - 1) * 99 / 100]) / calls;
+   result.max = OSTicksToNanoseconds(samples[options->iterations - 1]) / calls;
+   result.mean = OSTicksToNanoseconds(total) / options->iterations / calls;
+   if (options->bytesPerCall && result.median) {
+      result.bytesPerSecond = (uint32_t)(options->bytesPerCall * 1000000000ull / result.median);
+   }
+
+   MEMFreeToDefaultHeap(samples);
+
+   if (result.bytesPerSecond) {
+      WHBLogPrintf("%s: median %llu ns, p99 %llu ns, min %llu ns, max %llu ns, %u KiB/s",
+                   name, result.median, result.p99, result.min, result.max,
+                   result.bytesPerSecond / 1024);
+   } else {
+      WHBLogPrintf("%s: median %llu ns, p99 %llu ns, min %llu ns, max %llu ns",
+                   name, result.median, result.p99, result.min, result.max);
+   }
+
+   if (sOutput) {
+      fprintf(sOutput, "\"%s\",%u,%llu,%llu,%llu,%llu,%llu,%u\n",
+              name, result.iterations,
+              (unsigned long long)result.min, (unsigned long long)result.median,
+              (unsigned long long)result.p99, (unsigned long long)result.max,
+              (unsigned long long)result.mean, result.bytesPerSecond);
+      fflush(sOutput);
+   }
+
+   if (outResult) {
+      *outResult = result;
+   }
+
+   return TRUE;
+}
@@ -4,6 +4,7 @@
 #include <coreinit/debug.h>
 #include <coreinit/dynload.h>
 #include <coreinit/memexpheap.h>
+#include <wut_applet_memory.h>
 
 namespace nn
 {
@@ -16,6 +17,9 @@ static const uint32_t kRplAcquireBufferSize = 0xC80000;
 static MEMHeapHandle sHeapHandle = NULL;
 static OSDynLoad_Module sModuleHandle = NULL;
 
+// Work memory taken from the shared applet arena, returned in Destroy
+static void *sArenaWorkMemory = NULL;
+
 static void *sAppearError = NULL;
 static void *sAppearHomeNixSign = NULL;
 static void *sCalc = NULL;
@@ -85,19 +89,30 @@ Create(const CreateArg &args)
    OSDynLoadFreeFn prevDynLoadFree = NULL;
    uint32_t dynloadAcquireUseSize = 0;
    void *workMemory = NULL;
+   void *createMemory = args.workMemory;
    bool result = true;
 
-   if (!args.workMemory) {
-      OSReport("ERREULA: Create failed. CreateArg.workMemory is NULL.");
-      return false;
-   }
-
    if (!args.fsClient) {
       OSReport("ERREULA: Create failed. CreateArg.fsClient is NULL.");
       return false;
    }
 
-   sHeapHandle = MEMCreateExpHeapEx(args.workMemory, kWorkMemorySize, 0);
+   if (!createMemory) {
+      if (!WUTAppletMemoryIsInit()) {
+         OSReport("ERREULA: Create failed. CreateArg.workMemory is NULL.");
+         return false;
+      }
+
+      sArenaWorkMemory = WUTAppletMemoryAcquire(kWorkMemorySize);
+      if (!sArenaWorkMemory) {
+         OSReport("ERREULA: Create failed. Applet memory arena is in use.");
+         return false;
+      }
+
+      createMemory = sArenaWorkMemory;
+   }
+
+   sHeapHandle = MEMCreateExpHeapEx(createMemory, kWorkMemorySize, 0);
    OSDynLoad_GetAllocator(&prevDynLoadAlloc, &prevDynLoadFree);
    OSDynLoad_SetAllocator(allocForDynLoad, freeForDynLoad);
 
@@ -167,6 +182,9 @@ out:
          MEMDestroyExpHeap(sHeapHandle);
          sHeapHandle = NULL;
       }
+
+      WUTAppletMemoryRelease(sArenaWorkMemory);
+      sArenaWorkMemory = NULL;
    }
 
    OSDynLoad_SetAllocator(prevDynLoadAlloc, prevDynLoadFree);
@@ -219,6 +237,9 @@ Destroy()
       MEMDestroyExpHeap(sHeapHandle);
       sHeapHandle = NULL;
    }
+
+   WUTAppletMemoryRelease(sArenaWorkMemory);
+   sArenaWorkMemory = NULL;
 }
 
 void
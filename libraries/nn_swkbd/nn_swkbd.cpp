@@ -1,8 +1,13 @@
+#include <coreinit/cache.h>
 #include <coreinit/debug.h>
 #include <coreinit/dynload.h>
+#include <coreinit/event.h>
+#include <coreinit/memdefaultheap.h>
 #include <coreinit/memexpheap.h>
+#include <coreinit/thread.h>
 #include <nn/swkbd.h>
 #include <swkbd/rpl_interface.h>
+#include <wut_applet_memory.h>
 
 namespace nn
 {
@@ -10,46 +15,98 @@ namespace swkbd
 {
 
 static const uint32_t sRplAcquireBufferSize = 0x380000;
+static const uint32_t sPreloadStackSize = 0x4000;
+static const uint32_t sSubThreadStackSize = 0x8000;
+
+//! A swkbd.rpl function, looked up the first time it is called.
+struct Export
+{
+   const char *name;
+   uint32_t generation;
+   void *address;
+};
 
 static MEMHeapHandle sHeapHandle = NULL;
 static OSDynLoad_Module sModuleHandle = NULL;
 
-static void *sAppearInputForm = NULL;
-static void *sAppearKeyboard = NULL;
-static void *sCalcSubThreadFont = NULL;
-static void *sCalcSubThreadPredict = NULL;
-static void *sCalc = NULL;
-static void *sConfirmUnfixAll = NULL;
-static void *sCreate = NULL;
-static void *sDestroy = NULL;
-static void *sDisappearInputForm = NULL;
-static void *sDisappearKeyboard = NULL;
-static void *sDrawDRC = NULL;
-static void *sDrawTV = NULL;
-static void *sGetDrawStringInfo = NULL;
-static void *sGetInputFormString = NULL;
-static void *sGetKeyboardCondition = NULL;
-static void *sGetStateInputForm = NULL;
-static void *sGetStateKeyboard = NULL;
-static void *sInactivateSelectCursor = NULL;
-static void *sInitLearnDic = NULL;
-static void *sIsCoveredWithSubWindow = NULL;
-static void *sIsDecideCancelButton = NULL;
-static void *sIsDecideOkButton = NULL;
-static void *sIsKeyboardTarget = NULL;
-static void *sIsNeedCalcSubThreadFont = NULL;
-static void *sIsNeedCalcSubThreadPredict = NULL;
-static void *sIsSelectCursorActive = NULL;
-static void *sMuteAllSound = NULL;
-static void *sSetControllerRemo = NULL;
-static void *sSetCursorPos = NULL;
-static void *sSetEnableOkButton = NULL;
-static void *sSetInputFormString = NULL;
-static void *sSetReceiver = NULL;
-static void *sSetSelectFrom = NULL;
-static void *sSetUserControllerEventObj = NULL;
-static void *sSetUserSoundObj = NULL;
-static void *sSetVersion = NULL;
+// Work memory taken from the shared applet arena, returned on unload
+static void *sArenaWorkMemory = NULL;
+
+// Bumped whenever swkbd.rpl is released, so exports are looked up again
+static volatile uint32_t sModuleGeneration = 1;
+
+static OSThread sPreloadThread;
+static uint8_t sPreloadStack[sPreloadStackSize] __attribute__((aligned(16)));
+static bool sPreloadStarted = false;
+static bool sPreloadResult = false;
+static void *sPreloadWorkMemory = NULL;
+static uint32_t sPreloadUnk = 0;
+
+//! A helper thread running one of the CalcSubThread functions.
+struct SubThread
+{
+   OSThread thread;
+   OSEvent event;
+   void *stack;
+   void (*calc)();
+};
+
+static SubThread sFontThread;
+static SubThread sPredictThread;
+static volatile bool sSubThreadsRunning = false;
+
+static Export sAppearInputForm = { "SwkbdAppearInputForm__3RplFRCQ3_2nn5swkbd9AppearArg" };
+static Export sAppearKeyboard = { "SwkbdAppearKeyboard__3RplFRCQ3_2nn5swkbd11KeyboardArg" };
+static Export sCalcSubThreadFont = { "SwkbdCalcSubThreadFont__3RplFv" };
+static Export sCalcSubThreadPredict = { "SwkbdCalcSubThreadPredict__3RplFv" };
+static Export sCalc = { "SwkbdCalc__3RplFRCQ3_2nn5swkbd14ControllerInfo" };
+static Export sConfirmUnfixAll = { "SwkbdConfirmUnfixAll__3RplFv" };
+static Export sCreate = { "SwkbdCreate__3RplFPUcQ3_2nn5swkbd10RegionTypeUiP8FSClient" };
+static Export sDestroy = { "SwkbdDestroy__3RplFv" };
+static Export sDisappearInputForm = { "SwkbdDisappearInputForm__3RplFv" };
+static Export sDisappearKeyboard = { "SwkbdDisappearKeyboard__3RplFv" };
+static Export sDrawDRC = { "SwkbdDrawDRC__3RplFv" };
+static Export sDrawTV = { "SwkbdDrawTV__3RplFv" };
+static Export sGetDrawStringInfo = { "SwkbdGetDrawStringInfo__3RplFPQ3_2nn5swkbd14DrawStringInfo" };
+static Export sGetInputFormString = { "SwkbdGetInputFormString__3RplFv" };
+static Export sGetKeyboardCondition = { "SwkbdGetKeyboardCondition__3RplFPQ3_2nn5swkbd17KeyboardCondition" };
+static Export sGetStateInputForm = { "SwkbdGetStateInputForm__3RplFv" };
+static Export sGetStateKeyboard = { "SwkbdGetStateKeyboard__3RplFv" };
+static Export sInactivateSelectCursor = { "SwkbdInactivateSelectCursor__3RplFv" };
+static Export sInitLearnDic = { "SwkbdInitLearnDic__3RplFPv" };
+static Export sIsCoveredWithSubWindow = { "SwkbdIsCoveredWithSubWindow__3RplFv" };
+static Export sIsDecideCancelButton = { "SwkbdIsDecideCancelButton__3RplFPb" };
+static Export sIsDecideOkButton = { "SwkbdIsDecideOkButton__3RplFPb" };
+static Export sIsKeyboardTarget = { "SwkbdIsKeyboardTarget__3RplFPQ3_2nn5swkbd14IEventReceiver" };
+static Export sIsNeedCalcSubThreadFont = { "SwkbdIsNeedCalcSubThreadFont__3RplFv" };
+static Export sIsNeedCalcSubThreadPredict = { "SwkbdIsNeedCalcSubThreadPredict__3RplFv" };
+static Export sIsSelectCursorActive = { "SwkbdIsSelectCursorActive__3RplFv" };
+static Export sMuteAllSound = { "SwkbdMuteAllSound__3RplFb" };
+static Export sSetControllerRemo = { "SwkbdSetControllerRemo__3RplFQ3_2nn5swkbd14ControllerType" };
+static Export sSetCursorPos = { "SwkbdSetCursorPos__3RplFi" };
+static Export sSetEnableOkButton = { "SwkbdSetEnableOkButton__3RplFb" };
+static Export sSetInputFormString = { "SwkbdSetInputFormString__3RplFPCw" };
+static Export sSetReceiver = { "SwkbdSetReceiver__3RplFRCQ3_2nn5swkbd11ReceiverArg" };
+static Export sSetSelectFrom = { "SwkbdSetSelectFrom__3RplFi" };
+static Export sSetUserControllerEventObj = { "SwkbdSetUserControllerEventObj__3RplFPQ3_2nn5swkbd19IControllerEventObj" };
+static Export sSetUserSoundObj = { "SwkbdSetUserSoundObj__3RplFPQ3_2nn5swkbd9ISoundObj" };
+static Export sSetVersion = { "SwkbdSetVersion__3RplFi" };
+
+static void *
+resolve(Export &fn)
+{
+   if (fn.generation != sModuleGeneration) {
+      void *address = NULL;
+      OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, fn.name, &address);
+      fn.address = address;
+
+      // Another thread seeing the generation must also see the address
+      OSMemoryBarrier();
+      fn.generation = sModuleGeneration;
+   }
+
+   return fn.address;
+}
 
 static OSDynLoad_Error
 allocForDynLoad(int32_t size,
@@ -72,45 +129,46 @@ freeForDynLoad(void *addr)
 }
 
 static void
-Create(void *buffer,
-       nn::swkbd::RegionType regionType,
-       uint32_t unk,
-       FSClient *fsClient)
+unloadModule()
 {
+   if (sModuleHandle) {
+      OSDynLoad_Release(sModuleHandle);
+      sModuleHandle = NULL;
+   }
 
-   return reinterpret_cast<decltype(&Rpl::SwkbdCreate)>(sCreate)(
-      buffer, regionType, unk, fsClient);
-}
+   sModuleGeneration = sModuleGeneration + 1;
 
-static void
-SetVersion(int version)
-{
-   return reinterpret_cast<decltype(&Rpl::SwkbdSetVersion)>(sSetVersion)(
-      version);
+   if (sHeapHandle) {
+      MEMDestroyExpHeap(sHeapHandle);
+      sHeapHandle = NULL;
+   }
+
+   WUTAppletMemoryRelease(sArenaWorkMemory);
+   sArenaWorkMemory = NULL;
 }
 
-bool
-Create(const CreateArg &args)
+static bool
+loadModule(void *workMemory,
+           uint32_t unk)
 {
    OSDynLoadAllocFn prevDynLoadAlloc = NULL;
    OSDynLoadFreeFn prevDynLoadFree = NULL;
    uint32_t dynloadAcquireUseSize = 0;
-   void *workMemory = NULL;
    bool result = true;
 
-   if (!args.workMemory) {
-      OSReport("SWKBD: Create failed. CreateArg.workMemory is NULL.");
-      return false;
-   }
+   if (!workMemory) {
+      sArenaWorkMemory = WUTAppletMemoryAcquire(GetWorkMemorySize(unk));
+      if (!sArenaWorkMemory) {
+         OSReport("SWKBD: Create failed. Applet memory arena is in use.");
+         return false;
+      }
 
-   if (!args.fsClient) {
-      OSReport("SWKBD: Create failed. CreateArg.fsClient is NULL.");
-      return false;
+      workMemory = sArenaWorkMemory;
    }
 
    // Create work memory heap
-   sHeapHandle = MEMCreateExpHeapEx(args.workMemory,
-                                    GetWorkMemorySize(args.unk_0x08),
+   sHeapHandle = MEMCreateExpHeapEx(workMemory,
+                                    GetWorkMemorySize(unk),
                                     0);
 
    // Save the old DynLoad allocator functions
@@ -126,7 +184,7 @@ Create(const CreateArg &args)
       goto out;
    }
 
-   dynloadAcquireUseSize = GetWorkMemorySize(args.unk_0x08) -
+   dynloadAcquireUseSize = GetWorkMemorySize(unk) -
                            MEMGetAllocatableSizeForExpHeapEx(sHeapHandle, 4);
    OSReport("SWKBD: OSDynLoad_Acquire() use [%d/%d]\n",
             dynloadAcquireUseSize, sRplAcquireBufferSize);
@@ -137,69 +195,207 @@ Create(const CreateArg &args)
       goto out;
    }
 
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdAppearInputForm__3RplFRCQ3_2nn5swkbd9AppearArg", &sAppearInputForm);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdAppearKeyboard__3RplFRCQ3_2nn5swkbd11KeyboardArg", &sAppearKeyboard);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdCalcSubThreadFont__3RplFv", &sCalcSubThreadFont);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdCalcSubThreadPredict__3RplFv", &sCalcSubThreadPredict);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdCalc__3RplFRCQ3_2nn5swkbd14ControllerInfo", &sCalc);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdConfirmUnfixAll__3RplFv", &sConfirmUnfixAll);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdCreate__3RplFPUcQ3_2nn5swkbd10RegionTypeUiP8FSClient", &sCreate);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdDestroy__3RplFv", &sDestroy);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdDisappearInputForm__3RplFv", &sDisappearInputForm);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdDisappearKeyboard__3RplFv", &sDisappearKeyboard);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdDrawDRC__3RplFv", &sDrawDRC);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdDrawTV__3RplFv", &sDrawTV);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdGetDrawStringInfo__3RplFPQ3_2nn5swkbd14DrawStringInfo", &sGetDrawStringInfo);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdGetInputFormString__3RplFv", &sGetInputFormString);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdGetKeyboardCondition__3RplFPQ3_2nn5swkbd17KeyboardCondition", &sGetKeyboardCondition);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdGetStateInputForm__3RplFv", &sGetStateInputForm);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdGetStateKeyboard__3RplFv", &sGetStateKeyboard);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdInactivateSelectCursor__3RplFv", &sInactivateSelectCursor);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdInitLearnDic__3RplFPv", &sInitLearnDic);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdIsCoveredWithSubWindow__3RplFv", &sIsCoveredWithSubWindow);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdIsDecideCancelButton__3RplFPb", &sIsDecideCancelButton);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdIsDecideOkButton__3RplFPb", &sIsDecideOkButton);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdIsKeyboardTarget__3RplFPQ3_2nn5swkbd14IEventReceiver", &sIsKeyboardTarget);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdIsNeedCalcSubThreadFont__3RplFv", &sIsNeedCalcSubThreadFont);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdIsNeedCalcSubThreadPredict__3RplFv", &sIsNeedCalcSubThreadPredict);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdIsSelectCursorActive__3RplFv", &sIsSelectCursorActive);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdMuteAllSound__3RplFb", &sMuteAllSound);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetControllerRemo__3RplFQ3_2nn5swkbd14ControllerType", &sSetControllerRemo);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetCursorPos__3RplFi", &sSetCursorPos);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetEnableOkButton__3RplFb", &sSetEnableOkButton);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetInputFormString__3RplFPCw", &sSetInputFormString);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetReceiver__3RplFRCQ3_2nn5swkbd11ReceiverArg", &sSetReceiver);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetSelectFrom__3RplFi", &sSetSelectFrom);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetUserControllerEventObj__3RplFPQ3_2nn5swkbd19IControllerEventObj", &sSetUserControllerEventObj);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetUserSoundObj__3RplFPQ3_2nn5swkbd9ISoundObj", &sSetUserSoundObj);
-   OSDynLoad_FindExport(sModuleHandle, OS_DYNLOAD_EXPORT_FUNC, "SwkbdSetVersion__3RplFi", &sSetVersion);
+out:
+   if (!result) {
+      unloadModule();
+   }
+
+   OSDynLoad_SetAllocator(prevDynLoadAlloc, prevDynLoadFree);
+   return result;
+}
+
+static int
+preloadThreadEntry(int argc,
+                   const char **argv)
+{
+   sPreloadResult = loadModule(sPreloadWorkMemory, sPreloadUnk);
+   return 0;
+}
+
+//! \return true if a preload had been started and succeeded.
+static bool
+waitForPreload()
+{
+   if (!sPreloadStarted) {
+      return false;
+   }
+
+   OSJoinThread(&sPreloadThread, NULL);
+   sPreloadStarted = false;
+   return sPreloadResult;
+}
+
+static void
+Create(void *buffer,
+       nn::swkbd::RegionType regionType,
+       uint32_t unk,
+       FSClient *fsClient)
+{
+
+   return reinterpret_cast<decltype(&Rpl::SwkbdCreate)>(resolve(sCreate))(
+      buffer, regionType, unk, fsClient);
+}
+
+static void
+SetVersion(int version)
+{
+   return reinterpret_cast<decltype(&Rpl::SwkbdSetVersion)>(resolve(sSetVersion))(
+      version);
+}
+
+static int
+subThreadEntry(int argc,
+               const char **argv)
+{
+   SubThread *subThread = (SubThread *)argv;
+
+   while (true) {
+      OSWaitEvent(&subThread->event);
+      if (!sSubThreadsRunning) {
+         break;
+      }
+
+      subThread->calc();
+   }
+
+   return 0;
+}
+
+static bool
+startSubThread(SubThread *subThread,
+               void (*calc)(),
+               const char *name,
+               OSThreadAttributes affinity,
+               int32_t priority)
+{
+   subThread->calc = calc;
+   subThread->stack = MEMAllocFromDefaultHeapEx(sSubThreadStackSize, 16);
+   if (!subThread->stack) {
+      OSReport("SWKBD: StartSubThreads failed. Out of memory for the %s stack.", name);
+      return false;
+   }
+
+   OSInitEvent(&subThread->event, FALSE, OS_EVENT_MODE_AUTO);
+
+   if (!OSCreateThread(&subThread->thread,
+                       subThreadEntry,
+                       0,
+                       (char *)subThread,
+                       (uint8_t *)subThread->stack + sSubThreadStackSize,
+                       sSubThreadStackSize,
+                       priority,
+                       affinity)) {
+      OSReport("SWKBD: StartSubThreads failed. OSCreateThread() failed for %s.", name);
+      MEMFreeToDefaultHeap(subThread->stack);
+      subThread->stack = NULL;
+      return false;
+   }
+
+   OSSetThreadName(&subThread->thread, name);
+   OSResumeThread(&subThread->thread);
+   return true;
+}
+
+static void
+stopSubThread(SubThread *subThread)
+{
+   if (!subThread->stack) {
+      return;
+   }
+
+   OSSignalEvent(&subThread->event);
+   OSJoinThread(&subThread->thread, NULL);
+   MEMFreeToDefaultHeap(subThread->stack);
+   subThread->stack = NULL;
+}
+
+bool
+Preload(void *workMemory,
+        uint32_t unk)
+{
+   if (!workMemory && !WUTAppletMemoryIsInit()) {
+      OSReport("SWKBD: Preload failed. workMemory is NULL.");
+      return false;
+   }
+
+   if (sPreloadStarted || sModuleHandle) {
+      OSReport("SWKBD: Preload failed. swkbd.rpl is already loaded.");
+      return false;
+   }
+
+   sPreloadWorkMemory = workMemory;
+   sPreloadUnk = unk;
+   sPreloadResult = false;
+
+   if (!OSCreateThread(&sPreloadThread,
+                       preloadThreadEntry,
+                       0,
+                       NULL,
+                       sPreloadStack + sizeof(sPreloadStack),
+                       sizeof(sPreloadStack),
+                       20,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      OSReport("SWKBD: Preload failed. OSCreateThread() failed.");
+      return false;
+   }
+
+   OSSetThreadName(&sPreloadThread, "SWKBD preload");
+   sPreloadStarted = true;
+   OSResumeThread(&sPreloadThread);
+   return true;
+}
+
+bool
+Create(const CreateArg &args)
+{
+   OSDynLoadAllocFn prevDynLoadAlloc = NULL;
+   OSDynLoadFreeFn prevDynLoadFree = NULL;
+   void *workMemory = NULL;
+   bool loaded = false;
+   bool result = true;
+
+   if (!args.workMemory && !WUTAppletMemoryIsInit()) {
+      OSReport("SWKBD: Create failed. CreateArg.workMemory is NULL.");
+      return false;
+   }
+
+   if (!args.fsClient) {
+      OSReport("SWKBD: Create failed. CreateArg.fsClient is NULL.");
+      return false;
+   }
+
+   if (sPreloadStarted) {
+      loaded = waitForPreload();
+      if (loaded &&
+          (sPreloadWorkMemory != args.workMemory || sPreloadUnk != args.unk_0x08)) {
+         OSReport("SWKBD: Create failed. CreateArg.workMemory differs from Preload().");
+         unloadModule();
+         return false;
+      }
+   }
+
+   // Load synchronously when there was no preload or it failed
+   if (!loaded && !loadModule(args.workMemory, args.unk_0x08)) {
+      return false;
+   }
+
+   // The RPL may still allocate from the work memory while creating
+   OSDynLoad_GetAllocator(&prevDynLoadAlloc, &prevDynLoadFree);
+   OSDynLoad_SetAllocator(allocForDynLoad, freeForDynLoad);
 
    workMemory = MEMAllocFromExpHeapEx(sHeapHandle,
                                       GetWorkMemorySize(args.unk_0x08) - sRplAcquireBufferSize,
                                       4);
    if (!workMemory) {
       OSReport("SWKBD: Create failed. framework_buffer == NULL.");
+      unloadModule();
       result = false;
-      goto out;
    } else {
       SetVersion(3);
       Create(workMemory, args.regionType, args.unk_0x08, args.fsClient);
       result = true;
    }
 
-out:
-   if (!result) {
-      if (sModuleHandle) {
-         OSDynLoad_Release(sModuleHandle);
-         sModuleHandle = NULL;
-      }
-
-      if (sHeapHandle) {
-         MEMDestroyExpHeap(sHeapHandle);
-         sHeapHandle = NULL;
-      }
-   }
-
    OSDynLoad_SetAllocator(prevDynLoadAlloc, prevDynLoadFree);
    return result;
 }
@@ -208,7 +404,7 @@ bool
 AppearInputForm(const AppearArg& args)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdAppearInputForm)>
-      (sAppearInputForm)
+      (resolve(sAppearInputForm))
       (args);
 }
 
@@ -216,7 +412,7 @@ bool
 AppearKeyboard(const KeyboardArg& args)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdAppearKeyboard)>
-      (sAppearKeyboard)
+      (resolve(sAppearKeyboard))
       (args);
 }
 
@@ -224,7 +420,7 @@ void
 CalcSubThreadFont()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdCalcSubThreadFont)>
-      (sCalcSubThreadFont)
+      (resolve(sCalcSubThreadFont))
       ();
 }
 
@@ -232,47 +428,58 @@ void
 CalcSubThreadPredict()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdCalcSubThreadPredict)>
-      (sCalcSubThreadPredict)
+      (resolve(sCalcSubThreadPredict))
       ();
 }
 
 void
 Calc(const ControllerInfo &controllerInfo)
 {
-   return reinterpret_cast<decltype(&Rpl::SwkbdCalc)>
-      (sCalc)
+   reinterpret_cast<decltype(&Rpl::SwkbdCalc)>
+      (resolve(sCalc))
       (controllerInfo);
+
+   // Hand whatever this frame needs over to the helper threads
+   if (sSubThreadsRunning) {
+      if (IsNeedCalcSubThreadFont()) {
+         OSSignalEvent(&sFontThread.event);
+      }
+
+      if (IsNeedCalcSubThreadPredict()) {
+         OSSignalEvent(&sPredictThread.event);
+      }
+   }
 }
 
 void
 ConfirmUnfixAll()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdConfirmUnfixAll)>
-      (sConfirmUnfixAll)
+      (resolve(sConfirmUnfixAll))
       ();
 }
 
 void
 Destroy()
 {
-   reinterpret_cast<decltype(&Rpl::SwkbdDestroy)>(sDestroy)();
+   StopSubThreads();
 
-   if (sModuleHandle) {
-      OSDynLoad_Release(sModuleHandle);
-      sModuleHandle = NULL;
+   // Preloaded but never created, there is no keyboard to destroy
+   if (sPreloadStarted) {
+      waitForPreload();
+      unloadModule();
+      return;
    }
 
-   if (sHeapHandle) {
-      MEMDestroyExpHeap(sHeapHandle);
-      sHeapHandle = NULL;
-   }
+   reinterpret_cast<decltype(&Rpl::SwkbdDestroy)>(resolve(sDestroy))();
+   unloadModule();
 }
 
 bool
 DisappearInputForm()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdDisappearInputForm)>
-      (sDisappearInputForm)
+      (resolve(sDisappearInputForm))
       ();
 }
 
@@ -280,7 +487,7 @@ bool
 DisappearKeyboard()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdDisappearKeyboard)>
-      (sDisappearKeyboard)
+      (resolve(sDisappearKeyboard))
       ();
 }
 
@@ -288,7 +495,7 @@ void
 DrawDRC()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdDrawDRC)>
-      (sDrawDRC)
+      (resolve(sDrawDRC))
       ();
 }
 
@@ -296,7 +503,7 @@ void
 DrawTV()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdDrawTV)>
-      (sDrawTV)
+      (resolve(sDrawTV))
       ();
 }
 
@@ -304,7 +511,7 @@ void
 GetDrawStringInfo(DrawStringInfo *drawStringInfo)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdGetDrawStringInfo)>
-      (sGetDrawStringInfo)
+      (resolve(sGetDrawStringInfo))
       (drawStringInfo);
 }
 
@@ -312,7 +519,7 @@ const char16_t *
 GetInputFormString()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdGetInputFormString)>
-      (sGetInputFormString)
+      (resolve(sGetInputFormString))
       ();
 }
 
@@ -320,7 +527,7 @@ void
 GetKeyboardCondition(KeyboardCondition *keyboardCondition)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdGetKeyboardCondition)>
-      (sGetKeyboardCondition)
+      (resolve(sGetKeyboardCondition))
       (keyboardCondition);
 }
 
@@ -328,7 +535,7 @@ State
 GetStateInputForm()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdGetStateInputForm)>
-      (sGetStateInputForm)
+      (resolve(sGetStateInputForm))
       ();
 }
 
@@ -336,7 +543,7 @@ State
 GetStateKeyboard()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdGetStateKeyboard)>
-      (sGetStateKeyboard)
+      (resolve(sGetStateKeyboard))
       ();
 }
 
@@ -360,7 +567,7 @@ void
 InactivateSelectCursor()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdInactivateSelectCursor)>
-      (sInactivateSelectCursor)
+      (resolve(sInactivateSelectCursor))
       ();
 }
 
@@ -368,7 +575,7 @@ bool
 InitLearnDic(void *dictionary)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdInitLearnDic)>
-      (sInitLearnDic)
+      (resolve(sInitLearnDic))
       (dictionary);
 }
 
@@ -376,7 +583,7 @@ bool
 IsCoveredWithSubWindow()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdIsCoveredWithSubWindow)>
-      (sIsCoveredWithSubWindow)
+      (resolve(sIsCoveredWithSubWindow))
       ();
 }
 
@@ -384,7 +591,7 @@ bool
 IsDecideCancelButton(bool *outIsSelected)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdIsDecideCancelButton)>
-      (sIsDecideCancelButton)
+      (resolve(sIsDecideCancelButton))
       (outIsSelected);
 }
 
@@ -392,7 +599,7 @@ bool
 IsDecideOkButton(bool *outIsSelected)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdIsDecideOkButton)>
-      (sIsDecideOkButton)
+      (resolve(sIsDecideOkButton))
       (outIsSelected);
 }
 
@@ -400,7 +607,7 @@ bool
 IsKeyboardTarget(IEventReceiver *eventReceiver)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdIsKeyboardTarget)>
-      (sIsKeyboardTarget)
+      (resolve(sIsKeyboardTarget))
       (eventReceiver);
 }
 
@@ -408,7 +615,7 @@ bool
 IsNeedCalcSubThreadFont()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdIsNeedCalcSubThreadFont)>
-      (sIsNeedCalcSubThreadFont)
+      (resolve(sIsNeedCalcSubThreadFont))
       ();
 }
 
@@ -416,7 +623,7 @@ bool
 IsNeedCalcSubThreadPredict()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdIsNeedCalcSubThreadPredict)>
-      (sIsNeedCalcSubThreadPredict)
+      (resolve(sIsNeedCalcSubThreadPredict))
       ();
 }
 
@@ -424,7 +631,7 @@ bool
 IsSelectCursorActive()
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdIsSelectCursorActive)>
-      (sIsSelectCursorActive)
+      (resolve(sIsSelectCursorActive))
       ();
 }
 
@@ -432,7 +639,7 @@ void
 MuteAllSound(bool muted)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdMuteAllSound)>
-      (sMuteAllSound)
+      (resolve(sMuteAllSound))
       (muted);
 }
 
@@ -440,7 +647,7 @@ void
 SetControllerRemo(ControllerType type)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetControllerRemo)>
-      (sSetControllerRemo)
+      (resolve(sSetControllerRemo))
       (type);
 }
 
@@ -448,7 +655,7 @@ void
 SetCursorPos(int pos)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetCursorPos)>
-      (sSetCursorPos)
+      (resolve(sSetCursorPos))
       (pos);
 }
 
@@ -456,7 +663,7 @@ void
 SetEnableOkButton(bool enable)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetEnableOkButton)>
-      (sSetEnableOkButton)
+      (resolve(sSetEnableOkButton))
       (enable);
 }
 
@@ -464,7 +671,7 @@ void
 SetInputFormString(const char16_t *str)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetInputFormString)>
-      (sSetInputFormString)
+      (resolve(sSetInputFormString))
       (str);
 }
 
@@ -472,7 +679,7 @@ void
 SetReceiver(const ReceiverArg &receiver)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetReceiver)>
-      (sSetReceiver)
+      (resolve(sSetReceiver))
       (receiver);
 }
 
@@ -480,7 +687,7 @@ void
 SetSelectFrom(int from)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetSelectFrom)>
-      (sSetSelectFrom)
+      (resolve(sSetSelectFrom))
       (from);
 }
 
@@ -488,7 +695,7 @@ void
 SetUserControllerEventObj(IControllerEventObj *controllerEventObj)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetUserControllerEventObj)>
-      (sSetUserControllerEventObj)
+      (resolve(sSetUserControllerEventObj))
       (controllerEventObj);
 }
 
@@ -496,9 +703,47 @@ void
 SetUserSoundObj(ISoundObj *soundObj)
 {
    return reinterpret_cast<decltype(&Rpl::SwkbdSetUserSoundObj)>
-      (sSetUserSoundObj)
+      (resolve(sSetUserSoundObj))
       (soundObj);
 }
 
+bool
+StartSubThreads(OSThreadAttributes affinity,
+                int32_t priority)
+{
+   if (sSubThreadsRunning) {
+      return false;
+   }
+
+   sSubThreadsRunning = true;
+
+   if (!startSubThread(&sFontThread, CalcSubThreadFont,
+                       "SWKBD font", affinity, priority)) {
+      sSubThreadsRunning = false;
+      return false;
+   }
+
+   if (!startSubThread(&sPredictThread, CalcSubThreadPredict,
+                       "SWKBD predict", affinity, priority)) {
+      sSubThreadsRunning = false;
+      stopSubThread(&sFontThread);
+      return false;
+   }
+
+   return true;
+}
+
+void
+StopSubThreads()
+{
+   if (!sSubThreadsRunning) {
+      return;
+   }
+
+   sSubThreadsRunning = false;
+   stopSubThread(&sFontThread);
+   stopSubThread(&sPredictThread);
+}
+
 } // namespace swkbd
 } // namespace nn
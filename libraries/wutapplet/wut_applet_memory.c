@@ -0,0 +1,84 @@
+#include <wut_applet_memory.h>
+#include <coreinit/debug.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memexpheap.h>
+
+#define APPLET_MEMORY_ALIGN 0x40
+
+//! Blocks the arena has room for at once, one per wrapped applet
+#define APPLET_MEMORY_MAX_BLOCKS 2
+
+//! The heap header, and a block header and alignment padding for each block
+#define APPLET_MEMORY_OVERHEAD \
+   (sizeof(MEMExpHeap) + APPLET_MEMORY_ALIGN + \
+    APPLET_MEMORY_MAX_BLOCKS * (sizeof(MEMExpHeapBlock) + APPLET_MEMORY_ALIGN))
+
+static void *sArena = NULL;
+static MEMHeapHandle sArenaHeap = NULL;
+
+BOOL
+WUTAppletMemoryInit(uint32_t size)
+{
+   if (sArena) {
+      return FALSE;
+   }
+
+   if (!size) {
+      size = WUT_APPLET_MEMORY_DEFAULT_SIZE;
+   }
+
+   // size is what the applets get, the heap keeps its own headers on top
+   size += APPLET_MEMORY_OVERHEAD;
+   sArena = MEMAllocFromDefaultHeapEx(size, APPLET_MEMORY_ALIGN);
+   if (!sArena) {
+      WUT_DEBUG_REPORT("WUTAppletMemoryInit: out of memory for a %u byte arena\n", size);
+      return FALSE;
+   }
+
+   // The swkbd preload thread may take memory while the game runs
+   sArenaHeap = MEMCreateExpHeapEx(sArena, size, MEM_HEAP_FLAG_USE_LOCK);
+   if (!sArenaHeap) {
+      MEMFreeToDefaultHeap(sArena);
+      sArena = NULL;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+void
+WUTAppletMemoryShutdown(void)
+{
+   if (!sArena) {
+      return;
+   }
+
+   MEMDestroyExpHeap(sArenaHeap);
+   MEMFreeToDefaultHeap(sArena);
+   sArenaHeap = NULL;
+   sArena = NULL;
+}
+
+BOOL
+WUTAppletMemoryIsInit(void)
+{
+   return sArena != NULL;
+}
+
+void *
+WUTAppletMemoryAcquire(uint32_t size)
+{
+   if (!sArenaHeap) {
+      return NULL;
+   }
+
+   return MEMAllocFromExpHeapEx(sArenaHeap, size, APPLET_MEMORY_ALIGN);
+}
+
+void
+WUTAppletMemoryRelease(void *ptr)
+{
+   if (sArenaHeap && ptr) {
+      MEMFreeToExpHeap(sArenaHeap, ptr);
+   }
+}
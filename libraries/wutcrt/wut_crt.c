@@ -1,28 +1,190 @@
+#include <coreinit/atomic.h>
 #include <coreinit/debug.h>
+#include <coreinit/core.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <wut_startup.h>
+
+#define INIT_THREAD_STACK_SIZE 0x4000
+#define STARTUP_MAX_MARKS      32
+
 void __init_wut_newlib();
 void __init_wut_stdcpp();
 void __init_wut_devoptab();
 void __attribute__((weak)) __init_wut_socket();
+void __attribute__((weak)) __init_wut_socket_early();
 
 void __fini_wut_newlib();
 void __fini_wut_stdcpp();
 void __fini_wut_devoptab();
 void __attribute__((weak)) __fini_wut_socket();
+void __attribute__((weak)) __fini_wut_profile();
+
+// Set to 0 by the application to run every init step on the main thread
+uint32_t __attribute__((weak)) __wut_parallel_init = 1;
+
+static WUTStartupTimes sStartupTimes;
+static WUTStartupMark sStartupMarks[STARTUP_MAX_MARKS];
+static volatile int32_t sNumStartupMarks = 0;
+static OSThread sInitThread;
+static uint8_t sInitThreadStack[INIT_THREAD_STACK_SIZE] __attribute__((aligned(16)));
+
+static int
+__wut_init_thread_entry(int argc,
+                        const char **argv)
+{
+   OSTime start = OSGetSystemTime();
+   WUTMarkStartup("socket early");
+   __init_wut_socket_early();
+   sStartupTimes.socketEarly = OSGetSystemTime() - start;
+   return 0;
+}
+
+//! Start the parts of the init that don't touch newlib on another core
+static BOOL
+__wut_init_start_parallel()
+{
+   if (!__wut_parallel_init || !&__init_wut_socket_early) {
+      return FALSE;
+   }
+
+   OSThreadAttributes otherCores = OS_THREAD_ATTRIB_AFFINITY_ANY & ~(1 << OSGetCoreId());
+   if (!OSCreateThread(&sInitThread,
+                       __wut_init_thread_entry,
+                       0,
+                       NULL,
+                       sInitThreadStack + sizeof(sInitThreadStack),
+                       sizeof(sInitThreadStack),
+                       16,
+                       otherCores)) {
+      return FALSE;
+   }
+
+   OSResumeThread(&sInitThread);
+   return TRUE;
+}
 
 void __attribute__((weak))
 __init_wut()
 {
+   OSTime start = OSGetSystemTime();
+   OSTime step = start;
+   OSTime now;
+
+   WUTMarkStartup("__init_wut");
    __init_wut_newlib();
+   now = OSGetSystemTime();
+   sStartupTimes.newlib = now - step;
+   step = now;
+
+   WUTMarkStartup("stdc++");
    __init_wut_stdcpp();
+   now = OSGetSystemTime();
+   sStartupTimes.stdcpp = now - step;
+   step = now;
+
+   // Network bring-up overlaps with mounting the SD card
+   BOOL parallel = __wut_init_start_parallel();
+
+   WUTMarkStartup("devoptab");
    __init_wut_devoptab();
+   now = OSGetSystemTime();
+   sStartupTimes.devoptab = now - step;
+   step = now;
+
+   if (parallel) {
+      OSJoinThread(&sInitThread, NULL);
+      now = OSGetSystemTime();
+      sStartupTimes.join = now - step;
+      step = now;
+   }
+
+   WUTMarkStartup("socket");
    if (&__init_wut_socket) __init_wut_socket();
+   now = OSGetSystemTime();
+   sStartupTimes.socket = now - step;
+
+   sStartupTimes.total = now - start;
+   WUTMarkStartup("__init_wut done");
+}
+
+// Runs before every constructor without a priority, which is all of them
+// in most applications
+static void __attribute__((constructor(101)))
+__wut_mark_constructors()
+{
+   WUTMarkStartup("static constructors");
 }
 
 void __attribute__((weak))
 __fini_wut()
 {
    if (&__fini_wut_socket) __fini_wut_socket();
+   if (&__fini_wut_profile) __fini_wut_profile();
    __fini_wut_devoptab();
    __fini_wut_stdcpp();
    __fini_wut_newlib();
 }
+
+void
+WUTGetStartupTimes(WUTStartupTimes *outTimes)
+{
+   *outTimes = sStartupTimes;
+}
+
+void
+WUTMarkStartup(const char *name)
+{
+   uint32_t index = (uint32_t)OSAddAtomic(&sNumStartupMarks, 1);
+   if (index < STARTUP_MAX_MARKS) {
+      sStartupMarks[index].name = name;
+      sStartupMarks[index].time = OSGetSystemTime();
+   }
+}
+
+uint32_t
+WUTGetStartupMarks(WUTStartupMark *outMarks,
+                   uint32_t maxMarks)
+{
+   uint32_t count = (uint32_t)sNumStartupMarks;
+   if (count > STARTUP_MAX_MARKS) {
+      count = STARTUP_MAX_MARKS;
+   }
+
+   for (uint32_t i = 0; i < count && i < maxMarks; ++i) {
+      outMarks[i] = sStartupMarks[i];
+   }
+
+   return count;
+}
+
+void
+WUTReportStartupTimes()
+{
+   OSReport("wut startup: %llu us in __init_wut\n", OSTicksToMicroseconds(sStartupTimes.total));
+   OSReport("  newlib       %llu us\n", OSTicksToMicroseconds(sStartupTimes.newlib));
+   OSReport("  stdc++       %llu us\n", OSTicksToMicroseconds(sStartupTimes.stdcpp));
+   OSReport("  devoptab     %llu us\n", OSTicksToMicroseconds(sStartupTimes.devoptab));
+   OSReport("  socket early %llu us (in parallel)\n", OSTicksToMicroseconds(sStartupTimes.socketEarly));
+   OSReport("  join         %llu us\n", OSTicksToMicroseconds(sStartupTimes.join));
+   OSReport("  socket       %llu us\n", OSTicksToMicroseconds(sStartupTimes.socket));
+
+   uint32_t count = WUTGetStartupMarks(NULL, 0);
+   if (!count) {
+      return;
+   }
+
+   // Marks relative to the first one and to the one before, a mark from
+   // the init thread can be a little out of order
+   OSTime first = sStartupMarks[0].time;
+   OSTime prev = first;
+   OSReport("wut startup marks:\n");
+   for (uint32_t i = 0; i < count; ++i) {
+      OSTime time = sStartupMarks[i].time;
+      OSReport("  %10llu us  +%8llu us  %s\n",
+               OSTicksToMicroseconds(time > first ? time - first : 0),
+               OSTicksToMicroseconds(time > prev ? time - prev : 0),
+               sStartupMarks[i].name);
+      prev = time;
+   }
+}
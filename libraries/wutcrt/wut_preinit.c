@@ -1,4 +1,5 @@
 #include <coreinit/memdefaultheap.h>
+#include <wut_startup.h>
 
 void __init_wut_sbrk_heap(MEMHeapHandle heapHandle);
 void __init_wut_malloc_lock();
@@ -9,6 +10,7 @@ __preinit_user(MEMHeapHandle *mem1,
                MEMHeapHandle *foreground,
                MEMHeapHandle *mem2)
 {
+    WUTMarkStartup("__preinit_user");
     __init_wut_sbrk_heap(*mem2);
     __init_wut_malloc_lock();
     __init_wut_defaultheap();
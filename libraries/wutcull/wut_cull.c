@@ -0,0 +1,426 @@
+#include <wut_cull.h>
+#include <wut_job.h>
+#include <math.h>
+#include <string.h>
+
+//! Objects whose distances are computed in one go, kept on the stack
+#define CULL_BLOCK_SIZE   256
+
+//! Chunks of a parallel batch, each culled by one job
+#define CULL_MAX_CHUNKS   64
+
+/*
+ * The kernels compute the smallest signed distance of each object to the
+ * six planes, grown by its radius, which is negative for the objects that
+ * are entirely outside one of them. Indices are then gathered in C.
+ */
+typedef void (*CullDistanceFn)(const WUTFrustum *frustum,
+                               const void *bounds,
+                               uint32_t first,
+                               uint32_t count,
+                               float *distance);
+
+typedef struct CullBatch
+{
+   const WUTFrustum *frustum;
+   const void *bounds;
+   CullDistanceFn distanceFn;
+   uint32_t count;
+   uint32_t chunkSize;
+   uint32_t *visible;
+   uint32_t chunkVisible[CULL_MAX_CHUNKS];
+} CullBatch;
+
+#ifdef ESPRESSO
+#define PS_CULL_CLOBBER \
+   "fr0", "fr1", "fr2", "fr3", "fr4", "fr5", "fr6", "fr7", \
+   "fr8", "fr9", "fr10", "fr11", "fr12", "fr13", "fr14", "fr15", \
+   "fr16", "fr17", "fr18", "fr19", "fr20", "fr21", "fr22", "fr23"
+
+//! Plane k in 2k = {x, y} and 2k + 1 = {z, w}
+#define PS_CULL_LOAD_PLANES \
+   "psq_l 0, 0(%[planes]), 0, 0\n" \
+   "psq_l 1, 8(%[planes]), 0, 0\n" \
+   "psq_l 2, 16(%[planes]), 0, 0\n" \
+   "psq_l 3, 24(%[planes]), 0, 0\n" \
+   "psq_l 4, 32(%[planes]), 0, 0\n" \
+   "psq_l 5, 40(%[planes]), 0, 0\n" \
+   "psq_l 6, 48(%[planes]), 0, 0\n" \
+   "psq_l 7, 56(%[planes]), 0, 0\n" \
+   "psq_l 8, 64(%[planes]), 0, 0\n" \
+   "psq_l 9, 72(%[planes]), 0, 0\n" \
+   "psq_l 10, 80(%[planes]), 0, 0\n" \
+   "psq_l 11, 88(%[planes]), 0, 0\n" \
+   "psq_l 18, 0(%[one]), 0, 0\n"
+
+//! Distance of the centre pair in 12, 13, 14 to a plane, into 20
+#define PS_CULL_PLANE(xy, zw) \
+   "ps_muls0 20, 12, " #xy "\n" \
+   "ps_madds1 20, 13, " #xy ", 20\n" \
+   "ps_madds0 20, 14, " #zw ", 20\n" \
+   "ps_madds1 20, 18, " #zw ", 20\n"
+
+//! Plus the radius pair in 15
+#define PS_CULL_SPHERE_PLANE(xy, zw) \
+   PS_CULL_PLANE(xy, zw) \
+   "ps_add 20, 20, 15\n"
+
+//! Plus the extent pairs in 15, 16, 17 projected on the normal
+#define PS_CULL_BOX_PLANE(xy, zw) \
+   PS_CULL_PLANE(xy, zw) \
+   "ps_abs 22, " #xy "\n" \
+   "ps_abs 23, " #zw "\n" \
+   "ps_madds0 20, 15, 22, 20\n" \
+   "ps_madds1 20, 16, 22, 20\n" \
+   "ps_madds0 20, 17, 23, 20\n"
+
+//! 19 = min(19, 20)
+#define PS_CULL_MIN \
+   "ps_sub 21, 20, 19\n" \
+   "ps_sel 19, 21, 19, 20\n"
+
+static const float sCullOne[2] = { 1.0f, 1.0f };
+#endif
+
+static float
+CullSphereDistance(const WUTFrustum *frustum,
+                   const WUTCullSphereSoA *spheres,
+                   uint32_t i)
+{
+   float result = INFINITY;
+
+   for (int p = 0; p < 6; ++p) {
+      const WUTVec4 *plane = &frustum->planes[p];
+      float distance = plane->x * spheres->x[i] +
+                       plane->y * spheres->y[i] +
+                       plane->z * spheres->z[i] +
+                       plane->w + spheres->radius[i];
+      if (distance < result) {
+         result = distance;
+      }
+   }
+
+   return result;
+}
+
+static float
+CullBoxDistance(const WUTFrustum *frustum,
+                const WUTCullBoxSoA *boxes,
+                uint32_t i)
+{
+   float result = INFINITY;
+
+   for (int p = 0; p < 6; ++p) {
+      const WUTVec4 *plane = &frustum->planes[p];
+      float distance = plane->x * boxes->centerX[i] +
+                       plane->y * boxes->centerY[i] +
+                       plane->z * boxes->centerZ[i] +
+                       plane->w +
+                       fabsf(plane->x) * boxes->extentX[i] +
+                       fabsf(plane->y) * boxes->extentY[i] +
+                       fabsf(plane->z) * boxes->extentZ[i];
+      if (distance < result) {
+         result = distance;
+      }
+   }
+
+   return result;
+}
+
+static void
+CullSpheresDistanceScalar(const WUTFrustum *frustum,
+                          const void *bounds,
+                          uint32_t first,
+                          uint32_t count,
+                          float *distance)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      distance[i] = CullSphereDistance(frustum, bounds, first + i);
+   }
+}
+
+static void
+CullBoxesDistanceScalar(const WUTFrustum *frustum,
+                        const void *bounds,
+                        uint32_t first,
+                        uint32_t count,
+                        float *distance)
+{
+   for (uint32_t i = 0; i < count; ++i) {
+      distance[i] = CullBoxDistance(frustum, bounds, first + i);
+   }
+}
+
+static void
+CullSpheresDistance(const WUTFrustum *frustum,
+                    const void *bounds,
+                    uint32_t first,
+                    uint32_t count,
+                    float *distance)
+{
+#ifdef ESPRESSO
+   const WUTCullSphereSoA *spheres = bounds;
+   uint32_t pairs = count / 2;
+   uint32_t offset = 0;
+
+   if (pairs) {
+      // Two spheres per iteration, the planes stay in registers
+      __asm__ volatile (
+         PS_CULL_LOAD_PLANES
+         "mtctr %[pairs]\n"
+         "1:\n"
+         "psq_lx 12, %[x], %[offset], 0, 0\n"
+         "psq_lx 13, %[y], %[offset], 0, 0\n"
+         "psq_lx 14, %[z], %[offset], 0, 0\n"
+         "psq_lx 15, %[radius], %[offset], 0, 0\n"
+         PS_CULL_SPHERE_PLANE(0, 1)
+         "ps_mr 19, 20\n"
+         PS_CULL_SPHERE_PLANE(2, 3)
+         PS_CULL_MIN
+         PS_CULL_SPHERE_PLANE(4, 5)
+         PS_CULL_MIN
+         PS_CULL_SPHERE_PLANE(6, 7)
+         PS_CULL_MIN
+         PS_CULL_SPHERE_PLANE(8, 9)
+         PS_CULL_MIN
+         PS_CULL_SPHERE_PLANE(10, 11)
+         PS_CULL_MIN
+         "psq_stx 19, %[distance], %[offset], 0, 0\n"
+         "addi %[offset], %[offset], 8\n"
+         "bdnz 1b\n"
+         : [offset] "+r" (offset)
+         : [planes] "b" (frustum->planes), [one] "b" (sCullOne),
+           [x] "b" (spheres->x + first), [y] "b" (spheres->y + first),
+           [z] "b" (spheres->z + first), [radius] "b" (spheres->radius + first),
+           [distance] "b" (distance), [pairs] "r" (pairs)
+         : PS_CULL_CLOBBER, "ctr", "memory");
+   }
+
+   if (count & 1) {
+      distance[count - 1] = CullSphereDistance(frustum, spheres, first + count - 1);
+   }
+#else
+   CullSpheresDistanceScalar(frustum, bounds, first, count, distance);
+#endif
+}
+
+static void
+CullBoxesDistance(const WUTFrustum *frustum,
+                  const void *bounds,
+                  uint32_t first,
+                  uint32_t count,
+                  float *distance)
+{
+#ifdef ESPRESSO
+   const WUTCullBoxSoA *boxes = bounds;
+   uint32_t pairs = count / 2;
+   uint32_t offset = 0;
+
+   if (pairs) {
+      __asm__ volatile (
+         PS_CULL_LOAD_PLANES
+         "mtctr %[pairs]\n"
+         "1:\n"
+         "psq_lx 12, %[cx], %[offset], 0, 0\n"
+         "psq_lx 13, %[cy], %[offset], 0, 0\n"
+         "psq_lx 14, %[cz], %[offset], 0, 0\n"
+         "psq_lx 15, %[ex], %[offset], 0, 0\n"
+         "psq_lx 16, %[ey], %[offset], 0, 0\n"
+         "psq_lx 17, %[ez], %[offset], 0, 0\n"
+         PS_CULL_BOX_PLANE(0, 1)
+         "ps_mr 19, 20\n"
+         PS_CULL_BOX_PLANE(2, 3)
+         PS_CULL_MIN
+         PS_CULL_BOX_PLANE(4, 5)
+         PS_CULL_MIN
+         PS_CULL_BOX_PLANE(6, 7)
+         PS_CULL_MIN
+         PS_CULL_BOX_PLANE(8, 9)
+         PS_CULL_MIN
+         PS_CULL_BOX_PLANE(10, 11)
+         PS_CULL_MIN
+         "psq_stx 19, %[distance], %[offset], 0, 0\n"
+         "addi %[offset], %[offset], 8\n"
+         "bdnz 1b\n"
+         : [offset] "+r" (offset)
+         : [planes] "b" (frustum->planes), [one] "b" (sCullOne),
+           [cx] "b" (boxes->centerX + first), [cy] "b" (boxes->centerY + first),
+           [cz] "b" (boxes->centerZ + first), [ex] "b" (boxes->extentX + first),
+           [ey] "b" (boxes->extentY + first), [ez] "b" (boxes->extentZ + first),
+           [distance] "b" (distance), [pairs] "r" (pairs)
+         : PS_CULL_CLOBBER, "ctr", "memory");
+   }
+
+   if (count & 1) {
+      distance[count - 1] = CullBoxDistance(frustum, boxes, first + count - 1);
+   }
+#else
+   CullBoxesDistanceScalar(frustum, bounds, first, count, distance);
+#endif
+}
+
+//! Cull [first, end), writing the visible indices from visible on
+static uint32_t
+CullRange(const WUTFrustum *frustum,
+          const void *bounds,
+          CullDistanceFn distanceFn,
+          uint32_t first,
+          uint32_t end,
+          uint32_t *visible)
+{
+   float distance[CULL_BLOCK_SIZE];
+   uint32_t numVisible = 0;
+
+   for (uint32_t block = first; block < end; block += CULL_BLOCK_SIZE) {
+      uint32_t count = end - block < CULL_BLOCK_SIZE ? end - block : CULL_BLOCK_SIZE;
+
+      distanceFn(frustum, bounds, block, count, distance);
+      for (uint32_t i = 0; i < count; ++i) {
+         if (distance[i] >= 0.0f) {
+            visible[numVisible++] = block + i;
+         }
+      }
+   }
+
+   return numVisible;
+}
+
+static void
+CullChunks(uint32_t begin,
+           uint32_t end,
+           void *userData)
+{
+   CullBatch *batch = userData;
+
+   for (uint32_t chunk = begin; chunk < end; ++chunk) {
+      uint32_t first = chunk * batch->chunkSize;
+      uint32_t last = first + batch->chunkSize;
+      if (last > batch->count) {
+         last = batch->count;
+      }
+
+      // Each chunk writes into its own part of the output
+      batch->chunkVisible[chunk] = CullRange(batch->frustum, batch->bounds,
+                                             batch->distanceFn, first, last,
+                                             batch->visible + first);
+   }
+}
+
+static uint32_t
+CullParallel(const WUTFrustum *frustum,
+             const void *bounds,
+             CullDistanceFn distanceFn,
+             uint32_t count,
+             uint32_t *visible)
+{
+   CullBatch batch;
+   uint32_t numChunks, numVisible;
+
+   if (count < WUT_CULL_PARALLEL_THRESHOLD) {
+      return CullRange(frustum, bounds, distanceFn, 0, count, visible);
+   }
+
+   batch.frustum = frustum;
+   batch.bounds = bounds;
+   batch.distanceFn = distanceFn;
+   batch.count = count;
+   batch.visible = visible;
+   batch.chunkSize = (count + CULL_MAX_CHUNKS - 1) / CULL_MAX_CHUNKS;
+   if (batch.chunkSize < CULL_BLOCK_SIZE) {
+      batch.chunkSize = CULL_BLOCK_SIZE;
+   }
+
+   numChunks = (count + batch.chunkSize - 1) / batch.chunkSize;
+   WUTJobParallelFor(numChunks, 1, CullChunks, &batch);
+
+   // Close the gaps between the chunks, only moves the visible indices
+   numVisible = batch.chunkVisible[0];
+   for (uint32_t chunk = 1; chunk < numChunks; ++chunk) {
+      memmove(visible + numVisible,
+              visible + chunk * batch.chunkSize,
+              batch.chunkVisible[chunk] * sizeof(uint32_t));
+      numVisible += batch.chunkVisible[chunk];
+   }
+
+   return numVisible;
+}
+
+void
+WUTFrustumFromMtx44(const WUTMtx44 m,
+                    WUTFrustum *frustum)
+{
+   // Clip space -w <= x, y, z <= w is row 3 plus and minus rows 0 to 2
+   for (int p = 0; p < 6; ++p) {
+      int row = p / 2;
+      float sign = (p & 1) ? -1.0f : 1.0f;
+      WUTVec4 *plane = &frustum->planes[p];
+      float length;
+
+      plane->x = m[3][0] + sign * m[row][0];
+      plane->y = m[3][1] + sign * m[row][1];
+      plane->z = m[3][2] + sign * m[row][2];
+      plane->w = m[3][3] + sign * m[row][3];
+
+      length = sqrtf(plane->x * plane->x + plane->y * plane->y + plane->z * plane->z);
+      if (length > 0.0f) {
+         plane->x /= length;
+         plane->y /= length;
+         plane->z /= length;
+         plane->w /= length;
+      }
+   }
+}
+
+uint32_t
+WUTCullSpheres(const WUTFrustum *frustum,
+               const WUTCullSphereSoA *spheres,
+               uint32_t count,
+               uint32_t *visible)
+{
+   return CullRange(frustum, spheres, CullSpheresDistance, 0, count, visible);
+}
+
+uint32_t
+WUTCullSpheresScalar(const WUTFrustum *frustum,
+                     const WUTCullSphereSoA *spheres,
+                     uint32_t count,
+                     uint32_t *visible)
+{
+   return CullRange(frustum, spheres, CullSpheresDistanceScalar, 0, count, visible);
+}
+
+uint32_t
+WUTCullSpheresParallel(const WUTFrustum *frustum,
+                       const WUTCullSphereSoA *spheres,
+                       uint32_t count,
+                       uint32_t *visible)
+{
+   return CullParallel(frustum, spheres, CullSpheresDistance, count, visible);
+}
+
+uint32_t
+WUTCullBoxes(const WUTFrustum *frustum,
+             const WUTCullBoxSoA *boxes,
+             uint32_t count,
+             uint32_t *visible)
+{
+   return CullRange(frustum, boxes, CullBoxesDistance, 0, count, visible);
+}
+
+uint32_t
+WUTCullBoxesScalar(const WUTFrustum *frustum,
+                   const WUTCullBoxSoA *boxes,
+                   uint32_t count,
+                   uint32_t *visible)
+{
+   return CullRange(frustum, boxes, CullBoxesDistanceScalar, 0, count, visible);
+}
+
+uint32_t
+WUTCullBoxesParallel(const WUTFrustum *frustum,
+                     const WUTCullBoxSoA *boxes,
+                     uint32_t count,
+                     uint32_t *visible)
+{
+   return CullParallel(frustum, boxes, CullBoxesDistance, count, visible);
+}
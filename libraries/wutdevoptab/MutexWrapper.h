@@ -1,24 +1,43 @@
 #pragma once
 
-#include <coreinit/mutex.h>
+#include <coreinit/atomic.h>
+#include <coreinit/semaphore.h>
 #include "coreinit/cache.h"
+#include <coreinit/time.h>
+#include "../wutnewlib/wut_lock_stats.h"
 
+// Uncontended lock/unlock only do an atomic add, the semaphore is only touched
+// when another thread has to wait. Not recursive.
 class MutexWrapper {
 public:
     MutexWrapper() = default;
 
     void init(const char *name) {
-       OSInitMutexEx(&mutex, name);
+       count = 0;
+       OSInitSemaphoreEx(&semaphore, 0, name);
     }
 
     void lock() {
-       OSLockMutex(&mutex);
+       // OSAddAtomic returns the previous value
+       if (OSAddAtomic(&count, 1) > 0) {
+          if (!__wut_lock_stats_enabled) {
+             OSWaitSemaphore(&semaphore);
+             return;
+          }
+
+          OSTime start = OSGetSystemTime();
+          OSWaitSemaphore(&semaphore);
+          __wut_lock_stats_record(this, semaphore.name, OSGetSystemTime() - start);
+       }
     }
 
     void unlock() {
-       OSUnlockMutex(&mutex);
+       if (OSAddAtomic(&count, -1) > 1) {
+          OSSignalSemaphore(&semaphore);
+       }
     }
 
 private:
-    OSMutex mutex{};
+    volatile int32_t count = 0;
+    OSSemaphore semaphore{};
 };
@@ -34,6 +34,132 @@ static devoptab_t
 
 __wut_fsa_device_t __wut_fsa_device_data = {};
 
+// Can be overridden by the application to enable read-ahead for files opened with read access
+uint32_t __attribute__((weak)) __wut_fsa_read_ahead_size = 0;
+
+// Can be overridden by the application to enable write-behind for files opened with write access and without O_SYNC
+uint32_t __attribute__((weak)) __wut_fsa_write_behind_size = 0;
+
+// Can be overridden by the application to change the read-ahead of files hinted with posix_fadvise
+uint32_t __attribute__((weak)) __wut_fsa_read_ahead_sequential_size = 0x80000;
+uint32_t __attribute__((weak)) __wut_fsa_prefetch_size = 0x100000;
+
+// Can be overridden by the application to spread devoptab I/O over multiple FSA clients
+uint32_t __attribute__((weak)) __wut_fsa_client_pool_size = 1;
+
+// Can be overridden (or changed at runtime) by the application to preallocate space for newly created files
+uint32_t __attribute__((weak)) __wut_fsa_prealloc_size = 0;
+
+// Can be overridden by the application to cache stat results for __wut_fsa_stat_cache_ttl milliseconds,
+// entries read from a directory are cached as well
+uint32_t __attribute__((weak)) __wut_fsa_stat_cache_size = 0;
+uint32_t __attribute__((weak)) __wut_fsa_stat_cache_ttl = 1000;
+
+// Can be overridden (or changed at runtime) by the application to tune the size of a single FSA read/write request
+uint32_t __attribute__((weak)) __wut_fsa_read_chunk_size = 0x100000;
+uint32_t __attribute__((weak)) __wut_fsa_write_chunk_size = 0x40000;
+
+// Can be overridden by the application to change the size of stdio buffers for FILE streams on FSA devices
+uint32_t __attribute__((weak)) __wut_fsa_stdio_buffer_size = 0x8000;
+
+// Can be overridden by the application to keep read-only files open after close, for files that get reopened a lot
+uint32_t __attribute__((weak)) __wut_fsa_handle_cache_size = 0;
+
+static void
+__wut_fsa_init_device_data(__wut_fsa_device_t *deviceData,
+                           const char *name) {
+   *deviceData = {};
+   memcpy(&deviceData->device, &__wut_fsa_devoptab, sizeof(__wut_fsa_devoptab));
+   deviceData->device.deviceData = deviceData;
+   snprintf(deviceData->name, sizeof(deviceData->name), "%s", name);
+   deviceData->device.name = deviceData->name;
+   deviceData->setup = false;
+   deviceData->mounted = false;
+   deviceData->isSDCard = false;
+   deviceData->saveMutex.init("wut devoptab save");
+}
+
+static FSError
+__wut_fsa_add_clients(__wut_fsa_device_t *deviceData) {
+   deviceData->clientHandle = FSAAddClient(nullptr);
+   if (deviceData->clientHandle == 0) {
+      WUT_DEBUG_REPORT("FSAAddClient() failed");
+      return FS_ERROR_MAX_CLIENTS;
+   }
+
+   // The first pool entry is the main client which also does the mounting
+   deviceData->clientPool[0] = deviceData->clientHandle;
+   deviceData->clientPoolSize = 1;
+   uint32_t poolSize = MIN(MAX(__wut_fsa_client_pool_size, 1), FSA_CLIENT_POOL_MAX);
+   while (deviceData->clientPoolSize < poolSize) {
+      FSAClientHandle client = FSAAddClient(nullptr);
+      if (client == 0) {
+         // Keep going with the clients we already have
+         WUT_DEBUG_REPORT("FSAAddClient() for client pool failed");
+         break;
+      }
+      deviceData->clientPool[deviceData->clientPoolSize++] = client;
+   }
+
+   return FS_ERROR_OK;
+}
+
+static void
+__wut_fsa_del_clients(__wut_fsa_device_t *deviceData) {
+   for (uint32_t i = 1; i < deviceData->clientPoolSize; ++i) {
+      FSADelClient(deviceData->clientPool[i]);
+   }
+   FSADelClient(deviceData->clientHandle);
+   deviceData->clientHandle = 0;
+   deviceData->clientPoolSize = 0;
+}
+
+static void
+__wut_fsa_get_device_info(__wut_fsa_device_t *deviceData) {
+   FSError rc;
+   FSADeviceInfo deviceInfo;
+   if ((rc = FSAGetDeviceInfo(deviceData->clientHandle, deviceData->mountPath, &deviceInfo)) >= 0) {
+      deviceData->deviceSizeInSectors = deviceInfo.deviceSizeInSectors;
+      deviceData->deviceSectorSize = deviceInfo.deviceSectorSize;
+   } else {
+      deviceData->deviceSizeInSectors = 0xFFFFFFFF;
+      deviceData->deviceSectorSize = 512;
+      WUT_DEBUG_REPORT("Failed to get DeviceInfo for %s: %s\n", deviceData->mountPath, FSAGetStatusStr(rc));
+   }
+}
+
+static void
+__wut_fsa_remove_device(__wut_fsa_device_t *deviceData) {
+   // Cached handles would keep the device busy
+   __fini_wut_devoptab_handle_cache(deviceData);
+
+   if (deviceData->mounted) {
+      FSAUnmount(deviceData->clientHandle, deviceData->mountPath, FSA_UNMOUNT_FLAG_BIND_MOUNT);
+      deviceData->mounted = false;
+   }
+
+   __wut_fsa_del_clients(deviceData);
+
+   char deviceName[sizeof(deviceData->name) + 1];
+   snprintf(deviceName, sizeof(deviceName), "%s:", deviceData->name);
+   RemoveDevice(deviceName);
+
+   __fini_wut_devoptab_stat_cache(deviceData);
+   __wut_fsa_save_sums_clear(deviceData);
+   deviceData->setup = false;
+}
+
+__wut_fsa_device_t *
+__wut_fsa_find_device(const char *name) {
+   for (int i = 0; i < STD_MAX; ++i) {
+      const devoptab_t *devoptab = devoptab_list[i];
+      if (devoptab && devoptab->open_r == __wut_fsa_open && strcmp(devoptab->name, name) == 0) {
+         return (__wut_fsa_device_t *) devoptab->deviceData;
+      }
+   }
+   return nullptr;
+}
+
 FSError __init_wut_devoptab() {
    FSError rc;
 
@@ -41,22 +167,19 @@ FSError __init_wut_devoptab() {
       return FS_ERROR_OK;
    }
 
-   __wut_fsa_device_data = {};
-   memcpy(&__wut_fsa_device_data.device, &__wut_fsa_devoptab, sizeof(__wut_fsa_devoptab));
-   __wut_fsa_device_data.device.deviceData = &__wut_fsa_device_data;
-   snprintf(__wut_fsa_device_data.name, sizeof(__wut_fsa_device_data.name), "fs");
-   __wut_fsa_device_data.device.name = __wut_fsa_device_data.name;
-   __wut_fsa_device_data.setup = false;
-   __wut_fsa_device_data.mounted = false;
-   __wut_fsa_device_data.isSDCard = false;
+   __init_wut_devoptab_async();
+
+   __wut_fsa_init_device_data(&__wut_fsa_device_data, "fs");
 
    FSAInit();
-   __wut_fsa_device_data.clientHandle = FSAAddClient(nullptr);
-   if (__wut_fsa_device_data.clientHandle == 0) {
-      WUT_DEBUG_REPORT("FSAAddClient() failed");
-      return FS_ERROR_MAX_CLIENTS;
+   rc = __wut_fsa_add_clients(&__wut_fsa_device_data);
+   if (rc < 0) {
+      return rc;
    }
 
+   __init_wut_devoptab_stat_cache(&__wut_fsa_device_data);
+   __init_wut_devoptab_handle_cache(&__wut_fsa_device_data);
+
    int dev = AddDevice(&__wut_fsa_device_data.device);
 
    if (dev != -1) {
@@ -78,19 +201,11 @@ FSError __init_wut_devoptab() {
       __wut_fsa_device_data.cwd[1] = '\0';
       chdir("fs:/vol/external01");
 
-      FSADeviceInfo deviceInfo;
-      if ((rc = FSAGetDeviceInfo(__wut_fsa_device_data.clientHandle, __wut_fsa_device_data.mountPath, &deviceInfo)) >= 0) {
-         __wut_fsa_device_data.deviceSizeInSectors = deviceInfo.deviceSizeInSectors;
-         __wut_fsa_device_data.deviceSectorSize = deviceInfo.deviceSectorSize;
-      } else {
-         __wut_fsa_device_data.deviceSizeInSectors = 0xFFFFFFFF;
-         __wut_fsa_device_data.deviceSectorSize = 512;
-         WUT_DEBUG_REPORT("Failed to get DeviceInfo for %s: %s\n", __wut_fsa_device_data.mountPath, FSAGetStatusStr(rc));
-      }
-
+      __wut_fsa_get_device_info(&__wut_fsa_device_data);
    } else {
-      FSADelClient(__wut_fsa_device_data.clientHandle);
-      __wut_fsa_device_data.clientHandle = 0;
+      __wut_fsa_del_clients(&__wut_fsa_device_data);
+      __fini_wut_devoptab_stat_cache(&__wut_fsa_device_data);
+      __fini_wut_devoptab_handle_cache(&__wut_fsa_device_data);
       return FS_ERROR_MAX_CLIENTS;
    }
 
@@ -101,20 +216,113 @@ FSError
 __fini_wut_devoptab() {
    FSError rc = FS_ERROR_OK;
 
+   // Finish all queued async requests while the device is still around
+   __fini_wut_devoptab_async();
+
    if (!__wut_fsa_device_data.setup) {
       return rc;
    }
 
-   if (__wut_fsa_device_data.mounted) {
-      FSAUnmount(__wut_fsa_device_data.clientHandle, __wut_fsa_device_data.mountPath, FSA_UNMOUNT_FLAG_BIND_MOUNT);
-      __wut_fsa_device_data.mounted = false;
+   // Remove anything mounted with WUTDevoptabMount
+   for (int i = 0; i < STD_MAX; ++i) {
+      const devoptab_t *devoptab = devoptab_list[i];
+      if (devoptab && devoptab->open_r == __wut_fsa_open && devoptab->deviceData != &__wut_fsa_device_data) {
+         __wut_fsa_device_t *deviceData = (__wut_fsa_device_t *) devoptab->deviceData;
+         __wut_fsa_remove_device(deviceData);
+         free(deviceData);
+      }
    }
 
-   FSADelClient(__wut_fsa_device_data.clientHandle);
-
-   RemoveDevice(__wut_fsa_device_data.device.name);
-
+   __wut_fsa_remove_device(&__wut_fsa_device_data);
    __wut_fsa_device_data = {};
 
    return rc;
 }
+
+FSError
+WUTDevoptabMount(const char *name,
+                 const char *devicePath,
+                 const char *mountPath) {
+   FSError rc;
+   __wut_fsa_device_t *deviceData;
+
+   if (!__wut_fsa_device_data.setup) {
+      return FS_ERROR_NOT_INIT;
+   }
+
+   if (!name || !mountPath || name[0] == '\0' || strchr(name, ':') ||
+       strlen(name) >= sizeof(deviceData->name) || strlen(mountPath) >= sizeof(deviceData->mountPath)) {
+      return FS_ERROR_INVALID_PARAM;
+   }
+
+   if (__wut_fsa_find_device(name)) {
+      return FS_ERROR_ALREADY_EXISTS;
+   }
+
+   deviceData = static_cast<__wut_fsa_device_t *>(memalign(0x40, sizeof(__wut_fsa_device_t)));
+   if (!deviceData) {
+      WUT_DEBUG_REPORT("WUTDevoptabMount: failed to allocate memory for %s\n", name);
+      return FS_ERROR_OUT_OF_RESOURCES;
+   }
+
+   __wut_fsa_init_device_data(deviceData, name);
+   snprintf(deviceData->mountPath, sizeof(deviceData->mountPath), "%s", mountPath);
+   snprintf(deviceData->cwd, sizeof(deviceData->cwd), "%s", mountPath);
+
+   rc = __wut_fsa_add_clients(deviceData);
+   if (rc < 0) {
+      free(deviceData);
+      return rc;
+   }
+
+   if (devicePath) {
+      rc = FSAMount(deviceData->clientHandle, devicePath, deviceData->mountPath, (FSAMountFlags) 0, nullptr, 0);
+      if (rc < 0 && rc != FS_ERROR_ALREADY_EXISTS) {
+         WUT_DEBUG_REPORT("FSAMount(0x%08X, %s, %s, %08X, %08X, %08X) failed: %s\n",
+                          deviceData->clientHandle, devicePath, deviceData->mountPath, 0, nullptr, 0, FSAGetStatusStr(rc));
+         __wut_fsa_del_clients(deviceData);
+         free(deviceData);
+         return rc;
+      }
+      deviceData->mounted = true;
+   }
+
+   __init_wut_devoptab_stat_cache(deviceData);
+   __init_wut_devoptab_handle_cache(deviceData);
+
+   if (AddDevice(&deviceData->device) == -1) {
+      if (deviceData->mounted) {
+         FSAUnmount(deviceData->clientHandle, deviceData->mountPath, FSA_UNMOUNT_FLAG_BIND_MOUNT);
+      }
+      __wut_fsa_del_clients(deviceData);
+      __fini_wut_devoptab_stat_cache(deviceData);
+      __fini_wut_devoptab_handle_cache(deviceData);
+      free(deviceData);
+      return FS_ERROR_MAX_CLIENTS;
+   }
+
+   deviceData->setup = true;
+   __wut_fsa_get_device_info(deviceData);
+   return FS_ERROR_OK;
+}
+
+FSError
+WUTDevoptabUnmount(const char *name) {
+   if (!name) {
+      return FS_ERROR_INVALID_PARAM;
+   }
+
+   __wut_fsa_device_t *deviceData = __wut_fsa_find_device(name);
+   if (!deviceData) {
+      return FS_ERROR_NOT_FOUND;
+   }
+
+   // The default device is owned by the runtime
+   if (deviceData == &__wut_fsa_device_data) {
+      return FS_ERROR_INVALID_PARAM;
+   }
+
+   __wut_fsa_remove_device(deviceData);
+   free(deviceData);
+   return FS_ERROR_OK;
+}
@@ -1,8 +1,10 @@
 #pragma once
 
 #include <coreinit/filesystem_fsa.h>
+#include <coreinit/atomic.h>
 #include <coreinit/debug.h>
 #include <coreinit/mutex.h>
+#include <coreinit/time.h>
 
 #include <errno.h>
 #include <fcntl.h>
@@ -15,8 +17,88 @@
 #include <sys/param.h>
 #include <unistd.h>
 #include "MutexWrapper.h"
+#include <wut_devoptab.h>
+#include <wut_heap_budget.h>
+#include <wut_trace.h>
 #include "../wutnewlib/wut_clock.h"
 
+#define FSA_CLIENT_POOL_MAX 8
+#define FSA_HANDLE_CACHE_MAX 64
+
+/**
+ * Cached result of a FSAGetStat call
+ */
+typedef struct {
+    //! Set if the entry holds a result
+    bool valid;
+
+    //! Hash of path
+    uint32_t hash;
+
+    //! Result of FSAGetStat, either FS_ERROR_OK or FS_ERROR_NOT_FOUND
+    FSError status;
+
+    //! System time the entry was added at
+    OSTime time;
+
+    //! Valid if status is FS_ERROR_OK
+    FSAStat stat;
+
+    //! Normalized path, checked on lookup in case of hash collisions
+    char path[FS_MAX_PATH + 1];
+} __wut_fsa_stat_cache_entry_t;
+
+/**
+ * Read-only FSA file handle kept open after close
+ */
+typedef struct {
+    //! Set if the entry holds an open handle
+    bool valid;
+
+    //! Hash of path
+    uint32_t hash;
+
+    //! FSA client the handle belongs to
+    FSAClientHandle clientHandle;
+
+    //! The open handle
+    FSAFileHandle fd;
+
+    //! Flags the file was opened with, only reused for the same flags
+    FSOpenFileFlags openFlags;
+
+    //! Value of handleCacheClock when the file was closed, the lowest is evicted first
+    uint32_t lastUsed;
+
+    //! Normalized path
+    char path[FS_MAX_PATH + 1];
+} __wut_fsa_handle_cache_entry_t;
+
+/**
+ * Block checksums of a file written with WUTDevoptabWriteSaveFile
+ */
+typedef struct __wut_fsa_save_sums {
+    struct __wut_fsa_save_sums *next;
+
+    //! Checksums of the file as of the last commit, NULL if unknown
+    uint64_t *committed;
+
+    //! File size the committed checksums are for
+    uint32_t committedSize;
+
+    //! Checksums of the data written since the last commit, NULL if nothing was written
+    uint64_t *pending;
+
+    //! File size the pending checksums are for
+    uint32_t pendingSize;
+
+    //! Hash of path
+    uint32_t hash;
+
+    //! Normalized path
+    char path[FS_MAX_PATH + 1];
+} __wut_fsa_save_sums_t;
+
 typedef struct FSADeviceData {
     devoptab_t device;
     bool setup;
@@ -26,8 +108,26 @@ typedef struct FSADeviceData {
     char mountPath[0x80];
     char cwd[FS_MAX_PATH + 1];
     FSAClientHandle clientHandle;
+    FSAClientHandle clientPool[FSA_CLIENT_POOL_MAX];
+    uint32_t clientPoolSize;
+    volatile uint32_t clientPoolNext;
     uint64_t deviceSizeInSectors;
     uint32_t deviceSectorSize;
+    __wut_fsa_stat_cache_entry_t *statCache;
+    uint32_t statCacheSize;
+    //! Bumped by every invalidation, a stat that raced one isn't inserted
+    volatile uint32_t statCacheGeneration;
+    MutexWrapper statCacheMutex;
+    __wut_fsa_handle_cache_entry_t *handleCache;
+    uint32_t handleCacheSize;
+    uint32_t handleCacheClock;
+    MutexWrapper handleCacheMutex;
+    WUTDevoptabStats stats;
+    MutexWrapper saveMutex;
+    //! Quota path of the save opened with WUTDevoptabBeginSave, empty if none is open
+    char savePath[FS_MAX_PATH + 1];
+    //! Files written with WUTDevoptabWriteSaveFile, guarded by saveMutex
+    __wut_fsa_save_sums_t *saveSums;
 } __wut_fsa_device_t;
 
 /**
@@ -37,10 +137,19 @@ typedef struct {
     //! FSA file handle
     FSAFileHandle fd;
 
+    //! FSA client the file was opened with
+    FSAClientHandle clientHandle;
+
     //! Flags used in open(2)
     int flags;
 
+    //! Flags passed to FSAOpenFileEx
+    FSOpenFileFlags openFlags;
+
     //! Current file offset
+    //! FSA file positions and sizes are 32-bit all the way down to the IPC
+    //! requests (FSAFilePosition, FSAStat::size), so files are limited to
+    //! 4 GiB - 1 no matter what the underlying file system supports.
     uint32_t offset;
 
     //! Current file path
@@ -51,6 +160,42 @@ typedef struct {
 
     //! Current file size (only valid if O_APPEND is set)
     uint32_t appendOffset;
+
+    //! Read-ahead buffer, NULL if read-ahead is disabled for this file
+    uint8_t *readAheadBuffer;
+
+    //! Size of readAheadBuffer
+    uint32_t readAheadSize;
+
+    //! Number of valid bytes in readAheadBuffer
+    uint32_t readAheadLength;
+
+    //! Position of the next unread byte in readAheadBuffer
+    uint32_t readAheadPos;
+
+    //! Set after a read was served from prefetchBuffer, the FSA file position is behind file->offset
+    bool positionStale;
+
+    //! Buffer posix_fadvise(POSIX_FADV_WILLNEED) prefetches into, NULL if nothing was prefetched
+    uint8_t *prefetchBuffer;
+
+    //! Size of prefetchBuffer
+    uint32_t prefetchSize;
+
+    //! Read of prefetchBuffer on the async I/O thread, its data can be used once it is done
+    WUTDevoptabAsyncRequest prefetchRequest;
+
+    //! Set by writes to the file, the prefetched data is stale
+    bool prefetchInvalid;
+
+    //! Write-behind buffer, NULL if write-behind is disabled for this file
+    uint8_t *writeBehindBuffer;
+
+    //! Size of writeBehindBuffer
+    uint32_t writeBehindSize;
+
+    //! Number of bytes in writeBehindBuffer not yet written to the FSA
+    uint32_t writeBehindLength;
 } __wut_fsa_file_t;
 
 /**
@@ -63,34 +208,132 @@ typedef struct {
     //! FS directory handle
     FSADirectoryHandle fd;
 
+    //! FSA client the directory was opened with
+    FSAClientHandle clientHandle;
+
     //! Temporary storage for reading entries
     FSADirectoryEntry entry_data;
 
     //! Current directory path
     char fullPath[FS_MAX_PATH + 1];
 
+    //! Hash of fullPath with a trailing '/', entry inode numbers continue from it
+    uint32_t pathHash;
+
     //! Guard dir access
     MutexWrapper mutex;
 } __wut_fsa_dir_t;
 
 #define FSA_DIRITER_MAGIC 0x77696975
 
+// Same value as newlib's _FDIRECT, in case O_DIRECT isn't exposed by fcntl.h
+#ifndef O_DIRECT
+#define O_DIRECT 0x80000
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Size of the per-file read-ahead buffer, 0 disables read-ahead
+extern uint32_t __wut_fsa_read_ahead_size;
+
+// Size of the per-file write-behind buffer, 0 disables write-behind
+extern uint32_t __wut_fsa_write_behind_size;
+
+// Size of the read-ahead buffer of a file after posix_fadvise(POSIX_FADV_SEQUENTIAL)
+extern uint32_t __wut_fsa_read_ahead_sequential_size;
+
+// Largest range a single posix_fadvise(POSIX_FADV_WILLNEED) prefetches, 0 disables prefetching
+extern uint32_t __wut_fsa_prefetch_size;
+
+// Number of FSA clients used by the devoptab, at most FSA_CLIENT_POOL_MAX
+extern uint32_t __wut_fsa_client_pool_size;
+
+// Space preallocated for files created by open, 0 disables preallocation
+extern uint32_t __wut_fsa_prealloc_size;
+
+// Set by WUTDevoptabSetStatsEnabled
+extern volatile uint32_t __wut_fsa_stats_enabled;
+
+// Number of stat results cached per device, 0 disables the cache
+extern uint32_t __wut_fsa_stat_cache_size;
+
+// Time in milliseconds a cached stat result stays valid
+extern uint32_t __wut_fsa_stat_cache_ttl;
+
+// Maximum size of a single FSAReadFile/FSAWriteFile request, 0 removes the limit
+extern uint32_t __wut_fsa_read_chunk_size;
+extern uint32_t __wut_fsa_write_chunk_size;
+
+// Number of read-only handles kept open per device after close, at most FSA_HANDLE_CACHE_MAX
+extern uint32_t __wut_fsa_handle_cache_size;
+
+// Preferred I/O size reported for regular files, 0 reports 512 like before
+extern uint32_t __wut_fsa_stdio_buffer_size;
+
 FSError
 __init_wut_devoptab();
 
 FSError
 __fini_wut_devoptab();
 
+// devoptab_fsa_statcache.cpp
+void __init_wut_devoptab_stat_cache(__wut_fsa_device_t *deviceData);
+void __fini_wut_devoptab_stat_cache(__wut_fsa_device_t *deviceData);
+bool __wut_fsa_stat_cache_lookup(__wut_fsa_device_t *deviceData, const char *path, uint32_t hash,
+                                 FSError *status, FSAStat *stat);
+// Taken before the FSA call whose result is inserted, see __wut_fsa_stat_cache_insert
+static inline uint32_t __wut_fsa_stat_cache_generation(__wut_fsa_device_t *deviceData) {
+   return deviceData->statCacheGeneration;
+}
+// Does nothing if the cache was invalidated since generation was taken
+void __wut_fsa_stat_cache_insert(__wut_fsa_device_t *deviceData, const char *path, uint32_t hash,
+                                 uint32_t generation, FSError status, const FSAStat *stat);
+void __wut_fsa_stat_cache_invalidate(__wut_fsa_device_t *deviceData, const char *path);
+void __wut_fsa_stat_cache_clear(__wut_fsa_device_t *deviceData);
+
+// devoptab_fsa_handlecache.cpp
+void __init_wut_devoptab_handle_cache(__wut_fsa_device_t *deviceData);
+void __fini_wut_devoptab_handle_cache(__wut_fsa_device_t *deviceData);
+// Removes a handle for path from the cache and rewinds it, false if there is none
+bool __wut_fsa_handle_cache_take(__wut_fsa_device_t *deviceData, const char *path, FSOpenFileFlags openFlags,
+                                 FSAClientHandle *outClientHandle, FSAFileHandle *outFd);
+// Keeps a read-only handle open instead of closing it, false if the cache is disabled
+bool __wut_fsa_handle_cache_put(__wut_fsa_device_t *deviceData, const char *path, FSAClientHandle clientHandle,
+                                FSAFileHandle fd, FSOpenFileFlags openFlags);
+void __wut_fsa_handle_cache_invalidate(__wut_fsa_device_t *deviceData, const char *path);
+void __wut_fsa_handle_cache_clear(__wut_fsa_device_t *deviceData);
+
+// devoptab_fsa.cpp
+__wut_fsa_device_t *__wut_fsa_find_device(const char *name);
+
+// devoptab_fsa_save.cpp
+// Whether fullPath is inside the save open on the device
+bool __wut_fsa_save_contains(__wut_fsa_device_t *deviceData, const char *fullPath);
+// Forgets the block checksums of path, for when it is written or removed through other means
+void __wut_fsa_save_sums_invalidate(__wut_fsa_device_t *deviceData, const char *fullPath);
+void __wut_fsa_save_sums_clear(__wut_fsa_device_t *deviceData);
+
+// devoptab_fsa_stats.cpp
+void __wut_fsa_stats_record_op(__wut_fsa_device_t *deviceData, WUTDevoptabOp op, OSTime duration);
+void __wut_fsa_stats_add_read(__wut_fsa_device_t *deviceData, ssize_t bytes, bool bounced);
+void __wut_fsa_stats_add_write(__wut_fsa_device_t *deviceData, ssize_t bytes, bool bounced);
+
+// devoptab_fsa_async.cpp
+void __init_wut_devoptab_async();
+void __fini_wut_devoptab_async();
+
 int __wut_fsa_open(struct _reent *r, void *fileStruct, const char *path,
                    int flags, int mode);
 int __wut_fsa_close(struct _reent *r, void *fd);
 ssize_t __wut_fsa_write(struct _reent *r, void *fd, const char *ptr,
                         size_t len);
 ssize_t __wut_fsa_read(struct _reent *r, void *fd, char *ptr, size_t len);
+ssize_t __wut_fsa_pwrite(struct _reent *r, void *fd, const char *ptr, size_t len,
+                         off_t pos);
+ssize_t __wut_fsa_pread(struct _reent *r, void *fd, char *ptr, size_t len,
+                        off_t pos);
 off_t __wut_fsa_seek(struct _reent *r, void *fd, off_t pos, int dir);
 int __wut_fsa_fstat(struct _reent *r, void *fd, struct stat *st);
 int __wut_fsa_stat(struct _reent *r, const char *file, struct stat *st);
@@ -111,17 +354,42 @@ int __wut_fsa_statvfs(struct _reent *r, const char *path,
                       struct statvfs *buf);
 int __wut_fsa_ftruncate(struct _reent *r, void *fd, off_t len);
 int __wut_fsa_fsync(struct _reent *r, void *fd);
+int __wut_fsa_fallocate(struct _reent *r, void *fd, off_t offset, off_t len);
+int __wut_fsa_fadvise(struct _reent *r, void *fd, int handle, off_t offset, off_t len, int advice);
+// Waits for a prefetch in flight and frees prefetchBuffer, file->mutex must not be held
+void __wut_fsa_free_prefetch(__wut_fsa_file_t *file);
 int __wut_fsa_chmod(struct _reent *r, const char *path, mode_t mode);
 int __wut_fsa_fchmod(struct _reent *r, void *fd, mode_t mode);
 int __wut_fsa_rmdir(struct _reent *r, const char *name);
 int __wut_fsa_utimes(struct _reent *r, const char *filename, const struct timeval times[2]);
 
 // devoptab_fsa_utils.c
-char *__wut_fsa_fixpath(struct _reent *r, const char *path);
+// Writes the absolute, normalized path to out, which must hold FS_MAX_PATH + 1 bytes
+char *__wut_fsa_fixpath(struct _reent *r, const char *path, char *out);
 int __wut_fsa_translate_error(FSError error);
 mode_t __wut_fsa_translate_stat_mode(FSStat *fsStat);
 void __wut_fsa_translate_stat(FSAClientHandle handle, FSStat *fsStat, ino_t ino, struct stat *posStat);
 uint32_t __wut_fsa_hashstring(const char *str);
+// Continues a __wut_fsa_hashstring hash, so hashing a prefix once and appending gives the same result
+uint32_t __wut_fsa_hashstring_append(uint32_t h, const char *str);
+// Drops buffered data and moves the FSA file position back to file->offset
+FSError __wut_fsa_discard_read_ahead(__wut_fsa_device_t *deviceData, __wut_fsa_file_t *file);
+// Stops serving prefetched data, which is stale after a write or truncate
+void __wut_fsa_invalidate_prefetch(__wut_fsa_file_t *file);
+// Moves the FSA file position to file->offset after reads were served from prefetchBuffer
+FSError __wut_fsa_sync_position(__wut_fsa_file_t *file);
+// Number of prefetched bytes at offset and where they are, 0 if nothing there was prefetched
+uint32_t __wut_fsa_prefetch_available(__wut_fsa_file_t *file, uint32_t offset, const uint8_t **outData);
+FSError __wut_fsa_flush_write_behind(__wut_fsa_device_t *deviceData, __wut_fsa_file_t *file);
+
+static inline FSAClientHandle __wut_fsa_get_client(__wut_fsa_device_t *deviceData) {
+   // Hand out the pooled clients round-robin, handles returned by the FSA stay bound to the client they came from
+   if (deviceData->clientPoolSize <= 1) {
+      return deviceData->clientHandle;
+   }
+   uint32_t next = OSAddAtomic((volatile int32_t *) &deviceData->clientPoolNext, 1);
+   return deviceData->clientPool[next % deviceData->clientPoolSize];
+}
 
 static inline FSMode __wut_fsa_translate_permission_mode(mode_t mode) {
    // Convert normal Unix octal permission bits into CafeOS hexadecimal permission bits
@@ -134,4 +402,75 @@ static inline time_t __wut_fsa_translate_time(FSTime timeValue) {
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
+
+static inline const char *__wut_fsa_op_name(WUTDevoptabOp op) {
+   static const char *const names[WUT_DEVOPTAB_OP_COUNT] = {
+      "fs open", "fs close", "fs read", "fs write", "fs pread", "fs pwrite",
+      "fs seek", "fs fstat", "fs stat", "fs unlink", "fs chdir", "fs rename",
+      "fs mkdir", "fs diropen", "fs dirreset", "fs dirnext", "fs dirclose",
+      "fs statvfs", "fs ftruncate", "fs fsync", "fs chmod", "fs rmdir",
+   };
+   return names[op];
+}
+
+// Counts a handler call and records its latency when going out of scope,
+// and reports it to __wut_trace_span if that is defined
+class __wut_fsa_op_timer {
+public:
+    __wut_fsa_op_timer(struct _reent *r, WUTDevoptabOp op) :
+       deviceData(__wut_fsa_stats_enabled ? (__wut_fsa_device_t *) r->deviceData : nullptr),
+       op(op),
+       tracing(__wut_trace_span != nullptr),
+       start((deviceData || tracing) ? OSGetSystemTime() : 0) {
+    }
+
+    ~__wut_fsa_op_timer() {
+       if (!deviceData && !tracing) {
+          return;
+       }
+
+       OSTime end = OSGetSystemTime();
+       if (deviceData) {
+          __wut_fsa_stats_record_op(deviceData, op, end - start);
+       }
+
+       if (tracing) {
+          WUTTraceSpan span;
+          span.name  = __wut_fsa_op_name(op);
+          span.path  = path;
+          span.fd    = fd;
+          span.bytes = bytes;
+          span.start = start;
+          span.end   = end;
+          __wut_trace_span(&span);
+       }
+    }
+
+    void setPath(const char *path) {
+       this->path = path;
+    }
+
+    void setFile(void *fileStruct) {
+       if (fileStruct) {
+          path = ((__wut_fsa_file_t *) fileStruct)->fullPath;
+          fd   = (int) ((__wut_fsa_file_t *) fileStruct)->fd;
+       }
+    }
+
+    // Records the bytes transferred, for return timer.result(bytes);
+    template<typename T>
+    T result(T value) {
+       bytes = (int64_t) value;
+       return value;
+    }
+
+private:
+    __wut_fsa_device_t *deviceData;
+    WUTDevoptabOp op;
+    bool tracing;
+    OSTime start;
+    const char *path = nullptr;
+    int fd           = -1;
+    int64_t bytes    = 0;
+};
@@ -0,0 +1,238 @@
+#include "devoptab_fsa.h"
+#include <coreinit/condition.h>
+#include <coreinit/event.h>
+#include <coreinit/thread.h>
+
+#define WUT_DEVOPTAB_ASYNC_STACK_SIZE (32 * 1024)
+
+static OSThread sAsyncThread;
+static __attribute__((aligned(16))) uint8_t sAsyncThreadStack[WUT_DEVOPTAB_ASYNC_STACK_SIZE];
+
+//! A thread in WUTDevoptabWaitAsync, woken through its event on every completion
+struct __wut_fsa_async_waiter_t {
+   OSEvent event;
+   __wut_fsa_async_waiter_t *next;
+};
+
+//! Guards the request queue, the waiter list and the done flag of every request
+static OSMutex sAsyncMutex;
+static OSCondition sAsyncWorkCond;
+static __wut_fsa_async_waiter_t *sAsyncWaiters = nullptr;
+
+static WUTDevoptabAsyncRequest *sAsyncHead = nullptr;
+static WUTDevoptabAsyncRequest *sAsyncTail = nullptr;
+static bool sAsyncStarted = false;
+static bool sAsyncStop = false;
+
+static int
+__wut_fsa_async_thread_entry(int argc,
+                             const char **argv) {
+   while (true) {
+      OSLockMutex(&sAsyncMutex);
+      while (!sAsyncHead && !sAsyncStop) {
+         OSWaitCond(&sAsyncWorkCond, &sAsyncMutex);
+      }
+
+      // Drain the queue before stopping
+      WUTDevoptabAsyncRequest *request = sAsyncHead;
+      if (!request) {
+         OSUnlockMutex(&sAsyncMutex);
+         break;
+      }
+
+      sAsyncHead = request->next;
+      if (!sAsyncHead) {
+         sAsyncTail = nullptr;
+      }
+      OSUnlockMutex(&sAsyncMutex);
+
+      ssize_t rc;
+      if (request->write) {
+         rc = pwrite(request->fd, request->buffer, request->size, request->offset);
+      } else {
+         rc = pread(request->fd, request->buffer, request->size, request->offset);
+      }
+
+      // The request may be reused as soon as it is marked as done
+      WUTDevoptabAsyncCallbackFn callback = request->callback;
+      void *userContext = request->userContext;
+      OSMessageQueue *queue = request->queue;
+
+      OSLockMutex(&sAsyncMutex);
+      request->error = (rc < 0) ? errno : 0;
+      request->result = rc;
+      request->done = TRUE;
+      for (auto *waiter = sAsyncWaiters; waiter; waiter = waiter->next) {
+         OSSignalEvent(&waiter->event);
+      }
+      OSUnlockMutex(&sAsyncMutex);
+
+      if (callback) {
+         callback(request, userContext);
+      }
+
+      if (queue) {
+         OSMessage message = {};
+         message.message = request;
+         OSSendMessage(queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+      }
+   }
+
+   return 0;
+}
+
+static bool
+__wut_fsa_async_start() {
+   if (sAsyncStarted) {
+      return true;
+   }
+
+   sAsyncStop = false;
+   if (!OSCreateThread(&sAsyncThread,
+                       __wut_fsa_async_thread_entry,
+                       0,
+                       nullptr,
+                       sAsyncThreadStack + sizeof(sAsyncThreadStack),
+                       sizeof(sAsyncThreadStack),
+                       15,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      WUT_DEBUG_REPORT("__wut_fsa_async_start: OSCreateThread failed\n");
+      return false;
+   }
+
+   OSSetThreadName(&sAsyncThread, "wut devoptab async I/O");
+   OSResumeThread(&sAsyncThread);
+   sAsyncStarted = true;
+   return true;
+}
+
+static BOOL
+__wut_fsa_async_submit(WUTDevoptabAsyncRequest *request,
+                       BOOL write) {
+   if (!request || !request->buffer) {
+      return FALSE;
+   }
+
+   request->write = write;
+   request->result = -1;
+   request->error = 0;
+   request->done = FALSE;
+   request->next = nullptr;
+
+   OSLockMutex(&sAsyncMutex);
+   if (!__wut_fsa_async_start()) {
+      OSUnlockMutex(&sAsyncMutex);
+      return FALSE;
+   }
+
+   if (sAsyncTail) {
+      sAsyncTail->next = request;
+   } else {
+      sAsyncHead = request;
+   }
+   sAsyncTail = request;
+
+   OSSignalCond(&sAsyncWorkCond);
+   OSUnlockMutex(&sAsyncMutex);
+   return TRUE;
+}
+
+BOOL
+WUTDevoptabReadAsync(WUTDevoptabAsyncRequest *request) {
+   return __wut_fsa_async_submit(request, FALSE);
+}
+
+BOOL
+WUTDevoptabWriteAsync(WUTDevoptabAsyncRequest *request) {
+   return __wut_fsa_async_submit(request, TRUE);
+}
+
+BOOL
+WUTDevoptabIsAsyncDone(WUTDevoptabAsyncRequest *request) {
+   return request->done;
+}
+
+uint32_t
+WUTDevoptabWaitAsync(WUTDevoptabAsyncRequest **requests,
+                     uint32_t count,
+                     BOOL waitAll,
+                     OSTime timeout) {
+   // The event stays signalled if a request completes between checking the
+   // requests and waiting, so no completion is missed
+   __wut_fsa_async_waiter_t waiter;
+   OSInitEvent(&waiter.event, FALSE, OS_EVENT_MODE_AUTO);
+
+   OSTime deadline = (timeout >= 0) ? OSGetSystemTime() + timeout : 0;
+   uint32_t done;
+
+   OSLockMutex(&sAsyncMutex);
+   waiter.next = sAsyncWaiters;
+   sAsyncWaiters = &waiter;
+
+   while (true) {
+      uint32_t total = 0;
+      done = 0;
+      for (uint32_t i = 0; i < count; ++i) {
+         if (!requests[i]) {
+            continue;
+         }
+
+         ++total;
+         if (requests[i]->done) {
+            ++done;
+         }
+      }
+
+      if ((waitAll ? done == total : done > 0) || total == 0) {
+         break;
+      }
+
+      OSUnlockMutex(&sAsyncMutex);
+      if (timeout < 0) {
+         OSWaitEvent(&waiter.event);
+      } else {
+         OSTime remaining = deadline - OSGetSystemTime();
+         if (remaining <= 0 ||
+             !OSWaitEventWithTimeout(&waiter.event, OSTicksToNanoseconds(remaining))) {
+            OSLockMutex(&sAsyncMutex);
+            break;
+         }
+      }
+      OSLockMutex(&sAsyncMutex);
+   }
+
+   for (auto **link = &sAsyncWaiters; *link; link = &(*link)->next) {
+      if (*link == &waiter) {
+         *link = waiter.next;
+         break;
+      }
+   }
+   OSUnlockMutex(&sAsyncMutex);
+
+   return done;
+}
+
+void
+__init_wut_devoptab_async() {
+   OSInitMutexEx(&sAsyncMutex, "wut devoptab async");
+   OSInitCond(&sAsyncWorkCond);
+   sAsyncWaiters = nullptr;
+   sAsyncHead = nullptr;
+   sAsyncTail = nullptr;
+}
+
+void
+__fini_wut_devoptab_async() {
+   OSLockMutex(&sAsyncMutex);
+   if (!sAsyncStarted) {
+      OSUnlockMutex(&sAsyncMutex);
+      return;
+   }
+
+   sAsyncStop = true;
+   OSSignalCond(&sAsyncWorkCond);
+   OSUnlockMutex(&sAsyncMutex);
+
+   OSJoinThread(&sAsyncThread, nullptr);
+   sAsyncStarted = false;
+}
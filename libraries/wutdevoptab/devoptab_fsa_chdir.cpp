@@ -4,6 +4,8 @@
 int
 __wut_fsa_chdir(struct _reent *r,
                 const char *path) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_CHDIR);
+   timer.setPath(path);
    FSError status;
    __wut_fsa_device_t *deviceData;
 
@@ -12,9 +14,8 @@ __wut_fsa_chdir(struct _reent *r,
       return -1;
    }
 
-   char *fixedPath = __wut_fsa_fixpath(r, path);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   char fixedPath[FS_MAX_PATH + 1];
+   if (!__wut_fsa_fixpath(r, path, fixedPath)) {
       return -1;
    }
    deviceData = (__wut_fsa_device_t *) r->deviceData;
@@ -22,7 +23,6 @@ __wut_fsa_chdir(struct _reent *r,
    status = FSAChangeDir(deviceData->clientHandle, fixedPath);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSAChangeDir(0x%08X, %s) failed: %s\n", deviceData->clientHandle, fixedPath, FSAGetStatusStr(status));
-      free(fixedPath);
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
@@ -38,7 +38,5 @@ __wut_fsa_chdir(struct _reent *r,
       WUT_DEBUG_REPORT("__wut_fsa_chdir: snprintf result was truncated\n");
    }
 
-   free(fixedPath);
-
    return 0;
 }
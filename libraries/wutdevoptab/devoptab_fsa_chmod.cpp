@@ -6,6 +6,8 @@ int
 __wut_fsa_chmod(struct _reent *r,
                 const char *path,
                 mode_t mode) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_CHMOD);
+   timer.setPath(path);
    FSError status;
    __wut_fsa_device_t *deviceData;
 
@@ -14,25 +16,24 @@ __wut_fsa_chmod(struct _reent *r,
       return -1;
    }
 
-   char *fixedPath = __wut_fsa_fixpath(r, path);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   char fixedPath[FS_MAX_PATH + 1];
+   if (!__wut_fsa_fixpath(r, path, fixedPath)) {
       return -1;
    }
 
    FSMode translatedMode = __wut_fsa_translate_permission_mode(mode);
 
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
 
-   status = FSAChangeMode(deviceData->clientHandle, fixedPath, translatedMode);
+   status = FSAChangeMode(clientHandle, fixedPath, translatedMode);
+   __wut_fsa_stat_cache_invalidate(deviceData, fixedPath);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSAChangeMode(0x%08X, %s, 0x%X) failed: %s\n",
-                       deviceData->clientHandle, fixedPath, translatedMode, FSAGetStatusStr(status));
-      free(fixedPath);
+                       clientHandle, fixedPath, translatedMode, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
-   free(fixedPath);
 
    return 0;
 }
@@ -4,6 +4,8 @@
 int
 __wut_fsa_close(struct _reent *r,
                 void *fd) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_CLOSE);
+   timer.setFile(fd);
    FSError status;
    __wut_fsa_file_t *file;
    __wut_fsa_device_t *deviceData;
@@ -17,15 +19,37 @@ __wut_fsa_close(struct _reent *r,
 
    deviceData = (__wut_fsa_device_t *) r->deviceData;
 
+   // The prefetch reads through the file, let it finish before the handle goes away
+   __wut_fsa_free_prefetch(file);
+
    std::scoped_lock lock(file->mutex);
 
-   status = FSACloseFile(deviceData->clientHandle, file->fd);
+   // The file is closed even if the pending writes can't be flushed
+   FSError flushStatus = __wut_fsa_flush_write_behind(deviceData, file);
+
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, file->readAheadBuffer);
+   file->readAheadBuffer = nullptr;
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, file->writeBehindBuffer);
+   file->writeBehindBuffer = nullptr;
+
+   // Read-only handles can be kept open for the next open of the same path
+   if ((file->flags & O_ACCMODE) == O_RDONLY &&
+       __wut_fsa_handle_cache_put(deviceData, file->fullPath, file->clientHandle, file->fd, file->openFlags)) {
+      return 0;
+   }
+
+   status = FSACloseFile(file->clientHandle, file->fd);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s\n",
-                       deviceData->clientHandle, file->fd, file->fullPath, FSAGetStatusStr(status));
+                       file->clientHandle, file->fd, file->fullPath, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
 
+   if (flushStatus < 0) {
+      r->_errno = __wut_fsa_translate_error(flushStatus);
+      return -1;
+   }
+
    return 0;
 }
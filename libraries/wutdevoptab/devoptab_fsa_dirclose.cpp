@@ -4,9 +4,9 @@
 int
 __wut_fsa_dirclose(struct _reent *r,
                    DIR_ITER *dirState) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_DIRCLOSE);
    FSError status;
    __wut_fsa_dir_t *dir;
-   __wut_fsa_device_t *deviceData;
 
    if (!dirState) {
       r->_errno = EINVAL;
@@ -15,14 +15,12 @@ __wut_fsa_dirclose(struct _reent *r,
 
    dir = (__wut_fsa_dir_t *) (dirState->dirStruct);
 
-   deviceData = (__wut_fsa_device_t *) r->deviceData;
-
    std::scoped_lock lock(dir->mutex);
 
-   status = FSACloseDir(deviceData->clientHandle, dir->fd);
+   status = FSACloseDir(dir->clientHandle, dir->fd);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSACloseDir(0x%08X, 0x%08X) (%s) failed: %s\n",
-                       deviceData->clientHandle, dir->fd, dir->fullPath, FSAGetStatusStr(status));
+                       dir->clientHandle, dir->fd, dir->fullPath, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
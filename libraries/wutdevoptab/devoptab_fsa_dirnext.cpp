@@ -7,6 +7,7 @@ __wut_fsa_dirnext(struct _reent *r,
                   DIR_ITER *dirState,
                   char *filename,
                   struct stat *filestat) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_DIRNEXT);
    FSError status;
    __wut_fsa_dir_t *dir;
    __wut_fsa_device_t *deviceData;
@@ -22,30 +23,30 @@ __wut_fsa_dirnext(struct _reent *r,
    std::scoped_lock lock(dir->mutex);
    memset(&dir->entry_data, 0, sizeof(dir->entry_data));
 
-   status = FSAReadDir(deviceData->clientHandle, dir->fd, &dir->entry_data);
+   uint32_t generation = __wut_fsa_stat_cache_generation(deviceData);
+   status = FSAReadDir(dir->clientHandle, dir->fd, &dir->entry_data);
    if (status < 0) {
       if (status != FS_ERROR_END_OF_DIR) {
          WUT_DEBUG_REPORT("FSAReadDir(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
-                          deviceData->clientHandle, dir->fd, &dir->entry_data, dir->fullPath, FSAGetStatusStr(status));
+                          dir->clientHandle, dir->fd, &dir->entry_data, dir->fullPath, FSAGetStatusStr(status));
       }
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
 
-   ino_t ino;
-   size_t fullLen = strlen(dir->fullPath) + 1 + strlen(dir->entry_data.name) + 1;
-   char *fullStr = (char *) memalign(0x40, fullLen);
-   if (fullStr) {
-      if (snprintf(fullStr, fullLen, "%s/%s", dir->fullPath, dir->entry_data.name) >= (int) fullLen) {
-         WUT_DEBUG_REPORT("__wut_fsa_dirnext: snprintf fullStr result was truncated\n");
+   ino_t ino = __wut_fsa_hashstring_append(dir->pathHash, dir->entry_data.name);
+   __wut_fsa_translate_stat(deviceData->clientHandle, &dir->entry_data.info, ino, filestat);
+
+   // newlib fills d_type from filestat, and the stat a directory walk does
+   // next on the entry, e.g. for its size, is answered from the stat cache.
+   // The entry hash is the hash of the full path, see __wut_fsa_diropen
+   if (deviceData->statCacheSize != 0) {
+      char entryPath[FS_MAX_PATH + 1];
+      const char *separator = strcmp(dir->fullPath, "/") != 0 ? "/" : "";
+      if (snprintf(entryPath, sizeof(entryPath), "%s%s%s", dir->fullPath, separator, dir->entry_data.name) < (int) sizeof(entryPath)) {
+         __wut_fsa_stat_cache_insert(deviceData, entryPath, ino, generation, FS_ERROR_OK, &dir->entry_data.info);
       }
-      ino = __wut_fsa_hashstring(fullStr);
-      free(fullStr);
-   } else {
-      ino = 0;
-      WUT_DEBUG_REPORT("__wut_fsa_dirnext: Failed to allocate memory for fullStr. st_ino will be set to 0\n");
    }
-   __wut_fsa_translate_stat(deviceData->clientHandle, &dir->entry_data.info, ino, filestat);
 
    if (snprintf(filename, NAME_MAX, "%s", dir->entry_data.name) >= NAME_MAX) {
       WUT_DEBUG_REPORT("__wut_fsa_dirnext: snprintf filename result was truncated\n");
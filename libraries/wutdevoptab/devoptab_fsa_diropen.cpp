@@ -5,6 +5,8 @@ DIR_ITER *
 __wut_fsa_diropen(struct _reent *r,
                   DIR_ITER *dirState,
                   const char *path) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_DIROPEN);
+   timer.setPath(path);
    FSADirectoryHandle fd;
    FSError status;
    __wut_fsa_dir_t *dir;
@@ -15,39 +17,38 @@ __wut_fsa_diropen(struct _reent *r,
       return NULL;
    }
 
-   char *fixedPath = __wut_fsa_fixpath(r, path);
-   if (!fixedPath) {
+   dir = (__wut_fsa_dir_t *) (dirState->dirStruct);
+   if (!__wut_fsa_fixpath(r, path, dir->fullPath)) {
       return NULL;
    }
-   dir = (__wut_fsa_dir_t *) (dirState->dirStruct);
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   dir->clientHandle = __wut_fsa_get_client(deviceData);
 
    // Remove trailing '/'
-   if (fixedPath[0] != '\0') {
-      if (fixedPath[strlen(fixedPath) - 1] == '/') {
-         fixedPath[strlen(fixedPath) - 1] = 0;
-      }
-   }
-
-   if (snprintf(dir->fullPath, sizeof(dir->fullPath), "%s", fixedPath) >= (int) sizeof(dir->fullPath)) {
-      WUT_DEBUG_REPORT("__wut_fsa_diropen: snprintf result was truncated\n");
+   size_t pathLength = strlen(dir->fullPath);
+   if (pathLength > 1 && dir->fullPath[pathLength - 1] == '/') {
+      dir->fullPath[pathLength - 1] = '\0';
    }
 
-   free(fixedPath);
-
    dir->mutex.init(dir->fullPath);
    std::scoped_lock lock(dir->mutex);
 
-   status = FSAOpenDir(deviceData->clientHandle, dir->fullPath, &fd);
+   status = FSAOpenDir(dir->clientHandle, dir->fullPath, &fd);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSAOpenDir(0x%08X, %s, 0x%08X) failed: %s\n",
-                       deviceData->clientHandle, dir->fullPath, &fd, FSAGetStatusStr(status));
+                       dir->clientHandle, dir->fullPath, &fd, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return NULL;
    }
 
    dir->magic = FSA_DIRITER_MAGIC;
    dir->fd = fd;
+
+   // Entries are hashed as fullPath + '/' + name, the root already ends with a '/'
+   dir->pathHash = __wut_fsa_hashstring(dir->fullPath);
+   if (strcmp(dir->fullPath, "/") != 0) {
+      dir->pathHash = __wut_fsa_hashstring_append(dir->pathHash, "/");
+   }
    memset(&dir->entry_data, 0, sizeof(dir->entry_data));
    return dirState;
 }
@@ -0,0 +1,179 @@
+#include "devoptab_fsa.h"
+#include <mutex>
+
+// Replaces the read-ahead buffer of file, a size of 0 disables read-ahead
+static FSError
+__wut_fsa_resize_read_ahead(__wut_fsa_device_t *deviceData,
+                            __wut_fsa_file_t *file,
+                            uint32_t size) {
+   size = (size + 0x3F) & ~0x3F;
+   if (size == file->readAheadSize) {
+      return FS_ERROR_OK;
+   }
+
+   // Hand data still in the old buffer back to the FSA file position first,
+   // a prefetch is still good
+   FSError status = __wut_fsa_discard_read_ahead(deviceData, file);
+   if (status < 0) {
+      return status;
+   }
+
+   uint8_t *buffer = nullptr;
+   if (size > 0) {
+      // Keep the old buffer if the new one can't be allocated, the advice is only a hint
+      buffer = (uint8_t *) WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_DEVOPTAB, size, 0x40);
+      if (!buffer) {
+         WUT_DEBUG_REPORT("__wut_fsa_fadvise: failed to allocate 0x%X byte read-ahead buffer for %s\n", size, file->fullPath);
+         return FS_ERROR_OK;
+      }
+   }
+
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, file->readAheadBuffer);
+   file->readAheadBuffer = buffer;
+   file->readAheadSize = size;
+   return FS_ERROR_OK;
+}
+
+void
+__wut_fsa_free_prefetch(__wut_fsa_file_t *file) {
+   WUTDevoptabAsyncRequest *request = &file->prefetchRequest;
+   if (!file->prefetchBuffer) {
+      return;
+   }
+
+   if (!request->done) {
+      WUTDevoptabWaitAsync(&request, 1, TRUE, -1);
+   }
+
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, file->prefetchBuffer);
+   file->prefetchBuffer = nullptr;
+   file->prefetchSize = 0;
+}
+
+int
+__wut_fsa_fadvise(struct _reent *r,
+                  void *fd,
+                  int handle,
+                  off_t offset,
+                  off_t len,
+                  int advice) {
+   __wut_fsa_file_t *file;
+   __wut_fsa_device_t *deviceData;
+   FSError status = FS_ERROR_OK;
+
+   if (!fd || offset < 0 || len < 0) {
+      r->_errno = EINVAL;
+      return -1;
+   }
+
+   file = (__wut_fsa_file_t *) fd;
+   deviceData = (__wut_fsa_device_t *) r->deviceData;
+
+   // Nothing can be buffered for O_DIRECT or write-only files
+   if ((file->flags & O_ACCMODE) == O_WRONLY || (file->flags & O_DIRECT)) {
+      return 0;
+   }
+
+   std::scoped_lock lock(file->mutex);
+
+   switch (advice) {
+      case POSIX_FADV_NORMAL:
+         status = __wut_fsa_resize_read_ahead(deviceData, file, __wut_fsa_read_ahead_size);
+         break;
+      case POSIX_FADV_SEQUENTIAL:
+         if (__wut_fsa_read_ahead_sequential_size > file->readAheadSize) {
+            status = __wut_fsa_resize_read_ahead(deviceData, file, __wut_fsa_read_ahead_sequential_size);
+         }
+         break;
+      case POSIX_FADV_RANDOM:
+         // Every read goes straight to the FSA, nothing is read that isn't used
+         status = __wut_fsa_resize_read_ahead(deviceData, file, 0);
+         break;
+      case POSIX_FADV_NOREUSE:
+         break;
+      case POSIX_FADV_WILLNEED: {
+         if (__wut_fsa_prefetch_size == 0 || (uint64_t) offset >= UINT32_MAX) {
+            break;
+         }
+
+         // Only one prefetch per file is in flight, a new hint while it runs is dropped
+         if (!file->prefetchRequest.done) {
+            break;
+         }
+
+         // A length of 0 means up to the end of the file, which is clamped like any other range
+         uint32_t size = (len == 0 || (uint64_t) len > __wut_fsa_prefetch_size) ? __wut_fsa_prefetch_size : (uint32_t) len;
+         size = (size + 0x3F) & ~0x3F;
+         if (size > file->prefetchSize) {
+            WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, file->prefetchBuffer);
+            file->prefetchBuffer = (uint8_t *) WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_DEVOPTAB, size, 0x40);
+            file->prefetchSize = file->prefetchBuffer ? size : 0;
+            if (!file->prefetchBuffer) {
+               WUT_DEBUG_REPORT("__wut_fsa_fadvise: failed to allocate 0x%X byte prefetch buffer for %s\n", size, file->fullPath);
+               break;
+            }
+         }
+
+         // The request reads through pread on the async I/O thread, which
+         // skips the prefetch buffer until the request is done
+         WUTDevoptabAsyncRequest *request = &file->prefetchRequest;
+         *request = {};
+         request->fd = handle;
+         request->buffer = file->prefetchBuffer;
+         request->size = size;
+         request->offset = offset;
+         file->prefetchInvalid = false;
+         if (!WUTDevoptabReadAsync(request)) {
+            request->done = TRUE;
+            request->result = -1;
+         }
+         break;
+      }
+      case POSIX_FADV_DONTNEED:
+         // Drops prefetched data along with the read-ahead buffer
+         __wut_fsa_invalidate_prefetch(file);
+         status = __wut_fsa_discard_read_ahead(deviceData, file);
+         if (file->prefetchBuffer && file->prefetchRequest.done) {
+            WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, file->prefetchBuffer);
+            file->prefetchBuffer = nullptr;
+            file->prefetchSize = 0;
+         }
+         break;
+      default:
+         r->_errno = EINVAL;
+         return -1;
+   }
+
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   return 0;
+}
+
+extern "C" int
+posix_fadvise(int fd,
+              off_t offset,
+              off_t len,
+              int advice) {
+   __handle *handle = __get_handle(fd);
+   if (handle == NULL) {
+      return EBADF;
+   }
+
+   // The advice is only a hint, other devices simply ignore it
+   const devoptab_t *devoptab = devoptab_list[handle->device];
+   if (devoptab->read_r != __wut_fsa_read) {
+      return 0;
+   }
+
+   // Like posix_fallocate, errors are reported through the return value
+   struct _reent *r = _REENT;
+   r->deviceData    = devoptab->deviceData;
+   if (__wut_fsa_fadvise(r, handle->fileStruct, fd, offset, len, advice) < 0) {
+      return r->_errno;
+   }
+
+   return 0;
+}
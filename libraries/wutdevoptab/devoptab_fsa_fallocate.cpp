@@ -0,0 +1,95 @@
+#include "devoptab_fsa.h"
+#include <mutex>
+
+int
+__wut_fsa_fallocate(struct _reent *r,
+                    void *fd,
+                    off_t offset,
+                    off_t len) {
+   FSError status;
+   FSAStat fsStat;
+   __wut_fsa_file_t *file;
+   __wut_fsa_device_t *deviceData;
+
+   if (!fd || offset < 0 || len <= 0) {
+      r->_errno = EINVAL;
+      return -1;
+   }
+
+   if ((uint64_t) offset + (uint64_t) len > UINT32_MAX) {
+      r->_errno = EFBIG;
+      return -1;
+   }
+
+   // Check that the file was opened with write access
+   file = (__wut_fsa_file_t *) fd;
+   if ((file->flags & O_ACCMODE) == O_RDONLY) {
+      r->_errno = EBADF;
+      return -1;
+   }
+
+   deviceData = (__wut_fsa_device_t *) r->deviceData;
+
+   std::scoped_lock lock(file->mutex);
+
+   // The current file size has to include pending writes
+   status = __wut_fsa_flush_write_behind(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   status = FSAGetStatFile(file->clientHandle, file->fd, &fsStat);
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSAGetStatFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
+                       file->clientHandle, file->fd, &fsStat, file->fullPath, FSAGetStatusStr(status));
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   // Space below the current file size is already allocated
+   uint32_t end = (uint32_t) (offset + len);
+   if (end <= fsStat.size) {
+      return 0;
+   }
+
+   status = FSAAppendFileEx(file->clientHandle, file->fd, 1, end - fsStat.size, 0);
+   __wut_fsa_stat_cache_invalidate(deviceData, file->fullPath);
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSAAppendFileEx(0x%08X, 0x%08X, 1, 0x%08X, 0) (%s) failed: %s\n",
+                       file->clientHandle, file->fd, end - fsStat.size, file->fullPath, FSAGetStatusStr(status));
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   // Keep the cached file size used by O_APPEND in sync
+   if (FSAGetStatFile(file->clientHandle, file->fd, &fsStat) >= 0) {
+      file->appendOffset = fsStat.size;
+   }
+
+   return 0;
+}
+
+extern "C" int
+posix_fallocate(int fd,
+                off_t offset,
+                off_t len) {
+   __handle *handle = __get_handle(fd);
+   if (handle == NULL) {
+      return EBADF;
+   }
+
+   const devoptab_t *devoptab = devoptab_list[handle->device];
+   if (devoptab->write_r != __wut_fsa_write) {
+      return EOPNOTSUPP;
+   }
+
+   // Unlike most functions posix_fallocate reports errors through its return value
+   struct _reent *r = _REENT;
+   r->deviceData    = devoptab->deviceData;
+   if (__wut_fsa_fallocate(r, handle->fileStruct, offset, len) < 0) {
+      return r->_errno;
+   }
+
+   return 0;
+}
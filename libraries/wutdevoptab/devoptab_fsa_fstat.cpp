@@ -5,6 +5,8 @@ int
 __wut_fsa_fstat(struct _reent *r,
                 void *fd,
                 struct stat *st) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_FSTAT);
+   timer.setFile(fd);
    FSError status;
    FSAStat fsStat;
    __wut_fsa_file_t *file;
@@ -20,10 +22,17 @@ __wut_fsa_fstat(struct _reent *r,
 
    std::scoped_lock lock(file->mutex);
 
-   status = FSAGetStatFile(deviceData->clientHandle, file->fd, &fsStat);
+   // Make sure the reported size includes pending writes
+   status = __wut_fsa_flush_write_behind(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   status = FSAGetStatFile(file->clientHandle, file->fd, &fsStat);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSAGetStatFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
-                       deviceData->clientHandle, file->fd, &fsStat, FSAGetStatusStr(status));
+                       file->clientHandle, file->fd, &fsStat, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
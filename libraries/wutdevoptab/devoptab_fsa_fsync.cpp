@@ -4,6 +4,8 @@
 int
 __wut_fsa_fsync(struct _reent *r,
                 void *fd) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_FSYNC);
+   timer.setFile(fd);
    FSError status;
    __wut_fsa_file_t *file;
    __wut_fsa_device_t *deviceData;
@@ -19,10 +21,21 @@ __wut_fsa_fsync(struct _reent *r,
 
    std::scoped_lock lock(file->mutex);
 
-   status = FSAFlushFile(deviceData->clientHandle, file->fd);
+   status = __wut_fsa_flush_write_behind(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   // Files in an open save are flushed all at once by WUTDevoptabCommitSave
+   if (__wut_fsa_save_contains(deviceData, file->fullPath)) {
+      return 0;
+   }
+
+   status = FSAFlushFile(file->clientHandle, file->fd);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSAFlushFile(0x%08X, 0x%08X) (%s) failed: %s\n",
-                       deviceData->clientHandle, file->fd, file->fullPath, FSAGetStatusStr(status));
+                       file->clientHandle, file->fd, file->fullPath, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
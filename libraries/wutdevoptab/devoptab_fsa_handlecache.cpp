@@ -0,0 +1,172 @@
+#include "devoptab_fsa.h"
+#include <mutex>
+
+void
+__init_wut_devoptab_handle_cache(__wut_fsa_device_t *deviceData) {
+   deviceData->handleCacheMutex.init("wut devoptab handle cache");
+   deviceData->handleCache = nullptr;
+   deviceData->handleCacheSize = 0;
+   deviceData->handleCacheClock = 0;
+
+   uint32_t size = MIN(__wut_fsa_handle_cache_size, FSA_HANDLE_CACHE_MAX);
+   if (size == 0) {
+      return;
+   }
+
+   deviceData->handleCache = static_cast<__wut_fsa_handle_cache_entry_t *>(memalign(0x40, sizeof(__wut_fsa_handle_cache_entry_t) * size));
+   if (!deviceData->handleCache) {
+      // Not fatal, every open just goes to FSA
+      WUT_DEBUG_REPORT("__init_wut_devoptab_handle_cache: failed to allocate %u entries\n", size);
+      return;
+   }
+
+   deviceData->handleCacheSize = size;
+   for (uint32_t i = 0; i < deviceData->handleCacheSize; ++i) {
+      deviceData->handleCache[i].valid = false;
+   }
+}
+
+void
+__fini_wut_devoptab_handle_cache(__wut_fsa_device_t *deviceData) {
+   __wut_fsa_handle_cache_clear(deviceData);
+   free(deviceData->handleCache);
+   deviceData->handleCache = nullptr;
+   deviceData->handleCacheSize = 0;
+}
+
+static void
+__wut_fsa_handle_cache_close(__wut_fsa_handle_cache_entry_t *entry) {
+   FSError status = FSACloseFile(entry->clientHandle, entry->fd);
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s\n",
+                       entry->clientHandle, entry->fd, entry->path, FSAGetStatusStr(status));
+   }
+   entry->valid = false;
+}
+
+bool
+__wut_fsa_handle_cache_take(__wut_fsa_device_t *deviceData,
+                            const char *path,
+                            FSOpenFileFlags openFlags,
+                            FSAClientHandle *outClientHandle,
+                            FSAFileHandle *outFd) {
+   if (deviceData->handleCacheSize == 0) {
+      return false;
+   }
+
+   uint32_t hash = __wut_fsa_hashstring(path);
+   __wut_fsa_handle_cache_entry_t entry;
+
+   {
+      std::scoped_lock lock(deviceData->handleCacheMutex);
+
+      uint32_t i;
+      for (i = 0; i < deviceData->handleCacheSize; ++i) {
+         __wut_fsa_handle_cache_entry_t *candidate = &deviceData->handleCache[i];
+         if (candidate->valid && candidate->hash == hash && candidate->openFlags == openFlags &&
+             strcmp(candidate->path, path) == 0) {
+            break;
+         }
+      }
+
+      if (i == deviceData->handleCacheSize) {
+         return false;
+      }
+
+      entry = deviceData->handleCache[i];
+      deviceData->handleCache[i].valid = false;
+   }
+
+   // The handle is still at wherever the last user left it
+   FSError status = FSASetPosFile(entry.clientHandle, entry.fd, 0);
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSASetPosFile(0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                       entry.clientHandle, entry.fd, entry.path, FSAGetStatusStr(status));
+      __wut_fsa_handle_cache_close(&entry);
+      return false;
+   }
+
+   *outClientHandle = entry.clientHandle;
+   *outFd = entry.fd;
+   return true;
+}
+
+bool
+__wut_fsa_handle_cache_put(__wut_fsa_device_t *deviceData,
+                           const char *path,
+                           FSAClientHandle clientHandle,
+                           FSAFileHandle fd,
+                           FSOpenFileFlags openFlags) {
+   if (deviceData->handleCacheSize == 0) {
+      return false;
+   }
+
+   __wut_fsa_handle_cache_entry_t evicted;
+   evicted.valid = false;
+
+   {
+      std::scoped_lock lock(deviceData->handleCacheMutex);
+
+      // Take a free entry, or the least recently closed one
+      __wut_fsa_handle_cache_entry_t *entry = &deviceData->handleCache[0];
+      for (uint32_t i = 0; i < deviceData->handleCacheSize && entry->valid; ++i) {
+         __wut_fsa_handle_cache_entry_t *candidate = &deviceData->handleCache[i];
+         if (!candidate->valid || candidate->lastUsed < entry->lastUsed) {
+            entry = candidate;
+         }
+      }
+
+      if (entry->valid) {
+         evicted = *entry;
+      }
+
+      entry->valid = true;
+      entry->hash = __wut_fsa_hashstring(path);
+      entry->clientHandle = clientHandle;
+      entry->fd = fd;
+      entry->openFlags = openFlags;
+      entry->lastUsed = ++deviceData->handleCacheClock;
+      strcpy(entry->path, path);
+   }
+
+   // Close outside the lock so other opens don't wait for the FSA
+   if (evicted.valid) {
+      __wut_fsa_handle_cache_close(&evicted);
+   }
+   return true;
+}
+
+void
+__wut_fsa_handle_cache_invalidate(__wut_fsa_device_t *deviceData,
+                                  const char *path) {
+   if (deviceData->handleCacheSize == 0) {
+      return;
+   }
+
+   uint32_t hash = __wut_fsa_hashstring(path);
+
+   std::scoped_lock lock(deviceData->handleCacheMutex);
+
+   // The same file may have been closed more than once
+   for (uint32_t i = 0; i < deviceData->handleCacheSize; ++i) {
+      __wut_fsa_handle_cache_entry_t *entry = &deviceData->handleCache[i];
+      if (entry->valid && entry->hash == hash && strcmp(entry->path, path) == 0) {
+         __wut_fsa_handle_cache_close(entry);
+      }
+   }
+}
+
+void
+__wut_fsa_handle_cache_clear(__wut_fsa_device_t *deviceData) {
+   if (deviceData->handleCacheSize == 0) {
+      return;
+   }
+
+   std::scoped_lock lock(deviceData->handleCacheMutex);
+
+   for (uint32_t i = 0; i < deviceData->handleCacheSize; ++i) {
+      if (deviceData->handleCache[i].valid) {
+         __wut_fsa_handle_cache_close(&deviceData->handleCache[i]);
+      }
+   }
+}
@@ -0,0 +1,180 @@
+#include "devoptab_fsa.h"
+#include <mutex>
+#include <sys/stat.h>
+
+static void *
+__wut_fsa_load_file_alloc(const WUTDevoptabAllocator *allocator,
+                          uint32_t size,
+                          uint32_t alignment) {
+   if (allocator && allocator->alloc) {
+      return allocator->alloc(allocator->userContext, size, alignment);
+   }
+   return memalign(alignment, size);
+}
+
+static void
+__wut_fsa_load_file_free(const WUTDevoptabAllocator *allocator,
+                         void *ptr) {
+   if (allocator && allocator->alloc) {
+      if (allocator->free) {
+         allocator->free(allocator->userContext, ptr);
+      }
+      return;
+   }
+   free(ptr);
+}
+
+// Reads the whole file with FSA straight into the destination buffer
+static int
+__wut_fsa_load_file_fsa(__wut_fsa_file_t *file,
+                        const WUTDevoptabAllocator *allocator,
+                        uint32_t alignment,
+                        void **outData,
+                        uint32_t *outSize) {
+   FSError status;
+   FSAStat fsStat;
+
+   std::scoped_lock lock(file->mutex);
+
+   status = FSAGetStatFile(file->clientHandle, file->fd, &fsStat);
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSAGetStatFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
+                       file->clientHandle, file->fd, &fsStat, file->fullPath, FSAGetStatusStr(status));
+      errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   if (fsStat.size > UINT32_MAX - 0x3F) {
+      errno = EFBIG;
+      return -1;
+   }
+
+   // Pad to whole cache lines so every request can DMA straight into the buffer
+   uint32_t size = fsStat.size;
+   uint32_t paddedSize = (size + 0x3F) & ~0x3F;
+   uint8_t *data = (uint8_t *) __wut_fsa_load_file_alloc(allocator, MAX(paddedSize, 0x40), alignment);
+   if (!data) {
+      WUT_DEBUG_REPORT("WUTDevoptabLoadFile: failed to allocate 0x%08X bytes for %s\n", paddedSize, file->fullPath);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   uint32_t bytesRead = 0;
+   while (bytesRead < size) {
+      uint32_t chunk = paddedSize - bytesRead;
+      if (__wut_fsa_read_chunk_size && chunk > __wut_fsa_read_chunk_size) {
+         chunk = MAX(__wut_fsa_read_chunk_size & ~0x3F, 0x40);
+      }
+
+      status = FSAReadFileWithPos(file->clientHandle, data + bytesRead, 1, chunk, bytesRead, file->fd, 0);
+      if (status < 0) {
+         WUT_DEBUG_REPORT("FSAReadFileWithPos(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                          file->clientHandle, data + bytesRead, chunk, bytesRead, file->fd, file->fullPath, FSAGetStatusStr(status));
+         __wut_fsa_load_file_free(allocator, data);
+         errno = __wut_fsa_translate_error(status);
+         return -1;
+      }
+
+      if (status == 0) {
+         break; // file got shorter
+      }
+      bytesRead += status;
+   }
+
+   *outData = data;
+   *outSize = MIN(bytesRead, size);
+   return 0;
+}
+
+// Generic version for other devices
+static int
+__wut_fsa_load_file_generic(int fd,
+                            const WUTDevoptabAllocator *allocator,
+                            uint32_t alignment,
+                            void **outData,
+                            uint32_t *outSize) {
+   struct stat st;
+   if (fstat(fd, &st) < 0) {
+      return -1;
+   }
+
+   if (st.st_size < 0 || (uint64_t) st.st_size > UINT32_MAX - 0x3F) {
+      errno = EFBIG;
+      return -1;
+   }
+
+   uint32_t size = (uint32_t) st.st_size;
+   uint32_t paddedSize = (size + 0x3F) & ~0x3F;
+   uint8_t *data = (uint8_t *) __wut_fsa_load_file_alloc(allocator, MAX(paddedSize, 0x40), alignment);
+   if (!data) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   uint32_t bytesRead = 0;
+   while (bytesRead < size) {
+      ssize_t rc = read(fd, data + bytesRead, size - bytesRead);
+      if (rc < 0) {
+         int err = errno;
+         __wut_fsa_load_file_free(allocator, data);
+         errno = err;
+         return -1;
+      }
+
+      if (rc == 0) {
+         break;
+      }
+      bytesRead += rc;
+   }
+
+   *outData = data;
+   *outSize = bytesRead;
+   return 0;
+}
+
+void *
+WUTDevoptabLoadFile(const char *path,
+                    const WUTDevoptabAllocator *allocator,
+                    uint32_t alignment,
+                    uint32_t *outSize) {
+   void *data = nullptr;
+   uint32_t size = 0;
+   int rc;
+
+   if (!path) {
+      errno = EINVAL;
+      return nullptr;
+   }
+
+   // FSA needs at least cache line alignment to skip the bounce buffer
+   alignment = MAX(alignment, 0x40);
+   if (alignment & (alignment - 1)) {
+      errno = EINVAL;
+      return nullptr;
+   }
+
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      return nullptr;
+   }
+
+   __handle *handle = __get_handle(fd);
+   if (handle && devoptab_list[handle->device]->read_r == __wut_fsa_read) {
+      rc = __wut_fsa_load_file_fsa((__wut_fsa_file_t *) handle->fileStruct, allocator, alignment, &data, &size);
+   } else {
+      rc = __wut_fsa_load_file_generic(fd, allocator, alignment, &data, &size);
+   }
+
+   int err = errno;
+   close(fd);
+   errno = err;
+
+   if (rc < 0) {
+      return nullptr;
+   }
+
+   if (outSize) {
+      *outSize = size;
+   }
+   return data;
+}
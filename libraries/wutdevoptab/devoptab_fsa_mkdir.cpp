@@ -4,8 +4,10 @@ int
 __wut_fsa_mkdir(struct _reent *r,
                 const char *path,
                 int mode) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_MKDIR);
+   timer.setPath(path);
    FSError status;
-   char *fixedPath;
+   char fixedPath[FS_MAX_PATH + 1];
    __wut_fsa_device_t *deviceData;
 
    if (!path) {
@@ -13,25 +15,23 @@ __wut_fsa_mkdir(struct _reent *r,
       return -1;
    }
 
-   fixedPath = __wut_fsa_fixpath(r, path);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   if (!__wut_fsa_fixpath(r, path, fixedPath)) {
       return -1;
    }
 
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
 
    FSMode translatedMode = __wut_fsa_translate_permission_mode(mode);
 
-   status = FSAMakeDir(deviceData->clientHandle, fixedPath, translatedMode);
+   status = FSAMakeDir(clientHandle, fixedPath, translatedMode);
+   __wut_fsa_stat_cache_invalidate(deviceData, fixedPath);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSAMakeDir(0x%08X, %s, 0x%X) failed: %s\n",
-                       deviceData->clientHandle, fixedPath, translatedMode, FSAGetStatusStr(status));
-      free(fixedPath);
+                       clientHandle, fixedPath, translatedMode, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
-   free(fixedPath);
 
    return 0;
 }
@@ -12,6 +12,8 @@ __wut_fsa_open(struct _reent *r,
                const char *path,
                int flags,
                int mode) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_OPEN);
+   timer.setPath(path);
    FSAFileHandle fd;
    FSError status;
    const char *fsMode;
@@ -58,47 +60,48 @@ __wut_fsa_open(struct _reent *r,
       return -1;
    }
 
-   char *fixedPath = __wut_fsa_fixpath(r, path);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   file = (__wut_fsa_file_t *) fileStruct;
+   if (!__wut_fsa_fixpath(r, path, file->fullPath)) {
       return -1;
    }
 
-
-   file = (__wut_fsa_file_t *) fileStruct;
    deviceData = (__wut_fsa_device_t *) r->deviceData;
-
-   if (snprintf(file->fullPath, sizeof(file->fullPath), "%s", fixedPath) >= (int) sizeof(file->fullPath)) {
-      WUT_DEBUG_REPORT("__wut_fsa_open: snprintf result was truncated\n");
-   }
-   free(fixedPath);
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
 
    // Prepare flags
    FSOpenFileFlags openFlags = (flags & O_UNENCRYPTED) ? FS_OPEN_FLAG_UNENCRYPTED : FS_OPEN_FLAG_NONE;
    FSMode translatedMode = __wut_fsa_translate_permission_mode(mode);
-   uint32_t preAllocSize = 0;
+   uint32_t preAllocSize = __wut_fsa_prealloc_size;
 
    // Init mutex and lock
    file->mutex.init(file->fullPath);
    std::scoped_lock lock(file->mutex);
 
+   bool readOnly = (flags & O_ACCMODE) == O_RDONLY;
+   if (!readOnly) {
+      // A cached read handle could keep the file from being written
+      __wut_fsa_handle_cache_invalidate(deviceData, file->fullPath);
+      // Writes through this file aren't tracked by WUTDevoptabWriteSaveFile
+      __wut_fsa_save_sums_invalidate(deviceData, file->fullPath);
+   }
+
    if (createFileIfNotFound || failIfFileNotFound || (flags & (O_EXCL | O_CREAT)) == (O_EXCL | O_CREAT)) {
       // Check if file exists
       FSAStat stat;
-      status = FSAGetStat(deviceData->clientHandle, file->fullPath, &stat);
+      status = FSAGetStat(clientHandle, file->fullPath, &stat);
       if (status == FS_ERROR_NOT_FOUND) {
          if (createFileIfNotFound) { // Create new file if needed
-            status = FSAOpenFileEx(deviceData->clientHandle, file->fullPath, "w", translatedMode,
+            status = FSAOpenFileEx(clientHandle, file->fullPath, "w", translatedMode,
                                    openFlags, preAllocSize, &fd);
             if (status == FS_ERROR_OK) {
-               if (FSACloseFile(deviceData->clientHandle, fd) != FS_ERROR_OK) {
+               if (FSACloseFile(clientHandle, fd) != FS_ERROR_OK) {
                   WUT_DEBUG_REPORT("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s\n",
-                                   deviceData->clientHandle, fd, file->fullPath, FSAGetStatusStr(status));
+                                   clientHandle, fd, file->fullPath, FSAGetStatusStr(status));
                }
                fd = -1;
             } else {
                WUT_DEBUG_REPORT("FSAOpenFileEx(0x%08X, %s, %s, 0x%X, 0x%08X, 0x%08X, 0x%08X) failed: %s\n",
-                                deviceData->clientHandle, file->fullPath, "w", translatedMode, openFlags, preAllocSize, &fd,
+                                clientHandle, file->fullPath, "w", translatedMode, openFlags, preAllocSize, &fd,
                                 FSAGetStatusStr(status));
                r->_errno = __wut_fsa_translate_error(status);
                return -1;
@@ -116,38 +119,87 @@ __wut_fsa_open(struct _reent *r,
       }
    }
 
-   status = FSAOpenFileEx(deviceData->clientHandle, file->fullPath, fsMode, translatedMode, openFlags, preAllocSize, &fd);
-   if (status < 0) {
-      if (status != FS_ERROR_NOT_FOUND) {
-         WUT_DEBUG_REPORT("FSAOpenFileEx(0x%08X, %s, %s, 0x%X, 0x%08X, 0x%08X, 0x%08X) failed: %s\n",
-                          deviceData->clientHandle, file->fullPath, fsMode, translatedMode, openFlags, preAllocSize, &fd,
-                          FSAGetStatusStr(status));
+   // Reuse a handle kept open by the handle cache, may come from another pool client
+   if (!readOnly || !__wut_fsa_handle_cache_take(deviceData, file->fullPath, openFlags, &clientHandle, &fd)) {
+      status = FSAOpenFileEx(clientHandle, file->fullPath, fsMode, translatedMode, openFlags, preAllocSize, &fd);
+      if (status < 0) {
+         if (status != FS_ERROR_NOT_FOUND) {
+            WUT_DEBUG_REPORT("FSAOpenFileEx(0x%08X, %s, %s, 0x%X, 0x%08X, 0x%08X, 0x%08X) failed: %s\n",
+                             clientHandle, file->fullPath, fsMode, translatedMode, openFlags, preAllocSize, &fd,
+                             FSAGetStatusStr(status));
+         }
+         r->_errno = __wut_fsa_translate_error(status);
+         return -1;
       }
-      r->_errno = __wut_fsa_translate_error(status);
-      return -1;
+   }
+
+   // The file may have been created or truncated
+   if (!readOnly) {
+      __wut_fsa_stat_cache_invalidate(deviceData, file->fullPath);
    }
 
    file->fd = fd;
-   file->flags = (flags & (O_ACCMODE | O_APPEND | O_SYNC));
+   file->clientHandle = clientHandle;
+   file->flags = (flags & (O_ACCMODE | O_APPEND | O_SYNC | O_DIRECT));
+   file->openFlags = openFlags;
    // Is always 0, even if O_APPEND is set.
    file->offset = 0;
 
    if (flags & O_APPEND) {
       FSAStat stat;
-      status = FSAGetStatFile(deviceData->clientHandle, fd, &stat);
+      status = FSAGetStatFile(clientHandle, fd, &stat);
       if (status < 0) {
          WUT_DEBUG_REPORT("FSAGetStatFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
-                          deviceData->clientHandle, fd, &stat, file->fullPath, FSAGetStatusStr(status));
+                          clientHandle, fd, &stat, file->fullPath, FSAGetStatusStr(status));
 
          r->_errno = __wut_fsa_translate_error(status);
-         if (FSACloseFile(deviceData->clientHandle, fd) < 0) {
+         if (FSACloseFile(clientHandle, fd) < 0) {
             WUT_DEBUG_REPORT("FSACloseFile(0x%08X, 0x%08X) (%s) failed: %s\n",
-                             deviceData->clientHandle, fd, file->fullPath, FSAGetStatusStr(status));
+                             clientHandle, fd, file->fullPath, FSAGetStatusStr(status));
 
          }
          return -1;
       }
       file->appendOffset = stat.size;
    }
+
+   file->readAheadBuffer = nullptr;
+   file->readAheadSize = 0;
+   file->readAheadLength = 0;
+   file->readAheadPos = 0;
+   file->positionStale = false;
+
+   file->prefetchBuffer = nullptr;
+   file->prefetchSize = 0;
+   file->prefetchRequest = {};
+   file->prefetchRequest.done = TRUE;
+   file->prefetchInvalid = false;
+
+   // O_DIRECT files never go through the read-ahead or write-behind buffers
+   if ((flags & O_ACCMODE) != O_WRONLY && !(flags & O_DIRECT) && __wut_fsa_read_ahead_size > 0) {
+      // Read-ahead is optional, keep going without it if the allocation fails
+      uint32_t readAheadSize = (__wut_fsa_read_ahead_size + 0x3F) & ~0x3F;
+      file->readAheadBuffer = (uint8_t *) WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_DEVOPTAB, readAheadSize, 0x40);
+      if (file->readAheadBuffer) {
+         file->readAheadSize = readAheadSize;
+      } else {
+         WUT_DEBUG_REPORT("__wut_fsa_open: failed to allocate read-ahead buffer for %s\n", file->fullPath);
+      }
+   }
+
+   file->writeBehindBuffer = nullptr;
+   file->writeBehindSize = 0;
+   file->writeBehindLength = 0;
+
+   if ((flags & O_ACCMODE) != O_RDONLY && !(flags & (O_SYNC | O_DIRECT)) && __wut_fsa_write_behind_size > 0) {
+      // Write-behind is optional, keep going without it if the allocation fails
+      uint32_t writeBehindSize = (__wut_fsa_write_behind_size + 0x3F) & ~0x3F;
+      file->writeBehindBuffer = (uint8_t *) WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_DEVOPTAB, writeBehindSize, 0x40);
+      if (file->writeBehindBuffer) {
+         file->writeBehindSize = writeBehindSize;
+      } else {
+         WUT_DEBUG_REPORT("__wut_fsa_open: failed to allocate write-behind buffer for %s\n", file->fullPath);
+      }
+   }
    return 0;
 }
\ No newline at end of file
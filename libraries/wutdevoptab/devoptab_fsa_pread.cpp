@@ -0,0 +1,293 @@
+#include "devoptab_fsa.h"
+#include <mutex>
+#include <sys/param.h>
+
+ssize_t __wut_fsa_pread(struct _reent *r, void *fd, char *ptr, size_t len, off_t pos) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_PREAD);
+   timer.setFile(fd);
+   FSError status;
+   __wut_fsa_file_t *file;
+   __wut_fsa_device_t *deviceData;
+   if (!fd || !ptr || pos < 0) {
+      r->_errno = EINVAL;
+      return -1;
+   }
+
+   // Check that the file was opened with read access
+   file = (__wut_fsa_file_t *) fd;
+   if ((file->flags & O_ACCMODE) == O_WRONLY) {
+      r->_errno = EBADF;
+      return -1;
+   }
+
+   // Don't read past the largest possible file position, nothing can be stored beyond it
+   if ((uint64_t) pos >= UINT32_MAX) {
+      return timer.result(0);
+   } else if ((uint64_t) pos + len > UINT32_MAX) {
+      len = UINT32_MAX - (uint32_t) pos;
+   }
+
+   // cache-aligned, cache-line-sized
+   __attribute__((aligned(0x40))) uint8_t alignedBuffer[0x40];
+
+   deviceData = (__wut_fsa_device_t *) r->deviceData;
+   size_t prefetchedBytes = 0;
+
+   {
+      // Only hold the lock while flushing, positional reads don't touch file->offset
+      std::scoped_lock lock(file->mutex);
+
+      // Pending writes have to be visible to the read
+      status = __wut_fsa_flush_write_behind(deviceData, file);
+      if (status < 0) {
+         r->_errno = __wut_fsa_translate_error(status);
+         return -1;
+      }
+
+      // Serve the start of the range from what posix_fadvise(POSIX_FADV_WILLNEED) prefetched
+      const uint8_t *prefetched;
+      size_t available = __wut_fsa_prefetch_available(file, (uint32_t) pos, &prefetched);
+      if (available > 0) {
+         size_t size = MIN(available, len);
+         memcpy(ptr, prefetched, size);
+         if (size == len) {
+            return timer.result(size);
+         }
+
+         ptr += size;
+         pos += size;
+         prefetchedBytes = size;
+      }
+   }
+
+   size_t bytesRead = prefetchedBytes;
+   while (bytesRead < len) {
+      // only use input buffer if cache-aligned and read size is a multiple of cache line size
+      // otherwise read into alignedBuffer
+      uint8_t *tmp = (uint8_t *) ptr;
+      size_t size = len - bytesRead;
+
+      if ((file->flags & O_DIRECT) && !((uintptr_t) ptr & 0x3F)) {
+         // O_DIRECT: read straight into the aligned input buffer
+      } else if (size < 0x40) {
+         // read partial cache-line back-end
+         tmp = alignedBuffer;
+      } else if ((uintptr_t) ptr & 0x3F) {
+         // read partial cache-line front-end
+         tmp = alignedBuffer;
+         size = MIN(size, 0x40 - ((uintptr_t) ptr & 0x3F));
+      } else {
+         // read whole cache lines
+         size &= ~0x3F;
+      }
+
+      // Limit each request to 1 MiB by default
+      if (__wut_fsa_read_chunk_size && size > __wut_fsa_read_chunk_size) {
+         size = __wut_fsa_read_chunk_size;
+      }
+
+      status = FSAReadFileWithPos(file->clientHandle, tmp, 1, size, (uint32_t) pos, file->fd, 0);
+      __wut_fsa_stats_add_read(deviceData, status, tmp == alignedBuffer);
+
+      if (status < 0) {
+         WUT_DEBUG_REPORT("FSAReadFileWithPos(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                          file->clientHandle, tmp, size, (uint32_t) pos, file->fd, file->fullPath, FSAGetStatusStr(status));
+
+         if (bytesRead != 0) {
+            return timer.result(bytesRead); // error after partial read
+         }
+
+         r->_errno = __wut_fsa_translate_error(status);
+         return -1;
+      }
+
+      if (tmp == alignedBuffer) {
+         memcpy(ptr, alignedBuffer, status);
+      }
+
+      pos += status;
+      bytesRead += status;
+      ptr += status;
+
+      if ((size_t) status != size) {
+         return timer.result(bytesRead); // partial read
+      }
+   }
+
+   return timer.result(bytesRead);
+}
+
+ssize_t __wut_fsa_pwrite(struct _reent *r, void *fd, const char *ptr, size_t len, off_t pos) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_PWRITE);
+   timer.setFile(fd);
+   FSError status;
+   __wut_fsa_file_t *file;
+   __wut_fsa_device_t *deviceData;
+
+   if (!fd || !ptr || pos < 0) {
+      r->_errno = EINVAL;
+      return -1;
+   }
+
+   // FSA file positions are 32-bit, see __wut_fsa_file_t::offset
+   if ((uint64_t) pos + len > UINT32_MAX) {
+      if ((uint64_t) pos >= UINT32_MAX) {
+         r->_errno = EFBIG;
+         return -1;
+      }
+      len = UINT32_MAX - (uint32_t) pos;
+   }
+
+   // Check that the file was opened with write access
+   file = (__wut_fsa_file_t *) fd;
+   if ((file->flags & O_ACCMODE) == O_RDONLY) {
+      r->_errno = EBADF;
+      return -1;
+   }
+
+   // cache-aligned, cache-line-sized
+   __attribute__((aligned(0x40))) uint8_t alignedBuffer[0x40];
+
+   deviceData = (__wut_fsa_device_t *) r->deviceData;
+
+   {
+      std::scoped_lock lock(file->mutex);
+
+      // Buffered data could be stale after the write
+      __wut_fsa_invalidate_prefetch(file);
+      status = __wut_fsa_discard_read_ahead(deviceData, file);
+      if (status >= 0) {
+         status = __wut_fsa_flush_write_behind(deviceData, file);
+      }
+      if (status < 0) {
+         r->_errno = __wut_fsa_translate_error(status);
+         return -1;
+      }
+   }
+
+   size_t bytesWritten = 0;
+   while (bytesWritten < len) {
+      // only use input buffer if cache-aligned and write size is a multiple of cache line size
+      // otherwise write from alignedBuffer
+      uint8_t *tmp = (uint8_t *) ptr;
+      size_t size = len - bytesWritten;
+
+      if ((file->flags & O_DIRECT) && !((uintptr_t) ptr & 0x3F)) {
+         // O_DIRECT: write straight from the aligned input buffer
+      } else if (size < 0x40) {
+         // write partial cache-line back-end
+         tmp = alignedBuffer;
+      } else if ((uintptr_t) ptr & 0x3F) {
+         // write partial cache-line front-end
+         tmp = alignedBuffer;
+         size = MIN(size, 0x40 - ((uintptr_t) ptr & 0x3F));
+      } else {
+         // write whole cache lines
+         size &= ~0x3F;
+      }
+
+      // Limit each request to 256 KiB by default
+      if (__wut_fsa_write_chunk_size && size > __wut_fsa_write_chunk_size) {
+         size = __wut_fsa_write_chunk_size;
+      }
+
+      if (tmp == alignedBuffer) {
+         memcpy(tmp, ptr, size);
+      }
+
+      status = FSAWriteFileWithPos(file->clientHandle, tmp, 1, size, (uint32_t) pos, file->fd, 0);
+      __wut_fsa_stats_add_write(deviceData, status, tmp == alignedBuffer);
+      if (status < 0) {
+         WUT_DEBUG_REPORT("FSAWriteFileWithPos(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                          file->clientHandle, tmp, size, (uint32_t) pos, file->fd, file->fullPath, FSAGetStatusStr(status));
+         if (bytesWritten != 0) {
+            break; // error after partial write
+         }
+
+         r->_errno = __wut_fsa_translate_error(status);
+         return -1;
+      }
+
+      pos += status;
+      bytesWritten += status;
+      ptr += status;
+
+      if ((size_t) status != size) {
+         break; // partial write
+      }
+   }
+
+   {
+      // Keep the cached file size in sync if the write extended the file
+      std::scoped_lock lock(file->mutex);
+      if ((uint32_t) pos > file->appendOffset) {
+         file->appendOffset = (uint32_t) pos;
+      }
+   }
+
+   __wut_fsa_stat_cache_invalidate(deviceData, file->fullPath);
+
+   return timer.result(bytesWritten);
+}
+
+ssize_t
+pread(int fd,
+      void *buf,
+      size_t count,
+      off_t offset) {
+   __handle *handle = __get_handle(fd);
+   if (handle == NULL) {
+      errno = EBADF;
+      return -1;
+   }
+
+   const devoptab_t *devoptab = devoptab_list[handle->device];
+   if (devoptab->read_r != __wut_fsa_read) {
+      // Fall back to seek + read for other devices
+      off_t current = lseek(fd, 0, SEEK_CUR);
+      if (current < 0 || lseek(fd, offset, SEEK_SET) < 0) {
+         return -1;
+      }
+
+      ssize_t rc = read(fd, buf, count);
+      int err    = errno;
+      lseek(fd, current, SEEK_SET);
+      errno = err;
+      return rc;
+   }
+
+   struct _reent *r = _REENT;
+   r->deviceData    = devoptab->deviceData;
+   return __wut_fsa_pread(r, handle->fileStruct, (char *) buf, count, offset);
+}
+
+ssize_t
+pwrite(int fd,
+       const void *buf,
+       size_t count,
+       off_t offset) {
+   __handle *handle = __get_handle(fd);
+   if (handle == NULL) {
+      errno = EBADF;
+      return -1;
+   }
+
+   const devoptab_t *devoptab = devoptab_list[handle->device];
+   if (devoptab->write_r != __wut_fsa_write) {
+      // Fall back to seek + write for other devices
+      off_t current = lseek(fd, 0, SEEK_CUR);
+      if (current < 0 || lseek(fd, offset, SEEK_SET) < 0) {
+         return -1;
+      }
+
+      ssize_t rc = write(fd, buf, count);
+      int err    = errno;
+      lseek(fd, current, SEEK_SET);
+      errno = err;
+      return rc;
+   }
+
+   struct _reent *r = _REENT;
+   r->deviceData    = devoptab->deviceData;
+   return __wut_fsa_pwrite(r, handle->fileStruct, (const char *) buf, count, offset);
+}
@@ -3,6 +3,8 @@
 #include <sys/param.h>
 
 ssize_t __wut_fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_READ);
+   timer.setFile(fd);
    FSError status;
    __wut_fsa_file_t *file;
    __wut_fsa_device_t *deviceData;
@@ -25,14 +27,101 @@ ssize_t __wut_fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
 
    std::scoped_lock lock(file->mutex);
 
+   // Pending writes have to be visible to the read
+   status = __wut_fsa_flush_write_behind(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
    size_t bytesRead = 0;
+
+   // Serve what posix_fadvise(POSIX_FADV_WILLNEED) prefetched, unless the read-ahead buffer already
+   // holds the data at this position
+   if (file->readAheadPos == file->readAheadLength) {
+      const uint8_t *prefetched;
+      size_t available = __wut_fsa_prefetch_available(file, file->offset, &prefetched);
+      if (available > 0) {
+         size_t size = MIN(available, len);
+         memcpy(ptr, prefetched, size);
+
+         // The FSA file position is only moved once the FSA is read from again
+         file->positionStale = true;
+         file->offset += size;
+         bytesRead += size;
+         ptr += size;
+
+         if (bytesRead == len) {
+            return timer.result(bytesRead);
+         }
+      }
+   }
+
+   status = __wut_fsa_sync_position(file);
+   if (status < 0) {
+      if (bytesRead != 0) {
+         return timer.result(bytesRead);
+      }
+
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   if (file->readAheadBuffer) {
+      while (bytesRead < len) {
+         size_t available = file->readAheadLength - file->readAheadPos;
+         if (available > 0) {
+            // serve from the read-ahead buffer
+            size_t size = MIN(available, len - bytesRead);
+            memcpy(ptr, file->readAheadBuffer + file->readAheadPos, size);
+
+            file->readAheadPos += size;
+            file->offset += size;
+            bytesRead += size;
+            ptr += size;
+            continue;
+         }
+
+         // Reads at least as large as the buffer go straight to the FSA below
+         if (len - bytesRead >= file->readAheadSize) {
+            break;
+         }
+
+         status = FSAReadFile(file->clientHandle, file->readAheadBuffer, 1, file->readAheadSize, file->fd, 0);
+         __wut_fsa_stats_add_read(deviceData, status, false);
+         if (status < 0) {
+            WUT_DEBUG_REPORT("FSAReadFile(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                             file->clientHandle, file->readAheadBuffer, file->readAheadSize, file->fd, file->fullPath, FSAGetStatusStr(status));
+            file->readAheadLength = 0;
+            file->readAheadPos = 0;
+
+            if (bytesRead != 0) {
+               return timer.result(bytesRead); // error after partial read
+            }
+
+            r->_errno = __wut_fsa_translate_error(status);
+            return -1;
+         }
+
+         file->readAheadLength = status;
+         file->readAheadPos = 0;
+
+         if (status == 0) {
+            return timer.result(bytesRead); // end of file
+         }
+      }
+   }
+
    while (bytesRead < len) {
       // only use input buffer if cache-aligned and read size is a multiple of cache line size
       // otherwise read into alignedBuffer
       uint8_t *tmp = (uint8_t *) ptr;
       size_t size = len - bytesRead;
 
-      if (size < 0x40) {
+      if ((file->flags & O_DIRECT) && !((uintptr_t) ptr & 0x3F)) {
+         // O_DIRECT: read straight into the aligned input buffer, the caller
+         // owns the whole cache line that contains the last byte
+      } else if (size < 0x40) {
          // read partial cache-line back-end
          tmp = alignedBuffer;
       } else if ((uintptr_t) ptr & 0x3F) {
@@ -44,19 +133,20 @@ ssize_t __wut_fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
          size &= ~0x3F;
       }
 
-      // Limit each request to 1 MiB
-      if (size > 0x100000) {
-         size = 0x100000;
+      // Limit each request to 1 MiB by default
+      if (__wut_fsa_read_chunk_size && size > __wut_fsa_read_chunk_size) {
+         size = __wut_fsa_read_chunk_size;
       }
 
-      status = FSAReadFile(deviceData->clientHandle, tmp, 1, size, file->fd, 0);
+      status = FSAReadFile(file->clientHandle, tmp, 1, size, file->fd, 0);
+      __wut_fsa_stats_add_read(deviceData, status, tmp == alignedBuffer);
 
       if (status < 0) {
          WUT_DEBUG_REPORT("FSAReadFile(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
-                          deviceData->clientHandle, tmp, size, file->fd, file->fullPath, FSAGetStatusStr(status));
+                          file->clientHandle, tmp, size, file->fd, file->fullPath, FSAGetStatusStr(status));
 
          if (bytesRead != 0) {
-            return bytesRead; // error after partial read
+            return timer.result(bytesRead); // error after partial read
          }
 
          r->_errno = __wut_fsa_translate_error(status);
@@ -72,9 +162,9 @@ ssize_t __wut_fsa_read(struct _reent *r, void *fd, char *ptr, size_t len) {
       ptr += status;
 
       if ((size_t) status != size) {
-         return bytesRead; // partial read
+         return timer.result(bytesRead); // partial read
       }
    }
 
-   return bytesRead;
+   return timer.result(bytesRead);
 }
\ No newline at end of file
@@ -4,8 +4,10 @@ int
 __wut_fsa_rename(struct _reent *r,
                  const char *oldName,
                  const char *newName) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_RENAME);
+   timer.setPath(oldName);
    FSError status;
-   char *fixedOldPath, *fixedNewPath;
+   char fixedOldPath[FS_MAX_PATH + 1], fixedNewPath[FS_MAX_PATH + 1];
    __wut_fsa_device_t *deviceData;
 
    if (!oldName || !newName) {
@@ -13,32 +15,29 @@ __wut_fsa_rename(struct _reent *r,
       return -1;
    }
 
-   fixedOldPath = __wut_fsa_fixpath(r, oldName);
-   if (!fixedOldPath) {
-      r->_errno = ENOMEM;
+   if (!__wut_fsa_fixpath(r, oldName, fixedOldPath)) {
       return -1;
    }
 
-   fixedNewPath = __wut_fsa_fixpath(r, newName);
-   if (!fixedNewPath) {
-      free(fixedOldPath);
-      r->_errno = ENOMEM;
+   if (!__wut_fsa_fixpath(r, newName, fixedNewPath)) {
       return -1;
    }
 
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
 
-   status = FSARename(deviceData->clientHandle, fixedOldPath, fixedNewPath);
+   // Cached handles below a renamed directory would keep it busy
+   __wut_fsa_handle_cache_clear(deviceData);
+   __wut_fsa_save_sums_clear(deviceData);
+   status = FSARename(clientHandle, fixedOldPath, fixedNewPath);
+   // Renaming a directory moves everything below it as well
+   __wut_fsa_stat_cache_clear(deviceData);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSARename(0x%08X, %s, %s) failed: %s\n",
-                       deviceData->clientHandle, fixedOldPath, fixedNewPath, FSAGetStatusStr(status));
-      free(fixedOldPath);
-      free(fixedNewPath);
+                       clientHandle, fixedOldPath, fixedNewPath, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
-   free(fixedOldPath);
-   free(fixedNewPath);
 
    return 0;
 }
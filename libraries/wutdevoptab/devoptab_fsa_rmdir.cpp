@@ -3,6 +3,8 @@
 int
 __wut_fsa_rmdir(struct _reent *r,
                 const char *name) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_RMDIR);
+   timer.setPath(name);
    FSError status;
    __wut_fsa_device_t *deviceData;
 
@@ -11,24 +13,22 @@ __wut_fsa_rmdir(struct _reent *r,
       return -1;
    }
 
-   char *fixedPath = __wut_fsa_fixpath(r, name);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   char fixedPath[FS_MAX_PATH + 1];
+   if (!__wut_fsa_fixpath(r, name, fixedPath)) {
       return -1;
    }
 
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
 
-   status = FSARemove(deviceData->clientHandle, fixedPath);
+   status = FSARemove(clientHandle, fixedPath);
+   __wut_fsa_stat_cache_invalidate(deviceData, fixedPath);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSARemove(0x%08X, %s) failed: %s\n",
-                       deviceData->clientHandle, fixedPath, FSAGetStatusStr(status));
-      free(fixedPath);
+                       clientHandle, fixedPath, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
 
-   free(fixedPath);
-
    return 0;
 }
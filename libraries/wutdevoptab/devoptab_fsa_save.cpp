@@ -0,0 +1,375 @@
+#include "devoptab_fsa.h"
+#include <mutex>
+
+// Granularity WUTDevoptabWriteSaveFile compares and writes files at
+#define FSA_SAVE_BLOCK_SIZE 0x8000
+
+// Finds the FSA device of path and writes its absolute path on the device to fullPath
+static __wut_fsa_device_t *
+__wut_fsa_save_resolve(const char *path,
+                       char *fullPath) {
+   if (!path) {
+      errno = EINVAL;
+      return nullptr;
+   }
+
+   const devoptab_t *devoptab = GetDeviceOpTab(path);
+   if (!devoptab || devoptab->open_r != __wut_fsa_open) {
+      errno = ENODEV;
+      return nullptr;
+   }
+
+   // Resolve relative paths against the device's cwd like the handlers do
+   __wut_fsa_device_t *deviceData = (__wut_fsa_device_t *) devoptab->deviceData;
+   struct _reent *r = _REENT;
+   void *previousDeviceData = r->deviceData;
+   r->deviceData = deviceData;
+   char *fixedPath = __wut_fsa_fixpath(r, path, fullPath);
+   r->deviceData = previousDeviceData;
+
+   return fixedPath ? deviceData : nullptr;
+}
+
+// deviceData->saveMutex must be held
+static bool
+__wut_fsa_save_contains_locked(__wut_fsa_device_t *deviceData,
+                               const char *fullPath) {
+   size_t length = strlen(deviceData->savePath);
+   if (!length || strncmp(fullPath, deviceData->savePath, length) != 0) {
+      return false;
+   }
+   return fullPath[length] == '/' || fullPath[length] == '\0';
+}
+
+bool
+__wut_fsa_save_contains(__wut_fsa_device_t *deviceData,
+                        const char *fullPath) {
+   std::scoped_lock lock(deviceData->saveMutex);
+   return __wut_fsa_save_contains_locked(deviceData, fullPath);
+}
+
+// Unlinks and frees the checksums pointed to by link, deviceData->saveMutex must be held
+static void
+__wut_fsa_save_sums_remove(__wut_fsa_save_sums_t **link) {
+   __wut_fsa_save_sums_t *sums = *link;
+   *link = sums->next;
+   free(sums->committed);
+   free(sums->pending);
+   free(sums);
+}
+
+// Finds the checksums of fullPath, deviceData->saveMutex must be held
+static __wut_fsa_save_sums_t **
+__wut_fsa_save_sums_find(__wut_fsa_device_t *deviceData,
+                         const char *fullPath,
+                         uint32_t hash) {
+   __wut_fsa_save_sums_t **link = &deviceData->saveSums;
+   while (*link && ((*link)->hash != hash || strcmp((*link)->path, fullPath) != 0)) {
+      link = &(*link)->next;
+   }
+   return link;
+}
+
+void
+__wut_fsa_save_sums_invalidate(__wut_fsa_device_t *deviceData,
+                               const char *fullPath) {
+   std::scoped_lock lock(deviceData->saveMutex);
+   if (!deviceData->saveSums) {
+      return;
+   }
+
+   __wut_fsa_save_sums_t **link = __wut_fsa_save_sums_find(deviceData, fullPath, __wut_fsa_hashstring(fullPath));
+   if (*link) {
+      __wut_fsa_save_sums_remove(link);
+   }
+}
+
+void
+__wut_fsa_save_sums_clear(__wut_fsa_device_t *deviceData) {
+   std::scoped_lock lock(deviceData->saveMutex);
+   while (deviceData->saveSums) {
+      __wut_fsa_save_sums_remove(&deviceData->saveSums);
+   }
+}
+
+// 64-bit checksum of a block, two independent 32-bit lanes over its words
+static uint64_t
+__wut_fsa_save_checksum(const uint8_t *data,
+                        uint32_t size) {
+   uint32_t h1 = 0x9747B28C ^ size;
+   uint32_t h2 = 0x811C9DC5 + size;
+   uint32_t i;
+
+   for (i = 0; i + 4 <= size; i += 4) {
+      uint32_t k;
+      memcpy(&k, data + i, 4);
+      h2 = ((h2 ^ k) * 0x01000193) ^ (h2 >> 15);
+
+      k *= 0xCC9E2D51;
+      k = (k << 15) | (k >> 17);
+      h1 ^= k * 0x1B873593;
+      h1 = ((h1 << 13) | (h1 >> 19)) * 5 + 0xE6546B64;
+   }
+
+   for (; i < size; ++i) {
+      h1 = (h1 ^ data[i]) * 0x01000193;
+      h2 = (h2 ^ data[i]) * 0x85EBCA6B;
+   }
+
+   h1 ^= h1 >> 16;
+   h1 *= 0x85EBCA6B;
+   h1 ^= h1 >> 13;
+   h2 ^= h2 >> 16;
+   h2 *= 0xC2B2AE35;
+   h2 ^= h2 >> 13;
+   return ((uint64_t) h1 << 32) | h2;
+}
+
+int
+WUTDevoptabBeginSave(const char *path) {
+   char fullPath[FS_MAX_PATH + 1];
+   __wut_fsa_device_t *deviceData = __wut_fsa_save_resolve(path, fullPath);
+   if (!deviceData) {
+      return -1;
+   }
+
+   std::scoped_lock lock(deviceData->saveMutex);
+   if (deviceData->savePath[0]) {
+      errno = EBUSY;
+      return -1;
+   }
+
+   strcpy(deviceData->savePath, fullPath);
+   return 0;
+}
+
+int
+WUTDevoptabCommitSave(const char *path) {
+   char fullPath[FS_MAX_PATH + 1];
+   __wut_fsa_device_t *deviceData = __wut_fsa_save_resolve(path, fullPath);
+   if (!deviceData) {
+      return -1;
+   }
+
+   std::scoped_lock lock(deviceData->saveMutex);
+   if (strcmp(deviceData->savePath, fullPath) != 0) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   // The one journal flush for every file written since WUTDevoptabBeginSave
+   FSError status = FSAFlushQuota(deviceData->clientHandle, fullPath);
+   if (status < 0) {
+      // Stays open, so the save can be committed again or aborted
+      WUT_DEBUG_REPORT("FSAFlushQuota(0x%08X, %s) failed: %s\n",
+                       deviceData->clientHandle, fullPath, FSAGetStatusStr(status));
+      errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   // What was written is now the baseline for the next save
+   for (__wut_fsa_save_sums_t *sums = deviceData->saveSums; sums; sums = sums->next) {
+      if (sums->pending) {
+         free(sums->committed);
+         sums->committed     = sums->pending;
+         sums->committedSize = sums->pendingSize;
+         sums->pending       = nullptr;
+      }
+   }
+
+   deviceData->savePath[0] = '\0';
+   return 0;
+}
+
+int
+WUTDevoptabAbortSave(const char *path) {
+   char fullPath[FS_MAX_PATH + 1];
+   __wut_fsa_device_t *deviceData = __wut_fsa_save_resolve(path, fullPath);
+   if (!deviceData) {
+      return -1;
+   }
+
+   std::scoped_lock lock(deviceData->saveMutex);
+   if (strcmp(deviceData->savePath, fullPath) != 0) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   deviceData->savePath[0] = '\0';
+
+   // The files go back to their committed contents
+   for (__wut_fsa_save_sums_t **link = &deviceData->saveSums; *link;) {
+      free((*link)->pending);
+      (*link)->pending = nullptr;
+      if (!(*link)->committed) {
+         __wut_fsa_save_sums_remove(link);
+      } else {
+         link = &(*link)->next;
+      }
+   }
+
+   __wut_fsa_handle_cache_clear(deviceData);
+   FSError status = FSARollbackQuota(deviceData->clientHandle, fullPath);
+
+   // Cached results may describe files that were just rolled back
+   __wut_fsa_stat_cache_clear(deviceData);
+
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSARollbackQuota(0x%08X, %s) failed: %s\n",
+                       deviceData->clientHandle, fullPath, FSAGetStatusStr(status));
+      errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   return 0;
+}
+
+int
+WUTDevoptabWriteSaveFile(const char *path,
+                         const void *data,
+                         uint32_t size) {
+   char fullPath[FS_MAX_PATH + 1];
+   __wut_fsa_device_t *deviceData = __wut_fsa_save_resolve(path, fullPath);
+   if (!deviceData) {
+      return -1;
+   }
+
+   if (!data && size) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   // Held until the file is written, so the save can't be committed halfway
+   std::scoped_lock lock(deviceData->saveMutex);
+   if (!__wut_fsa_save_contains_locked(deviceData, fullPath)) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   uint32_t numBlocks = (uint32_t) (((uint64_t) size + FSA_SAVE_BLOCK_SIZE - 1) / FSA_SAVE_BLOCK_SIZE);
+   uint64_t *newSums  = (uint64_t *) malloc(MAX(numBlocks, 1) * sizeof(uint64_t));
+   uint8_t *buffer    = (uint8_t *) memalign(0x40, FSA_SAVE_BLOCK_SIZE);
+   if (!newSums || !buffer) {
+      free(newSums);
+      free(buffer);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   uint32_t hash                = __wut_fsa_hashstring(fullPath);
+   __wut_fsa_save_sums_t **link = __wut_fsa_save_sums_find(deviceData, fullPath, hash);
+   __wut_fsa_save_sums_t *sums  = *link;
+
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
+   FSMode mode                  = __wut_fsa_translate_permission_mode(0666);
+   FSAFileHandle fd             = 0;
+   FSAStat fsStat               = {};
+
+   __wut_fsa_handle_cache_invalidate(deviceData, fullPath);
+   FSError status = FSAOpenFileEx(clientHandle, fullPath, "r+", mode, FS_OPEN_FLAG_NONE, 0, &fd);
+   if (status == FS_ERROR_NOT_FOUND) {
+      status = FSAOpenFileEx(clientHandle, fullPath, "w+", mode, FS_OPEN_FLAG_NONE, 0, &fd);
+   }
+
+   bool opened = status >= 0;
+   if (opened) {
+      status = FSAGetStatFile(clientHandle, fd, &fsStat);
+   }
+
+   // Compare against the checksums of what the file holds now, if they are
+   // known and still match its size, otherwise against its actual contents
+   const uint64_t *oldSums = nullptr;
+   if (sums && sums->pending && sums->pendingSize == fsStat.size) {
+      oldSums = sums->pending;
+   } else if (sums && !sums->pending && sums->committed && sums->committedSize == fsStat.size) {
+      oldSums = sums->committed;
+   }
+
+   uint32_t oldBlocks = (uint32_t) (((uint64_t) fsStat.size + FSA_SAVE_BLOCK_SIZE - 1) / FSA_SAVE_BLOCK_SIZE);
+   for (uint32_t i = 0; status >= 0 && i < numBlocks; ++i) {
+      uint32_t pos         = i * FSA_SAVE_BLOCK_SIZE;
+      uint32_t length      = MIN(size - pos, FSA_SAVE_BLOCK_SIZE);
+      const uint8_t *block = (const uint8_t *) data + pos;
+      newSums[i]           = __wut_fsa_save_checksum(block, length);
+
+      bool unchanged = false;
+      if (oldSums) {
+         // The checksum covers the length, so a shorter last block never matches
+         unchanged = i < oldBlocks && oldSums[i] == newSums[i];
+      } else if (pos + length <= fsStat.size) {
+         status = FSAReadFileWithPos(clientHandle, buffer, 1, length, pos, fd, 0);
+         __wut_fsa_stats_add_read(deviceData, status, false);
+         if (status < 0) {
+            WUT_DEBUG_REPORT("FSAReadFileWithPos(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                             clientHandle, buffer, length, pos, fd, fullPath, FSAGetStatusStr(status));
+            break;
+         }
+         unchanged = (uint32_t) status == length && memcmp(buffer, block, length) == 0;
+      }
+
+      if (unchanged) {
+         continue;
+      }
+
+      // Changed blocks are written in order, so a file growing past its old
+      // end is always extended from there
+      void *source = (void *) block;
+      if ((uintptr_t) block & 0x3F) {
+         memcpy(buffer, block, length);
+         source = buffer;
+      }
+
+      status = FSAWriteFileWithPos(clientHandle, source, 1, length, pos, fd, 0);
+      __wut_fsa_stats_add_write(deviceData, status, source == buffer);
+      if (status < 0) {
+         WUT_DEBUG_REPORT("FSAWriteFileWithPos(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                          clientHandle, source, length, pos, fd, fullPath, FSAGetStatusStr(status));
+      } else if ((uint32_t) status != length) {
+         status = FS_ERROR_STORAGE_FULL;
+      }
+   }
+
+   if (status >= 0 && size < fsStat.size) {
+      status = FSASetPosFile(clientHandle, fd, size);
+      if (status >= 0) {
+         status = FSATruncateFile(clientHandle, fd);
+      }
+   }
+
+   if (opened) {
+      FSACloseFile(clientHandle, fd);
+   }
+
+   __wut_fsa_stat_cache_invalidate(deviceData, fullPath);
+   free(buffer);
+
+   if (status < 0) {
+      WUT_DEBUG_REPORT("WUTDevoptabWriteSaveFile(%s) failed: %s\n", fullPath, FSAGetStatusStr(status));
+      free(newSums);
+      // What the file holds now is unknown until the save is aborted
+      if (sums) {
+         __wut_fsa_save_sums_remove(link);
+      }
+      errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   if (!sums) {
+      sums = (__wut_fsa_save_sums_t *) calloc(1, sizeof(__wut_fsa_save_sums_t));
+      if (!sums) {
+         // Written fine, the next write just compares against the file again
+         free(newSums);
+         return 0;
+      }
+
+      sums->hash = hash;
+      strcpy(sums->path, fullPath);
+      sums->next           = deviceData->saveSums;
+      deviceData->saveSums = sums;
+   }
+
+   free(sums->pending);
+   sums->pending     = newSums;
+   sums->pendingSize = size;
+   return 0;
+}
@@ -6,6 +6,8 @@ __wut_fsa_seek(struct _reent *r,
                void *fd,
                off_t pos,
                int whence) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_SEEK);
+   timer.setFile(fd);
    FSError status;
    FSAStat fsStat;
    uint64_t offset;
@@ -23,6 +25,13 @@ __wut_fsa_seek(struct _reent *r,
 
    std::scoped_lock lock(file->mutex);
 
+   // Pending writes have to land at the current position
+   status = __wut_fsa_flush_write_behind(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
    // Find the offset to see from
    switch (whence) {
       case SEEK_SET: { // Set absolute position; start offset is 0
@@ -34,10 +43,10 @@ __wut_fsa_seek(struct _reent *r,
          break;
       }
       case SEEK_END: {  // Set position relative to the end of the file
-         status = FSAGetStatFile(deviceData->clientHandle, file->fd, &fsStat);
+         status = FSAGetStatFile(file->clientHandle, file->fd, &fsStat);
          if (status < 0) {
             WUT_DEBUG_REPORT("FSAGetStatFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
-                             deviceData->clientHandle, file->fd, &fsStat, file->fullPath, FSAGetStatusStr(status));
+                             file->clientHandle, file->fd, &fsStat, file->fullPath, FSAGetStatusStr(status));
             r->_errno = __wut_fsa_translate_error(status);
             return -1;
          }
@@ -55,22 +64,29 @@ __wut_fsa_seek(struct _reent *r,
       r->_errno = EINVAL;
       return -1;
    } else if (offset + pos > UINT32_MAX) {
-      // Check for overflow
-      r->_errno = EINVAL;
+      // FSA file positions are 32-bit, see __wut_fsa_file_t::offset
+      r->_errno = EOVERFLOW;
       return -1;
    }
 
-   if ((uint32_t) (offset + pos) == file->offset) {
+   // Drop the read-ahead buffer, the FSA file position is ahead of file->offset if data was left in it,
+   // or behind it if reads were served from the prefetch buffer
+   bool readAheadPending = file->readAheadPos != file->readAheadLength || file->positionStale;
+   file->readAheadLength = 0;
+   file->readAheadPos = 0;
+   file->positionStale = false;
+
+   if (!readAheadPending && (uint32_t) (offset + pos) == file->offset) {
       return file->offset;
    }
 
    uint32_t old_pos = file->offset;
    file->offset = offset + pos;
 
-   status = FSASetPosFile(deviceData->clientHandle, file->fd, file->offset);
+   status = FSASetPosFile(file->clientHandle, file->fd, file->offset);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSASetPosFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
-                       deviceData->clientHandle, file->fd, file->offset, file->fullPath, FSAGetStatusStr(status));
+                       file->clientHandle, file->fd, file->offset, file->fullPath, FSAGetStatusStr(status));
       file->offset = old_pos;
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
@@ -0,0 +1,111 @@
+#include "devoptab_fsa.h"
+#include <sys/socket.h>
+
+// Size of each of the two buffers, a multiple of the cache line size so
+// FSA can read straight into them
+#define WUT_SENDFILE_CHUNK_SIZE 0x10000
+
+// Send all of len bytes, returns the number of bytes sent
+static ssize_t
+__wut_sendfile_send_all(int sockfd,
+                        const uint8_t *data,
+                        size_t len) {
+   size_t sent = 0;
+   while (sent < len) {
+      ssize_t rc = send(sockfd, data + sent, len - sent, 0);
+      if (rc <= 0) {
+         return sent ? (ssize_t) sent : rc;
+      }
+      sent += rc;
+   }
+   return sent;
+}
+
+ssize_t
+wut_sendfile(int sockfd,
+             int filefd,
+             off_t offset,
+             size_t count) {
+   WUTDevoptabAsyncRequest requests[2];
+   WUTDevoptabAsyncRequest *request;
+   size_t total = 0;
+   int current  = 0;
+
+   if (offset < 0) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   uint8_t *buffers = (uint8_t *) WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_DEVOPTAB, WUT_SENDFILE_CHUNK_SIZE * 2, 0x40);
+   if (!buffers) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   memset(requests, 0, sizeof(requests));
+   for (int i = 0; i < 2; ++i) {
+      requests[i].fd     = filefd;
+      requests[i].buffer = buffers + i * WUT_SENDFILE_CHUNK_SIZE;
+   }
+
+   auto submit = [&](WUTDevoptabAsyncRequest *req, size_t done) {
+      size_t left = count ? count - done : WUT_SENDFILE_CHUNK_SIZE;
+      req->offset = offset + done;
+      req->size   = MIN(left, (size_t) WUT_SENDFILE_CHUNK_SIZE);
+      return req->size == 0 || WUTDevoptabReadAsync(req);
+   };
+
+   // Read the next chunk while the current one is being sent
+   size_t queued = 0;
+   request       = &requests[current];
+   if (!submit(request, queued)) {
+      WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, buffers);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   while (request->size) {
+      WUTDevoptabWaitAsync(&request, 1, TRUE, -1);
+      if (request->result <= 0) {
+         if (request->result < 0 && total == 0) {
+            errno = request->error;
+            total = (size_t) -1;
+         }
+         break;
+      }
+
+      queued += request->result;
+
+      WUTDevoptabAsyncRequest *next = &requests[current ^ 1];
+      if ((size_t) request->result < request->size || (count && queued >= count)) {
+         next->size = 0; // end of file or of the range
+      } else if (!submit(next, queued)) {
+         next->size = 0;
+      }
+
+      ssize_t sent = __wut_sendfile_send_all(sockfd, (const uint8_t *) request->buffer, request->result);
+      if (sent > 0) {
+         total += sent;
+      }
+
+      if (sent != request->result) {
+         if (total == 0) {
+            total = (size_t) -1;
+         }
+
+         // Don't free the buffer under a read that is still in flight
+         if (next->size) {
+            WUTDevoptabWaitAsync(&next, 1, TRUE, -1);
+         }
+         break;
+      }
+
+      current ^= 1;
+      request = next;
+   }
+
+   int err = errno;
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_DEVOPTAB, buffers);
+   errno = err;
+   return (ssize_t) total;
+}
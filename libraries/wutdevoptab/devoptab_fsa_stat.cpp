@@ -4,6 +4,8 @@ int
 __wut_fsa_stat(struct _reent *r,
                const char *path,
                struct stat *st) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_STAT);
+   timer.setPath(path);
    FSError status;
    FSAStat fsStat;
    __wut_fsa_device_t *deviceData;
@@ -13,28 +15,36 @@ __wut_fsa_stat(struct _reent *r,
       return -1;
    }
 
-   char *fixedPath = __wut_fsa_fixpath(r, path);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   char fixedPath[FS_MAX_PATH + 1];
+   if (!__wut_fsa_fixpath(r, path, fixedPath)) {
       return -1;
    }
 
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
+
+   // Paths with a trailing '/' aren't cached, so invalidating the plain path is enough
+   uint32_t hash = __wut_fsa_hashstring(fixedPath);
+   size_t pathLength = strlen(fixedPath);
+   bool cacheable = fixedPath[pathLength - 1] != '/' || pathLength == 1;
+
+   if (!cacheable || !__wut_fsa_stat_cache_lookup(deviceData, fixedPath, hash, &status, &fsStat)) {
+      uint32_t generation = __wut_fsa_stat_cache_generation(deviceData);
+      status = FSAGetStat(clientHandle, fixedPath, &fsStat);
+      if (cacheable) {
+         __wut_fsa_stat_cache_insert(deviceData, fixedPath, hash, generation, status, &fsStat);
+      }
+   }
 
-   status = FSAGetStat(deviceData->clientHandle, fixedPath, &fsStat);
    if (status < 0) {
       if (status != FS_ERROR_NOT_FOUND) {
          WUT_DEBUG_REPORT("FSAGetStat(0x%08X, %s, 0x%08X) failed: %s\n",
-                          deviceData->clientHandle, fixedPath, &fsStat, FSAGetStatusStr(status));
+                          clientHandle, fixedPath, &fsStat, FSAGetStatusStr(status));
       }
-      free(fixedPath);
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
-   ino_t ino = __wut_fsa_hashstring(fixedPath);
-   free(fixedPath);
-
-   __wut_fsa_translate_stat(deviceData->clientHandle, &fsStat, ino, st);
+   __wut_fsa_translate_stat(deviceData->clientHandle, &fsStat, hash, st);
 
    return 0;
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+#include "devoptab_fsa.h"
+#include <mutex>
+
+void
+__init_wut_devoptab_stat_cache(__wut_fsa_device_t *deviceData) {
+   deviceData->statCacheMutex.init("wut devoptab stat cache");
+   deviceData->statCache = nullptr;
+   deviceData->statCacheSize = 0;
+   deviceData->statCacheGeneration = 0;
+
+   if (__wut_fsa_stat_cache_size == 0) {
+      return;
+   }
+
+   deviceData->statCache = static_cast<__wut_fsa_stat_cache_entry_t *>(memalign(0x40, sizeof(__wut_fsa_stat_cache_entry_t) * __wut_fsa_stat_cache_size));
+   if (!deviceData->statCache) {
+      // Not fatal, stat just goes to FSA every time
+      WUT_DEBUG_REPORT("__init_wut_devoptab_stat_cache: failed to allocate %u entries\n", __wut_fsa_stat_cache_size);
+      return;
+   }
+
+   deviceData->statCacheSize = __wut_fsa_stat_cache_size;
+   for (uint32_t i = 0; i < deviceData->statCacheSize; ++i) {
+      deviceData->statCache[i].valid = false;
+   }
+}
+
+void
+__fini_wut_devoptab_stat_cache(__wut_fsa_device_t *deviceData) {
+   free(deviceData->statCache);
+   deviceData->statCache = nullptr;
+   deviceData->statCacheSize = 0;
+}
+
+bool
+__wut_fsa_stat_cache_lookup(__wut_fsa_device_t *deviceData,
+                            const char *path,
+                            uint32_t hash,
+                            FSError *status,
+                            FSAStat *stat) {
+   if (deviceData->statCacheSize == 0) {
+      return false;
+   }
+
+   std::scoped_lock lock(deviceData->statCacheMutex);
+
+   // Direct mapped, a colliding path simply replaces the entry
+   __wut_fsa_stat_cache_entry_t *entry = &deviceData->statCache[hash % deviceData->statCacheSize];
+   if (!entry->valid || entry->hash != hash || strcmp(entry->path, path) != 0) {
+      return false;
+   }
+
+   if (OSGetSystemTime() - entry->time > (OSTime) OSMillisecondsToTicks(__wut_fsa_stat_cache_ttl)) {
+      entry->valid = false;
+      return false;
+   }
+
+   *status = entry->status;
+   if (entry->status >= 0) {
+      *stat = entry->stat;
+   }
+   return true;
+}
+
+void
+__wut_fsa_stat_cache_insert(__wut_fsa_device_t *deviceData,
+                            const char *path,
+                            uint32_t hash,
+                            uint32_t generation,
+                            FSError status,
+                            const FSAStat *stat) {
+   if (deviceData->statCacheSize == 0) {
+      return;
+   }
+
+   // Only cache definite answers
+   if (status < 0 && status != FS_ERROR_NOT_FOUND) {
+      return;
+   }
+
+   std::scoped_lock lock(deviceData->statCacheMutex);
+
+   // The path may have changed after the FSA call that produced status
+   if (deviceData->statCacheGeneration != generation) {
+      return;
+   }
+
+   __wut_fsa_stat_cache_entry_t *entry = &deviceData->statCache[hash % deviceData->statCacheSize];
+   entry->valid = true;
+   entry->hash = hash;
+   entry->status = status;
+   entry->time = OSGetSystemTime();
+   if (status >= 0) {
+      entry->stat = *stat;
+   }
+   strcpy(entry->path, path);
+}
+
+void
+__wut_fsa_stat_cache_invalidate(__wut_fsa_device_t *deviceData,
+                                const char *path) {
+   if (deviceData->statCacheSize == 0) {
+      return;
+   }
+
+   uint32_t hash = __wut_fsa_hashstring(path);
+
+   std::scoped_lock lock(deviceData->statCacheMutex);
+   ++deviceData->statCacheGeneration;
+
+   __wut_fsa_stat_cache_entry_t *entry = &deviceData->statCache[hash % deviceData->statCacheSize];
+   if (entry->valid && entry->hash == hash) {
+      entry->valid = false;
+   }
+}
+
+void
+__wut_fsa_stat_cache_clear(__wut_fsa_device_t *deviceData) {
+   if (deviceData->statCacheSize == 0) {
+      return;
+   }
+
+   std::scoped_lock lock(deviceData->statCacheMutex);
+   ++deviceData->statCacheGeneration;
+
+   for (uint32_t i = 0; i < deviceData->statCacheSize; ++i) {
+      deviceData->statCache[i].valid = false;
+   }
+}
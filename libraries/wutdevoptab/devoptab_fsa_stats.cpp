@@ -0,0 +1,85 @@
+#include "devoptab_fsa.h"
+#include <coreinit/atomic64.h>
+
+volatile uint32_t __wut_fsa_stats_enabled = 0;
+
+void
+__wut_fsa_stats_record_op(__wut_fsa_device_t *deviceData,
+                          WUTDevoptabOp op,
+                          OSTime duration) {
+   uint64_t us = OSTicksToMicroseconds(duration);
+
+   // Bucket i holds [2^(i-1), 2^i) microseconds
+   uint32_t bucket = (us == 0) ? 0 : 64 - __builtin_clzll(us);
+   if (bucket >= WUT_DEVOPTAB_LATENCY_BUCKETS) {
+      bucket = WUT_DEVOPTAB_LATENCY_BUCKETS - 1;
+   }
+
+   OSAddAtomic((volatile int32_t *) &deviceData->stats.opCount[op], 1);
+   OSAddAtomic((volatile int32_t *) &deviceData->stats.latency[op][bucket], 1);
+}
+
+void
+__wut_fsa_stats_add_read(__wut_fsa_device_t *deviceData,
+                         ssize_t bytes,
+                         bool bounced) {
+   if (!__wut_fsa_stats_enabled) {
+      return;
+   }
+
+   if (bytes > 0) {
+      OSAddAtomic64((volatile int64_t *) &deviceData->stats.bytesRead, bytes);
+   }
+   if (bounced) {
+      OSAddAtomic((volatile int32_t *) &deviceData->stats.bounceBufferReads, 1);
+   }
+}
+
+void
+__wut_fsa_stats_add_write(__wut_fsa_device_t *deviceData,
+                          ssize_t bytes,
+                          bool bounced) {
+   if (!__wut_fsa_stats_enabled) {
+      return;
+   }
+
+   if (bytes > 0) {
+      OSAddAtomic64((volatile int64_t *) &deviceData->stats.bytesWritten, bytes);
+   }
+   if (bounced) {
+      OSAddAtomic((volatile int32_t *) &deviceData->stats.bounceBufferWrites, 1);
+   }
+}
+
+void
+WUTDevoptabSetStatsEnabled(BOOL enabled) {
+   __wut_fsa_stats_enabled = enabled ? 1 : 0;
+}
+
+BOOL
+WUTDevoptabGetStats(const char *name,
+                    WUTDevoptabStats *outStats) {
+   if (!outStats) {
+      return FALSE;
+   }
+
+   __wut_fsa_device_t *deviceData = __wut_fsa_find_device(name ? name : "fs");
+   if (!deviceData) {
+      return FALSE;
+   }
+
+   // Not a consistent snapshot if other threads are doing I/O, good enough for statistics
+   memcpy(outStats, &deviceData->stats, sizeof(WUTDevoptabStats));
+   return TRUE;
+}
+
+BOOL
+WUTDevoptabResetStats(const char *name) {
+   __wut_fsa_device_t *deviceData = __wut_fsa_find_device(name ? name : "fs");
+   if (!deviceData) {
+      return FALSE;
+   }
+
+   memset(&deviceData->stats, 0, sizeof(WUTDevoptabStats));
+   return TRUE;
+}
@@ -4,11 +4,14 @@ int
 __wut_fsa_statvfs(struct _reent *r,
                   const char *path,
                   struct statvfs *buf) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_STATVFS);
+   timer.setPath(path);
    FSError status;
    uint64_t freeSpace;
    __wut_fsa_device_t *deviceData;
 
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
    if (deviceData->isSDCard) {
       r->_errno = ENOSYS;
       return -1;
@@ -16,21 +19,18 @@ __wut_fsa_statvfs(struct _reent *r,
 
    memset(buf, 0, sizeof(struct statvfs));
 
-   char *fixedPath = __wut_fsa_fixpath(r, path);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   char fixedPath[FS_MAX_PATH + 1];
+   if (!__wut_fsa_fixpath(r, path, fixedPath)) {
       return -1;
    }
 
-   status = FSAGetFreeSpaceSize(deviceData->clientHandle, fixedPath, &freeSpace);
+   status = FSAGetFreeSpaceSize(clientHandle, fixedPath, &freeSpace);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSAGetFreeSpaceSize(0x%08X, %s, 0x%08X) failed: %s\n",
-                       deviceData->clientHandle, fixedPath, &freeSpace, FSAGetStatusStr(status));
-      free(fixedPath);
+                       clientHandle, fixedPath, &freeSpace, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
-   free(fixedPath);
 
    // File system block size
    buf->f_bsize = deviceData->deviceSectorSize;
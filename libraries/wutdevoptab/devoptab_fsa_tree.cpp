@@ -0,0 +1,419 @@
+#include "devoptab_fsa.h"
+#include <coreinit/atomic64.h>
+#include <coreinit/condition.h>
+#include <coreinit/thread.h>
+#include <cstdio>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define TREE_WORKER_MAX        3
+#define TREE_WORKER_STACK_SIZE (16 * 1024)
+#define TREE_COPY_BUFFER_SIZE  (1024 * 1024)
+
+typedef enum {
+   TREE_JOB_COPY,
+   TREE_JOB_UNLINK,
+   TREE_JOB_SIZE,
+} __wut_fsa_tree_job_type_t;
+
+typedef struct __wut_fsa_tree_job_t {
+   struct __wut_fsa_tree_job_t *next;
+   __wut_fsa_tree_job_type_t type;
+   char *src;
+   char *dst;
+} __wut_fsa_tree_job_t;
+
+struct __wut_fsa_tree_pool_t;
+
+typedef struct {
+   struct __wut_fsa_tree_pool_t *pool;
+   OSThread thread;
+   uint8_t *stack;
+   uint8_t *buffer;
+} __wut_fsa_tree_worker_t;
+
+typedef struct __wut_fsa_tree_pool_t {
+   //! Guards everything below
+   OSMutex mutex;
+   OSCondition workCond;
+   OSCondition doneCond;
+
+   __wut_fsa_tree_job_t *head;
+   __wut_fsa_tree_job_t *tail;
+
+   //! Queued or running jobs
+   uint32_t pending;
+   bool stop;
+
+   //! errno of the first failed job, later jobs are skipped
+   int error;
+
+   //! Sum of all TREE_JOB_SIZE results
+   uint64_t totalSize;
+
+   __wut_fsa_tree_worker_t workers[TREE_WORKER_MAX];
+   uint32_t workerCount;
+} __wut_fsa_tree_pool_t;
+
+static int
+__wut_fsa_tree_copy_file(const char *src,
+                         const char *dst,
+                         uint8_t *buffer) {
+   int in = open(src, O_RDONLY);
+   if (in < 0) {
+      return errno;
+   }
+
+   int out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+   if (out < 0) {
+      int err = errno;
+      close(in);
+      return err;
+   }
+
+   int err = 0;
+   while (true) {
+      ssize_t rc = read(in, buffer, TREE_COPY_BUFFER_SIZE);
+      if (rc <= 0) {
+         err = rc < 0 ? errno : 0;
+         break;
+      }
+
+      if (write(out, buffer, rc) != rc) {
+         err = errno ? errno : ENOSPC;
+         break;
+      }
+   }
+
+   close(in);
+   if (close(out) < 0 && err == 0) {
+      err = errno;
+   }
+   return err;
+}
+
+static int
+__wut_fsa_tree_run_job(__wut_fsa_tree_worker_t *worker,
+                       __wut_fsa_tree_job_t *job) {
+   switch (job->type) {
+      case TREE_JOB_COPY: {
+         return __wut_fsa_tree_copy_file(job->src, job->dst, worker->buffer);
+      }
+      case TREE_JOB_UNLINK: {
+         return unlink(job->src) < 0 ? errno : 0;
+      }
+      case TREE_JOB_SIZE: {
+         struct stat st;
+         if (stat(job->src, &st) < 0) {
+            return errno;
+         }
+         OSAddAtomic64((volatile int64_t *) &worker->pool->totalSize, st.st_size);
+         return 0;
+      }
+   }
+   return EINVAL;
+}
+
+static int
+__wut_fsa_tree_worker_entry(int argc,
+                            const char **argv) {
+   __wut_fsa_tree_worker_t *worker = (__wut_fsa_tree_worker_t *) argv;
+   __wut_fsa_tree_pool_t *pool = worker->pool;
+
+   OSLockMutex(&pool->mutex);
+   while (true) {
+      while (!pool->head && !pool->stop) {
+         OSWaitCond(&pool->workCond, &pool->mutex);
+      }
+
+      __wut_fsa_tree_job_t *job = pool->head;
+      if (!job) {
+         break;
+      }
+
+      pool->head = job->next;
+      if (!pool->head) {
+         pool->tail = nullptr;
+      }
+
+      int err = 0;
+      if (pool->error == 0) {
+         OSUnlockMutex(&pool->mutex);
+         err = __wut_fsa_tree_run_job(worker, job);
+         OSLockMutex(&pool->mutex);
+      }
+
+      if (err && pool->error == 0) {
+         pool->error = err;
+      }
+
+      free(job);
+      if (--pool->pending == 0) {
+         OSSignalCond(&pool->doneCond);
+      }
+   }
+   OSUnlockMutex(&pool->mutex);
+
+   return 0;
+}
+
+static void
+__wut_fsa_tree_pool_stop(__wut_fsa_tree_pool_t *pool) {
+   OSLockMutex(&pool->mutex);
+   pool->stop = true;
+   OSSignalCond(&pool->workCond);
+   OSUnlockMutex(&pool->mutex);
+
+   for (uint32_t i = 0; i < pool->workerCount; ++i) {
+      OSJoinThread(&pool->workers[i].thread, nullptr);
+   }
+
+   for (uint32_t i = 0; i < TREE_WORKER_MAX; ++i) {
+      free(pool->workers[i].stack);
+      free(pool->workers[i].buffer);
+   }
+}
+
+static bool
+__wut_fsa_tree_pool_start(__wut_fsa_tree_pool_t *pool,
+                          bool needsBuffer) {
+   memset(pool, 0, sizeof(*pool));
+   OSInitMutexEx(&pool->mutex, "wut devoptab tree");
+   OSInitCond(&pool->workCond);
+   OSInitCond(&pool->doneCond);
+
+   // One worker per core, running at the priority of the caller
+   int priority = OSGetThreadPriority(OSGetCurrentThread());
+   for (uint32_t i = 0; i < TREE_WORKER_MAX; ++i) {
+      __wut_fsa_tree_worker_t *worker = &pool->workers[i];
+      worker->pool = pool;
+      worker->stack = (uint8_t *) memalign(16, TREE_WORKER_STACK_SIZE);
+      if (needsBuffer) {
+         worker->buffer = (uint8_t *) memalign(0x40, TREE_COPY_BUFFER_SIZE);
+      }
+      if (!worker->stack || (needsBuffer && !worker->buffer)) {
+         break;
+      }
+
+      if (!OSCreateThread(&worker->thread,
+                          __wut_fsa_tree_worker_entry,
+                          0,
+                          (char *) worker,
+                          worker->stack + TREE_WORKER_STACK_SIZE,
+                          TREE_WORKER_STACK_SIZE,
+                          priority,
+                          (OSThreadAttributes) (OS_THREAD_ATTRIB_AFFINITY_CPU0 << i))) {
+         break;
+      }
+
+      OSSetThreadName(&worker->thread, "wut devoptab tree worker");
+      OSResumeThread(&worker->thread);
+      ++pool->workerCount;
+   }
+
+   if (pool->workerCount == 0) {
+      WUT_DEBUG_REPORT("__wut_fsa_tree_pool_start: failed to start any worker\n");
+      __wut_fsa_tree_pool_stop(pool);
+      return false;
+   }
+
+   return true;
+}
+
+static int
+__wut_fsa_tree_submit(__wut_fsa_tree_pool_t *pool,
+                      __wut_fsa_tree_job_type_t type,
+                      const char *src,
+                      const char *dst) {
+   // Job and both paths in a single allocation
+   size_t srcLength = strlen(src) + 1;
+   size_t dstLength = dst ? strlen(dst) + 1 : 0;
+   __wut_fsa_tree_job_t *job = (__wut_fsa_tree_job_t *) malloc(sizeof(__wut_fsa_tree_job_t) + srcLength + dstLength);
+   if (!job) {
+      return ENOMEM;
+   }
+
+   job->next = nullptr;
+   job->type = type;
+   job->src = (char *) (job + 1);
+   memcpy(job->src, src, srcLength);
+   job->dst = nullptr;
+   if (dst) {
+      job->dst = job->src + srcLength;
+      memcpy(job->dst, dst, dstLength);
+   }
+
+   OSLockMutex(&pool->mutex);
+   int err = pool->error;
+   if (err == 0) {
+      if (pool->tail) {
+         pool->tail->next = job;
+      } else {
+         pool->head = job;
+      }
+      pool->tail = job;
+      ++pool->pending;
+      OSSignalCond(&pool->workCond);
+   }
+   OSUnlockMutex(&pool->mutex);
+
+   if (err) {
+      free(job);
+   }
+   return err;
+}
+
+static int
+__wut_fsa_tree_wait(__wut_fsa_tree_pool_t *pool) {
+   OSLockMutex(&pool->mutex);
+   while (pool->pending != 0) {
+      OSWaitCond(&pool->doneCond, &pool->mutex);
+   }
+   int err = pool->error;
+   OSUnlockMutex(&pool->mutex);
+   return err;
+}
+
+static bool
+__wut_fsa_tree_join(char *out,
+                    const char *dir,
+                    const char *name) {
+   size_t len = strlen(dir);
+   const char *sep = (len && dir[len - 1] == '/') ? "" : "/";
+   return snprintf(out, PATH_MAX, "%s%s%s", dir, sep, name) < PATH_MAX;
+}
+
+// Walks src on the calling thread and hands the per-file work to the pool.
+// Directories are created before and removed after their contents.
+static int
+__wut_fsa_tree_walk(__wut_fsa_tree_pool_t *pool,
+                    __wut_fsa_tree_job_type_t type,
+                    const char *src,
+                    const char *dst) {
+   if (type == TREE_JOB_COPY && mkdir(dst, 0777) < 0 && errno != EEXIST) {
+      return errno;
+   }
+
+   DIR *dir = opendir(src);
+   if (!dir) {
+      return errno;
+   }
+
+   int err = 0;
+   // Kept off the stack, the recursion can get deep
+   char *srcPath = (char *) malloc(PATH_MAX * 2);
+   if (!srcPath) {
+      closedir(dir);
+      return ENOMEM;
+   }
+   char *dstPath = srcPath + PATH_MAX;
+
+   struct dirent *entry;
+   while (err == 0 && (entry = readdir(dir)) != nullptr) {
+      if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+         continue;
+      }
+
+      if (!__wut_fsa_tree_join(srcPath, src, entry->d_name) ||
+          (type == TREE_JOB_COPY && !__wut_fsa_tree_join(dstPath, dst, entry->d_name))) {
+         err = ENAMETOOLONG;
+         break;
+      }
+
+      bool isDir = entry->d_type == DT_DIR;
+      if (entry->d_type == DT_UNKNOWN) {
+         struct stat st;
+         if (stat(srcPath, &st) < 0) {
+            err = errno;
+            break;
+         }
+         isDir = S_ISDIR(st.st_mode);
+      }
+
+      if (isDir) {
+         err = __wut_fsa_tree_walk(pool, type, srcPath, type == TREE_JOB_COPY ? dstPath : nullptr);
+      } else {
+         err = __wut_fsa_tree_submit(pool, type, srcPath, type == TREE_JOB_COPY ? dstPath : nullptr);
+      }
+   }
+
+   free(srcPath);
+   closedir(dir);
+
+   if (err == 0 && type == TREE_JOB_UNLINK) {
+      // The directory has to be empty before it can be removed
+      err = __wut_fsa_tree_wait(pool);
+      if (err == 0 && rmdir(src) < 0) {
+         err = errno;
+      }
+   }
+
+   return err;
+}
+
+static int
+__wut_fsa_tree_run(__wut_fsa_tree_job_type_t type,
+                   const char *src,
+                   const char *dst,
+                   uint64_t *outSize) {
+   if (!src || (type == TREE_JOB_COPY && !dst)) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   __wut_fsa_tree_pool_t *pool = (__wut_fsa_tree_pool_t *) malloc(sizeof(__wut_fsa_tree_pool_t));
+   if (!pool) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   if (!__wut_fsa_tree_pool_start(pool, type == TREE_JOB_COPY)) {
+      free(pool);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   int err = __wut_fsa_tree_walk(pool, type, src, dst);
+
+   // Let running jobs finish even if the walk failed
+   int jobErr = __wut_fsa_tree_wait(pool);
+   if (err == 0) {
+      err = jobErr;
+   }
+
+   if (outSize) {
+      *outSize = pool->totalSize;
+   }
+
+   __wut_fsa_tree_pool_stop(pool);
+   free(pool);
+
+   if (err) {
+      errno = err;
+      return -1;
+   }
+   return 0;
+}
+
+int
+WUTDevoptabCopyTree(const char *src,
+                    const char *dst) {
+   return __wut_fsa_tree_run(TREE_JOB_COPY, src, dst, nullptr);
+}
+
+int
+WUTDevoptabRemoveTree(const char *path) {
+   return __wut_fsa_tree_run(TREE_JOB_UNLINK, path, nullptr, nullptr);
+}
+
+int
+WUTDevoptabGetTreeSize(const char *path,
+                       uint64_t *outSize) {
+   if (!outSize) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   *outSize = 0;
+   return __wut_fsa_tree_run(TREE_JOB_SIZE, path, nullptr, outSize);
+}
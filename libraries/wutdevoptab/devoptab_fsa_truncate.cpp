@@ -5,6 +5,8 @@ int
 __wut_fsa_ftruncate(struct _reent *r,
                     void *fd,
                     off_t len) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_FTRUNCATE);
+   timer.setFile(fd);
    FSError status;
    __wut_fsa_file_t *file;
    __wut_fsa_device_t *deviceData;
@@ -21,19 +23,33 @@ __wut_fsa_ftruncate(struct _reent *r,
 
    std::scoped_lock lock(file->mutex);
 
+   status = __wut_fsa_flush_write_behind(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   __wut_fsa_invalidate_prefetch(file);
+   status = __wut_fsa_discard_read_ahead(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
    // Set the new file size
-   status = FSASetPosFile(deviceData->clientHandle, file->fd, len);
+   status = FSASetPosFile(file->clientHandle, file->fd, len);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSASetPosFile(0x%08X, 0x%08X, 0x%08X) failed: %s\n",
-                       deviceData->clientHandle, file->fd, len, FSAGetStatusStr(status));
+                       file->clientHandle, file->fd, len, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
 
-   status = FSATruncateFile(deviceData->clientHandle, file->fd);
+   status = FSATruncateFile(file->clientHandle, file->fd);
+   __wut_fsa_stat_cache_invalidate(deviceData, file->fullPath);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSATruncateFile(0x%08X, 0x%08X) failed: %s\n",
-                       deviceData->clientHandle, file->fd, FSAGetStatusStr(status));
+                       file->clientHandle, file->fd, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
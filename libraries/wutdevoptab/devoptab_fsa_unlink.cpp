@@ -3,8 +3,10 @@
 int
 __wut_fsa_unlink(struct _reent *r,
                  const char *name) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_UNLINK);
+   timer.setPath(name);
    FSError status;
-   char *fixedPath;
+   char fixedPath[FS_MAX_PATH + 1];
    __wut_fsa_device_t *deviceData;
 
    if (!name) {
@@ -12,23 +14,22 @@ __wut_fsa_unlink(struct _reent *r,
       return -1;
    }
 
-   fixedPath = __wut_fsa_fixpath(r, name);
-   if (!fixedPath) {
-      r->_errno = ENOMEM;
+   if (!__wut_fsa_fixpath(r, name, fixedPath)) {
       return -1;
    }
    deviceData = (__wut_fsa_device_t *) r->deviceData;
+   FSAClientHandle clientHandle = __wut_fsa_get_client(deviceData);
 
-   status = FSARemove(deviceData->clientHandle, fixedPath);
+   __wut_fsa_handle_cache_invalidate(deviceData, fixedPath);
+   __wut_fsa_save_sums_invalidate(deviceData, fixedPath);
+   status = FSARemove(clientHandle, fixedPath);
+   __wut_fsa_stat_cache_invalidate(deviceData, fixedPath);
    if (status < 0) {
       WUT_DEBUG_REPORT("FSARemove(0x%08X, %s) failed: %s\n",
-                       deviceData->clientHandle, fixedPath, FSAGetStatusStr(status));
-      free(fixedPath);
+                       clientHandle, fixedPath, FSAGetStatusStr(status));
       r->_errno = __wut_fsa_translate_error(status);
       return -1;
    }
 
-   free(fixedPath);
-
    return 0;
 }
@@ -1,21 +1,19 @@
 #include <cstdio>
 #include "devoptab_fsa.h"
-
-#define COMP_MAX      50
+#include <coreinit/cache.h>
 
 #define ispathsep(ch) ((ch) == '/' || (ch) == '\\')
 #define iseos(ch)     ((ch) == '\0')
 #define ispathend(ch) (ispathsep(ch) || iseos(ch))
 
-// https://gist.github.com/starwing/2761647
-static
-char *
-__wut_fsa_normpath(char *out, const char *in) {
-   char *pos[COMP_MAX], **top = pos, *head = out;
-   int isabs = ispathsep(*in);
-
-   if (isabs) *out++ = '/';
-   *top++ = out;
+// Appends the components of in to the absolute path in out, resolving any ".", ".." or "//" on the way.
+// out always ends with a '/' in between calls, trailing is set if the last component should keep it.
+static bool
+__wut_fsa_normpath_append(char *out,
+                          size_t *length,
+                          bool *trailing,
+                          const char *in) {
+   size_t len = *length;
 
    while (!iseos(*in)) {
       while (ispathsep(*in)) {
@@ -26,130 +24,216 @@ __wut_fsa_normpath(char *out, const char *in) {
          break;
       }
 
-      if (memcmp(in, ".", 1) == 0 && ispathend(in[1])) {
-         ++in;
+      if (in[0] == '.' && ispathend(in[1])) {
+         in += 1;
+         *trailing = true;
          continue;
       }
 
-      if (memcmp(in, "..", 2) == 0 && ispathend(in[2])) {
+      if (in[0] == '.' && in[1] == '.' && ispathend(in[2])) {
          in += 2;
-         if (top != pos + 1) {
-            out = *--top;
-         } else if (isabs) {
-            out = top[-1];
-         } else {
-            strcpy(out, "../");
-            out += 3;
+         *trailing = true;
+
+         // Drop the previous component, ".." at the root stays at the root
+         if (len > 1) {
+            --len;
+            while (out[len - 1] != '/') {
+               --len;
+            }
          }
          continue;
       }
 
-      if (top - pos >= COMP_MAX) {
-         return NULL; // path to complicate
-      }
-
-      *top++ = out;
+      const char *component = in;
       while (!ispathend(*in)) {
-         *out++ = *in++;
+         ++in;
       }
-      if (ispathsep(*in)) {
-         *out++ = '/';
+
+      size_t componentLength = in - component;
+      if (len + componentLength + 1 > FS_MAX_PATH + 1) {
+         return false;
       }
-   }
 
-   *out = '\0';
-   if (*head == '\0') {
-      strcpy(head, "./");
+      memcpy(out + len, component, componentLength);
+      len += componentLength;
+      out[len++] = '/';
+      *trailing = ispathsep(*in);
    }
-   return head;
+
+   *length = len;
+   return true;
 }
 
 uint32_t
-__wut_fsa_hashstring(const char *str) {
-   uint32_t h;
+__wut_fsa_hashstring_append(uint32_t h, const char *str) {
    uint8_t *p;
 
-   h = 0;
    for (p = (uint8_t *) str; *p != '\0'; p++) {
       h = 37 * h + *p;
    }
    return h;
 }
 
+uint32_t
+__wut_fsa_hashstring(const char *str) {
+   return __wut_fsa_hashstring_append(0, str);
+}
+
 char *
 __wut_fsa_fixpath(struct _reent *r,
-                  const char *path) {
-   char *p;
-   char *fixedPath;
+                  const char *path,
+                  char *out) {
+   const char *p;
 
    if (!path) {
       r->_errno = EINVAL;
       return NULL;
    }
 
-   p = strchr(path, ':') + 1;
-   if (!strchr(path, ':')) {
-      p = (char *) path;
-   }
+   p = strchr(path, ':');
+   p = p ? p + 1 : path;
 
    // wii u softlocks on empty strings so give expected error back
-   if (strlen(p) == 0) {
+   if (p[0] == '\0') {
       r->_errno = ENOENT;
       return NULL;
    }
 
-   int maxPathLength = PATH_MAX;
-   fixedPath = static_cast<char *>(memalign(0x40, maxPathLength));
-   if (!fixedPath) {
-      WUT_DEBUG_REPORT("__wut_fsa_fixpath: failed to allocate memory for fixedPath\n");
-      r->_errno = ENOMEM;
-      return NULL;
-   }
+   size_t length = 1;
+   bool trailing = true;
+   out[0] = '/';
 
-   // Convert to an absolute path
-   if (p[0] != '\0' && p[0] != '\\' && p[0] != '/') {
+   // Convert to an absolute path and normalize it in one go, the cwd is already absolute
+   if (!ispathsep(p[0])) {
       __wut_fsa_device_t *deviceData = (__wut_fsa_device_t *) r->deviceData;
-      if (snprintf(fixedPath, maxPathLength, "%s/%s", deviceData->cwd, p) >= maxPathLength) {
-         WUT_DEBUG_REPORT("__wut_fsa_fixpath: fixedPath snprintf result (absolute) was truncated\n");
-      }
-   } else {
-      if (snprintf(fixedPath, maxPathLength, "%s", p) >= maxPathLength) {
-         WUT_DEBUG_REPORT("__wut_fsa_fixpath: fixedPath snprintf result (relative) was truncated\n");
+      if (!__wut_fsa_normpath_append(out, &length, &trailing, deviceData->cwd)) {
+         r->_errno = ENAMETOOLONG;
+         return NULL;
       }
    }
 
-   // Normalize path (resolve any ".", "..", or "//")
-   char *normalizedPath = strdup(fixedPath);
-   if (!normalizedPath) {
-      WUT_DEBUG_REPORT("__wut_fsa_fixpath: failed to allocate memory for normalizedPath\n");
-      free(fixedPath);
-      r->_errno = ENOMEM;
+   if (!__wut_fsa_normpath_append(out, &length, &trailing, p)) {
+      r->_errno = ENAMETOOLONG;
       return NULL;
    }
 
-   char *resPath = __wut_fsa_normpath(normalizedPath, fixedPath);
-   if (!resPath) {
-      WUT_DEBUG_REPORT("__wut_fsa_fixpath: failed to normalize path\n");
-      free(normalizedPath);
-      free(fixedPath);
-      r->_errno = EIO;
+   if (!trailing && length > 1) {
+      --length;
+   }
+
+   if (length > FS_MAX_PATH) {
+      r->_errno = ENAMETOOLONG;
       return NULL;
    }
 
-   if (snprintf(fixedPath, maxPathLength, "%s", resPath) >= maxPathLength) {
-      WUT_DEBUG_REPORT("__wut_fsa_fixpath: fixedPath snprintf result (relative) was truncated\n");
+   out[length] = '\0';
+   return out;
+}
+
+FSError
+__wut_fsa_discard_read_ahead(__wut_fsa_device_t *deviceData,
+                             __wut_fsa_file_t *file) {
+   bool pending = file->readAheadPos != file->readAheadLength || file->positionStale;
+
+   file->readAheadLength = 0;
+   file->readAheadPos = 0;
+   file->positionStale = false;
+
+   if (!pending) {
+      return FS_ERROR_OK;
    }
 
-   free(normalizedPath);
+   // The FSA file position is ahead of file->offset while buffered data is left, move it back
+   FSError status = FSASetPosFile(file->clientHandle, file->fd, file->offset);
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSASetPosFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
+                       file->clientHandle, file->fd, file->offset, file->fullPath, FSAGetStatusStr(status));
+   }
+   return status;
+}
 
-   size_t pathLength = strlen(fixedPath);
-   if (pathLength > FS_MAX_PATH) {
-      free(fixedPath);
-      r->_errno = ENAMETOOLONG;
-      return NULL;
+void
+__wut_fsa_invalidate_prefetch(__wut_fsa_file_t *file) {
+   // A prefetch in flight may read the old data too
+   if (file->prefetchBuffer) {
+      file->prefetchInvalid = true;
+   }
+}
+
+FSError
+__wut_fsa_sync_position(__wut_fsa_file_t *file) {
+   if (!file->positionStale) {
+      return FS_ERROR_OK;
+   }
+
+   FSError status = FSASetPosFile(file->clientHandle, file->fd, file->offset);
+   if (status < 0) {
+      WUT_DEBUG_REPORT("FSASetPosFile(0x%08X, 0x%08X, 0x%08X) (%s) failed: %s\n",
+                       file->clientHandle, file->fd, file->offset, file->fullPath, FSAGetStatusStr(status));
+      return status;
+   }
+
+   file->positionStale = false;
+   return FS_ERROR_OK;
+}
+
+uint32_t
+__wut_fsa_prefetch_available(__wut_fsa_file_t *file,
+                             uint32_t offset,
+                             const uint8_t **outData) {
+   if (!file->prefetchBuffer || !file->prefetchRequest.done || file->prefetchInvalid) {
+      return 0;
+   }
+
+   // done is set after result by the async I/O thread
+   OSMemoryBarrier();
+   ssize_t length = file->prefetchRequest.result;
+   uint32_t start = (uint32_t) file->prefetchRequest.offset;
+   if (length <= 0 || offset < start || offset - start >= (uint32_t) length) {
+      return 0;
+   }
+
+   *outData = file->prefetchBuffer + (offset - start);
+   return (uint32_t) length - (offset - start);
+}
+
+FSError
+__wut_fsa_flush_write_behind(__wut_fsa_device_t *deviceData,
+                             __wut_fsa_file_t *file) {
+   uint32_t written = 0;
+
+   if (file->writeBehindLength != 0) {
+      __wut_fsa_stat_cache_invalidate(deviceData, file->fullPath);
    }
 
-   return fixedPath;
+   while (written < file->writeBehindLength) {
+      uint32_t size = file->writeBehindLength - written;
+
+      // Limit each request to 256 KiB by default
+      if (__wut_fsa_write_chunk_size && size > __wut_fsa_write_chunk_size) {
+         size = __wut_fsa_write_chunk_size;
+      }
+
+      FSError status = FSAWriteFile(file->clientHandle, file->writeBehindBuffer + written, 1, size, file->fd, 0);
+      __wut_fsa_stats_add_write(deviceData, status, false);
+      if (status < 0 || (uint32_t) status != size) {
+         WUT_DEBUG_REPORT("FSAWriteFile(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
+                          file->clientHandle, file->writeBehindBuffer + written, size, file->fd, file->fullPath, FSAGetStatusStr(status));
+
+         // Keep whatever hasn't been written yet so a later flush can retry
+         if (status > 0) {
+            written += status;
+         }
+         memmove(file->writeBehindBuffer, file->writeBehindBuffer + written, file->writeBehindLength - written);
+         file->writeBehindLength -= written;
+         return status < 0 ? status : FS_ERROR_STORAGE_FULL;
+      }
+
+      written += status;
+   }
+
+   file->writeBehindLength = 0;
+   return FS_ERROR_OK;
 }
 
 mode_t __wut_fsa_translate_stat_mode(FSStat *fsStat) {
@@ -189,8 +273,14 @@ void __wut_fsa_translate_stat(FSAClientHandle clientHandle, FSStat *fsStat, ino_
    posStat->st_atime = __wut_fsa_translate_time(fsStat->modified);
    posStat->st_ctime = __wut_fsa_translate_time(fsStat->created);
    posStat->st_mtime = __wut_fsa_translate_time(fsStat->modified);
-   posStat->st_blksize = 512;
-   posStat->st_blocks = (posStat->st_size + posStat->st_blksize - 1) / posStat->st_size;
+   // newlib sizes a stream's buffer from st_blksize, with a large one every
+   // refill of a buffered file is a single aligned FSAReadFile
+   if (S_ISREG(posStat->st_mode) && __wut_fsa_stdio_buffer_size) {
+      posStat->st_blksize = __wut_fsa_stdio_buffer_size;
+   } else {
+      posStat->st_blksize = 512;
+   }
+   posStat->st_blocks = (posStat->st_size + 511) / 512;
 }
 
 int __wut_fsa_translate_error(FSError error) {
@@ -2,6 +2,8 @@
 #include <mutex>
 
 ssize_t __wut_fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len) {
+   __wut_fsa_op_timer timer(r, WUT_DEVOPTAB_OP_WRITE);
+   timer.setFile(fd);
    FSError status;
    __wut_fsa_file_t *file;
    __wut_fsa_device_t *deviceData;
@@ -25,12 +27,50 @@ ssize_t __wut_fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len)
 
    std::scoped_lock lock(file->mutex);
 
+   // Buffered data would be stale after the write
+   __wut_fsa_invalidate_prefetch(file);
+   status = __wut_fsa_discard_read_ahead(deviceData, file);
+   if (status < 0) {
+      r->_errno = __wut_fsa_translate_error(status);
+      return -1;
+   }
+
+   __wut_fsa_stat_cache_invalidate(deviceData, file->fullPath);
+
    // If O_APPEND is set, we always write to the end of the file.
    // When writing we file->offset to the file size to keep in sync.
    if (file->flags & O_APPEND) {
       file->offset = file->appendOffset;
    }
 
+   // FSA file positions are 32-bit, see __wut_fsa_file_t::offset
+   if ((uint64_t) file->offset + len > UINT32_MAX) {
+      len = UINT32_MAX - file->offset;
+      if (len == 0) {
+         r->_errno = EFBIG;
+         return -1;
+      }
+   }
+
+   if (file->writeBehindBuffer) {
+      if (file->writeBehindLength + len > file->writeBehindSize) {
+         status = __wut_fsa_flush_write_behind(deviceData, file);
+         if (status < 0) {
+            r->_errno = __wut_fsa_translate_error(status);
+            return -1;
+         }
+      }
+
+      // Writes at least as large as the buffer go straight to the FSA below
+      if (len < file->writeBehindSize) {
+         memcpy(file->writeBehindBuffer + file->writeBehindLength, ptr, len);
+         file->writeBehindLength += len;
+         file->appendOffset += len;
+         file->offset += len;
+         return timer.result(len);
+      }
+   }
+
    size_t bytesWritten = 0;
    while (bytesWritten < len) {
       // only use input buffer if cache-aligned and write size is a multiple of cache line size
@@ -38,7 +78,9 @@ ssize_t __wut_fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len)
       uint8_t *tmp = (uint8_t *) ptr;
       size_t size = len - bytesWritten;
 
-      if (size < 0x40) {
+      if ((file->flags & O_DIRECT) && !((uintptr_t) ptr & 0x3F)) {
+         // O_DIRECT: write straight from the aligned input buffer
+      } else if (size < 0x40) {
          // write partial cache-line back-end
          tmp = alignedBuffer;
       } else if ((uintptr_t) ptr & 0x3F) {
@@ -50,21 +92,22 @@ ssize_t __wut_fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len)
          size &= ~0x3F;
       }
 
-      // Limit each request to 256 KiB
-      if (size > 0x40000) {
-         size = 0x40000;
+      // Limit each request to 256 KiB by default
+      if (__wut_fsa_write_chunk_size && size > __wut_fsa_write_chunk_size) {
+         size = __wut_fsa_write_chunk_size;
       }
 
       if (tmp == alignedBuffer) {
          memcpy(tmp, ptr, size);
       }
 
-      status = FSAWriteFile(deviceData->clientHandle, tmp, 1, size, file->fd, 0);
+      status = FSAWriteFile(file->clientHandle, tmp, 1, size, file->fd, 0);
+      __wut_fsa_stats_add_write(deviceData, status, tmp == alignedBuffer);
       if (status < 0) {
          WUT_DEBUG_REPORT("FSAWriteFile(0x%08X, 0x%08X, 1, 0x%08X, 0x%08X, 0) (%s) failed: %s\n",
-                          deviceData->clientHandle, tmp, size, file->fd, file->fullPath, FSAGetStatusStr(status));
+                          file->clientHandle, tmp, size, file->fd, file->fullPath, FSAGetStatusStr(status));
          if (bytesWritten != 0) {
-            return bytesWritten; // error after partial write
+            return timer.result(bytesWritten); // error after partial write
          }
 
          r->_errno = __wut_fsa_translate_error(status);
@@ -77,9 +120,9 @@ ssize_t __wut_fsa_write(struct _reent *r, void *fd, const char *ptr, size_t len)
       ptr += status;
 
       if ((size_t) status != size) {
-         return bytesWritten; // partial write
+         return timer.result(bytesWritten); // partial write
       }
    }
 
-   return bytesWritten;
+   return timer.result(bytesWritten);
 }
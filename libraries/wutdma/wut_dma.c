@@ -0,0 +1,124 @@
+#include <wut_dma.h>
+#include <coreinit/cache.h>
+#include <dmae/mem.h>
+#include <string.h>
+
+#define DMA_CACHE_LINE 0x40
+
+// Each request stays within the 16-bit dword count of a DMA packet
+#define DMA_MAX_CHUNK  (0x10000 * 4 - DMA_CACHE_LINE)
+
+//! Split [dst, dst + size) into partial lines at the ends and whole lines
+//! in between, FALSE if there are no whole lines.
+static BOOL
+__wut_dma_split(uint8_t *dst,
+                size_t size,
+                uint8_t **outStart,
+                uint8_t **outEnd)
+{
+   uintptr_t start = ((uintptr_t)dst + DMA_CACHE_LINE - 1) & ~(DMA_CACHE_LINE - 1);
+   uintptr_t end = ((uintptr_t)dst + size) & ~(DMA_CACHE_LINE - 1);
+
+   if (end <= start) {
+      return FALSE;
+   }
+
+   *outStart = (uint8_t *)start;
+   *outEnd = (uint8_t *)end;
+   return TRUE;
+}
+
+WUTDmaFence
+wut_dma_copy_async(void *dst,
+                   const void *src,
+                   size_t size)
+{
+   WUTDmaFence fence = { 0 };
+   uint8_t *d = (uint8_t *)dst;
+   const uint8_t *s = (const uint8_t *)src;
+   uint8_t *start, *end;
+
+   // DMA copies whole words, so both need the same alignment
+   if ((((uintptr_t)d ^ (uintptr_t)s) & 3) || !__wut_dma_split(d, size, &start, &end)) {
+      memcpy(dst, src, size);
+      return fence;
+   }
+
+   memcpy(d, s, start - d);
+   memcpy(end, s + (end - d), d + size - end);
+
+   s += start - d;
+   DCStoreRange((void *)s, end - start);
+   DCFlushRange(start, end - start);
+
+   for (uint8_t *chunk = start; chunk < end; chunk += DMA_MAX_CHUNK) {
+      uint32_t chunkSize = (end - chunk) < DMA_MAX_CHUNK ? (end - chunk) : DMA_MAX_CHUNK;
+      fence.timestamp = DMAECopyMem(chunk, s + (chunk - start), chunkSize / 4, DMAE_SWAP_NONE);
+   }
+
+   fence.invalidateAddr = start;
+   fence.invalidateSize = end - start;
+   return fence;
+}
+
+WUTDmaFence
+wut_dma_fill_async(void *dst,
+                   int c,
+                   size_t size)
+{
+   WUTDmaFence fence = { 0 };
+   uint8_t *d = (uint8_t *)dst;
+   uint8_t *start, *end;
+   uint32_t value = (uint8_t)c * 0x01010101u;
+
+   if (!__wut_dma_split(d, size, &start, &end)) {
+      memset(dst, c, size);
+      return fence;
+   }
+
+   memset(d, c, start - d);
+   memset(end, c, d + size - end);
+
+   DCFlushRange(start, end - start);
+
+   for (uint8_t *chunk = start; chunk < end; chunk += DMA_MAX_CHUNK) {
+      uint32_t chunkSize = (end - chunk) < DMA_MAX_CHUNK ? (end - chunk) : DMA_MAX_CHUNK;
+      fence.timestamp = DMAEFillMem(chunk, value, chunkSize / 4);
+   }
+
+   fence.invalidateAddr = start;
+   fence.invalidateSize = end - start;
+   return fence;
+}
+
+static void
+__wut_dma_fence_complete(WUTDmaFence *fence)
+{
+   // Drop any lines of the destination that were fetched during the copy
+   if (fence->invalidateSize) {
+      DCInvalidateRange(fence->invalidateAddr, fence->invalidateSize);
+      fence->invalidateSize = 0;
+   }
+}
+
+BOOL
+wut_dma_fence_is_done(WUTDmaFence *fence)
+{
+   if (fence->timestamp && DMAEGetRetiredTimeStamp() < fence->timestamp) {
+      return FALSE;
+   }
+
+   __wut_dma_fence_complete(fence);
+   return TRUE;
+}
+
+BOOL
+wut_dma_fence_wait(WUTDmaFence *fence)
+{
+   if (fence->timestamp && !DMAEWaitDone(fence->timestamp)) {
+      return FALSE;
+   }
+
+   __wut_dma_fence_complete(fence);
+   return TRUE;
+}
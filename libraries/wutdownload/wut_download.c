@@ -0,0 +1,1015 @@
+#include <wut_download.h>
+#include <wut_connect.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define DOWNLOAD_DEFAULT_CONNECTIONS   4
+#define DOWNLOAD_DEFAULT_CHUNK_SIZE    (1024 * 1024)
+#define DOWNLOAD_DEFAULT_BUFFER_SIZE   (64 * 1024)
+#define DOWNLOAD_DEFAULT_TIMEOUT       10000
+#define DOWNLOAD_DEFAULT_PRIORITY      16
+#define DOWNLOAD_STACK_SIZE            (16 * 1024)
+#define DOWNLOAD_MAX_ATTEMPTS          3
+#define DOWNLOAD_CONNECT_STAGGER       250
+#define DOWNLOAD_HOST_SIZE             256
+#define DOWNLOAD_ETAG_SIZE             64
+#define DOWNLOAD_REQUEST_SIZE          2048
+
+#define DOWNLOAD_JOURNAL_MAGIC         0x57444C4A
+#define DOWNLOAD_JOURNAL_VERSION       1
+
+typedef struct
+{
+   uint32_t magic;
+   uint32_t version;
+   uint64_t totalSize;
+   uint32_t chunkSize;
+   uint32_t chunkCount;
+   char etag[DOWNLOAD_ETAG_SIZE];
+} __wut_download_journal_t;
+
+typedef struct
+{
+   int status;
+   BOOL keepAlive;
+   BOOL chunked;
+
+   //! -1 if the response has no Content-Length.
+   int64_t contentLength;
+
+   //! Parsed from Content-Range, totalSize is 0 if it is not known.
+   BOOL hasRange;
+   uint64_t rangeStart;
+   uint64_t rangeEnd;
+   uint64_t totalSize;
+
+   char etag[DOWNLOAD_ETAG_SIZE];
+
+   //! Body bytes received with the headers, at the start of the buffer.
+   uint32_t bodyBytes;
+} __wut_download_response_t;
+
+typedef struct
+{
+   WUTDownload *download;
+   int sock;
+   char *buffer;
+   void *stack;
+   BOOL created;
+   OSThread thread;
+} __wut_download_worker_t;
+
+struct WUTDownload
+{
+   OSMutex mutex;
+   WUTDownloadOptions options;
+
+   char host[DOWNLOAD_HOST_SIZE];
+   char port[8];
+   char *target;
+   char *path;
+   char *journalPath;
+   struct addrinfo *addresses;
+
+   int fd;
+   int journalFd;
+   char etag[DOWNLOAD_ETAG_SIZE];
+   uint64_t totalSize;
+   uint32_t chunkCount;
+   uint8_t *chunkDone;
+
+   //! Protected by mutex.
+   uint32_t nextChunk;
+   uint32_t chunksDone;
+   uint64_t downloaded;
+   int error;
+   int httpStatus;
+
+   volatile uint32_t stop;
+   volatile uint32_t done;
+   BOOL joined;
+
+   //! The first worker sets the download up and then downloads with the
+   //! others.
+   __wut_download_worker_t workers[WUT_DOWNLOAD_MAX_CONNECTIONS];
+};
+
+static void
+__wut_download_fail(WUTDownload *download,
+                    int error)
+{
+   OSLockMutex(&download->mutex);
+   if (!download->error) {
+      download->error = error;
+   }
+   download->stop = 1;
+   OSUnlockMutex(&download->mutex);
+}
+
+static BOOL
+__wut_download_parse_url(WUTDownload *download,
+                         const char *url)
+{
+   const char *host, *end, *port;
+   size_t hostLength;
+
+   if (strncasecmp(url, "http://", 7) != 0) {
+      return FALSE;
+   }
+
+   host = url + 7;
+   end = host + strcspn(host, "/?#");
+   port = memchr(host, ':', end - host);
+   hostLength = (port ? port : end) - host;
+   if (!hostLength || hostLength >= DOWNLOAD_HOST_SIZE) {
+      return FALSE;
+   }
+
+   memcpy(download->host, host, hostLength);
+   download->host[hostLength] = 0;
+
+   if (port) {
+      size_t portLength = end - (port + 1);
+      if (!portLength || portLength >= sizeof(download->port)) {
+         return FALSE;
+      }
+
+      memcpy(download->port, port + 1, portLength);
+      download->port[portLength] = 0;
+   } else {
+      strcpy(download->port, "80");
+   }
+
+   // The fragment is never sent to the server
+   if (*end == '/' || *end == '?') {
+      download->target = strndup(end, strcspn(end, "#"));
+   } else {
+      download->target = strdup("/");
+   }
+
+   return download->target != NULL;
+}
+
+static void
+__wut_download_close(__wut_download_worker_t *worker)
+{
+   if (worker->sock != -1) {
+      close(worker->sock);
+      worker->sock = -1;
+   }
+}
+
+// Data that is already there is taken without waiting, select is only
+// used to time out a receive that would block
+static int
+__wut_download_recv(__wut_download_worker_t *worker,
+                    char *buf,
+                    uint32_t len)
+{
+   struct timeval tv;
+   fd_set rd;
+   int rc;
+
+   rc = recv(worker->sock, buf, len, MSG_DONTWAIT);
+   if (rc >= 0 || (errno != EWOULDBLOCK && errno != EAGAIN)) {
+      return rc;
+   }
+
+   FD_ZERO(&rd);
+   FD_SET(worker->sock, &rd);
+   tv.tv_sec = worker->download->options.timeoutMs / 1000;
+   tv.tv_usec = (worker->download->options.timeoutMs % 1000) * 1000;
+
+   rc = select(worker->sock + 1, &rd, NULL, NULL, &tv);
+   if (rc <= 0) {
+      if (rc == 0) {
+         errno = ETIMEDOUT;
+      }
+      return -1;
+   }
+
+   return recv(worker->sock, buf, len, 0);
+}
+
+static void
+__wut_download_header_value(const char *line,
+                            char *value,
+                            size_t size)
+{
+   size_t length;
+
+   line += strspn(line, " \t");
+   length = strcspn(line, "\r\n");
+   while (length && (line[length - 1] == ' ' || line[length - 1] == '\t')) {
+      --length;
+   }
+
+   if (length >= size) {
+      length = size - 1;
+   }
+
+   memcpy(value, line, length);
+   value[length] = 0;
+}
+
+static int
+__wut_download_parse_response(char *headers,
+                              __wut_download_response_t *response)
+{
+   int major, minor;
+   char *line;
+
+   memset(response, 0, sizeof(__wut_download_response_t));
+   response->contentLength = -1;
+
+   if (sscanf(headers, "HTTP/%d.%d %d", &major, &minor, &response->status) != 3) {
+      return -1;
+   }
+
+   response->keepAlive = (major > 1 || (major == 1 && minor >= 1));
+
+   for (line = strstr(headers, "\r\n"); line && line[2] != '\r'; line = strstr(line + 2, "\r\n")) {
+      char value[DOWNLOAD_ETAG_SIZE];
+      char *name = line + 2;
+
+      if (!strncasecmp(name, "Content-Length:", 15)) {
+         __wut_download_header_value(name + 15, value, sizeof(value));
+         response->contentLength = strtoll(value, NULL, 10);
+      } else if (!strncasecmp(name, "Content-Range:", 14)) {
+         unsigned long long start, end, total;
+         __wut_download_header_value(name + 14, value, sizeof(value));
+         if (sscanf(value, "bytes %llu-%llu/%llu", &start, &end, &total) == 3) {
+            response->totalSize = total;
+         } else if (sscanf(value, "bytes */%llu", &total) == 1) {
+            response->totalSize = total;
+            continue;
+         } else if (sscanf(value, "bytes %llu-%llu/*", &start, &end) != 2) {
+            continue;
+         }
+
+         response->hasRange = TRUE;
+         response->rangeStart = start;
+         response->rangeEnd = end;
+      } else if (!strncasecmp(name, "Connection:", 11)) {
+         __wut_download_header_value(name + 11, value, sizeof(value));
+         if (!strcasecmp(value, "close")) {
+            response->keepAlive = FALSE;
+         } else if (!strcasecmp(value, "keep-alive")) {
+            response->keepAlive = TRUE;
+         }
+      } else if (!strncasecmp(name, "Transfer-Encoding:", 18)) {
+         __wut_download_header_value(name + 18, value, sizeof(value));
+         for (char *c = value; *c; ++c) {
+            *c = tolower((unsigned char)*c);
+         }
+         response->chunked = strstr(value, "chunked") != NULL;
+      } else if (!strncasecmp(name, "ETag:", 5)) {
+         __wut_download_header_value(name + 5, response->etag, sizeof(response->etag));
+      }
+   }
+
+   return 0;
+}
+
+// Sends a range request and receives the response headers, connecting first
+// if the worker has no connection left from its last request
+static int
+__wut_download_request(__wut_download_worker_t *worker,
+                       uint64_t first,
+                       uint64_t last,
+                       __wut_download_response_t *response)
+{
+   WUTDownload *download = worker->download;
+   uint32_t bufferSize = download->options.bufferSize;
+   char request[DOWNLOAD_REQUEST_SIZE];
+   uint32_t used = 0, headerLength;
+   int length, sent = 0;
+   char *end;
+
+   if (worker->sock == -1) {
+      worker->sock = wut_connect_race(download->addresses,
+                                      DOWNLOAD_CONNECT_STAGGER,
+                                      download->options.timeoutMs);
+      if (worker->sock == -1) {
+         return -1;
+      }
+   }
+
+   length = snprintf(request, sizeof(request),
+                     "GET %s HTTP/1.1\r\n"
+                     "Host: %s\r\n"
+                     "Range: bytes=%llu-%llu\r\n"
+                     "Connection: keep-alive\r\n"
+                     "\r\n",
+                     download->target, download->host,
+                     (unsigned long long)first, (unsigned long long)last);
+   if (length < 0 || length >= (int)sizeof(request)) {
+      errno = ENAMETOOLONG;
+      return -1;
+   }
+
+   while (sent < length) {
+      int rc = send(worker->sock, request + sent, length - sent, 0);
+      if (rc < 0) {
+         return -1;
+      }
+      sent += rc;
+   }
+
+   while (TRUE) {
+      int rc;
+
+      if (used >= bufferSize - 1) {
+         errno = EPROTO;
+         return -1;
+      }
+
+      rc = __wut_download_recv(worker, worker->buffer + used, bufferSize - 1 - used);
+      if (rc <= 0) {
+         if (rc == 0) {
+            errno = ECONNRESET;
+         }
+         return -1;
+      }
+
+      used += rc;
+      worker->buffer[used] = 0;
+
+      end = strstr(worker->buffer, "\r\n\r\n");
+      if (end) {
+         break;
+      }
+   }
+
+   headerLength = (uint32_t)(end + 4 - worker->buffer);
+   if (__wut_download_parse_response(worker->buffer, response) != 0) {
+      errno = EPROTO;
+      return -1;
+   }
+
+   // Keep the start of the body at the start of the buffer
+   response->bodyBytes = used - headerLength;
+   memmove(worker->buffer, worker->buffer + headerLength, response->bodyBytes);
+   return 0;
+}
+
+static void
+__wut_download_add_progress(WUTDownload *download,
+                            int64_t bytes)
+{
+   OSLockMutex(&download->mutex);
+   download->downloaded += bytes;
+   OSUnlockMutex(&download->mutex);
+}
+
+// Receives length bytes of body, writing them to the file at offset if it
+// is not -1, in writes of up to a whole buffer
+static int
+__wut_download_body(__wut_download_worker_t *worker,
+                    __wut_download_response_t *response,
+                    int64_t offset,
+                    uint64_t length,
+                    uint64_t *outWritten)
+{
+   WUTDownload *download = worker->download;
+   uint32_t bufferSize = download->options.bufferSize;
+   uint32_t used = response->bodyBytes;
+
+   *outWritten = 0;
+
+   // More than the body means the connection can't be reused
+   if (used > length) {
+      used = (uint32_t)length;
+      response->keepAlive = FALSE;
+   }
+
+   while (length) {
+      uint32_t size;
+
+      while (used < bufferSize && used < length) {
+         int rc;
+
+         if (download->stop) {
+            errno = ECANCELED;
+            return -1;
+         }
+
+         size = bufferSize - used;
+         if (size > length - used) {
+            size = (uint32_t)(length - used);
+         }
+
+         rc = __wut_download_recv(worker, worker->buffer + used, size);
+         if (rc <= 0) {
+            if (rc == 0) {
+               errno = ECONNRESET;
+            }
+            return -1;
+         }
+
+         used += rc;
+      }
+
+      if (offset >= 0) {
+         uint32_t written = 0;
+
+         while (written < used) {
+            ssize_t rc = pwrite(download->fd, worker->buffer + written, used - written,
+                                offset + written);
+            if (rc <= 0) {
+               if (rc == 0) {
+                  errno = EIO;
+               }
+               return -1;
+            }
+            written += rc;
+         }
+
+         offset += used;
+         *outWritten += used;
+         __wut_download_add_progress(download, used);
+      }
+
+      length -= used;
+      used = 0;
+   }
+
+   return 0;
+}
+
+static uint64_t
+__wut_download_body_length(__wut_download_response_t *response)
+{
+   if (response->contentLength >= 0) {
+      return (uint64_t)response->contentLength;
+   }
+
+   return response->hasRange ? response->rangeEnd - response->rangeStart + 1 : 0;
+}
+
+static void
+__wut_download_chunk_done(WUTDownload *download,
+                          uint32_t index)
+{
+   // The data has to be on the card before the journal says it is
+   if (download->journalFd != -1) {
+      fsync(download->fd);
+   }
+
+   OSLockMutex(&download->mutex);
+   download->chunkDone[index / 8] |= 1 << (index % 8);
+   download->chunksDone++;
+   if (download->journalFd != -1) {
+      pwrite(download->journalFd, &download->chunkDone[index / 8], 1,
+             sizeof(__wut_download_journal_t) + index / 8);
+   }
+   OSUnlockMutex(&download->mutex);
+}
+
+static int
+__wut_download_chunk(__wut_download_worker_t *worker,
+                     uint32_t index)
+{
+   WUTDownload *download = worker->download;
+   uint64_t first = (uint64_t)index * download->options.chunkSize;
+   uint64_t last = first + download->options.chunkSize - 1;
+   int error = EIO;
+
+   if (last >= download->totalSize) {
+      last = download->totalSize - 1;
+   }
+
+   for (uint32_t attempt = 0; attempt < DOWNLOAD_MAX_ATTEMPTS && !download->stop; ++attempt) {
+      __wut_download_response_t response;
+      uint64_t written = 0;
+      int rc;
+
+      rc = __wut_download_request(worker, first, last, &response);
+      if (rc == 0 && response.status != 206) {
+         // Not worth retrying, the server won't answer differently
+         OSLockMutex(&download->mutex);
+         download->httpStatus = response.status;
+         OSUnlockMutex(&download->mutex);
+         __wut_download_close(worker);
+         errno = (response.status >= 200 && response.status < 300) ? EPROTO : EIO;
+         return -1;
+      }
+
+      if (rc == 0 && (response.chunked || !response.hasRange
+                   || response.rangeStart != first || response.rangeEnd != last
+                   || (response.totalSize && response.totalSize != download->totalSize)
+                   || __wut_download_body_length(&response) != last - first + 1)) {
+         __wut_download_close(worker);
+         errno = EPROTO;
+         return -1;
+      }
+
+      if (rc == 0) {
+         rc = __wut_download_body(worker, &response, (int64_t)first, last - first + 1, &written);
+      }
+
+      if (rc == 0) {
+         if (!response.keepAlive) {
+            __wut_download_close(worker);
+         }
+
+         __wut_download_chunk_done(download, index);
+         return 0;
+      }
+
+      // Start the chunk over on a new connection
+      error = errno;
+      __wut_download_close(worker);
+      __wut_download_add_progress(download, -(int64_t)written);
+   }
+
+   errno = download->stop ? ECANCELED : error;
+   return -1;
+}
+
+static int
+__wut_download_next_chunk(WUTDownload *download)
+{
+   int index = -1;
+
+   OSLockMutex(&download->mutex);
+   while (download->nextChunk < download->chunkCount
+       && (download->chunkDone[download->nextChunk / 8] & (1 << (download->nextChunk % 8)))) {
+      download->nextChunk++;
+   }
+
+   if (!download->stop && download->nextChunk < download->chunkCount) {
+      index = (int)download->nextChunk++;
+   }
+   OSUnlockMutex(&download->mutex);
+   return index;
+}
+
+static void
+__wut_download_run(__wut_download_worker_t *worker)
+{
+   WUTDownload *download = worker->download;
+   int index;
+
+   while ((index = __wut_download_next_chunk(download)) != -1) {
+      if (__wut_download_chunk(worker, (uint32_t)index) != 0) {
+         __wut_download_fail(download, errno);
+         break;
+      }
+   }
+
+   __wut_download_close(worker);
+}
+
+static int
+__wut_download_worker_entry(int argc,
+                            const char **argv)
+{
+   __wut_download_run((__wut_download_worker_t *)argv);
+   return 0;
+}
+
+// Picks up a journal of an earlier attempt at the same file
+static BOOL
+__wut_download_load_journal(WUTDownload *download)
+{
+   __wut_download_journal_t journal;
+   uint32_t bitmapSize = (download->chunkCount + 7) / 8;
+
+   download->journalFd = open(download->journalPath, O_RDWR);
+   if (download->journalFd == -1) {
+      return FALSE;
+   }
+
+   if (pread(download->journalFd, &journal, sizeof(journal), 0) != sizeof(journal)
+    || journal.magic != DOWNLOAD_JOURNAL_MAGIC
+    || journal.version != DOWNLOAD_JOURNAL_VERSION
+    || journal.totalSize != download->totalSize
+    || journal.chunkSize != download->options.chunkSize
+    || journal.chunkCount != download->chunkCount
+    || strncmp(journal.etag, download->etag, sizeof(journal.etag)) != 0
+    || pread(download->journalFd, download->chunkDone, bitmapSize, sizeof(journal)) != bitmapSize) {
+      close(download->journalFd);
+      download->journalFd = -1;
+      return FALSE;
+   }
+
+   download->fd = open(download->path, O_RDWR);
+   if (download->fd == -1) {
+      close(download->journalFd);
+      download->journalFd = -1;
+      return FALSE;
+   }
+
+   for (uint32_t i = 0; i < download->chunkCount; ++i) {
+      if (download->chunkDone[i / 8] & (1 << (i % 8))) {
+         uint64_t start = (uint64_t)i * download->options.chunkSize;
+         uint64_t end = start + download->options.chunkSize;
+         download->downloaded += (end > download->totalSize ? download->totalSize : end) - start;
+         download->chunksDone++;
+      }
+   }
+
+   return TRUE;
+}
+
+static int
+__wut_download_open(WUTDownload *download,
+                    BOOL journal)
+{
+   __wut_download_journal_t header;
+   uint32_t bitmapSize = (download->chunkCount + 7) / 8;
+   int error;
+
+   download->chunkDone = (uint8_t *)calloc(bitmapSize ? bitmapSize : 1, 1);
+   if (!download->chunkDone) {
+      return ENOMEM;
+   }
+
+   if (journal && __wut_download_load_journal(download)) {
+      return 0;
+   }
+
+   memset(download->chunkDone, 0, bitmapSize);
+   download->fd = open(download->path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+   if (download->fd == -1) {
+      return errno;
+   }
+
+   // Reserve the whole file up front so the ranges can be written in any
+   // order without the file growing under them
+   if (download->totalSize) {
+      error = posix_fallocate(download->fd, 0, (off_t)download->totalSize);
+      if (error) {
+         return error;
+      }
+   }
+
+   if (!journal) {
+      return 0;
+   }
+
+   download->journalFd = open(download->journalPath, O_RDWR | O_CREAT | O_TRUNC, 0666);
+   if (download->journalFd == -1) {
+      return errno;
+   }
+
+   memset(&header, 0, sizeof(header));
+   header.magic = DOWNLOAD_JOURNAL_MAGIC;
+   header.version = DOWNLOAD_JOURNAL_VERSION;
+   header.totalSize = download->totalSize;
+   header.chunkSize = download->options.chunkSize;
+   header.chunkCount = download->chunkCount;
+   strncpy(header.etag, download->etag, sizeof(header.etag) - 1);
+
+   if (pwrite(download->journalFd, &header, sizeof(header), 0) != sizeof(header)
+    || pwrite(download->journalFd, download->chunkDone, bitmapSize, sizeof(header)) != bitmapSize) {
+      return errno ? errno : EIO;
+   }
+
+   return 0;
+}
+
+// Servers that ignore the range get the whole file in one response
+static int
+__wut_download_single(__wut_download_worker_t *worker,
+                      __wut_download_response_t *response)
+{
+   WUTDownload *download = worker->download;
+   uint64_t written;
+   int error;
+
+   if (response->chunked || response->contentLength < 0) {
+      return EPROTO;
+   }
+
+   OSLockMutex(&download->mutex);
+   download->totalSize = (uint64_t)response->contentLength;
+   download->chunkCount = 1;
+   OSUnlockMutex(&download->mutex);
+
+   error = __wut_download_open(download, FALSE);
+   if (error) {
+      return error;
+   }
+
+   if (__wut_download_body(worker, response, 0, download->totalSize, &written) != 0) {
+      return errno;
+   }
+
+   __wut_download_chunk_done(download, 0);
+   return 0;
+}
+
+static int
+__wut_download_setup(__wut_download_worker_t *worker)
+{
+   WUTDownload *download = worker->download;
+   __wut_download_response_t response;
+   struct addrinfo hints;
+   uint64_t written;
+   int error;
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   if (getaddrinfo(download->host, download->port, &hints, &download->addresses) != 0) {
+      return EHOSTUNREACH;
+   }
+
+   // A one byte range tells the size, the ETag and whether ranges work
+   if (__wut_download_request(worker, 0, 0, &response) != 0) {
+      return errno;
+   }
+
+   if (response.status == 200) {
+      return __wut_download_single(worker, &response);
+   }
+
+   if (response.status == 416 && !response.totalSize) {
+      // An empty file has no byte 0
+      __wut_download_close(worker);
+      download->totalSize = 0;
+      download->chunkCount = 0;
+      return __wut_download_open(download, FALSE);
+   }
+
+   if (response.status != 206) {
+      download->httpStatus = response.status;
+      return EIO;
+   }
+
+   if (response.chunked || !response.hasRange || !response.totalSize) {
+      return EPROTO;
+   }
+
+   if (__wut_download_body(worker, &response, -1, __wut_download_body_length(&response), &written) != 0) {
+      return errno;
+   }
+
+   if (!response.keepAlive) {
+      __wut_download_close(worker);
+   }
+
+   strcpy(download->etag, response.etag);
+   OSLockMutex(&download->mutex);
+   download->totalSize = response.totalSize;
+   download->chunkCount = (uint32_t)((download->totalSize + download->options.chunkSize - 1)
+                                     / download->options.chunkSize);
+   OSUnlockMutex(&download->mutex);
+   error = __wut_download_open(download, download->options.resume);
+   if (error) {
+      return error;
+   }
+
+   for (uint32_t i = 1; i < download->options.connections; ++i) {
+      __wut_download_worker_t *other = &download->workers[i];
+
+      if (download->chunksDone + i >= download->chunkCount) {
+         break;
+      }
+
+      if (!OSCreateThread(&other->thread,
+                          __wut_download_worker_entry,
+                          0,
+                          (char *)other,
+                          (uint8_t *)other->stack + DOWNLOAD_STACK_SIZE,
+                          DOWNLOAD_STACK_SIZE,
+                          download->options.priority,
+                          OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+         break;
+      }
+
+      OSSetThreadName(&other->thread, "WUTDownload");
+      other->created = TRUE;
+      OSResumeThread(&other->thread);
+   }
+
+   __wut_download_run(worker);
+
+   for (uint32_t i = 1; i < download->options.connections; ++i) {
+      if (download->workers[i].created) {
+         OSJoinThread(&download->workers[i].thread, NULL);
+      }
+   }
+
+   return 0;
+}
+
+static int
+__wut_download_main_entry(int argc,
+                          const char **argv)
+{
+   __wut_download_worker_t *worker = (__wut_download_worker_t *)argv;
+   WUTDownload *download = worker->download;
+   int error = __wut_download_setup(worker);
+   BOOL complete;
+
+   if (error) {
+      __wut_download_fail(download, error);
+   }
+
+   __wut_download_close(worker);
+
+   OSLockMutex(&download->mutex);
+   complete = !download->error && download->chunksDone == download->chunkCount;
+   if (!complete && !download->error) {
+      download->error = download->stop ? ECANCELED : EIO;
+   }
+   OSUnlockMutex(&download->mutex);
+
+   if (download->fd != -1) {
+      close(download->fd);
+      download->fd = -1;
+   }
+
+   if (download->journalFd != -1) {
+      close(download->journalFd);
+      download->journalFd = -1;
+      if (complete) {
+         unlink(download->journalPath);
+      }
+   }
+
+   if (download->addresses) {
+      freeaddrinfo(download->addresses);
+      download->addresses = NULL;
+   }
+
+   download->done = 1;
+   return 0;
+}
+
+static void
+__wut_download_free(WUTDownload *download)
+{
+   for (uint32_t i = 0; i < WUT_DOWNLOAD_MAX_CONNECTIONS; ++i) {
+      free(download->workers[i].buffer);
+      free(download->workers[i].stack);
+   }
+
+   free(download->chunkDone);
+   free(download->target);
+   free(download->path);
+   free(download->journalPath);
+   free(download);
+}
+
+WUTDownload *
+WUTDownloadStart(const char *url,
+                 const char *path,
+                 const WUTDownloadOptions *options)
+{
+   WUTDownload *download;
+   __wut_download_worker_t *worker;
+
+   if (!url || !path) {
+      errno = EINVAL;
+      return NULL;
+   }
+
+   download = (WUTDownload *)memalign(16, sizeof(WUTDownload));
+   if (!download) {
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   memset(download, 0, sizeof(WUTDownload));
+   OSInitMutexEx(&download->mutex, "WUTDownload");
+   download->fd = -1;
+   download->journalFd = -1;
+
+   if (options) {
+      download->options = *options;
+   }
+
+   if (!download->options.connections) {
+      download->options.connections = DOWNLOAD_DEFAULT_CONNECTIONS;
+   } else if (download->options.connections > WUT_DOWNLOAD_MAX_CONNECTIONS) {
+      download->options.connections = WUT_DOWNLOAD_MAX_CONNECTIONS;
+   }
+
+   if (!download->options.chunkSize) {
+      download->options.chunkSize = DOWNLOAD_DEFAULT_CHUNK_SIZE;
+   }
+
+   if (!download->options.bufferSize) {
+      download->options.bufferSize = DOWNLOAD_DEFAULT_BUFFER_SIZE;
+   }
+
+   if (!download->options.timeoutMs) {
+      download->options.timeoutMs = DOWNLOAD_DEFAULT_TIMEOUT;
+   }
+
+   if (!download->options.priority) {
+      download->options.priority = DOWNLOAD_DEFAULT_PRIORITY;
+   }
+
+   if (!__wut_download_parse_url(download, url)) {
+      __wut_download_free(download);
+      errno = EINVAL;
+      return NULL;
+   }
+
+   download->path = strdup(path);
+   download->journalPath = (char *)malloc(strlen(path) + sizeof(".journal"));
+   if (!download->path || !download->journalPath) {
+      __wut_download_free(download);
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   strcpy(download->journalPath, path);
+   strcat(download->journalPath, ".journal");
+
+   for (uint32_t i = 0; i < download->options.connections; ++i) {
+      worker = &download->workers[i];
+      worker->download = download;
+      worker->sock = -1;
+      worker->buffer = (char *)malloc(download->options.bufferSize);
+      worker->stack = memalign(16, DOWNLOAD_STACK_SIZE);
+      if (!worker->buffer || !worker->stack) {
+         __wut_download_free(download);
+         errno = ENOMEM;
+         return NULL;
+      }
+   }
+
+   worker = &download->workers[0];
+   if (!OSCreateThread(&worker->thread,
+                       __wut_download_main_entry,
+                       0,
+                       (char *)worker,
+                       (uint8_t *)worker->stack + DOWNLOAD_STACK_SIZE,
+                       DOWNLOAD_STACK_SIZE,
+                       download->options.priority,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      __wut_download_free(download);
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   OSSetThreadName(&worker->thread, "WUTDownload");
+   worker->created = TRUE;
+   OSResumeThread(&worker->thread);
+   return download;
+}
+
+BOOL
+WUTDownloadIsDone(WUTDownload *download)
+{
+   return download->done != 0;
+}
+
+void
+WUTDownloadGetProgress(WUTDownload *download,
+                       WUTDownloadProgress *outProgress)
+{
+   OSLockMutex(&download->mutex);
+   outProgress->totalSize = download->totalSize;
+   outProgress->downloaded = download->downloaded;
+   outProgress->chunksDone = download->chunksDone;
+   outProgress->chunkCount = download->chunkCount;
+   outProgress->httpStatus = download->httpStatus;
+   OSUnlockMutex(&download->mutex);
+}
+
+void
+WUTDownloadCancel(WUTDownload *download)
+{
+   download->stop = 1;
+}
+
+int
+WUTDownloadWait(WUTDownload *download)
+{
+   if (!download->joined) {
+      OSJoinThread(&download->workers[0].thread, NULL);
+      download->joined = TRUE;
+   }
+
+   return download->error;
+}
+
+void
+WUTDownloadDestroy(WUTDownload *download)
+{
+   if (!download) {
+      return;
+   }
+
+   WUTDownloadWait(download);
+   __wut_download_free(download);
+}
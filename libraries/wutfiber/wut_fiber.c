@@ -0,0 +1,466 @@
+#include <wut_fiber.h>
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/coroutine.h>
+#include <coreinit/event.h>
+#include <coreinit/spinlock.h>
+#include <coreinit/thread.h>
+#include <malloc.h>
+#include <string.h>
+
+#define FIBER_NUM_CORES           3
+#define FIBER_DEFAULT_STACK_SIZE  (8 * 1024)
+#define FIBER_WORKER_STACK_SIZE   (32 * 1024)
+
+typedef enum FiberState
+{
+   FIBER_STATE_READY,
+   FIBER_STATE_RUNNING,
+   FIBER_STATE_SLEEPING,
+   FIBER_STATE_EXITING,
+   FIBER_STATE_DONE,
+} FiberState;
+
+typedef struct FiberWorker FiberWorker;
+
+// The fiber's stack follows it in the same allocation
+struct WUTFiber
+{
+   OSCoroutine context;
+   WUTFiberFn fn;
+   void *userData;
+   FiberWorker *worker;
+   WUTFiber *next;
+   OSTime wakeTime;
+   volatile uint32_t state;
+   volatile uint32_t refs;
+};
+
+#define FIBER_HEADER_SIZE ((sizeof(WUTFiber) + 15) & ~15)
+
+struct FiberWorker
+{
+   OSThread thread;
+   OSCoroutine context;
+   WUTFiber *current;
+
+   //! Fibers ready to run, can be added to from any core.
+   OSSpinLock readyLock;
+   WUTFiber *readyHead;
+   WUTFiber *readyTail;
+
+   //! Sleeping fibers sorted by wake time, only touched by the worker.
+   WUTFiber *sleepers;
+
+   //! Signalled when a fiber is queued while the worker is idle.
+   OSEvent wakeEvent;
+   volatile uint32_t idle;
+
+   //! Fibers created on this worker that haven't finished.
+   volatile uint32_t live;
+};
+
+static FiberWorker sWorkers[FIBER_NUM_CORES];
+static __attribute__((aligned(16))) uint8_t sWorkerStacks[FIBER_NUM_CORES][FIBER_WORKER_STACK_SIZE];
+static int sNumWorkers = 0;
+static uint32_t sStackSize = FIBER_DEFAULT_STACK_SIZE;
+static volatile uint32_t sNextWorker = 0;
+static volatile uint32_t sStop = 0;
+
+// Finished fibers kept for reuse, they all have the same stack size
+static OSSpinLock sPoolLock;
+static WUTFiber *sPool = NULL;
+
+static FiberWorker *
+__wut_fiber_current_worker(void)
+{
+   OSThread *thread = OSGetCurrentThread();
+   int i;
+
+   for (i = 0; i < sNumWorkers; ++i) {
+      if (&sWorkers[i].thread == thread) {
+         return &sWorkers[i];
+      }
+   }
+
+   return NULL;
+}
+
+static void
+__wut_fiber_push_ready(FiberWorker *worker,
+                       WUTFiber *fiber)
+{
+   fiber->next = NULL;
+
+   OSUninterruptibleSpinLock_Acquire(&worker->readyLock);
+   if (worker->readyTail) {
+      worker->readyTail->next = fiber;
+   } else {
+      worker->readyHead = fiber;
+   }
+   worker->readyTail = fiber;
+   OSUninterruptibleSpinLock_Release(&worker->readyLock);
+}
+
+static WUTFiber *
+__wut_fiber_pop_ready(FiberWorker *worker)
+{
+   WUTFiber *fiber;
+
+   if (!worker->readyHead) {
+      return NULL;
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&worker->readyLock);
+   fiber = worker->readyHead;
+   if (fiber) {
+      worker->readyHead = fiber->next;
+      if (!worker->readyHead) {
+         worker->readyTail = NULL;
+      }
+   }
+   OSUninterruptibleSpinLock_Release(&worker->readyLock);
+   return fiber;
+}
+
+static void
+__wut_fiber_wake_worker(FiberWorker *worker)
+{
+   OSMemoryBarrier();
+   if (worker->idle) {
+      OSSignalEvent(&worker->wakeEvent);
+   }
+}
+
+static void
+__wut_fiber_add_sleeper(FiberWorker *worker,
+                        WUTFiber *fiber)
+{
+   WUTFiber **prev = &worker->sleepers;
+   while (*prev && (*prev)->wakeTime <= fiber->wakeTime) {
+      prev = &(*prev)->next;
+   }
+
+   fiber->next = *prev;
+   *prev = fiber;
+}
+
+static void
+__wut_fiber_release(WUTFiber *fiber)
+{
+   if (OSAddAtomic((volatile int32_t *)&fiber->refs, -1) != 1) {
+      return;
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sPoolLock);
+   fiber->next = sPool;
+   sPool = fiber;
+   OSUninterruptibleSpinLock_Release(&sPoolLock);
+}
+
+static void
+__wut_fiber_entry(void)
+{
+   FiberWorker *worker = __wut_fiber_current_worker();
+   WUTFiber *fiber = worker->current;
+
+   fiber->fn(fiber->userData);
+
+   // The worker marks the fiber as done once it is off its stack
+   fiber->state = FIBER_STATE_EXITING;
+   OSSwitchCoroutine(&fiber->context, &fiber->worker->context);
+}
+
+static void
+__wut_fiber_run(FiberWorker *worker,
+                WUTFiber *fiber)
+{
+   worker->current = fiber;
+   fiber->state = FIBER_STATE_RUNNING;
+   OSSwitchCoroutine(&worker->context, &fiber->context);
+   worker->current = NULL;
+
+   switch (fiber->state) {
+   case FIBER_STATE_READY:
+      __wut_fiber_push_ready(worker, fiber);
+      break;
+   case FIBER_STATE_SLEEPING:
+      __wut_fiber_add_sleeper(worker, fiber);
+      break;
+   case FIBER_STATE_EXITING:
+      OSMemoryBarrier();
+      fiber->state = FIBER_STATE_DONE;
+      OSAddAtomic((volatile int32_t *)&worker->live, -1);
+      __wut_fiber_release(fiber);
+      break;
+   }
+}
+
+static int
+__wut_fiber_worker_entry(int argc,
+                         const char **argv)
+{
+   FiberWorker *worker = (FiberWorker *)argv;
+   WUTFiber *fiber;
+   OSTime now;
+
+   while (TRUE) {
+      now = OSGetSystemTime();
+      while (worker->sleepers && worker->sleepers->wakeTime <= now) {
+         fiber = worker->sleepers;
+         worker->sleepers = fiber->next;
+         fiber->state = FIBER_STATE_READY;
+         __wut_fiber_push_ready(worker, fiber);
+      }
+
+      fiber = __wut_fiber_pop_ready(worker);
+      if (fiber) {
+         __wut_fiber_run(worker, fiber);
+         continue;
+      }
+
+      if (sStop && !worker->live) {
+         break;
+      }
+
+      // Check again after announcing the wait so a queued fiber can't be missed
+      worker->idle = 1;
+      OSMemoryBarrier();
+      if (!worker->readyHead) {
+         if (worker->sleepers) {
+            OSWaitEventWithTimeout(&worker->wakeEvent,
+                                   OSTicksToNanoseconds(worker->sleepers->wakeTime - now));
+         } else if (!sStop) {
+            OSWaitEvent(&worker->wakeEvent);
+         }
+      }
+      worker->idle = 0;
+   }
+
+   return 0;
+}
+
+BOOL
+WUTFiberSystemInit(uint32_t coreMask,
+                   int32_t priority,
+                   uint32_t stackSize)
+{
+   int core, i;
+
+   if (sNumWorkers) {
+      return FALSE;
+   }
+
+   if (!coreMask) {
+      coreMask = OS_THREAD_ATTRIB_AFFINITY_ANY;
+   }
+
+   sStackSize = stackSize ? (stackSize + 15) & ~15 : FIBER_DEFAULT_STACK_SIZE;
+   sStop = 0;
+   OSInitSpinLock(&sPoolLock);
+
+   for (core = 0; core < FIBER_NUM_CORES; ++core) {
+      FiberWorker *worker = &sWorkers[sNumWorkers];
+      if (!(coreMask & (1 << core))) {
+         continue;
+      }
+
+      memset(worker, 0, sizeof(FiberWorker));
+      OSInitSpinLock(&worker->readyLock);
+      OSInitEvent(&worker->wakeEvent, FALSE, OS_EVENT_MODE_AUTO);
+      if (!OSCreateThread(&worker->thread,
+                          __wut_fiber_worker_entry,
+                          0,
+                          (char *)worker,
+                          sWorkerStacks[sNumWorkers] + FIBER_WORKER_STACK_SIZE,
+                          FIBER_WORKER_STACK_SIZE,
+                          priority,
+                          (OSThreadAttributes)(1 << core))) {
+         break;
+      }
+
+      OSSetThreadName(&worker->thread, "wut fiber worker");
+      ++sNumWorkers;
+   }
+
+   for (i = 0; i < sNumWorkers; ++i) {
+      OSResumeThread(&sWorkers[i].thread);
+   }
+
+   if (core < FIBER_NUM_CORES) {
+      WUTFiberSystemShutdown();
+      return FALSE;
+   }
+
+   return sNumWorkers > 0;
+}
+
+void
+WUTFiberSystemShutdown(void)
+{
+   WUTFiber *fiber;
+   int i;
+
+   sStop = 1;
+   OSMemoryBarrier();
+   for (i = 0; i < sNumWorkers; ++i) {
+      OSSignalEvent(&sWorkers[i].wakeEvent);
+   }
+
+   for (i = 0; i < sNumWorkers; ++i) {
+      OSJoinThread(&sWorkers[i].thread, NULL);
+   }
+   sNumWorkers = 0;
+
+   OSUninterruptibleSpinLock_Acquire(&sPoolLock);
+   fiber = sPool;
+   sPool = NULL;
+   OSUninterruptibleSpinLock_Release(&sPoolLock);
+
+   while (fiber) {
+      WUTFiber *next = fiber->next;
+      free(fiber);
+      fiber = next;
+   }
+}
+
+WUTFiber *
+WUTFiberCreate(WUTFiberFn fn,
+               void *userData,
+               int core)
+{
+   FiberWorker *worker = NULL;
+   WUTFiber *fiber;
+   uint8_t *stackTop;
+   int i;
+
+   if (!sNumWorkers || sStop || !fn) {
+      return NULL;
+   }
+
+   if (core >= 0) {
+      for (i = 0; i < sNumWorkers; ++i) {
+         if (sWorkers[i].thread.attr & (1 << core)) {
+            worker = &sWorkers[i];
+            break;
+         }
+      }
+      if (!worker) {
+         return NULL;
+      }
+   } else {
+      worker = &sWorkers[(uint32_t)OSAddAtomic((volatile int32_t *)&sNextWorker, 1) % sNumWorkers];
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sPoolLock);
+   fiber = sPool;
+   if (fiber) {
+      sPool = fiber->next;
+   }
+   OSUninterruptibleSpinLock_Release(&sPoolLock);
+
+   if (!fiber) {
+      fiber = (WUTFiber *)memalign(16, FIBER_HEADER_SIZE + sStackSize);
+      if (!fiber) {
+         return NULL;
+      }
+   }
+
+   memset(fiber, 0, sizeof(WUTFiber));
+   fiber->fn = fn;
+   fiber->userData = userData;
+   fiber->worker = worker;
+   fiber->state = FIBER_STATE_READY;
+   fiber->refs = 2;
+
+   // Leave room for the back chain of the first stack frame
+   stackTop = (uint8_t *)fiber + FIBER_HEADER_SIZE + sStackSize - 16;
+   memset(stackTop, 0, 16);
+   OSInitCoroutine(&fiber->context, (void *)&__wut_fiber_entry, stackTop);
+
+   OSAddAtomic((volatile int32_t *)&worker->live, 1);
+   __wut_fiber_push_ready(worker, fiber);
+   __wut_fiber_wake_worker(worker);
+   return fiber;
+}
+
+void
+WUTFiberJoin(WUTFiber *fiber)
+{
+   while (fiber->state != FIBER_STATE_DONE) {
+      if (WUTFiberSelf()) {
+         WUTFiberYield();
+      } else {
+         OSSleepTicks(OSMillisecondsToTicks(1));
+      }
+   }
+
+   __wut_fiber_release(fiber);
+}
+
+void
+WUTFiberDetach(WUTFiber *fiber)
+{
+   __wut_fiber_release(fiber);
+}
+
+WUTFiber *
+WUTFiberSelf(void)
+{
+   FiberWorker *worker = __wut_fiber_current_worker();
+   return worker ? worker->current : NULL;
+}
+
+void
+WUTFiberYield(void)
+{
+   WUTFiber *fiber = WUTFiberSelf();
+   if (!fiber) {
+      OSYieldThread();
+      return;
+   }
+
+   fiber->state = FIBER_STATE_READY;
+   OSSwitchCoroutine(&fiber->context, &fiber->worker->context);
+}
+
+void
+WUTFiberSleep(OSTime ticks)
+{
+   WUTFiber *fiber = WUTFiberSelf();
+   if (!fiber) {
+      OSSleepTicks(ticks);
+      return;
+   }
+
+   fiber->wakeTime = OSGetSystemTime() + ticks;
+   fiber->state = FIBER_STATE_SLEEPING;
+   OSSwitchCoroutine(&fiber->context, &fiber->worker->context);
+}
+
+void
+WUTFiberMutexInit(WUTFiberMutex *mutex)
+{
+   mutex->locked = 0;
+}
+
+void
+WUTFiberMutexLock(WUTFiberMutex *mutex)
+{
+   while (!OSCompareAndSwapAtomic(&mutex->locked, 0, 1)) {
+      WUTFiberYield();
+   }
+}
+
+BOOL
+WUTFiberMutexTryLock(WUTFiberMutex *mutex)
+{
+   return OSCompareAndSwapAtomic(&mutex->locked, 0, 1);
+}
+
+void
+WUTFiberMutexUnlock(WUTFiberMutex *mutex)
+{
+   OSMemoryBarrier();
+   mutex->locked = 0;
+}
@@ -0,0 +1,219 @@
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/debug.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/thread.h>
+#include <string.h>
+#include <wut_hid.h>
+
+#define HID_BUFFER_ALIGN 0x40
+
+struct WUTHIDReader
+{
+   uint32_t handle;
+   uint32_t bufferSize;
+   uint32_t numBuffers;
+   uint8_t *buffers;
+
+   volatile uint32_t stopping;
+   volatile int32_t outstanding;
+
+   // Written by the HID callbacks only, the queue has a single producer as
+   // nsyshid runs the callbacks of a device one at a time
+   volatile uint32_t head __attribute__((aligned(32)));
+   uint32_t reports;
+   uint32_t dropped;
+   uint32_t errors;
+   OSTime firstTime;
+   OSTime lastTime;
+   OSTime minInterval;
+   OSTime maxInterval;
+
+   //! Consumer only.
+   volatile uint32_t tail __attribute__((aligned(32)));
+
+   uint32_t queueMask;
+   WUTHIDReport *queue;
+};
+
+static void
+__wut_hid_read_callback(uint32_t handle,
+                        int32_t error,
+                        uint8_t *buffer,
+                        uint32_t bytesTransferred,
+                        void *userContext);
+
+static BOOL
+__wut_hid_submit(WUTHIDReader *reader,
+                 uint8_t *buffer)
+{
+   OSAddAtomic(&reader->outstanding, 1);
+   if (HIDRead(reader->handle, buffer, reader->bufferSize,
+               __wut_hid_read_callback, reader) < 0) {
+      OSAddAtomic(&reader->outstanding, -1);
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+static void
+__wut_hid_push(WUTHIDReader *reader,
+               const uint8_t *buffer,
+               uint32_t size)
+{
+   OSTime now = OSGetSystemTime();
+   uint32_t head = reader->head;
+
+   if (reader->reports || reader->dropped) {
+      OSTime interval = now - reader->lastTime;
+      if (!reader->minInterval || interval < reader->minInterval) {
+         reader->minInterval = interval;
+      }
+      if (interval > reader->maxInterval) {
+         reader->maxInterval = interval;
+      }
+   } else {
+      reader->firstTime = now;
+   }
+   reader->lastTime = now;
+
+   if (head - reader->tail > reader->queueMask) {
+      reader->dropped++;
+      return;
+   }
+
+   WUTHIDReport *report = &reader->queue[head & reader->queueMask];
+   report->time = now;
+   report->size = size < WUT_HID_MAX_REPORT_SIZE ? size : WUT_HID_MAX_REPORT_SIZE;
+   memcpy(report->data, buffer, report->size);
+
+   // Publish the report before the index that makes it visible
+   OSMemoryBarrier();
+   reader->head = head + 1;
+   reader->reports++;
+}
+
+static void
+__wut_hid_read_callback(uint32_t handle,
+                        int32_t error,
+                        uint8_t *buffer,
+                        uint32_t bytesTransferred,
+                        void *userContext)
+{
+   WUTHIDReader *reader = (WUTHIDReader *)userContext;
+
+   if (error < 0) {
+      reader->errors++;
+   } else {
+      __wut_hid_push(reader, buffer, bytesTransferred);
+
+      // Requeue straight away so the next report has somewhere to go
+      if (!reader->stopping) {
+         __wut_hid_submit(reader, buffer);
+      }
+   }
+
+   OSAddAtomic(&reader->outstanding, -1);
+}
+
+WUTHIDReader *
+WUTHIDReaderCreate(uint32_t handle,
+                   uint32_t reportSize,
+                   uint32_t numBuffers,
+                   uint32_t queueSize)
+{
+   WUTHIDReader *reader;
+
+   if (!reportSize || !numBuffers || !queueSize || (queueSize & (queueSize - 1))) {
+      return NULL;
+   }
+
+   reader = (WUTHIDReader *)MEMAllocFromDefaultHeapEx(sizeof(WUTHIDReader), HID_BUFFER_ALIGN);
+   if (!reader) {
+      return NULL;
+   }
+
+   memset(reader, 0, sizeof(WUTHIDReader));
+   reader->handle = handle;
+   reader->numBuffers = numBuffers;
+   reader->queueMask = queueSize - 1;
+
+   // Each read buffer gets its own cache lines, as IOS writes them by DMA
+   reader->bufferSize = (reportSize + HID_BUFFER_ALIGN - 1) & ~(HID_BUFFER_ALIGN - 1);
+   reader->buffers = (uint8_t *)MEMAllocFromDefaultHeapEx(reader->bufferSize * numBuffers, HID_BUFFER_ALIGN);
+   reader->queue = (WUTHIDReport *)MEMAllocFromDefaultHeapEx(sizeof(WUTHIDReport) * queueSize, HID_BUFFER_ALIGN);
+   if (!reader->buffers || !reader->queue) {
+      if (reader->buffers) {
+         MEMFreeToDefaultHeap(reader->buffers);
+      }
+      if (reader->queue) {
+         MEMFreeToDefaultHeap(reader->queue);
+      }
+      MEMFreeToDefaultHeap(reader);
+      return NULL;
+   }
+
+   for (uint32_t i = 0; i < numBuffers; ++i) {
+      if (!__wut_hid_submit(reader, reader->buffers + i * reader->bufferSize)) {
+         WUT_DEBUG_REPORT("WUTHIDReaderCreate: only %u of %u reads queued\n", i, numBuffers);
+         if (i == 0) {
+            MEMFreeToDefaultHeap(reader->buffers);
+            MEMFreeToDefaultHeap(reader->queue);
+            MEMFreeToDefaultHeap(reader);
+            return NULL;
+         }
+         break;
+      }
+   }
+
+   return reader;
+}
+
+void
+WUTHIDReaderDestroy(WUTHIDReader *reader)
+{
+   if (!reader) {
+      return;
+   }
+
+   reader->stopping = 1;
+   while (reader->outstanding > 0) {
+      OSSleepTicks(OSMillisecondsToTicks(1));
+   }
+
+   MEMFreeToDefaultHeap(reader->buffers);
+   MEMFreeToDefaultHeap(reader->queue);
+   MEMFreeToDefaultHeap(reader);
+}
+
+BOOL
+WUTHIDReaderPop(WUTHIDReader *reader,
+                WUTHIDReport *outReport)
+{
+   uint32_t tail = reader->tail;
+   if (reader->head == tail) {
+      return FALSE;
+   }
+
+   OSMemoryBarrier();
+   *outReport = reader->queue[tail & reader->queueMask];
+
+   // The callback may reuse the slot as soon as it sees the new tail
+   OSMemoryBarrier();
+   reader->tail = tail + 1;
+   return TRUE;
+}
+
+void
+WUTHIDReaderGetStats(WUTHIDReader *reader,
+                     WUTHIDReaderStats *outStats)
+{
+   outStats->reports = reader->reports;
+   outStats->dropped = reader->dropped;
+   outStats->errors = reader->errors;
+   outStats->outstanding = reader->outstanding > 0 ? (uint32_t)reader->outstanding : 0;
+   outStats->minInterval = reader->minInterval;
+   outStats->maxInterval = reader->maxInterval;
+   outStats->totalInterval = (reader->reports || reader->dropped) ? reader->lastTime - reader->firstTime : 0;
+}
@@ -0,0 +1,314 @@
+#include <coreinit/cache.h>
+#include <coreinit/debug.h>
+#include <coreinit/thread.h>
+#include <string.h>
+#include <wut_input.h>
+
+#define INPUT_THREAD_STACK_SIZE  0x4000
+#define INPUT_READ_MAX           16
+#define INPUT_RING_MASK          (WUT_INPUT_RING_SIZE - 1)
+
+_Static_assert(!(WUT_INPUT_RING_SIZE & INPUT_RING_MASK), "WUT_INPUT_RING_SIZE must be a power of two");
+
+/*
+ * Single producer ring that overwrites the oldest samples when full. The
+ * consumer copies a slot out and then checks the producer hasn't started
+ * writing over it in the meantime.
+ */
+typedef struct InputRing
+{
+   //! Written by the sampling thread only.
+   volatile uint32_t head __attribute__((aligned(32)));
+
+   //! Consumer only.
+   uint32_t tail __attribute__((aligned(32)));
+   uint32_t lost;
+} InputRing;
+
+static InputRing sVPADRings[WUT_INPUT_VPAD_CHANNELS];
+static InputRing sKPADRings[WUT_INPUT_KPAD_CHANNELS];
+static WUTInputVPADSample sVPADSamples[WUT_INPUT_VPAD_CHANNELS][WUT_INPUT_RING_SIZE];
+static WUTInputKPADSample sKPADSamples[WUT_INPUT_KPAD_CHANNELS][WUT_INPUT_RING_SIZE];
+
+static WUTInputConfig sConfig;
+static volatile uint32_t sRunning = 0;
+static volatile uint32_t sStopRequested = 0;
+static OSThread sInputThread;
+static uint8_t sInputThreadStack[INPUT_THREAD_STACK_SIZE] __attribute__((aligned(16)));
+
+static void
+__wut_input_poll_vpad(VPADChan chan)
+{
+   VPADStatus buffers[INPUT_READ_MAX];
+   VPADReadError error = VPAD_READ_SUCCESS;
+   InputRing *ring = &sVPADRings[chan];
+   OSTime now;
+   int32_t count;
+
+   count = VPADRead(chan, buffers, INPUT_READ_MAX, &error);
+   if (error != VPAD_READ_SUCCESS || count <= 0) {
+      return;
+   }
+
+   // Samples come newest first
+   now = OSGetSystemTime();
+   for (int32_t i = count - 1; i >= 0; --i) {
+      uint32_t head = ring->head;
+      WUTInputVPADSample *sample = &sVPADSamples[chan][head & INPUT_RING_MASK];
+      sample->time = now;
+      sample->status = buffers[i];
+
+      OSMemoryBarrier();
+      ring->head = head + 1;
+   }
+}
+
+static void
+__wut_input_poll_kpad(KPADChan chan)
+{
+   KPADStatus buffers[INPUT_READ_MAX];
+   KPADError error = KPAD_ERROR_OK;
+   InputRing *ring = &sKPADRings[chan];
+   OSTime now;
+   int32_t count;
+
+   count = KPADReadEx(chan, buffers, INPUT_READ_MAX, &error);
+   if (error != KPAD_ERROR_OK || count <= 0) {
+      return;
+   }
+
+   now = OSGetSystemTime();
+   for (int32_t i = count - 1; i >= 0; --i) {
+      uint32_t head = ring->head;
+      WUTInputKPADSample *sample = &sKPADSamples[chan][head & INPUT_RING_MASK];
+      sample->time = now;
+      sample->status = buffers[i];
+
+      OSMemoryBarrier();
+      ring->head = head + 1;
+   }
+}
+
+static int
+__wut_input_thread_entry(int argc,
+                         const char **argv)
+{
+   while (!sStopRequested) {
+      for (uint32_t i = 0; i < WUT_INPUT_VPAD_CHANNELS; ++i) {
+         if (sConfig.vpadChannels & (1 << i)) {
+            __wut_input_poll_vpad((VPADChan)(VPAD_CHAN_0 + i));
+         }
+      }
+
+      for (uint32_t i = 0; i < WUT_INPUT_KPAD_CHANNELS; ++i) {
+         if (sConfig.kpadChannels & (1 << i)) {
+            __wut_input_poll_kpad((KPADChan)(WPAD_CHAN_0 + i));
+         }
+      }
+
+      OSSleepTicks(sConfig.interval);
+   }
+
+   return 0;
+}
+
+/**
+ * Copy samples out of a ring, oldest first.
+ */
+static uint32_t
+__wut_input_ring_read(InputRing *ring,
+                      const void *slots,
+                      uint32_t sampleSize,
+                      void *out,
+                      uint32_t maxSamples,
+                      OSTime deadline)
+{
+   uint32_t count = 0;
+
+   while (count < maxSamples) {
+      uint32_t head = ring->head;
+      uint32_t tail = ring->tail;
+
+      if (head - tail > WUT_INPUT_RING_SIZE) {
+         ring->lost += head - tail - WUT_INPUT_RING_SIZE;
+         tail = head - WUT_INPUT_RING_SIZE;
+      }
+
+      if (head == tail) {
+         ring->tail = tail;
+         break;
+      }
+
+      // Read the slot only after the index that published it
+      OSMemoryBarrier();
+      uint8_t *dst = (uint8_t *)out + count * sampleSize;
+      memcpy(dst, (const uint8_t *)slots + (tail & INPUT_RING_MASK) * sampleSize, sampleSize);
+      OSMemoryBarrier();
+
+      if (ring->head - tail >= WUT_INPUT_RING_SIZE) {
+         // The sampling thread lapped us while copying
+         ring->lost++;
+         ring->tail = tail + 1;
+         continue;
+      }
+
+      // Both sample types start with their time
+      if (deadline >= 0 && *(OSTime *)dst > deadline) {
+         ring->tail = tail;
+         break;
+      }
+
+      ring->tail = tail + 1;
+      ++count;
+   }
+
+   return count;
+}
+
+/**
+ * Copy the newest sample out of a ring and drop the ones before it.
+ */
+static BOOL
+__wut_input_ring_read_latest(InputRing *ring,
+                             const void *slots,
+                             uint32_t sampleSize,
+                             void *out)
+{
+   while (TRUE) {
+      uint32_t head = ring->head;
+      if (head == ring->tail) {
+         return FALSE;
+      }
+
+      OSMemoryBarrier();
+      memcpy(out, (const uint8_t *)slots + ((head - 1) & INPUT_RING_MASK) * sampleSize, sampleSize);
+      OSMemoryBarrier();
+
+      if (ring->head - (head - 1) < WUT_INPUT_RING_SIZE) {
+         ring->tail = head;
+         return TRUE;
+      }
+   }
+}
+
+BOOL
+WUTInputStart(const WUTInputConfig *config)
+{
+   if (sRunning) {
+      return FALSE;
+   }
+
+   if (config) {
+      sConfig = *config;
+   } else {
+      memset(&sConfig, 0, sizeof(sConfig));
+      sConfig.priority = 1;
+      sConfig.vpadChannels = 1 << VPAD_CHAN_0;
+      sConfig.kpadChannels = (1 << WUT_INPUT_KPAD_CHANNELS) - 1;
+   }
+
+   if (!sConfig.interval) {
+      sConfig.interval = OSMillisecondsToTicks(4);
+   }
+
+   if (!sConfig.affinity) {
+      sConfig.affinity = OS_THREAD_ATTRIB_AFFINITY_ANY;
+   }
+
+   memset(sVPADRings, 0, sizeof(sVPADRings));
+   memset(sKPADRings, 0, sizeof(sKPADRings));
+   sStopRequested = 0;
+
+   if (!OSCreateThread(&sInputThread,
+                       __wut_input_thread_entry,
+                       0,
+                       NULL,
+                       sInputThreadStack + sizeof(sInputThreadStack),
+                       sizeof(sInputThreadStack),
+                       sConfig.priority,
+                       sConfig.affinity)) {
+      WUT_DEBUG_REPORT("WUTInputStart: could not create the sampling thread\n");
+      return FALSE;
+   }
+
+   OSSetThreadName(&sInputThread, "wut input");
+   sRunning = 1;
+   OSResumeThread(&sInputThread);
+   return TRUE;
+}
+
+void
+WUTInputStop(void)
+{
+   if (!sRunning) {
+      return;
+   }
+
+   sStopRequested = 1;
+   OSJoinThread(&sInputThread, NULL);
+   sRunning = 0;
+}
+
+uint32_t
+WUTInputReadVPAD(VPADChan chan,
+                 WUTInputVPADSample *outSamples,
+                 uint32_t maxSamples,
+                 OSTime deadline)
+{
+   if ((uint32_t)chan >= WUT_INPUT_VPAD_CHANNELS) {
+      return 0;
+   }
+
+   return __wut_input_ring_read(&sVPADRings[chan], sVPADSamples[chan], sizeof(WUTInputVPADSample),
+                                outSamples, maxSamples, deadline);
+}
+
+uint32_t
+WUTInputReadKPAD(KPADChan chan,
+                 WUTInputKPADSample *outSamples,
+                 uint32_t maxSamples,
+                 OSTime deadline)
+{
+   if ((uint32_t)chan >= WUT_INPUT_KPAD_CHANNELS) {
+      return 0;
+   }
+
+   return __wut_input_ring_read(&sKPADRings[chan], sKPADSamples[chan], sizeof(WUTInputKPADSample),
+                                outSamples, maxSamples, deadline);
+}
+
+BOOL
+WUTInputGetLatestVPAD(VPADChan chan,
+                      WUTInputVPADSample *outSample)
+{
+   if ((uint32_t)chan >= WUT_INPUT_VPAD_CHANNELS) {
+      return FALSE;
+   }
+
+   return __wut_input_ring_read_latest(&sVPADRings[chan], sVPADSamples[chan],
+                                       sizeof(WUTInputVPADSample), outSample);
+}
+
+BOOL
+WUTInputGetLatestKPAD(KPADChan chan,
+                      WUTInputKPADSample *outSample)
+{
+   if ((uint32_t)chan >= WUT_INPUT_KPAD_CHANNELS) {
+      return FALSE;
+   }
+
+   return __wut_input_ring_read_latest(&sKPADRings[chan], sKPADSamples[chan],
+                                       sizeof(WUTInputKPADSample), outSample);
+}
+
+uint32_t
+WUTInputGetLostVPAD(VPADChan chan)
+{
+   return (uint32_t)chan < WUT_INPUT_VPAD_CHANNELS ? sVPADRings[chan].lost : 0;
+}
+
+uint32_t
+WUTInputGetLostKPAD(KPADChan chan)
+{
+   return (uint32_t)chan < WUT_INPUT_KPAD_CHANNELS ? sKPADRings[chan].lost : 0;
+}
@@ -0,0 +1,213 @@
+#include <coreinit/cache.h>
+#include <coreinit/debug.h>
+#include <coreinit/ipcbufpool.h>
+#include <coreinit/memdefaultheap.h>
+#include <wut_ios.h>
+
+#define IOS_BUFFER_ALIGN 0x40
+
+struct WUTIOSBufferPool
+{
+   IPCBufPool *pool;
+   uint32_t bufferSize;
+   void *memory;
+};
+
+WUTIOSBufferPool *
+WUTIOSBufferPoolCreate(uint32_t bufferSize,
+                       uint32_t count)
+{
+   WUTIOSBufferPool *pool;
+   uint32_t numMessages = 0;
+   uint32_t size;
+
+   if (!bufferSize || !count) {
+      return NULL;
+   }
+
+   pool = (WUTIOSBufferPool *)MEMAllocFromDefaultHeapEx(sizeof(WUTIOSBufferPool), 4);
+   if (!pool) {
+      return NULL;
+   }
+
+   // IPCBufPool keeps its header and a FIFO of message pointers in front of
+   // the messages, which start on a cache line
+   pool->bufferSize = (bufferSize + IOS_BUFFER_ALIGN - 1) & ~(IOS_BUFFER_ALIGN - 1);
+   size = pool->bufferSize * count;
+   size += (sizeof(IPCBufPool) + count * 8 + IOS_BUFFER_ALIGN * 2) & ~(IOS_BUFFER_ALIGN - 1);
+
+   pool->memory = MEMAllocFromDefaultHeapEx(size, IOS_BUFFER_ALIGN);
+   if (!pool->memory) {
+      MEMFreeToDefaultHeap(pool);
+      return NULL;
+   }
+
+   pool->pool = IPCBufPoolCreate(pool->memory, size, pool->bufferSize, &numMessages, 0);
+   if (!pool->pool || numMessages < count) {
+      WUT_DEBUG_REPORT("WUTIOSBufferPoolCreate: got %u of %u buffers\n", numMessages, count);
+      if (!pool->pool) {
+         MEMFreeToDefaultHeap(pool->memory);
+         MEMFreeToDefaultHeap(pool);
+         return NULL;
+      }
+   }
+
+   return pool;
+}
+
+void
+WUTIOSBufferPoolDestroy(WUTIOSBufferPool *pool)
+{
+   if (!pool) {
+      return;
+   }
+
+   MEMFreeToDefaultHeap(pool->memory);
+   MEMFreeToDefaultHeap(pool);
+}
+
+uint32_t
+WUTIOSBufferPoolGetBufferSize(WUTIOSBufferPool *pool)
+{
+   return pool->bufferSize;
+}
+
+void *
+WUTIOSBufferAlloc(WUTIOSBufferPool *pool)
+{
+   return IPCBufPoolAllocate(pool->pool, pool->bufferSize);
+}
+
+void
+WUTIOSBufferFree(WUTIOSBufferPool *pool,
+                 void *buffer)
+{
+   if (buffer) {
+      IPCBufPoolFree(pool->pool, buffer);
+   }
+}
+
+static void
+__wut_ios_complete(IOSError result,
+                   void *context)
+{
+   WUTIOSRequest *request = (WUTIOSRequest *)context;
+   OSMessage message;
+   uint32_t i;
+
+   // Drop whatever the CPU may have prefetched while IOS was writing
+   if (request->outBuf && request->outLen) {
+      DCInvalidateRange(request->outBuf, request->outLen);
+   }
+
+   for (i = request->vecIn; request->vec && i < request->vecIn + request->vecOut; ++i) {
+      if (request->vec[i].vaddr && request->vec[i].len) {
+         DCInvalidateRange(request->vec[i].vaddr, request->vec[i].len);
+      }
+   }
+
+   // The request can be resubmitted from the callback or as soon as it is
+   // received from the queue, so nothing of it is touched after those
+   WUTIOSCallbackFn callback = request->callback;
+   void *userContext = request->userContext;
+   OSMessageQueue *queue = request->queue;
+
+   request->result = result;
+   request->done = TRUE;
+   OSSignalEvent(&request->event);
+
+   if (queue) {
+      message.message = request;
+      message.args[0] = (uint32_t)result;
+      message.args[1] = 0;
+      message.args[2] = 0;
+      OSSendMessage(queue, &message, OS_MESSAGE_FLAGS_NONE);
+   }
+
+   if (callback) {
+      callback(request, userContext);
+   }
+}
+
+static void
+__wut_ios_prepare(WUTIOSRequest *request)
+{
+   request->result = IOS_ERROR_OK;
+   request->done = FALSE;
+   request->outBuf = NULL;
+   request->outLen = 0;
+   request->vec = NULL;
+   request->vecIn = 0;
+   request->vecOut = 0;
+   OSInitEvent(&request->event, FALSE, OS_EVENT_MODE_MANUAL);
+}
+
+IOSError
+WUTIOSIoctlAsync(WUTIOSRequest *request,
+                 IOSHandle handle,
+                 uint32_t ioctl,
+                 void *inBuf,
+                 uint32_t inLen,
+                 void *outBuf,
+                 uint32_t outLen)
+{
+   __wut_ios_prepare(request);
+   request->outBuf = outBuf;
+   request->outLen = outLen;
+
+   if (inBuf && inLen) {
+      DCFlushRange(inBuf, inLen);
+   }
+
+   // A dirty line evicted later would overwrite what IOS wrote
+   if (outBuf && outLen) {
+      DCFlushRange(outBuf, outLen);
+   }
+
+   return IOS_IoctlAsync(handle, ioctl, inBuf, inLen, outBuf, outLen,
+                         __wut_ios_complete, request);
+}
+
+IOSError
+WUTIOSIoctlvAsync(WUTIOSRequest *request,
+                  IOSHandle handle,
+                  uint32_t ioctlv,
+                  uint32_t vecIn,
+                  uint32_t vecOut,
+                  IOSVec *vec)
+{
+   uint32_t i;
+
+   __wut_ios_prepare(request);
+   request->vec = vec;
+   request->vecIn = vecIn;
+   request->vecOut = vecOut;
+
+   for (i = 0; i < vecIn + vecOut; ++i) {
+      if (vec[i].vaddr && vec[i].len) {
+         DCFlushRange(vec[i].vaddr, vec[i].len);
+      }
+   }
+
+   return IOS_IoctlvAsync(handle, ioctlv, vecIn, vecOut, vec,
+                          __wut_ios_complete, request);
+}
+
+BOOL
+WUTIOSIsDone(WUTIOSRequest *request)
+{
+   return request->done;
+}
+
+BOOL
+WUTIOSWait(WUTIOSRequest *request,
+           OSTime timeout)
+{
+   if (timeout < 0) {
+      OSWaitEvent(&request->event);
+      return TRUE;
+   }
+
+   // OSWaitEventWithTimeout takes the timeout in nanoseconds
+   return OSWaitEventWithTimeout(&request->event, OSTicksToNanoseconds(timeout));
+}
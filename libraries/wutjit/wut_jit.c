@@ -0,0 +1,359 @@
+#include <wut_jit.h>
+#include <coreinit/cache.h>
+#include <coreinit/codegen.h>
+#include <coreinit/core.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <string.h>
+
+#define JIT_ALIGN_UP(x)   (((x) + WUT_JIT_ALIGN - 1) & ~(WUT_JIT_ALIGN - 1))
+
+#define PPC_LI(rd, imm)       ((14u << 26) | ((rd) << 21) | ((imm) & 0xFFFF))
+#define PPC_LIS(rd, imm)      ((15u << 26) | ((rd) << 21) | ((imm) & 0xFFFF))
+#define PPC_ORI(ra, rs, imm)  ((24u << 26) | ((rs) << 21) | ((ra) << 16) | ((imm) & 0xFFFF))
+#define PPC_B(offset, lk)     ((18u << 26) | ((offset) & 0x03FFFFFC) | ((lk) ? 1 : 0))
+#define PPC_MTCTR(rs)         (0x7C0903A6u | ((rs) << 21))
+#define PPC_BCTR(lk)          (0x4E800420u | ((lk) ? 1 : 0))
+#define PPC_BLR               0x4E800020u
+
+typedef struct
+{
+   uint32_t start;
+   uint32_t size;
+} __wut_jit_range_t;
+
+static BOOL sJitInitialised = FALSE;
+static OSMutex sJitMutex;
+static uint32_t sJitStart = 0;
+static uint32_t sJitSize = 0;
+
+// Free ranges sorted by address, the bookkeeping can't live in the code
+// space as it is only writable during a batch
+static __wut_jit_range_t sJitFree[WUT_JIT_MAX_FREE_RANGES];
+static uint32_t sJitNumFree = 0;
+
+static uint32_t sJitWriteDepth = 0;
+static uint32_t sJitWriterAffinity = 0;
+static uint32_t sJitDirtyStart = 0;
+static uint32_t sJitDirtyEnd = 0;
+
+BOOL
+WUTJitInit(void)
+{
+   uint32_t start = 0, size = 0, end;
+
+   if (sJitInitialised) {
+      return TRUE;
+   }
+
+   OSCodegenGetVirtAddrRange(&start, &size);
+   end = (start + size) & ~(WUT_JIT_ALIGN - 1);
+   start = JIT_ALIGN_UP(start);
+   if (!size || end <= start) {
+      return FALSE;
+   }
+
+   OSInitMutexEx(&sJitMutex, "WUTJit");
+   sJitStart = start;
+   sJitSize = end - start;
+   sJitFree[0].start = start;
+   sJitFree[0].size = sJitSize;
+   sJitNumFree = 1;
+   sJitInitialised = TRUE;
+   return TRUE;
+}
+
+void *
+WUTJitAlloc(uint32_t size)
+{
+   void *code = NULL;
+
+   if (!sJitInitialised || !size) {
+      return NULL;
+   }
+
+   size = JIT_ALIGN_UP(size);
+   OSLockMutex(&sJitMutex);
+   for (uint32_t i = 0; i < sJitNumFree; ++i) {
+      __wut_jit_range_t *range = &sJitFree[i];
+      if (range->size < size) {
+         continue;
+      }
+
+      code = (void *)range->start;
+      range->start += size;
+      range->size -= size;
+      if (!range->size) {
+         memmove(range, range + 1, (sJitNumFree - i - 1) * sizeof(__wut_jit_range_t));
+         --sJitNumFree;
+      }
+      break;
+   }
+   OSUnlockMutex(&sJitMutex);
+   return code;
+}
+
+void
+WUTJitFree(void *code,
+           uint32_t size)
+{
+   uint32_t start = (uint32_t)code;
+   uint32_t i;
+
+   if (!code || !size) {
+      return;
+   }
+
+   size = JIT_ALIGN_UP(size);
+   if (start < sJitStart || start + size > sJitStart + sJitSize) {
+      return;
+   }
+
+   OSLockMutex(&sJitMutex);
+   for (i = 0; i < sJitNumFree && sJitFree[i].start < start; ++i);
+
+   // Merge with the range before and after
+   if (i > 0 && sJitFree[i - 1].start + sJitFree[i - 1].size == start) {
+      sJitFree[i - 1].size += size;
+      if (i < sJitNumFree && start + size == sJitFree[i].start) {
+         sJitFree[i - 1].size += sJitFree[i].size;
+         memmove(&sJitFree[i], &sJitFree[i + 1], (sJitNumFree - i - 1) * sizeof(__wut_jit_range_t));
+         --sJitNumFree;
+      }
+   } else if (i < sJitNumFree && start + size == sJitFree[i].start) {
+      sJitFree[i].start = start;
+      sJitFree[i].size += size;
+   } else if (sJitNumFree < WUT_JIT_MAX_FREE_RANGES) {
+      memmove(&sJitFree[i + 1], &sJitFree[i], (sJitNumFree - i) * sizeof(__wut_jit_range_t));
+      sJitFree[i].start = start;
+      sJitFree[i].size = size;
+      ++sJitNumFree;
+   }
+   // Otherwise the range is lost until a neighbour is freed, the table is
+   // full of fragments anyway
+   OSUnlockMutex(&sJitMutex);
+}
+
+uint32_t
+WUTJitGetFreeSize(void)
+{
+   uint32_t size = 0;
+
+   if (!sJitInitialised) {
+      return 0;
+   }
+
+   OSLockMutex(&sJitMutex);
+   for (uint32_t i = 0; i < sJitNumFree; ++i) {
+      size += sJitFree[i].size;
+   }
+   OSUnlockMutex(&sJitMutex);
+   return size;
+}
+
+BOOL
+WUTJitBeginWrite(void)
+{
+   OSThread *thread = OSGetCurrentThread();
+
+   if (!sJitInitialised) {
+      return FALSE;
+   }
+
+   OSLockMutex(&sJitMutex);
+   if (sJitWriteDepth == 0) {
+      // Codegen only works on its core, so keep the thread there until the
+      // batch ends instead of trusting where it happens to run now
+      sJitWriterAffinity = OSGetThreadAffinity(thread);
+      OSSetThreadAffinity(thread, OS_THREAD_ATTRIB_AFFINITY_CPU0 << OSGetCodegenCore());
+      if (OSGetCoreId() != OSGetCodegenCore()) {
+         OSYieldThread();
+      }
+
+      if (OSGetCoreId() != OSGetCodegenCore()
+       || !OSSwitchSecCodeGenMode(CODEGEN_RW_)) {
+         OSSetThreadAffinity(thread, sJitWriterAffinity);
+         OSUnlockMutex(&sJitMutex);
+         return FALSE;
+      }
+
+      sJitDirtyStart = 0;
+      sJitDirtyEnd = 0;
+   }
+
+   // The mutex stays locked until the batch ends, so only one thread
+   // writes code at a time
+   ++sJitWriteDepth;
+   return TRUE;
+}
+
+void
+WUTJitEndWrite(void)
+{
+   if (!sJitWriteDepth) {
+      return;
+   }
+
+   if (--sJitWriteDepth == 0) {
+      if (sJitDirtyEnd > sJitDirtyStart) {
+         // Write the new instructions back to memory before the
+         // instruction cache refetches them
+         DCFlushRange((void *)sJitDirtyStart, sJitDirtyEnd - sJitDirtyStart);
+      }
+
+      OSSwitchSecCodeGenMode(CODEGEN_R_X);
+
+      if (sJitDirtyEnd > sJitDirtyStart) {
+         ICInvalidateRange((void *)sJitDirtyStart, sJitDirtyEnd - sJitDirtyStart);
+      }
+
+      OSSetThreadAffinity(OSGetCurrentThread(), sJitWriterAffinity);
+   }
+
+   OSUnlockMutex(&sJitMutex);
+}
+
+void
+WUTJitMarkWritten(void *dst,
+                  uint32_t size)
+{
+   uint32_t start = (uint32_t)dst;
+
+   if (!sJitWriteDepth || !size) {
+      return;
+   }
+
+   if (sJitDirtyEnd == sJitDirtyStart) {
+      sJitDirtyStart = start;
+      sJitDirtyEnd = start + size;
+   } else {
+      if (start < sJitDirtyStart) {
+         sJitDirtyStart = start;
+      }
+      if (start + size > sJitDirtyEnd) {
+         sJitDirtyEnd = start + size;
+      }
+   }
+}
+
+BOOL
+WUTJitWrite(void *dst,
+            const void *src,
+            uint32_t size)
+{
+   uint32_t start = (uint32_t)dst;
+
+   if (!size || start < sJitStart || start + size > sJitStart + sJitSize) {
+      return FALSE;
+   }
+
+   if (!WUTJitBeginWrite()) {
+      return FALSE;
+   }
+
+   memcpy(dst, src, size);
+   WUTJitMarkWritten(dst, size);
+   WUTJitEndWrite();
+   return TRUE;
+}
+
+void *
+WUTJitCreateTrampoline(const void *target)
+{
+   uint32_t code[WUT_JIT_TRAMPOLINE_SIZE / 4];
+   WUTJitEmitter emitter;
+   void *trampoline = WUTJitAlloc(WUT_JIT_TRAMPOLINE_SIZE);
+
+   if (!trampoline) {
+      return NULL;
+   }
+
+   // Always through CTR, so any target in the address space can be reached
+   WUTJitEmitterInit(&emitter, code, sizeof(code), trampoline);
+   WUTJitEmitLoadImm(&emitter, 12, (uint32_t)target);
+   WUTJitEmit(&emitter, PPC_MTCTR(12));
+   WUTJitEmit(&emitter, PPC_BCTR(0));
+
+   if (!WUTJitWrite(trampoline, code, WUTJitEmitterGetSize(&emitter))) {
+      WUTJitFree(trampoline, WUT_JIT_TRAMPOLINE_SIZE);
+      return NULL;
+   }
+
+   return trampoline;
+}
+
+void
+WUTJitEmitterInit(WUTJitEmitter *emitter,
+                  void *buffer,
+                  uint32_t size,
+                  const void *address)
+{
+   emitter->buffer = (uint32_t *)buffer;
+   emitter->address = (uint32_t)address;
+   emitter->count = 0;
+   emitter->capacity = size / 4;
+   emitter->overflow = FALSE;
+}
+
+uint32_t
+WUTJitEmitterGetSize(WUTJitEmitter *emitter)
+{
+   return emitter->count * 4;
+}
+
+uint32_t
+WUTJitEmitterGetAddress(WUTJitEmitter *emitter)
+{
+   return emitter->address + emitter->count * 4;
+}
+
+void
+WUTJitEmit(WUTJitEmitter *emitter,
+           uint32_t instruction)
+{
+   if (emitter->count >= emitter->capacity) {
+      emitter->overflow = TRUE;
+      return;
+   }
+
+   emitter->buffer[emitter->count++] = instruction;
+}
+
+void
+WUTJitEmitLoadImm(WUTJitEmitter *emitter,
+                  uint32_t reg,
+                  uint32_t value)
+{
+   if ((int32_t)value >= -0x8000 && (int32_t)value < 0x8000) {
+      WUTJitEmit(emitter, PPC_LI(reg, value));
+      return;
+   }
+
+   WUTJitEmit(emitter, PPC_LIS(reg, value >> 16));
+   if (value & 0xFFFF) {
+      WUTJitEmit(emitter, PPC_ORI(reg, reg, value));
+   }
+}
+
+void
+WUTJitEmitBranch(WUTJitEmitter *emitter,
+                 const void *target,
+                 BOOL link)
+{
+   int32_t offset = (int32_t)((uint32_t)target - WUTJitEmitterGetAddress(emitter));
+
+   if (offset >= -0x2000000 && offset < 0x2000000 && !(offset & 3)) {
+      WUTJitEmit(emitter, PPC_B((uint32_t)offset, link));
+      return;
+   }
+
+   WUTJitEmitLoadImm(emitter, 12, (uint32_t)target);
+   WUTJitEmit(emitter, PPC_MTCTR(12));
+   WUTJitEmit(emitter, PPC_BCTR(link));
+}
+
+void
+WUTJitEmitReturn(WUTJitEmitter *emitter)
+{
+   WUTJitEmit(emitter, PPC_BLR);
+}
@@ -0,0 +1,499 @@
+#include <wut_job.h>
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/event.h>
+#include <coreinit/semaphore.h>
+#include <coreinit/spinlock.h>
+#include <coreinit/thread.h>
+#include <string.h>
+
+#define JOB_NUM_CORES     3
+#define JOB_DEQUE_SIZE    1024
+#define JOB_DEQUE_MASK    (JOB_DEQUE_SIZE - 1)
+#define JOB_STACK_SIZE    (64 * 1024)
+
+/*
+ * Chase-Lev work stealing deque. Only the owning worker pushes and pops at
+ * the bottom, other threads steal from the top with a compare and swap.
+ */
+typedef struct JobDeque
+{
+   volatile int32_t top;
+   volatile int32_t bottom;
+   WUTJob *volatile jobs[JOB_DEQUE_SIZE];
+} JobDeque;
+
+typedef struct JobWorker
+{
+   OSThread thread;
+   JobDeque deque;
+   int index;
+} JobWorker;
+
+static JobWorker sWorkers[JOB_NUM_CORES];
+static __attribute__((aligned(16))) uint8_t sWorkerStacks[JOB_NUM_CORES][JOB_STACK_SIZE];
+static int sNumWorkers = 0;
+static volatile uint32_t sStop = 0;
+
+// Jobs submitted by threads that aren't workers, or by a worker with a full deque
+static OSSpinLock sSharedLock;
+static WUTJob *sSharedHead = NULL;
+static WUTJob *sSharedTail = NULL;
+
+// Idle workers sleep on the semaphore
+static OSSemaphore sWakeSemaphore;
+static volatile uint32_t sSleepers = 0;
+
+// Suspended workers wait on the event, which is signalled while running
+static OSEvent sResumeEvent;
+static volatile uint32_t sSuspended = 0;
+
+static BOOL
+__wut_job_deque_push(JobDeque *deque,
+                     WUTJob *job)
+{
+   int32_t bottom = deque->bottom;
+   if (bottom - deque->top >= JOB_DEQUE_SIZE) {
+      return FALSE;
+   }
+
+   deque->jobs[bottom & JOB_DEQUE_MASK] = job;
+   OSMemoryBarrier();
+   deque->bottom = bottom + 1;
+   return TRUE;
+}
+
+static WUTJob *
+__wut_job_deque_pop(JobDeque *deque)
+{
+   WUTJob *job;
+   int32_t top;
+   int32_t bottom = deque->bottom - 1;
+
+   deque->bottom = bottom;
+   OSMemoryBarrier();
+   top = deque->top;
+
+   if (top > bottom) {
+      // Empty
+      deque->bottom = bottom + 1;
+      return NULL;
+   }
+
+   job = deque->jobs[bottom & JOB_DEQUE_MASK];
+   if (top == bottom) {
+      // Last job, race any thieves for it
+      if (!OSCompareAndSwapAtomic((volatile uint32_t *)&deque->top, top, top + 1)) {
+         job = NULL;
+      }
+      deque->bottom = bottom + 1;
+   }
+
+   return job;
+}
+
+static WUTJob *
+__wut_job_deque_steal(JobDeque *deque)
+{
+   WUTJob *job;
+   int32_t top = deque->top;
+   OSMemoryBarrier();
+   int32_t bottom = deque->bottom;
+
+   if (top >= bottom) {
+      return NULL;
+   }
+
+   job = deque->jobs[top & JOB_DEQUE_MASK];
+   if (!OSCompareAndSwapAtomic((volatile uint32_t *)&deque->top, top, top + 1)) {
+      return NULL;
+   }
+
+   return job;
+}
+
+static void
+__wut_job_push_shared(WUTJob *job)
+{
+   job->next = NULL;
+
+   OSUninterruptibleSpinLock_Acquire(&sSharedLock);
+   if (sSharedTail) {
+      sSharedTail->next = job;
+   } else {
+      sSharedHead = job;
+   }
+   sSharedTail = job;
+   OSUninterruptibleSpinLock_Release(&sSharedLock);
+}
+
+static WUTJob *
+__wut_job_pop_shared(void)
+{
+   WUTJob *job;
+
+   if (!sSharedHead) {
+      return NULL;
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sSharedLock);
+   job = sSharedHead;
+   if (job) {
+      sSharedHead = job->next;
+      if (!sSharedHead) {
+         sSharedTail = NULL;
+      }
+   }
+   OSUninterruptibleSpinLock_Release(&sSharedLock);
+   return job;
+}
+
+static JobWorker *
+__wut_job_current_worker(void)
+{
+   OSThread *thread = OSGetCurrentThread();
+   int i;
+
+   for (i = 0; i < sNumWorkers; ++i) {
+      if (&sWorkers[i].thread == thread) {
+         return &sWorkers[i];
+      }
+   }
+
+   return NULL;
+}
+
+static WUTJob *
+__wut_job_find(JobWorker *self)
+{
+   WUTJob *job = NULL;
+   int i, start;
+
+   if (self) {
+      job = __wut_job_deque_pop(&self->deque);
+   }
+
+   if (!job) {
+      job = __wut_job_pop_shared();
+   }
+
+   // Steal starting after ourselves so thieves spread over the victims
+   start = self ? self->index + 1 : 0;
+   for (i = 0; !job && i < sNumWorkers; ++i) {
+      JobWorker *victim = &sWorkers[(start + i) % sNumWorkers];
+      if (victim != self) {
+         job = __wut_job_deque_steal(&victim->deque);
+      }
+   }
+
+   return job;
+}
+
+static void
+__wut_job_finish(WUTJob *job)
+{
+   while (job) {
+      // The job can be gone as soon as it is done
+      WUTJob *parent = job->parent;
+      if (OSAddAtomic((volatile int32_t *)&job->unfinished, -1) != 1) {
+         break;
+      }
+      job = parent;
+   }
+}
+
+static void
+__wut_job_run(WUTJob *job)
+{
+   if (job->fn) {
+      job->fn(job, job->userData);
+   }
+
+   __wut_job_finish(job);
+}
+
+static int
+__wut_job_worker_entry(int argc,
+                       const char **argv)
+{
+   JobWorker *self = (JobWorker *)argv;
+   WUTJob *job;
+
+   while (TRUE) {
+      // Only between jobs, a running job always completes
+      if (sSuspended && !sStop) {
+         OSWaitEvent(&sResumeEvent);
+         continue;
+      }
+
+      job = __wut_job_find(self);
+      if (job) {
+         __wut_job_run(job);
+         continue;
+      }
+
+      if (sStop) {
+         break;
+      }
+
+      // Check again after announcing the sleep so a submit can't be missed
+      OSAddAtomic((volatile int32_t *)&sSleepers, 1);
+      OSMemoryBarrier();
+      job = __wut_job_find(self);
+      if (!job && !sStop) {
+         OSWaitSemaphore(&sWakeSemaphore);
+      }
+      OSAddAtomic((volatile int32_t *)&sSleepers, -1);
+
+      if (job) {
+         __wut_job_run(job);
+      }
+   }
+
+   return 0;
+}
+
+BOOL
+WUTJobSystemInit(uint32_t coreMask,
+                 int32_t priority)
+{
+   int core, i;
+
+   if (sNumWorkers) {
+      return FALSE;
+   }
+
+   if (!coreMask) {
+      coreMask = OS_THREAD_ATTRIB_AFFINITY_ANY;
+   }
+
+   OSInitSpinLock(&sSharedLock);
+   OSInitSemaphoreEx(&sWakeSemaphore, 0, "wut job");
+   OSInitEventEx(&sResumeEvent, TRUE, OS_EVENT_MODE_MANUAL, "wut job resume");
+   sSharedHead = NULL;
+   sSharedTail = NULL;
+   sSleepers = 0;
+   sSuspended = 0;
+   sStop = 0;
+
+   for (core = 0; core < JOB_NUM_CORES; ++core) {
+      JobWorker *worker = &sWorkers[sNumWorkers];
+      if (!(coreMask & (1 << core))) {
+         continue;
+      }
+
+      memset(worker, 0, sizeof(JobWorker));
+      worker->index = sNumWorkers;
+      if (!OSCreateThread(&worker->thread,
+                          __wut_job_worker_entry,
+                          0,
+                          (char *)worker,
+                          sWorkerStacks[sNumWorkers] + JOB_STACK_SIZE,
+                          JOB_STACK_SIZE,
+                          priority,
+                          (OSThreadAttributes)(1 << core))) {
+         break;
+      }
+
+      OSSetThreadName(&worker->thread, "wut job worker");
+      ++sNumWorkers;
+   }
+
+   // Start them once the worker list is complete
+   for (i = 0; i < sNumWorkers; ++i) {
+      OSResumeThread(&sWorkers[i].thread);
+   }
+
+   if (core < JOB_NUM_CORES) {
+      WUTJobSystemShutdown();
+      return FALSE;
+   }
+
+   return sNumWorkers > 0;
+}
+
+void
+WUTJobSystemShutdown(void)
+{
+   int i;
+
+   sStop = 1;
+   OSMemoryBarrier();
+   for (i = 0; i < sNumWorkers; ++i) {
+      OSSignalSemaphore(&sWakeSemaphore);
+   }
+
+   // Suspended workers still have to drain their queues
+   if (sNumWorkers) {
+      OSSignalEvent(&sResumeEvent);
+   }
+
+   for (i = 0; i < sNumWorkers; ++i) {
+      OSJoinThread(&sWorkers[i].thread, NULL);
+   }
+
+   sNumWorkers = 0;
+}
+
+void
+WUTJobSystemSuspend(void)
+{
+   if (!sNumWorkers || sSuspended) {
+      return;
+   }
+
+   OSResetEvent(&sResumeEvent);
+   sSuspended = 1;
+   OSMemoryBarrier();
+}
+
+void
+WUTJobSystemResume(void)
+{
+   if (!sNumWorkers || !sSuspended) {
+      return;
+   }
+
+   sSuspended = 0;
+   OSMemoryBarrier();
+   OSSignalEvent(&sResumeEvent);
+
+   // Jobs submitted while suspended did not wake anyone up
+   if (sSharedHead && sSleepers) {
+      OSSignalSemaphore(&sWakeSemaphore);
+   }
+}
+
+BOOL
+WUTJobSystemIsSuspended(void)
+{
+   return sSuspended != 0;
+}
+
+void
+WUTJobInit(WUTJob *job,
+           WUTJobFn fn,
+           void *userData,
+           WUTJob *parent)
+{
+   job->fn = fn;
+   job->userData = userData;
+   job->parent = parent;
+   job->unfinished = 1;
+   job->next = NULL;
+
+   if (parent) {
+      OSAddAtomic((volatile int32_t *)&parent->unfinished, 1);
+   }
+}
+
+void
+WUTJobSubmit(WUTJob *job)
+{
+   JobWorker *self;
+
+   if (!sNumWorkers) {
+      __wut_job_run(job);
+      return;
+   }
+
+   self = __wut_job_current_worker();
+   if (!self || !__wut_job_deque_push(&self->deque, job)) {
+      __wut_job_push_shared(job);
+   }
+
+   OSMemoryBarrier();
+   if (sSleepers) {
+      OSSignalSemaphore(&sWakeSemaphore);
+   }
+}
+
+BOOL
+WUTJobIsDone(WUTJob *job)
+{
+   return job->unfinished == 0;
+}
+
+void
+WUTJobWait(WUTJob *job)
+{
+   JobWorker *self = __wut_job_current_worker();
+   WUTJob *other;
+
+   while (job->unfinished) {
+      other = __wut_job_find(self);
+      if (other) {
+         __wut_job_run(other);
+      } else {
+         OSYieldThread();
+      }
+   }
+}
+
+typedef struct JobRange
+{
+   WUTJob job;
+   uint32_t begin;
+   uint32_t end;
+   uint32_t grainSize;
+   WUTJobParallelForFn fn;
+   void *userData;
+} JobRange;
+
+static void
+__wut_job_parallel_range(uint32_t begin,
+                         uint32_t end,
+                         uint32_t grainSize,
+                         WUTJobParallelForFn fn,
+                         void *userData);
+
+static void
+__wut_job_range_fn(WUTJob *job,
+                   void *userData)
+{
+   JobRange *range = (JobRange *)job;
+   __wut_job_parallel_range(range->begin, range->end, range->grainSize,
+                            range->fn, range->userData);
+}
+
+static void
+__wut_job_parallel_range(uint32_t begin,
+                         uint32_t end,
+                         uint32_t grainSize,
+                         WUTJobParallelForFn fn,
+                         void *userData)
+{
+   JobRange right;
+   uint32_t mid;
+
+   if (end - begin <= grainSize) {
+      fn(begin, end, userData);
+      return;
+   }
+
+   // Offer the upper half to other workers and split the lower half further
+   mid = begin + (end - begin) / 2;
+   right.begin = mid;
+   right.end = end;
+   right.grainSize = grainSize;
+   right.fn = fn;
+   right.userData = userData;
+   WUTJobInit(&right.job, __wut_job_range_fn, NULL, NULL);
+   WUTJobSubmit(&right.job);
+
+   __wut_job_parallel_range(begin, mid, grainSize, fn, userData);
+   WUTJobWait(&right.job);
+}
+
+void
+WUTJobParallelFor(uint32_t count,
+                  uint32_t grainSize,
+                  WUTJobParallelForFn fn,
+                  void *userData)
+{
+   if (!count) {
+      return;
+   }
+
+   __wut_job_parallel_range(0, count, grainSize ? grainSize : 1, fn, userData);
+}
@@ -1,13 +1,337 @@
 #include <coreinit/memexpheap.h>
 #include <coreinit/memdefaultheap.h>
+#include <coreinit/memunitheap.h>
 #include <coreinit/memorymap.h>
+#include <coreinit/core.h>
+#include <coreinit/interrupts.h>
+#include <coreinit/spinlock.h>
+#include <coreinit/atomic.h>
+#include <coreinit/time.h>
+#include <wut_malloc.h>
+#include <wut_memory.h>
 #include <malloc.h>
+#include <stdio.h>
 #include <string.h>
 #include <errno.h>
 
+/*
+ * Optional per-core cache for small allocations.
+ *
+ * Blocks of 64 to 1024 bytes are carved out of 64 KiB slabs in an arena
+ * allocated from the default heap at startup. Each core keeps free lists
+ * per size class that are only touched with interrupts disabled, so most
+ * small allocations never take the heap lock. Cores refill from and return
+ * to a shared depot in batches. Every block stays 64 byte aligned.
+ */
+
+// Size of the small block arena in bytes, 0 disables the cache.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_malloc_cache_size = 0;
+
+#define CACHE_SLAB_SIZE    0x10000
+#define CACHE_MAX_SLABS    1024
+#define CACHE_NUM_CLASSES  5
+#define CACHE_MIN_BLOCK    0x40
+#define CACHE_MAX_BLOCK    (CACHE_MIN_BLOCK << (CACHE_NUM_CLASSES - 1))
+#define CACHE_BATCH        32
+#define CACHE_NUM_CORES    3
+
+typedef struct CacheBlock
+{
+   struct CacheBlock *next;
+} CacheBlock;
+
+typedef struct
+{
+   CacheBlock *head[CACHE_NUM_CLASSES];
+   uint32_t count[CACHE_NUM_CLASSES];
+} CoreCache;
+
+static uint8_t *sArena = NULL;
+static uint32_t sArenaSlabs = 0;
+static uint8_t sSlabClass[CACHE_MAX_SLABS];
+
+static CoreCache sCoreCache[CACHE_NUM_CORES];
+
+//! Guards the depot and sNextSlab
+static OSSpinLock sDepotLock;
+static CacheBlock *sDepot[CACHE_NUM_CLASSES];
+static uint32_t sNextSlab = 0;
+
+static inline int
+__wut_cache_class(size_t size)
+{
+   if (size <= CACHE_MIN_BLOCK) {
+      return 0;
+   }
+   return 32 - __builtin_clz(size - 1) - 6;
+}
+
+static inline int
+__wut_cache_owns(void *ptr)
+{
+   return sArena && (uint8_t *)ptr >= sArena &&
+          (uint8_t *)ptr < sArena + sArenaSlabs * CACHE_SLAB_SIZE;
+}
+
+static inline size_t
+__wut_cache_block_size(void *ptr)
+{
+   return CACHE_MIN_BLOCK << sSlabClass[((uint8_t *)ptr - sArena) / CACHE_SLAB_SIZE];
+}
+
+// Called with interrupts disabled
+static void
+__wut_cache_refill(CoreCache *cache,
+                   int cls)
+{
+   uint32_t i;
+
+   OSUninterruptibleSpinLock_Acquire(&sDepotLock);
+
+   if (!sDepot[cls] && sNextSlab < sArenaSlabs) {
+      // Carve a new slab into blocks of this class
+      uint8_t *slab = sArena + sNextSlab * CACHE_SLAB_SIZE;
+      size_t blockSize = CACHE_MIN_BLOCK << cls;
+
+      sSlabClass[sNextSlab++] = cls;
+      for (i = CACHE_SLAB_SIZE / blockSize; i > 0; --i) {
+         CacheBlock *block = (CacheBlock *)(slab + (i - 1) * blockSize);
+         block->next = sDepot[cls];
+         sDepot[cls] = block;
+      }
+   }
+
+   for (i = 0; i < CACHE_BATCH && sDepot[cls]; ++i) {
+      CacheBlock *block = sDepot[cls];
+      sDepot[cls] = block->next;
+      block->next = cache->head[cls];
+      cache->head[cls] = block;
+      cache->count[cls]++;
+   }
+
+   OSUninterruptibleSpinLock_Release(&sDepotLock);
+}
+
+static void *
+__wut_cache_alloc(size_t size)
+{
+   int cls = __wut_cache_class(size);
+   BOOL enabled = OSDisableInterrupts();
+   CoreCache *cache = &sCoreCache[OSGetCoreId()];
+   CacheBlock *block;
+
+   if (!cache->head[cls]) {
+      __wut_cache_refill(cache, cls);
+   }
+
+   block = cache->head[cls];
+   if (block) {
+      cache->head[cls] = block->next;
+      cache->count[cls]--;
+   }
+
+   OSRestoreInterrupts(enabled);
+   return block;
+}
+
+static void
+__wut_cache_free(void *ptr)
+{
+   int cls = sSlabClass[((uint8_t *)ptr - sArena) / CACHE_SLAB_SIZE];
+   BOOL enabled = OSDisableInterrupts();
+   CoreCache *cache = &sCoreCache[OSGetCoreId()];
+   CacheBlock *block = (CacheBlock *)ptr;
+   uint32_t i;
+
+   block->next = cache->head[cls];
+   cache->head[cls] = block;
+   cache->count[cls]++;
+
+   // Give a batch back once this core holds two
+   if (cache->count[cls] >= 2 * CACHE_BATCH) {
+      OSUninterruptibleSpinLock_Acquire(&sDepotLock);
+      for (i = 0; i < CACHE_BATCH; ++i) {
+         block = cache->head[cls];
+         cache->head[cls] = block->next;
+         block->next = sDepot[cls];
+         sDepot[cls] = block;
+      }
+      cache->count[cls] -= CACHE_BATCH;
+      OSUninterruptibleSpinLock_Release(&sDepotLock);
+   }
+
+   OSRestoreInterrupts(enabled);
+}
+
+/*
+ * Optional unit heap backend for allocations of up to 256 bytes.
+ *
+ * One region from the default heap is split evenly between unit heaps for
+ * 16, 32, 64, 128 and 256 byte blocks, which allocate and free in O(1) with
+ * no fragmentation. Blocks are aligned to their size, up to 64 bytes, so
+ * unlike other allocations the 16 and 32 byte ones are not 64 byte aligned.
+ * Used before the small block cache when both are enabled.
+ */
+
+// Total size of the unit heaps in bytes, 0 disables them.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_malloc_unit_heap_size = 0;
+
+#define UNIT_NUM_CLASSES   5
+#define UNIT_MIN_BLOCK     0x10
+#define UNIT_MAX_BLOCK     (UNIT_MIN_BLOCK << (UNIT_NUM_CLASSES - 1))
+
+static uint8_t *sUnitRegion = NULL;
+static uint32_t sUnitClassSize = 0;
+static MEMHeapHandle sUnitHeaps[UNIT_NUM_CLASSES];
+
+static inline int
+__wut_unit_class(size_t size)
+{
+   if (size <= UNIT_MIN_BLOCK) {
+      return 0;
+   }
+   return 32 - __builtin_clz(size - 1) - 4;
+}
+
+static inline uint32_t
+__wut_unit_alignment(int cls)
+{
+   uint32_t blockSize = UNIT_MIN_BLOCK << cls;
+   return blockSize < 0x40 ? blockSize : 0x40;
+}
+
+static inline int
+__wut_unit_owns(void *ptr)
+{
+   return sUnitRegion && (uint8_t *)ptr >= sUnitRegion &&
+          (uint8_t *)ptr < sUnitRegion + sUnitClassSize * UNIT_NUM_CLASSES;
+}
+
+static inline int
+__wut_unit_class_of(void *ptr)
+{
+   return ((uint8_t *)ptr - sUnitRegion) / sUnitClassSize;
+}
+
+static void *
+__wut_unit_alloc(size_t size,
+                 size_t align)
+{
+   int cls = __wut_unit_class(size);
+
+   // Use a bigger class if this one isn't aligned enough
+   while (cls < UNIT_NUM_CLASSES && __wut_unit_alignment(cls) < align) {
+      ++cls;
+   }
+
+   if (cls >= UNIT_NUM_CLASSES || !sUnitHeaps[cls]) {
+      return NULL;
+   }
+
+   return MEMAllocFromUnitHeap(sUnitHeaps[cls]);
+}
+
+static void
+__wut_init_unit_heaps(void)
+{
+   int cls;
+
+   if (!__wut_malloc_unit_heap_size) {
+      return;
+   }
+
+   sUnitClassSize = (__wut_malloc_unit_heap_size / UNIT_NUM_CLASSES) & ~0x3F;
+   if (sUnitClassSize < 0x1000) {
+      return;
+   }
+
+   sUnitRegion = MEMAllocFromDefaultHeapEx(sUnitClassSize * UNIT_NUM_CLASSES, 0x40);
+   if (!sUnitRegion) {
+      return;
+   }
+
+   for (cls = 0; cls < UNIT_NUM_CLASSES; ++cls) {
+      sUnitHeaps[cls] = MEMCreateUnitHeapEx(sUnitRegion + cls * sUnitClassSize,
+                                            sUnitClassSize,
+                                            UNIT_MIN_BLOCK << cls,
+                                            __wut_unit_alignment(cls),
+                                            MEM_HEAP_FLAG_USE_LOCK);
+   }
+}
+
+/*
+ * Optional allocation tracing. Every allocation, free and in place resize
+ * is recorded into a ring buffer together with the caller's return address,
+ * see wut_malloc.h for reading it back.
+ */
+
+// Number of trace entries to keep, rounded down to a power of two, 0
+// disables tracing. Each entry takes 24 bytes.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_malloc_trace_size = 0;
+
+static WUTMallocTraceEntry *sTrace = NULL;
+static uint32_t sTraceMask = 0;
+static volatile uint32_t sTraceNext = 0;
+static volatile uint32_t sTracePaused = 0;
+
+static void
+__wut_init_trace(void)
+{
+   uint32_t count = __wut_malloc_trace_size;
+   while (count & (count - 1)) {
+      count &= count - 1;
+   }
+
+   if (count) {
+      sTrace = MEMAllocFromDefaultHeapEx(count * sizeof(WUTMallocTraceEntry), 0x40);
+      if (sTrace) {
+         memset(sTrace, 0, count * sizeof(WUTMallocTraceEntry));
+         sTraceMask = count - 1;
+      }
+   }
+}
+
+static void
+__wut_trace(WUTMallocTraceType type,
+            void *ptr,
+            uint32_t size,
+            uint32_t align,
+            void *caller)
+{
+   WUTMallocTraceEntry *entry;
+
+   if (!sTrace || sTracePaused) {
+      return;
+   }
+
+   entry = &sTrace[(uint32_t)OSAddAtomic((volatile int32_t *)&sTraceNext, 1) & sTraceMask];
+   entry->time = OSGetSystemTime();
+   entry->ptr = ptr;
+   entry->caller = caller;
+   entry->size = size;
+   entry->align = (uint16_t)align;
+   entry->type = (uint16_t)type;
+}
+
 void
 __init_wut_malloc(void)
 {
+   __wut_init_unit_heaps();
+   __wut_init_trace();
+
+   uint32_t slabs = __wut_malloc_cache_size / CACHE_SLAB_SIZE;
+   if (slabs > CACHE_MAX_SLABS) {
+      slabs = CACHE_MAX_SLABS;
+   }
+
+   OSInitSpinLock(&sDepotLock);
+   if (slabs) {
+      sArena = MEMAllocFromDefaultHeapEx(slabs * CACHE_SLAB_SIZE, CACHE_SLAB_SIZE);
+      sArenaSlabs = sArena ? slabs : 0;
+   }
 }
 
 void
@@ -15,37 +339,192 @@ __fini_wut_malloc(void)
 {
 }
 
-void *
-_malloc_r(struct _reent *r, size_t size)
+static size_t
+__wut_usable_size(void *ptr)
+{
+   if (__wut_unit_owns(ptr)) {
+      return UNIT_MIN_BLOCK << __wut_unit_class_of(ptr);
+   }
+   if (__wut_cache_owns(ptr)) {
+      return __wut_cache_block_size(ptr);
+   }
+   return MEMGetSizeForMBlockExpHeap(ptr);
+}
+
+/*
+ * Optional usage counters, reported by mallinfo and malloc_stats. They add
+ * a few atomic operations to every allocation and free.
+ */
+
+// Set to 1 to count allocations and track the bytes in use and their peak.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_malloc_track_usage = 0;
+
+static volatile uint32_t sAllocCount = 0;
+static volatile uint32_t sBlocksInUse = 0;
+static volatile uint32_t sBytesInUse = 0;
+static volatile uint32_t sPeakBytesInUse = 0;
+
+static void
+__wut_track_alloc(void *ptr)
+{
+   uint32_t size = __wut_usable_size(ptr);
+   uint32_t inUse, peak;
+
+   OSAddAtomic((volatile int32_t *)&sAllocCount, 1);
+   OSAddAtomic((volatile int32_t *)&sBlocksInUse, 1);
+   inUse = OSAddAtomic((volatile int32_t *)&sBytesInUse, size) + size;
+
+   do {
+      peak = sPeakBytesInUse;
+   } while (inUse > peak && !OSCompareAndSwapAtomic(&sPeakBytesInUse, peak, inUse));
+}
+
+static void
+__wut_track_free(void *ptr)
+{
+   OSAddAtomic((volatile int32_t *)&sBlocksInUse, -1);
+   OSAddAtomic((volatile int32_t *)&sBytesInUse, -(int32_t)__wut_usable_size(ptr));
+}
+
+static void *
+__wut_malloc(size_t size)
+{
+   void *ptr = NULL;
+
+   if (sUnitRegion && size <= UNIT_MAX_BLOCK) {
+      ptr = __wut_unit_alloc(size, 0);
+   }
+
+   if (!ptr && sArena && size <= CACHE_MAX_BLOCK) {
+      ptr = __wut_cache_alloc(size);
+   }
+
+   if (!ptr) {
+      ptr = MEMAllocFromDefaultHeapEx(size, 0x40);
+   }
+
+   return ptr;
+}
+
+static void *
+__wut_memalign(size_t align, size_t size)
+{
+   if (sUnitRegion && size <= UNIT_MAX_BLOCK && align <= 0x40) {
+      void *ptr = __wut_unit_alloc(size, align);
+      if (ptr) {
+         return ptr;
+      }
+   }
+
+   // Cached blocks are 64 byte aligned like the heap ones
+   if (sArena && align <= CACHE_MIN_BLOCK && size <= CACHE_MAX_BLOCK) {
+      void *ptr = __wut_cache_alloc(size);
+      if (ptr) {
+         return ptr;
+      }
+   }
+
+   // Only the start needs the alignment. The end is rounded to a cache line
+   // so aligned DMA buffers never share one with the next block
+   return MEMAllocFromDefaultHeapEx((size + 0x3F) & ~0x3F, align < 0x40 ? 0x40 : align);
+}
+
+static inline void *
+__wut_alloc_result(struct _reent *r,
+                   void *ptr,
+                   size_t size,
+                   size_t align,
+                   void *caller)
 {
-   void *ptr = MEMAllocFromDefaultHeapEx(size, 0x40);
    if (!ptr) {
       r->_errno = ENOMEM;
+      return NULL;
+   }
+
+   if (__wut_malloc_track_usage) {
+      __wut_track_alloc(ptr);
+   }
+   if (sTrace) {
+      __wut_trace(WUT_MALLOC_TRACE_ALLOC, ptr, size, align, caller);
    }
    return ptr;
 }
 
+static void
+__wut_free(void *ptr,
+           void *caller)
+{
+   if (__wut_malloc_track_usage) {
+      __wut_track_free(ptr);
+   }
+   if (sTrace) {
+      __wut_trace(WUT_MALLOC_TRACE_FREE, ptr, 0, 0, caller);
+   }
+
+   if (__wut_unit_owns(ptr)) {
+      MEMFreeToUnitHeap(sUnitHeaps[__wut_unit_class_of(ptr)], ptr);
+   } else if (__wut_cache_owns(ptr)) {
+      __wut_cache_free(ptr);
+   } else {
+      MEMFreeToDefaultHeap(ptr);
+   }
+}
+
+void *
+_malloc_r(struct _reent *r, size_t size)
+{
+   return __wut_alloc_result(r, __wut_malloc(size), size, 0, __builtin_return_address(0));
+}
+
 void
 _free_r(struct _reent *r, void *ptr)
 {
    if (ptr) {
-      MEMFreeToDefaultHeap(ptr);
+      __wut_free(ptr, __builtin_return_address(0));
    }
 }
 
 void *
 _realloc_r(struct _reent *r, void *ptr, size_t size)
 {
-   void *new_ptr = MEMAllocFromDefaultHeapEx(size, 0x40);
+   void *caller = __builtin_return_address(0);
+
+   if (ptr) {
+      // Try to grow or shrink the block where it is first
+      if (__wut_unit_owns(ptr) || __wut_cache_owns(ptr)) {
+         if (size <= __wut_usable_size(ptr)) {
+            if (sTrace) {
+               __wut_trace(WUT_MALLOC_TRACE_RESIZE, ptr, size, 0, caller);
+            }
+            return ptr;
+         }
+      } else {
+         MEMHeapHandle heap = MEMFindContainHeap(ptr);
+         if (heap && heap->tag == MEM_EXPANDED_HEAP_TAG) {
+            uint32_t old_size = __wut_usable_size(ptr);
+            if (MEMResizeForMBlockExpHeap(heap, ptr, size ? size : 1)) {
+               if (__wut_malloc_track_usage) {
+                  OSAddAtomic((volatile int32_t *)&sBytesInUse, (int32_t)(__wut_usable_size(ptr) - old_size));
+               }
+               if (sTrace) {
+                  __wut_trace(WUT_MALLOC_TRACE_RESIZE, ptr, size, 0, caller);
+               }
+               return ptr;
+            }
+         }
+      }
+   }
+
+   void *new_ptr = __wut_alloc_result(r, __wut_malloc(size), size, 0, caller);
    if (!new_ptr) {
-      r->_errno = ENOMEM;
       return new_ptr;
    }
 
    if (ptr) {
-      size_t old_size = MEMGetSizeForMBlockExpHeap(ptr);
-      memcpy(new_ptr, ptr, old_size <= size ? old_size : size);
-      MEMFreeToDefaultHeap(ptr);
+      size_t old_size = __wut_usable_size(ptr);
+      WUTMemcpy(new_ptr, ptr, old_size <= size ? old_size : size);
+      __wut_free(ptr, caller);
    }
    return new_ptr;
 }
@@ -53,11 +532,9 @@ _realloc_r(struct _reent *r, void *ptr, size_t size)
 void *
 _calloc_r(struct _reent *r, size_t num, size_t size)
 {
-   void *ptr = MEMAllocFromDefaultHeapEx(num * size, 0x40);
+   void *ptr = __wut_alloc_result(r, __wut_malloc(num * size), num * size, 0, __builtin_return_address(0));
    if (ptr) {
-      memset(ptr, 0, num * size);
-   } else {
-      r->_errno = ENOMEM;
+      WUTMemset(ptr, 0, num * size);
    }
 
    return ptr;
@@ -66,18 +543,76 @@ _calloc_r(struct _reent *r, size_t num, size_t size)
 void *
 _memalign_r(struct _reent *r, size_t align, size_t size)
 {
-   return MEMAllocFromDefaultHeapEx((size + align - 1) & ~(align - 1), align);
+   return __wut_alloc_result(r, __wut_memalign(align, size), size, align, __builtin_return_address(0));
+}
+
+static MEMHeapHandle
+__wut_get_exp_heap(void)
+{
+   MEMHeapHandle heap = MEMGetBaseHeapHandle(MEM_BASE_HEAP_MEM2);
+   if (!heap || heap->tag != MEM_EXPANDED_HEAP_TAG) {
+      return NULL;
+   }
+   return heap;
 }
 
+/*
+ * arena, fordblks, ordblks and keepcost describe the MEM2 expanded heap:
+ * its size, free bytes, number of free blocks and largest free block.
+ * uordblks is the rest of the heap. With __wut_malloc_track_usage set,
+ * uordblks is the bytes allocated through malloc instead, usmblks their
+ * peak, hblks the number of blocks in use and smblks the total number of
+ * allocations so far.
+ */
 struct mallinfo _mallinfo_r(struct _reent *r)
 {
    struct mallinfo info = { 0 };
+   MEMHeapHandle heap = __wut_get_exp_heap();
+   MEMExpHeapBlock *block;
+
+   if (heap) {
+      info.arena = (uint8_t *)heap->dataEnd - (uint8_t *)heap->dataStart;
+      info.fordblks = MEMGetTotalFreeSizeForExpHeap(heap);
+      info.keepcost = MEMGetAllocatableSizeForExpHeapEx(heap, 4);
+      info.uordblks = info.arena - info.fordblks;
+
+      if (heap->flags & MEM_HEAP_FLAG_USE_LOCK) {
+         OSUninterruptibleSpinLock_Acquire(&heap->lock);
+      }
+      for (block = ((MEMExpHeap *)heap)->freeList.head; block; block = block->next) {
+         info.ordblks++;
+      }
+      if (heap->flags & MEM_HEAP_FLAG_USE_LOCK) {
+         OSUninterruptibleSpinLock_Release(&heap->lock);
+      }
+   }
+
+   if (__wut_malloc_track_usage) {
+      info.uordblks = sBytesInUse;
+      info.usmblks = sPeakBytesInUse;
+      info.hblks = sBlocksInUse;
+      info.smblks = sAllocCount;
+   }
+
    return info;
 }
 
 void
 _malloc_stats_r(struct _reent *r)
 {
+   struct mallinfo info = _mallinfo_r(r);
+
+   fprintf(stderr, "heap size         = %10u\n", (unsigned)info.arena);
+   fprintf(stderr, "free bytes        = %10u\n", (unsigned)info.fordblks);
+   fprintf(stderr, "free blocks       = %10u\n", (unsigned)info.ordblks);
+   fprintf(stderr, "largest free      = %10u\n", (unsigned)info.keepcost);
+   fprintf(stderr, "in use bytes      = %10u\n", (unsigned)info.uordblks);
+
+   if (__wut_malloc_track_usage) {
+      fprintf(stderr, "peak in use bytes = %10u\n", (unsigned)info.usmblks);
+      fprintf(stderr, "in use blocks     = %10u\n", (unsigned)info.hblks);
+      fprintf(stderr, "allocations       = %10u\n", (unsigned)info.smblks);
+   }
 }
 
 int
@@ -89,19 +624,20 @@ _mallopt_r(struct _reent *r, int param, int value)
 size_t
 _malloc_usable_size_r(struct _reent *r, void *ptr)
 {
-   return MEMGetSizeForMBlockExpHeap(ptr);
+   return __wut_usable_size(ptr);
 }
 
 void *
 _valloc_r(struct _reent *r, size_t size)
 {
-   return MEMAllocFromDefaultHeapEx(size, OS_PAGE_SIZE);
+   return __wut_alloc_result(r, MEMAllocFromDefaultHeapEx(size, OS_PAGE_SIZE), size, OS_PAGE_SIZE, __builtin_return_address(0));
 }
 
 void *
 _pvalloc_r(struct _reent *r, size_t size)
 {
-   return MEMAllocFromDefaultHeapEx((size + (OS_PAGE_SIZE - 1)) & ~(OS_PAGE_SIZE - 1), OS_PAGE_SIZE);
+   size = (size + (OS_PAGE_SIZE - 1)) & ~(OS_PAGE_SIZE - 1);
+   return __wut_alloc_result(r, MEMAllocFromDefaultHeapEx(size, OS_PAGE_SIZE), size, OS_PAGE_SIZE, __builtin_return_address(0));
 }
 
 int
@@ -109,3 +645,99 @@ _malloc_trim_r(struct _reent *r, size_t pad)
 {
    return 0;
 }
+
+uint32_t
+WUTMallocTraceGetEntries(WUTMallocTraceEntry *outEntries,
+                         uint32_t maxEntries)
+{
+   uint32_t next, count, i;
+
+   if (!sTrace || !outEntries) {
+      return 0;
+   }
+
+   next = sTraceNext;
+   count = next <= sTraceMask ? next : sTraceMask + 1;
+   if (count > maxEntries) {
+      count = maxEntries;
+   }
+
+   // Newest entries last
+   for (i = 0; i < count; ++i) {
+      outEntries[i] = sTrace[(next - count + i) & sTraceMask];
+   }
+   return count;
+}
+
+void
+WUTMallocTraceReset(void)
+{
+   sTraceNext = 0;
+}
+
+BOOL
+WUTMallocTraceDump(WUTMallocTraceWriteFn writeFn,
+                   void *userContext)
+{
+   struct mallinfo info;
+   WUTMallocTraceEntry entry;
+   uint32_t next, count, i;
+   char line[128];
+   static const char *types[] = { "alloc", "free", "resize" };
+
+   if (!sTrace || !writeFn) {
+      return FALSE;
+   }
+
+   // Don't record the allocations made by writeFn itself
+   OSAddAtomic((volatile int32_t *)&sTracePaused, 1);
+
+   info = _mallinfo_r(_REENT);
+   snprintf(line, sizeof(line),
+            "# heap %u free %u free_blocks %u largest_free %u\n",
+            (unsigned)info.arena, (unsigned)info.fordblks,
+            (unsigned)info.ordblks, (unsigned)info.keepcost);
+   writeFn(line, userContext);
+   writeFn("# time type ptr size align caller\n", userContext);
+
+   next = sTraceNext;
+   count = next <= sTraceMask ? next : sTraceMask + 1;
+   for (i = 0; i < count; ++i) {
+      entry = sTrace[(next - count + i) & sTraceMask];
+      snprintf(line, sizeof(line), "%llu %s %p %u %u %p\n",
+               (unsigned long long)entry.time,
+               types[entry.type <= WUT_MALLOC_TRACE_RESIZE ? entry.type : 0],
+               entry.ptr, (unsigned)entry.size, (unsigned)entry.align,
+               entry.caller);
+      writeFn(line, userContext);
+   }
+
+   OSAddAtomic((volatile int32_t *)&sTracePaused, -1);
+   return TRUE;
+}
+
+static void
+__wut_trace_write_file(const char *line,
+                       void *userContext)
+{
+   fputs(line, (FILE *)userContext);
+}
+
+BOOL
+WUTMallocTraceDumpToFile(const char *path)
+{
+   BOOL result;
+   FILE *file;
+
+   if (!sTrace) {
+      return FALSE;
+   }
+
+   file = fopen(path, "w");
+   if (!file) {
+      return FALSE;
+   }
+
+   result = WUTMallocTraceDump(__wut_trace_write_file, file);
+   return fclose(file) == 0 ? result : FALSE;
+}
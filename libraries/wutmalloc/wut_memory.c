@@ -0,0 +1,102 @@
+#include <wut_memory.h>
+#include <string.h>
+
+#define MEM_CACHE_LINE     32
+#define MEM_MIN_SIZE       256
+#define MEM_PREFETCH_AHEAD (4 * MEM_CACHE_LINE)
+
+static inline void
+__wut_dcbz(void *ptr)
+{
+   __asm__ volatile ("dcbz 0, %0" : : "r" (ptr) : "memory");
+}
+
+static inline void
+__wut_dcbt(const void *ptr)
+{
+   // A touch never faults, so prefetching past the end of src is fine
+   __asm__ volatile ("dcbt 0, %0" : : "r" (ptr));
+}
+
+void *
+WUTMemcpy(void *dst,
+          const void *src,
+          size_t size)
+{
+   uint8_t *d = (uint8_t *)dst;
+   const uint8_t *s = (const uint8_t *)src;
+   size_t head;
+
+   if (size < MEM_MIN_SIZE) {
+      return memcpy(dst, src, size);
+   }
+
+   // Partial lines at either end are copied normally
+   head = -(uintptr_t)d & (MEM_CACHE_LINE - 1);
+   if (head) {
+      memcpy(d, s, head);
+      d += head;
+      s += head;
+      size -= head;
+   }
+
+   while (size >= MEM_CACHE_LINE) {
+      __wut_dcbt(s + MEM_PREFETCH_AHEAD);
+      __wut_dcbz(d);
+      __builtin_memcpy(d, s, MEM_CACHE_LINE);
+      d += MEM_CACHE_LINE;
+      s += MEM_CACHE_LINE;
+      size -= MEM_CACHE_LINE;
+   }
+
+   if (size) {
+      memcpy(d, s, size);
+   }
+
+   return dst;
+}
+
+void *
+WUTMemset(void *dst,
+          int c,
+          size_t size)
+{
+   uint8_t *d = (uint8_t *)dst;
+   uint32_t pattern;
+   size_t head;
+
+   if (size < MEM_MIN_SIZE) {
+      return memset(dst, c, size);
+   }
+
+   head = -(uintptr_t)d & (MEM_CACHE_LINE - 1);
+   if (head) {
+      memset(d, c, head);
+      d += head;
+      size -= head;
+   }
+
+   pattern = (uint8_t)c * 0x01010101u;
+   while (size >= MEM_CACHE_LINE) {
+      __wut_dcbz(d);
+      if (pattern) {
+         uint32_t *words = (uint32_t *)d;
+         words[0] = pattern;
+         words[1] = pattern;
+         words[2] = pattern;
+         words[3] = pattern;
+         words[4] = pattern;
+         words[5] = pattern;
+         words[6] = pattern;
+         words[7] = pattern;
+      }
+      d += MEM_CACHE_LINE;
+      size -= MEM_CACHE_LINE;
+   }
+
+   if (size) {
+      memset(d, c, size);
+   }
+
+   return dst;
+}
@@ -0,0 +1,315 @@
+#include <coreinit/cache.h>
+#include <coreinit/debug.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/thread.h>
+#include <string.h>
+#include <wut_mic.h>
+
+#define MIC_THREAD_STACK_SIZE   0x2000
+#define MIC_BUFFER_SAMPLES      0x2800
+#define MIC_DEFAULT_RING        0x4000
+#define MIC_PHASE_ONE           0x10000
+
+struct WUTMicCapture
+{
+   MICHandle handle;
+   MICWorkMemory workMemory;
+   uint32_t outputRate;
+   OSTime interval;
+   volatile uint32_t stopRequested;
+
+   //! Resampler state, capture thread only.
+   uint32_t step;
+   uint32_t phase;
+   int16_t previous;
+
+   int16_t *ring;
+   uint32_t ringMask;
+
+   //! Written by the capture thread only.
+   volatile uint32_t head __attribute__((aligned(32)));
+   volatile uint32_t overruns;
+
+   //! The sample before index anchorHead was recorded at about anchorTime,
+   //! updated under anchorSequence which is odd while they are written.
+   volatile uint32_t anchorSequence;
+   volatile uint32_t anchorHead;
+   volatile OSTime anchorTime;
+
+   //! Consumer only.
+   volatile uint32_t tail __attribute__((aligned(32)));
+
+   OSThread thread;
+   uint8_t stack[MIC_THREAD_STACK_SIZE] __attribute__((aligned(16)));
+};
+
+static uint32_t
+__wut_mic_resample(WUTMicCapture *capture,
+                   const int16_t *samples,
+                   uint32_t count,
+                   uint32_t head)
+{
+   uint32_t tail = capture->tail;
+
+   for (uint32_t i = 0; i < count; ++i) {
+      int32_t sample = samples[i];
+
+      // Linear interpolation between the previous input sample and this one
+      while (capture->phase < MIC_PHASE_ONE) {
+         int32_t previous = capture->previous;
+         int32_t value = previous + (((sample - previous) * (int32_t)(capture->phase >> 1)) >> 15);
+
+         if (head - tail > capture->ringMask) {
+            capture->overruns++;
+         } else {
+            capture->ring[head & capture->ringMask] = (int16_t)value;
+            ++head;
+         }
+
+         capture->phase += capture->step;
+      }
+
+      capture->phase -= MIC_PHASE_ONE;
+      capture->previous = (int16_t)sample;
+   }
+
+   return head;
+}
+
+static uint32_t
+__wut_mic_copy(WUTMicCapture *capture,
+               const int16_t *samples,
+               uint32_t count,
+               uint32_t head)
+{
+   uint32_t space = capture->ringMask + 1 - (head - capture->tail);
+
+   if (count > space) {
+      capture->overruns += count - space;
+      count = space;
+   }
+
+   for (uint32_t i = 0; i < count; ++i) {
+      capture->ring[(head + i) & capture->ringMask] = samples[i];
+   }
+
+   return head + count;
+}
+
+static void
+__wut_mic_drain(WUTMicCapture *capture)
+{
+   MICStatus status;
+   int16_t *buffer = (int16_t *)capture->workMemory.sampleBuffer;
+   uint32_t head = capture->head;
+
+   if (MICGetStatus(capture->handle, &status) != MIC_ERROR_OK || status.availableData <= 0) {
+      return;
+   }
+
+   OSTime now = OSGetSystemTime();
+   uint32_t available = (uint32_t)status.availableData;
+   uint32_t position = (uint32_t)status.bufferPos;
+
+   while (available) {
+      uint32_t count = capture->workMemory.sampleMaxCount - position;
+      if (count > available) {
+         count = available;
+      }
+
+      // The mic ring is only ever written by DMA
+      DCInvalidateRange(buffer + position, count * sizeof(int16_t));
+
+      if (capture->step == MIC_PHASE_ONE) {
+         head = __wut_mic_copy(capture, buffer + position, count, head);
+      } else {
+         head = __wut_mic_resample(capture, buffer + position, count, head);
+      }
+
+      position = (position + count) % capture->workMemory.sampleMaxCount;
+      available -= count;
+   }
+
+   MICSetDataConsumed(capture->handle, status.availableData);
+
+   // Publish the samples before the index that makes them visible
+   OSMemoryBarrier();
+   capture->head = head;
+
+   capture->anchorSequence++;
+   OSMemoryBarrier();
+   capture->anchorHead = head;
+   capture->anchorTime = now;
+   OSMemoryBarrier();
+   capture->anchorSequence++;
+}
+
+static int
+__wut_mic_thread_entry(int argc,
+                       const char **argv)
+{
+   WUTMicCapture *capture = (WUTMicCapture *)argv;
+
+   while (!capture->stopRequested) {
+      __wut_mic_drain(capture);
+      OSSleepTicks(capture->interval);
+   }
+
+   return 0;
+}
+
+static void
+__wut_mic_free(WUTMicCapture *capture)
+{
+   if (capture->ring) {
+      MEMFreeToDefaultHeap(capture->ring);
+   }
+   if (capture->workMemory.sampleBuffer) {
+      MEMFreeToDefaultHeap(capture->workMemory.sampleBuffer);
+   }
+   MEMFreeToDefaultHeap(capture);
+}
+
+WUTMicCapture *
+WUTMicCaptureStart(const WUTMicCaptureConfig *config)
+{
+   WUTMicCaptureConfig defaults;
+   WUTMicCapture *capture;
+   MICError error = MIC_ERROR_OK;
+
+   if (!config) {
+      memset(&defaults, 0, sizeof(defaults));
+      config = &defaults;
+   }
+
+   uint32_t outputRate = config->outputRate ? config->outputRate : WUT_MIC_SAMPLE_RATE;
+   uint32_t ringSamples = config->ringSamples ? config->ringSamples : MIC_DEFAULT_RING;
+   if (outputRate > WUT_MIC_SAMPLE_RATE || (ringSamples & (ringSamples - 1))) {
+      return NULL;
+   }
+
+   capture = (WUTMicCapture *)MEMAllocFromDefaultHeapEx(sizeof(WUTMicCapture), 32);
+   if (!capture) {
+      return NULL;
+   }
+
+   memset(capture, 0, sizeof(WUTMicCapture));
+   capture->outputRate = outputRate;
+   capture->interval = config->interval ? config->interval : OSMillisecondsToTicks(5);
+   capture->step = (uint32_t)(((uint64_t)WUT_MIC_SAMPLE_RATE << 16) / outputRate);
+   capture->ringMask = ringSamples - 1;
+   capture->ring = (int16_t *)MEMAllocFromDefaultHeapEx(ringSamples * sizeof(int16_t), 32);
+   capture->workMemory.sampleMaxCount = MIC_BUFFER_SAMPLES;
+   capture->workMemory.sampleBuffer = MEMAllocFromDefaultHeapEx(MIC_BUFFER_SAMPLES * sizeof(int16_t), 0x40);
+   if (!capture->ring || !capture->workMemory.sampleBuffer) {
+      __wut_mic_free(capture);
+      return NULL;
+   }
+
+   capture->handle = MICInit(config->instance, 0, &capture->workMemory, &error);
+   if (error != MIC_ERROR_OK) {
+      WUT_DEBUG_REPORT("WUTMicCaptureStart: MICInit failed with %d\n", error);
+      __wut_mic_free(capture);
+      return NULL;
+   }
+
+   error = MICOpen(capture->handle);
+   if (error != MIC_ERROR_OK) {
+      WUT_DEBUG_REPORT("WUTMicCaptureStart: MICOpen failed with %d\n", error);
+      MICUninit(capture->handle);
+      __wut_mic_free(capture);
+      return NULL;
+   }
+
+   if (!OSCreateThread(&capture->thread,
+                       __wut_mic_thread_entry,
+                       0,
+                       (char *)capture,
+                       capture->stack + sizeof(capture->stack),
+                       sizeof(capture->stack),
+                       config->priority ? config->priority : 10,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      WUT_DEBUG_REPORT("WUTMicCaptureStart: OSCreateThread failed\n");
+      MICClose(capture->handle);
+      MICUninit(capture->handle);
+      __wut_mic_free(capture);
+      return NULL;
+   }
+
+   OSSetThreadName(&capture->thread, "wut mic capture");
+   OSResumeThread(&capture->thread);
+   return capture;
+}
+
+void
+WUTMicCaptureStop(WUTMicCapture *capture)
+{
+   if (!capture) {
+      return;
+   }
+
+   capture->stopRequested = 1;
+   OSJoinThread(&capture->thread, NULL);
+
+   MICClose(capture->handle);
+   MICUninit(capture->handle);
+   __wut_mic_free(capture);
+}
+
+uint32_t
+WUTMicCaptureRead(WUTMicCapture *capture,
+                  int16_t *outSamples,
+                  uint32_t maxSamples,
+                  OSTime *outTime)
+{
+   uint32_t tail = capture->tail;
+   uint32_t count = capture->head - tail;
+
+   if (count > maxSamples) {
+      count = maxSamples;
+   }
+
+   if (outTime) {
+      uint32_t sequence;
+      uint32_t anchorHead;
+      OSTime anchorTime;
+
+      do {
+         sequence = capture->anchorSequence;
+         OSMemoryBarrier();
+         anchorHead = capture->anchorHead;
+         anchorTime = capture->anchorTime;
+         OSMemoryBarrier();
+      } while ((sequence & 1) || sequence != capture->anchorSequence);
+
+      uint64_t behind = (uint64_t)(anchorHead - tail);
+      *outTime = anchorTime - (OSTime)(behind * OSTimerClockSpeed / capture->outputRate);
+   }
+
+   if (!count) {
+      return 0;
+   }
+
+   // Read the samples only after the index that published them
+   OSMemoryBarrier();
+   for (uint32_t i = 0; i < count; ++i) {
+      outSamples[i] = capture->ring[(tail + i) & capture->ringMask];
+   }
+
+   // The capture thread may reuse the space as soon as it sees the new tail
+   OSMemoryBarrier();
+   capture->tail = tail + count;
+   return count;
+}
+
+uint32_t
+WUTMicCaptureGetAvailable(WUTMicCapture *capture)
+{
+   return capture->head - capture->tail;
+}
+
+uint32_t
+WUTMicCaptureGetOverruns(WUTMicCapture *capture)
+{
+   return capture->overruns;
+}
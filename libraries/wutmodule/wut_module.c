@@ -0,0 +1,401 @@
+#include <wut_module.h>
+#include <coreinit/atomic.h>
+#include <coreinit/condition.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MODULE_NAME_SIZE   64
+#define MODULE_STACK_SIZE  (16 * 1024)
+
+typedef enum
+{
+   MODULE_STATE_FREE,
+   MODULE_STATE_QUEUED,
+   MODULE_STATE_LOADING,
+   MODULE_STATE_LOADED,
+   MODULE_STATE_FAILED,
+} __wut_module_state_t;
+
+typedef struct
+{
+   char name[MODULE_NAME_SIZE];
+   __wut_module_state_t state;
+   OSDynLoad_Module handle;
+   OSDynLoad_Error error;
+   const char *const *exports;
+} __wut_module_t;
+
+typedef struct
+{
+   //! Index of the module + 1, 0 while the entry is unused.
+   uint32_t module;
+   OSDynLoad_ExportType type;
+   uint32_t hash;
+   char *name;
+   void *addr;
+} __wut_module_export_t;
+
+static volatile uint32_t sModuleInitState = 0;
+static OSMutex sModuleMutex;
+static OSCondition sModuleCond;
+
+static __wut_module_t sModules[WUT_MODULE_MAX_MODULES];
+static __wut_module_export_t sExports[WUT_MODULE_MAX_EXPORTS];
+
+static OSThread sPreloadThread;
+static uint8_t sPreloadStack[MODULE_STACK_SIZE] __attribute__((aligned(16)));
+static BOOL sPreloadCreated = FALSE;
+static BOOL sPreloadRunning = FALSE;
+
+static void
+__wut_module_init()
+{
+   uint32_t value = 0;
+
+   if (sModuleInitState == 2) {
+      return;
+   }
+
+   if (OSCompareAndSwapAtomicEx(&sModuleInitState, 0, 1, &value)) {
+      OSInitMutexEx(&sModuleMutex, "wut module");
+      OSInitCondEx(&sModuleCond, "wut module");
+      OSSwapAtomic(&sModuleInitState, 2);
+   } else {
+      while (sModuleInitState != 2) {
+         OSYieldThread();
+      }
+   }
+}
+
+static uint32_t
+__wut_module_hash(const char *name)
+{
+   uint32_t hash = 2166136261u;
+
+   while (*name) {
+      hash = (hash ^ (uint8_t)*name++) * 16777619u;
+   }
+
+   return hash;
+}
+
+// Must be called with the mutex locked
+static __wut_module_t *
+__wut_module_find(const char *name,
+                  BOOL add)
+{
+   __wut_module_t *unused = NULL;
+
+   for (uint32_t i = 0; i < WUT_MODULE_MAX_MODULES; ++i) {
+      __wut_module_t *module = &sModules[i];
+      if (module->state == MODULE_STATE_FREE) {
+         if (!unused) {
+            unused = module;
+         }
+      } else if (!strcmp(module->name, name)) {
+         return module;
+      }
+   }
+
+   if (!add || !unused || strlen(name) >= MODULE_NAME_SIZE) {
+      return NULL;
+   }
+
+   memset(unused, 0, sizeof(__wut_module_t));
+   strcpy(unused->name, name);
+   unused->state = MODULE_STATE_QUEUED;
+   return unused;
+}
+
+// Must be called with the mutex locked
+static __wut_module_export_t *
+__wut_module_find_export(uint32_t module,
+                         OSDynLoad_ExportType type,
+                         const char *name,
+                         uint32_t hash,
+                         BOOL add)
+{
+   uint32_t index = hash % WUT_MODULE_MAX_EXPORTS;
+
+   for (uint32_t i = 0; i < WUT_MODULE_MAX_EXPORTS; ++i) {
+      __wut_module_export_t *entry = &sExports[(index + i) % WUT_MODULE_MAX_EXPORTS];
+
+      if (!entry->module) {
+         if (!add) {
+            return NULL;
+         }
+
+         entry->name = strdup(name);
+         if (!entry->name) {
+            return NULL;
+         }
+
+         entry->module = module;
+         entry->type = type;
+         entry->hash = hash;
+         entry->addr = NULL;
+         return entry;
+      }
+
+      if (entry->module == module && entry->type == type && entry->hash == hash
+       && !strcmp(entry->name, name)) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+// Called with the mutex locked and the module marked as loading, unlocks it
+// around the loader calls
+static void
+__wut_module_load(__wut_module_t *module)
+{
+   OSDynLoad_Module handle = NULL;
+   const char *const *exports = module->exports;
+   uint32_t index = (uint32_t)(module - sModules) + 1;
+   OSDynLoad_Error error;
+   char name[MODULE_NAME_SIZE];
+
+   strcpy(name, module->name);
+   OSUnlockMutex(&sModuleMutex);
+   error = OSDynLoad_Acquire(name, &handle);
+   OSLockMutex(&sModuleMutex);
+
+   module->handle = handle;
+   module->error = error;
+   module->state = (error == OS_DYNLOAD_OK) ? MODULE_STATE_LOADED : MODULE_STATE_FAILED;
+
+   for (; error == OS_DYNLOAD_OK && exports && *exports; ++exports) {
+      __wut_module_export_t *entry;
+      void *addr = NULL;
+
+      if (OSDynLoad_FindExport(handle, OS_DYNLOAD_EXPORT_FUNC, *exports, &addr) != OS_DYNLOAD_OK) {
+         continue;
+      }
+
+      entry = __wut_module_find_export(index, OS_DYNLOAD_EXPORT_FUNC, *exports,
+                                       __wut_module_hash(*exports), TRUE);
+      if (entry) {
+         entry->addr = addr;
+      }
+   }
+
+   OSSignalCond(&sModuleCond);
+}
+
+static int
+__wut_module_preload_entry(int argc,
+                           const char **argv)
+{
+   OSLockMutex(&sModuleMutex);
+   while (TRUE) {
+      __wut_module_t *module = NULL;
+
+      for (uint32_t i = 0; i < WUT_MODULE_MAX_MODULES; ++i) {
+         if (sModules[i].state == MODULE_STATE_QUEUED) {
+            module = &sModules[i];
+            break;
+         }
+      }
+
+      if (!module) {
+         break;
+      }
+
+      module->state = MODULE_STATE_LOADING;
+      __wut_module_load(module);
+   }
+
+   sPreloadRunning = FALSE;
+   OSSignalCond(&sModuleCond);
+   OSUnlockMutex(&sModuleMutex);
+   return 0;
+}
+
+BOOL
+WUTModulePreload(const WUTModulePreloadSpec *specs,
+                 uint32_t count,
+                 int32_t priority)
+{
+   BOOL result = TRUE;
+
+   __wut_module_init();
+   OSLockMutex(&sModuleMutex);
+   for (uint32_t i = 0; i < count; ++i) {
+      __wut_module_t *module = __wut_module_find(specs[i].name, TRUE);
+      if (!module) {
+         result = FALSE;
+         continue;
+      }
+
+      if (module->state == MODULE_STATE_QUEUED) {
+         module->exports = specs[i].exports;
+      }
+   }
+
+   if (!sPreloadRunning) {
+      // A previous preload thread has finished, or is about to
+      if (sPreloadCreated) {
+         OSUnlockMutex(&sModuleMutex);
+         OSJoinThread(&sPreloadThread, NULL);
+         OSLockMutex(&sModuleMutex);
+         sPreloadCreated = FALSE;
+      }
+
+      if (!OSCreateThread(&sPreloadThread,
+                          __wut_module_preload_entry,
+                          0,
+                          NULL,
+                          sPreloadStack + sizeof(sPreloadStack),
+                          sizeof(sPreloadStack),
+                          priority,
+                          OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+         OSUnlockMutex(&sModuleMutex);
+         return FALSE;
+      }
+
+      OSSetThreadName(&sPreloadThread, "wut module preload");
+      sPreloadCreated = TRUE;
+      sPreloadRunning = TRUE;
+      OSResumeThread(&sPreloadThread);
+   }
+
+   OSUnlockMutex(&sModuleMutex);
+   return result;
+}
+
+void
+WUTModuleWaitPreload(void)
+{
+   __wut_module_init();
+   OSLockMutex(&sModuleMutex);
+   while (sPreloadRunning) {
+      OSWaitCond(&sModuleCond, &sModuleMutex);
+   }
+   OSUnlockMutex(&sModuleMutex);
+}
+
+// Must be called with the mutex locked
+static __wut_module_t *
+__wut_module_get(const char *name)
+{
+   __wut_module_t *module = __wut_module_find(name, TRUE);
+   if (!module) {
+      return NULL;
+   }
+
+   // Take a queued module over rather than wait for the preload thread
+   if (module->state == MODULE_STATE_QUEUED) {
+      module->state = MODULE_STATE_LOADING;
+      __wut_module_load(module);
+   }
+
+   while (module->state == MODULE_STATE_LOADING) {
+      OSWaitCond(&sModuleCond, &sModuleMutex);
+   }
+
+   return module;
+}
+
+OSDynLoad_Error
+WUTModuleAcquire(const char *name,
+                 OSDynLoad_Module *outModule)
+{
+   __wut_module_t *module;
+   OSDynLoad_Error error;
+
+   if (!name || !outModule) {
+      return OS_DYNLOAD_INVALID_ACQUIRE_PTR;
+   }
+
+   __wut_module_init();
+   OSLockMutex(&sModuleMutex);
+   module = __wut_module_get(name);
+   if (!module) {
+      OSUnlockMutex(&sModuleMutex);
+      return OS_DYNLOAD_OUT_OF_MEMORY;
+   }
+
+   *outModule = module->handle;
+   error = module->error;
+   OSUnlockMutex(&sModuleMutex);
+   return error;
+}
+
+OSDynLoad_Error
+WUTModuleFindExport(const char *module,
+                    OSDynLoad_ExportType type,
+                    const char *name,
+                    void **outAddr)
+{
+   __wut_module_export_t *entry;
+   __wut_module_t *entryModule;
+   OSDynLoad_Module handle;
+   OSDynLoad_Error error;
+   uint32_t index, hash;
+   void *addr = NULL;
+
+   if (!module || !name || !outAddr) {
+      return OS_DYNLOAD_INVALID_ACQUIRE_PTR;
+   }
+
+   __wut_module_init();
+   hash = __wut_module_hash(name);
+   OSLockMutex(&sModuleMutex);
+   entryModule = __wut_module_get(module);
+   if (!entryModule || entryModule->state != MODULE_STATE_LOADED) {
+      error = entryModule ? entryModule->error : OS_DYNLOAD_OUT_OF_MEMORY;
+      OSUnlockMutex(&sModuleMutex);
+      return error;
+   }
+
+   index = (uint32_t)(entryModule - sModules) + 1;
+   entry = __wut_module_find_export(index, type, name, hash, FALSE);
+   if (entry) {
+      *outAddr = entry->addr;
+      OSUnlockMutex(&sModuleMutex);
+      return OS_DYNLOAD_OK;
+   }
+
+   handle = entryModule->handle;
+   OSUnlockMutex(&sModuleMutex);
+
+   error = OSDynLoad_FindExport(handle, type, name, &addr);
+   if (error != OS_DYNLOAD_OK) {
+      return error;
+   }
+
+   // A full cache only means the next lookup goes to the loader again
+   OSLockMutex(&sModuleMutex);
+   entry = __wut_module_find_export(index, type, name, hash, TRUE);
+   if (entry) {
+      entry->addr = addr;
+   }
+   OSUnlockMutex(&sModuleMutex);
+
+   *outAddr = addr;
+   return OS_DYNLOAD_OK;
+}
+
+void
+WUTModuleReleaseAll(void)
+{
+   __wut_module_init();
+   OSLockMutex(&sModuleMutex);
+   for (uint32_t i = 0; i < WUT_MODULE_MAX_EXPORTS; ++i) {
+      free(sExports[i].name);
+      memset(&sExports[i], 0, sizeof(__wut_module_export_t));
+   }
+
+   for (uint32_t i = 0; i < WUT_MODULE_MAX_MODULES; ++i) {
+      if (sModules[i].state == MODULE_STATE_LOADED) {
+         OSDynLoad_Release(sModules[i].handle);
+      }
+
+      memset(&sModules[i], 0, sizeof(__wut_module_t));
+   }
+   OSUnlockMutex(&sModuleMutex);
+}
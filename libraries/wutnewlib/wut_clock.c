@@ -3,24 +3,76 @@
 
 #include <coreinit/systeminfo.h>
 #include <coreinit/time.h>
+#include <wut_time.h>
+
+/*
+ * Tick conversions without 64-bit division. Seconds are found by
+ * multiplying with a 0.64 fixed point reciprocal of the timer frequency,
+ * the remaining ticks are less than a second so their nanoseconds fit a
+ * 32.32 fixed point multiply.
+ */
+static uint32_t sTicksPerSecond = 0;
+static uint64_t sSecondsMul = 0;
+static uint64_t sNanosecondsMul = 0;
+
+static inline void
+__wut_clock_init(void)
+{
+   if (!sTicksPerSecond) {
+      uint32_t ticksPerSecond = OSTimerClockSpeed;
+      sSecondsMul = UINT64_MAX / ticksPerSecond;
+      sNanosecondsMul = (1000000000ull << 32) / ticksPerSecond;
+      sTicksPerSecond = ticksPerSecond;
+   }
+}
+
+static inline uint64_t
+__wut_mulhi64(uint64_t a,
+              uint64_t b)
+{
+   uint64_t al = (uint32_t)a, ah = a >> 32;
+   uint64_t bl = (uint32_t)b, bh = b >> 32;
+   uint64_t lh = al * bh, hl = ah * bl;
+   uint64_t mid = ((al * bl) >> 32) + (uint32_t)lh + (uint32_t)hl;
+   return ah * bh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+}
+
+static inline void
+__wut_ticks_to_timespec(OSTime ticks,
+                        struct timespec *tp)
+{
+   uint64_t seconds, rem;
+
+   __wut_clock_init();
+   seconds = __wut_mulhi64((uint64_t)ticks, sSecondsMul);
+
+   // The reciprocal is rounded down, so the estimate can be a second short
+   rem = (uint64_t)ticks - seconds * sTicksPerSecond;
+   while (rem >= sTicksPerSecond) {
+      rem -= sTicksPerSecond;
+      ++seconds;
+   }
+
+   tp->tv_sec = (time_t)seconds;
+   tp->tv_nsec = (long)((rem * sNanosecondsMul) >> 32);
+}
+
+uint64_t
+WUTTicksToNanoseconds(OSTime ticks)
+{
+   struct timespec ts;
+   __wut_ticks_to_timespec(ticks, &ts);
+   return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
 int
 __wut_clock_gettime(clockid_t clock_id,
                     struct timespec *tp)
 {
-   if (clock_id == CLOCK_MONOTONIC) {
-      OSTime time = OSGetSystemTime();
-      tp->tv_sec = (time_t)OSTicksToSeconds(time);
-
-      time -= OSSecondsToTicks(tp->tv_sec);
-      tp->tv_nsec = (long)OSTicksToNanoseconds(time);
+   if (clock_id == CLOCK_MONOTONIC || clock_id == CLOCK_MONOTONIC_RAW) {
+      __wut_ticks_to_timespec(OSGetSystemTime(), tp);
    } else if (clock_id == CLOCK_REALTIME) {
-      OSTime time = OSGetTime();
-      tp->tv_sec = (time_t)OSTicksToSeconds(time);
-
-      time -= OSSecondsToTicks(tp->tv_sec);
-      tp->tv_nsec = (long)OSTicksToNanoseconds(time);
-
+      __wut_ticks_to_timespec(OSGetTime(), tp);
       tp->tv_sec += EPOCH_DIFF_SECS(WIIU_OSTIME_EPOCH_YEAR);
    } else {
       return EINVAL;
@@ -41,6 +93,7 @@ __wut_clock_getres(clockid_t clock_id,
                    struct timespec *res)
 {
    if (clock_id != CLOCK_MONOTONIC &&
+       clock_id != CLOCK_MONOTONIC_RAW &&
        clock_id != CLOCK_REALTIME) {
       return EINVAL;
    }
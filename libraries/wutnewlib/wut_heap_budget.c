@@ -0,0 +1,247 @@
+#include "wut_newlib.h"
+
+#include <coreinit/atomic.h>
+#include <coreinit/debug.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memexpheap.h>
+#include <wut_heap_budget.h>
+#include <malloc.h>
+#include <stdlib.h>
+
+// Bytes of MEM2 for each subsystem's own heap, 0 to allocate from the
+// subsystem's usual allocator without a limit.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_heap_budget_devoptab = 0;
+uint32_t __attribute__((weak)) __wut_heap_budget_socket = 0;
+uint32_t __attribute__((weak)) __wut_heap_budget_thread = 0;
+uint32_t __attribute__((weak)) __wut_heap_budget_log = 0;
+uint32_t __attribute__((weak)) __wut_heap_budget_gfx = 0;
+
+typedef struct
+{
+   const char *name;
+   uint32_t *budget;
+
+   //! Allocate from the default heap instead of malloc without a budget
+   BOOL defaultHeap;
+
+   MEMHeapHandle heap;
+   uint8_t *heapBase;
+   uint32_t heapSize;
+
+   volatile uint32_t current;
+   volatile uint32_t peak;
+   volatile uint32_t allocations;
+   volatile uint32_t failures;
+} __wut_heap_budget_t;
+
+static __wut_heap_budget_t sBudgets[WUT_HEAP_SUBSYSTEM_COUNT] = {
+   [WUT_HEAP_SUBSYSTEM_DEVOPTAB] = { "devoptab", &__wut_heap_budget_devoptab, FALSE },
+   [WUT_HEAP_SUBSYSTEM_SOCKET]   = { "socket",   &__wut_heap_budget_socket,   FALSE },
+   [WUT_HEAP_SUBSYSTEM_THREAD]   = { "thread",   &__wut_heap_budget_thread,   FALSE },
+   [WUT_HEAP_SUBSYSTEM_LOG]      = { "log",      &__wut_heap_budget_log,      TRUE },
+   [WUT_HEAP_SUBSYSTEM_GFX]      = { "gfx",      &__wut_heap_budget_gfx,      TRUE },
+};
+
+static BOOL
+__wut_heap_budget_owns(__wut_heap_budget_t *budget,
+                       void *block)
+{
+   return budget->heap
+       && (uint8_t *)block >= budget->heapBase
+       && (uint8_t *)block < budget->heapBase + budget->heapSize;
+}
+
+static uint32_t
+__wut_heap_budget_block_size(__wut_heap_budget_t *budget,
+                             void *block)
+{
+   if (__wut_heap_budget_owns(budget, block)) {
+      return MEMGetSizeForMBlockExpHeap(block);
+   }
+
+   // __init_wut_defaultheap points the default heap at newlib as well
+   return malloc_usable_size(block);
+}
+
+void
+__init_wut_heap_budgets(MEMHeapHandle heapHandle)
+{
+   for (uint32_t i = 0; i < WUT_HEAP_SUBSYSTEM_COUNT; ++i) {
+      __wut_heap_budget_t *budget = &sBudgets[i];
+      uint32_t size = *budget->budget & ~3;
+
+      if (!size || budget->heap) {
+         continue;
+      }
+
+      budget->heapBase = (uint8_t *)MEMAllocFromExpHeapEx(heapHandle, size, 0x40);
+      if (!budget->heapBase) {
+         WUT_DEBUG_REPORT("wut: no MEM2 left for the 0x%X byte %s heap budget\n", size, budget->name);
+         continue;
+      }
+
+      budget->heap = MEMCreateExpHeapEx(budget->heapBase, size, MEM_HEAP_FLAG_USE_LOCK);
+      if (!budget->heap) {
+         MEMFreeToExpHeap(heapHandle, budget->heapBase);
+         budget->heapBase = NULL;
+         continue;
+      }
+
+      budget->heapSize = size;
+   }
+}
+
+void
+__fini_wut_heap_budgets(MEMHeapHandle heapHandle)
+{
+   for (uint32_t i = 0; i < WUT_HEAP_SUBSYSTEM_COUNT; ++i) {
+      __wut_heap_budget_t *budget = &sBudgets[i];
+
+      if (!budget->heap) {
+         continue;
+      }
+
+      MEMDestroyExpHeap(budget->heap);
+      MEMFreeToExpHeap(heapHandle, budget->heapBase);
+      budget->heap = NULL;
+      budget->heapBase = NULL;
+      budget->heapSize = 0;
+   }
+}
+
+void *
+WUTHeapBudgetAlloc(WUTHeapSubsystem subsystem,
+                   uint32_t size,
+                   uint32_t align)
+{
+   __wut_heap_budget_t *budget;
+   uint32_t failures;
+   uint32_t current;
+   uint32_t peak;
+   void *block;
+
+   if (subsystem >= WUT_HEAP_SUBSYSTEM_COUNT) {
+      return NULL;
+   }
+
+   budget = &sBudgets[subsystem];
+   if (align < 4) {
+      align = 4;
+   }
+
+   if (budget->heap) {
+      block = MEMAllocFromExpHeapEx(budget->heap, size, (int)align);
+   } else if (budget->defaultHeap) {
+      block = MEMAllocFromDefaultHeapEx(size, (int)align);
+   } else {
+      block = memalign(align, size);
+   }
+
+   if (!block) {
+      failures = (uint32_t)OSAddAtomic((volatile int32_t *)&budget->failures, 1) + 1;
+
+      // Enough to see what grew without flooding the log from a retry loop
+      if (!(failures & (failures - 1))) {
+         OSReport("wut: %s failed to allocate 0x%X bytes, %u failures\n",
+                  budget->name, size, failures);
+         WUTHeapBudgetReport();
+      }
+      return NULL;
+   }
+
+   size = __wut_heap_budget_block_size(budget, block);
+   current = (uint32_t)OSAddAtomic((volatile int32_t *)&budget->current, (int32_t)size) + size;
+   OSAddAtomic((volatile int32_t *)&budget->allocations, 1);
+
+   peak = budget->peak;
+   while (current > peak && !OSCompareAndSwapAtomic(&budget->peak, peak, current)) {
+      peak = budget->peak;
+   }
+
+   return block;
+}
+
+void
+WUTHeapBudgetFree(WUTHeapSubsystem subsystem,
+                  void *block)
+{
+   __wut_heap_budget_t *budget;
+
+   if (!block || subsystem >= WUT_HEAP_SUBSYSTEM_COUNT) {
+      return;
+   }
+
+   budget = &sBudgets[subsystem];
+   OSAddAtomic((volatile int32_t *)&budget->current,
+               -(int32_t)__wut_heap_budget_block_size(budget, block));
+
+   if (__wut_heap_budget_owns(budget, block)) {
+      MEMFreeToExpHeap(budget->heap, block);
+   } else if (budget->defaultHeap) {
+      MEMFreeToDefaultHeap(block);
+   } else {
+      free(block);
+   }
+}
+
+BOOL
+WUTHeapBudgetGetStats(WUTHeapSubsystem subsystem,
+                      WUTHeapBudgetStats *outStats)
+{
+   __wut_heap_budget_t *budget;
+
+   if (!outStats || subsystem >= WUT_HEAP_SUBSYSTEM_COUNT) {
+      return FALSE;
+   }
+
+   budget = &sBudgets[subsystem];
+   outStats->name = budget->name;
+   outStats->budget = budget->heapSize;
+   outStats->current = budget->current;
+   outStats->peak = budget->peak;
+   outStats->allocations = budget->allocations;
+   outStats->failures = budget->failures;
+   return TRUE;
+}
+
+void
+WUTHeapBudgetReport(void)
+{
+   WUTHeapBudgetStats stats[WUT_HEAP_SUBSYSTEM_COUNT];
+   uint32_t count = 0;
+
+   // Insertion into the sorted list, there are few subsystems
+   for (uint32_t i = 0; i < WUT_HEAP_SUBSYSTEM_COUNT; ++i) {
+      WUTHeapBudgetStats entry;
+      uint32_t pos;
+
+      WUTHeapBudgetGetStats((WUTHeapSubsystem)i, &entry);
+      for (pos = count; pos > 0 && stats[pos - 1].current < entry.current; --pos) {
+         stats[pos] = stats[pos - 1];
+      }
+      stats[pos] = entry;
+      ++count;
+   }
+
+   OSReport("Heap usage by subsystem:\n");
+   for (uint32_t i = 0; i < count; ++i) {
+      if (stats[i].budget) {
+         OSReport("  %-8s %10u bytes, %10u peak, %10u budget, %8u allocs, %6u failures\n",
+                  stats[i].name, stats[i].current, stats[i].peak, stats[i].budget,
+                  stats[i].allocations, stats[i].failures);
+      } else {
+         OSReport("  %-8s %10u bytes, %10u peak, %10s budget, %8u allocs, %6u failures\n",
+                  stats[i].name, stats[i].current, stats[i].peak, "no",
+                  stats[i].allocations, stats[i].failures);
+      }
+   }
+}
+
+void
+WUTHeapBudgetResetPeaks(void)
+{
+   for (uint32_t i = 0; i < WUT_HEAP_SUBSYSTEM_COUNT; ++i) {
+      sBudgets[i].peak = sBudgets[i].current;
+   }
+}
@@ -1,17 +1,61 @@
 #include "wut_newlib.h"
+#include "wut_lock_stats.h"
 
 #include <coreinit/mutex.h>
 #include <coreinit/atomic.h>
+#include <coreinit/memdefaultheap.h>
 
-#define MAX_LOCKS 16
+// Locks are allocated in chunks of 32 so a chunk's free slots fit in a mask.
+// The first chunk is static, the others are allocated once the earlier
+// ones are full and are never freed.
+#define LOCKS_PER_CHUNK 32
+#define MAX_LOCK_CHUNKS 64
 
-static OSMutex sLibcLocks[MAX_LOCKS];
-static volatile uint32_t sLibcLockUsedMask = 0;
+typedef struct
+{
+   OSMutex mutexes[LOCKS_PER_CHUNK];
+} __wut_lock_chunk_t;
+
+static __wut_lock_chunk_t sFirstLockChunk;
+static __wut_lock_chunk_t *volatile sLockChunks[MAX_LOCK_CHUNKS] = { &sFirstLockChunk };
+static volatile uint32_t sLockUsedMask[MAX_LOCK_CHUNKS] = { 0 };
 
-static inline bool
-__wut_is_lock_valid(int *lock)
+static inline OSMutex *
+__wut_get_lock(int *lock)
 {
-   return lock && *lock >= 0 && *lock < MAX_LOCKS;
+   if (!lock || *lock < 0 || *lock >= MAX_LOCK_CHUNKS * LOCKS_PER_CHUNK) {
+      return NULL;
+   }
+
+   __wut_lock_chunk_t *chunk = sLockChunks[*lock / LOCKS_PER_CHUNK];
+   if (!chunk) {
+      return NULL;
+   }
+
+   return &chunk->mutexes[*lock % LOCKS_PER_CHUNK];
+}
+
+static __wut_lock_chunk_t *
+__wut_get_lock_chunk(int index)
+{
+   __wut_lock_chunk_t *chunk = sLockChunks[index];
+   if (chunk) {
+      return chunk;
+   }
+
+   // Use the heap directly, malloc could end up taking a newlib lock
+   chunk = (__wut_lock_chunk_t *)MEMAllocFromDefaultHeapEx(sizeof(__wut_lock_chunk_t), 4);
+   if (!chunk) {
+      return NULL;
+   }
+
+   if (!OSCompareAndSwapAtomic((volatile uint32_t *)&sLockChunks[index], 0, (uint32_t)chunk)) {
+      // Another thread added this chunk first
+      MEMFreeToDefaultHeap(chunk);
+      chunk = sLockChunks[index];
+   }
+
+   return chunk;
 }
 
 int
@@ -22,36 +66,53 @@ __wut_lock_init(int *lock,
       return -1;
    }
 
-   int slot;
-   uint32_t new_mask;
-   uint32_t cur_mask = sLibcLockUsedMask;
-   do {
-      slot = __builtin_ffs(~cur_mask)-1;
-      if (slot < 0 || slot >= MAX_LOCKS) break;
-      new_mask = cur_mask | (1U << slot);
-   } while (!OSCompareAndSwapAtomicEx(&sLibcLockUsedMask, cur_mask, new_mask, &cur_mask));
+   // OSMutex is recursive, so the same lock works for both kinds
+   for (int index = 0; index < MAX_LOCK_CHUNKS; ++index) {
+      int slot;
+      uint32_t new_mask;
+      uint32_t cur_mask = sLockUsedMask[index];
 
-   if (slot < 0 || slot >= MAX_LOCKS) {
-      return -1;
+      if (cur_mask == 0xFFFFFFFF) {
+         continue;
+      }
+
+      __wut_lock_chunk_t *chunk = __wut_get_lock_chunk(index);
+      if (!chunk) {
+         return -1;
+      }
+
+      do {
+         slot = __builtin_ffs(~cur_mask)-1;
+         if (slot < 0) break;
+         new_mask = cur_mask | (1U << slot);
+      } while (!OSCompareAndSwapAtomicEx(&sLockUsedMask[index], cur_mask, new_mask, &cur_mask));
+
+      if (slot < 0) {
+         continue;
+      }
+
+      OSInitMutexEx(&chunk->mutexes[slot], "newlib lock");
+      *lock = index * LOCKS_PER_CHUNK + slot;
+      return 0;
    }
 
-   *lock = slot;
-   OSInitMutex(&sLibcLocks[*lock]);
-   return 0;
+   return -1;
 }
 
 int
 __wut_lock_close(int *lock)
 {
-   if (!__wut_is_lock_valid(lock)) {
+   if (!__wut_get_lock(lock)) {
       return -1;
    }
 
+   int index = *lock / LOCKS_PER_CHUNK;
+   int slot = *lock % LOCKS_PER_CHUNK;
    uint32_t new_mask;
-   uint32_t cur_mask = sLibcLockUsedMask;
+   uint32_t cur_mask = sLockUsedMask[index];
    do {
-      new_mask = cur_mask &~ (1U << *lock);
-   } while (!OSCompareAndSwapAtomicEx(&sLibcLockUsedMask, cur_mask, new_mask, &cur_mask));
+      new_mask = cur_mask &~ (1U << slot);
+   } while (!OSCompareAndSwapAtomicEx(&sLockUsedMask[index], cur_mask, new_mask, &cur_mask));
 
    *lock = -1;
    return 0;
@@ -60,21 +121,23 @@ __wut_lock_close(int *lock)
 int
 __wut_lock_acquire(int *lock)
 {
-   if (!__wut_is_lock_valid(lock)) {
+   OSMutex *mutex = __wut_get_lock(lock);
+   if (!mutex) {
       return -1;
    }
 
-   OSLockMutex(&sLibcLocks[*lock]);
+   __wut_lock_stats_lock_mutex(mutex);
    return 0;
 }
 
 int
 __wut_lock_release(int *lock)
 {
-   if (!__wut_is_lock_valid(lock)) {
+   OSMutex *mutex = __wut_get_lock(lock);
+   if (!mutex) {
       return -1;
    }
 
-   OSUnlockMutex(&sLibcLocks[*lock]);
+   OSUnlockMutex(mutex);
    return 0;
 }
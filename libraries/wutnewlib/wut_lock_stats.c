@@ -0,0 +1,156 @@
+#include "wut_lock_stats.h"
+
+#include <coreinit/atomic.h>
+#include <coreinit/atomic64.h>
+#include <coreinit/debug.h>
+#include <string.h>
+#include <wut_lock_stats.h>
+
+typedef struct
+{
+   //! Address of the lock, 0 while the entry is unused.
+   volatile uint32_t lock;
+   char name[32];
+   volatile uint32_t contended;
+   volatile uint64_t waitTicks;
+   volatile uint64_t maxWaitTicks;
+} __wut_lock_stats_entry_t;
+
+volatile uint32_t __wut_lock_stats_enabled = 0;
+
+// Open addressed by lock address, entries are claimed with a compare and
+// swap so recording never takes a lock itself
+static __wut_lock_stats_entry_t sLockStats[WUT_LOCK_STATS_MAX_LOCKS];
+
+static __wut_lock_stats_entry_t *
+__wut_lock_stats_find(uint32_t lock,
+                      const char *name)
+{
+   uint32_t index = ((lock >> 2) * 0x9E3779B1u) >> 24;
+
+   for (uint32_t i = 0; i < WUT_LOCK_STATS_MAX_LOCKS; ++i) {
+      __wut_lock_stats_entry_t *entry = &sLockStats[(index + i) % WUT_LOCK_STATS_MAX_LOCKS];
+      if (entry->lock == lock) {
+         return entry;
+      }
+
+      if (entry->lock == 0 && OSCompareAndSwapAtomic(&entry->lock, 0, lock)) {
+         // Copied, the name of a lock may not outlive it
+         strncpy(entry->name, name ? name : "", sizeof(entry->name) - 1);
+         entry->name[sizeof(entry->name) - 1] = '\0';
+         return entry;
+      }
+
+      if (entry->lock == lock) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+void
+__wut_lock_stats_record(const void *lock,
+                        const char *name,
+                        OSTime waitTicks)
+{
+   __wut_lock_stats_entry_t *entry = __wut_lock_stats_find((uint32_t)(uintptr_t)lock, name);
+   uint64_t max;
+
+   if (!entry) {
+      return;
+   }
+
+   OSAddAtomic((volatile int32_t *)&entry->contended, 1);
+   OSAddAtomic64((volatile int64_t *)&entry->waitTicks, waitTicks);
+
+   max = OSGetAtomic64(&entry->maxWaitTicks);
+   while ((uint64_t)waitTicks > max) {
+      if (OSCompareAndSwapAtomic64(&entry->maxWaitTicks, max, waitTicks)) {
+         break;
+      }
+      max = OSGetAtomic64(&entry->maxWaitTicks);
+   }
+}
+
+void
+WUTLockStatsSetEnabled(BOOL enabled)
+{
+   __wut_lock_stats_enabled = enabled ? 1 : 0;
+}
+
+uint32_t
+WUTLockStatsGetTop(WUTLockStats *outStats,
+                   uint32_t maxStats)
+{
+   uint32_t count = 0;
+
+   if (!outStats) {
+      return 0;
+   }
+
+   for (uint32_t i = 0; i < WUT_LOCK_STATS_MAX_LOCKS; ++i) {
+      __wut_lock_stats_entry_t *entry = &sLockStats[i];
+      WUTLockStats stats;
+      uint32_t pos;
+
+      if (!entry->lock || !entry->contended) {
+         continue;
+      }
+
+      stats.lock = (const void *)(uintptr_t)entry->lock;
+      memcpy(stats.name, entry->name, sizeof(stats.name));
+      stats.name[sizeof(stats.name) - 1] = '\0';
+      stats.contended = entry->contended;
+      stats.waitTicks = (OSTime)OSGetAtomic64(&entry->waitTicks);
+      stats.maxWaitTicks = (OSTime)OSGetAtomic64(&entry->maxWaitTicks);
+
+      // Insertion into the sorted output, there are few locks
+      for (pos = count; pos > 0 && outStats[pos - 1].waitTicks < stats.waitTicks; --pos);
+      if (pos >= maxStats) {
+         continue;
+      }
+
+      if (count < maxStats) {
+         ++count;
+      }
+
+      memmove(&outStats[pos + 1], &outStats[pos], (count - 1 - pos) * sizeof(WUTLockStats));
+      outStats[pos] = stats;
+   }
+
+   return count;
+}
+
+void
+WUTLockStatsReport(uint32_t count)
+{
+   WUTLockStats stats[16];
+
+   if (count > 16) {
+      count = 16;
+   }
+
+   count = WUTLockStatsGetTop(stats, count);
+   OSReport("Lock contention, %u locks:\n", count);
+   for (uint32_t i = 0; i < count; ++i) {
+      OSReport("  %08X %-31s %8u waits, %10llu us total, %8llu us max\n",
+               (uint32_t)(uintptr_t)stats[i].lock,
+               stats[i].name[0] ? stats[i].name : "(unnamed)",
+               stats[i].contended,
+               OSTicksToMicroseconds(stats[i].waitTicks),
+               OSTicksToMicroseconds(stats[i].maxWaitTicks));
+   }
+}
+
+void
+WUTLockStatsReset(void)
+{
+   // Entries stay claimed so the table never has to be rehashed
+   for (uint32_t i = 0; i < WUT_LOCK_STATS_MAX_LOCKS; ++i) {
+      __wut_lock_stats_entry_t *entry = &sLockStats[i];
+      entry->contended = 0;
+      OSSetAtomic64(&entry->waitTicks, 0);
+      OSSetAtomic64(&entry->maxWaitTicks, 0);
+   }
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <coreinit/mutex.h>
+#include <coreinit/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Set by WUTLockStatsSetEnabled
+extern volatile uint32_t __wut_lock_stats_enabled;
+
+// Records an acquisition of lock that waited for waitTicks
+void __wut_lock_stats_record(const void *lock, const char *name, OSTime waitTicks);
+
+// OSLockMutex that records the wait if the mutex is already held
+static inline void
+__wut_lock_stats_lock_mutex(OSMutex *mutex)
+{
+   OSTime start;
+
+   if (!__wut_lock_stats_enabled) {
+      OSLockMutex(mutex);
+      return;
+   }
+
+   if (OSTryLockMutex(mutex)) {
+      return;
+   }
+
+   start = OSGetSystemTime();
+   OSLockMutex(mutex);
+   __wut_lock_stats_record(mutex, mutex->name, OSGetSystemTime() - start);
+}
+
+#ifdef __cplusplus
+}
+#endif
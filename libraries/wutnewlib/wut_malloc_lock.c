@@ -1,23 +1,61 @@
 #include "wut_newlib.h"
 
+#include <coreinit/mutex.h>
 #include <coreinit/spinlock.h>
 
+/*
+ * 0: Spin with interrupts disabled. Cheapest without contention, but other
+ *    cores waiting for the lock spin with their interrupts disabled too.
+ * 1: Spin on OSTryLockMutex for __wut_malloc_lock_spin_count attempts, then
+ *    block on the mutex until it is released.
+ */
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_malloc_lock_adaptive = 1;
+
+// Number of attempts to take the mutex before blocking.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_malloc_lock_spin_count = 100;
+
 static OSSpinLock sMallocSpinLock;
+static OSMutex sMallocMutex;
+static BOOL sMallocLockAdaptive = FALSE;
 
 void
 __wut_malloc_lock(struct _reent *r)
 {
-   OSUninterruptibleSpinLock_Acquire(&sMallocSpinLock);
+   uint32_t i;
+
+   if (!sMallocLockAdaptive) {
+      OSUninterruptibleSpinLock_Acquire(&sMallocSpinLock);
+      return;
+   }
+
+   for (i = 0; i < __wut_malloc_lock_spin_count; ++i) {
+      if (OSTryLockMutex(&sMallocMutex)) {
+         return;
+      }
+   }
+
+   OSLockMutex(&sMallocMutex);
 }
 
 void
 __wut_malloc_unlock(struct _reent *r)
 {
-   OSUninterruptibleSpinLock_Release(&sMallocSpinLock);
+   if (!sMallocLockAdaptive) {
+      OSUninterruptibleSpinLock_Release(&sMallocSpinLock);
+      return;
+   }
+
+   OSUnlockMutex(&sMallocMutex);
 }
 
 void
 __init_wut_malloc_lock()
 {
    OSInitSpinLock(&sMallocSpinLock);
+   OSInitMutexEx(&sMallocMutex, "wut malloc");
+
+   // The mode can't change once malloc has been used
+   sMallocLockAdaptive = __wut_malloc_lock_adaptive ? TRUE : FALSE;
 }
@@ -3,14 +3,53 @@
 #include <coreinit/thread.h>
 #include <coreinit/systeminfo.h>
 #include <coreinit/time.h>
+#include <wut_time.h>
+
+/*
+ * The last part of a sleep, in microseconds, that is spun on the system
+ * timer instead of sleeping so the wakeup latency of the scheduler does not
+ * make the sleep overshoot. Can be overridden by the application.
+ */
+uint32_t __attribute__((weak)) __wut_nanosleep_spin_us = 200;
+
+void
+wut_precise_sleep_until(OSTime deadline)
+{
+   OSTime spin = (OSTime)OSMicrosecondsToTicks(__wut_nanosleep_spin_us);
+   OSTime now = OSGetSystemTime();
+
+   while (now < deadline) {
+      if (deadline - now > spin) {
+         OSSleepTicks(deadline - now - spin);
+      }
+
+      now = OSGetSystemTime();
+   }
+}
 
 int
 __wut_nanosleep(const struct timespec *req,
                 struct timespec *rem)
 {
-   OSSleepTicks(OSSecondsToTicks(req->tv_sec) +
-                OSNanosecondsToTicks(req->tv_nsec));
-   rem->tv_sec = 0;
-   rem->tv_nsec = 0;
+   if (!req || req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+      return EINVAL;
+   }
+
+   OSTime deadline = OSGetSystemTime() +
+                     OSSecondsToTicks(req->tv_sec) +
+                     OSNanosecondsToTicks(req->tv_nsec);
+   wut_precise_sleep_until(deadline);
+
+   if (rem) {
+      // Should be zero, but report whatever is actually left
+      OSTime left = deadline - OSGetSystemTime();
+      if (left < 0) {
+         left = 0;
+      }
+
+      rem->tv_sec = (time_t)OSTicksToSeconds(left);
+      rem->tv_nsec = (long)OSTicksToNanoseconds(left - OSSecondsToTicks(rem->tv_sec));
+   }
+
    return 0;
 }
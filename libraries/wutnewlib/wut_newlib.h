@@ -5,6 +5,7 @@
 #include <sys/reent.h>
 #include <sys/time.h>
 #include <sys/iosupport.h>
+#include <coreinit/memheap.h>
 
 void *   __wut_sbrk_r(struct _reent *r, ptrdiff_t incr);
 int      __wut_lock_init(int *lock, int recursive);
@@ -23,5 +24,7 @@ int      __wut_nanosleep(const struct timespec *req, struct timespec *rem);
 void     __init_wut_malloc_lock();
 void     __init_wut_sbrk_heap();
 void     __fini_wut_sbrk_heap();
+void     __init_wut_heap_budgets(MEMHeapHandle heapHandle);
+void     __fini_wut_heap_budgets(MEMHeapHandle heapHandle);
 
 #endif // ifndef __WUT_NEWLIB_H
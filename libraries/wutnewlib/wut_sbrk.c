@@ -4,12 +4,34 @@
 #include <coreinit/memheap.h>
 #include <coreinit/memdefaultheap.h>
 #include <coreinit/memexpheap.h>
+#include <wut_heap.h>
+#include <malloc.h>
+
+// Bytes of MEM2 to use for malloc, 0 to use __wut_sbrk_heap_percent.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_sbrk_heap_size = 0;
+
+// Percentage of the free MEM2 to use for malloc if __wut_sbrk_heap_size is
+// 0, the rest is left to the default heap.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_sbrk_heap_percent = 100;
+
+// Bytes of MEM2 for the GPU resource heap, 0 to not create it.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_gpu_heap_size = 0;
+
+static MEMHeapHandle sGpuHeap = NULL;
+static void *sGpuHeapBase = NULL;
+static uint32_t sGpuHeapSize = 0;
 
 static MEMHeapHandle sHeapHandle = NULL;
 static void *sHeapBase = NULL;
 static uint32_t sHeapMaxSize = 0;
 static volatile uint32_t sHeapSize = 0;
 
+// Size of the block reserved from MEM2, less than sHeapMaxSize after a trim
+static volatile uint32_t sHeapReserved = 0;
+
 void *
 __wut_sbrk_r(struct _reent *r,
              ptrdiff_t incr)
@@ -24,6 +46,18 @@ __wut_sbrk_r(struct _reent *r,
          r->_errno = ENOMEM;
          return (void *)-1;
       }
+
+      // Memory given back by WUTHeapTrim is taken back in place, which only
+      // works while nothing else was allocated right behind the block.
+      // newlib only calls sbrk with the malloc lock held.
+      if (newSize > sHeapReserved) {
+         uint32_t reserved = MEMResizeForMBlockExpHeap(sHeapHandle, sHeapBase, newSize);
+         if (reserved < newSize) {
+            r->_errno = ENOMEM;
+            return (void *)-1;
+         }
+         sHeapReserved = reserved;
+      }
    } while (!OSCompareAndSwapAtomicEx(&sHeapSize, oldSize, newSize, &oldSize));
 
    return ((uint8_t *)sHeapBase) + oldSize;
@@ -39,11 +73,38 @@ __init_wut_sbrk_heap(MEMHeapHandle heapHandle)
 
    sHeapHandle = heapHandle;
 
-   // Use all of the available memory for the custom heap
+   // The GPU resource heap is carved out first so it gets what it asked for
+   if (__wut_gpu_heap_size) {
+      sGpuHeapBase = MEMAllocFromExpHeapEx(sHeapHandle, __wut_gpu_heap_size, 0x100);
+      if (sGpuHeapBase) {
+         sGpuHeap = MEMCreateExpHeapEx(sGpuHeapBase, __wut_gpu_heap_size, MEM_HEAP_FLAG_USE_LOCK);
+         if (sGpuHeap) {
+            sGpuHeapSize = __wut_gpu_heap_size;
+         } else {
+            MEMFreeToExpHeap(sHeapHandle, sGpuHeapBase);
+            sGpuHeapBase = NULL;
+         }
+      }
+   }
+
+   __init_wut_heap_budgets(sHeapHandle);
+
    sHeapMaxSize = MEMGetAllocatableSizeForExpHeapEx(sHeapHandle, 4);
+   if (__wut_sbrk_heap_size) {
+      if (__wut_sbrk_heap_size < sHeapMaxSize) {
+         sHeapMaxSize = __wut_sbrk_heap_size;
+      }
+   } else if (__wut_sbrk_heap_percent < 100) {
+      sHeapMaxSize = (uint32_t)((uint64_t)sHeapMaxSize * __wut_sbrk_heap_percent / 100) & ~3;
+   }
+
    sHeapBase = MEMAllocFromExpHeapEx(sHeapHandle, sHeapMaxSize, 4);
+   if (!sHeapBase) {
+      sHeapMaxSize = 0;
+   }
 
    sHeapSize = 0;
+   sHeapReserved = sHeapMaxSize;
 }
 
 void
@@ -56,9 +117,83 @@ __fini_wut_sbrk_heap()
 
    if (sHeapHandle) {
       MEMFreeToExpHeap(sHeapHandle, sHeapBase);
+
+      if (sGpuHeap) {
+         MEMDestroyExpHeap(sGpuHeap);
+         MEMFreeToExpHeap(sHeapHandle, sGpuHeapBase);
+      }
+
+      __fini_wut_heap_budgets(sHeapHandle);
    }
 
+   sGpuHeap = NULL;
+   sGpuHeapBase = NULL;
+   sGpuHeapSize = 0;
    sHeapBase = NULL;
    sHeapSize = 0;
    sHeapMaxSize = 0;
+   sHeapReserved = 0;
+}
+
+MEMHeapHandle
+WUTGetGpuHeap(void)
+{
+   return sGpuHeap;
+}
+
+uint32_t
+WUTHeapTrim(uint32_t pad)
+{
+   struct _reent *r = _REENT;
+   uint32_t freed = 0;
+
+   // Let malloc give the free memory at its top back to sbrk first
+   malloc_trim(pad);
+
+   if (!sHeapBase) {
+      return 0;
+   }
+
+   __wut_malloc_lock(r);
+
+   // A block can't be shrunk to nothing, keep at least a word reserved
+   uint32_t size = (sHeapSize + 3) & ~3;
+   if (size < 4) {
+      size = 4;
+   }
+
+   if (size < sHeapReserved) {
+      uint32_t reserved = MEMResizeForMBlockExpHeap(sHeapHandle, sHeapBase, size);
+      if (reserved && reserved < sHeapReserved) {
+         freed = sHeapReserved - reserved;
+         sHeapReserved = reserved;
+      }
+   }
+
+   __wut_malloc_unlock(r);
+   return freed;
+}
+
+uint32_t
+WUTHeapShrinkGpuHeap(void)
+{
+   if (!sGpuHeap) {
+      return 0;
+   }
+
+   // The heap and its header are the whole block, so the adjusted size of
+   // the heap is what the block can be shrunk to
+   uint32_t oldSize = sGpuHeapSize;
+   uint32_t size = MEMAdjustExpHeap(sGpuHeap);
+   if (!size || size >= oldSize) {
+      return 0;
+   }
+
+   uint32_t reserved = MEMResizeForMBlockExpHeap(sHeapHandle, sGpuHeapBase, size);
+   if (!reserved || reserved >= oldSize) {
+      return 0;
+   }
+
+   sGpuHeapSize = reserved;
+   return oldSize - reserved;
 }
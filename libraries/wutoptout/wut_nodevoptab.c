@@ -0,0 +1,15 @@
+/*
+ * Linked with $(WUT_NODEVOPTAB) before -lwut, replaces the "fs:" device set
+ * up by __init_wut so none of wutdevoptab ends up in the RPX and the SD card
+ * is not mounted before main.
+ */
+
+void
+__init_wut_devoptab()
+{
+}
+
+void
+__fini_wut_devoptab()
+{
+}
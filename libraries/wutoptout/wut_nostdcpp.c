@@ -0,0 +1,15 @@
+/*
+ * Linked with $(WUT_NOSTDCPP) before -lwut, replaces the C++ runtime set up
+ * by __init_wut so wut's gthread implementation and its thread pool are left
+ * out of applications that don't use std::thread or its relatives.
+ */
+
+void
+__init_wut_stdcpp()
+{
+}
+
+void
+__fini_wut_stdcpp()
+{
+}
@@ -0,0 +1,642 @@
+#include <coreinit/atomic.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/dirent.h>
+#include <sys/iosupport.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <wut_pack.h>
+
+#define PACK_NAME_SIZE     32
+#define PACK_BLOCK_SIZE    0x8000
+
+typedef struct PackDevice
+{
+   devoptab_t device;
+   char name[PACK_NAME_SIZE];
+
+   //! The whole image in memory, or only its header and index for files.
+   const uint8_t *image;
+   uint32_t imageSize;
+   const WUTPackHeader *header;
+   const WUTPackEntry *entries;
+   const uint32_t *buckets;
+   const char *names;
+
+   //! Image file, -1 for images in memory.
+   int fd;
+
+   //! Open files and directories.
+   volatile int32_t openCount;
+} PackDevice;
+
+typedef struct PackFile
+{
+   const WUTPackEntry *entry;
+   uint32_t pos;
+} PackFile;
+
+typedef struct PackDir
+{
+   const WUTPackEntry *entry;
+   uint32_t next;
+} PackDir;
+
+static int
+packOpen(struct _reent *r, void *fileStruct, const char *path, int flags, int mode);
+
+static uint32_t
+packHash(const char *str)
+{
+   uint32_t hash = 0x811C9DC5;
+
+   while (*str) {
+      hash = (hash ^ (uint8_t)*str++) * 0x01000193;
+   }
+
+   return hash;
+}
+
+static PackDevice *
+packFindDevice(const char *name)
+{
+   int i;
+
+   for (i = 0; i < STD_MAX; ++i) {
+      const devoptab_t *devoptab = devoptab_list[i];
+      if (devoptab && devoptab->open_r == packOpen && strcmp(devoptab->name, name) == 0) {
+         return (PackDevice *)devoptab->deviceData;
+      }
+   }
+
+   return NULL;
+}
+
+//! Normalize path into the form stored in the image and look it up.
+static const WUTPackEntry *
+packLookup(struct _reent *r,
+           PackDevice *dev,
+           const char *path)
+{
+   char buffer[PATH_MAX];
+   const char *end;
+   uint32_t length = 0, hash, index, i;
+   size_t n;
+
+   // Skip the device name
+   end = strchr(path, ':');
+   if (end) {
+      path = end + 1;
+   }
+
+   while (*path) {
+      while (*path == '/') {
+         ++path;
+      }
+
+      for (end = path; *end && *end != '/'; ++end);
+      n = end - path;
+
+      if (n == 0 || (n == 1 && path[0] == '.')) {
+         // Nothing to add
+      } else if (n == 2 && path[0] == '.' && path[1] == '.') {
+         while (length && buffer[length - 1] != '/') {
+            --length;
+         }
+
+         if (length) {
+            --length;
+         }
+      } else {
+         if (length + n + 2 > sizeof(buffer)) {
+            r->_errno = ENAMETOOLONG;
+            return NULL;
+         }
+
+         if (length) {
+            buffer[length++] = '/';
+         }
+
+         memcpy(buffer + length, path, n);
+         length += n;
+      }
+
+      path = end;
+   }
+
+   buffer[length] = '\0';
+   hash = packHash(buffer);
+   index = dev->buckets[hash & (dev->header->numBuckets - 1)];
+
+   // Chains were checked to end at mount, bound the walk anyway
+   for (i = 0; index != WUT_PACK_INVALID_INDEX && i < dev->header->numEntries; ++i) {
+      const WUTPackEntry *entry = &dev->entries[index];
+      if (entry->hash == hash && strcmp(dev->names + entry->nameOffset, buffer) == 0) {
+         return entry;
+      }
+
+      index = entry->nextInBucket;
+   }
+
+   r->_errno = ENOENT;
+   return NULL;
+}
+
+static void
+packStat(PackDevice *dev,
+         const WUTPackEntry *entry,
+         struct stat *st)
+{
+   memset(st, 0, sizeof(struct stat));
+   st->st_ino = (ino_t)(entry - dev->entries) + 1;
+   st->st_nlink = 1;
+
+   if (entry->flags & WUT_PACK_ENTRY_DIRECTORY) {
+      st->st_mode = S_IFDIR | 0555;
+      st->st_blksize = 512;
+   } else {
+      st->st_mode = S_IFREG | 0444;
+      st->st_size = entry->size;
+      // Lets stdio read big chunks, which is a single memcpy or pread
+      st->st_blksize = PACK_BLOCK_SIZE;
+      st->st_blocks = (entry->size + 511) / 512;
+   }
+}
+
+static int
+packOpen(struct _reent *r,
+         void *fileStruct,
+         const char *path,
+         int flags,
+         int mode)
+{
+   PackDevice *dev = (PackDevice *)r->deviceData;
+   PackFile *file = (PackFile *)fileStruct;
+   const WUTPackEntry *entry;
+
+   if ((flags & O_ACCMODE) != O_RDONLY || (flags & (O_CREAT | O_TRUNC | O_APPEND))) {
+      r->_errno = EROFS;
+      return -1;
+   }
+
+   entry = packLookup(r, dev, path);
+   if (!entry) {
+      return -1;
+   }
+
+   if (entry->flags & WUT_PACK_ENTRY_DIRECTORY) {
+      r->_errno = EISDIR;
+      return -1;
+   }
+
+   file->entry = entry;
+   file->pos = 0;
+   OSAddAtomic(&dev->openCount, 1);
+   return 0;
+}
+
+static int
+packClose(struct _reent *r,
+          void *fd)
+{
+   PackDevice *dev = (PackDevice *)r->deviceData;
+
+   OSAddAtomic(&dev->openCount, -1);
+   return 0;
+}
+
+static ssize_t
+packRead(struct _reent *r,
+         void *fd,
+         char *ptr,
+         size_t len)
+{
+   PackDevice *dev = (PackDevice *)r->deviceData;
+   PackFile *file = (PackFile *)fd;
+   uint32_t size = file->entry->size;
+   ssize_t result;
+
+   if (file->pos >= size) {
+      return 0;
+   }
+
+   if (len > size - file->pos) {
+      len = size - file->pos;
+   }
+
+   if (dev->fd < 0) {
+      memcpy(ptr, dev->image + file->entry->offset + file->pos, len);
+      result = (ssize_t)len;
+   } else {
+      // Positional, so files on the same handle don't share a position
+      result = pread(dev->fd, ptr, len, (off_t)file->entry->offset + file->pos);
+      if (result < 0) {
+         r->_errno = errno;
+         return -1;
+      }
+   }
+
+   file->pos += (uint32_t)result;
+   return result;
+}
+
+static off_t
+packSeek(struct _reent *r,
+         void *fd,
+         off_t pos,
+         int dir)
+{
+   PackFile *file = (PackFile *)fd;
+   off_t base;
+
+   switch (dir) {
+   case SEEK_SET:
+      base = 0;
+      break;
+   case SEEK_CUR:
+      base = file->pos;
+      break;
+   case SEEK_END:
+      base = file->entry->size;
+      break;
+   default:
+      r->_errno = EINVAL;
+      return -1;
+   }
+
+   if (base + pos < 0) {
+      r->_errno = EINVAL;
+      return -1;
+   } else if (base + pos > UINT32_MAX) {
+      r->_errno = EOVERFLOW;
+      return -1;
+   }
+
+   file->pos = (uint32_t)(base + pos);
+   return file->pos;
+}
+
+static int
+packFstat(struct _reent *r,
+          void *fd,
+          struct stat *st)
+{
+   packStat((PackDevice *)r->deviceData, ((PackFile *)fd)->entry, st);
+   return 0;
+}
+
+static int
+packStatPath(struct _reent *r,
+             const char *path,
+             struct stat *st)
+{
+   PackDevice *dev = (PackDevice *)r->deviceData;
+   const WUTPackEntry *entry = packLookup(r, dev, path);
+
+   if (!entry) {
+      return -1;
+   }
+
+   packStat(dev, entry, st);
+   return 0;
+}
+
+static DIR_ITER *
+packDirOpen(struct _reent *r,
+            DIR_ITER *dirState,
+            const char *path)
+{
+   PackDevice *dev = (PackDevice *)r->deviceData;
+   PackDir *dir = (PackDir *)dirState->dirStruct;
+   const WUTPackEntry *entry = packLookup(r, dev, path);
+
+   if (!entry) {
+      return NULL;
+   }
+
+   if (!(entry->flags & WUT_PACK_ENTRY_DIRECTORY)) {
+      r->_errno = ENOTDIR;
+      return NULL;
+   }
+
+   dir->entry = entry;
+   dir->next = 0;
+   OSAddAtomic(&dev->openCount, 1);
+   return dirState;
+}
+
+static int
+packDirReset(struct _reent *r,
+             DIR_ITER *dirState)
+{
+   ((PackDir *)dirState->dirStruct)->next = 0;
+   return 0;
+}
+
+static int
+packDirNext(struct _reent *r,
+            DIR_ITER *dirState,
+            char *filename,
+            struct stat *filestat)
+{
+   PackDevice *dev = (PackDevice *)r->deviceData;
+   PackDir *dir = (PackDir *)dirState->dirStruct;
+   const WUTPackEntry *child;
+   const char *name;
+
+   if (dir->next >= dir->entry->size) {
+      r->_errno = ENOENT;
+      return -1;
+   }
+
+   child = &dev->entries[dir->entry->offset + dir->next++];
+   name = dev->names + child->nameOffset;
+   if (strrchr(name, '/')) {
+      name = strrchr(name, '/') + 1;
+   }
+
+   snprintf(filename, NAME_MAX, "%s", name);
+   packStat(dev, child, filestat);
+   return 0;
+}
+
+static int
+packDirClose(struct _reent *r,
+             DIR_ITER *dirState)
+{
+   PackDevice *dev = (PackDevice *)r->deviceData;
+
+   OSAddAtomic(&dev->openCount, -1);
+   return 0;
+}
+
+static const devoptab_t
+sPackDevoptab = {
+   .name         = NULL,
+   .structSize   = sizeof(PackFile),
+   .open_r       = packOpen,
+   .close_r      = packClose,
+   .read_r       = packRead,
+   .seek_r       = packSeek,
+   .fstat_r      = packFstat,
+   .stat_r       = packStatPath,
+   .dirStateSize = sizeof(PackDir),
+   .diropen_r    = packDirOpen,
+   .dirreset_r   = packDirReset,
+   .dirnext_r    = packDirNext,
+   .dirclose_r   = packDirClose,
+   .lstat_r      = packStatPath,
+};
+
+//! Size of the header and index, FALSE if the header is malformed.
+static BOOL
+packGetIndexSize(const WUTPackHeader *header,
+                 uint32_t *outSize)
+{
+   uint64_t entriesEnd, bucketsEnd, namesEnd, end;
+
+   if (header->magic != WUT_PACK_MAGIC ||
+       !header->numEntries ||
+       !header->numBuckets || (header->numBuckets & (header->numBuckets - 1)) ||
+       (header->entriesOffset & 3) || (header->bucketsOffset & 3) ||
+       !header->namesSize) {
+      return FALSE;
+   }
+
+   entriesEnd = (uint64_t)header->entriesOffset + (uint64_t)header->numEntries * sizeof(WUTPackEntry);
+   bucketsEnd = (uint64_t)header->bucketsOffset + (uint64_t)header->numBuckets * sizeof(uint32_t);
+   namesEnd = (uint64_t)header->namesOffset + header->namesSize;
+
+   end = sizeof(WUTPackHeader);
+   end = entriesEnd > end ? entriesEnd : end;
+   end = bucketsEnd > end ? bucketsEnd : end;
+   end = namesEnd > end ? namesEnd : end;
+   if (end > UINT32_MAX) {
+      return FALSE;
+   }
+
+   *outSize = (uint32_t)end;
+   return TRUE;
+}
+
+//! Check every index and offset once, so lookups and reads don't have to.
+static BOOL
+packValidate(PackDevice *dev,
+             uint32_t imageSize)
+{
+   const WUTPackHeader *header = dev->header;
+   uint32_t i;
+
+   if (dev->names[header->namesSize - 1] != '\0' ||
+       !(dev->entries[0].flags & WUT_PACK_ENTRY_DIRECTORY)) {
+      return FALSE;
+   }
+
+   for (i = 0; i < header->numBuckets; ++i) {
+      if (dev->buckets[i] != WUT_PACK_INVALID_INDEX && dev->buckets[i] >= header->numEntries) {
+         return FALSE;
+      }
+   }
+
+   for (i = 0; i < header->numEntries; ++i) {
+      const WUTPackEntry *entry = &dev->entries[i];
+
+      if (entry->nameOffset >= header->namesSize ||
+          entry->parent >= header->numEntries ||
+          (entry->nextInBucket != WUT_PACK_INVALID_INDEX && entry->nextInBucket >= header->numEntries)) {
+         return FALSE;
+      }
+
+      if (entry->flags & WUT_PACK_ENTRY_DIRECTORY) {
+         if ((uint64_t)entry->offset + entry->size > header->numEntries) {
+            return FALSE;
+         }
+      } else if ((uint64_t)entry->offset + entry->size > imageSize) {
+         return FALSE;
+      }
+   }
+
+   return TRUE;
+}
+
+static int
+packAddDevice(PackDevice *dev,
+              const char *name)
+{
+   memcpy(&dev->device, &sPackDevoptab, sizeof(devoptab_t));
+   snprintf(dev->name, sizeof(dev->name), "%s", name);
+   dev->device.name = dev->name;
+   dev->device.deviceData = dev;
+   dev->entries = (const WUTPackEntry *)(dev->image + dev->header->entriesOffset);
+   dev->buckets = (const uint32_t *)(dev->image + dev->header->bucketsOffset);
+   dev->names = (const char *)(dev->image + dev->header->namesOffset);
+   dev->openCount = 0;
+
+   if (!packValidate(dev, dev->imageSize)) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   if (AddDevice(&dev->device) < 0) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   return 0;
+}
+
+static BOOL
+packCheckName(const char *name)
+{
+   if (!name || !name[0] || strchr(name, ':') || strlen(name) >= PACK_NAME_SIZE) {
+      errno = EINVAL;
+      return FALSE;
+   }
+
+   if (packFindDevice(name)) {
+      errno = EEXIST;
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+int
+WUTPackMountMemory(const char *name,
+                   const void *image,
+                   uint32_t size)
+{
+   PackDevice *dev;
+   uint32_t indexSize;
+
+   if (!packCheckName(name)) {
+      return -1;
+   }
+
+   if (!image || ((uintptr_t)image & 3) || size < sizeof(WUTPackHeader) ||
+       !packGetIndexSize((const WUTPackHeader *)image, &indexSize) || indexSize > size) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   dev = (PackDevice *)malloc(sizeof(PackDevice));
+   if (!dev) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   memset(dev, 0, sizeof(PackDevice));
+   dev->image = (const uint8_t *)image;
+   dev->imageSize = size;
+   dev->header = (const WUTPackHeader *)image;
+   dev->fd = -1;
+
+   if (packAddDevice(dev, name) < 0) {
+      free(dev);
+      return -1;
+   }
+
+   return 0;
+}
+
+int
+WUTPackMountFile(const char *name,
+                 const char *path)
+{
+   WUTPackHeader header;
+   PackDevice *dev;
+   struct stat st;
+   uint32_t indexSize;
+   uint8_t *index;
+   int fd, err;
+
+   if (!packCheckName(name)) {
+      return -1;
+   }
+
+   fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      return -1;
+   }
+
+   if (fstat(fd, &st) < 0) {
+      goto error;
+   }
+
+   if (pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+       !packGetIndexSize(&header, &indexSize) || indexSize > st.st_size) {
+      errno = EINVAL;
+      goto error;
+   }
+
+   // Everything but the file data is kept in memory
+   dev = (PackDevice *)malloc(sizeof(PackDevice));
+   index = (uint8_t *)memalign(0x40, indexSize);
+   if (!dev || !index) {
+      free(dev);
+      free(index);
+      errno = ENOMEM;
+      goto error;
+   }
+
+   if (pread(fd, index, indexSize, 0) != (ssize_t)indexSize) {
+      free(dev);
+      free(index);
+      errno = EIO;
+      goto error;
+   }
+
+   memset(dev, 0, sizeof(PackDevice));
+   dev->image = index;
+   dev->imageSize = (uint32_t)st.st_size;
+   dev->header = (const WUTPackHeader *)index;
+   dev->fd = fd;
+
+   if (packAddDevice(dev, name) < 0) {
+      free(dev);
+      free(index);
+      goto error;
+   }
+
+   return 0;
+
+error:
+   err = errno;
+   close(fd);
+   errno = err;
+   return -1;
+}
+
+int
+WUTPackUnmount(const char *name)
+{
+   char deviceName[PACK_NAME_SIZE + 1];
+   PackDevice *dev;
+
+   dev = name ? packFindDevice(name) : NULL;
+   if (!dev) {
+      errno = ENOENT;
+      return -1;
+   }
+
+   if (dev->openCount) {
+      errno = EBUSY;
+      return -1;
+   }
+
+   snprintf(deviceName, sizeof(deviceName), "%s:", dev->name);
+   RemoveDevice(deviceName);
+
+   if (dev->fd >= 0) {
+      close(dev->fd);
+      free((void *)dev->image);
+   }
+
+   free(dev);
+   return 0;
+}
@@ -0,0 +1,135 @@
+#include <wut_profile.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+/*
+ * Instrumented objects are built with -fprofile-generate=/wutprofile, so
+ * the .gcda name of each is that directory followed by its own mangled
+ * path. Stripping the one leading component and prefixing the output
+ * directory puts every file directly in the output directory, which is
+ * created here: libgcov creates missing directories from the root down,
+ * which fails on a "fs:" path.
+ */
+#define PROFILE_STRIP "1"
+
+// Only linked into -fprofile-generate builds
+extern void __gcov_init(void *info) __attribute__((weak));
+extern void __gcov_dump(void) __attribute__((weak));
+extern void __gcov_reset(void) __attribute__((weak));
+
+static char sProfileDir[PATH_MAX] = WUT_PROFILE_DEFAULT_DIR;
+
+static BOOL
+__wut_profile_mkdirs(char *path)
+{
+   char *p = strchr(path, ':');
+
+   // Skip the device and the volume, e.g. fs:/vol/external01
+   p = p ? p + 1 : path;
+   if (!*p) {
+      return TRUE;
+   }
+
+   if (!strncmp(p, "/vol/", 5)) {
+      p = strchr(p + 5, '/');
+      if (!p) {
+         return TRUE;
+      }
+   }
+
+   for (++p;; ++p) {
+      if (*p == '/' || *p == '\0') {
+         char c = *p;
+         *p = '\0';
+         if (mkdir(path, 0777) == -1 && errno != EEXIST) {
+            *p = c;
+            return FALSE;
+         }
+         *p = c;
+
+         if (!c) {
+            return TRUE;
+         }
+      }
+   }
+}
+
+static BOOL
+__wut_profile_prepare(void)
+{
+   char path[PATH_MAX];
+
+   strcpy(path, sProfileDir);
+   if (!__wut_profile_mkdirs(path)) {
+      return FALSE;
+   }
+
+   // libgcov reads these every time it writes the profile
+   setenv("GCOV_PREFIX", sProfileDir, 1);
+   setenv("GCOV_PREFIX_STRIP", PROFILE_STRIP, 1);
+   return TRUE;
+}
+
+BOOL
+WUTProfileIsEnabled(void)
+{
+   return &__gcov_init != NULL && &__gcov_dump != NULL;
+}
+
+void
+WUTProfileSetOutputDir(const char *dir)
+{
+   size_t length;
+
+   if (!dir) {
+      dir = WUT_PROFILE_DEFAULT_DIR;
+   }
+
+   length = strlen(dir);
+   while (length > 1 && dir[length - 1] == '/') {
+      --length;
+   }
+
+   if (length >= sizeof(sProfileDir)) {
+      return;
+   }
+
+   memcpy(sProfileDir, dir, length);
+   sProfileDir[length] = '\0';
+}
+
+BOOL
+WUTProfileDump(BOOL reset)
+{
+   if (!WUTProfileIsEnabled() || !__wut_profile_prepare()) {
+      return FALSE;
+   }
+
+   __gcov_dump();
+   if (reset && &__gcov_reset) {
+      __gcov_reset();
+   }
+
+   return TRUE;
+}
+
+// Runs before the priority 100 destructor libgcov writes the profile from
+// at exit, while the SD card is still mounted
+static void __attribute__((destructor(101)))
+__wut_profile_exit()
+{
+   if (&__gcov_init) {
+      __wut_profile_prepare();
+   }
+}
+
+// Called from __fini_wut for exits that skip the destructors, libgcov only
+// writes the profile once
+void
+__fini_wut_profile()
+{
+   WUTProfileDump(FALSE);
+}
@@ -0,0 +1,814 @@
+#include <wut_psmath.h>
+#include <math.h>
+#include <string.h>
+
+/*
+ * The paired-single kernels are written as one asm block each, GCC does not
+ * know about the second half of a floating point register so no paired
+ * value can be kept in a C variable between blocks.
+ *
+ * Registers are numbered as in the crt0 sources, psq_l and psq_st use GQR0
+ * which the OS keeps at 0 for plain floats.
+ */
+
+#ifdef ESPRESSO
+#define PS_CLOBBER_0_7 \
+   "fr0", "fr1", "fr2", "fr3", "fr4", "fr5", "fr6", "fr7"
+#define PS_CLOBBER_0_13 \
+   PS_CLOBBER_0_7, "fr8", "fr9", "fr10", "fr11", "fr12", "fr13"
+#define PS_UGQR6 902
+
+//! {0, 1} adds a row's translation to the second half of a pair
+static const float sPsZeroOne[2] = { 0.0f, 1.0f };
+#endif
+
+void
+WUTVec2AddScalar(const WUTVec2 *a, const WUTVec2 *b, WUTVec2 *ab)
+{
+   ab->x = a->x + b->x;
+   ab->y = a->y + b->y;
+}
+
+void
+WUTVec2Add(const WUTVec2 *a, const WUTVec2 *b, WUTVec2 *ab)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[a]), 0, 0\n"
+      "psq_l 1, 0(%[b]), 0, 0\n"
+      "ps_add 0, 0, 1\n"
+      "psq_st 0, 0(%[ab]), 0, 0\n"
+      :
+      : [a] "b" (a), [b] "b" (b), [ab] "b" (ab)
+      : "fr0", "fr1", "memory");
+#else
+   WUTVec2AddScalar(a, b, ab);
+#endif
+}
+
+void
+WUTVec2ScaleScalar(const WUTVec2 *src, WUTVec2 *dst, float scale)
+{
+   dst->x = src->x * scale;
+   dst->y = src->y * scale;
+}
+
+void
+WUTVec2Scale(const WUTVec2 *src, WUTVec2 *dst, float scale)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[src]), 0, 0\n"
+      "ps_muls0 0, 0, %[scale]\n"
+      "psq_st 0, 0(%[dst]), 0, 0\n"
+      :
+      : [src] "b" (src), [dst] "b" (dst), [scale] "f" (scale)
+      : "fr0", "memory");
+#else
+   WUTVec2ScaleScalar(src, dst, scale);
+#endif
+}
+
+float
+WUTVec2DotScalar(const WUTVec2 *a, const WUTVec2 *b)
+{
+   return a->x * b->x + a->y * b->y;
+}
+
+float
+WUTVec2Dot(const WUTVec2 *a, const WUTVec2 *b)
+{
+#ifdef ESPRESSO
+   float dot;
+   __asm__ volatile (
+      "psq_l 0, 0(%[a]), 0, 0\n"
+      "psq_l 1, 0(%[b]), 0, 0\n"
+      "ps_mul 0, 0, 1\n"
+      "ps_sum0 %[dot], 0, 0, 0\n"
+      : [dot] "=f" (dot)
+      : [a] "b" (a), [b] "b" (b)
+      : "fr0", "fr1", "memory");
+   return dot;
+#else
+   return WUTVec2DotScalar(a, b);
+#endif
+}
+
+void
+WUTVec3AddScalar(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab)
+{
+   ab->x = a->x + b->x;
+   ab->y = a->y + b->y;
+   ab->z = a->z + b->z;
+}
+
+void
+WUTVec3Add(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[a]), 0, 0\n"
+      "psq_l 1, 0(%[b]), 0, 0\n"
+      "psq_l 2, 8(%[a]), 1, 0\n"
+      "psq_l 3, 8(%[b]), 1, 0\n"
+      "ps_add 0, 0, 1\n"
+      "ps_add 2, 2, 3\n"
+      "psq_st 0, 0(%[ab]), 0, 0\n"
+      "psq_st 2, 8(%[ab]), 1, 0\n"
+      :
+      : [a] "b" (a), [b] "b" (b), [ab] "b" (ab)
+      : "fr0", "fr1", "fr2", "fr3", "memory");
+#else
+   WUTVec3AddScalar(a, b, ab);
+#endif
+}
+
+void
+WUTVec3SubScalar(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab)
+{
+   ab->x = a->x - b->x;
+   ab->y = a->y - b->y;
+   ab->z = a->z - b->z;
+}
+
+void
+WUTVec3Sub(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *ab)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[a]), 0, 0\n"
+      "psq_l 1, 0(%[b]), 0, 0\n"
+      "psq_l 2, 8(%[a]), 1, 0\n"
+      "psq_l 3, 8(%[b]), 1, 0\n"
+      "ps_sub 0, 0, 1\n"
+      "ps_sub 2, 2, 3\n"
+      "psq_st 0, 0(%[ab]), 0, 0\n"
+      "psq_st 2, 8(%[ab]), 1, 0\n"
+      :
+      : [a] "b" (a), [b] "b" (b), [ab] "b" (ab)
+      : "fr0", "fr1", "fr2", "fr3", "memory");
+#else
+   WUTVec3SubScalar(a, b, ab);
+#endif
+}
+
+void
+WUTVec3ScaleScalar(const WUTVec3 *src, WUTVec3 *dst, float scale)
+{
+   dst->x = src->x * scale;
+   dst->y = src->y * scale;
+   dst->z = src->z * scale;
+}
+
+void
+WUTVec3Scale(const WUTVec3 *src, WUTVec3 *dst, float scale)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[src]), 0, 0\n"
+      "psq_l 1, 8(%[src]), 1, 0\n"
+      "ps_muls0 0, 0, %[scale]\n"
+      "ps_muls0 1, 1, %[scale]\n"
+      "psq_st 0, 0(%[dst]), 0, 0\n"
+      "psq_st 1, 8(%[dst]), 1, 0\n"
+      :
+      : [src] "b" (src), [dst] "b" (dst), [scale] "f" (scale)
+      : "fr0", "fr1", "memory");
+#else
+   WUTVec3ScaleScalar(src, dst, scale);
+#endif
+}
+
+float
+WUTVec3DotScalar(const WUTVec3 *a, const WUTVec3 *b)
+{
+   return a->x * b->x + a->y * b->y + a->z * b->z;
+}
+
+float
+WUTVec3Dot(const WUTVec3 *a, const WUTVec3 *b)
+{
+#ifdef ESPRESSO
+   float dot;
+   __asm__ volatile (
+      // (ay * by, az * bz) + (ax * bx, 1 * 1)
+      "psq_l 0, 4(%[a]), 0, 0\n"
+      "psq_l 1, 4(%[b]), 0, 0\n"
+      "psq_l 2, 0(%[a]), 1, 0\n"
+      "psq_l 3, 0(%[b]), 1, 0\n"
+      "ps_mul 0, 0, 1\n"
+      "ps_madd 2, 2, 3, 0\n"
+      "ps_sum0 %[dot], 2, 0, 0\n"
+      : [dot] "=f" (dot)
+      : [a] "b" (a), [b] "b" (b)
+      : "fr0", "fr1", "fr2", "fr3", "memory");
+   return dot;
+#else
+   return WUTVec3DotScalar(a, b);
+#endif
+}
+
+void
+WUTVec3CrossScalar(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *axb)
+{
+   WUTVec3 result;
+   result.x = a->y * b->z - a->z * b->y;
+   result.y = a->z * b->x - a->x * b->z;
+   result.z = a->x * b->y - a->y * b->x;
+   *axb = result;
+}
+
+void
+WUTVec3Cross(const WUTVec3 *a, const WUTVec3 *b, WUTVec3 *axb)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[a]), 0, 0\n"       // ax ay
+      "psq_l 1, 0(%[b]), 0, 0\n"       // bx by
+      "psq_l 2, 8(%[a]), 1, 0\n"
+      "psq_l 3, 8(%[b]), 1, 0\n"
+      "ps_merge00 2, 2, 2\n"           // az az
+      "ps_merge00 3, 3, 3\n"           // bz bz
+      "ps_merge10 4, 1, 1\n"           // by bx
+      "ps_mul 5, 1, 2\n"               // bx*az by*az
+      "ps_muls0 6, 1, 0\n"             // bx*ax by*ax
+      "ps_msub 5, 0, 3, 5\n"           // ax*bz-bx*az ay*bz-by*az
+      "ps_msub 6, 0, 4, 6\n"           // ax*by-bx*ax ay*bx-by*ax
+      "ps_merge11 7, 5, 5\n"           // x = ay*bz-az*by
+      "ps_merge01 5, 5, 6\n"
+      "ps_neg 5, 5\n"                  // y = az*bx-ax*bz, z = ax*by-ay*bx
+      "psq_st 7, 0(%[axb]), 1, 0\n"
+      "psq_st 5, 4(%[axb]), 0, 0\n"
+      :
+      : [a] "b" (a), [b] "b" (b), [axb] "b" (axb)
+      : PS_CLOBBER_0_7, "memory");
+#else
+   WUTVec3CrossScalar(a, b, axb);
+#endif
+}
+
+void
+WUTVec3NormalizeScalar(const WUTVec3 *src, WUTVec3 *dst)
+{
+   WUTVec3ScaleScalar(src, dst, 1.0f / sqrtf(WUTVec3DotScalar(src, src)));
+}
+
+void
+WUTVec3Normalize(const WUTVec3 *src, WUTVec3 *dst)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[src]), 0, 0\n"
+      "psq_l 1, 8(%[src]), 1, 0\n"
+      "ps_mul 2, 0, 0\n"               // x*x y*y
+      "ps_madd 3, 1, 1, 2\n"           // z*z+x*x 1+y*y
+      "ps_sum0 3, 3, 2, 2\n"           // x*x+y*y+z*z
+      "frsqrte 4, 3\n"
+      // One Newton-Raphson step: r = r * (1.5 - 0.5 * d * r * r)
+      "fmuls 5, 4, 4\n"
+      "fmuls 6, 4, %[half]\n"
+      "fnmsubs 5, 5, 3, %[three]\n"
+      "fmuls 4, 5, 6\n"
+      "ps_muls0 0, 0, 4\n"
+      "ps_muls0 1, 1, 4\n"
+      "psq_st 0, 0(%[dst]), 0, 0\n"
+      "psq_st 1, 8(%[dst]), 1, 0\n"
+      :
+      : [src] "b" (src), [dst] "b" (dst), [half] "f" (0.5f), [three] "f" (3.0f)
+      : PS_CLOBBER_0_7, "memory");
+#else
+   WUTVec3NormalizeScalar(src, dst);
+#endif
+}
+
+void
+WUTVec4AddScalar(const WUTVec4 *a, const WUTVec4 *b, WUTVec4 *ab)
+{
+   ab->x = a->x + b->x;
+   ab->y = a->y + b->y;
+   ab->z = a->z + b->z;
+   ab->w = a->w + b->w;
+}
+
+void
+WUTVec4Add(const WUTVec4 *a, const WUTVec4 *b, WUTVec4 *ab)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[a]), 0, 0\n"
+      "psq_l 1, 0(%[b]), 0, 0\n"
+      "psq_l 2, 8(%[a]), 0, 0\n"
+      "psq_l 3, 8(%[b]), 0, 0\n"
+      "ps_add 0, 0, 1\n"
+      "ps_add 2, 2, 3\n"
+      "psq_st 0, 0(%[ab]), 0, 0\n"
+      "psq_st 2, 8(%[ab]), 0, 0\n"
+      :
+      : [a] "b" (a), [b] "b" (b), [ab] "b" (ab)
+      : "fr0", "fr1", "fr2", "fr3", "memory");
+#else
+   WUTVec4AddScalar(a, b, ab);
+#endif
+}
+
+void
+WUTVec4ScaleScalar(const WUTVec4 *src, WUTVec4 *dst, float scale)
+{
+   dst->x = src->x * scale;
+   dst->y = src->y * scale;
+   dst->z = src->z * scale;
+   dst->w = src->w * scale;
+}
+
+void
+WUTVec4Scale(const WUTVec4 *src, WUTVec4 *dst, float scale)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[src]), 0, 0\n"
+      "psq_l 1, 8(%[src]), 0, 0\n"
+      "ps_muls0 0, 0, %[scale]\n"
+      "ps_muls0 1, 1, %[scale]\n"
+      "psq_st 0, 0(%[dst]), 0, 0\n"
+      "psq_st 1, 8(%[dst]), 0, 0\n"
+      :
+      : [src] "b" (src), [dst] "b" (dst), [scale] "f" (scale)
+      : "fr0", "fr1", "memory");
+#else
+   WUTVec4ScaleScalar(src, dst, scale);
+#endif
+}
+
+float
+WUTVec4DotScalar(const WUTVec4 *a, const WUTVec4 *b)
+{
+   return a->x * b->x + a->y * b->y + a->z * b->z + a->w * b->w;
+}
+
+float
+WUTVec4Dot(const WUTVec4 *a, const WUTVec4 *b)
+{
+#ifdef ESPRESSO
+   float dot;
+   __asm__ volatile (
+      "psq_l 0, 0(%[a]), 0, 0\n"
+      "psq_l 1, 0(%[b]), 0, 0\n"
+      "psq_l 2, 8(%[a]), 0, 0\n"
+      "psq_l 3, 8(%[b]), 0, 0\n"
+      "ps_mul 0, 0, 1\n"
+      "ps_madd 0, 2, 3, 0\n"
+      "ps_sum0 %[dot], 0, 0, 0\n"
+      : [dot] "=f" (dot)
+      : [a] "b" (a), [b] "b" (b)
+      : "fr0", "fr1", "fr2", "fr3", "memory");
+   return dot;
+#else
+   return WUTVec4DotScalar(a, b);
+#endif
+}
+
+void
+WUTMtx34Identity(WUTMtx34 m)
+{
+   memset(m, 0, sizeof(WUTMtx34));
+   m[0][0] = 1.0f;
+   m[1][1] = 1.0f;
+   m[2][2] = 1.0f;
+}
+
+void
+WUTMtx34ConcatScalar(const WUTMtx34 a, const WUTMtx34 b, WUTMtx34 ab)
+{
+   WUTMtx34 result;
+
+   for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 4; j++) {
+         result[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] + a[i][2] * b[2][j];
+      }
+      result[i][3] += a[i][3];
+   }
+
+   memcpy(ab, result, sizeof(WUTMtx34));
+}
+
+#ifdef ESPRESSO
+// Row of a from off(a) in 12 and 13, times the rows of b in 0 to 5, plus
+// the translation of a via {0, 1} in 6
+#define PS_MTX34_CONCAT_ROW(off) \
+   "psq_l 12, " #off "(%[a]), 0, 0\n" \
+   "psq_l 13, " #off "+8(%[a]), 0, 0\n" \
+   "ps_muls0 8, 0, 12\n" \
+   "ps_muls0 9, 1, 12\n" \
+   "ps_madds1 8, 2, 12, 8\n" \
+   "ps_madds1 9, 3, 12, 9\n" \
+   "ps_madds0 8, 4, 13, 8\n" \
+   "ps_madds0 9, 5, 13, 9\n" \
+   "ps_madds1 9, 6, 13, 9\n" \
+   "psq_st 8, " #off "(%[ab]), 0, 0\n" \
+   "psq_st 9, " #off "+8(%[ab]), 0, 0\n"
+#endif
+
+void
+WUTMtx34Concat(const WUTMtx34 a, const WUTMtx34 b, WUTMtx34 ab)
+{
+#ifdef ESPRESSO
+   // All of b is loaded first and each row of a is read before the same row
+   // of ab is written, so ab can be a or b
+   __asm__ volatile (
+      "psq_l 0, 0(%[b]), 0, 0\n"
+      "psq_l 1, 8(%[b]), 0, 0\n"
+      "psq_l 2, 16(%[b]), 0, 0\n"
+      "psq_l 3, 24(%[b]), 0, 0\n"
+      "psq_l 4, 32(%[b]), 0, 0\n"
+      "psq_l 5, 40(%[b]), 0, 0\n"
+      "psq_l 6, 0(%[zeroOne]), 0, 0\n"
+      PS_MTX34_CONCAT_ROW(0)
+      PS_MTX34_CONCAT_ROW(16)
+      PS_MTX34_CONCAT_ROW(32)
+      :
+      : [a] "b" (a), [b] "b" (b), [ab] "b" (ab), [zeroOne] "b" (sPsZeroOne)
+      : PS_CLOBBER_0_13, "memory");
+#else
+   WUTMtx34ConcatScalar(a, b, ab);
+#endif
+}
+
+void
+WUTMtx34MultVecScalar(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst)
+{
+   WUTVec3 result;
+   result.x = m[0][0] * src->x + m[0][1] * src->y + m[0][2] * src->z + m[0][3];
+   result.y = m[1][0] * src->x + m[1][1] * src->y + m[1][2] * src->z + m[1][3];
+   result.z = m[2][0] * src->x + m[2][1] * src->y + m[2][2] * src->z + m[2][3];
+   *dst = result;
+}
+
+#ifdef ESPRESSO
+// Transform the point (x y, z 1) in 6 and 7 by the rows in 0 to 5 and store
+// it to dst
+#define PS_MTX34_MULT_VEC \
+   "ps_mul 8, 0, 6\n" \
+   "ps_mul 9, 2, 6\n" \
+   "ps_mul 10, 4, 6\n" \
+   "ps_madd 8, 1, 7, 8\n" \
+   "ps_madd 9, 3, 7, 9\n" \
+   "ps_madd 10, 5, 7, 10\n" \
+   "ps_sum0 11, 8, 8, 8\n" \
+   "ps_sum1 11, 9, 11, 9\n" \
+   "ps_sum0 12, 10, 10, 10\n" \
+   "psq_st 11, 0(%[dst]), 0, 0\n" \
+   "psq_st 12, 8(%[dst]), 1, 0\n"
+#endif
+
+void
+WUTMtx34MultVec(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[m]), 0, 0\n"
+      "psq_l 1, 8(%[m]), 0, 0\n"
+      "psq_l 2, 16(%[m]), 0, 0\n"
+      "psq_l 3, 24(%[m]), 0, 0\n"
+      "psq_l 4, 32(%[m]), 0, 0\n"
+      "psq_l 5, 40(%[m]), 0, 0\n"
+      "psq_l 6, 0(%[src]), 0, 0\n"
+      "psq_l 7, 8(%[src]), 1, 0\n"
+      PS_MTX34_MULT_VEC
+      :
+      : [m] "b" (m), [src] "b" (src), [dst] "b" (dst)
+      : PS_CLOBBER_0_13, "memory");
+#else
+   WUTMtx34MultVecScalar(m, src, dst);
+#endif
+}
+
+void
+WUTMtx34MultVecArrayScalar(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst, uint32_t count)
+{
+   for (uint32_t i = 0; i < count; i++) {
+      WUTMtx34MultVecScalar(m, &src[i], &dst[i]);
+   }
+}
+
+void
+WUTMtx34MultVecArray(const WUTMtx34 m, const WUTVec3 *src, WUTVec3 *dst, uint32_t count)
+{
+#ifdef ESPRESSO
+   if (!count) {
+      return;
+   }
+
+   __asm__ volatile (
+      "psq_l 0, 0(%[m]), 0, 0\n"
+      "psq_l 1, 8(%[m]), 0, 0\n"
+      "psq_l 2, 16(%[m]), 0, 0\n"
+      "psq_l 3, 24(%[m]), 0, 0\n"
+      "psq_l 4, 32(%[m]), 0, 0\n"
+      "psq_l 5, 40(%[m]), 0, 0\n"
+      "mtctr %[count]\n"
+      "1:\n"
+      "psq_l 6, 0(%[src]), 0, 0\n"
+      "psq_l 7, 8(%[src]), 1, 0\n"
+      "addi %[src], %[src], 12\n"
+      PS_MTX34_MULT_VEC
+      "addi %[dst], %[dst], 12\n"
+      "bdnz 1b\n"
+      : [src] "+b" (src), [dst] "+b" (dst)
+      : [m] "b" (m), [count] "r" (count)
+      : PS_CLOBBER_0_13, "ctr", "memory");
+#else
+   WUTMtx34MultVecArrayScalar(m, src, dst, count);
+#endif
+}
+
+void
+WUTMtx44Identity(WUTMtx44 m)
+{
+   memset(m, 0, sizeof(WUTMtx44));
+   m[0][0] = 1.0f;
+   m[1][1] = 1.0f;
+   m[2][2] = 1.0f;
+   m[3][3] = 1.0f;
+}
+
+void
+WUTMtx44ConcatScalar(const WUTMtx44 a, const WUTMtx44 b, WUTMtx44 ab)
+{
+   WUTMtx44 result;
+
+   for (int i = 0; i < 4; i++) {
+      for (int j = 0; j < 4; j++) {
+         result[i][j] = a[i][0] * b[0][j] + a[i][1] * b[1][j] +
+                        a[i][2] * b[2][j] + a[i][3] * b[3][j];
+      }
+   }
+
+   memcpy(ab, result, sizeof(WUTMtx44));
+}
+
+#ifdef ESPRESSO
+// Row of a from off(a) in 8 and 9, times the rows of b in 0 to 7
+#define PS_MTX44_CONCAT_ROW(off) \
+   "psq_l 8, " #off "(%[a]), 0, 0\n" \
+   "psq_l 9, " #off "+8(%[a]), 0, 0\n" \
+   "ps_muls0 10, 0, 8\n" \
+   "ps_muls0 11, 1, 8\n" \
+   "ps_madds1 10, 2, 8, 10\n" \
+   "ps_madds1 11, 3, 8, 11\n" \
+   "ps_madds0 10, 4, 9, 10\n" \
+   "ps_madds0 11, 5, 9, 11\n" \
+   "ps_madds1 10, 6, 9, 10\n" \
+   "ps_madds1 11, 7, 9, 11\n" \
+   "psq_st 10, " #off "(%[ab]), 0, 0\n" \
+   "psq_st 11, " #off "+8(%[ab]), 0, 0\n"
+#endif
+
+void
+WUTMtx44Concat(const WUTMtx44 a, const WUTMtx44 b, WUTMtx44 ab)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[b]), 0, 0\n"
+      "psq_l 1, 8(%[b]), 0, 0\n"
+      "psq_l 2, 16(%[b]), 0, 0\n"
+      "psq_l 3, 24(%[b]), 0, 0\n"
+      "psq_l 4, 32(%[b]), 0, 0\n"
+      "psq_l 5, 40(%[b]), 0, 0\n"
+      "psq_l 6, 48(%[b]), 0, 0\n"
+      "psq_l 7, 56(%[b]), 0, 0\n"
+      PS_MTX44_CONCAT_ROW(0)
+      PS_MTX44_CONCAT_ROW(16)
+      PS_MTX44_CONCAT_ROW(32)
+      PS_MTX44_CONCAT_ROW(48)
+      :
+      : [a] "b" (a), [b] "b" (b), [ab] "b" (ab)
+      : PS_CLOBBER_0_13, "memory");
+#else
+   WUTMtx44ConcatScalar(a, b, ab);
+#endif
+}
+
+void
+WUTMtx44MultVecScalar(const WUTMtx44 m, const WUTVec4 *src, WUTVec4 *dst)
+{
+   WUTVec4 result;
+   result.x = m[0][0] * src->x + m[0][1] * src->y + m[0][2] * src->z + m[0][3] * src->w;
+   result.y = m[1][0] * src->x + m[1][1] * src->y + m[1][2] * src->z + m[1][3] * src->w;
+   result.z = m[2][0] * src->x + m[2][1] * src->y + m[2][2] * src->z + m[2][3] * src->w;
+   result.w = m[3][0] * src->x + m[3][1] * src->y + m[3][2] * src->z + m[3][3] * src->w;
+   *dst = result;
+}
+
+void
+WUTMtx44MultVec(const WUTMtx44 m, const WUTVec4 *src, WUTVec4 *dst)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[src]), 0, 0\n"     // x y
+      "psq_l 1, 8(%[src]), 0, 0\n"     // z w
+      "psq_l 2, 0(%[m]), 0, 0\n"
+      "psq_l 3, 8(%[m]), 0, 0\n"
+      "psq_l 4, 16(%[m]), 0, 0\n"
+      "psq_l 5, 24(%[m]), 0, 0\n"
+      "ps_mul 8, 2, 0\n"
+      "ps_mul 9, 4, 0\n"
+      "ps_madd 8, 3, 1, 8\n"
+      "ps_madd 9, 5, 1, 9\n"
+      "psq_l 2, 32(%[m]), 0, 0\n"
+      "psq_l 3, 40(%[m]), 0, 0\n"
+      "psq_l 4, 48(%[m]), 0, 0\n"
+      "psq_l 5, 56(%[m]), 0, 0\n"
+      "ps_mul 10, 2, 0\n"
+      "ps_mul 11, 4, 0\n"
+      "ps_madd 10, 3, 1, 10\n"
+      "ps_madd 11, 5, 1, 11\n"
+      "ps_sum0 12, 8, 8, 8\n"
+      "ps_sum1 12, 9, 12, 9\n"
+      "ps_sum0 13, 10, 10, 10\n"
+      "ps_sum1 13, 11, 13, 11\n"
+      "psq_st 12, 0(%[dst]), 0, 0\n"
+      "psq_st 13, 8(%[dst]), 0, 0\n"
+      :
+      : [m] "b" (m), [src] "b" (src), [dst] "b" (dst)
+      : PS_CLOBBER_0_13, "memory");
+#else
+   WUTMtx44MultVecScalar(m, src, dst);
+#endif
+}
+
+void
+WUTQuatMultiplyScalar(const WUTQuat *p, const WUTQuat *q, WUTQuat *pq)
+{
+   WUTQuat result;
+   result.x = p->w * q->x + p->x * q->w + p->y * q->z - p->z * q->y;
+   result.y = p->w * q->y - p->x * q->z + p->y * q->w + p->z * q->x;
+   result.z = p->w * q->z + p->x * q->y - p->y * q->x + p->z * q->w;
+   result.w = p->w * q->w - p->x * q->x - p->y * q->y - p->z * q->z;
+   *pq = result;
+}
+
+void
+WUTQuatMultiply(const WUTQuat *p, const WUTQuat *q, WUTQuat *pq)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[p]), 0, 0\n"       // px py
+      "psq_l 1, 8(%[p]), 0, 0\n"       // pz pw
+      "psq_l 2, 0(%[q]), 0, 0\n"       // qx qy
+      "psq_l 3, 8(%[q]), 0, 0\n"       // qz qw
+      "ps_merge10 4, 0, 0\n"           // py px
+      "ps_merge10 5, 2, 2\n"           // qy qx
+      "ps_merge10 6, 3, 3\n"           // qw qz
+      // x y = pw*(qx qy) + qw*(px py) + (py*qz - pz*qy, -(px*qz - pz*qx))
+      "ps_muls1 7, 2, 1\n"
+      "ps_madds1 7, 0, 3, 7\n"
+      "ps_muls0 8, 4, 3\n"             // py*qz px*qz
+      "ps_muls0 9, 5, 1\n"             // pz*qy pz*qx
+      "ps_sub 8, 8, 9\n"
+      "ps_neg 9, 8\n"
+      "ps_merge01 8, 8, 9\n"
+      "ps_add 7, 7, 8\n"
+      // z w = pw*(qz qw) + (pz*qw, -pz*qz) + (px*qy - py*qx, -(px*qx + py*qy))
+      "ps_muls1 10, 3, 1\n"
+      "ps_muls0 11, 6, 1\n"            // pz*qw pz*qz
+      "ps_neg 12, 11\n"
+      "ps_merge01 11, 11, 12\n"
+      "ps_add 10, 10, 11\n"
+      "ps_mul 11, 0, 5\n"              // px*qy py*qx
+      "ps_mul 12, 0, 2\n"              // px*qx py*qy
+      "ps_neg 13, 11\n"
+      "ps_sum0 11, 11, 11, 13\n"       // px*qy - py*qx
+      "ps_sum1 11, 12, 11, 12\n"       // px*qx + py*qy
+      "ps_neg 12, 11\n"
+      "ps_merge01 11, 11, 12\n"
+      "ps_add 10, 10, 11\n"
+      "psq_st 7, 0(%[pq]), 0, 0\n"
+      "psq_st 10, 8(%[pq]), 0, 0\n"
+      :
+      : [p] "b" (p), [q] "b" (q), [pq] "b" (pq)
+      : PS_CLOBBER_0_13, "memory");
+#else
+   WUTQuatMultiplyScalar(p, q, pq);
+#endif
+}
+
+void
+WUTQuatNormalizeScalar(const WUTQuat *src, WUTQuat *dst)
+{
+   WUTVec4ScaleScalar((const WUTVec4 *)src, (WUTVec4 *)dst,
+                      1.0f / sqrtf(WUTVec4DotScalar((const WUTVec4 *)src, (const WUTVec4 *)src)));
+}
+
+void
+WUTQuatNormalize(const WUTQuat *src, WUTQuat *dst)
+{
+#ifdef ESPRESSO
+   __asm__ volatile (
+      "psq_l 0, 0(%[src]), 0, 0\n"
+      "psq_l 1, 8(%[src]), 0, 0\n"
+      "ps_mul 2, 0, 0\n"
+      "ps_madd 2, 1, 1, 2\n"
+      "ps_sum0 3, 2, 2, 2\n"
+      "frsqrte 4, 3\n"
+      "fmuls 5, 4, 4\n"
+      "fmuls 6, 4, %[half]\n"
+      "fnmsubs 5, 5, 3, %[three]\n"
+      "fmuls 4, 5, 6\n"
+      "ps_muls0 0, 0, 4\n"
+      "ps_muls0 1, 1, 4\n"
+      "psq_st 0, 0(%[dst]), 0, 0\n"
+      "psq_st 1, 8(%[dst]), 0, 0\n"
+      :
+      : [src] "b" (src), [dst] "b" (dst), [half] "f" (0.5f), [three] "f" (3.0f)
+      : PS_CLOBBER_0_7, "memory");
+#else
+   WUTQuatNormalizeScalar(src, dst);
+#endif
+}
+
+void
+WUTQuatToMtx34(const WUTQuat *q, WUTMtx34 m)
+{
+   float xx = q->x * q->x, yy = q->y * q->y, zz = q->z * q->z;
+   float xy = q->x * q->y, xz = q->x * q->z, yz = q->y * q->z;
+   float wx = q->w * q->x, wy = q->w * q->y, wz = q->w * q->z;
+
+   m[0][0] = 1.0f - 2.0f * (yy + zz);
+   m[0][1] = 2.0f * (xy - wz);
+   m[0][2] = 2.0f * (xz + wy);
+   m[0][3] = 0.0f;
+
+   m[1][0] = 2.0f * (xy + wz);
+   m[1][1] = 1.0f - 2.0f * (xx + zz);
+   m[1][2] = 2.0f * (yz - wx);
+   m[1][3] = 0.0f;
+
+   m[2][0] = 2.0f * (xz - wy);
+   m[2][1] = 2.0f * (yz + wx);
+   m[2][2] = 1.0f - 2.0f * (xx + yy);
+   m[2][3] = 0.0f;
+}
+
+void
+WUTDequantizeScalar(float *dst, const void *src, uint32_t count, WUTQuantType type, uint32_t shift)
+{
+   float scale = 1.0f / (float)(1u << shift);
+
+   for (uint32_t i = 0; i < count; i++) {
+      switch (type) {
+      case WUT_QUANT_TYPE_U8:
+         dst[i] = ((const uint8_t *)src)[i] * scale;
+         break;
+      case WUT_QUANT_TYPE_U16:
+         dst[i] = ((const uint16_t *)src)[i] * scale;
+         break;
+      case WUT_QUANT_TYPE_S8:
+         dst[i] = ((const int8_t *)src)[i] * scale;
+         break;
+      case WUT_QUANT_TYPE_S16:
+         dst[i] = ((const int16_t *)src)[i] * scale;
+         break;
+      }
+   }
+}
+
+void
+WUTDequantize(float *dst, const void *src, uint32_t count, WUTQuantType type, uint32_t shift)
+{
+#ifdef ESPRESSO
+   uint32_t elementSize = (type == WUT_QUANT_TYPE_U16 || type == WUT_QUANT_TYPE_S16) ? 2 : 1;
+   uint32_t pairs = count / 2;
+   uint32_t gqr = ((shift & 0x3F) << 24) | ((uint32_t)type << 16);
+   uint32_t savedGqr;
+
+   __asm__ volatile ("mfspr %0, %1" : "=r" (savedGqr) : "i" (PS_UGQR6));
+   __asm__ volatile ("mtspr %0, %1" : : "i" (PS_UGQR6), "r" (gqr));
+
+   if (pairs) {
+      __asm__ volatile (
+         "mtctr %[pairs]\n"
+         "1:\n"
+         "psq_l 0, 0(%[src]), 0, 6\n"
+         "add %[src], %[src], %[stride]\n"
+         "psq_st 0, 0(%[dst]), 0, 0\n"
+         "addi %[dst], %[dst], 8\n"
+         "bdnz 1b\n"
+         : [src] "+b" (src), [dst] "+b" (dst)
+         : [pairs] "r" (pairs), [stride] "r" (elementSize * 2)
+         : "fr0", "ctr", "memory");
+   }
+
+   if (count & 1) {
+      __asm__ volatile (
+         "psq_l 0, 0(%[src]), 1, 6\n"
+         "psq_st 0, 0(%[dst]), 1, 0\n"
+         :
+         : [src] "b" (src), [dst] "b" (dst)
+         : "fr0", "memory");
+   }
+
+   __asm__ volatile ("mtspr %0, %1" : : "i" (PS_UGQR6), "r" (savedGqr));
+#else
+   WUTDequantizeScalar(dst, src, count, type, shift);
+#endif
+}
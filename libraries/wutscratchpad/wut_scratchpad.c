@@ -0,0 +1,99 @@
+#include <coreinit/cache.h>
+#include <coreinit/debug.h>
+#include <coreinit/lockedcache.h>
+#include <string.h>
+#include <wut_scratchpad.h>
+
+#define SCRATCHPAD_CHUNK_SIZE (LC_DMA_MAX_BLOCKS * LC_DMA_BLOCK_SIZE)
+
+BOOL
+WUTScratchpadInit(WUTScratchpad *pad,
+                  uint32_t size)
+{
+   memset(pad, 0, sizeof(WUTScratchpad));
+
+   if (!LCHardwareIsAvailable()) {
+      return FALSE;
+   }
+
+   size = (size + 511) & ~511;
+   if (!size) {
+      return FALSE;
+   }
+
+   if (!LCEnableDMA()) {
+      WUT_DEBUG_REPORT("WUTScratchpadInit: LCEnableDMA failed\n");
+      return FALSE;
+   }
+
+   pad->base = LCAlloc(size);
+   if (!pad->base) {
+      WUT_DEBUG_REPORT("WUTScratchpadInit: LCAlloc(0x%X) failed, 0x%X allocatable\n",
+                       size, LCGetAllocatableSize());
+      LCDisableDMA();
+      return FALSE;
+   }
+
+   pad->size = size;
+   return TRUE;
+}
+
+void
+WUTScratchpadShutdown(WUTScratchpad *pad)
+{
+   if (!pad->base) {
+      return;
+   }
+
+   LCWaitDMAQueue(0);
+   LCDealloc(pad->base);
+   LCDisableDMA();
+   memset(pad, 0, sizeof(WUTScratchpad));
+}
+
+//! Keep one slot free so a transfer never has to be dropped
+static inline void
+__wut_scratchpad_wait_for_slot()
+{
+   if (LCGetDMAQueueLength() >= LC_DMA_QUEUE_LENGTH - 1) {
+      LCWaitDMAQueue(LC_DMA_QUEUE_LENGTH - 2);
+   }
+}
+
+void
+WUTScratchpadLoad(void *lcDst,
+                  const void *src,
+                  uint32_t size)
+{
+   // The DMA reads memory, not the cache
+   DCFlushRange((void *)src, size);
+
+   for (uint32_t offset = 0; offset < size; offset += SCRATCHPAD_CHUNK_SIZE) {
+      uint32_t chunk = size - offset < SCRATCHPAD_CHUNK_SIZE ? size - offset : SCRATCHPAD_CHUNK_SIZE;
+      __wut_scratchpad_wait_for_slot();
+      LCLoadDMABlocks((uint8_t *)lcDst + offset, (const uint8_t *)src + offset,
+                      chunk / LC_DMA_BLOCK_SIZE);
+   }
+}
+
+void
+WUTScratchpadStore(void *dst,
+                   const void *lcSrc,
+                   uint32_t size)
+{
+   // Stale lines of the destination must not be written back over the data
+   DCInvalidateRange(dst, size);
+
+   for (uint32_t offset = 0; offset < size; offset += SCRATCHPAD_CHUNK_SIZE) {
+      uint32_t chunk = size - offset < SCRATCHPAD_CHUNK_SIZE ? size - offset : SCRATCHPAD_CHUNK_SIZE;
+      __wut_scratchpad_wait_for_slot();
+      LCStoreDMABlocks((uint8_t *)dst + offset, (const uint8_t *)lcSrc + offset,
+                       chunk / LC_DMA_BLOCK_SIZE);
+   }
+}
+
+void
+WUTScratchpadWait(uint32_t pending)
+{
+   LCWaitDMAQueue(pending);
+}
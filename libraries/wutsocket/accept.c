@@ -20,13 +20,16 @@ accept(int sockfd,
       return -1;
    }
 
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(accept)(sockfd, address, addrlen);
+   __wut_socket_trace_end("socket accept", NULL, sockfd, rc, traceStart);
    if (rc == -1) {
       __release_handle(fd);
       return __wut_get_nsysnet_result(NULL, rc);
    }
    
-   *(int *)__get_handle(fd)->fileStruct = rc;
+   __wut_socket_stats_reset_socket(rc);
+   __wut_socket_file_init(fd, rc);
    return fd;
 }
 
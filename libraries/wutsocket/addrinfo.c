@@ -1,6 +1,79 @@
 #include "wut_socket.h"
 #include <nsysnet/_netdb.h>
 #include <netdb.h>
+#include <stdlib.h>
+#include <wut_dns.h>
+
+// Marks an addrinfo list built from the DNS cache, nsysnet never sets it
+#define WUT_AI_CACHED 0x80000000
+
+static int
+__wut_addrinfo_is_cacheable(const char *node,
+                            const char *service,
+                            const struct addrinfo *hints)
+{
+   struct in_addr addr;
+   const char *p;
+
+   if (!node || RPLWRAP(inet_pton)(AF_INET, node, &addr) == 1) {
+      return 0;
+   }
+
+   if (hints && (hints->ai_flags || (hints->ai_family != AF_UNSPEC && hints->ai_family != AF_INET))) {
+      return 0;
+   }
+
+   // Only numeric ports, service names are left to nsysnet
+   for (p = service; p && *p; p++) {
+      if (*p < '0' || *p > '9') {
+         return 0;
+      }
+   }
+
+   return 1;
+}
+
+static struct addrinfo *
+__wut_addrinfo_from_cache(const char *service,
+                          const struct addrinfo *hints,
+                          const struct in_addr *addresses,
+                          uint32_t count)
+{
+   static const int socktypes[] = { SOCK_STREAM, SOCK_DGRAM };
+   uint32_t i, j, numTypes, n = 0;
+   struct addrinfo *ai;
+   struct sockaddr_in *sa;
+   uint16_t port = service ? htons(atoi(service)) : 0;
+
+   numTypes = (hints && hints->ai_socktype) ? 1 : 2;
+
+   ai = (struct addrinfo *)calloc(count * numTypes, sizeof(struct addrinfo) + sizeof(struct sockaddr_in));
+   if (!ai) {
+      return NULL;
+   }
+
+   sa = (struct sockaddr_in *)(ai + count * numTypes);
+   for (i = 0; i < count; i++) {
+      for (j = 0; j < numTypes; j++, n++) {
+         int socktype = (numTypes == 1) ? hints->ai_socktype : socktypes[j];
+
+         sa[n].sin_family = AF_INET;
+         sa[n].sin_port = port;
+         sa[n].sin_addr = addresses[i];
+
+         ai[n].ai_flags = WUT_AI_CACHED;
+         ai[n].ai_family = AF_INET;
+         ai[n].ai_socktype = socktype;
+         ai[n].ai_protocol = (hints && hints->ai_protocol) ? hints->ai_protocol :
+                             (socktype == SOCK_DGRAM) ? IPPROTO_UDP : IPPROTO_TCP;
+         ai[n].ai_addrlen = sizeof(struct sockaddr_in);
+         ai[n].ai_addr = (struct sockaddr *)&sa[n];
+         ai[n].ai_next = (n + 1 < count * numTypes) ? &ai[n + 1] : NULL;
+      }
+   }
+
+   return ai;
+}
 
 int
 getaddrinfo(const char *node,
@@ -8,7 +81,11 @@ getaddrinfo(const char *node,
             const struct addrinfo *hints,
             struct addrinfo **res)
 {
-   int rc;
+   struct in_addr addresses[WUT_DNS_MAX_ADDRESSES];
+   uint32_t count;
+   int rc, cacheable;
+
+   __wut_socket_ensure_init();
 
    if (!node && !service) {
       return EAI_NONAME;
@@ -19,7 +96,23 @@ getaddrinfo(const char *node,
       return EAI_SYSTEM;
    }
 
+   cacheable = __wut_addrinfo_is_cacheable(node, service, hints);
+   if (cacheable) {
+      count = __wut_dns_cache_lookup(node, addresses);
+      if (count) {
+         *res = __wut_addrinfo_from_cache(service, hints, addresses, count);
+         return *res ? 0 : EAI_MEMORY;
+      }
+   }
+
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(getaddrinfo)(node, service, hints, res);
+   __wut_socket_trace_end("socket getaddrinfo", node, -1, rc, traceStart);
+
+   if (rc == 0 && cacheable) {
+      count = __wut_dns_addrinfo_addresses(*res, addresses);
+      __wut_dns_cache_insert(node, addresses, count);
+   }
 
    return rc;
 }
@@ -27,6 +120,12 @@ getaddrinfo(const char *node,
 void
 freeaddrinfo(struct addrinfo *res)
 {
+   if (res && (res->ai_flags & WUT_AI_CACHED)) {
+      // Built by __wut_addrinfo_from_cache as a single allocation
+      free(res);
+      return;
+   }
+
    RPLWRAP(freeaddrinfo)(res);
 }
 
@@ -41,7 +140,11 @@ getnameinfo(const struct sockaddr *addr,
 {
    int rc;
    
+   __wut_socket_ensure_init();
+
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(getnameinfo)(addr, addrlen, host, hostlen, serv, servlen, flags);
+   __wut_socket_trace_end("socket getnameinfo", host, -1, rc, traceStart);
 
    return rc;
 }
@@ -9,7 +9,9 @@ int connect(int sockfd,
    if (sockfd == -1) {
       return -1;
    }
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(connect)(sockfd, addr, addrlen);
+   __wut_socket_trace_end("socket connect", NULL, sockfd, rc, traceStart);
    return __wut_get_nsysnet_result(NULL, rc);
 }
 
@@ -1,12 +1,15 @@
 #include "wut_socket.h"
 #include <netdb.h>
 #include <nsysnet/_netdb.h>
+#include <wut_dns.h>
 
 struct hostent *
 gethostbyaddr(const void *addr,
               socklen_t len,
               int type)
 {
+   __wut_socket_ensure_init();
+
    if (!addr || !len) {
       h_errno = HOST_NOT_FOUND;
       return NULL;
@@ -27,14 +30,50 @@ gethostbyaddr(const void *addr,
 struct hostent *
 gethostbyname(const char *name)
 {
+   __wut_socket_ensure_init();
+
    if (!name) {
       h_errno = HOST_NOT_FOUND;
       return NULL;
    }
 
+   // Like nsysnet's, the cached result is shared by all threads
+   static struct in_addr addresses[WUT_DNS_MAX_ADDRESSES];
+   static char *addrList[WUT_DNS_MAX_ADDRESSES + 1];
+   static char *aliases[1];
+   static char hostName[256];
+   static struct hostent cached;
+
+   struct in_addr found[WUT_DNS_MAX_ADDRESSES];
+   uint32_t i, count = __wut_dns_cache_lookup(name, found);
+   if (count) {
+      for (i = 0; i < count; i++) {
+         addresses[i] = found[i];
+         addrList[i] = (char *)&addresses[i];
+      }
+      addrList[count] = NULL;
+      aliases[0] = NULL;
+      strncpy(hostName, name, sizeof(hostName) - 1);
+
+      cached.h_name = hostName;
+      cached.h_aliases = aliases;
+      cached.h_addrtype = AF_INET;
+      cached.h_length = sizeof(struct in_addr);
+      cached.h_addr_list = addrList;
+      h_errno = NETDB_SUCCESS;
+      return &cached;
+   }
+
    struct hostent *ent = RPLWRAP(gethostbyname)(name);
 
    h_errno = *RPLWRAP(get_h_errno)();
 
+   if (ent && ent->h_addrtype == AF_INET && ent->h_length == sizeof(struct in_addr)) {
+      for (count = 0; ent->h_addr_list[count] && count < WUT_DNS_MAX_ADDRESSES; count++) {
+         memcpy(&found[count], ent->h_addr_list[count], sizeof(struct in_addr));
+      }
+      __wut_dns_cache_insert(name, found, count);
+   }
+
    return ent;
 }
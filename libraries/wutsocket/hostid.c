@@ -6,6 +6,10 @@ long
 gethostid(void)
 {
    uint32_t ip = UINT32_MAX;
+
+   // ACInitialize has to have been called first
+   __wut_socket_ensure_init();
+
    ACGetAssignedAddress(&ip);
    return (long)ip;
 }
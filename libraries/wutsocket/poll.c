@@ -1,5 +1,23 @@
 #include "wut_socket.h"
 
+static void
+__wut_poll_set_revents(struct pollfd *fd,
+                       int cnv_fd,
+                       nsysnet_fd_set *cnv_rd,
+                       nsysnet_fd_set *cnv_wr,
+                       nsysnet_fd_set *cnv_ex)
+{
+   if (NSYSNET_FD_ISSET(cnv_fd, cnv_rd)) {
+      fd->revents |= POLLIN;
+   }
+   if (NSYSNET_FD_ISSET(cnv_fd, cnv_wr)) {
+      fd->revents |= POLLOUT;
+   }
+   if (NSYSNET_FD_ISSET(cnv_fd, cnv_ex)) {
+      fd->revents |= POLLPRI;
+   }
+}
+
 int
 poll(struct pollfd *fds,
      nfds_t nfds,
@@ -8,6 +26,9 @@ poll(struct pollfd *fds,
    int cnv_nfds = 0, rc, i;
    nsysnet_fd_set cnv_rd, cnv_wr, cnv_ex;
    struct nsysnet_timeval cnv_timeout;
+   int cnv_to_index[NSYSNET_FD_SETSIZE];
+   uint32_t used = 0;
+   int duplicates = 0;
 
    if (!fds) {
       errno = EINVAL;
@@ -18,9 +39,13 @@ poll(struct pollfd *fds,
    NSYSNET_FD_ZERO(&cnv_wr);
    NSYSNET_FD_ZERO(&cnv_ex);
 
+   // Any number of fds can be polled, as nsysnet has fewer than
+   // NSYSNET_FD_SETSIZE sockets they always fit in a single select
    for (i = 0; i < nfds; i++) {
       int cnv_fd;
 
+      fds[i].revents = 0;
+
       if (fds[i].fd < 0) {
          continue;
       }
@@ -29,6 +54,17 @@ poll(struct pollfd *fds,
       if (cnv_fd == -1) {
          return -1;
       }
+      if (cnv_fd >= NSYSNET_FD_SETSIZE) {
+         errno = EINVAL;
+         return -1;
+      }
+
+      // Remember the mapping so the results don't need another lookup
+      if (used & (1u << cnv_fd)) {
+         duplicates = 1;
+      }
+      used |= 1u << cnv_fd;
+      cnv_to_index[cnv_fd] = i;
 
       if ((cnv_fd + 1) > cnv_nfds) {
          cnv_nfds = cnv_fd + 1;
@@ -50,36 +86,47 @@ poll(struct pollfd *fds,
       cnv_timeout.tv_usec = (timeout % 1000) * 1000;
    }
 
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(select)(cnv_nfds, &cnv_rd, &cnv_wr, &cnv_ex,
                         (timeout >= 0) ? &cnv_timeout : NULL);
+   __wut_socket_trace_end("socket poll", NULL, -1, rc, traceStart);
 
    rc = __wut_get_nsysnet_result(NULL, rc);
    if (rc == -1) {
       return rc;
    }
 
-   for (i = 0; i < nfds; i++) {
-      int cnv_fd;
+   rc = 0;
 
-      fds[i].revents = 0;
+   if (duplicates) {
+      // The same fd is in the array more than once, look every entry up again
+      for (i = 0; i < nfds; i++) {
+         int cnv_fd;
 
-      if (fds[i].fd < 0) {
-         continue;
-      }
+         if (fds[i].fd < 0) {
+            continue;
+         }
 
-      cnv_fd = __wut_get_nsysnet_fd(fds[i].fd);
-      if (cnv_fd == -1) {
-         continue;
-      }
+         // The fd may have been closed by another thread while we waited
+         cnv_fd = __wut_get_nsysnet_fd(fds[i].fd);
+         if (cnv_fd < 0 || cnv_fd >= NSYSNET_FD_SETSIZE) {
+            continue;
+         }
 
-      if (NSYSNET_FD_ISSET(cnv_fd, &cnv_rd)) {
-         fds[i].revents |= POLLIN;
-      }
-      if (NSYSNET_FD_ISSET(cnv_fd, &cnv_wr)) {
-         fds[i].revents |= POLLOUT;
+         __wut_poll_set_revents(&fds[i], cnv_fd, &cnv_rd, &cnv_wr, &cnv_ex);
+         if (fds[i].revents) {
+            rc++;
+         }
       }
-      if (NSYSNET_FD_ISSET(cnv_fd, &cnv_ex)) {
-         fds[i].revents |= POLLPRI;
+   } else {
+      // Only walk the fds that came back ready
+      uint32_t bits = cnv_rd.fds_bits | cnv_wr.fds_bits | cnv_ex.fds_bits;
+      while (bits) {
+         int cnv_fd = __builtin_ctz(bits);
+         bits &= bits - 1;
+
+         __wut_poll_set_revents(&fds[cnv_to_index[cnv_fd]], cnv_fd, &cnv_rd, &cnv_wr, &cnv_ex);
+         rc++;
       }
    }
 
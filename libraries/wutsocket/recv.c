@@ -11,7 +11,12 @@ recv(int sockfd,
    if (sockfd == -1) {
       return -1;
    }
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(recv)(sockfd, buf, len, flags);
+   __wut_socket_trace_end("socket recv", NULL, sockfd, rc, traceStart);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 0, rc);
+   }
    return (ssize_t)__wut_get_nsysnet_result(NULL, rc);
 }
 
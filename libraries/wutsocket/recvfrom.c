@@ -13,7 +13,12 @@ recvfrom(int sockfd,
    if (sockfd == -1) {
       return -1;
    }
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(recvfrom)(sockfd, buf, len, flags, src_addr, addrlen);
+   __wut_socket_trace_end("socket recvfrom", NULL, sockfd, rc, traceStart);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 0, rc);
+   }
    return (ssize_t)__wut_get_nsysnet_result(NULL, rc);
 }
 
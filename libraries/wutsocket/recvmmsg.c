@@ -0,0 +1,145 @@
+#include "wut_socket.h"
+#include <stdlib.h>
+#include <time.h>
+
+// Receives one datagram on an nsysnet fd, scattering it through buf if the
+// message has more than one iovec
+static int
+__wut_recvmmsg_one(int sockfd,
+                   struct msghdr *msg,
+                   int flags,
+                   char **buf,
+                   size_t *bufSize)
+{
+   size_t len = 0, left;
+   char *ptr;
+   int rc, i;
+
+   msg->msg_controllen = 0;
+   msg->msg_flags = 0;
+
+   if (msg->msg_iovlen <= 1) {
+      rc = RPLWRAP(recvfrom)(sockfd,
+                             msg->msg_iovlen ? msg->msg_iov[0].iov_base : NULL,
+                             msg->msg_iovlen ? msg->msg_iov[0].iov_len : 0,
+                             flags,
+                             (struct sockaddr *)msg->msg_name,
+                             msg->msg_name ? &msg->msg_namelen : NULL);
+      if (__wut_socket_stats_enabled) {
+         __wut_socket_stats_add(sockfd, 0, rc);
+      }
+      return rc;
+   }
+
+   for (i = 0; i < msg->msg_iovlen; i++) {
+      len += msg->msg_iov[i].iov_len;
+   }
+
+   // The buffer is kept for the rest of the batch
+   if (len > *bufSize) {
+      WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_SOCKET, *buf);
+      *buf = (char *)WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_SOCKET, len, 8);
+      *bufSize = *buf ? len : 0;
+      if (!*buf) {
+         return -2;
+      }
+   }
+
+   rc = RPLWRAP(recvfrom)(sockfd, *buf, len, flags,
+                          (struct sockaddr *)msg->msg_name,
+                          msg->msg_name ? &msg->msg_namelen : NULL);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 0, rc);
+   }
+
+   for (i = 0, ptr = *buf, left = (rc > 0) ? rc : 0; i < msg->msg_iovlen && left; i++) {
+      size_t size = msg->msg_iov[i].iov_len < left ? msg->msg_iov[i].iov_len : left;
+      memcpy(msg->msg_iov[i].iov_base, ptr, size);
+      ptr += size;
+      left -= size;
+   }
+
+   return rc;
+}
+
+int
+recvmmsg(int sockfd,
+         struct mmsghdr *msgvec,
+         unsigned int vlen,
+         int flags,
+         struct timespec *timeout)
+{
+   char *buf = NULL;
+   size_t bufSize = 0;
+   unsigned int count = 0;
+   int rc = 0, bytes = 0;
+
+   if (!msgvec || !vlen) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   for (count = 0; count < vlen; count++) {
+      struct msghdr *msg = &msgvec[count].msg_hdr;
+      if (msg->msg_iovlen < 0 || (msg->msg_iovlen && !msg->msg_iov)) {
+         errno = EINVAL;
+         return -1;
+      }
+   }
+
+   sockfd = __wut_get_nsysnet_fd(sockfd);
+   if (sockfd == -1) {
+      return -1;
+   }
+
+   flags &= ~MSG_WAITFORONE;
+   OSTime traceStart = __wut_socket_trace_begin();
+
+   if (timeout && !(flags & MSG_DONTWAIT)) {
+      nsysnet_fd_set rd;
+      struct nsysnet_timeval cnv_timeout;
+
+      NSYSNET_FD_ZERO(&rd);
+      NSYSNET_FD_SET(sockfd, &rd);
+      cnv_timeout.tv_sec = timeout->tv_sec;
+      cnv_timeout.tv_usec = timeout->tv_nsec / 1000;
+
+      rc = RPLWRAP(select)(sockfd + 1, &rd, NULL, NULL, &cnv_timeout);
+      if (rc == 0) {
+         __wut_socket_trace_end("socket recvmmsg", NULL, sockfd, 0, traceStart);
+         errno = EAGAIN;
+         return -1;
+      } else if (rc < 0) {
+         __wut_socket_trace_end("socket recvmmsg", NULL, sockfd, rc, traceStart);
+         return __wut_get_nsysnet_result(NULL, rc);
+      }
+   }
+
+   // Wait for the first datagram only, then drain what is already queued
+   for (count = 0; count < vlen; count++) {
+      rc = __wut_recvmmsg_one(sockfd, &msgvec[count].msg_hdr,
+                              count ? (flags | MSG_DONTWAIT) : flags,
+                              &buf, &bufSize);
+      if (rc < 0) {
+         break;
+      }
+
+      msgvec[count].msg_len = (unsigned int)rc;
+      bytes += rc;
+   }
+
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_SOCKET, buf);
+   __wut_socket_trace_end("socket recvmmsg", NULL, sockfd, count ? bytes : rc, traceStart);
+
+   // Like Linux, an error after the first datagram is left for the next call
+   if (count) {
+      return (int)count;
+   }
+
+   if (rc == -2) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   return __wut_get_nsysnet_result(NULL, rc);
+}
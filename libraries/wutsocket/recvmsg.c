@@ -0,0 +1,73 @@
+#include "wut_socket.h"
+#include <stdlib.h>
+
+ssize_t
+recvmsg(int sockfd,
+        struct msghdr *msg,
+        int flags)
+{
+   int rc, i;
+   size_t len = 0, left;
+   char *buf, *ptr;
+
+   if (!msg || msg->msg_iovlen < 0 || (msg->msg_iovlen && !msg->msg_iov)) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   sockfd = __wut_get_nsysnet_fd(sockfd);
+   if (sockfd == -1) {
+      return -1;
+   }
+
+   // Control messages are not supported
+   msg->msg_controllen = 0;
+   msg->msg_flags = 0;
+
+   // nsysnet has no recvmsg, a single buffer can be received into directly
+   if (msg->msg_iovlen <= 1) {
+      buf = msg->msg_iovlen ? (char *)msg->msg_iov[0].iov_base : NULL;
+      len = msg->msg_iovlen ? msg->msg_iov[0].iov_len : 0;
+      OSTime traceStart = __wut_socket_trace_begin();
+      rc = RPLWRAP(recvfrom)(sockfd, buf, len, flags,
+                             (struct sockaddr *)msg->msg_name,
+                             msg->msg_name ? &msg->msg_namelen : NULL);
+      __wut_socket_trace_end("socket recvmsg", NULL, sockfd, rc, traceStart);
+      if (__wut_socket_stats_enabled) {
+         __wut_socket_stats_add(sockfd, 0, rc);
+      }
+      return (ssize_t)__wut_get_nsysnet_result(NULL, rc);
+   }
+
+   // Otherwise receive into one buffer and scatter, so a datagram isn't
+   // split over several calls
+   for (i = 0; i < msg->msg_iovlen; i++) {
+      len += msg->msg_iov[i].iov_len;
+   }
+
+   buf = (char *)WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_SOCKET, len, 8);
+   if (!buf) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   OSTime traceStart = __wut_socket_trace_begin();
+   rc = RPLWRAP(recvfrom)(sockfd, buf, len, flags,
+                          (struct sockaddr *)msg->msg_name,
+                          msg->msg_name ? &msg->msg_namelen : NULL);
+   __wut_socket_trace_end("socket recvmsg", NULL, sockfd, rc, traceStart);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 0, rc);
+   }
+   rc = __wut_get_nsysnet_result(NULL, rc);
+
+   for (i = 0, ptr = buf, left = (rc > 0) ? rc : 0; i < msg->msg_iovlen && left; i++) {
+      size_t size = msg->msg_iov[i].iov_len < left ? msg->msg_iov[i].iov_len : left;
+      memcpy(msg->msg_iov[i].iov_base, ptr, size);
+      ptr += size;
+      left -= size;
+   }
+
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_SOCKET, buf);
+   return (ssize_t)rc;
+}
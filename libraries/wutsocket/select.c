@@ -1,5 +1,40 @@
 #include "wut_socket.h"
 
+// fd sets are accessed as arrays of 32 bit words, so callers may pass sets
+// bigger than FD_SETSIZE as long as they hold nfds bits
+#define SELECT_WORDS(nfds)  (((nfds) + 31) / 32)
+
+static inline uint32_t
+__wut_select_word(const fd_set *set,
+                  int word)
+{
+   return set ? ((const uint32_t *)set)[word] : 0;
+}
+
+static int
+__wut_select_scatter(nsysnet_fd_set *cnv_set,
+                     const int *cnv_to_fd,
+                     fd_set *set,
+                     int words)
+{
+   uint32_t bits = cnv_set->fds_bits;
+   uint32_t *out = (uint32_t *)set;
+   int count = 0;
+
+   memset(out, 0, words * sizeof(uint32_t));
+
+   while (bits) {
+      int cnv_fd = __builtin_ctz(bits);
+      int fd = cnv_to_fd[cnv_fd];
+      bits &= bits - 1;
+
+      out[fd / 32] |= 1u << (fd % 32);
+      count++;
+   }
+
+   return count;
+}
+
 int
 select(int nfds,
        fd_set *readfds,
@@ -7,11 +42,12 @@ select(int nfds,
        fd_set *exceptfds,
        struct timeval *timeout)
 {
-   int cnv_nfds = 0, rc, i;
+   int cnv_nfds = 0, rc, word, words;
    nsysnet_fd_set cnv_rd, cnv_wr, cnv_ex;
    struct nsysnet_timeval cnv_timeout;
+   int cnv_to_fd[NSYSNET_FD_SETSIZE];
 
-   if (nfds > FD_SETSIZE) {
+   if (nfds < 0) {
       errno = EINVAL;
       return -1;
    }
@@ -20,34 +56,49 @@ select(int nfds,
    NSYSNET_FD_ZERO(&cnv_wr);
    NSYSNET_FD_ZERO(&cnv_ex);
 
-   for (i = 0; i < nfds; i++) {
-      int rd_fd, wr_fd, ex_fd, cnv_fd;
-
-      rd_fd = readfds && FD_ISSET(i, readfds);
-      wr_fd = writefds && FD_ISSET(i, writefds);
-      ex_fd = exceptfds && FD_ISSET(i, exceptfds);
+   // Only the words covering nfds are read, and empty ones are skipped
+   words = SELECT_WORDS(nfds);
+   for (word = 0; word < words; word++) {
+      uint32_t rd = __wut_select_word(readfds, word);
+      uint32_t wr = __wut_select_word(writefds, word);
+      uint32_t ex = __wut_select_word(exceptfds, word);
+      uint32_t bits = rd | wr | ex;
 
-      if (!rd_fd && !wr_fd && !ex_fd) {
-         continue;
+      if (word == words - 1 && (nfds % 32)) {
+         bits &= (1u << (nfds % 32)) - 1;
       }
 
-      cnv_fd = __wut_get_nsysnet_fd(i);
-      if (cnv_fd == -1) {
-         return -1;
-      }
-
-      if ((cnv_fd + 1) > cnv_nfds) {
-         cnv_nfds = cnv_fd + 1;
-      }
-
-      if (rd_fd) {
-         NSYSNET_FD_SET(cnv_fd, &cnv_rd);
-      }
-      if (wr_fd) {
-         NSYSNET_FD_SET(cnv_fd, &cnv_wr);
-      }
-      if (ex_fd) {
-         NSYSNET_FD_SET(cnv_fd, &cnv_ex);
+      while (bits) {
+         int bit = __builtin_ctz(bits);
+         int i = word * 32 + bit;
+         int cnv_fd;
+         bits &= bits - 1;
+
+         cnv_fd = __wut_get_nsysnet_fd(i);
+         if (cnv_fd == -1) {
+            return -1;
+         }
+         if (cnv_fd >= NSYSNET_FD_SETSIZE) {
+            errno = EINVAL;
+            return -1;
+         }
+
+         // Remember the mapping so the results don't need another lookup
+         cnv_to_fd[cnv_fd] = i;
+
+         if ((cnv_fd + 1) > cnv_nfds) {
+            cnv_nfds = cnv_fd + 1;
+         }
+
+         if (rd & (1u << bit)) {
+            NSYSNET_FD_SET(cnv_fd, &cnv_rd);
+         }
+         if (wr & (1u << bit)) {
+            NSYSNET_FD_SET(cnv_fd, &cnv_wr);
+         }
+         if (ex & (1u << bit)) {
+            NSYSNET_FD_SET(cnv_fd, &cnv_ex);
+         }
       }
    }
 
@@ -56,11 +107,13 @@ select(int nfds,
       cnv_timeout.tv_usec = timeout->tv_usec;
    }
 
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(select)(cnv_nfds,
                         readfds ? &cnv_rd : NULL,
                         writefds ? &cnv_wr : NULL,
                         exceptfds ? &cnv_ex : NULL,
                         timeout ? &cnv_timeout : NULL);
+   __wut_socket_trace_end("socket select", NULL, -1, rc, traceStart);
 
    rc = __wut_get_nsysnet_result(NULL, rc);
    if (rc == -1) {
@@ -69,34 +122,16 @@ select(int nfds,
 
    rc = 0;
 
+   // Only walk the fds that came back ready, nsysnet only sets bits for fds
+   // we passed in, so cnv_to_fd is valid for all of them
    if (readfds) {
-      FD_ZERO(readfds);
+      rc += __wut_select_scatter(&cnv_rd, cnv_to_fd, readfds, words);
    }
    if (writefds) {
-      FD_ZERO(writefds);
+      rc += __wut_select_scatter(&cnv_wr, cnv_to_fd, writefds, words);
    }
    if (exceptfds) {
-      FD_ZERO(exceptfds);
-   }
-
-   for (i = 0; i < nfds; i++) {
-      int cnv_fd = __wut_get_nsysnet_fd(i);
-      if (cnv_fd == -1) {
-         continue;
-      }
-
-      if (NSYSNET_FD_ISSET(cnv_fd, &cnv_rd)) {
-         FD_SET(i, readfds);
-         rc++;
-      }
-      if (NSYSNET_FD_ISSET(cnv_fd, &cnv_wr)) {
-         FD_SET(i, writefds);
-         rc++;
-      }
-      if (NSYSNET_FD_ISSET(cnv_fd, &cnv_ex)) {
-         FD_SET(i, exceptfds);
-         rc++;
-      }
+      rc += __wut_select_scatter(&cnv_ex, cnv_to_fd, exceptfds, words);
    }
 
    return rc;
@@ -0,0 +1,110 @@
+#include "wut_socket.h"
+#include <stdlib.h>
+
+// Sends one datagram on an nsysnet fd, gathering it into buf if the message
+// has more than one iovec
+static int
+__wut_sendmmsg_one(int sockfd,
+                   const struct msghdr *msg,
+                   int flags,
+                   char **buf,
+                   size_t *bufSize)
+{
+   size_t len = 0;
+   char *ptr;
+   int rc, i;
+
+   if (msg->msg_iovlen <= 1) {
+      rc = RPLWRAP(sendto)(sockfd,
+                           msg->msg_iovlen ? msg->msg_iov[0].iov_base : NULL,
+                           msg->msg_iovlen ? msg->msg_iov[0].iov_len : 0,
+                           flags,
+                           (const struct sockaddr *)msg->msg_name, msg->msg_namelen);
+      if (__wut_socket_stats_enabled) {
+         __wut_socket_stats_add(sockfd, 1, rc);
+      }
+      return rc;
+   }
+
+   for (i = 0; i < msg->msg_iovlen; i++) {
+      len += msg->msg_iov[i].iov_len;
+   }
+
+   // The buffer is kept for the rest of the batch
+   if (len > *bufSize) {
+      WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_SOCKET, *buf);
+      *buf = (char *)WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_SOCKET, len, 8);
+      *bufSize = *buf ? len : 0;
+      if (!*buf) {
+         return -2;
+      }
+   }
+
+   for (i = 0, ptr = *buf; i < msg->msg_iovlen; i++) {
+      memcpy(ptr, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      ptr += msg->msg_iov[i].iov_len;
+   }
+
+   rc = RPLWRAP(sendto)(sockfd, *buf, len, flags,
+                        (const struct sockaddr *)msg->msg_name, msg->msg_namelen);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 1, rc);
+   }
+   return rc;
+}
+
+int
+sendmmsg(int sockfd,
+         struct mmsghdr *msgvec,
+         unsigned int vlen,
+         int flags)
+{
+   char *buf = NULL;
+   size_t bufSize = 0;
+   unsigned int count;
+   int rc = 0, bytes = 0;
+
+   if (!msgvec || !vlen) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   for (count = 0; count < vlen; count++) {
+      const struct msghdr *msg = &msgvec[count].msg_hdr;
+      if (msg->msg_iovlen < 0 || (msg->msg_iovlen && !msg->msg_iov)) {
+         errno = EINVAL;
+         return -1;
+      }
+   }
+
+   sockfd = __wut_get_nsysnet_fd(sockfd);
+   if (sockfd == -1) {
+      return -1;
+   }
+
+   OSTime traceStart = __wut_socket_trace_begin();
+   for (count = 0; count < vlen; count++) {
+      rc = __wut_sendmmsg_one(sockfd, &msgvec[count].msg_hdr, flags, &buf, &bufSize);
+      if (rc < 0) {
+         break;
+      }
+
+      msgvec[count].msg_len = (unsigned int)rc;
+      bytes += rc;
+   }
+
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_SOCKET, buf);
+   __wut_socket_trace_end("socket sendmmsg", NULL, sockfd, count ? bytes : rc, traceStart);
+
+   // Like Linux, an error after the first datagram is left for the next call
+   if (count) {
+      return (int)count;
+   }
+
+   if (rc == -2) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   return __wut_get_nsysnet_result(NULL, rc);
+}
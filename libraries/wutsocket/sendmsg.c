@@ -0,0 +1,63 @@
+#include "wut_socket.h"
+#include <stdlib.h>
+
+ssize_t
+sendmsg(int sockfd,
+        const struct msghdr *msg,
+        int flags)
+{
+   int rc, i;
+   size_t len = 0;
+   char *buf, *ptr;
+
+   if (!msg || msg->msg_iovlen < 0 || (msg->msg_iovlen && !msg->msg_iov)) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   sockfd = __wut_get_nsysnet_fd(sockfd);
+   if (sockfd == -1) {
+      return -1;
+   }
+
+   // nsysnet has no sendmsg, a single buffer can be sent as is
+   if (msg->msg_iovlen <= 1) {
+      buf = msg->msg_iovlen ? (char *)msg->msg_iov[0].iov_base : NULL;
+      len = msg->msg_iovlen ? msg->msg_iov[0].iov_len : 0;
+      OSTime traceStart = __wut_socket_trace_begin();
+      rc = RPLWRAP(sendto)(sockfd, buf, len, flags,
+                           (const struct sockaddr *)msg->msg_name, msg->msg_namelen);
+      __wut_socket_trace_end("socket sendmsg", NULL, sockfd, rc, traceStart);
+      if (__wut_socket_stats_enabled) {
+         __wut_socket_stats_add(sockfd, 1, rc);
+      }
+      return (ssize_t)__wut_get_nsysnet_result(NULL, rc);
+   }
+
+   // Otherwise gather into one buffer so a datagram is still sent whole
+   for (i = 0; i < msg->msg_iovlen; i++) {
+      len += msg->msg_iov[i].iov_len;
+   }
+
+   buf = (char *)WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_SOCKET, len, 8);
+   if (!buf) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   for (i = 0, ptr = buf; i < msg->msg_iovlen; i++) {
+      memcpy(ptr, msg->msg_iov[i].iov_base, msg->msg_iov[i].iov_len);
+      ptr += msg->msg_iov[i].iov_len;
+   }
+
+   OSTime traceStart = __wut_socket_trace_begin();
+   rc = RPLWRAP(sendto)(sockfd, buf, len, flags,
+                        (const struct sockaddr *)msg->msg_name, msg->msg_namelen);
+   __wut_socket_trace_end("socket sendmsg", NULL, sockfd, rc, traceStart);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 1, rc);
+   }
+   rc = __wut_get_nsysnet_result(NULL, rc);
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_SOCKET, buf);
+   return (ssize_t)rc;
+}
@@ -13,7 +13,12 @@ sendto(int sockfd,
    if (sockfd == -1) {
       return -1;
    }
+   OSTime traceStart = __wut_socket_trace_begin();
    rc = RPLWRAP(sendto)(sockfd, buf, len, flags, dest_addr, addrlen);
+   __wut_socket_trace_end("socket sendto", NULL, sockfd, rc, traceStart);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 1, rc);
+   }
    return (ssize_t)__wut_get_nsysnet_result(NULL, rc);
 }
 
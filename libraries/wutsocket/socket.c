@@ -1,11 +1,18 @@
 #include "wut_socket.h"
 
+// Default SO_RCVBUF and SO_SNDBUF of new sockets, 0 keeps the nsysnet default.
+// Can be overridden by the application, e.g. for high throughput transfers.
+uint32_t __attribute__((weak)) __wut_socket_rcvbuf_size = 0;
+uint32_t __attribute__((weak)) __wut_socket_sndbuf_size = 0;
+
 int
 socket(int domain,
        int type,
        int protocol)
 {
-   int rc, fd, dev;
+   int rc, fd, dev, size;
+
+   __wut_socket_ensure_init();
 
    dev = FindDevice("soc:");
    if (dev == -1) {
@@ -23,7 +30,17 @@ socket(int domain,
       return __wut_get_nsysnet_result(NULL, rc);
    }
 
-   *(int *)__get_handle(fd)->fileStruct = rc;
+   // Failing to resize the buffers isn't fatal, the socket still works
+   if (__wut_socket_rcvbuf_size) {
+      size = (int)__wut_socket_rcvbuf_size;
+      RPLWRAP(setsockopt)(rc, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+   }
+   if (__wut_socket_sndbuf_size) {
+      size = (int)__wut_socket_sndbuf_size;
+      RPLWRAP(setsockopt)(rc, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+   }
+
+   __wut_socket_stats_reset_socket(rc);
+   __wut_socket_file_init(fd, rc);
    return fd;
 }
-
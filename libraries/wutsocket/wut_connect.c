@@ -0,0 +1,295 @@
+#include "wut_socket.h"
+#include <wut_connect.h>
+#include <unistd.h>
+
+typedef struct
+{
+   int fd;
+   int flags;
+} __wut_connect_attempt_t;
+
+// Returns 0 if connected, 1 if the connect is in progress or -1 on error
+static int
+__wut_connect_start(int fd,
+                    const struct sockaddr *addr,
+                    socklen_t len,
+                    int *outFlags)
+{
+   int flags = fcntl(fd, F_GETFL);
+   if (flags == -1) {
+      return -1;
+   }
+
+   *outFlags = flags;
+   if (fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+      return -1;
+   }
+
+   if (connect(fd, addr, len) == 0) {
+      return 0;
+   }
+
+   if (errno == EINPROGRESS || errno == EALREADY || errno == EWOULDBLOCK) {
+      return 1;
+   }
+
+   return -1;
+}
+
+// Called once select reports the socket writable
+static int
+__wut_connect_result(int fd)
+{
+   int error = 0;
+   socklen_t len = sizeof(error);
+
+   if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == -1) {
+      return -1;
+   }
+
+   if (error) {
+      errno = __wut_nsysnet_error_to_errno(error);
+      return -1;
+   }
+
+   return 0;
+}
+
+static void
+__wut_connect_restore(int fd,
+                      int flags)
+{
+   int error = errno;
+   fcntl(fd, F_SETFL, flags);
+   errno = error;
+}
+
+// Milliseconds until deadline, rounded up, or -1 for no deadline
+static int
+__wut_connect_remaining(OSTime deadline)
+{
+   OSTime now;
+
+   if (!deadline) {
+      return -1;
+   }
+
+   now = OSGetSystemTime();
+   if (now >= deadline) {
+      return 0;
+   }
+
+   return (int)((OSTicksToMicroseconds(deadline - now) + 999) / 1000);
+}
+
+int
+wut_connect_timeout(int fd,
+                    const struct sockaddr *addr,
+                    socklen_t len,
+                    int ms)
+{
+   OSTime deadline;
+   int flags = -1, rc;
+
+   if (ms < 0) {
+      return connect(fd, addr, len);
+   }
+
+   deadline = OSGetSystemTime() + OSMillisecondsToTicks(ms);
+   if (!deadline) {
+      deadline = 1;
+   }
+
+   rc = __wut_connect_start(fd, addr, len, &flags);
+   if (rc == 1) {
+      while (TRUE) {
+         fd_set wr, ex;
+         struct timeval tv;
+         int remaining = __wut_connect_remaining(deadline);
+
+         FD_ZERO(&wr);
+         FD_ZERO(&ex);
+         FD_SET(fd, &wr);
+         FD_SET(fd, &ex);
+         tv.tv_sec = remaining / 1000;
+         tv.tv_usec = (remaining % 1000) * 1000;
+
+         rc = select(fd + 1, NULL, &wr, &ex, &tv);
+         if (rc > 0) {
+            rc = __wut_connect_result(fd);
+            break;
+         } else if (rc == 0) {
+            errno = ETIMEDOUT;
+            rc = -1;
+            break;
+         } else if (errno != EINTR) {
+            break;
+         }
+      }
+   }
+
+   if (flags != -1) {
+      __wut_connect_restore(fd, flags);
+   }
+
+   return rc;
+}
+
+static int
+__wut_connect_race_open(const struct addrinfo *ai,
+                        __wut_connect_attempt_t *attempt)
+{
+   int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+   int rc;
+
+   if (fd == -1) {
+      return -1;
+   }
+
+   rc = __wut_connect_start(fd, ai->ai_addr, ai->ai_addrlen, &attempt->flags);
+   if (rc == -1) {
+      int error = errno;
+      close(fd);
+      errno = error;
+      return -1;
+   }
+
+   attempt->fd = fd;
+   return rc;
+}
+
+int
+wut_connect_race(const struct addrinfo *list,
+                 int staggerMs,
+                 int ms)
+{
+   __wut_connect_attempt_t attempts[WUT_CONNECT_MAX_RACE];
+   uint32_t numAttempts = 0;
+   const struct addrinfo *next = list;
+   OSTime deadline = 0, nextStart = 0;
+   int winner = -1, error = ECONNREFUSED;
+   uint32_t i;
+
+   if (!list) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   if (ms >= 0) {
+      deadline = OSGetSystemTime() + OSMillisecondsToTicks(ms);
+      if (!deadline) {
+         deadline = 1;
+      }
+   }
+
+   while (winner == -1) {
+      fd_set wr, ex;
+      struct timeval tv, *ptv = NULL;
+      int nfds = 0, remaining, rc;
+      OSTime now = OSGetSystemTime();
+
+      // Start the next attempt when the last one has had its head start
+      // or there is nothing else in flight
+      while (next && numAttempts < WUT_CONNECT_MAX_RACE
+          && (!numAttempts || now >= nextStart)) {
+         const struct addrinfo *ai = next;
+         next = next->ai_next;
+
+         rc = __wut_connect_race_open(ai, &attempts[numAttempts]);
+         if (rc == -1) {
+            error = errno;
+            continue;
+         }
+
+         if (rc == 0) {
+            winner = attempts[numAttempts].fd;
+            __wut_connect_restore(winner, attempts[numAttempts].flags);
+            break;
+         }
+
+         ++numAttempts;
+         nextStart = now + OSMillisecondsToTicks(staggerMs > 0 ? staggerMs : 0);
+         break;
+      }
+
+      if (winner != -1) {
+         break;
+      }
+
+      if (!numAttempts) {
+         errno = error;
+         return -1;
+      }
+
+      remaining = __wut_connect_remaining(deadline);
+      if (remaining == 0) {
+         error = ETIMEDOUT;
+         break;
+      }
+
+      if (next && numAttempts < WUT_CONNECT_MAX_RACE) {
+         int stagger = __wut_connect_remaining(nextStart);
+         if (remaining < 0 || stagger < remaining) {
+            remaining = stagger;
+         }
+      }
+
+      if (remaining >= 0) {
+         tv.tv_sec = remaining / 1000;
+         tv.tv_usec = (remaining % 1000) * 1000;
+         ptv = &tv;
+      }
+
+      FD_ZERO(&wr);
+      FD_ZERO(&ex);
+      for (i = 0; i < numAttempts; ++i) {
+         FD_SET(attempts[i].fd, &wr);
+         FD_SET(attempts[i].fd, &ex);
+         if (attempts[i].fd >= nfds) {
+            nfds = attempts[i].fd + 1;
+         }
+      }
+
+      rc = select(nfds, NULL, &wr, &ex, ptv);
+      if (rc < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+
+         error = errno;
+         break;
+      }
+
+      for (i = 0; rc > 0 && i < numAttempts; ) {
+         __wut_connect_attempt_t *attempt = &attempts[i];
+
+         if (!FD_ISSET(attempt->fd, &wr) && !FD_ISSET(attempt->fd, &ex)) {
+            ++i;
+            continue;
+         }
+
+         if (__wut_connect_result(attempt->fd) == 0) {
+            winner = attempt->fd;
+            __wut_connect_restore(winner, attempt->flags);
+            attempts[i] = attempts[--numAttempts];
+            break;
+         }
+
+         // A failed attempt lets the next address start without waiting
+         error = errno;
+         close(attempt->fd);
+         attempts[i] = attempts[--numAttempts];
+         nextStart = 0;
+      }
+   }
+
+   for (i = 0; i < numAttempts; ++i) {
+      close(attempts[i].fd);
+   }
+
+   if (winner == -1) {
+      errno = error;
+   }
+
+   return winner;
+}
@@ -0,0 +1,348 @@
+#include "wut_socket.h"
+#include <coreinit/condition.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <netdb.h>
+#include <nsysnet/_netdb.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <wut_dns.h>
+
+#define WUT_DNS_MAX_NAME 256
+#define WUT_DNS_STACK_SIZE 0x4000
+
+// Number of cached host names, 0 disables the cache.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_dns_cache_size = 16;
+
+// Time in milliseconds a cached lookup is used for.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_dns_cache_ttl = 60000;
+
+typedef struct
+{
+   BOOL valid;
+   OSTime expires;
+   char name[WUT_DNS_MAX_NAME];
+   uint32_t count;
+   struct in_addr addresses[WUT_DNS_MAX_ADDRESSES];
+} __wut_dns_cache_entry_t;
+
+static BOOL sDnsInitialised = FALSE;
+
+//! Guards the cache and the request queue
+static OSMutex sDnsMutex;
+static OSCondition sDnsWorkCond;
+static __wut_dns_cache_entry_t *sDnsCache = NULL;
+
+static OSThread sDnsThread;
+static uint8_t sDnsThreadStack[WUT_DNS_STACK_SIZE] __attribute__((aligned(16)));
+static BOOL sDnsThreadStarted = FALSE;
+static BOOL sDnsThreadStop = FALSE;
+static WUTDnsRequest *sDnsHead = NULL;
+static WUTDnsRequest *sDnsTail = NULL;
+
+uint32_t
+__wut_dns_cache_lookup(const char *name,
+                       struct in_addr *addresses)
+{
+   uint32_t i, count = 0;
+   OSTime now;
+
+   if (!sDnsInitialised || !sDnsCache || strlen(name) >= WUT_DNS_MAX_NAME) {
+      return 0;
+   }
+
+   now = OSGetTime();
+   OSLockMutex(&sDnsMutex);
+   for (i = 0; i < __wut_dns_cache_size; i++) {
+      __wut_dns_cache_entry_t *entry = &sDnsCache[i];
+      if (!entry->valid || strcasecmp(entry->name, name) != 0) {
+         continue;
+      }
+
+      if (now >= entry->expires) {
+         entry->valid = FALSE;
+         break;
+      }
+
+      count = entry->count;
+      memcpy(addresses, entry->addresses, count * sizeof(struct in_addr));
+      break;
+   }
+   OSUnlockMutex(&sDnsMutex);
+
+   return count;
+}
+
+void
+__wut_dns_cache_insert(const char *name,
+                       const struct in_addr *addresses,
+                       uint32_t count)
+{
+   __wut_dns_cache_entry_t *slot;
+   uint32_t i;
+
+   if (!sDnsInitialised || !sDnsCache || !__wut_dns_cache_size
+    || !count || strlen(name) >= WUT_DNS_MAX_NAME) {
+      return;
+   }
+
+   if (count > WUT_DNS_MAX_ADDRESSES) {
+      count = WUT_DNS_MAX_ADDRESSES;
+   }
+
+   OSLockMutex(&sDnsMutex);
+   slot = &sDnsCache[0];
+   for (i = 0; i < __wut_dns_cache_size; i++) {
+      __wut_dns_cache_entry_t *entry = &sDnsCache[i];
+      if (entry->valid && strcasecmp(entry->name, name) == 0) {
+         slot = entry;
+         break;
+      }
+
+      // Otherwise replace a free entry or the one closest to expiring
+      if (slot->valid && (!entry->valid || entry->expires < slot->expires)) {
+         slot = entry;
+      }
+   }
+
+   strcpy(slot->name, name);
+   slot->count = count;
+   memcpy(slot->addresses, addresses, count * sizeof(struct in_addr));
+   slot->expires = OSGetTime() + OSMillisecondsToTicks(__wut_dns_cache_ttl);
+   slot->valid = TRUE;
+   OSUnlockMutex(&sDnsMutex);
+}
+
+uint32_t
+__wut_dns_addrinfo_addresses(const struct addrinfo *res,
+                             struct in_addr *addresses)
+{
+   uint32_t i, count = 0;
+
+   for (; res && count < WUT_DNS_MAX_ADDRESSES; res = res->ai_next) {
+      struct in_addr addr;
+
+      if (res->ai_family != AF_INET || !res->ai_addr) {
+         continue;
+      }
+
+      // getaddrinfo returns an entry per socket type for the same address
+      addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+      for (i = 0; i < count; i++) {
+         if (addresses[i].s_addr == addr.s_addr) {
+            break;
+         }
+      }
+
+      if (i == count) {
+         addresses[count++] = addr;
+      }
+   }
+
+   return count;
+}
+
+static int
+__wut_dns_resolve(const char *name,
+                  struct in_addr *addresses,
+                  uint32_t *outCount)
+{
+   struct addrinfo hints, *res;
+   int rc;
+
+   *outCount = __wut_dns_cache_lookup(name, addresses);
+   if (*outCount) {
+      return 0;
+   }
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+
+   rc = RPLWRAP(getaddrinfo)(name, NULL, &hints, &res);
+   if (rc != 0) {
+      return rc;
+   }
+
+   *outCount = __wut_dns_addrinfo_addresses(res, addresses);
+   RPLWRAP(freeaddrinfo)(res);
+
+   if (!*outCount) {
+      return EAI_NODATA;
+   }
+
+   __wut_dns_cache_insert(name, addresses, *outCount);
+   return 0;
+}
+
+static void
+__wut_dns_complete(WUTDnsRequest *request,
+                   int error,
+                   uint32_t count)
+{
+   // The request may be reused as soon as it is marked as done
+   WUTDnsCallbackFn callback = request->callback;
+   void *userContext = request->userContext;
+   OSMessageQueue *queue = request->queue;
+
+   request->error = error;
+   request->addressCount = count;
+   request->done = TRUE;
+
+   if (callback) {
+      callback(request, userContext);
+   }
+
+   if (queue) {
+      OSMessage message;
+      memset(&message, 0, sizeof(message));
+      message.message = request;
+      OSSendMessage(queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+   }
+}
+
+static int
+__wut_dns_thread_entry(int argc,
+                       const char **argv)
+{
+   while (TRUE) {
+      WUTDnsRequest *request;
+      uint32_t count;
+      int error;
+
+      OSLockMutex(&sDnsMutex);
+      while (!sDnsHead && !sDnsThreadStop) {
+         OSWaitCond(&sDnsWorkCond, &sDnsMutex);
+      }
+
+      request = sDnsHead;
+      if (!request) {
+         OSUnlockMutex(&sDnsMutex);
+         break;
+      }
+
+      sDnsHead = request->next;
+      if (!sDnsHead) {
+         sDnsTail = NULL;
+      }
+      OSUnlockMutex(&sDnsMutex);
+
+      error = __wut_dns_resolve(request->name, request->addresses, &count);
+      __wut_dns_complete(request, error, count);
+   }
+
+   return 0;
+}
+
+BOOL
+WUTDnsResolveAsync(WUTDnsRequest *request)
+{
+   uint32_t count;
+
+   __wut_socket_ensure_init();
+
+   if (!sDnsInitialised || !request || !request->name) {
+      return FALSE;
+   }
+
+   request->error = 0;
+   request->addressCount = 0;
+   request->done = FALSE;
+   request->next = NULL;
+
+   count = __wut_dns_cache_lookup(request->name, request->addresses);
+   if (count) {
+      __wut_dns_complete(request, 0, count);
+      return TRUE;
+   }
+
+   OSLockMutex(&sDnsMutex);
+   if (!sDnsThreadStarted) {
+      sDnsThreadStop = FALSE;
+      if (!OSCreateThread(&sDnsThread,
+                          __wut_dns_thread_entry,
+                          0,
+                          NULL,
+                          sDnsThreadStack + WUT_DNS_STACK_SIZE,
+                          WUT_DNS_STACK_SIZE,
+                          16,
+                          OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+         OSUnlockMutex(&sDnsMutex);
+         return FALSE;
+      }
+
+      OSSetThreadName(&sDnsThread, "wut DNS resolver");
+      OSResumeThread(&sDnsThread);
+      sDnsThreadStarted = TRUE;
+   }
+
+   if (sDnsTail) {
+      sDnsTail->next = request;
+   } else {
+      sDnsHead = request;
+   }
+   sDnsTail = request;
+
+   OSSignalCond(&sDnsWorkCond);
+   OSUnlockMutex(&sDnsMutex);
+   return TRUE;
+}
+
+void
+WUTDnsClearCache()
+{
+   uint32_t i;
+
+   __wut_socket_ensure_init();
+
+   if (sDnsInitialised && sDnsCache) {
+      OSLockMutex(&sDnsMutex);
+      for (i = 0; i < __wut_dns_cache_size; i++) {
+         sDnsCache[i].valid = FALSE;
+      }
+      OSUnlockMutex(&sDnsMutex);
+   }
+
+   RPLWRAP(clear_resolver_cache)();
+}
+
+void
+__wut_dns_init()
+{
+   OSInitMutexEx(&sDnsMutex, "wut DNS");
+   OSInitCond(&sDnsWorkCond);
+   sDnsHead = NULL;
+   sDnsTail = NULL;
+
+   if (__wut_dns_cache_size) {
+      sDnsCache = (__wut_dns_cache_entry_t *)calloc(__wut_dns_cache_size, sizeof(__wut_dns_cache_entry_t));
+   }
+
+   sDnsInitialised = TRUE;
+}
+
+void
+__wut_dns_fini()
+{
+   if (!sDnsInitialised) {
+      return;
+   }
+
+   OSLockMutex(&sDnsMutex);
+   sDnsThreadStop = TRUE;
+   OSSignalCond(&sDnsWorkCond);
+   OSUnlockMutex(&sDnsMutex);
+
+   // Pending lookups are still completed before the thread exits
+   if (sDnsThreadStarted) {
+      OSJoinThread(&sDnsThread, NULL);
+      sDnsThreadStarted = FALSE;
+   }
+
+   sDnsInitialised = FALSE;
+   free(sDnsCache);
+   sDnsCache = NULL;
+}
@@ -0,0 +1,388 @@
+#include "wut_socket.h"
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <wut_event_loop.h>
+#include <wut_poll.h>
+
+#define WUT_EVENT_LOOP_STACK_SIZE 0x4000
+#define WUT_EVENT_LOOP_MAX_EVENTS 32
+
+// Used when the wake socket couldn't be created, new requests are then
+// picked up after at most this long
+#define WUT_EVENT_LOOP_POLL_MS 10
+
+struct WUTEventLoop
+{
+   OSThread thread;
+   uint8_t stack[WUT_EVENT_LOOP_STACK_SIZE];
+
+   OSMessageQueue *queue;
+   wut_poll_t *set;
+
+   //! Loopback UDP socket the loop thread is woken up with
+   int wakeFd;
+   struct sockaddr_in wakeAddr;
+
+   //! Guards pending and stop
+   OSMutex mutex;
+   WUTEventLoopRequest *pending;
+   volatile BOOL stop;
+
+   //! Requests waiting for their socket, only used by the loop thread
+   WUTEventLoopRequest *active;
+};
+
+static int
+__wut_event_loop_events(WUTEventLoopRequestType type)
+{
+   return (type == WUT_EVENT_LOOP_SEND) ? POLLOUT : POLLIN;
+}
+
+// Keep the interest set in sync with the active requests on fd
+static void
+__wut_event_loop_update_fd(WUTEventLoop *loop,
+                           int fd)
+{
+   WUTEventLoopRequest *request;
+   int events = 0;
+
+   for (request = loop->active; request; request = request->next) {
+      if (request->fd == fd) {
+         events |= __wut_event_loop_events(request->type);
+      }
+   }
+
+   if (!events) {
+      wut_poll_del(loop->set, fd);
+   } else if (wut_poll_mod(loop->set, fd, events, NULL) < 0) {
+      wut_poll_add(loop->set, fd, events, NULL);
+   }
+}
+
+static void
+__wut_event_loop_complete(WUTEventLoop *loop,
+                          WUTEventLoopRequest *request)
+{
+   OSMessage message;
+
+   message.message = request;
+   message.args[0] = request->type;
+   message.args[1] = 0;
+   message.args[2] = 0;
+   OSSendMessage(loop->queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+}
+
+// Returns FALSE if the socket wasn't ready after all
+static BOOL
+__wut_event_loop_do(WUTEventLoopRequest *request)
+{
+   ssize_t rc;
+
+   switch (request->type) {
+   case WUT_EVENT_LOOP_RECV:
+      rc = recv(request->fd, request->buffer, request->size, request->flags | MSG_DONTWAIT);
+      break;
+   case WUT_EVENT_LOOP_SEND:
+      rc = send(request->fd, request->buffer, request->size, request->flags | MSG_DONTWAIT);
+      break;
+   case WUT_EVENT_LOOP_ACCEPT:
+      rc = accept(request->fd, NULL, NULL);
+      break;
+   default:
+      rc = -1;
+      errno = EINVAL;
+      break;
+   }
+
+   if (rc < 0 && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+      return FALSE;
+   }
+
+   request->result = rc;
+   request->error = (rc < 0) ? errno : 0;
+   return TRUE;
+}
+
+static void
+__wut_event_loop_dispatch(WUTEventLoop *loop,
+                          int fd,
+                          int events)
+{
+   WUTEventLoopRequest **link = &loop->active;
+
+   while (*link) {
+      WUTEventLoopRequest *request = *link;
+
+      if (request->fd != fd ||
+          !(events & (__wut_event_loop_events(request->type) | POLLERR | POLLHUP)) ||
+          !__wut_event_loop_do(request)) {
+         link = &request->next;
+         continue;
+      }
+
+      *link = request->next;
+      __wut_event_loop_complete(loop, request);
+   }
+
+   __wut_event_loop_update_fd(loop, fd);
+}
+
+static void
+__wut_event_loop_fail_closed(WUTEventLoop *loop)
+{
+   WUTEventLoopRequest **link = &loop->active;
+
+   while (*link) {
+      WUTEventLoopRequest *request = *link;
+
+      if (__wut_get_nsysnet_fd(request->fd) >= 0) {
+         link = &request->next;
+         continue;
+      }
+
+      *link = request->next;
+      wut_poll_del(loop->set, request->fd);
+      request->result = -1;
+      request->error = EBADF;
+      __wut_event_loop_complete(loop, request);
+   }
+}
+
+static int
+__wut_event_loop_thread_entry(int argc,
+                              const char **argv)
+{
+   WUTEventLoop *loop = (WUTEventLoop *)argv;
+   struct wut_poll_event events[WUT_EVENT_LOOP_MAX_EVENTS];
+   WUTEventLoopRequest *request, *next, *prev, **tail;
+   BOOL stop = FALSE;
+   char drain[16];
+   int i, count;
+
+   while (!stop) {
+      // Take over the newly submitted requests
+      OSLockMutex(&loop->mutex);
+      request = loop->pending;
+      loop->pending = NULL;
+      stop = loop->stop;
+      OSUnlockMutex(&loop->mutex);
+
+      // pending is newest first, append it oldest first so requests on the
+      // same socket complete in the order they were submitted
+      for (prev = NULL; request; request = next) {
+         next = request->next;
+         request->next = prev;
+         prev = request;
+      }
+
+      for (tail = &loop->active; *tail; tail = &(*tail)->next);
+      *tail = prev;
+
+      for (request = prev; request; request = request->next) {
+         __wut_event_loop_update_fd(loop, request->fd);
+      }
+
+      if (stop) {
+         break;
+      }
+
+      count = wut_poll_wait(loop->set, events, WUT_EVENT_LOOP_MAX_EVENTS,
+                            (loop->wakeFd >= 0) ? -1 : WUT_EVENT_LOOP_POLL_MS);
+      if (count < 0) {
+         // Most likely a socket was closed with a request still queued
+         __wut_event_loop_fail_closed(loop);
+         OSSleepTicks(OSMillisecondsToTicks(WUT_EVENT_LOOP_POLL_MS));
+         continue;
+      }
+
+      for (i = 0; i < count; i++) {
+         if (events[i].fd == loop->wakeFd) {
+            while (recv(loop->wakeFd, drain, sizeof(drain), MSG_DONTWAIT) > 0);
+            continue;
+         }
+
+         __wut_event_loop_dispatch(loop, events[i].fd, events[i].events);
+      }
+   }
+
+   // Cancel whatever is left
+   for (request = loop->active; request; request = next) {
+      next = request->next;
+      wut_poll_del(loop->set, request->fd);
+      request->result = -1;
+      request->error = ECANCELED;
+      __wut_event_loop_complete(loop, request);
+   }
+   loop->active = NULL;
+
+   return 0;
+}
+
+static void
+__wut_event_loop_open_wake_socket(WUTEventLoop *loop)
+{
+   socklen_t len = sizeof(loop->wakeAddr);
+
+   loop->wakeFd = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+   if (loop->wakeFd < 0) {
+      return;
+   }
+
+   memset(&loop->wakeAddr, 0, sizeof(loop->wakeAddr));
+   loop->wakeAddr.sin_family = AF_INET;
+   loop->wakeAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   if (bind(loop->wakeFd, (struct sockaddr *)&loop->wakeAddr, sizeof(loop->wakeAddr)) < 0 ||
+       getsockname(loop->wakeFd, (struct sockaddr *)&loop->wakeAddr, &len) < 0 ||
+       wut_poll_add(loop->set, loop->wakeFd, POLLIN, NULL) < 0) {
+      close(loop->wakeFd);
+      loop->wakeFd = -1;
+   }
+}
+
+WUTEventLoop *
+WUTEventLoopCreate(OSMessageQueue *queue,
+                   int32_t priority)
+{
+   WUTEventLoop *loop;
+
+   if (!queue) {
+      return NULL;
+   }
+
+   loop = (WUTEventLoop *)memalign(16, sizeof(WUTEventLoop));
+   if (!loop) {
+      return NULL;
+   }
+
+   memset(loop, 0, sizeof(WUTEventLoop));
+   loop->queue = queue;
+   loop->set = wut_poll_create();
+   if (!loop->set) {
+      free(loop);
+      return NULL;
+   }
+
+   OSInitMutexEx(&loop->mutex, "WUTEventLoop");
+   __wut_event_loop_open_wake_socket(loop);
+
+   if (!OSCreateThread(&loop->thread,
+                       __wut_event_loop_thread_entry,
+                       0,
+                       (char *)loop,
+                       loop->stack + WUT_EVENT_LOOP_STACK_SIZE,
+                       WUT_EVENT_LOOP_STACK_SIZE,
+                       priority,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      if (loop->wakeFd >= 0) {
+         close(loop->wakeFd);
+      }
+      wut_poll_destroy(loop->set);
+      free(loop);
+      return NULL;
+   }
+
+   OSSetThreadName(&loop->thread, "WUTEventLoop");
+   OSResumeThread(&loop->thread);
+   return loop;
+}
+
+static void
+__wut_event_loop_wake(WUTEventLoop *loop)
+{
+   char byte = 0;
+
+   if (loop->wakeFd >= 0) {
+      sendto(loop->wakeFd, &byte, 1, MSG_DONTWAIT,
+             (struct sockaddr *)&loop->wakeAddr, sizeof(loop->wakeAddr));
+   }
+}
+
+void
+WUTEventLoopDestroy(WUTEventLoop *loop)
+{
+   WUTEventLoopRequest *request, *next;
+
+   if (!loop) {
+      return;
+   }
+
+   OSLockMutex(&loop->mutex);
+   loop->stop = TRUE;
+   OSUnlockMutex(&loop->mutex);
+   __wut_event_loop_wake(loop);
+
+   OSJoinThread(&loop->thread, NULL);
+
+   // Requests submitted after the thread took its last batch
+   for (request = loop->pending; request; request = next) {
+      next = request->next;
+      request->result = -1;
+      request->error = ECANCELED;
+      __wut_event_loop_complete(loop, request);
+   }
+
+   if (loop->wakeFd >= 0) {
+      close(loop->wakeFd);
+   }
+
+   wut_poll_destroy(loop->set);
+   free(loop);
+}
+
+static BOOL
+__wut_event_loop_submit(WUTEventLoop *loop,
+                        WUTEventLoopRequest *request,
+                        WUTEventLoopRequestType type)
+{
+   if (!loop || !request || request->fd < 0) {
+      return FALSE;
+   }
+
+   // Only sockets fit into the select set
+   if (__wut_get_nsysnet_fd(request->fd) < 0) {
+      return FALSE;
+   }
+
+   request->type = type;
+   request->result = -1;
+   request->error = 0;
+
+   OSLockMutex(&loop->mutex);
+   if (loop->stop) {
+      OSUnlockMutex(&loop->mutex);
+      return FALSE;
+   }
+
+   request->next = loop->pending;
+   loop->pending = request;
+   OSUnlockMutex(&loop->mutex);
+
+   __wut_event_loop_wake(loop);
+   return TRUE;
+}
+
+BOOL
+WUTEventLoopRecv(WUTEventLoop *loop,
+                 WUTEventLoopRequest *request)
+{
+   return __wut_event_loop_submit(loop, request, WUT_EVENT_LOOP_RECV);
+}
+
+BOOL
+WUTEventLoopSend(WUTEventLoop *loop,
+                 WUTEventLoopRequest *request)
+{
+   return __wut_event_loop_submit(loop, request, WUT_EVENT_LOOP_SEND);
+}
+
+BOOL
+WUTEventLoopAccept(WUTEventLoop *loop,
+                   WUTEventLoopRequest *request)
+{
+   return __wut_event_loop_submit(loop, request, WUT_EVENT_LOOP_ACCEPT);
+}
@@ -0,0 +1,322 @@
+#include "wut_socket.h"
+#include <coreinit/mutex.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <wut_nssl_pool.h>
+
+#define WUT_NSSL_POOL_SESSIONS 8
+
+typedef struct
+{
+   BOOL used;
+   char host[WUT_NSSL_POOL_MAX_HOST];
+   uint16_t port;
+   int fd;
+   NSSLConnectionHandle connection;
+   OSTime idleSince;
+} __wut_nssl_pool_idle_t;
+
+typedef struct
+{
+   BOOL used;
+   char host[WUT_NSSL_POOL_MAX_HOST];
+   uint16_t port;
+   NSSLSessionHandle session;
+} __wut_nssl_pool_session_t;
+
+struct WUTNSSLPool
+{
+   OSMutex mutex;
+   NSSLContextHandle context;
+   OSTime idleTimeout;
+   uint32_t maxIdle;
+   __wut_nssl_pool_idle_t *idle;
+
+   //! Sessions of the last closed connection per server, replaced round-robin
+   __wut_nssl_pool_session_t sessions[WUT_NSSL_POOL_SESSIONS];
+   uint32_t nextSession;
+};
+
+static int
+__wut_nssl_pool_match(const char *host,
+                      uint16_t port,
+                      const char *entryHost,
+                      uint16_t entryPort)
+{
+   return port == entryPort && strcmp(host, entryHost) == 0;
+}
+
+static __wut_nssl_pool_session_t *
+__wut_nssl_pool_find_session(WUTNSSLPool *pool,
+                             const char *host,
+                             uint16_t port)
+{
+   int i;
+
+   for (i = 0; i < WUT_NSSL_POOL_SESSIONS; i++) {
+      __wut_nssl_pool_session_t *entry = &pool->sessions[i];
+      if (entry->used && __wut_nssl_pool_match(host, port, entry->host, entry->port)) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+static void
+__wut_nssl_pool_free_session(__wut_nssl_pool_session_t *entry)
+{
+   NSSLFreeSession(entry->session);
+   entry->used = FALSE;
+}
+
+// Must be called with the pool mutex held
+static void
+__wut_nssl_pool_close(WUTNSSLPool *pool,
+                      const char *host,
+                      uint16_t port,
+                      int fd,
+                      NSSLConnectionHandle connection)
+{
+   __wut_nssl_pool_session_t *entry;
+   NSSLSessionHandle session;
+
+   // Keep the session around so the next connection can resume it
+   session = NSSLGetSession(connection);
+   if (session >= 0) {
+      entry = __wut_nssl_pool_find_session(pool, host, port);
+      if (entry) {
+         __wut_nssl_pool_free_session(entry);
+      } else {
+         entry = &pool->sessions[pool->nextSession];
+         pool->nextSession = (pool->nextSession + 1) % WUT_NSSL_POOL_SESSIONS;
+         if (entry->used) {
+            __wut_nssl_pool_free_session(entry);
+         }
+      }
+
+      strcpy(entry->host, host);
+      entry->port = port;
+      entry->session = session;
+      entry->used = TRUE;
+   }
+
+   NSSLDestroyConnection(connection);
+   close(fd);
+}
+
+static int
+__wut_nssl_pool_is_alive(int fd)
+{
+   struct pollfd pfd;
+
+   // An idle connection has nothing to read unless the server closed it
+   pfd.fd = fd;
+   pfd.events = POLLIN;
+   return poll(&pfd, 1, 0) == 0;
+}
+
+static int
+__wut_nssl_pool_connect(const char *host,
+                        uint16_t port)
+{
+   struct addrinfo hints, *res, *ai;
+   char service[8];
+   int fd = -1;
+
+   memset(&hints, 0, sizeof(hints));
+   hints.ai_family = AF_INET;
+   hints.ai_socktype = SOCK_STREAM;
+   snprintf(service, sizeof(service), "%u", port);
+
+   if (getaddrinfo(host, service, &hints, &res) != 0) {
+      errno = EHOSTUNREACH;
+      return -1;
+   }
+
+   for (ai = res; ai; ai = ai->ai_next) {
+      fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (fd < 0) {
+         continue;
+      }
+
+      if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+         break;
+      }
+
+      close(fd);
+      fd = -1;
+   }
+
+   freeaddrinfo(res);
+   return fd;
+}
+
+WUTNSSLPool *
+WUTNSSLPoolCreate(NSSLContextHandle context,
+                  uint32_t maxIdle,
+                  OSTime idleTimeout)
+{
+   WUTNSSLPool *pool = (WUTNSSLPool *)calloc(1, sizeof(WUTNSSLPool));
+   if (!pool) {
+      return NULL;
+   }
+
+   if (maxIdle) {
+      pool->idle = (__wut_nssl_pool_idle_t *)calloc(maxIdle, sizeof(__wut_nssl_pool_idle_t));
+      if (!pool->idle) {
+         free(pool);
+         return NULL;
+      }
+   }
+
+   OSInitMutexEx(&pool->mutex, "WUTNSSLPool");
+   pool->context = context;
+   pool->maxIdle = maxIdle;
+   pool->idleTimeout = idleTimeout;
+   return pool;
+}
+
+void
+WUTNSSLPoolDestroy(WUTNSSLPool *pool)
+{
+   uint32_t i;
+
+   if (!pool) {
+      return;
+   }
+
+   for (i = 0; i < pool->maxIdle; i++) {
+      if (pool->idle[i].used) {
+         NSSLDestroyConnection(pool->idle[i].connection);
+         close(pool->idle[i].fd);
+      }
+   }
+
+   for (i = 0; i < WUT_NSSL_POOL_SESSIONS; i++) {
+      if (pool->sessions[i].used) {
+         __wut_nssl_pool_free_session(&pool->sessions[i]);
+      }
+   }
+
+   free(pool->idle);
+   free(pool);
+}
+
+NSSLError
+WUTNSSLPoolAcquire(WUTNSSLPool *pool,
+                   const char *host,
+                   uint16_t port,
+                   WUTNSSLPoolConnection *outConnection)
+{
+   __wut_nssl_pool_session_t *session;
+   NSSLConnectionHandle connection;
+   OSTime now = OSGetTime();
+   uint32_t i;
+   int fd;
+
+   if (!pool || !host || !outConnection || strlen(host) >= WUT_NSSL_POOL_MAX_HOST) {
+      return NSSL_ERROR_GENERIC;
+   }
+
+   strcpy(outConnection->host, host);
+   outConnection->port = port;
+
+   OSLockMutex(&pool->mutex);
+   for (i = 0; i < pool->maxIdle; i++) {
+      __wut_nssl_pool_idle_t *entry = &pool->idle[i];
+      if (!entry->used || !__wut_nssl_pool_match(host, port, entry->host, entry->port)) {
+         continue;
+      }
+
+      entry->used = FALSE;
+      if (now - entry->idleSince > pool->idleTimeout || !__wut_nssl_pool_is_alive(entry->fd)) {
+         __wut_nssl_pool_close(pool, entry->host, entry->port, entry->fd, entry->connection);
+         continue;
+      }
+
+      OSUnlockMutex(&pool->mutex);
+      outConnection->fd = entry->fd;
+      outConnection->connection = entry->connection;
+      outConnection->reused = TRUE;
+      return NSSL_ERROR_OK;
+   }
+   OSUnlockMutex(&pool->mutex);
+
+   // Connect without holding the lock, this can take a while
+   fd = __wut_nssl_pool_connect(host, port);
+   if (fd < 0) {
+      return NSSL_ERROR_IO_ERROR;
+   }
+
+   connection = NSSLCreateConnection(pool->context, host, strlen(host), 0, fd, 1);
+   if (connection < 0) {
+      close(fd);
+      return connection;
+   }
+
+   OSLockMutex(&pool->mutex);
+   session = __wut_nssl_pool_find_session(pool, host, port);
+   if (session && NSSLSetSession(connection, session->session) < 0) {
+      // Don't try a session the server rejected again
+      __wut_nssl_pool_free_session(session);
+   }
+   OSUnlockMutex(&pool->mutex);
+
+   outConnection->fd = fd;
+   outConnection->connection = connection;
+   outConnection->reused = FALSE;
+   return NSSL_ERROR_OK;
+}
+
+void
+WUTNSSLPoolRelease(WUTNSSLPool *pool,
+                   WUTNSSLPoolConnection *connection,
+                   BOOL keepAlive)
+{
+   __wut_nssl_pool_idle_t *slot = NULL, *oldest = NULL;
+   uint32_t i;
+
+   if (!pool || !connection) {
+      return;
+   }
+
+   OSLockMutex(&pool->mutex);
+   if (keepAlive) {
+      for (i = 0; i < pool->maxIdle; i++) {
+         __wut_nssl_pool_idle_t *entry = &pool->idle[i];
+         if (!entry->used) {
+            slot = entry;
+            break;
+         }
+
+         if (!oldest || entry->idleSince < oldest->idleSince) {
+            oldest = entry;
+         }
+      }
+
+      // Make room by closing the connection that has been idle the longest
+      if (!slot && oldest) {
+         __wut_nssl_pool_close(pool, oldest->host, oldest->port, oldest->fd, oldest->connection);
+         oldest->used = FALSE;
+         slot = oldest;
+      }
+   }
+
+   if (slot) {
+      strcpy(slot->host, connection->host);
+      slot->port = connection->port;
+      slot->fd = connection->fd;
+      slot->connection = connection->connection;
+      slot->idleSince = OSGetTime();
+      slot->used = TRUE;
+   } else {
+      __wut_nssl_pool_close(pool, connection->host, connection->port, connection->fd, connection->connection);
+   }
+   OSUnlockMutex(&pool->mutex);
+
+   connection->fd = -1;
+   connection->connection = NSSL_ERROR_INVALID_NSSL_CONNECTION;
+}
@@ -0,0 +1,249 @@
+#include "wut_socket.h"
+#include <wut_poll.h>
+#include <stdlib.h>
+
+struct wut_poll
+{
+   //! Interest sets in nsysnet fd numbers, passed to select as copies
+   nsysnet_fd_set rd, wr, ex;
+
+   //! Sockets in the set, indexed by nsysnet fd
+   struct wut_poll_event entries[NSYSNET_FD_SETSIZE];
+
+   //! nsysnet fd to start the next result scan at, so that a small
+   //! maxevents doesn't starve the higher fds
+   int next;
+};
+
+static void
+__wut_poll_set_events(wut_poll_t *set,
+                      int cnv_fd,
+                      int events)
+{
+   NSYSNET_FD_CLR(cnv_fd, &set->rd);
+   NSYSNET_FD_CLR(cnv_fd, &set->wr);
+   NSYSNET_FD_CLR(cnv_fd, &set->ex);
+
+   if (events & POLLIN) {
+      NSYSNET_FD_SET(cnv_fd, &set->rd);
+   }
+   if (events & POLLOUT) {
+      NSYSNET_FD_SET(cnv_fd, &set->wr);
+   }
+   if (events & POLLPRI) {
+      NSYSNET_FD_SET(cnv_fd, &set->ex);
+   }
+}
+
+static int
+__wut_poll_find(wut_poll_t *set,
+                int fd)
+{
+   int i;
+
+   // Search by fd rather than translating it, the socket may already be closed
+   for (i = 0; i < NSYSNET_FD_SETSIZE; i++) {
+      if (set->entries[i].fd == fd) {
+         return i;
+      }
+   }
+
+   errno = ENOENT;
+   return -1;
+}
+
+wut_poll_t *
+wut_poll_create(void)
+{
+   wut_poll_t *set;
+   int i;
+
+   set = (wut_poll_t *)malloc(sizeof(wut_poll_t));
+   if (!set) {
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   NSYSNET_FD_ZERO(&set->rd);
+   NSYSNET_FD_ZERO(&set->wr);
+   NSYSNET_FD_ZERO(&set->ex);
+   set->next = 0;
+
+   for (i = 0; i < NSYSNET_FD_SETSIZE; i++) {
+      set->entries[i].fd = -1;
+      set->entries[i].events = 0;
+      set->entries[i].data = NULL;
+   }
+
+   return set;
+}
+
+void
+wut_poll_destroy(wut_poll_t *set)
+{
+   free(set);
+}
+
+int
+wut_poll_add(wut_poll_t *set,
+             int fd,
+             int events,
+             void *data)
+{
+   int cnv_fd;
+
+   if (!set) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   cnv_fd = __wut_get_nsysnet_fd(fd);
+   if (cnv_fd == -1) {
+      return -1;
+   }
+   if (cnv_fd >= NSYSNET_FD_SETSIZE) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   if (set->entries[cnv_fd].fd != -1) {
+      errno = EEXIST;
+      return -1;
+   }
+
+   set->entries[cnv_fd].fd = fd;
+   set->entries[cnv_fd].events = events;
+   set->entries[cnv_fd].data = data;
+   __wut_poll_set_events(set, cnv_fd, events);
+   return 0;
+}
+
+int
+wut_poll_mod(wut_poll_t *set,
+             int fd,
+             int events,
+             void *data)
+{
+   int cnv_fd;
+
+   if (!set) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   cnv_fd = __wut_poll_find(set, fd);
+   if (cnv_fd == -1) {
+      return -1;
+   }
+
+   set->entries[cnv_fd].events = events;
+   set->entries[cnv_fd].data = data;
+   __wut_poll_set_events(set, cnv_fd, events);
+   return 0;
+}
+
+int
+wut_poll_del(wut_poll_t *set,
+             int fd)
+{
+   int cnv_fd;
+
+   if (!set) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   cnv_fd = __wut_poll_find(set, fd);
+   if (cnv_fd == -1) {
+      return -1;
+   }
+
+   set->entries[cnv_fd].fd = -1;
+   set->entries[cnv_fd].events = 0;
+   set->entries[cnv_fd].data = NULL;
+   __wut_poll_set_events(set, cnv_fd, 0);
+   return 0;
+}
+
+static int
+__wut_poll_scatter(wut_poll_t *set,
+                   uint32_t bits,
+                   nsysnet_fd_set *cnv_rd,
+                   nsysnet_fd_set *cnv_wr,
+                   nsysnet_fd_set *cnv_ex,
+                   struct wut_poll_event *events,
+                   int maxevents)
+{
+   int count = 0;
+
+   while (bits && count < maxevents) {
+      int cnv_fd = __builtin_ctz(bits);
+      bits &= bits - 1;
+
+      events[count].fd = set->entries[cnv_fd].fd;
+      events[count].data = set->entries[cnv_fd].data;
+      events[count].events = 0;
+      if (NSYSNET_FD_ISSET(cnv_fd, cnv_rd)) {
+         events[count].events |= POLLIN;
+      }
+      if (NSYSNET_FD_ISSET(cnv_fd, cnv_wr)) {
+         events[count].events |= POLLOUT;
+      }
+      if (NSYSNET_FD_ISSET(cnv_fd, cnv_ex)) {
+         events[count].events |= POLLPRI;
+      }
+
+      set->next = (cnv_fd + 1) % NSYSNET_FD_SETSIZE;
+      count++;
+   }
+
+   return count;
+}
+
+int
+wut_poll_wait(wut_poll_t *set,
+              struct wut_poll_event *events,
+              int maxevents,
+              int timeout)
+{
+   int cnv_nfds, rc;
+   uint32_t bits, mask;
+   nsysnet_fd_set cnv_rd, cnv_wr, cnv_ex;
+   struct nsysnet_timeval cnv_timeout;
+
+   if (!set || !events || maxevents <= 0) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   // select overwrites the sets with the results
+   cnv_rd = set->rd;
+   cnv_wr = set->wr;
+   cnv_ex = set->ex;
+
+   bits = cnv_rd.fds_bits | cnv_wr.fds_bits | cnv_ex.fds_bits;
+   cnv_nfds = bits ? (32 - __builtin_clz(bits)) : 0;
+
+   if (timeout >= 0) {
+      cnv_timeout.tv_sec  = timeout / 1000;
+      cnv_timeout.tv_usec = (timeout % 1000) * 1000;
+   }
+
+   rc = RPLWRAP(select)(cnv_nfds, &cnv_rd, &cnv_wr, &cnv_ex,
+                        (timeout >= 0) ? &cnv_timeout : NULL);
+
+   rc = __wut_get_nsysnet_result(NULL, rc);
+   if (rc == -1) {
+      return rc;
+   }
+
+   // Scan from where the last call stopped, then wrap around
+   bits = cnv_rd.fds_bits | cnv_wr.fds_bits | cnv_ex.fds_bits;
+   mask = ~0u << set->next;
+
+   rc = __wut_poll_scatter(set, bits & mask, &cnv_rd, &cnv_wr, &cnv_ex,
+                           events, maxevents);
+   rc += __wut_poll_scatter(set, bits & ~mask, &cnv_rd, &cnv_wr, &cnv_ex,
+                            events + rc, maxevents - rc);
+   return rc;
+}
@@ -3,18 +3,84 @@
 #include <nn/ac.h>
 #include <sys/iosupport.h>
 #include <sys/select.h>
+#include <sys/stat.h>
 #include <poll.h>
 #include <fcntl.h>
 #include <stdarg.h>
 #include <string.h>
 #define __LINUX_ERRNO_EXTENSIONS__
 #include <errno.h>
+#include <coreinit/time.h>
+#include <wut_heap_budget.h>
+#include <wut_trace.h>
 
+#define SOCKET_INIT_NONE     0
+#define SOCKET_INIT_RUNNING  1
+#define SOCKET_INIT_DONE     2
+
+extern volatile uint32_t __wut_socket_init_state;
+void    __wut_socket_init_slow();
+
+// Brings the network up on first use when __wut_socket_deferred_init is set
+static inline void
+__wut_socket_ensure_init(void)
+{
+   if (__wut_socket_init_state != SOCKET_INIT_DONE) {
+      __wut_socket_init_slow();
+   }
+}
+
+// Devoptab state of a socket, the nsysnet fd comes first
+typedef struct __wut_socket_file
+{
+   int sockfd;
+} __wut_socket_file;
+
+__wut_socket_file *__wut_get_socket_file(int fd);
+void    __wut_socket_file_init(int fd, int sockfd);
 int     __wut_get_nsysnet_fd(int fd);
 int     __wut_get_nsysnet_result(struct _reent *r, int rc);
+int     __wut_nsysnet_error_to_errno(int sockerror);
+
+extern volatile uint32_t __wut_socket_stats_enabled;
+void    __wut_socket_stats_record_error(int sockerror, int error);
+void    __wut_socket_stats_add(int sockfd, int send, int rc);
+void    __wut_socket_stats_reset_socket(int sockfd);
+
+// Trace spans are only timed if the application defines __wut_trace_span
+static inline OSTime
+__wut_socket_trace_begin(void)
+{
+   return __wut_trace_span ? OSGetSystemTime() : 0;
+}
+
+static inline void
+__wut_socket_trace_end(const char *name, const char *path, int fd, int rc, OSTime start)
+{
+   if (__wut_trace_span) {
+      WUTTraceSpan span;
+      span.name  = name;
+      span.path  = path;
+      span.fd    = fd;
+      span.bytes = rc;
+      span.start = start;
+      span.end   = OSGetSystemTime();
+      __wut_trace_span(&span);
+   }
+}
+
+struct addrinfo;
+struct in_addr;
+
+void     __wut_dns_init();
+void     __wut_dns_fini();
+uint32_t __wut_dns_cache_lookup(const char *name, struct in_addr *addresses);
+void     __wut_dns_cache_insert(const char *name, const struct in_addr *addresses, uint32_t count);
+uint32_t __wut_dns_addrinfo_addresses(const struct addrinfo *res, struct in_addr *addresses);
 
 int     __wut_socket_open(struct _reent *r, void *fileStruct, const char *path, int flags, int mode);
 int     __wut_socket_close(struct _reent *r, void *fd);
 ssize_t __wut_socket_write(struct _reent *r, void *fd, const char *ptr, size_t len);
 ssize_t __wut_socket_read(struct _reent *r, void *fd, char *ptr, size_t len);
+int     __wut_socket_fstat(struct _reent *r, void *fd, struct stat *st);
 
@@ -4,8 +4,11 @@ int
 __wut_socket_close(struct _reent *r,
                    void *fd)
 {
-   int sockfd = *(int *)fd;
+   __wut_socket_file *file = (__wut_socket_file *)fd;
+   int sockfd = file->sockfd;
+   OSTime traceStart = __wut_socket_trace_begin();
    int rc = RPLWRAP(socketclose)(sockfd);
+   __wut_socket_trace_end("socket close", NULL, sockfd, rc, traceStart);
    return __wut_get_nsysnet_result(r, rc);
 }
 
@@ -1,20 +1,36 @@
 #include "wut_socket.h"
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+#include <coreinit/event.h>
+#include <coreinit/thread.h>
+#include <wut_socket_init.h>
 
 #define NSYSNET_UNKNOWN_ERROR_OFFSET 10000
 
 int h_errno;
 
+// Set to 1 by the application to bring the network up on first use
+// instead of before main, see wut_socket_init.h
+uint32_t __attribute__((weak)) __wut_socket_deferred_init = 0;
+
+volatile uint32_t __wut_socket_init_state = SOCKET_INIT_NONE;
+
 static devoptab_t
 __wut_socket_devoptab =
 {
    .name         = "soc",
-   .structSize   = sizeof(int),
+   .structSize   = sizeof(__wut_socket_file),
    .open_r       = __wut_socket_open,
    .close_r      = __wut_socket_close,
    .write_r      = __wut_socket_write,
    .read_r       = __wut_socket_read,
+   .fstat_r      = __wut_socket_fstat,
 };
 
+// Index of the socket device in devoptab_list, -1 if it isn't registered
+static int
+__wut_socket_device = -1;
+
 static unsigned char
 __wut_nsysnet_error_code_map[] =
 {
@@ -75,46 +91,149 @@ __wut_nsysnet_error_code_map[] =
 void
 __wut_socket_init_devoptab()
 {
-   AddDevice(&__wut_socket_devoptab);
+   __wut_socket_device = AddDevice(&__wut_socket_devoptab);
 }
 
 void
 __wut_socket_fini_devoptab()
 {
    RemoveDevice("soc:");
+   __wut_socket_device = -1;
 }
 
-void __attribute__((weak))
-__init_wut_socket()
+// Set once __init_wut_socket_early has brought the network up
+static volatile BOOL
+__wut_socket_brought_up = FALSE;
+
+// Signalled once __wut_socket_init_state is SOCKET_INIT_DONE, so threads
+// waiting for another one's init block instead of spinning
+static OSEvent
+__wut_socket_init_done_event;
+
+static void
+__wut_socket_bring_up()
 {
    socket_lib_init();
-   __wut_socket_init_devoptab();
    ACInitialize();
    ACConnectAsync();
 }
 
+// Only calls into nsysnet and nn_ac, so __init_wut runs it on another core
+// while the main thread sets up the devoptab
+void __attribute__((weak))
+__init_wut_socket_early()
+{
+   if (!__wut_socket_deferred_init) {
+      __wut_socket_bring_up();
+      __wut_socket_brought_up = TRUE;
+   }
+}
+
+void
+__wut_socket_init_slow()
+{
+   if (OSCompareAndSwapAtomic(&__wut_socket_init_state, SOCKET_INIT_NONE, SOCKET_INIT_RUNNING)) {
+      if (!__wut_socket_brought_up) {
+         __wut_socket_bring_up();
+      }
+
+      __wut_socket_init_devoptab();
+      __wut_dns_init();
+
+      OSMemoryBarrier();
+      __wut_socket_init_state = SOCKET_INIT_DONE;
+      OSSignalEvent(&__wut_socket_init_done_event);
+      return;
+   }
+
+   // Another thread, maybe of lower priority, is bringing the network up
+   while (__wut_socket_init_state != SOCKET_INIT_DONE) {
+      OSWaitEvent(&__wut_socket_init_done_event);
+   }
+
+   OSMemoryBarrier();
+}
+
+void
+WUTSocketInit(void)
+{
+   __wut_socket_ensure_init();
+}
+
+BOOL
+WUTSocketIsInit(void)
+{
+   return __wut_socket_init_state == SOCKET_INIT_DONE;
+}
+
+void __attribute__((weak))
+__init_wut_socket()
+{
+   OSInitEvent(&__wut_socket_init_done_event, FALSE, OS_EVENT_MODE_MANUAL);
+
+   if (!__wut_socket_deferred_init) {
+      __wut_socket_init_slow();
+   }
+}
+
 void __attribute__((weak))
 __fini_wut_socket()
 {
+   if (__wut_socket_init_state != SOCKET_INIT_DONE) {
+      return;
+   }
+
    ACClose();
    ACFinalize();
+   __wut_dns_fini();
    __wut_socket_fini_devoptab();
    socket_lib_finish();
+   __wut_socket_brought_up = FALSE;
+   __wut_socket_init_state = SOCKET_INIT_NONE;
+   OSResetEvent(&__wut_socket_init_done_event);
 }
 
-int
-__wut_get_nsysnet_fd(int fd)
+__wut_socket_file *
+__wut_get_socket_file(int fd)
 {
    __handle *handle = __get_handle(fd);
    if (handle == NULL) {
       errno = EBADF;
-      return -1;
+      return NULL;
    }
-   if (strcmp(devoptab_list[handle->device]->name, "soc") != 0) {
+   if (handle->device != __wut_socket_device) {
       errno = ENOTSOCK;
+      return NULL;
+   }
+   return (__wut_socket_file *)handle->fileStruct;
+}
+
+void
+__wut_socket_file_init(int fd,
+                       int sockfd)
+{
+   __wut_socket_file *file = (__wut_socket_file *)__get_handle(fd)->fileStruct;
+   file->sockfd = sockfd;
+}
+
+int
+__wut_get_nsysnet_fd(int fd)
+{
+   __wut_socket_file *file = __wut_get_socket_file(fd);
+   if (file == NULL) {
       return -1;
    }
-   return *(int *)handle->fileStruct;
+   return file->sockfd;
+}
+
+int
+__wut_nsysnet_error_to_errno(int sockerror)
+{
+   if (sockerror < sizeof(__wut_nsysnet_error_code_map)) {
+      return __wut_nsysnet_error_code_map[sockerror];
+   }
+
+   return NSYSNET_UNKNOWN_ERROR_OFFSET + sockerror;
 }
 
 int
@@ -133,10 +252,10 @@ __wut_get_nsysnet_result(struct _reent *r,
       return -1;
    }
 
-   if (sockerror < sizeof(__wut_nsysnet_error_code_map)) {
-      error = __wut_nsysnet_error_code_map[sockerror];
-   } else {
-      error = NSYSNET_UNKNOWN_ERROR_OFFSET + sockerror;
+   error = __wut_nsysnet_error_to_errno(sockerror);
+
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_record_error(sockerror, error);
    }
 
    if (r) {
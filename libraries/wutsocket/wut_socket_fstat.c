@@ -0,0 +1,17 @@
+#include "wut_socket.h"
+#include <wut_socket_stdio.h>
+
+// Reported as st_blksize, stdio sizes the buffer of a plain fdopen stream by it
+uint32_t __attribute__((weak)) __wut_socket_stdio_buffer_size = WUT_SOCKET_STDIO_DEFAULT_BUFFER_SIZE;
+
+int
+__wut_socket_fstat(struct _reent *r,
+                   void *fd,
+                   struct stat *st)
+{
+   memset(st, 0, sizeof(struct stat));
+   st->st_mode = S_IFSOCK | S_IRUSR | S_IWUSR;
+   st->st_nlink = 1;
+   st->st_blksize = __wut_socket_stdio_buffer_size;
+   return 0;
+}
@@ -0,0 +1,128 @@
+#include "wut_socket.h"
+#include <coreinit/atomic.h>
+#include <coreinit/atomic64.h>
+#include <wut_socket_stats.h>
+
+volatile uint32_t __wut_socket_stats_enabled = 0;
+
+static WUTSocketStats sGlobalStats;
+
+// Indexed by nsysnet fd
+static WUTSocketStats sSocketStats[NSYSNET_FD_SETSIZE];
+
+static void
+__wut_socket_stats_count_error(WUTSocketStats *stats,
+                               int sockerror,
+                               int error)
+{
+   if (sockerror >= WUT_SOCKET_STATS_ERROR_CODES) {
+      sockerror = WUT_SOCKET_STATS_ERROR_CODES - 1;
+   }
+
+   OSAddAtomic((volatile int32_t *)&stats->errors, 1);
+   OSAddAtomic((volatile int32_t *)&stats->errorCodes[sockerror], 1);
+   if (error == EWOULDBLOCK || error == EAGAIN) {
+      OSAddAtomic((volatile int32_t *)&stats->wouldBlock, 1);
+   }
+}
+
+void
+__wut_socket_stats_record_error(int sockerror,
+                                int error)
+{
+   if (sockerror < 0) {
+      return;
+   }
+
+   __wut_socket_stats_count_error(&sGlobalStats, sockerror, error);
+}
+
+void
+__wut_socket_stats_add(int sockfd,
+                       int send,
+                       int rc)
+{
+   WUTSocketStats *stats = NULL;
+
+   if (sockfd >= 0 && sockfd < NSYSNET_FD_SETSIZE) {
+      stats = &sSocketStats[sockfd];
+   }
+
+   OSAddAtomic((volatile int32_t *)(send ? &sGlobalStats.sendCalls : &sGlobalStats.recvCalls), 1);
+   if (rc > 0) {
+      OSAddAtomic64((volatile int64_t *)(send ? &sGlobalStats.bytesOut : &sGlobalStats.bytesIn), rc);
+   }
+
+   if (!stats) {
+      return;
+   }
+
+   OSAddAtomic((volatile int32_t *)(send ? &stats->sendCalls : &stats->recvCalls), 1);
+   if (rc > 0) {
+      OSAddAtomic64((volatile int64_t *)(send ? &stats->bytesOut : &stats->bytesIn), rc);
+   } else if (rc < 0) {
+      // Still the error of this call, __wut_get_nsysnet_result reads it again
+      int sockerror = RPLWRAP(socketlasterr)();
+      if (sockerror >= 0) {
+         __wut_socket_stats_count_error(stats, sockerror, __wut_nsysnet_error_to_errno(sockerror));
+      }
+   }
+}
+
+void
+__wut_socket_stats_reset_socket(int sockfd)
+{
+   if (sockfd >= 0 && sockfd < NSYSNET_FD_SETSIZE) {
+      memset(&sSocketStats[sockfd], 0, sizeof(WUTSocketStats));
+   }
+}
+
+void
+WUTSocketSetStatsEnabled(BOOL enabled)
+{
+   __wut_socket_stats_enabled = enabled;
+}
+
+BOOL
+WUTSocketGetStats(int fd,
+                  WUTSocketStats *outStats)
+{
+   int sockfd;
+
+   if (!outStats) {
+      return FALSE;
+   }
+
+   if (fd == -1) {
+      memcpy(outStats, &sGlobalStats, sizeof(WUTSocketStats));
+      return TRUE;
+   }
+
+   sockfd = __wut_get_nsysnet_fd(fd);
+   if (sockfd < 0 || sockfd >= NSYSNET_FD_SETSIZE) {
+      return FALSE;
+   }
+
+   memcpy(outStats, &sSocketStats[sockfd], sizeof(WUTSocketStats));
+   return TRUE;
+}
+
+BOOL
+WUTSocketResetStats(int fd)
+{
+   int sockfd;
+
+   if (fd == -1) {
+      memset(&sGlobalStats, 0, sizeof(WUTSocketStats));
+      memset(sSocketStats, 0, sizeof(sSocketStats));
+      return TRUE;
+   }
+
+   sockfd = __wut_get_nsysnet_fd(fd);
+   if (sockfd < 0 || sockfd >= NSYSNET_FD_SETSIZE) {
+      return FALSE;
+   }
+
+   __wut_socket_stats_reset_socket(sockfd);
+   return TRUE;
+}
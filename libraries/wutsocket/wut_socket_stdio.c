@@ -0,0 +1,31 @@
+#include "wut_socket.h"
+#include <wut_socket_stdio.h>
+
+FILE *
+wut_socket_fdopen(int fd,
+                  const char *mode,
+                  size_t bufferSize)
+{
+   FILE *stream;
+
+   if (!__wut_get_socket_file(fd)) {
+      return NULL;
+   }
+
+   if (!bufferSize) {
+      bufferSize = WUT_SOCKET_STDIO_DEFAULT_BUFFER_SIZE;
+   }
+   bufferSize = (bufferSize + WUT_SOCKET_STDIO_BUFFER_ALIGN - 1) & ~(WUT_SOCKET_STDIO_BUFFER_ALIGN - 1);
+
+   stream = fdopen(fd, mode);
+   if (!stream) {
+      return NULL;
+   }
+
+   // newlib allocates the buffer and frees it in fclose, so it lives as long
+   // as the stream even if the socket is closed first. Above the unit heap
+   // sizes malloc returns cache line aligned blocks. On failure the stream
+   // keeps its default buffer.
+   setvbuf(stream, NULL, _IOFBF, bufferSize);
+   return stream;
+}
@@ -7,7 +7,12 @@ __wut_socket_write(struct _reent *r,
                    size_t len)
 {
    int sockfd = *(int *)fd;
+   OSTime traceStart = __wut_socket_trace_begin();
    int rc = RPLWRAP(send)(sockfd, ptr, len, 0);
+   __wut_socket_trace_end("socket write", NULL, sockfd, rc, traceStart);
+   if (__wut_socket_stats_enabled) {
+      __wut_socket_stats_add(sockfd, 1, rc);
+   }
    return (ssize_t)__wut_get_nsysnet_result(r, rc);
 }
 
@@ -0,0 +1,238 @@
+#include "wut_socket.h"
+#include <wut_tcp_stream.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+
+struct wut_tcp_stream
+{
+   int fd;
+   uint32_t corks;
+
+   //! Buffered data is in buffer[start, end)
+   char *buffer;
+   size_t size;
+   size_t start;
+   size_t end;
+};
+
+static ssize_t
+__wut_tcp_stream_send(wut_tcp_stream_t *stream,
+                      const char *buf,
+                      size_t len)
+{
+   size_t sent = 0;
+
+   while (sent < len) {
+      ssize_t rc = send(stream->fd, buf + sent, len - sent, 0);
+      if (rc < 0) {
+         if (errno == EINTR) {
+            continue;
+         }
+
+         return sent ? (ssize_t)sent : -1;
+      }
+
+      sent += rc;
+   }
+
+   return (ssize_t)sent;
+}
+
+wut_tcp_stream_t *
+wut_tcp_stream_create(int fd,
+                      size_t bufferSize)
+{
+   wut_tcp_stream_t *stream;
+   int nodelay = 1;
+
+   if (!bufferSize) {
+      bufferSize = WUT_TCP_STREAM_DEFAULT_BUFFER_SIZE;
+   }
+
+   // Writes are coalesced here, so Nagle would only delay each flush
+   if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay)) == -1) {
+      return NULL;
+   }
+
+   stream = (wut_tcp_stream_t *)malloc(sizeof(wut_tcp_stream_t));
+   if (!stream) {
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   stream->buffer = (char *)WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_SOCKET, bufferSize, 8);
+   if (!stream->buffer) {
+      free(stream);
+      errno = ENOMEM;
+      return NULL;
+   }
+
+   stream->fd = fd;
+   stream->corks = 0;
+   stream->size = bufferSize;
+   stream->start = 0;
+   stream->end = 0;
+   return stream;
+}
+
+void
+wut_tcp_stream_destroy(wut_tcp_stream_t *stream)
+{
+   if (!stream) {
+      return;
+   }
+
+   wut_tcp_stream_flush(stream);
+   WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_SOCKET, stream->buffer);
+   free(stream);
+}
+
+int
+wut_tcp_stream_flush(wut_tcp_stream_t *stream)
+{
+   ssize_t rc;
+
+   if (stream->start == stream->end) {
+      return 0;
+   }
+
+   rc = __wut_tcp_stream_send(stream, stream->buffer + stream->start,
+                              stream->end - stream->start);
+   if (rc > 0) {
+      stream->start += rc;
+   }
+
+   if (stream->start == stream->end) {
+      stream->start = 0;
+      stream->end = 0;
+      return 0;
+   }
+
+   if (rc >= 0) {
+      errno = EWOULDBLOCK;
+   }
+
+   return -1;
+}
+
+// Move what a partial flush left to the front of the buffer
+static void
+__wut_tcp_stream_compact(wut_tcp_stream_t *stream)
+{
+   if (stream->start) {
+      memmove(stream->buffer, stream->buffer + stream->start, stream->end - stream->start);
+      stream->end -= stream->start;
+      stream->start = 0;
+   }
+}
+
+static ssize_t
+__wut_tcp_stream_append(wut_tcp_stream_t *stream,
+                        const char *buf,
+                        size_t len)
+{
+   size_t space;
+
+   if (len > stream->size - stream->end) {
+      __wut_tcp_stream_compact(stream);
+   }
+
+   // Empty the buffer rather than split a write over two sends
+   if (len > stream->size - stream->end && stream->end) {
+      if (wut_tcp_stream_flush(stream) == -1 && errno != EWOULDBLOCK) {
+         return -1;
+      }
+
+      __wut_tcp_stream_compact(stream);
+   }
+
+   // Too big to buffer at all, send it straight after the buffered data
+   if (len >= stream->size && !stream->end) {
+      return __wut_tcp_stream_send(stream, buf, len);
+   }
+
+   space = stream->size - stream->end;
+   if (len > space) {
+      len = space;
+   }
+
+   if (!len) {
+      errno = EWOULDBLOCK;
+      return -1;
+   }
+
+   memcpy(stream->buffer + stream->end, buf, len);
+   stream->end += len;
+   return (ssize_t)len;
+}
+
+ssize_t
+wut_tcp_stream_write(wut_tcp_stream_t *stream,
+                     const void *buf,
+                     size_t len)
+{
+   struct iovec iov;
+   iov.iov_base = (void *)buf;
+   iov.iov_len = len;
+   return wut_tcp_stream_writev(stream, &iov, 1);
+}
+
+ssize_t
+wut_tcp_stream_writev(wut_tcp_stream_t *stream,
+                      const struct iovec *iov,
+                      int iovcnt)
+{
+   size_t total = 0;
+   int i;
+
+   if (!stream || iovcnt < 0 || (iovcnt && !iov)) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   for (i = 0; i < iovcnt; i++) {
+      const char *ptr = (const char *)iov[i].iov_base;
+      size_t left = iov[i].iov_len;
+
+      while (left) {
+         ssize_t rc = __wut_tcp_stream_append(stream, ptr, left);
+         if (rc < 0) {
+            return total ? (ssize_t)total : -1;
+         }
+
+         ptr += rc;
+         left -= rc;
+         total += rc;
+      }
+   }
+
+   // Data a non-blocking socket couldn't take yet stays buffered
+   if (!stream->corks && wut_tcp_stream_flush(stream) == -1 && errno != EWOULDBLOCK) {
+      return -1;
+   }
+
+   return (ssize_t)total;
+}
+
+void
+wut_tcp_stream_cork(wut_tcp_stream_t *stream)
+{
+   stream->corks++;
+}
+
+int
+wut_tcp_stream_uncork(wut_tcp_stream_t *stream)
+{
+   if (stream->corks && --stream->corks) {
+      return 0;
+   }
+
+   return wut_tcp_stream_flush(stream);
+}
+
+size_t
+wut_tcp_stream_pending(wut_tcp_stream_t *stream)
+{
+   return stream->end - stream->start;
+}
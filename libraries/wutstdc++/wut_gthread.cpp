@@ -73,6 +73,10 @@ int __gthr_impl_mutex_trylock (__gthread_mutex_t *__mutex) {
    return __wut_mutex_trylock((OSMutex*)__mutex);
 }
 
+int __gthr_impl_mutex_timedlock (__gthread_mutex_t *__mutex, const __gthread_time_t *__abs_timeout) {
+   return __wut_mutex_timedlock((OSMutex*)__mutex, __abs_timeout);
+}
+
 int __gthr_impl_mutex_unlock (__gthread_mutex_t *__mutex) {
    return __wut_mutex_unlock((OSMutex*)__mutex);
 }
@@ -89,6 +93,10 @@ int __gthr_impl_recursive_mutex_trylock (__gthread_recursive_mutex_t *__mutex) {
    return __wut_recursive_mutex_trylock((OSMutex*)__mutex);
 }
 
+int __gthr_impl_recursive_mutex_timedlock (__gthread_recursive_mutex_t *__mutex, const __gthread_time_t *__abs_timeout) {
+   return __wut_recursive_mutex_timedlock((OSMutex*)__mutex, __abs_timeout);
+}
+
 int __gthr_impl_recursive_mutex_unlock (__gthread_recursive_mutex_t *__mutex) {
    return __wut_recursive_mutex_unlock((OSMutex*)__mutex);
 }
@@ -128,10 +136,12 @@ int __gthr_impl_cond_destroy (__gthread_cond_t* __cond) {
 
 void __init_wut_stdcpp()
 {
+   __init_wut_thread_pool();
 }
 
 void __fini_wut_stdcpp()
 {
+   __fini_wut_thread_pool();
 }
 
 }
@@ -5,6 +5,7 @@
 #include <coreinit/condition.h>
 #include <coreinit/thread.h>
 #include <coreinit/mutex.h>
+#include <coreinit/fastmutex.h>
 
 #define __WUT_MAX_KEYS (128)
 #define __WUT_STACK_SIZE (128*1024)
@@ -12,9 +13,13 @@
 #define __WUT_ONCE_VALUE_INIT (0)
 #define __WUT_ONCE_VALUE_STARTED (1)
 #define __WUT_ONCE_VALUE_DONE (2)
+#define __WUT_ONCE_VALUE_WAITING (3)
 
 #define __WUT_KEY_THREAD_SPECIFIC_ID (0)
 
+// std::mutex can be backed by either, see __wut_gthread_fast_mutex
+#define __WUT_IS_FAST_MUTEX(mutex) ((mutex)->tag == OS_FAST_MUTEX_TAG)
+
 typedef volatile uint32_t __wut_once_t;
 typedef struct {
    uint32_t index;
@@ -23,6 +28,12 @@ typedef struct {
 void
 __init_wut_gthread();
 
+void
+__init_wut_thread_pool();
+
+void
+__fini_wut_thread_pool();
+
 int
 __wut_active_p();
 
@@ -35,6 +46,11 @@ int
 __wut_thread_join(OSThread * thread,
                   void **outValue);
 
+int
+__wut_thread_timedjoin(OSThread *thread,
+                       void **outValue,
+                       OSTime timeout);
+
 int
 __wut_thread_detach(OSThread * thread);
 
@@ -53,7 +69,8 @@ __wut_once(__wut_once_t *once,
            void (*func) (void));
 
 void
-__wut_key_cleanup(OSThread *thread);
+__wut_key_cleanup(OSThread *thread,
+                  bool freeKeys);
 
 int
 __wut_key_create(__wut_key_t *key,
@@ -81,6 +98,14 @@ __wut_mutex_lock(OSMutex *mutex);
 int
 __wut_mutex_trylock(OSMutex *mutex);
 
+int
+__wut_mutex_timedlock_ticks(OSMutex *mutex,
+                            OSTime timeout);
+
+int
+__wut_mutex_timedlock(OSMutex *mutex,
+                      const __gthread_time_t *abs_timeout);
+
 int
 __wut_mutex_unlock(OSMutex *mutex);
 
@@ -93,12 +118,19 @@ __wut_recursive_mutex_lock(OSMutex *mutex);
 int
 __wut_recursive_mutex_trylock(OSMutex *mutex);
 
+int
+__wut_recursive_mutex_timedlock(OSMutex *mutex,
+                                const __gthread_time_t *abs_timeout);
+
 int
 __wut_recursive_mutex_unlock(OSMutex *mutex);
 
 int
 __wut_recursive_mutex_destroy(OSMutex *mutex);
 
+OSTime
+__wut_gthread_abs_timeout_to_ticks(const __gthread_time_t *abs_timeout);
+
 void
 __wut_cond_init_function(OSCondition *cond);
 
@@ -4,91 +4,253 @@
 #include <sys/errno.h>
 #include <sys/time.h>
 
-#include <coreinit/alarm.h>
+#include <coreinit/event.h>
+#include <coreinit/interrupts.h>
 #include <coreinit/systeminfo.h>
 #include <coreinit/time.h>
 
+/*
+ * OSSignalCond wakes every waiting thread, so the condition variables are
+ * implemented here on top of the OSCondition storage instead. Each waiter
+ * queues an auto reset OSEvent on its stack, signal wakes the first one
+ * and broadcast all of them. The queue is guarded by a small spin lock
+ * taken with interrupts disabled, as signalling does not require holding
+ * the mutex. The events are only signalled after the lock is released.
+ */
+
+struct __wut_cond_waiter_t
+{
+   OSEvent event;
+   __wut_cond_waiter_t *next;
+   bool signalled;
+};
+
+struct __wut_cond_t
+{
+   uint32_t tag;
+   volatile uint32_t lock;
+   __wut_cond_waiter_t *head;
+   __wut_cond_waiter_t *tail;
+};
+static_assert(sizeof(__wut_cond_t) <= sizeof(OSCondition), "__wut_cond_t must fit in OSCondition");
+
+#define __WUT_COND_TAG 0x77436E64u
+
+static inline int
+__wut_cond_lock(__wut_cond_t *cond)
+{
+   int state = OSDisableInterrupts();
+   while (!OSCompareAndSwapAtomic(&cond->lock, 0, 1));
+   return state;
+}
+
+static inline void
+__wut_cond_unlock(__wut_cond_t *cond,
+                  int state)
+{
+   OSSwapAtomic(&cond->lock, 0);
+   OSRestoreInterrupts(state);
+}
+
 void
 __wut_cond_init_function(OSCondition *cond)
 {
-   OSInitCond(cond);
+   __wut_cond_t *c = (__wut_cond_t *)cond;
+   c->tag = __WUT_COND_TAG;
+   c->lock = 0;
+   c->head = NULL;
+   c->tail = NULL;
+}
+
+static void
+__wut_cond_wake(OSCondition *cond,
+                bool all)
+{
+   __wut_cond_t *c = (__wut_cond_t *)cond;
+   int state = __wut_cond_lock(c);
+
+   // Unlink the waiters to wake, they stay queued on their events until
+   // signalled so the list can be walked once the lock is released
+   __wut_cond_waiter_t *waiter = c->head;
+   __wut_cond_waiter_t *last = all ? c->tail : waiter;
+   if (waiter) {
+      c->head = last->next;
+      if (!c->head) {
+         c->tail = NULL;
+      }
+
+      for (__wut_cond_waiter_t *w = waiter; ; w = w->next) {
+         w->signalled = true;
+         if (w == last) {
+            break;
+         }
+      }
+   }
+
+   __wut_cond_unlock(c, state);
+
+   // Signal with interrupts enabled, OSSignalEvent may reschedule
+   while (waiter) {
+      // The waiter may return as soon as it is signalled
+      __wut_cond_waiter_t *next = waiter->next;
+      bool done = waiter == last;
+      OSSignalEvent(&waiter->event);
+      if (done) {
+         break;
+      }
+      waiter = next;
+   }
 }
 
 int
 __wut_cond_broadcast(OSCondition *cond)
 {
-   OSSignalCond(cond);
+   __wut_cond_wake(cond, true);
    return 0;
 }
 
 int
 __wut_cond_signal(OSCondition *cond)
 {
-   OSSignalCond(cond);
+   __wut_cond_wake(cond, false);
    return 0;
 }
 
+static void
+__wut_cond_enqueue(__wut_cond_t *c,
+                   __wut_cond_waiter_t *waiter)
+{
+   OSInitEvent(&waiter->event, FALSE, OS_EVENT_MODE_AUTO);
+   waiter->next = NULL;
+   waiter->signalled = false;
+
+   int state = __wut_cond_lock(c);
+   if (c->tail) {
+      c->tail->next = waiter;
+   } else {
+      c->head = waiter;
+   }
+   c->tail = waiter;
+   __wut_cond_unlock(c, state);
+}
+
+//! Remove a waiter that timed out, returns false if it was signalled meanwhile
+static bool
+__wut_cond_dequeue(__wut_cond_t *c,
+                   __wut_cond_waiter_t *waiter)
+{
+   bool removed = false;
+   int state = __wut_cond_lock(c);
+   if (!waiter->signalled) {
+      __wut_cond_waiter_t *prev = NULL;
+      for (__wut_cond_waiter_t *w = c->head; w; prev = w, w = w->next) {
+         if (w != waiter) {
+            continue;
+         }
+
+         if (prev) {
+            prev->next = w->next;
+         } else {
+            c->head = w->next;
+         }
+         if (c->tail == w) {
+            c->tail = prev;
+         }
+         removed = true;
+         break;
+      }
+   }
+   __wut_cond_unlock(c, state);
+   return removed;
+}
+
+//! Release every recursion level of the mutex, returns the count to restore
+static int32_t
+__wut_cond_release_mutex(OSMutex *mutex)
+{
+   if (__WUT_IS_FAST_MUTEX(mutex)) {
+      OSFastMutex_Unlock((OSFastMutex *)mutex);
+      return -1;
+   }
+
+   int32_t count = mutex->count;
+   for (int32_t i = 0; i < count; ++i) {
+      OSUnlockMutex(mutex);
+   }
+   return count;
+}
+
+static void
+__wut_cond_reacquire_mutex(OSMutex *mutex,
+                           int32_t count)
+{
+   if (count < 0) {
+      OSFastMutex_Lock((OSFastMutex *)mutex);
+      return;
+   }
+
+   for (int32_t i = 0; i < count; ++i) {
+      OSLockMutex(mutex);
+   }
+}
+
 int
 __wut_cond_wait(OSCondition *cond,
                 OSMutex *mutex)
 {
-   OSWaitCond(cond, mutex);
+   __wut_cond_waiter_t waiter;
+   __wut_cond_enqueue((__wut_cond_t *)cond, &waiter);
+
+   int32_t count = __wut_cond_release_mutex(mutex);
+   OSWaitEvent(&waiter.event);
+   __wut_cond_reacquire_mutex(mutex, count);
    return 0;
 }
 
-struct __wut_cond_timedwait_data_t
+//! Convert an absolute CLOCK_REALTIME timeout to OSGetTime ticks
+OSTime
+__wut_gthread_abs_timeout_to_ticks(const __gthread_time_t *abs_timeout)
 {
-   OSCondition *cond;
-   bool timed_out;
-};
-
-static void
-__wut_cond_timedwait_alarm_callback(OSAlarm *alarm,
-                                    OSContext *context)
-{
-   __wut_cond_timedwait_data_t *data = (__wut_cond_timedwait_data_t *)OSGetAlarmUserData(alarm);
-   data->timed_out = true;
-   OSSignalCond(data->cond);
+   return OSSecondsToTicks(abs_timeout->tv_sec - EPOCH_DIFF_SECS(WIIU_OSTIME_EPOCH_YEAR)) +
+          OSNanosecondsToTicks(abs_timeout->tv_nsec);
 }
 
 int
 __wut_cond_timedwait(OSCondition *cond, OSMutex *mutex,
                      const __gthread_time_t *abs_timeout)
 {
-   __wut_cond_timedwait_data_t data;
-   data.timed_out = false;
-   data.cond = cond;
+   __wut_cond_t *c = (__wut_cond_t *)cond;
+   __wut_cond_waiter_t waiter;
 
    OSTime time = OSGetTime();
-   OSTime timeout =
-      OSSecondsToTicks(abs_timeout->tv_sec - EPOCH_DIFF_SECS(WIIU_OSTIME_EPOCH_YEAR)) +
-      OSNanosecondsToTicks(abs_timeout->tv_nsec);
+   OSTime timeout = __wut_gthread_abs_timeout_to_ticks(abs_timeout);
 
    // Already timed out!
    if (timeout <= time) {
       return ETIMEDOUT;
    }
 
-   // Set an alarm
-   OSAlarm alarm;
-   OSCreateAlarm(&alarm);
-   OSSetAlarmUserData(&alarm, &data);
-   OSSetAlarm(&alarm, timeout - time,
-              &__wut_cond_timedwait_alarm_callback);
+   __wut_cond_enqueue(c, &waiter);
 
-   // Wait on the condition
-   OSWaitCond(cond, mutex);
+   // OSWaitEventWithTimeout takes the timeout in nanoseconds
+   int32_t count = __wut_cond_release_mutex(mutex);
+   bool timedOut = !OSWaitEventWithTimeout(&waiter.event, OSTicksToNanoseconds(timeout - time));
+   if (timedOut && !__wut_cond_dequeue(c, &waiter)) {
+      // Signalled right as the wait timed out, consume the wakeup so the
+      // event isn't signalled after the waiter is gone
+      OSWaitEvent(&waiter.event);
+      timedOut = false;
+   }
+   __wut_cond_reacquire_mutex(mutex, count);
 
-   OSCancelAlarm(&alarm);
-   return data.timed_out ? ETIMEDOUT : 0;
+   return timedOut ? ETIMEDOUT : 0;
 }
 
 int
 __wut_cond_wait_recursive(OSCondition *cond,
                         OSMutex *mutex)
 {
-   OSWaitCond(cond, mutex);
-   return 0;
+   return __wut_cond_wait(cond, mutex);
 }
 
 int
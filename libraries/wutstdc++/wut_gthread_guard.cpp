@@ -0,0 +1,98 @@
+#include "wut_gthread.h"
+
+#include <coreinit/cache.h>
+
+/*
+ * Guards for function-local statics, replacing libsupc++'s which take a
+ * global recursive mutex and condition for every first-time initialisation.
+ *
+ * The state lives in the first word of the 64-bit guard. The compiler only
+ * calls __cxa_guard_acquire after finding the first byte clear, so the done
+ * flag has to be that byte, the most significant one on big-endian PPC.
+ * Once a static is initialised no further calls are made at all.
+ */
+#define __WUT_GUARD_DONE     (0x01000000)
+#define __WUT_GUARD_PENDING  (0x00010000)
+#define __WUT_GUARD_WAITING  (0x00000100)
+
+// Shared by every guard, only used while one is contended
+static OSMutex sGuardMutex;
+static OSCondition sGuardCond;
+static volatile uint32_t sGuardSyncState = 0;
+
+static void
+__wut_guard_sync_init()
+{
+   uint32_t value = 0;
+
+   if (OSCompareAndSwapAtomicEx(&sGuardSyncState, 0, 1, &value)) {
+      OSInitMutexEx(&sGuardMutex, "wut guard");
+      OSInitCondEx(&sGuardCond, "wut guard");
+      OSSwapAtomic(&sGuardSyncState, 2);
+   } else {
+      while (sGuardSyncState != 2) {
+         OSYieldThread();
+      }
+   }
+}
+
+static void
+__wut_guard_wake(uint32_t previous)
+{
+   // Only wake threads if any went to sleep
+   if (previous & __WUT_GUARD_WAITING) {
+      OSLockMutex(&sGuardMutex);
+      OSSignalCond(&sGuardCond);
+      OSUnlockMutex(&sGuardMutex);
+   }
+}
+
+extern "C" int
+__cxa_guard_acquire(int64_t *guard)
+{
+   volatile uint32_t *state = (volatile uint32_t *)guard;
+   uint32_t value = 0;
+
+   while (true) {
+      if (OSCompareAndSwapAtomicEx(state, 0, __WUT_GUARD_PENDING, &value)) {
+         // The caller runs the initialiser
+         return 1;
+      }
+
+      if (value & __WUT_GUARD_DONE) {
+         // Reads of the static must not be satisfied before the guard's
+         OSMemoryBarrier();
+         return 0;
+      }
+
+      // Another thread is initialising, sleep until it finishes or aborts.
+      // OSSignalCond wakes every waiting thread.
+      __wut_guard_sync_init();
+      OSLockMutex(&sGuardMutex);
+      OSCompareAndSwapAtomic(state, __WUT_GUARD_PENDING,
+                             __WUT_GUARD_PENDING | __WUT_GUARD_WAITING);
+      while (*state & __WUT_GUARD_PENDING) {
+         OSWaitCond(&sGuardCond, &sGuardMutex);
+      }
+      OSUnlockMutex(&sGuardMutex);
+   }
+}
+
+extern "C" void
+__cxa_guard_release(int64_t *guard)
+{
+   volatile uint32_t *state = (volatile uint32_t *)guard;
+
+   // The static must be visible before the done flag
+   OSMemoryBarrier();
+   __wut_guard_wake(OSSwapAtomic(state, __WUT_GUARD_DONE));
+}
+
+extern "C" void
+__cxa_guard_abort(int64_t *guard)
+{
+   volatile uint32_t *state = (volatile uint32_t *)guard;
+
+   // Let the next thread try to initialise it
+   __wut_guard_wake(OSSwapAtomic(state, 0));
+}
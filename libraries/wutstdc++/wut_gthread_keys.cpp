@@ -56,20 +56,23 @@ __wut_key_delete(__wut_key_t key)
    return -1;
 }
 
-static const void **
+static inline const void **
 __wut_get_thread_keys()
 {
-   const void **keys = (const void **)OSGetThreadSpecific(__WUT_KEY_THREAD_SPECIFIC_ID);
-   if (!keys) {
-      keys = (const void **)malloc(sizeof(void *) * sizeof(__WUT_MAX_KEYS));
-      if (!keys) {
-         return NULL;
-      }
+   // Read the slot directly instead of calling OSGetThreadSpecific, threads
+   // created through gthreads already have their key array set
+   OSThread *thread = OSGetCurrentThread();
+   const void **keys = (const void **)thread->specific[__WUT_KEY_THREAD_SPECIFIC_ID];
+   if (__builtin_expect(keys != NULL, 1)) {
+      return keys;
+   }
 
-      memset(keys, 0, sizeof(void *) * sizeof(__WUT_MAX_KEYS));
-      OSSetThreadSpecific(__WUT_KEY_THREAD_SPECIFIC_ID, keys);
+   keys = (const void **)calloc(__WUT_MAX_KEYS, sizeof(void *));
+   if (!keys) {
+      return NULL;
    }
 
+   thread->specific[__WUT_KEY_THREAD_SPECIFIC_ID] = keys;
    return keys;
 }
 
@@ -98,9 +101,10 @@ __wut_setspecific(__wut_key_t key,
 }
 
 void
-__wut_key_cleanup(OSThread *thread)
+__wut_key_cleanup(OSThread *thread,
+                  bool freeKeys)
 {
-   void **keys = (void **)OSGetThreadSpecific(__WUT_KEY_THREAD_SPECIFIC_ID);
+   void **keys = (void **)thread->specific[__WUT_KEY_THREAD_SPECIFIC_ID];
    if (!keys) {
       return;
    }
@@ -108,11 +112,18 @@ __wut_key_cleanup(OSThread *thread)
    __wut_mutex_lock(&key_mutex);
 
    for (int i = 0; i < __WUT_MAX_KEYS; ++i) {
-      if (key_table[i].in_use && key_table[i].dtor && keys[i]) {
-         key_table[i].dtor(keys[i]);
+      void *value = keys[i];
+      keys[i] = NULL;
+
+      if (key_table[i].in_use && key_table[i].dtor && value) {
+         key_table[i].dtor(value);
       }
    }
 
    __wut_mutex_unlock(&key_mutex);
-   free(keys);
+
+   thread->specific[__WUT_KEY_THREAD_SPECIFIC_ID] = NULL;
+   if (freeKeys) {
+      free(keys);
+   }
 }
@@ -1,21 +1,50 @@
 #include "wut_gthread.h"
+#include "../wutnewlib/wut_lock_stats.h"
+
+#include <coreinit/fastmutex.h>
+#include <coreinit/time.h>
+#include <sys/errno.h>
+
+// Set to 1 to back std::mutex with OSFastMutex, which is cheaper to lock
+// and unlock when uncontended. Checked when a mutex is initialised, so it
+// can be changed at runtime for mutexes created afterwards.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_gthread_fast_mutex = 0;
+
+static_assert(sizeof(OSFastMutex) <= sizeof(OSMutex), "OSFastMutex must fit in OSMutex");
 
 void
 __wut_mutex_init_function(OSMutex *mutex)
 {
-   OSInitMutex(mutex);
+   if (__wut_gthread_fast_mutex) {
+      OSFastMutex_Init((OSFastMutex *)mutex, NULL);
+   } else {
+      OSInitMutex(mutex);
+   }
 }
 
 int
 __wut_mutex_lock(OSMutex *mutex)
 {
-   OSLockMutex(mutex);
+   if (!__WUT_IS_FAST_MUTEX(mutex)) {
+      __wut_lock_stats_lock_mutex(mutex);
+   } else if (!__wut_lock_stats_enabled) {
+      OSFastMutex_Lock((OSFastMutex *)mutex);
+   } else if (!OSFastMutex_TryLock((OSFastMutex *)mutex)) {
+      OSTime start = OSGetSystemTime();
+      OSFastMutex_Lock((OSFastMutex *)mutex);
+      __wut_lock_stats_record(mutex, ((OSFastMutex *)mutex)->name, OSGetSystemTime() - start);
+   }
    return 0;
 }
 
 int
 __wut_mutex_trylock(OSMutex *mutex)
 {
+   if (__WUT_IS_FAST_MUTEX(mutex)) {
+      return OSFastMutex_TryLock((OSFastMutex *)mutex) ? 0 : -1;
+   }
+
    if (!OSTryLockMutex(mutex)) {
       return -1;
    }
@@ -23,10 +52,49 @@ __wut_mutex_trylock(OSMutex *mutex)
    return 0;
 }
 
+/*
+ * Neither OSMutex nor OSFastMutex can be locked with a timeout, so a timed
+ * lock polls with a sleep that starts at 20 microseconds and doubles up to
+ * 1 millisecond. OSSleepTicks waits on an alarm on the stack, so unlike a
+ * wait on an OSCondition nothing has to be created or cancelled per call.
+ */
+int
+__wut_mutex_timedlock_ticks(OSMutex *mutex,
+                            OSTime timeout)
+{
+   OSTime backoff = OSMicrosecondsToTicks(20);
+   OSTime maxBackoff = OSMillisecondsToTicks(1);
+
+   while (__wut_mutex_trylock(mutex) != 0) {
+      OSTime now = OSGetTime();
+      if (now >= timeout) {
+         return ETIMEDOUT;
+      }
+
+      OSSleepTicks(backoff < timeout - now ? backoff : timeout - now);
+      if (backoff < maxBackoff) {
+         backoff *= 2;
+      }
+   }
+
+   return 0;
+}
+
+int
+__wut_mutex_timedlock(OSMutex *mutex,
+                      const __gthread_time_t *abs_timeout)
+{
+   return __wut_mutex_timedlock_ticks(mutex, __wut_gthread_abs_timeout_to_ticks(abs_timeout));
+}
+
 int
 __wut_mutex_unlock(OSMutex *mutex)
 {
-   OSUnlockMutex(mutex);
+   if (__WUT_IS_FAST_MUTEX(mutex)) {
+      OSFastMutex_Unlock((OSFastMutex *)mutex);
+   } else {
+      OSUnlockMutex(mutex);
+   }
    return 0;
 }
 
@@ -1,23 +1,67 @@
 #include "wut_gthread.h"
 
+// Number of times to check a running once before blocking
+#define __WUT_ONCE_SPIN_COUNT (100)
+
+// Shared by every once, only used while one is contended
+static OSMutex sOnceMutex;
+static OSCondition sOnceCond;
+static volatile uint32_t sOnceSyncState = 0;
+
+static void
+__wut_once_sync_init()
+{
+   uint32_t value = 0;
+
+   if (OSCompareAndSwapAtomicEx(&sOnceSyncState, 0, 1, &value)) {
+      OSInitMutexEx(&sOnceMutex, "wut once");
+      OSInitCondEx(&sOnceCond, "wut once");
+      OSSwapAtomic(&sOnceSyncState, 2);
+   } else {
+      while (sOnceSyncState != 2) {
+         OSYieldThread();
+      }
+   }
+}
+
 int
 __wut_once(__wut_once_t *once,
            void (*func) (void))
 {
    uint32_t value = 0;
 
+   if (*once == __WUT_ONCE_VALUE_DONE) {
+      return 0;
+   }
+
    if (OSCompareAndSwapAtomicEx(once,
                                 __WUT_ONCE_VALUE_INIT,
                                 __WUT_ONCE_VALUE_STARTED,
                                 &value)) {
       func();
-      OSSwapAtomic(once,
-                   __WUT_ONCE_VALUE_DONE);
-   } else if (value != __WUT_ONCE_VALUE_DONE) {
-      while (!OSCompareAndSwapAtomic(once,
-                                     __WUT_ONCE_VALUE_DONE,
-                                     __WUT_ONCE_VALUE_DONE));
+
+      // Only wake threads if any went to sleep
+      if (OSSwapAtomic(once, __WUT_ONCE_VALUE_DONE) == __WUT_ONCE_VALUE_WAITING) {
+         OSLockMutex(&sOnceMutex);
+         OSSignalCond(&sOnceCond);
+         OSUnlockMutex(&sOnceMutex);
+      }
+      return 0;
    }
 
+   for (int i = 0; i < __WUT_ONCE_SPIN_COUNT; ++i) {
+      if (*once == __WUT_ONCE_VALUE_DONE) {
+         return 0;
+      }
+   }
+
+   // OSSignalCond wakes every waiting thread
+   __wut_once_sync_init();
+   OSLockMutex(&sOnceMutex);
+   OSCompareAndSwapAtomic(once, __WUT_ONCE_VALUE_STARTED, __WUT_ONCE_VALUE_WAITING);
+   while (*once != __WUT_ONCE_VALUE_DONE) {
+      OSWaitCond(&sOnceCond, &sOnceMutex);
+   }
+   OSUnlockMutex(&sOnceMutex);
    return 0;
 }
@@ -24,6 +24,14 @@ __wut_recursive_mutex_trylock(OSMutex *mutex)
    return 0;
 }
 
+int
+__wut_recursive_mutex_timedlock(OSMutex *mutex,
+                                const __gthread_time_t *abs_timeout)
+{
+   // Recursive mutexes are always OSMutex, which OSTryLockMutex relocks
+   return __wut_mutex_timedlock(mutex, abs_timeout);
+}
+
 int
 __wut_recursive_mutex_unlock(OSMutex *mutex)
 {
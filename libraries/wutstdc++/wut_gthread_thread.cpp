@@ -1,23 +1,183 @@
 #include "wut_gthread.h"
+#include "../wutthreadstats/wut_thread_stats.h"
 
 #include <stdint.h>
 #include <malloc.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <coreinit/event.h>
+#include <coreinit/spinlock.h>
+#include <wut_heap_budget.h>
+#include <wut_thread.h>
+#include <wut_thread_stats.h>
+
 uint32_t __attribute__((weak)) __wut_thread_default_stack_size = __WUT_STACK_SIZE;
 
+// Number of finished threads whose OSThread and stack are kept for reuse by
+// the next std::thread with the same stack size, 0 disables pooling.
+// Can be overridden by the application.
+uint32_t __attribute__((weak)) __wut_thread_pool_size = 0;
+
+// The OSThread, its gthread keys and its stack share one allocation, the
+// stack follows
+struct __wut_thread_block
+{
+   OSThread thread;
+   __wut_thread_block *next;
+   uint32_t stackSize;
+   const void *keys[__WUT_MAX_KEYS];
+
+   //! Signalled when the thread exits, for timed joins
+   OSEvent exitEvent;
+};
+
+#define __WUT_THREAD_BLOCK_SIZE ((sizeof(__wut_thread_block) + 15) & ~15)
+
+// The deallocator can run on any core, so the pool is guarded by a spin lock
+static OSSpinLock sThreadPoolLock;
+static __wut_thread_block *sThreadPool = NULL;
+static uint32_t sThreadPoolCount = 0;
+
+// Attributes for threads created by the current thread, allocated on the
+// first WUTThreadSetAttributes call
+static __wut_key_t sAttribsKey;
+static __wut_once_t sAttribsKeyOnce = __WUT_ONCE_VALUE_INIT;
+
+static __wut_thread_block *
+__wut_thread_pool_take(uint32_t stackSize)
+{
+   __wut_thread_block *block = NULL;
+
+   if (!sThreadPool) {
+      return NULL;
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sThreadPoolLock);
+   for (__wut_thread_block **prev = &sThreadPool; *prev; prev = &(*prev)->next) {
+      if ((*prev)->stackSize == stackSize) {
+         block = *prev;
+         *prev = block->next;
+         --sThreadPoolCount;
+         break;
+      }
+   }
+   OSUninterruptibleSpinLock_Release(&sThreadPoolLock);
+   return block;
+}
+
 static void
 __wut_thread_deallocator(OSThread *thread,
                          void *stack)
 {
-   free(thread);
-   free(stack);
+   __wut_thread_block *block = (__wut_thread_block *)thread;
+
+   OSUninterruptibleSpinLock_Acquire(&sThreadPoolLock);
+   if (sThreadPoolCount < __wut_thread_pool_size) {
+      block->next = sThreadPool;
+      sThreadPool = block;
+      ++sThreadPoolCount;
+      block = NULL;
+   }
+   OSUninterruptibleSpinLock_Release(&sThreadPoolLock);
+
+   if (block) {
+      WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_THREAD, block);
+   }
 }
 
 static void
 __wut_thread_cleanup(OSThread *thread, void *stack)
 {
-   __wut_key_cleanup(thread);
+   // The keys are part of the thread block
+   __wut_key_cleanup(thread, false);
+
+   OSSignalEvent(&((__wut_thread_block *)thread)->exitEvent);
+}
+
+static void
+__wut_thread_attribs_key_init()
+{
+   __wut_key_create(&sAttribsKey, free);
+}
+
+static void
+__wut_thread_attribs_get(WUTThreadAttributes *outAttribs)
+{
+   if (sAttribsKeyOnce == __WUT_ONCE_VALUE_DONE) {
+      auto attribs = (const WUTThreadAttributes *)__wut_getspecific(sAttribsKey);
+      if (attribs) {
+         *outAttribs = *attribs;
+         return;
+      }
+   }
+
+   WUTThreadGetDefaultAttributes(outAttribs);
+}
+
+void
+WUTThreadGetDefaultAttributes(WUTThreadAttributes *outAttribs)
+{
+   outAttribs->stackSize = 0;
+   outAttribs->priority = 16;
+   outAttribs->affinity = OS_THREAD_ATTRIB_AFFINITY_ANY;
+   outAttribs->runQuantum = 1000;
+}
+
+BOOL
+WUTThreadSetAttributes(const WUTThreadAttributes *attribs)
+{
+   __wut_once(&sAttribsKeyOnce, __wut_thread_attribs_key_init);
+
+   auto current = (WUTThreadAttributes *)__wut_getspecific(sAttribsKey);
+   if (!attribs) {
+      // Back to the defaults
+      if (current) {
+         __wut_setspecific(sAttribsKey, NULL);
+         free(current);
+      }
+      return TRUE;
+   }
+
+   if (attribs->priority < 0 || attribs->priority > 31 ||
+       !(attribs->affinity & OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      return FALSE;
+   }
+
+   if (!current) {
+      current = (WUTThreadAttributes *)malloc(sizeof(WUTThreadAttributes));
+      if (!current || __wut_setspecific(sAttribsKey, current) != 0) {
+         free(current);
+         return FALSE;
+      }
+   }
+
+   *current = *attribs;
+   current->stackSize = (current->stackSize + 15) & ~15;
+   current->affinity &= OS_THREAD_ATTRIB_AFFINITY_ANY;
+   return TRUE;
+}
+
+void
+WUTThreadGetAttributes(WUTThreadAttributes *outAttribs)
+{
+   __wut_thread_attribs_get(outAttribs);
+}
+
+void
+WUTThreadSetStackSize(uint32_t size)
+{
+   WUTThreadAttributes attribs;
+   __wut_thread_attribs_get(&attribs);
+   attribs.stackSize = size;
+   WUTThreadSetAttributes(&attribs);
+}
+
+uint32_t
+WUTThreadGetStackSize()
+{
+   WUTThreadAttributes attribs;
+   __wut_thread_attribs_get(&attribs);
+   return attribs.stackSize ? attribs.stackSize : __wut_thread_default_stack_size;
 }
 
 int
@@ -25,44 +185,80 @@ __wut_thread_create(OSThread **outThread,
                     void *(*entryPoint) (void*),
                     void *entryArgs)
 {
-   OSThread *thread = (OSThread *)memalign(16, sizeof(OSThread));
-   if (!thread) {
-      return ENOMEM;
-   }   
+   WUTThreadAttributes attribs;
+   __wut_thread_attribs_get(&attribs);
 
-   memset(thread, 0, sizeof(OSThread));
+   uint32_t stackSize = attribs.stackSize ? attribs.stackSize : __wut_thread_default_stack_size;
 
-   char *stack = (char *)memalign(16, __wut_thread_default_stack_size);
-   if (!stack) {
-      free(thread);
-      return ENOMEM;
+   __wut_thread_block *block = __wut_thread_pool_take(stackSize);
+   if (!block) {
+      block = (__wut_thread_block *)WUTHeapBudgetAlloc(WUT_HEAP_SUBSYSTEM_THREAD, __WUT_THREAD_BLOCK_SIZE + stackSize, 16);
+      if (!block) {
+         return ENOMEM;
+      }
    }
 
+   OSThread *thread = &block->thread;
+   memset(block, 0, sizeof(__wut_thread_block));
+   block->stackSize = stackSize;
+   OSInitEvent(&block->exitEvent, FALSE, OS_EVENT_MODE_MANUAL);
+
+   char *stack = (char *)block + __WUT_THREAD_BLOCK_SIZE;
    if (!OSCreateThread(thread,
                        (OSThreadEntryPointFn)entryPoint,
                        (int)entryArgs,
                        NULL,
-                       stack + __wut_thread_default_stack_size,
-                       __wut_thread_default_stack_size,
-                       16,
-                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
-      free(thread);
-      free(stack);
+                       stack + stackSize,
+                       stackSize,
+                       attribs.priority,
+                       attribs.affinity)) {
+      WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_THREAD, block);
       return EINVAL;
    }
 
+   thread->specific[__WUT_KEY_THREAD_SPECIFIC_ID] = block->keys;
+
    *outThread = thread;
    OSSetThreadDeallocator(thread, &__wut_thread_deallocator);
    OSSetThreadCleanupCallback(thread, &__wut_thread_cleanup);
 
-   // Set a thread run quantum to 1 millisecond, to force the threads to
-   // behave more like pre-emptive scheduling rather than co-operative.
-   OSSetThreadRunQuantum(thread, 1000);
+   // After the cleanup callback, which the registry chains onto
+   if (__wut_thread_stats_running) {
+      WUTThreadStatsRegister(thread);
+   }
+
+   // Set a thread run quantum, 1 millisecond by default, to force the threads
+   // to behave more like pre-emptive scheduling rather than co-operative.
+   if (attribs.runQuantum) {
+      OSSetThreadRunQuantum(thread, attribs.runQuantum);
+   }
 
    OSResumeThread(thread);
    return 0;
 }
 
+void
+__init_wut_thread_pool()
+{
+   OSInitSpinLock(&sThreadPoolLock);
+}
+
+void
+__fini_wut_thread_pool()
+{
+   OSUninterruptibleSpinLock_Acquire(&sThreadPoolLock);
+   __wut_thread_block *block = sThreadPool;
+   sThreadPool = NULL;
+   sThreadPoolCount = 0;
+   OSUninterruptibleSpinLock_Release(&sThreadPoolLock);
+
+   while (block) {
+      __wut_thread_block *next = block->next;
+      WUTHeapBudgetFree(WUT_HEAP_SUBSYSTEM_THREAD, block);
+      block = next;
+   }
+}
+
 int
 __wut_thread_join(OSThread *thread,
                   void **outValue)
@@ -74,6 +270,39 @@ __wut_thread_join(OSThread *thread,
    return 0;
 }
 
+int
+__wut_thread_timedjoin(OSThread *thread,
+                       void **outValue,
+                       OSTime timeout)
+{
+   // Only threads created by __wut_thread_create have an exit event
+   if (thread->deallocator != &__wut_thread_deallocator) {
+      return EINVAL;
+   }
+
+   __wut_thread_block *block = (__wut_thread_block *)thread;
+   if (!OSWaitEventWithTimeout(&block->exitEvent, timeout > 0 ? OSTicksToNanoseconds(timeout) : 0)) {
+      return ETIMEDOUT;
+   }
+
+   return __wut_thread_join(thread, outValue);
+}
+
+BOOL
+WUTThreadJoinWithTimeout(OSThread *thread,
+                         OSTime timeout,
+                         int *outResult)
+{
+   return __wut_thread_timedjoin(thread, (void **)outResult, timeout) == 0;
+}
+
+BOOL
+WUTMutexLockWithTimeout(OSMutex *mutex,
+                        OSTime timeout)
+{
+   return __wut_mutex_timedlock_ticks(mutex, OSGetTime() + timeout) == 0;
+}
+
 int
 __wut_thread_detach(OSThread * thread)
 {
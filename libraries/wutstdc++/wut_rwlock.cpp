@@ -0,0 +1,106 @@
+#include <wut_rwlock.h>
+#include <coreinit/atomic.h>
+#include <coreinit/cache.h>
+
+void
+WUTRWLockInit(WUTRWLock *lock)
+{
+   lock->state = 0;
+   lock->waitingWriters = 0;
+   lock->waitingReaders = 0;
+   OSInitMutexEx(&lock->mutex, "wut rwlock");
+   OSInitCondEx(&lock->cond, "wut rwlock");
+}
+
+static bool
+__wut_rwlock_try_read(WUTRWLock *lock,
+                      bool yieldToWriters)
+{
+   uint32_t state = lock->state;
+   while (!(state & WUT_RWLOCK_WRITER)) {
+      if (yieldToWriters && lock->waitingWriters) {
+         return false;
+      }
+
+      if (OSCompareAndSwapAtomicEx(&lock->state, state, state + 1, &state)) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+//! Wake every waiter if any, they all recheck the lock
+static void
+__wut_rwlock_wake(WUTRWLock *lock)
+{
+   // The waiting counters must be read after the state was released
+   OSMemoryBarrier();
+   if (lock->waitingWriters || lock->waitingReaders) {
+      OSLockMutex(&lock->mutex);
+      OSSignalCond(&lock->cond);
+      OSUnlockMutex(&lock->mutex);
+   }
+}
+
+void
+WUTRWLockReadLock(WUTRWLock *lock)
+{
+   if (__wut_rwlock_try_read(lock, true)) {
+      return;
+   }
+
+   OSLockMutex(&lock->mutex);
+   OSAddAtomic((volatile int32_t *)&lock->waitingReaders, 1);
+   OSMemoryBarrier();
+   while (!__wut_rwlock_try_read(lock, true)) {
+      OSWaitCond(&lock->cond, &lock->mutex);
+   }
+   OSAddAtomic((volatile int32_t *)&lock->waitingReaders, -1);
+   OSUnlockMutex(&lock->mutex);
+}
+
+BOOL
+WUTRWLockTryReadLock(WUTRWLock *lock)
+{
+   return __wut_rwlock_try_read(lock, true) ? TRUE : FALSE;
+}
+
+void
+WUTRWLockReadUnlock(WUTRWLock *lock)
+{
+   // Only the last reader can let a writer in
+   if (OSAddAtomic((volatile int32_t *)&lock->state, -1) == 1) {
+      __wut_rwlock_wake(lock);
+   }
+}
+
+void
+WUTRWLockWriteLock(WUTRWLock *lock)
+{
+   if (OSCompareAndSwapAtomic(&lock->state, 0, WUT_RWLOCK_WRITER)) {
+      return;
+   }
+
+   OSLockMutex(&lock->mutex);
+   OSAddAtomic((volatile int32_t *)&lock->waitingWriters, 1);
+   OSMemoryBarrier();
+   while (!OSCompareAndSwapAtomic(&lock->state, 0, WUT_RWLOCK_WRITER)) {
+      OSWaitCond(&lock->cond, &lock->mutex);
+   }
+   OSAddAtomic((volatile int32_t *)&lock->waitingWriters, -1);
+   OSUnlockMutex(&lock->mutex);
+}
+
+BOOL
+WUTRWLockTryWriteLock(WUTRWLock *lock)
+{
+   return OSCompareAndSwapAtomic(&lock->state, 0, WUT_RWLOCK_WRITER);
+}
+
+void
+WUTRWLockWriteUnlock(WUTRWLock *lock)
+{
+   OSSwapAtomic(&lock->state, 0);
+   __wut_rwlock_wake(lock);
+}
@@ -0,0 +1,38 @@
+#include "wut_string.h"
+#include <string.h>
+
+WUT_STRING_FUNCTION void *
+memchr(const void *s,
+       int c,
+       size_t n)
+{
+   const unsigned char *p = (const unsigned char *)s;
+   unsigned char ch = (unsigned char)c;
+
+   while (n && !WUT_WORD_ALIGNED(p)) {
+      if (*p == ch) {
+         return (void *)p;
+      }
+      ++p;
+      --n;
+   }
+
+   if (n >= 4) {
+      uint32_t pattern = ch * 0x01010101u;
+
+      for (; n >= 4; n -= 4, p += 4) {
+         uint32_t mask = __wut_zero_bytes(*(const __wut_word *)p ^ pattern);
+         if (mask) {
+            return (void *)(p + __wut_first_byte(mask));
+         }
+      }
+   }
+
+   for (; n; --n, ++p) {
+      if (*p == ch) {
+         return (void *)p;
+      }
+   }
+
+   return NULL;
+}
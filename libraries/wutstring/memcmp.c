@@ -0,0 +1,38 @@
+#include "wut_string.h"
+#include <string.h>
+
+WUT_STRING_FUNCTION int
+memcmp(const void *s1,
+       const void *s2,
+       size_t n)
+{
+   const unsigned char *a = (const unsigned char *)s1;
+   const unsigned char *b = (const unsigned char *)s2;
+
+   if (n >= 8 && (((uintptr_t)a ^ (uintptr_t)b) & 3) == 0) {
+      while (!WUT_WORD_ALIGNED(a)) {
+         if (*a != *b) {
+            return *a - *b;
+         }
+         ++a;
+         ++b;
+         --n;
+      }
+
+      for (; n >= 4; n -= 4, a += 4, b += 4) {
+         uint32_t wa = *(const __wut_word *)a;
+         uint32_t wb = *(const __wut_word *)b;
+         if (wa != wb) {
+            return __wut_word_order(wa) < __wut_word_order(wb) ? -1 : 1;
+         }
+      }
+   }
+
+   for (; n; --n, ++a, ++b) {
+      if (*a != *b) {
+         return *a - *b;
+      }
+   }
+
+   return 0;
+}
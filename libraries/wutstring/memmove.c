@@ -0,0 +1,72 @@
+#include "wut_string.h"
+#include <string.h>
+
+//! Moves up to this size are a single lswx and stswx
+#define MEMMOVE_STRING_MAX 32
+
+WUT_STRING_FUNCTION void *
+memmove(void *dst,
+        const void *src,
+        size_t n)
+{
+   unsigned char *d = (unsigned char *)dst;
+   const unsigned char *s = (const unsigned char *)src;
+   int wordCopy;
+
+   if (d == s || !n) {
+      return dst;
+   }
+
+#ifdef ESPRESSO
+   if (n <= MEMMOVE_STRING_MAX) {
+      // All of src is in r5 to r12 before anything is stored, so this
+      // needs no care for overlap
+      __asm__ volatile (
+         "mtxer %[n]\n"
+         "lswx 5, 0, %[s]\n"
+         "stswx 5, 0, %[d]\n"
+         :
+         : [d] "b" (d), [s] "b" (s), [n] "r" (n)
+         : "r5", "r6", "r7", "r8", "r9", "r10", "r11", "r12", "xer", "memory");
+      return dst;
+   }
+#endif
+
+   if (d + n <= s || s + n <= d) {
+      return memcpy(dst, src, n);
+   }
+
+   wordCopy = (((uintptr_t)d ^ (uintptr_t)s) & 3) == 0;
+
+   if (d < s) {
+      if (wordCopy) {
+         for (; n && !WUT_WORD_ALIGNED(d); --n) {
+            *d++ = *s++;
+         }
+         for (; n >= 4; n -= 4, d += 4, s += 4) {
+            *(__wut_word *)d = *(const __wut_word *)s;
+         }
+      }
+      while (n--) {
+         *d++ = *s++;
+      }
+   } else {
+      d += n;
+      s += n;
+      if (wordCopy) {
+         for (; n && !WUT_WORD_ALIGNED(d); --n) {
+            *--d = *--s;
+         }
+         for (; n >= 4; n -= 4) {
+            d -= 4;
+            s -= 4;
+            *(__wut_word *)d = *(const __wut_word *)s;
+         }
+      }
+      while (n--) {
+         *--d = *--s;
+      }
+   }
+
+   return dst;
+}
@@ -0,0 +1,39 @@
+#include "wut_string.h"
+#include <string.h>
+
+WUT_STRING_FUNCTION int
+strcmp(const char *s1,
+       const char *s2)
+{
+   const unsigned char *a = (const unsigned char *)s1;
+   const unsigned char *b = (const unsigned char *)s2;
+
+   // Word compares need both strings at the same offset in a word
+   if ((((uintptr_t)a ^ (uintptr_t)b) & 3) == 0) {
+      while (!WUT_WORD_ALIGNED(a)) {
+         if (*a != *b || !*a) {
+            return *a - *b;
+         }
+         ++a;
+         ++b;
+      }
+
+      for (;;) {
+         uint32_t wa = *(const __wut_word *)a;
+         uint32_t wb = *(const __wut_word *)b;
+         if (wa != wb || __wut_zero_bytes(wa)) {
+            break;
+         }
+         a += 4;
+         b += 4;
+      }
+   }
+
+   // The word with the difference or the terminator, or unaligned strings
+   while (*a == *b && *a) {
+      ++a;
+      ++b;
+   }
+
+   return *a - *b;
+}
@@ -0,0 +1,22 @@
+#include "wut_string.h"
+#include <string.h>
+
+WUT_STRING_FUNCTION size_t
+strlen(const char *s)
+{
+   const char *p = s;
+   const __wut_word *w;
+   uint32_t mask;
+
+   while (!WUT_WORD_ALIGNED(p)) {
+      if (!*p) {
+         return p - s;
+      }
+      ++p;
+   }
+
+   for (w = (const __wut_word *)p; !(mask = __wut_zero_bytes(*w)); ++w) {
+   }
+
+   return (const char *)w - s + __wut_first_byte(mask);
+}
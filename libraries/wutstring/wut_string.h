@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Word at a time versions of the newlib string functions, which libwut
+ * provides in place of newlib's as it comes first on the link line.
+ *
+ * Aligned word loads never cross a page, so reading the rest of the word
+ * a terminator or the end of a buffer is in is safe.
+ */
+
+typedef uint32_t __attribute__((__may_alias__)) __wut_word;
+
+//! Keeps GCC from turning the byte loops back into calls to the
+//! functions they implement
+#define WUT_STRING_FUNCTION __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+#define WUT_WORD_ALIGNED(ptr) (((uintptr_t)(ptr) & 3) == 0)
+
+/*
+ * 0x80 in every byte of v that is zero and nothing else.
+ *
+ * The usual (v - 0x01010101) & ~v & 0x80808080 can also flag the byte
+ * before a zero byte through the borrow, which on a big endian CPU is the
+ * one at the lower address. This one has no carries between bytes, so
+ * cntlzw of it divided by 8 is the index of the first zero byte.
+ */
+static inline uint32_t
+__wut_zero_bytes(uint32_t v)
+{
+   return ~(((v & 0x7F7F7F7F) + 0x7F7F7F7F) | v | 0x7F7F7F7F);
+}
+
+//! Index of the first byte flagged by __wut_zero_bytes, mask must not be 0
+static inline uint32_t
+__wut_first_byte(uint32_t mask)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+   return (uint32_t)__builtin_clz(mask) >> 3;
+#else
+   return (uint32_t)__builtin_ctz(mask) >> 3;
+#endif
+}
+
+//! A word with its bytes in memory order from the most significant down,
+//! so words compare like their bytes
+static inline uint32_t
+__wut_word_order(uint32_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+   return v;
+#else
+   return __builtin_bswap32(v);
+#endif
+}
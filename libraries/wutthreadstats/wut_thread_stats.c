@@ -0,0 +1,385 @@
+#include "wut_thread_stats.h"
+
+#include <coreinit/alarm.h>
+#include <coreinit/atomic.h>
+#include <coreinit/core.h>
+#include <coreinit/debug.h>
+#include <coreinit/spinlock.h>
+#include <coreinit/thread.h>
+#include <stdio.h>
+#include <string.h>
+#include <wut_thread_stats.h>
+
+#define THREAD_STATS_NUM_CORES         3
+#define THREAD_STATS_SETUP_STACK_SIZE  4096
+
+typedef struct
+{
+   //! NULL while the entry is unused.
+   OSThread *volatile thread;
+   OSThreadCleanupCallbackFn cleanup;
+   uint32_t stackSize;
+   BOOL stackTracked;
+   volatile uint32_t samples[THREAD_STATS_NUM_CORES];
+} __wut_thread_stats_entry_t;
+
+typedef struct
+{
+   volatile uint32_t samples;
+   volatile uint32_t idleSamples;
+   volatile uint32_t otherSamples;
+} __wut_thread_stats_core_t;
+
+volatile uint32_t __wut_thread_stats_running = 0;
+
+static __wut_thread_stats_entry_t sThreads[WUT_THREAD_STATS_MAX_THREADS];
+static __wut_thread_stats_core_t sCores[THREAD_STATS_NUM_CORES];
+static OSSpinLock sThreadsLock;
+static volatile uint32_t sExitedStackUsed = 0;
+
+static OSAlarm sAlarms[THREAD_STATS_NUM_CORES];
+static BOOL sAlarmSet[THREAD_STATS_NUM_CORES];
+static OSTime sInterval;
+static OSThread sSetupThread;
+static uint8_t sSetupThreadStack[THREAD_STATS_SETUP_STACK_SIZE] __attribute__((aligned(16)));
+
+static __wut_thread_stats_entry_t *
+__wut_thread_stats_find(OSThread *thread)
+{
+   for (uint32_t i = 0; i < WUT_THREAD_STATS_MAX_THREADS; ++i) {
+      if (sThreads[i].thread == thread) {
+         return &sThreads[i];
+      }
+   }
+
+   return NULL;
+}
+
+static void
+__wut_thread_stats_exited(OSThread *thread)
+{
+   int32_t used = OSCheckThreadStackUsage(thread);
+   uint32_t max;
+
+   do {
+      max = sExitedStackUsed;
+      if (used <= 0 || (uint32_t)used <= max) {
+         return;
+      }
+   } while (!OSCompareAndSwapAtomic(&sExitedStackUsed, max, (uint32_t)used));
+}
+
+static void
+__wut_thread_stats_cleanup(OSThread *thread,
+                           void *stack)
+{
+   OSThreadCleanupCallbackFn cleanup = NULL;
+   __wut_thread_stats_entry_t *entry;
+   BOOL stackTracked = FALSE;
+
+   OSUninterruptibleSpinLock_Acquire(&sThreadsLock);
+   entry = __wut_thread_stats_find(thread);
+   if (entry) {
+      cleanup = entry->cleanup;
+      stackTracked = entry->stackTracked;
+      entry->thread = NULL;
+   }
+   OSUninterruptibleSpinLock_Release(&sThreadsLock);
+
+   // The stack is still there until the next cleanup callback returns
+   if (stackTracked) {
+      __wut_thread_stats_exited(thread);
+   }
+
+   if (cleanup) {
+      cleanup(thread, stack);
+   }
+}
+
+BOOL
+WUTThreadStatsRegister(OSThread *thread)
+{
+   __wut_thread_stats_entry_t *entry;
+
+   if (!thread) {
+      return FALSE;
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sThreadsLock);
+   entry = __wut_thread_stats_find(thread);
+   if (!entry) {
+      entry = __wut_thread_stats_find(NULL);
+   }
+
+   if (!entry) {
+      OSUninterruptibleSpinLock_Release(&sThreadsLock);
+      return FALSE;
+   }
+
+   if (entry->thread != thread) {
+      memset(entry, 0, sizeof(__wut_thread_stats_entry_t));
+      entry->stackSize = (uint32_t)thread->stackStart - (uint32_t)thread->stackEnd;
+      entry->cleanup = OSSetThreadCleanupCallback(thread, &__wut_thread_stats_cleanup);
+      entry->thread = thread;
+   }
+   OSUninterruptibleSpinLock_Release(&sThreadsLock);
+
+   // Filling the unused stack is only safe while the thread can't be
+   // running on another core
+   if (!entry->stackTracked
+    && (thread == OSGetCurrentThread() || thread->suspendCounter > 0)) {
+      entry->stackTracked = OSSetThreadStackUsage(thread);
+   }
+
+   return TRUE;
+}
+
+void
+WUTThreadStatsUnregister(OSThread *thread)
+{
+   __wut_thread_stats_entry_t *entry;
+   BOOL stackTracked = FALSE;
+
+   if (!thread) {
+      return;
+   }
+
+   OSUninterruptibleSpinLock_Acquire(&sThreadsLock);
+   entry = __wut_thread_stats_find(thread);
+   if (entry) {
+      if (thread->cleanupCallback == &__wut_thread_stats_cleanup) {
+         OSSetThreadCleanupCallback(thread, entry->cleanup);
+      }
+
+      stackTracked = entry->stackTracked;
+      entry->thread = NULL;
+   }
+   OSUninterruptibleSpinLock_Release(&sThreadsLock);
+
+   if (stackTracked) {
+      __wut_thread_stats_exited(thread);
+   }
+}
+
+static void
+__wut_thread_stats_alarm_callback(OSAlarm *alarm,
+                                  OSContext *context)
+{
+   uint32_t core = OSGetCoreId();
+   OSThread *thread = OSGetCurrentThread();
+   __wut_thread_stats_entry_t *entry;
+
+   // Runs in the alarm interrupt, so entries are only read here and may
+   // race with a thread being unregistered, which costs one sample
+   OSAddAtomic((volatile int32_t *)&sCores[core].samples, 1);
+   if (!thread) {
+      OSAddAtomic((volatile int32_t *)&sCores[core].idleSamples, 1);
+      return;
+   }
+
+   entry = __wut_thread_stats_find(thread);
+   if (entry) {
+      OSAddAtomic((volatile int32_t *)&entry->samples[core], 1);
+   } else {
+      OSAddAtomic((volatile int32_t *)&sCores[core].otherSamples, 1);
+   }
+}
+
+static int
+__wut_thread_stats_setup_entry(int argc,
+                               const char **argv)
+{
+   uint32_t core = OSGetCoreId();
+
+   // Alarms fire on the core they were set from
+   OSCreateAlarm(&sAlarms[core]);
+   sAlarmSet[core] = OSSetPeriodicAlarm(&sAlarms[core], sInterval, sInterval,
+                                        &__wut_thread_stats_alarm_callback);
+   return 0;
+}
+
+BOOL
+WUTThreadStatsStart(uint32_t intervalUs)
+{
+   BOOL result = FALSE;
+
+   if (__wut_thread_stats_running) {
+      return TRUE;
+   }
+
+   sInterval = OSMicrosecondsToTicks(intervalUs ? intervalUs : 1000);
+   for (uint32_t core = 0; core < THREAD_STATS_NUM_CORES; ++core) {
+      if (!OSCreateThread(&sSetupThread,
+                          __wut_thread_stats_setup_entry,
+                          0,
+                          NULL,
+                          sSetupThreadStack + sizeof(sSetupThreadStack),
+                          sizeof(sSetupThreadStack),
+                          0,
+                          OS_THREAD_ATTRIB_AFFINITY_CPU0 << core)) {
+         continue;
+      }
+
+      OSResumeThread(&sSetupThread);
+      OSJoinThread(&sSetupThread, NULL);
+      result = result || sAlarmSet[core];
+   }
+
+   __wut_thread_stats_running = result ? 1 : 0;
+   return result;
+}
+
+void
+WUTThreadStatsStop(void)
+{
+   for (uint32_t core = 0; core < THREAD_STATS_NUM_CORES; ++core) {
+      if (sAlarmSet[core]) {
+         OSCancelAlarm(&sAlarms[core]);
+         sAlarmSet[core] = FALSE;
+      }
+   }
+
+   __wut_thread_stats_running = 0;
+}
+
+void
+WUTThreadStatsReset(void)
+{
+   for (uint32_t core = 0; core < THREAD_STATS_NUM_CORES; ++core) {
+      sCores[core].samples = 0;
+      sCores[core].idleSamples = 0;
+      sCores[core].otherSamples = 0;
+
+      for (uint32_t i = 0; i < WUT_THREAD_STATS_MAX_THREADS; ++i) {
+         sThreads[i].samples[core] = 0;
+      }
+   }
+}
+
+uint32_t
+WUTThreadStatsGetThreads(WUTThreadStats *outStats,
+                         uint32_t maxStats)
+{
+   __wut_thread_stats_entry_t entries[WUT_THREAD_STATS_MAX_THREADS];
+   uint32_t numEntries = 0;
+   uint32_t count = 0;
+
+   if (!outStats) {
+      return 0;
+   }
+
+   // Scanning stacks takes too long for the spinlock, so only copy the
+   // entries under it
+   OSUninterruptibleSpinLock_Acquire(&sThreadsLock);
+   for (uint32_t i = 0; i < WUT_THREAD_STATS_MAX_THREADS; ++i) {
+      if (sThreads[i].thread) {
+         entries[numEntries++] = sThreads[i];
+      }
+   }
+   OSUninterruptibleSpinLock_Release(&sThreadsLock);
+
+   for (uint32_t i = 0; i < numEntries; ++i) {
+      __wut_thread_stats_entry_t *entry = &entries[i];
+      WUTThreadStats stats;
+      const char *name;
+      uint32_t total = 0, pos;
+      BOOL registered;
+
+      memset(&stats, 0, sizeof(stats));
+      stats.thread = entry->thread;
+      name = OSGetThreadName(entry->thread);
+      if (name) {
+         strncpy(stats.name, name, sizeof(stats.name) - 1);
+      }
+
+      stats.stackSize = entry->stackSize;
+      stats.stackUsed = entry->stackTracked ? OSCheckThreadStackUsage(entry->thread) : -1;
+      for (uint32_t core = 0; core < THREAD_STATS_NUM_CORES; ++core) {
+         stats.samples[core] = entry->samples[core];
+         total += stats.samples[core];
+      }
+      stats.runTicks = sInterval * total;
+
+      // A thread that exited while it was read can have been freed, so its
+      // name and stack usage are not trusted
+      OSUninterruptibleSpinLock_Acquire(&sThreadsLock);
+      registered = __wut_thread_stats_find(entry->thread) != NULL;
+      OSUninterruptibleSpinLock_Release(&sThreadsLock);
+      if (!registered) {
+         continue;
+      }
+
+      // Insertion into the sorted output, there are few threads
+      for (pos = count; pos > 0 && outStats[pos - 1].runTicks < stats.runTicks; --pos);
+      if (pos >= maxStats) {
+         continue;
+      }
+
+      if (count < maxStats) {
+         ++count;
+      }
+
+      memmove(&outStats[pos + 1], &outStats[pos], (count - 1 - pos) * sizeof(WUTThreadStats));
+      outStats[pos] = stats;
+   }
+
+   return count;
+}
+
+void
+WUTThreadStatsGetCores(WUTCoreStats *outStats)
+{
+   for (uint32_t core = 0; core < THREAD_STATS_NUM_CORES; ++core) {
+      WUTCoreStats *stats = &outStats[core];
+      stats->samples = sCores[core].samples;
+      stats->idleSamples = sCores[core].idleSamples;
+      stats->otherSamples = sCores[core].otherSamples;
+      stats->utilisation = stats->samples ?
+         100.0f * (float)(stats->samples - stats->idleSamples) / (float)stats->samples : 0.0f;
+   }
+}
+
+uint32_t
+WUTThreadStatsGetExitedStackUsed(void)
+{
+   return sExitedStackUsed;
+}
+
+void
+WUTThreadStatsReport(void)
+{
+   WUTThreadStats threads[WUT_THREAD_STATS_MAX_THREADS];
+   WUTCoreStats cores[THREAD_STATS_NUM_CORES];
+   uint32_t count;
+
+   WUTThreadStatsGetCores(cores);
+   OSReport("Core utilisation: %.1f%% %.1f%% %.1f%%\n",
+            cores[0].utilisation, cores[1].utilisation, cores[2].utilisation);
+
+   count = WUTThreadStatsGetThreads(threads, WUT_THREAD_STATS_MAX_THREADS);
+   OSReport("%u threads:\n", count);
+   for (uint32_t i = 0; i < count; ++i) {
+      WUTThreadStats *stats = &threads[i];
+      char stack[24] = "untracked";
+      float share[THREAD_STATS_NUM_CORES];
+
+      for (uint32_t core = 0; core < THREAD_STATS_NUM_CORES; ++core) {
+         share[core] = cores[core].samples ?
+            100.0f * (float)stats->samples[core] / (float)cores[core].samples : 0.0f;
+      }
+
+      if (stats->stackUsed >= 0) {
+         snprintf(stack, sizeof(stack), "%d/%u", stats->stackUsed, stats->stackSize);
+      }
+
+      OSReport("  %08X %-31s %10llu us, core %5.1f%% %5.1f%% %5.1f%%, stack %s\n",
+               (uint32_t)stats->thread,
+               stats->name[0] ? stats->name : "(unnamed)",
+               OSTicksToMicroseconds(stats->runTicks),
+               share[0], share[1], share[2], stack);
+   }
+
+   if (sExitedStackUsed) {
+      OSReport("  exited threads used at most %u bytes of stack\n", sExitedStackUsed);
+   }
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Set while WUTThreadStatsStart is sampling, gthreads register themselves
+// only then
+extern volatile uint32_t __wut_thread_stats_running;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,376 @@
+#include <coreinit/cache.h>
+#include <string.h>
+#include <wut_job.h>
+#include <wut_tiling.h>
+
+#define TILING_CACHE_LINE        32
+#define TILING_MICRO_TILE        8
+
+// The GPU7 memory layout: two pipes, four banks and a 256 byte group,
+// so a 2D macro tile is 4x2 micro tiles.
+#define TILING_NUM_PIPES         2
+#define TILING_NUM_BANKS         4
+#define TILING_GROUP_BYTES       256
+#define TILING_SWIZZLE_SHIFT     3
+#define TILING_MACRO_WIDTH       (TILING_MICRO_TILE * TILING_NUM_BANKS)
+#define TILING_MACRO_HEIGHT      (TILING_MICRO_TILE * TILING_NUM_PIPES)
+
+//! Micro tile rows per job of WUTTilingUploadParallel
+#define TILING_PARALLEL_GRAIN    4
+
+typedef struct WUTTilingJob
+{
+   uint8_t *image;
+   const uint8_t *src;
+   uint32_t srcPitch;
+   WUTTilingRect rect;
+   GX2TileMode tileMode;
+   uint32_t pitch;
+   uint32_t swizzle;
+   uint32_t bytes;
+   uint32_t tileBytes;
+
+   //! Elements of a micro tile row stored next to each other
+   uint32_t runElements;
+
+   //! Offset of each element of a micro tile from its first one
+   uint32_t offsets[TILING_MICRO_TILE * TILING_MICRO_TILE];
+} WUTTilingJob;
+
+static inline void
+__wut_dcbz(void *ptr)
+{
+   __asm__ volatile ("dcbz 0, %0" : : "r" (ptr) : "memory");
+}
+
+static uint32_t
+__wut_tiling_element_bytes(GX2SurfaceFormat format)
+{
+   // The low 6 bits are the hardware format
+   switch (format & 0x3F) {
+   case 0x01: case 0x02: case 0x03:
+      return 1;
+   case 0x05: case 0x06: case 0x07: case 0x08:
+   case 0x09: case 0x0A: case 0x0B: case 0x0C:
+      return 2;
+   case 0x0D: case 0x0E: case 0x0F: case 0x10:
+   case 0x11: case 0x12: case 0x13: case 0x14:
+   case 0x15: case 0x16: case 0x17: case 0x18:
+   case 0x19: case 0x1A: case 0x1B:
+      return 4;
+   case 0x1C: case 0x1D: case 0x1E: case 0x1F: case 0x20:
+   case 0x31: case 0x34:
+      return 8;
+   case 0x22: case 0x23:
+   case 0x32: case 0x33: case 0x35:
+      return 16;
+   default:
+      return 0;
+   }
+}
+
+static BOOL
+__wut_tiling_is_block_compressed(GX2SurfaceFormat format)
+{
+   uint32_t hwFormat = format & 0x3F;
+   return hwFormat >= 0x31 && hwFormat <= 0x35;
+}
+
+//! Index of an element within its micro tile, for colour surfaces
+static uint32_t
+__wut_tiling_element_index(uint32_t x,
+                           uint32_t y,
+                           uint32_t bytes)
+{
+   uint32_t x0 = x & 1, x1 = (x >> 1) & 1, x2 = (x >> 2) & 1;
+   uint32_t y0 = y & 1, y1 = (y >> 1) & 1, y2 = (y >> 2) & 1;
+
+   switch (bytes) {
+   case 1:
+      return x0 | (x1 << 1) | (x2 << 2) | (y1 << 3) | (y0 << 4) | (y2 << 5);
+   case 2:
+      return x0 | (x1 << 1) | (x2 << 2) | (y0 << 3) | (y1 << 4) | (y2 << 5);
+   case 8:
+      return x0 | (y0 << 1) | (x1 << 2) | (x2 << 3) | (y1 << 4) | (y2 << 5);
+   case 16:
+      return y0 | (x0 << 1) | (x1 << 2) | (x2 << 3) | (y1 << 4) | (y2 << 5);
+   default:
+      return x0 | (x1 << 1) | (y0 << 2) | (x2 << 3) | (y1 << 4) | (y2 << 5);
+   }
+}
+
+//! Spread an offset within a macro tile over the pipe and bank groups
+static inline uint32_t
+__wut_tiling_spread(const WUTTilingJob *job,
+                    uint32_t offset)
+{
+   if (job->tileMode != GX2_TILE_MODE_TILED_2D_THIN1) {
+      return offset;
+   }
+
+   return (offset & (TILING_GROUP_BYTES - 1))
+        | ((offset & ~(TILING_GROUP_BYTES - 1)) << TILING_SWIZZLE_SHIFT);
+}
+
+//! Address of the first element of the micro tile at x, y
+static uint32_t
+__wut_tiling_tile_address(const WUTTilingJob *job,
+                          uint32_t x,
+                          uint32_t y)
+{
+   uint32_t pipe, bank, bankPipe, macroOffset;
+
+   if (job->tileMode == GX2_TILE_MODE_TILED_1D_THIN1) {
+      return ((x / TILING_MICRO_TILE) + (y / TILING_MICRO_TILE) * (job->pitch / TILING_MICRO_TILE))
+           * job->tileBytes;
+   }
+
+   pipe = ((y >> 3) ^ (x >> 3)) & 1;
+   bank = (((y / (16 * TILING_NUM_PIPES)) ^ (x >> 3)) & 1)
+        | ((((y / (8 * TILING_NUM_PIPES)) ^ (x >> 4)) & 1) << 1);
+
+   // Slice 0 only, so the swizzle is the whole rotation
+   bankPipe = (pipe + TILING_NUM_PIPES * bank) ^ job->swizzle;
+   bankPipe %= TILING_NUM_PIPES * TILING_NUM_BANKS;
+   pipe = bankPipe % TILING_NUM_PIPES;
+   bank = bankPipe / TILING_NUM_PIPES;
+
+   macroOffset = ((x / TILING_MACRO_WIDTH) + (job->pitch / TILING_MACRO_WIDTH) * (y / TILING_MACRO_HEIGHT))
+               * job->bytes * TILING_MACRO_WIDTH * TILING_MACRO_HEIGHT;
+
+   return (bank << 9) | (pipe << 8) | __wut_tiling_spread(job, macroOffset >> TILING_SWIZZLE_SHIFT);
+}
+
+static inline void
+__wut_tiling_copy_run(uint8_t *dst,
+                      const uint8_t *src,
+                      uint32_t size)
+{
+   if (size == 16) {
+      __builtin_memcpy(dst, src, 16);
+   } else {
+      __builtin_memcpy(dst, src, 8);
+   }
+}
+
+static void
+__wut_tiling_tile(const WUTTilingJob *job,
+                  uint32_t tileX,
+                  uint32_t tileY)
+{
+   const WUTTilingRect *rect = &job->rect;
+   uint8_t *tile = job->image + __wut_tiling_tile_address(job, tileX, tileY);
+   uint32_t x0 = tileX > rect->x ? tileX : rect->x;
+   uint32_t y0 = tileY > rect->y ? tileY : rect->y;
+   uint32_t x1 = tileX + TILING_MICRO_TILE;
+   uint32_t y1 = tileY + TILING_MICRO_TILE;
+   uint32_t runBytes = job->runElements * job->bytes;
+   BOOL fullRows;
+   uint32_t i;
+
+   if (x1 > rect->x + rect->width) {
+      x1 = rect->x + rect->width;
+   }
+   if (y1 > rect->y + rect->height) {
+      y1 = rect->y + rect->height;
+   }
+
+   fullRows = x0 == tileX && x1 == tileX + TILING_MICRO_TILE;
+
+   // No need to read lines that are about to be overwritten entirely
+   if (fullRows && y0 == tileY && y1 == tileY + TILING_MICRO_TILE) {
+      for (i = 0; i < job->tileBytes; i += TILING_CACHE_LINE) {
+         __wut_dcbz(tile + __wut_tiling_spread(job, i));
+      }
+   }
+
+   for (uint32_t y = y0; y < y1; ++y) {
+      const uint8_t *row = job->src + (y - rect->y) * job->srcPitch + (x0 - rect->x) * job->bytes;
+      const uint32_t *offsets = job->offsets + (y & 7) * TILING_MICRO_TILE;
+
+      if (fullRows) {
+         for (i = 0; i < TILING_MICRO_TILE; i += job->runElements) {
+            __wut_tiling_copy_run(tile + offsets[i], row, runBytes);
+            row += runBytes;
+         }
+      } else {
+         for (i = x0 & 7; i < ((x1 - 1) & 7) + 1; ++i) {
+            memcpy(tile + offsets[i], row, job->bytes);
+            row += job->bytes;
+         }
+      }
+   }
+
+   // Store the pieces of the tile, which are at most a group each
+   for (i = 0; i < job->tileBytes; i += TILING_GROUP_BYTES) {
+      uint32_t size = job->tileBytes - i;
+      DCStoreRangeNoSync(tile + __wut_tiling_spread(job, i),
+                         size < TILING_GROUP_BYTES ? size : TILING_GROUP_BYTES);
+   }
+}
+
+static void
+__wut_tiling_rows(uint32_t begin,
+                  uint32_t end,
+                  void *userData)
+{
+   const WUTTilingJob *job = (const WUTTilingJob *)userData;
+   const WUTTilingRect *rect = &job->rect;
+   uint32_t firstTileX = rect->x & ~(TILING_MICRO_TILE - 1);
+   uint32_t firstTileY = rect->y & ~(TILING_MICRO_TILE - 1);
+
+   for (uint32_t row = begin; row < end; ++row) {
+      uint32_t tileY = firstTileY + row * TILING_MICRO_TILE;
+
+      for (uint32_t tileX = firstTileX; tileX < rect->x + rect->width; tileX += TILING_MICRO_TILE) {
+         __wut_tiling_tile(job, tileX, tileY);
+      }
+   }
+
+   OSMemoryBarrier();
+}
+
+static void
+__wut_tiling_linear(const WUTTilingJob *job)
+{
+   const WUTTilingRect *rect = &job->rect;
+   uint32_t rowBytes = rect->width * job->bytes;
+
+   for (uint32_t y = 0; y < rect->height; ++y) {
+      uint8_t *dst = job->image + ((rect->y + y) * job->pitch + rect->x) * job->bytes;
+      memcpy(dst, job->src + y * job->srcPitch, rowBytes);
+      DCStoreRangeNoSync(dst, rowBytes);
+   }
+
+   OSMemoryBarrier();
+}
+
+BOOL
+WUTTilingIsSupported(const GX2Surface *surface)
+{
+   if (!surface->image || surface->aa != GX2_AA_MODE1X
+    || !__wut_tiling_element_bytes(surface->format)) {
+      return FALSE;
+   }
+
+   switch (surface->tileMode) {
+   case GX2_TILE_MODE_LINEAR_ALIGNED:
+      return TRUE;
+   case GX2_TILE_MODE_TILED_1D_THIN1:
+      return (surface->pitch % TILING_MICRO_TILE) == 0;
+   case GX2_TILE_MODE_TILED_2D_THIN1:
+      return (surface->pitch % TILING_MACRO_WIDTH) == 0;
+   default:
+      return FALSE;
+   }
+}
+
+static BOOL
+__wut_tiling_init_job(WUTTilingJob *job,
+                      const GX2Surface *surface,
+                      const void *src,
+                      uint32_t srcPitch,
+                      const WUTTilingRect *rect)
+{
+   uint32_t width = surface->width;
+   uint32_t height = surface->height;
+
+   if (!WUTTilingIsSupported(surface)) {
+      return FALSE;
+   }
+
+   if (__wut_tiling_is_block_compressed(surface->format)) {
+      width = (width + 3) / 4;
+      height = (height + 3) / 4;
+   }
+
+   if (rect) {
+      if (!rect->width || !rect->height
+       || rect->x + rect->width > width || rect->y + rect->height > height) {
+         return FALSE;
+      }
+      job->rect = *rect;
+   } else {
+      job->rect.x = 0;
+      job->rect.y = 0;
+      job->rect.width = width;
+      job->rect.height = height;
+   }
+
+   job->image = (uint8_t *)surface->image;
+   job->src = (const uint8_t *)src;
+   job->srcPitch = srcPitch;
+   job->tileMode = surface->tileMode;
+   job->pitch = surface->pitch;
+   job->swizzle = GX2GetSurfaceSwizzle(surface) & 7;
+   job->bytes = __wut_tiling_element_bytes(surface->format);
+   job->tileBytes = job->bytes * TILING_MICRO_TILE * TILING_MICRO_TILE;
+
+   if (job->tileMode == GX2_TILE_MODE_LINEAR_ALIGNED) {
+      return TRUE;
+   }
+
+   // Elements are next to each other for as long as the low bits of the
+   // index are x bits, which is 8 or 16 bytes for every element size
+   job->runElements = job->bytes <= 2 ? 8 : 16 / job->bytes;
+
+   for (uint32_t y = 0; y < TILING_MICRO_TILE; ++y) {
+      for (uint32_t x = 0; x < TILING_MICRO_TILE; ++x) {
+         uint32_t offset = __wut_tiling_element_index(x, y, job->bytes) * job->bytes;
+         job->offsets[y * TILING_MICRO_TILE + x] = __wut_tiling_spread(job, offset);
+      }
+   }
+
+   return TRUE;
+}
+
+static uint32_t
+__wut_tiling_num_rows(const WUTTilingJob *job)
+{
+   uint32_t first = job->rect.y / TILING_MICRO_TILE;
+   uint32_t last = (job->rect.y + job->rect.height - 1) / TILING_MICRO_TILE;
+   return last - first + 1;
+}
+
+BOOL
+WUTTilingUpload(const GX2Surface *surface,
+                const void *src,
+                uint32_t srcPitch,
+                const WUTTilingRect *rect)
+{
+   WUTTilingJob job;
+
+   if (!__wut_tiling_init_job(&job, surface, src, srcPitch, rect)) {
+      return FALSE;
+   }
+
+   if (job.tileMode == GX2_TILE_MODE_LINEAR_ALIGNED) {
+      __wut_tiling_linear(&job);
+   } else {
+      __wut_tiling_rows(0, __wut_tiling_num_rows(&job), &job);
+   }
+
+   return TRUE;
+}
+
+BOOL
+WUTTilingUploadParallel(const GX2Surface *surface,
+                        const void *src,
+                        uint32_t srcPitch,
+                        const WUTTilingRect *rect)
+{
+   WUTTilingJob job;
+
+   if (!__wut_tiling_init_job(&job, surface, src, srcPitch, rect)) {
+      return FALSE;
+   }
+
+   if (job.tileMode == GX2_TILE_MODE_LINEAR_ALIGNED) {
+      __wut_tiling_linear(&job);
+   } else {
+      WUTJobParallelFor(__wut_tiling_num_rows(&job), TILING_PARALLEL_GRAIN,
+                        __wut_tiling_rows, &job);
+   }
+
+   return TRUE;
+}
@@ -0,0 +1,380 @@
+#include <wut_timer_wheel.h>
+#include <coreinit/alarm.h>
+#include <coreinit/interrupts.h>
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/threadqueue.h>
+#include <malloc.h>
+#include <string.h>
+
+#define TIMER_WHEEL_LEVELS       4
+#define TIMER_WHEEL_BITS         6
+#define TIMER_WHEEL_SLOTS        (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK         (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_MAX_DELAY    0x7FFFFFFF
+#define TIMER_WHEEL_STACK_SIZE   (16 * 1024)
+
+struct WUTTimerWheel
+{
+   OSMutex mutex;
+   OSTime start;
+   OSTime tick;
+
+   //! Tick the wheel has been advanced to.
+   uint32_t current;
+   WUTTimer *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+
+   //! Timers taken off the wheel by WUTTimerWheelPoll whose callbacks have
+   //! not been called yet, so they can still be cancelled.
+   WUTTimer *expired;
+
+   BOOL hasThread;
+   volatile uint32_t stop;
+   OSAlarm alarm;
+   OSThreadQueue queue;
+   OSThread thread;
+   void *stack;
+};
+
+static uint32_t
+__wut_timer_wheel_now(WUTTimerWheel *wheel)
+{
+   return (uint32_t)((OSGetSystemTime() - wheel->start) / wheel->tick);
+}
+
+static uint32_t
+__wut_timer_wheel_to_ticks(WUTTimerWheel *wheel,
+                           OSTime time)
+{
+   OSTime ticks;
+
+   if (time <= 0) {
+      return 0;
+   }
+
+   ticks = (time + wheel->tick - 1) / wheel->tick;
+   return ticks > TIMER_WHEEL_MAX_DELAY ? TIMER_WHEEL_MAX_DELAY : (uint32_t)ticks;
+}
+
+static void
+__wut_timer_list_push(WUTTimer **list,
+                      WUTTimer *timer)
+{
+   timer->prev = NULL;
+   timer->next = *list;
+   if (timer->next) {
+      timer->next->prev = timer;
+   }
+
+   *list = timer;
+   timer->list = list;
+}
+
+static void
+__wut_timer_list_remove(WUTTimer *timer)
+{
+   if (timer->prev) {
+      timer->prev->next = timer->next;
+   } else {
+      *timer->list = timer->next;
+   }
+
+   if (timer->next) {
+      timer->next->prev = timer->prev;
+   }
+
+   timer->next = NULL;
+   timer->prev = NULL;
+   timer->list = NULL;
+}
+
+// The level is picked by how far away the expiry is and the slot by the
+// expiry's own bits, so a timer is cascaded down before it is due
+static void
+__wut_timer_wheel_insert(WUTTimerWheel *wheel,
+                         WUTTimer *timer)
+{
+   int32_t delta = (int32_t)(timer->expires - wheel->current);
+   uint32_t level;
+
+   if (delta < 0) {
+      __wut_timer_list_push(&wheel->slots[0][wheel->current & TIMER_WHEEL_MASK], timer);
+      return;
+   }
+
+   for (level = 0; level < TIMER_WHEEL_LEVELS - 1; ++level) {
+      if ((uint32_t)delta < (1u << (TIMER_WHEEL_BITS * (level + 1)))) {
+         break;
+      }
+   }
+
+   __wut_timer_list_push(&wheel->slots[level][(timer->expires >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK],
+                         timer);
+}
+
+static uint32_t
+__wut_timer_wheel_cascade(WUTTimerWheel *wheel,
+                          uint32_t level)
+{
+   uint32_t index = (wheel->current >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+   WUTTimer *timer = wheel->slots[level][index];
+
+   wheel->slots[level][index] = NULL;
+   while (timer) {
+      WUTTimer *next = timer->next;
+      __wut_timer_wheel_insert(wheel, timer);
+      timer = next;
+   }
+
+   return index;
+}
+
+// Must be called with the wheel locked
+static void
+__wut_timer_wheel_advance(WUTTimerWheel *wheel,
+                          uint32_t target)
+{
+   while ((int32_t)(target - wheel->current) >= 0) {
+      uint32_t index = wheel->current & TIMER_WHEEL_MASK;
+      WUTTimer *timer;
+
+      if (!index
+       && !__wut_timer_wheel_cascade(wheel, 1)
+       && !__wut_timer_wheel_cascade(wheel, 2)) {
+         __wut_timer_wheel_cascade(wheel, 3);
+      }
+
+      timer = wheel->slots[0][index];
+      wheel->slots[0][index] = NULL;
+      wheel->current++;
+
+      while (timer) {
+         WUTTimer *next = timer->next;
+         __wut_timer_list_push(&wheel->expired, timer);
+         timer = next;
+      }
+   }
+}
+
+uint32_t
+WUTTimerWheelPoll(WUTTimerWheel *wheel)
+{
+   uint32_t count = 0;
+
+   OSLockMutex(&wheel->mutex);
+   __wut_timer_wheel_advance(wheel, __wut_timer_wheel_now(wheel));
+
+   while (wheel->expired) {
+      WUTTimer *timer = wheel->expired;
+      WUTTimerCallback callback = timer->callback;
+      void *userContext = timer->userContext;
+
+      __wut_timer_list_remove(timer);
+      if (timer->period) {
+         // Missed periods are skipped rather than fired back to back
+         timer->expires += timer->period;
+         if ((int32_t)(timer->expires - wheel->current) < 0) {
+            timer->expires = wheel->current;
+         }
+         __wut_timer_wheel_insert(wheel, timer);
+      } else {
+         timer->wheel = NULL;
+      }
+
+      OSUnlockMutex(&wheel->mutex);
+      if (callback) {
+         callback(timer, userContext);
+      }
+      ++count;
+      OSLockMutex(&wheel->mutex);
+   }
+
+   OSUnlockMutex(&wheel->mutex);
+   return count;
+}
+
+WUTTimerWheel *
+WUTTimerWheelCreate(uint32_t tickUs)
+{
+   WUTTimerWheel *wheel = (WUTTimerWheel *)memalign(16, sizeof(WUTTimerWheel));
+   if (!wheel) {
+      return NULL;
+   }
+
+   memset(wheel, 0, sizeof(WUTTimerWheel));
+   OSInitMutexEx(&wheel->mutex, "WUTTimerWheel");
+   OSInitThreadQueue(&wheel->queue);
+   wheel->tick = OSMicrosecondsToTicks(tickUs ? tickUs : 1000);
+   if (wheel->tick <= 0) {
+      wheel->tick = 1;
+   }
+
+   wheel->start = OSGetSystemTime();
+   return wheel;
+}
+
+static void
+__wut_timer_wheel_alarm_callback(OSAlarm *alarm,
+                                 OSContext *context)
+{
+   WUTTimerWheel *wheel = (WUTTimerWheel *)OSGetAlarmUserData(alarm);
+   OSWakeupThread(&wheel->queue);
+}
+
+static int
+__wut_timer_wheel_thread_entry(int argc,
+                               const char **argv)
+{
+   WUTTimerWheel *wheel = (WUTTimerWheel *)argv;
+
+   while (!wheel->stop) {
+      int state;
+
+      WUTTimerWheelPoll(wheel);
+
+      // A wakeup missed while polling only costs one tick
+      state = OSDisableInterrupts();
+      if (!wheel->stop) {
+         OSSleepThread(&wheel->queue);
+      }
+      OSRestoreInterrupts(state);
+   }
+
+   return 0;
+}
+
+BOOL
+WUTTimerWheelStartThread(WUTTimerWheel *wheel,
+                         int32_t priority,
+                         OSThreadAttributes affinity)
+{
+   if (wheel->hasThread) {
+      return FALSE;
+   }
+
+   wheel->stack = memalign(16, TIMER_WHEEL_STACK_SIZE);
+   if (!wheel->stack) {
+      return FALSE;
+   }
+
+   if (!OSCreateThread(&wheel->thread,
+                       __wut_timer_wheel_thread_entry,
+                       0,
+                       (char *)wheel,
+                       (uint8_t *)wheel->stack + TIMER_WHEEL_STACK_SIZE,
+                       TIMER_WHEEL_STACK_SIZE,
+                       priority,
+                       affinity)) {
+      free(wheel->stack);
+      wheel->stack = NULL;
+      return FALSE;
+   }
+
+   OSSetThreadName(&wheel->thread, "WUTTimerWheel");
+   wheel->stop = 0;
+   wheel->hasThread = TRUE;
+
+   OSCreateAlarm(&wheel->alarm);
+   OSSetAlarmUserData(&wheel->alarm, wheel);
+   OSSetPeriodicAlarm(&wheel->alarm, wheel->tick, wheel->tick,
+                      &__wut_timer_wheel_alarm_callback);
+
+   OSResumeThread(&wheel->thread);
+   return TRUE;
+}
+
+void
+WUTTimerWheelDestroy(WUTTimerWheel *wheel)
+{
+   uint32_t level, index;
+
+   if (!wheel) {
+      return;
+   }
+
+   if (wheel->hasThread) {
+      OSCancelAlarm(&wheel->alarm);
+      wheel->stop = 1;
+      OSWakeupThread(&wheel->queue);
+      OSJoinThread(&wheel->thread, NULL);
+      free(wheel->stack);
+   }
+
+   for (level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+      for (index = 0; index < TIMER_WHEEL_SLOTS; ++index) {
+         while (wheel->slots[level][index]) {
+            WUTTimer *timer = wheel->slots[level][index];
+            __wut_timer_list_remove(timer);
+            timer->wheel = NULL;
+         }
+      }
+   }
+
+   free(wheel);
+}
+
+void
+WUTTimerInit(WUTTimer *timer,
+             WUTTimerCallback callback,
+             void *userContext)
+{
+   memset(timer, 0, sizeof(WUTTimer));
+   timer->callback = callback;
+   timer->userContext = userContext;
+}
+
+BOOL
+WUTTimerWheelAdd(WUTTimerWheel *wheel,
+                 WUTTimer *timer,
+                 OSTime delay,
+                 OSTime period)
+{
+   if (!wheel || !timer || (timer->wheel && timer->wheel != wheel)) {
+      return FALSE;
+   }
+
+   OSLockMutex(&wheel->mutex);
+   if (timer->list) {
+      __wut_timer_list_remove(timer);
+   }
+
+   timer->wheel = wheel;
+   timer->expires = __wut_timer_wheel_now(wheel) + __wut_timer_wheel_to_ticks(wheel, delay);
+   timer->period = __wut_timer_wheel_to_ticks(wheel, period);
+   if (period > 0 && !timer->period) {
+      timer->period = 1;
+   }
+
+   __wut_timer_wheel_insert(wheel, timer);
+   OSUnlockMutex(&wheel->mutex);
+   return TRUE;
+}
+
+BOOL
+WUTTimerWheelCancel(WUTTimerWheel *wheel,
+                    WUTTimer *timer)
+{
+   BOOL pending = FALSE;
+
+   if (!wheel || !timer) {
+      return FALSE;
+   }
+
+   OSLockMutex(&wheel->mutex);
+   if (timer->wheel == wheel) {
+      if (timer->list) {
+         __wut_timer_list_remove(timer);
+      }
+
+      timer->wheel = NULL;
+      pending = TRUE;
+   }
+   OSUnlockMutex(&wheel->mutex);
+   return pending;
+}
+
+BOOL
+WUTTimerIsPending(WUTTimer *timer)
+{
+   return timer->wheel != NULL;
+}
@@ -0,0 +1,993 @@
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memexpheap.h>
+#include <coreinit/mutex.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/dirent.h>
+#include <sys/iosupport.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <wut_tmpfs.h>
+
+#define TMPFS_NAME_SIZE    32
+#define TMPFS_PAGE_SIZE    WUT_TMPFS_PAGE_SIZE
+
+typedef struct TmpfsNode TmpfsNode;
+
+struct TmpfsNode
+{
+   TmpfsNode *parent;
+   TmpfsNode *children;
+   TmpfsNode *next;
+   char *name;
+   mode_t mode;
+   ino_t ino;
+   time_t mtime;
+   uint32_t size;
+
+   //! Page table, pages which were never written are NULL.
+   uint8_t **pages;
+   uint32_t numPages;
+   uint32_t allocatedPages;
+
+   //! Open files and directories, an unlinked node is freed when it hits 0.
+   uint32_t openCount;
+   BOOL unlinked;
+};
+
+typedef struct TmpfsDevice
+{
+   devoptab_t device;
+   char name[TMPFS_NAME_SIZE];
+   MEMHeapHandle heap;
+   uint32_t maxSize;
+   uint32_t usedSize;
+   ino_t nextIno;
+   uint32_t openCount;
+   OSMutex mutex;
+   TmpfsNode root;
+} TmpfsDevice;
+
+typedef struct TmpfsFile
+{
+   TmpfsNode *node;
+   uint32_t pos;
+   int flags;
+} TmpfsFile;
+
+typedef struct TmpfsDir
+{
+   TmpfsNode *node;
+   uint32_t index;
+} TmpfsDir;
+
+static int
+tmpfsOpen(struct _reent *r, void *fileStruct, const char *path, int flags, int mode);
+
+static void *
+tmpfsAlloc(TmpfsDevice *dev,
+           uint32_t size,
+           int align)
+{
+   if (dev->heap) {
+      return MEMAllocFromExpHeapEx(dev->heap, size, align);
+   }
+
+   return MEMAllocFromDefaultHeapEx(size, align);
+}
+
+static void
+tmpfsFree(TmpfsDevice *dev,
+          void *ptr)
+{
+   if (!ptr) {
+      return;
+   } else if (dev->heap) {
+      MEMFreeToExpHeap(dev->heap, ptr);
+   } else {
+      MEMFreeToDefaultHeap(ptr);
+   }
+}
+
+static TmpfsDevice *
+tmpfsFindDevice(const char *name)
+{
+   int i;
+
+   for (i = 0; i < STD_MAX; ++i) {
+      const devoptab_t *devoptab = devoptab_list[i];
+      if (devoptab && devoptab->open_r == tmpfsOpen && strcmp(devoptab->name, name) == 0) {
+         return (TmpfsDevice *)devoptab->deviceData;
+      }
+   }
+
+   return NULL;
+}
+
+/**
+ * Walk path from the root of dev.
+ *
+ * With outParent, the directory holding the last component and the name of
+ * the last component are also returned, even if it doesn't exist, so the
+ * caller can create it.
+ */
+static TmpfsNode *
+tmpfsLookup(struct _reent *r,
+            TmpfsDevice *dev,
+            const char *path,
+            TmpfsNode **outParent,
+            const char **outName,
+            size_t *outNameLength)
+{
+   TmpfsNode *node = &dev->root;
+   TmpfsNode *child;
+   const char *end;
+   size_t n;
+
+   if (outParent) {
+      *outParent = NULL;
+   }
+
+   // Skip the device name
+   end = strchr(path, ':');
+   if (end) {
+      path = end + 1;
+   }
+
+   while (*path == '/') {
+      ++path;
+   }
+
+   while (*path) {
+      for (end = path; *end && *end != '/'; ++end);
+      n = end - path;
+
+      if (n > NAME_MAX) {
+         r->_errno = ENAMETOOLONG;
+         return NULL;
+      }
+
+      if (!S_ISDIR(node->mode)) {
+         r->_errno = ENOTDIR;
+         return NULL;
+      }
+
+      if (n == 1 && path[0] == '.') {
+         child = node;
+      } else if (n == 2 && path[0] == '.' && path[1] == '.') {
+         child = node->parent;
+      } else {
+         for (child = node->children; child; child = child->next) {
+            if (strncmp(child->name, path, n) == 0 && child->name[n] == '\0') {
+               break;
+            }
+         }
+      }
+
+      while (*end == '/') {
+         ++end;
+      }
+
+      if (!*end && outParent) {
+         *outParent = node;
+         *outName = path;
+         *outNameLength = n;
+         if (child == node || child == node->parent) {
+            // "." and ".." can't be created, removed or renamed
+            *outParent = NULL;
+         }
+      }
+
+      if (!child) {
+         r->_errno = ENOENT;
+         return NULL;
+      }
+
+      node = child;
+      path = end;
+   }
+
+   return node;
+}
+
+static TmpfsNode *
+tmpfsCreate(struct _reent *r,
+            TmpfsDevice *dev,
+            TmpfsNode *parent,
+            const char *name,
+            size_t nameLength,
+            mode_t mode)
+{
+   TmpfsNode *node = (TmpfsNode *)tmpfsAlloc(dev, sizeof(TmpfsNode), 4);
+   if (!node) {
+      r->_errno = ENOSPC;
+      return NULL;
+   }
+
+   memset(node, 0, sizeof(TmpfsNode));
+   node->name = (char *)tmpfsAlloc(dev, nameLength + 1, 4);
+   if (!node->name) {
+      tmpfsFree(dev, node);
+      r->_errno = ENOSPC;
+      return NULL;
+   }
+
+   memcpy(node->name, name, nameLength);
+   node->name[nameLength] = '\0';
+   node->mode = mode;
+   node->ino = dev->nextIno++;
+   node->mtime = time(NULL);
+   node->parent = parent;
+   node->next = parent->children;
+   parent->children = node;
+   parent->mtime = node->mtime;
+   return node;
+}
+
+//! Free the pages past size and clear the end of the last page, so growing the file again reads zeros.
+static void
+tmpfsFreePages(TmpfsDevice *dev,
+               TmpfsNode *node,
+               uint32_t size)
+{
+   uint32_t first = (uint32_t)(((uint64_t)size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE);
+   uint32_t i;
+
+   for (i = first; i < node->numPages; ++i) {
+      if (node->pages[i]) {
+         tmpfsFree(dev, node->pages[i]);
+         node->pages[i] = NULL;
+         node->allocatedPages--;
+         dev->usedSize -= TMPFS_PAGE_SIZE;
+      }
+   }
+
+   if ((size % TMPFS_PAGE_SIZE) && size / TMPFS_PAGE_SIZE < node->numPages && node->pages[size / TMPFS_PAGE_SIZE]) {
+      memset(node->pages[size / TMPFS_PAGE_SIZE] + (size % TMPFS_PAGE_SIZE), 0, TMPFS_PAGE_SIZE - (size % TMPFS_PAGE_SIZE));
+   }
+}
+
+static void
+tmpfsRelease(TmpfsDevice *dev,
+             TmpfsNode *node)
+{
+   if (!node->unlinked || node->openCount) {
+      return;
+   }
+
+   tmpfsFreePages(dev, node, 0);
+   tmpfsFree(dev, node->pages);
+   tmpfsFree(dev, node->name);
+   tmpfsFree(dev, node);
+}
+
+static void
+tmpfsDetach(TmpfsDevice *dev,
+            TmpfsNode *node)
+{
+   TmpfsNode **link = &node->parent->children;
+
+   while (*link != node) {
+      link = &(*link)->next;
+   }
+
+   *link = node->next;
+   node->next = NULL;
+   node->parent->mtime = time(NULL);
+   node->unlinked = TRUE;
+   tmpfsRelease(dev, node);
+}
+
+//! Grow the page table of node to hold at least numPages pages.
+static BOOL
+tmpfsReservePages(TmpfsDevice *dev,
+                  TmpfsNode *node,
+                  uint32_t numPages)
+{
+   uint32_t capacity;
+   uint8_t **pages;
+
+   if (numPages <= node->numPages) {
+      return TRUE;
+   }
+
+   capacity = node->numPages ? node->numPages * 2 : 8;
+   if (capacity < numPages) {
+      capacity = numPages;
+   }
+
+   pages = (uint8_t **)tmpfsAlloc(dev, capacity * sizeof(uint8_t *), 4);
+   if (!pages) {
+      return FALSE;
+   }
+
+   if (node->numPages) {
+      memcpy(pages, node->pages, node->numPages * sizeof(uint8_t *));
+   }
+
+   memset(pages + node->numPages, 0, (capacity - node->numPages) * sizeof(uint8_t *));
+   tmpfsFree(dev, node->pages);
+   node->pages = pages;
+   node->numPages = capacity;
+   return TRUE;
+}
+
+static void
+tmpfsStat(TmpfsNode *node,
+          struct stat *st)
+{
+   memset(st, 0, sizeof(struct stat));
+   st->st_mode = node->mode;
+   st->st_ino = node->ino;
+   st->st_nlink = 1;
+   st->st_size = node->size;
+   st->st_blksize = TMPFS_PAGE_SIZE;
+   st->st_blocks = node->allocatedPages * (TMPFS_PAGE_SIZE / 512);
+   st->st_atime = node->mtime;
+   st->st_mtime = node->mtime;
+   st->st_ctime = node->mtime;
+}
+
+static int
+tmpfsOpen(struct _reent *r,
+          void *fileStruct,
+          const char *path,
+          int flags,
+          int mode)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsFile *file = (TmpfsFile *)fileStruct;
+   TmpfsNode *node, *parent;
+   const char *name;
+   size_t nameLength;
+   int result = -1;
+
+   OSLockMutex(&dev->mutex);
+   node = tmpfsLookup(r, dev, path, &parent, &name, &nameLength);
+   if (!node) {
+      if (!(flags & O_CREAT) || !parent) {
+         goto out;
+      }
+
+      node = tmpfsCreate(r, dev, parent, name, nameLength, S_IFREG | (mode & 0777));
+      if (!node) {
+         goto out;
+      }
+   } else if ((flags & (O_CREAT | O_EXCL)) == (O_CREAT | O_EXCL)) {
+      r->_errno = EEXIST;
+      goto out;
+   } else if (S_ISDIR(node->mode)) {
+      r->_errno = EISDIR;
+      goto out;
+   } else if ((flags & O_TRUNC) && (flags & O_ACCMODE) != O_RDONLY) {
+      tmpfsFreePages(dev, node, 0);
+      node->size = 0;
+      node->mtime = time(NULL);
+   }
+
+   file->node = node;
+   file->pos = 0;
+   file->flags = flags;
+   node->openCount++;
+   dev->openCount++;
+   result = 0;
+
+out:
+   OSUnlockMutex(&dev->mutex);
+   return result;
+}
+
+static int
+tmpfsClose(struct _reent *r,
+           void *fd)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsFile *file = (TmpfsFile *)fd;
+
+   OSLockMutex(&dev->mutex);
+   file->node->openCount--;
+   dev->openCount--;
+   tmpfsRelease(dev, file->node);
+   OSUnlockMutex(&dev->mutex);
+   return 0;
+}
+
+static ssize_t
+tmpfsWrite(struct _reent *r,
+           void *fd,
+           const char *ptr,
+           size_t len)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsFile *file = (TmpfsFile *)fd;
+   TmpfsNode *node = file->node;
+   size_t written = 0;
+   ssize_t result = -1;
+
+   if ((file->flags & O_ACCMODE) == O_RDONLY) {
+      r->_errno = EBADF;
+      return -1;
+   }
+
+   OSLockMutex(&dev->mutex);
+   if (file->flags & O_APPEND) {
+      file->pos = node->size;
+   }
+
+   if ((uint64_t)file->pos + len > UINT32_MAX) {
+      r->_errno = EFBIG;
+      goto out;
+   }
+
+   if (!tmpfsReservePages(dev, node, (uint32_t)(((uint64_t)file->pos + len + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE))) {
+      r->_errno = ENOSPC;
+      goto out;
+   }
+
+   while (written < len) {
+      uint32_t pos = file->pos + written;
+      uint32_t offset = pos % TMPFS_PAGE_SIZE;
+      uint32_t chunk = TMPFS_PAGE_SIZE - offset;
+      uint8_t **page = &node->pages[pos / TMPFS_PAGE_SIZE];
+
+      if (chunk > len - written) {
+         chunk = len - written;
+      }
+
+      if (!*page) {
+         if (dev->maxSize && dev->usedSize + TMPFS_PAGE_SIZE > dev->maxSize) {
+            break;
+         }
+
+         *page = (uint8_t *)tmpfsAlloc(dev, TMPFS_PAGE_SIZE, 0x40);
+         if (!*page) {
+            break;
+         }
+
+         memset(*page, 0, TMPFS_PAGE_SIZE);
+         node->allocatedPages++;
+         dev->usedSize += TMPFS_PAGE_SIZE;
+      }
+
+      memcpy(*page + offset, ptr + written, chunk);
+      written += chunk;
+   }
+
+   // A short write is only an error if nothing fit
+   if (!written && len) {
+      r->_errno = ENOSPC;
+      goto out;
+   }
+
+   file->pos += written;
+   if (file->pos > node->size) {
+      node->size = file->pos;
+   }
+
+   node->mtime = time(NULL);
+   result = (ssize_t)written;
+
+out:
+   OSUnlockMutex(&dev->mutex);
+   return result;
+}
+
+static ssize_t
+tmpfsRead(struct _reent *r,
+          void *fd,
+          char *ptr,
+          size_t len)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsFile *file = (TmpfsFile *)fd;
+   TmpfsNode *node = file->node;
+   size_t done = 0;
+
+   if ((file->flags & O_ACCMODE) == O_WRONLY) {
+      r->_errno = EBADF;
+      return -1;
+   }
+
+   OSLockMutex(&dev->mutex);
+   if (file->pos >= node->size) {
+      len = 0;
+   } else if (len > node->size - file->pos) {
+      len = node->size - file->pos;
+   }
+
+   while (done < len) {
+      uint32_t pos = file->pos + done;
+      uint32_t offset = pos % TMPFS_PAGE_SIZE;
+      uint32_t chunk = TMPFS_PAGE_SIZE - offset;
+      uint32_t index = pos / TMPFS_PAGE_SIZE;
+
+      if (chunk > len - done) {
+         chunk = len - done;
+      }
+
+      // Holes left by seeking or truncating past the end read as zeros
+      if (index < node->numPages && node->pages[index]) {
+         memcpy(ptr + done, node->pages[index] + offset, chunk);
+      } else {
+         memset(ptr + done, 0, chunk);
+      }
+
+      done += chunk;
+   }
+
+   file->pos += done;
+   OSUnlockMutex(&dev->mutex);
+   return (ssize_t)done;
+}
+
+static off_t
+tmpfsSeek(struct _reent *r,
+          void *fd,
+          off_t pos,
+          int dir)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsFile *file = (TmpfsFile *)fd;
+   off_t base;
+
+   switch (dir) {
+   case SEEK_SET:
+      base = 0;
+      break;
+   case SEEK_CUR:
+      base = file->pos;
+      break;
+   case SEEK_END:
+      OSLockMutex(&dev->mutex);
+      base = file->node->size;
+      OSUnlockMutex(&dev->mutex);
+      break;
+   default:
+      r->_errno = EINVAL;
+      return -1;
+   }
+
+   if (base + pos < 0) {
+      r->_errno = EINVAL;
+      return -1;
+   } else if (base + pos > UINT32_MAX) {
+      r->_errno = EOVERFLOW;
+      return -1;
+   }
+
+   file->pos = (uint32_t)(base + pos);
+   return file->pos;
+}
+
+static int
+tmpfsFstat(struct _reent *r,
+           void *fd,
+           struct stat *st)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+
+   OSLockMutex(&dev->mutex);
+   tmpfsStat(((TmpfsFile *)fd)->node, st);
+   OSUnlockMutex(&dev->mutex);
+   return 0;
+}
+
+static int
+tmpfsStatPath(struct _reent *r,
+              const char *path,
+              struct stat *st)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsNode *node;
+
+   OSLockMutex(&dev->mutex);
+   node = tmpfsLookup(r, dev, path, NULL, NULL, NULL);
+   if (node) {
+      tmpfsStat(node, st);
+   }
+
+   OSUnlockMutex(&dev->mutex);
+   return node ? 0 : -1;
+}
+
+static int
+tmpfsUnlink(struct _reent *r,
+            const char *path)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsNode *node;
+   int result = -1;
+
+   OSLockMutex(&dev->mutex);
+   node = tmpfsLookup(r, dev, path, NULL, NULL, NULL);
+   if (!node) {
+      goto out;
+   } else if (S_ISDIR(node->mode)) {
+      r->_errno = EISDIR;
+      goto out;
+   }
+
+   tmpfsDetach(dev, node);
+   result = 0;
+
+out:
+   OSUnlockMutex(&dev->mutex);
+   return result;
+}
+
+static int
+tmpfsRename(struct _reent *r,
+            const char *oldName,
+            const char *newName)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsNode *node, *target, *parent, *ancestor;
+   const char *name;
+   size_t nameLength;
+   char *newNodeName;
+   int result = -1;
+
+   OSLockMutex(&dev->mutex);
+   node = tmpfsLookup(r, dev, oldName, &parent, &name, &nameLength);
+   if (!node) {
+      goto out;
+   } else if (!parent) {
+      r->_errno = node == &dev->root ? EBUSY : EINVAL;
+      goto out;
+   }
+
+   target = tmpfsLookup(r, dev, newName, &parent, &name, &nameLength);
+   if (!parent) {
+      if (target) {
+         r->_errno = EINVAL;
+      }
+      goto out;
+   }
+
+   if (target == node) {
+      result = 0;
+      goto out;
+   }
+
+   if (target) {
+      if (S_ISDIR(node->mode) && !S_ISDIR(target->mode)) {
+         r->_errno = ENOTDIR;
+         goto out;
+      } else if (!S_ISDIR(node->mode) && S_ISDIR(target->mode)) {
+         r->_errno = EISDIR;
+         goto out;
+      } else if (target->children) {
+         r->_errno = ENOTEMPTY;
+         goto out;
+      }
+   }
+
+   // A directory can't be moved below itself
+   for (ancestor = parent; ancestor != &dev->root; ancestor = ancestor->parent) {
+      if (ancestor == node) {
+         r->_errno = EINVAL;
+         goto out;
+      }
+   }
+
+   newNodeName = (char *)tmpfsAlloc(dev, nameLength + 1, 4);
+   if (!newNodeName) {
+      r->_errno = ENOSPC;
+      goto out;
+   }
+
+   memcpy(newNodeName, name, nameLength);
+   newNodeName[nameLength] = '\0';
+
+   if (target) {
+      tmpfsDetach(dev, target);
+   }
+
+   // Detaching takes the node off its old directory, keep it alive meanwhile
+   node->openCount++;
+   tmpfsDetach(dev, node);
+   node->openCount--;
+   node->unlinked = FALSE;
+
+   tmpfsFree(dev, node->name);
+   node->name = newNodeName;
+   node->parent = parent;
+   node->next = parent->children;
+   parent->children = node;
+   parent->mtime = time(NULL);
+   result = 0;
+
+out:
+   OSUnlockMutex(&dev->mutex);
+   return result;
+}
+
+static int
+tmpfsMkdir(struct _reent *r,
+           const char *path,
+           int mode)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsNode *node, *parent;
+   const char *name;
+   size_t nameLength;
+   int result = -1;
+
+   OSLockMutex(&dev->mutex);
+   node = tmpfsLookup(r, dev, path, &parent, &name, &nameLength);
+   if (node) {
+      r->_errno = EEXIST;
+   } else if (parent && tmpfsCreate(r, dev, parent, name, nameLength, S_IFDIR | (mode & 0777))) {
+      result = 0;
+   }
+
+   OSUnlockMutex(&dev->mutex);
+   return result;
+}
+
+static int
+tmpfsRmdir(struct _reent *r,
+           const char *path)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsNode *node, *parent;
+   const char *name;
+   size_t nameLength;
+   int result = -1;
+
+   OSLockMutex(&dev->mutex);
+   node = tmpfsLookup(r, dev, path, &parent, &name, &nameLength);
+   if (!node) {
+      goto out;
+   } else if (!S_ISDIR(node->mode)) {
+      r->_errno = ENOTDIR;
+      goto out;
+   } else if (!parent) {
+      r->_errno = node == &dev->root ? EBUSY : EINVAL;
+      goto out;
+   } else if (node->children) {
+      r->_errno = ENOTEMPTY;
+      goto out;
+   }
+
+   tmpfsDetach(dev, node);
+   result = 0;
+
+out:
+   OSUnlockMutex(&dev->mutex);
+   return result;
+}
+
+static DIR_ITER *
+tmpfsDirOpen(struct _reent *r,
+             DIR_ITER *dirState,
+             const char *path)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsDir *dir = (TmpfsDir *)dirState->dirStruct;
+   TmpfsNode *node;
+
+   OSLockMutex(&dev->mutex);
+   node = tmpfsLookup(r, dev, path, NULL, NULL, NULL);
+   if (node && !S_ISDIR(node->mode)) {
+      r->_errno = ENOTDIR;
+      node = NULL;
+   }
+
+   if (node) {
+      dir->node = node;
+      dir->index = 0;
+      node->openCount++;
+      dev->openCount++;
+   }
+
+   OSUnlockMutex(&dev->mutex);
+   return node ? dirState : NULL;
+}
+
+static int
+tmpfsDirReset(struct _reent *r,
+              DIR_ITER *dirState)
+{
+   ((TmpfsDir *)dirState->dirStruct)->index = 0;
+   return 0;
+}
+
+static int
+tmpfsDirNext(struct _reent *r,
+             DIR_ITER *dirState,
+             char *filename,
+             struct stat *filestat)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsDir *dir = (TmpfsDir *)dirState->dirStruct;
+   TmpfsNode *child;
+   uint32_t i;
+
+   // Counting from the start keeps the position valid while entries are
+   // removed, directories on a RAM disk are expected to stay small
+   OSLockMutex(&dev->mutex);
+   child = dir->node->children;
+   for (i = 0; child && i < dir->index; ++i) {
+      child = child->next;
+   }
+
+   if (child) {
+      snprintf(filename, NAME_MAX + 1, "%s", child->name);
+      tmpfsStat(child, filestat);
+      dir->index++;
+   } else {
+      r->_errno = ENOENT;
+   }
+
+   OSUnlockMutex(&dev->mutex);
+   return child ? 0 : -1;
+}
+
+static int
+tmpfsDirClose(struct _reent *r,
+              DIR_ITER *dirState)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsDir *dir = (TmpfsDir *)dirState->dirStruct;
+
+   OSLockMutex(&dev->mutex);
+   dir->node->openCount--;
+   dev->openCount--;
+   tmpfsRelease(dev, dir->node);
+   OSUnlockMutex(&dev->mutex);
+   return 0;
+}
+
+static int
+tmpfsFtruncate(struct _reent *r,
+               void *fd,
+               off_t len)
+{
+   TmpfsDevice *dev = (TmpfsDevice *)r->deviceData;
+   TmpfsFile *file = (TmpfsFile *)fd;
+
+   if ((file->flags & O_ACCMODE) == O_RDONLY || len < 0) {
+      r->_errno = EINVAL;
+      return -1;
+   } else if (len > UINT32_MAX) {
+      r->_errno = EFBIG;
+      return -1;
+   }
+
+   // Growing only moves the end, the new range is a hole until written
+   OSLockMutex(&dev->mutex);
+   if ((uint32_t)len < file->node->size) {
+      tmpfsFreePages(dev, file->node, (uint32_t)len);
+   }
+
+   file->node->size = (uint32_t)len;
+   file->node->mtime = time(NULL);
+   OSUnlockMutex(&dev->mutex);
+   return 0;
+}
+
+static int
+tmpfsFsync(struct _reent *r,
+           void *fd)
+{
+   return 0;
+}
+
+static const devoptab_t
+sTmpfsDevoptab = {
+   .name         = NULL,
+   .structSize   = sizeof(TmpfsFile),
+   .open_r       = tmpfsOpen,
+   .close_r      = tmpfsClose,
+   .write_r      = tmpfsWrite,
+   .read_r       = tmpfsRead,
+   .seek_r       = tmpfsSeek,
+   .fstat_r      = tmpfsFstat,
+   .stat_r       = tmpfsStatPath,
+   .unlink_r     = tmpfsUnlink,
+   .rename_r     = tmpfsRename,
+   .mkdir_r      = tmpfsMkdir,
+   .dirStateSize = sizeof(TmpfsDir),
+   .diropen_r    = tmpfsDirOpen,
+   .dirreset_r   = tmpfsDirReset,
+   .dirnext_r    = tmpfsDirNext,
+   .dirclose_r   = tmpfsDirClose,
+   .ftruncate_r  = tmpfsFtruncate,
+   .fsync_r      = tmpfsFsync,
+   .rmdir_r      = tmpfsRmdir,
+   .lstat_r      = tmpfsStatPath,
+};
+
+static void
+tmpfsFreeTree(TmpfsDevice *dev,
+              TmpfsNode *node)
+{
+   while (node->children) {
+      TmpfsNode *child = node->children;
+      node->children = child->next;
+      tmpfsFreeTree(dev, child);
+      child->unlinked = TRUE;
+      tmpfsRelease(dev, child);
+   }
+}
+
+int
+WUTTmpfsMount(const char *name,
+              MEMHeapHandle heap,
+              uint32_t maxSize)
+{
+   TmpfsDevice *dev;
+
+   if (!name || !name[0] || strchr(name, ':') || strlen(name) >= TMPFS_NAME_SIZE) {
+      errno = EINVAL;
+      return -1;
+   }
+
+   if (tmpfsFindDevice(name)) {
+      errno = EEXIST;
+      return -1;
+   }
+
+   dev = (TmpfsDevice *)malloc(sizeof(TmpfsDevice));
+   if (!dev) {
+      errno = ENOMEM;
+      return -1;
+   }
+
+   memset(dev, 0, sizeof(TmpfsDevice));
+   memcpy(&dev->device, &sTmpfsDevoptab, sizeof(devoptab_t));
+   snprintf(dev->name, sizeof(dev->name), "%s", name);
+   dev->device.name = dev->name;
+   dev->device.deviceData = dev;
+   dev->heap = heap;
+   dev->maxSize = maxSize;
+   OSInitMutexEx(&dev->mutex, dev->name);
+
+   dev->root.parent = &dev->root;
+   dev->root.name = dev->name;
+   dev->root.mode = S_IFDIR | 0777;
+   dev->root.ino = 1;
+   dev->root.mtime = time(NULL);
+   dev->nextIno = 2;
+
+   if (AddDevice(&dev->device) < 0) {
+      free(dev);
+      errno = ENOMEM;
+      return -1;
+   }
+
+   return 0;
+}
+
+int
+WUTTmpfsUnmount(const char *name)
+{
+   char deviceName[TMPFS_NAME_SIZE + 1];
+   TmpfsDevice *dev;
+
+   dev = name ? tmpfsFindDevice(name) : NULL;
+   if (!dev) {
+      errno = ENOENT;
+      return -1;
+   }
+
+   OSLockMutex(&dev->mutex);
+   if (dev->openCount) {
+      OSUnlockMutex(&dev->mutex);
+      errno = EBUSY;
+      return -1;
+   }
+
+   snprintf(deviceName, sizeof(deviceName), "%s:", dev->name);
+   RemoveDevice(deviceName);
+   tmpfsFreeTree(dev, &dev->root);
+   OSUnlockMutex(&dev->mutex);
+
+   free(dev);
+   return 0;
+}
@@ -0,0 +1,196 @@
+#include <coreinit/debug.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/thread.h>
+#include <string.h>
+#include <wut_usb_bulk.h>
+
+#define USB_BULK_WORKER_STACK_SIZE 0x2000
+
+struct WUTUsbBulkQueue
+{
+   UhsHandle *handle;
+   uint32_t ifHandle;
+   uint8_t endpoint;
+   int32_t direction;
+   uint32_t endpointMask;
+
+   WUTIOSBufferPool *pool;
+
+   OSMessageQueue queue;
+   OSMessage *messages;
+
+   BOOL workerStarted;
+   OSThread worker;
+   uint8_t *stack;
+};
+
+static int
+__wut_usb_bulk_worker_entry(int argc,
+                            const char **argv)
+{
+   WUTUsbBulkQueue *queue = (WUTUsbBulkQueue *)argv;
+   OSMessage message;
+
+   // One transfer at a time, the data of a bulk endpoint is a stream and
+   // blocking requests from several threads could reach IOS out of order
+   while (TRUE) {
+      OSReceiveMessage(&queue->queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+
+      WUTUsbBulkTransfer *transfer = (WUTUsbBulkTransfer *)message.message;
+      if (!transfer) {
+         break;
+      }
+
+      transfer->result = (int32_t)UhsSubmitBulkRequest(queue->handle, queue->ifHandle,
+                                                       queue->endpoint, queue->direction,
+                                                       transfer->buffer, transfer->length,
+                                                       transfer->timeout);
+      transfer->done = TRUE;
+
+      if (transfer->callback) {
+         transfer->callback(transfer, transfer->userContext);
+      }
+   }
+
+   return 0;
+}
+
+static void
+__wut_usb_bulk_free(WUTUsbBulkQueue *queue)
+{
+   if (queue->pool) {
+      WUTIOSBufferPoolDestroy(queue->pool);
+   }
+   if (queue->messages) {
+      MEMFreeToDefaultHeap(queue->messages);
+   }
+   if (queue->stack) {
+      MEMFreeToDefaultHeap(queue->stack);
+   }
+   MEMFreeToDefaultHeap(queue);
+}
+
+static void
+__wut_usb_bulk_stop_worker(WUTUsbBulkQueue *queue)
+{
+   OSMessage message;
+
+   if (!queue->workerStarted) {
+      return;
+   }
+
+   // Queued behind every transfer submitted so far
+   memset(&message, 0, sizeof(message));
+   OSSendMessage(&queue->queue, &message, OS_MESSAGE_FLAGS_BLOCKING);
+   OSJoinThread(&queue->worker, NULL);
+   queue->workerStarted = FALSE;
+}
+
+WUTUsbBulkQueue *
+WUTUsbBulkQueueCreate(UhsHandle *handle,
+                      uint32_t ifHandle,
+                      uint8_t endpoint,
+                      int32_t direction,
+                      uint32_t maxPending,
+                      uint32_t maxTransferSize,
+                      uint32_t queueLength)
+{
+   WUTUsbBulkQueue *queue;
+   UHSStatus status;
+
+   if (!maxPending || !maxTransferSize || !queueLength) {
+      return NULL;
+   }
+
+   queue = (WUTUsbBulkQueue *)MEMAllocFromDefaultHeapEx(sizeof(WUTUsbBulkQueue), 4);
+   if (!queue) {
+      return NULL;
+   }
+
+   memset(queue, 0, sizeof(WUTUsbBulkQueue));
+   queue->handle = handle;
+   queue->ifHandle = ifHandle;
+   queue->endpoint = endpoint & 0x0F;
+   queue->direction = direction;
+
+   queue->pool = WUTIOSBufferPoolCreate(maxTransferSize, maxPending * 2);
+   queue->messages = (OSMessage *)MEMAllocFromDefaultHeapEx(sizeof(OSMessage) * (queueLength + 1), 4);
+   queue->stack = (uint8_t *)MEMAllocFromDefaultHeapEx(USB_BULK_WORKER_STACK_SIZE, 16);
+   if (!queue->pool || !queue->messages || !queue->stack) {
+      __wut_usb_bulk_free(queue);
+      return NULL;
+   }
+
+   if (direction == ENDPOINT_TRANSFER_IN) {
+      queue->endpointMask = 1 << (queue->endpoint + 16);
+   } else {
+      queue->endpointMask = 1 << queue->endpoint;
+   }
+
+   status = UhsAdministerEndpoint(handle, ifHandle, UHS_ADMIN_EP_ENABLE,
+                                  queue->endpointMask, maxPending, maxTransferSize);
+   if (status != UHS_STATUS_OK) {
+      WUT_DEBUG_REPORT("WUTUsbBulkQueueCreate: UhsAdministerEndpoint failed with 0x%08X\n", status);
+      __wut_usb_bulk_free(queue);
+      return NULL;
+   }
+
+   // Room for the stop message on top of queueLength
+   OSInitMessageQueue(&queue->queue, queue->messages, queueLength + 1);
+
+   if (!OSCreateThread(&queue->worker,
+                       __wut_usb_bulk_worker_entry,
+                       0,
+                       (char *)queue,
+                       queue->stack + USB_BULK_WORKER_STACK_SIZE,
+                       USB_BULK_WORKER_STACK_SIZE,
+                       15,
+                       OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+      WUT_DEBUG_REPORT("WUTUsbBulkQueueCreate: OSCreateThread failed\n");
+      UhsAdministerEndpoint(handle, ifHandle, UHS_ADMIN_EP_DISABLE,
+                            queue->endpointMask, 0, 0);
+      __wut_usb_bulk_free(queue);
+      return NULL;
+   }
+
+   OSSetThreadName(&queue->worker, "wut usb bulk");
+   OSResumeThread(&queue->worker);
+   queue->workerStarted = TRUE;
+   return queue;
+}
+
+void
+WUTUsbBulkQueueDestroy(WUTUsbBulkQueue *queue)
+{
+   if (!queue) {
+      return;
+   }
+
+   __wut_usb_bulk_stop_worker(queue);
+   UhsAdministerEndpoint(queue->handle, queue->ifHandle, UHS_ADMIN_EP_DISABLE,
+                         queue->endpointMask, 0, 0);
+   __wut_usb_bulk_free(queue);
+}
+
+WUTIOSBufferPool *
+WUTUsbBulkGetBufferPool(WUTUsbBulkQueue *queue)
+{
+   return queue->pool;
+}
+
+BOOL
+WUTUsbBulkSubmit(WUTUsbBulkQueue *queue,
+                 WUTUsbBulkTransfer *transfer)
+{
+   OSMessage message;
+
+   transfer->result = 0;
+   transfer->done = FALSE;
+
+   message.message = transfer;
+   message.args[0] = 0;
+   message.args[1] = 0;
+   message.args[2] = 0;
+   return OSSendMessage(&queue->queue, &message, OS_MESSAGE_FLAGS_NONE);
+}
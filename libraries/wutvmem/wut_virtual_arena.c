@@ -0,0 +1,107 @@
+#include <coreinit/debug.h>
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memorymap.h>
+#include <string.h>
+#include <wut_virtual_arena.h>
+
+static inline uint32_t
+__wut_virtual_arena_pages(uint32_t size)
+{
+   return (size + OS_PAGE_SIZE - 1) / OS_PAGE_SIZE;
+}
+
+BOOL
+WUTVirtualArenaCreate(WUTVirtualArena *arena,
+                      uint32_t size)
+{
+   uint32_t numPages = __wut_virtual_arena_pages(size);
+
+   memset(arena, 0, sizeof(WUTVirtualArena));
+   if (!numPages) {
+      return FALSE;
+   }
+
+   arena->pages = (void **)MEMAllocFromDefaultHeap(numPages * sizeof(void *));
+   if (!arena->pages) {
+      return FALSE;
+   }
+
+   uint32_t base = OSAllocVirtAddr(0, numPages * OS_PAGE_SIZE, OS_PAGE_SIZE);
+   if (!base) {
+      WUT_DEBUG_REPORT("WUTVirtualArenaCreate: could not reserve 0x%08X bytes\n", numPages * OS_PAGE_SIZE);
+      MEMFreeToDefaultHeap(arena->pages);
+      arena->pages = NULL;
+      return FALSE;
+   }
+
+   arena->base = (uint8_t *)base;
+   arena->reserved = numPages * OS_PAGE_SIZE;
+   return TRUE;
+}
+
+void
+WUTVirtualArenaDestroy(WUTVirtualArena *arena)
+{
+   if (!arena->base) {
+      return;
+   }
+
+   WUTVirtualArenaDecommit(arena, 0);
+   OSFreeVirtAddr((uint32_t)arena->base, arena->reserved);
+   MEMFreeToDefaultHeap(arena->pages);
+   memset(arena, 0, sizeof(WUTVirtualArena));
+}
+
+BOOL
+WUTVirtualArenaCommit(WUTVirtualArena *arena,
+                      uint32_t size)
+{
+   if (size > arena->reserved) {
+      return FALSE;
+   }
+
+   uint32_t numPages = __wut_virtual_arena_pages(size);
+   for (uint32_t i = arena->committed / OS_PAGE_SIZE; i < numPages; ++i) {
+      // A page aligned block of the default heap is physically contiguous
+      void *page = MEMAllocFromDefaultHeapEx(OS_PAGE_SIZE, OS_PAGE_SIZE);
+      if (!page) {
+         return FALSE;
+      }
+
+      uint32_t virtualAddress = (uint32_t)arena->base + i * OS_PAGE_SIZE;
+      if (!OSMapMemory(virtualAddress, OSEffectiveToPhysical((uint32_t)page),
+                       OS_PAGE_SIZE, OS_MAP_MEMORY_READ_WRITE)) {
+         WUT_DEBUG_REPORT("WUTVirtualArenaCommit: could not map 0x%08X\n", virtualAddress);
+         MEMFreeToDefaultHeap(page);
+         return FALSE;
+      }
+
+      arena->pages[i] = page;
+      arena->committed = (i + 1) * OS_PAGE_SIZE;
+   }
+
+   return TRUE;
+}
+
+void
+WUTVirtualArenaDecommit(WUTVirtualArena *arena,
+                        uint32_t size)
+{
+   uint32_t numPages = __wut_virtual_arena_pages(size);
+   uint32_t committedPages = arena->committed / OS_PAGE_SIZE;
+
+   if (numPages >= committedPages) {
+      return;
+   }
+
+   // The caches are physically tagged, so nothing has to be flushed before
+   // the heap hands the memory out again under its own address
+   uint32_t offset = numPages * OS_PAGE_SIZE;
+   OSUnmapMemory((uint32_t)arena->base + offset, arena->committed - offset);
+   for (uint32_t i = numPages; i < committedPages; ++i) {
+      MEMFreeToDefaultHeap(arena->pages[i]);
+      arena->pages[i] = NULL;
+   }
+
+   arena->committed = offset;
+}
@@ -0,0 +1,217 @@
+#include <coreinit/event.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/rendezvous.h>
+#include <coreinit/spinlock.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+#include <whb/proc.h>
+#include <whb/log.h>
+#include <whb/log_console.h>
+
+#include <wut_doorbell.h>
+#include <wut_lockfree.h>
+
+// Every benchmark bounces a token between the main thread on core 1 and a
+// peer thread on core 2, and reports half the average round trip
+static const int kIterations = 10000;
+static const int kStackSize = 0x4000;
+
+static OSThread sPeerThread;
+static uint8_t sPeerStack[kStackSize] __attribute__((aligned(16)));
+static void (*sPeerLoop)();
+
+static int
+peer_entry(int argc, const char **argv)
+{
+   sPeerLoop();
+   return 0;
+}
+
+static void
+run_benchmark(const char *name,
+              void (*ping)(),
+              void (*pong)())
+{
+   sPeerLoop = pong;
+   OSCreateThread(&sPeerThread, peer_entry, 0, NULL,
+                  sPeerStack + sizeof(sPeerStack), sizeof(sPeerStack),
+                  15, OS_THREAD_ATTRIB_AFFINITY_CPU2);
+   OSResumeThread(&sPeerThread);
+
+   OSTime start = OSGetTime();
+   ping();
+   OSTime elapsed = OSGetTime() - start;
+   OSJoinThread(&sPeerThread, NULL);
+
+   WHBLogPrintf("%s: %llu ns per hand-off", name,
+                OSTicksToNanoseconds(elapsed) / (kIterations * 2));
+   WHBLogConsoleDraw();
+}
+
+// OSMessageQueue
+static OSMessageQueue sQueues[2];
+static OSMessage sMessages[2][4];
+
+static void
+queue_ping()
+{
+   OSMessage message = { };
+   for (int i = 0; i < kIterations; ++i) {
+      OSSendMessage(&sQueues[0], &message, OS_MESSAGE_FLAGS_BLOCKING);
+      OSReceiveMessage(&sQueues[1], &message, OS_MESSAGE_FLAGS_BLOCKING);
+   }
+}
+
+static void
+queue_pong()
+{
+   OSMessage message;
+   for (int i = 0; i < kIterations; ++i) {
+      OSReceiveMessage(&sQueues[0], &message, OS_MESSAGE_FLAGS_BLOCKING);
+      OSSendMessage(&sQueues[1], &message, OS_MESSAGE_FLAGS_BLOCKING);
+   }
+}
+
+// OSEvent
+static OSEvent sEvents[2];
+
+static void
+event_ping()
+{
+   for (int i = 0; i < kIterations; ++i) {
+      OSSignalEvent(&sEvents[0]);
+      OSWaitEvent(&sEvents[1]);
+   }
+}
+
+static void
+event_pong()
+{
+   for (int i = 0; i < kIterations; ++i) {
+      OSWaitEvent(&sEvents[0]);
+      OSSignalEvent(&sEvents[1]);
+   }
+}
+
+// OSRendezvous, each one can only be used once
+static OSRendezvous sRendezvous[kIterations * 2];
+static const uint32_t kRendezvousCores = (1 << 1) | (1 << 2);
+
+static void
+rendezvous_loop()
+{
+   for (int i = 0; i < kIterations * 2; ++i) {
+      OSWaitRendezvous(&sRendezvous[i], kRendezvousCores);
+   }
+}
+
+// OSSpinLock guarding whose turn it is
+static OSSpinLock sSpinLock;
+static volatile uint32_t sTurn;
+
+static void
+spinlock_loop(uint32_t self)
+{
+   for (int i = 0; i < kIterations; ) {
+      OSAcquireSpinLock(&sSpinLock);
+      if ((sTurn & 1) == self) {
+         ++sTurn;
+         ++i;
+      }
+      OSReleaseSpinLock(&sSpinLock);
+   }
+}
+
+static void spinlock_ping() { spinlock_loop(0); }
+static void spinlock_pong() { spinlock_loop(1); }
+
+// wut::spsc_queue, both sides spinning
+static wut::spsc_queue<uint32_t, 4> sSpsc[2];
+
+static void
+spsc_ping()
+{
+   uint32_t value = 0;
+   for (int i = 0; i < kIterations; ++i) {
+      while (!sSpsc[0].try_push(value)) { }
+      while (!sSpsc[1].try_pop(value)) { }
+   }
+}
+
+static void
+spsc_pong()
+{
+   uint32_t value;
+   for (int i = 0; i < kIterations; ++i) {
+      while (!sSpsc[0].try_pop(value)) { }
+      while (!sSpsc[1].try_push(value)) { }
+   }
+}
+
+// wut::doorbell, spinning first and blocking straight away
+static wut::doorbell sBells[2];
+static uint32_t sSpinTimeUs;
+
+static void
+doorbell_ping()
+{
+   for (int i = 0; i < kIterations; ++i) {
+      sBells[0].ring();
+      sBells[1].wait(sSpinTimeUs);
+   }
+}
+
+static void
+doorbell_pong()
+{
+   for (int i = 0; i < kIterations; ++i) {
+      sBells[0].wait(sSpinTimeUs);
+      sBells[1].ring();
+   }
+}
+
+int
+main(int argc, char **argv)
+{
+   WHBProcInit();
+   WHBLogConsoleInit();
+
+   // The main thread has to stay on core 1 for the peer to be across cores
+   OSSetThreadAffinity(OSGetCurrentThread(), OS_THREAD_ATTRIB_AFFINITY_CPU1);
+   OSYieldThread();
+
+   OSInitMessageQueue(&sQueues[0], sMessages[0], 4);
+   OSInitMessageQueue(&sQueues[1], sMessages[1], 4);
+   run_benchmark("OSMessageQueue", queue_ping, queue_pong);
+
+   OSInitEvent(&sEvents[0], FALSE, OS_EVENT_MODE_AUTO);
+   OSInitEvent(&sEvents[1], FALSE, OS_EVENT_MODE_AUTO);
+   run_benchmark("OSEvent", event_ping, event_pong);
+
+   for (int i = 0; i < kIterations * 2; ++i) {
+      OSInitRendezvous(&sRendezvous[i]);
+   }
+   run_benchmark("OSRendezvous", rendezvous_loop, rendezvous_loop);
+
+   OSInitSpinLock(&sSpinLock);
+   sTurn = 0;
+   run_benchmark("OSSpinLock", spinlock_ping, spinlock_pong);
+
+   run_benchmark("wut::spsc_queue", spsc_ping, spsc_pong);
+
+   sSpinTimeUs = wut::doorbell::DefaultSpinTimeUs;
+   run_benchmark("wut::doorbell", doorbell_ping, doorbell_pong);
+
+   sSpinTimeUs = 0;
+   run_benchmark("wut::doorbell without spinning", doorbell_ping, doorbell_pong);
+
+   while (WHBProcIsRunning()) {
+      WHBLogConsoleDraw();
+      OSSleepTicks(OSMillisecondsToTicks(100));
+   }
+
+   WHBLogConsoleFree();
+   WHBProcShutdown();
+   return 0;
+}
@@ -0,0 +1,85 @@
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+#include <whb/proc.h>
+#include <whb/log.h>
+#include <whb/log_console.h>
+
+#include <mutex>
+#include <thread>
+
+// Overrides the default in wutstdc++, std::mutex objects created while it
+// is set are backed by OSFastMutex
+uint32_t __wut_gthread_fast_mutex = 0;
+
+static const int kIterations = 1000000;
+
+static void
+lock_loop(std::mutex *mutex,
+          int iterations)
+{
+   for (int i = 0; i < iterations; ++i) {
+      mutex->lock();
+      mutex->unlock();
+   }
+}
+
+static void
+pinned_lock_loop(std::mutex *mutex,
+                 int iterations,
+                 int core)
+{
+   // std::thread runs on any core, pin it so every core really contends
+   OSSetThreadAffinity(OSGetCurrentThread(), OS_THREAD_ATTRIB_AFFINITY_CPU0 << core);
+   OSYieldThread();
+   lock_loop(mutex, iterations);
+}
+
+static void
+run_benchmark(const char *name)
+{
+   std::mutex mutex;
+
+   OSTime start = OSGetTime();
+   lock_loop(&mutex, kIterations);
+   OSTime uncontended = OSGetTime() - start;
+
+   // One thread per core fighting over the same mutex
+   start = OSGetTime();
+   std::thread threads[3];
+   for (int i = 0; i < 3; ++i) {
+      threads[i] = std::thread(pinned_lock_loop, &mutex, kIterations / 3, i);
+   }
+   for (int i = 0; i < 3; ++i) {
+      threads[i].join();
+   }
+   OSTime contended = OSGetTime() - start;
+
+   WHBLogPrintf("%s: uncontended %llu ns, contended %llu ns per lock/unlock",
+                name,
+                OSTicksToNanoseconds(uncontended) / kIterations,
+                OSTicksToNanoseconds(contended) / kIterations);
+   WHBLogConsoleDraw();
+}
+
+int
+main(int argc, char **argv)
+{
+   WHBProcInit();
+   WHBLogConsoleInit();
+
+   __wut_gthread_fast_mutex = 0;
+   run_benchmark("OSMutex");
+
+   __wut_gthread_fast_mutex = 1;
+   run_benchmark("OSFastMutex");
+
+   while (WHBProcIsRunning()) {
+      WHBLogConsoleDraw();
+      OSSleepTicks(OSMillisecondsToTicks(100));
+   }
+
+   WHBLogConsoleFree();
+   WHBProcShutdown();
+   return 0;
+}
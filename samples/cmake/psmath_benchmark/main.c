@@ -0,0 +1,155 @@
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+#include <whb/proc.h>
+#include <whb/log.h>
+#include <whb/log_console.h>
+
+#include <wut_psmath.h>
+
+#define NUM_VERTICES 4096
+#define NUM_ITERATIONS 100
+
+static WUTVec3 sSrc[NUM_VERTICES];
+static WUTVec3 sDst[NUM_VERTICES];
+static int16_t sQuantized[NUM_VERTICES * 3];
+static float sDequantized[NUM_VERTICES * 3];
+
+static void
+report(const char *name,
+       OSTime paired,
+       OSTime scalar,
+       uint32_t count)
+{
+   WHBLogPrintf("%s: paired %llu ns, scalar %llu ns per call",
+                name,
+                OSTicksToNanoseconds(paired) / count,
+                OSTicksToNanoseconds(scalar) / count);
+   WHBLogConsoleDraw();
+}
+
+static void
+bench_transform(void)
+{
+   WUTMtx34 m;
+   WUTQuat q = { 0.0f, 0.3826834f, 0.0f, 0.9238795f };
+   OSTime start, paired, scalar;
+
+   WUTQuatToMtx34(&q, m);
+   m[0][3] = 1.0f;
+   m[1][3] = 2.0f;
+   m[2][3] = 3.0f;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS; ++i) {
+      WUTMtx34MultVecArray(m, sSrc, sDst, NUM_VERTICES);
+   }
+   paired = OSGetTime() - start;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS; ++i) {
+      WUTMtx34MultVecArrayScalar(m, sSrc, sDst, NUM_VERTICES);
+   }
+   scalar = OSGetTime() - start;
+
+   report("Mtx34MultVecArray (per vertex)", paired, scalar, NUM_ITERATIONS * NUM_VERTICES);
+}
+
+static void
+bench_concat(void)
+{
+   WUTMtx44 a, b;
+   OSTime start, paired, scalar;
+
+   WUTMtx44Identity(a);
+   WUTMtx44Identity(b);
+   b[0][1] = 0.5f;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS * 100; ++i) {
+      WUTMtx44Concat(a, b, a);
+   }
+   paired = OSGetTime() - start;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS * 100; ++i) {
+      WUTMtx44ConcatScalar(a, b, a);
+   }
+   scalar = OSGetTime() - start;
+
+   report("Mtx44Concat", paired, scalar, NUM_ITERATIONS * 100);
+}
+
+static void
+bench_quat(void)
+{
+   WUTQuat p = { 0.1f, 0.2f, 0.3f, 0.9f };
+   WUTQuat q = { 0.0f, 0.0f, 0.0998f, 0.995f };
+   OSTime start, paired, scalar;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS * 100; ++i) {
+      WUTQuatMultiply(&p, &q, &p);
+      WUTQuatNormalize(&p, &p);
+   }
+   paired = OSGetTime() - start;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS * 100; ++i) {
+      WUTQuatMultiplyScalar(&p, &q, &p);
+      WUTQuatNormalizeScalar(&p, &p);
+   }
+   scalar = OSGetTime() - start;
+
+   report("QuatMultiply + QuatNormalize", paired, scalar, NUM_ITERATIONS * 100);
+}
+
+static void
+bench_dequantize(void)
+{
+   OSTime start, paired, scalar;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS; ++i) {
+      WUTDequantize(sDequantized, sQuantized, NUM_VERTICES * 3, WUT_QUANT_TYPE_S16, 8);
+   }
+   paired = OSGetTime() - start;
+
+   start = OSGetTime();
+   for (int i = 0; i < NUM_ITERATIONS; ++i) {
+      WUTDequantizeScalar(sDequantized, sQuantized, NUM_VERTICES * 3, WUT_QUANT_TYPE_S16, 8);
+   }
+   scalar = OSGetTime() - start;
+
+   report("Dequantize s16 (per vertex)", paired, scalar, NUM_ITERATIONS * NUM_VERTICES);
+}
+
+int
+main(int argc, char **argv)
+{
+   WHBProcInit();
+   WHBLogConsoleInit();
+
+   for (int i = 0; i < NUM_VERTICES; ++i) {
+      sSrc[i].x = (float)(i % 64);
+      sSrc[i].y = (float)(i / 64);
+      sSrc[i].z = 1.0f;
+      sQuantized[i * 3 + 0] = (int16_t)(i - NUM_VERTICES / 2);
+      sQuantized[i * 3 + 1] = (int16_t)(i * 3);
+      sQuantized[i * 3 + 2] = (int16_t)-i;
+   }
+
+   bench_transform();
+   bench_concat();
+   bench_quat();
+   bench_dequantize();
+
+   while (WHBProcIsRunning()) {
+      WHBLogConsoleDraw();
+      OSSleepTicks(OSMillisecondsToTicks(100));
+   }
+
+   WHBLogConsoleFree();
+   WHBProcShutdown();
+   return 0;
+}
@@ -33,6 +33,9 @@ int main(int argc, char **argv)
       return -1;
    }
 
+   // Run the font and prediction calculations on core 2, off the render core
+   nn::swkbd::StartSubThreads(OS_THREAD_ATTRIB_AFFINITY_CPU2);
+
    // Enable sound
    nn::swkbd::MuteAllSound(false);
 
@@ -62,14 +65,6 @@ int main(int argc, char **argv)
       controllerInfo.kpad[3] = nullptr;
       nn::swkbd::Calc(controllerInfo);
 
-      if (nn::swkbd::IsNeedCalcSubThreadFont()) {
-         nn::swkbd::CalcSubThreadFont();
-      }
-
-      if (nn::swkbd::IsNeedCalcSubThreadPredict()) {
-         nn::swkbd::CalcSubThreadPredict();
-      }
-
       if (nn::swkbd::IsDecideOkButton(nullptr)) {
          nn::swkbd::DisappearInputForm();
          break;
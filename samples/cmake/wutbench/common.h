@@ -0,0 +1,41 @@
+#pragma once
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+#include <whb/proc.h>
+#include <whb/log.h>
+#include <whb/log_console.h>
+
+#include <wutbench/bench.h>
+
+#include <stdio.h>
+
+//! Results are also written to the SD card when there is one
+static inline void
+bench_begin(const char *name)
+{
+   char path[256];
+
+   WHBProcInit();
+   WHBLogConsoleInit();
+
+   snprintf(path, sizeof(path), "fs:/vol/external01/%s.csv", name);
+   if (!WUTBenchInit(path)) {
+      WUTBenchInit(NULL);
+   }
+}
+
+static inline void
+bench_end()
+{
+   WUTBenchShutdown();
+   WHBLogPrintf("Done, press HOME to exit");
+
+   while (WHBProcIsRunning()) {
+      WHBLogConsoleDraw();
+      OSSleepTicks(OSMillisecondsToTicks(100));
+   }
+
+   WHBLogConsoleFree();
+   WHBProcShutdown();
+}
@@ -0,0 +1,87 @@
+#include "common.h"
+
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PATH "fs:/vol/external01/wutbench.tmp"
+
+static const uint32_t kSizes[] = { 512, 4096, 65536, 1024 * 1024 };
+
+//! Offset from a 64 byte aligned buffer, unaligned buffers need bouncing
+static const uint32_t kAlignments[] = { 0, 4, 1 };
+
+typedef struct FileTest
+{
+   int fd;
+   uint8_t *buffer;
+   uint32_t size;
+} FileTest;
+
+static void
+file_pwrite(void *context)
+{
+   FileTest *test = (FileTest *)context;
+   pwrite(test->fd, test->buffer, test->size, 0);
+}
+
+static void
+file_pread(void *context)
+{
+   FileTest *test = (FileTest *)context;
+   pread(test->fd, test->buffer, test->size, 0);
+}
+
+static void
+file_open_close(void *context)
+{
+   close(open(TEST_PATH, O_RDONLY));
+}
+
+int
+main(int argc, char **argv)
+{
+   WUTBenchOptions options;
+   FileTest test;
+   uint8_t *buffer;
+   char name[64];
+
+   bench_begin("file_benchmark");
+   WUTBenchInitOptions(&options);
+   options.iterations = 100;
+   options.warmupIterations = 4;
+
+   buffer = (uint8_t *)memalign(64, kSizes[3] + 64);
+   test.fd = open(TEST_PATH, O_RDWR | O_CREAT | O_TRUNC, 0666);
+   if (!buffer || test.fd < 0) {
+      WHBLogPrintf("Could not create %s", TEST_PATH);
+      bench_end();
+      return 0;
+   }
+
+   memset(buffer, 0xA5, kSizes[3] + 64);
+   WUTBenchRun("open/close", file_open_close, NULL, &options, NULL);
+
+   for (uint32_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+      for (uint32_t j = 0; j < sizeof(kAlignments) / sizeof(kAlignments[0]); ++j) {
+         test.buffer = buffer + kAlignments[j];
+         test.size = kSizes[i];
+         options.bytesPerCall = kSizes[i];
+
+         snprintf(name, sizeof(name), "pwrite %u, offset %u", kSizes[i], kAlignments[j]);
+         WUTBenchRun(name, file_pwrite, &test, &options, NULL);
+
+         snprintf(name, sizeof(name), "pread %u, offset %u", kSizes[i], kAlignments[j]);
+         WUTBenchRun(name, file_pread, &test, &options, NULL);
+         WHBLogConsoleDraw();
+      }
+   }
+
+   close(test.fd);
+   unlink(TEST_PATH);
+   free(buffer);
+   bench_end();
+   return 0;
+}
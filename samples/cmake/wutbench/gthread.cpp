@@ -0,0 +1,102 @@
+#include "common.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+static std::mutex sMutex;
+static std::recursive_mutex sRecursiveMutex;
+static std::shared_mutex sSharedMutex;
+static std::condition_variable sCondition;
+static thread_local uint32_t sThreadLocal;
+
+static void
+mutex_lock_unlock(void *context)
+{
+   sMutex.lock();
+   sMutex.unlock();
+}
+
+static void
+recursive_mutex_lock_unlock(void *context)
+{
+   sRecursiveMutex.lock();
+   sRecursiveMutex.unlock();
+}
+
+static void
+shared_mutex_lock_shared(void *context)
+{
+   sSharedMutex.lock_shared();
+   sSharedMutex.unlock_shared();
+}
+
+static void
+condition_notify_none(void *context)
+{
+   sCondition.notify_one();
+}
+
+static void
+thread_local_access(void *context)
+{
+   ++sThreadLocal;
+}
+
+static void
+thread_create_join(void *context)
+{
+   std::thread thread([] { });
+   thread.join();
+}
+
+//! Hand a token to a thread waiting on a condition variable and back
+static void
+condition_ping_pong(void *context)
+{
+   static bool sServerRunning = false;
+   static bool sToken = false;
+
+   if (!sServerRunning) {
+      sServerRunning = true;
+      std::thread([] {
+         std::unique_lock<std::mutex> lock(sMutex);
+         while (true) {
+            sCondition.wait(lock, [] { return sToken; });
+            sToken = false;
+            sCondition.notify_all();
+         }
+      }).detach();
+   }
+
+   std::unique_lock<std::mutex> lock(sMutex);
+   sToken = true;
+   sCondition.notify_all();
+   sCondition.wait(lock, [] { return !sToken; });
+}
+
+int
+main(int argc, char **argv)
+{
+   WUTBenchOptions options;
+
+   bench_begin("gthread_benchmark");
+   WUTBenchInitOptions(&options);
+   options.callsPerIteration = 64;
+
+   WUTBenchRun("std::mutex lock/unlock", mutex_lock_unlock, NULL, &options, NULL);
+   WUTBenchRun("std::recursive_mutex lock/unlock", recursive_mutex_lock_unlock, NULL, &options, NULL);
+   WUTBenchRun("std::shared_mutex lock_shared/unlock_shared", shared_mutex_lock_shared, NULL, &options, NULL);
+   WUTBenchRun("std::condition_variable notify_one, no waiter", condition_notify_none, NULL, &options, NULL);
+   WUTBenchRun("thread_local increment", thread_local_access, NULL, &options, NULL);
+   WHBLogConsoleDraw();
+
+   options.callsPerIteration = 1;
+   options.iterations = 200;
+   WUTBenchRun("std::condition_variable ping-pong", condition_ping_pong, NULL, &options, NULL);
+   WUTBenchRun("std::thread create/join", thread_create_join, NULL, &options, NULL);
+
+   bench_end();
+   return 0;
+}
@@ -0,0 +1,68 @@
+#include "common.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t kSizes[] = { 16, 64, 256, 4096, 65536, 1024 * 1024 };
+
+static void
+alloc_free(void *context)
+{
+   free(malloc((uintptr_t)context));
+}
+
+static void
+memalign_free(void *context)
+{
+   free(memalign(64, (uintptr_t)context));
+}
+
+static void
+calloc_free(void *context)
+{
+   free(calloc(1, (uintptr_t)context));
+}
+
+//! Grow a block in steps up to the size, like a vector being filled
+static void
+realloc_grow(void *context)
+{
+   void *ptr = NULL;
+   for (uint32_t size = 16; size <= (uintptr_t)context; size *= 2) {
+      ptr = realloc(ptr, size);
+   }
+   free(ptr);
+}
+
+int
+main(int argc, char **argv)
+{
+   WUTBenchOptions options;
+   char name[64];
+
+   bench_begin("malloc_benchmark");
+   WUTBenchInitOptions(&options);
+
+   for (uint32_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+      void *size = (void *)(uintptr_t)kSizes[i];
+
+      options.callsPerIteration = kSizes[i] <= 4096 ? 16 : 1;
+
+      snprintf(name, sizeof(name), "malloc/free %u", kSizes[i]);
+      WUTBenchRun(name, alloc_free, size, &options, NULL);
+
+      snprintf(name, sizeof(name), "memalign(64)/free %u", kSizes[i]);
+      WUTBenchRun(name, memalign_free, size, &options, NULL);
+
+      snprintf(name, sizeof(name), "calloc/free %u", kSizes[i]);
+      WUTBenchRun(name, calloc_free, size, &options, NULL);
+
+      snprintf(name, sizeof(name), "realloc growth to %u", kSizes[i]);
+      WUTBenchRun(name, realloc_grow, size, &options, NULL);
+      WHBLogConsoleDraw();
+   }
+
+   bench_end();
+   return 0;
+}
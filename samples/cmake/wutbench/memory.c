@@ -0,0 +1,119 @@
+#include "common.h"
+
+#include <coreinit/memexpheap.h>
+#include <coreinit/memfrmheap.h>
+#include <coreinit/memheap.h>
+#include <malloc.h>
+#include <string.h>
+
+#define BUFFER_SIZE     (4 * 1024 * 1024)
+#define LINE_SIZE       64
+#define CHASE_LOADS     4096
+#define FRAME_HEAP_TAG  (0x4D454D31)
+
+typedef struct
+{
+   uint8_t *buffer;
+   void *volatile next;
+} Chase;
+
+//! Link every cache line of the buffer into one cycle in random order, so
+//! every load misses the caches and can't be prefetched
+static void
+chase_init(Chase *chase,
+           uint8_t *buffer)
+{
+   static uint32_t order[BUFFER_SIZE / LINE_SIZE];
+   uint32_t numLines = BUFFER_SIZE / LINE_SIZE;
+   uint32_t seed = 0x12345678;
+
+   for (uint32_t i = 0; i < numLines; ++i) {
+      order[i] = i;
+   }
+
+   for (uint32_t i = numLines - 1; i > 0; --i) {
+      seed = seed * 1664525 + 1013904223;
+      uint32_t j = seed % (i + 1);
+      uint32_t tmp = order[i];
+      order[i] = order[j];
+      order[j] = tmp;
+   }
+
+   for (uint32_t i = 0; i < numLines; ++i) {
+      *(void **)(buffer + order[i] * LINE_SIZE) = buffer + order[(i + 1) % numLines] * LINE_SIZE;
+   }
+
+   chase->buffer = buffer;
+   chase->next = buffer + order[0] * LINE_SIZE;
+}
+
+static void
+chase_run(void *context)
+{
+   Chase *chase = (Chase *)context;
+   void *p = chase->next;
+   for (uint32_t i = 0; i < CHASE_LOADS; ++i) {
+      p = *(void **)p;
+   }
+   chase->next = p;
+}
+
+static void
+read_all(void *context)
+{
+   const uint32_t *words = (const uint32_t *)((Chase *)context)->buffer;
+   uint32_t sum = 0;
+   for (uint32_t i = 0; i < BUFFER_SIZE / 4; i += 8) {
+      sum += words[i];
+   }
+   ((Chase *)context)->next = (void *)(uintptr_t)sum;
+}
+
+static void
+bench_memory(const char *name,
+             uint8_t *buffer)
+{
+   WUTBenchOptions options;
+   char label[64];
+   Chase chase;
+
+   chase_init(&chase, buffer);
+   WUTBenchInitOptions(&options);
+   options.iterations = 200;
+
+   // Times are per CHASE_LOADS dependent loads
+   snprintf(label, sizeof(label), "%s random load x%u", name, CHASE_LOADS);
+   WUTBenchRun(label, chase_run, &chase, &options, NULL);
+
+   options.iterations = 50;
+   options.bytesPerCall = BUFFER_SIZE;
+   snprintf(label, sizeof(label), "%s sequential read", name);
+   WUTBenchRun(label, read_all, &chase, &options, NULL);
+   WHBLogConsoleDraw();
+}
+
+int
+main(int argc, char **argv)
+{
+   bench_begin("memory_benchmark");
+
+   uint8_t *mem2 = (uint8_t *)memalign(LINE_SIZE, BUFFER_SIZE);
+   if (mem2) {
+      bench_memory("MEM2", mem2);
+      free(mem2);
+   }
+
+   // MEM1 is ours while in the foreground, the console already took its part
+   MEMHeapHandle mem1Heap = MEMGetBaseHeapHandle(MEM_BASE_HEAP_MEM1);
+   MEMRecordStateForFrmHeap(mem1Heap, FRAME_HEAP_TAG);
+   uint8_t *mem1 = (uint8_t *)MEMAllocFromFrmHeapEx(mem1Heap, BUFFER_SIZE, LINE_SIZE);
+   if (mem1) {
+      bench_memory("MEM1", mem1);
+   } else {
+      WHBLogPrintf("Could not allocate 0x%X bytes of MEM1", BUFFER_SIZE);
+   }
+   MEMFreeByStateToFrmHeap(mem1Heap, FRAME_HEAP_TAG);
+
+   bench_end();
+   return 0;
+}
@@ -0,0 +1,88 @@
+#include "common.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_PORT 45123
+
+static const uint32_t kSizes[] = { 16, 512, 1400, 8192 };
+
+typedef struct SocketTest
+{
+   int sender;
+   int receiver;
+   uint32_t size;
+   uint8_t buffer[8192];
+} SocketTest;
+
+static SocketTest sTest;
+
+static void
+socket_create_close(void *context)
+{
+   close(socket(AF_INET, SOCK_DGRAM, 0));
+}
+
+//! Send a datagram over loopback and receive it again
+static void
+udp_round_trip(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   send(test->sender, test->buffer, test->size, 0);
+   recv(test->receiver, test->buffer, sizeof(test->buffer), 0);
+}
+
+static void
+poll_idle(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   struct pollfd fd = { test->receiver, POLLIN, 0 };
+   poll(&fd, 1, 0);
+}
+
+int
+main(int argc, char **argv)
+{
+   WUTBenchOptions options;
+   struct sockaddr_in addr;
+   char name[64];
+
+   bench_begin("socket_benchmark");
+   WUTBenchInitOptions(&options);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(TEST_PORT);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   sTest.receiver = socket(AF_INET, SOCK_DGRAM, 0);
+   sTest.sender = socket(AF_INET, SOCK_DGRAM, 0);
+   if (sTest.receiver < 0 || sTest.sender < 0 ||
+       bind(sTest.receiver, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+       connect(sTest.sender, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+      WHBLogPrintf("Could not set up loopback sockets");
+      bench_end();
+      return 0;
+   }
+
+   WUTBenchRun("socket/close", socket_create_close, NULL, &options, NULL);
+   WUTBenchRun("poll, nothing ready", poll_idle, &sTest, &options, NULL);
+
+   for (uint32_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+      sTest.size = kSizes[i];
+      options.bytesPerCall = kSizes[i];
+
+      snprintf(name, sizeof(name), "UDP loopback round trip %u", kSizes[i]);
+      WUTBenchRun(name, udp_round_trip, &sTest, &options, NULL);
+      WHBLogConsoleDraw();
+   }
+
+   close(sTest.sender);
+   close(sTest.receiver);
+   bench_end();
+   return 0;
+}
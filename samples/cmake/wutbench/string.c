@@ -0,0 +1,178 @@
+#include "common.h"
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint32_t kSizes[] = { 8, 32, 256, 4096 };
+
+//! Offsets of the strings from a word boundary
+static const uint32_t kOffsets[] = { 0, 1 };
+
+#define BUFFER_SIZE  (4096 + 64)
+
+typedef struct
+{
+   char *a;
+   char *b;
+   uint32_t size;
+   volatile uintptr_t result;
+} StringCase;
+
+/*
+ * Byte at a time reference versions of what libwut replaces. GCC would
+ * otherwise recognise the loops and call the functions being measured.
+ */
+#define REFERENCE __attribute__((noinline, optimize("no-tree-loop-distribute-patterns")))
+
+static REFERENCE size_t
+ref_strlen(const char *s)
+{
+   const char *p = s;
+   while (*p) {
+      ++p;
+   }
+   return p - s;
+}
+
+static REFERENCE int
+ref_strcmp(const char *a,
+           const char *b)
+{
+   while (*a && *a == *b) {
+      ++a;
+      ++b;
+   }
+   return (unsigned char)*a - (unsigned char)*b;
+}
+
+static REFERENCE int
+ref_memcmp(const void *s1,
+           const void *s2,
+           size_t n)
+{
+   const unsigned char *a = s1, *b = s2;
+   for (; n; --n, ++a, ++b) {
+      if (*a != *b) {
+         return *a - *b;
+      }
+   }
+   return 0;
+}
+
+static REFERENCE void *
+ref_memchr(const void *s,
+           int c,
+           size_t n)
+{
+   const unsigned char *p = s;
+   for (; n; --n, ++p) {
+      if (*p == (unsigned char)c) {
+         return (void *)p;
+      }
+   }
+   return NULL;
+}
+
+static REFERENCE void *
+ref_memmove(void *dst,
+            const void *src,
+            size_t n)
+{
+   unsigned char *d = dst;
+   const unsigned char *s = src;
+   if (d < s) {
+      while (n--) {
+         *d++ = *s++;
+      }
+   } else {
+      d += n;
+      s += n;
+      while (n--) {
+         *--d = *--s;
+      }
+   }
+   return dst;
+}
+
+#define STRING_BENCH(name, call) \
+   static void name(void *context) \
+   { \
+      StringCase *c = (StringCase *)context; \
+      c->result = (uintptr_t)(call); \
+   }
+
+STRING_BENCH(bench_strlen, strlen(c->a))
+STRING_BENCH(bench_ref_strlen, ref_strlen(c->a))
+STRING_BENCH(bench_strcmp, strcmp(c->a, c->b))
+STRING_BENCH(bench_ref_strcmp, ref_strcmp(c->a, c->b))
+STRING_BENCH(bench_memcmp, memcmp(c->a, c->b, c->size))
+STRING_BENCH(bench_ref_memcmp, ref_memcmp(c->a, c->b, c->size))
+STRING_BENCH(bench_memchr, memchr(c->a, '!', c->size))
+STRING_BENCH(bench_ref_memchr, ref_memchr(c->a, '!', c->size))
+// Overlapping by one byte, so memmove can't hand it to memcpy
+STRING_BENCH(bench_memmove, memmove(c->a + 1, c->a, c->size))
+STRING_BENCH(bench_ref_memmove, ref_memmove(c->a + 1, c->a, c->size))
+
+static void
+run_pair(const char *name,
+         WUTBenchFn fn,
+         WUTBenchFn reference,
+         StringCase *c,
+         uint32_t offset,
+         WUTBenchOptions *options)
+{
+   char label[64];
+
+   snprintf(label, sizeof(label), "%s %u +%u", name, c->size, offset);
+   WUTBenchRun(label, fn, c, options, NULL);
+
+   snprintf(label, sizeof(label), "%s %u +%u bytewise", name, c->size, offset);
+   WUTBenchRun(label, reference, c, options, NULL);
+}
+
+int
+main(int argc, char **argv)
+{
+   WUTBenchOptions options;
+   StringCase c;
+
+   char *bufferA = (char *)memalign(64, BUFFER_SIZE);
+   char *bufferB = (char *)memalign(64, BUFFER_SIZE);
+   if (!bufferA || !bufferB) {
+      return -1;
+   }
+
+   bench_begin("string_benchmark");
+   WUTBenchInitOptions(&options);
+
+   for (uint32_t o = 0; o < sizeof(kOffsets) / sizeof(kOffsets[0]); ++o) {
+      for (uint32_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+         uint32_t size = kSizes[i];
+
+         // Equal strings of size characters, so everything is compared
+         c.a = bufferA + kOffsets[o];
+         c.b = bufferB + kOffsets[o];
+         c.size = size;
+         options.callsPerIteration = size <= 256 ? 64 : 4;
+         options.bytesPerCall = size;
+
+         memset(c.a, 'a', size);
+         memset(c.b, 'a', size);
+         c.a[size] = '\0';
+         c.b[size] = '\0';
+
+         run_pair("strlen", bench_strlen, bench_ref_strlen, &c, kOffsets[o], &options);
+         run_pair("strcmp", bench_strcmp, bench_ref_strcmp, &c, kOffsets[o], &options);
+         run_pair("memcmp", bench_memcmp, bench_ref_memcmp, &c, kOffsets[o], &options);
+         run_pair("memchr", bench_memchr, bench_ref_memchr, &c, kOffsets[o], &options);
+         run_pair("memmove", bench_memmove, bench_ref_memmove, &c, kOffsets[o], &options);
+         WHBLogConsoleDraw();
+      }
+   }
+
+   bench_end();
+   free(bufferA);
+   free(bufferB);
+   return 0;
+}
@@ -0,0 +1,20 @@
+# Helpers for on-device benchmarks built on libwutbench, see
+# <wutbench/bench.h>:
+#
+#   include("${WUT_ROOT}/share/wut_bench.cmake")
+#   wut_add_benchmark(malloc_benchmark malloc.c)
+#
+# Each benchmark is built as its own RPX and installed next to the other
+# targets of the project.
+
+function(wut_add_benchmark target)
+   if(NOT ARGN)
+      message(FATAL_ERROR "wut_add_benchmark(${target}) needs at least one source file")
+   endif()
+
+   add_executable(${target} ${ARGN})
+   wut_create_rpx(${target})
+
+   install(FILES "${CMAKE_CURRENT_BINARY_DIR}/${target}.rpx"
+           DESTINATION "${CMAKE_INSTALL_PREFIX}")
+endfunction()
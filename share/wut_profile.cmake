@@ -0,0 +1,38 @@
+# Helpers for profile-guided optimisation, see <wut_profile.h>:
+#
+#   include("${WUT_ROOT}/share/wut_profile.cmake")
+#   wut_create_rpx(game)
+#   wut_profile(game GENERATE)
+#
+# GENERATE instruments the target, running it writes its profile to the SD
+# card. Copy that directory back and build with it:
+#
+#   wut_profile(game USE DIR "${CMAKE_SOURCE_DIR}/profile")
+#
+# The .gcda files are named after the mangled path of each object, so the
+# profile only matches objects built in the same build directory.
+
+function(wut_profile target mode)
+   cmake_parse_arguments(PROFILE "" "DIR" "" ${ARGN})
+
+   if(mode STREQUAL "GENERATE")
+      # Every object's .gcda ends up directly in the output directory, the
+      # runtime strips the /wutprofile component again
+      target_compile_options(${target} PRIVATE
+         -fprofile-generate=/wutprofile -fprofile-update=prefer-atomic)
+      target_link_options(${target} PRIVATE
+         -fprofile-generate=/wutprofile
+         -Wl,-u,WUTProfileDump -Wl,-u,__gcov_dump -Wl,-u,__gcov_reset)
+   elseif(mode STREQUAL "USE")
+      if(NOT PROFILE_DIR)
+         set(PROFILE_DIR "${CMAKE_SOURCE_DIR}/profile")
+      endif()
+
+      # Code that didn't run while profiling is still optimised normally
+      target_compile_options(${target} PRIVATE
+         -fprofile-use=${PROFILE_DIR} -fprofile-partial-training -Wno-missing-profile)
+      target_link_options(${target} PRIVATE -fprofile-use=${PROFILE_DIR})
+   else()
+      message(FATAL_ERROR "wut_profile(${target} ${mode}) needs GENERATE or USE")
+   endif()
+endfunction()
@@ -0,0 +1,71 @@
+#pragma once
+#include "../mock/mock.h"
+
+#include <wutbench/bench.h>
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct HostBenchConfig
+{
+   //! Timed samples of small calls, calls moving a lot of data get fewer.
+   uint32_t iterations;
+} HostBenchConfig;
+
+void
+__init_wut_devoptab();
+
+void
+__fini_wut_devoptab();
+
+void
+bench_fsa(const HostBenchConfig *config);
+
+void
+bench_socket(const HostBenchConfig *config);
+
+//! Checks of wut_task.h, returns the number of failures
+int
+test_task(void);
+
+//! Samples for a call moving bytes, so big transfers don't take minutes
+static inline uint32_t
+bench_iterations(const HostBenchConfig *config,
+                 uint32_t bytes)
+{
+   uint32_t iterations = config->iterations;
+   if (bytes > 0x8000) {
+      iterations = iterations * 0x8000ull / bytes;
+   }
+   return iterations < 10 ? 10 : iterations;
+}
+
+//! Run fn and report the backend calls it made per call next to its timings
+static inline void
+bench_run(const char *name,
+          WUTBenchFn fn,
+          void *context,
+          const WUTBenchOptions *options,
+          void (*getCounters)(MockCounters *),
+          void (*resetCounters)(void))
+{
+   MockCounters counters;
+   uint64_t calls = (uint64_t)(options->warmupIterations + options->iterations) *
+                    (options->callsPerIteration ? options->callsPerIteration : 1);
+
+   resetCounters();
+   WUTBenchRun(name, fn, context, options, NULL);
+   getCounters(&counters);
+
+   printf("   %.2f requests, %.2f unaligned, %.1f us modelled per call\n",
+          (double)counters.requests / calls,
+          (double)counters.unaligned / calls,
+          (double)counters.busyUs / calls);
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,272 @@
+#include "common.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define READ_PATH       "fs:/vol/external01/bench/read.bin"
+#define READ_FSA_PATH   "/vol/external01/bench/read.bin"
+#define READ_FILE_SIZE  (8 * 1024 * 1024)
+#define WRITE_PATH      "fs:/vol/external01/bench/write.bin"
+#define LIST_PATH       "fs:/vol/external01/bench/list"
+#define LIST_FSA_PATH   "/vol/external01/bench/list"
+#define LIST_FILES      64
+
+extern uint32_t __wut_fsa_read_ahead_size;
+extern uint32_t __wut_fsa_write_behind_size;
+extern uint32_t __wut_fsa_stat_cache_size;
+extern uint32_t __wut_fsa_handle_cache_size;
+
+static const uint32_t kReadSizes[] = { 64, 512, 4096, 32768, 256 * 1024, 1024 * 1024 };
+static const uint32_t kWriteSizes[] = { 64, 4096, 65536 };
+
+//! Offset from a 64 byte aligned buffer, unaligned buffers need bouncing
+static const uint32_t kAlignments[] = { 0, 4, 32 };
+
+//! Off, and a typical setting for streaming assets
+static const uint32_t kBufferSizes[] = { 0, 0x10000 };
+
+typedef struct FileTest
+{
+   int fd;
+   uint8_t *buffer;
+   uint32_t size;
+   off_t limit;
+   uint32_t seed;
+} FileTest;
+
+static uint32_t
+next_random(uint32_t *seed)
+{
+   *seed ^= *seed << 13;
+   *seed ^= *seed >> 17;
+   *seed ^= *seed << 5;
+   return *seed;
+}
+
+static BOOL
+check_pattern(const uint8_t *buffer,
+              uint32_t offset,
+              uint32_t size)
+{
+   for (uint32_t i = 0; i < size; ++i) {
+      if (buffer[i] != MockFSAFileByte(offset + i)) {
+         return FALSE;
+      }
+   }
+   return TRUE;
+}
+
+//! Read through the file, starting over at its end
+static void
+file_read(void *context)
+{
+   FileTest *test = (FileTest *)context;
+   if (read(test->fd, test->buffer, test->size) < (ssize_t)test->size) {
+      lseek(test->fd, 0, SEEK_SET);
+   }
+}
+
+static void
+file_pread_random(void *context)
+{
+   FileTest *test = (FileTest *)context;
+   off_t blocks = test->limit / test->size;
+   pread(test->fd, test->buffer, test->size, (next_random(&test->seed) % blocks) * test->size);
+}
+
+static void
+file_write(void *context)
+{
+   FileTest *test = (FileTest *)context;
+   if (lseek(test->fd, 0, SEEK_CUR) + test->size > test->limit) {
+      lseek(test->fd, 0, SEEK_SET);
+   }
+   write(test->fd, test->buffer, test->size);
+}
+
+static void
+file_open_close(void *context)
+{
+   close(open(READ_PATH, O_RDONLY));
+}
+
+static void
+file_stat(void *context)
+{
+   struct stat st;
+   stat(READ_PATH, &st);
+}
+
+static void
+dir_list(void *context)
+{
+   DIR *dir = opendir(LIST_PATH);
+   if (dir) {
+      while (readdir(dir)) {
+      }
+      closedir(dir);
+   }
+}
+
+static void
+bench_fsa_run(const char *name,
+              WUTBenchFn fn,
+              void *context,
+              const WUTBenchOptions *options)
+{
+   bench_run(name, fn, context, options, MockFSAGetCounters, MockFSAResetCounters);
+}
+
+static void
+bench_reads(const HostBenchConfig *config,
+            uint8_t *buffer)
+{
+   WUTBenchOptions options;
+   FileTest test;
+   char name[96];
+
+   WUTBenchInitOptions(&options);
+   for (uint32_t i = 0; i < sizeof(kReadSizes) / sizeof(kReadSizes[0]); ++i) {
+      for (uint32_t j = 0; j < sizeof(kAlignments) / sizeof(kAlignments[0]); ++j) {
+         for (uint32_t k = 0; k < sizeof(kBufferSizes) / sizeof(kBufferSizes[0]); ++k) {
+            // Read-ahead is picked when a file is opened
+            __wut_fsa_read_ahead_size = kBufferSizes[k];
+            test.fd = open(READ_PATH, O_RDONLY);
+            test.buffer = buffer + kAlignments[j];
+            test.size = kReadSizes[i];
+            if (test.fd < 0) {
+               printf("Could not open %s\n", READ_PATH);
+               return;
+            }
+
+            if (read(test.fd, test.buffer, test.size) != (ssize_t)test.size ||
+                !check_pattern(test.buffer, 0, test.size)) {
+               printf("read %u, offset %u returned wrong data\n", test.size, kAlignments[j]);
+            }
+
+            options.iterations = bench_iterations(config, test.size);
+            options.warmupIterations = options.iterations / 10;
+            options.bytesPerCall = test.size;
+            snprintf(name, sizeof(name), "read %u, offset %u, read-ahead %u",
+                     kReadSizes[i], kAlignments[j], kBufferSizes[k]);
+            bench_fsa_run(name, file_read, &test, &options);
+            close(test.fd);
+         }
+      }
+   }
+
+   __wut_fsa_read_ahead_size = 0;
+   test.fd = open(READ_PATH, O_RDONLY);
+   test.buffer = buffer;
+   test.limit = READ_FILE_SIZE;
+   test.seed = 0x12345678;
+   for (uint32_t i = 2; i < 4; ++i) {
+      test.size = kReadSizes[i];
+      options.iterations = bench_iterations(config, test.size);
+      options.warmupIterations = options.iterations / 10;
+      options.bytesPerCall = test.size;
+      snprintf(name, sizeof(name), "pread %u, random offset", test.size);
+      bench_fsa_run(name, file_pread_random, &test, &options);
+   }
+   close(test.fd);
+}
+
+static void
+bench_writes(const HostBenchConfig *config,
+             uint8_t *buffer)
+{
+   WUTBenchOptions options;
+   FileTest test;
+   char name[96];
+
+   WUTBenchInitOptions(&options);
+   test.limit = 1024 * 1024;
+   for (uint32_t i = 0; i < sizeof(kWriteSizes) / sizeof(kWriteSizes[0]); ++i) {
+      for (uint32_t j = 0; j < sizeof(kAlignments) / sizeof(kAlignments[0]); ++j) {
+         for (uint32_t k = 0; k < sizeof(kBufferSizes) / sizeof(kBufferSizes[0]); ++k) {
+            __wut_fsa_write_behind_size = kBufferSizes[k];
+            test.fd = open(WRITE_PATH, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            test.buffer = buffer + kAlignments[j];
+            test.size = kWriteSizes[i];
+            if (test.fd < 0) {
+               printf("Could not create %s\n", WRITE_PATH);
+               return;
+            }
+
+            options.iterations = bench_iterations(config, test.size);
+            options.warmupIterations = options.iterations / 10;
+            options.bytesPerCall = test.size;
+            snprintf(name, sizeof(name), "write %u, offset %u, write-behind %u",
+                     kWriteSizes[i], kAlignments[j], kBufferSizes[k]);
+            bench_fsa_run(name, file_write, &test, &options);
+            close(test.fd);
+         }
+      }
+   }
+
+   __wut_fsa_write_behind_size = 0;
+   unlink(WRITE_PATH);
+}
+
+static void
+bench_metadata(const HostBenchConfig *config,
+               BOOL cached)
+{
+   WUTBenchOptions options;
+   char name[96];
+
+   // The caches are set up with the device
+   __fini_wut_devoptab();
+   __wut_fsa_stat_cache_size = cached ? 64 : 0;
+   __wut_fsa_handle_cache_size = cached ? 8 : 0;
+   __init_wut_devoptab();
+
+   WUTBenchInitOptions(&options);
+   options.iterations = config->iterations;
+   options.warmupIterations = options.iterations / 10;
+
+   snprintf(name, sizeof(name), "open/close, %s", cached ? "handle cache" : "no cache");
+   bench_fsa_run(name, file_open_close, NULL, &options);
+
+   snprintf(name, sizeof(name), "stat, %s", cached ? "stat cache" : "no cache");
+   bench_fsa_run(name, file_stat, NULL, &options);
+
+   snprintf(name, sizeof(name), "list %u entries, %s", LIST_FILES, cached ? "stat cache" : "no cache");
+   bench_fsa_run(name, dir_list, NULL, &options);
+
+   __fini_wut_devoptab();
+   __wut_fsa_stat_cache_size = 0;
+   __wut_fsa_handle_cache_size = 0;
+   __init_wut_devoptab();
+}
+
+void
+bench_fsa(const HostBenchConfig *config)
+{
+   uint8_t *buffer;
+   char path[64];
+
+   MockFSAClear();
+   MockFSACreateFile(READ_FSA_PATH, READ_FILE_SIZE);
+   for (uint32_t i = 0; i < LIST_FILES; ++i) {
+      snprintf(path, sizeof(path), LIST_FSA_PATH "/%03u.bin", i);
+      MockFSACreateFile(path, 4096);
+   }
+
+   buffer = (uint8_t *)aligned_alloc(64, 2 * 1024 * 1024);
+   if (!buffer) {
+      return;
+   }
+   memset(buffer, 0xA5, 2 * 1024 * 1024);
+
+   bench_reads(config, buffer);
+   bench_writes(config, buffer);
+   bench_metadata(config, FALSE);
+   bench_metadata(config, TRUE);
+
+   free(buffer);
+}
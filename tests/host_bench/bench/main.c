@@ -0,0 +1,116 @@
+#include "common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Defaults in the order of an SD card behind IOS and a 100 Mbit link, pass
+ * --fsa-latency 0 --net-latency 0 to time the library code alone.
+ */
+#define DEFAULT_FSA_LATENCY_US  50
+#define DEFAULT_FSA_RATE        20
+#define DEFAULT_NET_LATENCY_US  20
+#define DEFAULT_NET_RATE        12
+#define DEFAULT_ITERATIONS      200
+
+static void
+usage(const char *argv0)
+{
+   printf("usage: %s [options] [fsa] [socket] [task]\n"
+          "  --fsa-latency US     fixed cost of every FSA call (%u)\n"
+          "  --fsa-rate MBPS      FSA transfer rate, 0 for unlimited (%u)\n"
+          "  --fsa-channels N     FSA calls served at once, 0 for unlimited (1)\n"
+          "  --net-latency US     fixed cost of every nsysnet call (%u)\n"
+          "  --net-rate MBPS      nsysnet transfer rate, 0 for unlimited (%u)\n"
+          "  --iterations N       timed samples of small calls (%u)\n"
+          "  --csv PATH           also write the results as CSV\n",
+          argv0, DEFAULT_FSA_LATENCY_US, DEFAULT_FSA_RATE,
+          DEFAULT_NET_LATENCY_US, DEFAULT_NET_RATE, DEFAULT_ITERATIONS);
+}
+
+int
+main(int argc,
+     char **argv)
+{
+   MockLatency fsa = { DEFAULT_FSA_LATENCY_US, DEFAULT_FSA_RATE, 1 };
+   MockLatency net = { DEFAULT_NET_LATENCY_US, DEFAULT_NET_RATE, 0 };
+   HostBenchConfig config = { DEFAULT_ITERATIONS };
+   const char *csv = NULL;
+   BOOL runFsa = FALSE;
+   BOOL runSocket = FALSE;
+   BOOL runTask = FALSE;
+   int failures = 0;
+
+   for (int i = 1; i < argc; ++i) {
+      const char *arg = argv[i];
+      const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+      uint32_t *option = NULL;
+
+      if (!strcmp(arg, "fsa")) {
+         runFsa = TRUE;
+         continue;
+      } else if (!strcmp(arg, "socket")) {
+         runSocket = TRUE;
+         continue;
+      } else if (!strcmp(arg, "task")) {
+         runTask = TRUE;
+         continue;
+      } else if (!strcmp(arg, "--fsa-latency")) {
+         option = &fsa.requestUs;
+      } else if (!strcmp(arg, "--fsa-rate")) {
+         option = &fsa.bytesPerUs;
+      } else if (!strcmp(arg, "--fsa-channels")) {
+         option = &fsa.channels;
+      } else if (!strcmp(arg, "--net-latency")) {
+         option = &net.requestUs;
+      } else if (!strcmp(arg, "--net-rate")) {
+         option = &net.bytesPerUs;
+      } else if (!strcmp(arg, "--iterations")) {
+         option = &config.iterations;
+      } else if (!strcmp(arg, "--csv") && value) {
+         csv = value;
+         ++i;
+         continue;
+      }
+
+      if (!option || !value) {
+         usage(argv[0]);
+         return 1;
+      }
+
+      *option = (uint32_t)strtoul(value, NULL, 0);
+      ++i;
+   }
+
+   if (!runFsa && !runSocket && !runTask) {
+      runFsa = runSocket = TRUE;
+   }
+   if (!config.iterations) {
+      config.iterations = 1;
+   }
+
+   if (!WUTBenchInit(csv)) {
+      return 1;
+   }
+
+   MockFSASetLatency(&fsa);
+   MockNetSetLatency(&net);
+   __init_wut_devoptab();
+
+   if (runFsa) {
+      printf("FSA: %u us per call, %u MB/s, %u channels\n", fsa.requestUs, fsa.bytesPerUs, fsa.channels);
+      bench_fsa(&config);
+   }
+   if (runSocket) {
+      printf("nsysnet: %u us per call, %u MB/s\n", net.requestUs, net.bytesPerUs);
+      bench_socket(&config);
+   }
+   if (runTask) {
+      MockNetSetLatency(&(MockLatency) { 0, 0, 0 });
+      failures = test_task();
+   }
+
+   __fini_wut_devoptab();
+   WUTBenchShutdown();
+   return failures ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+#include "common.h"
+
+#include <wut_tcp_stream.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TCP_PORT      45123
+#define UDP_PORT      45124
+#define MAX_PAIRS     15
+#define BATCH         16
+#define DATAGRAM_SIZE 512
+
+static const uint32_t kPollCounts[] = { 1, 4, 8, MAX_PAIRS };
+static const uint32_t kStreamSizes[] = { 64, 1460, 16384, 65536 };
+static const uint32_t kWriteSizes[] = { 16, 128 };
+
+typedef struct SocketTest
+{
+   int client[MAX_PAIRS];
+   int server[MAX_PAIRS];
+   uint32_t count;
+   uint32_t size;
+   int sender;
+   int receiver;
+   wut_tcp_stream_t *stream;
+   uint8_t buffer[65536];
+   uint8_t datagrams[BATCH][DATAGRAM_SIZE];
+} SocketTest;
+
+static SocketTest sTest;
+
+//! Connect count TCP pairs, the last server end has a byte waiting
+static BOOL
+connect_pairs(SocketTest *test)
+{
+   struct sockaddr_in addr;
+   int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(TCP_PORT);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if (listener < 0 ||
+       bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+       listen(listener, MAX_PAIRS) < 0) {
+      return FALSE;
+   }
+
+   for (uint32_t i = 0; i < MAX_PAIRS; ++i) {
+      test->client[i] = socket(AF_INET, SOCK_STREAM, 0);
+      if (test->client[i] < 0 ||
+          connect(test->client[i], (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+          (test->server[i] = accept(listener, NULL, NULL)) < 0) {
+         close(listener);
+         return FALSE;
+      }
+   }
+
+   close(listener);
+   return send(test->client[MAX_PAIRS - 1], "x", 1, 0) == 1;
+}
+
+static BOOL
+connect_udp(SocketTest *test)
+{
+   struct sockaddr_in addr;
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(UDP_PORT);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+   test->receiver = socket(AF_INET, SOCK_DGRAM, 0);
+   test->sender = socket(AF_INET, SOCK_DGRAM, 0);
+   return test->receiver >= 0 && test->sender >= 0 &&
+          bind(test->receiver, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+          connect(test->sender, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+}
+
+static void
+poll_last_ready(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   uint32_t first = MAX_PAIRS - test->count;
+   struct pollfd fds[MAX_PAIRS];
+
+   for (uint32_t i = 0; i < test->count; ++i) {
+      fds[i].fd = test->server[first + i];
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+   }
+   poll(fds, test->count, 0);
+}
+
+static void
+select_last_ready(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   struct timeval timeout = { 0, 0 };
+   fd_set fds;
+   int nfds = 0;
+
+   FD_ZERO(&fds);
+   for (uint32_t i = MAX_PAIRS - test->count; i < MAX_PAIRS; ++i) {
+      FD_SET(test->server[i], &fds);
+      nfds = test->server[i] >= nfds ? test->server[i] + 1 : nfds;
+   }
+   select(nfds, &fds, NULL, NULL, &timeout);
+}
+
+//! Send size bytes and receive them on the other end
+static void
+tcp_round_trip(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   uint32_t received = 0;
+
+   send(test->client[0], test->buffer, test->size, 0);
+   while (received < test->size) {
+      ssize_t rc = recv(test->server[0], test->buffer + received, test->size - received, 0);
+      if (rc <= 0) {
+         break;
+      }
+      received += rc;
+   }
+}
+
+//! BATCH sends of size bytes, then drain the other end
+static void
+tcp_small_writes(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   for (uint32_t i = 0; i < BATCH; ++i) {
+      send(test->client[0], test->buffer, test->size, 0);
+   }
+   recv(test->server[0], test->buffer, BATCH * test->size, MSG_DONTWAIT);
+}
+
+static void
+tcp_stream_writes(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   wut_tcp_stream_cork(test->stream);
+   for (uint32_t i = 0; i < BATCH; ++i) {
+      wut_tcp_stream_write(test->stream, test->buffer, test->size);
+   }
+   wut_tcp_stream_uncork(test->stream);
+   recv(test->server[0], test->buffer, BATCH * test->size, MSG_DONTWAIT);
+}
+
+static void
+udp_send_batch(SocketTest *test)
+{
+   struct mmsghdr messages[BATCH];
+   struct iovec iov[BATCH];
+
+   memset(messages, 0, sizeof(messages));
+   for (uint32_t i = 0; i < BATCH; ++i) {
+      iov[i].iov_base = test->datagrams[i];
+      iov[i].iov_len = DATAGRAM_SIZE;
+      messages[i].msg_hdr.msg_iov = &iov[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+   }
+   sendmmsg(test->sender, messages, BATCH, 0);
+}
+
+static void
+udp_recv_loop(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   udp_send_batch(test);
+   for (uint32_t i = 0; i < BATCH; ++i) {
+      recv(test->receiver, test->datagrams[i], DATAGRAM_SIZE, 0);
+   }
+}
+
+static void
+udp_recvmmsg(void *context)
+{
+   SocketTest *test = (SocketTest *)context;
+   struct mmsghdr messages[BATCH];
+   struct iovec iov[BATCH];
+
+   udp_send_batch(test);
+
+   memset(messages, 0, sizeof(messages));
+   for (uint32_t i = 0; i < BATCH; ++i) {
+      iov[i].iov_base = test->datagrams[i];
+      iov[i].iov_len = DATAGRAM_SIZE;
+      messages[i].msg_hdr.msg_iov = &iov[i];
+      messages[i].msg_hdr.msg_iovlen = 1;
+   }
+   recvmmsg(test->receiver, messages, BATCH, 0, NULL);
+}
+
+static void
+bench_net_run(const char *name,
+              WUTBenchFn fn,
+              void *context,
+              const WUTBenchOptions *options)
+{
+   bench_run(name, fn, context, options, MockNetGetCounters, MockNetResetCounters);
+}
+
+void
+bench_socket(const HostBenchConfig *config)
+{
+   WUTBenchOptions options;
+   char name[96];
+
+   if (!connect_pairs(&sTest) || !connect_udp(&sTest)) {
+      printf("Could not set up loopback sockets\n");
+      return;
+   }
+
+   WUTBenchInitOptions(&options);
+   options.iterations = config->iterations;
+   options.warmupIterations = options.iterations / 10;
+
+   for (uint32_t i = 0; i < sizeof(kPollCounts) / sizeof(kPollCounts[0]); ++i) {
+      sTest.count = kPollCounts[i];
+
+      snprintf(name, sizeof(name), "poll %u fds, last ready", sTest.count);
+      bench_net_run(name, poll_last_ready, &sTest, &options);
+
+      snprintf(name, sizeof(name), "select %u fds, last ready", sTest.count);
+      bench_net_run(name, select_last_ready, &sTest, &options);
+   }
+
+   for (uint32_t i = 0; i < sizeof(kStreamSizes) / sizeof(kStreamSizes[0]); ++i) {
+      sTest.size = kStreamSizes[i];
+      options.iterations = bench_iterations(config, sTest.size);
+      options.warmupIterations = options.iterations / 10;
+      options.bytesPerCall = sTest.size;
+
+      snprintf(name, sizeof(name), "TCP round trip %u", sTest.size);
+      bench_net_run(name, tcp_round_trip, &sTest, &options);
+   }
+
+   sTest.stream = wut_tcp_stream_create(sTest.client[0], 0);
+   options.iterations = config->iterations;
+   options.warmupIterations = options.iterations / 10;
+   for (uint32_t i = 0; i < sizeof(kWriteSizes) / sizeof(kWriteSizes[0]); ++i) {
+      sTest.size = kWriteSizes[i];
+      options.bytesPerCall = BATCH * sTest.size;
+
+      snprintf(name, sizeof(name), "%u sends of %u", BATCH, sTest.size);
+      bench_net_run(name, tcp_small_writes, &sTest, &options);
+
+      if (sTest.stream) {
+         snprintf(name, sizeof(name), "%u stream writes of %u, corked", BATCH, sTest.size);
+         bench_net_run(name, tcp_stream_writes, &sTest, &options);
+      }
+   }
+   if (sTest.stream) {
+      wut_tcp_stream_destroy(sTest.stream);
+   }
+
+   options.bytesPerCall = BATCH * DATAGRAM_SIZE;
+   snprintf(name, sizeof(name), "sendmmsg %u + recv loop", BATCH);
+   bench_net_run(name, udp_recv_loop, &sTest, &options);
+
+   snprintf(name, sizeof(name), "sendmmsg %u + recvmmsg", BATCH);
+   bench_net_run(name, udp_recvmmsg, &sTest, &options);
+
+   for (uint32_t i = 0; i < MAX_PAIRS; ++i) {
+      close(sTest.client[i]);
+      close(sTest.server[i]);
+   }
+   close(sTest.sender);
+   close(sTest.receiver);
+}
@@ -0,0 +1,223 @@
+#include "common.h"
+
+#include <wut_task.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <thread>
+
+/*
+ * Checks of the wut::scheduler awaitables that depend on timing between
+ * threads, which the header compile tests can't cover.
+ */
+
+#define TASK_PORT       45125
+#define TASK_TIMEOUT_S  10
+
+static int sFailures = 0;
+
+#define TASK_CHECK(cond) \
+   do { \
+      if (!(cond)) { \
+         printf("   FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+         ++sFailures; \
+      } \
+   } while (0)
+
+//! Run the scheduler, a lost resume would make run() wait forever
+static bool
+run_with_timeout(wut::scheduler &sched)
+{
+   std::packaged_task<void()> run([&sched]() { sched.run(); });
+   std::future<void> done = run.get_future();
+   std::thread thread(std::move(run));
+
+   if (done.wait_for(std::chrono::seconds(TASK_TIMEOUT_S)) != std::future_status::ready) {
+      printf("   FAILED: scheduler did not finish in %u s\n", TASK_TIMEOUT_S);
+      fflush(stdout);
+      _Exit(1);
+   }
+
+   thread.join();
+   return true;
+}
+
+static wut::task<void>
+sleeper(wut::scheduler &sched,
+        bool *resumed)
+{
+   co_await sched.sleep_for(OSMillisecondsToTicks(5));
+   *resumed = true;
+}
+
+//! Fills the message queue and holds the scheduler thread while the alarm
+//! of sleeper fires, so the alarm can't post its resume
+static wut::task<void>
+queue_filler(wut::scheduler &sched,
+             uint32_t *posted)
+{
+   while (sched.post(std::noop_coroutine(), false)) {
+      ++*posted;
+   }
+
+   OSSleepTicks(OSMillisecondsToTicks(50));
+   co_return;
+}
+
+static void
+test_alarm_with_full_queue()
+{
+   wut::scheduler sched;
+   bool resumed = false;
+   uint32_t posted = 0;
+
+   printf("sleep_for with a full message queue\n");
+   sched.spawn(sleeper(sched, &resumed));
+   sched.spawn(queue_filler(sched, &posted));
+   run_with_timeout(sched);
+
+   TASK_CHECK(posted > 0);
+   TASK_CHECK(resumed);
+}
+
+// GCC 12 miscompiles co_await in a condition, so results go through a local
+
+static wut::task<void>
+wait_readable(wut::scheduler &sched,
+              int fd,
+              uint32_t *count)
+{
+   bool ok = co_await sched.readable(fd);
+   if (ok) {
+      ++*count;
+   }
+}
+
+static wut::task<void>
+wait_writable_then_send(wut::scheduler &sched,
+                        int fd,
+                        int peer,
+                        uint32_t *count)
+{
+   bool ok = co_await sched.writable(fd);
+   if (ok) {
+      ++*count;
+   }
+
+   co_await sched.sleep_for(OSMillisecondsToTicks(5));
+   send(peer, "x", 1, 0);
+}
+
+static bool
+connect_pair(int *client,
+             int *server)
+{
+   struct sockaddr_in addr;
+   int listener = socket(AF_INET, SOCK_STREAM, 0);
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sin_family = AF_INET;
+   addr.sin_port = htons(TASK_PORT);
+   addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   if (listener < 0
+    || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0
+    || listen(listener, 1) < 0) {
+      return false;
+   }
+
+   *client = socket(AF_INET, SOCK_STREAM, 0);
+   if (*client < 0
+    || connect(*client, (struct sockaddr *)&addr, sizeof(addr)) < 0
+    || (*server = accept(listener, NULL, NULL)) < 0) {
+      close(listener);
+      return false;
+   }
+
+   close(listener);
+   return true;
+}
+
+static void
+test_shared_socket()
+{
+   wut::scheduler sched;
+   uint32_t readable = 0, writable = 0;
+   int client = -1, server = -1;
+
+   printf("several awaiters on one socket\n");
+   if (!connect_pair(&client, &server)) {
+      TASK_CHECK(!"connect_pair");
+      return;
+   }
+
+   sched.spawn(wait_readable(sched, server, &readable));
+   sched.spawn(wait_readable(sched, server, &readable));
+   sched.spawn(wait_writable_then_send(sched, server, client, &writable));
+   run_with_timeout(sched);
+
+   TASK_CHECK(writable == 1);
+   TASK_CHECK(readable == 2);
+
+   close(client);
+   close(server);
+}
+
+static wut::task<void>
+wait_readable_result(wut::scheduler &sched,
+                     int fd,
+                     uint32_t *failed)
+{
+   bool ok = co_await sched.readable(fd);
+   if (!ok) {
+      ++*failed;
+   }
+}
+
+static wut::task<void>
+close_later(wut::scheduler &sched,
+            int fd)
+{
+   co_await sched.sleep_for(OSMillisecondsToTicks(5));
+   close(fd);
+}
+
+static void
+test_closed_socket()
+{
+   wut::scheduler sched;
+   uint32_t failed = 0;
+   int client = -1, server = -1;
+
+   printf("socket closed while awaited\n");
+   if (!connect_pair(&client, &server)) {
+      TASK_CHECK(!"connect_pair");
+      return;
+   }
+
+   // Nothing is ever sent, both waiters can only resume through the error
+   sched.spawn(wait_readable_result(sched, server, &failed));
+   sched.spawn(wait_readable_result(sched, client, &failed));
+   sched.spawn(close_later(sched, server));
+   run_with_timeout(sched);
+
+   TASK_CHECK(failed == 2);
+
+   close(client);
+}
+
+int
+test_task()
+{
+   test_alarm_with_full_queue();
+   test_shared_socket();
+   test_closed_socket();
+
+   printf("%d failures\n", sFailures);
+   return sFailures;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+ * Forced into the library sources and the benchmarks. newlib sends these
+ * through the devoptab of the path or fd, the host C library would go to
+ * the host file system instead, so they are redirected to the device table
+ * of mock/newlib.cpp. Function-like, so struct stat and members named like
+ * them are left alone. The host headers declaring them come first.
+ */
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+#include <cstdio>
+extern "C" {
+#endif
+
+int __wut_host_open(const char *path, int flags, ...);
+int __wut_host_close(int fd);
+ssize_t __wut_host_read(int fd, void *buf, size_t count);
+ssize_t __wut_host_write(int fd, const void *buf, size_t count);
+off_t __wut_host_lseek(int fd, off_t offset, int whence);
+int __wut_host_fstat(int fd, struct stat *st);
+int __wut_host_stat(const char *path, struct stat *st);
+int __wut_host_ftruncate(int fd, off_t length);
+int __wut_host_fsync(int fd);
+int __wut_host_unlink(const char *path);
+int __wut_host_rename(const char *oldPath, const char *newPath);
+int __wut_host_mkdir(const char *path, mode_t mode);
+int __wut_host_rmdir(const char *path);
+int __wut_host_chdir(const char *path);
+DIR *__wut_host_opendir(const char *path);
+struct dirent *__wut_host_readdir(DIR *dir);
+int __wut_host_closedir(DIR *dir);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define open(...)      __wut_host_open(__VA_ARGS__)
+#define close(...)     __wut_host_close(__VA_ARGS__)
+#define read(...)      __wut_host_read(__VA_ARGS__)
+#define write(...)     __wut_host_write(__VA_ARGS__)
+#define lseek(...)     __wut_host_lseek(__VA_ARGS__)
+#define fstat(...)     __wut_host_fstat(__VA_ARGS__)
+#define stat(...)      __wut_host_stat(__VA_ARGS__)
+#define ftruncate(...) __wut_host_ftruncate(__VA_ARGS__)
+#define fsync(...)     __wut_host_fsync(__VA_ARGS__)
+#define unlink(...)    __wut_host_unlink(__VA_ARGS__)
+#define rename(...)    __wut_host_rename(__VA_ARGS__)
+#define mkdir(...)     __wut_host_mkdir(__VA_ARGS__)
+#define rmdir(...)     __wut_host_rmdir(__VA_ARGS__)
+#define chdir(...)     __wut_host_chdir(__VA_ARGS__)
+#define opendir(...)   __wut_host_opendir(__VA_ARGS__)
+#define readdir(...)   __wut_host_readdir(__VA_ARGS__)
+#define closedir(...)  __wut_host_closedir(__VA_ARGS__)
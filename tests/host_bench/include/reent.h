@@ -0,0 +1,17 @@
+#pragma once
+
+// Host stand-in for the reentrancy struct of devkitPPC's newlib, only the
+// members the devoptabs use
+struct _reent
+{
+   int _errno;
+   void *deviceData;
+};
+
+#ifdef __cplusplus
+extern "C"
+#endif
+struct _reent *
+__getreent(void);
+
+#define _REENT (__getreent())
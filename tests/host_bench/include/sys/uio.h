@@ -0,0 +1,4 @@
+#pragma once
+
+// The host C library already defines struct iovec with the same members
+#include <bits/types/struct_iovec.h>
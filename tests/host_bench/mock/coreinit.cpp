@@ -0,0 +1,605 @@
+#include <coreinit/alarm.h>
+#include <coreinit/atomic.h>
+#include <coreinit/atomic64.h>
+#include <coreinit/condition.h>
+#include <coreinit/debug.h>
+#include <coreinit/event.h>
+#include <coreinit/messagequeue.h>
+#include <coreinit/mutex.h>
+#include <coreinit/semaphore.h>
+#include <coreinit/systeminfo.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <thread>
+#include <time.h>
+
+/*
+ * Every mutex, condition, event, semaphore and message queue keeps its
+ * state in its own struct and is guarded by one host lock, waiters are woken
+ * with a broadcast and check their object again. Threads and alarms are host
+ * threads.
+ */
+
+// Bus clock of the console, the timer runs at a quarter of it
+#define MOCK_BUS_CLOCK_SPEED 248625000
+
+// Seconds from 1970 to 2000, the OSTime epoch
+#define MOCK_OSTIME_EPOCH 946684800ull
+
+static std::mutex sLock;
+static std::condition_variable sChanged;
+
+static OSThread sMainThread;
+static thread_local OSThread *sCurrentThread = &sMainThread;
+
+struct MockThread
+{
+   std::thread thread;
+   OSThreadEntryPointFn entry;
+   int argc;
+   char *argv;
+   int result;
+};
+
+static std::map<OSThread *, MockThread> sThreads;
+
+struct MockAlarm
+{
+   uint64_t generation;
+   bool firing;
+};
+
+static std::map<OSAlarm *, MockAlarm> sAlarms;
+static uint64_t sAlarmGeneration = 0;
+
+static OSSystemInfo sSystemInfo = { MOCK_BUS_CLOCK_SPEED, MOCK_BUS_CLOCK_SPEED * 5 };
+
+static const auto sStartTime = std::chrono::steady_clock::now();
+
+extern "C" {
+
+OSSystemInfo *
+OSGetSystemInfo()
+{
+   return &sSystemInfo;
+}
+
+OSTime
+OSGetSystemTime()
+{
+   uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - sStartTime).count();
+   return (OSTime)OSNanosecondsToTicks(ns);
+}
+
+OSTime
+OSGetTime()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_REALTIME, &now);
+   uint64_t ns = (now.tv_sec - MOCK_OSTIME_EPOCH) * 1000000000ull + now.tv_nsec;
+   return (OSTime)OSNanosecondsToTicks(ns);
+}
+
+void
+OSSleepTicks(OSTime ticks)
+{
+   std::this_thread::sleep_for(std::chrono::nanoseconds(OSTicksToNanoseconds(ticks)));
+}
+
+int32_t
+OSAddAtomic(volatile int32_t *ptr,
+            int32_t value)
+{
+   return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+int64_t
+OSAddAtomic64(volatile int64_t *ptr,
+              int64_t value)
+{
+   return __atomic_fetch_add(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+uint64_t
+OSGetAtomic64(volatile uint64_t *ptr)
+{
+   return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+uint64_t
+OSSetAtomic64(volatile uint64_t *ptr,
+              uint64_t value)
+{
+   return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+BOOL
+OSCompareAndSwapAtomic64(volatile uint64_t *ptr,
+                         uint64_t compare,
+                         uint64_t value)
+{
+   return __atomic_compare_exchange_n(ptr, &compare, value, false,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+BOOL
+OSCompareAndSwapAtomic(volatile uint32_t *ptr,
+                       uint32_t compare,
+                       uint32_t value)
+{
+   return __atomic_compare_exchange_n(ptr, &compare, value, false,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+void
+OSMemoryBarrier()
+{
+   __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void
+OSReport(const char *fmt, ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   vfprintf(stderr, fmt, args);
+   va_end(args);
+}
+
+void
+OSInitMutexEx(OSMutex *mutex,
+              const char *name)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   mutex->tag = OS_MUTEX_TAG;
+   mutex->name = name;
+   mutex->owner = nullptr;
+   mutex->count = 0;
+}
+
+void
+OSInitMutex(OSMutex *mutex)
+{
+   OSInitMutexEx(mutex, nullptr);
+}
+
+void
+OSLockMutex(OSMutex *mutex)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   while (mutex->owner && mutex->owner != sCurrentThread) {
+      sChanged.wait(lock);
+   }
+
+   mutex->owner = sCurrentThread;
+   ++mutex->count;
+}
+
+BOOL
+OSTryLockMutex(OSMutex *mutex)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   if (mutex->owner && mutex->owner != sCurrentThread) {
+      return FALSE;
+   }
+
+   mutex->owner = sCurrentThread;
+   ++mutex->count;
+   return TRUE;
+}
+
+void
+OSUnlockMutex(OSMutex *mutex)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   if (mutex->owner != sCurrentThread) {
+      return;
+   }
+
+   if (--mutex->count == 0) {
+      mutex->owner = nullptr;
+      sChanged.notify_all();
+   }
+}
+
+// The thread queue of a condition is unused, its head counts the signals
+static uintptr_t
+MockConditionSignals(OSCondition *condition)
+{
+   return reinterpret_cast<uintptr_t>(condition->queue.head);
+}
+
+static void
+MockSetConditionSignals(OSCondition *condition,
+                        uintptr_t signals)
+{
+   condition->queue.head = reinterpret_cast<OSThread *>(signals);
+}
+
+void
+OSInitCondEx(OSCondition *condition,
+             const char *name)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   condition->tag = OS_CONDITION_TAG;
+   condition->name = name;
+   MockSetConditionSignals(condition, 0);
+}
+
+void
+OSInitCond(OSCondition *condition)
+{
+   OSInitCondEx(condition, nullptr);
+}
+
+void
+OSWaitCond(OSCondition *condition,
+           OSMutex *mutex)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   uintptr_t signals = MockConditionSignals(condition);
+   int32_t count = mutex->count;
+
+   mutex->owner = nullptr;
+   mutex->count = 0;
+   sChanged.notify_all();
+
+   while (MockConditionSignals(condition) == signals) {
+      sChanged.wait(lock);
+   }
+
+   while (mutex->owner) {
+      sChanged.wait(lock);
+   }
+
+   mutex->owner = sCurrentThread;
+   mutex->count = count;
+}
+
+void
+OSSignalCond(OSCondition *condition)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   MockSetConditionSignals(condition, MockConditionSignals(condition) + 1);
+   sChanged.notify_all();
+}
+
+void
+OSInitEvent(OSEvent *event,
+            BOOL value,
+            OSEventMode mode)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   event->tag = OS_EVENT_TAG;
+   event->name = nullptr;
+   event->value = value;
+   event->mode = mode;
+}
+
+void
+OSSignalEvent(OSEvent *event)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   event->value = TRUE;
+   sChanged.notify_all();
+}
+
+void
+OSResetEvent(OSEvent *event)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   event->value = FALSE;
+}
+
+void
+OSWaitEvent(OSEvent *event)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   while (!event->value) {
+      sChanged.wait(lock);
+   }
+
+   if (event->mode == OS_EVENT_MODE_AUTO) {
+      event->value = FALSE;
+   }
+}
+
+BOOL
+OSWaitEventWithTimeout(OSEvent *event,
+                       OSTime timeout)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::nanoseconds(timeout);
+   while (!event->value) {
+      if (sChanged.wait_until(lock, deadline) == std::cv_status::timeout && !event->value) {
+         return FALSE;
+      }
+   }
+
+   if (event->mode == OS_EVENT_MODE_AUTO) {
+      event->value = FALSE;
+   }
+   return TRUE;
+}
+
+void
+OSInitSemaphoreEx(OSSemaphore *semaphore,
+                  int32_t count,
+                  const char *name)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   semaphore->tag = OS_SEMAPHORE_TAG;
+   semaphore->name = name;
+   semaphore->count = count;
+}
+
+void
+OSInitSemaphore(OSSemaphore *semaphore,
+                int32_t count)
+{
+   OSInitSemaphoreEx(semaphore, count, nullptr);
+}
+
+int32_t
+OSWaitSemaphore(OSSemaphore *semaphore)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   while (semaphore->count <= 0) {
+      sChanged.wait(lock);
+   }
+
+   return semaphore->count--;
+}
+
+int32_t
+OSSignalSemaphore(OSSemaphore *semaphore)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   sChanged.notify_all();
+   return semaphore->count++;
+}
+
+void
+OSInitMessageQueue(OSMessageQueue *queue,
+                   OSMessage *messages,
+                   int32_t size)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   queue->tag = OS_MESSAGE_QUEUE_TAG;
+   queue->name = nullptr;
+   queue->messages = messages;
+   queue->size = size;
+   queue->first = 0;
+   queue->used = 0;
+}
+
+void
+OSInitMessageQueueEx(OSMessageQueue *queue,
+                     OSMessage *messages,
+                     int32_t size,
+                     const char *name)
+{
+   OSInitMessageQueue(queue, messages, size);
+   queue->name = name;
+}
+
+BOOL
+OSSendMessage(OSMessageQueue *queue,
+              OSMessage *message,
+              OSMessageFlags flags)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   while (queue->used == queue->size) {
+      if (!(flags & OS_MESSAGE_FLAGS_BLOCKING)) {
+         return FALSE;
+      }
+      sChanged.wait(lock);
+   }
+
+   queue->messages[(queue->first + queue->used) % queue->size] = *message;
+   ++queue->used;
+   sChanged.notify_all();
+   return TRUE;
+}
+
+BOOL
+OSReceiveMessage(OSMessageQueue *queue,
+                 OSMessage *message,
+                 OSMessageFlags flags)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   while (queue->used == 0) {
+      if (!(flags & OS_MESSAGE_FLAGS_BLOCKING)) {
+         return FALSE;
+      }
+      sChanged.wait(lock);
+   }
+
+   *message = queue->messages[queue->first];
+   queue->first = (queue->first + 1) % queue->size;
+   --queue->used;
+   sChanged.notify_all();
+   return TRUE;
+}
+
+BOOL
+OSCreateThread(OSThread *thread,
+               OSThreadEntryPointFn entry,
+               int32_t argc,
+               char *argv,
+               void *stack,
+               uint32_t stackSize,
+               int32_t priority,
+               OSThreadAttributes attributes)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   MockThread &mock = sThreads[thread];
+   if (mock.thread.joinable()) {
+      return FALSE;
+   }
+
+   mock.entry = entry;
+   mock.argc = argc;
+   mock.argv = argv;
+   mock.result = 0;
+   thread->tag = OS_THREAD_TAG;
+   thread->priority = priority;
+   thread->basePriority = priority;
+   thread->entryPoint = entry;
+   thread->name = nullptr;
+   return TRUE;
+}
+
+int32_t
+OSResumeThread(OSThread *thread)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   auto it = sThreads.find(thread);
+   if (it == sThreads.end() || it->second.thread.joinable()) {
+      return 0;
+   }
+
+   MockThread *mock = &it->second;
+   mock->thread = std::thread([thread, mock]() {
+      sCurrentThread = thread;
+      mock->result = mock->entry(mock->argc, (const char **)mock->argv);
+   });
+   return 1;
+}
+
+BOOL
+OSJoinThread(OSThread *thread,
+             int *threadResult)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   auto it = sThreads.find(thread);
+   if (it == sThreads.end() || !it->second.thread.joinable()) {
+      return FALSE;
+   }
+
+   std::thread host = std::move(it->second.thread);
+   lock.unlock();
+   host.join();
+   lock.lock();
+
+   if (threadResult) {
+      *threadResult = it->second.result;
+   }
+   sThreads.erase(it);
+   return TRUE;
+}
+
+void
+OSSetThreadName(OSThread *thread,
+                const char *name)
+{
+   thread->name = name;
+}
+
+OSThread *
+OSGetCurrentThread()
+{
+   return sCurrentThread;
+}
+
+int32_t
+OSGetThreadPriority(OSThread *thread)
+{
+   return thread == &sMainThread ? 16 : thread->priority;
+}
+
+void
+OSYieldThread()
+{
+   std::this_thread::yield();
+}
+
+void
+OSCreateAlarm(OSAlarm *alarm)
+{
+   alarm->tag = OS_ALARM_TAG;
+   alarm->name = nullptr;
+   alarm->callback = nullptr;
+   alarm->userData = nullptr;
+}
+
+void
+OSSetAlarmUserData(OSAlarm *alarm,
+                   void *data)
+{
+   alarm->userData = data;
+}
+
+void *
+OSGetAlarmUserData(OSAlarm *alarm)
+{
+   return alarm->userData;
+}
+
+BOOL
+OSSetAlarm(OSAlarm *alarm,
+           OSTime time,
+           OSAlarmCallback callback)
+{
+   std::lock_guard<std::mutex> lock(sLock);
+   uint64_t generation = ++sAlarmGeneration;
+   auto deadline = std::chrono::steady_clock::now() +
+                   std::chrono::nanoseconds(OSTicksToNanoseconds(time));
+
+   alarm->callback = callback;
+   sAlarms[alarm] = { generation, false };
+
+   std::thread([alarm, callback, generation, deadline]() {
+      std::unique_lock<std::mutex> lock(sLock);
+      auto pending = [&]() {
+         auto it = sAlarms.find(alarm);
+         return it != sAlarms.end() && it->second.generation == generation;
+      };
+
+      while (pending() && std::chrono::steady_clock::now() < deadline) {
+         sChanged.wait_until(lock, deadline);
+      }
+
+      if (!pending()) {
+         return;
+      }
+
+      // OSCancelAlarm waits for the callback, the alarm may not outlive it
+      sAlarms[alarm].firing = true;
+      lock.unlock();
+      callback(alarm, nullptr);
+      lock.lock();
+      sAlarms.erase(alarm);
+      sChanged.notify_all();
+   }).detach();
+   return TRUE;
+}
+
+BOOL
+OSCancelAlarm(OSAlarm *alarm)
+{
+   std::unique_lock<std::mutex> lock(sLock);
+   auto it = sAlarms.find(alarm);
+   while (it != sAlarms.end() && it->second.firing) {
+      sChanged.wait(lock);
+      it = sAlarms.find(alarm);
+   }
+
+   if (it == sAlarms.end()) {
+      return FALSE;
+   }
+
+   sAlarms.erase(it);
+   sChanged.notify_all();
+   return TRUE;
+}
+
+} // extern "C"
@@ -0,0 +1,788 @@
+#include "latency.h"
+
+#include <coreinit/filesystem_fsa.h>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+ * FSA on an in-memory file system. Each call charges the FSA latency model,
+ * reads and writes for the bytes they transferred. Paths are absolute FSA
+ * paths, /vol/external01 exists from the start like a mounted SD card.
+ */
+
+#define MOCK_FSA_FREE_SPACE   (1ull << 30)
+#define MOCK_FSA_SECTOR_SIZE  512
+
+struct MockNode
+{
+   bool directory;
+   FSMode mode;
+   uint32_t entryId;
+   FSTime created;
+   FSTime modified;
+   std::vector<uint8_t> data;
+};
+
+struct MockFile
+{
+   std::shared_ptr<MockNode> node;
+   uint32_t position;
+   bool read;
+   bool write;
+   bool append;
+};
+
+struct MockDir
+{
+   std::vector<std::string> names;
+   std::string path;
+   size_t next;
+};
+
+static MockBackend sBackend;
+
+static std::mutex sMutex;
+static std::map<std::string, std::shared_ptr<MockNode>> sNodes;
+static std::map<FSAFileHandle, MockFile> sFiles;
+static std::map<FSADirectoryHandle, MockDir> sDirs;
+static std::map<FSAClientHandle, std::string> sClients;
+static uint32_t sNextHandle = 1;
+static uint32_t sNextEntryId = 1;
+static FSAClientHandle sNextClient = 1;
+
+static std::shared_ptr<MockNode>
+MockNewNode(bool directory)
+{
+   auto node = std::make_shared<MockNode>();
+   node->directory = directory;
+   node->mode = (FSMode)0x666;
+   node->entryId = sNextEntryId++;
+   node->created = node->modified = OSTicksToMicroseconds(OSGetTime());
+   return node;
+}
+
+static void
+MockInitTree()
+{
+   if (sNodes.empty()) {
+      sNodes["/"] = MockNewNode(true);
+      sNodes["/vol"] = MockNewNode(true);
+      sNodes["/vol/external01"] = MockNewNode(true);
+   }
+}
+
+// Makes path absolute and drops ".", ".." and repeated slashes
+static std::string
+MockNormalize(FSAClientHandle client,
+              const char *path)
+{
+   std::string full = path;
+   if (full.empty() || full[0] != '/') {
+      auto it = sClients.find(client);
+      full = (it != sClients.end() ? it->second : std::string("/")) + "/" + full;
+   }
+
+   std::vector<std::string> parts;
+   size_t start = 0;
+   while (start <= full.size()) {
+      size_t end = full.find('/', start);
+      if (end == std::string::npos) {
+         end = full.size();
+      }
+
+      std::string part = full.substr(start, end - start);
+      if (part == "..") {
+         if (!parts.empty()) {
+            parts.pop_back();
+         }
+      } else if (!part.empty() && part != ".") {
+         parts.push_back(part);
+      }
+      start = end + 1;
+   }
+
+   std::string result;
+   for (const auto &part : parts) {
+      result += "/" + part;
+   }
+   return result.empty() ? "/" : result;
+}
+
+static std::string
+MockParent(const std::string &path)
+{
+   size_t slash = path.rfind('/');
+   return slash == 0 ? "/" : path.substr(0, slash);
+}
+
+static void
+MockFillStat(const MockNode &node,
+             FSAStat *stat)
+{
+   *stat = {};
+   stat->flags = node.directory ? FS_STAT_DIRECTORY : FS_STAT_FILE;
+   stat->mode = node.mode;
+   stat->size = node.directory ? 0 : (uint32_t)node.data.size();
+   stat->allocSize = stat->size;
+   stat->entryId = node.entryId;
+   stat->created = node.created;
+   stat->modified = node.modified;
+}
+
+static bool
+MockUnaligned(const void *buffer)
+{
+   return ((uintptr_t)buffer & 0x3F) != 0;
+}
+
+extern "C" {
+
+void
+MockFSASetLatency(const MockLatency *latency)
+{
+   sBackend.setLatency(latency);
+}
+
+void
+MockFSAGetCounters(MockCounters *outCounters)
+{
+   sBackend.getCounters(outCounters);
+}
+
+void
+MockFSAResetCounters(void)
+{
+   sBackend.resetCounters();
+}
+
+BOOL
+MockFSACreateFile(const char *path,
+                  uint32_t size)
+{
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockInitTree();
+
+   std::string full = MockNormalize(0, path);
+   for (std::string dir = MockParent(full); !sNodes.count(dir); dir = MockParent(dir)) {
+      sNodes[dir] = MockNewNode(true);
+   }
+
+   auto &node = sNodes[full];
+   if (node && node->directory) {
+      return FALSE;
+   }
+
+   node = MockNewNode(false);
+   node->data.resize(size);
+   for (uint32_t i = 0; i < size; ++i) {
+      node->data[i] = MockFSAFileByte(i);
+   }
+   return TRUE;
+}
+
+void
+MockFSAClear(void)
+{
+   std::lock_guard<std::mutex> lock(sMutex);
+   sNodes.clear();
+   MockInitTree();
+}
+
+FSError
+FSAInit()
+{
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockInitTree();
+   return FS_ERROR_OK;
+}
+
+FSAClientHandle
+FSAAddClient(FSAClientAttachAsyncData *attachAsyncData)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   FSAClientHandle client = sNextClient++;
+   sClients[client] = "/";
+   return client;
+}
+
+FSError
+FSADelClient(FSAClientHandle client)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   return sClients.erase(client) ? FS_ERROR_OK : FS_ERROR_INVALID_CLIENTHANDLE;
+}
+
+FSError
+FSAMount(FSAClientHandle client,
+         const char *source,
+         const char *target,
+         FSAMountFlags flags,
+         void *arg_buf,
+         uint32_t arg_len)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockInitTree();
+
+   std::string full = MockNormalize(client, target);
+   if (!sNodes.count(full)) {
+      sNodes[full] = MockNewNode(true);
+   }
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAUnmount(FSAClientHandle client,
+           const char *mountedTarget,
+           FSAUnmountFlags flags)
+{
+   sBackend.charge(0);
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAGetDeviceInfo(FSAClientHandle client,
+                 const char *path,
+                 FSADeviceInfo *fileSystemInfo)
+{
+   sBackend.charge(0);
+   *fileSystemInfo = {};
+   fileSystemInfo->deviceSizeInSectors = MOCK_FSA_FREE_SPACE / MOCK_FSA_SECTOR_SIZE;
+   fileSystemInfo->deviceSectorSize = MOCK_FSA_SECTOR_SIZE;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAGetFreeSpaceSize(FSAClientHandle client,
+                    const char *path,
+                    uint64_t *freeSpaceSize)
+{
+   sBackend.charge(0);
+   *freeSpaceSize = MOCK_FSA_FREE_SPACE;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAFlushQuota(FSAClientHandle client,
+              const char *path)
+{
+   sBackend.charge(0);
+   return FS_ERROR_OK;
+}
+
+FSError
+FSARollbackQuota(FSAClientHandle client,
+                 const char *path)
+{
+   sBackend.charge(0);
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAChangeDir(FSAClientHandle client,
+             const char *path)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   std::string full = MockNormalize(client, path);
+   auto it = sNodes.find(full);
+   if (it == sNodes.end()) {
+      return FS_ERROR_NOT_FOUND;
+   }
+   if (!it->second->directory) {
+      return FS_ERROR_NOT_DIR;
+   }
+
+   sClients[client] = full;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAChangeMode(FSAClientHandle client,
+              const char *path,
+              FSMode permission)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sNodes.find(MockNormalize(client, path));
+   if (it == sNodes.end()) {
+      return FS_ERROR_NOT_FOUND;
+   }
+
+   it->second->mode = permission;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAGetStat(FSAClientHandle client,
+           const char *path,
+           FSAStat *stat)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sNodes.find(MockNormalize(client, path));
+   if (it == sNodes.end()) {
+      return FS_ERROR_NOT_FOUND;
+   }
+
+   MockFillStat(*it->second, stat);
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAMakeDir(FSAClientHandle client,
+           const char *path,
+           FSMode mode)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   std::string full = MockNormalize(client, path);
+   if (sNodes.count(full)) {
+      return FS_ERROR_ALREADY_EXISTS;
+   }
+
+   auto parent = sNodes.find(MockParent(full));
+   if (parent == sNodes.end()) {
+      return FS_ERROR_NOT_FOUND;
+   }
+   if (!parent->second->directory) {
+      return FS_ERROR_NOT_DIR;
+   }
+
+   auto node = MockNewNode(true);
+   node->mode = mode;
+   sNodes[full] = node;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSARemove(FSAClientHandle client,
+          const char *path)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   std::string full = MockNormalize(client, path);
+   auto it = sNodes.find(full);
+   if (it == sNodes.end()) {
+      return FS_ERROR_NOT_FOUND;
+   }
+
+   if (it->second->directory) {
+      auto child = sNodes.upper_bound(full + "/");
+      if (child != sNodes.end() && child->first.compare(0, full.size() + 1, full + "/") == 0) {
+         return FS_ERROR_NOT_EMPTY;
+      }
+   }
+
+   // Open files keep their data, like on a real file system
+   sNodes.erase(it);
+   return FS_ERROR_OK;
+}
+
+FSError
+FSARename(FSAClientHandle client,
+          const char *oldPath,
+          const char *newPath)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   std::string from = MockNormalize(client, oldPath);
+   std::string to = MockNormalize(client, newPath);
+   auto it = sNodes.find(from);
+   if (it == sNodes.end()) {
+      return FS_ERROR_NOT_FOUND;
+   }
+   if (sNodes.count(to)) {
+      return FS_ERROR_ALREADY_EXISTS;
+   }
+   if (!sNodes.count(MockParent(to))) {
+      return FS_ERROR_NOT_FOUND;
+   }
+
+   // Move the entry and everything below it
+   std::vector<std::pair<std::string, std::shared_ptr<MockNode>>> moved;
+   for (auto child = sNodes.begin(); child != sNodes.end();) {
+      if (child->first == from || child->first.compare(0, from.size() + 1, from + "/") == 0) {
+         moved.emplace_back(to + child->first.substr(from.size()), child->second);
+         child = sNodes.erase(child);
+      } else {
+         ++child;
+      }
+   }
+
+   for (auto &entry : moved) {
+      sNodes[entry.first] = entry.second;
+   }
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAOpenFileEx(FSAClientHandle client,
+              const char *path,
+              const char *mode,
+              FSMode createMode,
+              FSOpenFileFlags openFlag,
+              uint32_t preallocSize,
+              FSAFileHandle *outFileHandle)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   std::string full = MockNormalize(client, path);
+   bool plus = strchr(mode, '+') != nullptr;
+   MockFile file = {};
+
+   switch (mode[0]) {
+   case 'r':
+      file.read = true;
+      file.write = plus;
+      break;
+   case 'w':
+      file.read = plus;
+      file.write = true;
+      break;
+   case 'a':
+      file.read = plus;
+      file.write = true;
+      file.append = true;
+      break;
+   default:
+      return FS_ERROR_INVALID_PARAM;
+   }
+
+   auto it = sNodes.find(full);
+   if (it == sNodes.end()) {
+      if (mode[0] == 'r') {
+         return FS_ERROR_NOT_FOUND;
+      }
+
+      auto parent = sNodes.find(MockParent(full));
+      if (parent == sNodes.end() || !parent->second->directory) {
+         return FS_ERROR_NOT_FOUND;
+      }
+
+      auto node = MockNewNode(false);
+      node->mode = createMode;
+      it = sNodes.emplace(full, node).first;
+   } else if (it->second->directory) {
+      return FS_ERROR_NOT_FILE;
+   } else if (mode[0] == 'w') {
+      it->second->data.clear();
+   }
+
+   file.node = it->second;
+   *outFileHandle = sNextHandle++;
+   sFiles[*outFileHandle] = file;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSACloseFile(FSAClientHandle client,
+             FSAFileHandle fileHandle)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   return sFiles.erase(fileHandle) ? FS_ERROR_OK : FS_ERROR_INVALID_FILEHANDLE;
+}
+
+static FSError
+MockReadFile(void *buffer,
+             uint32_t size,
+             uint32_t count,
+             uint32_t *pos,
+             FSAFileHandle handle)
+{
+   uint32_t bytes;
+
+   {
+      std::lock_guard<std::mutex> lock(sMutex);
+      auto it = sFiles.find(handle);
+      if (it == sFiles.end()) {
+         return FS_ERROR_INVALID_FILEHANDLE;
+      }
+
+      MockFile &file = it->second;
+      if (!file.read) {
+         return FS_ERROR_ACCESS_ERROR;
+      }
+      if (!size) {
+         return FS_ERROR_INVALID_PARAM;
+      }
+
+      uint32_t offset = pos ? *pos : file.position;
+      const auto &data = file.node->data;
+      uint32_t available = offset < data.size() ? (uint32_t)data.size() - offset : 0;
+      count = std::min(count, available / size);
+      bytes = size * count;
+      memcpy(buffer, data.data() + offset, bytes);
+
+      if (!pos) {
+         file.position += bytes;
+      }
+   }
+
+   sBackend.charge(bytes, MockUnaligned(buffer));
+   return (FSError)count;
+}
+
+FSError
+FSAReadFile(FSAClientHandle client,
+            void *buffer,
+            uint32_t size,
+            uint32_t count,
+            FSAFileHandle handle,
+            uint32_t flags)
+{
+   return MockReadFile(buffer, size, count, nullptr, handle);
+}
+
+FSError
+FSAReadFileWithPos(FSAClientHandle client,
+                   void *buffer,
+                   uint32_t size,
+                   uint32_t count,
+                   uint32_t pos,
+                   FSAFileHandle handle,
+                   uint32_t flags)
+{
+   return MockReadFile(buffer, size, count, &pos, handle);
+}
+
+static FSError
+MockWriteFile(const void *buffer,
+              uint32_t size,
+              uint32_t count,
+              uint32_t *pos,
+              FSAFileHandle handle)
+{
+   uint32_t bytes = size * count;
+
+   {
+      std::lock_guard<std::mutex> lock(sMutex);
+      auto it = sFiles.find(handle);
+      if (it == sFiles.end()) {
+         return FS_ERROR_INVALID_FILEHANDLE;
+      }
+
+      MockFile &file = it->second;
+      if (!file.write) {
+         return FS_ERROR_ACCESS_ERROR;
+      }
+
+      auto &data = file.node->data;
+      uint32_t offset = file.append ? (uint32_t)data.size() : pos ? *pos : file.position;
+      if ((uint64_t)offset + bytes > UINT32_MAX) {
+         return FS_ERROR_FILE_TOO_BIG;
+      }
+
+      if (offset + bytes > data.size()) {
+         data.resize(offset + bytes);
+      }
+      memcpy(data.data() + offset, buffer, bytes);
+      file.node->modified = OSTicksToMicroseconds(OSGetTime());
+
+      if (!pos) {
+         file.position = offset + bytes;
+      }
+   }
+
+   sBackend.charge(bytes, MockUnaligned(buffer));
+   return (FSError)count;
+}
+
+FSError
+FSAWriteFile(FSAClientHandle client,
+             void *buffer,
+             uint32_t size,
+             uint32_t count,
+             FSAFileHandle handle,
+             uint32_t flags)
+{
+   return MockWriteFile(buffer, size, count, nullptr, handle);
+}
+
+FSError
+FSAWriteFileWithPos(FSAClientHandle client,
+                    void *buffer,
+                    uint32_t size,
+                    uint32_t count,
+                    uint32_t pos,
+                    FSAFileHandle handle,
+                    uint32_t flags)
+{
+   return MockWriteFile(buffer, size, count, &pos, handle);
+}
+
+FSError
+FSASetPosFile(FSAClientHandle client,
+              FSAFileHandle fileHandle,
+              uint32_t pos)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sFiles.find(fileHandle);
+   if (it == sFiles.end()) {
+      return FS_ERROR_INVALID_FILEHANDLE;
+   }
+
+   it->second.position = pos;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAGetStatFile(FSAClientHandle client,
+               FSAFileHandle fileHandle,
+               FSAStat *stat)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sFiles.find(fileHandle);
+   if (it == sFiles.end()) {
+      return FS_ERROR_INVALID_FILEHANDLE;
+   }
+
+   MockFillStat(*it->second.node, stat);
+   return FS_ERROR_OK;
+}
+
+FSError
+FSATruncateFile(FSAClientHandle client,
+                FSAFileHandle handle)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sFiles.find(handle);
+   if (it == sFiles.end()) {
+      return FS_ERROR_INVALID_FILEHANDLE;
+   }
+   if (!it->second.write) {
+      return FS_ERROR_ACCESS_ERROR;
+   }
+
+   it->second.node->data.resize(it->second.position);
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAAppendFileEx(FSAClientHandle client,
+                FSAFileHandle fileHandle,
+                uint32_t size,
+                uint32_t count,
+                uint32_t flags)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sFiles.find(fileHandle);
+   if (it == sFiles.end()) {
+      return FS_ERROR_INVALID_FILEHANDLE;
+   }
+
+   auto &data = it->second.node->data;
+   data.resize(data.size() + (size_t)size * count);
+   return (FSError)count;
+}
+
+FSError
+FSAFlushFile(FSAClientHandle client,
+             FSAFileHandle fileHandle)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   return sFiles.count(fileHandle) ? FS_ERROR_OK : FS_ERROR_INVALID_FILEHANDLE;
+}
+
+FSError
+FSAOpenDir(FSAClientHandle client,
+           const char *path,
+           FSADirectoryHandle *dirHandle)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   std::string full = MockNormalize(client, path);
+   auto it = sNodes.find(full);
+   if (it == sNodes.end()) {
+      return FS_ERROR_NOT_FOUND;
+   }
+   if (!it->second->directory) {
+      return FS_ERROR_NOT_DIR;
+   }
+
+   MockDir dir = {};
+   dir.path = full == "/" ? "" : full;
+   std::string prefix = dir.path + "/";
+   for (auto child = sNodes.upper_bound(prefix); child != sNodes.end(); ++child) {
+      if (child->first.compare(0, prefix.size(), prefix) != 0) {
+         break;
+      }
+      if (child->first.find('/', prefix.size()) == std::string::npos) {
+         dir.names.push_back(child->first.substr(prefix.size()));
+      }
+   }
+
+   *dirHandle = sNextHandle++;
+   sDirs[*dirHandle] = dir;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSAReadDir(FSAClientHandle client,
+           FSADirectoryHandle dirHandle,
+           FSADirectoryEntry *directoryEntry)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sDirs.find(dirHandle);
+   if (it == sDirs.end()) {
+      return FS_ERROR_INVALID_DIRHANDLE;
+   }
+
+   // Entries removed since the directory was opened are skipped
+   MockDir &dir = it->second;
+   while (dir.next < dir.names.size()) {
+      const std::string &name = dir.names[dir.next++];
+      auto node = sNodes.find(dir.path + "/" + name);
+      if (node == sNodes.end()) {
+         continue;
+      }
+
+      *directoryEntry = {};
+      MockFillStat(*node->second, &directoryEntry->info);
+      snprintf(directoryEntry->name, sizeof(directoryEntry->name), "%s", name.c_str());
+      return FS_ERROR_OK;
+   }
+
+   return FS_ERROR_END_OF_DIR;
+}
+
+FSError
+FSARewindDir(FSAClientHandle client,
+             FSADirectoryHandle dirHandle)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   auto it = sDirs.find(dirHandle);
+   if (it == sDirs.end()) {
+      return FS_ERROR_INVALID_DIRHANDLE;
+   }
+
+   it->second.next = 0;
+   return FS_ERROR_OK;
+}
+
+FSError
+FSACloseDir(FSAClientHandle client,
+            FSADirectoryHandle dirHandle)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   return sDirs.erase(dirHandle) ? FS_ERROR_OK : FS_ERROR_INVALID_DIRHANDLE;
+}
+
+} // extern "C"
@@ -0,0 +1,87 @@
+#include "latency.h"
+
+#include <time.h>
+
+// Left to spin at the end of a delay
+#define MOCK_SPIN_US 60
+
+static uint64_t
+MockNowNs()
+{
+   struct timespec now;
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (uint64_t)now.tv_sec * 1000000000ull + now.tv_nsec;
+}
+
+void
+MockDelay(uint64_t us)
+{
+   if (!us) {
+      return;
+   }
+
+   uint64_t end = MockNowNs() + us * 1000;
+   if (us > MOCK_SPIN_US) {
+      struct timespec sleep;
+      uint64_t ns = (us - MOCK_SPIN_US) * 1000;
+      sleep.tv_sec = ns / 1000000000ull;
+      sleep.tv_nsec = ns % 1000000000ull;
+      nanosleep(&sleep, nullptr);
+   }
+
+   while (MockNowNs() < end) {
+   }
+}
+
+void
+MockBackend::setLatency(const MockLatency *latency)
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   mLatency = latency ? *latency : MockLatency {};
+   mChannelFree.notify_all();
+}
+
+void
+MockBackend::getCounters(MockCounters *outCounters)
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   *outCounters = mCounters;
+}
+
+void
+MockBackend::resetCounters()
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   mCounters = {};
+}
+
+void
+MockBackend::charge(uint32_t bytes,
+                    bool unaligned)
+{
+   uint64_t us;
+
+   {
+      std::unique_lock<std::mutex> lock(mMutex);
+      while (mLatency.channels && mBusy >= mLatency.channels) {
+         mChannelFree.wait(lock);
+      }
+
+      us = mLatency.requestUs;
+      if (mLatency.bytesPerUs) {
+         us += bytes / mLatency.bytesPerUs;
+      }
+
+      ++mBusy;
+      ++mCounters.requests;
+      mCounters.bytes += bytes;
+      mCounters.unaligned += unaligned ? 1 : 0;
+      mCounters.busyUs += us;
+   }
+
+   MockDelay(us);
+
+   std::lock_guard<std::mutex> lock(mMutex);
+   --mBusy;
+   mChannelFree.notify_one();
+}
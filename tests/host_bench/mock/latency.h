@@ -0,0 +1,30 @@
+#pragma once
+#include "mock.h"
+
+#include <condition_variable>
+#include <mutex>
+
+// Latency model and counters of one backend
+class MockBackend
+{
+public:
+   void setLatency(const MockLatency *latency);
+   void getCounters(MockCounters *outCounters);
+   void resetCounters();
+
+   // Waits for a channel and for the time the model gives a call
+   // transferring bytes, then updates the counters
+   void charge(uint32_t bytes, bool unaligned = false);
+
+private:
+   std::mutex mMutex;
+   std::condition_variable mChannelFree;
+   MockLatency mLatency = {};
+   MockCounters mCounters = {};
+   uint32_t mBusy = 0;
+};
+
+// Sleeps most of the way and spins the rest, sleeps alone overshoot by
+// more than a short FSA request takes
+void
+MockDelay(uint64_t us);
@@ -0,0 +1,85 @@
+#pragma once
+#include <wut.h>
+
+/*
+ * Host stand-ins for the parts of coreinit, FSA and nsysnet the devoptab and
+ * socket libraries call. Files live in memory and sockets are connected to
+ * each other in process, every FSA and nsysnet call is charged the time the
+ * latency model of its backend gives it before it returns.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct MockLatency
+{
+   //! Fixed cost of every call in microseconds, the IPC round trip to IOS.
+   uint32_t requestUs;
+
+   //! Transfer rate in bytes per microsecond (MB/s), 0 for unlimited.
+   uint32_t bytesPerUs;
+
+   //! Calls served at the same time, others wait for a free channel.
+   //! 0 for unlimited.
+   uint32_t channels;
+} MockLatency;
+
+typedef struct MockCounters
+{
+   //! Calls into the backend.
+   uint64_t requests;
+
+   //! Bytes read and written.
+   uint64_t bytes;
+
+   //! Reads and writes with a buffer that is not 0x40 byte aligned, which
+   //! the devoptab is supposed to bounce.
+   uint64_t unaligned;
+
+   //! Time charged by the latency model in microseconds.
+   uint64_t busyUs;
+} MockCounters;
+
+void
+MockFSASetLatency(const MockLatency *latency);
+
+void
+MockFSAGetCounters(MockCounters *outCounters);
+
+void
+MockFSAResetCounters(void);
+
+//! Byte at offset of the files MockFSACreateFile creates.
+static inline uint8_t
+MockFSAFileByte(uint32_t offset)
+{
+   return (uint8_t)(offset ^ (offset >> 8));
+}
+
+/**
+ * Create a file of size bytes with a known pattern, path is an FSA path
+ * such as "/vol/external01/data.bin". Missing directories are created.
+ */
+BOOL
+MockFSACreateFile(const char *path,
+                  uint32_t size);
+
+/**
+ * Remove every file and directory.
+ */
+void
+MockFSAClear(void);
+
+void
+MockNetSetLatency(const MockLatency *latency);
+
+void
+MockNetGetCounters(MockCounters *outCounters);
+
+void
+MockNetResetCounters(void);
+
+#ifdef __cplusplus
+}
+#endif
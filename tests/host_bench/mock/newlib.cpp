@@ -0,0 +1,494 @@
+#include <sys/iosupport.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <mutex>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*
+ * The device and handle tables of devkitPPC's newlib, and the syscalls of
+ * host_syscalls.h that go through them. Like newlib, each call sets the
+ * deviceData of the reentrancy struct to the device it goes to.
+ */
+
+#define MOCK_MAX_HANDLES 128
+
+struct __dirstream
+{
+   DIR_ITER iter;
+   struct dirent entry;
+};
+
+static const devoptab_t
+sStdNull = { "stdnull" };
+
+const devoptab_t *devoptab_list[STD_MAX] = { &sStdNull, &sStdNull, &sStdNull };
+
+static int sDefaultDevice = 0;
+static std::mutex sHandleLock;
+static __handle *sHandles[MOCK_MAX_HANDLES];
+
+static thread_local struct _reent sReent;
+
+// Like newlib the error is in the reentrancy struct, copied to the host
+// errno once a call fails
+static inline struct _reent *
+MockBeginCall(int device)
+{
+   struct _reent *r = &sReent;
+   r->_errno = 0;
+   r->deviceData = devoptab_list[device]->deviceData;
+   return r;
+}
+
+template<typename T>
+static inline T
+MockEndCall(struct _reent *r,
+            T rc)
+{
+   if (r->_errno) {
+      errno = r->_errno;
+   }
+   return rc;
+}
+
+static int
+MockDeviceOfPath(const char *path)
+{
+   if (!strchr(path, ':')) {
+      return sDefaultDevice;
+   }
+
+   return FindDevice(path);
+}
+
+static __handle *
+MockHandleOfFd(int fd,
+               int *outDevice)
+{
+   __handle *handle = __get_handle(fd);
+   if (!handle) {
+      errno = EBADF;
+      return nullptr;
+   }
+
+   *outDevice = handle->device;
+   return handle;
+}
+
+extern "C" {
+
+struct _reent *
+__getreent(void)
+{
+   return &sReent;
+}
+
+int
+FindDevice(const char *name)
+{
+   size_t length = strcspn(name, ":");
+
+   for (int i = 0; i < STD_MAX; ++i) {
+      const devoptab_t *device = devoptab_list[i];
+      if (device && strlen(device->name) == length && !strncmp(device->name, name, length)) {
+         return i;
+      }
+   }
+
+   return -1;
+}
+
+int
+AddDevice(const devoptab_t *device)
+{
+   int slot = -1;
+
+   for (int i = 3; i < STD_MAX; ++i) {
+      if (!devoptab_list[i]) {
+         if (slot == -1) {
+            slot = i;
+         }
+      } else if (!strcmp(devoptab_list[i]->name, device->name)) {
+         devoptab_list[i] = device;
+         return i;
+      }
+   }
+
+   if (slot != -1) {
+      devoptab_list[slot] = device;
+   }
+   return slot;
+}
+
+int
+RemoveDevice(const char *name)
+{
+   int device = FindDevice(name);
+   if (device < 3) {
+      return -1;
+   }
+
+   devoptab_list[device] = nullptr;
+   if (sDefaultDevice == device) {
+      sDefaultDevice = 0;
+   }
+   return 0;
+}
+
+void
+setDefaultDevice(int device)
+{
+   if (device >= 0 && device < STD_MAX && devoptab_list[device]) {
+      sDefaultDevice = device;
+   }
+}
+
+const devoptab_t *
+GetDeviceOpTab(const char *name)
+{
+   int device = MockDeviceOfPath(name);
+   return device == -1 ? nullptr : devoptab_list[device];
+}
+
+__handle *
+__get_handle(int fd)
+{
+   if (fd < 0 || fd >= MOCK_MAX_HANDLES) {
+      return nullptr;
+   }
+
+   return sHandles[fd];
+}
+
+int
+__alloc_handle(int device)
+{
+   std::lock_guard<std::mutex> lock(sHandleLock);
+   for (int fd = 3; fd < MOCK_MAX_HANDLES; ++fd) {
+      if (sHandles[fd]) {
+         continue;
+      }
+
+      size_t size = devoptab_list[device]->structSize;
+      __handle *handle = (__handle *)calloc(1, sizeof(__handle) + size);
+      if (!handle) {
+         errno = ENOMEM;
+         return -1;
+      }
+
+      handle->refcount = 1;
+      handle->device = device;
+      handle->fileStruct = handle + 1;
+      sHandles[fd] = handle;
+      return fd;
+   }
+
+   errno = EMFILE;
+   return -1;
+}
+
+void
+__release_handle(int fd)
+{
+   std::lock_guard<std::mutex> lock(sHandleLock);
+   if (fd >= 0 && fd < MOCK_MAX_HANDLES) {
+      free(sHandles[fd]);
+      sHandles[fd] = nullptr;
+   }
+}
+
+int
+__wut_host_open(const char *path,
+                int flags,
+                ...)
+{
+   int device = MockDeviceOfPath(path);
+   if (device == -1 || !devoptab_list[device]->open_r) {
+      errno = ENODEV;
+      return -1;
+   }
+
+   int mode = 0;
+   if (flags & O_CREAT) {
+      va_list args;
+      va_start(args, flags);
+      mode = va_arg(args, int);
+      va_end(args);
+   }
+
+   int fd = __alloc_handle(device);
+   if (fd == -1) {
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   if (devoptab_list[device]->open_r(r, sHandles[fd]->fileStruct, path, flags, mode) == -1) {
+      __release_handle(fd);
+      return MockEndCall(r, -1);
+   }
+
+   return MockEndCall(r, fd);
+}
+
+int
+__wut_host_close(int fd)
+{
+   int device;
+   __handle *handle = MockHandleOfFd(fd, &device);
+   if (!handle) {
+      return -1;
+   }
+
+   int rc = 0;
+   struct _reent *r = MockBeginCall(device);
+   if (devoptab_list[device]->close_r) {
+      rc = devoptab_list[device]->close_r(r, handle->fileStruct);
+   }
+
+   __release_handle(fd);
+   return MockEndCall(r, rc);
+}
+
+ssize_t
+__wut_host_read(int fd,
+                void *buf,
+                size_t count)
+{
+   int device;
+   __handle *handle = MockHandleOfFd(fd, &device);
+   if (!handle) {
+      return -1;
+   }
+
+   if (!devoptab_list[device]->read_r) {
+      errno = ENOTSUP;
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   return MockEndCall(r, devoptab_list[device]->read_r(r, handle->fileStruct, (char *)buf, count));
+}
+
+ssize_t
+__wut_host_write(int fd,
+                 const void *buf,
+                 size_t count)
+{
+   int device;
+   __handle *handle = MockHandleOfFd(fd, &device);
+   if (!handle) {
+      return -1;
+   }
+
+   if (!devoptab_list[device]->write_r) {
+      errno = ENOTSUP;
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   return MockEndCall(r, devoptab_list[device]->write_r(r, handle->fileStruct, (const char *)buf, count));
+}
+
+off_t
+__wut_host_lseek(int fd,
+                 off_t offset,
+                 int whence)
+{
+   int device;
+   __handle *handle = MockHandleOfFd(fd, &device);
+   if (!handle) {
+      return -1;
+   }
+
+   if (!devoptab_list[device]->seek_r) {
+      errno = ESPIPE;
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   return MockEndCall(r, devoptab_list[device]->seek_r(r, handle->fileStruct, offset, whence));
+}
+
+int
+__wut_host_fstat(int fd,
+                 struct stat *st)
+{
+   int device;
+   __handle *handle = MockHandleOfFd(fd, &device);
+   if (!handle) {
+      return -1;
+   }
+
+   if (!devoptab_list[device]->fstat_r) {
+      errno = ENOTSUP;
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   return MockEndCall(r, devoptab_list[device]->fstat_r(r, handle->fileStruct, st));
+}
+
+int
+__wut_host_ftruncate(int fd,
+                     off_t length)
+{
+   int device;
+   __handle *handle = MockHandleOfFd(fd, &device);
+   if (!handle) {
+      return -1;
+   }
+
+   if (!devoptab_list[device]->ftruncate_r) {
+      errno = ENOTSUP;
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   return MockEndCall(r, devoptab_list[device]->ftruncate_r(r, handle->fileStruct, length));
+}
+
+int
+__wut_host_fsync(int fd)
+{
+   int device;
+   __handle *handle = MockHandleOfFd(fd, &device);
+   if (!handle) {
+      return -1;
+   }
+
+   if (!devoptab_list[device]->fsync_r) {
+      errno = ENOTSUP;
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   return MockEndCall(r, devoptab_list[device]->fsync_r(r, handle->fileStruct));
+}
+
+// Looks up the device of path and calls one of its path based functions
+#define MOCK_PATH_CALL(path, function, ...)                                 \
+   do {                                                                     \
+      int device = MockDeviceOfPath(path);                                  \
+      if (device == -1 || !devoptab_list[device]->function) {               \
+         errno = device == -1 ? ENODEV : ENOTSUP;                           \
+         return -1;                                                         \
+      }                                                                     \
+      struct _reent *r = MockBeginCall(device);                             \
+      return MockEndCall(r, devoptab_list[device]->function(r, __VA_ARGS__)); \
+   } while (0)
+
+int
+__wut_host_stat(const char *path,
+                struct stat *st)
+{
+   MOCK_PATH_CALL(path, stat_r, path, st);
+}
+
+int
+__wut_host_unlink(const char *path)
+{
+   MOCK_PATH_CALL(path, unlink_r, path);
+}
+
+int
+__wut_host_rename(const char *oldPath,
+                  const char *newPath)
+{
+   MOCK_PATH_CALL(oldPath, rename_r, oldPath, newPath);
+}
+
+int
+__wut_host_mkdir(const char *path,
+                 mode_t mode)
+{
+   MOCK_PATH_CALL(path, mkdir_r, path, mode);
+}
+
+int
+__wut_host_rmdir(const char *path)
+{
+   MOCK_PATH_CALL(path, rmdir_r, path);
+}
+
+int
+__wut_host_chdir(const char *path)
+{
+   int device = MockDeviceOfPath(path);
+   if (device == -1 || !devoptab_list[device]->chdir_r) {
+      errno = device == -1 ? ENODEV : ENOTSUP;
+      return -1;
+   }
+
+   struct _reent *r = MockBeginCall(device);
+   if (devoptab_list[device]->chdir_r(r, path) == -1) {
+      return MockEndCall(r, -1);
+   }
+
+   sDefaultDevice = device;
+   return 0;
+}
+
+DIR *
+__wut_host_opendir(const char *path)
+{
+   int device = MockDeviceOfPath(path);
+   if (device == -1 || !devoptab_list[device]->diropen_r) {
+      errno = device == -1 ? ENODEV : ENOTSUP;
+      return nullptr;
+   }
+
+   DIR *dir = (DIR *)calloc(1, sizeof(DIR) + devoptab_list[device]->dirStateSize);
+   if (!dir) {
+      errno = ENOMEM;
+      return nullptr;
+   }
+
+   dir->iter.device = device;
+   dir->iter.dirStruct = dir + 1;
+
+   struct _reent *r = MockBeginCall(device);
+   if (!devoptab_list[device]->diropen_r(r, &dir->iter, path)) {
+      free(dir);
+      return MockEndCall(r, (DIR *)nullptr);
+   }
+
+   return dir;
+}
+
+struct dirent *
+__wut_host_readdir(DIR *dir)
+{
+   struct stat st;
+   int device = dir->iter.device;
+
+   struct _reent *r = MockBeginCall(device);
+   if (devoptab_list[device]->dirnext_r(r, &dir->iter, dir->entry.d_name, &st) == -1) {
+      // The end of the directory is not an error
+      if (r->_errno == ENOENT) {
+         r->_errno = 0;
+      }
+      return MockEndCall(r, (struct dirent *)nullptr);
+   }
+
+   dir->entry.d_ino = st.st_ino;
+   dir->entry.d_type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+   return &dir->entry;
+}
+
+int
+__wut_host_closedir(DIR *dir)
+{
+   int device = dir->iter.device;
+
+   struct _reent *r = MockBeginCall(device);
+   int rc = devoptab_list[device]->dirclose_r(r, &dir->iter);
+   free(dir);
+   return MockEndCall(r, rc);
+}
+
+} // extern "C"
@@ -0,0 +1,1038 @@
+#include "latency.h"
+
+#include <nsysnet/_netdb.h>
+#include <nsysnet/_socket.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+/*
+ * nsysnet sockets connected to each other in process. Addresses are ignored,
+ * every socket is on 127.0.0.1 and only the port matters. Like nsysnet, fds
+ * are below NSYSNET_FD_SETSIZE and a failed call returns -1 and leaves its
+ * error for socketlasterr.
+ */
+
+// nsysnet error numbers, see __wut_nsysnet_error_code_map
+#define MOCK_NET_EISCONN       3
+#define MOCK_NET_EOPNOTSUPP    4
+#define MOCK_NET_EWOULDBLOCK   6
+#define MOCK_NET_ECONNREFUSED  7
+#define MOCK_NET_ENOTCONN      9
+#define MOCK_NET_EINVAL        11
+#define MOCK_NET_EMSGSIZE      12
+#define MOCK_NET_EPIPE         13
+#define MOCK_NET_EADDRINUSE    20
+#define MOCK_NET_EAFNOSUPPORT  21
+#define MOCK_NET_ENOTSOCK      24
+#define MOCK_NET_EPROTOTYPE    32
+#define MOCK_NET_EBADFD        49
+#define MOCK_NET_EMFILE        51
+
+#define MOCK_NET_BUFFER_SIZE   0x10000
+#define MOCK_NET_MAX_DATAGRAMS 256
+#define MOCK_NET_MAX_DATAGRAM  0xFFFF
+#define MOCK_NET_FIRST_PORT    49152
+
+// One direction of a stream connection
+struct MockPipe
+{
+   std::deque<uint8_t> data;
+   uint32_t capacity = MOCK_NET_BUFFER_SIZE;
+   bool writerClosed = false;
+   bool readerClosed = false;
+};
+
+struct MockDatagram
+{
+   uint16_t port;
+   std::vector<uint8_t> data;
+};
+
+struct MockSocket
+{
+   int type;
+   bool nonblock = false;
+   uint16_t port = 0;
+   uint16_t peerPort = 0;
+   bool connected = false;
+   bool listening = false;
+   int backlog = 0;
+   std::deque<int> pending;
+   std::shared_ptr<MockPipe> rx;
+   std::shared_ptr<MockPipe> tx;
+   std::deque<MockDatagram> datagrams;
+   uint32_t rcvbuf = MOCK_NET_BUFFER_SIZE;
+};
+
+static MockBackend sBackend;
+
+static std::mutex sMutex;
+static std::condition_variable sChanged;
+static std::unique_ptr<MockSocket> sSockets[NSYSNET_FD_SETSIZE];
+static uint16_t sNextPort = MOCK_NET_FIRST_PORT;
+static thread_local int sLastError;
+
+static int
+MockFail(int error)
+{
+   sLastError = error;
+   return -1;
+}
+
+static MockSocket *
+MockGetSocket(int fd)
+{
+   if (fd < 0 || fd >= NSYSNET_FD_SETSIZE) {
+      return nullptr;
+   }
+
+   return sSockets[fd].get();
+}
+
+static int
+MockAllocSocket(int type)
+{
+   for (int fd = 0; fd < NSYSNET_FD_SETSIZE; ++fd) {
+      if (!sSockets[fd]) {
+         sSockets[fd].reset(new MockSocket());
+         sSockets[fd]->type = type;
+         return fd;
+      }
+   }
+
+   return -1;
+}
+
+static bool
+MockPortInUse(int type,
+              uint16_t port)
+{
+   for (auto &socket : sSockets) {
+      if (socket && socket->type == type && socket->port == port && (type == SOCK_DGRAM || socket->listening)) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+static uint16_t
+MockEphemeralPort()
+{
+   uint16_t port = sNextPort++;
+   if (!sNextPort) {
+      sNextPort = MOCK_NET_FIRST_PORT;
+   }
+   return port;
+}
+
+static void
+MockFillAddress(uint16_t port,
+                struct sockaddr *addr,
+                socklen_t *addrlen)
+{
+   if (!addr || !addrlen) {
+      return;
+   }
+
+   struct sockaddr_in in = {};
+   in.sin_family = AF_INET;
+   in.sin_port = htons(port);
+   in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+   memcpy(addr, &in, std::min<socklen_t>(*addrlen, sizeof(in)));
+   *addrlen = sizeof(in);
+}
+
+static bool
+MockAddressPort(const struct sockaddr *addr,
+                socklen_t addrlen,
+                uint16_t *outPort)
+{
+   if (!addr || addrlen < sizeof(struct sockaddr_in) || addr->sa_family != AF_INET) {
+      return false;
+   }
+
+   *outPort = ntohs(((const struct sockaddr_in *)addr)->sin_port);
+   return true;
+}
+
+static bool
+MockReadable(const MockSocket &socket)
+{
+   if (socket.listening) {
+      return !socket.pending.empty();
+   }
+   if (socket.type == SOCK_DGRAM) {
+      return !socket.datagrams.empty();
+   }
+   return socket.rx && (!socket.rx->data.empty() || socket.rx->writerClosed || socket.rx->readerClosed);
+}
+
+static bool
+MockWritable(const MockSocket &socket)
+{
+   if (socket.type == SOCK_DGRAM) {
+      return true;
+   }
+   return socket.tx && (socket.tx->data.size() < socket.tx->capacity || socket.tx->readerClosed);
+}
+
+// Closes the socket's ends of its connection, the caller notifies sChanged
+static void
+MockCloseSocket(int fd)
+{
+   MockSocket *socket = sSockets[fd].get();
+   if (socket->rx) {
+      socket->rx->readerClosed = true;
+      socket->rx->data.clear();
+   }
+   if (socket->tx) {
+      socket->tx->writerClosed = true;
+   }
+
+   // Connections that were never accepted are refused
+   for (int pending : socket->pending) {
+      MockCloseSocket(pending);
+   }
+   sSockets[fd].reset();
+}
+
+static int
+MockSendStream(std::unique_lock<std::mutex> &lock,
+               int fd,
+               const uint8_t *buf,
+               size_t len,
+               int flags)
+{
+   size_t sent = 0;
+
+   while (true) {
+      MockSocket *socket = MockGetSocket(fd);
+      if (!socket) {
+         return MockFail(MOCK_NET_EBADFD);
+      }
+      if (!socket->connected) {
+         return MockFail(MOCK_NET_ENOTCONN);
+      }
+
+      MockPipe &pipe = *socket->tx;
+      if (pipe.readerClosed || pipe.writerClosed) {
+         return sent ? (int)sent : MockFail(MOCK_NET_EPIPE);
+      }
+
+      size_t room = pipe.capacity > pipe.data.size() ? pipe.capacity - pipe.data.size() : 0;
+      size_t count = std::min(room, len - sent);
+      pipe.data.insert(pipe.data.end(), buf + sent, buf + sent + count);
+      sent += count;
+      if (count) {
+         sChanged.notify_all();
+      }
+
+      // Blocking sends only return once everything is queued
+      if (sent == len || (sent && (socket->nonblock || (flags & MSG_DONTWAIT)))) {
+         return (int)sent;
+      }
+      if (socket->nonblock || (flags & MSG_DONTWAIT)) {
+         return MockFail(MOCK_NET_EWOULDBLOCK);
+      }
+
+      sChanged.wait(lock);
+   }
+}
+
+static int
+MockRecvStream(std::unique_lock<std::mutex> &lock,
+               int fd,
+               uint8_t *buf,
+               size_t len,
+               int flags)
+{
+   while (true) {
+      MockSocket *socket = MockGetSocket(fd);
+      if (!socket) {
+         return MockFail(MOCK_NET_EBADFD);
+      }
+      if (!socket->connected) {
+         return MockFail(MOCK_NET_ENOTCONN);
+      }
+
+      MockPipe &pipe = *socket->rx;
+      if (!pipe.data.empty()) {
+         size_t count = std::min(len, pipe.data.size());
+         std::copy(pipe.data.begin(), pipe.data.begin() + count, buf);
+         if (!(flags & MSG_PEEK)) {
+            pipe.data.erase(pipe.data.begin(), pipe.data.begin() + count);
+            sChanged.notify_all();
+         }
+         return (int)count;
+      }
+
+      if (pipe.writerClosed || pipe.readerClosed) {
+         return 0;
+      }
+      if (socket->nonblock || (flags & MSG_DONTWAIT)) {
+         return MockFail(MOCK_NET_EWOULDBLOCK);
+      }
+
+      sChanged.wait(lock);
+   }
+}
+
+static int
+MockSendDatagram(int fd,
+                 const uint8_t *buf,
+                 size_t len,
+                 const struct sockaddr *addr,
+                 socklen_t addrlen)
+{
+   MockSocket *socket = MockGetSocket(fd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+   if (len > MOCK_NET_MAX_DATAGRAM) {
+      return MockFail(MOCK_NET_EMSGSIZE);
+   }
+
+   uint16_t port;
+   if (addr) {
+      if (!MockAddressPort(addr, addrlen, &port)) {
+         return MockFail(MOCK_NET_EAFNOSUPPORT);
+      }
+   } else if (socket->connected) {
+      port = socket->peerPort;
+   } else {
+      return MockFail(MOCK_NET_ENOTCONN);
+   }
+
+   if (!socket->port) {
+      socket->port = MockEphemeralPort();
+   }
+
+   // Datagrams nobody is bound to, or that do not fit, are dropped
+   for (auto &target : sSockets) {
+      if (target && target->type == SOCK_DGRAM && target->port == port) {
+         if (target->datagrams.size() < MOCK_NET_MAX_DATAGRAMS) {
+            target->datagrams.push_back({ socket->port, std::vector<uint8_t>(buf, buf + len) });
+            sChanged.notify_all();
+         }
+         break;
+      }
+   }
+
+   return (int)len;
+}
+
+static int
+MockRecvDatagram(std::unique_lock<std::mutex> &lock,
+                 int fd,
+                 uint8_t *buf,
+                 size_t len,
+                 int flags,
+                 struct sockaddr *addr,
+                 socklen_t *addrlen)
+{
+   while (true) {
+      MockSocket *socket = MockGetSocket(fd);
+      if (!socket) {
+         return MockFail(MOCK_NET_EBADFD);
+      }
+
+      if (!socket->datagrams.empty()) {
+         MockDatagram &datagram = socket->datagrams.front();
+         size_t count = std::min(len, datagram.data.size());
+         memcpy(buf, datagram.data.data(), count);
+         MockFillAddress(datagram.port, addr, addrlen);
+         if (!(flags & MSG_PEEK)) {
+            socket->datagrams.pop_front();
+         }
+         return (int)count;
+      }
+
+      if (socket->nonblock || (flags & MSG_DONTWAIT)) {
+         return MockFail(MOCK_NET_EWOULDBLOCK);
+      }
+
+      sChanged.wait(lock);
+   }
+}
+
+extern "C" {
+
+void
+MockNetSetLatency(const MockLatency *latency)
+{
+   sBackend.setLatency(latency);
+}
+
+void
+MockNetGetCounters(MockCounters *outCounters)
+{
+   sBackend.getCounters(outCounters);
+}
+
+void
+MockNetResetCounters(void)
+{
+   sBackend.resetCounters();
+}
+
+void
+socket_lib_init()
+{
+}
+
+void
+socket_lib_finish()
+{
+   std::lock_guard<std::mutex> lock(sMutex);
+   for (int fd = 0; fd < NSYSNET_FD_SETSIZE; ++fd) {
+      if (sSockets[fd]) {
+         MockCloseSocket(fd);
+      }
+   }
+   sChanged.notify_all();
+}
+
+int
+RPLWRAP(socketlasterr)()
+{
+   return sLastError;
+}
+
+int
+RPLWRAP(socket)(int domain,
+                int type,
+                int protocol)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   if (domain != AF_INET) {
+      return MockFail(MOCK_NET_EAFNOSUPPORT);
+   }
+   if (type != SOCK_STREAM && type != SOCK_DGRAM) {
+      return MockFail(MOCK_NET_EPROTOTYPE);
+   }
+
+   int fd = MockAllocSocket(type);
+   return fd == -1 ? MockFail(MOCK_NET_EMFILE) : fd;
+}
+
+int
+RPLWRAP(socketclose)(int sockfd)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   if (!MockGetSocket(sockfd)) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+
+   MockCloseSocket(sockfd);
+   sChanged.notify_all();
+   return 0;
+}
+
+int
+RPLWRAP(bind)(int sockfd,
+              const struct sockaddr *addr,
+              socklen_t addrlen)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+
+   uint16_t port;
+   if (!MockAddressPort(addr, addrlen, &port)) {
+      return MockFail(MOCK_NET_EAFNOSUPPORT);
+   }
+   if (socket->port) {
+      return MockFail(MOCK_NET_EINVAL);
+   }
+   if (port && MockPortInUse(socket->type, port)) {
+      return MockFail(MOCK_NET_EADDRINUSE);
+   }
+
+   socket->port = port ? port : MockEphemeralPort();
+   return 0;
+}
+
+int
+RPLWRAP(listen)(int sockfd,
+                int backlog)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+   if (socket->type != SOCK_STREAM) {
+      return MockFail(MOCK_NET_EOPNOTSUPP);
+   }
+   if (socket->connected) {
+      return MockFail(MOCK_NET_EISCONN);
+   }
+
+   if (!socket->port) {
+      socket->port = MockEphemeralPort();
+   }
+   socket->listening = true;
+   socket->backlog = backlog > 0 ? backlog : 1;
+   return 0;
+}
+
+int
+RPLWRAP(connect)(int sockfd,
+                 const struct sockaddr *addr,
+                 socklen_t addrlen)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+
+   uint16_t port;
+   if (!MockAddressPort(addr, addrlen, &port)) {
+      return MockFail(MOCK_NET_EAFNOSUPPORT);
+   }
+
+   if (socket->type == SOCK_DGRAM) {
+      socket->connected = true;
+      socket->peerPort = port;
+      return 0;
+   }
+
+   if (socket->connected || socket->listening) {
+      return MockFail(MOCK_NET_EISCONN);
+   }
+
+   MockSocket *listener = nullptr;
+   for (auto &target : sSockets) {
+      if (target && target->listening && target->port == port) {
+         listener = target.get();
+      }
+   }
+   if (!listener || (int)listener->pending.size() >= listener->backlog) {
+      return MockFail(MOCK_NET_ECONNREFUSED);
+   }
+
+   int peerfd = MockAllocSocket(SOCK_STREAM);
+   if (peerfd == -1) {
+      return MockFail(MOCK_NET_EMFILE);
+   }
+
+   // Connections complete at once, even on non-blocking sockets
+   MockSocket *peer = sSockets[peerfd].get();
+   socket->port = socket->port ? socket->port : MockEphemeralPort();
+   socket->peerPort = port;
+   socket->rx = std::make_shared<MockPipe>();
+   socket->tx = std::make_shared<MockPipe>();
+   socket->rx->capacity = socket->rcvbuf;
+   socket->connected = true;
+
+   peer->port = port;
+   peer->peerPort = socket->port;
+   peer->rx = socket->tx;
+   peer->tx = socket->rx;
+   peer->connected = true;
+
+   listener->pending.push_back(peerfd);
+   sChanged.notify_all();
+   return 0;
+}
+
+int
+RPLWRAP(accept)(int sockfd,
+                struct sockaddr *addr,
+                socklen_t *addrlen)
+{
+   sBackend.charge(0);
+   std::unique_lock<std::mutex> lock(sMutex);
+   while (true) {
+      MockSocket *socket = MockGetSocket(sockfd);
+      if (!socket) {
+         return MockFail(MOCK_NET_EBADFD);
+      }
+      if (!socket->listening) {
+         return MockFail(MOCK_NET_EINVAL);
+      }
+
+      if (!socket->pending.empty()) {
+         int fd = socket->pending.front();
+         socket->pending.pop_front();
+         MockFillAddress(sSockets[fd]->peerPort, addr, addrlen);
+         return fd;
+      }
+
+      if (socket->nonblock) {
+         return MockFail(MOCK_NET_EWOULDBLOCK);
+      }
+
+      sChanged.wait(lock);
+   }
+}
+
+int
+RPLWRAP(shutdown)(int sockfd,
+                  int how)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+   if (!socket->connected || socket->type != SOCK_STREAM) {
+      return MockFail(MOCK_NET_ENOTCONN);
+   }
+
+   if (how == SHUT_RD || how == SHUT_RDWR) {
+      socket->rx->readerClosed = true;
+      socket->rx->data.clear();
+   }
+   if (how == SHUT_WR || how == SHUT_RDWR) {
+      socket->tx->writerClosed = true;
+   }
+   sChanged.notify_all();
+   return 0;
+}
+
+int
+RPLWRAP(send)(int sockfd,
+              const void *buf,
+              size_t len,
+              int flags)
+{
+   return RPLWRAP(sendto)(sockfd, buf, len, flags, nullptr, 0);
+}
+
+int
+RPLWRAP(sendto)(int sockfd,
+                const void *buf,
+                size_t len,
+                int flags,
+                const struct sockaddr *dest_addr,
+                socklen_t addrlen)
+{
+   int rc;
+
+   {
+      std::unique_lock<std::mutex> lock(sMutex);
+      MockSocket *socket = MockGetSocket(sockfd);
+      if (!socket) {
+         rc = MockFail(MOCK_NET_EBADFD);
+      } else if (socket->type == SOCK_STREAM) {
+         rc = MockSendStream(lock, sockfd, (const uint8_t *)buf, len, flags);
+      } else {
+         rc = MockSendDatagram(sockfd, (const uint8_t *)buf, len, dest_addr, addrlen);
+      }
+   }
+
+   sBackend.charge(rc > 0 ? rc : 0);
+   return rc;
+}
+
+int
+RPLWRAP(recv)(int sockfd,
+              void *buf,
+              size_t len,
+              int flags)
+{
+   return RPLWRAP(recvfrom)(sockfd, buf, len, flags, nullptr, nullptr);
+}
+
+int
+RPLWRAP(recvfrom)(int sockfd,
+                  void *buf,
+                  size_t len,
+                  int flags,
+                  struct sockaddr *src_addr,
+                  socklen_t *addrlen)
+{
+   int rc;
+
+   {
+      std::unique_lock<std::mutex> lock(sMutex);
+      MockSocket *socket = MockGetSocket(sockfd);
+      if (!socket) {
+         rc = MockFail(MOCK_NET_EBADFD);
+      } else if (socket->type == SOCK_STREAM) {
+         rc = MockRecvStream(lock, sockfd, (uint8_t *)buf, len, flags);
+         if (rc >= 0) {
+            MockFillAddress(socket->peerPort, src_addr, addrlen);
+         }
+      } else {
+         rc = MockRecvDatagram(lock, sockfd, (uint8_t *)buf, len, flags, src_addr, addrlen);
+      }
+   }
+
+   sBackend.charge(rc > 0 ? rc : 0);
+   return rc;
+}
+
+int
+RPLWRAP(select)(int nfds,
+                nsysnet_fd_set *readfds,
+                nsysnet_fd_set *writefds,
+                nsysnet_fd_set *exceptfds,
+                struct nsysnet_timeval *timeout)
+{
+   sBackend.charge(0);
+   std::unique_lock<std::mutex> lock(sMutex);
+
+   auto deadline = std::chrono::steady_clock::now();
+   if (timeout) {
+      deadline += std::chrono::seconds(timeout->tv_sec) + std::chrono::microseconds(timeout->tv_usec);
+   }
+
+   if (nfds < 0 || nfds > NSYSNET_FD_SETSIZE) {
+      return MockFail(MOCK_NET_EINVAL);
+   }
+
+   while (true) {
+      nsysnet_fd_set rd, wr;
+      int ready = 0;
+      NSYSNET_FD_ZERO(&rd);
+      NSYSNET_FD_ZERO(&wr);
+
+      for (int fd = 0; fd < nfds; ++fd) {
+         bool read = readfds && NSYSNET_FD_ISSET(fd, readfds);
+         bool write = writefds && NSYSNET_FD_ISSET(fd, writefds);
+         bool except = exceptfds && NSYSNET_FD_ISSET(fd, exceptfds);
+         if (!read && !write && !except) {
+            continue;
+         }
+
+         MockSocket *socket = MockGetSocket(fd);
+         if (!socket) {
+            return MockFail(MOCK_NET_EBADFD);
+         }
+
+         if (read && MockReadable(*socket)) {
+            NSYSNET_FD_SET(fd, &rd);
+            ++ready;
+         }
+         if (write && MockWritable(*socket)) {
+            NSYSNET_FD_SET(fd, &wr);
+            ++ready;
+         }
+      }
+
+      if (ready || (timeout && std::chrono::steady_clock::now() >= deadline)) {
+         if (readfds) {
+            *readfds = rd;
+         }
+         if (writefds) {
+            *writefds = wr;
+         }
+         if (exceptfds) {
+            NSYSNET_FD_ZERO(exceptfds);
+         }
+         return ready;
+      }
+
+      if (timeout) {
+         sChanged.wait_until(lock, deadline);
+      } else {
+         sChanged.wait(lock);
+      }
+   }
+}
+
+int
+RPLWRAP(getsockopt)(int sockfd,
+                    int level,
+                    int optname,
+                    void *optval,
+                    socklen_t *optlen)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+   if (!optval || !optlen || *optlen < sizeof(int)) {
+      return MockFail(MOCK_NET_EINVAL);
+   }
+
+   int value = 0;
+   if (level == SOL_SOCKET) {
+      switch (optname) {
+      case SO_NONBLOCK:
+         value = socket->nonblock;
+         break;
+      case SO_TYPE:
+         value = socket->type;
+         break;
+      case SO_RCVBUF:
+         value = socket->rx ? socket->rx->capacity : socket->rcvbuf;
+         break;
+      case SO_SNDBUF:
+         value = socket->tx ? socket->tx->capacity : MOCK_NET_BUFFER_SIZE;
+         break;
+      case SO_RXDATA:
+         if (socket->type == SOCK_DGRAM) {
+            value = socket->datagrams.empty() ? 0 : (int)socket->datagrams.front().data.size();
+         } else {
+            value = socket->rx ? (int)socket->rx->data.size() : 0;
+         }
+         break;
+      case SO_TXDATA:
+         value = socket->tx ? (int)socket->tx->data.size() : 0;
+         break;
+      }
+   }
+
+   memcpy(optval, &value, sizeof(value));
+   *optlen = sizeof(value);
+   return 0;
+}
+
+int
+RPLWRAP(setsockopt)(int sockfd,
+                    int level,
+                    int optname,
+                    const void *optval,
+                    socklen_t optlen)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+
+   // Options without an effect here are accepted and ignored
+   int value = 0;
+   if (optval && optlen >= sizeof(int)) {
+      memcpy(&value, optval, sizeof(value));
+   }
+
+   if (level == SOL_SOCKET) {
+      switch (optname) {
+      case SO_NONBLOCK:
+         socket->nonblock = value != 0;
+         break;
+      case SO_NBIO:
+         socket->nonblock = true;
+         break;
+      case SO_BIO:
+         socket->nonblock = false;
+         break;
+      case SO_RCVBUF:
+         if (value > 0) {
+            socket->rcvbuf = value;
+            if (socket->rx) {
+               socket->rx->capacity = value;
+            }
+         }
+         break;
+      case SO_SNDBUF:
+         if (value > 0 && socket->tx) {
+            socket->tx->capacity = std::max<uint32_t>(socket->tx->capacity, value);
+         }
+         break;
+      }
+   }
+
+   return 0;
+}
+
+int
+RPLWRAP(getsockname)(int sockfd,
+                     struct sockaddr *addr,
+                     socklen_t *addrlen)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+
+   MockFillAddress(socket->port, addr, addrlen);
+   return 0;
+}
+
+int
+RPLWRAP(getpeername)(int sockfd,
+                     struct sockaddr *addr,
+                     socklen_t *addrlen)
+{
+   sBackend.charge(0);
+   std::lock_guard<std::mutex> lock(sMutex);
+   MockSocket *socket = MockGetSocket(sockfd);
+   if (!socket) {
+      return MockFail(MOCK_NET_EBADFD);
+   }
+   if (!socket->connected) {
+      return MockFail(MOCK_NET_ENOTCONN);
+   }
+
+   MockFillAddress(socket->peerPort, addr, addrlen);
+   return 0;
+}
+
+int
+RPLWRAP(inet_pton)(int af,
+                   const char *src,
+                   void *dst)
+{
+   unsigned int a, b, c, d;
+   char end;
+
+   if (af != AF_INET) {
+      return MockFail(MOCK_NET_EAFNOSUPPORT);
+   }
+   if (sscanf(src, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+      return 0;
+   }
+
+   in_addr_t addr = htonl((a << 24) | (b << 16) | (c << 8) | d);
+   memcpy(dst, &addr, sizeof(addr));
+   return 1;
+}
+
+const char *
+RPLWRAP(inet_ntop)(int af,
+                   const void *src,
+                   char *dst,
+                   socklen_t size)
+{
+   in_addr_t addr;
+
+   if (af != AF_INET) {
+      MockFail(MOCK_NET_EAFNOSUPPORT);
+      return nullptr;
+   }
+
+   memcpy(&addr, src, sizeof(addr));
+   addr = ntohl(addr);
+   if (snprintf(dst, size, "%u.%u.%u.%u", addr >> 24, (addr >> 16) & 0xFF, (addr >> 8) & 0xFF, addr & 0xFF) >= (int)size) {
+      MockFail(MOCK_NET_EINVAL);
+      return nullptr;
+   }
+   return dst;
+}
+
+// There is no resolver, only numeric hosts have an address
+
+int
+RPLWRAP(getaddrinfo)(const char *node,
+                     const char *service,
+                     const struct addrinfo *hints,
+                     struct addrinfo **res)
+{
+   sBackend.charge(0);
+
+   in_addr_t addr = htonl(INADDR_LOOPBACK);
+   if (node && RPLWRAP(inet_pton)(AF_INET, node, &addr) != 1) {
+      return EAI_NONAME;
+   }
+
+   struct addrinfo *info = (struct addrinfo *)calloc(1, sizeof(struct addrinfo) + sizeof(struct sockaddr_in));
+   if (!info) {
+      return EAI_MEMORY;
+   }
+
+   struct sockaddr_in *in = (struct sockaddr_in *)(info + 1);
+   in->sin_family = AF_INET;
+   in->sin_port = htons(service ? (uint16_t)atoi(service) : 0);
+   in->sin_addr.s_addr = addr;
+
+   info->ai_family = AF_INET;
+   info->ai_socktype = hints && hints->ai_socktype ? hints->ai_socktype : SOCK_STREAM;
+   info->ai_protocol = hints ? hints->ai_protocol : 0;
+   info->ai_addrlen = sizeof(struct sockaddr_in);
+   info->ai_addr = (struct sockaddr *)in;
+   *res = info;
+   return 0;
+}
+
+void
+RPLWRAP(freeaddrinfo)(struct addrinfo *res)
+{
+   while (res) {
+      struct addrinfo *next = res->ai_next;
+      free(res);
+      res = next;
+   }
+}
+
+int
+RPLWRAP(getnameinfo)(const struct sockaddr *addr,
+                     socklen_t addrlen,
+                     char *host,
+                     socklen_t hostlen,
+                     char *serv,
+                     socklen_t servlen,
+                     int flags)
+{
+   uint16_t port;
+   if (!MockAddressPort(addr, addrlen, &port)) {
+      return EAI_FAMILY;
+   }
+
+   if (host && hostlen && !RPLWRAP(inet_ntop)(AF_INET, &((const struct sockaddr_in *)addr)->sin_addr, host, hostlen)) {
+      return EAI_OVERFLOW;
+   }
+   if (serv && servlen && snprintf(serv, servlen, "%u", port) >= (int)servlen) {
+      return EAI_OVERFLOW;
+   }
+   return 0;
+}
+
+struct hostent *
+RPLWRAP(gethostbyname)(const char *name)
+{
+   return nullptr;
+}
+
+struct hostent *
+RPLWRAP(gethostbyaddr)(const void *addr,
+                       size_t len,
+                       int type)
+{
+   return nullptr;
+}
+
+int *
+RPLWRAP(get_h_errno)(void)
+{
+   static thread_local int error = HOST_NOT_FOUND;
+   return &error;
+}
+
+const char *
+RPLWRAP(gai_strerror)(int ecode)
+{
+   return ecode == EAI_NONAME ? "Name does not resolve" : "Unknown error";
+}
+
+void
+RPLWRAP(clear_resolver_cache)(void)
+{
+}
+
+int
+RPLWRAP(set_resolver_allocator)(void *(*alloc)(uint32_t),
+                                void (*free)(void *))
+{
+   return 0;
+}
+
+} // extern "C"
@@ -0,0 +1,160 @@
+#include <coreinit/memdefaultheap.h>
+#include <coreinit/memexpheap.h>
+#include <nn/ac/ac_c.h>
+#include <nsysnet/nssl.h>
+#include <wut_rplwrap.h>
+#include <whb/log.h>
+
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * The rest of what the libraries link against. The network is always up and
+ * there is no TLS, NSSL calls fail like on a console without certificates.
+ */
+
+static void *
+MockAllocFromDefaultHeap(uint32_t size)
+{
+   return malloc(size);
+}
+
+static void *
+MockAllocFromDefaultHeapEx(uint32_t size,
+                           int32_t alignment)
+{
+   size_t align = alignment < 0 ? -alignment : alignment;
+   if (align < sizeof(void *)) {
+      align = sizeof(void *);
+   }
+   return aligned_alloc(align, (size + align - 1) & ~(align - 1));
+}
+
+static void
+MockFreeToDefaultHeap(void *ptr)
+{
+   free(ptr);
+}
+
+extern "C" {
+
+MEMAllocFromDefaultHeapFn MEMAllocFromDefaultHeap = MockAllocFromDefaultHeap;
+MEMAllocFromDefaultHeapExFn MEMAllocFromDefaultHeapEx = MockAllocFromDefaultHeapEx;
+MEMFreeToDefaultHeapFn MEMFreeToDefaultHeap = MockFreeToDefaultHeap;
+
+// Only for the heap budgets, which never get a heap of their own here
+MEMHeapHandle
+MEMCreateExpHeapEx(void *heap,
+                   uint32_t size,
+                   uint16_t flags)
+{
+   return NULL;
+}
+
+void *
+MEMDestroyExpHeap(MEMHeapHandle heap)
+{
+   return NULL;
+}
+
+void *
+MEMAllocFromExpHeapEx(MEMHeapHandle heap,
+                      uint32_t size,
+                      int alignment)
+{
+   return MockAllocFromDefaultHeapEx(size, alignment);
+}
+
+void
+MEMFreeToExpHeap(MEMHeapHandle heap,
+                 void *block)
+{
+   free(block);
+}
+
+uint32_t
+MEMGetSizeForMBlockExpHeap(void *block)
+{
+   return malloc_usable_size(block);
+}
+
+BOOL
+WHBLogPrintf(const char *fmt, ...)
+{
+   va_list args;
+   va_start(args, fmt);
+   vprintf(fmt, args);
+   va_end(args);
+   putchar('\n');
+   return TRUE;
+}
+
+NNResult
+ACInitialize()
+{
+   return NNResult { 0 };
+}
+
+void
+ACFinalize()
+{
+}
+
+NNResult
+ACConnectAsync()
+{
+   return NNResult { 0 };
+}
+
+NNResult
+ACClose()
+{
+   return NNResult { 0 };
+}
+
+NNResult
+ACGetAssignedAddress(uint32_t *ip)
+{
+   *ip = 0x7F000001;
+   return NNResult { 0 };
+}
+
+NSSLConnectionHandle
+RPLWRAP(NSSLCreateConnection)(NSSLContextHandle context,
+                              const char *host,
+                              int32_t hostLength,
+                              int32_t options,
+                              int32_t socket,
+                              int32_t block)
+{
+   return NSSL_ERROR_INVALID_NSSL_CONTEXT;
+}
+
+NSSLError
+NSSLDestroyConnection(NSSLConnectionHandle connection)
+{
+   return NSSL_ERROR_INVALID_NSSL_CONNECTION;
+}
+
+NSSLSessionHandle
+NSSLGetSession(NSSLConnectionHandle connection)
+{
+   return NSSL_ERROR_INVALID_NSSL_CONNECTION;
+}
+
+NSSLError
+NSSLSetSession(NSSLConnectionHandle connection,
+               NSSLSessionHandle session)
+{
+   return NSSL_ERROR_INVALID_NSSL_CONNECTION;
+}
+
+NSSLError
+NSSLFreeSession(NSSLSessionHandle session)
+{
+   return NSSL_ERROR_INVALID_NSSL_CONNECTION;
+}
+
+} // extern "C"
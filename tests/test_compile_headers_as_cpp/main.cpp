@@ -1,5 +1,36 @@
 #include "test_compile_headers_list.h"
 
+// The compile-time register builders must pack fields where GX2 does
+static_assert(wut::gx2::blend_control(GX2_RENDER_TARGET_0,
+                                      GX2_BLEND_MODE_SRC_ALPHA, GX2_BLEND_MODE_INV_SRC_ALPHA,
+                                      GX2_BLEND_COMBINE_MODE_ADD,
+                                      TRUE,
+                                      GX2_BLEND_MODE_ONE, GX2_BLEND_MODE_ZERO,
+                                      GX2_BLEND_COMBINE_MODE_ADD).cb_blend_control == 0x20010504,
+              "cb_blend_control");
+static_assert(wut::gx2::color_control(GX2_LOGIC_OP_COPY, 0x01, FALSE, TRUE).cb_color_control == 0x00CC0100,
+              "cb_color_control");
+static_assert(wut::gx2::color_control(GX2_LOGIC_OP_COPY, 0x00, FALSE, FALSE).cb_color_control == 0x00CC0010,
+              "cb_color_control SPECIAL_OP");
+static_assert(wut::gx2::depth_stencil_control(TRUE, TRUE, GX2_COMPARE_FUNC_LEQUAL,
+                                              FALSE, FALSE,
+                                              GX2_COMPARE_FUNC_ALWAYS, GX2_STENCIL_FUNCTION_KEEP,
+                                              GX2_STENCIL_FUNCTION_KEEP, GX2_STENCIL_FUNCTION_KEEP,
+                                              GX2_COMPARE_FUNC_ALWAYS, GX2_STENCIL_FUNCTION_KEEP,
+                                              GX2_STENCIL_FUNCTION_KEEP, GX2_STENCIL_FUNCTION_KEEP).db_depth_control == 0x00700736,
+              "db_depth_control");
+static_assert(wut::gx2::stencil_mask(0xFF, 0x0F, 0x01, 0xF0, 0x0E, 0x02).db_stencilrefmask == 0x000FFF01,
+              "db_stencilrefmask");
+static_assert(wut::gx2::target_channel_masks(GX2_CHANNEL_MASK_RGBA, GX2_CHANNEL_MASK_RGBA,
+                                             GX2_CHANNEL_MASK_RGBA, GX2_CHANNEL_MASK_RGBA,
+                                             GX2_CHANNEL_MASK_RGBA, GX2_CHANNEL_MASK_RGBA,
+                                             GX2_CHANNEL_MASK_RGBA, GX2_CHANNEL_MASK_RGBA).cb_target_mask == 0xFFFFFFFF,
+              "cb_target_mask");
+static_assert(wut::gx2::alpha_test(TRUE, GX2_COMPARE_FUNC_LESS, 1.0f).sx_alpha_ref == 0x3F800000,
+              "sx_alpha_ref");
+static_assert(wut::gx2::aa_mask(0x11, 0x22, 0x33, 0x44).pa_sc_aa_mask == 0x44332211,
+              "pa_sc_aa_mask");
+
 int main(int argc, char **argv)
 {
    (void)argc, (void)argv;
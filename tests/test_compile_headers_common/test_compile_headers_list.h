@@ -30,6 +30,7 @@
 #include <coreinit/interrupts.h>
 #include <coreinit/ios.h>
 #include <coreinit/kernel.h>
+#include <coreinit/lockedcache.h>
 #include <coreinit/mcp.h>
 #include <coreinit/memblockheap.h>
 #include <coreinit/memdefaultheap.h>
@@ -85,6 +86,7 @@
 #include <gx2r/surface.h>
 #include <h264/stream.h>
 #include <h264/decode.h>
+#include <lzma920/lzmadec.h>
 #include <mic/mic.h>
 #include <nn/ac/ac_c.h>
 #include <nn/ac/ac_cpp.h>
@@ -149,5 +151,53 @@
 #include <vpad/input.h>
 #include <vpadbase/base.h>
 #include <wut.h>
+#include <wut_applet_memory.h>
+#include <wut_connect.h>
+#include <wut_cull.h>
+#include <wut_devoptab.h>
+#include <wut_dma.h>
+#include <wut_dns.h>
+#include <wut_doorbell.h>
+#include <wut_download.h>
+#include <wut_event_loop.h>
+#include <wut_execution.h>
+#include <wut_fiber.h>
+#include <wut_gx2_registers.h>
+#include <wut_heap.h>
+#include <wut_heap_budget.h>
+#include <wut_hid.h>
+#include <wut_input.h>
+#include <wut_ios.h>
+#include <wut_jit.h>
+#include <wut_job.h>
+#include <wut_lock_stats.h>
+#include <wut_lockfree.h>
+#include <wut_malloc.h>
+#include <wut_memory.h>
+#include <wut_mic.h>
+#include <wut_module.h>
+#include <wut_nssl_pool.h>
+#include <wut_pack.h>
+#include <wut_pmr.h>
+#include <wut_poll.h>
+#include <wut_profile.h>
+#include <wut_psmath.h>
+#include <wut_rwlock.h>
+#include <wut_scratchpad.h>
+#include <wut_socket_init.h>
+#include <wut_socket_stats.h>
+#include <wut_socket_stdio.h>
+#include <wut_startup.h>
 #include <wut_structsize.h>
+#include <wut_task.h>
+#include <wut_tcp_stream.h>
+#include <wut_thread.h>
+#include <wut_thread_stats.h>
+#include <wut_tiling.h>
+#include <wut_time.h>
+#include <wut_timer_wheel.h>
+#include <wut_tmpfs.h>
+#include <wut_trace.h>
 #include <wut_types.h>
+#include <wut_usb_bulk.h>
+#include <wut_virtual_arena.h>